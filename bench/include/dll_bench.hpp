@@ -0,0 +1,371 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Minimal framework of the benchmark suite: warmup, repetitions,
+ * statistics and machine-readable reports
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dll_bench {
+
+/*!
+ * \brief The result of one benchmark
+ */
+struct bench_result {
+    std::string name;    ///< The name of the benchmark
+    std::string params;  ///< The parameters of the benchmark (shape, batch size, ...)
+    size_t repetitions;  ///< The number of measured repetitions
+    size_t iterations;   ///< The number of calls in one repetition
+    double mean;         ///< The mean time of one call (ns)
+    double median;       ///< The median time of one call (ns)
+    double stddev;       ///< The standard deviation of the time of one call (ns)
+    double min;          ///< The fastest call (ns)
+    double max;          ///< The slowest call (ns)
+    double throughput;   ///< The number of items processed per second (from the median)
+};
+
+/*!
+ * \brief Prevent the compiler from optimizing away a value
+ */
+template <typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/*!
+ * \brief A suite of benchmarks, with its configuration and its results
+ */
+struct bench_suite {
+    using clock = std::chrono::steady_clock;
+
+    size_t warmup      = 2;    ///< The number of unmeasured repetitions
+    size_t repetitions = 10;   ///< The number of measured repetitions
+    double min_time    = 0.01; ///< The minimum duration of a repetition (s)
+    double threshold   = 5.0;  ///< The relative slowdown (%) above which a significant change is a regression
+    size_t threads     = 0;    ///< The number of threads of ETL and of the networks, reported with the results
+
+    std::string filter;        ///< Only the benchmarks containing one of these comma-separated strings are run
+    std::string json_file;     ///< The JSON report, if any
+    std::string csv_file;      ///< The CSV report, if any
+    std::string machine;       ///< The identifier of the machine
+    std::string config;        ///< The name of the configuration of the build
+    std::string baseline_file; ///< The report to compare against, if any
+    std::string baseline_dir;  ///< The folder of the baselines of the machines, if any
+
+    bool list               = false; ///< Only list the benchmarks
+    bool update_baseline    = false; ///< Replace the baseline with the results of this run
+    bool fail_on_regression = false; ///< Exit with an error if a regression is found
+
+    bool scaling          = false; ///< Run the scaling harness instead of the benchmarks
+    bool weak             = false; ///< Only run the benchmarks whose work can grow, for weak scaling
+    size_t work           = 1;     ///< The multiplier of the work of the benchmarks, for weak scaling
+    double min_efficiency = 0.5;   ///< The parallel efficiency under which more threads are not recommended
+
+    std::vector<std::string> tabulate;  ///< Only tabulate these reports together
+    std::vector<size_t> thread_counts;  ///< The numbers of threads of the scaling runs (by default, the powers of two)
+
+    std::vector<bench_result> results; ///< The results of the benchmarks
+
+    /*!
+     * \brief Parse the command line options of the suite
+     * \return false if the options are invalid
+     */
+    bool parse(int argc, char** argv) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg(argv[i]);
+
+            auto value = [&arg](const char* option) -> const char* {
+                const size_t n = std::strlen(option);
+                return arg.compare(0, n, option) ? nullptr : arg.c_str() + n;
+            };
+
+            if (auto v = value("--json=")) {
+                json_file = v;
+            } else if (auto v = value("--csv=")) {
+                csv_file = v;
+            } else if (auto v = value("--filter=")) {
+                filter = v;
+            } else if (auto v = value("--repetitions=")) {
+                repetitions = std::max(size_t(1), size_t(std::stoul(v)));
+            } else if (auto v = value("--warmup=")) {
+                warmup = std::stoul(v);
+            } else if (auto v = value("--min-time=")) {
+                min_time = std::stod(v);
+            } else if (auto v = value("--config=")) {
+                config = v;
+            } else if (auto v = value("--baseline=")) {
+                baseline_file = v;
+            } else if (auto v = value("--baseline-dir=")) {
+                baseline_dir = v;
+            } else if (auto v = value("--threshold=")) {
+                threshold = std::stod(v);
+            } else if (auto v = value("--tabulate=")) {
+                tabulate = split(v);
+            } else if (auto v = value("--scaling=")) {
+                scaling = true;
+
+                for (auto& count : split(v)) {
+                    thread_counts.push_back(std::max(size_t(1), size_t(std::stoul(count))));
+                }
+            } else if (auto v = value("--work=")) {
+                weak = true;
+                work = std::max(size_t(1), size_t(std::stoul(v)));
+            } else if (auto v = value("--min-efficiency=")) {
+                min_efficiency = std::stod(v);
+            } else if (arg == "--scaling") {
+                scaling = true;
+            } else if (arg == "--weak") {
+                weak = true;
+            } else if (arg == "--update-baseline") {
+                update_baseline = true;
+            } else if (arg == "--fail-on-regression") {
+                fail_on_regression = true;
+            } else if (arg == "--list") {
+                list = true;
+            } else {
+                std::cerr << "ERROR: Unknown option " << arg << std::endl;
+                std::cerr << "Usage: dll_bench [--filter=str] [--repetitions=n] [--warmup=n] [--min-time=s] [--json=file] [--csv=file] [--list]" << std::endl;
+                std::cerr << "                 [--config=name] [--baseline=file] [--baseline-dir=dir] [--update-baseline] [--threshold=%] [--fail-on-regression]" << std::endl;
+                std::cerr << "       dll_bench --scaling[=n,n,...] [--weak] [--min-efficiency=e] [--filter=str,...] [--csv=file]" << std::endl;
+                std::cerr << "       dll_bench --tabulate=file,file,..." << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Run a benchmark.
+     *
+     * The number of calls of a repetition is first calibrated so that a
+     * repetition lasts at least min_time, then the warmup repetitions are
+     * run before the measured ones.
+     *
+     * \param name The name of the benchmark
+     * \param params The parameters of the benchmark
+     * \param items The number of items processed by one call
+     * \param functor The code to measure
+     */
+    template <typename Functor>
+    void run(const std::string& name, const std::string& params, size_t items, Functor&& functor) {
+        const std::string full_name = name + "/" + params;
+
+        if (!selected(full_name)) {
+            return;
+        }
+
+        if (list) {
+            std::cout << full_name << std::endl;
+            return;
+        }
+
+        // Calibrate the number of calls per repetition
+
+        size_t iterations = 1;
+        double seconds    = measure(functor, iterations) * 1e-9;
+
+        while (seconds < min_time) {
+            iterations = std::max(iterations + 1, size_t(iterations * std::min(10.0, 1.2 * min_time / std::max(seconds, 1e-9))));
+            seconds    = measure(functor, iterations) * 1e-9 * iterations;
+        }
+
+        for (size_t w = 0; w < warmup; ++w) {
+            measure(functor, iterations);
+        }
+
+        std::vector<double> times(repetitions);
+
+        for (auto& t : times) {
+            t = measure(functor, iterations);
+        }
+
+        results.push_back(statistics(name, params, iterations, items, std::move(times)));
+
+        report(results.back());
+    }
+
+    /*!
+     * \brief Indicates if the benchmark of the given full name is selected
+     * by the filter
+     */
+    bool selected(const std::string& full_name) const {
+        if (filter.empty()) {
+            return true;
+        }
+
+        for (auto& part : split(filter)) {
+            if (full_name.find(part) != std::string::npos) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Split a comma-separated list
+     */
+    static std::vector<std::string> split(const std::string& list) {
+        std::vector<std::string> parts;
+
+        for (size_t start = 0, end; start <= list.size(); start = end + 1) {
+            end = std::min(list.find(',', start), list.size());
+
+            if (end > start) {
+                parts.push_back(list.substr(start, end - start));
+            }
+        }
+
+        return parts;
+    }
+
+    /*!
+     * \brief Write the machine-readable reports that were asked for
+     * \return false if a report cannot be written
+     */
+    bool write_reports() const {
+        return (json_file.empty() || write_json(json_file)) && (csv_file.empty() || write_csv(csv_file));
+    }
+
+    /*!
+     * \brief Write the results as JSON
+     */
+    bool write_json(const std::string& file) const {
+        std::ofstream os(file);
+
+        if (!os) {
+            std::cerr << "ERROR: Impossible to open " << file << std::endl;
+            return false;
+        }
+
+        os.precision(10);
+
+        os << "{\n  \"machine\": \"" << machine << "\",\n  \"config\": \"" << config << "\",\n  \"threads\": " << threads << ",\n  \"benchmarks\": [\n";
+
+        for (size_t i = 0; i < results.size(); ++i) {
+            auto& r = results[i];
+
+            os << "    {\"name\": \"" << r.name << "\", \"params\": \"" << r.params << "\""
+               << ", \"repetitions\": " << r.repetitions << ", \"iterations\": " << r.iterations
+               << ", \"mean_ns\": " << r.mean << ", \"median_ns\": " << r.median << ", \"stddev_ns\": " << r.stddev
+               << ", \"min_ns\": " << r.min << ", \"max_ns\": " << r.max << ", \"items_per_second\": " << r.throughput << "}"
+               << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+
+        os << "  ]\n}\n";
+
+        return true;
+    }
+
+    /*!
+     * \brief Write the results as CSV
+     */
+    bool write_csv(const std::string& file) const {
+        std::ofstream os(file);
+
+        if (!os) {
+            std::cerr << "ERROR: Impossible to open " << file << std::endl;
+            return false;
+        }
+
+        os.precision(10);
+
+        os << "name,params,repetitions,iterations,mean_ns,median_ns,stddev_ns,min_ns,max_ns,items_per_second\n";
+
+        for (auto& r : results) {
+            os << r.name << "," << r.params << "," << r.repetitions << "," << r.iterations << ","
+               << r.mean << "," << r.median << "," << r.stddev << "," << r.min << "," << r.max << "," << r.throughput << "\n";
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Compute the statistics of the given times (ns per call)
+     */
+    static bench_result statistics(const std::string& name, const std::string& params, size_t iterations, size_t items, std::vector<double> times) {
+        bench_result r;
+
+        r.name        = name;
+        r.params      = params;
+        r.repetitions = times.size();
+        r.iterations  = iterations;
+
+        std::sort(times.begin(), times.end());
+
+        const size_t n = times.size();
+
+        double sum = 0.0;
+        for (auto t : times) {
+            sum += t;
+        }
+
+        r.mean   = sum / n;
+        r.median = n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2.0;
+        r.min    = times.front();
+        r.max    = times.back();
+
+        double var = 0.0;
+        for (auto t : times) {
+            var += (t - r.mean) * (t - r.mean);
+        }
+
+        r.stddev     = n > 1 ? std::sqrt(var / (n - 1)) : 0.0;
+        r.throughput = r.median > 0.0 ? items * 1e9 / r.median : 0.0;
+
+        return r;
+    }
+
+private:
+    /*!
+     * \brief Returns the mean time (ns) of the given number of calls
+     */
+    template <typename Functor>
+    static double measure(Functor& functor, size_t iterations) {
+        auto start = clock::now();
+
+        for (size_t i = 0; i < iterations; ++i) {
+            functor();
+        }
+
+        auto end = clock::now();
+
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / double(iterations);
+    }
+
+    /*!
+     * \brief Display one result on the console
+     */
+    static void report(const bench_result& r) {
+        printf("%-40s %-28s median %12.0fns mean %12.0fns +/- %5.1f%% [%.0f, %.0f] %12.1f items/s\n",
+               r.name.c_str(), r.params.c_str(), r.median, r.mean, r.mean > 0.0 ? 100.0 * r.stddev / r.mean : 0.0,
+               r.min, r.max, r.throughput);
+    }
+};
+
+// The groups of benchmarks
+
+void bench_layers(bench_suite& suite);
+void bench_generators(bench_suite& suite);
+void bench_trainers(bench_suite& suite);
+
+} //end of namespace dll_bench
@@ -0,0 +1,424 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Baselines of the benchmark suite: identification of the machine
+ * and of the build, comparison of a run against a baseline and
+ * tabulation of several reports
+ */
+
+#pragma once
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dll_bench.hpp"
+
+namespace dll_bench {
+
+/*!
+ * \brief A report of the benchmark suite, as written by write_json
+ */
+struct bench_report {
+    std::string machine;               ///< The identifier of the machine
+    std::string config;                ///< The configuration of the build
+    size_t threads = 0;                ///< The number of threads of ETL and of the networks
+    std::vector<bench_result> results; ///< The results of the benchmarks
+
+    /*!
+     * \brief Returns the result of the given benchmark, or nullptr if it is not in the report
+     */
+    const bench_result* find(const std::string& name, const std::string& params) const {
+        for (auto& r : results) {
+            if (r.name == name && r.params == params) {
+                return &r;
+            }
+        }
+
+        return nullptr;
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Keep only the characters that can be used in a file name
+ */
+inline std::string sanitize(const std::string& value) {
+    std::string result;
+
+    for (char c : value) {
+        if (isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '-' || c == '_') {
+            result += c;
+        } else if (!result.empty() && result.back() != '_') {
+            result += '_';
+        }
+    }
+
+    while (!result.empty() && result.back() == '_') {
+        result.pop_back();
+    }
+
+    return result;
+}
+
+/*!
+ * \brief Returns the string value of the given key in a line of a report
+ */
+inline std::string json_string(const std::string& line, const std::string& key) {
+    const std::string prefix = "\"" + key + "\": \"";
+    const size_t start       = line.find(prefix);
+
+    if (start == std::string::npos) {
+        return {};
+    }
+
+    const size_t end = line.find('"', start + prefix.size());
+
+    return line.substr(start + prefix.size(), end - start - prefix.size());
+}
+
+/*!
+ * \brief Returns the numeric value of the given key in a line of a report
+ */
+inline double json_number(const std::string& line, const std::string& key) {
+    const std::string prefix = "\"" + key + "\": ";
+    const size_t start       = line.find(prefix);
+
+    return start == std::string::npos ? 0.0 : std::strtod(line.c_str() + start + prefix.size(), nullptr);
+}
+
+/*!
+ * \brief Returns the two-sided critical value of the Student t
+ * distribution at 95% for the given degrees of freedom
+ */
+inline double t_critical(double df) {
+    static constexpr double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                       2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                       2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+    if (df < 1.0) {
+        return table[0];
+    } else if (df <= 30.0) {
+        return table[size_t(df) - 1];
+    } else {
+        return 1.96 + 2.4 / df;
+    }
+}
+
+/*!
+ * \brief Format a duration in nanoseconds
+ */
+inline std::string ns_str(double ns) {
+    char buffer[32];
+
+    if (ns >= 1e9) {
+        snprintf(buffer, 32, "%.3fs", ns * 1e-9);
+    } else if (ns >= 1e6) {
+        snprintf(buffer, 32, "%.3fms", ns * 1e-6);
+    } else if (ns >= 1e3) {
+        snprintf(buffer, 32, "%.3fus", ns * 1e-3);
+    } else {
+        snprintf(buffer, 32, "%.0fns", ns);
+    }
+
+    return buffer;
+}
+
+/*!
+ * \brief Append a part to the name of a configuration
+ */
+inline void add_part(std::string& config, const char* part) {
+    config += config.empty() ? part : std::string("+") + part;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Returns the identifier of the machine: its host name, its
+ * processor and its number of hardware threads
+ */
+inline std::string machine_id() {
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+
+    std::string cpu;
+
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    for (std::string line; cpu.empty() && std::getline(cpuinfo, line);) {
+        if (!line.compare(0, 10, "model name")) {
+            const size_t start = line.find_first_not_of(" \t", line.find(':') + 1);
+
+            cpu = start == std::string::npos ? "unknown" : line.substr(start);
+        }
+    }
+
+    return detail::sanitize(std::string(host) + "-" + cpu + "-" + std::to_string(std::thread::hardware_concurrency()) + "t");
+}
+
+/*!
+ * \brief Returns the name of the configuration of ETL and DLL the suite was
+ * built with
+ */
+inline std::string build_config() {
+    std::string config;
+
+#ifdef ETL_MKL_MODE
+    detail::add_part(config, "mkl");
+#endif
+#ifdef ETL_BLAS_MODE
+    detail::add_part(config, "blas");
+#endif
+#ifdef ETL_CUBLAS_MODE
+    detail::add_part(config, "cublas");
+#endif
+#ifdef ETL_CUFFT_MODE
+    detail::add_part(config, "cufft");
+#endif
+#ifdef ETL_CUDNN_MODE
+    detail::add_part(config, "cudnn");
+#endif
+#ifdef ETL_EGBLAS_MODE
+    detail::add_part(config, "egblas");
+#endif
+#ifdef ETL_GPU
+    detail::add_part(config, "gpu");
+#endif
+#ifdef ETL_PARALLEL
+    detail::add_part(config, "parallel");
+#endif
+#ifdef ETL_VECTORIZE_FULL
+    detail::add_part(config, "vectorize");
+#endif
+#if defined(__AVX512F__)
+    detail::add_part(config, "avx512");
+#elif defined(__AVX2__)
+    detail::add_part(config, "avx2");
+#elif defined(__AVX__)
+    detail::add_part(config, "avx");
+#endif
+#ifdef DLL_NO_TIMERS
+    detail::add_part(config, "no_timers");
+#endif
+
+    return config.empty() ? "default" : config;
+}
+
+/*!
+ * \brief Returns the path of the baseline of the given suite in the
+ * folder of baselines: one file per machine and per configuration
+ */
+inline std::string baseline_path(const bench_suite& suite) {
+    return suite.baseline_dir + "/" + suite.machine + "-" + detail::sanitize(suite.config) + ".json";
+}
+
+/*!
+ * \brief Read a report written by bench_suite::write_json
+ * \return false if the report cannot be read
+ */
+inline bool read_report(const std::string& file, bench_report& report) {
+    std::ifstream is(file);
+
+    if (!is) {
+        return false;
+    }
+
+    for (std::string line; std::getline(is, line);) {
+        if (line.find("\"name\": ") != std::string::npos) {
+            bench_result r;
+
+            r.name        = detail::json_string(line, "name");
+            r.params      = detail::json_string(line, "params");
+            r.repetitions = size_t(detail::json_number(line, "repetitions"));
+            r.iterations  = size_t(detail::json_number(line, "iterations"));
+            r.mean        = detail::json_number(line, "mean_ns");
+            r.median      = detail::json_number(line, "median_ns");
+            r.stddev      = detail::json_number(line, "stddev_ns");
+            r.min         = detail::json_number(line, "min_ns");
+            r.max         = detail::json_number(line, "max_ns");
+            r.throughput  = detail::json_number(line, "items_per_second");
+
+            report.results.push_back(r);
+        } else if (line.find("\"machine\": ") != std::string::npos) {
+            report.machine = detail::json_string(line, "machine");
+        } else if (line.find("\"config\": ") != std::string::npos) {
+            report.config = detail::json_string(line, "config");
+        } else if (line.find("\"threads\": ") != std::string::npos) {
+            report.threads = size_t(detail::json_number(line, "threads"));
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Indicates if the difference of the means of two results is
+ * statistically significant (Welch's t-test at 95%)
+ */
+inline bool significant(const bench_result& a, const bench_result& b) {
+    const double va = a.stddev * a.stddev / std::max(size_t(1), a.repetitions);
+    const double vb = b.stddev * b.stddev / std::max(size_t(1), b.repetitions);
+
+    if (va + vb == 0.0) {
+        return a.mean != b.mean;
+    }
+
+    const double t = std::abs(a.mean - b.mean) / std::sqrt(va + vb);
+
+    const double df = (va + vb) * (va + vb)
+                    / ((a.repetitions > 1 ? va * va / (a.repetitions - 1) : 0.0) + (b.repetitions > 1 ? vb * vb / (b.repetitions - 1) : 0.0) + 1e-300);
+
+    return t > detail::t_critical(df);
+}
+
+/*!
+ * \brief Compare the results of a run against a baseline and display the
+ * change of each benchmark.
+ *
+ * A benchmark regresses when its median is slower than the baseline by
+ * more than the threshold and the difference is significant.
+ *
+ * \return The number of regressions
+ */
+inline size_t compare_baseline(const bench_report& baseline, const std::vector<bench_result>& results, double threshold) {
+    if (!baseline.machine.empty()) {
+        std::cout << "Baseline " << baseline.machine << " (" << baseline.config << ")" << std::endl;
+    }
+
+    size_t regressions = 0;
+
+    for (auto& r : results) {
+        auto* base = baseline.find(r.name, r.params);
+
+        if (!base) {
+            printf("%-40s %-28s %12s -> %12s %8s  new\n", r.name.c_str(), r.params.c_str(), "-", detail::ns_str(r.median).c_str(), "");
+            continue;
+        }
+
+        const double change = base->median > 0.0 ? 100.0 * (r.median - base->median) / base->median : 0.0;
+        const bool changed  = significant(*base, r);
+
+        const char* verdict = "~";
+
+        if (changed && change > threshold) {
+            verdict = "REGRESSION";
+            ++regressions;
+        } else if (changed && change < -threshold) {
+            verdict = "improvement";
+        }
+
+        printf("%-40s %-28s %12s -> %12s %+7.1f%%  %s\n", r.name.c_str(), r.params.c_str(),
+               detail::ns_str(base->median).c_str(), detail::ns_str(r.median).c_str(), change, verdict);
+    }
+
+    std::cout << regressions << " significant regression(s) above " << threshold << "%" << std::endl;
+
+    return regressions;
+}
+
+/*!
+ * \brief Tabulate the medians of several reports, one column per report
+ * (usually one per configuration) with the speedup relative to the first
+ *
+ * \param files The reports
+ * \param csv_file If not empty, the table is also written as CSV to this file
+ *
+ * \return false if a report cannot be read
+ */
+inline bool tabulate_reports(const std::vector<std::string>& files, const std::string& csv_file) {
+    std::vector<bench_report> reports(files.size());
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!read_report(files[i], reports[i])) {
+            std::cerr << "ERROR: Impossible to read " << files[i] << std::endl;
+            return false;
+        }
+
+        if (reports[i].config.empty()) {
+            reports[i].config = files[i];
+        }
+    }
+
+    // The union of the benchmarks, in their order of appearance
+
+    bench_report rows;
+
+    for (auto& report : reports) {
+        for (auto& r : report.results) {
+            if (!rows.find(r.name, r.params)) {
+                rows.results.push_back(r);
+            }
+        }
+    }
+
+    std::ostringstream csv;
+
+    printf("%-60s", "benchmark");
+    csv << "benchmark";
+
+    for (auto& report : reports) {
+        printf(" %22s", report.config.substr(0, 22).c_str());
+        csv << "," << report.config;
+    }
+
+    printf("\n");
+    csv << "\n";
+
+    for (auto& row : rows.results) {
+        const std::string name = row.name + "/" + row.params;
+
+        printf("%-60s", name.c_str());
+        csv << name;
+
+        auto* first = reports.front().find(row.name, row.params);
+
+        for (auto& report : reports) {
+            auto* r = report.find(row.name, row.params);
+
+            if (!r) {
+                printf(" %22s", "-");
+                csv << ",";
+            } else if (first && first->median > 0.0 && r->median > 0.0) {
+                printf(" %13s (x%5.2f)", detail::ns_str(r->median).c_str(), first->median / r->median);
+                csv << "," << r->median;
+            } else {
+                printf(" %22s", detail::ns_str(r->median).c_str());
+                csv << "," << r->median;
+            }
+        }
+
+        printf("\n");
+        csv << "\n";
+    }
+
+    if (!csv_file.empty()) {
+        std::ofstream os(csv_file);
+
+        if (!os) {
+            std::cerr << "ERROR: Impossible to open " << csv_file << std::endl;
+            return false;
+        }
+
+        os << csv.str();
+    }
+
+    return true;
+}
+
+} //end of namespace dll_bench
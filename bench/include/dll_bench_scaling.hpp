@@ -0,0 +1,310 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Scaling harness of the benchmark suite: the selected benchmarks
+ * are run again with 1, 2, 4, ... threads, each run in a process bound to
+ * as many CPUs, and their speedup, efficiency and serial fraction are
+ * reported.
+ *
+ * The thread pools of ETL and of the networks are sized from the number of
+ * CPUs of the process (etl::threads), so each run uses as many threads as
+ * CPUs. The number of threads actually used by a run is checked against
+ * its number of CPUs.
+ */
+
+#pragma once
+
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "dll_bench.hpp"
+#include "dll_bench_baseline.hpp"
+
+namespace dll_bench {
+
+namespace detail {
+
+/*!
+ * \brief Returns the CPUs the process is allowed to run on
+ */
+inline std::vector<int> allowed_cpus() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    std::vector<int> cpus;
+
+    if (!sched_getaffinity(0, sizeof(set), &set)) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+
+    return cpus;
+}
+
+/*!
+ * \brief Returns the numbers of threads of the scaling runs: the given
+ * ones, or the powers of two up to the number of CPUs, always with one
+ * thread (the reference) and never more threads than CPUs
+ */
+inline std::vector<size_t> scaling_counts(std::vector<size_t> counts, size_t cpus) {
+    if (counts.empty()) {
+        for (size_t n = 1; n < cpus; n *= 2) {
+            counts.push_back(n);
+        }
+
+        counts.push_back(cpus);
+    }
+
+    counts.push_back(1);
+
+    counts.erase(std::remove_if(counts.begin(), counts.end(), [cpus](size_t n) { return n > cpus; }), counts.end());
+
+    std::sort(counts.begin(), counts.end());
+    counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+
+    return counts;
+}
+
+/*!
+ * \brief Run the benchmark suite again in a child process bound to the
+ * first CPUs of the given ones and read its report.
+ *
+ * \param args The arguments of the run
+ * \param cpus The CPUs of the run
+ * \param report The report of the run
+ *
+ * \return false if the run failed
+ */
+inline bool scaling_run(std::vector<std::string> args, const std::vector<int>& cpus, bench_report& report) {
+    char file[] = "/tmp/dll_bench_scaling_XXXXXX";
+
+    const int fd = mkstemp(file);
+
+    if (fd < 0) {
+        std::cerr << "ERROR: Impossible to create the report of the run" << std::endl;
+        return false;
+    }
+
+    close(fd);
+
+    args.push_back(std::string("--json=") + file);
+
+    std::vector<char*> argv;
+
+    for (auto& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+
+    argv.push_back(nullptr);
+
+    std::cout.flush();
+    fflush(stdout);
+
+    const pid_t pid = fork();
+
+    if (pid == 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+
+        for (int cpu : cpus) {
+            CPU_SET(cpu, &set);
+        }
+
+        // The affinity is kept by exec, before the thread pools are created
+        if (sched_setaffinity(0, sizeof(set), &set)) {
+            _exit(126);
+        }
+
+        execv("/proc/self/exe", argv.data());
+        _exit(127);
+    }
+
+    int status = 0;
+
+    const bool ok = pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0 && read_report(file, report);
+
+    std::remove(file);
+
+    if (!ok) {
+        std::cerr << "ERROR: The run with " << cpus.size() << " CPU(s) failed" << std::endl;
+    }
+
+    return ok;
+}
+
+/*!
+ * \brief Returns the serial fraction of a benchmark fitted (least squares)
+ * on its speedups: with Amdahl's law (1 / S = f + (1 - f) / n) for strong
+ * scaling and with Gustafson's law (S = n - f (n - 1)) for weak scaling
+ */
+inline double serial_fraction(const std::vector<size_t>& counts, const std::vector<double>& speedups, bool weak) {
+    double num = 0.0;
+    double den = 0.0;
+
+    for (size_t i = 0; i < counts.size(); ++i) {
+        const double n = counts[i];
+
+        if (counts[i] == 1 || speedups[i] <= 0.0) {
+            continue;
+        }
+
+        if (weak) {
+            num += (n - speedups[i]) * (n - 1.0);
+            den += (n - 1.0) * (n - 1.0);
+        } else {
+            num += (1.0 / speedups[i] - 1.0 / n) * (1.0 - 1.0 / n);
+            den += (1.0 - 1.0 / n) * (1.0 - 1.0 / n);
+        }
+    }
+
+    return den > 0.0 ? std::min(1.0, std::max(0.0, num / den)) : 0.0;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Run the scaling harness: the selected benchmarks (by default, the
+ * training and generator ones) are run with each number of threads and the
+ * tables of their throughput, speedup, efficiency and serial fraction are
+ * displayed.
+ *
+ * For strong scaling, the work is the same for each number of threads. For
+ * weak scaling (suite.weak), the work of the benchmarks grows with the
+ * number of threads and the benchmarks with a fixed work are not run.
+ *
+ * The speedup is the throughput relative to one thread and the efficiency
+ * the speedup divided by the number of threads. The recommended number of
+ * threads is the largest one whose efficiency is at least min_efficiency.
+ *
+ * \param suite The configuration of the harness
+ * \param argv0 The name of the suite executable
+ *
+ * \return false if a run failed or the CSV table cannot be written
+ */
+inline bool run_scaling(const bench_suite& suite, const std::string& argv0) {
+    const auto cpus   = detail::allowed_cpus();
+    const auto counts = detail::scaling_counts(suite.thread_counts, std::max(size_t(1), cpus.size()));
+
+    std::vector<std::string> args{argv0, "--filter=" + (suite.filter.empty() ? std::string("train/,generator/") : suite.filter),
+                                  "--warmup=" + std::to_string(suite.warmup), "--repetitions=" + std::to_string(suite.repetitions),
+                                  "--min-time=" + std::to_string(suite.min_time), "--config=" + suite.config};
+
+    std::vector<bench_report> reports(counts.size());
+
+    for (size_t i = 0; i < counts.size(); ++i) {
+        const size_t n = counts[i];
+
+        std::cout << (suite.weak ? "Weak" : "Strong") << " scaling run with " << n << " thread(s)" << std::endl;
+
+        auto run_args = args;
+
+        if (suite.weak) {
+            run_args.push_back("--work=" + std::to_string(n));
+        }
+
+        if (!detail::scaling_run(run_args, std::vector<int>(cpus.begin(), cpus.begin() + std::min(n, cpus.size())), reports[i])) {
+            return false;
+        }
+
+        if (reports[i].threads != n) {
+            std::cout << "WARNING: The run with " << n << " CPU(s) used " << reports[i].threads << " thread(s)" << std::endl;
+        }
+    }
+
+    std::ostringstream csv;
+    csv << "name,params,threads,median_ns,items_per_second,speedup,efficiency,serial_fraction\n";
+
+    std::cout << std::endl;
+
+    // The benchmarks are matched by name and order, their parameters changing with their work
+
+    auto& reference = reports.front().results;
+
+    for (size_t b = 0; b < reference.size(); ++b) {
+        auto& r = reference[b];
+
+        const size_t occurrence = std::count_if(reference.begin(), reference.begin() + b, [&r](auto& o) { return o.name == r.name; });
+
+        std::vector<const bench_result*> results;
+
+        for (auto& report : reports) {
+            size_t seen = 0;
+
+            auto it = std::find_if(report.results.begin(), report.results.end(), [&](auto& o) { return o.name == r.name && seen++ == occurrence; });
+
+            results.push_back(it == report.results.end() ? nullptr : &*it);
+        }
+
+        std::vector<double> speedups(counts.size(), 0.0);
+
+        for (size_t i = 0; i < counts.size(); ++i) {
+            if (results[i] && r.throughput > 0.0) {
+                speedups[i] = results[i]->throughput / r.throughput;
+            }
+        }
+
+        const double serial = detail::serial_fraction(counts, speedups, suite.weak);
+
+        size_t recommended = 1;
+
+        printf("%-40s %-28s serial fraction %5.3f (%s)\n", r.name.c_str(), r.params.c_str(), serial, suite.weak ? "Gustafson" : "Amdahl");
+
+        for (size_t i = 0; i < counts.size(); ++i) {
+            if (!results[i]) {
+                continue;
+            }
+
+            const double efficiency = speedups[i] / counts[i];
+
+            if (efficiency >= suite.min_efficiency) {
+                recommended = std::max(recommended, counts[i]);
+            }
+
+            printf("    %4zu thread(s) %14s %14.1f items/s  speedup %6.2f  efficiency %5.1f%%\n", counts[i],
+                   detail::ns_str(results[i]->median).c_str(), results[i]->throughput, speedups[i], 100.0 * efficiency);
+
+            csv << r.name << "," << results[i]->params << "," << counts[i] << "," << results[i]->median << "," << results[i]->throughput
+                << "," << speedups[i] << "," << efficiency << "," << serial << "\n";
+        }
+
+        if (!suite.weak && serial > 0.0) {
+            printf("    maximum speedup %.2f, recommended %zu thread(s)\n", 1.0 / serial, recommended);
+        } else {
+            printf("    recommended %zu thread(s)\n", recommended);
+        }
+    }
+
+    if (!suite.csv_file.empty()) {
+        std::ofstream os(suite.csv_file);
+
+        if (!os) {
+            std::cerr << "ERROR: Impossible to open " << suite.csv_file << std::endl;
+            return false;
+        }
+
+        os << csv.str();
+    }
+
+    return true;
+}
+
+} //end of namespace dll_bench
@@ -0,0 +1,92 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Throughput benchmarks of the generators
+ */
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dll_bench.hpp"
+
+#include "dll/generators.hpp"
+
+namespace {
+
+constexpr size_t samples = 4096; ///< The number of samples of the datasets
+constexpr size_t classes = 10;   ///< The number of classes of the datasets
+
+/*!
+ * \brief A random dataset of flat 28x28 samples
+ */
+struct dataset {
+    std::vector<etl::dyn_matrix<float, 1>> images;
+    std::vector<size_t> labels;
+
+    /*!
+     * \brief Generate n samples
+     */
+    explicit dataset(size_t n) {
+        std::default_random_engine engine(42);
+        std::uniform_int_distribution<size_t> label_dist(0, classes - 1);
+
+        for (size_t i = 0; i < n; ++i) {
+            images.emplace_back(28 * 28);
+            images.back() = etl::uniform_generator(engine, 0.0, 255.0);
+            labels.push_back(label_dist(engine));
+        }
+    }
+};
+
+/*!
+ * \brief Benchmark one shuffled epoch of a generator, each batch being
+ * read entirely
+ */
+template <typename Desc>
+void bench_generator(dll_bench::bench_suite& suite, const dataset& data, const std::string& name) {
+    const size_t n = data.images.size();
+
+    auto generator = dll::make_generator(data.images, data.labels, n, classes, Desc{});
+
+    const std::string params = "n" + std::to_string(n) + ":b" + std::to_string(generator->batch_size);
+
+    suite.run("generator/" + name, params, n, [&] {
+        double sum = 0.0;
+
+        generator->reset_shuffle();
+
+        while (generator->has_next_batch()) {
+            sum += etl::sum(generator->data_batch()) + etl::sum(generator->label_batch());
+
+            generator->next_batch();
+        }
+
+        dll_bench::do_not_optimize(sum);
+    });
+}
+
+template <size_t B>
+void bench_batch_generators(dll_bench::bench_suite& suite, const dataset& data) {
+    bench_generator<dll::inmemory_data_generator_desc<dll::batch_size<B>, dll::categorical>>(suite, data, "inmemory");
+    bench_generator<dll::inmemory_data_generator_desc<dll::batch_size<B>, dll::categorical, dll::scale_pre<255>>>(suite, data, "inmemory_scaled");
+    bench_generator<dll::inmemory_data_generator_desc<dll::batch_size<B>, dll::categorical, dll::index_shuffle>>(suite, data, "inmemory_index_shuffle");
+    bench_generator<dll::inmemory_data_generator_desc<dll::batch_size<B>, dll::categorical, dll::noise<10>>>(suite, data, "inmemory_noise");
+    bench_generator<dll::inmemory_data_generator_desc<dll::batch_size<B>, dll::categorical, dll::noise<10>, dll::threaded>>(suite, data, "inmemory_noise_threaded");
+}
+
+} // end of anonymous namespace
+
+void dll_bench::bench_generators(bench_suite& suite) {
+    // For weak scaling, the datasets grow with the work
+    const dataset data(samples * suite.work);
+
+    bench_batch_generators<32>(suite, data);
+    bench_batch_generators<128>(suite, data);
+}
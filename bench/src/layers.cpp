@@ -0,0 +1,123 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Forward and backward benchmarks of single layers, across shapes
+ * and batch sizes
+ */
+
+#include <memory>
+#include <string>
+
+#include "dll_bench.hpp"
+
+#include "dll/neural/dyn_dense_layer.hpp"
+#include "dll/neural/dyn_conv_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/trainer/stochastic_gradient_descent.hpp"
+
+namespace {
+
+template <size_t B>
+using dense_net_t = typename dll::dbn_desc<
+    dll::dbn_layers<
+        dll::dyn_dense_layer_desc<dll::weight_type<float>, dll::relu>::layer_t>,
+    dll::batch_size<B>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+template <size_t B>
+using conv_net_t = typename dll::dbn_desc<
+    dll::dbn_layers<
+        dll::dyn_conv_layer_desc<dll::weight_type<float>, dll::relu>::layer_t>,
+    dll::batch_size<B>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+/*!
+ * \brief Benchmark the passes of the only layer of the given network.
+ *
+ * The contexts of the SGD trainer are used as inputs, outputs and errors,
+ * like during the training.
+ */
+template <typename Net, typename Init>
+void bench_layer(dll_bench::bench_suite& suite, const std::string& name, const std::string& params, Init&& init) {
+    constexpr size_t B = Net::batch_size;
+
+    auto net = std::make_unique<Net>();
+
+    init(*net);
+
+    dll::sgd_trainer<Net> trainer(*net);
+    trainer.init_training(B);
+
+    auto& layer = net->template layer_get<0>();
+    auto& ctx   = *std::get<0>(trainer.full_context).second;
+
+    ctx.input  = etl::uniform_generator(-1.0, 1.0);
+    ctx.errors = etl::uniform_generator(-1.0, 1.0);
+
+    auto input_errors = ctx.input;
+
+    const std::string batch_params = params + ":b" + std::to_string(B);
+
+    layer.forward_batch(ctx.output, ctx.input);
+
+    suite.run(name + "/forward", batch_params, B, [&] {
+        layer.forward_batch(ctx.output, ctx.input);
+        dll_bench::do_not_optimize(ctx.output[0]);
+    });
+
+    suite.run(name + "/backward", batch_params, B, [&] {
+        layer.adapt_errors(ctx);
+        layer.backward_batch(input_errors, ctx);
+        dll_bench::do_not_optimize(input_errors[0]);
+    });
+
+    suite.run(name + "/gradients", batch_params, B, [&] {
+        layer.compute_gradients(ctx);
+        dll_bench::do_not_optimize(ctx.output[0]);
+    });
+}
+
+template <size_t B>
+void bench_dense(dll_bench::bench_suite& suite) {
+    for (auto [nv, nh] : {std::pair<size_t, size_t>{784, 500}, {500, 500}, {1024, 1024}, {500, 10}}) {
+        bench_layer<dense_net_t<B>>(suite, "dense", std::to_string(nv) + "x" + std::to_string(nh), [nv = nv, nh = nh](auto& net) {
+            net.template init_layer<0>(nv, nh);
+        });
+    }
+}
+
+template <size_t B>
+void bench_conv(dll_bench::bench_suite& suite) {
+    struct shape {
+        size_t nc, nv, k, nw;
+    };
+
+    for (auto s : {shape{1, 28, 8, 5}, shape{3, 32, 16, 3}, shape{16, 16, 32, 3}}) {
+        const std::string params = std::to_string(s.nc) + "x" + std::to_string(s.nv) + "x" + std::to_string(s.nv) + "-" + std::to_string(s.k) + "x" + std::to_string(s.nw) + "x" + std::to_string(s.nw);
+
+        bench_layer<conv_net_t<B>>(suite, "conv", params, [s](auto& net) {
+            net.template init_layer<0>(s.nc, s.nv, s.nv, s.k, s.nw, s.nw);
+        });
+    }
+}
+
+} // end of anonymous namespace
+
+void dll_bench::bench_layers(bench_suite& suite) {
+    // The work of a layer cannot grow for weak scaling
+    if (suite.weak) {
+        return;
+    }
+
+    bench_dense<1>(suite);
+    bench_dense<32>(suite);
+    bench_dense<128>(suite);
+
+    bench_conv<1>(suite);
+    bench_conv<32>(suite);
+    bench_conv<128>(suite);
+}
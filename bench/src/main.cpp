@@ -0,0 +1,82 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <fstream>
+
+#include "etl/etl.hpp"
+
+#include "dll_bench.hpp"
+#include "dll_bench_baseline.hpp"
+#include "dll_bench_scaling.hpp"
+
+int main(int argc, char** argv) {
+    dll_bench::bench_suite suite;
+
+    if (!suite.parse(argc, argv)) {
+        return 1;
+    }
+
+    if (!suite.tabulate.empty()) {
+        return dll_bench::tabulate_reports(suite.tabulate, suite.csv_file) ? 0 : 1;
+    }
+
+    suite.machine = dll_bench::machine_id();
+    suite.threads = etl::threads;
+
+    if (suite.config.empty()) {
+        suite.config = dll_bench::build_config();
+    }
+
+    if (suite.scaling) {
+        return dll_bench::run_scaling(suite, argv[0]) ? 0 : 1;
+    }
+
+    std::cout << "Machine " << suite.machine << " (" << suite.config << ")" << std::endl;
+
+    dll_bench::bench_layers(suite);
+    dll_bench::bench_generators(suite);
+    dll_bench::bench_trainers(suite);
+
+    if (suite.list) {
+        return 0;
+    }
+
+    bool ok = suite.write_reports();
+
+    // Compare against the baseline, from a file or from the baseline of the machine
+
+    size_t regressions = 0;
+
+    const std::string baseline = !suite.baseline_file.empty() ? suite.baseline_file
+                               : !suite.baseline_dir.empty()  ? dll_bench::baseline_path(suite)
+                                                              : std::string();
+
+    dll_bench::bench_report report;
+
+    const bool found = !baseline.empty() && dll_bench::read_report(baseline, report);
+
+    if (found && !suite.update_baseline) {
+        regressions = dll_bench::compare_baseline(report, suite.results, suite.threshold);
+    } else if (!suite.baseline_file.empty() && !found) {
+        std::cerr << "ERROR: Impossible to read " << baseline << std::endl;
+        ok = false;
+    }
+
+    if (!suite.baseline_dir.empty() && (!found || suite.update_baseline)) {
+        if (suite.write_json(baseline)) {
+            std::cout << "Baseline saved in " << baseline << std::endl;
+        } else {
+            ok = false;
+        }
+    }
+
+    if (!ok) {
+        return 1;
+    }
+
+    return suite.fail_on_regression && regressions ? 2 : 0;
+}
@@ -0,0 +1,173 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief End-to-end benchmarks of the training steps and epochs
+ */
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dll_bench.hpp"
+
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/lstm_layer.hpp"
+#include "dll/neural/recurrent_last_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/rbm/conv_rbm.hpp"
+#include "dll/network.hpp"
+#include "dll/generators.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+
+namespace {
+
+constexpr size_t samples = 2048; ///< The number of samples of an epoch
+constexpr size_t classes = 10;   ///< The number of classes
+
+template <size_t B, dll::updater_type U>
+using mlp_t = typename dll::network_desc<
+    dll::network_layers<
+        dll::dense_layer<28 * 28, 500, dll::relu>,
+        dll::dense_layer<500, 250, dll::relu>,
+        dll::dense_layer<250, classes, dll::softmax>>,
+    dll::updater<U>, dll::batch_size<B>, dll::watcher<dll::mute_dbn_watcher>>::network_t;
+
+template <size_t B, dll::updater_type U>
+using cnn_t = typename dll::network_desc<
+    dll::network_layers<
+        dll::conv_layer<1, 28, 28, 8, 5, 5, dll::relu>,
+        dll::mp_2d_layer<8, 24, 24, 2, 2>,
+        dll::conv_layer<8, 12, 12, 8, 5, 5, dll::relu>,
+        dll::mp_2d_layer<8, 8, 8, 2, 2>,
+        dll::dense_layer<8 * 4 * 4, 150, dll::relu>,
+        dll::dense_layer<150, classes, dll::softmax>>,
+    dll::updater<U>, dll::batch_size<B>, dll::watcher<dll::mute_dbn_watcher>>::network_t;
+
+template <size_t B>
+using lstm_t = typename dll::network_desc<
+    dll::network_layers<
+        dll::lstm_layer<28, 28, 100, dll::last_only>,
+        dll::recurrent_last_layer<28, 100>,
+        dll::dense_layer<100, classes, dll::softmax>>,
+    dll::updater<dll::updater_type::ADAM>, dll::batch_size<B>, dll::watcher<dll::mute_dbn_watcher>>::network_t;
+
+template <size_t B>
+using crbm_t = typename dll::conv_rbm_square_desc<
+    1, 28, 20, 24,
+    dll::batch_size<B>,
+    dll::momentum>::layer_t;
+
+/*!
+ * \brief Benchmark one training step (forward, backward and update of a
+ * batch) and one training epoch of the given network
+ *
+ * For weak scaling, only the epoch is run, on suite.work times more samples.
+ *
+ * \param sample The shape of one sample
+ */
+template <typename Net, typename... Dims>
+void bench_network(dll_bench::bench_suite& suite, const std::string& name, const std::string& updater, Dims... sample) {
+    constexpr size_t B = Net::batch_size;
+
+    std::default_random_engine engine(42);
+    std::uniform_int_distribution<size_t> label_dist(0, classes - 1);
+
+    auto net = std::make_unique<Net>();
+
+    const std::string params = updater + ":b" + std::to_string(B);
+
+    // One step on a random batch
+
+    etl::dyn_matrix<float, sizeof...(Dims) + 1> inputs(B, sample...);
+    etl::dyn_matrix<float, 2> labels(B, classes);
+
+    inputs = etl::uniform_generator(engine, 0.0, 1.0);
+    labels = 0.0;
+
+    for (size_t i = 0; i < B; ++i) {
+        labels(i, label_dist(engine)) = 1.0;
+    }
+
+    dll::sgd_trainer<Net> trainer(*net);
+    trainer.init_training(B);
+
+    size_t iteration = 0;
+
+    if (!suite.weak) {
+        suite.run(name + "/step", params, B, [&] {
+            dll_bench::do_not_optimize(trainer.train_batch(iteration++, inputs, labels).first);
+        });
+    }
+
+    // One epoch from a generator
+
+    const size_t n = samples * suite.work;
+
+    std::vector<etl::dyn_matrix<float, sizeof...(Dims)>> images;
+    std::vector<size_t> image_labels;
+
+    for (size_t i = 0; i < n; ++i) {
+        images.emplace_back(sample...);
+        images.back() = etl::uniform_generator(engine, 0.0, 1.0);
+        image_labels.push_back(label_dist(engine));
+    }
+
+    auto generator = dll::make_generator(images, image_labels, n, classes, dll::inmemory_data_generator_desc<dll::batch_size<B>, dll::categorical>{});
+
+    suite.run(name + "/epoch", params + ":n" + std::to_string(n), n, [&] {
+        dll_bench::do_not_optimize(net->fine_tune(*generator, 1));
+    });
+}
+
+/*!
+ * \brief Benchmark one epoch of contrastive divergence of a Convolutional
+ * RBM, on suite.work times more samples for weak scaling, the trainer
+ * using a thread pool sized like the pools of the networks
+ */
+template <size_t B>
+void bench_crbm(dll_bench::bench_suite& suite) {
+    std::default_random_engine engine(42);
+
+    const size_t n = samples * suite.work;
+
+    auto rbm = std::make_unique<crbm_t<B>>();
+
+    std::vector<etl::fast_dyn_matrix<float, 1, 28, 28>> images(n);
+
+    for (auto& image : images) {
+        image = etl::uniform_generator(engine, 0.0, 1.0);
+    }
+
+    cpp::thread_pool<true> pool(etl::threads);
+    dll::thread_pool_scope scope(pool);
+
+    suite.run("train/crbm/epoch", "cd1:b" + std::to_string(B) + ":n" + std::to_string(n), n, [&] {
+        dll_bench::do_not_optimize(rbm->train(images, 1));
+    });
+}
+
+template <size_t B>
+void bench_networks(dll_bench::bench_suite& suite) {
+    bench_network<mlp_t<B, dll::updater_type::MOMENTUM>>(suite, "train/mlp", "momentum", 28 * 28);
+    bench_network<mlp_t<B, dll::updater_type::ADAM>>(suite, "train/mlp", "adam", 28 * 28);
+    bench_network<cnn_t<B, dll::updater_type::MOMENTUM>>(suite, "train/cnn", "momentum", 1, 28, 28);
+    bench_network<cnn_t<B, dll::updater_type::ADAM>>(suite, "train/cnn", "adam", 1, 28, 28);
+    bench_network<lstm_t<B>>(suite, "train/lstm", "adam", 28, 28);
+
+    bench_crbm<B>(suite);
+}
+
+} // end of anonymous namespace
+
+void dll_bench::bench_trainers(bench_suite& suite) {
+    bench_networks<32>(suite);
+    bench_networks<128>(suite);
+}
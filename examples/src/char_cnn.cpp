@@ -5,12 +5,10 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
-#include <unordered_map>
-
 #include "cpp_utils/tuple_utils.hpp"
 
 #include "dll/neural/embedding_layer.hpp"
-#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/conv_1d_layer.hpp"
 #include "dll/pooling/mp_layer.hpp"
 #include "dll/neural/dense_layer.hpp"
 #include "dll/utility/group_layer.hpp"
@@ -51,47 +49,37 @@ int main(int /*argc*/, char* /*argv*/ []) {
     std::mt19937_64 engine(rd());
     cpp::parallel_shuffle(words.begin(), words.end(), labels.begin(), labels.end(), engine);
 
-    std::vector<etl::fast_dyn_matrix<float, 15>> samples;
-    std::unordered_map<char, size_t> chars;
-
-    for (auto& word : words) {
-        samples.emplace_back();
-
-        for (size_t i = 0; i < word.size(); ++i) {
-            auto c = word[i];
+    constexpr size_t embedding = 16;
+    constexpr size_t length = 15;
+    constexpr size_t vocabulary_size = 26 + 2; // The letters, the padding and the unknown characters
 
-            if (!chars.count(c)) {
-                auto s = chars.size();
-                // Done before because operator[] will create a new value
-                chars[c] = s;
-            }
+    // Each character is encoded as its index, not as its one-hot vector
+    dll::text_vocabulary vocabulary;
+    std::vector<etl::fast_dyn_matrix<float, length>> samples(words.size());
 
-            samples.back()[i] = chars[c];
-        }
+    for (size_t i = 0; i < words.size(); ++i) {
+        dll::encode_text(vocabulary, words[i], dll::text_tokens::CHARS, samples[i]);
     }
 
-    constexpr size_t embedding = 16;
-    constexpr size_t length = 15;
-
     using embedding_network_t = dll::dyn_network_desc<
         dll::network_layers<
             // The embedding layer
-            dll::embedding_layer<26, length, embedding>
+            dll::embedding_layer<vocabulary_size, length, embedding>
 
             // The convolutional layers
             , dll::merge_layer<
                 0
                 , dll::group_layer<
-                      dll::conv_layer<1, length, embedding, 16, 3, embedding>
-                    , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+                      dll::conv_1d_layer<length, embedding, 16, 3>
+                    , dll::mp_1d_layer<length - 3 + 1, 16, length - 3 + 1>
                 >
                 , dll::group_layer<
-                      dll::conv_layer<1, length, embedding, 16, 4, embedding>
-                    , dll::mp_2d_layer<16, length - 4 + 1, 1, length - 4 + 1, 1>
+                      dll::conv_1d_layer<length, embedding, 16, 4>
+                    , dll::mp_1d_layer<length - 4 + 1, 16, length - 4 + 1>
                 >
                 , dll::group_layer<
-                      dll::conv_layer<1, length, embedding, 16, 5, embedding>
-                    , dll::mp_2d_layer<16, length - 5 + 1, 1, length - 5 + 1, 1>
+                      dll::conv_1d_layer<length, embedding, 16, 5>
+                    , dll::mp_1d_layer<length - 5 + 1, 16, length - 5 + 1>
                 >
             >
 
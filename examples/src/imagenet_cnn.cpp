@@ -24,6 +24,8 @@ int main(int /*argc*/, char* /*argv*/ []) {
     auto dataset = dll::make_imagenet_dataset("/home/wichtounet/datasets/imagenet_resized/"
         , dll::batch_size<B>{}
         , dll::scale_pre<255>{}
+        , dll::threaded{}
+        , dll::workers<4>{}
         );
 
     // Build the network
@@ -23,7 +23,9 @@
 #include "loss.hpp"
 #include "decay_type.hpp"
 #include "sparsity_method.hpp"
+#include "corruption_type.hpp"
 #include "bias_mode.hpp"
+#include "sampler_type.hpp"
 #include "initializer.hpp"
 #include "output.hpp"
 
@@ -141,14 +143,23 @@ struct random_crop_id;
 struct batch_mode_id;
 struct dbn_only_id;
 struct last_only_id;
+struct variable_length_id;
+struct parallel_bptt_id;
 struct horizontal_mirroring_id;
 struct vertical_mirroring_id;
 struct categorical_id;
 struct threaded_id;
+struct workers_id;
+struct lock_free_id;
+struct prefetch_id;
+struct index_shuffle_id;
+struct storage_type_id;
+struct index_labels_id;
 struct nop_id;
 struct no_bias_id;
 struct elastic_distortion_id;
 struct noise_id;
+struct corruption_id;
 struct scale_pre_id;
 struct normalize_pre_id;
 struct binarize_pre_id;
@@ -156,7 +167,28 @@ struct autoencoder_id;
 struct updater_id;
 struct early_stopping_id;
 struct early_training_id;
+struct async_validation_id;
+struct data_parallel_id;
+struct staleness_id;
+struct pipelined_updates_id;
+struct lazy_updates_id;
+struct pretrain_cache_id;
+struct pretrain_pipeline_id;
+struct huge_pages_id;
+struct pin_threads_id;
+struct producer_cores_id;
+struct no_smt_id;
+struct staged_training_id;
+struct frozen_layers_id;
+struct gpu_resident_id;
+struct sync_batch_norm_id;
+struct sparse_input_id;
+struct negative_sampler_id;
 struct truncate_id;
+struct groups_id;
+struct strides_id;
+struct keep_lowered_id;
+struct model_parallel_id;
 
 /*!
  * \brief Sets the minibatch size
@@ -195,6 +227,134 @@ struct early_stopping : value_conf_elt<early_stopping_id, strategy, S> {};
  */
 struct early_training : basic_conf_elt<early_training_id> {};
 
+/*!
+ * \brief Compute the validation statistics on a snapshot of the weights,
+ * in another thread, while the next epoch is trained. The statistics are
+ * reported one epoch late.
+ *
+ * The network must be default constructible with its final shape, i.e.
+ * it cannot contain manually initialized dynamic layers.
+ */
+struct async_validation : basic_conf_elt<async_validation_id> {};
+
+/*!
+ * \brief Split each training batch in S shards, trained concurrently by
+ * the thread pool of the network. The gradients of the shards are reduced
+ * before a single update of the weights.
+ *
+ * The batch size must be divisible by S. The layers that keep per-batch
+ * state (dropout, batch normalization) and the group and merge layers are
+ * not supported.
+ *
+ * \tparam S The number of shards
+ */
+template <size_t S>
+struct data_parallel : value_conf_elt<data_parallel_id, size_t, S> {};
+
+/*!
+ * \brief Sets the maximum number of batches in flight in the asynchronous
+ * SGD trainer, which bounds the staleness of the gradients.
+ *
+ * \tparam S The maximum number of batches in flight (0 for the number of workers)
+ */
+template <size_t S>
+struct staleness : value_conf_elt<staleness_id, size_t, S> {};
+
+/*!
+ * \brief Compute the gradients and update the weights of each layer on the
+ * thread pool of the network, as soon as the backward pass is done with
+ * the layer, overlapped with the backward pass of the previous layers.
+ */
+struct pipelined_updates : basic_conf_elt<pipelined_updates_id> {};
+
+/*!
+ * \brief Only update the rows of the embeddings referenced by the batch, for
+ * the MOMENTUM and ADAM updaters. The state of the updater of the other
+ * rows is not decayed (lazy updates).
+ */
+struct lazy_updates : basic_conf_elt<lazy_updates_id> {};
+
+/*!
+ * \brief Stream the outputs of each layer during pretraining to a
+ * memory-mapped file, instead of keeping them in memory. The files are
+ * reused by the next pretraining when the weights and the input are the
+ * same (see dbn::pretrain_prefix). In batch mode, with pretrain_pipeline,
+ * the type is the storage of the outputs of the previous layers of the
+ * batches in flight.
+ * \tparam T The type used to store the outputs (float, double or bfloat16)
+ */
+template <typename T = float>
+struct pretrain_cache : type_conf_elt<pretrain_cache_id, T> {};
+
+/*!
+ * \brief Pipeline the pretraining of the layers: the next layer starts
+ * training as soon as a layer is trained, while the outputs of this layer
+ * are computed in the background. In batch mode, the outputs of the
+ * previous layers for the next batches are computed in the background while
+ * a layer trains on the current batch.
+ */
+struct pretrain_pipeline : basic_conf_elt<pretrain_pipeline_id> {};
+
+/*!
+ * \brief Back the large buffers with transparent huge pages, to reduce the
+ * misses of the TLB: the weights of the layers and the contexts of the SGD
+ * trainer for a network, the caches for a generator.
+ */
+struct huge_pages : basic_conf_elt<huge_pages_id> {};
+
+/*!
+ * \brief Pin the workers of the thread pool of the network to the cores of
+ * the machine, one per CPU, and the calling thread to all of them.
+ */
+struct pin_threads : basic_conf_elt<pin_threads_id> {};
+
+/*!
+ * \brief Dedicate the last physical cores of the machine to the producers
+ * of the generators used to train the network
+ * \tparam C The number of cores of the producers
+ */
+template <size_t C>
+struct producer_cores : value_conf_elt<producer_cores_id, size_t, C> {};
+
+/*!
+ * \brief Only place the threads on one hardware thread of each physical
+ * core, leaving the SMT siblings alone
+ */
+struct no_smt : basic_conf_elt<no_smt_id> {};
+
+/*!
+ * \brief Train the network through an asynchronous pipeline of stages
+ * (load, upload, compute), with the given number of batches in flight
+ * \tparam D The number of batches in flight
+ */
+template <size_t D = 3>
+struct staged_training : value_conf_elt<staged_training_id, size_t, D> {};
+
+/*!
+ * \brief Freeze the first layers of the network during the fine-tuning:
+ * they are only forwarded, neither their errors nor their gradients are
+ * computed and their weights are not updated
+ * \tparam N The number of frozen layers
+ */
+template <size_t N>
+struct frozen_layers : value_conf_elt<frozen_layers_id, size_t, N> {};
+
+/*!
+ * \brief Keep the training on the GPU: the weights, the states of the
+ * updater and the contexts of the SGD trainer stay resident on the device,
+ * the next batches are staged to the device while the current one is
+ * computed and the updates are computed with GPU expressions instead of
+ * the passes on the CPU. Without GPU support in ETL, this has no effect.
+ */
+struct gpu_resident : basic_conf_elt<gpu_resident_id> {};
+
+/*!
+ * \brief Synchronize the batch normalization over the ranks of the
+ * distributed training: the statistics of each batch and the sums of the
+ * backward pass are computed over the batches of all the ranks.
+ */
+struct sync_batch_norm : basic_conf_elt<sync_batch_norm_id> {};
+
 /*!
  * \brief Sets the visible unit type
  * \tparam VT The visible unit type
@@ -230,6 +390,13 @@ struct activation : value_conf_elt<activation_id, function, FT> {};
 template <loss_function FT>
 struct loss : value_conf_elt<loss_id, loss_function, FT> {};
 
+/*!
+ * \brief Sets the distribution of the negative classes of a sampled softmax
+ * \tparam S The sampler type
+ */
+template <sampler_type S>
+struct negative_sampler : value_conf_elt<negative_sampler_id, sampler_type, S> {};
+
 /*!
  * \brief Sets the output policy
  *
@@ -384,6 +551,47 @@ struct categorical : basic_conf_elt<categorical_id> {};
  */
 struct threaded : basic_conf_elt<threaded_id> {};
 
+/*!
+ * \brief Sets the number of producer threads of a threaded generator
+ * \tparam N The number of workers
+ */
+template <size_t N>
+struct workers : value_conf_elt<workers_id, size_t, N> {};
+
+/*!
+ * \brief Use a lock-free ring of batches between the producers and the
+ * consumer of a threaded generator
+ */
+struct lock_free : basic_conf_elt<lock_free_id> {};
+
+/*!
+ * \brief Read the next big batch in the background (out-of-memory
+ * generator only)
+ */
+struct prefetch : basic_conf_elt<prefetch_id> {};
+
+/*!
+ * \brief Shuffle only the order of the samples and gather the batches
+ * from the cache, instead of moving the samples in the cache (in-memory
+ * generator only)
+ */
+struct index_shuffle : basic_conf_elt<index_shuffle_id> {};
+
+/*!
+ * \brief Sets the type used to store the samples in the cache of the
+ * in-memory generators. The samples are converted and pre-transformed when
+ * the batches are materialized.
+ * \tparam T The storage type
+ */
+template <typename T>
+struct storage_type : type_conf_elt<storage_type_id, T> {};
+
+/*!
+ * \brief Store the categorical labels of a generator as class indices
+ * instead of one-hot vectors
+ */
+struct index_labels : basic_conf_elt<index_labels_id> {};
+
 /*!
  * \brief Sets the elastic distortion kernel
  * \tparam K The elastic distortion kernel
@@ -398,6 +606,13 @@ struct elastic_distortion : value_conf_elt<elastic_distortion_id, size_t, K> {};
 template <size_t N>
 struct noise : value_conf_elt<noise_id, size_t, N> {};
 
+/*!
+ * \brief Sets the type of noise
+ * \tparam C The type of corruption of the inputs
+ */
+template <corruption_type C>
+struct corruption : value_conf_elt<corruption_id, corruption_type, C> {};
+
 /*!
  * \brief Sets the prescaling factor
  * \tparam S The scaling factor
@@ -467,6 +682,23 @@ struct dbn_only : basic_conf_elt<dbn_only_id> {};
  */
 struct last_only : basic_conf_elt<last_only_id> {};
 
+/*!
+ * \brief Indicates that the sequences have variable lengths, padded with
+ * zero time steps at their end.
+ *
+ * Each time step is only computed for the sequences still active and the
+ * padded steps repeat the last output of their sequence.
+ */
+struct variable_length : basic_conf_elt<variable_length_id> {};
+
+/*!
+ * \brief Backpropagate through time the slices of the batch of a recurrent
+ * layer in parallel, on the workers of the scoped thread pool, and compute
+ * the gradients of the weights after the recurrence, with one product over
+ * all the time steps.
+ */
+struct parallel_bptt : basic_conf_elt<parallel_bptt_id> {};
+
 /*!
  * \brief Do nothing (for TMP)
  */
@@ -477,6 +709,12 @@ struct nop : basic_conf_elt<nop_id> {};
  */
 struct no_bias : basic_conf_elt<no_bias_id> {};
 
+/*!
+ * \brief Use sparse kernels for the input of the layer, when the batches
+ * are sparse enough (see sparse_max_density)
+ */
+struct sparse_input : basic_conf_elt<sparse_input_id> {};
+
 /*!
  * \brief Use batch mode in DBN (Do not process the complete dataset at once)
  */
@@ -489,6 +727,43 @@ struct batch_mode : basic_conf_elt<batch_mode_id> {};
 template <size_t T>
 struct truncate : value_conf_elt<truncate_id, size_t, T> {};
 
+/*!
+ * \brief Sets the number of groups of a convolutional layer. The
+ * channels and the filters are split in G independent convolutions.
+ * \tparam G The number of groups
+ */
+template <size_t G>
+struct groups : value_conf_elt<groups_id, size_t, G> {};
+
+/*!
+ * \brief Sets the strides of a 'same' convolutional layer, the output
+ * having ceil(NV1 / S1) x ceil(NV2 / S2) pixels.
+ * \tparam S1 The vertical stride
+ * \tparam S2 The horizontal stride
+ */
+template <size_t S1, size_t S2 = S1>
+struct strides : value_pair_conf_elt<strides_id, size_t, S1, S2> {};
+
+/*!
+ * \brief Keep the lowered input of the training forward pass of a 'same'
+ * convolutional layer to compute the gradients of the filters, instead of
+ * lowering the input again. The lowering of the whole batch is stored in
+ * the layer.
+ * \tparam T The type used to store the lowered input (float, double or bfloat16)
+ */
+template <typename T = float>
+struct keep_lowered : type_conf_elt<keep_lowered_id, T> {};
+
+/*!
+ * \brief Split the outputs of a dense layer in S shards of contiguous
+ * columns of the weights, computed by the workers of the thread pool of the
+ * network (model parallelism), for the very wide layers. Each shard keeps
+ * its own copy of its columns of the weights.
+ * \tparam S The number of shards (0 for the number of threads)
+ */
+template <size_t S = 0>
+struct model_parallel : value_conf_elt<model_parallel_id, size_t, S> {};
+
 /*!
  * \brief Conditional shuffle (shuffle if Cond = true)
  */
@@ -0,0 +1,173 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "etl/etl.hpp"
+
+#include "neural_layer.hpp"
+#include "util/conv_1d.hpp"
+#include "util/epilogue.hpp"
+#include "util/timers.hpp"
+#include "util/workspace.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Base class for the 1D convolutional layers (fast / dynamic).
+ *
+ * The sequences are time-major with the channels last (L x C), as the
+ * output of the embedding and recurrent layers, and so is the output
+ * (L - NW + 1 x K). The filters are stored as (NW x C x K).
+ */
+template <typename Derived, typename Desc>
+struct base_conv_1d_layer : neural_layer<Derived, Desc> {
+    using desc      = Desc;                                ///< The descriptor of the layer
+    using derived_t = Derived;                             ///< The derived type (CRTP)
+    using weight    = typename desc::weight;               ///< The data type for this layer
+    using this_type = base_conv_1d_layer<derived_t, desc>; ///< The type of this layer
+    using base_type = neural_layer<Derived, Desc>;         ///< The base type
+
+    static constexpr auto activation_function = desc::activation_function;                           ///< The layer's activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+
+    workspace* arena = nullptr; ///< The workspace shared by the layers of the network
+
+    /*!
+     * \brief Initialize the 1D convolutional layer
+     */
+    base_conv_1d_layer() : base_type() {
+        // Nothing to init here
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template <typename C>
+    void adapt_errors(C& context) const {
+        dll::auto_timer timer("conv_1d:adapt_errors");
+
+        if constexpr (activation_function != function::IDENTITY) {
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
+    }
+
+    /*!
+     * \brief Use the given workspace for the temporaries of the GEMM kernels
+     * \param ws The workspace shared by the layers of the network
+     */
+    void set_workspace(workspace* ws) {
+        arena = ws;
+    }
+
+    /*!
+     * \brief Returns the size, in bytes, of the workspace needed by the
+     * layer. The temporaries depend on the batch size, the workspace grows
+     * on the first use instead.
+     */
+    size_t workspace_size() const {
+        return 0;
+    }
+
+protected:
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param output A batch of output that will be filled
+     * \param v A batch of input
+     */
+    template <typename H1, typename V>
+    void forward_batch_impl(H1&& output, const V& v, size_t nv, size_t nc, size_t k, size_t nw) const {
+        static_assert(etl::is_dma<V>, "The input of the 1D convolutional layers must have direct memory access");
+        static_assert(etl::is_dma<std::decay_t<H1>>, "The output of the 1D convolutional layers must have direct memory access");
+
+        auto& w = as_derived().w;
+
+        v.ensure_cpu_up_to_date();
+        w.ensure_cpu_up_to_date();
+
+        conv_1d_forward(v.memory_start(), w.memory_start(), output.memory_start(), etl::dim<0>(v), nv, nc, k, nw, arena);
+
+        output.invalidate_gpu();
+
+        if constexpr (!no_bias && fused_epilogue<activation_function>) {
+            bias_activate_last<activation_function>(output, as_derived().b);
+        } else {
+            if constexpr (!no_bias) {
+                bias_activate_last<function::IDENTITY>(output, as_derived().b);
+            }
+
+            if constexpr (activation_function != function::IDENTITY) {
+                output = f_activate<activation_function>(output);
+            }
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template <typename H, typename C>
+    void backward_batch_impl(H&& output, C& context, size_t nv, size_t nc, size_t k, size_t nw) const {
+        auto& w = as_derived().w;
+
+        context.errors.ensure_cpu_up_to_date();
+        w.ensure_cpu_up_to_date();
+        output.ensure_cpu_up_to_date();
+
+        conv_1d_backward(context.errors.memory_start(), w.memory_start(), output.memory_start(), etl::dim<0>(context.errors), nv, nc, k, nw, arena);
+
+        output.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template <typename C>
+    void compute_gradients_impl(C& context, size_t nv, size_t nc, size_t k, size_t nw) const {
+        const size_t B = etl::dim<0>(context.input);
+
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+
+        context.input.ensure_cpu_up_to_date();
+        context.errors.ensure_cpu_up_to_date();
+        w_grad.ensure_cpu_up_to_date();
+
+        conv_1d_backward_filter(context.input.memory_start(), context.errors.memory_start(), w_grad.memory_start(), B, nv, nc, k, nw, arena);
+
+        w_grad.invalidate_gpu();
+
+        if constexpr (!no_bias) {
+            auto& b_grad = std::get<1>(context.up.context)->grad;
+
+            b_grad.ensure_cpu_up_to_date();
+
+            conv_1d_backward_bias(context.errors.memory_start(), b_grad.memory_start(), B * (nv - nw + 1), k);
+
+            b_grad.invalidate_gpu();
+        }
+    }
+
+private:
+    //CRTP Deduction
+
+    /*!
+     * \brief Returns a reference to the derived object, i.e. the object using the CRTP injector.
+     * \return a reference to the derived object.
+     */
+    const derived_t& as_derived() const {
+        return *static_cast<const derived_t*>(this);
+    }
+};
+
+} //end of dll namespace
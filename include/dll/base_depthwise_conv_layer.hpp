@@ -0,0 +1,290 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <fstream>
+
+#include "cpp_utils/assert.hpp" //Assertions
+#include "cpp_utils/io.hpp"     // For binary writing
+
+#include "etl/etl.hpp"
+
+#include "layer.hpp"
+#include "layer_traits.hpp"
+#include "util/tmp.hpp"
+#include "util/depthwise.hpp"
+#include "util/epilogue.hpp"
+#include "util/timers.hpp"
+#include "util/workspace.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Base class for the depthwise-separable convolutional layers (fast
+ * / dynamic).
+ *
+ * The input is first convolved (valid) channel by channel, each channel
+ * with its own filter (w), and then mixed by a pointwise (1x1) convolution
+ * (u), computed as one GEMM per sample. The intermediate depthwise output
+ * is taken from the workspace of the network.
+ */
+template <typename Derived, typename Desc>
+struct base_depthwise_conv_layer : layer<Derived> {
+    using desc      = Desc;                                       ///< The descriptor of the layer
+    using derived_t = Derived;                                    ///< The derived type (CRTP)
+    using weight    = typename desc::weight;                      ///< The data type for this layer
+    using this_type = base_depthwise_conv_layer<derived_t, desc>; ///< The type of this layer
+    using base_type = layer<Derived>;                             ///< The base type
+
+    static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+
+    workspace* arena = nullptr; ///< The workspace shared by the layers of the network
+
+    /*!
+     * \brief Initialize the depthwise layer
+     */
+    base_depthwise_conv_layer() : base_type() {
+        // Nothing to init here
+    }
+
+    base_depthwise_conv_layer(const base_depthwise_conv_layer& rhs) = delete;
+    base_depthwise_conv_layer(base_depthwise_conv_layer&& rhs)      = delete;
+
+    base_depthwise_conv_layer& operator=(const base_depthwise_conv_layer& rhs) = delete;
+    base_depthwise_conv_layer& operator=(base_depthwise_conv_layer&& rhs) = delete;
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template <typename C>
+    void adapt_errors(C& context) const {
+        dll::auto_timer timer("depthwise_conv:adapt_errors");
+
+        if constexpr (activation_function != function::IDENTITY) {
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
+    }
+
+    /*!
+     * \brief Use the given workspace for the intermediate depthwise output
+     * \param ws The workspace shared by the layers of the network
+     */
+    void set_workspace(workspace* ws) {
+        arena = ws;
+    }
+
+    /*!
+     * \brief Returns the size, in bytes, of the workspace needed by the
+     * layer. The intermediate output depends on the batch size, the
+     * workspace grows on the first use instead.
+     */
+    size_t workspace_size() const {
+        return 0;
+    }
+
+    /*!
+     * \brief Backup the weights in the secondary weights matrix
+     */
+    void backup_weights() {
+        unique_safe_get(as_derived().bak_w) = as_derived().w;
+        unique_safe_get(as_derived().bak_u) = as_derived().u;
+        unique_safe_get(as_derived().bak_b) = as_derived().b;
+    }
+
+    /*!
+     * \brief Restore the weights from the secondary weights matrix
+     */
+    void restore_weights() {
+        as_derived().w = *as_derived().bak_w;
+        as_derived().u = *as_derived().bak_u;
+        as_derived().b = *as_derived().bak_b;
+    }
+
+    /*!
+     * \brief Swap the weights with the secondary weights matrix, restoring
+     * the backup in constant time. The secondary weights matrix holds the
+     * replaced weights afterwards.
+     */
+    void swap_weights() {
+        std::swap(as_derived().w, *as_derived().bak_w);
+        std::swap(as_derived().u, *as_derived().bak_u);
+        std::swap(as_derived().b, *as_derived().bak_b);
+    }
+
+    /*!
+     * \brief Load the weigts into the given stream
+     */
+    void store(std::ostream& os) const {
+        cpp::binary_write_all(os, as_derived().w);
+        cpp::binary_write_all(os, as_derived().u);
+        cpp::binary_write_all(os, as_derived().b);
+    }
+
+    /*!
+     * \brief Load the weigts from the given stream
+     */
+    void load(std::istream& is) {
+        cpp::binary_load_all(is, as_derived().w);
+        cpp::binary_load_all(is, as_derived().u);
+        cpp::binary_load_all(is, as_derived().b);
+    }
+
+    /*!
+     * \brief Load the weigts into the given file
+     */
+    void store(const std::string& file) const {
+        std::ofstream os(file, std::ofstream::binary);
+        store(os);
+    }
+
+    /*!
+     * \brief Load the weigts from the given file
+     */
+    void load(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+        load(is);
+    }
+
+    /*!
+     * \brief Returns the trainable variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) trainable_parameters() {
+        return std::make_tuple(std::ref(as_derived().w), std::ref(as_derived().u), std::ref(as_derived().b));
+    }
+
+    /*!
+     * \brief Returns the trainable variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) trainable_parameters() const {
+        return std::make_tuple(std::cref(as_derived().w), std::cref(as_derived().u), std::cref(as_derived().b));
+    }
+
+protected:
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param output A batch of output that will be filled
+     * \param v A batch of input
+     */
+    template <typename H1, typename V>
+    void forward_batch_impl(H1&& output, const V& v, size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2) const {
+        static_assert(etl::is_dma<V>, "The input of the depthwise layers must have direct memory access");
+
+        const size_t B = etl::dim<0>(v);
+        const size_t S = (nv1 - nw1 + 1) * (nv2 - nw2 + 1);
+
+        auto& w = as_derived().w;
+
+        v.ensure_cpu_up_to_date();
+        w.ensure_cpu_up_to_date();
+        output.ensure_cpu_up_to_date();
+
+        workspace_lease<weight> d(arena, B * nc * S);
+
+        depthwise_forward(v.memory_start(), w.memory_start(), d.data(), B, nc, nv1, nv2, nw1, nw2);
+        pointwise_forward(d.data(), as_derived().u, output.memory_start(), B, nc, k, S);
+
+        output.invalidate_gpu();
+
+        if constexpr (fused_epilogue<activation_function> && etl::is_dma<std::decay_t<H1>>) {
+            bias_activate_4d<activation_function>(output, as_derived().b);
+        } else {
+            output = bias_add_4d(output, as_derived().b);
+            output = f_activate<activation_function>(output);
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template <typename H, typename C>
+    void backward_batch_impl(H&& output, C& context, size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2) const {
+        const size_t B = etl::dim<0>(context.errors);
+        const size_t S = (nv1 - nw1 + 1) * (nv2 - nw2 + 1);
+
+        auto& w = as_derived().w;
+
+        context.errors.ensure_cpu_up_to_date();
+        w.ensure_cpu_up_to_date();
+        output.ensure_cpu_up_to_date();
+
+        workspace_lease<weight> d_errors(arena, B * nc * S);
+
+        pointwise_backward(context.errors.memory_start(), as_derived().u, d_errors.data(), B, nc, k, S);
+        depthwise_backward(d_errors.data(), w.memory_start(), output.memory_start(), B, nc, nv1, nv2, nw1, nw2);
+
+        output.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any.
+     *
+     * The intermediate depthwise output is computed again, which is cheap
+     * compared to the pointwise convolution, rather than kept by the
+     * layer between the forward and backward passes.
+     *
+     * \param context The trainng context
+     */
+    template <typename C>
+    void compute_gradients_impl(C& context, size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2) const {
+        const size_t B = etl::dim<0>(context.input);
+        const size_t S = (nv1 - nw1 + 1) * (nv2 - nw2 + 1);
+
+        auto& w      = as_derived().w;
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+
+        context.input.ensure_cpu_up_to_date();
+        context.errors.ensure_cpu_up_to_date();
+        w.ensure_cpu_up_to_date();
+        w_grad.ensure_cpu_up_to_date();
+
+        workspace_lease<weight> tmp(arena, 2 * B * nc * S);
+
+        weight* d        = tmp.data();
+        weight* d_errors = tmp.data() + B * nc * S;
+
+        depthwise_forward(context.input.memory_start(), w.memory_start(), d, B, nc, nv1, nv2, nw1, nw2);
+        pointwise_backward_filter(d, context.errors.memory_start(), std::get<1>(context.up.context)->grad, B, nc, k, S);
+
+        pointwise_backward(context.errors.memory_start(), as_derived().u, d_errors, B, nc, k, S);
+        depthwise_backward_filter(context.input.memory_start(), d_errors, w_grad.memory_start(), B, nc, nv1, nv2, nw1, nw2);
+
+        w_grad.invalidate_gpu();
+
+        std::get<2>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+    }
+
+private:
+    //CRTP Deduction
+
+    /*!
+     * \brief Returns a reference to the derived object, i.e. the object using the CRTP injector.
+     * \return a reference to the derived object.
+     */
+    derived_t& as_derived() {
+        return *static_cast<derived_t*>(this);
+    }
+
+    /*!
+     * \brief Returns a reference to the derived object, i.e. the object using the CRTP injector.
+     * \return a reference to the derived object.
+     */
+    const derived_t& as_derived() const {
+        return *static_cast<const derived_t*>(this);
+    }
+};
+
+} //end of dll namespace
@@ -17,6 +17,10 @@
 #include "layer.hpp"
 #include "layer_traits.hpp"
 #include "util/tmp.hpp"
+#include "util/lstm.hpp"
+#include "util/memory.hpp"
+#include "util/sequence_packing.hpp"
+#include "util/timers.hpp"
 
 namespace dll {
 
@@ -31,7 +35,23 @@ struct base_lstm_layer : layer<Derived> {
     using this_type = base_lstm_layer<derived_t, desc>; ///< The type of this layer
     using base_type = layer<Derived>;                          ///< The base type
 
-    static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+    static constexpr auto activation_function = desc::activation_function;                         ///< The layer's activation function
+    static constexpr bool packed_sequences    = desc::parameters::template contains<variable_length>(); ///< Indicates if the sequences have variable lengths
+    static constexpr bool sparse_last_step    = !packed_sequences;                                       ///< Indicates if the errors of the last time step can be backpropagated alone
+    static constexpr bool deferred_gradients  = desc::parameters::template contains<parallel_bptt>();    ///< Indicates if the gradients of the weights are computed after the recurrence
+
+    static_assert(!packed_sequences || fused_epilogue<activation_function>,
+                  "The variable-length sequences only support element-wise activation functions");
+
+    mutable lstm_fused_weights<weight> fused;           ///< The concatenated weights of the four gates
+    mutable lstm_train_cache<weight> cache;             ///< The state of the training forward pass
+    mutable lstm_backward_cache<weight> backward_cache; ///< The temporaries of the backward pass
+    mutable sequence_packing packing;                   ///< The packing of the batch of the training forward pass
+    mutable lstm_gate_errors<weight> gate_errors;       ///< The sums of the errors of the gates, for the deferred gradients
+
+    workspace* arena = nullptr; ///< The workspace shared by the layers of the network
+
+    lstm_stream_state<weight> stream; ///< The state carried by the streaming inference
 
     /*!
      * \brief Initialize the neural layer
@@ -47,6 +67,79 @@ struct base_lstm_layer : layer<Derived> {
     base_lstm_layer& operator=(const base_lstm_layer& rhs) = delete;
     base_lstm_layer& operator=(base_lstm_layer&& rhs) = delete;
 
+    /*!
+     * \brief Compute the output of the new time steps of the given batch,
+     * for streaming inference.
+     *
+     * The computation starts from the state left by the previous call, or
+     * from a zero state after reset_state(), and the state is updated with
+     * the new time steps. Feeding the time steps of a window in several
+     * calls gives the same output as the full window.
+     *
+     * \param output The output of the new time steps (Batch x n x hidden_units)
+     * \param x The new time steps of the input (Batch x n x sequence_length)
+     */
+    template <typename H, typename V>
+    void stream_batch(H&& output, const V& x) {
+        dll::auto_timer timer("lstm:stream_batch");
+
+        cpp_assert(etl::dim<0>(output) == etl::dim<0>(x), "The number of samples must be consistent");
+
+        fused.update(as_derived());
+
+        lstm_stream_forward<activation_function>(output, x, fused, stream);
+    }
+
+    /*!
+     * \brief Reset the state of the streaming inference to zero
+     */
+    void reset_state() {
+        stream.reset();
+    }
+
+    /*!
+     * \brief Use the given workspace for the temporaries of the inference
+     * \param ws The workspace shared by the layers of the network
+     */
+    void set_workspace(workspace* ws) {
+        arena = ws;
+    }
+
+    /*!
+     * \brief Returns the size, in bytes, of the workspace needed by the
+     * layer. The temporaries depend on the batch size, the workspace grows
+     * on the first use instead.
+     */
+    size_t workspace_size() const {
+        return 0;
+    }
+
+    /*!
+     * \brief Returns the number of bytes of the backups of the weights
+     */
+    size_t backup_bytes() const {
+        auto& d = as_derived();
+
+        return memory_bytes(std::tie(d.bak_w_i, d.bak_u_i, d.bak_b_i, d.bak_w_g, d.bak_u_g, d.bak_b_g,
+                                     d.bak_w_f, d.bak_u_f, d.bak_b_f, d.bak_w_o, d.bak_u_o, d.bak_b_o));
+    }
+
+    /*!
+     * \brief Returns the number of bytes of the caches of the layer (fused
+     * weights, training forward and backward passes, streaming state)
+     */
+    size_t cache_bytes() const {
+        auto& c  = cache;
+        auto& bc = backward_cache;
+
+        return memory_bytes(std::tie(fused.u, fused.w, fused.b))
+               + memory_bytes(std::tie(c.x_t, c.i_t, c.f_t, c.g_t, c.o_t, c.s_t, c.h_t, c.x_proj, c.rec))
+               + memory_bytes(std::tie(bc.delta_t, bc.d_h_t, bc.d_c_t, bc.d_x_t, bc.d_h_i_t, bc.d_h_f_t, bc.d_h_c_t, bc.d_h_o_t, bc.d_gates))
+               + memory_bytes(std::tie(gate_errors.i_t, gate_errors.f_t, gate_errors.g_t, gate_errors.o_t))
+               + memory_bytes(std::tie(packing.order, packing.lengths, packing.active))
+               + memory_bytes(std::tie(stream.h, stream.s));
+    }
+
     /*!
      * \brief Backup the weights in the secondary weights matrix
      */
@@ -81,6 +174,30 @@ struct base_lstm_layer : layer<Derived> {
         as_derived().w_o = *as_derived().bak_w_o;
         as_derived().u_o = *as_derived().bak_u_o;
         as_derived().b_o = *as_derived().bak_b_o;
+
+        fused.invalidate();
+    }
+
+    /*!
+     * \brief Swap the weights with the secondary weights matrix, restoring
+     * the backup in constant time. The secondary weights matrix holds the
+     * replaced weights afterwards.
+     */
+    void swap_weights() {
+        std::swap(as_derived().w_i, *as_derived().bak_w_i);
+        std::swap(as_derived().u_i, *as_derived().bak_u_i);
+        std::swap(as_derived().b_i, *as_derived().bak_b_i);
+        std::swap(as_derived().w_g, *as_derived().bak_w_g);
+        std::swap(as_derived().u_g, *as_derived().bak_u_g);
+        std::swap(as_derived().b_g, *as_derived().bak_b_g);
+        std::swap(as_derived().w_f, *as_derived().bak_w_f);
+        std::swap(as_derived().u_f, *as_derived().bak_u_f);
+        std::swap(as_derived().b_f, *as_derived().bak_b_f);
+        std::swap(as_derived().w_o, *as_derived().bak_w_o);
+        std::swap(as_derived().u_o, *as_derived().bak_u_o);
+        std::swap(as_derived().b_o, *as_derived().bak_b_o);
+
+        fused.invalidate();
     }
 
     /*!
@@ -117,6 +234,8 @@ struct base_lstm_layer : layer<Derived> {
         cpp::binary_load_all(is, as_derived().w_o);
         cpp::binary_load_all(is, as_derived().u_o);
         cpp::binary_load_all(is, as_derived().b_o);
+
+        fused.invalidate();
     }
 
     /*!
@@ -140,6 +259,9 @@ struct base_lstm_layer : layer<Derived> {
      * \return a tuple containing references to the variables of this layer
      */
     decltype(auto) trainable_parameters() {
+        // The parameters may be modified through the references
+        fused.invalidate();
+
         return std::make_tuple(
             std::ref(as_derived().w_i), std::ref(as_derived().u_i), std::ref(as_derived().b_i),
             std::ref(as_derived().w_g), std::ref(as_derived().u_g), std::ref(as_derived().b_g),
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <fstream>
+#include <utility>
 
 #include "cpp_utils/assert.hpp" //Assertions
 #include "cpp_utils/io.hpp"     // For binary writing
@@ -17,6 +18,10 @@
 #include "layer.hpp"
 #include "layer_traits.hpp"
 #include "util/tmp.hpp"
+#include "util/memory.hpp"
+#include "util/model_parallel.hpp" // for gather_columns and scatter_columns
+#include "util/sequence_packing.hpp"
+#include "util/timers.hpp"
 
 namespace dll {
 
@@ -31,7 +36,10 @@ struct base_rnn_layer : layer<Derived> {
     using this_type = base_rnn_layer<derived_t, desc>; ///< The type of this layer
     using base_type = layer<Derived>;                  ///< The base type
 
-    static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+    static constexpr auto activation_function = desc::activation_function;                         ///< The layer's activation function
+    static constexpr bool packed_sequences    = desc::parameters::template contains<variable_length>(); ///< Indicates if the sequences have variable lengths
+    static constexpr bool sparse_last_step    = !packed_sequences;                                       ///< Indicates if the errors of the last time step can be backpropagated alone
+    static constexpr bool parallel_bptt       = desc::parameters::template contains<dll::parallel_bptt>(); ///< Indicates if the batch is backpropagated in parallel slices
 
     /*!
      * \brief Initialize the neural layer
@@ -47,11 +55,80 @@ struct base_rnn_layer : layer<Derived> {
     base_rnn_layer& operator=(const base_rnn_layer& rhs) = delete;
     base_rnn_layer& operator=(base_rnn_layer&& rhs) = delete;
 
-    mutable etl::dyn_matrix<float, 3> x_t;
-    mutable etl::dyn_matrix<float, 3> s_t;
+    mutable etl::dyn_matrix<float, 3> x_t; ///< The input of the training forward pass, time major
+    mutable etl::dyn_matrix<float, 3> s_t; ///< The state of the training forward pass, time major
+    mutable sequence_packing packing;      ///< The packing of the batch of the training forward pass
 
+    etl::dyn_matrix<float, 2> stream_s; ///< The state of the last time step of the streaming inference
+    bool stream_started = false;        ///< Indicates if the streaming inference has a state
+
+    /*!
+     * \brief Compute the output of the new time steps of the given batch,
+     * for streaming inference.
+     *
+     * The computation starts from the state left by the previous call, or
+     * from a zero state after reset_state(), and the state is updated with
+     * the new time steps. Feeding the time steps of a window in several
+     * calls gives the same output as the full window.
+     *
+     * \param output The output of the new time steps (Batch x n x hidden_units)
+     * \param x The new time steps of the input (Batch x n x sequence_length)
+     */
+    template <typename H, typename V>
+    void stream_batch(H&& output, const V& x) {
+        dll::auto_timer timer("rnn:stream_batch");
+
+        const auto& w = as_derived().w;
+        const auto& u = as_derived().u;
+        const auto& b = as_derived().b;
+
+        const size_t Batch = etl::dim<0>(x);
+        const size_t N     = etl::dim<1>(x);
+
+        cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
+        cpp_assert(!stream_started || etl::dim<0>(stream_s) == Batch, "The batch size cannot change while streaming");
+
+        etl::dyn_matrix<float, 2> x_s(Batch, etl::dim<0>(u));
+        etl::dyn_matrix<float, 2> s_new(Batch, etl::dim<1>(u));
+
+        if (!stream_started) {
+            stream_s = etl::dyn_matrix<float, 2>(Batch, etl::dim<1>(u));
+        }
+
+        for (size_t t = 0; t < N; ++t) {
+            for (size_t i = 0; i < Batch; ++i) {
+                x_s(i) = x(i)(t);
+            }
+
+            if (stream_started) {
+                s_new = f_activate<activation_function>(bias_add_2d(x_s * u + stream_s * w, b));
+            } else {
+                s_new = f_activate<activation_function>(bias_add_2d(x_s * u, b));
+            }
+
+            std::swap(stream_s, s_new);
+
+            stream_started = true;
+
+            for (size_t i = 0; i < Batch; ++i) {
+                output(i)(t) = stream_s(i);
+            }
+        }
+    }
+
+    /*!
+     * \brief Reset the state of the streaming inference to zero
+     */
+    void reset_state() {
+        stream_started = false;
+    }
+
+    /*!
+     * \brief Make sure the state of the training forward pass is allocated
+     * for the given batch size
+     */
     void prepare_cache(size_t Batch, size_t time_steps, size_t sequence_length, size_t hidden_units) const {
-        if (cpp_unlikely(!x_t.memory_start())) {
+        if (cpp_unlikely(!x_t.memory_start() || etl::dim<1>(x_t) != Batch)) {
             x_t.resize(time_steps, Batch, sequence_length);
             s_t.resize(time_steps, Batch, hidden_units);
         }
@@ -71,11 +148,13 @@ struct base_rnn_layer : layer<Derived> {
 
         prepare_cache(Batch, time_steps, sequence_length, hidden_units);
 
+        packing.pack(x, packed_sequences);
+
         // 1. Rearrange input
 
         for (size_t b = 0; b < Batch; ++b) {
             for (size_t t = 0; t < time_steps; ++t) {
-                x_t(t)(b) = x(b)(t);
+                x_t(t)(b) = x(packing.order[b])(t);
             }
         }
 
@@ -86,15 +165,97 @@ struct base_rnn_layer : layer<Derived> {
         s_t(0) = f_activate<activation_function>(bias_add_2d(x_t(0) * u, b));
 
         for (size_t t = 1; t < time_steps; ++t) {
-            s_t(t) = f_activate<activation_function>(bias_add_2d(x_t(t) * u + s_t(t - 1) * w, b));
+            const size_t active = packing.active[t];
+
+            if (active == Batch) {
+                s_t(t) = f_activate<activation_function>(bias_add_2d(x_t(t) * u + s_t(t - 1) * w, b));
+            } else {
+                // Only the still active rows are computed, the others repeat their last state
+                x_t.ensure_cpu_up_to_date();
+                s_t.ensure_cpu_up_to_date();
+
+                float* s_prev = s_t.memory_start() + (t - 1) * Batch * hidden_units;
+                float* s_cur  = s_prev + Batch * hidden_units;
+
+                if (active) {
+                    etl::custom_dyn_matrix<float, 2> x_a(x_t.memory_start() + t * Batch * sequence_length, active, sequence_length);
+                    etl::custom_dyn_matrix<float, 2> s_a(s_prev, active, hidden_units);
+                    etl::custom_dyn_matrix<float, 2> s_c(s_cur, active, hidden_units);
+
+                    s_c = f_activate<activation_function>(bias_add_2d(x_a * u + s_a * w, b));
+                }
+
+                carry_rows(s_cur, s_prev, active, Batch, hidden_units);
+
+                s_t.invalidate_gpu();
+            }
         }
 
         // 3. Rearrange the output
 
         for (size_t b = 0; b < Batch; ++b) {
             for (size_t t = 0; t < time_steps; ++t) {
-                output(b)(t) = s_t(t)(b);
+                output(packing.order[b])(t) = s_t(t)(b);
+            }
+        }
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, for inference.
+     *
+     * Only the state of the previous time step is kept, nothing is stored
+     * in the layer, so the layer can be used from several threads.
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     * \param w The W weights matrix
+     * \param u The U weights matrix
+     */
+    template <typename H, typename V, typename W, typename U, typename B>
+    void test_forward_batch_impl(H&& output, const V& x, const W& w, const U& u, const B& b, size_t time_steps, size_t sequence_length, size_t hidden_units) const {
+        const auto Batch = etl::dim<0>(x);
+
+        sequence_packing sequences;
+        sequences.pack(x, packed_sequences);
+
+        etl::dyn_matrix<float, 2> x_s(Batch, sequence_length);
+        etl::dyn_matrix<float, 2> s_prev(Batch, hidden_units);
+        etl::dyn_matrix<float, 2> s_cur(Batch, hidden_units);
+
+        for (size_t t = 0; t < time_steps; ++t) {
+            const size_t active = sequences.active[t];
+
+            for (size_t b = 0; b < Batch; ++b) {
+                x_s(b) = x(sequences.order[b])(t);
             }
+
+            if (t == 0) {
+                s_cur = f_activate<activation_function>(bias_add_2d(x_s * u, b));
+            } else if (active == Batch) {
+                s_cur = f_activate<activation_function>(bias_add_2d(x_s * u + s_prev * w, b));
+            } else {
+                // Only the still active rows are computed, the others repeat their last state
+                x_s.ensure_cpu_up_to_date();
+                s_prev.ensure_cpu_up_to_date();
+
+                if (active) {
+                    etl::custom_dyn_matrix<float, 2> x_a(x_s.memory_start(), active, sequence_length);
+                    etl::custom_dyn_matrix<float, 2> s_a(s_prev.memory_start(), active, hidden_units);
+                    etl::custom_dyn_matrix<float, 2> s_c(s_cur.memory_start(), active, hidden_units);
+
+                    s_c = f_activate<activation_function>(bias_add_2d(x_a * u + s_a * w, b));
+                }
+
+                carry_rows(s_cur.memory_start(), s_prev.memory_start(), active, Batch, hidden_units);
+
+                s_cur.invalidate_gpu();
+            }
+
+            for (size_t b = 0; b < Batch; ++b) {
+                output(sequences.order[b])(t) = s_cur(b);
+            }
+
+            std::swap(s_prev, s_cur);
         }
     }
 
@@ -109,16 +270,29 @@ struct base_rnn_layer : layer<Derived> {
 
         const size_t Batch = etl::dim<0>(context.errors);
 
-        etl::dyn_matrix<float, 3> delta_t(time_steps, Batch, hidden_units);
+        // Only the last time step of the errors is used by the next layer,
+        // its errors are injected in d_h_t and the other ones are not read
+        constexpr bool sparse = C::last_step_errors;
+
+        etl::dyn_matrix<float, 3> delta_t(sparse ? 1 : time_steps, Batch, hidden_units);
         etl::dyn_matrix<float, 3> d_h_t(time_steps, Batch, hidden_units);
         etl::dyn_matrix<float, 3> d_x_t(time_steps, Batch, sequence_length);
 
         // 1. Rearrange errors
 
-        for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                delta_t(t)(b) = context.errors(b)(t);
+        if constexpr (sparse) {
+            for (size_t b = 0; b < Batch; ++b) {
+                delta_t(0)(b) = context.errors(packing.order[b])(time_steps - 1);
+            }
+        } else {
+            for (size_t b = 0; b < Batch; ++b) {
+                for (size_t t = 0; t < time_steps; ++t) {
+                    delta_t(t)(b) = context.errors(packing.order[b])(t);
+                }
             }
+
+            // The padded steps repeat the last state, their errors are its errors
+            fold_padded_errors(delta_t, packing);
         }
 
         // 2. Get the gradients from the context
@@ -127,12 +301,50 @@ struct base_rnn_layer : layer<Derived> {
         auto& u_grad = std::get<1>(context.up.context)->grad;
         auto& b_grad = std::get<2>(context.up.context)->grad;
 
-        w_grad = 0;
-        u_grad = 0;
-        b_grad = 0;
-
         // 3. Backpropagation through time
 
+        auto* pool = parallel_bptt ? scoped_thread_pool() : nullptr;
+
+        if (pool && Batch > 1) {
+            parallel_bptt_impl<sparse>(*pool, delta_t, d_x_t, w_grad, u_grad, b_grad, w, u, time_steps, sequence_length, hidden_units, bptt_steps);
+        } else {
+            w_grad = 0;
+            u_grad = 0;
+            b_grad = 0;
+
+            bptt_impl<sparse>(delta_t, s_t, d_h_t, d_x_t, w, u, time_steps, bptt_steps, [&](size_t t, auto&& d_h) {
+                if (t > 0) {
+                    w_grad += etl::batch_outer(s_t(t - 1), d_h);
+                }
+
+                u_grad += etl::batch_outer(x_t(t), d_h);
+                b_grad += etl::bias_batch_sum_2d(d_h);
+            });
+        }
+
+        // 3. Rearrange for the output
+
+        if (direct) {
+            for (size_t b = 0; b < Batch; ++b) {
+                for (size_t t = 0; t < time_steps; ++t) {
+                    output(packing.order[b])(t) = d_x_t(t)(b);
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors through time.
+     *
+     * \param delta_t The errors of the output (time major)
+     * \param s The states of the forward pass (time major)
+     * \param d_h_t The errors of the states (time major)
+     * \param d_x_t The gradients of the input (time major)
+     * \param gradients Functor called with each time step and the errors of
+     * its state, to compute the gradients of the weights
+     */
+    template <bool Sparse, typename D, typename S, typename X, typename W, typename U, typename G>
+    void bptt_impl(const D& delta_t, const S& s, D& d_h_t, X& d_x_t, const W& w, const U& u, size_t time_steps, size_t bptt_steps, G&& gradients) const {
         size_t ttt = time_steps - 1;
 
         do {
@@ -143,17 +355,14 @@ struct base_rnn_layer : layer<Derived> {
                 const size_t t = tt;
 
                 if(t == time_steps - 1){
-                    d_h_t(t) = delta_t(t) >> f_derivative<activation_function>(s_t(t));
+                    d_h_t(t) = delta_t(Sparse ? 0 : t) >> f_derivative<activation_function>(s(t));
+                } else if constexpr (Sparse) {
+                    d_h_t(t) = d_h_t(t + 1) >> f_derivative<activation_function>(s(t));
                 } else {
-                    d_h_t(t) = (delta_t(t) + d_h_t(t + 1)) >> f_derivative<activation_function>(s_t(t));
-                }
-
-                if (t > 0) {
-                    w_grad += etl::batch_outer(s_t(t - 1), d_h_t(t));
+                    d_h_t(t) = (delta_t(t) + d_h_t(t + 1)) >> f_derivative<activation_function>(s(t));
                 }
 
-                u_grad += etl::batch_outer(x_t(t), d_h_t(t));
-                b_grad += etl::bias_batch_sum_2d(d_h_t(t));
+                gradients(t, d_h_t(t));
 
                 // Gradients to the input
                 d_x_t(t) = d_h_t(t) * trans(u);
@@ -169,15 +378,94 @@ struct base_rnn_layer : layer<Derived> {
                 break;
             }
         } while (ttt != 0);
+    }
 
-        // 3. Rearrange for the output
+    /*!
+     * \brief Backpropagate the errors through time, the batch being split in
+     * slices of samples, each backpropagated by a worker of the given pool.
+     *
+     * Each worker sums the errors of the states of its slice for each time
+     * step and computes the gradients of the weights of its slice after the
+     * recurrence, with one product over all the time steps. The gradients of
+     * the slices are then summed.
+     */
+    template <bool Sparse, typename D, typename X, typename WG, typename UG, typename BG, typename W, typename U>
+    void parallel_bptt_impl(cpp::thread_pool<true>& pool, const D& delta_t, X& d_x_t, WG& w_grad, UG& u_grad, BG& b_grad, const W& w, const U& u,
+                            size_t time_steps, size_t sequence_length, size_t hidden_units, size_t bptt_steps) const {
+        const size_t Batch  = etl::dim<1>(delta_t);
+        const size_t DT     = etl::dim<0>(delta_t);
+        const size_t slices = std::min(Batch, etl::threads);
 
-        if (direct) {
-            for (size_t b = 0; b < Batch; ++b) {
-                for (size_t t = 0; t < time_steps; ++t) {
-                    output(b)(t) = d_x_t(t)(b);
+        x_t.ensure_cpu_up_to_date();
+        s_t.ensure_cpu_up_to_date();
+        delta_t.ensure_cpu_up_to_date();
+
+        std::vector<etl::dyn_matrix<float, 2>> w_grads(slices);
+        std::vector<etl::dyn_matrix<float, 2>> u_grads(slices);
+        std::vector<etl::dyn_matrix<float, 1>> b_grads(slices);
+
+        dll::maybe_parallel_foreach_n(pool, 0, slices, [&](size_t i) {
+            SERIAL_SECTION {
+                const size_t first = (i * Batch) / slices;
+                const size_t n     = ((i + 1) * Batch) / slices - first;
+
+                etl::dyn_matrix<float, 3> s(time_steps, n, hidden_units);
+                etl::dyn_matrix<float, 3> x(time_steps, n, sequence_length);
+                etl::dyn_matrix<float, 3> delta(DT, n, hidden_units);
+                etl::dyn_matrix<float, 3> d_h(time_steps, n, hidden_units);
+                etl::dyn_matrix<float, 3> d_x(time_steps, n, sequence_length);
+                etl::dyn_matrix<float, 3> errors(time_steps, n, hidden_units);
+
+                detail::gather_columns(s_t.memory_start(), time_steps, Batch * hidden_units, first * hidden_units, n * hidden_units, s.memory_start());
+                detail::gather_columns(x_t.memory_start(), time_steps, Batch * sequence_length, first * sequence_length, n * sequence_length, x.memory_start());
+                detail::gather_columns(delta_t.memory_start(), DT, Batch * hidden_units, first * hidden_units, n * hidden_units, delta.memory_start());
+
+                s.invalidate_gpu();
+                x.invalidate_gpu();
+                delta.invalidate_gpu();
+
+                errors = 0;
+
+                bptt_impl<Sparse>(delta, s, d_h, d_x, w, u, time_steps, bptt_steps, [&errors](size_t t, auto&& d_h_t) {
+                    errors(t) += d_h_t;
+                });
+
+                // The gradients of all the time steps, with one product each
+
+                etl::custom_dyn_matrix<float, 2> x_all(x.memory_start(), time_steps * n, sequence_length);
+                etl::custom_dyn_matrix<float, 2> e_all(errors.memory_start(), time_steps * n, hidden_units);
+
+                u_grads[i] = etl::dyn_matrix<float, 2>(sequence_length, hidden_units);
+                b_grads[i] = etl::dyn_matrix<float, 1>(hidden_units);
+                w_grads[i] = etl::dyn_matrix<float, 2>(hidden_units, hidden_units, 0.0f);
+
+                u_grads[i] = etl::batch_outer(x_all, e_all);
+                b_grads[i] = etl::bias_batch_sum_2d(e_all);
+
+                if (time_steps > 1) {
+                    etl::custom_dyn_matrix<float, 2> s_prev(s.memory_start(), (time_steps - 1) * n, hidden_units);
+                    etl::custom_dyn_matrix<float, 2> e_next(errors.memory_start() + n * hidden_units, (time_steps - 1) * n, hidden_units);
+
+                    w_grads[i] = etl::batch_outer(s_prev, e_next);
                 }
+
+                d_x.ensure_cpu_up_to_date();
+                detail::scatter_columns(d_x.memory_start(), time_steps, Batch * sequence_length, first * sequence_length, n * sequence_length, d_x_t.memory_start());
             }
+        });
+
+        d_x_t.invalidate_gpu();
+
+        // Reduction of the gradients of the slices, always in the same order
+
+        w_grad = w_grads[0];
+        u_grad = u_grads[0];
+        b_grad = b_grads[0];
+
+        for (size_t i = 1; i < slices; ++i) {
+            w_grad += w_grads[i];
+            u_grad += u_grads[i];
+            b_grad += b_grads[i];
         }
     }
 
@@ -192,6 +480,21 @@ struct base_rnn_layer : layer<Derived> {
         }
     }
 
+    /*!
+     * \brief Returns the number of bytes of the backups of the weights
+     */
+    size_t backup_bytes() const {
+        return memory_bytes(std::tie(as_derived().bak_w, as_derived().bak_u, as_derived().bak_b));
+    }
+
+    /*!
+     * \brief Returns the number of bytes of the caches of the layer
+     * (training forward pass, streaming state)
+     */
+    size_t cache_bytes() const {
+        return memory_bytes(std::tie(x_t, s_t, packing.order, packing.lengths, packing.active, stream_s));
+    }
+
     /*!
      * \brief Backup the weights in the secondary weights matrix
      */
@@ -210,6 +513,17 @@ struct base_rnn_layer : layer<Derived> {
         as_derived().b = *as_derived().bak_b;
     }
 
+    /*!
+     * \brief Swap the weights with the secondary weights matrix, restoring
+     * the backup in constant time. The secondary weights matrix holds the
+     * replaced weights afterwards.
+     */
+    void swap_weights() {
+        std::swap(as_derived().w, *as_derived().bak_w);
+        std::swap(as_derived().u, *as_derived().bak_u);
+        std::swap(as_derived().b, *as_derived().bak_b);
+    }
+
     /*!
      * \brief Load the weigts into the given stream
      */
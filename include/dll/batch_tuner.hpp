@@ -0,0 +1,275 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Tuning of the batch size (and of the big batch size of the
+ * generators) of a network for the best training throughput within a
+ * memory budget
+ *
+ * The batch size is part of the type of the network, the candidates are
+ * therefore the instantiations of an alias template of the network over
+ * the batch size. Each candidate is trained for a few steps on synthetic
+ * batches, for its throughput and for the memory of the network, of its
+ * trainer and of its batches.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "util/batch_extend.hpp" // For make_batch
+#include "util/memory.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The parameters of a batch size tuning
+ */
+struct batch_tuning_desc {
+    size_t budget        = 0;  ///< The memory budget, in bytes (0 for no limit)
+    size_t warmup        = 2;  ///< The number of warmup steps of each candidate, not measured
+    size_t steps         = 5;  ///< The number of measured steps of each candidate
+    size_t effective     = 0;  ///< The effective batch size to reach with gradient accumulation (0 for none)
+    size_t max_big_batch = 64; ///< The largest recommended big batch size
+};
+
+/*!
+ * \brief The measures of one candidate batch size
+ */
+struct batch_candidate {
+    size_t batch              = 0;     ///< The batch size
+    size_t bytes              = 0;     ///< The memory of the network, of its trainer and of one batch
+    size_t batch_bytes        = 0;     ///< The memory of one batch of inputs and labels
+    double samples_per_second = 0.0;   ///< The training throughput
+    bool fits                 = false; ///< Indicates if the candidate fits in the budget
+};
+
+/*!
+ * \brief The results of a batch size tuning
+ */
+struct batch_tuning {
+    std::vector<batch_candidate> candidates; ///< The measures of each candidate
+
+    size_t batch        = 0; ///< The recommended batch size (0 if no candidate fits in the budget)
+    size_t big_batch    = 1; ///< The recommended big batch size of the generators
+    size_t accumulation = 1; ///< The recommended number of accumulated batches, for the effective batch size
+
+    /*!
+     * \brief Display the measures and the recommendation in the given stream
+     */
+    void display(std::ostream& os) const {
+        for (auto& c : candidates) {
+            os << "  batch " << c.batch << ": " << memory_report::bytes_str(c.bytes);
+
+            if (c.fits) {
+                os << ", " << c.samples_per_second << " samples/s";
+            } else {
+                os << ", over the budget";
+            }
+
+            os << (c.batch == batch ? " (best)" : "") << "\n";
+        }
+
+        if (batch) {
+            os << "  recommended: batch_size<" << batch << ">, big_batch_size<" << big_batch << ">";
+
+            if (accumulation > 1) {
+                os << ", gradient_accumulation = " << accumulation;
+            }
+
+            os << "\n";
+        } else {
+            os << "  no candidate fits in the budget\n";
+        }
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Measure one candidate network of the given batch size
+ */
+template <typename DBN, typename Configure>
+batch_candidate measure_batch_candidate(const batch_tuning_desc& desc, Configure& configure) {
+    using weight = typename DBN::weight;
+
+    constexpr size_t B = DBN::batch_size;
+
+    batch_candidate candidate;
+    candidate.batch = B;
+
+    auto dbn = std::make_unique<DBN>();
+
+    configure(*dbn);
+
+    auto one = dbn->template layer_get<DBN::input_layer_n>().prepare_one_input();
+
+    auto inputs = dll::make_batch(B, one);
+    inputs      = etl::uniform_generator(-1.0, 1.0);
+
+    const size_t classes = dbn->output_size();
+
+    etl::dyn_matrix<weight, 2> labels(B, classes, weight(0));
+
+    for (size_t i = 0; i < B; ++i) {
+        labels(i, i % classes) = weight(1);
+    }
+
+    // The contexts of the trainer are allocated on the first step
+    dbn->partial_fit(inputs, labels);
+
+    candidate.batch_bytes = memory_bytes(std::tie(inputs, labels));
+
+    memory_report report;
+
+    dbn->report_memory(report);
+    dbn->get_online_trainer().report_memory(report);
+    report.add("batch", candidate.batch_bytes);
+
+    candidate.bytes = report.total();
+    candidate.fits  = !desc.budget || candidate.bytes <= desc.budget;
+
+    if (!candidate.fits) {
+        return candidate;
+    }
+
+    for (size_t i = 1; i < desc.warmup; ++i) {
+        dbn->partial_fit(inputs, labels);
+    }
+
+    const size_t steps = std::max(size_t(1), desc.steps);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < steps; ++i) {
+        dbn->partial_fit(inputs, labels);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+
+    candidate.samples_per_second = seconds > 0.0 ? (steps * B) / seconds : 0.0;
+
+    return candidate;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Measure the training throughput and the memory of the network for
+ * each candidate batch size and recommend the fastest configuration within
+ * the memory budget.
+ *
+ * The network of each candidate is created, configured and trained on
+ * synthetic batches (with partial_fit), then destroyed before the next
+ * one. The big batch size of the generators is the number of batches that
+ * fit in what remains of the budget, clamped to the maximum of the
+ * parameters (or the maximum without a budget). With an effective batch
+ * size, the number of accumulated batches (gradient_accumulation) reaching
+ * it with the recommended batch size is given as well.
+ *
+ * \tparam Net The alias template of the network over its batch size
+ * \tparam B The candidate batch sizes
+ *
+ * \param desc The parameters of the tuning
+ * \param configure Functor called as configure(dbn) on each network before its measure
+ *
+ * \return The measures of the candidates and the recommendation
+ */
+template <template <size_t> typename Net, size_t... B, typename Configure>
+batch_tuning tune_batch_size(const batch_tuning_desc& desc, Configure&& configure) {
+    static_assert(sizeof...(B) > 0, "The batch size tuning needs at least one candidate");
+    static_assert(((Net<B>::batch_size == B) && ...), "The network must be instantiated with the batch size of the candidate");
+
+    batch_tuning tuning;
+
+    (tuning.candidates.push_back(detail::measure_batch_candidate<Net<B>>(desc, configure)), ...);
+
+    const batch_candidate* best = nullptr;
+
+    for (auto& c : tuning.candidates) {
+        if (c.fits && (!best || c.samples_per_second > best->samples_per_second)) {
+            best = &c;
+        }
+    }
+
+    if (!best) {
+        return tuning;
+    }
+
+    tuning.batch     = best->batch;
+    tuning.big_batch = desc.max_big_batch;
+
+    if (desc.budget) {
+        tuning.big_batch = (desc.budget - best->bytes) / best->batch_bytes + 1;
+    }
+
+    tuning.big_batch = std::max(size_t(1), std::min(tuning.big_batch, desc.max_big_batch));
+
+    if (desc.effective > tuning.batch) {
+        tuning.accumulation = (desc.effective + tuning.batch - 1) / tuning.batch;
+    }
+
+    return tuning;
+}
+
+/*!
+ * \brief Measure the training throughput and the memory of the network,
+ * with its default configuration, for each candidate batch size and
+ * recommend the fastest configuration within the memory budget.
+ *
+ * \tparam Net The alias template of the network over its batch size
+ * \tparam B The candidate batch sizes
+ *
+ * \param desc The parameters of the tuning
+ *
+ * \return The measures of the candidates and the recommendation
+ */
+template <template <size_t> typename Net, size_t... B>
+batch_tuning tune_batch_size(const batch_tuning_desc& desc) {
+    return tune_batch_size<Net, B...>(desc, [](auto& dbn) {
+        cpp_unused(dbn);
+    });
+}
+
+/*!
+ * \brief Call functor(std::integral_constant<size_t, B>) with the batch
+ * size recommended by the given tuning, among the candidates, to
+ * instantiate the tuned network as Net<decltype(b)::value>.
+ *
+ * \return false if the recommended batch size is not one of the candidates
+ */
+template <size_t... B, typename Functor>
+bool with_tuned_batch(const batch_tuning& tuning, Functor&& functor) {
+    bool found = false;
+
+    auto call = [&](auto b) {
+        if (!found && tuning.batch == decltype(b)::value) {
+            found = true;
+            functor(b);
+        }
+    };
+
+    (call(std::integral_constant<size_t, B>{}), ...);
+
+    return found;
+}
+
+} //end of dll namespace
@@ -16,6 +16,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <thread>
+#include <vector>
+
 #include "cpp_utils/assert.hpp"         //Assertions
 #include "cpp_utils/maybe_parallel.hpp" //conditional parallel loops
 #include "cpp_utils/static_if.hpp"      //static_if for compile-time reduction
@@ -25,13 +29,17 @@
 #include "util/batch.hpp"
 #include "util/timers.hpp"
 #include "decay_type.hpp"
+#include "unit_type.hpp"
 #include "layer_traits.hpp"
 #include "util/blas.hpp"
+#include "util/binary_states.hpp"
+#include "util/csr_batch.hpp"
+#include "util/pool_stats.hpp"
+#include "util/thread_pool_scope.hpp"
+#include "util/winograd.hpp"
 
 namespace dll {
 
-#define STATIC_IF_DECAY(d, ...) if constexpr (decay == d) { __VA_ARGS__; }
-
 /*!
  * \brief Base class for all standard trainer
  */
@@ -40,21 +48,6 @@ struct base_trainer {
     using rmb_t = RBM; ///< The RBM type being trained
 
     bool init = true; ///< Helper to indicate if first epoch of CD
-
-    /*!
-     * \brief Update the gradients given some type of decay
-     * \param grad The gradients to update
-     * \param rbm The current RBM
-     * \param penalty The penalty to apply
-     * \tparam decay The type of decay to apply
-     */
-    template <decay_type decay, typename V, typename G>
-    void update_grad(G& grad, const V& value, const RBM& rbm, double penalty) {
-        STATIC_IF_DECAY(decay_type::NONE, grad = grad - penalty);
-        STATIC_IF_DECAY(decay_type::L1, grad = grad - rbm.l1_weight_cost * abs(value) - penalty);
-        STATIC_IF_DECAY(decay_type::L2, grad = grad - rbm.l2_weight_cost * value - penalty);
-        STATIC_IF_DECAY(decay_type::L1L2, grad = grad - rbm.l1_weight_cost * abs(value) - rbm.l2_weight_cost * value - penalty);
-    }
 };
 
 template<typename Grad, typename T>
@@ -66,22 +59,132 @@ void apply_clip_gradients(Grad& grad, T t, size_t n){
     }
 }
 
+/*!
+ * \brief Apply the decay, the sparsity penalties, the learning rate and the
+ * momentum to a tensor of parameters of an RBM, in a single pass over the
+ * parameters, their gradients and their increments.
+ *
+ * The gradients are updated with the decay and the penalties. The penalty
+ * of the element i is penalty + penalties[(i / inner) % groups], penalties
+ * being optional (nullptr).
+ *
+ * \tparam decay The type of decay to apply
+ * \tparam Momentum Indicates if the increments are updated with momentum
+ * \tparam Update Indicates if the parameters are updated or only the gradients
+ * \param rbm The RBM, for the weight costs and the momentum
+ * \param value The parameters
+ * \param grad The gradients
+ * \param inc The increments of the parameters (only used with Momentum)
+ * \param penalty The penalty of all the elements
+ * \param penalties The penalties of the groups of elements (can be nullptr)
+ * \param groups The number of groups
+ * \param inner The number of consecutive elements in a group
+ * \param eps The learning rate
+ */
+template <decay_type decay, bool Momentum, bool Update, typename RBM, typename V, typename G, typename I, typename T>
+void fused_update(const RBM& rbm, V& value, G& grad, I& inc, T penalty, const T* penalties, size_t groups, size_t inner, T eps) {
+    const size_t n     = etl::size(grad);
+    const size_t outer = penalties ? n / (groups * inner) : 1;
+
+    if (!penalties) {
+        groups = 1;
+        inner  = n;
+    }
+
+    value.ensure_cpu_up_to_date();
+    grad.ensure_cpu_up_to_date();
+
+    T* v_p = value.memory_start();
+    T* g_p = grad.memory_start();
+    T* i_p = nullptr;
+
+    if constexpr (Momentum) {
+        inc.ensure_cpu_up_to_date();
+        i_p = inc.memory_start();
+    } else {
+        cpp_unused(inc);
+    }
+
+    const T l1 = rbm.l1_weight_cost;
+    const T l2 = rbm.l2_weight_cost;
+    const T m  = Momentum ? T(rbm.momentum) : T(0);
+
+    auto step = [=](size_t i, T p) {
+        T d = g_p[i] - p;
+
+        if constexpr (decay == decay_type::L1 || decay == decay_type::L1L2) {
+            d -= l1 * std::abs(v_p[i]);
+        }
+
+        if constexpr (decay == decay_type::L2 || decay == decay_type::L1L2) {
+            d -= l2 * v_p[i];
+        }
+
+        g_p[i] = d;
+
+        if constexpr (Update && Momentum) {
+            i_p[i] = m * i_p[i] + eps * d;
+            v_p[i] += i_p[i];
+        } else if constexpr (Update) {
+            v_p[i] += eps * d;
+        }
+    };
+
+    for (size_t o = 0; o < outer; ++o) {
+        if (penalties && inner == 1) {
+            // The penalties follow the contiguous elements
+            for (size_t g = 0; g < groups; ++g) {
+                step(o * groups + g, penalty + penalties[g]);
+            }
+        } else {
+            for (size_t g = 0; g < groups; ++g) {
+                const T p          = penalties ? penalty + penalties[g] : penalty;
+                const size_t first = (o * groups + g) * inner;
+
+                for (size_t i = first; i < first + inner; ++i) {
+                    step(i, p);
+                }
+            }
+        }
+    }
+
+    grad.invalidate_gpu();
+
+    if constexpr (Update) {
+        value.invalidate_gpu();
+
+        if constexpr (Momentum) {
+            inc.invalidate_gpu();
+        }
+    }
+}
+
 /* The update weights procedure */
 
 /*!
  * \brief Given the gradients of the RBM, update it according to the training
  * configuration.
+ *
+ * The decay, the penalties, the momentum and the learning rate are applied
+ * in a single pass over each tensor of parameters, except with gradients
+ * clipping, which needs the complete gradients first.
  */
 template <typename RBM, typename Trainer>
 void update_normal(RBM& rbm, Trainer& t) {
     dll::auto_timer timer("cd:update:normal");
 
     using rbm_t  = RBM;                    ///< The type of the RBM being trained
+    using weight = typename rbm_t::weight; ///< The data type for this layer
+
+    constexpr auto w_d      = w_decay(rbm_layer_traits<rbm_t>::decay());
+    constexpr auto b_d      = b_decay(rbm_layer_traits<rbm_t>::decay());
+    constexpr bool momentum = rbm_layer_traits<rbm_t>::has_momentum();
+    constexpr bool clip     = rbm_layer_traits<rbm_t>::has_clip_gradients();
 
     //Penalty to be applied to weights and hidden biases
-    typename rbm_t::weight w_penalty = 0.0;
-    typename rbm_t::weight h_penalty = 0.0;
-    typename rbm_t::weight v_penalty = 0.0;
+    weight w_penalty = 0.0;
+    weight h_penalty = 0.0;
+    weight v_penalty = 0.0;
 
     //Global sparsity method
     if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::GLOBAL_TARGET) {
@@ -94,13 +197,9 @@ void update_normal(RBM& rbm, Trainer& t) {
         w_penalty = h_penalty = cost * (t.q_global_t - p);
     }
 
-    //Apply L1/L2 regularization and penalties to the biases
+    //Local sparsity method, one penalty for each hidden unit
+    etl::dyn_vector<weight> h_penalties;
 
-    t.template update_grad<w_decay(rbm_layer_traits<rbm_t>::decay())>(t.w_grad, rbm.w, rbm, w_penalty);
-    t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.b_grad, rbm.b, rbm, h_penalty);
-    t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.c_grad, rbm.c, rbm, v_penalty);
-
-    //Local sparsity method
     if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
         auto decay_rate = rbm.decay_rate;
         auto p          = rbm.sparsity_target;
@@ -108,49 +207,41 @@ void update_normal(RBM& rbm, Trainer& t) {
 
         t.q_local_t = decay_rate * t.q_local_t + (1.0 - decay_rate) * t.q_local_batch;
 
-        auto q_local_penalty = cost * (t.q_local_t - p);
-
-        t.b_grad -= q_local_penalty;
-
-        for (size_t i = 0; i < num_hidden(rbm); ++i) {
-            for (size_t j = 0; j < num_visible(rbm); ++j) {
-                t.w_grad(j, i) -= q_local_penalty(i);
-            }
-        }
+        h_penalties = etl::dyn_vector<weight>(num_hidden(rbm));
+        h_penalties = cost * (t.q_local_t - p);
+        h_penalties.ensure_cpu_up_to_date();
     }
 
+    const weight* hp = etl::size(h_penalties) ? h_penalties.memory_start() : nullptr;
+    const size_t NH  = num_hidden(rbm);
+
     //TODO the batch is not necessary full!
     const auto n_samples = double(etl::dim<0>(t.v1));
 
-    // Gradients clipping
-    if constexpr (rbm_layer_traits<rbm_t>::has_clip_gradients()){
+    // Scale the learning rate with the size of the batch
+    weight eps = rbm.learning_rate / n_samples;
+
+    if constexpr (clip) {
+        //Apply L1/L2 regularization and penalties, then clip the gradients
+        fused_update<w_d, momentum, false>(rbm, rbm.w, t.w_grad, t.w_inc, w_penalty, hp, NH, 1, eps);
+        fused_update<b_d, momentum, false>(rbm, rbm.b, t.b_grad, t.b_inc, h_penalty, hp, NH, 1, eps);
+        fused_update<b_d, momentum, false>(rbm, rbm.c, t.c_grad, t.c_inc, v_penalty, static_cast<const weight*>(nullptr), 1, 1, eps);
+
         auto grad_t = rbm.gradient_clip;
 
         apply_clip_gradients(t.w_grad, grad_t, n_samples);
         apply_clip_gradients(t.b_grad, grad_t, n_samples);
         apply_clip_gradients(t.c_grad, grad_t, n_samples);
-    }
-
-    // Scale the learning rate with the size of the batch
-    auto eps = rbm.learning_rate / n_samples;
-
-    //Apply momentum and learning rate
-    if constexpr (rbm_layer_traits<rbm_t>::has_momentum()) {
-        auto momentum = rbm.momentum;
 
-        t.w_inc = momentum * t.w_inc + eps * t.w_grad;
-        t.b_inc = momentum * t.b_inc + eps * t.b_grad;
-        t.c_inc = momentum * t.c_inc + eps * t.c_grad;
-
-        rbm.w += t.w_inc;
-        rbm.b += t.b_inc;
-        rbm.c += t.c_inc;
-    }
-    //Apply the learning rate
-    else {
-        rbm.w += eps * t.w_grad;
-        rbm.b += eps * t.b_grad;
-        rbm.c += eps * t.c_grad;
+        //Apply momentum and learning rate
+        fused_update<decay_type::NONE, momentum, true>(rbm, rbm.w, t.w_grad, t.w_inc, weight(0), static_cast<const weight*>(nullptr), 1, 1, eps);
+        fused_update<decay_type::NONE, momentum, true>(rbm, rbm.b, t.b_grad, t.b_inc, weight(0), static_cast<const weight*>(nullptr), 1, 1, eps);
+        fused_update<decay_type::NONE, momentum, true>(rbm, rbm.c, t.c_grad, t.c_inc, weight(0), static_cast<const weight*>(nullptr), 1, 1, eps);
+    } else {
+        //Apply L1/L2 regularization, penalties, momentum and learning rate
+        fused_update<w_d, momentum, true>(rbm, rbm.w, t.w_grad, t.w_inc, w_penalty, hp, NH, 1, eps);
+        fused_update<b_d, momentum, true>(rbm, rbm.b, t.b_grad, t.b_inc, h_penalty, hp, NH, 1, eps);
+        fused_update<b_d, momentum, true>(rbm, rbm.c, t.c_grad, t.c_inc, v_penalty, static_cast<const weight*>(nullptr), 1, 1, eps);
     }
 
     //Check for NaN
@@ -160,6 +251,10 @@ void update_normal(RBM& rbm, Trainer& t) {
 /*!
  * \brief Given the gradients of the RBM, update it according to the training
  * configuration.
+ *
+ * The decay, the penalties, the momentum and the learning rate are applied
+ * in a single pass over each tensor of parameters, except with the sparsity
+ * biases of Honglak Lee, which are applied to the complete gradients.
  */
 template <typename RBM, typename Trainer>
 void update_convolutional(RBM& rbm, Trainer& t) {
@@ -168,6 +263,11 @@ void update_convolutional(RBM& rbm, Trainer& t) {
     using rbm_t  = RBM;                    ///< The type of the RBM being trained
     using weight = typename rbm_t::weight; ///< The data type for this layer
 
+    constexpr auto w_d      = w_decay(rbm_layer_traits<rbm_t>::decay());
+    constexpr auto b_d      = b_decay(rbm_layer_traits<rbm_t>::decay());
+    constexpr bool momentum = rbm_layer_traits<rbm_t>::has_momentum();
+    constexpr bool lee      = rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LEE;
+
     //Penalty to be applied to weights and hidden biases
     weight w_penalty = 0.0;
     weight h_penalty = 0.0;
@@ -184,13 +284,12 @@ void update_convolutional(RBM& rbm, Trainer& t) {
         w_penalty = h_penalty = cost * (t.q_global_t - p);
     }
 
-    //Apply L1/L2 regularization and penalties to the biases
+    const auto K  = get_k(rbm);
+    const auto FS = etl::size(rbm.w) / K;
 
-    t.template update_grad<w_decay(rbm_layer_traits<rbm_t>::decay())>(t.w_grad, rbm.w, rbm, w_penalty);
-    t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.b_grad, rbm.b, rbm, h_penalty);
-    t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.c_grad, rbm.c, rbm, v_penalty);
+    //Local sparsity method, one penalty for each filter
+    etl::dyn_vector<weight> k_penalties;
 
-    //Local sparsity method
     if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
         auto decay_rate = rbm.decay_rate;
         auto p          = rbm.sparsity_target;
@@ -198,47 +297,40 @@ void update_convolutional(RBM& rbm, Trainer& t) {
 
         t.q_local_t = decay_rate * t.q_local_t + (1.0 - decay_rate) * t.q_local_batch;
 
-        auto q_local_penalty = cost * (t.q_local_t - p);
+        k_penalties = etl::dyn_vector<weight>(K);
+        k_penalties = sum_r(cost * (t.q_local_t - p));
+        k_penalties.ensure_cpu_up_to_date();
+    }
 
-        t.b_grad -= sum_r(q_local_penalty);
+    const weight* kp = etl::size(k_penalties) ? k_penalties.memory_start() : nullptr;
 
-        const auto K   = get_k(rbm);
+    constexpr auto n_samples = RBM::batch_size;
+    weight eps               = rbm.learning_rate / n_samples;
 
-        auto k_penalty = sum_r(q_local_penalty);
-        for (size_t k = 0; k < K; ++k) {
-            t.w_grad(k) = t.w_grad(k) - k_penalty(k);
-        }
-    }
+    if constexpr (lee) {
+        //Apply L1/L2 regularization and penalties, then the sparsity biases
+        fused_update<w_d, momentum, false>(rbm, rbm.w, t.w_grad, t.w_inc, w_penalty, kp, K, FS, eps);
+        fused_update<b_d, momentum, false>(rbm, rbm.b, t.b_grad, t.b_inc, h_penalty, kp, K, 1, eps);
+        fused_update<b_d, momentum, false>(rbm, rbm.c, t.c_grad, t.c_inc, v_penalty, static_cast<const weight*>(nullptr), 1, 1, eps);
 
-    //Honglak Lee's sparsity method
-    if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LEE) {
+        //Honglak Lee's sparsity method
         t.w_grad -= rbm.pbias_lambda * t.w_bias;
         t.b_grad -= rbm.pbias_lambda * t.b_bias;
         t.c_grad -= rbm.pbias_lambda * t.c_bias;
-    }
-
-    constexpr auto n_samples = RBM::batch_size;
-    auto eps             = rbm.learning_rate / n_samples;
 
-    //Apply momentum and learning rate
-    if constexpr (rbm_layer_traits<rbm_t>::has_momentum()) {
-        auto momentum = rbm.momentum;
-
-        t.w_inc = momentum * t.w_inc + eps * t.w_grad;
-        t.b_inc = momentum * t.b_inc + eps * t.b_grad;
-        t.c_inc = momentum * t.c_inc + eps * t.c_grad;
-
-        rbm.w += t.w_inc;
-        rbm.b += t.b_inc;
-        rbm.c += t.c_inc;
-    }
-    //Apply learning rate only
-    else {
-        rbm.w += eps * t.w_grad;
-        rbm.b += eps * t.b_grad;
-        rbm.c += eps * t.c_grad;
+        //Apply momentum and learning rate
+        fused_update<decay_type::NONE, momentum, true>(rbm, rbm.w, t.w_grad, t.w_inc, weight(0), static_cast<const weight*>(nullptr), 1, 1, eps);
+        fused_update<decay_type::NONE, momentum, true>(rbm, rbm.b, t.b_grad, t.b_inc, weight(0), static_cast<const weight*>(nullptr), 1, 1, eps);
+        fused_update<decay_type::NONE, momentum, true>(rbm, rbm.c, t.c_grad, t.c_inc, weight(0), static_cast<const weight*>(nullptr), 1, 1, eps);
+    } else {
+        //Apply L1/L2 regularization, penalties, momentum and learning rate
+        fused_update<w_d, momentum, true>(rbm, rbm.w, t.w_grad, t.w_inc, w_penalty, kp, K, FS, eps);
+        fused_update<b_d, momentum, true>(rbm, rbm.b, t.b_grad, t.b_inc, h_penalty, kp, K, 1, eps);
+        fused_update<b_d, momentum, true>(rbm, rbm.c, t.c_grad, t.c_inc, v_penalty, static_cast<const weight*>(nullptr), 1, 1, eps);
     }
 
+    rbm.invalidate_weights_cache();
+
     //Check for NaN
     nan_check_deep(rbm.w);
     nan_check_deep(rbm.b);
@@ -247,6 +339,246 @@ void update_convolutional(RBM& rbm, Trainer& t) {
 
 /* The training procedures */
 
+/*!
+ * \brief Indicates if the hidden samples of the fantasy particles of the
+ * given RBM are stored bit-packed
+ */
+template <typename RBM>
+constexpr bool packed_particles =
+        RBM::hidden_unit == unit_type::BINARY
+    && (RBM::visible_unit == unit_type::BINARY || RBM::visible_unit == unit_type::GAUSSIAN || RBM::visible_unit == unit_type::RELU);
+
+/*!
+ * \brief Compute the visible activations of the particles [first, last)
+ * from their packed hidden samples
+ */
+template <typename RBM, typename Trainer>
+void packed_activate_visible(RBM& rbm, Trainer& t, size_t first, size_t last) {
+    binary_visible_activations(t.f_h_bits, first, last, rbm.w, rbm.c, t.f_v_a);
+
+    auto v_a = etl::slice(t.f_v_a, first, last);
+
+    if constexpr (RBM::visible_unit == unit_type::BINARY) {
+        v_a = etl::sigmoid(v_a);
+    } else if constexpr (RBM::visible_unit == unit_type::RELU) {
+        v_a = etl::max(v_a, 0.0);
+    }
+}
+
+/*!
+ * \brief Advance the fantasy particles of PCD by K Gibbs steps, in chunks
+ * of particles on the scoped thread pool if there is one.
+ *
+ * With binary hidden units, the hidden samples are written directly as
+ * bits and the visible activations only sum the weights of the active
+ * hidden units.
+ */
+template <size_t K, typename RBM, typename Trainer>
+void advance_particles(RBM& rbm, Trainer& t) {
+    dll::auto_timer timer("cd:particles:gibbs");
+
+    const size_t P = etl::dim<0>(t.f_h_a);
+
+    auto gibbs = [&rbm, &t](size_t first, size_t last) {
+        auto h_a = etl::slice(t.f_h_a, first, last);
+        auto v_a = etl::slice(t.f_v_a, first, last);
+
+        if constexpr (packed_particles<RBM>) {
+            for (size_t k = 0; k < K; ++k) {
+                packed_activate_visible(rbm, t, first, last);
+                rbm.template batch_activate_hidden<true, false>(h_a, h_a, v_a, v_a);
+                t.f_h_bits.sample(t.f_h_a, first, last);
+            }
+        } else {
+            auto h_s = etl::slice(t.f_h_s, first, last);
+            auto v_s = etl::slice(t.f_v_s, first, last);
+
+            for (size_t k = 0; k < K; ++k) {
+                rbm.template batch_activate_visible<true, false>(h_a, h_s, v_a, v_s);
+                rbm.template batch_activate_hidden<true, true>(h_a, h_s, v_a, v_s);
+            }
+        }
+    };
+
+    auto* pool = scoped_thread_pool();
+
+    if (pool && P > 1) {
+        const size_t chunks = std::min(P, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&gibbs, P, chunks](size_t c) {
+            SERIAL_SECTION {
+                gibbs((c * P) / chunks, ((c + 1) * P) / chunks);
+            }
+        });
+    } else {
+        gibbs(0, P);
+    }
+}
+
+/*!
+ * \brief Compute the gradients of a fully-connected RBM with Persistent CD,
+ * with rbm.fantasy_particles persistent chains, independent of the batch
+ * size.
+ *
+ * The negative phase is the mean over all the particles, scaled to the
+ * batch size. The reconstruction of the batch (v2_a) is only computed for
+ * the reconstruction error.
+ *
+ * \param IB The number of samples in the batch
+ * \param rbm The RBM being trained
+ * \param t The trainer
+ */
+/*!
+ * \brief Compute the positive phase of the weights gradients of a
+ * fully-connected RBM in t.w_grad, with the sparse kernels when the input
+ * is sparse enough.
+ */
+template <typename RBM, typename Trainer>
+void positive_weight_gradients(Trainer& t) {
+    if constexpr (RBM::sparse_input) {
+        csr_batch<typename RBM::weight> sparse;
+
+        if (sparse.compress(t.vf)) {
+            t.w_grad = 0;
+            csr_outer_add(sparse, t.h1_a, t.w_grad);
+            return;
+        }
+    }
+
+    t.w_grad = batch_outer(t.vf, t.h1_a);
+}
+
+template <size_t K, typename RBM, typename Trainer>
+void compute_gradients_particles(size_t IB, RBM& rbm, Trainer& t) {
+    using weight = typename RBM::weight;
+
+    const size_t B = etl::dim<0>(t.v1);
+    const size_t P = rbm.fantasy_particles;
+
+    // Start the chains from the hidden states of the first batch
+    if (etl::dim<0>(t.f_h_a) != P) {
+        t.f_h_a = etl::dyn_matrix<weight>(P, etl::dim<1>(t.h1_a));
+        t.f_v_a = etl::dyn_matrix<weight>(P, etl::dim<1>(t.v1));
+
+        for (size_t p = 0; p < P; ++p) {
+            t.f_h_a(p) = t.h1_a(p % IB);
+        }
+
+        if constexpr (packed_particles<RBM>) {
+            t.h1_s.ensure_cpu_up_to_date();
+
+            t.f_h_bits.resize(P, etl::dim<1>(t.h1_a));
+
+            for (size_t p = 0; p < P; ++p) {
+                t.f_h_bits.set_row(p, t.h1_s(p % IB));
+            }
+        } else {
+            t.f_h_s = etl::dyn_matrix<weight>(P, etl::dim<1>(t.h1_a));
+            t.f_v_s = etl::dyn_matrix<weight>(P, etl::dim<1>(t.v1));
+
+            for (size_t p = 0; p < P; ++p) {
+                t.f_h_s(p) = t.h1_s(p % IB);
+            }
+        }
+    }
+
+    advance_particles<K>(rbm, t);
+
+    // Reconstruction of the batch, for the error and the sparsity
+    rbm.template batch_activate_visible<true, false>(t.h1_a, t.h1_s, t.v2_a, t.v2_s);
+    t.h2_a = t.h1_a;
+
+    {
+        dll::auto_timer timer("cd:batch_compute_gradients:particles");
+
+        const weight ratio = weight(B) / weight(P);
+
+        positive_weight_gradients<RBM>(t);
+        t.w_grad -= ratio * batch_outer(t.f_v_a, t.f_h_a);
+
+        t.b_grad = sum_l(t.h1_a) - ratio * sum_l(t.f_h_a);
+        t.c_grad = sum_l(t.vf) - ratio * sum_l(t.f_v_a);
+    }
+
+    dense_hidden_statistics<false, RBM>(t);
+}
+
+/*!
+ * \brief Compute the sparsity statistics of the batch of a fully-connected
+ * RBM, and optionally the gradients of its hidden biases, in a single pass
+ * over the hidden activations.
+ *
+ * \tparam Grad Indicates if the gradients of the hidden biases are computed
+ */
+template <bool Grad, typename RBM, typename Trainer>
+void dense_hidden_statistics(Trainer& t) {
+    using weight = typename RBM::weight;
+
+    constexpr bool local = rbm_layer_traits<RBM>::sparsity_method() == sparsity_method::LOCAL_TARGET;
+
+    const size_t B  = etl::dim<0>(t.h2_a);
+    const size_t NH = etl::dim<1>(t.h2_a);
+
+    t.h1_a.ensure_cpu_up_to_date();
+    t.h2_a.ensure_cpu_up_to_date();
+
+    const weight* h1 = t.h1_a.memory_start();
+    const weight* h2 = t.h2_a.memory_start();
+
+    weight* bg = nullptr;
+    weight* q  = nullptr;
+
+    if constexpr (Grad) {
+        bg = t.b_grad.memory_start();
+        std::fill(bg, bg + NH, weight(0));
+    }
+
+    if constexpr (local) {
+        q = t.q_local_batch.memory_start();
+        std::fill(q, q + NH, weight(0));
+    }
+
+    double total = 0.0;
+
+    for (size_t b = 0; b < B; ++b) {
+        const weight* h1_b = h1 + b * NH;
+        const weight* h2_b = h2 + b * NH;
+
+        weight sum = 0;
+
+        for (size_t j = 0; j < NH; ++j) {
+            if constexpr (Grad) {
+                bg[j] += h1_b[j] - h2_b[j];
+            }
+
+            if constexpr (local) {
+                q[j] += h2_b[j];
+            }
+
+            sum += h2_b[j];
+        }
+
+        total += sum;
+    }
+
+    t.q_global_batch = total / (B * NH);
+
+    if constexpr (Grad) {
+        t.b_grad.invalidate_gpu();
+    } else {
+        cpp_unused(bg);
+        cpp_unused(h1);
+    }
+
+    if constexpr (local) {
+        for (size_t j = 0; j < NH; ++j) {
+            q[j] /= B;
+        }
+
+        t.q_local_batch.invalidate_gpu();
+    }
+}
+
 /*!
  * \brief Compute the gradients for a fully-connected RBM
  */
@@ -281,24 +613,46 @@ void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_b
     //First step
     rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, t.v1, t.v1);
 
+    //PCD with fantasy particles decoupled from the batch
+    if constexpr (Persistent) {
+        if (rbm.fantasy_particles) {
+            compute_gradients_particles<K>(IB, rbm, t);
+            return;
+        }
+    }
+
     if (Persistent && t.init) {
         t.p_h_a = t.h1_a;
         t.p_h_s = t.h1_s;
     }
 
-    //CD-1
-    if constexpr (Persistent) {
-        rbm.template batch_activate_visible<true, false>(t.p_h_a, t.p_h_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+    if constexpr (RBM::fused_gibbs) {
+        //CD-1
+        if constexpr (Persistent) {
+            rbm.template batch_gibbs_step<true>(t.p_h_s, t.v2_a, t.h2_a, t.h2_s);
+        } else {
+            rbm.template batch_gibbs_step<(K > 1)>(t.h1_s, t.v2_a, t.h2_a, t.h2_s);
+        }
+
+        //CD-k, in place in the buffers of the chain
+        for (size_t k = 1; k < K; ++k) {
+            rbm.template batch_gibbs_step<true>(t.h2_s, t.v2_a, t.h2_a, t.h2_s);
+        }
     } else {
-        rbm.template batch_activate_visible<true, false>(t.h1_a, t.h1_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, (K > 1)>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
-    }
+        //CD-1
+        if constexpr (Persistent) {
+            rbm.template batch_activate_visible<true, false>(t.p_h_a, t.p_h_s, t.v2_a, t.v2_s);
+            rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        } else {
+            rbm.template batch_activate_visible<true, false>(t.h1_a, t.h1_s, t.v2_a, t.v2_s);
+            rbm.template batch_activate_hidden<true, (K > 1)>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        }
 
-    //CD-k
-    for (size_t k = 1; k < K; ++k) {
-        rbm.template batch_activate_visible<true, false>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        //CD-k
+        for (size_t k = 1; k < K; ++k) {
+            rbm.template batch_activate_visible<true, false>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+            rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        }
     }
 
     //Compute the gradients
@@ -306,13 +660,11 @@ void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_b
     {
         dll::auto_timer timer("cd:batch_compute_gradients:std");
 
-        t.w_grad = batch_outer(t.vf, t.h1_a);
+        positive_weight_gradients<RBM>(t);
         t.w_grad -= batch_outer(t.v2_a, t.h2_a);
 
-        t.b_grad = t.h1_a(0) - t.h2_a(0);
-        for (size_t b = 1; b < B; b++) {
-            t.b_grad += t.h1_a(b) - t.h2_a(b);
-        }
+        //The gradients of the hidden biases, with the sparsity of the batch
+        dense_hidden_statistics<true, RBM>(t);
 
         t.c_grad = t.vf(0) - t.v2_a(0);
         for (size_t b = 1; b < B; b++) {
@@ -330,8 +682,6 @@ void train_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_tr
 
     using namespace etl;
 
-    using rbm_t  = RBM;                    ///< The type of the RBM being trained
-
     compute_gradients_normal<Persistent, K>(input_batch, expected_batch, rbm, t);
 
     if (Persistent) {
@@ -345,21 +695,69 @@ void train_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_tr
 
     nan_check_deep_3(t.w_grad, t.b_grad, t.c_grad);
 
-    //Compute the mean activation probabilities
-    t.q_global_batch = mean(t.h2_a);
-
-    if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
-        t.q_local_batch = mean_l(t.h2_a);
-    }
-
+    //The mean activation probabilities are computed with the gradients
     context.batch_sparsity = t.q_global_batch;
 
     //Update the weights and biases based on the gradients
     t.update(rbm);
 }
 
+/*!
+ * \brief Compute the positive and negative gradients of the weights of a
+ * Convolutional RBM on the given thread pool.
+ *
+ * The batch is split into chunks, the gradients of each chunk are computed
+ * into the accumulators of its worker and the accumulators are reduced at
+ * the end.
+ */
+template <typename Trainer>
+void parallel_gradients_conv(cpp::thread_pool<true>& pool, Trainer& t) {
+    const size_t B      = etl::dim<0>(t.vf);
+    const size_t chunks = std::min(B, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+    if (t.w_pos_workers.size() != chunks) {
+        t.w_pos_workers.assign(chunks, t.w_pos);
+        t.w_neg_workers.assign(chunks, t.w_neg);
+    }
+
+    dll::maybe_parallel_foreach_n(pool, 0, chunks, [&t, B, chunks](size_t c) {
+        SERIAL_SECTION {
+            const size_t first = (c * B) / chunks;
+            const size_t last  = ((c + 1) * B) / chunks;
+
+            t.w_pos_workers[c] = conv_4d_valid_filter_flipped(etl::slice(t.vf, first, last), etl::slice(t.h1_a, first, last));
+            t.w_neg_workers[c] = conv_4d_valid_filter_flipped(etl::slice(t.v2_a, first, last), etl::slice(t.h2_a, first, last));
+        }
+    });
+
+    t.w_pos = t.w_pos_workers[0];
+    t.w_neg = t.w_neg_workers[0];
+
+    for (size_t c = 1; c < chunks; ++c) {
+        t.w_pos += t.w_pos_workers[c];
+        t.w_neg += t.w_neg_workers[c];
+    }
+}
+
+/*!
+ * \brief Traits to test if a Convolutional RBM caches the Winograd transform
+ * of its filters
+ */
+template <typename RBM, typename Enable = void>
+struct has_winograd_filters : std::false_type {};
+
+/*!
+ * \copydoc has_winograd_filters
+ */
+template <typename RBM>
+struct has_winograd_filters<RBM, std::void_t<decltype(std::declval<RBM&>().w_winograd)>> : std::true_type {};
+
 /*!
  * \brief Compute the gradients for a Convolutional RBM
+ *
+ * With 3x3 filters, the activations use the cached Winograd transform of
+ * the filters and the transformed visible units are kept for the gradients
+ * of the filters.
  */
 template <bool Persistent, size_t N, typename Trainer, typename InputBatch, typename ExpectedBatch, typename RBM>
 void compute_gradients_conv(InputBatch& input_batch, ExpectedBatch& expected_batch, RBM& rbm, Trainer& t) {
@@ -382,8 +780,26 @@ void compute_gradients_conv(InputBatch& input_batch, ExpectedBatch& expected_bat
         etl::slice(t.vf, 0, B) = expected_batch;
     }
 
+    using weight = typename RBM::weight;
+
+    //The transformed visible units, kept for the gradients of the filters
+    weight* v1_tiles = nullptr;
+    weight* v2_tiles = nullptr;
+
+    if constexpr (has_winograd_filters<RBM>::value) {
+        if (rbm.use_winograd()) {
+            const size_t tiles = etl::dim<0>(t.v1) * winograd_input_size(etl::dim<1>(t.v1), etl::dim<2>(t.v1), etl::dim<3>(t.v1), 0);
+
+            t.v1_tiles.resize(tiles);
+            t.v2_tiles.resize(tiles);
+
+            v1_tiles = t.v1_tiles.data();
+            v2_tiles = t.v2_tiles.data();
+        }
+    }
+
     //First step
-    rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, t.v1, t.v1);
+    rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, t.v1, t.v1, v1_tiles);
 
     if (Persistent && t.init) {
         t.p_h_a = t.h1_a;
@@ -393,16 +809,16 @@ void compute_gradients_conv(InputBatch& input_batch, ExpectedBatch& expected_bat
     //CD-1
     if (Persistent) {
         rbm.template batch_activate_visible<true, false>(t.p_h_a, t.p_h_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s, v2_tiles);
     } else {
         rbm.template batch_activate_visible<true, false>(t.h1_a, t.h1_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, (N > 1)>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        rbm.template batch_activate_hidden<true, (N > 1)>(t.h2_a, t.h2_s, t.v2_a, t.v2_s, v2_tiles);
     }
 
     //CD-k
     for (size_t k = 1; k < N; ++k) {
         rbm.template batch_activate_visible<true, false>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s, v2_tiles);
     }
 
     //Compute gradients
@@ -410,8 +826,100 @@ void compute_gradients_conv(InputBatch& input_batch, ExpectedBatch& expected_bat
     {
         dll::auto_timer timer("cd:batch_compute_gradients_conv");
 
-        t.w_pos = conv_4d_valid_filter_flipped(t.vf, t.h1_a);
-        t.w_neg = conv_4d_valid_filter_flipped(t.v2_a, t.h2_a);
+        if (v1_tiles) {
+            const size_t NC  = etl::dim<1>(t.v1);
+            const size_t NV1 = etl::dim<2>(t.v1);
+            const size_t NV2 = etl::dim<3>(t.v1);
+            const size_t K   = etl::dim<0>(rbm.w);
+
+            //The input tiles can only be reused when the expected batch is the input batch
+            t.v1.ensure_cpu_up_to_date();
+            t.vf.ensure_cpu_up_to_date();
+
+            const bool same = std::equal(t.v1.memory_start(), t.v1.memory_end(), t.vf.memory_start());
+
+            dll::winograd_backward_filter(t.vf, t.h1_a, t.w_pos, NC, NV1, NV2, K, 0, nullptr, same ? v1_tiles : nullptr);
+            dll::winograd_backward_filter(t.v2_a, t.h2_a, t.w_neg, NC, NV1, NV2, K, 0, nullptr, v2_tiles);
+        } else if (auto* pool = scoped_thread_pool()) {
+            parallel_gradients_conv(*pool, t);
+        } else {
+            t.w_pos = conv_4d_valid_filter_flipped(t.vf, t.h1_a);
+            t.w_neg = conv_4d_valid_filter_flipped(t.v2_a, t.h2_a);
+        }
+    }
+}
+
+/*!
+ * \brief Compute the gradients of the hidden biases of a Convolutional RBM
+ * and the sparsity statistics of the batch in a single pass over the hidden
+ * activations.
+ */
+template <typename RBM, typename Trainer>
+void conv_hidden_statistics(const RBM& rbm, Trainer& t) {
+    using weight = typename RBM::weight;
+
+    constexpr bool local = rbm_layer_traits<RBM>::sparsity_method() == sparsity_method::LOCAL_TARGET;
+    constexpr bool lee   = rbm_layer_traits<RBM>::sparsity_method() == sparsity_method::LEE && rbm_layer_traits<RBM>::bias_mode() == bias_mode::SIMPLE;
+
+    const size_t B = etl::dim<0>(t.h2_a);
+    const size_t K = etl::dim<1>(t.h2_a);
+    const size_t S = etl::dim<2>(t.h2_a) * etl::dim<3>(t.h2_a);
+
+    t.h1_a.ensure_cpu_up_to_date();
+    t.h2_a.ensure_cpu_up_to_date();
+
+    const weight* h1 = t.h1_a.memory_start();
+    const weight* h2 = t.h2_a.memory_start();
+    weight* bg       = t.b_grad.memory_start();
+    weight* q        = nullptr;
+
+    if constexpr (local) {
+        q = t.q_local_batch.memory_start();
+        std::fill(q, q + K * S, weight(0));
+    }
+
+    double total = 0.0;
+
+    for (size_t k = 0; k < K; ++k) {
+        weight diff = 0;
+        weight sum  = 0;
+
+        for (size_t b = 0; b < B; ++b) {
+            const weight* h1_k = h1 + (b * K + k) * S;
+            const weight* h2_k = h2 + (b * K + k) * S;
+
+            for (size_t s = 0; s < S; ++s) {
+                diff += h1_k[s] - h2_k[s];
+                sum += h2_k[s];
+
+                if constexpr (local) {
+                    q[k * S + s] += h2_k[s];
+                }
+            }
+        }
+
+        bg[k] = diff / S;
+        total += sum;
+
+        if constexpr (lee) {
+            t.b_bias[k] = sum / (B * S) - rbm.pbias;
+        }
+    }
+
+    t.q_global_batch = total / (B * K * S);
+
+    t.b_grad.invalidate_gpu();
+
+    if constexpr (local) {
+        for (size_t i = 0; i < K * S; ++i) {
+            q[i] /= B;
+        }
+
+        t.q_local_batch.invalidate_gpu();
+    }
+
+    if constexpr (!lee) {
+        cpp_unused(rbm);
     }
 }
 
@@ -422,8 +930,6 @@ template <bool Persistent, size_t N, typename Trainer, typename InputBatch, type
 void train_convolutional(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_training_context& context, RBM& rbm, Trainer& t) {
     dll::auto_timer timer("cd:train:conv");
 
-    using rbm_t = RBM; ///< The type of the RBM being trained
-
     compute_gradients_conv<Persistent, N>(input_batch, expected_batch, rbm, t);
 
     if (Persistent) {
@@ -435,27 +941,16 @@ void train_convolutional(InputBatch& input_batch, ExpectedBatch& expected_batch,
 
     //Compute the gradients
     t.w_grad = t.w_pos - t.w_neg;
-    t.b_grad = mean_r(sum_l(t.h1_a - t.h2_a));
     t.c_grad = mean_r(sum_l(t.vf - t.v2_a));
 
+    //The gradients of the hidden biases, with the mean activation
+    //probabilities and the biases for sparsity (only b_bias for now)
+    conv_hidden_statistics(rbm, t);
+
     nan_check_deep(t.w_grad);
     nan_check_deep(t.b_grad);
     nan_check_deep(t.c_grad);
 
-    //Compute the mean activation probabilities
-    t.q_global_batch = mean(t.h2_a);
-
-    if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
-        t.q_local_batch = mean_l(t.h2_a);
-    }
-
-    //Compute the biases for sparsity
-
-    //Only b_bias are supported for now
-    if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LEE && rbm_layer_traits<rbm_t>::bias_mode() == bias_mode::SIMPLE) {
-        t.b_bias = mean_r(mean_l(t.h2_a)) - rbm.pbias;
-    }
-
     //Accumulate the sparsity
     context.batch_sparsity = t.q_global_batch;
 
@@ -524,6 +1019,12 @@ struct base_cd_trainer : base_trainer<RBM> {
     etl::fast_matrix<weight, batch_size, rbm_t::num_hidden> p_h_a; ///< Beginning of the contrastive divergence chain (activations)
     etl::fast_matrix<weight, batch_size, rbm_t::num_hidden> p_h_s; ///< Beginning of the contrastive divergence chain (samples)
 
+    etl::dyn_matrix<weight> f_h_a; ///< The hidden activations of the fantasy particles
+    etl::dyn_matrix<weight> f_h_s; ///< The hidden samples of the fantasy particles
+    etl::dyn_matrix<weight> f_v_a; ///< The visible activations of the fantasy particles
+    etl::dyn_matrix<weight> f_v_s; ///< The visible samples of the fantasy particles
+    binary_states f_h_bits;        ///< The packed hidden samples of the fantasy particles (binary hidden units)
+
     base_cd_trainer(rbm_t& rbm)
             : rbm(rbm), q_global_t(0.0), q_local_t(0.0) {
         if constexpr (rbm_layer_traits<rbm_t>::has_momentum()) {
@@ -610,6 +1111,12 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
     etl::dyn_matrix<weight> p_h_a; ///< Beginning of the contrastive divergence chain (activations)
     etl::dyn_matrix<weight> p_h_s; ///< Beginning of the contrastive divergence chain (samples)
 
+    etl::dyn_matrix<weight> f_h_a; ///< The hidden activations of the fantasy particles
+    etl::dyn_matrix<weight> f_h_s; ///< The hidden samples of the fantasy particles
+    etl::dyn_matrix<weight> f_v_a; ///< The visible activations of the fantasy particles
+    etl::dyn_matrix<weight> f_v_s; ///< The visible samples of the fantasy particles
+    binary_states f_h_bits;        ///< The packed hidden samples of the fantasy particles (binary hidden units)
+
     template <bool M = rbm_layer_traits<rbm_t>::has_momentum(), cpp_disable_iff(M)>
     base_cd_trainer(rbm_t& rbm)
             : rbm(rbm),
@@ -747,6 +1254,12 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<!layer_traits<RBM>::
     etl::fast_matrix<weight, W_DIMS> w_pos; ///< The positive gradients
     etl::fast_matrix<weight, W_DIMS> w_neg; ///< The negative gradients
 
+    std::vector<etl::fast_matrix<weight, W_DIMS>> w_pos_workers; ///< The positive gradients of each worker
+    std::vector<etl::fast_matrix<weight, W_DIMS>> w_neg_workers; ///< The negative gradients of each worker
+
+    std::vector<weight> v1_tiles; ///< The Winograd transform of the input
+    std::vector<weight> v2_tiles; ///< The Winograd transform of the reconstructed visible units
+
     etl::fast_matrix<weight, batch_size, NC, NV1, NV2> v1; ///< Input
     etl::fast_matrix<weight, batch_size, NC, NV1, NV2> vf; ///< Expected
 
@@ -854,6 +1367,12 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
     etl::dyn_matrix<weight, 4> w_pos; ///< The positive gradients
     etl::dyn_matrix<weight, 4> w_neg; ///< The negative gradients
 
+    std::vector<etl::dyn_matrix<weight, 4>> w_pos_workers; ///< The positive gradients of each worker
+    std::vector<etl::dyn_matrix<weight, 4>> w_neg_workers; ///< The negative gradients of each worker
+
+    std::vector<weight> v1_tiles; ///< The Winograd transform of the input
+    std::vector<weight> v2_tiles; ///< The Winograd transform of the reconstructed visible units
+
     etl::dyn_matrix<weight, 4> v1; ///< Input
     etl::dyn_matrix<weight, 4> vf; ///< Expected
 
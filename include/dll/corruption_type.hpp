@@ -0,0 +1,21 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+namespace dll {
+
+/*!
+ * \brief Define how the noise corrupts the inputs
+ */
+enum class corruption_type {
+    MASKING,     ///< N% of the inputs are set to zero
+    SALT_PEPPER, ///< N% of the inputs are set to zero or one, with equal probability
+    GAUSSIAN     ///< Gaussian noise of standard deviation N% is added to the inputs
+};
+
+} //end of dll namespace
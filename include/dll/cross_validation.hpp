@@ -0,0 +1,179 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Parallel k-fold cross-validation of a network over one in-memory
+ * dataset
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "generators.hpp"
+#include "util/placement.hpp"
+#include "util/random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The metrics of one fold of a cross-validation
+ */
+struct cv_fold {
+    double train_error = 0.0; ///< The final training error
+    double error       = 0.0; ///< The error on the validation samples
+    double loss        = 0.0; ///< The loss on the validation samples
+};
+
+/*!
+ * \brief The results of a cross-validation
+ */
+struct cv_results {
+    std::vector<cv_fold> folds; ///< The metrics of each fold
+
+    double mean_error   = 0.0; ///< The mean of the validation errors of the folds
+    double stddev_error = 0.0; ///< The standard deviation of the validation errors of the folds
+    double mean_loss    = 0.0; ///< The mean of the validation losses of the folds
+};
+
+namespace detail {
+
+/*!
+ * \brief Split the physical cores of the process into (at most) k
+ * partitions of contiguous cores, each with the CPUs of its cores
+ */
+inline std::vector<std::vector<int>> cv_partitions(size_t k) {
+    const auto cores = physical_cores();
+
+    std::vector<std::vector<int>> partitions(std::max(size_t(1), std::min(k, cores.size())));
+
+    for (size_t c = 0; c < cores.size(); ++c) {
+        auto& partition = partitions[(c * partitions.size()) / cores.size()];
+        partition.insert(partition.end(), cores[c].begin(), cores[c].end());
+    }
+
+    return partitions;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Cross-validate a network of type DBN on the samples of the given
+ * in-memory generator, with k folds.
+ *
+ * The samples are split once, at random, into k folds. Each fold is the
+ * validation set of a new network trained for the given number of epochs on
+ * the other folds. The generators of the folds are only views of indices
+ * (fold_generator) over the caches of the given generator, the data is
+ * therefore loaded only once. The k networks are trained concurrently,
+ * each on its own partition of the physical cores (the threads of a fold
+ * are restricted to its partition, the partitions being shared when there
+ * are more folds than cores) and with its own random stream.
+ *
+ * \param generator The in-memory generator of all the samples, neither modified nor shuffled
+ * \param k The number of folds
+ * \param epochs The number of epochs of training of each fold
+ * \param configure Functor called as configure(dbn, fold) to configure each network before its training
+ *
+ * \return The metrics of the folds and their aggregation
+ */
+template <typename DBN, typename Generator, typename Configure>
+cv_results cross_validate(const Generator& generator, size_t k, size_t epochs, Configure&& configure) {
+    cpp_assert(k > 1, "A cross-validation needs at least two folds");
+    cpp_assert(generator.size() >= k, "A cross-validation needs at least one sample per fold");
+
+    const size_t n = generator.size();
+
+    // Split the samples once, on the calling thread
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), dll::rand_engine());
+
+    const auto partitions = detail::cv_partitions(k);
+    const size_t stream   = new_streams(k);
+
+    cv_results results;
+    results.folds.resize(k);
+
+    std::vector<std::thread> workers;
+
+    for (size_t f = 0; f < k; ++f) {
+        workers.emplace_back([&, f] {
+            // The network and its workers are created on the partition
+            bind_current_thread(partitions[f % partitions.size()]);
+
+            auto engine = make_engine(stream + f);
+            engine_scope scope(engine);
+
+            const size_t first = (f * n) / k;
+            const size_t last  = ((f + 1) * n) / k;
+
+            std::vector<size_t> train_indices(order.begin(), order.begin() + first);
+            train_indices.insert(train_indices.end(), order.begin() + last, order.end());
+
+            fold_generator<Generator> train(generator, std::move(train_indices));
+            fold_generator<Generator> validation(generator, std::vector<size_t>(order.begin() + first, order.begin() + last));
+
+            auto dbn = std::make_unique<DBN>();
+
+            configure(*dbn, f);
+
+            auto& fold = results.folds[f];
+
+            fold.train_error = dbn->fine_tune(train, epochs);
+
+            std::tie(fold.error, fold.loss) = dbn->evaluate_metrics(validation);
+        });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (auto& fold : results.folds) {
+        results.mean_error += fold.error / k;
+        results.mean_loss += fold.loss / k;
+    }
+
+    for (auto& fold : results.folds) {
+        results.stddev_error += (fold.error - results.mean_error) * (fold.error - results.mean_error) / k;
+    }
+
+    results.stddev_error = std::sqrt(results.stddev_error);
+
+    return results;
+}
+
+/*!
+ * \brief Cross-validate a network of type DBN, with its default
+ * configuration, on the samples of the given in-memory generator, with k
+ * folds.
+ *
+ * \param generator The in-memory generator of all the samples, neither modified nor shuffled
+ * \param k The number of folds
+ * \param epochs The number of epochs of training of each fold
+ *
+ * \return The metrics of the folds and their aggregation
+ */
+template <typename DBN, typename Generator>
+cv_results cross_validate(const Generator& generator, size_t k, size_t epochs) {
+    return cross_validate<DBN>(generator, k, epochs, [](DBN& dbn, size_t fold) {
+        cpp_unused(dbn);
+        cpp_unused(fold);
+    });
+}
+
+} //end of dll namespace
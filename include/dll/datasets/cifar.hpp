@@ -9,6 +9,8 @@
 
 #include "cifar/cifar10_reader.hpp"
 
+#include "dll/datasets/direct_reader.hpp"
+
 namespace dll {
 
 /*!
@@ -25,23 +27,18 @@ auto make_cifar10_generator_train(const std::string& folder, size_t limit, Param
     float label;
 
     size_t n = 50000;
-    size_t m = 0;
-
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, label, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::categorical>{});
 
-    generator->label_cache = 0;
-
-    // Read all the necessary images and labels
-    cifar::read_training_categorical(folder, m, generator->input_cache, generator->label_cache);
-
-    // Apply the transformations on the input
-    generator->finalize_prepared_data();
+    // Read all the necessary images and labels, transformed while they are stored
+    if(!read_cifar10_direct(*generator, {folder + "/data_batch_1.bin", folder + "/data_batch_2.bin", folder + "/data_batch_3.bin",
+                                         folder + "/data_batch_4.bin", folder + "/data_batch_5.bin"})){
+        std::cerr << "Something went wrong, impossible to load CIFAR-10 training set" << std::endl;
+    }
 
     return generator;
 }
@@ -60,23 +57,17 @@ auto make_cifar10_generator_test(const std::string& folder, size_t limit, Parame
     float label;
 
     size_t n = 10000;
-    size_t m = 0;
-
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, label, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::categorical>{});
 
-    generator->label_cache = 0;
-
-    // Read all the necessary images and labels
-    cifar::read_test_categorical(folder, m, generator->input_cache, generator->label_cache);
-
-    // Apply the transformations on the input
-    generator->finalize_prepared_data();
+    // Read all the necessary images and labels, transformed while they are stored
+    if(!read_cifar10_direct(*generator, {folder + "/test_batch.bin"})){
+        std::cerr << "Something went wrong, impossible to load CIFAR-10 test set" << std::endl;
+    }
 
     return generator;
 }
@@ -0,0 +1,283 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Readers of the MNIST (IDX) and CIFAR-10 (binary) files directly
+ * into the caches of an in-memory generator.
+ *
+ * The files are streamed in small chunks, by several threads for the large
+ * sets, each with its own stream on a contiguous range of the samples. The
+ * pre-transformations of the generator are applied on each sample while it
+ * is stored, so the caches are never transformed in a second pass.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dll {
+
+namespace direct_reader_detail {
+
+constexpr size_t chunk_samples    = 256;  ///< The number of samples read at once by a thread
+constexpr size_t thread_samples   = 4096; ///< The minimum number of samples read by a thread
+constexpr uint32_t idx_images     = 0x803; ///< The magic number of the IDX image files
+constexpr uint32_t idx_labels     = 0x801; ///< The magic number of the IDX label files
+constexpr size_t cifar_batch_size = 10000; ///< The number of samples of each CIFAR-10 file
+
+/*!
+ * \brief Read a big-endian 32 bits value from the given stream
+ */
+inline uint32_t read_big_endian(std::istream& stream) {
+    uint8_t bytes[4] = {0, 0, 0, 0};
+    stream.read(reinterpret_cast<char*>(bytes), 4);
+    return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+}
+
+/*!
+ * \brief Store the raw pixels of a sample at the given position of the input
+ * cache of the generator.
+ *
+ * The pixels are converted and transformed in the same pass, unless the
+ * storage is compact, in which case the transformation is done when the
+ * batches are gathered.
+ */
+template <typename Generator>
+void store_sample(Generator& generator, size_t i, const uint8_t* raw) {
+    using desc      = typename Generator::desc;
+    using storage_t = typename Generator::storage_t;
+
+    auto sample = generator.input_cache(i);
+
+    const size_t n = etl::size(sample);
+    storage_t* out = sample.memory_start();
+
+    if constexpr (desc::CompactStorage) {
+        for (size_t j = 0; j < n; ++j) {
+            out[j] = storage_t(float(raw[j]));
+        }
+    } else {
+        for (size_t j = 0; j < n; ++j) {
+            out[j] = pre_transformer<desc>::template element<storage_t>(float(raw[j]));
+        }
+
+        pre_transformer<desc>::finalize(sample);
+    }
+}
+
+/*!
+ * \brief Store a raw label at the given position of the label cache of the
+ * generator
+ */
+template <typename Generator>
+void store_label(Generator& generator, size_t i, uint8_t raw) {
+    const float label = raw;
+    const float* it   = &label;
+
+    Generator::label_cache_helper_t::set(i, it, generator.label_cache);
+}
+
+/*!
+ * \brief Call functor(first, last) on contiguous ranges of the n samples,
+ * on several threads when there are enough samples
+ * \return true if every call succeeded
+ */
+template <typename Functor>
+bool parallel_ranges(size_t n, Functor&& functor) {
+    const size_t threads = std::max(size_t(1), std::min(size_t(std::thread::hardware_concurrency()), n / thread_samples));
+
+    if (threads == 1) {
+        return functor(size_t(0), n);
+    }
+
+    std::atomic<bool> ok{true};
+    std::vector<std::thread> workers;
+
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            if (!functor((t * n) / threads, ((t + 1) * n) / threads)) {
+                ok = false;
+            }
+        });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    return ok;
+}
+
+} //end of namespace direct_reader_detail
+
+/*!
+ * \brief Read the images of an IDX file, from the given one, directly into
+ * the input cache of the generator (one image per sample of the cache)
+ * \param generator The prepared generator
+ * \param file The path to the IDX image file
+ * \param start The index of the first image to read
+ * \return true if the images have been read, false otherwise
+ */
+template <typename Generator>
+bool read_idx_images_direct(Generator& generator, const std::string& file, size_t start) {
+    using namespace direct_reader_detail;
+
+    const size_t n = etl::dim<0>(generator.input_cache);
+
+    if (!n) {
+        return true;
+    }
+
+    const size_t sample_size = etl::size(generator.input_cache) / n;
+
+    std::ifstream stream(file, std::ios::binary);
+
+    const uint32_t magic = read_big_endian(stream);
+    const uint32_t count = read_big_endian(stream);
+    const uint32_t rows  = read_big_endian(stream);
+    const uint32_t cols  = read_big_endian(stream);
+
+    if (!stream || magic != idx_images || size_t(rows) * cols != sample_size || start + n > count) {
+        return false;
+    }
+
+    const bool ok = parallel_ranges(n, [&](size_t first, size_t last) {
+        std::ifstream is(file, std::ios::binary);
+        is.seekg(16 + (start + first) * sample_size);
+
+        std::vector<uint8_t> buffer(chunk_samples * sample_size);
+
+        for (size_t i = first; i < last; i += chunk_samples) {
+            const size_t m = std::min(chunk_samples, last - i);
+
+            if (!is.read(reinterpret_cast<char*>(buffer.data()), m * sample_size)) {
+                return false;
+            }
+
+            for (size_t k = 0; k < m; ++k) {
+                store_sample(generator, i + k, buffer.data() + k * sample_size);
+            }
+        }
+
+        return true;
+    });
+
+    generator.input_cache.invalidate_gpu();
+
+    return ok;
+}
+
+/*!
+ * \brief Read the labels of an IDX file, from the given one, directly into
+ * the label cache of the generator
+ * \param generator The prepared generator
+ * \param file The path to the IDX label file
+ * \param start The index of the first label to read
+ * \return true if the labels have been read, false otherwise
+ */
+template <typename Generator>
+bool read_idx_labels_direct(Generator& generator, const std::string& file, size_t start) {
+    using namespace direct_reader_detail;
+
+    const size_t n = etl::dim<0>(generator.label_cache);
+
+    std::ifstream stream(file, std::ios::binary);
+
+    const uint32_t magic = read_big_endian(stream);
+    const uint32_t count = read_big_endian(stream);
+
+    if (!stream || magic != idx_labels || start + n > count) {
+        return false;
+    }
+
+    std::vector<uint8_t> buffer(n);
+
+    stream.seekg(8 + start);
+
+    if (!stream.read(reinterpret_cast<char*>(buffer.data()), n)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        store_label(generator, i, buffer[i]);
+    }
+
+    generator.label_cache.invalidate_gpu();
+
+    return true;
+}
+
+/*!
+ * \brief Read the records (label and image) of the given CIFAR-10 binary
+ * files, of 10000 records each, directly into the caches of the generator
+ * \param generator The prepared generator
+ * \param files The paths to the CIFAR-10 binary files
+ * \return true if the records have been read, false otherwise
+ */
+template <typename Generator>
+bool read_cifar10_direct(Generator& generator, const std::vector<std::string>& files) {
+    using namespace direct_reader_detail;
+
+    const size_t n = etl::dim<0>(generator.input_cache);
+
+    if (!n) {
+        return true;
+    }
+
+    const size_t sample_size = etl::size(generator.input_cache) / n;
+    const size_t record_size = sample_size + 1;
+
+    if (sample_size != 3 * 32 * 32 || n > files.size() * cifar_batch_size) {
+        return false;
+    }
+
+    const bool ok = parallel_ranges(n, [&](size_t first, size_t last) {
+        std::vector<uint8_t> buffer(chunk_samples * record_size);
+
+        std::ifstream is;
+        size_t opened = size_t(-1);
+
+        for (size_t i = first; i < last;) {
+            const size_t f      = i / cifar_batch_size;
+            const size_t record = i % cifar_batch_size;
+            const size_t m      = std::min({chunk_samples, last - i, cifar_batch_size - record});
+
+            if (f != opened) {
+                is = std::ifstream(files[f], std::ios::binary);
+                is.seekg(record * record_size);
+                opened = f;
+            }
+
+            if (!is.read(reinterpret_cast<char*>(buffer.data()), m * record_size)) {
+                return false;
+            }
+
+            for (size_t k = 0; k < m; ++k) {
+                store_label(generator, i + k, buffer[k * record_size]);
+                store_sample(generator, i + k, buffer.data() + k * record_size + 1);
+            }
+
+            i += m;
+        }
+
+        return true;
+    });
+
+    generator.input_cache.invalidate_gpu();
+    generator.label_cache.invalidate_gpu();
+
+    return ok;
+}
+
+} //end of namespace dll
@@ -11,8 +11,16 @@
 #include <unordered_map>
 #include <utility>
 #include <string>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <cstring>
 
 #include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // Only for image loading...
 #include <opencv2/highgui/highgui.hpp>
@@ -21,12 +29,60 @@ namespace dll {
 
 namespace imagenet {
 
-inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unordered_map<size_t, float>& label_map, const std::string& file_path){
+/*!
+ * \brief The magic identifier of a manifest of the dataset
+ */
+constexpr char manifest_magic[8] = {'D', 'L', 'L', 'I', 'M', 'A', 'N', '1'};
+
+/*!
+ * \brief The header of a manifest.
+ *
+ * The header is followed by the labels, as (label, mtime) pairs of
+ * uint64_t in the order of the label map, and then by the files, as
+ * (label, image) pairs of uint64_t.
+ */
+struct manifest_header {
+    char magic[8];   ///< The magic identifier of the format
+    uint64_t mtime;  ///< The modification time of the dataset directory
+    uint64_t labels; ///< The number of labels
+    uint64_t files;  ///< The number of files
+};
+
+/*!
+ * \brief Returns the modification time of the given path, in nanoseconds,
+ * or zero if it cannot be accessed
+ */
+inline uint64_t modification_time(const std::string& path){
+    struct stat st;
+
+    if (stat(path.c_str(), &st) < 0) {
+        return 0;
+    }
+
+    return uint64_t(st.st_mtim.tv_sec) * 1000000000UL + uint64_t(st.st_mtim.tv_nsec);
+}
+
+/*!
+ * \brief Returns the path of the folder of the given label
+ */
+inline std::string label_folder(const std::string& file_path, size_t label){
+    return file_path + "/n" + (label < 10000000 ? "0" : "") + std::to_string(label);
+}
+
+/*!
+ * \brief Crawl the dataset directory to find all the files
+ */
+inline void crawl_files(std::vector<std::pair<size_t, size_t>>& files, std::unordered_map<size_t, float>& label_map, std::vector<size_t>& label_order, const std::string& file_path){
     files.reserve(1200000);
 
     struct dirent* entry;
     auto dir = opendir(file_path.c_str());
 
+    if (!dir) {
+        std::cerr << "ERROR: Impossible to open " << file_path << std::endl;
+        return;
+    }
+
     while ((entry = readdir(dir))) {
         std::string file_name(entry->d_name);
 
@@ -39,10 +95,15 @@ inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unord
 
         auto l = label_map.size();
         label_map[label] = l;
+        label_order.push_back(label);
 
         struct dirent* sub_entry;
         auto sub_dir = opendir((file_path + "/" + file_name).c_str());
 
+        if (!sub_dir) {
+            continue;
+        }
+
         while ((sub_entry = readdir(sub_dir))) {
             std::string image_name(sub_entry->d_name);
 
@@ -55,9 +116,220 @@ inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unord
 
             files.emplace_back(label, image);
         }
+
+        closedir(sub_dir);
     }
+
+    closedir(dir);
 }
 
+/*!
+ * \brief Read the files from a manifest.
+ *
+ * The manifest is only used if the modification time of the dataset
+ * directory and of all the label directories did not change since it was
+ * written.
+ *
+ * \return true if the manifest was valid and has been read, false otherwise
+ */
+inline bool read_manifest(std::vector<std::pair<size_t, size_t>>& files, std::unordered_map<size_t, float>& label_map, const std::string& file_path, const std::string& manifest_path){
+    std::ifstream stream(manifest_path, std::ios::binary);
+
+    if (!stream) {
+        return false;
+    }
+
+    manifest_header header;
+    stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    if (!stream || std::memcmp(header.magic, manifest_magic, sizeof(header.magic)) || header.mtime != modification_time(file_path)) {
+        return false;
+    }
+
+    std::vector<uint64_t> labels(2 * header.labels);
+    stream.read(reinterpret_cast<char*>(labels.data()), labels.size() * sizeof(uint64_t));
+
+    std::vector<uint64_t> entries(2 * header.files);
+    stream.read(reinterpret_cast<char*>(entries.data()), entries.size() * sizeof(uint64_t));
+
+    if (!stream) {
+        return false;
+    }
+
+    for (size_t l = 0; l < header.labels; ++l) {
+        if (labels[2 * l + 1] != modification_time(label_folder(file_path, labels[2 * l]))) {
+            return false;
+        }
+    }
+
+    label_map.clear();
+
+    for (size_t l = 0; l < header.labels; ++l) {
+        label_map[labels[2 * l]] = l;
+    }
+
+    files.clear();
+    files.reserve(header.files);
+
+    for (size_t i = 0; i < header.files; ++i) {
+        files.emplace_back(entries[2 * i], entries[2 * i + 1]);
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Write the manifest of the files of the dataset
+ * \return true if the manifest was written, false otherwise
+ */
+inline bool write_manifest(const std::vector<std::pair<size_t, size_t>>& files, const std::vector<size_t>& label_order, const std::string& file_path, const std::string& manifest_path){
+    std::ofstream stream(manifest_path, std::ios::binary);
+
+    if (!stream) {
+        return false;
+    }
+
+    manifest_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, manifest_magic, sizeof(header.magic));
+
+    header.mtime  = modification_time(file_path);
+    header.labels = label_order.size();
+    header.files  = files.size();
+
+    std::vector<uint64_t> labels;
+    labels.reserve(2 * label_order.size());
+
+    for (auto label : label_order) {
+        labels.push_back(label);
+        labels.push_back(modification_time(label_folder(file_path, label)));
+    }
+
+    std::vector<uint64_t> entries;
+    entries.reserve(2 * files.size());
+
+    for (auto& file : files) {
+        entries.push_back(file.first);
+        entries.push_back(file.second);
+    }
+
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(labels.data()), labels.size() * sizeof(uint64_t));
+    stream.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(uint64_t));
+
+    return bool(stream);
+}
+
+/*!
+ * \brief Read the list of files of the dataset.
+ *
+ * If a valid manifest is found at manifest_path, it is used instead of
+ * crawling the directories. Otherwise, the directories are crawled and the
+ * manifest is written for the next runs. An empty manifest_path disables
+ * the manifest.
+ *
+ * \param files The output list of (label, image) pairs
+ * \param label_map The output map from label to class index
+ * \param file_path The directory of the dataset
+ * \param manifest_path The path of the manifest
+ */
+inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unordered_map<size_t, float>& label_map, const std::string& file_path, const std::string& manifest_path){
+    if (!manifest_path.empty() && read_manifest(files, label_map, file_path, manifest_path)) {
+        return;
+    }
+
+    std::vector<size_t> label_order;
+
+    crawl_files(files, label_map, label_order, file_path);
+
+    if (!manifest_path.empty() && !write_manifest(files, label_order, file_path, manifest_path)) {
+        std::cerr << "WARNING: Impossible to write the manifest " << manifest_path << std::endl;
+    }
+}
+
+/*!
+ * \brief Read the list of files of the dataset, using the default manifest
+ * next to the dataset directory
+ * \param files The output list of (label, image) pairs
+ * \param label_map The output map from label to class index
+ * \param file_path The directory of the dataset
+ */
+inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unordered_map<size_t, float>& label_map, const std::string& file_path){
+    read_files(files, label_map, file_path, file_path + ".manifest");
+}
+
+constexpr size_t image_size = 3 * 256 * 256; ///< The number of values of one image
+
+/*!
+ * \brief Returns the path of the JPEG file of the given image
+ * \param imagenet_path The root folder of the dataset
+ * \param image_file The (label, image) pair identifying the image
+ */
+inline std::string image_path(const std::string& imagenet_path, const std::pair<size_t, size_t>& image_file){
+    auto label = std::string("/n") + (image_file.first < 10000000 ? "0" : "") + std::to_string(image_file.first);
+
+    return imagenet_path + "/train" + label + label + "_" + std::to_string(image_file.second) + ".JPEG";
+}
+
+/*!
+ * \brief Decode an image into a packed 3x256x256 buffer.
+ *
+ * On failure, the buffer is filled with zeroes.
+ *
+ * \param image_path The path of the image file
+ * \param pixels The output buffer
+ * \return true if the image was decoded, false otherwise
+ */
+template <typename T>
+bool decode_image(const std::string& image_path, T* pixels){
+    static constexpr size_t plane = 256 * 256;
+
+    auto mat = cv::imread(image_path.c_str(), cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
+
+    if (!mat.data || mat.empty()) {
+        std::cerr << "ERROR: Failed to read image: " << image_path << std::endl;
+        std::fill_n(pixels, image_size, T(0));
+        return false;
+    }
+
+    if (mat.cols != 256 || mat.rows != 256) {
+        std::cerr << "ERROR: Image of invalid size: " << image_path << std::endl;
+        std::fill_n(pixels, image_size, T(0));
+        return false;
+    }
+
+    if (cpp_likely(mat.channels() == 3)) {
+        for (size_t y = 0; y < 256; ++y) {
+            const auto* row = mat.ptr<cv::Vec3b>(y);
+
+            for (size_t x = 0; x < 256; ++x) {
+                pixels[0 * plane + x * 256 + y] = row[x].val[0];
+                pixels[1 * plane + x * 256 + y] = row[x].val[1];
+                pixels[2 * plane + x * 256 + y] = row[x].val[2];
+            }
+        }
+    } else {
+        for (size_t y = 0; y < 256; ++y) {
+            const auto* row = mat.ptr<unsigned char>(y);
+
+            for (size_t x = 0; x < 256; ++x) {
+                pixels[x * 256 + y] = row[x];
+            }
+        }
+
+        std::fill_n(pixels + plane, 2 * plane, T(0));
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Iterator decoding the JPEG images of the dataset.
+ *
+ * The iterators are cheap to copy, a threaded generator with several
+ * workers (dll::threaded and dll::workers<N>) decodes the images in
+ * parallel.
+ */
 struct image_iterator : std::iterator<
                                      std::input_iterator_tag,
                                      etl::fast_dyn_matrix<float, 3, 256, 256>,
@@ -100,50 +372,9 @@ struct image_iterator : std::iterator<
     }
 
     value_type operator*() {
-        auto& image_file = (*files)[index];
-
-        auto label = std::string("/n") + (image_file.first < 10000000 ? "0" : "") + std::to_string(image_file.first);
-
-        auto image_path =
-            std::string(imagenet_path) + "/train" + label + label +
-            "_" + std::to_string(image_file.second) + ".JPEG";
-
-        auto mat = cv::imread(image_path.c_str(), cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
-
         value_type image;
 
-        if (!mat.data || mat.empty()) {
-            std::cerr << "ERROR: Failed to read image: " << image_path << std::endl;
-            image = 0;
-            return image;
-        }
-
-        if (mat.cols != 256 || mat.rows != 256) {
-            std::cerr << "ERROR: Image of invalid size: " << image_path << std::endl;
-            image = 0;
-            return image;
-        }
-
-        if (cpp_likely(mat.channels() == 3)) {
-            for (size_t x = 0; x < 256; ++x) {
-                for (size_t y = 0; y < 256; ++y) {
-                    auto pixel = mat.at<cv::Vec3b>(y, x);
-
-                    image(0, x, y) = pixel.val[0];
-                    image(1, x, y) = pixel.val[1];
-                    image(2, x, y) = pixel.val[2];
-                }
-            }
-        } else {
-            for (size_t x = 0; x < 256; ++x) {
-                for (size_t y = 0; y < 256; ++y) {
-                    image(0, x, y) = mat.at<unsigned char>(y, x);
-                }
-            }
-
-            image(1) = 0;
-            image(2) = 0;
-        }
+        decode_image(image_path(imagenet_path, (*files)[index]), image.memory_start());
 
         return image;
     }
@@ -206,6 +437,323 @@ struct label_iterator : std::iterator<
     }
 };
 
+/*!
+ * \brief The magic identifier of a packed shard of images
+ */
+constexpr char shard_magic[8] = {'D', 'L', 'L', 'I', 'N', 'E', 'T', '1'};
+
+/*!
+ * \brief The header of a packed shard.
+ *
+ * The header is followed by the labels (uint32_t) of the images and, on an
+ * aligned offset, by the decoded images stored as 3x256x256 bytes.
+ */
+struct shard_header {
+    char magic[8];         ///< The magic identifier of the format
+    uint64_t count;        ///< The number of images in the shard
+    uint64_t label_offset; ///< The offset of the labels
+    uint64_t data_offset;  ///< The offset of the images
+};
+
+/*!
+ * \brief Returns the path of the given shard
+ */
+inline std::string shard_path(const std::string& shard_folder, size_t shard){
+    return shard_folder + "/shard_" + std::to_string(shard) + ".bin";
+}
+
+/*!
+ * \brief Decode the training images once and store them into packed shards
+ * of uint8 images, so that the next runs do not need to decode them again.
+ *
+ * The images are shuffled before being written and are decoded in
+ * parallel.
+ *
+ * \param folder The folder of the dataset
+ * \param shard_folder The folder in which the shards are written
+ * \param shard_size The number of images per shard
+ * \param threads The number of decoding threads
+ * \return The number of written shards, zero in case of error
+ */
+inline size_t write_shards(const std::string& folder, const std::string& shard_folder, size_t shard_size = 1024, size_t threads = std::thread::hardware_concurrency()){
+    std::vector<std::pair<size_t, size_t>> files;
+    std::unordered_map<size_t, float> label_map;
+
+    read_files(files, label_map, std::string(folder) + "train");
+
+    std::random_device rd;
+    std::default_random_engine engine(rd());
+    std::shuffle(files.begin(), files.end(), engine);
+
+    threads = std::max(threads, size_t(1));
+
+    std::vector<uint8_t> pixels(shard_size * image_size);
+    std::vector<uint32_t> labels(shard_size);
+
+    size_t shards = 0;
+
+    for (size_t first = 0; first < files.size(); first += shard_size, ++shards) {
+        const size_t n = std::min(shard_size, files.size() - first);
+
+        for (size_t i = 0; i < n; ++i) {
+            labels[i] = label_map[files[first + i].first];
+        }
+
+        std::atomic<size_t> next(0);
+
+        auto decoder = [&] {
+            for (size_t i = next++; i < n; i = next++) {
+                decode_image(image_path(folder, files[first + i]), pixels.data() + i * image_size);
+            }
+        };
+
+        std::vector<std::thread> pool;
+
+        for (size_t t = 1; t < threads; ++t) {
+            pool.emplace_back(decoder);
+        }
+
+        decoder();
+
+        for (auto& thread : pool) {
+            thread.join();
+        }
+
+        auto path = shard_path(shard_folder, shards);
+
+        std::ofstream stream(path, std::ios::binary);
+
+        if (!stream) {
+            std::cerr << "ERROR: Impossible to open " << path << std::endl;
+            return 0;
+        }
+
+        shard_header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, shard_magic, sizeof(header.magic));
+
+        header.count        = n;
+        header.label_offset = sizeof(header);
+        header.data_offset  = mmap_detail::align(header.label_offset + n * sizeof(uint32_t));
+
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.write(reinterpret_cast<const char*>(labels.data()), n * sizeof(uint32_t));
+
+        mmap_detail::pad(stream, header.data_offset);
+
+        stream.write(reinterpret_cast<const char*>(pixels.data()), n * image_size);
+
+        if (!stream) {
+            std::cerr << "ERROR: Failed to write " << path << std::endl;
+            return 0;
+        }
+    }
+
+    return shards;
+}
+
+/*!
+ * \brief The set of memory-mapped shards of a packed dataset
+ */
+struct shard_set {
+    /*!
+     * \brief One memory-mapped shard
+     */
+    struct shard {
+        void* mapping;          ///< The memory mapping of the file
+        size_t length;          ///< The length of the mapping
+        size_t count;           ///< The number of images
+        const uint32_t* labels; ///< Pointer to the labels
+        const uint8_t* pixels;  ///< Pointer to the images
+    };
+
+    std::vector<shard> shards;  ///< The mapped shards
+    std::vector<size_t> starts; ///< The index of the first image of each shard
+    size_t images = 0;          ///< The total number of images
+
+    /*!
+     * \brief Map all the shards found in the given folder
+     */
+    explicit shard_set(const std::string& shard_folder){
+        for (size_t s = 0;; ++s) {
+            auto path = shard_path(shard_folder, s);
+
+            auto fd = ::open(path.c_str(), O_RDONLY);
+
+            if (fd < 0) {
+                break;
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(shard_header)) {
+                std::cerr << "ERROR: Invalid shard " << path << std::endl;
+                ::close(fd);
+                break;
+            }
+
+            auto mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+            ::close(fd);
+
+            if (mapping == MAP_FAILED) {
+                std::cerr << "ERROR: Impossible to map " << path << std::endl;
+                break;
+            }
+
+            auto* bytes   = static_cast<const uint8_t*>(mapping);
+            auto& header  = *reinterpret_cast<const shard_header*>(bytes);
+
+            if (std::memcmp(header.magic, shard_magic, sizeof(header.magic)) || header.data_offset + header.count * image_size > size_t(st.st_size)) {
+                std::cerr << "ERROR: Invalid shard " << path << std::endl;
+                munmap(mapping, st.st_size);
+                break;
+            }
+
+            madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+            shards.push_back({mapping, size_t(st.st_size), header.count,
+                reinterpret_cast<const uint32_t*>(bytes + header.label_offset), bytes + header.data_offset});
+            starts.push_back(images);
+
+            images += header.count;
+        }
+    }
+
+    shard_set(const shard_set& rhs) = delete;
+    shard_set& operator=(const shard_set& rhs) = delete;
+
+    /*!
+     * \brief Unmap all the shards
+     */
+    ~shard_set(){
+        for (auto& shard : shards) {
+            munmap(shard.mapping, shard.length);
+        }
+    }
+
+    /*!
+     * \brief Returns the shard and the position inside the shard of the given image
+     */
+    std::pair<const shard*, size_t> locate(size_t i) const {
+        auto s = std::upper_bound(starts.begin(), starts.end(), i) - starts.begin() - 1;
+
+        return {&shards[s], i - starts[s]};
+    }
+
+    /*!
+     * \brief Returns a pointer to the packed pixels of the given image
+     */
+    const uint8_t* pixels(size_t i) const {
+        auto location = locate(i);
+        return location.first->pixels + location.second * image_size;
+    }
+
+    /*!
+     * \brief Returns the label of the given image
+     */
+    float label(size_t i) const {
+        auto location = locate(i);
+        return location.first->labels[location.second];
+    }
+};
+
+/*!
+ * \brief Iterator over the images of packed shards
+ */
+struct shard_image_iterator : std::iterator<
+                                     std::input_iterator_tag,
+                                     etl::fast_dyn_matrix<float, 3, 256, 256>,
+                                     ptrdiff_t,
+                                     etl::fast_dyn_matrix<float, 3, 256, 256>*,
+                                     etl::fast_dyn_matrix<float, 3, 256, 256>&
+                                 > {
+
+    using value_type = etl::fast_dyn_matrix<float, 3, 256, 256>;
+
+    std::shared_ptr<shard_set> shards;
+
+    size_t index;
+
+    shard_image_iterator(std::shared_ptr<shard_set> shards, size_t index) : shards(shards), index(index) {
+        // Nothing else to init
+    }
+
+    shard_image_iterator& operator++(){
+        ++index;
+        return *this;
+    }
+
+    shard_image_iterator operator++(int){
+        auto it = *this;
+        ++index;
+        return it;
+    }
+
+    value_type operator*() const {
+        value_type image;
+
+        const uint8_t* pixels = shards->pixels(index);
+        float* out            = image.memory_start();
+
+        for (size_t i = 0; i < image_size; ++i) {
+            out[i] = pixels[i];
+        }
+
+        return image;
+    }
+
+    bool operator==(const shard_image_iterator& rhs) const {
+        return index == rhs.index;
+    }
+
+    bool operator!=(const shard_image_iterator& rhs) const {
+        return index != rhs.index;
+    }
+};
+
+/*!
+ * \brief Iterator over the labels of packed shards
+ */
+struct shard_label_iterator : std::iterator<
+                                     std::input_iterator_tag,
+                                     float,
+                                     ptrdiff_t,
+                                     float*,
+                                     float&
+                                 > {
+
+    std::shared_ptr<shard_set> shards;
+
+    size_t index;
+
+    shard_label_iterator(std::shared_ptr<shard_set> shards, size_t index) : shards(shards), index(index) {
+        // Nothing else to init
+    }
+
+    shard_label_iterator& operator++(){
+        ++index;
+        return *this;
+    }
+
+    shard_label_iterator operator++(int){
+        auto it = *this;
+        ++index;
+        return it;
+    }
+
+    float operator*() const {
+        return shards->label(index);
+    }
+
+    bool operator==(const shard_label_iterator& rhs) const {
+        return index == rhs.index;
+    }
+
+    bool operator!=(const shard_label_iterator& rhs) const {
+        return index != rhs.index;
+    }
+};
+
 } // end of namespace imagenet
 
 /*!
@@ -240,4 +788,29 @@ auto make_imagenet_dataset(const std::string& folder, Parameters&&... /*paramete
         make_generator(iit, iend, lit, lend, train_files->size(), 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}));
 }
 
+/*!
+ * \brief Creates a dataset around the packed shards of ImageNet written by
+ * imagenet::write_shards
+ * \param shard_folder The folder in which the shards are
+ * \param parameters The parameters of the generator
+ * \return The ImageNet dataset
+ */
+template<typename... Parameters>
+auto make_imagenet_shard_dataset(const std::string& shard_folder, Parameters&&... /*parameters*/){
+    auto shards = std::make_shared<imagenet::shard_set>(shard_folder);
+
+    // The image iterators
+    imagenet::shard_image_iterator iit(shards, 0);
+    imagenet::shard_image_iterator iend(shards, shards->images);
+
+    // The label iterators
+    imagenet::shard_label_iterator lit(shards, 0);
+    imagenet::shard_label_iterator lend(shards, shards->images);
+
+    return make_dataset_holder(
+        "imagenet",
+        make_generator(iit, iend, lit, lend, shards->images, 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}),
+        make_generator(iit, iend, lit, lend, shards->images, 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}));
+}
+
 } // end of namespace dll
@@ -7,7 +7,11 @@
 
 #pragma once
 
+#include <memory>
+#include <utility>
+
 #include "generic_dbn_desc.hpp"
+#include "util/batch_norm.hpp"
 
 namespace dll {
 
@@ -139,4 +143,83 @@ using fast_dbn_desc = generic_dbn_desc<dbn, Layers, Parameters...>;
 template <typename Layers, typename... Parameters>
 using fast_network_desc = generic_dbn_desc<dbn, Layers, Parameters...>;
 
+/*!
+ * \brief Traits to get the dynamic version of a network, with the dynamic
+ * version of each of its layers and the same parameters
+ */
+template <typename DBN, typename Parameters = typename DBN::desc::parameters>
+struct dyn_network;
+
+template <typename DBN, typename... Parameters>
+struct dyn_network<DBN, cpp::type_list<Parameters...>> {
+    using type = typename generic_dyn_dbn_desc<dbn, typename DBN::desc::base_layers, Parameters...>::dbn_t; ///< The dynamic network type
+};
+
+/*!
+ * \brief The dynamic version of the given network type
+ */
+template <typename DBN>
+using dyn_network_t = typename dyn_network<DBN>::type;
+
+namespace detail {
+
+template <typename Source, typename Target, size_t... I>
+void copy_parameters(const Source& source, Target& target, std::index_sequence<I...> /*seq*/) {
+    ((std::get<I>(target).get() = std::get<I>(source).get()), ...);
+}
+
+/*!
+ * \brief Copy the parameters of a layer into the same layer of another
+ * network
+ */
+template <typename From, typename To>
+void copy_layer_parameters(const From& from, To& to) {
+    if constexpr (decay_layer_traits<From>::is_neural_layer()) {
+        auto source = from.trainable_parameters();
+        auto target = to.trainable_parameters();
+
+        constexpr size_t parameters = std::tuple_size<decltype(source)>::value;
+
+        static_assert(parameters == std::tuple_size<decltype(target)>::value, "The layers have different parameters");
+
+        copy_parameters(source, target, std::make_index_sequence<parameters>());
+    }
+
+    if constexpr (is_batch_normalization_layer_v<From>) {
+        to.mean = from.mean;
+        to.var  = from.var;
+    }
+}
+
+template <typename From, typename To, size_t... I>
+void copy_network_parameters(const From& from, To& to, std::index_sequence<I...> /*seq*/) {
+    (copy_layer_parameters(from.template layer_get<I>(), to.template layer_get<I>()), ...);
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Create the dynamic version of the given network, with the same
+ * parameters (weights, biases and batch normalization statistics).
+ *
+ * The layers of the dynamic version can be shrunk, for instance by
+ * prune_units().
+ *
+ * \param source The network
+ * \return The dynamic version of the network
+ */
+template <typename DBN>
+std::unique_ptr<dyn_network_t<DBN>> make_dynamic(const DBN& source) {
+    using dyn_t = dyn_network_t<DBN>;
+
+    static_assert(!std::is_same<typename dyn_t::desc::layers, typename dyn_t::desc::base_layers>::value,
+                  "The network must be built from static layers to be made dynamic");
+
+    auto target = std::make_unique<dyn_t>();
+
+    detail::copy_network_parameters(source, *target, std::make_index_sequence<DBN::layers>());
+
+    return target;
+}
+
 } //end of dll namespace
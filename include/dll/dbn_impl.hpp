@@ -16,20 +16,51 @@
 
 #pragma once
 
+#include <array>
+#include <sstream>
+
 #include "cpp_utils/maybe_parallel.hpp"
 #include "cpp_utils/tuple_utils.hpp"
 
 #include "generators.hpp"
 #include "unit_type.hpp"
+#include "warmup_mode.hpp"
 #include "trainer/dbn_trainer.hpp"
+#include "trainer/online_trainer.hpp"
 #include "trainer/rbm_trainer_fwd.hpp"
 #include "dll/trainer/rbm_training_context.hpp"
 #include "dbn_common.hpp"
 #include "svm_common.hpp"
+#include "quantized_network.hpp"
+#include "frozen_network.hpp"
+#include "util/checkpointer.hpp"
+#include "util/pool_stats.hpp"
+#include "util/thread_pool_scope.hpp"
+#include "util/workspace.hpp"
+#include "util/arena.hpp"
+#include "util/huge_pages.hpp"
+#include "util/placement.hpp"
+#include "util/inference_context.hpp"
+#include "util/mapped_weights.hpp"
+#include "util/model_file.hpp"
+#include "util/conv_autotune.hpp"
+#include "util/batch_norm.hpp"
+#include "util/pruning.hpp"
+#include "util/structured_pruning.hpp"
 #include "util/export.hpp"
+#include "util/labels.hpp"
+#include "util/latency.hpp"
+#include "util/layer_cost.hpp"
+#include "util/memory.hpp"
 #include "util/timers.hpp"
+#include "util/topk.hpp"
+#include "util/transport.hpp"
+#include "util/gradient_compression.hpp"
 #include "util/random.hpp"
 #include "util/ready.hpp"
+#include "util/reconstruction.hpp"
+#include "util/batch_extend.hpp"
+#include "util/pipeline.hpp"
 #include "dbn_detail.hpp" // dbn_detail namespace
 
 namespace dll {
@@ -138,6 +169,12 @@ public:
     static constexpr auto updater          = desc::Updater;      ///< The Updater type
     static constexpr auto early            = desc::Early;        ///< The Early Stopping stragy
 
+    /*!
+     * \brief The random initializations of the layers, deferred during the
+     * construction of the layers to be computed concurrently
+     */
+    deferred_initialization inits;
+
     layers_t tuples; ///< The layers
 
     weight learning_rate       = 0.1; ///< The learning rate for finetuning
@@ -159,9 +196,73 @@ public:
 
     weight gradient_clip = 5.0; ///< The gradient clipping
 
+    size_t gradient_accumulation = 1; ///< The number of batches whose gradients are accumulated before each update (sequential SGD)
+
+    /*!
+     * \brief The transport used to train the network over several
+     * processes (sequential SGD), each process training on its own shard
+     * of the data. When not set, the network is trained locally.
+     */
+    std::shared_ptr<distributed_transport> transport;
+
+    /*!
+     * \brief The number of gradients summed over the ranks at once. The
+     * gradients of consecutive layers are packed until the bucket is full,
+     * to amortize the latency of each allreduce over the small layers.
+     * When 0, the gradients of each variable are summed separately.
+     */
+    size_t gradient_bucket = 0;
+
+    /*!
+     * \brief The compression of the gradients summed over the ranks, per
+     * layer, and the counters of the achieved compression. By default, the
+     * gradients are summed in full precision.
+     */
+    gradient_compression_policy gradient_compression;
+
+    /*!
+     * \brief The checkpointer used to store the weights in the background
+     * during fine-tuning. When not set, no checkpoint is taken.
+     */
+    std::shared_ptr<checkpointer> checkpoints;
+
+    /*!
+     * \brief The state of the training loaded by resume, consumed by the
+     * next fine-tuning (empty when the training is not resumed)
+     */
+    std::string resume_state;
+
     weight goal     = 0.0; ///< The learning goal
     size_t patience = 1;   ///< The patience for early stopping goals
 
+    double pruning_sparsity = 0.0; ///< The ratio of pruned weights of the dense layers reached during fine-tuning (0 to disable pruning)
+    size_t pruning_epochs   = 10;  ///< The number of epochs over which the ratio of pruned weights is gradually increased
+
+    size_t validation_samples = 0;  ///< The number of validation samples evaluated each epoch (0 to always use the full validation set)
+    size_t full_validation    = 10; ///< The number of epochs between two full validations, when the validation is sampled
+
+    size_t batch_metrics = 1; ///< The metrics of the batches are computed every N batches during fine-tuning (0 to never compute them)
+
+    /*!
+     * \brief The numerical health of the fine-tuning is checked when set.
+     * The loss and the norms of the gradients are checked for every batch
+     * and the activations, the errors and the gradients of all the layers
+     * are scanned every N batches. The training is stopped at the first
+     * non-finite value (0 to disable the checks).
+     */
+    size_t finite_checks = 0;
+
+    std::string pretrain_prefix = "dll_pretrain"; ///< The prefix of the files caching the outputs of the layers during pretraining (pretrain_cache)
+    size_t pretrain_start       = 0;              ///< The first layer trained by pretrain(), the previous layers are only forwarded
+
+    /*!
+     * \brief The placement of the threads of the network, applied by
+     * apply_placement() (at construction for the policy of the
+     * descriptor). The producers of the generators are pinned at the
+     * start of fine-tuning.
+     */
+    placement_policy placement = dbn_traits<this_type>::placement();
+
 #ifdef DLL_SVM_SUPPORT
     //TODO Ideally these fields should be private
     svm::model svm_model;    ///< The learned model
@@ -178,13 +279,13 @@ public:
 
     using ae_generator_t = std::conditional_t<
         !dbn_traits<this_type>::batch_mode(),
-        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
-        outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
+        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::corruption<desc::Corruption>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
+        outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::corruption<desc::Corruption>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
 
     using reg_generator_t = std::conditional_t<
         !dbn_traits<this_type>::batch_mode(),
-        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
-        outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
+        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::corruption<desc::Corruption>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
+        outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::corruption<desc::Corruption>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
 
     template<size_t B>
     using rbm_generator_fast_t = std::conditional_t<
@@ -204,20 +305,31 @@ public:
     template<size_t B>
     using rbm_denoising_generator_fast_t = std::conditional_t<
         !dbn_traits<this_type>::batch_mode(),
-        inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
-        outmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
+        inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::corruption<desc::Corruption>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
+        outmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::corruption<desc::Corruption>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
 
     template<size_t B>
-    using rbm_denoising_ingenerator_fast_inner_t = inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder, dll::noise<desc::Noise>>;
+    using rbm_denoising_ingenerator_fast_inner_t = inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder, dll::noise<desc::Noise>, dll::corruption<desc::Corruption>>;
 
     template<size_t B>
     using rbm_denoising_generator_fast_inner_t = std::conditional_t<
         !dbn_traits<this_type>::batch_mode(),
-        inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder, dll::noise<desc::Noise>>,
-        outmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder, dll::noise<desc::Noise>>>;
+        inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder, dll::noise<desc::Noise>, dll::corruption<desc::Corruption>>,
+        outmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder, dll::noise<desc::Noise>, dll::corruption<desc::Corruption>>>;
+
+    template<size_t B>
+    using rbm_cache_generator_inner_t = mmap_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>>;
 
 private:
-    cpp::thread_pool<!dbn_traits<this_type>::is_serial()> pool;
+    mutable cpp::thread_pool<!dbn_traits<this_type>::is_serial()> pool; ///< The thread pool, also used by the inference of collections
+
+    workspace arena; ///< The workspace shared by the kernels of the layers
+
+    thread_placement placed; ///< The CPUs of the last applied placement
+
+    uint64_t pretrain_key = 0; ///< The key of the input of the layer being pretrained (pretrain_cache)
+
+    std::unique_ptr<dll::online_trainer<this_type>> online; ///< The trainer of partial_fit, kept between the batches
 
     template<size_t I, cpp_disable_iff(I == layers)>
     void dyn_init(){
@@ -233,6 +345,85 @@ private:
     template<size_t I, cpp_enable_iff(I == layers)>
     void dyn_init(){}
 
+    /*!
+     * \brief Tie the tied layers to the weights of their encoder
+     */
+    template <size_t I>
+    void tie_layers() {
+        if constexpr (I < layers) {
+            if constexpr (is_tied_layer_v<layer_type<I>>) {
+                static_assert(layer_type<I>::encoder < I, "A tied layer must come after its encoder");
+
+                layer_get<I>().tie(layer_get<layer_type<I>::encoder>());
+            }
+
+            tie_layers<I + 1>();
+        }
+    }
+
+    /*!
+     * \brief Returns the index of the layer consuming the units of the
+     * layer before I, through the layers keeping the units, or layers if
+     * the units cannot be removed
+     */
+    template <size_t I>
+    static constexpr size_t unit_consumer() {
+        if constexpr (I == layers) {
+            return layers;
+        } else if constexpr (is_shrinkable_layer_v<layer_type<I>>) {
+            return I;
+        } else if constexpr (is_unit_passthrough_layer_v<layer_type<I>>) {
+            return unit_consumer<I + 1>();
+        } else {
+            return layers;
+        }
+    }
+
+    template <size_t L>
+    void prune_units_layer(double ratio, size_t& removed) {
+        if constexpr (L + 1 < layers) {
+            constexpr size_t C = unit_consumer<L + 1>();
+
+            if constexpr (is_shrinkable_layer_v<layer_type<L>> && C < layers) {
+                auto& layer = layer_get<L>();
+
+                const size_t units = layer.output_units();
+
+                std::vector<size_t> kept;
+
+                // Network slimming: the scale of the next batch normalization
+                if constexpr (is_batch_normalization_layer_v<layer_type<L + 1>>) {
+                    kept = select_units(layer_get<L + 1>().unit_scores(), ratio);
+                } else {
+                    kept = select_units(layer.unit_norms(), ratio);
+                }
+
+                if (kept.size() < units) {
+                    layer.shrink_outputs(kept);
+
+                    shrink_units_layers<L + 1, C>(kept);
+
+                    layer_get<C>().shrink_inputs(kept, units);
+
+                    removed += units - kept.size();
+                }
+            }
+
+            prune_units_layer<L + 1>(ratio, removed);
+        }
+    }
+
+    template <size_t I, size_t C>
+    void shrink_units_layers(const std::vector<size_t>& kept) {
+        if constexpr (I < C) {
+            if constexpr (has_shrink_units<layer_type<I>>::value) {
+                layer_get<I>().shrink_units(kept);
+            }
+
+            shrink_units_layers<I + 1, C>(kept);
+        }
+    }
+
     template<size_t L = rbm_layer_n>
     auto get_rbm_generator_desc(){
         static_assert(decay_layer_traits<layer_type<L>>::is_rbm_layer(), "Invalid use of get_rbm_generator_desc");
@@ -307,6 +498,28 @@ public:
             this->template dyn_init<0>();
         }
 
+        tie_layers<0>();
+
+        // The convolutional and recurrent layers share the temporaries of their kernels
+
+        for_each_layer([this](auto& layer) {
+            if constexpr (uses_workspace_v<decltype(layer)>) {
+                arena.reserve(layer.workspace_size());
+                layer.set_workspace(&arena);
+            }
+
+            if constexpr (dbn_traits<this_type>::huge_pages()) {
+                advise_layer_huge_pages(layer);
+            }
+        });
+
+        // Initialize the weights of all the layers at once
+        inits.run(pool);
+
+        if (placement.pin || placement.producer_cores) {
+            apply_placement();
+        }
+
         // Update defaults for each updater type
 
         if(updater == updater_type::RMSPROP){
@@ -338,6 +551,114 @@ public:
     dbn(dbn&& dbn) = delete;
     dbn& operator=(dbn&& dbn) = delete;
 
+    /*!
+     * \brief Apply the placement policy: pin the workers of the thread pool
+     * of the network to the compute CPUs and restrict the calling thread
+     * (and the threads it creates, the workers of ETL for instance) to all
+     * of them, and select the CPUs of the producers.
+     *
+     * \return The selected CPUs
+     */
+    const thread_placement& apply_placement() {
+        placed = make_placement(placement);
+
+        if (placed.pinned()) {
+            pin_pool_workers(pool, etl::threads, placed.compute);
+            bind_current_thread(placed.compute);
+        }
+
+        return placed;
+    }
+
+    /*!
+     * \brief Pin the producer threads of the given generator to the CPUs
+     * dedicated to the producers by the placement, if any
+     */
+    template <typename Generator>
+    void place_producers(Generator& generator) {
+        if (!placed.producers.empty()) {
+            pin_producers(generator, placed.producers);
+        }
+    }
+
+    /*!
+     * \brief Returns the thread pool of the network, used by the trainers
+     * to run independent work concurrently.
+     */
+    auto& get_thread_pool() {
+        return pool;
+    }
+
+    /*!
+     * \brief Select the fastest convolution algorithm of each convolutional
+     * layer, for its shape, the given batch size and the threads of the
+     * network, by benchmarking the candidates.
+     *
+     * The decisions are read from and stored to the given file, if any, so
+     * that the next runs on the same CPU model do not benchmark again.
+     *
+     * \param batch The batch size the network will be used with
+     * \param file The file of the decisions (none if empty)
+     */
+    void autotune_convolutions(size_t batch = batch_size, const std::string& file = "") {
+        dll::auto_timer timer("net:autotune");
+
+        conv_tuning_cache cache;
+
+        if (!file.empty()) {
+            cache.load(file);
+        }
+
+        thread_pool_scope pool_scope(pool);
+
+        for_each_layer([batch, &cache](auto& layer) {
+            if constexpr (is_autotunable_layer_v<decltype(layer)>) {
+                layer.autotune(batch, cache);
+            }
+        });
+
+        if (!file.empty()) {
+            cache.store(file);
+        }
+    }
+
+    /*!
+     * \brief Allocate ahead of time the buffers used by the network for the
+     * given mode and batch size, so that the first batches do not pay for
+     * them.
+     *
+     * The workspace of the kernels is already allocated by the
+     * constructor. In training mode, the backup weights are allocated,
+     * which overwrites a previous backup. If forward is set, a batch of
+     * zeros is forwarded in test mode on the thread pool of the network,
+     * which sizes the caches of the layers (recurrent states, folded and
+     * transformed weights, ...) for this batch size and initializes the
+     * BLAS and the threads. The generators and the trainer contexts are
+     * not allocated, they do not exist yet.
+     *
+     * \param max_batch The largest batch size the network will be used with
+     * \param mode The usage of the network
+     * \param forward Indicates if a dummy batch must be forwarded
+     */
+    void warmup(size_t max_batch = batch_size, warmup_mode mode = warmup_mode::INFERENCE, bool forward = true) {
+        dll::auto_timer timer("net:warmup");
+
+        if (mode == warmup_mode::TRAINING) {
+            backup_weights();
+        }
+
+        if (forward && max_batch) {
+            thread_pool_scope pool_scope(pool);
+
+            auto one = layer_get<input_layer_n>().prepare_one_input();
+
+            auto batch = dll::make_batch(max_batch, one);
+            batch = weight(0);
+
+            test_forward_batch(batch);
+        }
+    }
+
     /*!
      * \brief Prints a textual representation of the network.
      */
@@ -496,6 +817,164 @@ public:
         out << buffer;
     }
 
+    /*!
+     * \brief Add the memory held by the layers of the network (weights,
+     * backups and caches) to the given report
+     */
+    void report_memory(memory_report& report) const {
+        size_t i = 0;
+
+        for_each_layer([&](auto& layer) {
+            const std::string name = "layer:" + std::to_string(i++) + ":" + layer.to_short_string("");
+
+            report.add(name + " weights", layer_weights_bytes(layer));
+            report.add(name + " backups", layer_backup_bytes(layer));
+            report.add(name + " caches", layer_cache_bytes(layer));
+        });
+    }
+
+    /*!
+     * \brief Returns the memory held by the layers of the network
+     */
+    memory_report memory() const {
+        memory_report report;
+        report_memory(report);
+        report.record_peak();
+        return report;
+    }
+
+    /*!
+     * \brief Prints the memory held by the layers of the network
+     */
+    void display_memory() const {
+        out << "\nMemory:\n";
+        memory().display(out);
+    }
+
+    /*!
+     * \brief Returns the estimated cost of each layer of the network for a
+     * batch of the given size
+     */
+    std::vector<layer_cost> layer_costs(size_t batch = batch_size) const {
+        std::vector<layer_cost> costs;
+
+        std::vector<size_t> output;
+
+        auto volume = [](const std::vector<size_t>& shape) {
+            return shape.empty() ? size_t(0) : std::accumulate(shape.begin(), shape.end(), size_t(1), std::multiplies<>());
+        };
+
+        for_each_layer([&](auto& layer) {
+            size_t in = volume(output);
+
+            output = layer.output_shape(output);
+
+            size_t out = volume(output);
+
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                in  = layer.input_size();
+                out = layer.output_size();
+            }
+
+            costs.push_back(estimate_layer_cost(layer, in, out, batch, sizeof(weight)));
+        });
+
+        return costs;
+    }
+
+    /*!
+     * \brief Measure the duration of the forward pass of each layer of the
+     * network, on a dummy batch of the given size
+     * \param batch The size of the batch
+     * \param repeat The number of measured passes of each layer
+     * \return The average duration of each layer, in nanoseconds
+     */
+    std::vector<double> profile_forward(size_t batch = batch_size, size_t repeat = 10) const {
+        thread_pool_scope pool_scope(pool);
+
+        std::vector<double> durations(layers);
+
+        auto one = layer_get<input_layer_n>().prepare_one_input();
+
+        auto input = dll::make_batch(batch, one);
+        input = weight(0);
+
+        profile_forward_impl<0>(input, durations, std::max(size_t(1), repeat));
+
+        return durations;
+    }
+
+    /*!
+     * \brief Prints the estimated cost of each layer with its measured
+     * throughput, in a roofline view
+     * \param batch The size of the batch
+     * \param repeat The number of measured passes of each layer
+     * \param balance The machine balance, peak FLOP/s over peak bytes/s, separating the memory-bound layers from the compute-bound ones
+     */
+    void display_roofline(size_t batch = batch_size, size_t repeat = 10, double balance = 8.0) const {
+        constexpr size_t columns = 9;
+
+        auto costs     = layer_costs(batch);
+        auto durations = profile_forward(batch, repeat);
+
+        const double total = std::accumulate(durations.begin(), durations.end(), 0.0);
+
+        std::array<std::string, columns> column_name{{"Index", "Layer", "MFLOP", "MB", "FLOP/B", "Time", "%", "GFLOP/s", "GB/s"}};
+
+        std::vector<std::array<std::string, columns>> rows;
+
+        size_t i = 0;
+
+        for_each_layer([&](auto& layer) {
+            auto& cost      = costs[i];
+            const double ns = durations[i];
+            const double ai = cost.forward_intensity();
+
+            rows.push_back({{std::to_string(i), layer.to_short_string(""),
+                             to_string_precision(cost.forward_flops * 1e-6, 4), to_string_precision(cost.forward_bytes * 1e-6, 4),
+                             to_string_precision(ai, 3) + (ai < balance ? " (mem)" : " (cpu)"), duration_str(ns, 4),
+                             to_string_precision(total > 0.0 ? 100.0 * ns / total : 0.0, 3),
+                             to_string_precision(ns > 0.0 ? cost.forward_flops / ns : 0.0, 4),
+                             to_string_precision(ns > 0.0 ? cost.forward_bytes / ns : 0.0, 4)}});
+
+            ++i;
+        });
+
+        std::array<size_t, columns> column_length;
+
+        for (size_t c = 0; c < columns; ++c) {
+            column_length[c] = column_name[c].size();
+
+            for (auto& row : rows) {
+                column_length[c] = std::max(column_length[c], row[c].size());
+            }
+        }
+
+        const size_t line_length = (columns + 1) * 1 + 2 + (columns - 1) * 2 + std::accumulate(column_length.begin(), column_length.end(), 0);
+
+        auto print_row = [&](const std::array<std::string, columns>& row) {
+            out << " |";
+
+            for (size_t c = 0; c < columns; ++c) {
+                out << " " << row[c] << std::string(column_length[c] - row[c].size(), ' ') << " |";
+            }
+
+            out << '\n';
+        };
+
+        out << '\n';
+        out << " " << std::string(line_length, '-') << '\n';
+        print_row(column_name);
+        out << " " << std::string(line_length, '-') << '\n';
+
+        for (auto& row : rows) {
+            print_row(row);
+        }
+
+        out << " " << std::string(line_length, '-') << '\n';
+        out << "  Forward of a batch of " << batch << ": " << duration_str(total, 4) << '\n';
+    }
+
     /*!
      * \brief Backup the weights of all the layers into a temporary storage.
      *
@@ -520,6 +999,172 @@ public:
         });
     }
 
+    /*!
+     * \brief Restore the weights previously saved by swapping them with the
+     * current weights, in constant time for the dynamic matrices.
+     *
+     * The temporary storage holds the replaced weights afterwards, i.e.
+     * calling this function twice restores the current weights.
+     */
+    void swap_weights() {
+        for_each_layer([](auto& layer) {
+            layer.swap_weights();
+        });
+    }
+
+    /*!
+     * \brief Fold the batch normalization layers into the weights and biases
+     * of the layers preceding them, for inference.
+     *
+     * A batch normalization layer is folded when it directly follows a
+     * dense or convolutional layer with biases and without activation
+     * function. The folded layers become the identity, the network must not
+     * be trained anymore after this. The other batch normalization layers
+     * keep their (cached) test-time transformation.
+     *
+     * \return The number of folded layers
+     */
+    size_t fold_batch_normalization() {
+        size_t folded = 0;
+
+        for_each_layer_pair([&folded](auto& layer_1, auto& layer_2) {
+            using layer_1_t = std::decay_t<decltype(layer_1)>;
+
+            if constexpr (is_batch_normalization_layer_v<decltype(layer_2)>) {
+                if constexpr (std::decay_t<decltype(layer_2)>::template foldable_into<layer_1_t>()) {
+                    if (!layer_2.folded) {
+                        layer_2.fold_into(layer_1);
+                        ++folded;
+                    }
+                }
+            }
+        });
+
+        return folded;
+    }
+
+    /*!
+     * \brief Prune the weights of the dense layers with the smallest
+     * magnitude, with a global threshold for all the layers.
+     *
+     * The pruned weights are kept at zero by the next trainings and are
+     * computed with the sparse kernels once they are sparse enough. The
+     * weights pruned before stay pruned.
+     *
+     * \param sparsity The ratio of weights to prune, in [0, 1]
+     * \return The magnitude threshold that has been used
+     */
+    weight prune(double sparsity) {
+        std::vector<weight> magnitudes;
+
+        for_each_layer([&magnitudes](auto& layer) {
+            if constexpr (is_prunable_layer_v<decltype(layer)>) {
+                append_magnitudes(layer.w, magnitudes);
+            }
+        });
+
+        const auto threshold = magnitude_threshold(magnitudes, sparsity);
+
+        for_each_layer([threshold](auto& layer) {
+            if constexpr (is_prunable_layer_v<decltype(layer)>) {
+                layer.prune(threshold);
+            }
+        });
+
+        return threshold;
+    }
+
+    /*!
+     * \brief Remove the given ratio of the neurons of the dense layers and of
+     * the filters of the convolutional layers, shrinking the layers.
+     *
+     * The units with the smallest L2 norm are removed, or the ones with the
+     * smallest gamma when the layer is followed by a batch normalization
+     * layer. The inputs of the next dense or convolutional layer are
+     * removed with them, through the batch normalization, pooling,
+     * activation and dropout layers in between. The last layer keeps its
+     * outputs.
+     *
+     * Only the dynamic layers can be shrunk, a network with static layers
+     * must be converted first with make_dynamic(). The network should be
+     * fine-tuned after this.
+     *
+     * \param ratio The ratio of units to remove from each layer, in [0, 1]
+     * \return The number of removed units
+     */
+    size_t prune_units(double ratio) {
+        static_assert(dbn_traits<this_type>::is_dynamic(), "Only the dynamic layers can be shrunk, see make_dynamic()");
+
+        size_t removed = 0;
+
+        prune_units_layer<0>(ratio, removed);
+
+        return removed;
+    }
+
+    /*!
+     * \brief Create an 8-bit quantized inference version of the network.
+     *
+     * The input scales of the quantized layers are calibrated on the
+     * samples of the given generator. The network must outlive the returned
+     * object, which uses its layers without weights.
+     *
+     * \param generator The generator of the calibration samples
+     * \return The quantized network
+     */
+    template <typename Generator>
+    quantized_network<this_type> quantize(Generator& generator) {
+        quantized_network<this_type> quantized(*this);
+
+        quantized.calibrate(generator);
+
+        return quantized;
+    }
+
+    /*!
+     * \brief Create a frozen inference-only version of the network.
+     *
+     * The batch normalization layers are first folded into the layers
+     * preceding them, the network must not be trained anymore after this.
+     * The parameters of the dense layers are packed in one allocation and
+     * the dropout layers are removed. The network must outlive the returned
+     * object, which uses its other layers.
+     *
+     * \return The frozen network
+     */
+    frozen_network<this_type> freeze() {
+        fold_batch_normalization();
+
+        return frozen_network<this_type>(*this);
+    }
+
+    /*!
+     * \brief Create a frozen inference-only version of the network, whose
+     * dense layers use their weights directly from the given mapping.
+     *
+     * The other layers are loaded from the mapping. The network and the
+     * mapping must outlive the returned object.
+     *
+     * \param weights The mapping of a file written by store_mapped
+     * \return The frozen network
+     */
+    frozen_network<this_type> freeze(const mapped_weights& weights) {
+        cpp_assert(weights.is_open() && weights.blocks() == layers, "Invalid mapped weights");
+        cpp_assert(weights.dtype() == sizeof(weight), "Invalid type of the mapped weights");
+
+        size_t i = 0;
+
+        for_each_layer([&](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer() && !detail::frozen_view_v<decltype(layer)>) {
+                load_mapped_layer(layer, weights, i);
+            }
+
+            ++i;
+        });
+
+        return frozen_network<this_type>(*this, weights);
+    }
+
     /*!
      * \brief Store the network weights to the given file.
      * \param file The path to the file
@@ -538,6 +1183,44 @@ public:
         load(is);
     }
 
+    /*!
+     * \brief Store the network weights to a new checkpoint of the given
+     * checkpointer. The weights are written in the background.
+     * \param checkpoints The checkpointer
+     * \return The name of the checkpoint file
+     */
+    std::string store_async(checkpointer& checkpoints) const {
+        return checkpoints.checkpoint(*this);
+    }
+
+    /*!
+     * \brief Load the weights and the state of the training from the given
+     * checkpoint. The next fine-tuning resumes the training from the batch
+     * following the checkpoint, with the states of the updater, of the
+     * early stopping, of the random generator and of the order of the
+     * training generator.
+     *
+     * \param file The path to the checkpoint file
+     * \return false if the checkpoint only holds weights, in which case
+     * only the weights are loaded
+     */
+    bool resume(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+        load(is);
+
+        std::ostringstream state;
+        state << is.rdbuf();
+
+        resume_state = state.str();
+
+        if (!dbn_trainer<this_type>::is_training_state(resume_state)) {
+            resume_state.clear();
+            return false;
+        }
+
+        return true;
+    }
+
     /*!
      * \brief Store the network weights using the given output stream.
      * \param os The stream to output the network weights to.
@@ -570,6 +1253,208 @@ public:
 #endif //DLL_SVM_SUPPORT
     }
 
+    /*!
+     * \brief Store the network weights to the given file, in the
+     * self-describing model format, one tensor per layer.
+     *
+     * The tensors are encoded in parallel, on the thread pool of the
+     * network, with a checksum per chunk. The FP16 and INT8 encodings are
+     * lossy.
+     *
+     * \param file The path to the file
+     * \param encoding The encoding of the weights
+     * \return true if the file was written, false otherwise
+     */
+    bool store_compressed(const std::string& file, model_encoding encoding = model_encoding::RAW) const {
+        thread_pool_scope pool_scope(pool);
+
+        std::ofstream os(file, std::ofstream::binary);
+
+        if (!os) {
+            std::cerr << "ERROR: Impossible to open " << file << std::endl;
+            return false;
+        }
+
+        write_model_header(os, sizeof(weight), layers);
+
+        for_each_layer([&os, encoding](auto& layer) {
+            std::vector<weight> values;
+
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                std::ostringstream ss;
+                layer.store(ss);
+
+                auto raw = ss.str();
+
+                values.resize(raw.size() / sizeof(weight));
+                std::memcpy(values.data(), raw.data(), values.size() * sizeof(weight));
+            }
+
+            write_model_tensor(os, values.data(), values.size(), encoding);
+        });
+
+        return bool(os);
+    }
+
+    /*!
+     * \brief Load the network weights from the given file, written by
+     * store_compressed.
+     *
+     * The whole file is verified before any layer is modified, an
+     * incompatible, truncated or corrupted file or a mismatch of the sizes
+     * of the layers leaves the network unchanged.
+     *
+     * \param file The path to the file
+     * \return true if the weights were loaded, false otherwise
+     */
+    bool load_compressed(const std::string& file) {
+        thread_pool_scope pool_scope(pool);
+
+        std::ifstream is(file, std::ifstream::binary);
+
+        if (!is) {
+            std::cerr << "ERROR: Impossible to open " << file << std::endl;
+            return false;
+        }
+
+        if (!read_model_header(is, sizeof(weight), layers)) {
+            return false;
+        }
+
+        std::vector<std::vector<weight>> tensors(layers);
+
+        bool valid = true;
+        size_t i   = 0;
+
+        for_each_layer([&](auto& layer) {
+            size_t expected = 0;
+
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                std::ostringstream ss;
+                layer.store(ss);
+
+                expected = ss.str().size() / sizeof(weight);
+            }
+
+            valid = valid && read_model_tensor(is, tensors[i], expected);
+
+            ++i;
+        });
+
+        if (!valid) {
+            return false;
+        }
+
+        i = 0;
+
+        for_each_layer([&](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                mapped_block_buffer buffer(reinterpret_cast<char*>(tensors[i].data()), tensors[i].size() * sizeof(weight));
+                std::istream block(&buffer);
+
+                layer.load(block);
+            }
+
+            ++i;
+        });
+
+        return true;
+    }
+
+    /*!
+     * \brief Store the network weights to the given file, in the aligned
+     * memory-mapped weights format, one block per layer.
+     * \param file The path to the file
+     * \return true if the file was written, false otherwise
+     */
+    bool store_mapped(const std::string& file) const {
+        std::vector<std::string> blocks;
+        blocks.reserve(layers);
+
+        for_each_layer([&blocks](auto& layer) {
+            std::ostringstream os;
+
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                layer.store(os);
+            }
+
+            blocks.push_back(os.str());
+        });
+
+        return write_mapped_weights(file, sizeof(weight), blocks);
+    }
+
+    /*!
+     * \brief Load the network weights from the given mapping of a file
+     * written by store_mapped.
+     * \param weights The mapped weights
+     */
+    void load_mapped(const mapped_weights& weights) {
+        cpp_assert(weights.is_open() && weights.blocks() == layers, "Invalid mapped weights");
+        cpp_assert(weights.dtype() == sizeof(weight), "Invalid type of the mapped weights");
+
+        size_t i = 0;
+
+        for_each_layer([&](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                load_mapped_layer(layer, weights, i);
+            }
+
+            ++i;
+        });
+    }
+
+    /*!
+     * \brief Store the network weights to the given file, only the
+     * non-zero weights of the dense layers.
+     * \param file The path to the file
+     */
+    void store_sparse(const std::string& file) const {
+        std::ofstream os(file, std::ofstream::binary);
+        store_sparse(os);
+    }
+
+    /*!
+     * \brief Load the network weights stored with store_sparse from the
+     * given file.
+     * \param file The path to the file
+     */
+    void load_sparse(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+        load_sparse(is);
+    }
+
+    /*!
+     * \brief Store the network weights using the given output stream, only
+     * the non-zero weights of the dense layers.
+     * \param os The stream to output the network weights to.
+     */
+    void store_sparse(std::ostream& os) const {
+        for_each_layer([&os](auto& layer) {
+            if constexpr (is_prunable_layer_v<decltype(layer)>) {
+                layer.store_sparse(os);
+            } else if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                layer.store(os);
+            }
+        });
+    }
+
+    /*!
+     * \brief Load the network weights stored with store_sparse from the
+     * given stream. The zero weights of the dense layers are considered
+     * pruned.
+     * \param is The stream to load the network weights from.
+     */
+    void load_sparse(std::istream& is) {
+        for_each_layer([&is](auto& layer) {
+            if constexpr (is_prunable_layer_v<decltype(layer)>) {
+                layer.load_sparse(is);
+            } else if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                layer.load(is);
+            }
+        });
+    }
+
     /*!
      * \brief Returns the Nth layer.
      * \return The Nth layer
@@ -653,11 +1538,15 @@ public:
     template <typename Generator, cpp_enable_iff(is_generator<Generator>)>
     void pretrain(Generator& generator, size_t max_epochs) {
         static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
+        static_assert(!dbn_traits<this_type>::pretrain_cache() || !dbn_traits<this_type>::pretrain_pipeline(), "pretrain_cache and pretrain_pipeline cannot be used together");
 
         validate_pretraining();
 
         dll::auto_timer timer("net:pretrain");
 
+        // The layer trainers may use the thread pool of the network
+        thread_pool_scope pool_scope(pool);
+
         watcher_t watcher;
 
         watcher.pretraining_begin(*this, max_epochs);
@@ -672,6 +1561,10 @@ public:
 
             pretrain_layer_batch<0>(generator, watcher, max_epochs);
         } else {
+            if constexpr (dbn_traits<this_type>::pretrain_cache()) {
+                pretrain_key = pretrain_input_key(generator);
+            }
+
             pretrain_layer<0>(generator, watcher, max_epochs);
         }
 
@@ -740,6 +1633,9 @@ public:
 
         dll::auto_timer timer("net:pretrain:denoising");
 
+        // The layer trainers may use the thread pool of the network
+        thread_pool_scope pool_scope(pool);
+
         watcher_t watcher;
 
         watcher.pretraining_begin(*this, max_epochs);
@@ -921,8 +1817,34 @@ public:
 
     // Forward one batch at a time
 
-    // Forward functions are not perfect:
-    // TODO: Transform layers should be applied inline
+    // The shape layers are views, the elementwise layers are computed in
+    // place on the outputs of the network, consecutive ones in a single pass
+
+    /*!
+     * \brief Returns the end of the run of fusable layers starting at the
+     * layer L, before the layer LS
+     */
+    template <size_t L, size_t LS>
+    static constexpr size_t fused_end() {
+        if constexpr (L < LS && is_fusable_layer_v<layer_type<L>>) {
+            return fused_end<L + 1, LS>();
+        } else {
+            return L;
+        }
+    }
+
+    /*!
+     * \brief Returns the expression of the fusable layers [L, E) applied to
+     * the given expression
+     */
+    template <size_t L, size_t E, typename Expr>
+    static decltype(auto) fused_layers_expr(Expr&& expr) {
+        if constexpr (L + 1 == E) {
+            return layer_type<L>::fused_expr(std::forward<Expr>(expr));
+        } else {
+            return fused_layers_expr<L + 1, E>(layer_type<L>::fused_expr(std::forward<Expr>(expr)));
+        }
+    }
 
     /*
      * \brief Return the test representation for the given input batch.
@@ -934,14 +1856,69 @@ public:
      *
      * \return The test representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Input>
+    template <size_t LS, size_t L, bool Owned = false, typename Input>
     decltype(auto) test_forward_batch_impl(Input&& sample) const {
-        if constexpr (L != LS) {
-            decltype(auto) next = layer_get<L>().test_forward_batch(sample);
-            return test_forward_batch_impl<LS, L + 1>(next);
+        if constexpr (L != LS && is_alias_layer_v<layer_type<L>>) {
+            // The next layer reads the input through a view with the new shape
+            auto next = layer_get<L>().alias_batch(sample);
+            return test_forward_batch_impl<LS, L + 1, Owned>(next);
+        } else if constexpr (L != LS && Owned && fused_end<L, LS>() > L + 1) {
+            // The consecutive elementwise layers are computed in a single pass
+            sample = fused_layers_expr<L, fused_end<L, LS>()>(sample);
+            return test_forward_batch_impl<LS, fused_end<L, LS>(), Owned>(sample);
+        } else if constexpr (L != LS && Owned && is_in_place_layer_v<layer_type<L>>) {
+            // The batch is an output of the network, it can be overwritten
+            {
+                latency_timer timer(layer_latency_name<L>());
+                layer_get<L>().forward_batch_in_place(sample);
+            }
+
+            return test_forward_batch_impl<LS, L + 1, Owned>(sample);
+        } else if constexpr (L != LS) {
+            decltype(auto) next = timed_test_forward_batch<L>(sample);
+            return test_forward_batch_impl<LS, L + 1, true>(next);
         } else {
-            return layer_get<L>().test_forward_batch(sample);
+            return timed_test_forward_batch<L>(sample);
+        }
+    }
+
+    /*!
+     * \brief Measure the forward pass of the layer L and of the next ones
+     */
+    template <size_t L, typename Input>
+    void profile_forward_impl(const Input& input, std::vector<double>& durations, size_t repeat) const {
+        auto start = std::chrono::steady_clock::now();
+
+        for (size_t r = 0; r < repeat; ++r) {
+            forward_batch<L, L>(input);
         }
+
+        auto end = std::chrono::steady_clock::now();
+
+        durations[L] = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / double(repeat);
+
+        if constexpr (L + 1 < layers) {
+            auto next = forward_batch<L, L>(input);
+            profile_forward_impl<L + 1>(next, durations, repeat);
+        }
+    }
+
+    /*!
+     * \brief Returns the name of the latency histogram of the layer L
+     */
+    template <size_t L>
+    const char* layer_latency_name() const {
+        static const std::string name = "layer:" + std::to_string(L) + ":" + layer_get<L>().to_short_string();
+        return name.c_str();
+    }
+
+    /*!
+     * \brief Apply the layer L to the given batch, recording its latency
+     */
+    template <size_t L, typename Input>
+    decltype(auto) timed_test_forward_batch(Input&& sample) const {
+        latency_timer timer(layer_latency_name<L>());
+        return layer_get<L>().test_forward_batch(sample);
     }
 
     /*
@@ -954,11 +1931,23 @@ public:
      *
      * \return The train representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Input>
+    template <size_t LS, size_t L, bool Owned = false, typename Input>
     decltype(auto) train_forward_batch_impl(Input&& sample) {
-        if constexpr (L != LS) {
+        if constexpr (L != LS && is_alias_layer_v<layer_type<L>>) {
+            // The next layer reads the input through a view with the new shape
+            auto next = layer_get<L>().alias_batch(sample);
+            return train_forward_batch_impl<LS, L + 1, Owned>(next);
+        } else if constexpr (L != LS && Owned && fused_end<L, LS>() > L + 1) {
+            // The consecutive elementwise layers are computed in a single pass
+            sample = fused_layers_expr<L, fused_end<L, LS>()>(sample);
+            return train_forward_batch_impl<LS, fused_end<L, LS>(), Owned>(sample);
+        } else if constexpr (L != LS && Owned && is_in_place_layer_v<layer_type<L>>) {
+            // The batch is an output of the network, it can be overwritten
+            layer_get<L>().forward_batch_in_place(sample);
+            return train_forward_batch_impl<LS, L + 1, Owned>(sample);
+        } else if constexpr (L != LS) {
             decltype(auto) next = layer_get<L>().train_forward_batch(sample);
-            return train_forward_batch_impl<LS, L + 1>(next);
+            return train_forward_batch_impl<LS, L + 1, true>(next);
         } else {
             return layer_get<L>().train_forward_batch(sample);
         }
@@ -1006,13 +1995,47 @@ public:
      */
     template <size_t LS = layers - 1, size_t L = 0, typename Input>
     decltype(auto) forward_batch(Input&& sample) const {
+        latency_timer timer("net:forward_batch");
+        return test_forward_batch_impl<LS, L>(sample);
+    }
+
+    /*!
+     * \brief Create a new context for the inference of this network, to
+     * run forward_batch(context, batch) from several threads at the same
+     * time, one context per thread.
+     */
+    inference_context make_inference_context() const {
+        return inference_context(arena.size());
+    }
+
+    /*
+     * \brief Return the test representation for the given input batch,
+     * using the temporaries of the given context instead of the ones of the
+     * network, so that several threads can share the network.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     * \tparam L The layer to which the input is given
+     *
+     * \param context The inference context of the current thread
+     * \param sample The input batch to the layer L
+     *
+     * \return The test representation of the LS layer forwarded from L
+     */
+    template <size_t LS = layers - 1, size_t L = 0, typename Input>
+    decltype(auto) forward_batch(inference_context& context, Input&& sample) const {
+        latency_timer timer("net:forward_batch");
+        workspace_scope scope(arena, context.arena);
+        arena_scope step(context.temporaries);
+
         return test_forward_batch_impl<LS, L>(sample);
     }
 
     // Forward one sample at a time
-    // This is not as fast as it could be, far from it, but supports
-    // larger range of input. The rationale being that time should
-    // be spent in forward_batch
+    // The layers with a single-sample kernel (dense) use it instead of a
+    // batch of one sample and the fixed-size intermediate outputs are
+    // reused between the calls, for the latency of the inference of one
+    // sample. The rationale being that throughput should be spent in
+    // forward_batch
 
     /*
      * \brief Return the test representation for the given input sample.
@@ -1027,8 +2050,21 @@ public:
     template <size_t LS, size_t L, typename Input>
     decltype(auto) test_forward_one_impl(Input&& sample) const {
         if constexpr (L != LS) {
-            decltype(auto) next = layer_get<L>().test_forward_one(sample);
-            return test_forward_one_impl<LS, L + 1>(next);
+            decltype(auto) layer = layer_get<L>();
+
+            using next_t = std::decay_t<decltype(prepare_one_ready_output(layer, sample))>;
+
+            if constexpr (etl::all_fast<next_t>) {
+                // The shape only depends on the type, the intermediate
+                // output can be reused by every network of this type
+                thread_local next_t next;
+
+                layer.test_forward_one(next, sample);
+                return test_forward_one_impl<LS, L + 1>(next);
+            } else {
+                decltype(auto) next = layer.test_forward_one(sample);
+                return test_forward_one_impl<LS, L + 1>(next);
+            }
         } else {
             return layer_get<L>().test_forward_one(sample);
         }
@@ -1096,13 +2132,13 @@ public:
      */
     template <size_t LS = layers - 1, size_t L = 0, typename Input>
     decltype(auto) forward_one(Input&& sample) const {
+        latency_timer timer("net:forward_one");
         return test_forward_one_impl<LS, L>(sample);
     }
 
     // Forward a collection of samples at a time
-    // This is not as fast as it could be, far from it, but supports
-    // larger range of input. The rationale being that time should
-    // be spent in forward_batch
+    // The test representations are computed in batches, as for the
+    // iterators below, the train representations sample by sample
 
     /*
      * \brief Return the test representation for the given collection of inputs.
@@ -1116,17 +2152,7 @@ public:
      */
     template <size_t LS, size_t L, typename Inputs>
     decltype(auto) test_forward_many_impl(Inputs&& samples) const {
-        decltype(auto) layer = layer_get<L>();
-
-        auto next = prepare_many_ready_output(layer, samples[0], samples.size());
-
-        layer.test_forward_many(next, samples);
-
-        if constexpr (L != LS) {
-            return test_forward_many_impl<LS, L + 1>(next);
-        } else {
-            return next;
-        }
+        return test_forward_many_impl<LS, L>(samples.begin(), samples.end());
     }
 
     /*
@@ -1200,9 +2226,11 @@ public:
     }
 
     // Forward a collection of samples (iterators) at a time
-    // This is not as fast as it could be, far from it, but supports
-    // larger range of input. The rationale being that time should
-    // be spent in forward_batch
+    // The test representations are computed by streaming batches of
+    // batch_size samples through test_forward_batch, the chunks of batches
+    // being computed on the thread pool of the network, each with its own
+    // inference context, so that only the outputs of the last layer are
+    // kept for the whole collection
 
     /*
      * \brief Return the test representation for the given collection of inputs.
@@ -1217,20 +2245,46 @@ public:
      */
     template <size_t LS, size_t L, typename Iterator>
     decltype(auto) test_forward_many_impl(const Iterator& first, const Iterator& last) const {
-        decltype(auto) layer = layer_get<L>();
+        const size_t n = std::distance(first, last);
 
-        auto n    = std::distance(first, last);
-        auto next = prepare_many_ready_output(layer, *first, n);
+        // The outputs have the shape of the outputs of the first sample
+        auto result = [&]() {
+            if constexpr (L == LS) {
+                return prepare_many_ready_output(layer_get<LS>(), *first, n);
+            } else {
+                decltype(auto) input = test_forward_one_impl<LS - 1, L>(*first);
+                return prepare_many_ready_output(layer_get<LS>(), input, n);
+            }
+        }();
 
-        cpp::foreach_i(first, last, [&](auto& sample, size_t i) {
-            layer.test_forward_one(next[i], sample);
+        const size_t batches = (n + batch_size - 1) / batch_size;
+        const size_t chunks  = std::min(batches, dbn_traits<this_type>::is_serial() ? size_t(1) : size_t(etl::threads));
+
+        dll::maybe_parallel_foreach_n(pool, 0, chunks, [&](size_t c) {
+            auto context = make_inference_context();
+
+            // The chunk c computes the batches c, c + chunks, ...
+            for (size_t b = c; b < batches; b += chunks) {
+                const size_t begin = b * batch_size;
+                const size_t end   = std::min(n, begin + batch_size);
+
+                auto it = std::next(first, begin);
+
+                auto batch = dll::make_batch(end - begin, *it);
+
+                for (size_t i = 0; i < end - begin; ++i, ++it) {
+                    batch(i) = *it;
+                }
+
+                auto output = forward_batch<LS, L>(context, batch);
+
+                for (size_t i = begin; i < end; ++i) {
+                    result[i] = output(i - begin);
+                }
+            }
         });
 
-        if constexpr (L != LS) {
-            return test_forward_many_impl<LS, L + 1>(next);
-        } else {
-            return next;
-        }
+        return result;
     }
 
     /*
@@ -1328,6 +2382,70 @@ public:
         }
     }
 
+    /*!
+     * \brief Export the features of the layer LS of all the samples of the
+     * given generator, with their labels, into a single file in the
+     * memory-mapped dataset format.
+     *
+     * The batches are forwarded in test mode, with the thread pool of the
+     * network, and written as soon as they are computed. The file can be
+     * read back with make_mmap_generator.
+     *
+     * \tparam LS The layer whose features are exported
+     * \param generator The generator of the samples
+     * \param path The path of the file to write
+     * \return true if the file has been written, false otherwise
+     */
+    template <size_t LS = layers - 1, typename Generator>
+    bool export_features(Generator& generator, const std::string& path) const {
+        dll::auto_timer timer("net:export_features");
+
+        // The layers may use the thread pool of the network
+        thread_pool_scope pool_scope(pool);
+
+        generator.reset();
+        generator.set_test();
+
+        std::unique_ptr<mmap_dataset_writer<weight>> writer;
+
+        while (generator.has_next_batch()) {
+            auto input_batch = generator.data_batch();
+            auto label_batch = generator.label_batch();
+
+            const size_t n = etl::dim<0>(input_batch);
+
+            auto output = test_forward_batch<LS>(input_batch);
+
+            const size_t feature_size = etl::size(output) / n;
+            const size_t label_width  = etl::size(label_batch) / etl::dim<0>(label_batch);
+
+            if (!writer) {
+                std::vector<size_t> shape;
+
+                for (size_t d = 1; d < etl::dimensions(output); ++d) {
+                    shape.push_back(etl::dim(output, d));
+                }
+
+                writer = std::make_unique<mmap_dataset_writer<weight>>(path, generator.size(), shape, label_width);
+            }
+
+            etl::dyn_matrix<weight, 2> features(n, feature_size);
+            etl::dyn_matrix<weight, 2> labels(n, label_width);
+
+            features = etl::reshape(output, n, feature_size);
+            labels   = etl::reshape(etl::slice(label_batch, 0, n), n, label_width);
+
+            features.ensure_cpu_up_to_date();
+            labels.ensure_cpu_up_to_date();
+
+            writer->write(features.memory_start(), labels.memory_start(), n);
+
+            generator.next_batch();
+        }
+
+        return writer && writer->good();
+    }
+
     template <typename Output>
     size_t predict_label(const Output& result) const {
         return std::distance(result.begin(), std::max_element(result.begin(), result.end()));
@@ -1339,6 +2457,63 @@ public:
         return predict_label(result);
     }
 
+    /*!
+     * \brief Predict the k best labels of the given sample
+     * \param item The sample
+     * \param k The number of labels
+     * \return The k best labels, from the most to the least likely
+     */
+    template <typename Input>
+    std::vector<size_t> predict_topk(const Input& item, size_t k) const {
+        auto result = forward_one(item);
+
+        result.ensure_cpu_up_to_date();
+
+        const size_t width = etl::size(result);
+
+        std::vector<size_t> top(std::min(k, width));
+
+        topk_row(result.memory_start(), width, top.size(), top.data());
+
+        return top;
+    }
+
+    /*!
+     * \brief Predict the k best labels of each sample of the given batch.
+     *
+     * The rows are selected in parallel on the thread pool of the network.
+     *
+     * \param batch The batch of samples
+     * \param k The number of labels per sample
+     * \return The k best labels of each sample, from the most to the least
+     * likely, the labels of the sample i starting at i * k
+     */
+    template <typename Input>
+    std::vector<size_t> predict_topk_batch(const Input& batch, size_t k) const {
+        auto output = forward_batch(batch);
+
+        output.ensure_cpu_up_to_date();
+
+        const size_t n     = etl::dim<0>(output);
+        const size_t width = n ? etl::size(output) / n : 0;
+
+        k = std::min(k, width);
+
+        std::vector<size_t> top(n * k);
+
+        const weight* scores = output.memory_start();
+
+        const size_t chunks = std::min(n, dbn_traits<this_type>::is_serial() ? size_t(1) : size_t(etl::threads));
+
+        dll::maybe_parallel_foreach_n(pool, 0, chunks, [&](size_t c) {
+            for (size_t i = (c * n) / chunks; i < ((c + 1) * n) / chunks; ++i) {
+                topk_row(scores + i * width, width, k, top.data() + i * k);
+            }
+        });
+
+        return top;
+    }
+
     /*!
      * \brief Create a trainer for custom training of the network
      * \return The trainer for this network
@@ -1348,6 +2523,49 @@ public:
         return trainer;
     }
 
+    /*!
+     * \brief Returns the online trainer used by partial_fit, created on the
+     * first call, for instance to set the cadence of its snapshot
+     */
+    dll::online_trainer<this_type>& get_online_trainer() {
+        if (!online) {
+            online = std::make_unique<dll::online_trainer<this_type>>(*this);
+        }
+
+        return *online;
+    }
+
+    /*!
+     * \brief Train the network on one more batch, from a stream of samples.
+     *
+     * The trainer and its state are kept between the calls. The labels are
+     * in the format of the training generators (one-hot for
+     * classification).
+     *
+     * \param inputs The batch of inputs
+     * \param labels The batch of labels
+     *
+     * \return the (error, loss) of the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> partial_fit(const Inputs& inputs, const Labels& labels) {
+        // The layers may use the thread pool of the network
+        thread_pool_scope pool_scope(pool);
+
+        return get_online_trainer().partial_fit(inputs, labels);
+    }
+
+    /*!
+     * \brief Returns the last snapshot of the network published by the
+     * online trainer, for concurrent inference with its own contexts, or
+     * nullptr if none was published yet.
+     *
+     * This can be called from any thread once the online trainer exists.
+     */
+    std::shared_ptr<const this_type> inference_snapshot() const {
+        return online ? online->snapshot() : nullptr;
+    }
+
     // Fine-tune for classification
 
     /*!
@@ -1362,7 +2580,11 @@ public:
     weight fine_tune(Generator& generator, size_t max_epochs) {
         dll::auto_timer timer("net:train:ft");
 
+        // The layers may use the thread pool of the network
+        thread_pool_scope pool_scope(pool);
+
         validate_generator(generator);
+        place_producers(generator);
 
         dll::dbn_trainer<this_type> trainer;
         return trainer.train(*this, generator, max_epochs);
@@ -1381,8 +2603,13 @@ public:
     weight fine_tune_val(Generator& train_generator, ValGenerator& val_generator, size_t max_epochs) {
         dll::auto_timer timer("net:train:ft");
 
+        // The layers may use the thread pool of the network
+        thread_pool_scope pool_scope(pool);
+
         validate_generator(train_generator);
         validate_generator(val_generator);
+        place_producers(train_generator);
+        place_producers(val_generator);
 
         dll::dbn_trainer<this_type> trainer;
         return trainer.train(*this, train_generator, val_generator, max_epochs);
@@ -1441,7 +2668,11 @@ public:
     weight fine_tune_ae(Generator& generator, size_t max_epochs) {
         dll::auto_timer timer("net:train:ft:ae");
 
+        // The layers may use the thread pool of the network
+        thread_pool_scope pool_scope(pool);
+
         validate_generator(generator);
+        place_producers(generator);
 
         cpp_assert(dll::input_size(layer_get<0>()) == dll::output_size(layer_get<layers - 1>()), "The network is not build as an autoencoder");
 
@@ -1499,7 +2730,11 @@ public:
     weight fine_tune_reg(Generator& generator, size_t max_epochs) {
         dll::auto_timer timer("net:train:ft:reg");
 
+        // The layers may use the thread pool of the network
+        thread_pool_scope pool_scope(pool);
+
         validate_generator(generator);
+        place_producers(generator);
 
         dll::dbn_trainer<this_type> trainer;
         return trainer.train(*this, generator, max_epochs);
@@ -1897,6 +3132,23 @@ public:
 
     using metrics_t = std::tuple<double, double>; ///< The metrics returned by evaluate_metrics
 
+    /*!
+     * \brief Compute the sums of the absolute errors and of the losses of
+     * the first n outputs of the batch with the fused reconstruction kernel,
+     * directly on the memory of the outputs and of the labels.
+     */
+    template <typename Output, typename Labels>
+    static std::pair<double, double> fused_reconstruction_metrics(size_t n, const Output& output, const Labels& labels) {
+        output.ensure_cpu_up_to_date();
+        labels.ensure_cpu_up_to_date();
+
+        const size_t width = etl::size(output) / etl::dim<0>(output);
+
+        cpp_assert(etl::size(labels) >= n * width, "Invalid sizes");
+
+        return reconstruction_metrics<loss>(output.memory_start(), labels.memory_start(), n * width);
+    }
+
     template <typename Output, typename Labels>
     std::tuple<double, double> compute_loss(size_t n, bool full_batch, double s, Output&& output, Labels&& labels) {
         double batch_loss;
@@ -1905,7 +3157,21 @@ public:
         if constexpr (loss == loss_function::CATEGORICAL_CROSS_ENTROPY) {
             dll::auto_timer timer("net:compute_loss:CCE");
 
-            if (cpp_unlikely(!full_batch)) {
+            if constexpr (is_index_labels<Labels>) {
+                // Only the column of the expected class is needed
+                batch_loss  = 0.0;
+                batch_error = 0.0;
+
+                for (size_t i = 0; i < n; ++i) {
+                    const size_t l = labels(i);
+
+                    batch_loss += std::log(output(i, l));
+                    batch_error += etl::max_index(output(i)) != l ? 1.0 : 0.0;
+                }
+
+                batch_loss *= -1.0 / s;
+                batch_error *= 1.0 / s;
+            } else if (cpp_unlikely(!full_batch)) {
                 auto soutput = slice(output, 0, n);
 
                 batch_loss  = etl::ml::cce_loss(soutput, labels, -1.0 / s);
@@ -1917,8 +3183,18 @@ public:
         } else if constexpr (loss == loss_function::BINARY_CROSS_ENTROPY) {
             dll::auto_timer timer("net:compute_loss:BCE");
 
+            static_assert(!is_index_labels<Labels>, "Index labels are only supported with the categorical cross entropy loss");
+
+            if constexpr (etl::is_dma<std::decay_t<Output>> && etl::is_dma<std::decay_t<Labels>>) {
+                // The outputs are clipped in the kernel, not in a copy
+                auto [error_sum, loss_sum] = fused_reconstruction_metrics(n, output, labels);
+
+                return std::make_tuple(error_sum / (s * output_size()), loss_sum / (s * output_size()));
+            }
+
             // Avoid Nan in log(out) or log(1-out)
-            auto out = etl::force_temporary(etl::clip(output, 0.001, 0.999));
+            auto clipped = dll::arena_temporary(etl::clip(output, 0.001, 0.999));
+            auto& out    = clipped.matrix;
 
             if (cpp_unlikely(!full_batch)) {
                 auto sout = slice(out, 0, n);
@@ -1932,6 +3208,14 @@ public:
         } else { // MEAN_SQUARED_ERROR
             dll::auto_timer timer("net:compute_loss:MSE");
 
+            static_assert(!is_index_labels<Labels>, "Index labels are only supported with the categorical cross entropy loss");
+
+            if constexpr (etl::is_dma<std::decay_t<Output>> && etl::is_dma<std::decay_t<Labels>>) {
+                auto [error_sum, loss_sum] = fused_reconstruction_metrics(n, output, labels);
+
+                return std::make_tuple(error_sum / s, loss_sum / (2.0 * s));
+            }
+
             if (cpp_unlikely(!full_batch)) {
                 auto soutput = slice(output, 0, n);
 
@@ -1969,40 +3253,208 @@ public:
         // TODO Detect if labels are categorical already or not
         // And change the way this is done
 
-        return compute_loss(n, full_batch, s, output, labels);
+        return compute_loss(n, full_batch, s, output, labels);
+    }
+
+    /*!
+     * \brief Evaluate the network on the given classification task
+     * and return the evaluation metrics.
+     *
+     * The batches are evaluated in parallel, on the thread pool of the
+     * network (see evaluate_metrics_batches).
+     *
+     * \param generator The data generator
+     *
+     * \return The evaluation metrics
+     */
+    template <typename Generator>
+    metrics_t evaluate_metrics(Generator& generator){
+        validate_generator(generator);
+
+        return parallel_evaluate_metrics(generator, nullptr);
+    }
+
+    /*!
+     * \brief Evaluate the network on the given batches of the generator
+     * and return the evaluation metrics.
+     *
+     * The generator is read on the calling thread, by waves of one batch
+     * per thread of the pool of the network, each batch being copied out of
+     * the generator. The batches of a wave are then forwarded, each with its
+     * own inference context, and their metrics computed in parallel. The
+     * metrics of the batches are summed in order, the result does not
+     * depend on the number of threads.
+     *
+     * \param generator The data generator
+     * \param batches The sorted indices of the batches to evaluate
+     *
+     * \return The evaluation metrics
+     */
+    template <typename Generator>
+    metrics_t evaluate_metrics_batches(Generator& generator, const std::vector<size_t>& batches){
+        validate_generator(generator);
+
+        return parallel_evaluate_metrics(generator, &batches);
+    }
+
+    /*!
+     * \brief Evaluate the network on the given classification task
+     * and return the evaluation metrics.
+     *
+     * \param generator The data generator
+     * \param helper The function to use to compute a batch of output
+     *
+     * \return The evaluation metrics
+     */
+    template <typename Generator, typename Helper>
+    metrics_t evaluate_metrics(Generator& generator, Helper&& helper){
+        validate_generator(generator);
+
+        // Starts a new
+        generator.reset();
+
+        // Set the generator in test mode
+        generator.set_test();
+
+        double error = 0.0;
+        double loss  = 0.0;
+
+        while(generator.has_next_batch()){
+            auto input_batch = generator.data_batch();
+            auto label_batch = generator.label_batch();
+
+            decltype(auto) output = helper(input_batch);
+
+            auto [batch_error, batch_loss] = evaluate_metrics_batch(output, label_batch, etl::dim<0>(input_batch), false);
+
+            error += batch_error;
+            loss += batch_loss;
+
+            generator.next_batch();
+        }
+
+        error /= generator.size();
+        loss /= generator.size();
+
+        return std::make_tuple(error, loss);
+    }
+
+    /*!
+     * \brief Evaluate the top-k error of the network on the given
+     * classification task, i.e. the ratio of samples whose label is not
+     * one of the k best outputs.
+     *
+     * The rank of the label is counted directly, the outputs are neither
+     * sorted nor selected.
+     *
+     * \param generator The data generator
+     * \param k The number of labels considered correct
+     *
+     * \return The top-k error
+     */
+    template <typename Generator>
+    double evaluate_topk_error(Generator& generator, size_t k) {
+        validate_generator(generator);
+
+        generator.reset();
+        generator.set_test();
+
+        size_t errors = 0;
+
+        while (generator.has_next_batch()) {
+            auto input_batch = generator.data_batch();
+            auto label_batch = generator.label_batch();
+
+            auto output = forward_batch(input_batch);
+
+            output.ensure_cpu_up_to_date();
+
+            const size_t n     = etl::dim<0>(input_batch);
+            const size_t width = etl::size(output) / etl::dim<0>(output);
+
+            for (size_t i = 0; i < n; ++i) {
+                size_t label;
+
+                if constexpr (is_index_labels<decltype(label_batch)>) {
+                    label = label_batch(i);
+                } else {
+                    label = etl::max_index(label_batch(i));
+                }
+
+                errors += topk_rank(output.memory_start() + i * width, width, label) >= k ? 1 : 0;
+            }
+
+            generator.next_batch();
+        }
+
+        return generator.size() ? double(errors) / generator.size() : 0.0;
     }
 
     /*!
-     * \brief Evaluate the network on the given classification task
+     * \brief Evaluate the network on the given batches of the generator
      * and return the evaluation metrics.
      *
      * \param generator The data generator
+     * \param helper The function to use to compute a batch of output
+     * \param batches The sorted indices of the batches to evaluate
      *
      * \return The evaluation metrics
      */
-    template <typename Generator>
-    metrics_t evaluate_metrics(Generator& generator){
+    template <typename Generator, typename Helper>
+    metrics_t evaluate_metrics(Generator& generator, Helper&& helper, const std::vector<size_t>& batches){
         validate_generator(generator);
 
-        auto forward_helper = [this](auto&& input_batch){
-            return this->forward_batch(input_batch);
-        };
+        // Starts a new
+        generator.reset();
+
+        // Set the generator in test mode
+        generator.set_test();
+
+        double error = 0.0;
+        double loss  = 0.0;
+
+        size_t samples = 0;
 
-        return evaluate_metrics(generator, forward_helper);
+        auto next = batches.begin();
+
+        while(generator.has_next_batch() && next != batches.end()){
+            if (generator.current_batch() == *next) {
+                auto input_batch = generator.data_batch();
+                auto label_batch = generator.label_batch();
+
+                decltype(auto) output = helper(input_batch);
+
+                auto [batch_error, batch_loss] = evaluate_metrics_batch(output, label_batch, etl::dim<0>(input_batch), false);
+
+                error += batch_error;
+                loss += batch_loss;
+
+                samples += etl::dim<0>(input_batch);
+
+                ++next;
+            }
+
+            generator.next_batch();
+        }
+
+        if (samples) {
+            error /= samples;
+            loss /= samples;
+        }
+
+        return std::make_tuple(error, loss);
     }
 
+private:
     /*!
-     * \brief Evaluate the network on the given classification task
-     * and return the evaluation metrics.
-     *
-     * \param generator The data generator
-     * \param helper The function to use to compute a batch of output
-     *
-     * \return The evaluation metrics
+     * \brief Evaluate the network on the given batches of the generator
+     * (all of them without batches), in parallel, and return the
+     * evaluation metrics.
      */
-    template <typename Generator, typename Helper>
-    metrics_t evaluate_metrics(Generator& generator, Helper&& helper){
-        validate_generator(generator);
+    template <typename Generator>
+    metrics_t parallel_evaluate_metrics(Generator& generator, const std::vector<size_t>* batches){
+        using input_t = std::decay_t<decltype(etl::force_temporary(generator.data_batch()))>;
+        using label_t = std::decay_t<decltype(etl::force_temporary(generator.label_batch()))>;
 
         // Starts a new
         generator.reset();
@@ -2010,25 +3462,65 @@ public:
         // Set the generator in test mode
         generator.set_test();
 
+        const size_t chunks = std::max(size_t(1), std::min(generator.batches(), dbn_traits<this_type>::is_serial() ? size_t(1) : size_t(etl::threads)));
+
+        std::vector<input_t> inputs(chunks);
+        std::vector<label_t> labels(chunks);
+        std::vector<metrics_t> metrics(chunks);
+        std::vector<std::unique_ptr<inference_context>> contexts(chunks);
+
         double error = 0.0;
         double loss  = 0.0;
 
-        while(generator.has_next_batch()){
-            auto input_batch = generator.data_batch();
-            auto label_batch = generator.label_batch();
+        size_t samples = 0;
 
-            decltype(auto) output = helper(input_batch);
+        auto next = batches ? batches->begin() : std::vector<size_t>::const_iterator();
 
-            auto [batch_error, batch_loss] = evaluate_metrics_batch(output, label_batch, etl::dim<0>(input_batch), false);
+        auto more = [&]() {
+            return generator.has_next_batch() && (!batches || next != batches->end());
+        };
 
-            error += batch_error;
-            loss += batch_loss;
+        while (more()) {
+            size_t k = 0;
 
-            generator.next_batch();
+            // The batches of the generator are only valid until the next one
+            while (k < chunks && more()) {
+                if (!batches || generator.current_batch() == *next) {
+                    copy_batch(inputs[k], generator.data_batch());
+                    copy_batch(labels[k], generator.label_batch());
+
+                    ++k;
+
+                    if (batches) {
+                        ++next;
+                    }
+                }
+
+                generator.next_batch();
+            }
+
+            dll::maybe_parallel_foreach_n(pool, 0, k, [&](size_t c) {
+                if (!contexts[c]) {
+                    contexts[c] = std::make_unique<inference_context>(arena.size());
+                }
+
+                decltype(auto) output = forward_batch(*contexts[c], inputs[c]);
+
+                metrics[c] = evaluate_metrics_batch(output, labels[c], etl::dim<0>(inputs[c]), false);
+            });
+
+            for (size_t c = 0; c < k; ++c) {
+                error += std::get<0>(metrics[c]);
+                loss += std::get<1>(metrics[c]);
+
+                samples += etl::dim<0>(inputs[c]);
+            }
         }
 
-        error /= generator.size();
-        loss /= generator.size();
+        if (samples) {
+            error /= samples;
+            loss /= samples;
+        }
 
         return std::make_tuple(error, loss);
     }
@@ -2197,8 +3689,8 @@ public:
             return false;
         }
 
-        //Perform a grid-search
-        svm::rbf_grid_search(problem, parameters, n_fold, g);
+        //Perform a grid-search, the points of the grid on the thread pool
+        svm_parallel_grid_search(problem, parameters, n_fold, g, pool);
 
         return true;
     }
@@ -2220,8 +3712,8 @@ public:
             return false;
         }
 
-        //Perform a grid-search
-        svm::rbf_grid_search(problem, parameters, n_fold, g);
+        //Perform a grid-search, the points of the grid on the thread pool
+        svm_parallel_grid_search(problem, parameters, n_fold, g, pool);
 
         return true;
     }
@@ -2235,6 +3727,18 @@ public:
 #endif //DLL_SVM_SUPPORT
 
 private:
+    /*!
+     * \brief Load the weights of the given layer from its block of the
+     * given mapping
+     */
+    template <typename Layer>
+    static void load_mapped_layer(Layer& layer, const mapped_weights& weights, size_t i) {
+        mapped_block_buffer buffer(weights.block(i), weights.block_size(i));
+        std::istream is(&buffer);
+
+        layer.load(is);
+    }
+
     //By default all layer are trained
     template <size_t I, typename Enable = void>
     struct train_next : std::true_type {};
@@ -2294,6 +3798,164 @@ private:
         pretrain_layer<I + 2>(*next_generator, watcher, max_epochs);
     }
 
+    /*!
+     * \brief Compute the key of the input of the pretraining, for the
+     * pretraining cache
+     */
+    template <typename Generator>
+    static uint64_t pretrain_input_key(Generator& generator) {
+        uint64_t key = layer_cache_seed;
+
+        generator.reset();
+        generator.set_test();
+
+        while (generator.has_next_batch()) {
+            auto batch = generator.data_batch();
+
+            for (size_t i = 0; i < etl::size(batch); ++i) {
+                const float value = batch[i];
+                key = layer_cache_hash(key, &value, sizeof(value));
+            }
+
+            generator.next_batch();
+        }
+
+        const uint64_t n = generator.size();
+        return layer_cache_hash(key, &n, sizeof(n));
+    }
+
+    /*!
+     * \brief Compute the key of the output of the given layer, from the key of
+     * its input and its weights
+     */
+    template <typename Layer>
+    static uint64_t pretrain_output_key(uint64_t key, const Layer& layer) {
+        if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            std::ostringstream os;
+            layer.store(os);
+
+            const std::string weights = os.str();
+            key = layer_cache_hash(key, weights.data(), weights.size());
+        }
+
+        const uint64_t storage = sizeof(typename desc::pretrain_cache_t);
+        return layer_cache_hash(key, &storage, sizeof(storage));
+    }
+
+    /*!
+     * \brief Compute the outputs of the layer I into its cache file, unless
+     * the file already holds them, and pretrain the next layer from it
+     */
+    template <size_t I, typename Generator>
+    void cached_layer_pretrain(Generator& generator, watcher_t& watcher, size_t max_epochs) {
+        using storage_t = typename desc::pretrain_cache_t;
+
+        decltype(auto) layer = layer_get<I>();
+
+        // Reset correctly the generator
+        generator.reset();
+        generator.set_test();
+
+        // Need one output in order to know the shape of the outputs
+        auto one = prepare_one_ready_output(layer, generator.data_batch()(0));
+
+        using one_t       = std::decay_t<decltype(one)>;
+        using generator_t = layer_cache_generator<
+            etl::value_t<one_t>, storage_t, etl::decay_traits<one_t>::dimensions(),
+            rbm_cache_generator_inner_t<layer_type<rbm_layer_n>::batch_size>>;
+
+        const std::string path = pretrain_prefix + "." + std::to_string(I + 1) + ".dat";
+        const uint64_t key     = pretrain_output_key(pretrain_key, layer);
+
+        auto next_generator = std::make_unique<generator_t>(path);
+
+        if (next_generator->matches(key, generator.size())) {
+            out << "DBN: Reuse the cached outputs of layer " << I << " (" << path << ")" << std::endl;
+        } else {
+            // The file must not be mapped while it is replaced
+            next_generator.reset();
+
+            layer_cache_writer<storage_t> writer(path, key, generator.size(), one);
+
+            // Compute the input of the next layer
+            // using batch activation
+
+            while (generator.has_next_batch()) {
+                writer.write(layer.train_forward_batch(generator.data_batch()));
+
+                generator.next_batch();
+            }
+
+            writer.finish();
+
+            next_generator = std::make_unique<generator_t>(path);
+
+            if (!next_generator->matches(key, generator.size())) {
+                std::cerr << "ERROR: Impossible to cache the outputs of layer " << I << " in " << path << std::endl;
+                return;
+            }
+        }
+
+        next_generator->set_safe();
+
+        // Release the memory if possible
+        generator.clear();
+
+        pretrain_key = key;
+
+        //Pass the output to the next layer
+        this->template pretrain_layer<I + 1>(*next_generator, watcher, max_epochs);
+    }
+
+    /*!
+     * \brief Pretrain the next layer while the outputs of the layer I are
+     * computed by a background producer, batch by batch.
+     *
+     * The first epoch of the next layer only waits for the batches it
+     * consumes. The producer computes in serial, to not compete with the
+     * training for the thread pools.
+     */
+    template <size_t I, typename Generator>
+    void pipelined_layer_pretrain(Generator& generator, watcher_t& watcher, size_t max_epochs) {
+        decltype(auto) layer = layer_get<I>();
+
+        // Reset correctly the generator
+        generator.reset();
+        generator.set_test();
+
+        // Need one output in order to create the generator
+        auto one = prepare_one_ready_output(layer, generator.data_batch()(0));
+
+        // Prepare a generator to hold the data
+        auto inner_generator = prepare_generator(
+            one, one,
+            generator.size(), output_size(),
+            get_rbm_ingenerator_inner_desc());
+
+        inner_generator->set_safe();
+
+        using next_generator_t = pipelined_generator<typename decltype(inner_generator)::element_type>;
+
+        // Compute the input of the next layer in the background
+        // using batch activation
+
+        next_generator_t next_generator(std::move(inner_generator), [&generator, &layer](next_generator_t& next) {
+            SERIAL_SECTION {
+                while (generator.has_next_batch()) {
+                    next.push(layer.train_forward_batch(generator.data_batch()));
+
+                    generator.next_batch();
+                }
+            }
+
+            // Release the memory if possible
+            generator.clear();
+        });
+
+        //Pass the output to the next layer
+        this->template pretrain_layer<I + 1>(next_generator, watcher, max_epochs);
+    }
+
     template <size_t I, typename Generator>
     void pretrain_layer(Generator& generator, watcher_t& watcher, size_t max_epochs) {
         if constexpr (I < layers) {
@@ -2304,10 +3966,12 @@ private:
             watcher.pretrain_layer(*this, I, layer, generator.size());
 
             if constexpr (layer_traits<layer_t>::is_pretrained()) {
-                // Train the RBM
-                layer.template train<!watcher_t::ignore_sub,               //Enable the RBM Watcher or not
-                                     dbn_detail::rbm_watcher_t<watcher_t>> //Replace the RBM watcher if not void
-                    (generator, max_epochs);
+                // Train the RBM (the first layers may already be trained)
+                if (I >= pretrain_start) {
+                    layer.template train<!watcher_t::ignore_sub,               //Enable the RBM Watcher or not
+                                         dbn_detail::rbm_watcher_t<watcher_t>> //Replace the RBM watcher if not void
+                        (generator, max_epochs);
+                }
             }
 
             //When the next layer is a pooling layer, a lot of memory can be saved by directly computing
@@ -2316,7 +3980,17 @@ private:
                 this->template inline_layer_pretrain<I>(generator, watcher, max_epochs);
             }
 
-            if constexpr (train_next<I + 1>::value && !inline_next<I + 1>::value) {
+            //The outputs can be streamed to a file instead of memory
+            if constexpr (train_next<I + 1>::value && !inline_next<I + 1>::value && dbn_traits<this_type>::pretrain_cache()) {
+                this->template cached_layer_pretrain<I>(generator, watcher, max_epochs);
+            }
+
+            //The outputs can be computed in the background, while the next layer is trained
+            if constexpr (train_next<I + 1>::value && !inline_next<I + 1>::value && !dbn_traits<this_type>::pretrain_cache() && dbn_traits<this_type>::pretrain_pipeline()) {
+                this->template pipelined_layer_pretrain<I>(generator, watcher, max_epochs);
+            }
+
+            if constexpr (train_next<I + 1>::value && !inline_next<I + 1>::value && !dbn_traits<this_type>::pretrain_cache() && !dbn_traits<this_type>::pretrain_pipeline()) {
                 // Reset correctly the generator
                 generator.reset();
                 generator.set_test();
@@ -2489,16 +4163,26 @@ private:
             generator.reset();
             generator.set_train();
 
-            while (generator.has_next_batch()) {
-                auto next_batch = forward_batch<I - 1>(generator.data_batch());
+            if constexpr (dbn_traits<this_type>::pretrain_pipeline()) {
+                pipelined_batch_epoch<I>(generator, [&](auto& next_batch) {
+                    r_trainer.train_batch(next_batch, next_batch, trainer, context, rbm);
 
-                r_trainer.train_batch(next_batch, next_batch, trainer, context, rbm);
+                    if (dbn_traits<this_type>::is_verbose()) {
+                        watcher.pretraining_batch(*this, big_batch);
+                    }
+                });
+            } else {
+                while (generator.has_next_batch()) {
+                    auto next_batch = forward_batch<I - 1>(generator.data_batch());
 
-                if (dbn_traits<this_type>::is_verbose()) {
-                    watcher.pretraining_batch(*this, big_batch);
-                }
+                    r_trainer.train_batch(next_batch, next_batch, trainer, context, rbm);
 
-                generator.next_batch();
+                    if (dbn_traits<this_type>::is_verbose()) {
+                        watcher.pretraining_batch(*this, big_batch);
+                    }
+
+                    generator.next_batch();
+                }
             }
 
             r_trainer.finalize_epoch(epoch, context, rbm);
@@ -2514,6 +4198,117 @@ private:
     template <size_t I, typename Generator, cpp_enable_iff(I == layers)>
     void pretrain_layer_batch(Generator&, watcher_t&, size_t) {}
 
+    /*!
+     * \brief Resize the given batch to the given dimensions, if necessary
+     */
+    template <typename Batch, size_t... Is>
+    static void resize_batch(Batch& batch, const std::array<size_t, sizeof...(Is)>& dims, std::index_sequence<Is...>) {
+        if (((etl::dim(batch, Is) != dims[Is]) || ...)) {
+            batch = Batch(dims[Is]...);
+        }
+    }
+
+    /*!
+     * \brief Train the layer I for one epoch of the batch mode pretraining,
+     * while the outputs of the previous layers for the next batches are
+     * computed in the background.
+     *
+     * The batches of the generator are copied, by the thread of the source
+     * of a staged pipeline, into a fixed set of slots. The outputs of layer
+     * I - 1 are computed by the thread of the "forward" stage, in serial to
+     * not compete with the training for the thread pools, with the
+     * inference context of the slot. The outputs are kept in the storage
+     * type of the pretraining cache (dll::pretrain_cache<T>, the weight
+     * type without one) and converted back by the consumer, this thread,
+     * which trains the layer I on the slots, in order.
+     *
+     * \param generator The generator, only used by the source during the epoch
+     * \param train Functor called as train(batch) on the outputs of each batch
+     */
+    template <size_t I, typename Generator, typename Train>
+    void pipelined_batch_epoch(Generator& generator, Train&& train) {
+        using input_t   = std::decay_t<decltype(etl::force_temporary(generator.data_batch()))>;
+        using output_t  = std::decay_t<decltype(this->template forward_batch<I - 1>(std::declval<inference_context&>(), std::declval<input_t&>()))>;
+        using storage_t = std::conditional_t<dbn_traits<this_type>::pretrain_cache(), typename desc::pretrain_cache_t, weight>;
+
+        static constexpr size_t D = etl::decay_traits<output_t>::dimensions();
+
+        using batch_t = etl::dyn_matrix<weight, D>;
+
+        constexpr bool compact = !std::is_same_v<storage_t, weight>;
+
+        struct pretrain_slot {
+            input_t input;                              ///< The input batch
+            batch_t output;                             ///< The outputs of the layer I - 1, without compact storage
+            std::vector<storage_t> values;              ///< The outputs of the layer I - 1, in compact storage
+            std::array<size_t, D> dims;                 ///< The dimensions of the outputs
+            std::unique_ptr<inference_context> context; ///< The inference context of the slot
+        };
+
+        // One slot is trained, one is ready and one is forwarded
+        staged_pipeline<pretrain_slot> pipeline(3, "pretrain");
+
+        pipeline.add_stage("forward", 1, [this](pretrain_slot& slot) {
+            if (!slot.context) {
+                slot.context = std::make_unique<inference_context>(arena.size());
+            }
+
+            SERIAL_SECTION {
+                decltype(auto) output = this->template forward_batch<I - 1>(*slot.context, slot.input);
+
+                for (size_t d = 0; d < D; ++d) {
+                    slot.dims[d] = etl::dim(output, d);
+                }
+
+                if constexpr (compact) {
+                    output.ensure_cpu_up_to_date();
+
+                    slot.values.resize(etl::size(output));
+
+                    for (size_t i = 0; i < etl::size(output); ++i) {
+                        slot.values[i] = storage_t(output[i]);
+                    }
+                } else {
+                    copy_batch(slot.output, output);
+                }
+            }
+        });
+
+        pipeline.start("load", [&generator](pretrain_slot& slot) {
+            if (!generator.has_next_batch()) {
+                return false;
+            }
+
+            copy_batch(slot.input, generator.data_batch());
+
+            generator.next_batch();
+
+            return true;
+        });
+
+        batch_t batch;
+
+        while (auto* slot = pipeline.next()) {
+            if constexpr (compact) {
+                resize_batch(batch, slot->dims, std::make_index_sequence<D>());
+
+                for (size_t i = 0; i < slot->values.size(); ++i) {
+                    batch[i] = weight(slot->values[i]);
+                }
+
+                batch.invalidate_gpu();
+
+                train(batch);
+            } else {
+                train(slot->output);
+            }
+
+            pipeline.release(slot);
+        }
+
+        pipeline.stop();
+    }
+
     /* Pretrain layer denoising batch  */
 
     //Special handling for the layer 0
@@ -2704,16 +4499,6 @@ private:
 
 #ifdef DLL_SVM_SUPPORT
 
-    template <typename Samples, typename Input>
-    void add_activation_probabilities(Samples& result, const Input& sample) {
-        if constexpr (dbn_traits<this_type>::concatenate()) {
-            result.emplace_back(full_output_size());
-            full_activation_probabilities(sample, result.back());
-        } else {
-            result.push_back(forward_one(sample));
-        }
-    }
-
     template <typename Input>
     using svm_sample_t = std::conditional_t<
         dbn_traits<this_type>::concatenate(),
@@ -2723,15 +4508,47 @@ private:
     template <typename Input>
     using svm_samples_t = std::vector<svm_sample_t<Input>>;
 
-    template <typename Samples, typename Labels>
-    void make_problem(const Samples& training_data, const Labels& labels, bool scale = false) {
-        svm_samples_t<safe_value_t<Samples>> svm_samples;
+    /*!
+     * \brief Compute the features of the given samples for the SVM, on the
+     * thread pool of the network.
+     *
+     * In normal mode, the features are computed in batches. In full mode,
+     * the samples are forwarded concurrently.
+     */
+    template <typename Input, typename Iterator>
+    svm_samples_t<Input> svm_features(const Iterator& first, const Iterator& last) const {
+        const size_t n = std::distance(first, last);
 
-        //Get all the activation probabilities
-        for (auto& sample : training_data) {
-            add_activation_probabilities(svm_samples, sample);
+        svm_samples_t<Input> svm_samples;
+        svm_samples.reserve(n);
+
+        if (!n) {
+            return svm_samples;
+        }
+
+        if constexpr (dbn_traits<this_type>::concatenate()) {
+            for (size_t i = 0; i < n; ++i) {
+                svm_samples.emplace_back(full_output_size());
+            }
+
+            dll::maybe_parallel_foreach_n(pool, 0, n, [&](size_t i) {
+                full_activation_probabilities(*std::next(first, i), svm_samples[i]);
+            });
+        } else {
+            auto features = test_forward_many_impl<layers - 1, 0>(first, last);
+
+            for (auto& feature : features) {
+                svm_samples.emplace_back(feature);
+            }
         }
 
+        return svm_samples;
+    }
+
+    template <typename Samples, typename Labels>
+    void make_problem(const Samples& training_data, const Labels& labels, bool scale = false) {
+        auto svm_samples = svm_features<safe_value_t<Samples>>(training_data.begin(), training_data.end());
+
         //static_cast ensure using the correct overload
         problem = svm::make_problem(labels, static_cast<const svm_samples_t<safe_value_t<Samples>>&>(svm_samples), scale);
     }
@@ -2741,12 +4558,7 @@ private:
      */
     template <typename Iterator, typename LIterator>
     void make_problem(Iterator first, Iterator last, LIterator&& lfirst, LIterator&& llast, bool scale = false) {
-        svm_samples_t<safe_value_t<Iterator>> svm_samples;
-
-        //Get all the activation probabilities
-        std::for_each(first, last, [this, &svm_samples](auto& sample) {
-            this->add_activation_probabilities(svm_samples, sample);
-        });
+        auto svm_samples = svm_features<safe_value_t<Iterator>>(first, last);
 
         //static_cast ensure using the correct overload
         problem = svm::make_problem(
@@ -8,6 +8,8 @@
 #pragma once
 
 #include "util/tmp.hpp"
+#include "util/placement.hpp"
+#include "util/gpu_resident.hpp"
 #include "decay_type.hpp"
 
 namespace dll {
@@ -63,6 +65,114 @@ struct dbn_traits {
         return desc::parameters::template contains<dll::early_training>();
     }
 
+    /*!
+     * \brief Indicates if the validation statistics are computed
+     * asynchronously, while the next epoch is trained.
+     */
+    static constexpr bool async_validation() noexcept {
+        return desc::parameters::template contains<dll::async_validation>();
+    }
+
+    /*!
+     * \brief Get the number of shards of each batch for data-parallel
+     * training (1 when disabled).
+     */
+    static constexpr size_t data_parallel() noexcept {
+        return desc::DataParallel;
+    }
+
+    /*!
+     * \brief Get the maximum number of batches in flight for asynchronous
+     * SGD (0 when not bounded explicitly).
+     */
+    static constexpr size_t staleness() noexcept {
+        return desc::Staleness;
+    }
+
+    /*!
+     * \brief Indicates if the weight updates are overlapped with the
+     * backward pass.
+     */
+    static constexpr bool pipelined_updates() noexcept {
+        return desc::parameters::template contains<dll::pipelined_updates>();
+    }
+
+    /*!
+     * \brief Indicates if the embeddings are updated lazily, only on the
+     * rows referenced by the batch.
+     */
+    static constexpr bool lazy_updates() noexcept {
+        return desc::parameters::template contains<dll::lazy_updates>();
+    }
+
+    /*!
+     * \brief Indicates if the outputs of the layers are cached on disk
+     * during pretraining.
+     */
+    static constexpr bool pretrain_cache() noexcept {
+        return !std::is_void<typename desc::pretrain_cache_t>::value;
+    }
+
+    /*!
+     * \brief Indicates if the pretraining of the layers is pipelined.
+     */
+    static constexpr bool pretrain_pipeline() noexcept {
+        return desc::parameters::template contains<dll::pretrain_pipeline>();
+    }
+
+    /*!
+     * \brief Indicates if the weights and the training contexts are backed
+     * by huge pages.
+     */
+    static constexpr bool huge_pages() noexcept {
+        return desc::parameters::template contains<dll::huge_pages>();
+    }
+
+    /*!
+     * \brief Indicates if the training is kept resident on the GPU, only
+     * with GPU support in ETL.
+     */
+    static constexpr bool gpu_resident() noexcept {
+        return gpu_enabled && desc::parameters::template contains<dll::gpu_resident>();
+    }
+
+    /*!
+     * \brief Indicates if the batch normalization is synchronized over the
+     * ranks of the distributed training.
+     */
+    static constexpr bool sync_batch_norm() noexcept {
+        return desc::parameters::template contains<dll::sync_batch_norm>();
+    }
+
+    /*!
+     * \brief Returns the default placement policy of the threads of the
+     * network.
+     */
+    static constexpr placement_policy placement() noexcept {
+        return {desc::parameters::template contains<dll::pin_threads>(), desc::ProducerCores, desc::parameters::template contains<dll::no_smt>()};
+    }
+
+    /*!
+     * \brief Returns the number of batches in flight in the staged
+     * training of the network, 0 if it is not staged.
+     */
+    static constexpr size_t staged_training() noexcept {
+        // The GPU-resident training always stages the next batches
+        if constexpr (gpu_resident()) {
+            return desc::StagedTraining > 2 ? desc::StagedTraining : 2;
+        } else {
+            return desc::StagedTraining;
+        }
+    }
+
+    /*!
+     * \brief Returns the number of layers frozen during the fine-tuning of
+     * the network
+     */
+    static constexpr size_t frozen_layers() noexcept {
+        return desc::FrozenLayers;
+    }
+
     /*!
      * \brief Indicates if the DBN shuffles the inputs before each
      * fine-tuning epoch.
@@ -0,0 +1,191 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Inference of an ensemble of networks on the same input
+ */
+
+#pragma once
+
+#include <optional>
+#include <tuple>
+#include <utility>
+
+#include "cpp_utils/assert.hpp"
+#include "cpp_utils/maybe_parallel.hpp"
+
+#include "etl/etl.hpp"
+
+#include "layer_traits.hpp"
+#include "util/batch_reshape.hpp"
+#include "util/pool_stats.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The reduction of the outputs of the members of an ensemble
+ */
+enum class ensemble_reduction {
+    AVERAGE, ///< The outputs are averaged
+    VOTE     ///< Each member votes for its best output, the output is the ratio of the votes
+};
+
+namespace detail {
+
+/*!
+ * \brief Indicates if the layer L is the same, and without any state, in
+ * all the given networks
+ */
+template <size_t L, typename First, typename... DBN>
+constexpr bool ensemble_shared_layer() {
+    if constexpr (((L + 1 < First::layers) && ... && (L + 1 < DBN::layers))) {
+        using layer_t = typename First::template layer_type<L>;
+
+        constexpr bool same      = (std::is_same<layer_t, typename DBN::template layer_type<L>>::value && ...);
+        constexpr bool stateless = layer_traits<layer_t>::is_transform_layer() || layer_traits<layer_t>::is_pooling_layer();
+
+        return same && stateless && !layer_traits<layer_t>::is_dynamic();
+    } else {
+        return false;
+    }
+}
+
+/*!
+ * \brief Returns the number of first layers shared by all the networks
+ */
+template <size_t L, typename... DBN>
+constexpr size_t ensemble_prefix() {
+    if constexpr (ensemble_shared_layer<L, DBN...>()) {
+        return ensemble_prefix<L + 1, DBN...>();
+    } else {
+        return L;
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief An ensemble of networks computed on the same input batch.
+ *
+ * The first layers that are identical and without state in all the
+ * members (transform and pooling layers) are computed only once, the
+ * remaining layers of the members are computed concurrently on the
+ * thread pool of the ensemble and their outputs are reduced in a single
+ * pass. The members must be distinct networks and must outlive the
+ * ensemble.
+ */
+template <typename... DBN>
+struct ensemble {
+    static_assert(sizeof...(DBN) > 0, "An ensemble needs at least one network");
+
+    using first_t = std::tuple_element_t<0, std::tuple<DBN...>>; ///< The type of the first network
+    using weight  = typename first_t::weight;                    ///< The floating point type
+
+    static constexpr size_t members = sizeof...(DBN);                      ///< The number of networks
+    static constexpr size_t prefix  = detail::ensemble_prefix<0, DBN...>(); ///< The number of shared first layers
+
+    /*!
+     * \brief Create an ensemble of the given networks
+     */
+    explicit ensemble(const DBN&... dbns) : dbns(dbns...) {}
+
+    /*!
+     * \brief Compute the output of the ensemble for the given batch
+     * \param input The batch of input
+     * \param reduction The reduction of the outputs of the members
+     * \return The reduced output, one row per sample
+     */
+    template <typename Input>
+    etl::dyn_matrix<weight, 2> forward_batch(const Input& input, ensemble_reduction reduction = ensemble_reduction::AVERAGE) {
+        if constexpr (prefix > 0) {
+            auto shared = std::get<0>(dbns).template test_forward_batch<prefix - 1>(input);
+            return forward_members(shared, reduction, std::make_index_sequence<members>());
+        } else {
+            return forward_members(input, reduction, std::make_index_sequence<members>());
+        }
+    }
+
+    /*!
+     * \brief Compute the output of the ensemble for the given sample
+     * \param sample The input sample
+     * \param reduction The reduction of the outputs of the members
+     * \return The reduced output
+     */
+    template <typename Input>
+    etl::dyn_vector<weight> forward_one(const Input& sample, ensemble_reduction reduction = ensemble_reduction::AVERAGE) {
+        auto output = forward_batch(batch_reshape(sample), reduction);
+        return etl::dyn_vector<weight>(output(0));
+    }
+
+private:
+    template <size_t I, typename Input>
+    using member_output_t = std::decay_t<decltype(std::declval<const std::tuple_element_t<I, std::tuple<DBN...>>&>()
+                                                      .template forward_batch<std::tuple_element_t<I, std::tuple<DBN...>>::layers - 1, prefix>(std::declval<const Input&>()))>;
+
+    /*!
+     * \brief Compute the members concurrently and reduce their outputs
+     */
+    template <typename Input, size_t... I>
+    etl::dyn_matrix<weight, 2> forward_members(const Input& input, ensemble_reduction reduction, std::index_sequence<I...>) {
+        std::tuple<std::optional<member_output_t<I, Input>>...> outputs;
+
+        dll::maybe_parallel_foreach_n(pool, 0, members, [&](size_t m) {
+            ((m == I ? (void)std::get<I>(outputs).emplace(forward_member<I>(input)) : (void)0), ...);
+        });
+
+        const size_t B = etl::dim<0>(input);
+        const size_t K = etl::size(*std::get<0>(outputs)) / B;
+
+        cpp_assert(((etl::size(*std::get<I>(outputs)) == B * K) && ...), "The members of an ensemble must have the same output size");
+
+        etl::dyn_matrix<weight, 2> result(B, K);
+
+        if (reduction == ensemble_reduction::AVERAGE) {
+            // A single expression, evaluated in one pass
+            result = (etl::reshape(*std::get<I>(outputs), B, K) + ...) * weight(1.0 / members);
+        } else {
+            result = weight(0);
+
+            (vote(result, etl::reshape(*std::get<I>(outputs), B, K)), ...);
+        }
+
+        return result;
+    }
+
+    /*!
+     * \brief Compute the layers of the member I after the shared prefix
+     */
+    template <size_t I, typename Input>
+    auto forward_member(const Input& input) const {
+        using member_t = std::tuple_element_t<I, std::tuple<DBN...>>;
+        return member_output_t<I, Input>(std::get<I>(dbns).template forward_batch<member_t::layers - 1, prefix>(input));
+    }
+
+    /*!
+     * \brief Add the vote of a member to the result
+     */
+    template <typename Output>
+    static void vote(etl::dyn_matrix<weight, 2>& result, const Output& output) {
+        for (size_t i = 0; i < etl::dim<0>(result); ++i) {
+            result(i, etl::max_index(output(i))) += weight(1.0 / members);
+        }
+    }
+
+    std::tuple<const DBN&...> dbns; ///< The members
+    cpp::thread_pool<true> pool;    ///< The thread pool running the members
+};
+
+/*!
+ * \brief Create an ensemble of the given networks
+ */
+template <typename... DBN>
+ensemble<DBN...> make_ensemble(const DBN&... dbns) {
+    return ensemble<DBN...>(dbns...);
+}
+
+} //end of dll namespace
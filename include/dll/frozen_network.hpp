@@ -0,0 +1,400 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Frozen inference-only version of a network
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <tuple>
+#include <utility>
+
+#include "etl/etl.hpp"
+
+#include "layer_fwd.hpp"
+#include "layer_traits.hpp"
+#include "util/batch_reshape.hpp"
+#include "util/epilogue.hpp"
+#include "util/mapped_weights.hpp"
+#include "util/softmax.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The alignment, in bytes, of the parameters of each layer in the
+ * packed parameters of a frozen network
+ */
+constexpr size_t frozen_alignment = 64;
+
+/*!
+ * \brief Inference version of a dense layer, whose parameters are views in
+ * the packed parameters of a frozen network
+ */
+template <typename T, function F>
+struct frozen_dense_layer {
+    size_t visible = 0;       ///< The number of inputs
+    size_t hidden  = 0;       ///< The number of outputs
+    T* w           = nullptr; ///< The weights (visible x hidden)
+    T* b           = nullptr; ///< The biases
+
+    /*!
+     * \brief Returns the number of values of the parameters of the layer
+     * \param layer The dense layer
+     */
+    template <typename L>
+    static size_t packed_size(const L& layer) {
+        return etl::size(layer.w) + etl::dim<1>(layer.w);
+    }
+
+    /*!
+     * \brief Copy the parameters of the given layer at the given location
+     * \param layer The dense layer
+     * \param memory The location of the parameters in the packed parameters
+     */
+    template <typename L>
+    void init(const L& layer, T* memory) {
+        visible = etl::dim<0>(layer.w);
+        hidden  = etl::dim<1>(layer.w);
+
+        layer.w.ensure_cpu_up_to_date();
+
+        w = memory;
+        b = memory + visible * hidden;
+
+        std::copy(layer.w.memory_start(), layer.w.memory_end(), w);
+
+        if constexpr (L::no_bias) {
+            std::fill(b, b + hidden, T(0));
+        } else {
+            layer.b.ensure_cpu_up_to_date();
+            std::copy(layer.b.memory_start(), layer.b.memory_end(), b);
+        }
+    }
+
+    /*!
+     * \brief Use the parameters of the given layer directly from the given
+     * block, as written by the store function of the layer.
+     * \param layer The dense layer
+     * \param block The weights followed by the biases, read-only
+     */
+    template <typename L>
+    void view(const L& layer, T* block) {
+        visible = etl::dim<0>(layer.w);
+        hidden  = etl::dim<1>(layer.w);
+
+        w = block;
+        b = block + visible * hidden;
+    }
+
+    /*!
+     * \brief Apply the layer to a batch of input
+     */
+    template <typename I>
+    etl::dyn_matrix<T, 2> forward_batch(const I& input) const {
+        const size_t B = etl::dim<0>(input);
+
+        cpp_assert(etl::size(input) == B * visible, "Invalid input for the frozen dense layer");
+
+        etl::custom_dyn_matrix<T, 2> w_m(w, visible, hidden);
+        etl::custom_dyn_matrix<T, 1> b_m(b, hidden);
+
+        etl::dyn_matrix<T, 2> output(B, hidden);
+
+        output = etl::reshape(input, B, visible) * w_m;
+
+        if constexpr (fused_epilogue<F>) {
+            bias_activate_2d<F>(output, b_m);
+        } else if constexpr (F == function::SOFTMAX) {
+            bias_softmax_last(output, b_m);
+        } else {
+            output = f_activate<F>(bias_add_2d(output, b_m));
+        }
+
+        return output;
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief The layers that are computed by the original network
+ */
+struct frozen_passthrough_layer {};
+
+/*!
+ * \brief The layers that are the identity at test time, removed from the
+ * frozen network
+ */
+struct frozen_skipped_layer {};
+
+/*!
+ * \brief Select the frozen version of a layer
+ */
+template <typename Layer, typename Enable = void>
+struct frozen_layer {
+    using type = frozen_passthrough_layer; ///< The frozen layer type
+};
+
+template <typename Desc>
+struct frozen_layer<dense_layer_impl<Desc>> {
+    using type = frozen_dense_layer<typename Desc::weight, Desc::activation_function>; ///< The frozen layer type
+};
+
+template <typename Desc>
+struct frozen_layer<dyn_dense_layer_impl<Desc>> {
+    using type = frozen_dense_layer<typename Desc::weight, Desc::activation_function>; ///< The frozen layer type
+};
+
+template <typename Desc>
+struct frozen_layer<dropout_layer_impl<Desc>> {
+    using type = frozen_skipped_layer; ///< The frozen layer type
+};
+
+template <typename Desc>
+struct frozen_layer<dyn_dropout_layer_impl<Desc>> {
+    using type = frozen_skipped_layer; ///< The frozen layer type
+};
+
+template <typename Layer>
+using frozen_layer_t = typename frozen_layer<Layer>::type;
+
+/*!
+ * \brief Traits indicating if the stored weights of a layer can be used
+ * directly by its frozen version, without any copy
+ */
+template <typename Layer, typename Enable = void>
+struct frozen_view : std::false_type {};
+
+template <typename Desc>
+struct frozen_view<dense_layer_impl<Desc>, std::enable_if_t<!dense_layer_impl<Desc>::no_bias>> : std::true_type {};
+
+template <typename Desc>
+struct frozen_view<dyn_dense_layer_impl<Desc>, std::enable_if_t<!dyn_dense_layer_impl<Desc>::no_bias>> : std::true_type {};
+
+template <typename Layer>
+constexpr bool frozen_view_v = frozen_view<std::decay_t<Layer>>::value;
+
+template <typename DBN, typename Sequence>
+struct frozen_layers;
+
+template <typename DBN, size_t... I>
+struct frozen_layers<DBN, std::index_sequence<I...>> {
+    using type = std::tuple<frozen_layer_t<typename DBN::template layer_type<I>>...>; ///< The tuple of frozen layers
+};
+
+/*!
+ * \brief Round the given number of values of type T up to the alignment of
+ * the packed parameters
+ */
+template <typename T>
+constexpr size_t frozen_align(size_t n) {
+    constexpr size_t values = frozen_alignment / sizeof(T);
+    return ((n + values - 1) / values) * values;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Inference-only version of a network.
+ *
+ * The parameters of the dense layers are copied into a single aligned
+ * allocation, each layer starting on a cache line, and are computed from
+ * there. The dropout layers, which are the identity at test time, are
+ * removed at compile-time. The other layers (convolutional, pooling,
+ * transform, ...) are computed by the original network, which must
+ * outlive this object and must not be trained anymore. When created from
+ * a mapped weights file, the dense layers use their weights directly from
+ * the mapping instead.
+ */
+template <typename DBN>
+struct frozen_network {
+    using dbn_t  = DBN;                    ///< The network type
+    using weight = typename dbn_t::weight; ///< The floating point type
+
+    static constexpr size_t layers = dbn_t::layers; ///< The number of layers
+
+    using layers_t = typename detail::frozen_layers<dbn_t, std::make_index_sequence<layers>>::type; ///< The frozen layers
+
+    /*!
+     * \brief Create the frozen version of the given network.
+     * \param dbn The network
+     */
+    explicit frozen_network(const dbn_t& dbn) : dbn(dbn) {
+        pack(nullptr);
+    }
+
+    /*!
+     * \brief Create the frozen version of the given network, using the
+     * stored weights of its dense layers directly from the given mapping.
+     *
+     * The other layers of the network must already be loaded from the
+     * mapping. The mapping must outlive this object.
+     *
+     * \param dbn The network
+     * \param weights The mapping of the weights of the network
+     */
+    frozen_network(const dbn_t& dbn, const mapped_weights& weights) : dbn(dbn) {
+        cpp_assert(weights.blocks() == layers, "Invalid number of layers in the mapped weights");
+        cpp_assert(weights.dtype() == sizeof(weight), "Invalid type of the mapped weights");
+
+        pack(&weights);
+    }
+
+    /*!
+     * \brief Returns the number of values of the packed parameters
+     */
+    size_t packed_size() const {
+        return etl::size(parameters);
+    }
+
+    /*!
+     * \brief Compute the output of the network for the given batch of input
+     * \param input The batch of input
+     * \return The batch of output
+     */
+    template <typename Input>
+    auto forward_batch(const Input& input) const {
+        return forward_impl<0>(input);
+    }
+
+    /*!
+     * \brief Compute the output of the network for the given sample
+     * \param sample The input sample
+     * \return The output of the network for the sample
+     */
+    template <typename Input>
+    auto forward_one(const Input& sample) const {
+        auto output = forward_batch(batch_reshape(sample));
+
+        return etl::dyn_matrix<weight, etl::dimensions<decltype(output)>() - 1>(output(0));
+    }
+
+private:
+    template <size_t L>
+    using frozen_t = std::tuple_element_t<L, layers_t>;
+
+    template <size_t L>
+    static constexpr bool is_passthrough = std::is_same<frozen_t<L>, detail::frozen_passthrough_layer>::value;
+
+    template <size_t L>
+    static constexpr bool is_skipped = std::is_same<frozen_t<L>, detail::frozen_skipped_layer>::value;
+
+    /*!
+     * \brief Pack the parameters of the frozen layers that are not views in
+     * the given mapping
+     */
+    void pack(const mapped_weights* weights) {
+        size_t size = 0;
+
+        size_impl(size, weights, std::make_index_sequence<layers>());
+
+        parameters = etl::dyn_matrix<weight, 1>(std::max(size, size_t(1)));
+
+        size_t offset = 0;
+
+        init_impl(offset, weights, std::make_index_sequence<layers>());
+
+        parameters.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Indicates if the given layer can use its block of the given
+     * mapping directly
+     */
+    template <size_t L>
+    bool is_view(const mapped_weights* weights) const {
+        if constexpr (detail::frozen_view_v<typename dbn_t::template layer_type<L>>) {
+            return weights && weights->block_size(L) == frozen_t<L>::packed_size(dbn.template layer_get<L>()) * sizeof(weight);
+        } else {
+            return false;
+        }
+    }
+
+    /*!
+     * \brief Compute the size of the packed parameters
+     */
+    template <size_t... I>
+    void size_impl(size_t& size, const mapped_weights* weights, std::index_sequence<I...>) const {
+        (size_layer<I>(size, weights), ...);
+    }
+
+    /*!
+     * \brief Add the size of the parameters of the given layer
+     */
+    template <size_t L>
+    void size_layer(size_t& size, const mapped_weights* weights) const {
+        if constexpr (!is_passthrough<L> && !is_skipped<L>) {
+            if (!is_view<L>(weights)) {
+                size += detail::frozen_align<weight>(frozen_t<L>::packed_size(dbn.template layer_get<L>()));
+            }
+        }
+    }
+
+    /*!
+     * \brief Copy the parameters of the layers
+     */
+    template <size_t... I>
+    void init_impl(size_t& offset, const mapped_weights* weights, std::index_sequence<I...>) {
+        (init_layer<I>(offset, weights), ...);
+    }
+
+    /*!
+     * \brief Copy the parameters of the given layer, or use them from the
+     * mapping
+     */
+    template <size_t L>
+    void init_layer(size_t& offset, const mapped_weights* weights) {
+        if constexpr (!is_passthrough<L> && !is_skipped<L>) {
+            decltype(auto) layer = dbn.template layer_get<L>();
+
+            if (is_view<L>(weights)) {
+                std::get<L>(flayers).view(layer, reinterpret_cast<weight*>(weights->block(L)));
+            } else {
+                std::get<L>(flayers).init(layer, parameters.memory_start() + offset);
+
+                offset += detail::frozen_align<weight>(frozen_t<L>::packed_size(layer));
+            }
+        }
+    }
+
+    /*!
+     * \brief Propagate the batch from the given layer to the output
+     */
+    template <size_t L, typename Input>
+    auto forward_impl(const Input& input) const {
+        if constexpr (is_skipped<L>) {
+            if constexpr (L + 1 < layers) {
+                return forward_impl<L + 1>(input);
+            } else {
+                return etl::dyn_matrix<weight, etl::dimensions<Input>()>(input);
+            }
+        } else {
+            auto next = [&]() {
+                if constexpr (is_passthrough<L>) {
+                    return dbn.template layer_get<L>().test_forward_batch(input);
+                } else {
+                    return std::get<L>(flayers).forward_batch(input);
+                }
+            }();
+
+            if constexpr (L + 1 < layers) {
+                return forward_impl<L + 1>(next);
+            } else {
+                return next;
+            }
+        }
+    }
+
+    const dbn_t& dbn;                      ///< The original network
+    layers_t flayers;                      ///< The frozen layers
+    etl::dyn_matrix<weight, 1> parameters; ///< The packed parameters of the frozen layers
+};
+
+} //end of dll namespace
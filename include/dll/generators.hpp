@@ -10,6 +10,9 @@
 #include "etl/etl.hpp"
 
 #include "dll/util/tmp.hpp"
+#include "dll/util/bfloat16.hpp"
+#include "dll/util/memory.hpp"
+#include "dll/util/huge_pages.hpp"
 #include "dll/base_conf.hpp"
 
 // Common helpers
@@ -17,6 +20,8 @@
 #include "dll/generators/label_cache_helper.hpp"
 #include "dll/generators/augmenters.hpp"
 #include "dll/generators/transformers.hpp"
+#include "dll/generators/generator_stats.hpp"
+#include "dll/generators/batch_workers.hpp"
 
 namespace dll {
 
@@ -58,3 +63,9 @@ static constexpr bool is_threaded = Desc::Threaded;
 
 #include "dll/generators/inmemory_data_generator.hpp"
 #include "dll/generators/outmemory_data_generator.hpp"
+#include "dll/generators/mmap_data_generator.hpp"
+#include "dll/generators/compressed_data_generator.hpp"
+#include "dll/generators/layer_cache.hpp"
+#include "dll/generators/pipelined_generator.hpp"
+#include "dll/generators/fold_generator.hpp"
+#include "dll/generators/text_index.hpp"
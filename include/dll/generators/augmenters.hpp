@@ -7,10 +7,14 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <thread>
+#include <utility>
 
+#include "dll/corruption_type.hpp"
 #include "dll/util/random.hpp"
+#include "dll/util/sampling.hpp"
 
 namespace dll {
 
@@ -57,6 +61,22 @@ struct random_cropper<Desc, std::enable_if_t<Desc::random_crop_x != 0 && Desc::r
         return (x - random_crop_x) * (y - random_crop_y);
     }
 
+    /*!
+     * \brief Pick the window of the next crop
+     * \param test Indicates if the center crop (test mode) is used
+     * \return The (y, x) offsets of the window inside the image
+     */
+    std::pair<size_t, size_t> window(bool test) {
+        if (test) {
+            return {(y - random_crop_y) / 2, (x - random_crop_x) / 2};
+        }
+
+        const size_t y_offset = dist_y(dll::rand_engine());
+        const size_t x_offset = dist_x(dll::rand_engine());
+
+        return {y_offset, x_offset};
+    }
+
     /*!
      * \brief Transform an image.
      *
@@ -67,16 +87,7 @@ struct random_cropper<Desc, std::enable_if_t<Desc::random_crop_x != 0 && Desc::r
      */
     template <typename O, typename T>
     void transform_first(O&& target, const T& image) {
-        const size_t y_offset = dist_y(dll::rand_engine());
-        const size_t x_offset = dist_x(dll::rand_engine());
-
-        for (size_t c = 0; c < etl::dim<0>(image); ++c) {
-            for (size_t y = 0; y < random_crop_y; ++y) {
-                for (size_t x = 0; x < random_crop_x; ++x) {
-                    target(c, y, x) = image(c, y_offset + y, x_offset + x);
-                }
-            }
-        }
+        crop(target, image, window(false));
     }
 
     /*!
@@ -89,13 +100,19 @@ struct random_cropper<Desc, std::enable_if_t<Desc::random_crop_x != 0 && Desc::r
      */
     template <typename O, typename T>
     void transform_first_test(O&& target, const T& image) {
-        const size_t y_offset = (x - random_crop_x) / 2;
-        const size_t x_offset = (y - random_crop_y) / 2;
+        crop(target, image, window(true));
+    }
 
+private:
+    /*!
+     * \brief Copy the given window of the image into the target
+     */
+    template <typename O, typename T>
+    static void crop(O&& target, const T& image, std::pair<size_t, size_t> offsets) {
         for (size_t c = 0; c < etl::dim<0>(image); ++c) {
             for (size_t y = 0; y < random_crop_y; ++y) {
                 for (size_t x = 0; x < random_crop_x; ++x) {
-                    target(c, y, x) = image(c, y_offset + y, x_offset + x);
+                    target(c, y, x) = image(c, offsets.first + y, offsets.second + x);
                 }
             }
         }
@@ -124,6 +141,17 @@ struct random_cropper<Desc, std::enable_if_t<Desc::random_crop_x == 0 || Desc::r
         return 1;
     }
 
+    /*!
+     * \brief Pick the window of the next crop, the full image
+     * \param test Indicates if the center crop (test mode) is used
+     * \return The (y, x) offsets of the window inside the image
+     */
+    static std::pair<size_t, size_t> window(bool test) {
+        cpp_unused(test);
+
+        return {0, 0};
+    }
+
     /*!
      * \brief Transform an image.
      *
@@ -196,32 +224,34 @@ struct random_mirrorer<Desc, std::enable_if_t<Desc::HorizontalMirroring || Desc:
         }
     }
 
+    /*!
+     * \brief Pick the flips of the next image
+     * \return The (horizontal, vertical) flips
+     */
+    std::pair<bool, bool> flips() {
+        auto choice = dist(dll::rand_engine());
+
+        if (horizontal && vertical) {
+            return {choice == 2, choice == 1};
+        }
+
+        return {horizontal && choice == 1, vertical && choice == 1};
+    }
+
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
      */
     template <typename O>
     void transform(O&& target) {
-        auto choice = dist(dll::rand_engine());
+        auto [h, v] = flips();
 
-        if (horizontal && vertical && choice == 1) {
-            for (size_t c = 0; c < etl::dim<0>(target); ++c) {
-                target(c) = vflip(target(c));
-            }
-        } else if (horizontal && vertical && choice == 2) {
-            for (size_t c = 0; c < etl::dim<0>(target); ++c) {
+        for (size_t c = 0; c < etl::dim<0>(target); ++c) {
+            if (h) {
                 target(c) = hflip(target(c));
             }
-        }
 
-        if (horizontal && choice == 1) {
-            for (size_t c = 0; c < etl::dim<0>(target); ++c) {
-                target(c) = hflip(target(c));
-            }
-        }
-
-        if (vertical && choice == 1) {
-            for (size_t c = 0; c < etl::dim<0>(target); ++c) {
+            if (v) {
                 target(c) = vflip(target(c));
             }
         }
@@ -250,6 +280,14 @@ struct random_mirrorer<Desc, std::enable_if_t<!Desc::HorizontalMirroring && !Des
         return 1;
     }
 
+    /*!
+     * \brief Pick the flips of the next image, none
+     * \return The (horizontal, vertical) flips
+     */
+    static std::pair<bool, bool> flips() {
+        return {false, false};
+    }
+
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
@@ -271,16 +309,15 @@ struct random_noise;
  */
 template <typename Desc>
 struct random_noise<Desc, std::enable_if_t<Desc::Noise != 0>> {
-    static constexpr size_t N = Desc::Noise; ///< The amount of noise (in percent)
-
-    std::uniform_int_distribution<size_t> dist; ///< The random distribution
+    static constexpr size_t N                   = Desc::Noise;      ///< The amount of noise (in percent)
+    static constexpr corruption_type Corruption = Desc::Corruption; ///< The type of noise
 
     /*!
      * \brief Initialize the random_noise
      * \param image The image to crop from
      */
     template <typename T>
-    random_noise(const T& image) : dist(0, 1000) {
+    random_noise(const T& image) {
         cpp_unused(image);
     }
 
@@ -298,10 +335,29 @@ struct random_noise<Desc, std::enable_if_t<Desc::Noise != 0>> {
      */
     template <typename O>
     void transform(O&& target) {
-        auto& g = dll::rand_engine();
+        constexpr float p = N / 100.0f;
 
-        for (auto& v : target) {
-            v *= dist(g) < N * 10 ? 0.0 : 1.0;
+        if constexpr (Corruption == corruption_type::MASKING) {
+            dll::mask_noise(target, p);
+        } else if constexpr (Corruption == corruption_type::SALT_PEPPER) {
+            dll::salt_pepper_noise(target, p);
+        } else {
+            dll::add_normal_noise(target, p);
+        }
+    }
+
+    /*!
+     * \brief Apply the transform in place on the first n samples of a batch,
+     * in one pass over the memory
+     * \param batch The batch to transform
+     * \param n The number of samples to transform
+     */
+    template <typename O>
+    void transform_batch(O&& batch, size_t n) {
+        if (n == etl::dim<0>(batch)) {
+            transform(batch);
+        } else if (n) {
+            transform(etl::slice(batch, 0, n));
         }
     }
 };
@@ -336,6 +392,17 @@ struct random_noise<Desc, std::enable_if_t<Desc::Noise == 0>> {
     static void transform(O&& target) {
         cpp_unused(target);
     }
+
+    /*!
+     * \brief Apply the transform on the first n samples of a batch
+     * \param batch The batch to transform
+     * \param n The number of samples to transform
+     */
+    template <typename O>
+    static void transform_batch(O&& batch, size_t n) {
+        cpp_unused(batch);
+        cpp_unused(n);
+    }
 };
 
 /*!
@@ -344,20 +411,31 @@ struct random_noise<Desc, std::enable_if_t<Desc::Noise == 0>> {
 template <typename Desc, typename Enable = void>
 struct elastic_distorter;
 
-// TODO This needs to be made MUCH faster
-
 /*!
  * \copydoc elastic_distorter
+ *
+ * The displacement fields are generated for a full batch at once and blurred
+ * with a separable kernel, the scratch buffers being reused across calls.
  */
 template <typename Desc>
 struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
-    using weight = typename Desc::weight; ///< The data type
+    using weight = float; ///< The type of the displacement fields
+
+    static constexpr size_t K      = Desc::ElasticDistortion;         ///< size of elastic distortion kernel
+    static constexpr size_t mid    = K / 2;                           ///< Half of the kernel
+    static constexpr size_t fields = Desc::BatchSize;                 ///< The number of displacement fields generated at once
+    static constexpr double sigma  = 0.8 + 0.3 * ((K - 1) * 0.5 - 1); ///< Sigma for gaussian kernel
+
+    etl::fast_dyn_matrix<weight, K> kernel; ///< The precomputed separable kernel
 
-    static constexpr size_t K     = Desc::ElasticDistortion;         ///< size of elastic distortion kernel
-    static constexpr size_t mid   = K / 2;                           ///< Half of the kernel
-    static constexpr double sigma = 0.8 + 0.3 * ((K - 1) * 0.5 - 1); ///< Sigma for gaussian kernel
+    size_t width  = 0;      ///< The width of the displacement fields
+    size_t height = 0;      ///< The height of the displacement fields
+    size_t next   = fields; ///< The next unused displacement field
 
-    etl::fast_dyn_matrix<weight, K, K> kernel; ///< The precomputed kernel
+    etl::dyn_matrix<weight, 3> d_x;   ///< The horizontal displacement fields
+    etl::dyn_matrix<weight, 3> d_y;   ///< The vertical displacement fields
+    etl::dyn_matrix<weight, 2> d_tmp; ///< Scratch buffer for the first pass of the blur
+    etl::dyn_matrix<weight, 2> d_sum; ///< Scratch buffer for the second pass of the blur
 
     static_assert(K % 2 == 1, "The kernel size must be odd");
 
@@ -371,17 +449,16 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
 
         cpp_unused(image);
 
-        // Precompute the gaussian kernel
+        // Precompute the gaussian kernel, the 2D kernel is the outer
+        // product of this kernel with itself
 
-        auto gaussian = [](double x, double y) {
-            auto Z = 2.0 * M_PI * sigma * sigma;
-            return (1.0 / Z) * std::exp(-((x * x + y * y) / (2.0 * sigma * sigma)));
+        auto gaussian = [](double x) {
+            auto Z = std::sqrt(2.0 * M_PI) * sigma;
+            return (1.0 / Z) * std::exp(-((x * x) / (2.0 * sigma * sigma)));
         };
 
         for (size_t i = 0; i < K; ++i) {
-            for (size_t j = 0; j < K; ++j) {
-                kernel(i, j) = gaussian(double(i) - mid, double(j) - mid);
-            }
+            kernel(i) = gaussian(double(i) - mid);
         }
     }
 
@@ -393,37 +470,47 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
         return 10;
     }
 
+    /*!
+     * \brief Start a new batch, the fields of the previous batch are
+     * dropped so that each batch only depends on its own random stream
+     */
+    void begin_batch() {
+        next = fields;
+    }
+
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
      */
     template <typename O>
     void transform(O&& target) {
-        const size_t width  = etl::dim<1>(target);
-        const size_t height = etl::dim<2>(target);
+        const size_t w = etl::dim<1>(target);
+        const size_t h = etl::dim<2>(target);
 
-        // 0. Generate random displacement fields
+        // 0. Generate and blur the displacement fields of a full batch
 
-        etl::dyn_matrix<weight> d_x(width, height);
-        etl::dyn_matrix<weight> d_y(width, height);
+        if (w != width || h != height) {
+            width  = w;
+            height = h;
 
-        d_x = etl::uniform_generator(dll::rand_engine(), -1.0, 1.0);
-        d_y = etl::uniform_generator(dll::rand_engine(), -1.0, 1.0);
-
-        // 1. Gaussian blur the displacement fields
+            d_x   = etl::dyn_matrix<weight, 3>(fields, width, height);
+            d_y   = etl::dyn_matrix<weight, 3>(fields, width, height);
+            d_tmp = etl::dyn_matrix<weight, 2>(width, height);
+            d_sum = etl::dyn_matrix<weight, 2>(width, height);
 
-        etl::dyn_matrix<weight> d_x_blur(width, height);
-        etl::dyn_matrix<weight> d_y_blur(width, height);
+            next = fields;
+        }
 
-        gaussian_blur(d_x, d_x_blur);
-        gaussian_blur(d_y, d_y_blur);
+        if (next == fields) {
+            generate_fields();
+        }
 
-        // 2. Normalize and scale the displacement field
+        auto d_x_blur = d_x(next);
+        auto d_y_blur = d_y(next);
 
-        d_x_blur *= (weight(8) / sum(d_x_blur));
-        d_y_blur *= (weight(8) / sum(d_y_blur));
+        ++next;
 
-        // 3. Apply the displacement field (using bilinear interpolation)
+        // 1. Apply the displacement field (using bilinear interpolation)
 
         auto safe = [&](size_t channel, weight x, weight y) {
             if (x < 0 || y < 0 || x > width - 1 || y > height - 1) {
@@ -436,21 +523,23 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
         for (size_t channel = 0; channel < etl::dim<0>(target); ++channel) {
             for (int x = 0; x < int(width); ++x) {
                 for (int y = 0; y < int(height); ++y) {
-                    auto dx = d_x_blur(x, y);
-                    auto dy = d_y_blur(x, y);
+                    weight px = x + d_x_blur(x, y);
+                    weight py = y + d_y_blur(x, y);
 
-                    weight px = x + dx;
-                    weight py = y + dy;
+                    const weight fx = std::floor(px);
+                    const weight fy = std::floor(py);
+                    const weight cx = std::ceil(px);
+                    const weight cy = std::ceil(py);
 
-                    weight a = safe(channel, std::floor(px), std::floor(py));
-                    weight b = safe(channel, std::ceil(px), std::floor(py));
-                    weight c = safe(channel, std::ceil(px), std::ceil(py));
-                    weight d = safe(channel, std::floor(px), std::ceil(py));
+                    weight a = safe(channel, fx, fy);
+                    weight b = safe(channel, cx, fy);
+                    weight c = safe(channel, cx, cy);
+                    weight d = safe(channel, fx, cy);
 
-                    auto e = a * (1.0 - (px - std::floor(px))) + d * (px - std::floor(px));
-                    auto f = b * (1.0 - (px - std::floor(px))) + c * (px - std::floor(px));
+                    auto e = a * (1.0 - (px - fx)) + d * (px - fx);
+                    auto f = b * (1.0 - (px - fx)) + c * (px - fx);
 
-                    auto value = e * (1.0 - (py - std::floor(py))) + f * (py - std::floor(py));
+                    auto value = e * (1.0 - (py - fy)) + f * (py - fy);
 
                     target(channel, x, y) = value;
                 }
@@ -458,30 +547,89 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
         }
     }
 
+private:
+    /*!
+     * \brief Generate, blur and normalize a batch of displacement fields
+     */
+    void generate_fields() {
+        d_x = etl::uniform_generator(dll::rand_engine(), -1.0, 1.0);
+        d_y = etl::uniform_generator(dll::rand_engine(), -1.0, 1.0);
+
+        for (size_t b = 0; b < fields; ++b) {
+            gaussian_blur(d_x.memory_start() + b * width * height);
+            gaussian_blur(d_y.memory_start() + b * width * height);
+
+            // Normalize and scale the displacement field
+
+            d_x(b) *= (weight(8) / sum(d_x(b)));
+            d_y(b) *= (weight(8) / sum(d_y(b)));
+        }
+
+        next = 0;
+    }
+
     /*!
-     * \brief Apply a gaussian blur on the distortion matrix
+     * \brief Apply a gaussian blur on the distortion matrix, in place.
+     *
+     * The kernel is applied in two passes, the inner loops running over
+     * contiguous memory so that they can be vectorized.
+     *
+     * \param d Pointer to the width x height distortion matrix
      */
-    void gaussian_blur(const etl::dyn_matrix<weight>& d, etl::dyn_matrix<weight>& d_blur) {
-        const size_t width  = etl::dim<0>(d);
-        const size_t height = etl::dim<1>(d);
+    void gaussian_blur(weight* d) {
+        weight* tmp = d_tmp.memory_start();
+        weight* acc = d_sum.memory_start();
+
+        std::fill_n(tmp, width * height, weight(0));
+        std::fill_n(acc, width * height, weight(0));
+
+        // 1. Pass along the rows (contiguous dimension)
 
         for (size_t j = 0; j < width; ++j) {
-            for (size_t k = 0; k < height; ++k) {
-                weight sum(0.0);
-
-                for (size_t p = 0; p < K; ++p) {
-                    if (long(j) + p - mid >= 0 && long(j) + p - mid < width) {
-                        for (size_t q = 0; q < K; ++q) {
-                            if (long(k) + q - mid >= 0 && long(k) + q - mid < height) {
-                                sum += kernel(p, q) * d(j + p - mid, k + q - mid);
-                            }
-                        }
-                    }
+            const weight* in = d + j * height;
+            weight* out      = tmp + j * height;
+
+            for (size_t q = 0; q < K; ++q) {
+                const long shift = long(q) - long(mid);
+                const long first = std::max(0L, -shift);
+                const long last  = std::min(long(height), long(height) - shift);
+
+                const weight k = kernel(q);
+
+                for (long y = first; y < last; ++y) {
+                    out[y] += k * in[y + shift];
                 }
+            }
+        }
+
+        // 2. Pass along the columns
+
+        for (size_t j = 0; j < width; ++j) {
+            weight* out = acc + j * height;
 
-                d_blur(j, k) = d(j, k) - (sum / (K * K));
+            for (size_t p = 0; p < K; ++p) {
+                const long src = long(j) + long(p) - long(mid);
+
+                if (src < 0 || src >= long(width)) {
+                    continue;
+                }
+
+                const weight* in = tmp + src * height;
+                const weight k   = kernel(p);
+
+                for (size_t y = 0; y < height; ++y) {
+                    out[y] += k * in[y];
+                }
             }
         }
+
+        // 3. Remove the local mean from the field
+
+        const weight scale = weight(1) / (K * K);
+
+        for (size_t i = 0; i < width * height; ++i) {
+            d[i] -= scale * acc[i];
+        }
     }
 };
 
@@ -507,6 +655,11 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion == 0>> {
         return 1;
     }
 
+    /*!
+     * \brief Start a new batch
+     */
+    static void begin_batch() {}
+
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
@@ -517,4 +670,108 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion == 0>> {
     }
 };
 
+/*!
+ * \brief The complete set of augmenters used by one producer of a
+ * generator.
+ *
+ * Each producer thread owns its own set so that the producers never
+ * share augmenter state.
+ */
+template <typename Desc>
+struct augmenter_set {
+    random_cropper<Desc> cropper;      ///< The random cropper
+    random_mirrorer<Desc> mirrorer;    ///< The random mirrorer
+    elastic_distorter<Desc> distorter; ///< The elastic distorter
+    random_noise<Desc> noiser;         ///< The random noiser
+
+    /*!
+     * \brief Initialize the set of augmenters
+     * \param image An example of the images to augment
+     */
+    template <typename T>
+    explicit augmenter_set(const T& image) : cropper(image), mirrorer(image), distorter(image), noiser(image) {}
+
+    /*!
+     * \brief The number of generated images from one input image
+     * \return The augmentation factor
+     */
+    size_t scaling() const {
+        return cropper.scaling() * mirrorer.scaling() * noiser.scaling() * distorter.scaling();
+    }
+
+    /*!
+     * \brief Start the augmentation of a new batch
+     */
+    void begin_batch() {
+        distorter.begin_batch();
+    }
+
+    /*!
+     * \brief Crop and mirror an image into the target in a single pass,
+     * passing each value through the given function.
+     *
+     * In test mode, the center crop is used and the image is not mirrored.
+     *
+     * \param target The target output
+     * \param image The input image
+     * \param test Indicates if the test mode is used
+     * \param f The function applied to each value
+     */
+    template <typename O, typename T, typename F>
+    void first_transform(O&& target, const T& image, bool test, F&& f) {
+        using value_type = etl::value_t<std::decay_t<O>>;
+
+        value_type* out = target.memory_start();
+
+        if constexpr (etl::dimensions<T>() != 3) {
+            // Only the noise can be used on such images
+            const size_t n = etl::size(target);
+
+            cpp_unused(test);
+
+            for (size_t i = 0; i < n; ++i) {
+                out[i] = f(image[i]);
+            }
+        } else {
+            const auto offsets = cropper.window(test);
+            const auto flips   = test ? std::pair<bool, bool>{false, false} : mirrorer.flips();
+
+            const size_t C  = etl::dim<0>(target);
+            const size_t H  = etl::dim<1>(target);
+            const size_t W  = etl::dim<2>(target);
+            const size_t IH = etl::dim<1>(image);
+            const size_t IW = etl::dim<2>(image);
+
+            for (size_t c = 0; c < C; ++c) {
+                for (size_t y = 0; y < H; ++y) {
+                    const size_t iy = offsets.first + (flips.second ? H - 1 - y : y);
+
+                    value_type* row = out + (c * H + y) * W;
+
+                    if constexpr (etl::is_dma<T>) {
+                        const auto* in = image.memory_start() + (c * IH + iy) * IW + offsets.second;
+
+                        if (flips.first) {
+                            for (size_t x = 0; x < W; ++x) {
+                                row[x] = f(in[W - 1 - x]);
+                            }
+                        } else {
+                            for (size_t x = 0; x < W; ++x) {
+                                row[x] = f(in[x]);
+                            }
+                        }
+                    } else {
+                        cpp_unused(IH);
+                        cpp_unused(IW);
+
+                        for (size_t x = 0; x < W; ++x) {
+                            row[x] = f(image(c, iy, offsets.second + (flips.first ? W - 1 - x : x)));
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
 } //end of dll namespace
@@ -0,0 +1,570 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Producer workers used by the threaded generators
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "dll/util/random.hpp"
+#include "dll/generators/generator_stats.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The status of a slot of the big batch cache
+ */
+enum class slot_status {
+    EMPTY,   ///< The slot is waiting to be filled
+    FILLING, ///< The slot is being filled by a worker
+    READY    ///< The slot is ready to be consumed
+};
+
+/*!
+ * \brief A set of producer threads filling the batch slots of a
+ * threaded generator.
+ *
+ * The big batch cache is seen as a set of slots, each holding one
+ * batch. A worker always claims the empty slot with the lowest batch
+ * index, which means that the batches are claimed in the order of the
+ * dataset, even with several workers. Filling the slot is done without
+ * holding the lock, so several workers can fill different slots at the
+ * same time. The consumer waits for the slot of the current batch and
+ * releases it once it has been consumed.
+ *
+ * \tparam BigBatchSize The number of slots
+ */
+template <size_t BigBatchSize>
+struct batch_workers {
+    static constexpr size_t big_batch_size = BigBatchSize; ///< The number of slots
+
+    mutable std::mutex main_lock;                    ///< The main lock
+    mutable std::condition_variable condition;       ///< The condition variable for the workers to wait for some space
+    mutable std::condition_variable ready_condition; ///< The condition variable for a reader to wait for ready data
+
+    slot_status status[big_batch_size]; ///< Status of each slot
+    size_t indices[big_batch_size];     ///< Index of the batch of each slot
+
+    size_t batches    = 0;     ///< The total number of batches to produce
+    size_t generation = 0;     ///< The number of resets of the generation
+    bool stop_flag    = false; ///< Boolean flag indicating to the workers to stop
+
+    const size_t stream = new_streams(); ///< The random stream of the workers
+
+    mutable generator_counters counters; ///< The counters of the pipeline
+
+    std::vector<std::thread> threads; ///< The worker threads
+
+    batch_workers() {
+        for (size_t b = 0; b < big_batch_size; ++b) {
+            status[b]  = slot_status::EMPTY;
+            indices[b] = b;
+        }
+    }
+
+    batch_workers(const batch_workers& rhs) = delete;
+    batch_workers& operator=(const batch_workers& rhs) = delete;
+
+    batch_workers(batch_workers&& rhs) = delete;
+    batch_workers& operator=(batch_workers&& rhs) = delete;
+
+    /*!
+     * \brief Destructs the workers, stopping the threads if necessary
+     */
+    ~batch_workers() {
+        stop();
+    }
+
+    /*!
+     * \brief Start the workers.
+     *
+     * The claim functor is called with the lock held, right after a
+     * worker claimed a slot. Since the slots are claimed in order, this
+     * can be used to read from a sequential source. The fill functor is
+     * then called without the lock to fill the slot.
+     *
+     * During the fill, dll::rand_engine() returns an engine that only
+     * depends on the batch and the generation, not on the worker.
+     *
+     * \param n The number of worker threads
+     * \param n_batches The total number of batches to produce
+     * \param claim The functor called as claim(worker, slot, batch) with the lock held
+     * \param fill The functor called as fill(worker, slot, batch) after the claim
+     */
+    template <typename Claim, typename Fill>
+    void start(size_t n, size_t n_batches, Claim claim, Fill fill) {
+        batches = n_batches;
+
+        for (size_t w = 0; w < n; ++w) {
+            threads.emplace_back([this, w, claim, fill] {
+                while (true) {
+                    size_t index   = 0;
+                    size_t batch   = 0;
+                    size_t counter = 0;
+
+                    {
+                        std::unique_lock<std::mutex> ulock(main_lock);
+
+                        // Wait for the end or for some work
+                        auto wait_work = [this, &index, &ulock] {
+                            condition.wait(ulock, [this, &index] {
+                                return stop_flag || find_empty(index);
+                            });
+                        };
+
+                        // Only waiting for a free slot is a stall, not
+                        // waiting for the next generation
+                        if (!stop_flag && !find_empty(index) && pending()) {
+                            generator_counters::timed(counters.producer_wait, wait_work);
+                        } else {
+                            wait_work();
+                        }
+
+                        // If there is no more work for the thread, exit
+                        if (stop_flag) {
+                            return;
+                        }
+
+                        status[index] = slot_status::FILLING;
+                        batch         = indices[index];
+                        counter       = generation * batches + batch;
+
+                        claim(w, index, batch);
+                    }
+
+                    {
+                        auto engine = make_engine(stream, counter);
+                        engine_scope scope(engine);
+
+                        fill(w, index, batch);
+                    }
+
+                    counters.batches.fetch_add(1, std::memory_order_relaxed);
+
+                    // Notify the waiters that one batch is ready
+
+                    {
+                        std::unique_lock<std::mutex> ulock(main_lock);
+
+                        status[index] = slot_status::READY;
+
+                        ready_condition.notify_all();
+                    }
+                }
+            });
+        }
+    }
+
+    /*!
+     * \brief Stop and join all the worker threads
+     */
+    void stop() {
+        cpp::with_lock(main_lock, [this] { stop_flag = true; });
+
+        condition.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        threads.clear();
+    }
+
+    /*!
+     * \brief Reset the generation to its beginning.
+     *
+     * This waits for the slots currently being filled to be completed.
+     *
+     * \param functor A functor called with the lock held, once no slot is being filled
+     */
+    template <typename Functor>
+    void reset(Functor functor) {
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        ready_condition.wait(ulock, [this] {
+            for (size_t b = 0; b < big_batch_size; ++b) {
+                if (status[b] == slot_status::FILLING) {
+                    return false;
+                }
+            }
+
+            return true;
+        });
+
+        for (size_t b = 0; b < big_batch_size; ++b) {
+            status[b]  = slot_status::EMPTY;
+            indices[b] = b;
+        }
+
+        ++generation;
+
+        counters.reset();
+
+        functor();
+
+        condition.notify_all();
+    }
+
+    /*!
+     * \brief Reset the generation to its beginning.
+     */
+    void reset() {
+        reset([] {});
+    }
+
+    /*!
+     * \brief Wait for the given batch to be ready
+     * \param batch The index of the batch
+     * \return The slot holding the batch
+     */
+    size_t wait(size_t batch) const {
+        const size_t b = batch % big_batch_size;
+
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        auto ready = [this, b] { return status[b] == slot_status::READY; };
+
+        if (!ready()) {
+            generator_counters::timed(counters.consumer_wait, [&] { ready_condition.wait(ulock, ready); });
+        }
+
+        return b;
+    }
+
+    /*!
+     * \brief Release the slot of given batch after it has been consumed.
+     *
+     * If the slot is still being filled, this waits for the worker to
+     * be done with it.
+     *
+     * \param batch The index of the batch
+     */
+    void release(size_t batch) {
+        const size_t b = batch % big_batch_size;
+
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        auto filled = [this, b] { return status[b] != slot_status::FILLING; };
+
+        if (!filled()) {
+            generator_counters::timed(counters.consumer_wait, [&] { ready_condition.wait(ulock, filled); });
+        }
+
+        status[b] = slot_status::EMPTY;
+        indices[b] += big_batch_size;
+
+        condition.notify_all();
+    }
+
+private:
+    /*!
+     * \brief Find the empty slot with the lowest batch index.
+     *
+     * This must be called with the lock held.
+     *
+     * \param index Output of the found slot
+     * \return true if a slot has been found, false otherwise
+     */
+    bool find_empty(size_t& index) const {
+        bool found = false;
+
+        for (size_t b = 0; b < big_batch_size; ++b) {
+            if (status[b] == slot_status::EMPTY && indices[b] < batches) {
+                if (!found || indices[b] < indices[index]) {
+                    index = b;
+                    found = true;
+                }
+            }
+        }
+
+        return found;
+    }
+
+    /*!
+     * \brief Indicates if some batches of the generation still need a slot.
+     *
+     * This must be called with the lock held.
+     */
+    bool pending() const {
+        for (size_t b = 0; b < big_batch_size; ++b) {
+            if (indices[b] + (status[b] == slot_status::EMPTY ? 0 : big_batch_size) < batches) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+/*!
+ * \brief Wait for the given predicate to become true, spinning first and
+ * then backing off more and more.
+ * \param pred The predicate to wait for
+ */
+template <typename Pred>
+void backoff_wait(Pred pred) {
+    for (size_t i = 0; !pred(); ++i) {
+        if (i < 64) {
+            // Simply spin
+        } else if (i < 128) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+}
+
+/*!
+ * \brief A lock-free set of producer threads filling the batch slots of a
+ * threaded generator.
+ *
+ * The slots form a ring with a sequence number each. For the batch k,
+ * held by the slot k % BigBatchSize, the sequence is 2 * k while the slot
+ * waits to be filled and 2 * k + 1 once the batch is ready. The workers
+ * claim the batches with a single atomic increment and the claims are
+ * passed in the order of the batches. Waiting for a batch and releasing
+ * it are a single atomic operation each when nobody has to wait.
+ *
+ * This has the same interface as batch_workers.
+ *
+ * \tparam BigBatchSize The number of slots
+ */
+template <size_t BigBatchSize>
+struct lockfree_batch_workers {
+    static constexpr size_t big_batch_size = BigBatchSize; ///< The number of slots
+
+    /*!
+     * \brief The sequence of a slot, alone on its cache line
+     */
+    struct alignas(64) slot_sequence {
+        std::atomic<size_t> seq; ///< The sequence number of the slot
+    };
+
+    using functor_t = std::function<void(size_t, size_t, size_t)>; ///< The type of the claim and fill functors
+
+    slot_sequence sequences[big_batch_size]; ///< The sequence of each slot
+
+    alignas(64) std::atomic<size_t> next_batch;    ///< The next batch to be claimed
+    alignas(64) std::atomic<size_t> claimed_batch; ///< The next batch to be passed to the claim functor
+    std::atomic<bool> stop_flag;                   ///< Boolean flag indicating to the workers to stop
+
+    size_t batches    = 0; ///< The total number of batches to produce
+    size_t n_workers  = 0; ///< The number of worker threads
+    size_t generation = 0; ///< The number of resets of the generation
+
+    const size_t stream = new_streams(); ///< The random stream of the workers
+
+    mutable generator_counters counters; ///< The counters of the pipeline
+
+    functor_t claim_functor; ///< The claim functor
+    functor_t fill_functor;  ///< The fill functor
+
+    std::vector<std::thread> threads; ///< The worker threads
+
+    lockfree_batch_workers() {
+        init();
+    }
+
+    lockfree_batch_workers(const lockfree_batch_workers& rhs) = delete;
+    lockfree_batch_workers& operator=(const lockfree_batch_workers& rhs) = delete;
+
+    lockfree_batch_workers(lockfree_batch_workers&& rhs) = delete;
+    lockfree_batch_workers& operator=(lockfree_batch_workers&& rhs) = delete;
+
+    /*!
+     * \brief Destructs the workers, stopping the threads if necessary
+     */
+    ~lockfree_batch_workers() {
+        stop();
+    }
+
+    /*!
+     * \copydoc batch_workers::start
+     */
+    template <typename Claim, typename Fill>
+    void start(size_t n, size_t n_batches, Claim claim, Fill fill) {
+        n_workers     = n;
+        batches       = n_batches;
+        claim_functor = claim;
+        fill_functor  = fill;
+
+        launch();
+    }
+
+    /*!
+     * \brief Stop and join all the worker threads
+     */
+    void stop() {
+        stop_flag.store(true, std::memory_order_release);
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        threads.clear();
+    }
+
+    /*!
+     * \brief Reset the generation to its beginning.
+     *
+     * The workers are stopped, once they are done with their current
+     * batch, and started again from the first batch.
+     *
+     * \param functor A functor called once no slot is being filled
+     */
+    template <typename Functor>
+    void reset(Functor functor) {
+        stop();
+        init();
+
+        ++generation;
+
+        counters.reset();
+
+        functor();
+
+        launch();
+    }
+
+    /*!
+     * \brief Reset the generation to its beginning.
+     */
+    void reset() {
+        reset([] {});
+    }
+
+    /*!
+     * \brief Wait for the given batch to be ready
+     * \param batch The index of the batch
+     * \return The slot holding the batch
+     */
+    size_t wait(size_t batch) const {
+        const size_t b = batch % big_batch_size;
+
+        auto ready = [this, b, batch] {
+            return sequences[b].seq.load(std::memory_order_acquire) == 2 * batch + 1;
+        };
+
+        if (!ready()) {
+            generator_counters::timed(counters.consumer_wait, [&ready] { backoff_wait(ready); });
+        }
+
+        return b;
+    }
+
+    /*!
+     * \brief Release the slot of given batch after it has been consumed.
+     *
+     * If the slot is still being filled, this waits for the worker to
+     * be done with it.
+     *
+     * \param batch The index of the batch
+     */
+    void release(size_t batch) {
+        const size_t b = wait(batch);
+
+        sequences[b].seq.store(2 * (batch + big_batch_size), std::memory_order_release);
+    }
+
+private:
+    /*!
+     * \brief Initialize the ring for the first batch
+     */
+    void init() {
+        for (size_t b = 0; b < big_batch_size; ++b) {
+            sequences[b].seq.store(2 * b, std::memory_order_relaxed);
+        }
+
+        next_batch.store(0, std::memory_order_relaxed);
+        claimed_batch.store(0, std::memory_order_relaxed);
+        stop_flag.store(false, std::memory_order_release);
+    }
+
+    /*!
+     * \brief Launch all the worker threads
+     */
+    void launch() {
+        for (size_t w = 0; w < n_workers; ++w) {
+            threads.emplace_back([this, w] { work(w); });
+        }
+    }
+
+    /*!
+     * \brief The main loop of a worker
+     * \param w The index of the worker
+     */
+    void work(size_t w) {
+        auto stopped = [this] { return stop_flag.load(std::memory_order_acquire); };
+
+        while (!stopped()) {
+            const size_t batch = next_batch.fetch_add(1, std::memory_order_relaxed);
+
+            // The workers exit at the end of the generation, they will
+            // be launched again on reset
+            if (batch >= batches) {
+                return;
+            }
+
+            const size_t index = batch % big_batch_size;
+
+            // The claims are passed in the order of the batches
+            backoff_wait([&] { return stopped() || claimed_batch.load(std::memory_order_acquire) == batch; });
+
+            if (stopped()) {
+                return;
+            }
+
+            claim_functor(w, index, batch);
+
+            claimed_batch.store(batch + 1, std::memory_order_release);
+
+            // Wait for the consumer to release the slot
+            auto released = [&] { return stopped() || sequences[index].seq.load(std::memory_order_acquire) == 2 * batch; };
+
+            if (!released()) {
+                generator_counters::timed(counters.producer_wait, [&released] { backoff_wait(released); });
+            }
+
+            if (stopped()) {
+                return;
+            }
+
+            {
+                auto engine = make_engine(stream, generation * batches + batch);
+                engine_scope scope(engine);
+
+                fill_functor(w, index, batch);
+            }
+
+            counters.batches.fetch_add(1, std::memory_order_relaxed);
+
+            sequences[index].seq.store(2 * batch + 1, std::memory_order_release);
+        }
+    }
+};
+
+/*!
+ * \brief Select the producer workers implementation from the generator
+ * descriptor
+ */
+template <typename Desc>
+using batch_workers_t = std::conditional_t<
+    Desc::LockFree,
+    lockfree_batch_workers<Desc::BigBatchSize>,
+    batch_workers<Desc::BigBatchSize>>;
+
+} //end of dll namespace
@@ -31,6 +31,9 @@ struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_1d<typename std::it
     using cache_type     = etl::dyn_matrix<T, 2>; ///< The type of the cache
     using big_cache_type = etl::dyn_matrix<T, 3>; ///< The type of the big cache
 
+    template <typename S>
+    using storage_cache_type = etl::dyn_matrix<S, 2>; ///< The type of the cache with a given storage type
+
     static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
     static constexpr size_t big_batch_size = Desc::BigBatchSize; ///< The number of batches kept in cache
 
@@ -40,9 +43,10 @@ struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_1d<typename std::it
      * \param it An iterator to an element
      * \param cache The cache to initialize
      */
-    static void init(size_t n, const Iterator& it, cache_type& cache) {
+    template <typename Cache>
+    static void init(size_t n, const Iterator& it, Cache& cache) {
         auto one = *it;
-        cache    = cache_type(n, etl::dim<0>(one));
+        cache    = Cache(n, etl::dim<0>(one));
     }
 
     /*!
@@ -66,6 +70,9 @@ struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_3d<typename std::it
     using cache_type     = etl::dyn_matrix<T, 4>; ///< The type of the cache
     using big_cache_type = etl::dyn_matrix<T, 5>; ///< The type of the big cache
 
+    template <typename S>
+    using storage_cache_type = etl::dyn_matrix<S, 4>; ///< The type of the cache with a given storage type
+
     static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
     static constexpr size_t big_batch_size = Desc::BigBatchSize; ///< The number of batches kept in cache
 
@@ -75,9 +82,10 @@ struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_3d<typename std::it
      * \param it An iterator to an element
      * \param cache The cache to initialize
      */
-    static void init(size_t n, const Iterator& it, cache_type& cache) {
+    template <typename Cache>
+    static void init(size_t n, const Iterator& it, Cache& cache) {
         auto one = *it;
-        cache    = cache_type(n, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
+        cache    = Cache(n, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
     }
 
     /*!
@@ -106,6 +114,9 @@ struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_2d<typename std::it
     using cache_type     = etl::dyn_matrix<T, 3>; ///< The type of the cache
     using big_cache_type = etl::dyn_matrix<T, 4>; ///< The type of the big cache
 
+    template <typename S>
+    using storage_cache_type = etl::dyn_matrix<S, 3>; ///< The type of the cache with a given storage type
+
     static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
     static constexpr size_t big_batch_size = Desc::BigBatchSize; ///< The number of batches kept in cache
 
@@ -115,9 +126,10 @@ struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_2d<typename std::it
      * \param it An iterator to an element
      * \param cache The cache to initialize
      */
-    static void init(size_t n, const Iterator& it, cache_type& cache) {
+    template <typename Cache>
+    static void init(size_t n, const Iterator& it, Cache& cache) {
         auto one = *it;
-        cache    = cache_type(n, etl::dim<0>(one), etl::dim<1>(one));
+        cache    = Cache(n, etl::dim<0>(one), etl::dim<1>(one));
     }
 
     /*!
@@ -0,0 +1,509 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Implementation of a data generator reading a block-compressed
+ * dataset file
+ *
+ * See compressed_dataset.hpp for the file format.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include "dll/generators/compressed_dataset.hpp"
+#include "dll/generators/batch_workers.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace dll {
+
+/*!
+ * \brief A data generator reading a block-compressed dataset file.
+ *
+ * The blocks are read and decompressed by the producer workers, ahead of
+ * their consumption, each slot of the cache holding one block. The
+ * batches are views on the decompressed blocks. Shuffling is done at the
+ * block level, in order to keep the blocks contiguous in the file.
+ *
+ * The statistics of the pipeline count the blocks produced.
+ *
+ * \tparam T The type of the values of the dataset
+ * \tparam D The number of dimensions of one sample
+ * \tparam Desc The generator descriptor
+ */
+template <typename T, size_t D, typename Desc>
+struct compressed_data_generator {
+    using desc   = Desc; ///< The generator descriptor
+    using weight = T;    ///< The data type
+
+    static constexpr bool dll_generator    = true;               ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the generated batches
+    static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of blocks decompressed ahead
+    static constexpr size_t workers        = desc::Workers;      ///< The number of producer threads
+
+    compressed_dataset_header header;    ///< The header of the dataset
+    std::vector<compressed_block> index; ///< The index of the blocks
+
+    int fd             = -1; ///< The file descriptor
+    size_t sample_size = 0;  ///< The number of values of one sample
+
+    std::vector<size_t> order; ///< The order in which the blocks are served
+
+    mutable std::vector<std::vector<T>> slots; ///< The decompressed block of each slot
+    std::vector<std::vector<char>> buffers;    ///< The compressed block of each worker
+
+    batch_workers_t<desc> pool; ///< The pool of producers
+
+    size_t current  = 0;     ///< The index of the current batch
+    size_t block    = 0;     ///< The position of the current block in the order
+    size_t in_block = 0;     ///< The index of the current batch in its block
+    bool is_safe    = false; ///< Indicates if the generator is safe to reclaim memory from
+
+    /*!
+     * \brief Construct a compressed_data_generator around the given file
+     * \param path The path to the dataset file
+     */
+    explicit compressed_data_generator(const std::string& path) {
+        std::memset(&header, 0, sizeof(header));
+
+        fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            std::cerr << "ERROR: Impossible to open " << path << std::endl;
+            return;
+        }
+
+        if (::pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header))) {
+            std::cerr << "ERROR: Invalid dataset file " << path << std::endl;
+            close();
+            return;
+        }
+
+        if (std::memcmp(header.magic, compressed_dataset_magic, sizeof(header.magic)) != 0 || header.dtype != sizeof(T) || header.dimensions != D) {
+            std::cerr << "ERROR: Incompatible dataset file " << path << std::endl;
+            close();
+            return;
+        }
+
+        if (!codec_available(block_codec(header.codec))) {
+            std::cerr << "ERROR: The codec of " << path << " is not available" << std::endl;
+            close();
+            return;
+        }
+
+        if (header.block_samples % batch_size != 0) {
+            std::cerr << "ERROR: The blocks of " << path << " are not made of complete batches" << std::endl;
+            close();
+            return;
+        }
+
+        index.resize(header.blocks);
+
+        const ssize_t index_size = index.size() * sizeof(compressed_block);
+
+        if (!header.blocks || ::pread(fd, index.data(), index_size, header.index_offset) != index_size) {
+            std::cerr << "ERROR: Truncated dataset file " << path << std::endl;
+            close();
+            return;
+        }
+
+        sample_size = 1;
+        for (size_t d = 0; d < D; ++d) {
+            sample_size *= header.shape[d];
+        }
+
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+
+        order.resize(header.blocks);
+        std::iota(order.begin(), order.end(), 0);
+
+        slots.resize(big_batch_size);
+        buffers.resize(workers);
+
+        // The blocks are read at their offsets, there is nothing to claim in order
+        auto claim = [](size_t w, size_t slot, size_t position) {
+            cpp_unused(w);
+            cpp_unused(slot);
+            cpp_unused(position);
+        };
+
+        auto fill = [this](size_t w, size_t slot, size_t position) {
+            read_block(buffers[w], slots[slot], order[position]);
+        };
+
+        pool.start(workers, header.blocks, claim, fill);
+    }
+
+    compressed_data_generator(const compressed_data_generator& rhs) = delete;
+    compressed_data_generator operator=(const compressed_data_generator& rhs) = delete;
+
+    compressed_data_generator(compressed_data_generator&& rhs) = delete;
+    compressed_data_generator operator=(compressed_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Destructs the generator and close the file
+     */
+    ~compressed_data_generator() {
+        pool.stop();
+        close();
+    }
+
+    /*!
+     * \brief Indicates if the dataset file was correctly opened
+     */
+    bool is_open() const {
+        return fd >= 0;
+    }
+
+    /*!
+     * \brief Returns the ratio between the size of the decompressed blocks
+     * and the size of the compressed blocks
+     */
+    double ratio() const {
+        size_t raw  = 0;
+        size_t size = 0;
+
+        for (auto& b : index) {
+            raw += b.raw;
+            size += b.size;
+        }
+
+        return size ? double(raw) / size : 1.0;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Compressed Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "            Blocks: " << header.blocks << std::endl;
+        stream << "             Ratio: " << ratio() << std::endl;
+        stream << "           Workers: " << workers << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        is_safe = true;
+    }
+
+    /*!
+     * \brier Clear the memory of the generator.
+     *
+     * Only the slots of the blocks decompressed ahead are held in memory,
+     * which are needed by the producers.
+     */
+    void clear() {
+        // Nothing to clear
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Returns the statistics of the pipeline since the beginning of
+     * the generation
+     */
+    generator_stats stats() const {
+        return pool.counters.stats();
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current  = 0;
+        block    = 0;
+        in_block = 0;
+
+        pool.reset();
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of blocks
+     */
+    void reset_shuffle() {
+        current  = 0;
+        block    = 0;
+        in_block = 0;
+
+        // The shuffle is done once no worker is reading the order
+        pool.reset([this] { std::shuffle(order.begin(), order.end(), dll::rand_engine()); });
+    }
+
+    /*!
+     * \brief Shuffle the order of the blocks.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        reset_shuffle();
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        // Nothing can be done here
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return header.samples;
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return block < header.blocks;
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        ++current;
+
+        // Release the block once all its batches have been consumed
+        if (++in_block * batch_size >= block_size(order[block])) {
+            pool.release(block);
+
+            ++block;
+            in_block = 0;
+        }
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        auto& slot = slots[pool.wait(block)];
+
+        return make_view(slot.data() + in_block * batch_size * sample_size, batch_samples(), std::make_index_sequence<D>());
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        auto& slot = slots[pool.wait(block)];
+
+        T* labels = slot.data() + block_size(order[block]) * sample_size;
+
+        return etl::custom_dyn_matrix<T, 2>(labels + in_block * batch_size * header.label_width, batch_samples(), size_t(header.label_width));
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return D;
+    }
+
+private:
+    /*!
+     * \brief Returns the number of samples of the given block
+     */
+    size_t block_size(size_t b) const {
+        return std::min(size_t(header.block_samples), size_t(header.samples) - b * header.block_samples);
+    }
+
+    /*!
+     * \brief Returns the number of samples of the current batch
+     */
+    size_t batch_samples() const {
+        return std::min(batch_size, block_size(order[block]) - in_block * batch_size);
+    }
+
+    /*!
+     * \brief Read and decompress the given block into the given slot
+     * \param buffer The buffer of the compressed block
+     * \param slot The slot of the decompressed block
+     * \param b The index of the block in the file
+     */
+    void read_block(std::vector<char>& buffer, std::vector<T>& slot, size_t b) const {
+        const auto& entry = index[b];
+
+        const size_t values = block_size(b) * (sample_size + header.label_width);
+
+        buffer.resize(entry.size);
+        slot.resize(values);
+
+        if (entry.raw != values * sizeof(T) || ::pread(fd, buffer.data(), entry.size, entry.offset) != ssize_t(entry.size)
+            || !decompress_block(block_codec(header.codec), buffer.data(), entry.size, reinterpret_cast<char*>(slot.data()), entry.raw)) {
+            std::cerr << "ERROR: Impossible to read the block " << b << " of the dataset" << std::endl;
+            std::fill(slot.begin(), slot.end(), T(0));
+        }
+    }
+
+    /*!
+     * \brief Create a view of n samples on a block
+     */
+    template <size_t... I>
+    auto make_view(T* memory, size_t n, std::index_sequence<I...> /*seq*/) const {
+        return etl::custom_dyn_matrix<T, D + 1>(memory, n, size_t(header.shape[I])...);
+    }
+
+    /*!
+     * \brief Close the file
+     */
+    void close() {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+
+        header.samples = 0;
+        header.blocks  = 0;
+    }
+};
+
+template <typename T, size_t D, typename Desc>
+const size_t compressed_data_generator<T, D, Desc>::batch_size;
+
+template <typename T, size_t D, typename Desc>
+const size_t compressed_data_generator<T, D, Desc>::big_batch_size;
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename T, size_t D, typename Desc>
+std::ostream& operator<<(std::ostream& os, compressed_data_generator<T, D, Desc>& generator) {
+    return generator.display(os);
+}
+
+/*!
+ * \brief Descriptor for a compressed_data_generator
+ */
+template <typename... Parameters>
+struct compressed_data_generator_desc {
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    /*!
+     * \brief The size of a batch
+     */
+    static constexpr size_t BatchSize = detail::get_value_v<batch_size<1>, Parameters...>;
+
+    /*!
+     * \brief The number of blocks decompressed ahead
+     */
+    static constexpr size_t BigBatchSize = detail::get_value_v<big_batch_size<2>, Parameters...>;
+
+    /*!
+     * \brief The number of producer threads
+     */
+    static constexpr size_t Workers = detail::get_value_v<workers<1>, Parameters...>;
+
+    /*!
+     * \brief Indicates if the producers use a lock-free ring
+     */
+    static constexpr bool LockFree = parameters::template contains<lock_free>();
+
+    static_assert(BatchSize > 0, "The batch size must be larger than one");
+    static_assert(BigBatchSize > 0, "The big batch size must be larger than one");
+    static_assert(Workers > 0, "The generator needs at least one worker");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<batch_size_id, big_batch_size_id, workers_id, lock_free_id, nop_id>, Parameters...>,
+        "Invalid parameters type for compressed_data_generator_desc");
+
+    /*!
+     * The generator type
+     */
+    template <typename T, size_t D>
+    using generator_t = compressed_data_generator<T, D, compressed_data_generator_desc<Parameters...>>;
+};
+
+/*!
+ * \brief Make a data generator around the given block-compressed dataset file
+ * \tparam T The type of the values of the dataset
+ * \tparam D The number of dimensions of one sample
+ * \param path The path to the dataset file
+ */
+template <typename T, size_t D, typename... Parameters>
+auto make_compressed_generator(const std::string& path, const compressed_data_generator_desc<Parameters...>& /*desc*/) {
+    using generator_t = typename compressed_data_generator_desc<Parameters...>::template generator_t<T, D>;
+    return std::make_unique<generator_t>(path);
+}
+
+} //end of dll namespace
@@ -0,0 +1,508 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief The block-compressed dataset format
+ *
+ * A fixed-size header (compressed_dataset_header) is followed by the
+ * compressed blocks and by the index of the blocks. Each block holds a
+ * fixed number of consecutive samples (except the last one), their values
+ * followed by the values of their labels, as in the memory-mapped format,
+ * and is compressed independently, so that the blocks can be read and
+ * decompressed in parallel and in any order.
+ *
+ * The LZ4 codec is only available when DLL_LZ4 is defined and the zstd
+ * codec when DLL_ZSTD is defined, the program must then be linked with
+ * liblz4 (resp. libzstd).
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef DLL_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef DLL_ZSTD
+#include <zstd.h>
+#endif
+
+#include "cpp_utils/assert.hpp"
+#include "etl/etl_light.hpp"
+
+#include "dll/generators/mmap_dataset.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The codec of the blocks of a compressed dataset
+ */
+enum class block_codec : uint32_t {
+    NONE = 0, ///< The blocks are stored as such
+    LZ4  = 1, ///< The blocks are compressed with LZ4 (fast)
+    ZSTD = 2  ///< The blocks are compressed with zstd (better ratio)
+};
+
+/*!
+ * \brief The magic identifier of a compressed dataset
+ */
+constexpr char compressed_dataset_magic[8] = {'D', 'L', 'L', 'B', 'L', 'K', 'Z', '1'};
+
+/*!
+ * \brief The header of a compressed dataset file
+ */
+struct compressed_dataset_header {
+    char magic[8];          ///< The magic identifier of the format
+    uint32_t version;       ///< The version of the format
+    uint32_t dtype;         ///< The size in bytes of one value
+    uint64_t samples;       ///< The number of samples
+    uint64_t dimensions;    ///< The number of dimensions of one sample
+    uint64_t shape[4];      ///< The shape of one sample
+    uint64_t label_width;   ///< The number of values of each label
+    uint32_t codec;         ///< The codec of the blocks (block_codec)
+    uint32_t reserved;      ///< Unused
+    uint64_t block_samples; ///< The number of samples of each block
+    uint64_t blocks;        ///< The number of blocks
+    uint64_t index_offset;  ///< The offset of the index of the blocks
+};
+
+/*!
+ * \brief The entry of a block in the index of a compressed dataset
+ */
+struct compressed_block {
+    uint64_t offset; ///< The offset of the compressed block
+    uint64_t size;   ///< The size of the compressed block
+    uint64_t raw;    ///< The size of the decompressed block
+};
+
+/*!
+ * \brief Indicates if the given codec is available in this build
+ */
+constexpr bool codec_available(block_codec codec) {
+#ifndef DLL_LZ4
+    if (codec == block_codec::LZ4) {
+        return false;
+    }
+#endif
+
+#ifndef DLL_ZSTD
+    if (codec == block_codec::ZSTD) {
+        return false;
+    }
+#endif
+
+    return codec == block_codec::NONE || codec == block_codec::LZ4 || codec == block_codec::ZSTD;
+}
+
+/*!
+ * \brief Returns the maximum size of a block of n bytes compressed with the
+ * given codec
+ */
+inline size_t compress_bound(block_codec codec, size_t n) {
+    switch (codec) {
+#ifdef DLL_LZ4
+        case block_codec::LZ4:
+            return LZ4_compressBound(int(n));
+#endif
+
+#ifdef DLL_ZSTD
+        case block_codec::ZSTD:
+            return ZSTD_compressBound(n);
+#endif
+
+        default:
+            return n;
+    }
+}
+
+/*!
+ * \brief Compress a block with the given codec
+ * \param codec The codec
+ * \param level The compression level (zstd only, 0 for the default)
+ * \param src The block
+ * \param n The size of the block
+ * \param dst The output, of at least compress_bound(codec, n) bytes
+ * \return The size of the compressed block, 0 on failure
+ */
+inline size_t compress_block(block_codec codec, int level, const char* src, size_t n, char* dst) {
+    cpp_unused(level);
+
+    switch (codec) {
+        case block_codec::NONE:
+            std::memcpy(dst, src, n);
+            return n;
+
+#ifdef DLL_LZ4
+        case block_codec::LZ4:
+            return std::max(0, LZ4_compress_default(src, dst, int(n), int(compress_bound(codec, n))));
+#endif
+
+#ifdef DLL_ZSTD
+        case block_codec::ZSTD: {
+            const size_t size = ZSTD_compress(dst, compress_bound(codec, n), src, n, level ? level : ZSTD_CLEVEL_DEFAULT);
+            return ZSTD_isError(size) ? 0 : size;
+        }
+#endif
+
+        default:
+            return 0;
+    }
+}
+
+/*!
+ * \brief Decompress a block compressed with the given codec
+ * \param codec The codec
+ * \param src The compressed block
+ * \param n The size of the compressed block
+ * \param dst The output
+ * \param raw The size of the decompressed block
+ * \return true if the block was decompressed, false otherwise
+ */
+inline bool decompress_block(block_codec codec, const char* src, size_t n, char* dst, size_t raw) {
+    switch (codec) {
+        case block_codec::NONE:
+            if (n != raw) {
+                return false;
+            }
+
+            std::memcpy(dst, src, n);
+            return true;
+
+#ifdef DLL_LZ4
+        case block_codec::LZ4:
+            return LZ4_decompress_safe(src, dst, int(n), int(raw)) == int(raw);
+#endif
+
+#ifdef DLL_ZSTD
+        case block_codec::ZSTD:
+            return ZSTD_decompress(dst, raw, src, n) == raw;
+#endif
+
+        default:
+            return false;
+    }
+}
+
+/*!
+ * \brief Write a dataset in the block-compressed format, batch by batch.
+ *
+ * The number of samples and their shape must be known before the first
+ * batch is written. The samples are given in order, each block being
+ * compressed and written once complete.
+ *
+ * \tparam T The type of the values of the dataset
+ */
+template <typename T>
+struct compressed_dataset_writer {
+    /*!
+     * \brief Create the dataset file and write its header
+     * \param path The path of the file to write
+     * \param samples The number of samples of the dataset
+     * \param shape The shape of one sample (from 1 to 4 dimensions)
+     * \param label_width The number of values of each label
+     * \param codec The codec of the blocks
+     * \param block_samples The number of samples of each block (a multiple of the batch size of the generators)
+     * \param level The compression level (zstd only, 0 for the default)
+     */
+    compressed_dataset_writer(const std::string& path, size_t samples, const std::vector<size_t>& shape, size_t label_width,
+                              block_codec codec, size_t block_samples, int level = 0)
+            : stream(path, std::ios::binary), level(level) {
+        cpp_assert(!shape.empty() && shape.size() <= 4, "Only samples from 1D to 4D are supported");
+        cpp_assert(block_samples > 0, "The blocks must hold at least one sample");
+
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, compressed_dataset_magic, sizeof(header.magic));
+
+        if (!codec_available(codec)) {
+            std::cerr << "ERROR: The codec of " << path << " is not available" << std::endl;
+            stream.close();
+            stream.setstate(std::ios::failbit);
+            return;
+        }
+
+        if (!stream) {
+            std::cerr << "ERROR: Impossible to open " << path << std::endl;
+            return;
+        }
+
+        sample_size = 1;
+
+        for (size_t d = 0; d < shape.size(); ++d) {
+            header.shape[d] = shape[d];
+            sample_size *= shape[d];
+        }
+
+        header.version       = 1;
+        header.dtype         = sizeof(T);
+        header.samples       = samples;
+        header.dimensions    = shape.size();
+        header.label_width   = label_width;
+        header.codec         = uint32_t(codec);
+        header.block_samples = block_samples;
+        header.blocks        = (samples + block_samples - 1) / block_samples;
+
+        data.reserve(block_samples * sample_size);
+        labels.reserve(block_samples * label_width);
+
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    compressed_dataset_writer(const compressed_dataset_writer& rhs) = delete;
+    compressed_dataset_writer& operator=(const compressed_dataset_writer& rhs) = delete;
+
+    /*!
+     * \brief Write the index and complete the header, if not done yet
+     */
+    ~compressed_dataset_writer() {
+        close();
+    }
+
+    /*!
+     * \brief Write the next n samples and their labels
+     * \param samples The n samples, stored contiguously
+     * \param sample_labels The n labels, stored contiguously
+     * \param n The number of samples
+     */
+    void write(const T* samples, const T* sample_labels, size_t n) {
+        cpp_assert(written + n <= header.samples, "Too many samples written in the dataset");
+
+        while (n && stream) {
+            const size_t m = std::min(n, size_t(header.block_samples) - (data.size() / sample_size));
+
+            data.insert(data.end(), samples, samples + m * sample_size);
+            labels.insert(labels.end(), sample_labels, sample_labels + m * header.label_width);
+
+            samples += m * sample_size;
+            sample_labels += m * header.label_width;
+
+            written += m;
+            n -= m;
+
+            if (data.size() == header.block_samples * sample_size || written == header.samples) {
+                flush();
+            }
+        }
+    }
+
+    /*!
+     * \brief Write the index of the blocks and complete the header.
+     * \return true if all the samples have been written without error
+     */
+    bool close() {
+        if (stream.is_open() && !closed) {
+            closed = true;
+
+            header.index_offset = stream.tellp();
+
+            stream.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(compressed_block));
+
+            stream.seekp(0);
+            stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            stream.flush();
+        }
+
+        return good();
+    }
+
+    /*!
+     * \brief Indicates if all the samples have been written without error
+     */
+    bool good() const {
+        return bool(stream) && written == header.samples && index.size() == header.blocks;
+    }
+
+    /*!
+     * \brief Returns the ratio between the size of the raw blocks and the
+     * size of the compressed blocks written so far
+     */
+    double ratio() const {
+        size_t raw  = 0;
+        size_t size = 0;
+
+        for (auto& block : index) {
+            raw += block.raw;
+            size += block.size;
+        }
+
+        return size ? double(raw) / size : 1.0;
+    }
+
+private:
+    /*!
+     * \brief Compress and write the current block
+     */
+    void flush() {
+        std::vector<char> raw(sizeof(T) * (data.size() + labels.size()));
+
+        std::memcpy(raw.data(), data.data(), data.size() * sizeof(T));
+        std::memcpy(raw.data() + data.size() * sizeof(T), labels.data(), labels.size() * sizeof(T));
+
+        const auto codec = block_codec(header.codec);
+
+        compressed.resize(compress_bound(codec, raw.size()));
+
+        const size_t size = compress_block(codec, level, raw.data(), raw.size(), compressed.data());
+
+        if (!size) {
+            std::cerr << "ERROR: Impossible to compress the block " << index.size() << std::endl;
+            stream.setstate(std::ios::failbit);
+            return;
+        }
+
+        index.push_back({uint64_t(stream.tellp()), size, raw.size()});
+
+        stream.write(compressed.data(), size);
+
+        data.clear();
+        labels.clear();
+    }
+
+    std::ofstream stream;                 ///< The stream of the file
+    compressed_dataset_header header;     ///< The header of the dataset
+    std::vector<compressed_block> index;  ///< The index of the written blocks
+    std::vector<T> data;                  ///< The samples of the current block
+    std::vector<T> labels;                ///< The labels of the current block
+    std::vector<char> compressed;         ///< The buffer of the compressed block
+    const int level;                      ///< The compression level
+    size_t sample_size = 0;               ///< The number of values of one sample
+    size_t written     = 0;               ///< The number of samples written
+    bool closed        = false;           ///< Indicates if the index has been written
+};
+
+/*!
+ * \brief Write a dataset in the block-compressed format.
+ *
+ * When n_classes is not zero and the labels are scalar, the labels are
+ * stored as one-hot (categorical) vectors. Otherwise, the labels are
+ * stored as such.
+ *
+ * \param path The path of the file to write
+ * \param images The container of samples
+ * \param labels The container of labels
+ * \param codec The codec of the blocks
+ * \param block_samples The number of samples of each block (a multiple of the batch size of the generators)
+ * \param n_classes The number of classes (zero to store the labels as such)
+ * \param level The compression level (zstd only, 0 for the default)
+ * \return true if the dataset was written, false otherwise
+ */
+template <typename Container, typename LContainer>
+bool write_compressed_dataset(const std::string& path, const Container& images, const LContainer& labels, block_codec codec, size_t block_samples,
+                              size_t n_classes = 0, int level = 0) {
+    using image_t = typename Container::value_type;
+    using label_t = typename LContainer::value_type;
+    using T       = etl::value_t<image_t>;
+
+    static constexpr size_t D = etl::decay_traits<image_t>::dimensions();
+
+    static_assert(D > 0 && D <= 4, "Only samples from 1D to 4D are supported");
+
+    if (images.empty() || images.size() != labels.size()) {
+        std::cerr << "ERROR: Invalid dataset for " << path << std::endl;
+        return false;
+    }
+
+    auto& first = images.front();
+
+    std::vector<size_t> shape(D);
+
+    for (size_t d = 0; d < D; ++d) {
+        shape[d] = etl::dim(first, d);
+    }
+
+    size_t label_width = n_classes ? n_classes : 1;
+
+    if constexpr (etl::is_etl_expr<label_t>) {
+        label_width = etl::size(labels.front());
+    }
+
+    compressed_dataset_writer<T> writer(path, images.size(), shape, label_width, codec, block_samples, level);
+
+    const size_t sample_size = etl::size(first);
+
+    std::vector<T> label(label_width);
+
+    auto lit = labels.begin();
+
+    for (auto& image : images) {
+        cpp_assert(etl::size(image) == sample_size, "All the samples must have the same size");
+
+        image.ensure_cpu_up_to_date();
+
+        mmap_detail::fill_label(*lit++, n_classes, label);
+
+        writer.write(image.memory_start(), label.data(), 1);
+    }
+
+    return writer.close();
+}
+
+/*!
+ * \brief Convert a dataset in the memory-mapped format into the
+ * block-compressed format
+ *
+ * \param input The path of the memory-mapped dataset
+ * \param output The path of the compressed dataset to write
+ * \param codec The codec of the blocks
+ * \param block_samples The number of samples of each block (a multiple of the batch size of the generators)
+ * \param level The compression level (zstd only, 0 for the default)
+ * \return true if the dataset was converted, false otherwise
+ */
+template <typename T>
+bool compress_mmap_dataset(const std::string& input, const std::string& output, block_codec codec, size_t block_samples, int level = 0) {
+    std::ifstream stream(input, std::ios::binary);
+
+    mmap_dataset_header header;
+
+    if (!stream || !stream.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || std::memcmp(header.magic, mmap_dataset_magic, sizeof(header.magic)) != 0 || header.dtype != sizeof(T)) {
+        std::cerr << "ERROR: Incompatible dataset file " << input << std::endl;
+        return false;
+    }
+
+    std::vector<size_t> shape(header.shape, header.shape + header.dimensions);
+
+    size_t sample_size = 1;
+
+    for (size_t d : shape) {
+        sample_size *= d;
+    }
+
+    compressed_dataset_writer<T> writer(output, header.samples, shape, header.label_width, codec, block_samples, level);
+
+    std::vector<T> data(block_samples * sample_size);
+    std::vector<T> labels(block_samples * header.label_width);
+
+    for (size_t first = 0; first < header.samples && stream; first += block_samples) {
+        const size_t n = std::min(block_samples, size_t(header.samples) - first);
+
+        stream.seekg(header.data_offset + first * sample_size * sizeof(T));
+        stream.read(reinterpret_cast<char*>(data.data()), n * sample_size * sizeof(T));
+
+        stream.seekg(header.label_offset + first * header.label_width * sizeof(T));
+        stream.read(reinterpret_cast<char*>(labels.data()), n * header.label_width * sizeof(T));
+
+        if (stream) {
+            writer.write(data.data(), labels.data(), n);
+        }
+    }
+
+    if (!stream) {
+        std::cerr << "ERROR: Truncated dataset file " << input << std::endl;
+    }
+
+    return writer.close() && bool(stream);
+}
+
+} // end of namespace dll
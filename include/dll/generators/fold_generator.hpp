@@ -0,0 +1,297 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Generator of a subset of the samples of an in-memory generator
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief A generator of a subset of the samples of an in-memory generator,
+ * given by their indices.
+ *
+ * The caches of the source generator are only read, several fold
+ * generators can therefore read the same source concurrently (the folds of
+ * a cross-validation for instance), as long as nothing modifies or
+ * shuffles the source meanwhile. Only the order of the indices of the fold
+ * is shuffled and the batches are gathered into the buffers of the fold.
+ *
+ * \tparam Generator The type of the source in-memory generator
+ */
+template <typename Generator>
+struct fold_generator {
+    using generator_t = Generator;                      ///< The type of the source generator
+    using desc        = typename generator_t::desc;   ///< The generator descriptor
+    using weight      = typename generator_t::weight; ///< The data type
+
+    using data_cache_type  = typename generator_t::data_cache_type;  ///< The type of the data batches
+    using label_cache_type = typename generator_t::label_cache_type; ///< The type of the label batches
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static constexpr size_t batch_size = generator_t::batch_size; ///< The size of the generated batches
+
+    static_assert(!is_augmented<desc>, "The folds are only generated from in-memory generators without augmentation");
+
+    const generator_t& source;   ///< The source generator
+    std::vector<size_t> indices; ///< The indices of the samples of the fold, in their current order
+
+    mutable data_cache_type data_buffer;   ///< The gathered data batch
+    mutable label_cache_type label_buffer; ///< The gathered label batch
+    mutable size_t gathered = size_t(-1);  ///< The index of the gathered batch
+
+    size_t current = 0; ///< The current index
+
+    /*!
+     * \brief Create a generator of the given samples of the source
+     * \param source The source generator, which must outlive the fold
+     * \param indices The indices of the samples of the fold in the source
+     */
+    fold_generator(const generator_t& source, std::vector<size_t> indices) : source(source), indices(std::move(indices)) {
+        data_buffer  = batch_like<data_cache_type>(source.input_cache, std::make_index_sequence<etl::dimensions<data_cache_type>() - 1>());
+        label_buffer = batch_like<label_cache_type>(source.label_cache, std::make_index_sequence<etl::dimensions<label_cache_type>() - 1>());
+    }
+
+    fold_generator(const fold_generator& rhs) = delete;
+    fold_generator operator=(const fold_generator& rhs) = delete;
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Fold Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        // The caches belong to the source
+    }
+
+    /*!
+     * \brief Clear the memory of the generator.
+     *
+     * The caches of the source are shared and are never cleared.
+     */
+    void clear() {
+        // The caches belong to the source
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current = 0;
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        current = 0;
+        shuffle();
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples of the fold.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        std::shuffle(indices.begin(), indices.end(), dll::rand_engine());
+
+        gathered = size_t(-1);
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        // The batches are gathered on the CPU
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current / batch_size;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return indices.size();
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return indices.size();
+    }
+
+    /*!
+     * \brief Add the memory held by the fold to the given report
+     * \param report The report
+     * \param name The name of the generator in the report
+     */
+    void report_memory(memory_report& report, const std::string& name) const {
+        report.add(name + " buffers", memory_bytes(std::tie(data_buffer, label_buffer, indices)));
+    }
+
+    /*!
+     * \brief Store the order of the samples of the fold into the given stream
+     * \param os The output stream
+     */
+    void store_state(std::ostream& os) const {
+        cpp::binary_write_all(os, indices);
+    }
+
+    /*!
+     * \brief Load the order of the samples of the fold from the given stream
+     * and reset the generator to the beginning
+     * \param is The input stream
+     */
+    void load_state(std::istream& is) {
+        cpp::binary_load_all(is, indices);
+
+        current  = 0;
+        gathered = size_t(-1);
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < size();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        current += batch_size;
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        gather();
+
+        return etl::slice(data_buffer, 0, std::min(batch_size, size() - current));
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        gather();
+
+        return etl::slice(label_buffer, 0, std::min(batch_size, size() - current));
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return generator_t::dimensions();
+    }
+
+private:
+    /*!
+     * \brief Returns a buffer of one batch of the samples of the given cache
+     */
+    template <typename Buffer, typename Cache, size_t... I>
+    static Buffer batch_like(const Cache& cache, std::index_sequence<I...>) {
+        return Buffer(batch_size, etl::dim(cache, I + 1)...);
+    }
+
+    /*!
+     * \brief Gather the samples of the current batch into the batch buffers
+     */
+    void gather() const {
+        if (gathered == current) {
+            return;
+        }
+
+        const size_t n = std::min(batch_size, size() - current);
+
+        for (size_t i = 0; i < n; ++i) {
+            const size_t sample = indices[current + i];
+
+            if constexpr (desc::CompactStorage) {
+                pre_transformer<desc>::widen(data_buffer(i), source.input_cache(sample));
+            } else {
+                data_buffer(i) = source.input_cache(sample);
+            }
+
+            label_buffer(i) = source.label_cache(sample);
+        }
+
+        gathered = current;
+    }
+};
+
+} //end of dll namespace
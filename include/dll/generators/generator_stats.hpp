@@ -0,0 +1,177 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Instrumentation of the pipeline of the threaded generators
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <type_traits>
+
+namespace dll {
+
+/*!
+ * \brief Statistics of the pipeline of a generator, since the beginning of
+ * the current generation.
+ *
+ * All the times are in microseconds. The stage times are summed over all
+ * the producers, the wait times are the times spent blocked, waiting for
+ * the other side of the pipeline.
+ */
+struct generator_stats {
+    size_t batches       = 0; ///< The number of batches produced
+    size_t consumer_wait = 0; ///< The time the consumer waited for batches to be ready
+    size_t producer_wait = 0; ///< The time the producers waited for free slots
+    size_t crop_mirror   = 0; ///< The time spent in the fused crop, mirror and value by value pre-transforms
+    size_t pre_transform = 0; ///< The time spent in the other passes of the pre-transforms
+    size_t distortion    = 0; ///< The time spent in the elastic distortion
+    size_t noise         = 0; ///< The time spent in the noise
+
+    /*!
+     * \brief Display the statistics on a single line
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        auto ms = [](size_t us) { return double(us) / 1000.0; };
+
+        stream << "generator: batches " << batches
+               << " consumer_wait " << ms(consumer_wait) << "ms"
+               << " producer_wait " << ms(producer_wait) << "ms"
+               << " crop/mirror " << ms(crop_mirror) << "ms"
+               << " pre " << ms(pre_transform) << "ms"
+               << " distortion " << ms(distortion) << "ms"
+               << " noise " << ms(noise) << "ms";
+
+        return stream;
+    }
+};
+
+/*!
+ * \brief The time spent by a producer in each augmentation stage, while
+ * filling one batch (in nanoseconds)
+ */
+struct stage_times {
+    size_t crop_mirror   = 0; ///< The time spent in the fused crop, mirror and value by value pre-transforms
+    size_t pre_transform = 0; ///< The time spent in the other passes of the pre-transforms
+    size_t distortion    = 0; ///< The time spent in the elastic distortion
+    size_t noise         = 0; ///< The time spent in the noise
+};
+
+/*!
+ * \brief Add the time spent in its scope to the given counter
+ */
+struct stage_timer {
+    size_t& counter;                                                ///< The counter to update
+    std::chrono::time_point<std::chrono::steady_clock> start_time; ///< The start time
+
+    /*!
+     * \brief Start the timer
+     * \param counter The counter to update (in nanoseconds)
+     */
+    explicit stage_timer(size_t& counter) : counter(counter), start_time(std::chrono::steady_clock::now()) {}
+
+    stage_timer(const stage_timer& rhs) = delete;
+    stage_timer& operator=(const stage_timer& rhs) = delete;
+
+    /*!
+     * \brief Stop the timer and update the counter
+     */
+    ~stage_timer() {
+        counter += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count();
+    }
+};
+
+/*!
+ * \brief The counters of the pipeline of a threaded generator, updated
+ * concurrently by the producers and the consumer.
+ *
+ * The times are kept in nanoseconds.
+ */
+struct generator_counters {
+    std::atomic<size_t> batches{0};       ///< The number of batches produced
+    std::atomic<size_t> consumer_wait{0}; ///< The time the consumer waited
+    std::atomic<size_t> producer_wait{0}; ///< The time the producers waited
+    std::atomic<size_t> crop_mirror{0};   ///< The time in the fused first stage
+    std::atomic<size_t> pre_transform{0}; ///< The time in the other passes of pre-transforms
+    std::atomic<size_t> distortion{0};    ///< The time in the elastic distortion
+    std::atomic<size_t> noise{0};         ///< The time in the noise
+
+    /*!
+     * \brief Reset all the counters
+     */
+    void reset() {
+        for (auto* counter : {&batches, &consumer_wait, &producer_wait, &crop_mirror, &pre_transform, &distortion, &noise}) {
+            counter->store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /*!
+     * \brief Add the stage times of one batch
+     * \param times The stage times of the batch
+     */
+    void add(const stage_times& times) {
+        crop_mirror.fetch_add(times.crop_mirror, std::memory_order_relaxed);
+        pre_transform.fetch_add(times.pre_transform, std::memory_order_relaxed);
+        distortion.fetch_add(times.distortion, std::memory_order_relaxed);
+        noise.fetch_add(times.noise, std::memory_order_relaxed);
+    }
+
+    /*!
+     * \brief Wait for the given predicate, adding the time spent waiting to
+     * the given counter
+     * \param counter The counter to update
+     * \param wait The functor doing the wait
+     */
+    template <typename Wait>
+    static void timed(std::atomic<size_t>& counter, Wait wait) {
+        auto start = std::chrono::steady_clock::now();
+
+        wait();
+
+        counter.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+    }
+
+    /*!
+     * \brief Returns a snapshot of the counters
+     */
+    generator_stats stats() const {
+        auto us = [](const std::atomic<size_t>& counter) { return counter.load(std::memory_order_relaxed) / 1000; };
+
+        generator_stats stats;
+
+        stats.batches       = batches.load(std::memory_order_relaxed);
+        stats.consumer_wait = us(consumer_wait);
+        stats.producer_wait = us(producer_wait);
+        stats.crop_mirror   = us(crop_mirror);
+        stats.pre_transform = us(pre_transform);
+        stats.distortion    = us(distortion);
+        stats.noise         = us(noise);
+
+        return stats;
+    }
+};
+
+/*!
+ * \brief Traits to test if a generator exposes the statistics of its
+ * pipeline
+ */
+template <typename G, typename Enable = void>
+struct has_generator_stats : std::false_type {};
+
+/*!
+ * \copydoc has_generator_stats
+ */
+template <typename G>
+struct has_generator_stats<G, std::void_t<decltype(std::declval<const G&>().stats())>> : std::true_type {};
+
+} //end of dll namespace
@@ -13,6 +13,7 @@
 #pragma once
 
 #include <atomic>
+#include <numeric>
 #include <thread>
 
 namespace dll {
@@ -36,13 +37,25 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     using data_cache_type  = typename data_cache_helper_t::cache_type;  ///< The type of the data cache
     using label_cache_type = typename label_cache_helper_t::cache_type; ///< The type of the label cache
 
+    using storage_t        = std::conditional_t<desc::CompactStorage, typename desc::storage, weight>; ///< The type of the stored samples
+    using input_cache_type = typename data_cache_helper_t::template storage_cache_type<storage_t>;   ///< The type of the input cache
+
     static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
 
     static constexpr size_t batch_size = desc::BatchSize; ///< The size of the generated batches
 
-    data_cache_type input_cache;  ///< The input cache
+    static constexpr bool gathering = desc::IndexShuffle || desc::CompactStorage; ///< Indicates if the batches are gathered
+
+    static_assert(desc::Copy == 1, "The copies of the samples (dll::copy) are only generated with data augmentation");
+
+    input_cache_type input_cache; ///< The input cache
     label_cache_type label_cache; ///< The label cache
 
+    std::vector<size_t> indices;            ///< The order of the samples (index shuffling only)
+    mutable data_cache_type data_buffer;    ///< The gathered data batch (index shuffling or compact storage only)
+    mutable label_cache_type label_buffer;  ///< The gathered label batch (index shuffling only)
+    mutable size_t gathered = size_t(-1);   ///< The index of the gathered batch (index shuffling or compact storage only)
+
     size_t current = 0;     ///< The current index
     bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
 
@@ -51,6 +64,20 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
         // Initialize both caches for enough elements
         data_cache_helper_t::init(n, &input, input_cache);
         label_cache_helper_t::init(n, n_classes, &label, label_cache);
+
+        if constexpr (gathering) {
+            data_cache_helper_t::init(batch_size, &input, data_buffer);
+        }
+
+        if constexpr (desc::IndexShuffle) {
+            init_indices(n);
+
+            label_cache_helper_t::init(batch_size, n_classes, &label, label_buffer);
+        }
+
+        if constexpr (desc::HugePages) {
+            advise_huge_pages(std::tie(input_cache, label_cache));
+        }
     }
 
     /*!
@@ -62,6 +89,20 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
         data_cache_helper_t::init(n, first, input_cache);
         label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
 
+        if constexpr (gathering) {
+            data_cache_helper_t::init(batch_size, first, data_buffer);
+        }
+
+        if constexpr (desc::IndexShuffle) {
+            init_indices(n);
+
+            label_cache_helper_t::init(batch_size, n_classes, lfirst, label_buffer);
+        }
+
+        if constexpr (desc::HugePages) {
+            advise_huge_pages(std::tie(input_cache, label_cache));
+        }
+
         // Fill the cache
 
         size_t i = 0;
@@ -77,16 +118,7 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
 
         // Transform if necessary
 
-        pre_scaler<desc>::transform_all(input_cache);
-        pre_normalizer<desc>::transform_all(input_cache);
-        pre_binarizer<desc>::transform_all(input_cache);
-
-        // In case of auto-encoders, the label images also need to be transformed
-        if constexpr (desc::AutoEncoder) {
-            pre_scaler<desc>::transform_all(label_cache);
-            pre_normalizer<desc>::transform_all(label_cache);
-            pre_binarizer<desc>::transform_all(label_cache);
-        }
+        finalize_prepared_data();
 
         cpp_unused(llast);
     }
@@ -178,7 +210,14 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     void shuffle() {
         cpp_assert(!current, "Shuffle should only be performed on start of generation");
 
-        etl::parallel_shuffle(input_cache, label_cache, dll::random_engine());
+        if constexpr (desc::IndexShuffle) {
+            // Only the order is shuffled, the caches are never modified
+            std::shuffle(indices.begin(), indices.end(), dll::rand_engine());
+        } else {
+            etl::parallel_shuffle(input_cache, label_cache, dll::random_engine());
+        }
+
+        gathered = size_t(-1);
     }
 
     /*!
@@ -217,6 +256,54 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
         return etl::dim<0>(input_cache);
     }
 
+    /*!
+     * \brief Add the memory held by the caches of the generator to the given report
+     * \param report The report
+     * \param name The name of the generator in the report
+     */
+    void report_memory(memory_report& report, const std::string& name) const {
+        report.add(name + " input_cache", memory_bytes(input_cache));
+        report.add(name + " label_cache", memory_bytes(label_cache));
+        report.add(name + " buffers", memory_bytes(std::tie(data_buffer, label_buffer, indices)));
+    }
+
+    /*!
+     * \brief Store the order of the samples into the given stream: the
+     * shuffled indices, or the shuffled caches
+     * \param os The output stream
+     */
+    void store_state(std::ostream& os) const {
+        if constexpr (desc::IndexShuffle) {
+            cpp::binary_write_all(os, indices);
+        } else {
+            input_cache.ensure_cpu_up_to_date();
+            label_cache.ensure_cpu_up_to_date();
+
+            cpp::binary_write_all(os, input_cache);
+            cpp::binary_write_all(os, label_cache);
+        }
+    }
+
+    /*!
+     * \brief Load the order of the samples from the given stream and reset
+     * the generator to the beginning
+     * \param is The input stream
+     */
+    void load_state(std::istream& is) {
+        if constexpr (desc::IndexShuffle) {
+            cpp::binary_load_all(is, indices);
+        } else {
+            cpp::binary_load_all(is, input_cache);
+            cpp::binary_load_all(is, label_cache);
+
+            input_cache.invalidate_gpu();
+            label_cache.invalidate_gpu();
+        }
+
+        current  = 0;
+        gathered = size_t(-1);
+    }
+
     /*!
      * \brief Returns the number of batches in the generator.
      * \return The number of batches in the generator
@@ -247,7 +334,13 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      * \return a a batch of data.
      */
     auto data_batch() const {
-        return etl::slice(input_cache, current, std::min(current + batch_size, size()));
+        if constexpr (gathering) {
+            gather();
+
+            return etl::slice(data_buffer, 0, std::min(batch_size, size() - current));
+        } else {
+            return etl::slice(input_cache, current, std::min(current + batch_size, size()));
+        }
     }
 
     /*!
@@ -255,7 +348,13 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      * \return a a batch of label.
      */
     auto label_batch() const {
-        return etl::slice(label_cache, current, std::min(current + batch_size, size()));
+        if constexpr (desc::IndexShuffle) {
+            gather();
+
+            return etl::slice(label_buffer, 0, std::min(batch_size, size() - current));
+        } else {
+            return etl::slice(label_cache, current, std::min(current + batch_size, size()));
+        }
     }
 
     /*!
@@ -282,15 +381,14 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      * \brief Finalize the dataset if it was filled directly after having being prepared.
      */
     void finalize_prepared_data() {
-        pre_scaler<desc>::transform_all(input_cache);
-        pre_normalizer<desc>::transform_all(input_cache);
-        pre_binarizer<desc>::transform_all(input_cache);
-
-        // In case of auto-encoders, the label images also need to be transformed
-        if constexpr (desc::AutoEncoder) {
-            pre_scaler<desc>::transform_all(label_cache);
-            pre_normalizer<desc>::transform_all(label_cache);
-            pre_binarizer<desc>::transform_all(label_cache);
+        if constexpr (desc::CompactStorage) {
+            // The inputs are transformed when the batches are gathered
+            if constexpr (desc::AutoEncoder) {
+                pre_transformer<desc>::transform_all(label_cache);
+            }
+        } else {
+            // In case of auto-encoders, the label images also need to be transformed
+            pre_transformer<desc>::transform_all(input_cache, label_cache);
         }
     }
 
@@ -301,6 +399,43 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     static constexpr size_t dimensions() {
         return etl::dimensions<data_cache_type>() - 1;
     }
+
+private:
+    /*!
+     * \brief Initialize the order of the samples
+     * \param n The number of samples
+     */
+    void init_indices(size_t n) {
+        indices.resize(n);
+        std::iota(indices.begin(), indices.end(), 0);
+    }
+
+    /*!
+     * \brief Gather the samples of the current batch into the batch buffers
+     */
+    void gather() const {
+        if (gathered == current) {
+            return;
+        }
+
+        const size_t n = std::min(batch_size, size() - current);
+
+        for (size_t i = 0; i < n; ++i) {
+            const size_t sample = desc::IndexShuffle ? indices[current + i] : current + i;
+
+            if constexpr (desc::CompactStorage) {
+                pre_transformer<desc>::widen(data_buffer(i), input_cache(sample));
+            } else {
+                data_buffer(i) = input_cache(sample);
+            }
+
+            if constexpr (desc::IndexShuffle) {
+                label_buffer(i) = label_cache(sample);
+            }
+        }
+
+        gathered = current;
+    }
 };
 
 /*!
@@ -313,52 +448,68 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
     using data_cache_helper_t  = cache_helper<desc, Iterator>;                ///< The helper for the data cache
     using label_cache_helper_t = label_cache_helper<desc, weight, LIterator>; ///< The helper for the label cache
 
-    using data_cache_type  = typename data_cache_helper_t::cache_type;     ///< The type of the data cache
-    using big_cache_type   = typename data_cache_helper_t::big_cache_type; ///< The type of big data cache
-    using label_cache_type = typename label_cache_helper_t::cache_type;    ///< The type of the label cache
+    using data_cache_type      = typename data_cache_helper_t::cache_type;      ///< The type of the data cache
+    using big_cache_type       = typename data_cache_helper_t::big_cache_type;  ///< The type of big data cache
+    using label_cache_type     = typename label_cache_helper_t::cache_type;     ///< The type of the label cache
+    using big_label_cache_type = typename label_cache_helper_t::big_cache_type; ///< The type of the big label cache
 
     static constexpr bool dll_generator    = true;               ///< Simple flag to indicate that the class is a DLL generator
 
     static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the generated batches
     static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of batches kept in cache
 
-    data_cache_type input_cache;  ///< The data cache
+    using storage_t        = std::conditional_t<desc::CompactStorage, typename desc::storage, weight>; ///< The type of the stored samples
+    using input_cache_type = typename data_cache_helper_t::template storage_cache_type<storage_t>;   ///< The type of the input cache
+
+    static constexpr size_t workers = desc::Workers; ///< The number of producer threads
+    static constexpr size_t copies  = desc::Copy;    ///< The number of augmented copies of each sample
+
+    static constexpr bool indexed = desc::IndexShuffle || copies > 1; ///< Indicates if the samples are generated through an order of indices
+
+    input_cache_type input_cache; ///< The data cache
     big_cache_type batch_cache;   ///< The data batch cache
     label_cache_type label_cache; ///< The label cache
 
-    random_cropper<Desc> cropper;      ///< The random cropper
-    random_mirrorer<Desc> mirrorer;    ///< The random mirrorer
-    elastic_distorter<Desc> distorter; ///< The elastic distorter
-    random_noise<Desc> noiser;         ///< The random noiser
+    big_label_cache_type label_batch_cache; ///< The label batch cache (indexed only)
+    std::vector<size_t> indices;            ///< The order of the virtual samples, copies included (indexed only)
 
+    std::vector<augmenter_set<Desc>> augmenters; ///< The augmenters of each producer
 
     size_t current = 0;     ///< The current index
     bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
 
-    mutable volatile bool status[big_batch_size];    ///< Status of each batch
-    mutable volatile size_t indices[big_batch_size]; ///< Indices of each batch
-
-    mutable std::mutex main_lock;                    ///< The main lock
-    mutable std::condition_variable condition;       ///< The condition variable for the thread to wait for some space
-    mutable std::condition_variable ready_condition; ///< The condition variable for a reader to wait for ready data
-
-    volatile bool stop_flag = false; ///< Boolean flag indicating to the thread to stop
-
-    std::thread main_thread; ///< The main thread
-    bool train_mode = false; ///< The train mode status
+    batch_workers_t<desc> pool; ///< The pool of producers
+    bool train_mode = false;    ///< The train mode status
 
     /*!
      * \brief Construct an inmemory data generator
      */
-    inmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes)
-            : cropper(*first), mirrorer(*first), distorter(*first), noiser(*first) {
+    inmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes) {
         const size_t n = std::distance(first, last);
 
+        augmenters.reserve(workers);
+
+        for (size_t w = 0; w < workers; ++w) {
+            augmenters.emplace_back(*first);
+        }
+
         data_cache_helper_t::init(n, first, input_cache);
         data_cache_helper_t::init_big(first, batch_cache);
 
         label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
 
+        if constexpr (indexed) {
+            label_cache_helper_t::init_big(n_classes, lfirst, label_batch_cache);
+
+            // The copies are virtual, each sample is only stored once
+            indices.resize(n * copies);
+            std::iota(indices.begin(), indices.end(), 0);
+        }
+
+        if constexpr (desc::HugePages) {
+            advise_huge_pages(std::tie(input_cache, batch_cache, label_cache));
+        }
+
         // Fill the cache
 
         size_t i = 0;
@@ -374,105 +525,69 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
 
         // Transform if necessary
 
-        pre_scaler<desc>::transform_all(input_cache);
-        pre_normalizer<desc>::transform_all(input_cache);
-        pre_binarizer<desc>::transform_all(input_cache);
-
-        // In case of auto-encoders, the label images also need to be transformed
-        if constexpr (desc::AutoEncoder) {
-            pre_scaler<desc>::transform_all(label_cache);
-            pre_normalizer<desc>::transform_all(label_cache);
-            pre_binarizer<desc>::transform_all(label_cache);
-        }
-
-        for (size_t b = 0; b < big_batch_size; ++b) {
-            status[b]  = false;
-            indices[b] = b;
+        if constexpr (desc::CompactStorage) {
+            // The inputs are transformed when the batches are filled
+            if constexpr (desc::AutoEncoder) {
+                pre_transformer<desc>::transform_all(label_cache);
+            }
+        } else {
+            // In case of auto-encoders, the label images also need to be transformed
+            pre_transformer<desc>::transform_all(input_cache, label_cache);
         }
 
         cpp_unused(llast);
 
-        main_thread = std::thread([this] {
-            while (true) {
-                // The index of the batch inside the batch cache
-                size_t index = 0;
-
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
+        // The data is already in memory, nothing needs to be claimed
+        auto claim = [](size_t w, size_t index, size_t batch) {
+            cpp_unused(w);
+            cpp_unused(index);
+            cpp_unused(batch);
+        };
 
-                    bool found = false;
-
-                    // Try to find a read batch first
-                    for (size_t b = 0; b < big_batch_size; ++b) {
-                        if (!status[b] && indices[b] * batch_size < size()) {
-                            index = b;
-                            found = true;
-                            break;
-                        }
-                    }
+        auto fill = [this](size_t w, size_t index, size_t batch) {
+            auto& augmenter = augmenters[w];
 
-                    // if not found, wait for a ready to compute batch
+            augmenter.begin_batch();
 
-                    if (!found) {
-                        // Wait for the end or for some work
-                        condition.wait(ulock, [this, &index] {
-                            if (stop_flag) {
-                                return true;
-                            }
+            stage_times times;
 
-                            for (size_t b = 0; b < big_batch_size; ++b) {
-                                if (!status[b] && indices[b] * batch_size < size()) {
-                                    index = b;
-                                    return true;
-                                }
-                            }
+            // Get the index from where to read inside the input cache
+            const size_t input_n = batch * batch_size;
 
-                            return false;
-                        });
+            SERIAL_SECTION {
+                for (size_t i = 0; i < batch_size && input_n + i < size(); ++i) {
+                    const size_t sample = sample_index(input_n + i);
 
-                        // If there is no more thread for the thread, exit
-                        if (stop_flag) {
-                            return;
-                        }
+                    if constexpr (indexed) {
+                        label_batch_cache(index)(i) = label_cache(sample);
                     }
-                }
 
-                // Get the batch that needs to be read
-                const size_t batch = indices[index];
-
-                // Get the index from where to read inside the input cache
-                const size_t input_n = batch * batch_size;
-
-                for (size_t i = 0; i < batch_size && input_n + i < size(); ++i) {
                     if (train_mode) {
-                        // Random crop the image
-                        cropper.transform_first(batch_cache(index)(i), input_cache(input_n + i));
-
-                        // Mirror the image
-                        mirrorer.transform(batch_cache(index)(i));
+                        // Random crop and mirror the image
+                        first_transform(augmenter, false, batch_cache(index)(i), input_cache(sample), times);
 
                         // Distort the image
-                        distorter.transform(batch_cache(index)(i));
-
-                        // Noise the image
-                        noiser.transform(batch_cache(index)(i));
+                        {
+                            stage_timer timer(times.distortion);
+                            augmenter.distorter.transform(batch_cache(index)(i));
+                        }
                     } else {
                         // Center crop the image
-                        cropper.transform_first_test(batch_cache(index)(i), input_cache(input_n + i));
+                        first_transform(augmenter, true, batch_cache(index)(i), input_cache(sample), times);
                     }
                 }
 
-                // Notify a waiter that one batch is ready
-
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
-
-                    status[index] = true;
-
-                    ready_condition.notify_one();
+                // Noise the whole batch in place, the labels stay clean
+                if (train_mode) {
+                    stage_timer timer(times.noise);
+                    augmenter.noiser.transform_batch(batch_cache(index), std::min(batch_size, size() - input_n));
                 }
             }
-        });
+
+            pool.counters.add(times);
+        };
+
+        pool.start(workers, batches(), claim, fill);
     }
 
     inmemory_data_generator(const inmemory_data_generator& rhs) = delete;
@@ -490,6 +605,11 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
         stream << "In-Memory Data Generator" << std::endl;
         stream << "              Size: " << size() << std::endl;
         stream << "           Batches: " << batches() << std::endl;
+        stream << "           Workers: " << workers << std::endl;
+
+        if (copies > 1) {
+            stream << "            Copies: " << copies << std::endl;
+        }
 
         if (augmented_size() != size()) {
             stream << "    Augmented Size: " << augmented_size() << std::endl;
@@ -523,6 +643,7 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
             input_cache.clear();
             batch_cache.clear();
             label_cache.clear();
+            label_batch_cache.clear();
         }
     }
 
@@ -544,25 +665,22 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \brief Destructs the inmemory_data_generator
      */
     ~inmemory_data_generator() {
-        cpp::with_lock(main_lock, [this] { stop_flag = true; });
-
-        condition.notify_all();
+        pool.stop();
+    }
 
-        main_thread.join();
+    /*!
+     * \brief Returns the statistics of the pipeline since the beginning of
+     * the generation
+     */
+    generator_stats stats() const {
+        return pool.counters.stats();
     }
 
     /*!
      * \brief Reset the generation to its beginning
      */
     void reset_generation() {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
-        for (size_t b = 0; b < big_batch_size; ++b) {
-            status[b]  = false;
-            indices[b] = b;
-        }
-
-        condition.notify_one();
+        pool.reset();
     }
 
     /*!
@@ -578,8 +696,9 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      */
     void reset_shuffle() {
         current = 0;
-        shuffle();
-        reset_generation();
+
+        // The shuffle is done once no worker is reading the input cache
+        pool.reset([this] { shuffle_samples(); });
     }
 
     /*!
@@ -590,7 +709,7 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
     void shuffle() {
         cpp_assert(!current, "Shuffle should only be performed on start of generation");
 
-        etl::parallel_shuffle(input_cache, label_cache, dll::random_engine());
+        pool.reset([this] { shuffle_samples(); });
     }
 
     /*!
@@ -609,10 +728,19 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
     }
 
     /*!
-     * \brief Returns the number of elements in the generator
+     * \brief Returns the number of elements in the generator, the copies of
+     * the samples included
      * \return The number of elements in the generator
      */
     size_t size() const {
+        return copies * stored_size();
+    }
+
+    /*!
+     * \brief Returns the number of samples stored in the generator
+     * \return The number of samples stored in the generator
+     */
+    size_t stored_size() const {
         return etl::dim<0>(input_cache);
     }
 
@@ -625,7 +753,52 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \return The augmented number of elements in the generator
      */
     size_t augmented_size() const {
-        return cropper.scaling() * mirrorer.scaling() * noiser.scaling() * distorter.scaling() * etl::dim<0>(input_cache);
+        return augmenters.front().scaling() * size();
+    }
+
+    /*!
+     * \brief Add the memory held by the caches of the generator to the given report
+     * \param report The report
+     * \param name The name of the generator in the report
+     */
+    void report_memory(memory_report& report, const std::string& name) const {
+        report.add(name + " input_cache", memory_bytes(input_cache));
+        report.add(name + " batch_cache", memory_bytes(batch_cache));
+        report.add(name + " label_cache", memory_bytes(label_cache));
+        report.add(name + " buffers", memory_bytes(std::tie(label_batch_cache, indices)));
+    }
+
+    /*!
+     * \brief Store the order of the samples into the given stream: the
+     * shuffled indices, or the shuffled caches
+     * \param os The output stream
+     */
+    void store_state(std::ostream& os) const {
+        if constexpr (indexed) {
+            cpp::binary_write_all(os, indices);
+        } else {
+            cpp::binary_write_all(os, input_cache);
+            cpp::binary_write_all(os, label_cache);
+        }
+    }
+
+    /*!
+     * \brief Load the order of the samples from the given stream and reset
+     * the generator to the beginning
+     * \param is The input stream
+     */
+    void load_state(std::istream& is) {
+        current = 0;
+
+        // The caches are loaded once no worker is reading them
+        pool.reset([this, &is] {
+            if constexpr (indexed) {
+                cpp::binary_load_all(is, indices);
+            } else {
+                cpp::binary_load_all(is, input_cache);
+                cpp::binary_load_all(is, label_cache);
+            }
+        });
     }
 
     /*!
@@ -650,18 +823,8 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * This should only be called if the generator has a next batch.
      */
     void next_batch() {
-        // Get information from batch that has been consumed
-        const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
-
-        {
-            std::unique_lock<std::mutex> ulock(main_lock);
-
-            status[b] = false;
-            indices[b] += big_batch_size;
-
-            condition.notify_one();
-        }
+        // Release the batch that has been consumed
+        pool.release(current / batch_size);
 
         current += batch_size;
     }
@@ -671,48 +834,83 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \return a a batch of data.
      */
     auto data_batch() const {
-        std::unique_lock<std::mutex> ulock(main_lock);
+        const auto b = pool.wait(current / batch_size);
 
-        const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
+        return etl::slice(batch_cache(b), 0, std::min(batch_size, size() - current));
+    }
 
-        if (status[b]) {
-            const auto input_n = indices[b] * batch_size + batch_size;
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        if constexpr (indexed) {
+            const auto b = pool.wait(current / batch_size);
 
-            if (input_n > size()) {
-                return etl::slice(batch_cache(b), 0, batch_size - (input_n - size()));
-            } else {
-                return etl::slice(batch_cache(b), 0, batch_size);
-            }
+            return etl::slice(label_batch_cache(b), 0, std::min(batch_size, size() - current));
+        } else {
+            return etl::slice(label_cache, current, std::min(current + batch_size, size()));
         }
+    }
 
-        ready_condition.wait(ulock, [this, b] {
-            return status[b];
-        });
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return etl::dimensions<data_cache_type>() - 1;
+    }
 
-        const auto input_n = indices[b] * batch_size + batch_size;
+private:
+    /*!
+     * \brief Crop and mirror a stored sample into the batch. With compact
+     * storage, the sample is also converted and pre-transformed in the same
+     * pass.
+     * \param augmenter The augmenters of the producer
+     * \param test Indicates if the center crop (test mode) is used
+     * \param target The sample of the batch
+     * \param source The stored sample
+     * \param times The stage times of the batch
+     */
+    template <typename O, typename I>
+    static void first_transform(augmenter_set<Desc>& augmenter, bool test, O&& target, const I& source, stage_times& times) {
+        if constexpr (desc::CompactStorage) {
+            {
+                stage_timer timer(times.crop_mirror);
+                augmenter.first_transform(target, source, test, [](auto x) { return pre_transformer<desc>::template element<weight>(x); });
+            }
 
-        if (input_n > size()) {
-            return etl::slice(batch_cache(b), 0, batch_size - (input_n - size()));
+            if constexpr (pre_transformer<desc>::Normalize) {
+                stage_timer timer(times.pre_transform);
+                pre_transformer<desc>::finalize(target);
+            }
         } else {
-            return etl::slice(batch_cache(b), 0, batch_size);
+            stage_timer timer(times.crop_mirror);
+            augmenter.first_transform(target, source, test, [](auto x) { return x; });
         }
     }
 
     /*!
-     * \brief Returns the current label batch
-     * \return a a batch of label.
+     * \brief Returns the index in the cache of the i-th sample of the
+     * generation. All the copies of a sample share its stored sample.
      */
-    auto label_batch() const {
-        return etl::slice(label_cache, current, std::min(current + batch_size, size()));
+    size_t sample_index(size_t i) const {
+        if constexpr (indexed) {
+            return indices[i] % stored_size();
+        } else {
+            return i;
+        }
     }
 
     /*!
-     * \brief Returns the number of dimensions of the input.
-     * \return The number of dimensions of the input.
+     * \brief Shuffle the samples, or only their order when indexed
      */
-    static constexpr size_t dimensions() {
-        return etl::dimensions<data_cache_type>() - 1;
+    void shuffle_samples() {
+        if constexpr (indexed) {
+            std::shuffle(indices.begin(), indices.end(), dll::rand_engine());
+        } else {
+            etl::parallel_shuffle(input_cache, label_cache, dll::random_engine());
+        }
     }
 };
 
@@ -761,6 +959,11 @@ struct inmemory_data_generator_desc {
      */
     static constexpr bool Categorical = parameters::template contains<categorical>();
 
+    /*!
+     * \brief Indicates if the categorical labels are stored as class indices
+     */
+    static constexpr bool IndexLabels = parameters::template contains<index_labels>();
+
     /*!
      * \brief Indicates if horizontal mirroring should be used as augmentation.
      */
@@ -771,6 +974,41 @@ struct inmemory_data_generator_desc {
      */
     static constexpr bool VerticalMirroring = parameters::template contains<vertical_mirroring>();
 
+    /*!
+     * \brief The number of producer threads (augmented generators only)
+     */
+    static constexpr size_t Workers = detail::get_value_v<workers<1>, Parameters...>;
+
+    /*!
+     * \brief Indicates if the producers use a lock-free ring (augmented generators only)
+     */
+    static constexpr bool LockFree = parameters::template contains<lock_free>();
+
+    /*!
+     * \brief Indicates if only the order of the samples is shuffled
+     */
+    static constexpr bool IndexShuffle = parameters::template contains<index_shuffle>();
+
+    /*!
+     * \brief Indicates if the caches are backed by huge pages
+     */
+    static constexpr bool HugePages = parameters::template contains<huge_pages>();
+
+    /*!
+     * \brief The number of augmented copies of each sample (augmented generators only)
+     */
+    static constexpr size_t Copy = detail::get_value_v<copy<1>, Parameters...>;
+
+    /*!
+     * \brief The type used to store the samples (void for the type of the samples)
+     */
+    using storage = detail::get_type_t<storage_type<void>, Parameters...>;
+
+    /*!
+     * \brief Indicates if the samples are stored in a compact type
+     */
+    static constexpr bool CompactStorage = !std::is_void<storage>::value;
+
     /*!
      * \brief The random cropping X
      */
@@ -791,6 +1029,11 @@ struct inmemory_data_generator_desc {
      */
     static constexpr size_t Noise = detail::get_value_v<noise<0>, Parameters...>;
 
+    /*!
+     * \brief The type of noise
+     */
+    static constexpr corruption_type Corruption = detail::get_value_v<corruption<corruption_type::MASKING>, Parameters...>;
+
     /*!
      * \brief The scaling
      */
@@ -813,6 +1056,8 @@ struct inmemory_data_generator_desc {
 
     static_assert(BatchSize > 0, "The batch size must be larger than one");
     static_assert(BigBatchSize > 0, "The big batch size must be larger than one");
+    static_assert(Workers > 0, "The generator needs at least one worker");
+    static_assert(Copy > 0, "The generator needs at least one copy of each sample");
     static_assert(!(AutoEncoder && (random_crop_x || random_crop_y)), "autoencoder mode is not compatible with random crop");
 
     //Make sure only valid types are passed to the configuration list
@@ -820,7 +1065,7 @@ struct inmemory_data_generator_desc {
         detail::is_valid_v<
             cpp::type_list<
                 batch_size_id, big_batch_size_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id, elastic_distortion_id,
-                categorical_id, noise_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
+                categorical_id, index_labels_id, noise_id, corruption_id, workers_id, lock_free_id, index_shuffle_id, storage_type_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id, huge_pages_id, copy_id>,
             Parameters...>,
         "Invalid parameters type for rbm_desc");
 
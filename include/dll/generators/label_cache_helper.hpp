@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <cstdint>
+
 namespace dll {
 
 /*!
@@ -21,7 +23,7 @@ struct label_cache_helper;
  * This version makes the label categorical.
  */
 template <typename Desc, typename T, typename LIterator>
-struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical && !etl::is_etl_expr<typename std::iterator_traits<LIterator>::value_type>>> {
+struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical && !Desc::IndexLabels && !etl::is_etl_expr<typename std::iterator_traits<LIterator>::value_type>>> {
     using cache_type     = etl::dyn_matrix<T, 2>; ///< The type of the cache
     using big_cache_type = etl::dyn_matrix<T, 3>; ///< The type of the big cache
 
@@ -67,6 +69,59 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical
     }
 };
 
+/*!
+ * \brief Helper to create and initialize a cache for labels.
+ *
+ * This version keeps the categorical labels as class indices, the one-hot
+ * vectors are never built.
+ */
+template <typename Desc, typename T, typename LIterator>
+struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical && Desc::IndexLabels && !etl::is_etl_expr<typename std::iterator_traits<LIterator>::value_type>>> {
+    using cache_type     = etl::dyn_matrix<uint32_t, 1>; ///< The type of the cache
+    using big_cache_type = etl::dyn_matrix<uint32_t, 2>; ///< The type of the big cache
+
+    static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
+    static constexpr size_t big_batch_size = Desc::BigBatchSize; ///< The number of batches kept in cache
+
+    /*!
+     * \brief Init the cache
+     * \param n The size of the cache
+     * \param n_classes The number of classes
+     * \param it An iterator to an element
+     * \param cache The cache to initialize
+     */
+    static void init(size_t n, size_t n_classes, const LIterator& it, cache_type& cache) {
+        cache = cache_type(n);
+
+        cpp_unused(n_classes);
+        cpp_unused(it);
+    }
+
+    /*!
+     * \brief Init the big cache
+     * \param n_classes The number of classes
+     * \param it An iterator to an element
+     * \param cache The big cache to initialize
+     */
+    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache) {
+        cache = big_cache_type(big_batch_size, batch_size);
+
+        cpp_unused(n_classes);
+        cpp_unused(it);
+    }
+
+    /*!
+     * \brief Set the value of a label in the cache from the iterator
+     * \param i The index of the label in the cache
+     * \param it The label iterator
+     * \param cache The label cache
+     */
+    template <typename E>
+    static void set(size_t i, const LIterator& it, E&& cache) {
+        cache(i) = uint32_t(*it);
+    }
+};
+
 /*!
  * \brief Helper to create and initialize a cache for labels.
  *
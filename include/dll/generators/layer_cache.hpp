@@ -0,0 +1,577 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Disk-backed cache of the outputs of a layer during pretraining
+ *
+ * The cache files are memory-mapped datasets (see mmap_dataset.hpp),
+ * without labels, whose values are stored in a (possibly compact) storage
+ * type. A layer_cache_key is stored right after the header, in the
+ * padding of the data block, to identify the weights and the input that
+ * produced the outputs.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "dll/generators/mmap_dataset.hpp"
+#include "dll/util/random.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace dll {
+
+/*!
+ * \brief The identification of the content of a layer cache
+ */
+struct layer_cache_key {
+    char magic[8]; ///< The magic identifier of the key
+    uint64_t key;  ///< The hash of the weights and the input of the layer
+};
+
+/*!
+ * \brief The magic identifier of a layer cache key
+ */
+constexpr char layer_cache_magic[8] = {'D', 'L', 'L', 'C', 'A', 'C', 'H', 'E'};
+
+/*!
+ * \brief Combine the given bytes into the given hash (64 bits FNV-1a)
+ * \param hash The current hash
+ * \param data The bytes to hash
+ * \param n The number of bytes
+ * \return The new hash
+ */
+inline uint64_t layer_cache_hash(uint64_t hash, const void* data, size_t n) {
+    auto* p = static_cast<const unsigned char*>(data);
+
+    for (size_t i = 0; i < n; ++i) {
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/*!
+ * \brief The initial value of the layer cache hashes
+ */
+constexpr uint64_t layer_cache_seed = 14695981039346656037ULL;
+
+/*!
+ * \brief Write the outputs of a layer to a cache file, batch by batch.
+ *
+ * The file is first written to a temporary file and only renamed to its
+ * final name once complete, so that an interrupted pretraining never
+ * leaves a partial cache behind.
+ *
+ * \tparam S The storage type of the values
+ */
+template <typename S>
+struct layer_cache_writer {
+    /*!
+     * \brief Start writing a cache file
+     * \param path The path of the cache file
+     * \param key The key of the content
+     * \param samples The number of samples
+     * \param sample The first sample, to get the shape of all the samples
+     */
+    template <typename Sample>
+    layer_cache_writer(std::string path, uint64_t key, size_t samples, const Sample& sample) : path(std::move(path)), tmp(this->path + ".tmp") {
+        static constexpr size_t D = etl::decay_traits<Sample>::dimensions();
+
+        static_assert(D > 0 && D <= 4, "Only samples from 1D to 4D are supported");
+
+        stream.open(tmp, std::ios::binary);
+
+        if (!stream) {
+            std::cerr << "ERROR: Impossible to open " << tmp << std::endl;
+            return;
+        }
+
+        mmap_dataset_header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, mmap_dataset_magic, sizeof(header.magic));
+
+        sample_size = etl::size(sample);
+
+        header.version     = 1;
+        header.dtype       = sizeof(S);
+        header.samples     = samples;
+        header.dimensions  = D;
+        header.label_width = 0;
+
+        for (size_t d = 0; d < D; ++d) {
+            header.shape[d] = etl::dim(sample, d);
+        }
+
+        header.data_offset  = mmap_detail::align(sizeof(header) + sizeof(layer_cache_key));
+        header.label_offset = mmap_detail::align(header.data_offset + samples * sample_size * sizeof(S));
+
+        layer_cache_key cache_key;
+        std::memcpy(cache_key.magic, layer_cache_magic, sizeof(cache_key.magic));
+        cache_key.key = key;
+
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.write(reinterpret_cast<const char*>(&cache_key), sizeof(cache_key));
+
+        mmap_detail::pad(stream, header.data_offset);
+
+        label_offset = header.label_offset;
+    }
+
+    /*!
+     * \brief Append a batch of samples to the cache
+     * \param batch The batch of outputs
+     */
+    template <typename Batch>
+    void write(const Batch& batch) {
+        const size_t n = etl::size(batch);
+
+        buffer.resize(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            buffer[i] = S(batch[i]);
+        }
+
+        stream.write(reinterpret_cast<const char*>(buffer.data()), n * sizeof(S));
+    }
+
+    /*!
+     * \brief Complete the cache file
+     * \return true if the cache was completely written, false otherwise
+     */
+    bool finish() {
+        mmap_detail::pad(stream, label_offset);
+        stream.close();
+
+        if (!stream) {
+            std::cerr << "ERROR: Impossible to write " << tmp << std::endl;
+            std::remove(tmp.c_str());
+            return false;
+        }
+
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::cerr << "ERROR: Impossible to rename " << tmp << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    const std::string path; ///< The path of the cache file
+    const std::string tmp;  ///< The path of the temporary file
+
+    std::ofstream stream;    ///< The stream to the temporary file
+    std::vector<S> buffer;   ///< The converted batch
+    size_t sample_size  = 0; ///< The number of values of one sample
+    size_t label_offset = 0; ///< The offset of the end of the data block
+};
+
+/*!
+ * \brief A data generator serving the batches of a layer cache file.
+ *
+ * This works like mmap_data_generator, but the values are converted from
+ * the storage type when it is not the weight type, and the labels are the
+ * data (auto-encoder), as needed by pretraining.
+ *
+ * \tparam T The type of the values of the batches
+ * \tparam S The storage type of the values in the file
+ * \tparam D The number of dimensions of one sample
+ * \tparam Desc The generator descriptor (mmap_data_generator_desc)
+ */
+template <typename T, typename S, size_t D, typename Desc>
+struct layer_cache_generator {
+    using desc   = Desc; ///< The generator descriptor
+    using weight = T;    ///< The data type
+
+    static constexpr bool dll_generator    = true;               ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the generated batches
+    static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of batches read ahead
+
+    static constexpr bool direct = std::is_same<T, S>::value; ///< Indicates if the batches are views on the mapping
+
+    mmap_dataset_header header; ///< The header of the cache
+    uint64_t key = 0;           ///< The key of the content of the cache
+
+    int fd              = -1;      ///< The file descriptor
+    char* mapping       = nullptr; ///< The start of the mapping
+    size_t mapping_size = 0;       ///< The size of the mapping
+    S* data             = nullptr; ///< The start of the data block
+    size_t sample_size  = 0;       ///< The number of values of one sample
+
+    std::vector<size_t> order; ///< The order in which the batches are served
+
+    mutable std::vector<T> buffer;        ///< The converted batch (compact storage only)
+    mutable size_t converted = size_t(-1); ///< The index of the converted batch (compact storage only)
+
+    size_t current = 0;     ///< The current index
+    bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
+
+    /*!
+     * \brief Open the given cache file
+     * \param path The path to the cache file
+     */
+    explicit layer_cache_generator(const std::string& path) {
+        std::memset(&header, 0, sizeof(header));
+
+        fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(header) + sizeof(layer_cache_key)) {
+            close();
+            return;
+        }
+
+        mapping_size = st.st_size;
+
+        void* ptr = ::mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+        if (ptr == MAP_FAILED) {
+            std::cerr << "ERROR: Impossible to map " << path << std::endl;
+            close();
+            return;
+        }
+
+        mapping = static_cast<char*>(ptr);
+
+        std::memcpy(&header, mapping, sizeof(header));
+
+        layer_cache_key cache_key;
+        std::memcpy(&cache_key, mapping + sizeof(header), sizeof(cache_key));
+
+        if (std::memcmp(header.magic, mmap_dataset_magic, sizeof(header.magic)) != 0
+            || std::memcmp(cache_key.magic, layer_cache_magic, sizeof(cache_key.magic)) != 0
+            || header.dtype != sizeof(S) || header.dimensions != D) {
+            close();
+            return;
+        }
+
+        sample_size = 1;
+        for (size_t d = 0; d < D; ++d) {
+            sample_size *= header.shape[d];
+        }
+
+        if (header.data_offset + header.samples * sample_size * sizeof(S) > mapping_size) {
+            close();
+            return;
+        }
+
+        key  = cache_key.key;
+        data = reinterpret_cast<S*>(mapping + header.data_offset);
+
+        order.resize(batches());
+        std::iota(order.begin(), order.end(), 0);
+
+        reset();
+    }
+
+    layer_cache_generator(const layer_cache_generator& rhs) = delete;
+    layer_cache_generator operator=(const layer_cache_generator& rhs) = delete;
+
+    layer_cache_generator(layer_cache_generator&& rhs) = delete;
+    layer_cache_generator operator=(layer_cache_generator&& rhs) = delete;
+
+    /*!
+     * \brief Destructs the generator and unmap the file
+     */
+    ~layer_cache_generator() {
+        close();
+    }
+
+    /*!
+     * \brief Indicates if the cache holds the given content
+     * \param expected_key The key of the expected content
+     * \param samples The expected number of samples
+     */
+    bool matches(uint64_t expected_key, size_t samples) const {
+        return data && key == expected_key && size() == samples;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Layer Cache Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        is_safe = true;
+    }
+
+    /*!
+     * \brief Clear the memory of the generator.
+     *
+     * The pages are simply given back to the kernel, the file is kept to
+     * be reused by the next pretraining.
+     */
+    void clear() {
+        if (is_safe && mapping) {
+            ::madvise(mapping, mapping_size, MADV_DONTNEED);
+        }
+
+        std::vector<T>().swap(buffer);
+        converted = size_t(-1);
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current = 0;
+
+        prefetch(0);
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of batches
+     */
+    void reset_shuffle() {
+        current = 0;
+        shuffle();
+    }
+
+    /*!
+     * \brief Shuffle the order of the batches.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        std::shuffle(order.begin(), order.end(), dll::rand_engine());
+
+        converted = size_t(-1);
+
+        prefetch(0);
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        // Nothing can be done here
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current / batch_size;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return header.samples;
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < size();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        current += batch_size;
+
+        prefetch_batch(current_batch() + big_batch_size);
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        const size_t first = order[current_batch()] * batch_size;
+        const size_t n     = std::min(batch_size, size() - first);
+
+        if constexpr (direct) {
+            return make_view(data + first * sample_size, n, std::make_index_sequence<D>());
+        } else {
+            if (converted != current_batch()) {
+                const S* source = data + first * sample_size;
+
+                buffer.resize(batch_size * sample_size);
+
+                for (size_t i = 0; i < n * sample_size; ++i) {
+                    buffer[i] = T(source[i]);
+                }
+
+                converted = current_batch();
+            }
+
+            return make_view(buffer.data(), n, std::make_index_sequence<D>());
+        }
+    }
+
+    /*!
+     * \brief Returns the current label batch, the same as the data batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        return data_batch();
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return D;
+    }
+
+private:
+    /*!
+     * \brief Create a view of n samples on the given memory
+     */
+    template <size_t... I>
+    auto make_view(T* memory, size_t n, std::index_sequence<I...> /*seq*/) const {
+        return etl::custom_dyn_matrix<T, D + 1>(memory, n, size_t(header.shape[I])...);
+    }
+
+    /*!
+     * \brief Advise the kernel that the given batch will be needed
+     * \param batch The index of the batch in the generation order
+     */
+    void prefetch_batch(size_t batch) const {
+        if (!data || batch >= order.size()) {
+            return;
+        }
+
+        const size_t first = order[batch] * batch_size;
+        const size_t n     = std::min(batch_size, size() - first);
+
+        const size_t page  = mmap_dataset_alignment;
+        const size_t start = reinterpret_cast<size_t>(data + first * sample_size);
+        const size_t begin = (start / page) * page;
+        const size_t end   = start + n * sample_size * sizeof(S);
+
+        ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+    }
+
+    /*!
+     * \brief Advise the kernel that the window of batches starting at
+     * the given batch will be needed
+     */
+    void prefetch(size_t batch) const {
+        for (size_t b = batch; b < batch + big_batch_size; ++b) {
+            prefetch_batch(b);
+        }
+    }
+
+    /*!
+     * \brief Unmap the file and close it
+     */
+    void close() {
+        if (mapping) {
+            ::munmap(mapping, mapping_size);
+            mapping = nullptr;
+        }
+
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+
+        data = nullptr;
+
+        header.samples = 0;
+    }
+};
+
+template <typename T, typename S, size_t D, typename Desc>
+const size_t layer_cache_generator<T, S, D, Desc>::batch_size;
+
+template <typename T, typename S, size_t D, typename Desc>
+const size_t layer_cache_generator<T, S, D, Desc>::big_batch_size;
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename T, typename S, size_t D, typename Desc>
+std::ostream& operator<<(std::ostream& os, layer_cache_generator<T, S, D, Desc>& generator) {
+    return generator.display(os);
+}
+
+} //end of dll namespace
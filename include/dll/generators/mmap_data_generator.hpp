@@ -0,0 +1,452 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Implementation of a data generator backed by a memory-mapped file
+ *
+ * See mmap_dataset.hpp for the file format.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+
+#include "dll/generators/mmap_dataset.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace dll {
+
+/*!
+ * \brief A data generator serving batches directly from a memory-mapped
+ * dataset file.
+ *
+ * The returned batches are views on the mapping, no data is ever copied.
+ * The next batches are advised to the kernel to be read ahead. Shuffling
+ * is done at the batch level, in order to keep the batches contiguous.
+ *
+ * \tparam T The type of the values of the dataset
+ * \tparam D The number of dimensions of one sample
+ * \tparam Desc The generator descriptor
+ */
+template <typename T, size_t D, typename Desc>
+struct mmap_data_generator {
+    using desc   = Desc; ///< The generator descriptor
+    using weight = T;    ///< The data type
+
+    static constexpr bool dll_generator    = true;               ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the generated batches
+    static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of batches read ahead
+
+    mmap_dataset_header header; ///< The header of the dataset
+
+    int fd              = -1;      ///< The file descriptor
+    char* mapping       = nullptr; ///< The start of the mapping
+    size_t mapping_size = 0;       ///< The size of the mapping
+    T* data             = nullptr; ///< The start of the data block
+    T* labels           = nullptr; ///< The start of the label block
+    size_t sample_size  = 0;       ///< The number of values of one sample
+
+    std::vector<size_t> order; ///< The order in which the batches are served
+
+    size_t current = 0;     ///< The current index
+    bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
+
+    /*!
+     * \brief Construct a mmap_data_generator around the given file
+     * \param path The path to the dataset file
+     */
+    explicit mmap_data_generator(const std::string& path) {
+        std::memset(&header, 0, sizeof(header));
+
+        fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            std::cerr << "ERROR: Impossible to open " << path << std::endl;
+            return;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(header)) {
+            std::cerr << "ERROR: Invalid dataset file " << path << std::endl;
+            close();
+            return;
+        }
+
+        mapping_size = st.st_size;
+
+        // The mapping is private, batches can be modified without touching the file
+        void* ptr = ::mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+        if (ptr == MAP_FAILED) {
+            std::cerr << "ERROR: Impossible to map " << path << std::endl;
+            close();
+            return;
+        }
+
+        mapping = static_cast<char*>(ptr);
+
+        std::memcpy(&header, mapping, sizeof(header));
+
+        if (std::memcmp(header.magic, mmap_dataset_magic, sizeof(header.magic)) != 0 || header.dtype != sizeof(T) || header.dimensions != D) {
+            std::cerr << "ERROR: Incompatible dataset file " << path << std::endl;
+            close();
+            return;
+        }
+
+        sample_size = 1;
+        for (size_t d = 0; d < D; ++d) {
+            sample_size *= header.shape[d];
+        }
+
+        if (header.label_offset + header.samples * header.label_width * sizeof(T) > mapping_size) {
+            std::cerr << "ERROR: Truncated dataset file " << path << std::endl;
+            close();
+            return;
+        }
+
+        data   = reinterpret_cast<T*>(mapping + header.data_offset);
+        labels = reinterpret_cast<T*>(mapping + header.label_offset);
+
+        order.resize(batches());
+        std::iota(order.begin(), order.end(), 0);
+
+        reset();
+    }
+
+    mmap_data_generator(const mmap_data_generator& rhs) = delete;
+    mmap_data_generator operator=(const mmap_data_generator& rhs) = delete;
+
+    mmap_data_generator(mmap_data_generator&& rhs) = delete;
+    mmap_data_generator operator=(mmap_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Destructs the generator and unmap the file
+     */
+    ~mmap_data_generator() {
+        close();
+    }
+
+    /*!
+     * \brief Indicates if the dataset file was correctly mapped
+     */
+    bool is_open() const {
+        return data != nullptr;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Memory-Mapped Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        is_safe = true;
+    }
+
+    /*!
+     * \brier Clear the memory of the generator.
+     *
+     * The pages are simply given back to the kernel, they will be read
+     * again from the file if necessary.
+     */
+    void clear() {
+        if (is_safe && mapping) {
+            ::madvise(mapping, mapping_size, MADV_DONTNEED);
+        }
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current = 0;
+
+        prefetch(0);
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of batches
+     */
+    void reset_shuffle() {
+        current = 0;
+        shuffle();
+    }
+
+    /*!
+     * \brief Shuffle the order of the batches.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        std::shuffle(order.begin(), order.end(), dll::rand_engine());
+
+        prefetch(0);
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        // Nothing can be done here
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current / batch_size;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return header.samples;
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < size();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        current += batch_size;
+
+        // Only the last batch of the window needs to be advised
+        prefetch_batch(current_batch() + big_batch_size);
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        const size_t first = order[current_batch()] * batch_size;
+        const size_t n     = std::min(batch_size, size() - first);
+
+        return make_view(data + first * sample_size, n, std::make_index_sequence<D>());
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        const size_t first = order[current_batch()] * batch_size;
+        const size_t n     = std::min(batch_size, size() - first);
+
+        return etl::custom_dyn_matrix<T, 2>(labels + first * header.label_width, n, size_t(header.label_width));
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return D;
+    }
+
+private:
+    /*!
+     * \brief Create a view of n samples on the mapping
+     */
+    template <size_t... I>
+    auto make_view(T* memory, size_t n, std::index_sequence<I...> /*seq*/) const {
+        return etl::custom_dyn_matrix<T, D + 1>(memory, n, size_t(header.shape[I])...);
+    }
+
+    /*!
+     * \brief Advise the kernel that a range of the mapping will be needed
+     */
+    void advise(const void* start, size_t length) const {
+        const size_t page  = mmap_dataset_alignment;
+        const size_t begin = (reinterpret_cast<size_t>(start) / page) * page;
+        const size_t end   = reinterpret_cast<size_t>(start) + length;
+
+        ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+    }
+
+    /*!
+     * \brief Advise the kernel that the given batch will be needed
+     * \param batch The index of the batch in the generation order
+     */
+    void prefetch_batch(size_t batch) const {
+        if (!data || batch >= order.size()) {
+            return;
+        }
+
+        const size_t first = order[batch] * batch_size;
+        const size_t n     = std::min(batch_size, size() - first);
+
+        advise(data + first * sample_size, n * sample_size * sizeof(T));
+        advise(labels + first * header.label_width, n * header.label_width * sizeof(T));
+    }
+
+    /*!
+     * \brief Advise the kernel that the window of batches starting at
+     * the given batch will be needed
+     */
+    void prefetch(size_t batch) const {
+        for (size_t b = batch; b < batch + big_batch_size; ++b) {
+            prefetch_batch(b);
+        }
+    }
+
+    /*!
+     * \brief Unmap the file and close it
+     */
+    void close() {
+        if (mapping) {
+            ::munmap(mapping, mapping_size);
+            mapping = nullptr;
+        }
+
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+
+        data   = nullptr;
+        labels = nullptr;
+
+        header.samples = 0;
+    }
+};
+
+template <typename T, size_t D, typename Desc>
+const size_t mmap_data_generator<T, D, Desc>::batch_size;
+
+template <typename T, size_t D, typename Desc>
+const size_t mmap_data_generator<T, D, Desc>::big_batch_size;
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename T, size_t D, typename Desc>
+std::ostream& operator<<(std::ostream& os, mmap_data_generator<T, D, Desc>& generator) {
+    return generator.display(os);
+}
+
+/*!
+ * \brief Descriptor for a mmap_data_generator
+ */
+template <typename... Parameters>
+struct mmap_data_generator_desc {
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    /*!
+     * \brief The size of a batch
+     */
+    static constexpr size_t BatchSize = detail::get_value_v<batch_size<1>, Parameters...>;
+
+    /*!
+     * \brief The number of batches to read ahead
+     */
+    static constexpr size_t BigBatchSize = detail::get_value_v<big_batch_size<1>, Parameters...>;
+
+    static_assert(BatchSize > 0, "The batch size must be larger than one");
+    static_assert(BigBatchSize > 0, "The big batch size must be larger than one");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<batch_size_id, big_batch_size_id, nop_id>, Parameters...>,
+        "Invalid parameters type for mmap_data_generator_desc");
+
+    /*!
+     * The generator type
+     */
+    template <typename T, size_t D>
+    using generator_t = mmap_data_generator<T, D, mmap_data_generator_desc<Parameters...>>;
+};
+
+/*!
+ * \brief Make a memory-mapped data generator around the given file
+ * \tparam T The type of the values of the dataset
+ * \tparam D The number of dimensions of one sample
+ * \param path The path to the dataset file
+ */
+template <typename T, size_t D, typename... Parameters>
+auto make_mmap_generator(const std::string& path, const mmap_data_generator_desc<Parameters...>& /*desc*/) {
+    using generator_t = typename mmap_data_generator_desc<Parameters...>::template generator_t<T, D>;
+    return std::make_unique<generator_t>(path);
+}
+
+} //end of dll namespace
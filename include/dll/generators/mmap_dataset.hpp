@@ -0,0 +1,280 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief The memory-mapped dataset format
+ *
+ * The file format is very simple. A fixed-size header (mmap_dataset_header)
+ * is followed by the data block, containing all the samples stored
+ * contiguously, and by the label block, containing the labels of all the
+ * samples stored contiguously. Both blocks start on an aligned offset so
+ * that batches can be used directly from the mapping, without any copy.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+#include "etl/etl_light.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The alignment of the blocks of a memory-mapped dataset
+ */
+constexpr size_t mmap_dataset_alignment = 4096;
+
+/*!
+ * \brief The magic identifier of a memory-mapped dataset
+ */
+constexpr char mmap_dataset_magic[8] = {'D', 'L', 'L', 'M', 'M', 'A', 'P', '1'};
+
+/*!
+ * \brief The header of a memory-mapped dataset file
+ */
+struct mmap_dataset_header {
+    char magic[8];         ///< The magic identifier of the format
+    uint32_t version;      ///< The version of the format
+    uint32_t dtype;        ///< The size in bytes of one value
+    uint64_t samples;      ///< The number of samples
+    uint64_t dimensions;   ///< The number of dimensions of one sample
+    uint64_t shape[4];     ///< The shape of one sample
+    uint64_t label_width;  ///< The number of values of each label
+    uint64_t data_offset;  ///< The offset of the data block
+    uint64_t label_offset; ///< The offset of the label block
+};
+
+namespace mmap_detail {
+
+/*!
+ * \brief Align the given offset on the alignment of the blocks
+ */
+inline size_t align(size_t offset) {
+    return ((offset + mmap_dataset_alignment - 1) / mmap_dataset_alignment) * mmap_dataset_alignment;
+}
+
+/*!
+ * \brief Write zeroes in the stream until the given offset is reached
+ */
+inline void pad(std::ofstream& stream, size_t offset) {
+    while (size_t(stream.tellp()) < offset) {
+        stream.put('\0');
+    }
+}
+
+/*!
+ * \brief Fill the values of the given label, one-hot encoded when
+ * n_classes is not zero and the label is scalar
+ */
+template <typename L, typename T>
+void fill_label(const L& l, size_t n_classes, std::vector<T>& label) {
+    if constexpr (etl::is_etl_expr<L>) {
+        l.ensure_cpu_up_to_date();
+
+        std::copy(l.memory_start(), l.memory_end(), label.begin());
+    } else if (n_classes) {
+        std::fill(label.begin(), label.end(), T(0));
+        label[size_t(l)] = T(1);
+    } else {
+        label[0] = T(l);
+    }
+}
+
+} // end of namespace mmap_detail
+
+/*!
+ * \brief Write a dataset in the memory-mapped format.
+ *
+ * When n_classes is not zero and the labels are scalar, the labels are
+ * stored as one-hot (categorical) vectors. Otherwise, the labels are
+ * stored as such.
+ *
+ * \param path The path of the file to write
+ * \param images The container of samples
+ * \param labels The container of labels
+ * \param n_classes The number of classes (zero to store the labels as such)
+ * \return true if the dataset was written, false otherwise
+ */
+template <typename Container, typename LContainer>
+bool write_mmap_dataset(const std::string& path, const Container& images, const LContainer& labels, size_t n_classes = 0) {
+    using image_t = typename Container::value_type;
+    using label_t = typename LContainer::value_type;
+    using T       = etl::value_t<image_t>;
+
+    static constexpr size_t D = etl::decay_traits<image_t>::dimensions();
+
+    static_assert(D > 0 && D <= 4, "Only samples from 1D to 4D are supported");
+
+    if (images.empty() || images.size() != labels.size()) {
+        std::cerr << "ERROR: Invalid dataset for " << path << std::endl;
+        return false;
+    }
+
+    std::ofstream stream(path, std::ios::binary);
+
+    if (!stream) {
+        std::cerr << "ERROR: Impossible to open " << path << std::endl;
+        return false;
+    }
+
+    mmap_dataset_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, mmap_dataset_magic, sizeof(header.magic));
+
+    auto& first = images.front();
+
+    header.version    = 1;
+    header.dtype      = sizeof(T);
+    header.samples    = images.size();
+    header.dimensions = D;
+
+    for (size_t d = 0; d < D; ++d) {
+        header.shape[d] = etl::dim(first, d);
+    }
+
+    if constexpr (etl::is_etl_expr<label_t>) {
+        header.label_width = etl::size(labels.front());
+    } else {
+        header.label_width = n_classes ? n_classes : 1;
+    }
+
+    const size_t sample_size = etl::size(first);
+
+    header.data_offset  = mmap_detail::align(sizeof(header));
+    header.label_offset = mmap_detail::align(header.data_offset + header.samples * sample_size * sizeof(T));
+
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // 1. The data block
+
+    mmap_detail::pad(stream, header.data_offset);
+
+    for (auto& image : images) {
+        cpp_assert(etl::size(image) == sample_size, "All the samples must have the same size");
+
+        image.ensure_cpu_up_to_date();
+
+        stream.write(reinterpret_cast<const char*>(image.memory_start()), sample_size * sizeof(T));
+    }
+
+    // 2. The label block
+
+    mmap_detail::pad(stream, header.label_offset);
+
+    std::vector<T> label(header.label_width);
+
+    for (auto& l : labels) {
+        mmap_detail::fill_label(l, n_classes, label);
+
+        stream.write(reinterpret_cast<const char*>(label.data()), label.size() * sizeof(T));
+    }
+
+    return bool(stream);
+}
+
+/*!
+ * \brief Write a dataset in the memory-mapped format, batch by batch,
+ * without holding the dataset in memory.
+ *
+ * The number of samples and their shape must be known before the first
+ * batch is written. The samples and the labels are written at their
+ * offsets in their blocks.
+ *
+ * \tparam T The type of the values of the dataset
+ */
+template <typename T>
+struct mmap_dataset_writer {
+    /*!
+     * \brief Create the dataset file and write its header
+     * \param path The path of the file to write
+     * \param samples The number of samples of the dataset
+     * \param shape The shape of one sample (from 1 to 4 dimensions)
+     * \param label_width The number of values of each label
+     */
+    mmap_dataset_writer(const std::string& path, size_t samples, const std::vector<size_t>& shape, size_t label_width)
+            : stream(path, std::ios::binary) {
+        cpp_assert(!shape.empty() && shape.size() <= 4, "Only samples from 1D to 4D are supported");
+
+        if (!stream) {
+            std::cerr << "ERROR: Impossible to open " << path << std::endl;
+            return;
+        }
+
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, mmap_dataset_magic, sizeof(header.magic));
+
+        sample_size = 1;
+
+        for (size_t d = 0; d < shape.size(); ++d) {
+            header.shape[d] = shape[d];
+            sample_size *= shape[d];
+        }
+
+        header.version     = 1;
+        header.dtype       = sizeof(T);
+        header.samples     = samples;
+        header.dimensions  = shape.size();
+        header.label_width = label_width;
+
+        header.data_offset  = mmap_detail::align(sizeof(header));
+        header.label_offset = mmap_detail::align(header.data_offset + samples * sample_size * sizeof(T));
+
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        // Make the blocks exist, even if the last batches are not written
+        const size_t end = header.label_offset + samples * label_width * sizeof(T);
+
+        if (end > sizeof(header)) {
+            stream.seekp(end - 1);
+            stream.put('\0');
+        }
+    }
+
+    mmap_dataset_writer(const mmap_dataset_writer& rhs) = delete;
+    mmap_dataset_writer& operator=(const mmap_dataset_writer& rhs) = delete;
+
+    /*!
+     * \brief Write the next n samples and their labels
+     * \param data The n samples, stored contiguously
+     * \param labels The n labels, stored contiguously
+     * \param n The number of samples
+     */
+    void write(const T* data, const T* labels, size_t n) {
+        cpp_assert(written + n <= header.samples, "Too many samples written in the dataset");
+
+        stream.seekp(header.data_offset + written * sample_size * sizeof(T));
+        stream.write(reinterpret_cast<const char*>(data), n * sample_size * sizeof(T));
+
+        stream.seekp(header.label_offset + written * header.label_width * sizeof(T));
+        stream.write(reinterpret_cast<const char*>(labels), n * header.label_width * sizeof(T));
+
+        written += n;
+    }
+
+    /*!
+     * \brief Indicates if all the samples have been written without error
+     */
+    bool good() const {
+        return bool(stream) && written == header.samples;
+    }
+
+private:
+    std::ofstream stream;       ///< The stream of the file
+    mmap_dataset_header header; ///< The header of the dataset
+    size_t sample_size = 0;     ///< The number of values of one sample
+    size_t written     = 0;     ///< The number of samples written
+};
+
+} // end of namespace dll
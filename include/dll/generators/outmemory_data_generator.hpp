@@ -13,6 +13,7 @@
 #pragma once
 
 #include <atomic>
+#include <future>
 #include <thread>
 
 namespace dll {
@@ -43,8 +44,12 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
     big_data_cache_type batch_cache;  ///< The data batch cache
     big_label_cache_type label_cache; ///< The label batch cache
 
+    big_data_cache_type next_batch_cache;  ///< The data batch cache being prefetched
+    big_label_cache_type next_label_cache; ///< The label batch cache being prefetched
+
     size_t current      = 0;     ///< The current index
     size_t current_real = 0;     ///< The current real index
+    size_t next_real    = 0;     ///< The real index at the end of the prefetched big batch
     size_t current_b    = 0;     ///< The current batch
     bool is_safe        = false; ///< Indicates if the generator is safe to reclaim memory from
 
@@ -54,6 +59,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
     Iterator it;        ///< The current iterator on data
     LIterator lit;      ///< The current iterator on label
 
+    std::future<void> prefetcher; ///< The background reading of the next big batch
 
     /*!
      * \brief Construct an outmemory_data_generator
@@ -69,6 +75,15 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
         data_cache_helper_t::init_big(first, batch_cache);
         label_cache_helper_t::init_big(n_classes, lfirst, label_cache);
 
+        if constexpr (desc::Prefetch) {
+            data_cache_helper_t::init_big(first, next_batch_cache);
+            label_cache_helper_t::init_big(n_classes, lfirst, next_label_cache);
+        }
+
+        if constexpr (desc::HugePages) {
+            advise_huge_pages(std::tie(batch_cache, label_cache, next_batch_cache, next_label_cache));
+        }
+
         reset();
 
         cpp_unused(last);
@@ -81,6 +96,13 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
     outmemory_data_generator(outmemory_data_generator&& rhs) = delete;
     outmemory_data_generator operator=(outmemory_data_generator&& rhs) = delete;
 
+    /*!
+     * \brief Destructs the outmemory_data_generator
+     */
+    ~outmemory_data_generator() {
+        wait_prefetch();
+    }
+
     /*!
      * \brief Display a description of the generator in the given stream
      * \param stream The stream to print to
@@ -120,8 +142,12 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
      */
     void clear() {
         if (is_safe) {
+            wait_prefetch();
+
             batch_cache.clear();
             label_cache.clear();
+            next_batch_cache.clear();
+            next_label_cache.clear();
         }
     }
 
@@ -140,42 +166,88 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
     }
 
     /*!
-     * \brief Fetch the next batch
+     * \brief Read the next samples from the iterators into a big batch
+     * \param cache The data cache to fill
+     * \param lcache The label cache to fill
+     * \param real The real index of the first sample to read
+     * \return The real index after the last read sample
      */
-    void fetch_next() {
-        current_b = 0;
-
-        for (size_t b = 0; b < big_batch_size && current_real < _size; ++b) {
-            for (size_t i = 0; i < batch_size && current_real < _size;) {
-                auto sub = batch_cache(b)(i);
+    size_t read_big_batch(big_data_cache_type& cache, big_label_cache_type& lcache, size_t real) {
+        for (size_t b = 0; b < big_batch_size && real < _size; ++b) {
+            for (size_t i = 0; i < batch_size && real < _size;) {
+                auto sub = cache(b)(i);
 
                 sub = *it;
 
-                pre_scaler<desc>::transform(sub);
-                pre_normalizer<desc>::transform(sub);
-                pre_binarizer<desc>::transform(sub);
-
-                label_cache_helper_t::set(i, lit, label_cache(b));
+                label_cache_helper_t::set(i, lit, lcache(b));
 
                 // In case of auto-encoders, the label images also need to be transformed
-                if constexpr (desc::AutoEncoder) {
-                    pre_scaler<desc>::transform(label_cache(b)(i));
-                    pre_normalizer<desc>::transform(label_cache(b)(i));
-                    pre_binarizer<desc>::transform(label_cache(b)(i));
-                }
+                pre_transformer<desc>::transform(sub, lcache(b)(i));
 
                 ++i;
-                ++current_real;
+                ++real;
                 ++it;
                 ++lit;
             }
         }
+
+        return real;
+    }
+
+    /*!
+     * \brief Start reading the next big batch in the background
+     */
+    void start_prefetch() {
+        if (current_real < _size) {
+            prefetcher = std::async(std::launch::async, [this, real = current_real] {
+                SERIAL_SECTION {
+                    next_real = read_big_batch(next_batch_cache, next_label_cache, real);
+                }
+            });
+        }
+    }
+
+    /*!
+     * \brief Wait for the background reading, if any, to be done
+     */
+    void wait_prefetch() {
+        if (prefetcher.valid()) {
+            prefetcher.get();
+        }
+    }
+
+    /*!
+     * \brief Fetch the next batch
+     */
+    void fetch_next() {
+        current_b = 0;
+
+        if constexpr (desc::Prefetch) {
+            if (prefetcher.valid()) {
+                // The next big batch is (being) read in the background
+                wait_prefetch();
+
+                std::swap(batch_cache, next_batch_cache);
+                std::swap(label_cache, next_label_cache);
+
+                current_real = next_real;
+            } else {
+                current_real = read_big_batch(batch_cache, label_cache, current_real);
+            }
+
+            start_prefetch();
+        } else {
+            current_real = read_big_batch(batch_cache, label_cache, current_real);
+        }
     }
 
     /*!
      * \brief Reset the generator to the beginning
      */
     void reset() {
+        // The iterators cannot be touched while being used in the background
+        wait_prefetch();
+
         current      = 0;
         current_real = 0;
 
@@ -236,6 +308,16 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
         return _size;
     }
 
+    /*!
+     * \brief Add the memory held by the caches of the generator to the given report
+     * \param report The report
+     * \param name The name of the generator in the report
+     */
+    void report_memory(memory_report& report, const std::string& name) const {
+        report.add(name + " batch_cache", memory_bytes(std::tie(batch_cache, next_batch_cache)));
+        report.add(name + " label_cache", memory_bytes(std::tie(label_cache, next_label_cache)));
+    }
+
     /*!
      * \brief Returns the number of batches in the generator.
      * \return The number of batches in the generator
@@ -309,35 +391,40 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
     static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the generated batches
     static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of batches kept in cache
 
+    static constexpr size_t workers = desc::Workers; ///< The number of producer threads
+
+    /*!
+     * \brief The state of one producer thread
+     */
+    struct producer_state {
+        Iterator it;                   ///< The iterator on data of the batch being filled
+        LIterator lit;                 ///< The iterator on label of the batch being filled
+        augmenter_set<Desc> augmenter; ///< The augmenters of the producer
+
+        /*!
+         * \brief Construct the state of a producer
+         * \param it The iterator on the beginning of data
+         * \param lit The iterator on the beginning of labels
+         */
+        producer_state(Iterator it, LIterator lit) : it(it), lit(lit), augmenter(*it) {}
+    };
+
     big_data_cache_type batch_cache;  ///< The data batch cache
     big_label_cache_type label_cache; ///< The label batch cache
 
     size_t current      = 0;     ///< The current index
-    size_t current_read = 0;     ///< The current index read
     bool is_safe        = false; ///< Indicates if the generator is safe to reclaim memory from
 
-    mutable volatile bool status[big_batch_size];    ///< Status of each batch
-    mutable volatile size_t indices[big_batch_size]; ///< Indices of each batch
-
-    mutable std::mutex main_lock;                    ///< The main lock
-    mutable std::condition_variable condition;       ///< The condition variable for the thread to wait for some space
-    mutable std::condition_variable ready_condition; ///< The condition variable for a reader to wait for ready data
-
-    volatile bool stop_flag = false; ///< Boolean flag indicating to the thread to stop
-
-    std::thread main_thread; ///< The main thread
-    bool train_mode = false; ///< The train mode status
+    batch_workers_t<desc> pool; ///< The pool of producers
+    bool train_mode = false;    ///< The train mode status
 
     const size_t _size; ///< The size of the dataset
     Iterator orig_it;   ///< The original first iterator on data
     LIterator orig_lit; ///< The original first iterator on label
-    Iterator it;        ///< The current iterator on data
-    LIterator lit;      ///< The current iterator on label
+    Iterator it;        ///< The next iterator on data to be claimed
+    LIterator lit;      ///< The next iterator on label to be claimed
 
-    random_cropper<Desc> cropper;      ///< The random cropper
-    random_mirrorer<Desc> mirrorer;    ///< The random mirrorer
-    elastic_distorter<Desc> distorter; ///< The elastic distorter
-    random_noise<Desc> noiser;         ///< The random noiser
+    std::vector<producer_state> producers; ///< The state of each producer
 
     /*!
      * \brief Construct an outmemory_data_generator
@@ -349,113 +436,90 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \param size The size of the entire dataset
      */
     outmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes, size_t size)
-            : _size(size), orig_it(first), orig_lit(lfirst), it(orig_it), lit(orig_lit), cropper(*first), mirrorer(*first), distorter(*first), noiser(*first) {
+            : _size(size), orig_it(first), orig_lit(lfirst), it(orig_it), lit(orig_lit) {
         data_cache_helper_t::init_big(first, batch_cache);
         label_cache_helper_t::init_big(n_classes, lfirst, label_cache);
 
+        if constexpr (desc::HugePages) {
+            advise_huge_pages(std::tie(batch_cache, label_cache));
+        }
+
         cpp_unused(last);
         cpp_unused(llast);
 
-        main_thread = std::thread([this] {
-            while (true) {
-                // The index of the batch inside the batch cache
-                size_t index = 0;
+        producers.reserve(workers);
 
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
+        for (size_t w = 0; w < workers; ++w) {
+            producers.emplace_back(orig_it, orig_lit);
+        }
 
-                    bool found = false;
+        // The claim is done with the lock held, the iterators are always
+        // advanced in the order of the batches
+        auto claim = [this](size_t w, size_t index, size_t batch) {
+            cpp_unused(index);
 
-                    // Try to find a read batch first
-                    for (size_t b = 0; b < big_batch_size; ++b) {
-                        if (!status[b] && indices[b] * batch_size < _size) {
-                            index = b;
-                            found = true;
-                            break;
-                        }
-                    }
+            const size_t n = std::min(batch_size, _size - batch * batch_size);
 
-                    // if not found, wait for a ready to compute batch
-
-                    if (!found) {
-                        // Wait for the end or for some work
-                        condition.wait(ulock, [this, &index] {
-                            if (stop_flag) {
-                                return true;
-                            }
-
-                            for (size_t b = 0; b < big_batch_size; ++b) {
-                                if (!status[b] && indices[b] * batch_size < _size) {
-                                    index = b;
-                                    return true;
-                                }
-                            }
-
-                            return false;
-                        });
-
-                        // If there is no more thread for the thread, exit
-                        if (stop_flag) {
-                            return;
-                        }
-                    }
-                }
+            producers[w].it  = it;
+            producers[w].lit = lit;
 
-                SERIAL_SECTION {
-                    for (size_t i = 0; i < batch_size && current_read < _size; ++i) {
-                        auto sub = batch_cache(index)(i);
+            std::advance(it, n);
+            std::advance(lit, n);
+        };
+
+        auto fill = [this](size_t w, size_t index, size_t batch) {
+            auto& state     = producers[w];
+            auto& augmenter = state.augmenter;
 
-                        if (train_mode) {
-                            // Random crop the image
-                            cropper.transform_first(sub, *it);
+            augmenter.begin_batch();
 
-                            pre_scaler<desc>::transform(sub);
-                            pre_normalizer<desc>::transform(sub);
-                            pre_binarizer<desc>::transform(sub);
+            stage_times times;
 
-                            // Mirror the image
-                            mirrorer.transform(sub);
+            const size_t n = std::min(batch_size, _size - batch * batch_size);
 
-                            // Distort the image
-                            distorter.transform(sub);
+            SERIAL_SECTION {
+                for (size_t i = 0; i < n; ++i) {
+                    auto sub = batch_cache(index)(i);
 
-                            // Noise the image
-                            noiser.transform(sub);
-                        } else {
-                            // Center crop the image
-                            cropper.transform_first_test(sub, *it);
+                    label_cache_helper_t::set(i, state.lit, label_cache(index));
+
+                    // Crop (center crop in test mode) and mirror the image,
+                    // pre-transforming it in the same pass
+                    {
+                        stage_timer timer(times.crop_mirror);
+                        augmenter.first_transform(sub, *state.it, !train_mode, [](auto x) { return pre_transformer<desc>::template element<weight>(x); });
+                    }
 
-                            pre_scaler<desc>::transform(sub);
-                            pre_normalizer<desc>::transform(sub);
-                            pre_binarizer<desc>::transform(sub);
-                        }
+                    {
+                        stage_timer timer(times.pre_transform);
 
-                        label_cache_helper_t::set(i, lit, label_cache(index));
+                        pre_transformer<desc>::finalize(sub);
 
                         // In case of auto-encoders, the label images also need to be transformed
-                        if constexpr (desc::AutoEncoder){
-                            pre_scaler<desc>::transform(label_cache(index)(i));
-                            pre_normalizer<desc>::transform(label_cache(index)(i));
-                            pre_binarizer<desc>::transform(label_cache(index)(i));
-                        }
-
-                        ++it;
-                        ++lit;
-                        ++current_read;
+                        pre_transformer<desc>::transform_label(label_cache(index)(i));
                     }
-                }
-
-                // Notify a waiter that one batch is ready
 
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
+                    if (train_mode) {
+                        // Distort the image
+                        stage_timer timer(times.distortion);
+                        augmenter.distorter.transform(sub);
+                    }
 
-                    status[index] = true;
+                    ++state.it;
+                    ++state.lit;
+                }
 
-                    ready_condition.notify_one();
+                // Noise the whole batch in place, the labels stay clean
+                if (train_mode) {
+                    stage_timer timer(times.noise);
+                    augmenter.noiser.transform_batch(batch_cache(index), n);
                 }
             }
-        });
+
+            pool.counters.add(times);
+        };
+
+        pool.start(workers, batches(), claim, fill);
     }
 
     outmemory_data_generator(const outmemory_data_generator& rhs) = delete;
@@ -468,11 +532,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \brief Destructs the outmemory_data_generator
      */
     ~outmemory_data_generator() {
-        cpp::with_lock(main_lock, [this] { stop_flag = true; });
-
-        condition.notify_all();
-
-        main_thread.join();
+        pool.stop();
     }
 
     /*!
@@ -484,6 +544,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
         stream << "Out-Of-Memory Data Generator" << std::endl;
         stream << "              Size: " << size() << std::endl;
         stream << "           Batches: " << batches() << std::endl;
+        stream << "           Workers: " << workers << std::endl;
 
         if (augmented_size() != size()) {
             stream << "    Augmented Size: " << augmented_size() << std::endl;
@@ -533,22 +594,22 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
         train_mode = true;
     }
 
+    /*!
+     * \brief Returns the statistics of the pipeline since the beginning of
+     * the generation
+     */
+    generator_stats stats() const {
+        return pool.counters.stats();
+    }
+
     /*!
      * \brief Reset the generation
      */
     void reset_generation() {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
-        current_read = 0;
-        it           = orig_it;
-        lit          = orig_lit;
-
-        for (size_t b = 0; b < big_batch_size; ++b) {
-            status[b]  = false;
-            indices[b] = b;
-        }
-
-        condition.notify_one();
+        pool.reset([this] {
+            it  = orig_it;
+            lit = orig_lit;
+        });
     }
 
     /*!
@@ -607,7 +668,17 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \return The augmented number of elements in the generator
      */
     size_t augmented_size() const {
-        return cropper.scaling() * mirrorer.scaling() * noiser.scaling() * distorter.scaling() * size();
+        return producers.front().augmenter.scaling() * size();
+    }
+
+    /*!
+     * \brief Add the memory held by the caches of the generator to the given report
+     * \param report The report
+     * \param name The name of the generator in the report
+     */
+    void report_memory(memory_report& report, const std::string& name) const {
+        report.add(name + " batch_cache", memory_bytes(batch_cache));
+        report.add(name + " label_cache", memory_bytes(label_cache));
     }
 
     /*!
@@ -632,18 +703,8 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * This should only be called if the generator has a next batch.
      */
     void next_batch() {
-        // Get information from batch that has been consumed
-        const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
-
-        {
-            std::unique_lock<std::mutex> ulock(main_lock);
-
-            status[b] = false;
-            indices[b] += big_batch_size;
-
-            condition.notify_one();
-        }
+        // Release the batch that has been consumed
+        pool.release(current / batch_size);
 
         current += batch_size;
     }
@@ -653,18 +714,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \return a a batch of data.
      */
     auto data_batch() const {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
-        const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
-
-        if (status[b]) {
-            return etl::slice(batch_cache(b), 0, std::min(batch_size, _size - current));
-        }
-
-        ready_condition.wait(ulock, [this, b] {
-            return status[b];
-        });
+        const auto b = pool.wait(current / batch_size);
 
         return etl::slice(batch_cache(b), 0, std::min(batch_size, _size - current));
     }
@@ -674,18 +724,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \return a a batch of label.
      */
     auto label_batch() const {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
-        const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
-
-        if (status[b]) {
-            return etl::slice(label_cache(b), 0, std::min(batch_size, _size - current));
-        }
-
-        ready_condition.wait(ulock, [this, b] {
-            return status[b];
-        });
+        const auto b = pool.wait(current / batch_size);
 
         return etl::slice(label_cache(b), 0, std::min(batch_size, _size - current));
     }
@@ -749,6 +788,11 @@ struct outmemory_data_generator_desc {
      */
     static constexpr bool Categorical = parameters::template contains<categorical>();
 
+    /*!
+     * \brief Indicates if the categorical labels are stored as class indices
+     */
+    static constexpr bool IndexLabels = parameters::template contains<index_labels>();
+
     /*!
      * \brief Indicates if horizontal mirroring should be used as augmentation.
      */
@@ -764,6 +808,26 @@ struct outmemory_data_generator_desc {
      */
     static constexpr bool Threaded = parameters::template contains<threaded>();
 
+    /*!
+     * \brief The number of producer threads (threaded or augmented generators only)
+     */
+    static constexpr size_t Workers = detail::get_value_v<workers<1>, Parameters...>;
+
+    /*!
+     * \brief Indicates if the next big batch is read in the background (non-threaded generators only)
+     */
+    static constexpr bool Prefetch = parameters::template contains<prefetch>();
+
+    /*!
+     * \brief Indicates if the producers use a lock-free ring (threaded or augmented generators only)
+     */
+    static constexpr bool LockFree = parameters::template contains<lock_free>();
+
+    /*!
+     * \brief Indicates if the caches are backed by huge pages
+     */
+    static constexpr bool HugePages = parameters::template contains<huge_pages>();
+
     /*!
      * \brief The random cropping X
      */
@@ -784,6 +848,11 @@ struct outmemory_data_generator_desc {
      */
     static constexpr size_t Noise = detail::get_value_v<noise<0>, Parameters...>;
 
+    /*!
+     * \brief The type of noise
+     */
+    static constexpr corruption_type Corruption = detail::get_value_v<corruption<corruption_type::MASKING>, Parameters...>;
+
     /*!
      * \brief The scaling
      */
@@ -806,6 +875,7 @@ struct outmemory_data_generator_desc {
 
     static_assert(BatchSize > 0, "The batch size must be larger than one");
     static_assert(BigBatchSize > 0, "The big batch size must be larger than one");
+    static_assert(Workers > 0, "The generator needs at least one worker");
     static_assert(!(AutoEncoder && (random_crop_x || random_crop_y)), "autoencoder mode is not compatible with random crop");
 
     //Make sure only valid types are passed to the configuration list
@@ -813,7 +883,7 @@ struct outmemory_data_generator_desc {
         detail::is_valid_v<
             cpp::type_list<
                 batch_size_id, big_batch_size_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id,
-                elastic_distortion_id, categorical_id, noise_id, threaded_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
+                elastic_distortion_id, categorical_id, index_labels_id, noise_id, corruption_id, threaded_id, workers_id, lock_free_id, prefetch_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id, huge_pages_id>,
             Parameters...>,
         "Invalid parameters type for rbm_desc");
 
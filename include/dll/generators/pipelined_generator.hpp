@@ -0,0 +1,291 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Generator filled in the background by a producer thread
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace dll {
+
+/*!
+ * \brief A generator whose samples are produced in the background, batch by
+ * batch, in the order of the samples.
+ *
+ * The batches can be consumed as soon as they are produced. The operations
+ * that need all the samples (shuffling, clearing) wait for the end of the
+ * production.
+ *
+ * \tparam Generator The type of the generator holding the samples
+ */
+template <typename Generator>
+struct pipelined_generator {
+    using generator_t = Generator;                      ///< The type of the generator holding the samples
+    using desc        = typename generator_t::desc;   ///< The generator descriptor
+    using weight      = typename generator_t::weight; ///< The data type
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static constexpr size_t batch_size = generator_t::batch_size; ///< The size of the generated batches
+
+    /*!
+     * \brief Create the generator and start the producer
+     * \param generator The generator holding the samples, its samples are set by the producer
+     * \param producer The producer, called with this generator on the producer thread, that must push all the samples
+     */
+    template <typename Producer>
+    pipelined_generator(std::unique_ptr<generator_t> generator, Producer producer) : generator(std::move(generator)) {
+        producer_thread = std::thread([this, producer]() mutable {
+            producer(*this);
+
+            std::lock_guard<std::mutex> l(lock);
+
+            done = true;
+            ready.notify_all();
+        });
+    }
+
+    pipelined_generator(const pipelined_generator& rhs) = delete;
+    pipelined_generator operator=(const pipelined_generator& rhs) = delete;
+
+    pipelined_generator(pipelined_generator&& rhs) = delete;
+    pipelined_generator operator=(pipelined_generator&& rhs) = delete;
+
+    /*!
+     * \brief Wait for the end of the production
+     */
+    ~pipelined_generator() {
+        wait_all();
+
+        if (producer_thread.joinable()) {
+            producer_thread.join();
+        }
+    }
+
+    /*!
+     * \brief Push the next batch of samples, the labels are the samples.
+     *
+     * This must only be called by the producer.
+     *
+     * \param batch The batch of samples
+     */
+    template <typename Batch>
+    void push(const Batch& batch) {
+        generator->set_data_batch(pushed, batch);
+        generator->set_label_batch(pushed, batch);
+
+        pushed += etl::dim<0>(batch);
+
+        std::lock_guard<std::mutex> l(lock);
+
+        produced = pushed;
+        ready.notify_all();
+    }
+
+    /*!
+     * \brief Wait until all the samples have been produced
+     */
+    void wait_all() const {
+        wait(size());
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Pipelined ";
+        return generator->display(stream);
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        generator->set_safe();
+    }
+
+    /*!
+     * \brier Clear the memory of the generator, once all the samples have
+     * been produced.
+     */
+    void clear() {
+        wait_all();
+        generator->clear();
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        generator->set_test();
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        generator->set_train();
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        generator->reset();
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples, once all
+     * the samples have been produced.
+     */
+    void reset_shuffle() {
+        wait_all();
+        generator->reset_shuffle();
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples, once all the samples have
+     * been produced.
+     */
+    void shuffle() {
+        wait_all();
+        generator->shuffle();
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        wait_all();
+        generator->prepare_epoch();
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return generator->current_batch();
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return generator->size();
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return generator->augmented_size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return generator->batches();
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return generator->has_next_batch();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        generator->next_batch();
+    }
+
+    /*!
+     * \brief Returns the current data batch, once it has been produced
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        wait_current();
+        return generator->data_batch();
+    }
+
+    /*!
+     * \brief Returns the current label batch, once it has been produced
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        wait_current();
+        return generator->label_batch();
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return generator_t::dimensions();
+    }
+
+private:
+    /*!
+     * \brief Wait for the production of the current batch
+     */
+    void wait_current() const {
+        const size_t current = generator->current_batch() * batch_size;
+
+        wait(std::min(current + batch_size, size()));
+    }
+
+    /*!
+     * \brief Wait until the first n samples have been produced
+     */
+    void wait(size_t n) const {
+        std::unique_lock<std::mutex> l(lock);
+
+        ready.wait(l, [this, n] { return done || produced >= n; });
+    }
+
+    std::unique_ptr<generator_t> generator; ///< The generator holding the samples
+
+    std::thread producer_thread; ///< The producer thread
+
+    mutable std::mutex lock;               ///< The lock protecting the production state
+    mutable std::condition_variable ready; ///< The condition for the consumer to wait for samples
+
+    size_t pushed   = 0;     ///< The number of samples pushed (producer only)
+    size_t produced = 0;     ///< The number of samples visible to the consumer
+    bool done       = false; ///< Indicates if the producer is done
+};
+
+} //end of dll namespace
@@ -0,0 +1,152 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Encoding of texts into sequences of indices (characters or words)
+ * and generators of their batches, for the embedding and the one-hot dense
+ * layers
+ */
+
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief The tokens of the encoding of a text
+ */
+enum class text_tokens {
+    CHARS, ///< Each character is a token
+    WORDS  ///< Each sequence of non-space characters is a token
+};
+
+/*!
+ * \brief The vocabulary of a text encoding, from the tokens to their
+ * indices. The first two indices are reserved for the padding and the
+ * unknown tokens.
+ */
+struct text_vocabulary {
+    static constexpr uint32_t padding = 0; ///< The index of the padding after the end of a text
+    static constexpr uint32_t unknown = 1; ///< The index of the tokens not in a frozen vocabulary
+
+    std::unordered_map<std::string, uint32_t> indices; ///< The index of each token
+    bool frozen = false;                               ///< Indicates if the new tokens are unknown instead of added
+
+    /*!
+     * \brief Returns the size of the vocabulary, with the reserved indices
+     */
+    size_t size() const {
+        return indices.size() + 2;
+    }
+
+    /*!
+     * \brief Returns the index of the given token, added to the vocabulary
+     * if it is not frozen
+     */
+    uint32_t index(const std::string& token) {
+        auto it = indices.find(token);
+
+        if (it != indices.end()) {
+            return it->second;
+        }
+
+        if (frozen) {
+            return unknown;
+        }
+
+        const auto i = uint32_t(size());
+
+        indices.emplace(token, i);
+
+        return i;
+    }
+};
+
+/*!
+ * \brief Encode the given text as the indices of its tokens into the given
+ * sample, truncated or padded to the size of the sample
+ *
+ * \param vocabulary The vocabulary, extended with the new tokens if it is not frozen
+ * \param text The text to encode
+ * \param tokens The tokens of the encoding
+ * \param sample The sample to fill with the indices
+ */
+template <typename Sample>
+void encode_text(text_vocabulary& vocabulary, const std::string& text, text_tokens tokens, Sample& sample) {
+    const size_t L = etl::size(sample);
+
+    size_t l = 0;
+
+    if (tokens == text_tokens::CHARS) {
+        std::string token(1, ' ');
+
+        for (size_t i = 0; i < text.size() && l < L; ++i) {
+            token[0]    = text[i];
+            sample[l++] = vocabulary.index(token);
+        }
+    } else {
+        size_t i = 0;
+
+        while (i < text.size() && l < L) {
+            while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i]))) {
+                ++i;
+            }
+
+            const size_t first = i;
+
+            while (i < text.size() && !std::isspace(static_cast<unsigned char>(text[i]))) {
+                ++i;
+            }
+
+            if (i > first) {
+                sample[l++] = vocabulary.index(text.substr(first, i - first));
+            }
+        }
+    }
+
+    for (; l < L; ++l) {
+        sample[l] = text_vocabulary::padding;
+    }
+}
+
+/*!
+ * \brief Make an in-memory generator of the given texts, each encoded as
+ * the indices of its first L tokens (padded).
+ *
+ * The batches are batches of indices (batch x L), the input of an
+ * embedding layer or of a one-hot dense layer, instead of their one-hot
+ * encoding (batch x L x V), so that their construction and the first layer
+ * are proportional to L instead of L x V.
+ *
+ * \tparam L The length of the sequences
+ *
+ * \param texts The texts
+ * \param labels The labels of the texts
+ * \param n_classes The number of classes
+ * \param vocabulary The vocabulary, extended with the new tokens if it is not frozen
+ * \param tokens The tokens of the encoding
+ * \param desc The descriptor of the generator
+ */
+template <size_t L, typename Label, typename... Parameters>
+auto make_text_index_generator(const std::vector<std::string>& texts, const std::vector<Label>& labels, size_t n_classes, text_vocabulary& vocabulary, text_tokens tokens,
+                               const inmemory_data_generator_desc<Parameters...>& desc) {
+    std::vector<etl::fast_dyn_matrix<float, L>> samples(texts.size());
+
+    for (size_t i = 0; i < texts.size(); ++i) {
+        encode_text(vocabulary, texts[i], tokens, samples[i]);
+    }
+
+    return make_generator(samples, labels, n_classes, desc);
+}
+
+} //end of dll namespace
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <atomic>
+#include <cmath>
 #include <thread>
 
 #include "cpp_utils/data.hpp"
@@ -182,4 +183,215 @@ struct pre_normalizer <Desc, std::enable_if_t<!Desc::NormalizePre>> {
     }
 };
 
+/*!
+ * \brief Fused transformer applying all the enabled pre-transforms
+ * (scaling, normalization and binarization) in a single traversal of
+ * each sample.
+ *
+ * The two-argument versions also transform the labels in the same loop in
+ * auto-encoder mode and leave them untouched otherwise.
+ */
+template<typename Desc>
+struct pre_transformer {
+    static constexpr size_t S       = Desc::ScalePre;     ///< The scaling factor
+    static constexpr size_t B       = Desc::BinarizePre;  ///< The binarization threshold
+    static constexpr bool Normalize = Desc::NormalizePre; ///< Indicates if the samples are normalized
+
+    static constexpr bool enabled = S || B || Normalize; ///< Indicates if any transform is enabled
+
+    /*!
+     * \brief Apply the transform on one sample
+     * \param target The sample to transform
+     */
+    template<typename O>
+    static void transform(O&& target){
+        if constexpr (enabled) {
+            if constexpr (Normalize) {
+                normalize_and_binarize(target);
+            } else {
+                for(auto& x : target){
+                    x = apply(x);
+                }
+            }
+        } else {
+            cpp_unused(target);
+        }
+    }
+
+    /*!
+     * \brief Apply the transform on one sample and on its label in
+     * auto-encoder mode
+     * \param target The sample to transform
+     * \param label The label of the sample
+     */
+    template<typename O, typename L>
+    static void transform(O&& target, L&& label){
+        if constexpr (enabled && Desc::AutoEncoder) {
+            if constexpr (Normalize) {
+                normalize_and_binarize(target);
+                normalize_and_binarize(label);
+            } else {
+                const size_t n = etl::size(target);
+
+                for(size_t i = 0; i < n; ++i){
+                    target[i] = apply(target[i]);
+                    label[i]  = apply(label[i]);
+                }
+            }
+        } else {
+            transform(target);
+            cpp_unused(label);
+        }
+    }
+
+    /*!
+     * \brief Apply the transform on all the samples
+     * \param target The samples to transform
+     */
+    template<typename O>
+    static void transform_all(O&& target){
+        if constexpr (enabled) {
+            for(size_t i = 0; i < etl::dim<0>(target); ++i){
+                transform(target(i));
+            }
+        } else {
+            cpp_unused(target);
+        }
+    }
+
+    /*!
+     * \brief Apply the transform on all the samples and on their labels in
+     * auto-encoder mode
+     * \param target The samples to transform
+     * \param labels The labels of the samples
+     */
+    template<typename O, typename L>
+    static void transform_all(O&& target, L&& labels){
+        if constexpr (enabled && Desc::AutoEncoder) {
+            for(size_t i = 0; i < etl::dim<0>(target); ++i){
+                transform(target(i), labels(i));
+            }
+        } else {
+            transform_all(target);
+            cpp_unused(labels);
+        }
+    }
+
+    /*!
+     * \brief Convert a sample from its storage type and apply the
+     * transform, in the same pass when possible
+     * \param target The converted sample
+     * \param source The stored sample
+     */
+    template<typename O, typename I>
+    static void widen(O&& target, const I& source){
+        using T = etl::value_t<std::decay_t<O>>;
+
+        const size_t n = etl::size(target);
+
+        T* out         = target.memory_start();
+        const auto* in = source.memory_start();
+
+        for(size_t i = 0; i < n; ++i){
+            out[i] = element<T>(in[i]);
+        }
+
+        finalize(target);
+    }
+
+    /*!
+     * \brief Convert a single value and apply the transform on it. With
+     * normalization, the value is only converted and finalize() must be
+     * called on the complete sample.
+     * \param x The value to convert
+     * \return The transformed value
+     */
+    template<typename T, typename V>
+    static T element(V x){
+        if constexpr (Normalize) {
+            return T(x);
+        } else {
+            return apply(T(x));
+        }
+    }
+
+    /*!
+     * \brief Finish the transform of a sample whose values have been
+     * passed through element()
+     * \param target The sample to transform
+     */
+    template<typename O>
+    static void finalize(O&& target){
+        if constexpr (Normalize) {
+            normalize_and_binarize(target);
+        } else {
+            cpp_unused(target);
+        }
+    }
+
+    /*!
+     * \brief Apply the transform on the label of a sample, only in
+     * auto-encoder mode
+     * \param label The label to transform
+     */
+    template<typename L>
+    static void transform_label(L&& label){
+        if constexpr (Desc::AutoEncoder) {
+            transform(label);
+        } else {
+            cpp_unused(label);
+        }
+    }
+
+private:
+    /*!
+     * \brief Scale and binarize a single value
+     */
+    template<typename T>
+    static T apply(T x){
+        if constexpr (S != 0) {
+            x /= S;
+        }
+
+        if constexpr (B != 0) {
+            x = x > B ? 1.0 : 0.0;
+        }
+
+        return x;
+    }
+
+    /*!
+     * \brief Normalize a sample to zero-mean and unit variance, binarizing
+     * it in the same final pass.
+     *
+     * Scaling is skipped since it does not change the normalized values.
+     */
+    template<typename O>
+    static void normalize_and_binarize(O&& target){
+        const double n = etl::size(target);
+
+        double mean = 0.0;
+        for(auto x : target){
+            mean += x;
+        }
+        mean /= n;
+
+        double var = 0.0;
+        for(auto x : target){
+            var += (x - mean) * (x - mean);
+        }
+
+        const double stddev = std::sqrt(var / n);
+        const double inv    = stddev != 0.0 ? 1.0 / stddev : 1.0;
+
+        for(auto& x : target){
+            x = (x - mean) * inv;
+
+            if constexpr (B != 0) {
+                x = x > B ? 1.0 : 0.0;
+            }
+        }
+    }
+};
+
 } //end of dll namespace
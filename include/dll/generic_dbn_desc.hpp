@@ -48,6 +48,33 @@ struct generic_dbn_desc {
      */
     static constexpr size_t BigBatchSize = detail::get_value_v<big_batch_size<1>, Parameters...>;
 
+    /*!
+     * \brief The number of shards of each batch for data-parallel training
+     */
+    static constexpr size_t DataParallel = detail::get_value_v<data_parallel<1>, Parameters...>;
+
+    /*!
+     * \brief The maximum number of batches in flight for asynchronous SGD
+     */
+    static constexpr size_t Staleness = detail::get_value_v<staleness<0>, Parameters...>;
+
+    /*!
+     * \brief The number of physical cores dedicated to the producers
+     */
+    static constexpr size_t ProducerCores = detail::get_value_v<producer_cores<0>, Parameters...>;
+
+    /*!
+     * \brief The number of batches in flight in the staged training, 0 to
+     * train without stages
+     */
+    static constexpr size_t StagedTraining = detail::get_value_v<staged_training<0>, Parameters...>;
+
+    /*!
+     * \brief The number of layers frozen during the fine-tuning, at the
+     * beginning of the network
+     */
+    static constexpr size_t FrozenLayers = detail::get_value_v<frozen_layers<0>, Parameters...>;
+
     /*!
      * \brief The pre scaling factor
      */
@@ -58,6 +85,11 @@ struct generic_dbn_desc {
      */
     static constexpr size_t Noise = detail::get_value_v<noise<0>, Parameters...>;
 
+    /*!
+     * \brief The type of noise
+     */
+    static constexpr corruption_type Corruption = detail::get_value_v<corruption<corruption_type::MASKING>, Parameters...>;
+
     /*!
      * \brief The pre binarization thresholding
      */
@@ -93,6 +125,8 @@ struct generic_dbn_desc {
 
     using output_policy_t = detail::get_type_t<output_policy<default_output_policy>, Parameters...>; ///< The output policy
 
+    using pretrain_cache_t = detail::get_type_t<pretrain_cache<void>, Parameters...>; ///< The storage type of the pretraining cache (void if disabled)
+
     /*! The DBN type */
     using dbn_t = DBN_T<generic_dbn_desc<DBN_T, Layers, Parameters...>>;
 
@@ -113,8 +147,10 @@ struct generic_dbn_desc {
             cpp::type_list<
                 trainer_id, watcher_id, weight_decay_id, big_batch_size_id, batch_size_id, verbose_id, no_epoch_error_id,
                 batch_mode_id, svm_concatenate_id, svm_scale_id, serial_id, shuffle_id, shuffle_pre_id, loss_id,
-                normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id, noise_id, updater_id,
-                early_stopping_id, early_training_id, clip_gradients_id, output_policy_id>,
+                normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id, noise_id, corruption_id, updater_id,
+                early_stopping_id, early_training_id, async_validation_id, data_parallel_id, staleness_id,
+                pipelined_updates_id, lazy_updates_id, clip_gradients_id, output_policy_id, pretrain_cache_id, pretrain_pipeline_id, huge_pages_id,
+                pin_threads_id, producer_cores_id, no_smt_id, staged_training_id, frozen_layers_id, gpu_resident_id, sync_batch_norm_id>,
             Parameters...>,
         "Invalid parameters type");
 };
@@ -124,3 +160,4 @@ struct generic_dbn_desc {
 // Include the trainers
 #include "dll/trainer/conjugate_gradient.hpp"
 #include "dll/trainer/stochastic_gradient_descent.hpp"
+#include "dll/trainer/async_sgd_trainer.hpp"
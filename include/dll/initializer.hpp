@@ -5,7 +5,14 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <vector>
+
 #include "dll/util/random.hpp"
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
 
 /*!
  * \brief Initialization methods
@@ -15,6 +22,147 @@
 
 namespace dll {
 
+/*!
+ * \brief The number of values of each chunk of the random initializations,
+ * drawn from its own engine
+ */
+constexpr size_t init_chunk = 1UL << 16;
+
+/*!
+ * \brief The random initializations deferred until the end of the
+ * construction of a network, to fill the chunks of all its layers
+ * concurrently.
+ *
+ * While the object is alive (and until run() is called), random_fill()
+ * records the initializations made on the current thread instead of
+ * computing them.
+ */
+struct deferred_initialization {
+    /*!
+     * \brief Start deferring the initializations of the current thread
+     */
+    deferred_initialization() : previous(current()) {
+        current() = this;
+    }
+
+    deferred_initialization(const deferred_initialization& rhs) = delete;
+    deferred_initialization& operator=(const deferred_initialization& rhs) = delete;
+
+    /*!
+     * \brief Stop deferring the initializations, the ones that were not
+     * run are discarded (their weights may not exist anymore)
+     */
+    ~deferred_initialization() {
+        stop();
+    }
+
+    /*!
+     * \brief Record the initialization of the given number of chunks
+     */
+    void add(size_t chunks, std::function<void(size_t)> fill) {
+        fills.emplace_back(chunks, std::move(fill));
+    }
+
+    /*!
+     * \brief Stop deferring the initializations and compute the recorded
+     * ones, the chunks of all the initializations being filled in parallel
+     * on the given thread pool
+     */
+    template <typename TP>
+    void run(TP& pool) {
+        stop();
+
+        std::vector<std::pair<size_t, size_t>> chunks;
+
+        for (size_t f = 0; f < fills.size(); ++f) {
+            for (size_t c = 0; c < fills[f].first; ++c) {
+                chunks.emplace_back(f, c);
+            }
+        }
+
+        dll::maybe_parallel_foreach_n(pool, 0, chunks.size(), [this, &chunks](size_t i) {
+            fills[chunks[i].first].second(chunks[i].second);
+        });
+
+        fills.clear();
+    }
+
+    /*!
+     * \brief Returns the deferred initializations of the current thread, if any
+     */
+    static deferred_initialization*& current() {
+        thread_local deferred_initialization* inits = nullptr;
+        return inits;
+    }
+
+private:
+    /*!
+     * \brief Stop deferring the initializations of the current thread
+     */
+    void stop() {
+        if (current() == this) {
+            current() = previous;
+        }
+    }
+
+    std::vector<std::pair<size_t, std::function<void(size_t)>>> fills; ///< The number of chunks and the filler of each initialization
+    deferred_initialization* previous;                                 ///< The deferred initializations of the enclosing scope
+};
+
+/*!
+ * \brief Fill the given weights with values drawn from the given
+ * distribution.
+ *
+ * The values are split in chunks of init_chunk values, each drawn from its
+ * own engine seeded with one draw of rand_engine() and the index of the
+ * chunk, so that they only depend on the state of rand_engine() and not on
+ * the number of threads. The chunks are filled in parallel on the scoped
+ * thread pool, if any, or deferred with the initializations of the network
+ * being constructed.
+ *
+ * \param b The weights to fill
+ * \param distribution The distribution of the values
+ */
+template <typename B, typename Distribution>
+void random_fill(B& b, const Distribution& distribution) {
+    static_assert(etl::is_dma<B>, "random_fill needs direct memory access");
+
+    const uint64_t key  = rand_engine()();
+    const size_t n      = etl::size(b);
+    const size_t chunks = (n + init_chunk - 1) / init_chunk;
+
+    b.ensure_cpu_up_to_date();
+    b.invalidate_gpu();
+
+    auto fill = [&b, key, n, distribution](size_t c) {
+        // The weights were reallocated, and initialized again, since
+        if (etl::size(b) != n) {
+            return;
+        }
+
+        random_engine engine(detail::mix_bits(detail::mix_bits(key) + c));
+        auto dist = distribution;
+
+        auto* values = b.memory_start();
+
+        const size_t last = std::min(n, (c + 1) * init_chunk);
+
+        for (size_t i = c * init_chunk; i < last; ++i) {
+            values[i] = dist(engine);
+        }
+    };
+
+    if (auto* inits = deferred_initialization::current()) {
+        inits->add(chunks, fill);
+    } else if (auto* pool = scoped_thread_pool(); pool && chunks > 1) {
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, fill);
+    } else {
+        for (size_t c = 0; c < chunks; ++c) {
+            fill(c);
+        }
+    }
+}
+
 /*!
  * \brief Initialization function no-op
  */
@@ -85,7 +233,7 @@ struct init_normal {
         constexpr auto mean   = etl::value_t<B>(Mean::num) / etl::value_t<B>(Mean::den);
         constexpr auto stddev = etl::value_t<B>(Std::num) / etl::value_t<B>(Std::den);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), mean, stddev);
+        random_fill(b, std::normal_distribution<etl::value_t<B>>(mean, stddev));
     }
 };
 
@@ -109,7 +257,7 @@ struct init_uniform {
         constexpr auto a = etl::value_t<W>(A::num) / etl::value_t<W>(A::den);
         constexpr auto b = etl::value_t<W>(B::num) / etl::value_t<W>(B::den);
 
-        w = etl::uniform_generator<etl::value_t<W>>(dll::rand_engine(), a, b);
+        random_fill(w, std::uniform_real_distribution<etl::value_t<W>>(a, b));
     }
 };
 
@@ -130,7 +278,7 @@ struct init_lecun {
     static void initialize(B& b, size_t nin, size_t nout){
         cpp_unused(nout);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) / sqrt(double(nin));
+        random_fill(b, std::normal_distribution<etl::value_t<B>>(0.0, 1.0 / sqrt(double(nin))));
     }
 };
 
@@ -149,7 +297,7 @@ struct init_xavier {
     static void initialize(B& b, size_t nin, size_t nout){
         cpp_unused(nout);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) * sqrt(1.0 / nin);
+        random_fill(b, std::normal_distribution<etl::value_t<B>>(0.0, sqrt(1.0 / nin)));
     }
 };
 
@@ -166,7 +314,7 @@ struct init_xavier_full {
      */
     template<typename B>
     static void initialize(B& b, size_t nin, size_t nout){
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) * sqrt(2.0 / (nin + nout));
+        random_fill(b, std::normal_distribution<etl::value_t<B>>(0.0, sqrt(2.0 / (nin + nout))));
     }
 };
 
@@ -185,7 +333,7 @@ struct init_he {
     static void initialize(B& b, size_t nin, size_t nout){
         cpp_unused(nout);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) * sqrt(2.0 / nin);
+        random_fill(b, std::normal_distribution<etl::value_t<B>>(0.0, sqrt(2.0 / nin)));
     }
 };
 
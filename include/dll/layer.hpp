@@ -8,6 +8,7 @@
 #pragma once
 
 #include <memory>
+#include <type_traits>
 
 #include "etl/etl.hpp" // Every layer needs ETL
 
@@ -29,6 +30,21 @@ T& unique_safe_get(std::unique_ptr<T>& ptr) {
     return *ptr;
 }
 
+/*!
+ * \brief Traits indicating if a layer has a latency-optimized kernel to
+ * forward propagate a single sample, instead of a batch of one sample
+ */
+template <typename Layer, typename Enable = void>
+struct has_forward_one_direct : std::false_type {};
+
+/*!
+ * \copydoc has_forward_one_direct
+ */
+template <typename Layer>
+struct has_forward_one_direct<Layer, std::void_t<decltype(std::declval<const Layer&>().forward_one_direct(
+                                          std::declval<etl::dyn_matrix<typename Layer::weight, 1>&>(),
+                                          std::declval<const etl::dyn_matrix<typename Layer::weight, 1>&>()))>> : std::true_type {};
+
 /*!
  * \brief A layer in a neural network
  */
@@ -130,7 +146,11 @@ struct layer {
      */
     template <typename Input, typename Output>
     void test_forward_one(Output&& output, const Input& input) const {
-        as_derived().test_forward_batch(batch_reshape(output), batch_reshape(input));
+        if constexpr (has_forward_one_direct<parent_t>::value) {
+            as_derived().forward_one_direct(output, input);
+        } else {
+            as_derived().test_forward_batch(batch_reshape(output), batch_reshape(input));
+        }
     }
 
     /*!
@@ -157,7 +177,7 @@ struct layer {
         if constexpr (Train) {
             as_derived().train_forward_batch(batch_reshape(output), batch_reshape(input));
         } else {
-            as_derived().test_forward_batch(batch_reshape(output), batch_reshape(input));
+            test_forward_one(output, input);
         }
     }
 
@@ -409,6 +429,13 @@ struct layer {
         // Nothing by default
     }
 
+    /*!
+     * \brief Swap the weights with the secondary weights matrix
+     */
+    void swap_weights() const {
+        // Nothing by default
+    }
+
 private:
     //CRTP Deduction
 
@@ -29,6 +29,12 @@ struct conv_rbm_mp_impl;
 template <typename Desc>
 struct dyn_conv_rbm_mp_impl;
 
+template <typename Desc>
+struct mp_1d_layer_impl;
+
+template <typename Desc>
+struct dyn_mp_1d_layer_impl;
+
 template <typename Desc>
 struct mp_3d_layer_impl;
 
@@ -68,18 +74,69 @@ struct dyn_lcn_layer_impl;
 template <typename Desc>
 struct scale_layer_impl;
 
+template <typename Desc>
+struct dropout_layer_impl;
+
+template <typename Desc>
+struct dyn_dropout_layer_impl;
+
 template <typename Desc>
 struct dense_layer_impl;
 
 template <typename Desc>
 struct dyn_dense_layer_impl;
 
+template <typename Desc>
+struct tied_dense_layer_impl;
+
 template <typename Desc>
 struct conv_layer_impl;
 
 template <typename Desc>
 struct dyn_conv_layer_impl;
 
+template <typename Desc>
+struct conv_mp_layer_impl;
+
+template <typename Desc>
+struct conv_same_layer_impl;
+
+template <typename Desc>
+struct dyn_conv_same_layer_impl;
+
+template <typename Desc>
+struct upsample_conv_layer_impl;
+
+template <typename Desc>
+struct one_hot_dense_layer_impl;
+
+template <typename Desc>
+struct conv_1d_layer_impl;
+
+template <typename Desc>
+struct dyn_conv_1d_layer_impl;
+
+template <typename Desc>
+struct sampled_softmax_layer_impl;
+
+template <typename Desc>
+struct depthwise_conv_layer_impl;
+
+template <typename Desc>
+struct dyn_depthwise_conv_layer_impl;
+
+template <typename Desc>
+struct batch_normalization_2d_layer_impl;
+
+template <typename Desc>
+struct dyn_batch_normalization_2d_layer_impl;
+
+template <typename Desc>
+struct batch_normalization_4d_layer_impl;
+
+template <typename Desc>
+struct dyn_batch_normalization_4d_layer_impl;
+
 template <typename Desc>
 struct deconv_layer_impl;
 
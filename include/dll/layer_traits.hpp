@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include "etl/etl.hpp"
+
 #include "util/tmp.hpp"
 #include "base_traits.hpp"
 #include "layer_fwd.hpp"
@@ -407,4 +409,161 @@ constexpr size_t input_size(const RBM&) {
     return RBM::input_size();
 }
 
+/*!
+ * \brief Traits indicating if a layer only reinterprets the shape of its
+ * input, its output being a view of its input (alias_batch)
+ */
+template <typename Layer, typename Enable = void>
+struct is_alias_layer : std::false_type {};
+
+/*!
+ * \copydoc is_alias_layer
+ */
+template <typename Layer>
+struct is_alias_layer<Layer, std::void_t<decltype(std::declval<const Layer&>().alias_batch(std::declval<etl::dyn_matrix<typename Layer::weight, 2>&>()))>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the given (possibly cv-qualified reference) type is a
+ * layer that only reinterprets the shape of its input
+ */
+template <typename Layer>
+constexpr bool is_alias_layer_v = is_alias_layer<std::decay_t<Layer>>::value;
+
+/*!
+ * \brief Traits indicating if a layer uses the transposed weights of another
+ * layer of the network (its encoder), whose index is Layer::encoder
+ */
+template <typename Layer, typename Enable = void>
+struct is_tied_layer : std::false_type {};
+
+/*!
+ * \copydoc is_tied_layer
+ */
+template <typename Layer>
+struct is_tied_layer<Layer, std::void_t<decltype(Layer::encoder)>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the given (possibly cv-qualified reference) type is a
+ * tied layer
+ */
+template <typename Layer>
+constexpr bool is_tied_layer_v = is_tied_layer<std::decay_t<Layer>>::value;
+
+/*!
+ * \brief Traits indicating if an elementwise layer can be computed in place,
+ * on its input (forward_batch_in_place). Its backward pass does not need its
+ * input.
+ */
+template <typename Layer, typename Enable = void>
+struct is_in_place_layer : std::false_type {};
+
+/*!
+ * \copydoc is_in_place_layer
+ */
+template <typename Layer>
+struct is_in_place_layer<Layer, std::enable_if_t<Layer::in_place>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the given (possibly cv-qualified reference) type is a
+ * layer that can be computed in place
+ */
+template <typename Layer>
+constexpr bool is_in_place_layer_v = is_in_place_layer<std::decay_t<Layer>>::value;
+
+/*!
+ * \brief Traits indicating if an elementwise layer can be fused with the
+ * next elementwise layers in a single expression (fused_expr)
+ */
+template <typename Layer, typename Enable = void>
+struct is_fusable_layer : std::false_type {};
+
+/*!
+ * \copydoc is_fusable_layer
+ */
+template <typename Layer>
+struct is_fusable_layer<Layer, std::enable_if_t<Layer::fusable>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the given (possibly cv-qualified reference) type is a
+ * layer that can be fused with the next elementwise layers
+ */
+template <typename Layer>
+constexpr bool is_fusable_layer_v = is_fusable_layer<std::decay_t<Layer>>::value;
+
+/*!
+ * \brief Traits indicating if a layer only keeps the last time step of its
+ * input (last_step). Its backward pass does not need its input.
+ */
+template <typename Layer, typename Enable = void>
+struct is_last_step_layer : std::false_type {};
+
+/*!
+ * \copydoc is_last_step_layer
+ */
+template <typename Layer>
+struct is_last_step_layer<Layer, std::enable_if_t<Layer::last_step>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the given (possibly cv-qualified reference) type is a
+ * layer that only keeps the last time step of its input
+ */
+template <typename Layer>
+constexpr bool is_last_step_layer_v = is_last_step_layer<std::decay_t<Layer>>::value;
+
+/*!
+ * \brief Traits indicating if a recurrent layer can backpropagate the errors
+ * of its last time step only, without reading the other time steps of its
+ * errors (sparse_last_step)
+ */
+template <typename Layer, typename Enable = void>
+struct is_sparse_last_step_layer : std::false_type {};
+
+/*!
+ * \copydoc is_sparse_last_step_layer
+ */
+template <typename Layer>
+struct is_sparse_last_step_layer<Layer, std::enable_if_t<Layer::sparse_last_step>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the given (possibly cv-qualified reference) type is a
+ * recurrent layer that can backpropagate the errors of its last time step only
+ */
+template <typename Layer>
+constexpr bool is_sparse_last_step_layer_v = is_sparse_last_step_layer<std::decay_t<Layer>>::value;
+
+/*!
+ * \brief Traits indicating if a layer computes its training output, errors
+ * and loss on a sample of the classes, from the labels (sampled_output).
+ */
+template <typename Layer, typename Enable = void>
+struct is_sampled_output_layer : std::false_type {};
+
+/*!
+ * \copydoc is_sampled_output_layer
+ */
+template <typename Layer>
+struct is_sampled_output_layer<Layer, std::enable_if_t<Layer::sampled_output>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the given (possibly cv-qualified reference) type is a
+ * layer that is trained on a sample of the classes
+ */
+template <typename Layer>
+constexpr bool is_sampled_output_layer_v = is_sampled_output_layer<std::decay_t<Layer>>::value;
+
+/*!
+ * \brief Indicates if the Lth layer of the network only keeps the last time
+ * step of the recurrent layer before it, which then only reads the errors
+ * of its last time step. The other time steps of its errors are neither
+ * cleared nor read.
+ */
+template <typename DBN, size_t L>
+constexpr bool sparse_last_step_errors() {
+    if constexpr (L > 0 && L < DBN::layers) {
+        return is_last_step_layer_v<typename DBN::template layer_type<L>> && is_sparse_last_step_layer_v<typename DBN::template layer_type<L - 1>>;
+    } else {
+        return false;
+    }
+}
+
 } //end of dll namespace
@@ -25,6 +25,8 @@ struct activation_layer_impl : transform_layer<activation_layer_impl<Desc>> {
     using dyn_layer_t = typename desc::dyn_layer_t;                   ///< The dynamic version of this layer
 
     static constexpr function activation_function = desc::activation_function;
+    static constexpr bool in_place                = activation_function != function::SOFTMAX; ///< Indicates if the layer can be computed in place
+    static constexpr bool fusable                 = in_place;                                 ///< Indicates if the layer can be fused with the next elementwise layers
 
     activation_layer_impl() = default;
 
@@ -60,6 +62,24 @@ struct activation_layer_impl : transform_layer<activation_layer_impl<Desc>> {
         output = f_activate<activation_function>(input);
     }
 
+    /*!
+     * \brief Returns the expression of the layer applied to the given
+     * expression, to fuse the layer with the next elementwise layers
+     */
+    template <typename E>
+    static decltype(auto) fused_expr(E&& e) {
+        return f_activate<activation_function>(std::forward<E>(e));
+    }
+
+    /*!
+     * \brief Apply the layer in place to the given batch
+     * \param x The batch, replaced by the output of the layer
+     */
+    template <typename X>
+    static void forward_batch_in_place(X&& x) {
+        x = f_activate<activation_function>(x);
+    }
+
     /*!
      * \brief Adapt the errors, called before backpropagation of the errors.
      *
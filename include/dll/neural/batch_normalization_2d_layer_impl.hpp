@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/util/batch_norm.hpp"
 
 namespace dll {
 
@@ -45,6 +46,13 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
 
     weight momentum = 0.9;
 
+    mutable bn_inference_cache<weight> test_cache; ///< The test-time transformation, computed once from the parameters
+
+    bool folded = false; ///< Indicates if the layer has been folded into the preceding layer
+
+    distributed_transport* sync = nullptr; ///< The transport synchronizing the statistics over the ranks, if any
+    size_t last_samples         = 0;       ///< The number of values of each unit in the statistics of the last batch
+
     //Backup gamma and beta
     std::unique_ptr<etl::fast_matrix<weight, Input>> bak_gamma; ///< Backup gamma
     std::unique_ptr<etl::fast_matrix<weight, Input>> bak_beta;  ///< Backup beta
@@ -120,10 +128,15 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
 
         const auto B = etl::dim<0>(input);
 
-        auto inv_var = etl::force_temporary(1.0 / etl::sqrt(var + e));
+        if (folded) {
+            output = input;
+            return;
+        }
+
+        test_cache.update(gamma, beta, mean, var, e);
 
         for(size_t b = 0; b < B; ++b){
-            output(b) = (gamma >> ((input(b) - mean) >> inv_var)) + beta;
+            output(b) = (input(b) >> test_cache.scale) + test_cache.shift;
         }
     }
 
@@ -134,24 +147,42 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
      */
     template <typename Input, typename Output>
     void train_forward_batch(Output& output, const Input& input) {
+        cpp_assert(!folded, "A folded batch normalization layer cannot be trained");
+
         dll::auto_timer timer("bn:2d:train:forward");
 
         const auto B = etl::dim<0>(input);
 
-        last_mean = etl::bias_batch_mean_2d(input);
-        last_var  = etl::bias_batch_var_2d(input, last_mean);
-        inv_var   = 1.0 / etl::sqrt(last_var + e);
-
         input_pre.inherit_if_null(input);
 
-        for(size_t b = 0; b < B; ++b){
-            input_pre(b) = (input(b) - last_mean) >> inv_var;
-            output(b)    = (input_pre(b) >> gamma) + beta;
+        if constexpr (etl::is_dma<Input> && etl::is_dma<Output>) {
+            // One pass for the statistics and one for the normalization
+            bn_statistics_2d(input, last_mean, last_var);
+
+            last_samples = bn_sync_statistics(*this, B);
+
+            inv_var = 1.0 / etl::sqrt(last_var + e);
+
+            bn_normalize_2d(input, last_mean, inv_var, gamma, beta, input_pre, output);
+        } else {
+            last_mean = etl::bias_batch_mean_2d(input);
+            last_var  = etl::bias_batch_var_2d(input, last_mean);
+
+            last_samples = bn_sync_statistics(*this, B);
+
+            inv_var = 1.0 / etl::sqrt(last_var + e);
+
+            for(size_t b = 0; b < B; ++b){
+                input_pre(b) = (input(b) - last_mean) >> inv_var;
+                output(b)    = (input_pre(b) >> gamma) + beta;
+            }
         }
 
         // Update the current mean and variance
         mean = momentum * mean + (1.0 - momentum) * last_mean;
-        var  = momentum * var + (1.0 - momentum) * (B / (B - 1) * last_var);
+        var  = momentum * var + (1.0 - momentum) * (last_samples / (last_samples - 1) * last_var);
+
+        test_cache.invalidate();
     }
 
     /*!
@@ -183,8 +214,16 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
         dbeta  = bias_batch_sum_2d(context.errors);
         dgamma = bias_batch_sum_2d(input_pre >> context.errors);
 
+        // With synchronized statistics, the sums are over the whole batch of all the ranks
+        auto gamma_sum = etl::force_temporary(dgamma);
+        auto beta_sum  = etl::force_temporary(dbeta);
+
+        bn_sync_sums(*this, gamma_sum, beta_sum);
+
+        const auto N = sync ? last_samples : B;
+
         for(size_t b = 0; b < B; ++b){
-            output(b) = (1.0 / B) >> inv_var >> gamma >> ((B >> context.errors(b)) - (input_pre(b) >> dgamma) - dbeta);
+            output(b) = (1.0 / N) >> inv_var >> gamma >> ((N >> context.errors(b)) - (input_pre(b) >> gamma_sum) - beta_sum);
         }
     }
 
@@ -243,6 +282,9 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
      * \return a tuple containing references to the variables of this layer
      */
     decltype(auto) trainable_parameters(){
+        // The parameters may be modified through the references
+        invalidate_weights_cache();
+
         return std::make_tuple(std::ref(gamma), std::ref(beta));
     }
 
@@ -268,6 +310,56 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
     void restore_weights() {
         gamma = *bak_gamma;
         beta  = *bak_beta;
+
+        invalidate_weights_cache();
+    }
+
+    /*!
+     * \brief Swap the weights with the secondary weights matrix, restoring
+     * the backup in constant time. The secondary weights matrix holds the
+     * replaced weights afterwards.
+     */
+    void swap_weights() {
+        std::swap(gamma, *bak_gamma);
+        std::swap(beta, *bak_beta);
+
+        invalidate_weights_cache();
+    }
+
+    /*!
+     * \brief Invalidate the test-time transformation, after a modification
+     * of the parameters
+     */
+    void invalidate_weights_cache() {
+        test_cache.invalidate();
+    }
+
+    /*!
+     * \brief Indicates if the layer can be folded into the given preceding
+     * layer
+     */
+    template <typename L>
+    static constexpr bool foldable_into() {
+        return bn_foldable<L, 2>();
+    }
+
+    /*!
+     * \brief Fold the test-time transformation of the layer into the weights
+     * and biases of the preceding layer. The layer is then the identity and
+     * cannot be trained anymore.
+     * \param layer The preceding layer
+     */
+    template <typename L>
+    void fold_into(L& layer) {
+        static_assert(foldable_into<L>(), "The batch normalization cannot be folded into this layer");
+
+        cpp_assert(!folded, "The batch normalization layer is already folded");
+
+        test_cache.update(gamma, beta, mean, var, e);
+
+        bn_fold_dense(layer, test_cache.scale, test_cache.shift);
+
+        folded = true;
     }
 };
 
@@ -8,6 +8,8 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/util/arena.hpp"
+#include "dll/util/batch_norm.hpp"
 
 namespace dll {
 
@@ -47,6 +49,13 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
 
     weight momentum = 0.9;
 
+    mutable bn_inference_cache<weight> test_cache; ///< The test-time transformation, computed once from the parameters
+
+    bool folded = false; ///< Indicates if the layer has been folded into the preceding layer
+
+    distributed_transport* sync = nullptr; ///< The transport synchronizing the statistics over the ranks, if any
+    size_t last_samples         = 0;       ///< The number of values of each unit in the statistics of the last batch
+
     //Backup gamma and beta
     std::unique_ptr<etl::fast_matrix<weight, Kernels>> bak_gamma; ///< Backup gamma
     std::unique_ptr<etl::fast_matrix<weight, Kernels>> bak_beta;  ///< Backup beta
@@ -120,11 +129,16 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
     void test_forward_batch(Output& output, const Input& input) const {
         const auto B = etl::dim<0>(input);
 
-        auto inv_var = etl::force_temporary(1.0 / etl::sqrt(var + e));
+        if (folded) {
+            output = input;
+            return;
+        }
+
+        test_cache.update(gamma, beta, mean, var, e);
 
         for (size_t b = 0; b < B; ++b) {
             for (size_t k = 0; k < Kernels; ++k) {
-                output(b)(k) = (gamma(k) >> ((input(b)(k) - mean(k)) >> inv_var(k))) + beta(k);
+                output(b)(k) = (test_cache.scale(k) >> input(b)(k)) + test_cache.shift(k);
             }
         }
     }
@@ -136,39 +150,54 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
      */
     template <typename Input, typename Output>
     void train_forward_batch(Output& output, const Input& input) {
-        cpp_unused(output);
+        cpp_assert(!folded, "A folded batch normalization layer cannot be trained");
 
         const auto B = etl::dim<0>(input);
         const auto S = B * W * H;
 
-        // Compute the mean of the mini-batch
-        last_mean = etl::bias_batch_mean_4d(input);
+        input_pre.inherit_if_null(input);
 
-        // Compute the variance of the mini-batch
-        last_var  = 0;
+        if constexpr (etl::is_dma<Input> && etl::is_dma<Output>) {
+            // One pass for the statistics and one for the normalization
+            bn_statistics_4d(input, last_mean, last_var);
 
-        for (size_t b = 0; b < B; ++b) {
-            for (size_t k = 0; k < Kernels; ++k) {
-                last_var(k) += etl::sum((input(b)(k) - last_mean(k)) >> (input(b)(k) - last_mean(k)));
+            last_samples = bn_sync_statistics(*this, S);
+
+            inv_var = 1.0 / etl::sqrt(last_var + e);
+
+            bn_normalize_4d(input, last_mean, inv_var, gamma, beta, input_pre, output);
+        } else {
+            // Compute the mean of the mini-batch
+            last_mean = etl::bias_batch_mean_4d(input);
+
+            // Compute the variance of the mini-batch
+            last_var  = 0;
+
+            for (size_t b = 0; b < B; ++b) {
+                for (size_t k = 0; k < Kernels; ++k) {
+                    last_var(k) += etl::sum((input(b)(k) - last_mean(k)) >> (input(b)(k) - last_mean(k)));
+                }
             }
-        }
 
-        last_var /= S;
+            last_var /= S;
 
-        inv_var  = 1.0 / etl::sqrt(last_var + e);
+            last_samples = bn_sync_statistics(*this, S);
 
-        input_pre.inherit_if_null(input);
+            inv_var  = 1.0 / etl::sqrt(last_var + e);
 
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                input_pre(b)(k) = (input(b)(k) - last_mean(k)) >> inv_var(k);
-                output(b)(k)    = (gamma(k) >> input_pre(b)(k)) + beta(k);
+            for(size_t b = 0; b < B; ++b){
+                for (size_t k = 0; k < Kernels; ++k) {
+                    input_pre(b)(k) = (input(b)(k) - last_mean(k)) >> inv_var(k);
+                    output(b)(k)    = (gamma(k) >> input_pre(b)(k)) + beta(k);
+                }
             }
         }
 
         //// Update the current mean and variance
         mean = momentum * mean + (1.0 - momentum) * last_mean;
-        var  = momentum * var + (1.0 - momentum) * (S / (S - 1) * last_var);
+        var  = momentum * var + (1.0 - momentum) * (last_samples / (last_samples - 1) * last_var);
+
+        test_cache.invalidate();
     }
 
     /*!
@@ -191,9 +220,10 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
     template<typename HH, typename C>
     void backward_batch(HH&& output, C& context) const {
         const auto B = etl::dim<0>(context.input);
-        const auto S = B * W * H;
+        const auto S = sync ? last_samples : B * W * H;
 
-        auto dxhat = etl::force_temporary_dim_only(context.errors);
+        auto dxhat_t = dll::arena_temporary_dim_only(context.errors);
+        auto& dxhat  = dxhat_t.matrix;
 
         for(size_t b = 0; b < B; ++b){
             for (size_t k = 0; k < Kernels; ++k) {
@@ -201,11 +231,11 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
             }
         }
 
-        auto dxhat_l      = etl::bias_batch_sum_4d(dxhat);
-        auto dxhat_xhat_l = etl::bias_batch_sum_4d(dxhat >> input_pre);
+        auto dxhat_l      = etl::force_temporary(etl::bias_batch_sum_4d(dxhat));
+        auto dxhat_xhat_l = etl::force_temporary(etl::bias_batch_sum_4d(dxhat >> input_pre));
 
-        *dxhat_l;
-        *dxhat_xhat_l;
+        // With synchronized statistics, the sums are over the whole batch of all the ranks
+        bn_sync_sums(*this, dxhat_l, dxhat_xhat_l);
 
         for(size_t b = 0; b < B; ++b){
             for (size_t k = 0; k < Kernels; ++k) {
@@ -263,6 +293,9 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
      * \return a tuple containing references to the variables of this layer
      */
     decltype(auto) trainable_parameters(){
+        // The parameters may be modified through the references
+        invalidate_weights_cache();
+
         return std::make_tuple(std::ref(gamma), std::ref(beta));
     }
 
@@ -288,6 +321,56 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
     void restore_weights() {
         gamma = *bak_gamma;
         beta  = *bak_beta;
+
+        invalidate_weights_cache();
+    }
+
+    /*!
+     * \brief Swap the weights with the secondary weights matrix, restoring
+     * the backup in constant time. The secondary weights matrix holds the
+     * replaced weights afterwards.
+     */
+    void swap_weights() {
+        std::swap(gamma, *bak_gamma);
+        std::swap(beta, *bak_beta);
+
+        invalidate_weights_cache();
+    }
+
+    /*!
+     * \brief Invalidate the test-time transformation, after a modification
+     * of the parameters
+     */
+    void invalidate_weights_cache() {
+        test_cache.invalidate();
+    }
+
+    /*!
+     * \brief Indicates if the layer can be folded into the given preceding
+     * layer
+     */
+    template <typename L>
+    static constexpr bool foldable_into() {
+        return bn_foldable<L, 4>();
+    }
+
+    /*!
+     * \brief Fold the test-time transformation of the layer into the weights
+     * and biases of the preceding layer. The layer is then the identity and
+     * cannot be trained anymore.
+     * \param layer The preceding layer
+     */
+    template <typename L>
+    void fold_into(L& layer) {
+        static_assert(foldable_into<L>(), "The batch normalization cannot be folded into this layer");
+
+        cpp_assert(!folded, "The batch normalization layer is already folded");
+
+        test_cache.update(gamma, beta, mean, var, e);
+
+        bn_fold_conv(layer, test_cache.scale, test_cache.shift);
+
+        folded = true;
     }
 };
 
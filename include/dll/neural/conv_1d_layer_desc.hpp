@@ -0,0 +1,66 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_conf.hpp"
+#include "dll/util/tmp.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Describe a 1D convolutional layer.
+ *
+ * The input is a sequence of NV steps of NC channels (NV x NC), convolved
+ * with K filters of NW steps into a sequence of NV - NW + 1 steps of K
+ * channels.
+ */
+template <size_t NV_T, size_t NC_T, size_t K_T, size_t NW_T, typename... Parameters>
+struct conv_1d_layer_desc {
+    static constexpr size_t NV = NV_T; ///< The length of the input sequences
+    static constexpr size_t NC = NC_T; ///< The number of input channels
+    static constexpr size_t K  = K_T;  ///< The number of filters
+    static constexpr size_t NW = NW_T; ///< The width of the filters
+
+    /*!
+     * \brief A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>; ///< The layer's activation function
+
+    using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
+    using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
+
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    /*! The layer type */
+    using layer_t = conv_1d_layer_impl<conv_1d_layer_desc<NV_T, NC_T, K_T, NW_T, Parameters...>>;
+
+    /*! The dynamic layer type */
+    using dyn_layer_t = dyn_conv_1d_layer_impl<dyn_conv_1d_layer_desc<Parameters...>>;
+
+    static_assert(NV > 0, "A sequence of at least one step is necessary");
+    static_assert(NC > 0, "At least one channel is necessary");
+    static_assert(K > 0, "At least one filter is necessary");
+    static_assert(NW > 0, "A filter of at least one step is necessary");
+    static_assert(NW <= NV, "The filters cannot be longer than the input");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id>, Parameters...>,
+        "Invalid parameters type for conv_1d_layer_desc");
+};
+
+/*!
+ * \brief Describe a 1D convolutional layer.
+ */
+template <size_t NV_T, size_t NC_T, size_t K_T, size_t NW_T, typename... Parameters>
+using conv_1d_layer = typename conv_1d_layer_desc<NV_T, NC_T, K_T, NW_T, Parameters...>::layer_t;
+
+} //end of dll namespace
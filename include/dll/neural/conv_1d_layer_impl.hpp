@@ -0,0 +1,260 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_conv_1d_layer.hpp"
+
+namespace dll {
+
+/*!
+ * \brief 1D convolutional layer of neural network.
+ */
+template <typename Desc>
+struct conv_1d_layer_impl final : base_conv_1d_layer<conv_1d_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                                ///< The descriptor of the layer
+    using weight      = typename desc::weight;               ///< The data type for this layer
+    using this_type   = conv_1d_layer_impl<desc>;            ///< The type of this layer
+    using base_type   = base_conv_1d_layer<this_type, desc>; ///< The base type
+    using layer_t     = this_type;                           ///< This layer's type
+    using dyn_layer_t = typename desc::dyn_layer_t;          ///< The dynamic version of this layer
+
+    static constexpr size_t NV = desc::NV; ///< The length of the input sequences
+    static constexpr size_t NC = desc::NC; ///< The number of input channels
+    static constexpr size_t K  = desc::K;  ///< The number of filters
+    static constexpr size_t NW = desc::NW; ///< The width of the filters
+
+    static constexpr size_t NH = NV - NW + 1; //By definition
+
+    static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, NV, NC>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, NH, K>;  ///< The type of one output
+    using input_t      = std::vector<input_one_t>;             ///< The type of the input
+    using output_t     = std::vector<output_one_t>;            ///< The type of the output
+
+    using w_type = etl::fast_matrix<weight, NW, NC, K>; ///< The type of the filters
+    using b_type = etl::fast_matrix<weight, K>;         ///< The type of the biases
+
+    //Weights and biases
+    w_type w; ///< Filters
+    b_type b; ///< Hidden biases
+
+    //Backup weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup filters
+    std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
+
+    /*!
+     * \brief Initialize a 1D conv layer with basic weights.
+     */
+    conv_1d_layer_impl() : base_type() {
+        w_initializer::initialize(w, NW * NC, K);
+        b_initializer::initialize(b, NW * NC, K);
+    }
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return NV * NC;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return NH * K;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    static constexpr size_t parameters() noexcept {
+        return NW * NC * K;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        if constexpr (activation_function == function::IDENTITY) {
+            return "Conv(1D)";
+        } else {
+            char buffer[512];
+            snprintf(buffer, 512, "Conv(1D) (%s)", to_string(activation_function).c_str());
+            return {buffer};
+        }
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[512];
+
+        if (activation_function == function::IDENTITY) {
+            snprintf(buffer, 512, "Conv(1D): %lux%lu -> (%lux%lu) -> %lux%lu", NV, NC, K, NW, NH, K);
+        } else {
+            snprintf(buffer, 512, "Conv(1D): %lux%lu -> (%lux%lu) -> %s -> %lux%lu", NV, NC, K, NW, to_string(activation_function).c_str(), NH, K);
+        }
+
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {NH, K};
+    }
+
+    using base_type::forward_batch;
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V>
+    void forward_batch(H1&& output, const V& v) const {
+        dll::auto_timer timer("conv_1d:forward_batch");
+
+        this->forward_batch_impl(output, v, NV, NC, K, NW);
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DRBM>
+    static void dyn_init(DRBM& dyn){
+        dyn.init_layer(NV, NC, K, NW);
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("conv_1d:backward_batch");
+
+        this->backward_batch_impl(output, context, NV, NC, K, NW);
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        dll::auto_timer timer("conv_1d:compute_gradients");
+
+        this->compute_gradients_impl(context, NV, NC, K, NW);
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t conv_1d_layer_impl<Desc>::NV;
+
+template <typename Desc>
+const size_t conv_1d_layer_impl<Desc>::NC;
+
+template <typename Desc>
+const size_t conv_1d_layer_impl<Desc>::K;
+
+template <typename Desc>
+const size_t conv_1d_layer_impl<Desc>::NW;
+
+template <typename Desc>
+const size_t conv_1d_layer_impl<Desc>::NH;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<conv_1d_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = true;  ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of the sgd_context for conv_1d_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, conv_1d_layer_impl<Desc>, L> {
+    using layer_t = conv_1d_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr size_t NV = layer_t::NV;
+    static constexpr size_t NC = layer_t::NC;
+    static constexpr size_t NH = layer_t::NH;
+    static constexpr size_t K  = layer_t::K;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, NV, NC> input;
+    etl::fast_matrix<weight, batch_size, NH, K> output;
+    etl::fast_matrix<weight, batch_size, NH, K> errors;
+
+    sgd_context(const layer_t& /* layer */)
+            : output(0.0), errors(0.0) {}
+};
+
+} //end of dll namespace
@@ -30,6 +30,7 @@ struct conv_layer_desc {
     using parameters = cpp::type_list<Parameters...>;
 
     static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>;            ///< The layer's activation function
+    static constexpr size_t Groups            = detail::get_value_v<groups<1>, Parameters...>;                                ///< The number of groups of filters
 
     using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
     using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
@@ -49,10 +50,13 @@ struct conv_layer_desc {
     static_assert(NW2 > 0, "A matrix of at least 1x1 is necessary for the weights");
     static_assert(NC > 0, "At least one channel is necessary");
     static_assert(K > 0, "At least one group is necessary");
+    static_assert(Groups > 0, "At least one group of filters is necessary");
+    static_assert(NC % Groups == 0, "The channels must be divisible by the number of groups");
+    static_assert(K % Groups == 0, "The filters must be divisible by the number of groups");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, groups_id, no_bias_id>, Parameters...>,
         "Invalid parameters type for rbm_desc");
 };
 
@@ -10,6 +10,10 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/epilogue.hpp" // for fused bias and activation
+#include "dll/util/grouped_conv.hpp" // for grouped convolutions
+#include "dll/util/winograd.hpp" // for F(2x2,3x3) kernels
+#include "dll/util/conv_autotune.hpp" // for the selection of the algorithm
 
 namespace dll {
 
@@ -32,11 +36,14 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     static constexpr size_t NC  = desc::NC;  ///< The number of input channels
     static constexpr size_t K   = desc::K;   ///< The number of filters
 
+    static constexpr size_t Groups = desc::Groups; ///< The number of groups of filters
+
     static constexpr size_t NH1 = NV1 - NW1 + 1; //By definition
     static constexpr size_t NH2 = NV2 - NW2 + 1; //By definition
 
     static constexpr auto activation_function = desc::activation_function; ///< The activation function
     static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr bool winograd            = NW1 == 3 && NW2 == 3 && Groups == 1; ///< Use the Winograd kernels for the 3x3 filters
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -46,7 +53,7 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     using input_t      = std::vector<input_one_t>; ///< The type of the input
     using output_t     = std::vector<output_one_t>; ///< The type of the output
 
-    using w_type = etl::fast_matrix<weight, K, NC, NW1, NW2>; ///< The type of the weights
+    using w_type = etl::fast_matrix<weight, K, NC / Groups, NW1, NW2>; ///< The type of the weights
     using b_type = etl::fast_matrix<weight, K>; ///< The type of the biases
 
     //Weights and biases
@@ -57,6 +64,11 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    mutable winograd_filters<weight> w_winograd; ///< The Winograd transform of the filters, if winograd
+    workspace* arena = nullptr;                  ///< The workspace shared by the layers of the network
+
+    conv_algorithm algorithm = conv_algorithm::DEFAULT; ///< The algorithm of the convolutions (see autotune)
+
     /*!
      * \brief Initialize a conv layer with basic weights.
      */
@@ -154,18 +166,18 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("conv:forward_batch");
 
-        if constexpr (etl::dimensions<V>() == 4) {
-            output = etl::ml::convolution_forward(v, w);
-        } else {
-            output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), w);
-        }
+        convolution_forward(output, v);
 
-        if constexpr (!no_bias) {
-            output = bias_add_4d(output, b);
-        }
+        if constexpr (!no_bias && fused_epilogue<activation_function> && etl::is_dma<std::decay_t<H1>>) {
+            bias_activate_4d<activation_function>(output, b);
+        } else {
+            if constexpr (!no_bias) {
+                output = bias_add_4d(output, b);
+            }
 
-        if constexpr (activation_function != function::IDENTITY) {
-            output = f_activate<activation_function>(output);
+            if constexpr (activation_function != function::IDENTITY) {
+                output = f_activate<activation_function>(output);
+            }
         }
     }
 
@@ -225,11 +237,7 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("conv:backward_batch");
 
-        if constexpr (etl::dimensions<H>() == 4) {
-            output = etl::ml::convolution_backward(context.errors, w);
-        } else {
-            etl::reshape(output, etl::dim<0>(output), NC, NV1, NV2) = etl::ml::convolution_backward(context.errors, w);
-        }
+        convolution_backward(output, context);
     }
 
     /*!
@@ -240,12 +248,148 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     void compute_gradients(C& context) const {
         dll::auto_timer timer("conv:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors);
+        convolution_backward_filter(std::get<0>(context.up.context)->grad, context);
 
         if constexpr (!no_bias) {
             std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
         }
     }
+
+    /*!
+     * \brief Invalidate the Winograd transform of the filters, after a
+     * modification of the weights
+     */
+    void invalidate_weights_cache() {
+        w_winograd.invalidate();
+    }
+
+    /*!
+     * \brief Use the given workspace for the temporaries of the kernels
+     * \param ws The workspace shared by the layers of the network
+     */
+    void set_workspace(workspace* ws) {
+        arena = ws;
+    }
+
+    /*!
+     * \brief Returns the size, in bytes, of the workspace needed by the
+     * kernels of the layer
+     */
+    size_t workspace_size() const {
+        if constexpr (winograd) {
+            return winograd_workspace_size<weight>(NC, NV1, NV2, K, 0);
+        }
+
+        return 0;
+    }
+
+    /*!
+     * \brief Select the fastest algorithm of the convolutions for the given
+     * batch size, from the cache or by benchmarking the candidates
+     * \param batch The batch size
+     * \param cache The decisions of the autotuning
+     */
+    void autotune(size_t batch, conv_tuning_cache& cache) {
+        if constexpr (Groups == 1) {
+            autotune_conv(*this, batch, cache, NC, NV1, NV2, K, NW1, NW2);
+        } else {
+            cpp_unused(batch);
+            cpp_unused(cache);
+        }
+    }
+
+private:
+    /*!
+     * \brief Indicates if the convolutions are computed with the Winograd
+     * kernels
+     */
+    bool use_winograd() const noexcept {
+        return winograd && (algorithm == conv_algorithm::DEFAULT || algorithm == conv_algorithm::WINOGRAD);
+    }
+
+    /*!
+     * \brief Compute the convolution of the input with the filters, with the
+     * selected algorithm (Winograd kernels for 3x3 filters by default)
+     */
+    template <typename H1, typename V>
+    void convolution_forward(H1&& output, const V& v) const {
+        if constexpr (Groups > 1 && etl::dimensions<V>() == 4) {
+            dll::grouped_conv_forward(v, w, output, Groups, 0, 0);
+        } else if constexpr (Groups > 1) {
+            dll::grouped_conv_forward(etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), w, output, Groups, 0, 0);
+        } else {
+            if constexpr (winograd && etl::is_dma<V> && etl::is_dma<std::decay_t<H1>>) {
+                if (use_winograd()) {
+                    dll::winograd_forward(v, w_winograd.get(w), output, NC, NV1, NV2, K, 0, arena);
+                    return;
+                }
+            }
+
+            if (algorithm == conv_algorithm::PER_SAMPLE) {
+                if constexpr (etl::dimensions<V>() == 4) {
+                    dll::grouped_conv_forward(v, w, output, 1, 0, 0);
+                } else {
+                    dll::grouped_conv_forward(etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), w, output, 1, 0, 0);
+                }
+            } else if constexpr (etl::dimensions<V>() == 4) {
+                output = etl::ml::convolution_forward(v, w);
+            } else {
+                output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), w);
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients of the input of the convolution
+     */
+    template <typename H, typename C>
+    void convolution_backward(H&& output, C& context) const {
+        if constexpr (Groups > 1 && etl::dimensions<H>() == 4) {
+            dll::grouped_conv_backward(context.errors, w, output, Groups, 0, 0);
+        } else if constexpr (Groups > 1) {
+            dll::grouped_conv_backward(context.errors, w, etl::reshape(output, etl::dim<0>(output), NC, NV1, NV2), Groups, 0, 0);
+        } else {
+            if constexpr (winograd && etl::is_dma<decltype(context.errors)> && etl::is_dma<std::decay_t<H>>) {
+                if (use_winograd()) {
+                    dll::winograd_backward(context.errors, w_winograd.get(w), output, NC, NV1, NV2, K, 0, arena);
+                    return;
+                }
+            }
+
+            if (algorithm == conv_algorithm::PER_SAMPLE) {
+                if constexpr (etl::dimensions<H>() == 4) {
+                    dll::grouped_conv_backward(context.errors, w, output, 1, 0, 0);
+                } else {
+                    dll::grouped_conv_backward(context.errors, w, etl::reshape(output, etl::dim<0>(output), NC, NV1, NV2), 1, 0, 0);
+                }
+            } else if constexpr (etl::dimensions<H>() == 4) {
+                output = etl::ml::convolution_backward(context.errors, w);
+            } else {
+                etl::reshape(output, etl::dim<0>(output), NC, NV1, NV2) = etl::ml::convolution_backward(context.errors, w);
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients of the filters of the convolution
+     */
+    template <typename G, typename C>
+    void convolution_backward_filter(G& grad, C& context) const {
+        if constexpr (Groups > 1) {
+            dll::grouped_conv_backward_filter(context.input, context.errors, grad, Groups, 0, 0, arena);
+        } else {
+            // The per-sample algorithm would need a reduction, the gradients
+            // of the filters are computed on the whole batch
+            if constexpr (winograd && etl::is_dma<decltype(context.input)> && etl::is_dma<decltype(context.errors)>) {
+                if (use_winograd()) {
+                    dll::winograd_backward_filter(context.input, context.errors, grad, NC, NV1, NV2, K, 0, arena);
+                    return;
+                }
+            }
+
+            grad = etl::ml::convolution_backward_filter(context.input, context.errors);
+        }
+    }
 };
 
 //Allow odr-use of the constexpr static members
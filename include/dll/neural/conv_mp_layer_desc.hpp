@@ -0,0 +1,77 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_conf.hpp"
+#include "dll/util/tmp.hpp"
+#include "dll/util/epilogue.hpp"
+#include "dll/util/max_pool.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Describe a convolutional layer fused with the max pooling of its
+ * output (conv_layer followed by mp_2d_layer).
+ */
+template <size_t NC_T, size_t NV_1, size_t NV_2, size_t K_T, size_t NW_1, size_t NW_2, size_t C_1, size_t C_2, typename... Parameters>
+struct conv_mp_layer_desc {
+    static constexpr size_t NV1 = NV_1; ///< The first dimension of the input
+    static constexpr size_t NV2 = NV_2; ///< The second dimension of the input
+    static constexpr size_t NW1 = NW_1; ///< The first dimension of the filters
+    static constexpr size_t NW2 = NW_2; ///< The second dimension of the filters
+    static constexpr size_t NC  = NC_T; ///< The number of input channels
+    static constexpr size_t K   = K_T;  ///< The number of filters
+    static constexpr size_t C1  = C_1;  ///< The first dimension of the pooling
+    static constexpr size_t C2  = C_2;  ///< The second dimension of the pooling
+
+    /*!
+     * \brief A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>; ///< The layer's activation function
+
+    using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
+    using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
+
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    /*! The layer type */
+    using layer_t = conv_mp_layer_impl<conv_mp_layer_desc<NC_T, NV_1, NV_2, K_T, NW_1, NW_2, C_1, C_2, Parameters...>>;
+
+    /*! The dynamic layer type (the fused layer has no dynamic version) */
+    using dyn_layer_t = layer_t;
+
+    static_assert(NV1 > 0, "A matrix of at least 1x1 is necessary for the visible units");
+    static_assert(NV2 > 0, "A matrix of at least 1x1 is necessary for the visible units");
+    static_assert(NW1 > 0, "A matrix of at least 1x1 is necessary for the weights");
+    static_assert(NW2 > 0, "A matrix of at least 1x1 is necessary for the weights");
+    static_assert(NC > 0, "At least one channel is necessary");
+    static_assert(K > 0, "At least one filter is necessary");
+    static_assert(C1 > 0, "Cannot shrink a layer by less than 1");
+    static_assert(C2 > 0, "Cannot shrink a layer by less than 1");
+    static_assert((NV1 - NW1 + 1) % C1 == 0, "The output of the convolution is not divisible by C");
+    static_assert((NV2 - NW2 + 1) % C2 == 0, "The output of the convolution is not divisible by C");
+    static_assert(C1 * C2 <= max_argmax_window, "The pooling window is too large for the argmax offsets");
+    static_assert(fused_epilogue<activation_function>, "Only element-wise activation functions can be fused with the pooling");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id>, Parameters...>,
+        "Invalid parameters type for conv_mp_layer_desc");
+};
+
+/*!
+ * \brief Describe a convolutional layer fused with the max pooling of its
+ * output.
+ */
+template <size_t NC_T, size_t NV_1, size_t NV_2, size_t K_T, size_t NW_1, size_t NW_2, size_t C_1, size_t C_2, typename... Parameters>
+using conv_mp_layer = typename conv_mp_layer_desc<NC_T, NV_1, NV_2, K_T, NW_1, NW_2, C_1, C_2, Parameters...>::layer_t;
+
+} //end of dll namespace
@@ -0,0 +1,506 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/neural_layer.hpp"
+
+#include "dll/util/timers.hpp"   // for auto_timer
+#include "dll/util/epilogue.hpp" // for fused bias and activation
+#include "dll/util/max_pool.hpp" // for the argmax pooling kernels
+#include "dll/util/winograd.hpp" // for F(2x2,3x3) kernels
+
+namespace dll {
+
+/*!
+ * \brief Convolutional layer fused with the max pooling of its output.
+ *
+ * Each sample is convolved into a tile of the size of one full-resolution
+ * output, which is pooled while it is still in cache. The full-resolution
+ * output of the batch is never stored. In training, only the position of
+ * the maximums is kept for the backward pass.
+ */
+template <typename Desc>
+struct conv_mp_layer_impl final : neural_layer<conv_mp_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                          ///< The descriptor of the layer
+    using weight      = typename desc::weight;         ///< The data type of the layer
+    using this_type   = conv_mp_layer_impl<desc>;      ///< The type of this layer
+    using base_type   = neural_layer<this_type, desc>; ///< The base type of the layer
+    using layer_t     = this_type;                     ///< The type of this layer
+    using dyn_layer_t = typename desc::dyn_layer_t;    ///< The type of this layer
+
+    static constexpr size_t NV1 = desc::NV1; ///< The first dimension of the visible units
+    static constexpr size_t NV2 = desc::NV2; ///< The second dimension of the visible units
+    static constexpr size_t NW1 = desc::NW1; ///< The first dimension of the filter
+    static constexpr size_t NW2 = desc::NW2; ///< The second dimension of the filter
+    static constexpr size_t NC  = desc::NC;  ///< The number of input channels
+    static constexpr size_t K   = desc::K;   ///< The number of filters
+    static constexpr size_t C1  = desc::C1;  ///< The first dimension of the pooling
+    static constexpr size_t C2  = desc::C2;  ///< The second dimension of the pooling
+
+    static constexpr size_t NH1 = NV1 - NW1 + 1; ///< The first dimension of the convolution output
+    static constexpr size_t NH2 = NV2 - NW2 + 1; ///< The second dimension of the convolution output
+
+    static constexpr size_t NP1 = NH1 / C1; ///< The first dimension of the output
+    static constexpr size_t NP2 = NH2 / C2; ///< The second dimension of the output
+
+    static constexpr auto activation_function = desc::activation_function; ///< The activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr bool winograd            = NW1 == 3 && NW2 == 3; ///< Use the Winograd kernels for the 3x3 filters
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, NC, NV1, NV2>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, K, NP1, NP2>;  ///< The type of one output
+    using input_t      = std::vector<input_one_t>;                   ///< The type of the input
+    using output_t     = std::vector<output_one_t>;                  ///< The type of the output
+
+    using w_type = etl::fast_matrix<weight, K, NC, NW1, NW2>; ///< The type of the weights
+    using b_type = etl::fast_matrix<weight, K>;               ///< The type of the biases
+
+    //Weights and biases
+    w_type w; ///< Weights
+    b_type b; ///< Hidden biases
+
+    //Backup weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup Weights
+    std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
+
+    mutable winograd_filters<weight> w_winograd; ///< The Winograd transform of the filters, if winograd
+    workspace* arena = nullptr;                  ///< The workspace shared by the layers of the network
+
+    std::vector<std::unique_ptr<workspace>> tile_arenas; ///< The workspaces of the Winograd kernels of each chunk of samples
+
+    mutable pooling_argmax argmax;                  ///< The position of the maximums of the last training batch
+    mutable etl::dyn_matrix<weight, 4> full_errors; ///< The errors of the convolution output, scattered from the pooled errors
+    mutable bool scattered = false;                 ///< Indicates if full_errors holds the errors of the last training batch
+
+    /*!
+     * \brief Initialize a conv_mp layer with basic weights.
+     */
+    conv_mp_layer_impl() : base_type() {
+        w_initializer::initialize(w, input_size(), K * NH1 * NH2);
+        b_initializer::initialize(b, input_size(), K * NH1 * NH2);
+
+        // The workspaces are created once for the largest number of chunks,
+        // the forward pass does not modify the layer
+        if constexpr (winograd) {
+            for (size_t c = 0; c < std::max(1u, std::thread::hardware_concurrency()); ++c) {
+                tile_arenas.push_back(std::make_unique<workspace>());
+            }
+        }
+    }
+
+    // No copying or moving
+    conv_mp_layer_impl(const conv_mp_layer_impl& rhs) = delete;
+    conv_mp_layer_impl& operator=(const conv_mp_layer_impl& rhs) = delete;
+
+    // No copying or moving
+    conv_mp_layer_impl(const conv_mp_layer_impl&& rhs) = delete;
+    conv_mp_layer_impl& operator=(const conv_mp_layer_impl&& rhs) = delete;
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return NC * NV1 * NV2;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return K * NP1 * NP2;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    static constexpr size_t parameters() noexcept {
+        return K * NW1 * NW2;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        if constexpr (activation_function == function::IDENTITY) {
+            return "Conv+MP";
+        } else {
+            char buffer[512];
+            snprintf(buffer, 512, "Conv+MP (%s)", to_string(activation_function).c_str());
+            return {buffer};
+        }
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[512];
+
+        if (activation_function == function::IDENTITY) {
+            snprintf(buffer, 512, "Conv+MP: %lux%lux%lu -> (%lux%lux%lu) -> (%lux%lu) -> %lux%lux%lu",
+                     NC, NV1, NV2, K, NW1, NW2, C1, C2, K, NP1, NP2);
+        } else {
+            snprintf(buffer, 512, "Conv+MP: %lux%lux%lu -> (%lux%lux%lu) -> %s -> (%lux%lu) -> %lux%lux%lu",
+                     NC, NV1, NV2, K, NW1, NW2, to_string(activation_function).c_str(), C1, C2, K, NP1, NP2);
+        }
+
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {K, NP1, NP2};
+    }
+
+    using base_type::forward_batch;
+    using base_type::train_forward_batch;
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V>
+    void forward_batch(H1&& output, const V& v) const {
+        dll::auto_timer timer("conv_mp:forward_batch");
+
+        fused_forward<false>(output, v);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, for training,
+     * recording the position of the maximums for the backward pass.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V>
+    void train_forward_batch(H1&& output, const V& v) const {
+        dll::auto_timer timer("conv_mp:train:forward");
+
+        fused_forward<true>(output, v);
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer (the layer is its own dynamic version)
+     */
+    template<typename DRBM>
+    static void dyn_init(DRBM& /*dyn*/){
+        //Nothing to change
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * The derivative of the activation at the position of a maximum only
+     * depends on the pooled output, it is applied to the pooled errors,
+     * which are then scattered to the positions of the maximums.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        dll::auto_timer timer("conv_mp:adapt_errors");
+
+        if constexpr (activation_function != function::IDENTITY){
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
+
+        scatter_errors(context);
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("conv_mp:backward_batch");
+
+        const auto& errors = scatter_errors(context);
+
+        if constexpr (winograd && etl::is_dma<std::decay_t<H>>) {
+            dll::winograd_backward(errors, w_winograd.get(w), output, NC, NV1, NV2, K, 0, arena);
+        } else if constexpr (etl::dimensions<H>() == 4) {
+            output = etl::ml::convolution_backward(errors, w);
+        } else {
+            etl::reshape(output, etl::dim<0>(output), NC, NV1, NV2) = etl::ml::convolution_backward(errors, w);
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        dll::auto_timer timer("conv_mp:compute_gradients");
+
+        const auto& errors = scatter_errors(context);
+
+        auto& grad = std::get<0>(context.up.context)->grad;
+
+        if constexpr (winograd && etl::is_dma<decltype(context.input)>) {
+            dll::winograd_backward_filter(context.input, errors, grad, NC, NV1, NV2, K, 0, arena);
+        } else {
+            grad = etl::ml::convolution_backward_filter(context.input, errors);
+        }
+
+        // The scatter keeps the sum of the errors of each feature map
+        if constexpr (!no_bias) {
+            std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+        }
+    }
+
+    /*!
+     * \brief Invalidate the Winograd transform of the filters, after a
+     * modification of the weights
+     */
+    void invalidate_weights_cache() {
+        w_winograd.invalidate();
+    }
+
+    /*!
+     * \brief Use the given workspace for the temporaries of the kernels
+     * \param ws The workspace shared by the layers of the network
+     */
+    void set_workspace(workspace* ws) {
+        arena = ws;
+    }
+
+    /*!
+     * \brief Returns the size, in bytes, of the workspace needed by the
+     * kernels of the layer
+     */
+    size_t workspace_size() const {
+        if constexpr (winograd) {
+            return winograd_workspace_size<weight>(NC, NV1, NV2, K, 0);
+        }
+
+        return 0;
+    }
+
+private:
+    /*!
+     * \brief Compute the convolution, bias, activation and pooling of a
+     * batch, one sample at a time, the samples being split across the
+     * threads of the scoped pool.
+     *
+     * \tparam Train Indicates if the position of the maximums must be recorded
+     */
+    template <bool Train, typename H1, typename V>
+    void fused_forward(H1&& output, const V& v) const {
+        static_assert(etl::is_dma<V>, "The input of the conv_mp layers must have direct memory access");
+        static_assert(etl::is_dma<std::decay_t<H1>>, "The output of the conv_mp layers must have direct memory access");
+
+        const size_t B = etl::dim<0>(v);
+
+        uint8_t* a_p = nullptr;
+
+        if constexpr (Train) {
+            argmax.offsets.resize(B * output_size());
+            a_p       = argmax.offsets.data();
+            scattered = false;
+        }
+
+        const weight* u = nullptr;
+
+        if constexpr (winograd) {
+            u = w_winograd.get(w);
+        }
+
+        v.ensure_cpu_up_to_date();
+        w.ensure_cpu_up_to_date();
+        b.ensure_cpu_up_to_date();
+
+        weight* out_p = output.memory_start();
+
+        // One full-resolution tile per chunk, and a workspace per chunk for
+        // the Winograd kernels
+        const size_t chunks    = detail::winograd_chunk_count(B);
+        const size_t tile_size = K * NH1 * NH2;
+
+        workspace_lease<weight> tiles(arena, chunks * tile_size);
+
+        detail::winograd_chunks(B, chunks, [&, a_p, u, out_p](size_t c, size_t first, size_t last) {
+            SERIAL_SECTION {
+                etl::custom_dyn_matrix<weight, 4> tile(tiles.data() + c * tile_size, 1, K, NH1, NH2);
+
+                for (size_t i = first; i < last; ++i) {
+                    auto v_i = etl::reshape(etl::slice(v, i, i + 1), 1, NC, NV1, NV2);
+
+                    if constexpr (winograd && etl::is_dma<decltype(v_i)>) {
+                        dll::winograd_forward(v_i, u, tile, NC, NV1, NV2, K, 0, tile_arenas[c].get());
+                    } else {
+                        tile = etl::ml::convolution_forward(v_i, w);
+                    }
+
+                    if constexpr (!no_bias) {
+                        bias_activate_4d<activation_function>(tile, b);
+                    } else if constexpr (activation_function != function::IDENTITY) {
+                        tile = f_activate<activation_function>(tile);
+                    }
+
+                    detail::max_pool_argmax_sample(tile.memory_start(), out_p + i * output_size(), a_p ? a_p + i * output_size() : nullptr,
+                                                   K, NH1, NH2, 1, C1, C2);
+                }
+            }
+        });
+
+        output.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Scatter the pooled errors of the last training batch to the
+     * positions of their maximums, once per batch
+     * \return the errors of the convolution output
+     */
+    template <typename C>
+    const etl::dyn_matrix<weight, 4>& scatter_errors(C& context) const {
+        if (!scattered) {
+            const size_t B = etl::dim<0>(context.errors);
+
+            if (etl::dim<0>(full_errors) != B) {
+                full_errors = etl::dyn_matrix<weight, 4>(B, K, NH1, NH2);
+            }
+
+            max_pool_argmax_backward(full_errors, context.errors, 1, C1, C2, argmax);
+
+            scattered = true;
+        }
+
+        return full_errors;
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NV1;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NV2;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NH1;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NH2;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NP1;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NP2;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NC;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NW1;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NW2;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::K;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::C1;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::C2;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<conv_mp_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = true;  ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of the sgd_context for conv_mp_layer_impl
+ *
+ * Only the pooled output and errors are stored, the full-resolution
+ * errors of the convolution are held by the layer during the backward pass.
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, conv_mp_layer_impl<Desc>, L> {
+    using layer_t = conv_mp_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr size_t NV1 = layer_t::NV1;
+    static constexpr size_t NV2 = layer_t::NV2;
+    static constexpr size_t NP1 = layer_t::NP1;
+    static constexpr size_t NP2 = layer_t::NP2;
+    static constexpr size_t NC  = layer_t::NC;
+    static constexpr size_t K   = layer_t::K;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, NC, NV1, NV2> input;
+    etl::fast_matrix<weight, batch_size, K, NP1, NP2> output;
+    etl::fast_matrix<weight, batch_size, K, NP1, NP2> errors;
+
+    sgd_context(const conv_mp_layer_impl<Desc>& /* layer */)
+            : output(0.0), errors(0.0) {}
+};
+
+} //end of dll namespace
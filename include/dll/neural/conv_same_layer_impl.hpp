@@ -10,6 +10,10 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/epilogue.hpp" // for fused bias and activation
+#include "dll/util/grouped_conv.hpp" // for grouped convolutions
+#include "dll/util/winograd.hpp" // for F(2x2,3x3) kernels
+#include "dll/util/same_conv.hpp" // for the boundary-aware kernels
 
 namespace dll {
 
@@ -32,26 +36,35 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
     static constexpr size_t NC  = desc::NC;  ///< The number of input channels
     static constexpr size_t K   = desc::K;   ///< The number of filters
 
-    static constexpr size_t NH1 = NV1; //By definition
-    static constexpr size_t NH2 = NV2; //By definition
+    static constexpr size_t Groups = desc::Groups; ///< The number of groups of filters
+    static constexpr size_t S1     = desc::S1;     ///< The vertical stride
+    static constexpr size_t S2     = desc::S2;     ///< The horizontal stride
 
-    static constexpr size_t P1 = (NW1 - 1) / 2;
-    static constexpr size_t P2 = (NW2 - 1) / 2;
+    static constexpr size_t NH1 = same_conv_geometry::same_output(NV1, S1); //By definition
+    static constexpr size_t NH2 = same_conv_geometry::same_output(NV2, S2); //By definition
+
+    static constexpr size_t P1 = same_conv_geometry::same_padding(NV1, NH1, NW1, S1); ///< The padding at the top
+    static constexpr size_t P2 = same_conv_geometry::same_padding(NV2, NH2, NW2, S2); ///< The padding at the left
 
     static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+    static constexpr bool winograd = NW1 == 3 && NW2 == 3 && S1 == 1 && S2 == 1 && Groups == 1; ///< Use the Winograd kernels for the 3x3 filters
+
+    using lowered_t = typename desc::lowered_t; ///< The storage type of the kept lowered input (void if disabled)
+
+    static constexpr bool keeps_lowering = !std::is_void<lowered_t>::value && Groups == 1 && !winograd; ///< Keep the lowered input of the training batches
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
 
-    static_assert(NW1 % 2 == 1, "conv_same_layer_impl only works with odd-sized filters");
-    static_assert(NW2 % 2 == 1, "conv_same_layer_impl only works with odd-sized filters");
+    static_assert(Groups == 1 || (NW1 % 2 == 1 && NW2 % 2 == 1), "The grouped conv_same_layer_impl only works with odd-sized filters");
+    static_assert(Groups == 1 || (S1 == 1 && S2 == 1), "The grouped conv_same_layer_impl only works without strides");
 
     using input_one_t  = etl::fast_dyn_matrix<weight, NC, NV1, NV2>; ///< The type of one input
     using output_one_t = etl::fast_dyn_matrix<weight, K, NH1, NH2>; ///< The type of one output
     using input_t      = std::vector<input_one_t>; ///< The type of the input
     using output_t     = std::vector<output_one_t>; ///< The type of the output
 
-    using w_type = etl::fast_matrix<weight, K, NC, NW1, NW2>; ///< The type of the weights
+    using w_type = etl::fast_matrix<weight, K, NC / Groups, NW1, NW2>; ///< The type of the weights
     using b_type = etl::fast_matrix<weight, K>; ///< The type of the biases
 
     //Weights and biases
@@ -62,6 +75,11 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    mutable winograd_filters<weight> w_winograd; ///< The Winograd transform of the filters, if winograd
+    workspace* arena = nullptr;                  ///< The workspace shared by the layers of the network
+
+    mutable same_conv_lowered<std::conditional_t<keeps_lowering, lowered_t, weight>> lowered; ///< The lowered input of the last training batch, if keeps_lowering
+
     /*!
      * \brief Initialize a conv layer with basic weights.
      */
@@ -138,14 +156,26 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("conv:forward_batch");
 
-        if constexpr (etl::dimensions<V>() == 4) {
-            output = etl::ml::convolution_forward<1, 1, P1, P2>(v, w);
-        } else {
-            output = etl::ml::convolution_forward<1, 1, P1, P2>(etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), w);
-        }
+        convolution_forward<false>(output, v);
+        bias_activate(output);
+    }
+
+    using base_type::train_forward_batch;
+
+    /*!
+     * \brief Apply the layer to the given batch of input, for training,
+     * keeping the lowered input for the gradients of the filters with
+     * keep_lowered.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V>
+    void train_forward_batch(H1&& output, const V& v) const {
+        dll::auto_timer timer("conv:train:forward");
 
-        output = bias_add_4d(output, b);
-        output = f_activate<activation_function>(output);
+        convolution_forward<keeps_lowering>(output, v);
+        bias_activate(output);
     }
 
     template <typename Input>
@@ -172,7 +202,7 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
      */
     template<typename DRBM>
     static void dyn_init(DRBM& dyn){
-        dyn.init_layer(NC, NV1, NV2, K, NW1, NW2);
+        dyn.init_layer(NC, NV1, NV2, K, NW1, NW2, S1, S2);
     }
 
     /*!
@@ -200,7 +230,7 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("conv_same:backward_batch");
 
-        output = etl::ml::convolution_backward<1, 1, P1, P2>(context.errors, w);
+        convolution_backward(output, context);
     }
 
     /*!
@@ -211,9 +241,126 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
     void compute_gradients(C& context) const {
         dll::auto_timer timer("conv_same:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter<1, 1, P1, P2>(context.input, context.errors);
+        convolution_backward_filter(std::get<0>(context.up.context)->grad, context);
         std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
     }
+
+    /*!
+     * \brief Invalidate the Winograd transform of the filters, after a
+     * modification of the weights
+     */
+    void invalidate_weights_cache() {
+        w_winograd.invalidate();
+    }
+
+    /*!
+     * \brief Use the given workspace for the temporaries of the kernels
+     * \param ws The workspace shared by the layers of the network
+     */
+    void set_workspace(workspace* ws) {
+        arena = ws;
+    }
+
+    /*!
+     * \brief Returns the size, in bytes, of the workspace needed by the
+     * kernels of the layer
+     */
+    size_t workspace_size() const {
+        if constexpr (winograd) {
+            return winograd_workspace_size<weight>(NC, NV1, NV2, K, P1);
+        } else if constexpr (Groups == 1) {
+            return same_conv_workspace_size<weight>(geometry());
+        }
+
+        return 0;
+    }
+
+    /*!
+     * \brief Returns the geometry of the convolutions of the layer
+     */
+    static same_conv_geometry geometry() {
+        return {NC, NV1, NV2, K, NW1, NW2, S1, S2};
+    }
+
+private:
+    /*!
+     * \brief Add the biases to the output of the convolution and apply the
+     * activation function
+     */
+    template <typename H1>
+    void bias_activate(H1&& output) const {
+        if constexpr (fused_epilogue<activation_function> && etl::is_dma<std::decay_t<H1>>) {
+            bias_activate_4d<activation_function>(output, b);
+        } else {
+            output = bias_add_4d(output, b);
+            output = f_activate<activation_function>(output);
+        }
+    }
+
+    /*!
+     * \brief Compute the convolution of the input with the filters, with the
+     * Winograd kernels for 3x3 filters and the boundary-aware kernels
+     * otherwise
+     *
+     * \tparam Keep Keep the lowered input for the gradients of the filters
+     */
+    template <bool Keep, typename H1, typename V>
+    void convolution_forward(H1&& output, const V& v) const {
+        if constexpr (etl::dimensions<V>() != 4) {
+            convolution_forward<Keep>(output, etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2));
+        } else if constexpr (Groups > 1) {
+            dll::grouped_conv_forward(v, w, output, Groups, P1, P2);
+        } else if constexpr (!etl::is_dma<V> || !etl::is_dma<std::decay_t<H1>>) {
+            // The kernels need direct memory access
+            etl::dyn_matrix<weight, 4> input(etl::dim<0>(v), NC, NV1, NV2);
+            etl::dyn_matrix<weight, 4> result(etl::dim<0>(v), K, NH1, NH2);
+
+            // The lowering of the copy would not be reused
+            input = v;
+            convolution_forward<false>(result, input);
+            output = result;
+        } else if constexpr (winograd) {
+            dll::winograd_forward(v, w_winograd.get(w), output, NC, NV1, NV2, K, P1, arena);
+        } else {
+            dll::same_conv_forward(v, w, output, geometry(), arena, Keep ? &lowered : nullptr);
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients of the input of the convolution
+     */
+    template <typename H, typename C>
+    void convolution_backward(H&& output, C& context) const {
+        if constexpr (etl::dimensions<H>() != 4) {
+            convolution_backward(etl::reshape(output, etl::dim<0>(output), NC, NV1, NV2), context);
+        } else if constexpr (Groups > 1) {
+            dll::grouped_conv_backward(context.errors, w, output, Groups, P1, P2);
+        } else if constexpr (!etl::is_dma<std::decay_t<H>>) {
+            // The kernels need direct memory access
+            etl::dyn_matrix<weight, 4> result(etl::dim<0>(output), NC, NV1, NV2);
+
+            convolution_backward(result, context);
+            output = result;
+        } else if constexpr (winograd) {
+            dll::winograd_backward(context.errors, w_winograd.get(w), output, NC, NV1, NV2, K, P1, arena);
+        } else {
+            dll::same_conv_backward(context.errors, w, output, geometry(), arena);
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients of the filters of the convolution
+     */
+    template <typename G, typename C>
+    void convolution_backward_filter(G& grad, C& context) const {
+        if constexpr (Groups > 1) {
+            dll::grouped_conv_backward_filter(context.input, context.errors, grad, Groups, P1, P2, arena);
+        } else if constexpr (winograd) {
+            dll::winograd_backward_filter(context.input, context.errors, grad, NC, NV1, NV2, K, P1, arena);
+        } else {
+            dll::same_conv_backward_filter(context.input, context.errors, grad, geometry(), arena, keeps_lowering ? &lowered : nullptr);
+        }
+    }
 };
 
 //Allow odr-use of the constexpr static members
@@ -272,14 +419,16 @@ struct sgd_context<DBN, conv_same_layer_impl<Desc>, L> {
 
     static constexpr size_t NV1 = layer_t::NV1;
     static constexpr size_t NV2 = layer_t::NV2;
+    static constexpr size_t NH1 = layer_t::NH1;
+    static constexpr size_t NH2 = layer_t::NH2;
     static constexpr size_t NC  = layer_t::NC;
     static constexpr size_t K   = layer_t::K;
 
     static constexpr auto batch_size = DBN::batch_size;
 
     etl::fast_matrix<weight, batch_size, NC, NV1, NV2> input;
-    etl::fast_matrix<weight, batch_size, K,  NV1, NV2> output;
-    etl::fast_matrix<weight, batch_size, K,  NV1, NV2> errors;
+    etl::fast_matrix<weight, batch_size, K,  NH1, NH2> output;
+    etl::fast_matrix<weight, batch_size, K,  NH1, NH2> errors;
 
     sgd_context(const layer_t& /* layer */)
             : output(0.0), errors(0.0) {}
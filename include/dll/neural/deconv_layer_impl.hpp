@@ -9,6 +9,9 @@
 
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/epilogue.hpp" // for fused bias and activation
+#include "dll/util/deconv.hpp" // for the kernels of the deconvolutions
+
 namespace dll {
 
 /*!
@@ -54,6 +57,11 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    conv_algorithm algorithm = conv_algorithm::DEFAULT; ///< The algorithm of the convolutions (see autotune)
+
+    mutable deconv_filters<weight> w_transposed; ///< The transposed-convolution filters
+    workspace* arena = nullptr;                  ///< The workspace shared by the layers of the network
+
     /*!
      * \brief Initialize a conv layer with basic weights.
      */
@@ -128,20 +136,13 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        output = etl::conv_4d_full_flipped(v, w);
+        dll::deconv_forward(v, w, output, algorithm, w_transposed, arena);
 
-        if constexpr (etl::decay_traits<H1>::is_fast) {
-            static constexpr auto batch_size = etl::decay_traits<H1>::template dim<0>();
-
-            auto b_rep = etl::force_temporary(etl::rep_l<batch_size>(etl::rep<NH1, NH2>(b)));
-
-            output = f_activate<activation_function>(b_rep + output);
+        // The biases are added in place, without a replicated temporary
+        if constexpr (fused_epilogue<activation_function> && etl::is_dma<std::decay_t<H1>>) {
+            bias_activate_4d<activation_function>(output, b);
         } else {
-            auto batch_size = etl::dim<0>(output);
-
-            auto b_rep = etl::force_temporary(etl::rep_l(etl::rep<NH1, NH2>(b), batch_size));
-
-            output = f_activate<activation_function>(b_rep + output);
+            output = f_activate<activation_function>(etl::bias_add_4d(output, b));
         }
     }
 
@@ -200,10 +201,10 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
         if constexpr (etl::decay_traits<H>::dimensions() == 4) {
-            output = etl::conv_4d_valid_flipped(context.errors, w);
+            dll::deconv_backward(context.errors, w, output, algorithm, w_transposed, arena);
         } else {
-            static constexpr auto B               = etl::decay_traits<H>::template dim<0>();
-            etl::reshape<B, NC, NV1, NV2>(output) = etl::conv_4d_valid_flipped(context.errors, w);
+            static constexpr auto B = etl::decay_traits<H>::template dim<0>();
+            dll::deconv_backward(context.errors, w, etl::reshape<B, NC, NV1, NV2>(output), algorithm, w_transposed, arena);
         }
     }
 
@@ -216,6 +217,40 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
         std::get<0>(context.up.context)->grad = etl::conv_4d_valid_filter_flipped(context.errors, context.input);
         std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
     }
+
+    /*!
+     * \brief Invalidate the transposed-convolution filters, after a
+     * modification of the weights
+     */
+    void invalidate_weights_cache() {
+        w_transposed.invalidate();
+    }
+
+    /*!
+     * \brief Use the given workspace for the temporaries of the kernels
+     * \param ws The workspace shared by the layers of the network
+     */
+    void set_workspace(workspace* ws) {
+        arena = ws;
+    }
+
+    /*!
+     * \brief Returns the size, in bytes, of the workspace needed by the
+     * kernels of the layer
+     */
+    size_t workspace_size() const {
+        return deconv_workspace_size<weight>(NC, NV1, NV2, K, NW1, NW2);
+    }
+
+    /*!
+     * \brief Select the fastest algorithm of the convolutions for the given
+     * batch size, from the cache or by benchmarking the candidates
+     * \param batch The batch size
+     * \param cache The decisions of the autotuning
+     */
+    void autotune(size_t batch, conv_tuning_cache& cache) {
+        autotune_deconv(*this, batch, cache, NC, NV1, NV2, K, NW1, NW2);
+    }
 };
 
 //Allow odr-use of the constexpr static members
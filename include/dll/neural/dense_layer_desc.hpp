@@ -30,6 +30,8 @@ struct dense_layer_desc {
     using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
     using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
 
+    static constexpr size_t model_shards = detail::get_value_v<model_parallel<1>, Parameters...>; ///< The number of model-parallel shards (1 if disabled)
+
     /*! The type used to store the weights */
     using weight = detail::get_type_t<weight_type<float>, Parameters...>;
 
@@ -45,7 +47,7 @@ struct dense_layer_desc {
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<
-            weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id>,
+            weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id, sparse_input_id, model_parallel_id>,
             Parameters...>,
         "Invalid parameters type for dense_layer_desc");
 };
@@ -11,6 +11,13 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/csr_batch.hpp"
+#include "dll/util/pruning.hpp"
+#include "dll/util/epilogue.hpp" // for fused bias and activation
+#include "dll/util/softmax.hpp"  // for the fused bias and softmax
+#include "dll/util/model_parallel.hpp"
+#include "dll/util/transposed_weights.hpp"
+#include "dll/util/binary_states.hpp"
 
 namespace dll {
 
@@ -29,8 +36,10 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
     static constexpr size_t num_visible = desc::num_visible; ///< The number of visible units
     static constexpr size_t num_hidden  = desc::num_hidden;  ///< The number of hidden units
 
-    static constexpr auto activation_function = desc::activation_function;                           ///< The layer's activation function
-    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr auto activation_function = desc::activation_function;                                ///< The layer's activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>();      ///< Disable the biases
+    static constexpr auto sparse_input        = desc::parameters::template contains<dll::sparse_input>(); ///< Use the sparse kernels for the input
+    static constexpr size_t model_shards      = desc::model_shards;                                       ///< The number of model-parallel shards (1 if disabled, 0 for the number of threads)
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -51,6 +60,12 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    std::unique_ptr<w_type> w_mask; ///< Mask of the pruned weights (1 for kept weights)
+
+    mutable sparse_weights<weight> sparse_w; ///< The compressed pruned weights
+    mutable weight_shards<weight> w_shards;  ///< The shards of the weights, for model parallelism
+    mutable transposed_weights<weight> w_t;  ///< The transposed weights, for the backward pass without BLAS
+
     /*!
      * \brief Initialize a dense layer with basic weights.
      *
@@ -128,6 +143,90 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
         return {num_hidden};
     }
 
+    /*!
+     * \brief Prune the weights whose magnitude is under the given threshold.
+     *
+     * The pruned weights are kept at zero by the next trainings and, once
+     * sparse enough, are computed with the sparse kernels.
+     *
+     * \param threshold The magnitude under which the weights are pruned
+     * \return The total number of pruned weights of the layer
+     */
+    size_t prune(weight threshold) {
+        const size_t pruned = prune_weights(w, w_mask, threshold);
+
+        invalidate_weights_cache();
+
+        return pruned;
+    }
+
+    /*!
+     * \brief Prune the given ratio of the weights, those with the smallest
+     * magnitude
+     * \param sparsity The ratio of weights to prune, in [0, 1]
+     * \return The magnitude threshold that has been used
+     */
+    weight prune_ratio(double sparsity) {
+        std::vector<weight> magnitudes;
+        append_magnitudes(w, magnitudes);
+
+        const auto threshold = magnitude_threshold(magnitudes, sparsity);
+
+        prune(threshold);
+
+        return threshold;
+    }
+
+    /*!
+     * \brief Returns the ratio of pruned weights of the layer
+     */
+    double sparsity() const {
+        return w_mask ? 1.0 - double(etl::sum(*w_mask)) / double(etl::size(w)) : 0.0;
+    }
+
+    /*!
+     * \brief Set the pruned weights back to zero, after a modification of
+     * the weights
+     */
+    void apply_weights_mask() {
+        if (w_mask) {
+            w = w >> *w_mask;
+
+            invalidate_weights_cache();
+        }
+    }
+
+    /*!
+     * \brief Invalidate the compressed weights, after a modification of the
+     * weights
+     */
+    void invalidate_weights_cache() {
+        sparse_w.invalidate();
+        w_shards.invalidate();
+        w_t.invalidate();
+    }
+
+    /*!
+     * \brief Store the weights, only their non-zeros, and the biases into
+     * the given stream
+     */
+    void store_sparse(std::ostream& os) const {
+        store_sparse_weights(os, w);
+        cpp::binary_write_all(os, b);
+    }
+
+    /*!
+     * \brief Load the weights stored with store_sparse from the given stream.
+     *
+     * All the zero weights are considered pruned.
+     */
+    void load_sparse(std::istream& is) {
+        load_sparse_weights(is, w, w_mask);
+        cpp::binary_load_all(is, b);
+
+        invalidate_weights_cache();
+    }
+
     /*!
      * \brief Apply the layer to the given batch of input.
      *
@@ -145,13 +244,79 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        output = etl::reshape(input, Batch, num_visible) * w;
-
-        if constexpr (!no_bias) {
-            output = bias_add_2d(output, b);
+        if (pruned_forward(output, input)) {
+            // The pruned weights are computed with the sparse kernel
+        } else if constexpr (sparse_input && etl::is_dma<V>) {
+            csr_batch<weight> sparse;
+
+            if (sparse.compress(input)) {
+                csr_mul(sparse, w, output);
+            } else if (!parallel_forward(output, input, Batch)) {
+                output = etl::reshape(input, Batch, num_visible) * w;
+            }
+        } else if (!parallel_forward(output, input, Batch)) {
+            output = etl::reshape(input, Batch, num_visible) * w;
         }
 
-        output = f_activate<activation_function>(output);
+        forward_epilogue(output);
+    }
+
+    /*!
+     * \brief Apply the layer to the given bit-packed batch of binary input,
+     * for instance the packed output of a binarize layer.
+     *
+     * Only the rows of the weights of the active units are added, instead of
+     * the product with the expanded batch.
+     *
+     * \param output A batch of output that will be filled
+     * \param input A packed batch of input
+     */
+    template <typename H>
+    void forward_batch_packed(H&& output, const binary_states& input) const {
+        dll::auto_timer timer("dense:forward_batch:packed");
+
+        cpp_assert(etl::dim<0>(output) == input.rows, "The number of samples must be consistent");
+
+        binary_hidden_product(input, w, output);
+
+        forward_epilogue(output);
+    }
+
+    /*!
+     * \brief Apply the layer to a single sample, with a vector-matrix
+     * product instead of the matrix-matrix product of a batch of one.
+     *
+     * The pruned weights and the sparse input are computed with the batch
+     * kernels.
+     *
+     * \param output The output vector that will be filled
+     * \param input One input sample
+     */
+    template <typename H, typename V>
+    void forward_one_direct(H&& output, const V& input) const {
+        dll::auto_timer timer("dense:forward_one");
+
+        if (sparse_input || w_mask) {
+            forward_batch(batch_reshape(output), batch_reshape(input));
+        } else {
+            output = etl::reshape<num_visible>(input) * w;
+
+            if constexpr (!no_bias && fused_epilogue<activation_function> && etl::is_dma<std::decay_t<H>>) {
+                bias_activate_last<activation_function>(output, b);
+            } else if constexpr (activation_function == function::SOFTMAX && etl::is_dma<std::decay_t<H>>) {
+                if constexpr (no_bias) {
+                    softmax_last(output, num_hidden);
+                } else {
+                    bias_softmax_last(output, b);
+                }
+            } else {
+                if constexpr (!no_bias) {
+                    output = output + b;
+                }
+
+                output = f_activate<activation_function>(output);
+            }
+        }
     }
 
     /*!
@@ -214,7 +379,14 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
 
         // The reshape has no overhead, so better than SFINAE for nothing
         constexpr auto Batch = etl::decay_traits<decltype(context.errors)>::template dim<0>();
-        etl::reshape<Batch, num_visible>(output) = context.errors * etl::transpose(w);
+
+        if (auto* pool = model_pool()) {
+            model_parallel_backward(*pool, context.errors, w, etl::reshape<Batch, num_visible>(output), w_shards, model_parallel_shards(num_hidden, model_shards));
+        } else if constexpr (transpose_free_gemm) {
+            etl::reshape<Batch, num_visible>(output) = context.errors * etl::transpose(w);
+        } else {
+            etl::reshape<Batch, num_visible>(output) = context.errors * w_t.get(w);
+        }
     }
 
     /*!
@@ -225,12 +397,122 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
     void compute_gradients(C& context) const {
         dll::unsafe_auto_timer timer("dense:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+
+        if constexpr (sparse_input) {
+            csr_batch<weight> sparse;
+
+            if (sparse.compress(context.input)) {
+                w_grad = 0;
+                csr_outer_add(sparse, context.errors, w_grad);
+            } else if (!parallel_gradients(w_grad, context)) {
+                w_grad = batch_outer(context.input, context.errors);
+            }
+        } else if (!parallel_gradients(w_grad, context)) {
+            w_grad = batch_outer(context.input, context.errors);
+        }
 
         if constexpr (!no_bias) {
             std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
         }
     }
+
+private:
+    /*!
+     * \brief Add the biases to the product of the input by the weights and
+     * apply the activation function, fused when possible
+     */
+    template <typename H>
+    void forward_epilogue(H&& output) const {
+        if constexpr (!no_bias && fused_epilogue<activation_function> && etl::is_dma<std::decay_t<H>>) {
+            bias_activate_2d<activation_function>(output, b);
+        } else if constexpr (activation_function == function::SOFTMAX && etl::is_dma<std::decay_t<H>>) {
+            if constexpr (no_bias) {
+                softmax_last(output, num_hidden);
+            } else {
+                bias_softmax_last(output, b);
+            }
+        } else {
+            if constexpr (!no_bias) {
+                output = bias_add_2d(output, b);
+            }
+
+            output = f_activate<activation_function>(output);
+        }
+    }
+
+    /*!
+     * \brief Returns the thread pool of the model-parallel kernels, or
+     * nullptr if the layer is not split in several shards or there is no
+     * thread pool in the scope
+     */
+    cpp::thread_pool<true>* model_pool() const {
+        if constexpr (model_shards != 1) {
+            if (model_parallel_shards(num_hidden, model_shards) > 1) {
+                return scoped_thread_pool();
+            }
+        }
+
+        return nullptr;
+    }
+
+    /*!
+     * \brief Compute output = input * w with the model-parallel kernels, if
+     * possible
+     * \return true if the product has been computed, false otherwise
+     */
+    template <typename H, typename V>
+    bool parallel_forward(H&& output, const V& input, size_t Batch) const {
+        if constexpr (etl::is_dma<std::decay_t<H>>) {
+            if (auto* pool = model_pool()) {
+                model_parallel_forward(*pool, etl::reshape(input, Batch, num_visible), w, output, w_shards, model_parallel_shards(num_hidden, model_shards));
+                return true;
+            }
+        } else {
+            cpp_unused(output);
+            cpp_unused(input);
+            cpp_unused(Batch);
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Compute the gradients of the weights with the model-parallel
+     * kernels, if possible
+     * \return true if the gradients have been computed, false otherwise
+     */
+    template <typename G, typename C>
+    bool parallel_gradients(G& w_grad, C& context) const {
+        if (auto* pool = model_pool()) {
+            model_parallel_gradients(*pool, context.input, context.errors, w_grad, model_parallel_shards(num_hidden, model_shards));
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Compute the product of the input by the pruned weights with the
+     * sparse kernel, if the weights are sparse enough
+     * \return true if the product has been computed, false otherwise
+     */
+    template <typename H, typename V>
+    bool pruned_forward(H&& output, const V& input) const {
+        if constexpr (etl::is_dma<V> && etl::is_dma<std::decay_t<H>>) {
+            if (w_mask) {
+                if (const auto* sparse = sparse_w.get(w)) {
+                    dense_csr_mul(input, *sparse, output);
+                    return true;
+                }
+            }
+        } else {
+            cpp_unused(output);
+            cpp_unused(input);
+        }
+
+        return false;
+    }
 };
 
 //Allow odr-use of the constexpr static members
@@ -0,0 +1,14 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+// Include the dyn version (for dyn_dbn)
+#include "dll/neural/dyn_depthwise_conv_layer.hpp"
+
+#include "dll/neural/depthwise_conv_layer_impl.hpp"
+#include "dll/neural/depthwise_conv_layer_desc.hpp"
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/transform/transform_layer.hpp"
+#include "dll/util/dropout_mask.hpp"
 
 namespace dll {
 
@@ -24,11 +25,9 @@ struct dropout_layer_impl : transform_layer<dropout_layer_impl<Desc>> {
 
     static constexpr float p = float(desc::Drop) / 100.0f; ///< The dropout rate
 
-    mutable decltype(etl::state_inverted_dropout_mask(dll::rand_engine(), p)) dropout; ///< The dropout mask generator (ETL)
+    mutable random_engine engine = make_engine(new_streams()); ///< The random engine of the layer
 
-    dropout_layer_impl() : dropout(dll::rand_engine(), p) {
-        // Nothing else to init
-    }
+    mutable dropout_mask mask; ///< The mask of the last training batch
 
     /*!
      * \brief Returns a full string representation of the layer
@@ -96,9 +95,8 @@ struct dropout_layer_impl : transform_layer<dropout_layer_impl<Desc>> {
     void train_forward_batch(Output& output, const Input& input) const noexcept {
         dll::auto_timer timer("dropout:train:forward");
 
-        // Note: For now, cannot do on one pass because of state_inverted dropout not copy-able
-        output = dropout;
-        output = output >> input;
+        mask.generate(engine, etl::size(input), p);
+        mask.apply(output, input);
     }
 
     /*!
@@ -122,7 +120,7 @@ struct dropout_layer_impl : transform_layer<dropout_layer_impl<Desc>> {
     void backward_batch(H&& output, C& context) const {
         dll::unsafe_auto_timer timer("dropout:backward");
 
-        output = context.errors;
+        mask.apply(output, context.errors);
     }
 
     /*!
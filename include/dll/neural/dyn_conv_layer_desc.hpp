@@ -23,6 +23,7 @@ struct dyn_conv_layer_desc {
     using parameters = cpp::type_list<Parameters...>;
 
     static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>;            ///< The layer's activation function
+    static constexpr size_t Groups            = detail::get_value_v<groups<1>, Parameters...>;                                ///< The number of groups of filters
 
     using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
     using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
@@ -38,7 +39,7 @@ struct dyn_conv_layer_desc {
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, groups_id, no_bias_id>, Parameters...>,
         "Invalid parameters type for dyn_conv_layer_desc");
 };
 
@@ -11,6 +11,11 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/epilogue.hpp" // for fused bias and activation
+#include "dll/util/grouped_conv.hpp" // for grouped convolutions
+#include "dll/util/winograd.hpp" // for F(2x2,3x3) kernels
+#include "dll/util/conv_autotune.hpp" // for the selection of the algorithm
+#include "dll/util/structured_pruning.hpp" // for the removal of filters
 
 namespace dll {
 
@@ -28,6 +33,7 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
 
     static constexpr auto activation_function = desc::activation_function;                           ///< The layer's activation function
     static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr size_t Groups            = desc::Groups;                                        ///< The number of groups of filters
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -48,6 +54,11 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    mutable winograd_filters<weight> w_winograd; ///< The Winograd transform of the filters, for 3x3 filters
+    workspace* arena = nullptr;                  ///< The workspace shared by the layers of the network
+
+    conv_algorithm algorithm = conv_algorithm::DEFAULT; ///< The algorithm of the convolutions (see autotune)
+
     size_t nv1; ///< The first visible dimension
     size_t nv2; ///< The second visible dimension
     size_t nh1; ///< The first output dimension
@@ -55,8 +66,8 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     size_t nc;  ///< The number of input channels
     size_t k;   ///< The number of filters
 
-    size_t nw1; ///< The first dimension of the filters
-    size_t nw2; ///< The second dimension of the filters
+    size_t nw1 = 0; ///< The first dimension of the filters
+    size_t nw2 = 0; ///< The second dimension of the filters
 
     dyn_conv_layer_impl(): base_type() {
         // Nothing else to init
@@ -76,12 +87,17 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
         this->nh1 = nv1 - nw1 + 1;
         this->nh2 = nv2 - nw2 + 1;
 
-        w = etl::dyn_matrix<weight, 4>(k, nc, nw1, nw2);
+        cpp_assert(nc % Groups == 0, "The channels must be divisible by the number of groups");
+        cpp_assert(k % Groups == 0, "The filters must be divisible by the number of groups");
+
+        w = etl::dyn_matrix<weight, 4>(k, nc / Groups, nw1, nw2);
 
         b = etl::dyn_vector<weight>(k);
 
         w_initializer::initialize(w, input_size(), output_size());
         b_initializer::initialize(b, input_size(), output_size());
+
+        w_winograd.invalidate();
     }
 
     /*!
@@ -164,18 +180,18 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("conv:forward_batch");
 
-        if constexpr (etl::dimensions<V>() == 4) {
-            output = etl::ml::convolution_forward(v, w);
-        } else {
-            output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w);
-        }
+        convolution_forward(output, v);
 
-        if constexpr (!no_bias) {
-            output = bias_add_4d(output, b);
-        }
+        if constexpr (!no_bias && fused_epilogue<activation_function> && etl::is_dma<std::decay_t<H1>>) {
+            bias_activate_4d<activation_function>(output, b);
+        } else {
+            if constexpr (!no_bias) {
+                output = bias_add_4d(output, b);
+            }
 
-        if constexpr (activation_function != function::IDENTITY) {
-            output = f_activate<activation_function>(output);
+            if constexpr (activation_function != function::IDENTITY) {
+                output = f_activate<activation_function>(output);
+            }
         }
     }
 
@@ -246,11 +262,7 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("conv:backward_batch");
 
-        if constexpr (etl::dimensions<H>() == 4) {
-            output = etl::ml::convolution_backward(context.errors, w);
-        } else {
-            etl::reshape(output, etl::dim<0>(output), nc, nv1, nv2) = etl::ml::convolution_backward(context.errors, w);
-        }
+        convolution_backward(output, context);
     }
 
     /*!
@@ -261,12 +273,235 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     void compute_gradients(C& context) const {
         dll::auto_timer timer("conv:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors);
+        convolution_backward_filter(std::get<0>(context.up.context)->grad, context);
 
         if constexpr (!no_bias) {
             std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
         }
     }
+
+    /*!
+     * \brief Invalidate the Winograd transform of the filters, after a
+     * modification of the weights
+     */
+    void invalidate_weights_cache() {
+        w_winograd.invalidate();
+    }
+
+    /*!
+     * \brief Returns the number of output units (filters) of the layer
+     */
+    size_t output_units() const noexcept {
+        return k;
+    }
+
+    /*!
+     * \brief Returns the L2 norm of each filter, the criterion of the
+     * structured pruning
+     */
+    std::vector<weight> unit_norms() const {
+        return unit_row_norms(w, k);
+    }
+
+    /*!
+     * \brief Remove the filters not in the given list, shrinking the layer
+     * \param kept The indices of the filters to keep, in order
+     */
+    void shrink_outputs(const std::vector<size_t>& kept) {
+        cpp_assert(Groups == 1, "The grouped filters cannot be removed");
+
+        w_type shrunk_w(kept.size(), nc, nw1, nw2);
+        b_type shrunk_b(kept.size());
+
+        gather_rows(w, shrunk_w, kept, k);
+        gather_rows(b, shrunk_b, kept, k);
+
+        w = std::move(shrunk_w);
+        b = std::move(shrunk_b);
+
+        k = kept.size();
+
+        shrunk();
+    }
+
+    /*!
+     * \brief Remove the input channels not in the given list, shrinking the
+     * layer
+     * \param kept The indices of the channels to keep, in order
+     * \param units The number of channels of the previous layer
+     */
+    void shrink_inputs(const std::vector<size_t>& kept, size_t units) {
+        cpp_assert(Groups == 1, "The channels of grouped filters cannot be removed");
+        cpp_assert(units == nc, "The channels of the layer do not match the units");
+
+        w_type shrunk_w(k, kept.size(), nw1, nw2);
+
+        gather_columns(w, shrunk_w, kept, nc);
+
+        w = std::move(shrunk_w);
+
+        nc = kept.size();
+
+        shrunk();
+    }
+
+    /*!
+     * \brief Invalidate the state depending on the shape of the weights,
+     * after they have been shrunk
+     */
+    void shrunk() {
+        bak_w.reset();
+        bak_b.reset();
+
+        // The autotuned algorithm was selected for the previous shape
+        algorithm = conv_algorithm::DEFAULT;
+
+        invalidate_weights_cache();
+    }
+
+    /*!
+     * \brief Use the given workspace for the temporaries of the kernels
+     * \param ws The workspace shared by the layers of the network
+     */
+    void set_workspace(workspace* ws) {
+        arena = ws;
+    }
+
+    /*!
+     * \brief Returns the size, in bytes, of the workspace needed by the
+     * kernels of the layer
+     */
+    size_t workspace_size() const {
+        if (winograd()) {
+            return winograd_workspace_size<weight>(nc, nv1, nv2, k, 0);
+        }
+
+        return 0;
+    }
+
+    /*!
+     * \brief Indicates if the Winograd kernels are used, for 3x3 filters
+     */
+    bool winograd() const noexcept {
+        return nw1 == 3 && nw2 == 3 && Groups == 1;
+    }
+
+    /*!
+     * \brief Select the fastest algorithm of the convolutions for the given
+     * batch size, from the cache or by benchmarking the candidates
+     * \param batch The batch size
+     * \param cache The decisions of the autotuning
+     */
+    void autotune(size_t batch, conv_tuning_cache& cache) {
+        if constexpr (Groups == 1) {
+            autotune_conv(*this, batch, cache, nc, nv1, nv2, k, nw1, nw2);
+        } else {
+            cpp_unused(batch);
+            cpp_unused(cache);
+        }
+    }
+
+private:
+    /*!
+     * \brief Indicates if the convolutions are computed with the Winograd
+     * kernels
+     */
+    bool use_winograd() const noexcept {
+        return winograd() && (algorithm == conv_algorithm::DEFAULT || algorithm == conv_algorithm::WINOGRAD);
+    }
+
+    /*!
+     * \brief Compute the convolution of the input with the filters, with the
+     * selected algorithm (Winograd kernels for 3x3 filters by default)
+     */
+    template <typename H1, typename V>
+    void convolution_forward(H1&& output, const V& v) const {
+        if constexpr (Groups > 1) {
+            if constexpr (etl::dimensions<V>() == 4) {
+                dll::grouped_conv_forward(v, w, output, Groups, 0, 0);
+            } else {
+                dll::grouped_conv_forward(etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w, output, Groups, 0, 0);
+            }
+
+            return;
+        }
+
+        if constexpr (etl::is_dma<V> && etl::is_dma<std::decay_t<H1>>) {
+            if (use_winograd()) {
+                dll::winograd_forward(v, w_winograd.get(w), output, nc, nv1, nv2, k, 0, arena);
+                return;
+            }
+        }
+
+        if (algorithm == conv_algorithm::PER_SAMPLE) {
+            if constexpr (etl::dimensions<V>() == 4) {
+                dll::grouped_conv_forward(v, w, output, 1, 0, 0);
+            } else {
+                dll::grouped_conv_forward(etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w, output, 1, 0, 0);
+            }
+        } else if constexpr (etl::dimensions<V>() == 4) {
+            output = etl::ml::convolution_forward(v, w);
+        } else {
+            output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w);
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients of the input of the convolution
+     */
+    template <typename H, typename C>
+    void convolution_backward(H&& output, C& context) const {
+        if constexpr (Groups > 1) {
+            if constexpr (etl::dimensions<H>() == 4) {
+                dll::grouped_conv_backward(context.errors, w, output, Groups, 0, 0);
+            } else {
+                dll::grouped_conv_backward(context.errors, w, etl::reshape(output, etl::dim<0>(output), nc, nv1, nv2), Groups, 0, 0);
+            }
+
+            return;
+        }
+
+        if constexpr (etl::is_dma<decltype(context.errors)> && etl::is_dma<std::decay_t<H>>) {
+            if (use_winograd()) {
+                dll::winograd_backward(context.errors, w_winograd.get(w), output, nc, nv1, nv2, k, 0, arena);
+                return;
+            }
+        }
+
+        if (algorithm == conv_algorithm::PER_SAMPLE) {
+            if constexpr (etl::dimensions<H>() == 4) {
+                dll::grouped_conv_backward(context.errors, w, output, 1, 0, 0);
+            } else {
+                dll::grouped_conv_backward(context.errors, w, etl::reshape(output, etl::dim<0>(output), nc, nv1, nv2), 1, 0, 0);
+            }
+        } else if constexpr (etl::dimensions<H>() == 4) {
+            output = etl::ml::convolution_backward(context.errors, w);
+        } else {
+            etl::reshape(output, etl::dim<0>(output), nc, nv1, nv2) = etl::ml::convolution_backward(context.errors, w);
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients of the filters of the convolution
+     */
+    template <typename G, typename C>
+    void convolution_backward_filter(G& grad, C& context) const {
+        if constexpr (Groups > 1) {
+            dll::grouped_conv_backward_filter(context.input, context.errors, grad, Groups, 0, 0, arena);
+            return;
+        }
+
+        if constexpr (etl::is_dma<decltype(context.input)> && etl::is_dma<decltype(context.errors)>) {
+            if (use_winograd()) {
+                dll::winograd_backward_filter(context.input, context.errors, grad, nc, nv1, nv2, k, 0, arena);
+                return;
+            }
+        }
+
+        // The per-sample algorithm would need a reduction, the gradients of
+        // the filters are computed on the whole batch
+        grad = etl::ml::convolution_backward_filter(context.input, context.errors);
+    }
 };
 
 // Declare the traits for the Layer
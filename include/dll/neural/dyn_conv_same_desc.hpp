@@ -23,9 +23,13 @@ struct dyn_conv_same_desc {
     using parameters = cpp::type_list<Parameters...>;
 
     static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>;            ///< The layer's activation function
+    static constexpr size_t Groups            = detail::get_value_v<groups<1>, Parameters...>;                                ///< The number of groups of filters
+    static constexpr size_t S1                = detail::get_value_1<strides<1, 1>, Parameters...>::value;                     ///< The default vertical stride
+    static constexpr size_t S2                = detail::get_value_2<strides<1, 1>, Parameters...>::value;                     ///< The default horizontal stride
 
     using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
     using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
+    using lowered_t     = detail::get_type_t<keep_lowered<void>, Parameters...>;         ///< The storage type of the kept lowered input (void if disabled)
 
     /*! The type used to store the weights */
     using weight = detail::get_type_t<weight_type<float>, Parameters...>;
@@ -38,7 +42,7 @@ struct dyn_conv_same_desc {
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, groups_id, strides_id, keep_lowered_id>, Parameters...>,
         "Invalid parameters type for dyn_conv_same_desc");
 };
 
@@ -11,6 +11,10 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/epilogue.hpp" // for fused bias and activation
+#include "dll/util/grouped_conv.hpp" // for grouped convolutions
+#include "dll/util/winograd.hpp" // for F(2x2,3x3) kernels
+#include "dll/util/same_conv.hpp" // for the boundary-aware kernels
 
 namespace dll {
 
@@ -27,6 +31,11 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
     using dyn_layer_t = typename desc::dyn_layer_t;    ///< The dynamic version of this layer
 
     static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+    static constexpr size_t Groups            = desc::Groups;              ///< The number of groups of filters
+
+    using lowered_t = typename desc::lowered_t; ///< The storage type of the kept lowered input (void if disabled)
+
+    static constexpr bool keeps_lowering = !std::is_void<lowered_t>::value && Groups == 1; ///< Keep the lowered input of the training batches
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -47,6 +56,11 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    mutable winograd_filters<weight> w_winograd; ///< The Winograd transform of the filters, for 3x3 filters
+    workspace* arena = nullptr;                  ///< The workspace shared by the layers of the network
+
+    mutable same_conv_lowered<std::conditional_t<keeps_lowering, lowered_t, weight>> lowered; ///< The lowered input of the last training batch, if keeps_lowering
+
     size_t nv1; ///< The first visible dimension
     size_t nv2; ///< The second visible dimension
     size_t nh1; ///< The first output dimension
@@ -54,11 +68,14 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
     size_t nc;  ///< The number of input channels
     size_t k;   ///< The number of filters
 
-    size_t nw1; ///< The first dimension of the filters
-    size_t nw2; ///< The second dimension of the filters
+    size_t nw1 = 0; ///< The first dimension of the filters
+    size_t nw2 = 0; ///< The second dimension of the filters
+
+    size_t s1 = 1; ///< The first dimension stride
+    size_t s2 = 1; ///< The second dimension stride
 
-    size_t p1; ///< The first dimension padding
-    size_t p2; ///< The second dimension padding
+    size_t p1; ///< The first dimension padding (at the top)
+    size_t p2; ///< The second dimension padding (at the left)
 
     dyn_conv_same_layer_impl(): base_type() {
         // Nothing else to init
@@ -67,26 +84,36 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
     /*!
      * \brief Initialize the dynamic layer
      */
-    void init_layer(size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2){
+    void init_layer(size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2, size_t s1 = desc::S1, size_t s2 = desc::S2){
         this->nv1 = nv1;
         this->nv2 = nv2;
         this->nw1 = nw1;
         this->nw2 = nw2;
         this->nc = nc;
         this->k = k;
+        this->s1 = s1;
+        this->s2 = s2;
 
-        this->nh1 = nv1;
-        this->nh2 = nv2;
+        this->nh1 = same_conv_geometry::same_output(nv1, s1);
+        this->nh2 = same_conv_geometry::same_output(nv2, s2);
 
-        this->p1 = (nw1 - 1) / 2;
-        this->p2 = (nw2 - 1) / 2;
+        this->p1 = same_conv_geometry::same_padding(nv1, nh1, nw1, s1);
+        this->p2 = same_conv_geometry::same_padding(nv2, nh2, nw2, s2);
 
-        w = etl::dyn_matrix<weight, 4>(k, nc, nw1, nw2);
+        cpp_assert(nc % Groups == 0, "The channels must be divisible by the number of groups");
+        cpp_assert(k % Groups == 0, "The filters must be divisible by the number of groups");
+        cpp_assert(s1 > 0 && s2 > 0, "The strides must be at least 1");
+        cpp_assert(Groups == 1 || (nw1 % 2 == 1 && nw2 % 2 == 1), "The grouped dyn_conv_same_layer_impl only works with odd-sized filters");
+        cpp_assert(Groups == 1 || (s1 == 1 && s2 == 1), "The grouped dyn_conv_same_layer_impl only works without strides");
+
+        w = etl::dyn_matrix<weight, 4>(k, nc / Groups, nw1, nw2);
 
         b = etl::dyn_vector<weight>(k);
 
         w_initializer::initialize(w, input_size(), output_size());
         b_initializer::initialize(b, input_size(), output_size());
+
+        w_winograd.invalidate();
     }
 
     /*!
@@ -127,8 +154,8 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
      */
     size_t context_memory_size(size_t batch_size) const noexcept {
         return batch_size * nc * nv1 * nv2  // Input
-           + batch_size * k * nv1 * nv2  // Output
-           + batch_size * k * nv1 * nv2; // Errors
+           + batch_size * k * nh1 * nh2  // Output
+           + batch_size * k * nh1 * nh2; // Errors
     }
 
     /*!
@@ -175,14 +202,26 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("conv:forward_batch");
 
-        if constexpr (etl::dimensions<V>() == 4) {
-            output = etl::ml::convolution_forward(v, w, 1, 1, p1, p2);
-        } else {
-            output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w, 1, 1, p1, p2);
-        }
+        convolution_forward<false>(output, v);
+        bias_activate(output);
+    }
+
+    using base_type::train_forward_batch;
 
-        output = bias_add_4d(output, b);
-        output = f_activate<activation_function>(output);
+    /*!
+     * \brief Apply the layer to the given batch of input, for training,
+     * keeping the lowered input for the gradients of the filters with
+     * keep_lowered.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V>
+    void train_forward_batch(H1&& output, const V& v) const {
+        dll::auto_timer timer("conv:train:forward");
+
+        convolution_forward<keeps_lowering>(output, v);
+        bias_activate(output);
     }
 
     void prepare_input(input_one_t& input) const {
@@ -248,7 +287,7 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        output = etl::ml::convolution_backward(context.errors, w, 1, 1, p1, p2);
+        convolution_backward(output, context);
     }
 
     /*!
@@ -257,9 +296,134 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors, 1, 1, p1, p2);
+        convolution_backward_filter(std::get<0>(context.up.context)->grad, context);
         std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
     }
+
+    /*!
+     * \brief Invalidate the Winograd transform of the filters, after a
+     * modification of the weights
+     */
+    void invalidate_weights_cache() {
+        w_winograd.invalidate();
+    }
+
+    /*!
+     * \brief Use the given workspace for the temporaries of the kernels
+     * \param ws The workspace shared by the layers of the network
+     */
+    void set_workspace(workspace* ws) {
+        arena = ws;
+    }
+
+    /*!
+     * \brief Returns the size, in bytes, of the workspace needed by the
+     * kernels of the layer
+     */
+    size_t workspace_size() const {
+        if (winograd()) {
+            return winograd_workspace_size<weight>(nc, nv1, nv2, k, p1);
+        } else if (Groups == 1) {
+            return same_conv_workspace_size<weight>(geometry());
+        }
+
+        return 0;
+    }
+
+    /*!
+     * \brief Indicates if the Winograd kernels are used, for 3x3 filters
+     * without strides
+     */
+    bool winograd() const noexcept {
+        return nw1 == 3 && nw2 == 3 && s1 == 1 && s2 == 1 && Groups == 1;
+    }
+
+    /*!
+     * \brief Returns the geometry of the convolutions of the layer
+     */
+    same_conv_geometry geometry() const {
+        return {nc, nv1, nv2, k, nw1, nw2, s1, s2};
+    }
+
+private:
+    /*!
+     * \brief Add the biases to the output of the convolution and apply the
+     * activation function
+     */
+    template <typename H1>
+    void bias_activate(H1&& output) const {
+        if constexpr (fused_epilogue<activation_function> && etl::is_dma<std::decay_t<H1>>) {
+            bias_activate_4d<activation_function>(output, b);
+        } else {
+            output = bias_add_4d(output, b);
+            output = f_activate<activation_function>(output);
+        }
+    }
+
+    /*!
+     * \brief Compute the convolution of the input with the filters, with the
+     * Winograd kernels for 3x3 filters and the boundary-aware kernels
+     * otherwise
+     *
+     * \tparam Keep Keep the lowered input for the gradients of the filters
+     */
+    template <bool Keep, typename H1, typename V>
+    void convolution_forward(H1&& output, const V& v) const {
+        if constexpr (etl::dimensions<V>() != 4) {
+            convolution_forward<Keep>(output, etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2));
+        } else if constexpr (Groups > 1) {
+            dll::grouped_conv_forward(v, w, output, Groups, p1, p2);
+        } else if constexpr (!etl::is_dma<V> || !etl::is_dma<std::decay_t<H1>>) {
+            // The kernels need direct memory access
+            etl::dyn_matrix<weight, 4> input(etl::dim<0>(v), nc, nv1, nv2);
+            etl::dyn_matrix<weight, 4> result(etl::dim<0>(v), k, nh1, nh2);
+
+            // The lowering of the copy would not be reused
+            input = v;
+            convolution_forward<false>(result, input);
+            output = result;
+        } else if (winograd()) {
+            dll::winograd_forward(v, w_winograd.get(w), output, nc, nv1, nv2, k, p1, arena);
+        } else {
+            dll::same_conv_forward(v, w, output, geometry(), arena, Keep ? &lowered : nullptr);
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients of the input of the convolution
+     */
+    template <typename H, typename C>
+    void convolution_backward(H&& output, C& context) const {
+        if constexpr (etl::dimensions<H>() != 4) {
+            convolution_backward(etl::reshape(output, etl::dim<0>(output), nc, nv1, nv2), context);
+        } else if constexpr (Groups > 1) {
+            dll::grouped_conv_backward(context.errors, w, output, Groups, p1, p2);
+        } else if constexpr (!etl::is_dma<std::decay_t<H>>) {
+            // The kernels need direct memory access
+            etl::dyn_matrix<weight, 4> result(etl::dim<0>(output), nc, nv1, nv2);
+
+            convolution_backward(result, context);
+            output = result;
+        } else if (winograd()) {
+            dll::winograd_backward(context.errors, w_winograd.get(w), output, nc, nv1, nv2, k, p1, arena);
+        } else {
+            dll::same_conv_backward(context.errors, w, output, geometry(), arena);
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients of the filters of the convolution
+     */
+    template <typename G, typename C>
+    void convolution_backward_filter(G& grad, C& context) const {
+        if constexpr (Groups > 1) {
+            dll::grouped_conv_backward_filter(context.input, context.errors, grad, Groups, p1, p2, arena);
+        } else if (winograd()) {
+            dll::winograd_backward_filter(context.input, context.errors, grad, nc, nv1, nv2, k, p1, arena);
+        } else {
+            dll::same_conv_backward_filter(context.input, context.errors, grad, geometry(), arena, keeps_lowering ? &lowered : nullptr);
+        }
+    }
 };
 
 // Declare the traits for the Layer
@@ -298,7 +462,7 @@ struct sgd_context<DBN, dyn_conv_same_layer_impl<Desc>, L> {
 
     sgd_context(const layer_t& layer)
             : input(batch_size, layer.nc, layer.nv1, layer.nv2),
-              output(batch_size, layer.k, layer.nv1, layer.nv2), errors(batch_size, layer.k, layer.nv1, layer.nv2) {}
+              output(batch_size, layer.k, layer.nh1, layer.nh2), errors(batch_size, layer.k, layer.nh1, layer.nh2) {}
 };
 
 } //end of dll namespace
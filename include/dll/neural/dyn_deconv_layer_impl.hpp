@@ -10,6 +10,9 @@
 #include "dll/base_traits.hpp"
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/epilogue.hpp" // for fused bias and activation
+#include "dll/util/deconv.hpp" // for the kernels of the deconvolutions
+
 namespace dll {
 
 /*!
@@ -45,6 +48,11 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    conv_algorithm algorithm = conv_algorithm::DEFAULT; ///< The algorithm of the convolutions (see autotune)
+
+    mutable deconv_filters<weight> w_transposed; ///< The transposed-convolution filters
+    workspace* arena = nullptr;                  ///< The workspace shared by the layers of the network
+
     size_t nv1; ///< The first visible dimension
     size_t nv2; ///< The second visible dimension
     size_t nh1; ///< The first output dimension
@@ -150,13 +158,14 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        output = etl::conv_4d_full_flipped(v, w);
+        dll::deconv_forward(v, w, output, algorithm, w_transposed, arena);
 
-        const auto batch_size = etl::dim<0>(output);
-
-        auto b_rep = etl::force_temporary(etl::rep_l(etl::rep(b, nh1, nh2), batch_size));
-
-        output = f_activate<activation_function>(b_rep + output);
+        // The biases are added in place, without a replicated temporary
+        if constexpr (fused_epilogue<activation_function> && etl::is_dma<std::decay_t<H1>>) {
+            bias_activate_4d<activation_function>(output, b);
+        } else {
+            output = f_activate<activation_function>(etl::bias_add_4d(output, b));
+        }
     }
 
     void prepare_input(input_one_t& input) const {
@@ -223,10 +232,10 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
     template <typename H, typename C>
     void backward_batch(H&& output, C& context) const {
         if constexpr (etl::decay_traits<H>::dimensions() == 4) {
-            output = etl::conv_4d_valid_flipped(context.errors, w);
+            dll::deconv_backward(context.errors, w, output, algorithm, w_transposed, arena);
         } else {
-            const auto B                          = etl::dim<0>(output);
-            etl::reshape(output, B, nc, nv1, nv2) = etl::conv_4d_valid_flipped(context.errors, w);
+            const auto B = etl::dim<0>(output);
+            dll::deconv_backward(context.errors, w, etl::reshape(output, B, nc, nv1, nv2), algorithm, w_transposed, arena);
         }
     }
 
@@ -239,6 +248,40 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
         //TODO Update the gradients (probably with conv_4d_valid_filter)
         std::get<1>(context.up.context)->grad = etl::mean_r(etl::sum_l(context.errors));
     }
+
+    /*!
+     * \brief Invalidate the transposed-convolution filters, after a
+     * modification of the weights
+     */
+    void invalidate_weights_cache() {
+        w_transposed.invalidate();
+    }
+
+    /*!
+     * \brief Use the given workspace for the temporaries of the kernels
+     * \param ws The workspace shared by the layers of the network
+     */
+    void set_workspace(workspace* ws) {
+        arena = ws;
+    }
+
+    /*!
+     * \brief Returns the size, in bytes, of the workspace needed by the
+     * kernels of the layer
+     */
+    size_t workspace_size() const {
+        return deconv_workspace_size<weight>(nc, nv1, nv2, k, nw1, nw2);
+    }
+
+    /*!
+     * \brief Select the fastest algorithm of the convolutions for the given
+     * batch size, from the cache or by benchmarking the candidates
+     * \param batch The batch size
+     * \param cache The decisions of the autotuning
+     */
+    void autotune(size_t batch, conv_tuning_cache& cache) {
+        autotune_deconv(*this, batch, cache, nc, nv1, nv2, k, nw1, nw2);
+    }
 };
 
 // Declare the traits for the Layer
@@ -10,6 +10,14 @@
 #include "dll/base_traits.hpp"  // The traits
 #include "dll/neural_layer.hpp" // The base class
 #include "dll/util/timers.hpp"  // For auto_timer
+#include "dll/util/csr_batch.hpp"
+#include "dll/util/pruning.hpp"
+#include "dll/util/structured_pruning.hpp"
+#include "dll/util/epilogue.hpp"  // For fused bias and activation
+#include "dll/util/softmax.hpp"   // For fused bias and softmax
+#include "dll/util/dyn_dispatch.hpp"
+#include "dll/util/model_parallel.hpp"
+#include "dll/util/transposed_weights.hpp"
 
 namespace dll {
 
@@ -25,8 +33,10 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
     using layer_t     = this_type;                     ///< The type of this layer
     using dyn_layer_t = typename desc::dyn_layer_t;    ///< The dynamic type of this layer
 
-    static constexpr auto activation_function = desc::activation_function;                           ///< The layer's activation function
-    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr auto activation_function = desc::activation_function;                                ///< The layer's activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>();      ///< Disable the biases
+    static constexpr auto sparse_input        = desc::parameters::template contains<dll::sparse_input>(); ///< Use the sparse kernels for the input
+    static constexpr size_t model_shards      = desc::model_shards;                                       ///< The number of model-parallel shards (1 if disabled, 0 for the number of threads)
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -47,9 +57,17 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    std::unique_ptr<w_type> w_mask; ///< Mask of the pruned weights (1 for kept weights)
+
+    mutable sparse_weights<weight> sparse_w; ///< The compressed pruned weights
+    mutable weight_shards<weight> w_shards;  ///< The shards of the weights, for model parallelism
+    mutable transposed_weights<weight> w_t;  ///< The transposed weights, for the backward pass without BLAS
+
     size_t num_visible; ///< The number of visible units
     size_t num_hidden;  ///< The number of hidden units
 
+    size_t shape_index = default_dyn_shapes::size; ///< The index of the compile-time shape of the weights
+
     dyn_dense_layer_impl() : base_type() {}
 
     /*!
@@ -59,6 +77,9 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
         num_visible = nv;
         num_hidden  = nh;
 
+        // Common shapes are computed with compile-time kernels
+        shape_index = default_dyn_shapes::find(num_visible, num_hidden);
+
         w = etl::dyn_matrix<weight, 2>(num_visible, num_hidden);
         b = etl::dyn_matrix<weight, 1>(num_hidden);
 
@@ -132,6 +153,174 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
         return {num_hidden};
     }
 
+    /*!
+     * \brief Prune the weights whose magnitude is under the given threshold.
+     *
+     * The pruned weights are kept at zero by the next trainings and, once
+     * sparse enough, are computed with the sparse kernels.
+     *
+     * \param threshold The magnitude under which the weights are pruned
+     * \return The total number of pruned weights of the layer
+     */
+    size_t prune(weight threshold) {
+        const size_t pruned = prune_weights(w, w_mask, threshold);
+
+        invalidate_weights_cache();
+
+        return pruned;
+    }
+
+    /*!
+     * \brief Prune the given ratio of the weights, those with the smallest
+     * magnitude
+     * \param sparsity The ratio of weights to prune, in [0, 1]
+     * \return The magnitude threshold that has been used
+     */
+    weight prune_ratio(double sparsity) {
+        std::vector<weight> magnitudes;
+        append_magnitudes(w, magnitudes);
+
+        const auto threshold = magnitude_threshold(magnitudes, sparsity);
+
+        prune(threshold);
+
+        return threshold;
+    }
+
+    /*!
+     * \brief Returns the ratio of pruned weights of the layer
+     */
+    double sparsity() const {
+        return w_mask ? 1.0 - double(etl::sum(*w_mask)) / double(etl::size(w)) : 0.0;
+    }
+
+    /*!
+     * \brief Set the pruned weights back to zero, after a modification of
+     * the weights
+     */
+    void apply_weights_mask() {
+        if (w_mask) {
+            w = w >> *w_mask;
+
+            invalidate_weights_cache();
+        }
+    }
+
+    /*!
+     * \brief Returns the number of output units (neurons) of the layer
+     */
+    size_t output_units() const noexcept {
+        return num_hidden;
+    }
+
+    /*!
+     * \brief Returns the L2 norm of the weights of each neuron, the
+     * criterion of the structured pruning
+     */
+    std::vector<weight> unit_norms() const {
+        return unit_column_norms(w);
+    }
+
+    /*!
+     * \brief Remove the neurons not in the given list, shrinking the layer
+     * \param kept The indices of the neurons to keep, in order
+     */
+    void shrink_outputs(const std::vector<size_t>& kept) {
+        w_type shrunk_w(num_visible, kept.size());
+        b_type shrunk_b(kept.size());
+
+        gather_columns(w, shrunk_w, kept, num_hidden);
+        gather_rows(b, shrunk_b, kept, num_hidden);
+
+        if (w_mask) {
+            auto shrunk_mask = std::make_unique<w_type>(num_visible, kept.size());
+            gather_columns(*w_mask, *shrunk_mask, kept, num_hidden);
+            w_mask = std::move(shrunk_mask);
+        }
+
+        w = std::move(shrunk_w);
+        b = std::move(shrunk_b);
+
+        shrunk(num_visible, kept.size());
+    }
+
+    /*!
+     * \brief Remove the inputs coming from the units of the previous layer
+     * not in the given list, shrinking the layer.
+     *
+     * Each unit of the previous layer is a block of consecutive inputs, a
+     * channel of a flattened convolution for instance.
+     *
+     * \param kept The indices of the units to keep, in order
+     * \param units The number of units of the previous layer
+     */
+    void shrink_inputs(const std::vector<size_t>& kept, size_t units) {
+        cpp_assert(num_visible % units == 0, "The inputs of the layer do not match the units");
+
+        const size_t visible = kept.size() * (num_visible / units);
+
+        w_type shrunk_w(visible, num_hidden);
+
+        gather_rows(w, shrunk_w, kept, units);
+
+        if (w_mask) {
+            auto shrunk_mask = std::make_unique<w_type>(visible, num_hidden);
+            gather_rows(*w_mask, *shrunk_mask, kept, units);
+            w_mask = std::move(shrunk_mask);
+        }
+
+        w = std::move(shrunk_w);
+
+        shrunk(visible, num_hidden);
+    }
+
+    /*!
+     * \brief Invalidate the compressed weights, after a modification of the
+     * weights
+     */
+    void invalidate_weights_cache() {
+        sparse_w.invalidate();
+        w_shards.invalidate();
+        w_t.invalidate();
+    }
+
+    /*!
+     * \brief Update the sizes of the layer after its weights have been
+     * shrunk. The backup of the weights does not match them anymore.
+     */
+    void shrunk(size_t nv, size_t nh) {
+        num_visible = nv;
+        num_hidden  = nh;
+
+        shape_index = default_dyn_shapes::find(num_visible, num_hidden);
+
+        bak_w.reset();
+        bak_b.reset();
+
+        invalidate_weights_cache();
+    }
+
+    /*!
+     * \brief Store the weights, only their non-zeros, and the biases into
+     * the given stream
+     */
+    void store_sparse(std::ostream& os) const {
+        store_sparse_weights(os, w);
+        cpp::binary_write_all(os, b);
+    }
+
+    /*!
+     * \brief Load the weights stored with store_sparse from the given stream.
+     *
+     * All the zero weights are considered pruned.
+     */
+    void load_sparse(std::istream& is) {
+        load_sparse_weights(is, w, w_mask);
+        cpp::binary_load_all(is, b);
+
+        invalidate_weights_cache();
+    }
+
     /*!
      * \brief Apply the layer to the given batch of input.
      *
@@ -149,13 +338,74 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        output = etl::reshape(input, Batch, num_visible) * w;
+        if (pruned_forward(output, input)) {
+            // The pruned weights are computed with the sparse kernel
+        } else if constexpr (sparse_input && etl::is_dma<V>) {
+            csr_batch<weight> sparse;
 
-        if constexpr (!no_bias) {
-            output = bias_add_2d(output, b);
+            if (sparse.compress(input)) {
+                csr_mul(sparse, w, output);
+            } else {
+                forward_product(output, input, Batch);
+            }
+        } else {
+            forward_product(output, input, Batch);
+        }
+
+        if constexpr (!no_bias && fused_epilogue<activation_function> && etl::is_dma<std::decay_t<H>>) {
+            bias_activate_2d<activation_function>(output, b);
+        } else if constexpr (activation_function == function::SOFTMAX && etl::is_dma<std::decay_t<H>>) {
+            if constexpr (no_bias) {
+                softmax_last(output, num_hidden);
+            } else {
+                bias_softmax_last(output, b);
+            }
+        } else {
+            if constexpr (!no_bias) {
+                output = bias_add_2d(output, b);
+            }
+
+            output = f_activate<activation_function>(output);
         }
+    }
+
+    /*!
+     * \brief Apply the layer to a single sample, with a vector-matrix
+     * product instead of the matrix-matrix product of a batch of one.
+     *
+     * The pruned weights and the sparse input are computed with the batch
+     * kernels.
+     *
+     * \param output The output vector that will be filled
+     * \param input One input sample
+     */
+    template <typename H, typename V>
+    void forward_one_direct(H&& output, const V& input) const {
+        dll::auto_timer timer("dense:forward_one");
 
-        output = f_activate<activation_function>(output);
+        if (sparse_input || w_mask) {
+            forward_batch(batch_reshape(output), batch_reshape(input));
+        } else {
+            default_dyn_shapes::dispatch(shape_index, w, [&](auto&& fw) {
+                output = etl::reshape(input, num_visible) * fw;
+            });
+
+            if constexpr (!no_bias && fused_epilogue<activation_function> && etl::is_dma<std::decay_t<H>>) {
+                bias_activate_last<activation_function>(output, b);
+            } else if constexpr (activation_function == function::SOFTMAX && etl::is_dma<std::decay_t<H>>) {
+                if constexpr (no_bias) {
+                    softmax_last(output, num_hidden);
+                } else {
+                    bias_softmax_last(output, b);
+                }
+            } else {
+                if constexpr (!no_bias) {
+                    output = output + b;
+                }
+
+                output = f_activate<activation_function>(output);
+            }
+        }
     }
 
     /*!
@@ -225,7 +475,16 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
 
         // The reshape has no overhead, so better than SFINAE for nothing
         auto batch_size = etl::dim<0>(output);
-        etl::reshape(output, batch_size, num_visible) = context.errors * etl::transpose(w);
+
+        if (auto* pool = model_pool()) {
+            model_parallel_backward(*pool, context.errors, w, etl::reshape(output, batch_size, num_visible), w_shards, model_parallel_shards(num_hidden, model_shards));
+        } else if constexpr (transpose_free_gemm) {
+            default_dyn_shapes::dispatch(shape_index, w, [&](auto&& fw) {
+                etl::reshape(output, batch_size, num_visible) = context.errors * etl::transpose(fw);
+            });
+        } else {
+            etl::reshape(output, batch_size, num_visible) = context.errors * w_t.get(w);
+        }
     }
 
     /*!
@@ -236,12 +495,100 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
     void compute_gradients(C& context) const {
         dll::unsafe_auto_timer timer("dense:gradients");
 
-        std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+
+        if constexpr (sparse_input) {
+            csr_batch<weight> sparse;
+
+            if (sparse.compress(context.input)) {
+                w_grad = 0;
+                csr_outer_add(sparse, context.errors, w_grad);
+            } else {
+                outer_gradients(w_grad, context);
+            }
+        } else {
+            outer_gradients(w_grad, context);
+        }
 
         if constexpr (!no_bias) {
             std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
         }
     }
+
+private:
+    /*!
+     * \brief Returns the thread pool of the model-parallel kernels, or
+     * nullptr if the layer is not split in several shards or there is no
+     * thread pool in the scope
+     */
+    cpp::thread_pool<true>* model_pool() const {
+        if constexpr (model_shards != 1) {
+            if (model_parallel_shards(num_hidden, model_shards) > 1) {
+                return scoped_thread_pool();
+            }
+        }
+
+        return nullptr;
+    }
+
+    /*!
+     * \brief Compute output = input * w, with the model-parallel kernels if
+     * the layer is split in several shards, otherwise with the compile-time
+     * shape of the weights if it is a common one
+     */
+    template <typename H, typename V>
+    void forward_product(H& output, const V& input, size_t Batch) const {
+        if constexpr (etl::is_dma<std::decay_t<H>>) {
+            if (auto* pool = model_pool()) {
+                model_parallel_forward(*pool, etl::reshape(input, Batch, num_visible), w, output, w_shards, model_parallel_shards(num_hidden, model_shards));
+                return;
+            }
+        }
+
+        default_dyn_shapes::dispatch(shape_index, w, [&](auto&& fw) {
+            output = etl::reshape(input, Batch, num_visible) * fw;
+        });
+    }
+
+    /*!
+     * \brief Compute the gradients of the weights from the batch of input
+     * and errors, with the model-parallel kernels if the layer is split in
+     * several shards, otherwise with the compile-time shape of the weights if
+     * it is a common one
+     */
+    template <typename G, typename C>
+    void outer_gradients(G& w_grad, C& context) const {
+        if (auto* pool = model_pool()) {
+            model_parallel_gradients(*pool, context.input, context.errors, w_grad, model_parallel_shards(num_hidden, model_shards));
+            return;
+        }
+
+        default_dyn_shapes::dispatch(shape_index, w_grad, [&](auto&& fw_grad) {
+            fw_grad = batch_outer(context.input, context.errors);
+        });
+    }
+
+    /*!
+     * \brief Compute the product of the input by the pruned weights with the
+     * sparse kernel, if the weights are sparse enough
+     * \return true if the product has been computed, false otherwise
+     */
+    template <typename H, typename V>
+    bool pruned_forward(H&& output, const V& input) const {
+        if constexpr (etl::is_dma<V> && etl::is_dma<std::decay_t<H>>) {
+            if (w_mask) {
+                if (const auto* sparse = sparse_w.get(w)) {
+                    dense_csr_mul(input, *sparse, output);
+                    return true;
+                }
+            }
+        } else {
+            cpp_unused(output);
+            cpp_unused(input);
+        }
+
+        return false;
+    }
 };
 
 // Declare the traits for the Layer
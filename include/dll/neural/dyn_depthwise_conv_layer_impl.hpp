@@ -0,0 +1,267 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_traits.hpp"
+#include "dll/base_depthwise_conv_layer.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Dynamic depthwise-separable convolutional layer of neural network.
+ */
+template <typename Desc>
+struct dyn_depthwise_conv_layer_impl final : base_depthwise_conv_layer<dyn_depthwise_conv_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                                       ///< The descriptor type
+    using weight      = typename desc::weight;                      ///< The weight type
+    using this_type   = dyn_depthwise_conv_layer_impl<desc>;        ///< This type
+    using base_type   = base_depthwise_conv_layer<this_type, desc>; ///< The base type
+    using layer_t     = this_type;                                  ///< This layer's type
+    using dyn_layer_t = typename desc::dyn_layer_t;                 ///< The dynamic version of this layer
+
+    static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::dyn_matrix<weight, 3>; ///< The type for one input
+    using output_one_t = etl::dyn_matrix<weight, 3>; ///< The type for one output
+    using input_t      = std::vector<input_one_t>;   ///< The type for many input
+    using output_t     = std::vector<output_one_t>;  ///< The type for many output
+
+    using w_type = etl::dyn_matrix<weight, 3>; ///< The type of the depthwise filters
+    using u_type = etl::dyn_matrix<weight, 2>; ///< The type of the pointwise weights
+    using b_type = etl::dyn_matrix<weight, 1>; ///< The type of the biases
+
+    //Weights and biases
+    w_type w; ///< Depthwise filters
+    u_type u; ///< Pointwise weights
+    b_type b; ///< Hidden biases
+
+    //Backup weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup depthwise filters
+    std::unique_ptr<u_type> bak_u; ///< Backup pointwise weights
+    std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
+
+    size_t nv1; ///< The first visible dimension
+    size_t nv2; ///< The second visible dimension
+    size_t nh1; ///< The first output dimension
+    size_t nh2; ///< The second output dimension
+    size_t nc;  ///< The number of input channels
+    size_t k;   ///< The number of output channels
+
+    size_t nw1; ///< The first dimension of the depthwise filters
+    size_t nw2; ///< The second dimension of the depthwise filters
+
+    dyn_depthwise_conv_layer_impl(): base_type() {
+        // Nothing else to init
+    }
+
+    /*!
+     * \brief Initialize the dynamic layer
+     */
+    void init_layer(size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2){
+        this->nv1 = nv1;
+        this->nv2 = nv2;
+        this->nw1 = nw1;
+        this->nw2 = nw2;
+        this->nc = nc;
+        this->k = k;
+
+        this->nh1 = nv1 - nw1 + 1;
+        this->nh2 = nv2 - nw2 + 1;
+
+        w = etl::dyn_matrix<weight, 3>(nc, nw1, nw2);
+        u = etl::dyn_matrix<weight, 2>(k, nc);
+
+        b = etl::dyn_vector<weight>(k);
+
+        w_initializer::initialize(w, nw1 * nw2, nw1 * nw2);
+        w_initializer::initialize(u, nc, k);
+        b_initializer::initialize(b, input_size(), output_size());
+    }
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    size_t input_size() const noexcept {
+        return nc * nv1 * nv2;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    size_t output_size() const noexcept {
+        return k * nh1 * nh2;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    size_t parameters() const noexcept {
+        return nc * nw1 * nw2 + k * nc;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    std::string to_short_string(std::string pre = "") const {
+        cpp_unused(pre);
+
+        char buffer[1024];
+        snprintf(buffer, 1024, "Conv(depthwise)(%s)(dyn)", to_string(activation_function).c_str());
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    std::string to_full_string(std::string pre = "") const {
+        cpp_unused(pre);
+
+        char buffer[1024];
+        snprintf(buffer, 1024, "Conv(depthwise,dyn): %lux%lux%lu -> (%lux%lu + 1x1x%lu) -> %s -> %lux%lux%lu", nc, nv1, nv2, nw1, nw2, k, to_string(activation_function).c_str(), k, nh1, nh2);
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {k, nh1, nh2};
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V>
+    void forward_batch(H1&& output, const V& v) const {
+        dll::auto_timer timer("depthwise_conv:forward_batch");
+
+        this->forward_batch_impl(output, v, nc, nv1, nv2, k, nw1, nw2);
+    }
+
+    void prepare_input(input_one_t& input) const {
+        input = input_one_t(nc, nv1, nv2);
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    output_t prepare_output(size_t samples) const {
+        output_t output;
+        output.reserve(samples);
+
+        for(size_t i = 0; i < samples; ++i){
+            output.emplace_back(k, nh1, nh2);
+        }
+
+        return output;
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     *
+     * \tparam Input The type of one Input
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return output_one_t(k, nh1, nh2);
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DRBM>
+    static void dyn_init(DRBM&){
+        //Nothing to change
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("depthwise_conv:backward_batch");
+
+        this->backward_batch_impl(output, context, nc, nv1, nv2, k, nw1, nw2);
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        dll::auto_timer timer("depthwise_conv:compute_gradients");
+
+        this->compute_gradients_impl(context, nc, nv1, nv2, k, nw1, nw2);
+    }
+};
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<dyn_depthwise_conv_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = true;  ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = true;  ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of sgd_context for dyn_depthwise_conv_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, dyn_depthwise_conv_layer_impl<Desc>, L> {
+    using layer_t = dyn_depthwise_conv_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::dyn_matrix<weight, 4> input;
+    etl::dyn_matrix<weight, 4> output;
+    etl::dyn_matrix<weight, 4> errors;
+
+    sgd_context(const layer_t& layer)
+            : input(batch_size, layer.nc, layer.nv1, layer.nv2),
+              output(batch_size, layer.k, layer.nh1, layer.nh2), errors(batch_size, layer.k, layer.nh1, layer.nh2) {}
+};
+
+} //end of dll namespace
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/transform/transform_layer.hpp"
+#include "dll/util/dropout_mask.hpp"
 
 namespace dll {
 
@@ -24,28 +25,17 @@ struct dyn_dropout_layer_impl : transform_layer<dyn_dropout_layer_impl<Desc>> {
 
     float p; ///< The dropout probability
 
-    using dropout_t = decltype(etl::state_inverted_dropout_mask(dll::rand_engine(), p));
+    mutable random_engine engine = make_engine(new_streams()); ///< The random engine of the layer
 
-    dropout_t* dropout = nullptr; ///< The dropout mask generator (ETL)
+    mutable dropout_mask mask; ///< The mask of the last training batch
 
     dyn_dropout_layer_impl() = default;
 
-    /*!
-     * \brief Delete the layer and frees all allocated resources
-     */
-    ~dyn_dropout_layer_impl() {
-        if (dropout) {
-            delete dropout;
-        }
-    }
-
     /*!
      * \brief Initialize the dynamic layer
      */
     void init_layer(float p) {
         this->p = p;
-
-        dropout = new dropout_t(dll::rand_engine(), p);
     }
 
     /*!
@@ -103,9 +93,8 @@ struct dyn_dropout_layer_impl : transform_layer<dyn_dropout_layer_impl<Desc>> {
     void train_forward_batch(Output& output, const Input& input) const {
         dll::auto_timer timer("dropout:train:forward");
 
-        // Note: For now, cannot do on one pass because of state_inverted dropout not copy-able
-        output = *dropout;
-        output = output >> input;
+        mask.generate(engine, etl::size(input), p);
+        mask.apply(output, input);
     }
 
     /*!
@@ -129,7 +118,7 @@ struct dyn_dropout_layer_impl : transform_layer<dyn_dropout_layer_impl<Desc>> {
     void backward_batch(H&& output, C& context) const {
         dll::unsafe_auto_timer timer("dropout:backward");
 
-        output = context.errors;
+        mask.apply(output, context.errors);
     }
 
     /*!
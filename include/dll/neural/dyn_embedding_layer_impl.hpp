@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer_no_bias.hpp"
+#include "dll/neural/embedding_gradients.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
 
@@ -130,7 +131,7 @@ struct dyn_embedding_layer_impl final : neural_layer_no_bias<dyn_embedding_layer
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("embedding:forward_batch");
 
-        output = batch_embedding_lookup(v, w);
+        embedding_gather(v, w, output);
     }
 
     void prepare_input(input_one_t& input) const {
@@ -197,7 +198,8 @@ struct dyn_embedding_layer_impl final : neural_layer_no_bias<dyn_embedding_layer
     void compute_gradients(C& context) const {
         dll::auto_timer timer("embedding:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = batch_embedding_gradients(context.input, context.errors, w);;
+        // Only the rows referenced by the batch are computed
+        sparse_embedding_gradients(context.input, context.errors, std::get<0>(context.up.context)->grad, context.rows, context.sparse);
     }
 };
 
@@ -235,8 +237,12 @@ struct sgd_context<DBN, dyn_embedding_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 3> output;
     etl::dyn_matrix<weight, 3> errors;
 
+    std::vector<size_t> rows; ///< The rows of the vocabulary referenced by the last batch
+    bool sparse = false;      ///< Indicates if the gradients are only non-zero on rows
+
     sgd_context(const dyn_embedding_layer_impl<Desc>&  layer )
             : input(batch_size, layer.I), output(batch_size, layer.I, layer.K), errors(batch_size, layer.I, layer.K) {
+        input  = weight(0);
         output = weight(0);
         errors = weight(0);
     }
@@ -50,7 +50,7 @@ struct dyn_lstm_layer_desc {
     static_assert(
         detail::is_valid_v<cpp::type_list<
             weight_type_id, activation_id, rnn_initializer_w_id, rnn_initializer_u_id,
-            initializer_bias_id, initializer_forget_bias_id, truncate_id, last_only_id>,
+            initializer_bias_id, initializer_forget_bias_id, truncate_id, last_only_id, variable_length_id, parallel_bptt_id>,
             Parameters...>,
         "Invalid parameters type for dyn_lstm_layer_desc");
 };
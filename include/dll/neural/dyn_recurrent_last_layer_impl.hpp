@@ -8,8 +8,10 @@
 #pragma once
 
 #include "dll/base_traits.hpp"
+#include "dll/layer_traits.hpp"
 
-#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/timers.hpp"    // for auto_timer
+#include "dll/util/last_step.hpp" // for the last step kernels
 
 namespace dll {
 
@@ -25,6 +27,8 @@ struct dyn_recurrent_last_layer_impl final : layer<dyn_recurrent_last_layer_impl
     using layer_t     = this_type;                       ///< This layer's type
     using dyn_layer_t = typename desc::dyn_layer_t;      ///< The dynamic version of this layer
 
+    static constexpr bool last_step = true; ///< Only the last time step of the input is kept
+
     using input_one_t  = etl::dyn_matrix<weight, 2>; ///< The type of one input
     using output_one_t = etl::dyn_matrix<weight, 1>; ///< The type of one output
     using input_t      = std::vector<input_one_t>;   ///< The type of the input
@@ -108,8 +112,16 @@ struct dyn_recurrent_last_layer_impl final : layer<dyn_recurrent_last_layer_impl
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        for(size_t b = 0; b < Batch; ++b){
-            output(b) = input(b)(time_steps - 1);
+        if constexpr (etl::is_dma<V> && etl::is_dma<std::decay_t<H>>) {
+            input.ensure_cpu_up_to_date();
+
+            last_step_forward(input.memory_start(), output.memory_start(), Batch, time_steps, hidden_units);
+
+            output.invalidate_gpu();
+        } else {
+            for (size_t b = 0; b < Batch; ++b) {
+                output(b) = input(b)(time_steps - 1);
+            }
         }
     }
 
@@ -175,10 +187,24 @@ struct dyn_recurrent_last_layer_impl final : layer<dyn_recurrent_last_layer_impl
 
         const auto Batch = etl::dim<0>(output);
 
-        output = 0;
+        // The recurrent layer before only reads the errors of the last time
+        // step, the other time steps are not cleared
+        constexpr bool sparse = C::sparse_errors;
+
+        if constexpr (etl::is_dma<std::decay_t<H>>) {
+            context.errors.ensure_cpu_up_to_date();
+
+            last_step_backward(context.errors.memory_start(), output.memory_start(), Batch, time_steps, hidden_units, !sparse);
 
-        for(size_t b = 0; b < Batch; ++b){
-            output(b)(time_steps - 1) = context.errors(b);
+            output.invalidate_gpu();
+        } else {
+            if constexpr (!sparse) {
+                output = 0;
+            }
+
+            for (size_t b = 0; b < Batch; ++b) {
+                output(b)(time_steps - 1) = context.errors(b);
+            }
         }
     }
 
@@ -223,6 +249,12 @@ struct sgd_context<DBN, dyn_recurrent_last_layer_impl<Desc>, L> {
 
     static constexpr auto batch_size = DBN::batch_size;
 
+    /*!
+     * \brief Indicates if only the last time step of the errors of the
+     * previous recurrent layer is written
+     */
+    static constexpr bool sparse_errors = std::is_same<typename DBN::template layer_type<L>, layer_t>::value && sparse_last_step_errors<DBN, L>();
+
     etl::dyn_matrix<weight, 3> input;
     etl::dyn_matrix<weight, 2> output;
     etl::dyn_matrix<weight, 2> errors;
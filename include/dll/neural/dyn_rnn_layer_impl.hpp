@@ -165,6 +165,24 @@ struct dyn_rnn_layer_impl final : base_rnn_layer<dyn_rnn_layer_impl<Desc>, Desc>
         base_type::forward_batch_impl(output, x, w, u, b, time_steps, sequence_length, hidden_units);
     }
 
+    using base_type::test_forward_batch;
+
+    /*!
+     * \brief Apply the layer to the given batch of input, for inference,
+     * without keeping the state needed by the backward pass.
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H, typename V>
+    void test_forward_batch(H&& output, const V& x) const {
+        dll::auto_timer timer("rnn:test_forward_batch");
+
+        cpp_assert(etl::dim<0>(output) == etl::dim<0>(x), "The number of samples must be consistent");
+
+        base_type::test_forward_batch_impl(output, x, w, u, b, time_steps, sequence_length, hidden_units);
+    }
+
     /*!
      * \brief Prepare one empty output for this layer
      * \return an empty ETL matrix suitable to store one output of this layer
@@ -271,6 +289,12 @@ struct sgd_context<DBN, dyn_rnn_layer_impl<Desc>, L> {
     static constexpr size_t layer    = L;               ///< The index of the layer
     static constexpr auto batch_size = DBN::batch_size; ///< The batch size of the network
 
+    /*!
+     * \brief Indicates if the next layer only writes the last time step of
+     * the errors
+     */
+    static constexpr bool last_step_errors = std::is_same<typename DBN::template layer_type<L>, layer_t>::value && sparse_last_step_errors<DBN, L + 1>();
+
     etl::dyn_matrix<weight, 3> input;
     etl::dyn_matrix<weight, 3> output;
     etl::dyn_matrix<weight, 3> errors;
@@ -0,0 +1,331 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Lookup and sparse computation of the gradients of the embedding
+ * layers and of the one-hot dense layers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Call functor(first, last) on chunks of [0, n), on the scoped
+ * thread pool if there is one.
+ */
+template <typename Functor>
+void embedding_chunks(size_t n, Functor&& functor) {
+    auto* pool = scoped_thread_pool();
+
+    if (pool && n > 1) {
+        const size_t chunks = std::min(n, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&functor, n, chunks](size_t c) {
+            functor((c * n) / chunks, ((c + 1) * n) / chunks);
+        });
+    } else {
+        functor(0, n);
+    }
+}
+
+/*!
+ * \brief Convert the given batch of indices (possibly stored as floating
+ * point values) into integer indices
+ */
+template <typename Input>
+void embedding_indices(const Input& input, std::vector<uint32_t>& indices) {
+    const size_t N = etl::size(input);
+
+    input.ensure_cpu_up_to_date();
+
+    const auto* in = input.memory_start();
+
+    indices.resize(N);
+
+    for (size_t i = 0; i < N; ++i) {
+        indices[i] = uint32_t(in[i]);
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Compute the embedding of the given batch of indices, by copying
+ * the rows of the embedding, in chunks on the scoped thread pool if there
+ * is one.
+ *
+ * The indices can be given as integers, used directly, or as floating
+ * point values, converted once.
+ *
+ * \param input The batch of input (the indices in the vocabulary)
+ * \param w The embedding (vocabulary x K)
+ * \param output The batch of output (input x K)
+ */
+template <typename Input, typename W, typename Output>
+void embedding_gather(const Input& input, const W& w, Output&& output) {
+    using weight = etl::value_t<W>;
+
+    const size_t N  = etl::size(input);
+    const size_t VV = etl::dim<0>(w);
+    const size_t K  = etl::dim<1>(w);
+
+    cpp_assert(etl::size(output) == N * K, "Invalid dimensions for embedding_gather");
+    cpp_unused(VV);
+
+    w.ensure_cpu_up_to_date();
+
+    const weight* w_p = w.memory_start();
+    weight* o_p       = output.memory_start();
+
+    auto gather = [=](const auto* in) {
+        detail::embedding_chunks(N, [=](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                const size_t r = in[i];
+
+                cpp_assert(r < VV, "Invalid index for the embedding");
+
+                std::copy_n(w_p + r * K, K, o_p + i * K);
+            }
+        });
+    };
+
+    if constexpr (std::is_integral<etl::value_t<Input>>::value) {
+        input.ensure_cpu_up_to_date();
+
+        gather(input.memory_start());
+    } else {
+        std::vector<uint32_t> indices;
+        detail::embedding_indices(input, indices);
+
+        gather(indices.data());
+    }
+
+    output.invalidate_gpu();
+}
+
+namespace detail {
+
+/*!
+ * \brief Compute the gradients of rows of weights into grad, only touching
+ * the rows referenced by the given indices.
+ *
+ * The errors are shared by group consecutive indices: the index i adds the
+ * errors i / group to its row.
+ *
+ * \param indices The rows referenced by the batch
+ * \param errors The batch of errors of the layer
+ * \param grad The gradients of the weights, to fill
+ * \param rows The rows referenced by the batch (sorted and unique)
+ * \param sparse Indicates if grad is only non-zero on rows
+ * \param group The number of indices sharing the same errors
+ */
+template <typename Errors, typename Grad>
+void sparse_rows_gradients(const std::vector<uint32_t>& indices, Errors& errors, Grad& grad, std::vector<size_t>& rows, bool& sparse, size_t group) {
+    using weight = etl::value_t<Grad>;
+
+    const size_t K = etl::dim(grad, 1);
+    const size_t N = indices.size();
+
+    if (!sparse) {
+        grad = weight(0);
+    }
+
+    errors.ensure_cpu_up_to_date();
+    grad.ensure_cpu_up_to_date();
+
+    const auto* e = errors.memory_start();
+    weight* g     = grad.memory_start();
+
+    // Clear the rows of the previous batch
+
+    if (sparse) {
+        for (size_t r : rows) {
+            std::fill(g + r * K, g + (r + 1) * K, weight(0));
+        }
+    }
+
+    // Sort the positions of the batch by row, so that each row is
+    // accumulated by a single thread, in a deterministic order
+
+    std::vector<uint32_t> positions(N);
+    std::iota(positions.begin(), positions.end(), uint32_t(0));
+
+    std::stable_sort(positions.begin(), positions.end(), [&indices](uint32_t lhs, uint32_t rhs) {
+        return indices[lhs] < indices[rhs];
+    });
+
+    std::vector<size_t> starts;
+
+    rows.clear();
+
+    for (size_t p = 0; p < N; ++p) {
+        const size_t r = indices[positions[p]];
+
+        if (rows.empty() || rows.back() != r) {
+            rows.push_back(r);
+            starts.push_back(p);
+        }
+    }
+
+    starts.push_back(N);
+
+    detail::embedding_chunks(rows.size(), [&](size_t first, size_t last) {
+        for (size_t s = first; s < last; ++s) {
+            weight* g_r = g + rows[s] * K;
+
+            for (size_t p = starts[s]; p < starts[s + 1]; ++p) {
+                const auto* e_i = e + (positions[p] / group) * K;
+
+                for (size_t k = 0; k < K; ++k) {
+                    g_r[k] += e_i[k];
+                }
+            }
+        }
+    });
+
+    grad.invalidate_gpu();
+
+    sparse = true;
+}
+
+/*!
+ * \brief Convert the given batch of sequences of indices (batch x length)
+ * into the rows of their one-hot encoding: the index v at the position l of
+ * a sequence is the row l * V + v.
+ */
+template <typename Input>
+void one_hot_rows(const Input& input, size_t V, std::vector<uint32_t>& indices) {
+    const size_t L = etl::size(input) / etl::dim<0>(input);
+
+    embedding_indices(input, indices);
+
+    for (size_t i = 0; i < indices.size(); ++i) {
+        cpp_assert(indices[i] < V, "Invalid index for the one-hot encoding");
+
+        indices[i] += uint32_t((i % L) * V);
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Compute the gradients of an embedding into grad, only touching the
+ * rows of the vocabulary referenced by the batch.
+ *
+ * The rows referenced by the batch are stored (sorted and unique) into
+ * rows. When sparse is set, grad is only non-zero on the rows of the
+ * previous batch and only these rows are cleared, otherwise the complete
+ * gradients are cleared. After this call, sparse is always set.
+ *
+ * \param input The batch of input (the indices in the vocabulary)
+ * \param errors The batch of errors of the layer
+ * \param grad The gradients of the embedding, to fill
+ * \param rows The rows of the vocabulary referenced by the batch
+ * \param sparse Indicates if grad is only non-zero on rows
+ */
+template <typename Input, typename Errors, typename Grad>
+void sparse_embedding_gradients(Input& input, Errors& errors, Grad& grad, std::vector<size_t>& rows, bool& sparse) {
+    std::vector<uint32_t> indices;
+    detail::embedding_indices(input, indices);
+
+    detail::sparse_rows_gradients(indices, errors, grad, rows, sparse, 1);
+}
+
+/*!
+ * \brief Compute the product of the one-hot encoding of the given batch of
+ * sequences of indices with the weights, by summing the rows of the
+ * weights of the indices, in chunks of samples on the scoped thread pool if
+ * there is one.
+ *
+ * This is the product of a dense layer with the one-hot input (batch x
+ * (length x V)) in time proportional to the length of the sequences
+ * instead of the size of the one-hot input.
+ *
+ * \param input The batch of input (batch x length, the indices in the vocabulary)
+ * \param w The weights ((length x V) x K)
+ * \param output The batch of output (batch x K)
+ * \param V The size of the vocabulary
+ */
+template <typename Input, typename W, typename Output>
+void one_hot_gather(const Input& input, const W& w, Output&& output, size_t V) {
+    using weight = etl::value_t<W>;
+
+    const size_t B = etl::dim<0>(input);
+    const size_t L = etl::size(input) / B;
+    const size_t K = etl::dim<1>(w);
+
+    cpp_assert(etl::dim<0>(w) == L * V, "Invalid dimensions for one_hot_gather");
+    cpp_assert(etl::size(output) == B * K, "Invalid dimensions for one_hot_gather");
+
+    std::vector<uint32_t> indices;
+    detail::one_hot_rows(input, V, indices);
+
+    w.ensure_cpu_up_to_date();
+
+    const weight* w_p = w.memory_start();
+    weight* o_p       = output.memory_start();
+
+    detail::embedding_chunks(B, [&indices, w_p, o_p, L, K](size_t first, size_t last) {
+        for (size_t b = first; b < last; ++b) {
+            weight* o_b = o_p + b * K;
+
+            std::copy_n(w_p + size_t(indices[b * L]) * K, K, o_b);
+
+            for (size_t l = 1; l < L; ++l) {
+                const weight* w_r = w_p + size_t(indices[b * L + l]) * K;
+
+                for (size_t k = 0; k < K; ++k) {
+                    o_b[k] += w_r[k];
+                }
+            }
+        }
+    });
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the gradients of the weights of a dense layer with the
+ * one-hot encoding of the given batch of sequences as input, only touching
+ * the rows of the indices of the batch.
+ *
+ * The same as sparse_embedding_gradients, the errors of a sample being
+ * added to the rows of all the positions of its sequence.
+ *
+ * \param input The batch of input (batch x length, the indices in the vocabulary)
+ * \param errors The batch of errors of the layer (batch x K)
+ * \param grad The gradients of the weights ((length x V) x K), to fill
+ * \param rows The rows of the weights referenced by the batch
+ * \param sparse Indicates if grad is only non-zero on rows
+ * \param V The size of the vocabulary
+ */
+template <typename Input, typename Errors, typename Grad>
+void sparse_one_hot_gradients(Input& input, Errors& errors, Grad& grad, std::vector<size_t>& rows, bool& sparse, size_t V) {
+    std::vector<uint32_t> indices;
+    detail::one_hot_rows(input, V, indices);
+
+    detail::sparse_rows_gradients(indices, errors, grad, rows, sparse, etl::size(input) / etl::dim<0>(input));
+}
+
+} //end of dll namespace
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer_no_bias.hpp"
+#include "dll/neural/embedding_gradients.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
 
@@ -117,7 +118,7 @@ struct embedding_layer_impl final : neural_layer_no_bias<embedding_layer_impl<De
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("embedding:forward_batch");
 
-        output = batch_embedding_lookup(v, w);
+        embedding_gather(v, w, output);
     }
 
     /*!
@@ -172,7 +173,8 @@ struct embedding_layer_impl final : neural_layer_no_bias<embedding_layer_impl<De
     void compute_gradients(C& context) const {
         dll::auto_timer timer("embedding:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = batch_embedding_gradients(context.input, context.errors, w);;
+        // Only the rows referenced by the batch are computed
+        sparse_embedding_gradients(context.input, context.errors, std::get<0>(context.up.context)->grad, context.rows, context.sparse);
     }
 };
 
@@ -225,8 +227,11 @@ struct sgd_context<DBN, embedding_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, I, K> output;
     etl::fast_matrix<weight, batch_size, I, K> errors;
 
+    std::vector<size_t> rows; ///< The rows of the vocabulary referenced by the last batch
+    bool sparse = false;      ///< Indicates if the gradients are only non-zero on rows
+
     sgd_context(const embedding_layer_impl<Desc>& /* layer */)
-            : output(0.0), errors(0.0) {}
+            : input(0.0), output(0.0), errors(0.0) {}
 };
 
 } //end of dll namespace
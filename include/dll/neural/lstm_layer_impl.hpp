@@ -11,6 +11,7 @@
 #include "dll/base_lstm_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/lstm.hpp"   // for the fused gates
 
 namespace dll {
 
@@ -166,65 +167,7 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
         return {time_steps, hidden_units};
     }
 
-    mutable etl::dyn_matrix<float, 3> g_t;
-    mutable etl::dyn_matrix<float, 3> i_t;
-    mutable etl::dyn_matrix<float, 3> f_t;
-    mutable etl::dyn_matrix<float, 3> o_t;
-
-    mutable etl::dyn_matrix<float, 3> x_t;
-    mutable etl::dyn_matrix<float, 3> s_t;
-    mutable etl::dyn_matrix<float, 3> h_t;
-
-    mutable etl::dyn_matrix<float, 3> d_h_t;
-    mutable etl::dyn_matrix<float, 3> d_c_t;
-    mutable etl::dyn_matrix<float, 3> d_x_t;
-
-    mutable etl::dyn_matrix<float, 3> d_h_o_t;
-    mutable etl::dyn_matrix<float, 3> d_h_f_t;
-    mutable etl::dyn_matrix<float, 3> d_h_i_t;
-    mutable etl::dyn_matrix<float, 3> d_h_c_t;
-
-    mutable etl::dyn_matrix<float, 3> d_x_o_t;
-    mutable etl::dyn_matrix<float, 3> d_x_f_t;
-    mutable etl::dyn_matrix<float, 3> d_x_i_t;
-    mutable etl::dyn_matrix<float, 3> d_x_c_t;
-
-    mutable etl::dyn_matrix<float, 3> d_xh_o_t;
-    mutable etl::dyn_matrix<float, 3> d_xh_f_t;
-    mutable etl::dyn_matrix<float, 3> d_xh_i_t;
-    mutable etl::dyn_matrix<float, 3> d_xh_c_t;
-
-    void prepare_cache(size_t Batch) const {
-        if (cpp_unlikely(!i_t.memory_start())) {
-            g_t.resize(time_steps, Batch, hidden_units);
-            i_t.resize(time_steps, Batch, hidden_units);
-            f_t.resize(time_steps, Batch, hidden_units);
-            o_t.resize(time_steps, Batch, hidden_units);
-
-            x_t.resize(time_steps, Batch, sequence_length);
-            s_t.resize(time_steps, Batch, hidden_units);
-            h_t.resize(time_steps, Batch, hidden_units);
-
-            d_h_t.resize(time_steps, Batch, hidden_units);
-            d_c_t.resize(time_steps, Batch, hidden_units);
-            d_x_t.resize(time_steps, Batch, sequence_length);
-
-            d_h_o_t.resize(time_steps, Batch, hidden_units);
-            d_h_f_t.resize(time_steps, Batch, hidden_units);
-            d_h_i_t.resize(time_steps, Batch, hidden_units);
-            d_h_c_t.resize(time_steps, Batch, hidden_units);
-
-            d_x_o_t.resize(time_steps, Batch, sequence_length);
-            d_x_f_t.resize(time_steps, Batch, sequence_length);
-            d_x_i_t.resize(time_steps, Batch, sequence_length);
-            d_x_c_t.resize(time_steps, Batch, sequence_length);
-
-            d_xh_o_t.resize(time_steps, Batch, hidden_units);
-            d_xh_f_t.resize(time_steps, Batch, hidden_units);
-            d_xh_i_t.resize(time_steps, Batch, hidden_units);
-            d_xh_c_t.resize(time_steps, Batch, hidden_units);
-        }
-    }
+    using base_type::test_forward_batch;
 
     /*!
      * \brief Apply the layer to the given batch of input.
@@ -236,51 +179,114 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
     void forward_batch(H&& output, const V& x) const {
         dll::auto_timer timer("lstm:forward_batch");
 
+        forward_batch_impl(output, x, this->cache, this->packing);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, keeping the state
+     * of the forward pass in the given cache and packing.
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     * \param c The state of the forward pass
+     * \param packing The packing of the batch
+     */
+    template <typename H, typename V>
+    void forward_batch_impl(H&& output, const V& x, lstm_train_cache<weight>& c, sequence_packing& packing) const {
         const auto Batch = etl::dim<0>(x);
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        prepare_cache(Batch);
+        c.prepare(time_steps, Batch, sequence_length, hidden_units);
+
+        auto& x_t = c.x_t;
+        auto& h_t = c.h_t;
+
+        packing.pack(x, base_type::packed_sequences);
 
         // 1. Rearrange input
 
         for (size_t b = 0; b < Batch; ++b) {
             for (size_t t = 0; t < time_steps; ++t) {
-                x_t(t)(b) = x(b)(t);
+                x_t(t)(b) = x(packing.order[b])(t);
             }
         }
 
         // 2. Forward propagation through time
 
-        // t == 0
+        if constexpr (fused_epilogue<activation_function>) {
+            // One product per time step for the four gates
+            this->fused.update(*this);
 
-        g_t(0) =    etl::tanh(bias_add_2d(x_t(0) * (u_g), b_g));
-        i_t(0) = etl::sigmoid(bias_add_2d(x_t(0) * (u_i), b_i));
-        f_t(0) = etl::sigmoid(bias_add_2d(x_t(0) * (u_f), b_f));
-        o_t(0) = etl::sigmoid(bias_add_2d(x_t(0) * (u_o), b_o));
-
-        s_t(0) = g_t(0) >> i_t(0);
-        h_t(0) = f_activate<activation_function>(s_t(0)) >> o_t(0);
-
-        for (size_t t = 1; t < time_steps; ++t) {
-            g_t(t) =    etl::tanh(bias_add_2d(x_t(t) * u_g + h_t(t - 1) * w_g, b_g));
-            i_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * u_i + h_t(t - 1) * w_i, b_i));
-            f_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * u_f + h_t(t - 1) * w_f, b_f));
-            o_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * u_o + h_t(t - 1) * w_o, b_o));
-
-            s_t(t) = f_activate<activation_function>( (g_t(t) >> i_t(t)) + (s_t(t - 1) >> f_t(t)) );
-            h_t(t) = s_t(t) >> o_t(t);
+            lstm_fused_forward<activation_function>(c, this->fused, packing);
+        } else {
+            auto& i_t = c.i_t;
+            auto& f_t = c.f_t;
+            auto& g_t = c.g_t;
+            auto& o_t = c.o_t;
+            auto& s_t = c.s_t;
+
+            // t == 0
+
+            g_t(0) =    etl::tanh(bias_add_2d(x_t(0) * (u_g), b_g));
+            i_t(0) = etl::sigmoid(bias_add_2d(x_t(0) * (u_i), b_i));
+            f_t(0) = etl::sigmoid(bias_add_2d(x_t(0) * (u_f), b_f));
+            o_t(0) = etl::sigmoid(bias_add_2d(x_t(0) * (u_o), b_o));
+
+            s_t(0) = g_t(0) >> i_t(0);
+            h_t(0) = f_activate<activation_function>(s_t(0)) >> o_t(0);
+
+            for (size_t t = 1; t < time_steps; ++t) {
+                g_t(t) =    etl::tanh(bias_add_2d(x_t(t) * u_g + h_t(t - 1) * w_g, b_g));
+                i_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * u_i + h_t(t - 1) * w_i, b_i));
+                f_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * u_f + h_t(t - 1) * w_f, b_f));
+                o_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * u_o + h_t(t - 1) * w_o, b_o));
+
+                s_t(t) = f_activate<activation_function>( (g_t(t) >> i_t(t)) + (s_t(t - 1) >> f_t(t)) );
+                h_t(t) = s_t(t) >> o_t(t);
+            }
         }
 
         // 3. Rearrange the output
 
         for (size_t b = 0; b < Batch; ++b) {
             for (size_t t = 0; t < time_steps; ++t) {
-                output(b)(t) = h_t(t)(b);
+                output(packing.order[b])(t) = h_t(t)(b);
             }
         }
     }
 
+    /*!
+     * \brief Apply the layer to the given batch of input, for inference.
+     *
+     * The state needed by the backward pass is not kept and the
+     * temporaries are borrowed from the workspace of the network, so the
+     * layer can be used from several threads.
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H, typename V>
+    void test_forward_batch(H&& output, const V& x) const {
+        if constexpr (fused_epilogue<activation_function>) {
+            dll::auto_timer timer("lstm:test_forward_batch");
+
+            cpp_assert(etl::dim<0>(output) == etl::dim<0>(x), "The number of samples must be consistent");
+
+            this->fused.update(*this);
+
+            lstm_fused_inference<activation_function>(output, x, this->fused, this->arena, base_type::packed_sequences);
+        } else {
+            dll::auto_timer timer("lstm:test_forward_batch");
+
+            // The state of the training forward pass of the layer is not used
+            lstm_train_cache<weight> c;
+            sequence_packing packing;
+
+            forward_batch_impl(output, x, c, packing);
+        }
+    }
+
     /*!
      * \brief Prepare one empty output for this layer
      * \return an empty ETL matrix suitable to store one output of this layer
@@ -333,12 +339,49 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
 
         // 1. Rearrange input/errors
 
-        etl::dyn_matrix<float, 3> delta_t(time_steps, Batch, hidden_units);
+        auto& c  = this->cache;
+        auto& bc = this->backward_cache;
 
-        for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                delta_t(t)(b) = context.errors(b)(t);
+        bc.prepare(time_steps, Batch, sequence_length, hidden_units);
+
+        this->fused.update(*this);
+
+        auto& x_t = c.x_t;
+        auto& i_t = c.i_t;
+        auto& f_t = c.f_t;
+        auto& g_t = c.g_t;
+        auto& o_t = c.o_t;
+        auto& s_t = c.s_t;
+        auto& h_t = c.h_t;
+
+        auto& delta_t = bc.delta_t;
+        auto& d_h_t   = bc.d_h_t;
+        auto& d_c_t   = bc.d_c_t;
+        auto& d_x_t   = bc.d_x_t;
+        auto& d_h_i_t = bc.d_h_i_t;
+        auto& d_h_f_t = bc.d_h_f_t;
+        auto& d_h_c_t = bc.d_h_c_t;
+        auto& d_h_o_t = bc.d_h_o_t;
+
+        const auto& packing = this->packing;
+
+        // Only the last time step of the errors is used by the next layer,
+        // its errors are injected in d_h_t and the other ones are not read
+        constexpr bool sparse = C::last_step_errors;
+
+        if constexpr (sparse) {
+            for (size_t b = 0; b < Batch; ++b) {
+                delta_t(time_steps - 1)(b) = context.errors(packing.order[b])(time_steps - 1);
+            }
+        } else {
+            for (size_t b = 0; b < Batch; ++b) {
+                for (size_t t = 0; t < time_steps; ++t) {
+                    delta_t(t)(b) = context.errors(packing.order[b])(t);
+                }
             }
+
+            // The padded steps repeat the last output, their errors are its errors
+            fold_padded_errors(delta_t, packing);
         }
 
         // 2. Get gradients from the context
@@ -356,18 +399,28 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
         auto& u_o_grad = std::get<10>(context.up.context)->grad;
         auto& b_o_grad = std::get<11>(context.up.context)->grad;
 
-        w_i_grad = 0;
-        u_i_grad = 0;
-        b_i_grad = 0;
-        w_g_grad = 0;
-        u_g_grad = 0;
-        b_g_grad = 0;
-        w_f_grad = 0;
-        u_f_grad = 0;
-        b_f_grad = 0;
-        w_o_grad = 0;
-        u_o_grad = 0;
-        b_o_grad = 0;
+        // The gradients are either summed at each time step or computed
+        // after the recurrence, from the sums of the errors of the gates
+        constexpr bool deferred = base_type::deferred_gradients;
+
+        auto& e = this->gate_errors;
+
+        if constexpr (deferred) {
+            e.prepare(time_steps, Batch, hidden_units);
+        } else {
+            w_i_grad = 0;
+            u_i_grad = 0;
+            b_i_grad = 0;
+            w_g_grad = 0;
+            u_g_grad = 0;
+            b_g_grad = 0;
+            w_f_grad = 0;
+            u_f_grad = 0;
+            b_f_grad = 0;
+            w_o_grad = 0;
+            u_o_grad = 0;
+            b_o_grad = 0;
+        }
 
         // 3. Backpropagation through time
 
@@ -383,6 +436,9 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
                 if (t == time_steps - 1) {
                     d_h_t(t) = delta_t(t);
                     d_c_t(t) = (o_t(t) >> d_h_t(t)) >> f_derivative<activation_function>(s_t(t));
+                } else if constexpr (sparse) {
+                    d_h_t(t) = d_h_t(t + 1);
+                    d_c_t(t) = ((o_t(t) >> d_h_t(t)) >> f_derivative<activation_function>(s_t(t))) + d_c_t(t + 1);
                 } else {
                     d_h_t(t) = delta_t(t) + d_h_t(t + 1);
                     d_c_t(t) = ((o_t(t) >> d_h_t(t)) >> f_derivative<activation_function>(s_t(t))) + d_c_t(t + 1);
@@ -398,39 +454,31 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
                     d_h_f_t(t) = etl::ml::sigmoid_backward(f_t(t), s_t(t - 1) >> d_c_t(t));
                 }
 
-                b_o_grad += bias_batch_sum_2d(d_h_o_t(t));
-                b_i_grad += bias_batch_sum_2d(d_h_i_t(t));
-                b_f_grad += bias_batch_sum_2d(d_h_f_t(t));
-                b_g_grad += bias_batch_sum_2d(d_h_c_t(t));
-
-                u_o_grad += batch_outer(x_t(t), d_h_o_t(t));
-                u_i_grad += batch_outer(x_t(t), d_h_i_t(t));
-                u_f_grad += batch_outer(x_t(t), d_h_f_t(t));
-                u_g_grad += batch_outer(x_t(t), d_h_c_t(t));
-
-                if(t > 0){
-                    w_o_grad += batch_outer(h_t(t - 1), d_h_o_t(t));
-                    w_i_grad += batch_outer(h_t(t - 1), d_h_i_t(t));
-                    w_f_grad += batch_outer(h_t(t - 1), d_h_f_t(t));
-                    w_g_grad += batch_outer(h_t(t - 1), d_h_c_t(t));
+                if constexpr (deferred) {
+                    e.accumulate(bc, t);
+                } else {
+                    b_o_grad += bias_batch_sum_2d(d_h_o_t(t));
+                    b_i_grad += bias_batch_sum_2d(d_h_i_t(t));
+                    b_f_grad += bias_batch_sum_2d(d_h_f_t(t));
+                    b_g_grad += bias_batch_sum_2d(d_h_c_t(t));
+
+                    u_o_grad += batch_outer(x_t(t), d_h_o_t(t));
+                    u_i_grad += batch_outer(x_t(t), d_h_i_t(t));
+                    u_f_grad += batch_outer(x_t(t), d_h_f_t(t));
+                    u_g_grad += batch_outer(x_t(t), d_h_c_t(t));
+
+                    if(t > 0){
+                        w_o_grad += batch_outer(h_t(t - 1), d_h_o_t(t));
+                        w_i_grad += batch_outer(h_t(t - 1), d_h_i_t(t));
+                        w_f_grad += batch_outer(h_t(t - 1), d_h_f_t(t));
+                        w_g_grad += batch_outer(h_t(t - 1), d_h_c_t(t));
+                    }
                 }
 
-                // The part going back to x
-                d_x_o_t(t) = d_h_o_t(t) * trans(u_o);
-                d_x_i_t(t) = d_h_i_t(t) * trans(u_i);
-                d_x_f_t(t) = d_h_f_t(t) * trans(u_f);
-                d_x_c_t(t) = d_h_c_t(t) * trans(u_g);
-
-                d_x_t(t) = d_x_o_t(t) + d_x_i_t(t) + d_x_f_t(t) + d_x_c_t(t);
-
-                // The part going back to h
-                d_xh_o_t(t) = d_h_o_t(t) * trans(w_o);
-                d_xh_i_t(t) = d_h_i_t(t) * trans(w_i);
-                d_xh_f_t(t) = d_h_f_t(t) * trans(w_f);
-                d_xh_c_t(t) = d_h_c_t(t) * trans(w_g);
+                // The parts going back to x and to h, with one product each
+                lstm_fused_backward_step(bc, this->fused, t, packing.active[t]);
 
                 // Update for the next step
-                d_h_t(t) = d_xh_o_t(t) + d_xh_i_t(t) + d_xh_f_t(t) + d_xh_c_t(t);
                 d_c_t(t) = f_t(t) >> d_c_t(t);
             }
 
@@ -442,12 +490,19 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
             }
         } while (ttt != 0);
 
+        if constexpr (deferred) {
+            lstm_deferred_gradients(x_t, h_t, e.i_t, w_i_grad, u_i_grad, b_i_grad);
+            lstm_deferred_gradients(x_t, h_t, e.f_t, w_f_grad, u_f_grad, b_f_grad);
+            lstm_deferred_gradients(x_t, h_t, e.g_t, w_g_grad, u_g_grad, b_g_grad);
+            lstm_deferred_gradients(x_t, h_t, e.o_t, w_o_grad, u_o_grad, b_o_grad);
+        }
+
         // 3. Rearrange for the output
 
         if (direct) {
             for (size_t b = 0; b < Batch; ++b) {
                 for (size_t t = 0; t < time_steps; ++t) {
-                    output(b)(t) = d_x_t(t)(b);
+                    output(packing.order[b])(t) = d_x_t(t)(b);
                 }
             }
         }
@@ -473,7 +528,7 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
     void compute_gradients(C& context) const {
         if constexpr (!C::layer) {
             dll::auto_timer timer("lstm:compute_gradients");
-            backward_pass(x_t, context, false);
+            backward_pass(this->backward_cache.d_x_t, context, false);
         }
     }
 };
@@ -523,6 +578,12 @@ struct sgd_context<DBN, lstm_layer_impl<Desc>, L> {
     static constexpr size_t layer    = L;               ///< The index of the layer
     static constexpr auto batch_size = DBN::batch_size; ///< The batch size of the network
 
+    /*!
+     * \brief Indicates if the next layer only writes the last time step of
+     * the errors
+     */
+    static constexpr bool last_step_errors = std::is_same<typename DBN::template layer_type<L>, layer_t>::value && sparse_last_step_errors<DBN, L + 1>();
+
     etl::fast_matrix<weight, batch_size, time_steps, sequence_length> input;
     etl::fast_matrix<weight, batch_size, time_steps, hidden_units> output;
     etl::fast_matrix<weight, batch_size, time_steps, hidden_units> errors;
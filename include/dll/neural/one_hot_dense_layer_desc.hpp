@@ -0,0 +1,66 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_conf.hpp"
+#include "dll/util/tmp.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Descriptor for a dense layer on the one-hot encoding of sequences
+ * of indices, the equivalent of a dense_layer (L x V -> H) on the one-hot
+ * input, from the indices themselves.
+ *
+ * \tparam L_T The length of the sequences
+ * \tparam V_T The size of the vocabulary
+ * \tparam H_T The number of hidden units
+ */
+template <size_t L_T, size_t V_T, size_t H_T, typename... Parameters>
+struct one_hot_dense_layer_desc {
+    static constexpr size_t L = L_T; ///< The length of the sequences
+    static constexpr size_t V = V_T; ///< The size of the vocabulary
+    static constexpr size_t H = H_T; ///< The number of hidden units
+
+    /*!
+     * \brief A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>; ///< The layer's activation function
+
+    using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
+    using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
+
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    /*! The layer type */
+    using layer_t = one_hot_dense_layer_impl<one_hot_dense_layer_desc<L_T, V_T, H_T, Parameters...>>;
+
+    /*! The dynamic layer type, the one-hot layer has no dynamic version */
+    using dyn_layer_t = layer_t;
+
+    static_assert(L > 0, "At least one index is necessary");
+    static_assert(V > 0, "At least one index in vocabulary is necessary");
+    static_assert(H > 0, "There must be at least 1 hidden unit");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id>, Parameters...>,
+        "Invalid parameters type for one_hot_dense_layer_desc");
+};
+
+/*!
+ * \brief Describe a dense layer on the one-hot encoding of sequences of
+ * indices
+ */
+template <size_t L_T, size_t V_T, size_t H_T, typename... Parameters>
+using one_hot_dense_layer = typename one_hot_dense_layer_desc<L_T, V_T, H_T, Parameters...>::layer_t;
+
+} //end of dll namespace
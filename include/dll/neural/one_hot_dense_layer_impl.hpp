@@ -0,0 +1,280 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/neural_layer.hpp"
+#include "dll/neural/embedding_gradients.hpp"
+
+#include "dll/util/timers.hpp"   // for auto_timer
+#include "dll/util/epilogue.hpp" // for fused bias and activation
+#include "dll/util/softmax.hpp"  // for the fused bias and softmax
+
+namespace dll {
+
+/*!
+ * \brief Dense layer on the one-hot encoding of sequences of indices.
+ *
+ * The input is a batch of sequences of L indices in a vocabulary of V
+ * (characters or tokens) and the weights are the weights of the dense
+ * layer on their one-hot encoding (L x V). The one-hot input is never
+ * built: the output is the sum of the rows of the weights of the L indices
+ * and only these rows of the gradients are computed, in time proportional
+ * to L instead of L x V.
+ *
+ * The layer can only be the first layer of a network, its input is not
+ * differentiable.
+ */
+template <typename Desc>
+struct one_hot_dense_layer_impl final : neural_layer<one_hot_dense_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                              ///< The descriptor of the layer
+    using weight      = typename desc::weight;             ///< The data type for this layer
+    using this_type   = one_hot_dense_layer_impl<desc>;    ///< The type of this layer
+    using base_type   = neural_layer<this_type, desc>;     ///< The base type
+    using layer_t     = this_type;                         ///< This layer's type
+    using dyn_layer_t = typename desc::dyn_layer_t;        ///< The dynamic version of this layer
+
+    static constexpr size_t L = desc::L; ///< The length of the sequences
+    static constexpr size_t V = desc::V; ///< The size of the vocabulary
+    static constexpr size_t H = desc::H; ///< The number of hidden units
+
+    static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, L>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, H>; ///< The type of one output
+    using input_t      = std::vector<input_one_t>;        ///< The type of the input
+    using output_t     = std::vector<output_one_t>;       ///< The type of the output
+
+    using w_type = etl::fast_matrix<weight, L * V, H>; ///< The type of the weights
+    using b_type = etl::fast_matrix<weight, H>;        ///< The type of the biases
+
+    //Weights and biases
+    w_type w; ///< Weights
+    b_type b; ///< Hidden biases
+
+    //Backup weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup Weights
+    std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
+
+    /*!
+     * \brief Initialize a one-hot dense layer with basic weights.
+     *
+     * Only L of the L x V one-hot inputs are active, the weights are
+     * initialized for L inputs.
+     */
+    one_hot_dense_layer_impl() : base_type() {
+        w_initializer::initialize(w, input_size(), output_size());
+        b_initializer::initialize(b, input_size(), output_size());
+    }
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return L;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return H;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    static constexpr size_t parameters() noexcept {
+        return L * V * H;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[1024];
+        snprintf(buffer, 1024, "One-Hot Dense(%s)", to_string(activation_function).c_str());
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[1024];
+        snprintf(buffer, 1024, "One-Hot Dense: %lu (x%lu) -> %s -> %lu", L, V, to_string(activation_function).c_str(), H);
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {H};
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input (the indices of the sequences)
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename Input>
+    void forward_batch(H1&& output, const Input& input) const {
+        dll::auto_timer timer("one_hot_dense:forward_batch");
+
+        if constexpr (etl::is_dma<std::decay_t<H1>>) {
+            one_hot_gather(input, w, output, V);
+        } else {
+            // The kernel needs direct memory access
+            etl::dyn_matrix<weight, 2> result(etl::dim<0>(input), H);
+
+            one_hot_gather(input, w, result, V);
+            output = result;
+        }
+
+        if constexpr (fused_epilogue<activation_function> && etl::is_dma<std::decay_t<H1>>) {
+            bias_activate_2d<activation_function>(output, b);
+        } else if constexpr (activation_function == function::SOFTMAX && etl::is_dma<std::decay_t<H1>>) {
+            bias_softmax_last(output, b);
+        } else {
+            output = bias_add_2d(output, b);
+            output = f_activate<activation_function>(output);
+        }
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer, the layer is its
+     * own dynamic version
+     */
+    template <typename DLayer>
+    static void dyn_init(DLayer& dyn) {
+        cpp_unused(dyn);
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        dll::auto_timer timer("one_hot_dense:adapt_errors");
+
+        if constexpr (activation_function != function::IDENTITY){
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        dll::auto_timer timer("one_hot_dense:compute_gradients");
+
+        // Only the rows of the indices of the batch are computed
+        sparse_one_hot_gradients(context.input, context.errors, std::get<0>(context.up.context)->grad, context.rows, context.sparse, V);
+
+        std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t one_hot_dense_layer_impl<Desc>::L;
+
+template <typename Desc>
+const size_t one_hot_dense_layer_impl<Desc>::V;
+
+template <typename Desc>
+const size_t one_hot_dense_layer_impl<Desc>::H;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<one_hot_dense_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of the sgd_context for one_hot_dense_layer_impl
+ */
+template <typename DBN, typename Desc, size_t LL>
+struct sgd_context<DBN, one_hot_dense_layer_impl<Desc>, LL> {
+    using layer_t = one_hot_dense_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr size_t L = layer_t::L;
+    static constexpr size_t H = layer_t::H;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, L> input;
+    etl::fast_matrix<weight, batch_size, H> output;
+    etl::fast_matrix<weight, batch_size, H> errors;
+
+    std::vector<size_t> rows; ///< The rows of the weights referenced by the last batch
+    bool sparse = false;      ///< Indicates if the gradients are only non-zero on rows
+
+    sgd_context(const layer_t& /* layer */)
+            : input(0.0), output(0.0), errors(0.0) {}
+};
+
+} //end of dll namespace
@@ -8,8 +8,10 @@
 #pragma once
 
 #include "dll/base_traits.hpp"
+#include "dll/layer_traits.hpp"
 
-#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/timers.hpp"    // for auto_timer
+#include "dll/util/last_step.hpp" // for the last step kernels
 
 namespace dll {
 
@@ -25,6 +27,8 @@ struct recurrent_last_layer_impl final : layer<recurrent_last_layer_impl<Desc>>
     using layer_t     = this_type;                       ///< This layer's type
     using dyn_layer_t = typename desc::dyn_layer_t;      ///< The dynamic version of this layer
 
+    static constexpr bool last_step = true; ///< Only the last time step of the input is kept
+
     static constexpr size_t time_steps   = desc::time_steps;   ///< The number of time steps
     static constexpr size_t hidden_units = desc::hidden_units; ///< The number of hidden units
 
@@ -102,8 +106,16 @@ struct recurrent_last_layer_impl final : layer<recurrent_last_layer_impl<Desc>>
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        for(size_t b = 0; b < Batch; ++b){
-            output(b) = input(b)(time_steps - 1);
+        if constexpr (etl::is_dma<V> && etl::is_dma<std::decay_t<H>>) {
+            input.ensure_cpu_up_to_date();
+
+            last_step_forward(input.memory_start(), output.memory_start(), Batch, time_steps, hidden_units);
+
+            output.invalidate_gpu();
+        } else {
+            for (size_t b = 0; b < Batch; ++b) {
+                output(b) = input(b)(time_steps - 1);
+            }
         }
     }
 
@@ -164,10 +176,24 @@ struct recurrent_last_layer_impl final : layer<recurrent_last_layer_impl<Desc>>
 
         const auto Batch = etl::dim<0>(output);
 
-        output = 0;
+        // The recurrent layer before only reads the errors of the last time
+        // step, the other time steps are not cleared
+        constexpr bool sparse = C::sparse_errors;
+
+        if constexpr (etl::is_dma<std::decay_t<H>>) {
+            context.errors.ensure_cpu_up_to_date();
+
+            last_step_backward(context.errors.memory_start(), output.memory_start(), Batch, time_steps, hidden_units, !sparse);
 
-        for(size_t b = 0; b < Batch; ++b){
-            output(b)(time_steps - 1) = context.errors(b);
+            output.invalidate_gpu();
+        } else {
+            if constexpr (!sparse) {
+                output = 0;
+            }
+
+            for (size_t b = 0; b < Batch; ++b) {
+                output(b)(time_steps - 1) = context.errors(b);
+            }
         }
     }
 
@@ -223,6 +249,12 @@ struct sgd_context<DBN, recurrent_last_layer_impl<Desc>, L> {
 
     static constexpr auto batch_size = DBN::batch_size;
 
+    /*!
+     * \brief Indicates if only the last time step of the errors of the
+     * previous recurrent layer is written
+     */
+    static constexpr bool sparse_errors = std::is_same<typename DBN::template layer_type<L>, layer_t>::value && sparse_last_step_errors<DBN, L>();
+
     etl::fast_matrix<weight, batch_size, time_steps, hidden_units> input;
     etl::fast_matrix<weight, batch_size, hidden_units> output;
     etl::fast_matrix<weight, batch_size, hidden_units> errors;
@@ -56,7 +56,7 @@ struct rnn_layer_desc {
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<
-            weight_type_id, activation_id, rnn_initializer_w_id, rnn_initializer_u_id, initializer_bias_id, truncate_id, last_only_id>,
+            weight_type_id, activation_id, rnn_initializer_w_id, rnn_initializer_u_id, initializer_bias_id, truncate_id, last_only_id, variable_length_id, parallel_bptt_id>,
             Parameters...>,
         "Invalid parameters type for rnn_layer_desc");
 };
@@ -0,0 +1,60 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_conf.hpp"
+#include "dll/util/tmp.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Descriptor for a softmax output layer trained on a sample of its
+ * classes
+ */
+template <size_t visibles, size_t classes, size_t samples, typename... Parameters>
+struct sampled_softmax_layer_desc {
+    static constexpr size_t num_visible = visibles; ///< The number of visible units
+    static constexpr size_t num_classes = classes;  ///< The number of classes
+    static constexpr size_t num_samples = samples;  ///< The number of negative classes drawn for each batch
+
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    static constexpr auto sampler = detail::get_value_v<negative_sampler<sampler_type::LOG_UNIFORM>, Parameters...>; ///< The distribution of the negative classes
+
+    using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
+    using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
+
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    /*! The layer type */
+    using layer_t = sampled_softmax_layer_impl<sampled_softmax_layer_desc<visibles, classes, samples, Parameters...>>;
+
+    /*! The dynamic layer type (the same layer) */
+    using dyn_layer_t = layer_t;
+
+    static_assert(num_visible > 0, "There must be at least 1 visible unit");
+    static_assert(num_classes > 1, "There must be at least 2 classes");
+    static_assert(num_samples > 0, "At least one negative class must be sampled");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id, negative_sampler_id, initializer_id, initializer_bias_id>, Parameters...>,
+        "Invalid parameters type for sampled_softmax_layer_desc");
+};
+
+/*!
+ * \brief Describe a softmax output layer trained on a sample of its classes
+ */
+template <size_t visibles, size_t classes, size_t samples, typename... Parameters>
+using sampled_softmax_layer = typename sampled_softmax_layer_desc<visibles, classes, samples, Parameters...>::layer_t;
+
+} //end of dll namespace
@@ -0,0 +1,435 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "dll/base_traits.hpp"
+#include "dll/neural_layer.hpp"
+#include "dll/util/timers.hpp"          // for auto_timer
+#include "dll/util/labels.hpp"          // for is_index_labels
+#include "dll/util/softmax.hpp"         // for the fused bias and softmax
+#include "dll/util/sampled_softmax.hpp" // for the negative sampling
+
+namespace dll {
+
+/*!
+ * \brief Softmax output layer for a very large number of classes, trained
+ * on a sample of its classes.
+ *
+ * For each training batch, only the logits of the classes of the labels
+ * and of num_samples negative classes drawn from the sampler are computed.
+ * The logits are corrected by the log of the expected count of each class
+ * in the sample, so that the sampled softmax is an unbiased estimate of
+ * the full one. The gradients are only non-zero on the rows of the
+ * candidate classes.
+ *
+ * The weights are stored class-major (classes x visible), each class being
+ * one contiguous row. The test forward pass computes the full softmax.
+ */
+template <typename Desc>
+struct sampled_softmax_layer_impl final : neural_layer<sampled_softmax_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                               ///< The descriptor of the layer
+    using weight      = typename desc::weight;              ///< The data type for this layer
+    using this_type   = sampled_softmax_layer_impl<desc>;   ///< The type of this layer
+    using base_type   = neural_layer<this_type, desc>;      ///< The base type
+    using layer_t     = this_type;                          ///< This layer's type
+    using dyn_layer_t = typename desc::dyn_layer_t;         ///< The dynamic version of this layer
+
+    static constexpr size_t num_visible = desc::num_visible; ///< The number of visible units
+    static constexpr size_t num_classes = desc::num_classes; ///< The number of classes
+    static constexpr size_t num_samples = desc::num_samples; ///< The number of negative classes of each batch
+    static constexpr auto sampler       = desc::sampler;     ///< The distribution of the negative classes
+
+    static constexpr auto activation_function = function::SOFTMAX; ///< The layer's activation function
+    static constexpr bool sampled_output      = true;              ///< The training errors are computed from the labels
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, num_visible>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, num_classes>; ///< The type of one output
+    using input_t      = std::vector<input_one_t>;                  ///< The type of the input
+    using output_t     = std::vector<output_one_t>;                 ///< The type of the output
+
+    using w_type = etl::fast_matrix<weight, num_classes, num_visible>; ///< The type of the weights
+    using b_type = etl::fast_matrix<weight, num_classes>;              ///< The type of the biases
+
+    //Weights and biases
+    w_type w; ///< Weights (one row per class)
+    b_type b; ///< Biases
+
+    //Backup Weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup Weights
+    std::unique_ptr<b_type> bak_b; ///< Backup Biases
+
+    /*!
+     * \brief Initialize a sampled softmax layer with basic weights.
+     */
+    sampled_softmax_layer_impl() : base_type() {
+        w_initializer::initialize(w, num_visible, num_classes);
+        b_initializer::initialize(b, num_visible, num_classes);
+    }
+
+    /*!
+     * \brief Returns the input size of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return num_visible;
+    }
+
+    /*!
+     * \brief Returns the output size of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return num_classes;
+    }
+
+    /*!
+     * \brief Returns the number of parameters of this layer
+     */
+    static constexpr size_t parameters() noexcept {
+        return num_visible * num_classes;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        return "Sampled softmax";
+    }
+
+    /*!
+     * \brief Returns a full description of the layer
+     * \return an std::string containing a full description of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[512];
+        snprintf(buffer, 512, "Sampled softmax: %lu -> %lu (%lu %s samples)", num_visible, num_classes, num_samples, to_string(sampler).c_str());
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {num_classes};
+    }
+
+    using base_type::forward_batch;
+
+    /*!
+     * \brief Apply the layer to the given batch of input, with the softmax
+     * over all the classes.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H, typename V>
+    void forward_batch(H&& output, const V& input) const {
+        dll::auto_timer timer("sampled_softmax:forward_batch");
+
+        static_assert(etl::is_dma<std::decay_t<H>>, "The output of the sampled softmax layer must have direct memory access");
+
+        const auto Batch = etl::dim<0>(input);
+
+        output = etl::reshape(input, Batch, num_visible) * etl::transpose(w);
+
+        bias_softmax_last(output, b);
+    }
+
+    /*!
+     * \brief Compute the training output of the layer, which is nothing:
+     * the logits of the sampled classes are only computed with the labels,
+     * by sampled_errors.
+     */
+    template <typename Input, typename Output>
+    void train_forward_batch(Output&& output, const Input& input) const {
+        cpp_unused(output);
+        cpp_unused(input);
+    }
+
+    /*!
+     * \brief Compute the errors of the layer on the classes of the labels
+     * and on a sample of negative classes, together with the error and the
+     * loss (categorical cross entropy) of the batch.
+     *
+     * The error is computed among the sampled classes only.
+     *
+     * \param context The training context, with the input of the batch
+     * \param n The number of samples
+     * \param labels The labels of the samples (indices or one-hot)
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename C, typename Labels>
+    std::pair<double, double> sampled_errors(C& context, size_t n, const Labels& labels) const {
+        dll::auto_timer timer("sampled_softmax:errors");
+
+        const size_t B = etl::dim<0>(context.input);
+
+        // The class of each sample
+
+        std::vector<size_t> targets(n);
+
+        if constexpr (is_index_labels<Labels>) {
+            for (size_t i = 0; i < n; ++i) {
+                targets[i] = labels(i);
+            }
+        } else {
+            labels.ensure_cpu_up_to_date();
+
+            const auto* t = labels.memory_start();
+
+            for (size_t i = 0; i < n; ++i) {
+                targets[i] = std::max_element(t + i * num_classes, t + (i + 1) * num_classes) - (t + i * num_classes);
+            }
+        }
+
+        auto& classes = context.classes;
+
+        sample_candidates<sampler>(targets, num_samples, num_classes, classes);
+
+        const size_t M = classes.size();
+
+        // Gather the weights of the candidates, the biases being corrected
+        // by the log of the expected count of the classes in the sample
+
+        context.w_s = etl::dyn_matrix<weight, 2>(M, num_visible);
+
+        etl::dyn_matrix<weight, 1> b_s(M);
+
+        w.ensure_cpu_up_to_date();
+        b.ensure_cpu_up_to_date();
+
+        for (size_t c = 0; c < M; ++c) {
+            const size_t k = classes[c];
+
+            std::copy_n(w.memory_start() + k * num_visible, num_visible, context.w_s.memory_start() + c * num_visible);
+
+            b_s[c] = b[k] - std::log(num_samples * class_probability<sampler>(k, num_classes));
+        }
+
+        context.w_s.invalidate_gpu();
+
+        // The probabilities of the candidates
+
+        context.errors = etl::dyn_matrix<weight, 2>(B, M);
+        context.errors = context.input * etl::transpose(context.w_s);
+
+        bias_softmax_last(context.errors, b_s);
+
+        auto* e = context.errors.memory_start();
+
+        double loss  = 0.0;
+        double error = 0.0;
+
+        for (size_t i = 0; i < n; ++i) {
+            auto* e_i = e + i * M;
+
+            const size_t p = std::lower_bound(classes.begin(), classes.end(), targets[i]) - classes.begin();
+
+            loss += std::log(e_i[p]);
+            error += size_t(std::max_element(e_i, e_i + M) - e_i) != p ? 1.0 : 0.0;
+
+            for (size_t j = 0; j < M; ++j) {
+                e_i[j] = -e_i[j];
+            }
+
+            e_i[p] += 1.0;
+        }
+
+        std::fill(e + n * M, e + B * M, weight(0));
+
+        context.errors.invalidate_gpu();
+
+        return std::make_pair(error / n, -loss / n);
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DRBM>
+    static void dyn_init(DRBM& dyn){
+        cpp_unused(dyn);
+
+        // The layer has no dynamic version
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * The errors are computed with the loss, there is nothing to adapt.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        cpp_unused(context);
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the sampled classes to the
+     * previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("sampled_softmax:backward_batch");
+
+        constexpr auto Batch = etl::decay_traits<decltype(context.input)>::template dim<0>();
+
+        etl::reshape<Batch, num_visible>(output) = context.errors * context.w_s;
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, only on the rows of the
+     * sampled classes
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        dll::auto_timer timer("sampled_softmax:compute_gradients");
+
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+        auto& b_grad = std::get<1>(context.up.context)->grad;
+
+        const auto& classes = context.classes;
+        const size_t M      = classes.size();
+
+        etl::dyn_matrix<weight, 2> g_s(M, num_visible);
+        g_s = etl::transpose(context.errors) * context.input;
+
+        if (!context.sparse) {
+            w_grad = weight(0);
+        }
+
+        w_grad.ensure_cpu_up_to_date();
+
+        weight* g = w_grad.memory_start();
+
+        // Clear the rows of the previous batch
+
+        if (context.sparse) {
+            for (size_t r : context.rows) {
+                std::fill(g + r * num_visible, g + (r + 1) * num_visible, weight(0));
+            }
+        }
+
+        for (size_t c = 0; c < M; ++c) {
+            std::copy_n(g_s.memory_start() + c * num_visible, num_visible, g + classes[c] * num_visible);
+        }
+
+        w_grad.invalidate_gpu();
+
+        context.rows   = classes;
+        context.sparse = true;
+
+        // The biases are small enough to be updated as a whole
+
+        auto b_s = etl::force_temporary(etl::bias_batch_sum_2d(context.errors));
+
+        b_grad = weight(0);
+
+        for (size_t c = 0; c < M; ++c) {
+            b_grad[classes[c]] = b_s[c];
+        }
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t sampled_softmax_layer_impl<Desc>::num_visible;
+
+template <typename Desc>
+const size_t sampled_softmax_layer_impl<Desc>::num_classes;
+
+template <typename Desc>
+const size_t sampled_softmax_layer_impl<Desc>::num_samples;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<sampled_softmax_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = true;  ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief specialization of sgd_context for sampled_softmax_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, sampled_softmax_layer_impl<Desc>, L> {
+    using layer_t = sampled_softmax_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr auto num_visible = layer_t::num_visible;
+    static constexpr auto num_classes = layer_t::num_classes;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, num_visible> input;  ///< The input of the batch
+    etl::fast_matrix<weight, batch_size, num_classes> output; ///< The full output, only computed for evaluation
+    etl::dyn_matrix<weight, 2> errors;                        ///< The errors of the sampled classes (batch x candidates)
+
+    etl::dyn_matrix<weight, 2> w_s; ///< The weights of the sampled classes
+    std::vector<size_t> classes;    ///< The sampled classes of the last batch, sorted
+
+    std::vector<size_t> rows; ///< The rows of the gradients written by the last batch
+    bool sparse = false;      ///< Indicates if the gradients are only non-zero on rows
+
+    sgd_context(const layer_t& /* layer */)
+            : output(0.0), errors(batch_size, 1), w_s(1, num_visible) {}
+};
+
+} //end of dll namespace
@@ -0,0 +1,376 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "cpp_utils/io.hpp" // For binary writing
+
+#include "dll/base_traits.hpp"
+#include "dll/layer.hpp"
+
+#include "dll/util/timers.hpp"   // for auto_timer
+#include "dll/util/epilogue.hpp" // for fused bias and activation
+#include "dll/util/softmax.hpp"  // for the fused bias and softmax
+
+namespace dll {
+
+/*!
+ * \brief Dense layer using the transposed weights of another dense layer of
+ * the network, its encoder, typically the decoder of an auto-encoder.
+ *
+ * The layer only has its own biases. The weights are those of the encoder,
+ * the gradients of both uses are accumulated into the gradients of the
+ * encoder, which are the only ones updated, with a single state of the
+ * updater. The network ties the layer to its encoder when it is created.
+ */
+template <typename Desc>
+struct tied_dense_layer_impl final : layer<tied_dense_layer_impl<Desc>> {
+    using desc        = Desc;                       ///< The descriptor of the layer
+    using weight      = typename desc::weight;      ///< The data type for this layer
+    using this_type   = tied_dense_layer_impl<desc>; ///< The type of this layer
+    using base_type   = layer<this_type>;           ///< The base type
+    using layer_t     = this_type;                  ///< This layer's type
+    using dyn_layer_t = typename desc::dyn_layer_t; ///< The dynamic version of this layer
+
+    static constexpr size_t num_visible = desc::num_visible; ///< The number of visible units
+    static constexpr size_t num_hidden  = desc::num_hidden;  ///< The number of hidden units
+    static constexpr size_t encoder     = desc::encoder;     ///< The index of the encoder in the network
+
+    static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+    static constexpr bool no_bias             = false;                     ///< The biases are always used
+
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, num_visible>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, num_hidden>;  ///< The type of one output
+    using input_t      = std::vector<input_one_t>;                  ///< The type of the input
+    using output_t     = std::vector<output_one_t>;                 ///< The type of the output
+
+    using b_type = etl::fast_matrix<weight, num_hidden>; ///< The type of the biases
+
+    b_type b; ///< Hidden biases
+
+    std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
+
+    /*!
+     * \brief Initialize the biases of the layer, the layer must then be
+     * tied to its encoder.
+     */
+    tied_dense_layer_impl() : base_type() {
+        b_initializer::initialize(b, input_size(), output_size());
+    }
+
+    tied_dense_layer_impl(const tied_dense_layer_impl& rhs) = delete;
+    tied_dense_layer_impl(tied_dense_layer_impl&& rhs) = delete;
+
+    tied_dense_layer_impl& operator=(const tied_dense_layer_impl& rhs) = delete;
+    tied_dense_layer_impl& operator=(tied_dense_layer_impl&& rhs) = delete;
+
+    /*!
+     * \brief Use the weights of the given layer, which must have num_hidden
+     * inputs and num_visible outputs
+     */
+    template <typename Encoder>
+    void tie(const Encoder& layer) {
+        cpp_assert(layer.input_size() == num_hidden, "The encoder must have the outputs of the tied layer as inputs");
+        cpp_assert(layer.output_size() == num_visible, "The encoder must have the inputs of the tied layer as outputs");
+
+        tied        = &layer;
+        tied_memory = [](const void* encoder) -> weight* {
+            auto& w = static_cast<const Encoder*>(encoder)->w;
+
+            w.ensure_cpu_up_to_date();
+
+            return const_cast<weight*>(w.memory_start());
+        };
+    }
+
+    /*!
+     * \brief Returns a view of the weights of the encoder (num_hidden x
+     * num_visible), used transposed by the layer
+     */
+    etl::custom_dyn_matrix<weight, 2> w() const {
+        cpp_assert(tied, "The layer must be tied to its encoder");
+
+        // The memory is taken each time, the encoder may swap its weights
+        return etl::custom_dyn_matrix<weight, 2>(tied_memory(tied), num_hidden, num_visible);
+    }
+
+    /*!
+     * \brief Returns the input size of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return num_visible;
+    }
+
+    /*!
+     * \brief Returns the output size of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return num_hidden;
+    }
+
+    /*!
+     * \brief Returns the number of parameters of this layer, only its biases
+     */
+    static constexpr size_t parameters() noexcept {
+        return num_hidden;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        if constexpr (activation_function == function::IDENTITY) {
+            return "Dense (tied)";
+        } else {
+            char buffer[512];
+            snprintf(buffer, 512, "Dense (tied) (%s)", to_string(activation_function).c_str());
+            return {buffer};
+        }
+    }
+
+    /*!
+     * \brief Returns a full description of the layer
+     * \return an std::string containing a full description of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[512];
+
+        if constexpr (activation_function == function::IDENTITY) {
+            snprintf(buffer, 512, "Dense (tied to %lu): %lu -> %lu", encoder, num_visible, num_hidden);
+        } else {
+            snprintf(buffer, 512, "Dense (tied to %lu): %lu -> %s -> %lu", encoder, num_visible, to_string(activation_function).c_str(), num_hidden);
+        }
+
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {num_hidden};
+    }
+
+    /*!
+     * \brief Backup the biases in the secondary biases matrix
+     */
+    void backup_weights() {
+        unique_safe_get(bak_b) = b;
+    }
+
+    /*!
+     * \brief Restore the biases from the secondary biases matrix
+     */
+    void restore_weights() {
+        b = *bak_b;
+    }
+
+    /*!
+     * \brief Swap the biases with the secondary biases matrix
+     */
+    void swap_weights() {
+        std::swap(b, *bak_b);
+    }
+
+    /*!
+     * \brief Store the biases into the given stream, the weights are stored
+     * by the encoder
+     */
+    void store(std::ostream& os) const {
+        cpp::binary_write_all(os, b);
+    }
+
+    /*!
+     * \brief Load the biases from the given stream
+     */
+    void load(std::istream& is) {
+        cpp::binary_load_all(is, b);
+    }
+
+    /*!
+     * \brief Returns the trainable variables of this layer, only its biases.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) trainable_parameters() {
+        return std::make_tuple(std::ref(b));
+    }
+
+    /*!
+     * \brief Returns the trainable variables of this layer, only its biases.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) trainable_parameters() const {
+        return std::make_tuple(std::cref(b));
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H, typename V>
+    void forward_batch(H&& output, const V& input) const {
+        dll::auto_timer timer("dense:tied:forward_batch");
+
+        const auto Batch = etl::dim<0>(input);
+
+        cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
+
+        output = etl::reshape(input, Batch, num_visible) * etl::transpose(w());
+
+        if constexpr (fused_epilogue<activation_function> && etl::is_dma<std::decay_t<H>>) {
+            bias_activate_2d<activation_function>(output, b);
+        } else if constexpr (activation_function == function::SOFTMAX && etl::is_dma<std::decay_t<H>>) {
+            bias_softmax_last(output, b);
+        } else {
+            output = bias_add_2d(output, b);
+            output = f_activate<activation_function>(output);
+        }
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     *
+     * \tparam Input The type of one Input
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer, the layer is its
+     * own dynamic version
+     */
+    template <typename DLayer>
+    static void dyn_init(DLayer& dyn) {
+        cpp_unused(dyn);
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template <typename C>
+    void adapt_errors(C& context) const {
+        dll::unsafe_auto_timer timer("dense:tied:adapt_errors");
+
+        if constexpr (activation_function != function::IDENTITY) {
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template <typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        dll::unsafe_auto_timer timer("dense:tied:backward_batch");
+
+        constexpr auto Batch = etl::decay_traits<decltype(context.errors)>::template dim<0>();
+        etl::reshape<Batch, num_visible>(output) = context.errors * w();
+    }
+
+    /*!
+     * \brief Compute the gradients of the biases of this layer. The
+     * gradients of the weights are accumulated into the gradients of the
+     * encoder, by the trainer.
+     * \param context The trainng context
+     */
+    template <typename C>
+    void compute_gradients(C& context) const {
+        dll::unsafe_auto_timer timer("dense:tied:compute_gradients");
+
+        std::get<0>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+    }
+
+private:
+    const void* tied                    = nullptr; ///< The encoder
+    weight* (*tied_memory)(const void*) = nullptr; ///< Returns the memory of the weights of the encoder
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t tied_dense_layer_impl<Desc>::num_visible;
+
+template <typename Desc>
+const size_t tied_dense_layer_impl<Desc>::num_hidden;
+
+template <typename Desc>
+const size_t tied_dense_layer_impl<Desc>::encoder;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<tied_dense_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief specialization of sgd_context for tied_dense_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, tied_dense_layer_impl<Desc>, L> {
+    using layer_t = tied_dense_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr auto num_visible = layer_t::num_visible;
+    static constexpr auto num_hidden  = layer_t::num_hidden;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, num_visible> input;
+    etl::fast_matrix<weight, batch_size, num_hidden> output;
+    etl::fast_matrix<weight, batch_size, num_hidden> errors;
+
+    sgd_context(const tied_dense_layer_impl<Desc>& /* layer */)
+            : output(0.0), errors(0.0) {}
+};
+
+} //end of dll namespace
@@ -58,6 +58,20 @@ struct neural_layer : layer<Derived> {
     void restore_weights() {
         as_derived().w = *as_derived().bak_w;
         as_derived().b = *as_derived().bak_b;
+
+        as_derived().invalidate_weights_cache();
+    }
+
+    /*!
+     * \brief Swap the weights with the secondary weights matrix, restoring
+     * the backup in constant time. The secondary weights matrix holds the
+     * replaced weights afterwards.
+     */
+    void swap_weights() {
+        std::swap(as_derived().w, *as_derived().bak_w);
+        std::swap(as_derived().b, *as_derived().bak_b);
+
+        as_derived().invalidate_weights_cache();
     }
 
     /*!
@@ -74,6 +88,8 @@ struct neural_layer : layer<Derived> {
     void load(std::istream& is) {
         cpp::binary_load_all(is, as_derived().w);
         cpp::binary_load_all(is, as_derived().b);
+
+        as_derived().invalidate_weights_cache();
     }
 
     /*!
@@ -97,9 +113,20 @@ struct neural_layer : layer<Derived> {
      * \return a tuple containing references to the variables of this layer
      */
     decltype(auto) trainable_parameters(){
+        // The parameters may be modified through the references
+        as_derived().invalidate_weights_cache();
+
         return std::make_tuple(std::ref(as_derived().w), std::ref(as_derived().b));
     }
 
+    /*!
+     * \brief Invalidate the data computed from the weights by the layer,
+     * after a modification of the weights.
+     */
+    void invalidate_weights_cache() {
+        // Nothing is cached by default
+    }
+
     /*!
      * \brief Returns the trainable variables of this layer.
      * \return a tuple containing references to the variables of this layer
@@ -58,6 +58,15 @@ struct neural_layer_no_bias : layer<Derived> {
         as_derived().w = *as_derived().bak_w;
     }
 
+    /*!
+     * \brief Swap the weights with the secondary weights matrix, restoring
+     * the backup in constant time. The secondary weights matrix holds the
+     * replaced weights afterwards.
+     */
+    void swap_weights() {
+        std::swap(as_derived().w, *as_derived().bak_w);
+    }
+
     /*!
      * \brief Load the weigts into the given stream
      */
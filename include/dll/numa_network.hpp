@@ -0,0 +1,218 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief NUMA-aware replicated inference of a network
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "frozen_network.hpp"
+#include "util/numa.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Inference of a network with one replica of its weights per NUMA
+ * node and workers bound to the CPUs of each node.
+ *
+ * Each replica is a frozen_network built by a thread bound to its node, so
+ * that its packed parameters are first touched, and therefore allocated,
+ * on that node. The work submitted to a node is computed by the workers of
+ * the node, with the replica of the node. The layers that are not packed
+ * by the frozen network (convolutional, ...) still use the weights of the
+ * original network, which must outlive this object and must not be
+ * trained anymore.
+ */
+template <typename DBN>
+struct numa_network {
+    using dbn_t     = DBN;                   ///< The type of the network
+    using replica_t = frozen_network<dbn_t>; ///< The type of the replicas
+
+    /*!
+     * \brief Build the replicas and start the workers
+     * \param dbn The network, its batch normalization is folded
+     * \param topology The NUMA topology of the machine
+     * \param workers_per_node The number of workers of each node (0 for one per CPU of the node)
+     */
+    explicit numa_network(dbn_t& dbn, numa_topology topology = numa_topology::detect(), size_t workers_per_node = 0) : topology(std::move(topology)) {
+        cpp_assert(this->topology.size() > 0, "The topology must have at least one node");
+
+        dbn.fold_batch_normalization();
+
+        nodes.resize(this->topology.size());
+
+        for (size_t n = 0; n < nodes.size(); ++n) {
+            nodes[n] = std::make_unique<node>();
+
+            // The replica is allocated by a thread of its node
+            std::thread builder([this, &dbn, n] {
+                bind_current_thread(this->topology.nodes[n]);
+                nodes[n]->replica = std::make_unique<replica_t>(dbn);
+            });
+
+            builder.join();
+
+            const size_t workers = workers_per_node ? workers_per_node : this->topology.nodes[n].size();
+
+            for (size_t w = 0; w < workers; ++w) {
+                nodes[n]->threads.emplace_back([this, n] { work(n); });
+            }
+        }
+    }
+
+    numa_network(const numa_network& rhs) = delete;
+    numa_network& operator=(const numa_network& rhs) = delete;
+
+    /*!
+     * \brief Compute the pending work and stop the workers
+     */
+    ~numa_network() {
+        for (auto& n : nodes) {
+            {
+                std::unique_lock<std::mutex> l(n->lock);
+                n->stopping = true;
+            }
+
+            n->ready.notify_all();
+        }
+
+        for (auto& n : nodes) {
+            for (auto& thread : n->threads) {
+                thread.join();
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the number of NUMA nodes
+     */
+    size_t size() const {
+        return nodes.size();
+    }
+
+    /*!
+     * \brief Returns the replica of the given node
+     */
+    const replica_t& replica(size_t n) const {
+        return *nodes[n]->replica;
+    }
+
+    /*!
+     * \brief Returns the replica of the node of the current thread
+     */
+    const replica_t& local_replica() const {
+        return replica(topology.current_node() % nodes.size());
+    }
+
+    /*!
+     * \brief Run functor(replica) on a worker of the given node
+     * \param n The node
+     * \param functor The work, called with the replica of the node
+     * \return The future result of the functor
+     */
+    template <typename Functor>
+    auto submit(size_t n, Functor&& functor) {
+        using result_t = decltype(functor(std::declval<const replica_t&>()));
+
+        auto task = std::make_shared<std::packaged_task<result_t(const replica_t&)>>(std::forward<Functor>(functor));
+
+        auto future = task->get_future();
+
+        {
+            std::unique_lock<std::mutex> l(nodes[n]->lock);
+
+            cpp_assert(!nodes[n]->stopping, "Submission to a stopping network");
+
+            nodes[n]->pending.emplace_back([task](const replica_t& replica) { (*task)(replica); });
+        }
+
+        nodes[n]->ready.notify_one();
+
+        return future;
+    }
+
+    /*!
+     * \brief Run functor(replica) on a worker of the next node, the nodes
+     * being used in turn
+     */
+    template <typename Functor>
+    auto submit(Functor&& functor) {
+        return submit(next.fetch_add(1, std::memory_order_relaxed) % nodes.size(), std::forward<Functor>(functor));
+    }
+
+    /*!
+     * \brief Compute the output of the network for the given batch, on a
+     * worker of the next node
+     * \param input The batch of input
+     * \return The batch of output
+     */
+    template <typename Input>
+    auto forward_batch(const Input& input) {
+        return submit([&input](const replica_t& replica) { return replica.forward_batch(input); }).get();
+    }
+
+private:
+    /*!
+     * \brief A NUMA node, with its replica and its workers
+     */
+    struct node {
+        std::unique_ptr<replica_t> replica;                        ///< The replica of the weights
+        std::mutex lock;                                           ///< The lock protecting the queue
+        std::condition_variable ready;                             ///< The condition for the workers to wait for work
+        std::deque<std::function<void(const replica_t&)>> pending; ///< The pending work
+        bool stopping = false;                                     ///< Indicates if the workers are stopping
+        std::vector<std::thread> threads;                          ///< The workers
+    };
+
+    /*!
+     * \brief The loop of a worker of the given node
+     */
+    void work(size_t n) {
+        bind_current_thread(topology.nodes[n]);
+
+        auto& self = *nodes[n];
+
+        while (true) {
+            std::function<void(const replica_t&)> task;
+
+            {
+                std::unique_lock<std::mutex> l(self.lock);
+
+                self.ready.wait(l, [&self] { return self.stopping || !self.pending.empty(); });
+
+                if (self.pending.empty()) {
+                    return;
+                }
+
+                task = std::move(self.pending.front());
+                self.pending.pop_front();
+            }
+
+            task(*self.replica);
+        }
+    }
+
+    numa_topology topology;                   ///< The NUMA topology
+    std::vector<std::unique_ptr<node>> nodes; ///< The nodes
+    std::atomic<size_t> next{0};              ///< The next node used by submit
+};
+
+} //end of dll namespace
@@ -13,6 +13,14 @@
 #include "dbn_traits.hpp"
 
 #ifndef DLL_DETAIL_ONLY
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
 #include <opencv2/opencv.hpp>
 #endif
 
@@ -126,6 +134,143 @@ constexpr inline size_t best_width(const size_t total) {
 
 #ifndef DLL_DETAIL_ONLY
 
+/*!
+ * \brief The render thread of the OpenCV visualizers.
+ *
+ * The training thread only posts frames, functors drawing a snapshot of
+ * the weights and returning the image to show. The window, the drawing,
+ * the display and the events of the GUI are all handled by the render
+ * thread, at most max_fps frames per second. Only the last posted frame is
+ * drawn, the frames posted in between are dropped.
+ *
+ * The thread is only started with the first frame.
+ */
+struct ocv_render_thread {
+    using frame_t = std::function<cv::Mat()>; ///< The type of a frame
+
+    /*!
+     * \brief Create a render thread for the given window
+     * \param window The name of the window
+     * \param max_fps The maximum number of frames per second
+     */
+    explicit ocv_render_thread(std::string window, size_t max_fps = 20)
+            : window(std::move(window)), period(1000 / std::max(size_t(1), max_fps)) {
+        //Nothing else to init
+    }
+
+    ocv_render_thread(const ocv_render_thread& rhs) = delete;
+    ocv_render_thread& operator=(const ocv_render_thread& rhs) = delete;
+
+    /*!
+     * \brief Stop the render thread, after its current frame
+     */
+    ~ocv_render_thread() {
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> l(lock);
+                stop = true;
+            }
+
+            condition.notify_all();
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Post a frame to draw, replacing the one not drawn yet, if any
+     */
+    void post(frame_t frame) {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            pending = std::move(frame);
+        }
+
+        if (!thread.joinable()) {
+            thread = std::thread([this] { run(); });
+        }
+
+        condition.notify_all();
+    }
+
+    /*!
+     * \brief Wait for a key to be pressed in the window, once the last
+     * posted frame is shown
+     */
+    void wait_key() {
+        if (!thread.joinable()) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> l(lock);
+
+        waiting = true;
+        condition.notify_all();
+        condition.wait(l, [this] { return !waiting; });
+    }
+
+private:
+    /*!
+     * \brief The loop of the render thread
+     */
+    void run() {
+        cv::namedWindow(window, cv::WINDOW_NORMAL);
+
+        while (true) {
+            frame_t frame;
+            bool wait = false;
+            bool done = false;
+
+            {
+                std::lock_guard<std::mutex> l(lock);
+
+                frame = std::move(pending);
+                pending = nullptr;
+                wait    = waiting;
+                done    = stop;
+            }
+
+            if (frame) {
+                cv::imshow(window, frame());
+            }
+
+            if (wait) {
+                cv::waitKey(0);
+
+                {
+                    std::lock_guard<std::mutex> l(lock);
+                    waiting = false;
+                }
+
+                condition.notify_all();
+            } else if (done) {
+                break;
+            } else {
+                // Handle the events of the GUI until the next frame
+                cv::waitKey(period);
+            }
+        }
+    }
+
+    const std::string window; ///< The name of the window
+    const int period;         ///< The minimum time between two frames, in milliseconds
+
+    std::mutex lock;                   ///< The lock protecting the state
+    std::condition_variable condition; ///< The condition variable for the state
+    frame_t pending;                   ///< The frame not drawn yet
+    bool waiting = false;              ///< Indicates if a key must be waited
+    bool stop    = false;              ///< Indicates if the thread must stop
+    std::thread thread;                ///< The render thread
+};
+
+/*!
+ * \brief Returns a snapshot of the given weights, cheap to copy into a
+ * frame of the render thread
+ */
+template <typename W>
+std::shared_ptr<const std::decay_t<W>> ocv_snapshot(const W& w) {
+    return std::make_shared<const std::decay_t<W>>(w);
+}
+
 /*!
  * \brief The base type for an OpenCV visualizer
  */
@@ -136,7 +281,9 @@ struct base_ocv_rbm_visualizer {
     const size_t width;  ///< The width of the view
     const size_t height; ///< The height of the view
 
-    cv::Mat buffer_image; ///< The OpenCV buffer image
+    cv::Mat buffer_image; ///< The OpenCV buffer image, only drawn by the render thread
+
+    ocv_render_thread renderer{"RBM Training"}; ///< The render thread
 
     /*!
      * \brief Initialize the base_ocv_rbm_visualizer
@@ -176,8 +323,6 @@ struct base_ocv_rbm_visualizer {
             std::cout << "   sparsity_target(Local)=" << rbm.sparsity_target << std::endl;
         }
 
-        cv::namedWindow("RBM Training", cv::WINDOW_NORMAL);
-
         refresh();
     }
 
@@ -189,7 +334,7 @@ struct base_ocv_rbm_visualizer {
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window..." << std::endl;
-        cv::waitKey(0);
+        renderer.wait_key();
 
         cpp_unused(rbm);
     }
@@ -212,8 +357,7 @@ struct base_ocv_rbm_visualizer {
      * \brief Refresh the view
      */
     void refresh() {
-        cv::imshow("RBM Training", buffer_image);
-        cv::waitKey(30);
+        renderer.post([image = buffer_image] { return image; });
     }
 };
 
@@ -254,7 +398,11 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
                   filter_shape.width * tile_shape.width + (tile_shape.height + 1) * 1 + 2 * padding,
                   filter_shape.height * tile_shape.height + (tile_shape.height + 1) * 1 + 2 * padding) {}
 
-    void draw_weights(const RBM& rbm) {
+    /*!
+     * \brief Draw the given weights of the RBM into the buffer image
+     */
+    template <typename W>
+    void draw_weights(const W& w) {
         for (size_t hi = 0; hi < tile_shape.width; ++hi) {
             for (size_t hj = 0; hj < tile_shape.height; ++hj) {
                 auto real_h = hi * tile_shape.height + hj;
@@ -267,8 +415,8 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
                 typename RBM::weight max;
 
                 if (scale) {
-                    min = etl::min(rbm.w);
-                    max = etl::max(rbm.w);
+                    min = etl::min(w);
+                    max = etl::max(w);
                 }
 
                 for (size_t i = 0; i < filter_shape.width; ++i) {
@@ -279,7 +427,7 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
                             break;
                         }
 
-                        auto value = rbm.w(real_v, real_h);
+                        auto value = w(real_v, real_h);
 
                         if (scale) {
                             value -= min;
@@ -305,13 +453,16 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
         printf("epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n", epoch,
                context.reconstruction_error, context.free_energy, context.sparsity);
 
-        buffer_image = cv::Scalar(255);
+        // Only the copy of the weights is done on the training thread
+        this->renderer.post([this, epoch, w = ocv_snapshot(rbm.w)] {
+            buffer_image = cv::Scalar(255);
 
-        cv::putText(buffer_image, "epoch " + std::to_string(epoch), cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
+            cv::putText(buffer_image, "epoch " + std::to_string(epoch), cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
 
-        draw_weights(rbm);
+            draw_weights(*w);
 
-        refresh();
+            return buffer_image;
+        });
     }
 };
 
@@ -341,7 +492,11 @@ struct opencv_rbm_visualizer<RBM, C, std::enable_if_t<layer_traits<RBM>::is_conv
                   filter_shape.width * tile_shape.width + (tile_shape.height + 1) * 1 + 2 * padding,
                   filter_shape.height * tile_shape.height + (tile_shape.height + 1) * 1 + 2 * padding) {}
 
-    void draw_weights(const RBM& rbm) {
+    /*!
+     * \brief Draw the given weights of the RBM into the buffer image
+     */
+    template <typename W>
+    void draw_weights(const W& w) {
         size_t channel = 0;
 
         for (size_t hi = 0; hi < tile_shape.width; ++hi) {
@@ -356,13 +511,13 @@ struct opencv_rbm_visualizer<RBM, C, std::enable_if_t<layer_traits<RBM>::is_conv
                 typename RBM::weight max;
 
                 if (scale) {
-                    min = etl::min(rbm.w(channel)(real_k));
-                    max = etl::max(rbm.w(channel)(real_k));
+                    min = etl::min(w(channel)(real_k));
+                    max = etl::max(w(channel)(real_k));
                 }
 
                 for (size_t fi = 0; fi < filter_shape.width; ++fi) {
                     for (size_t fj = 0; fj < filter_shape.height; ++fj) {
-                        auto value = rbm.w(channel, real_k, fi, fj);
+                        auto value = w(channel, real_k, fi, fj);
 
                         if (scale) {
                             value -= min;
@@ -388,13 +543,16 @@ struct opencv_rbm_visualizer<RBM, C, std::enable_if_t<layer_traits<RBM>::is_conv
         printf("epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n", epoch,
                context.reconstruction_error, context.free_energy, context.sparsity);
 
-        buffer_image = cv::Scalar(255);
+        // Only the copy of the weights is done on the training thread
+        this->renderer.post([this, epoch, w = ocv_snapshot(rbm.w)] {
+            buffer_image = cv::Scalar(255);
 
-        cv::putText(buffer_image, "epoch " + std::to_string(epoch), cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
+            cv::putText(buffer_image, "epoch " + std::to_string(epoch), cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
 
-        draw_weights(rbm);
+            draw_weights(*w);
 
-        refresh();
+            return buffer_image;
+        });
     }
 };
 
@@ -410,6 +568,8 @@ struct opencv_dbn_visualizer {
     static std::vector<cv::Mat> buffer_images; ///< The buffer images
     static size_t current_image;               ///< The current images
 
+    ocv_render_thread renderer{"DBN Training"}; ///< The render thread
+
     opencv_dbn_visualizer() = default;
 
     //Pretraining phase
@@ -423,8 +583,6 @@ struct opencv_dbn_visualizer {
         cpp_unused(dbn);
 
         std::cout << "DBN: Pretraining begin for " << max_epochs << " epochs" << std::endl;
-
-        cv::namedWindow("DBN Training", cv::WINDOW_NORMAL);
     }
 
     /*!
@@ -516,54 +674,57 @@ struct opencv_dbn_visualizer {
         static constexpr auto scale   = C::scale;
         static constexpr auto padding = C::padding;
 
-        auto& buffer_image = buffer_images[current_image];
+        // Only the copy of the weights is done on the training thread
+        renderer.post([=, buffer_image = buffer_images[current_image], layer = current_image, weights = ocv_snapshot(rbm.w)]() mutable {
+            const auto& w = *weights;
 
-        buffer_image = cv::Scalar(255);
+            buffer_image = cv::Scalar(255);
 
-        cv::putText(buffer_image,
-                    "layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch),
-                    cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
+            cv::putText(buffer_image,
+                        "layer: " + std::to_string(layer) + " epoch " + std::to_string(epoch),
+                        cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
 
-        for (size_t hi = 0; hi < tile_shape.width; ++hi) {
-            for (size_t hj = 0; hj < tile_shape.height; ++hj) {
-                auto real_h = hi * tile_shape.height + hj;
+            for (size_t hi = 0; hi < tile_shape.width; ++hi) {
+                for (size_t hj = 0; hj < tile_shape.height; ++hj) {
+                    auto real_h = hi * tile_shape.height + hj;
 
-                if (real_h >= rbm_t::num_hidden) {
-                    break;
-                }
+                    if (real_h >= rbm_t::num_hidden) {
+                        break;
+                    }
 
-                typename RBM::weight min;
-                typename RBM::weight max;
+                    typename RBM::weight min;
+                    typename RBM::weight max;
 
-                if (scale) {
-                    min = etl::min(rbm.w);
-                    max = etl::max(rbm.w);
-                }
+                    if (scale) {
+                        min = etl::min(w);
+                        max = etl::max(w);
+                    }
 
-                for (size_t i = 0; i < filter_shape.width; ++i) {
-                    for (size_t j = 0; j < filter_shape.height; ++j) {
-                        auto real_v = i * filter_shape.height + j;
+                    for (size_t i = 0; i < filter_shape.width; ++i) {
+                        for (size_t j = 0; j < filter_shape.height; ++j) {
+                            auto real_v = i * filter_shape.height + j;
 
-                        if (real_v >= rbm_t::num_visible) {
-                            break;
-                        }
+                            if (real_v >= rbm_t::num_visible) {
+                                break;
+                            }
 
-                        auto value = rbm.w(real_v, real_h);
+                            auto value = w(real_v, real_h);
 
-                        if (scale) {
-                            value -= min;
-                            value *= 1.0 / (max + 1e-8);
-                        }
+                            if (scale) {
+                                value -= min;
+                                value *= 1.0 / (max + 1e-8);
+                            }
 
-                        buffer_image.template at<uint8_t>(
-                            padding + 1 + hi * (filter_shape.width + 1) + i,
-                            padding + 1 + hj * (filter_shape.height + 1) + j) = value * 255;
+                            buffer_image.template at<uint8_t>(
+                                padding + 1 + hi * (filter_shape.width + 1) + i,
+                                padding + 1 + hj * (filter_shape.height + 1) + j) = value * 255;
+                        }
                     }
                 }
             }
-        }
 
-        refresh();
+            return buffer_image;
+        });
     }
 
     /*!
@@ -588,7 +749,7 @@ struct opencv_dbn_visualizer {
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window and continue training..." << std::endl;
-        cv::waitKey(0);
+        renderer.wait_key();
     }
 
     /*!
@@ -647,7 +808,7 @@ struct opencv_dbn_visualizer {
         std::cout << "Total training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window" << std::endl;
-        cv::waitKey(0);
+        renderer.wait_key();
     }
 
     //Utility functions
@@ -656,8 +817,7 @@ struct opencv_dbn_visualizer {
      * \brief Refresh the view
      */
     void refresh() {
-        cv::imshow("DBN Training", buffer_images[current_image]);
-        cv::waitKey(30);
+        renderer.post([image = buffer_images[current_image]] { return image; });
     }
 };
 
@@ -679,6 +839,8 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
     static std::vector<cv::Mat> buffer_images; ///< The buffer images
     static size_t current_image;               ///< The current images
 
+    ocv_render_thread renderer{"DBN Training"}; ///< The render thread
+
     opencv_dbn_visualizer() = default;
 
     //Pretraining phase
@@ -692,8 +854,6 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
     void pretraining_begin(const DBN& dbn, size_t max_epochs) {
         std::cout << "DBN: Pretraining begin for " << max_epochs << " epochs" << std::endl;
 
-        cv::namedWindow("DBN Training", cv::WINDOW_NORMAL);
-
         cpp_unused(dbn);
     }
 
@@ -770,54 +930,57 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
         static constexpr auto scale   = C::scale;
         static constexpr auto padding = C::padding;
 
-        auto& buffer_image = buffer_images[current_image];
+        // Only the copy of the weights is done on the training thread
+        renderer.post([=, buffer_image = buffer_images[current_image], layer = current_image, weights = ocv_snapshot(rbm.w)]() mutable {
+            const auto& w = *weights;
 
-        buffer_image = cv::Scalar(255);
+            buffer_image = cv::Scalar(255);
 
-        cv::putText(buffer_image,
-                    "layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch),
-                    cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
+            cv::putText(buffer_image,
+                        "layer: " + std::to_string(layer) + " epoch " + std::to_string(epoch),
+                        cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
 
-        for (size_t hi = 0; hi < tile_shape.width; ++hi) {
-            for (size_t hj = 0; hj < tile_shape.height; ++hj) {
-                auto real_h = hi * tile_shape.height + hj;
+            for (size_t hi = 0; hi < tile_shape.width; ++hi) {
+                for (size_t hj = 0; hj < tile_shape.height; ++hj) {
+                    auto real_h = hi * tile_shape.height + hj;
 
-                if (real_h >= hidden) {
-                    break;
-                }
+                    if (real_h >= hidden) {
+                        break;
+                    }
 
-                typename RBM::weight min;
-                typename RBM::weight max;
+                    typename RBM::weight min;
+                    typename RBM::weight max;
 
-                if (scale) {
-                    min = etl::min(rbm.w);
-                    max = etl::max(rbm.w);
-                }
+                    if (scale) {
+                        min = etl::min(w);
+                        max = etl::max(w);
+                    }
 
-                for (size_t i = 0; i < filter_shape.width; ++i) {
-                    for (size_t j = 0; j < filter_shape.height; ++j) {
-                        auto real_v = i * filter_shape.height + j;
+                    for (size_t i = 0; i < filter_shape.width; ++i) {
+                        for (size_t j = 0; j < filter_shape.height; ++j) {
+                            auto real_v = i * filter_shape.height + j;
 
-                        if (real_v >= visible) {
-                            break;
-                        }
+                            if (real_v >= visible) {
+                                break;
+                            }
 
-                        auto value = rbm.w(real_v, real_h);
+                            auto value = w(real_v, real_h);
 
-                        if (scale) {
-                            value -= min;
-                            value *= 1.0 / (max + 1e-8);
-                        }
+                            if (scale) {
+                                value -= min;
+                                value *= 1.0 / (max + 1e-8);
+                            }
 
-                        buffer_image.template at<uint8_t>(
-                            padding + 1 + hi * (filter_shape.width + 1) + i,
-                            padding + 1 + hj * (filter_shape.height + 1) + j) = value * 255;
+                            buffer_image.template at<uint8_t>(
+                                padding + 1 + hi * (filter_shape.width + 1) + i,
+                                padding + 1 + hj * (filter_shape.height + 1) + j) = value * 255;
+                        }
                     }
                 }
             }
-        }
 
-        refresh();
+            return buffer_image;
+        });
     }
 
     /*!
@@ -842,7 +1005,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window and continue training..." << std::endl;
-        cv::waitKey(0);
+        renderer.wait_key();
     }
 
     /*!
@@ -867,8 +1030,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
      * \brief Refresh the view
      */
     void refresh() {
-        cv::imshow("DBN Training", buffer_images[current_image]);
-        cv::waitKey(30);
+        renderer.post([image = buffer_images[current_image]] { return image; });
     }
 };
 
@@ -890,6 +1052,8 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
     static std::vector<cv::Mat> buffer_images; ///< The buffer images
     static size_t current_image;               ///< The current images
 
+    ocv_render_thread renderer{"CDBN Training"}; ///< The render thread
+
     opencv_dbn_visualizer() = default;
 
     //Pretraining phase
@@ -903,8 +1067,6 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
     void pretraining_begin(const DBN& dbn, size_t max_epochs) {
         std::cout << "CDBN: Pretraining begin for " << max_epochs << " epochs" << std::endl;
 
-        cv::namedWindow("CDBN Training", cv::WINDOW_NORMAL);
-
         cpp_unused(dbn);
     }
 
@@ -984,50 +1146,53 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
         static constexpr auto scale   = C::scale;
         static constexpr auto padding = C::padding;
 
-        auto& buffer_image = buffer_images[current_image];
+        // Only the copy of the weights is done on the training thread
+        renderer.post([=, buffer_image = buffer_images[current_image], layer = current_image, weights = ocv_snapshot(rbm.w)]() mutable {
+            const auto& w = *weights;
 
-        buffer_image = cv::Scalar(255);
+            buffer_image = cv::Scalar(255);
 
-        cv::putText(buffer_image,
-                    "layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch),
-                    cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
+            cv::putText(buffer_image,
+                        "layer: " + std::to_string(layer) + " epoch " + std::to_string(epoch),
+                        cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
 
-        size_t channel = 0;
+            size_t channel = 0;
 
-        for (size_t hi = 0; hi < tile_shape.width; ++hi) {
-            for (size_t hj = 0; hj < tile_shape.height; ++hj) {
-                auto real_k = hi * tile_shape.height + hj;
+            for (size_t hi = 0; hi < tile_shape.width; ++hi) {
+                for (size_t hj = 0; hj < tile_shape.height; ++hj) {
+                    auto real_k = hi * tile_shape.height + hj;
 
-                if (real_k >= rbm_t::K) {
-                    break;
-                }
+                    if (real_k >= rbm_t::K) {
+                        break;
+                    }
 
-                typename RBM::weight min;
-                typename RBM::weight max;
+                    typename RBM::weight min;
+                    typename RBM::weight max;
 
-                if (scale) {
-                    min = etl::min(rbm.w(channel)(real_k));
-                    max = etl::max(rbm.w(channel)(real_k));
-                }
+                    if (scale) {
+                        min = etl::min(w(channel)(real_k));
+                        max = etl::max(w(channel)(real_k));
+                    }
 
-                for (size_t fi = 0; fi < filter_shape.width; ++fi) {
-                    for (size_t fj = 0; fj < filter_shape.height; ++fj) {
-                        auto value = rbm.w(channel, real_k, fi, fj);
+                    for (size_t fi = 0; fi < filter_shape.width; ++fi) {
+                        for (size_t fj = 0; fj < filter_shape.height; ++fj) {
+                            auto value = w(channel, real_k, fi, fj);
 
-                        if (scale) {
-                            value -= min;
-                            value *= 1.0 / (max + 1e-8);
-                        }
+                            if (scale) {
+                                value -= min;
+                                value *= 1.0 / (max + 1e-8);
+                            }
 
-                        buffer_image.template at<uint8_t>(
-                            padding + 1 + hi * (filter_shape.width + 1) + fi,
-                            padding + 1 + hj * (filter_shape.height + 1) + fj) = value * 255;
+                            buffer_image.template at<uint8_t>(
+                                padding + 1 + hi * (filter_shape.width + 1) + fi,
+                                padding + 1 + hj * (filter_shape.height + 1) + fj) = value * 255;
+                        }
                     }
                 }
             }
-        }
 
-        refresh();
+            return buffer_image;
+        });
     }
 
     /*!
@@ -1052,7 +1217,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window and continue training..." << std::endl;
-        cv::waitKey(0);
+        renderer.wait_key();
     }
 
     /*!
@@ -1064,9 +1229,11 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
 
     //Utility functions
 
+    /*!
+     * \brief Refresh the view
+     */
     void refresh() {
-        cv::imshow("CDBN Training", buffer_images[current_image]);
-        cv::waitKey(30);
+        renderer.post([image = buffer_images[current_image]] { return image; });
     }
 };
 
@@ -1078,12 +1245,10 @@ size_t opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
 
 template <typename RBM>
 void visualize_rbm(const RBM& rbm) {
-    cv::namedWindow("RBM Training", cv::WINDOW_NORMAL);
-
     opencv_rbm_visualizer<RBM> visualizer;
-    visualizer.draw_weights(rbm);
+    visualizer.draw_weights(rbm.w);
     visualizer.refresh();
-    cv::waitKey(0);
+    visualizer.renderer.wait_key();
 }
 
 #endif
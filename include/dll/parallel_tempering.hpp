@@ -0,0 +1,314 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Parallel Tempering trainer for the fully-connected RBMs
+ *
+ * The negative phase is sampled from a ladder of persistent replicas at
+ * decreasing inverse temperatures. The replicas at high temperature mix
+ * easily between the modes of the model and their states are propagated
+ * to the replica at temperature 1 by swap steps between neighbouring
+ * temperatures.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "dll/contrastive_divergence.hpp"
+#include "dll/util/random.hpp"
+#include "dll/util/sampling.hpp"
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Advance the rows [first, last) of the replicas by one Gibbs
+ * step, each at the inverse temperature of its replica.
+ */
+template <typename RBM, typename Trainer>
+void tempered_gibbs_step(RBM& rbm, Trainer& t, size_t first, size_t last) {
+    const size_t B = etl::dim<0>(t.v1);
+
+    auto v_a = etl::slice(t.t_v_a, first, last);
+    auto v_s = etl::slice(t.t_v_s, first, last);
+    auto h_a = etl::slice(t.t_h_a, first, last);
+    auto h_s = etl::slice(t.t_h_s, first, last);
+
+    v_a = etl::bias_add_2d(h_s * etl::transpose(rbm.w), rbm.c);
+
+    for (size_t i = first; i < last; ++i) {
+        v_a(i - first) *= t.betas[i / B];
+    }
+
+    v_a = etl::sigmoid(v_a);
+    dll::sample_bernoulli(v_a, v_s);
+
+    h_a = etl::bias_add_2d(v_s * rbm.w, rbm.b);
+
+    for (size_t i = first; i < last; ++i) {
+        h_a(i - first) *= t.betas[i / B];
+    }
+
+    h_a = etl::sigmoid(h_a);
+    dll::sample_bernoulli(h_a, h_s);
+}
+
+/*!
+ * \brief Propose a swap of the states of the neighbouring temperatures,
+ * alternating between the even and the odd pairs.
+ *
+ * The energies of all the replicas are computed at once and a swap
+ * between two replicas of the same chain is accepted with probability
+ * min(1, exp((beta_r - beta_r+1) * (E_r - E_r+1))).
+ */
+template <typename RBM, typename Trainer>
+void tempered_swap_step(RBM& rbm, Trainer& t) {
+    dll::auto_timer timer("pt:swap");
+
+    using weight = typename RBM::weight;
+
+    const size_t B = etl::dim<0>(t.v1);
+    const size_t R = t.betas.size();
+    const size_t V = etl::dim<1>(t.t_v_s);
+    const size_t H = etl::dim<1>(t.t_h_s);
+
+    // E(v,h) = -c.v - b.h - v W h, for all the replicas at once
+    t.t_x      = t.t_v_s * rbm.w;
+    t.t_energy = -(t.t_v_s * rbm.c) - (t.t_h_s * rbm.b) - etl::sum_r(t.t_x >> t.t_h_s);
+
+    t.t_energy.ensure_cpu_up_to_date();
+    t.t_v_s.ensure_cpu_up_to_date();
+    t.t_h_s.ensure_cpu_up_to_date();
+
+    auto& g = dll::rand_engine();
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+    weight* v_p = t.t_v_s.memory_start();
+    weight* h_p = t.t_h_s.memory_start();
+
+    for (size_t r = t.swap_parity; r + 1 < R; r += 2) {
+        const double beta_diff = double(t.betas[r]) - double(t.betas[r + 1]);
+
+        for (size_t b = 0; b < B; ++b) {
+            const size_t i = r * B + b;
+            const size_t j = (r + 1) * B + b;
+
+            const double delta = beta_diff * (double(t.t_energy[i]) - double(t.t_energy[j]));
+
+            ++t.swaps_proposed;
+
+            if (delta >= 0.0 || dist(g) < std::exp(delta)) {
+                std::swap_ranges(v_p + i * V, v_p + (i + 1) * V, v_p + j * V);
+                std::swap_ranges(h_p + i * H, h_p + (i + 1) * H, h_p + j * H);
+
+                ++t.swaps_accepted;
+            }
+        }
+    }
+
+    t.t_v_s.invalidate_gpu();
+    t.t_h_s.invalidate_gpu();
+
+    t.swap_parity ^= 1;
+}
+
+/*!
+ * \brief Advance all the replicas by K Gibbs steps, in chunks of rows on
+ * the scoped thread pool if there is one.
+ */
+template <size_t K, typename RBM, typename Trainer>
+void advance_replicas(RBM& rbm, Trainer& t) {
+    dll::auto_timer timer("pt:gibbs");
+
+    const size_t P = etl::dim<0>(t.t_h_s);
+
+    auto gibbs = [&rbm, &t](size_t first, size_t last) {
+        for (size_t k = 0; k < K; ++k) {
+            tempered_gibbs_step(rbm, t, first, last);
+        }
+    };
+
+    auto* pool = scoped_thread_pool();
+
+    if (pool && P > 1) {
+        const size_t chunks = std::min(P, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&gibbs, P, chunks](size_t c) {
+            SERIAL_SECTION {
+                gibbs((c * P) / chunks, ((c + 1) * P) / chunks);
+            }
+        });
+    } else {
+        gibbs(0, P);
+    }
+}
+
+/*!
+ * \brief Train a fully-connected RBM with Parallel Tempering
+ */
+template <size_t K, typename InputBatch, typename ExpectedBatch, typename RBM, typename Trainer>
+void train_tempering(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_training_context& context, RBM& rbm, Trainer& t) {
+    dll::auto_timer timer("pt:train");
+
+    using weight = typename RBM::weight;
+
+    cpp_assert(etl::dim<0>(input_batch) == etl::dim<0>(expected_batch), "Invalid batch sizes");
+    cpp_assert(etl::dim<0>(t.v1) >= etl::dim<0>(input_batch), "Invalid batch sizes");
+
+    const size_t B  = etl::dim<0>(t.v1);
+    const size_t IB = etl::dim<0>(input_batch);
+    const size_t R  = std::max(rbm.tempering_replicas, size_t(1));
+
+    //Copy input/expected for computations
+    if (cpp_likely(IB == RBM::batch_size)) {
+        t.v1 = input_batch;
+        t.vf = expected_batch;
+    } else {
+        t.v1 = 0;
+        t.vf = 0;
+
+        etl::slice(t.v1, 0, IB) = input_batch;
+        etl::slice(t.vf, 0, IB) = expected_batch;
+    }
+
+    //Positive phase
+    rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, t.v1, t.v1);
+
+    //Start all the replicas from the hidden states of the first batch
+    if (t.betas.size() != R || etl::dim<0>(t.t_h_s) != R * B) {
+        t.betas.resize(R);
+
+        // Linear ladder of inverse temperatures from 1 to tempering_min_beta
+        for (size_t r = 0; r < R; ++r) {
+            t.betas[r] = R == 1 ? weight(1) : weight(1) - weight(r) * (weight(1) - rbm.tempering_min_beta) / weight(R - 1);
+        }
+
+        t.t_v_a    = etl::dyn_matrix<weight>(R * B, etl::dim<1>(t.v1));
+        t.t_v_s    = etl::dyn_matrix<weight>(R * B, etl::dim<1>(t.v1));
+        t.t_h_a    = etl::dyn_matrix<weight>(R * B, etl::dim<1>(t.h1_a));
+        t.t_h_s    = etl::dyn_matrix<weight>(R * B, etl::dim<1>(t.h1_a));
+        t.t_x      = etl::dyn_matrix<weight>(R * B, etl::dim<1>(t.h1_a));
+        t.t_energy = etl::dyn_vector<weight>(R * B);
+
+        for (size_t r = 0; r < R; ++r) {
+            etl::slice(t.t_h_s, r * B, (r + 1) * B) = t.h1_s;
+        }
+
+        t.swap_parity = 0;
+    } else {
+        tempered_swap_step(rbm, t);
+    }
+
+    advance_replicas<K>(rbm, t);
+
+    //Negative phase from the replicas at temperature 1
+    t.v2_a = etl::slice(t.t_v_a, 0, B);
+    t.h2_a = etl::slice(t.t_h_a, 0, B);
+
+    {
+        dll::auto_timer timer("pt:batch_compute_gradients");
+
+        positive_weight_gradients<RBM>(t);
+        t.w_grad -= batch_outer(t.v2_a, t.h2_a);
+
+        t.b_grad = sum_l(t.h1_a) - sum_l(t.h2_a);
+        t.c_grad = sum_l(t.vf) - sum_l(t.v2_a);
+    }
+
+    context.batch_error = etl::mean((t.vf - t.v2_a) >> (t.vf - t.v2_a));
+
+    nan_check_deep_3(t.w_grad, t.b_grad, t.c_grad);
+
+    //Compute the mean activation probabilities
+    t.q_global_batch = etl::mean(t.h2_a);
+
+    if constexpr (rbm_layer_traits<RBM>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
+        t.q_local_batch = etl::mean_l(t.h2_a);
+    }
+
+    context.batch_sparsity = t.q_global_batch;
+
+    //Update the weights and biases based on the gradients
+    t.update(rbm);
+}
+
+/*!
+ * \brief Parallel Tempering trainer for the fully-connected RBMs (static
+ * and dynamic), with binary visible and hidden units.
+ *
+ * The ladder has rbm.tempering_replicas temperatures, linearly spaced from
+ * 1 to rbm.tempering_min_beta. Each temperature holds one persistent chain
+ * per sample of the batch and all the replicas are stored in a single
+ * batched matrix.
+ *
+ * \tparam N The number of Gibbs steps between two swap steps
+ * \tparam RBM The RBM type
+ */
+template <size_t N, typename RBM>
+struct parallel_tempering_trainer : base_cd_trainer<N, RBM, true> {
+    using base_t = base_cd_trainer<N, RBM, true>; ///< The base trainer
+    using rbm_t  = RBM;                           ///< The type of RBM being trained
+    using weight = typename rbm_t::weight;        ///< The data type for this layer
+
+    static_assert(!layer_traits<rbm_t>::is_convolutional_rbm_layer(), "Parallel Tempering is only implemented for fully-connected RBMs");
+    static_assert(rbm_t::visible_unit == unit_type::BINARY && rbm_t::hidden_unit == unit_type::BINARY,
+                  "Parallel Tempering is only implemented for binary units");
+
+    std::vector<weight> betas; ///< The inverse temperatures of the replicas
+
+    etl::dyn_matrix<weight> t_v_a;    ///< The visible activations of the replicas
+    etl::dyn_matrix<weight> t_v_s;    ///< The visible samples of the replicas
+    etl::dyn_matrix<weight> t_h_a;    ///< The hidden activations of the replicas
+    etl::dyn_matrix<weight> t_h_s;    ///< The hidden samples of the replicas
+    etl::dyn_matrix<weight> t_x;      ///< The product of the visible samples and the weights
+    etl::dyn_vector<weight> t_energy; ///< The energies of the replicas
+
+    size_t swap_parity    = 0; ///< The parity of the pairs of temperatures of the next swap step
+    size_t swaps_proposed = 0; ///< The number of proposed swaps
+    size_t swaps_accepted = 0; ///< The number of accepted swaps
+
+    /*!
+     * \brief Construct the trainer for the given RBM
+     */
+    parallel_tempering_trainer(rbm_t& rbm) : base_t(rbm) {}
+
+    /*!
+     * \brief Train the RBM with one batch of data
+     */
+    template <typename InputBatch, typename ExpectedBatch>
+    void train_batch(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_training_context& context) {
+        train_tempering<N>(input_batch, expected_batch, context, this->rbm, *this);
+    }
+
+    /*!
+     * \brief Returns the rate of accepted swaps
+     */
+    double swap_rate() const {
+        return swaps_proposed ? double(swaps_accepted) / double(swaps_proposed) : 0.0;
+    }
+
+    /*!
+     * \brief The name of the trainer
+     */
+    static std::string name() {
+        return "Parallel Tempering";
+    }
+};
+
+/*!
+ * \brief Parallel Tempering with one Gibbs step between two swap steps
+ */
+template <typename RBM>
+using pt1_trainer_t = parallel_tempering_trainer<1, RBM>;
+
+} //end of dll namespace
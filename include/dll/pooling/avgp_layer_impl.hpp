@@ -68,7 +68,11 @@ struct avgp_2d_layer_impl final : pooling_2d_layer<avgp_2d_layer_impl<Desc>, Des
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        output = etl::ml::avg_pool_forward<base::C1, base::C2>(input);
+        if constexpr (base::window != small_pool_window::NONE && etl::is_dma<Input> && etl::is_dma<Output>) {
+            small_avg_pool_forward(output, input, base::window);
+        } else {
+            output = etl::ml::avg_pool_forward<base::C1, base::C2>(input);
+        }
     }
 
     /*!
@@ -105,7 +109,11 @@ struct avgp_2d_layer_impl final : pooling_2d_layer<avgp_2d_layer_impl<Desc>, Des
         static constexpr size_t C2 = base::C2; ///< The pooling second dimension
         static constexpr size_t C3 = base::C3; ///< The pooling second dimension
 
-        output = etl::ml::avg_pool_backward<C1, C2, C3>(context.input, context.output, context.errors);
+        if constexpr (base::window != small_pool_window::NONE && etl::is_dma<std::decay_t<H>>) {
+            small_avg_pool_backward(output, context.errors, base::window);
+        } else {
+            output = etl::ml::avg_pool_backward<C1, C2, C3>(context.input, context.output, context.errors);
+        }
     }
 
     /*!
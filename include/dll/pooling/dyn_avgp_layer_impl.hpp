@@ -68,6 +68,13 @@ struct dyn_avgp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_avgp_2d_layer_imp
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
+        if constexpr (etl::is_dma<Input> && etl::is_dma<Output>) {
+            if (base::window != small_pool_window::NONE) {
+                small_avg_pool_forward(output, input, base::window);
+                return;
+            }
+        }
+
         output = etl::ml::avg_pool_forward(input, base::c1, base::c2);
     }
 
@@ -104,6 +111,13 @@ struct dyn_avgp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_avgp_2d_layer_imp
         size_t c1 = base::c1;
         size_t c2 = base::c2;
 
+        if constexpr (etl::is_dma<std::decay_t<H>>) {
+            if (base::window != small_pool_window::NONE) {
+                small_avg_pool_backward(output, context.errors, base::window);
+                return;
+            }
+        }
+
         output = etl::ml::avg_pool_backward(context.input, context.output, context.errors, c1, c2);
     }
 
@@ -11,6 +11,23 @@
 
 namespace dll {
 
+/*!
+ * \brief Description of a Dynamic Max Pooling one-dimensional layer.
+ */
+template <typename... Parameters>
+struct dyn_mp_1d_layer_desc : dyn_pooling_1d_layer_desc<Parameters...> {
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    /*! The layer type */
+    using layer_t = dyn_mp_1d_layer_impl<dyn_mp_1d_layer_desc<Parameters...>>;
+
+    /*! The dynamic layer type */
+    using dyn_layer_t = dyn_mp_1d_layer_impl<dyn_mp_1d_layer_desc<Parameters...>>;
+};
+
 /*!
  * \brief Description of a Dynamic Max Pooling two-dimensional layer.
  */
@@ -45,6 +62,12 @@ struct dyn_mp_3d_layer_desc : dyn_pooling_3d_layer_desc<Parameters...> {
     using dyn_layer_t = dyn_mp_3d_layer_impl<dyn_mp_3d_layer_desc<Parameters...>>;
 };
 
+/*!
+ * \brief Description of a Dynamic Max Pooling one-dimensional layer.
+ */
+template <typename... Parameters>
+using dyn_mp_1d_layer = typename dyn_mp_1d_layer_desc<Parameters...>::layer_t;
+
 /*!
  * \brief Description of a Dynamic Max Pooling two-dimensional layer.
  */
@@ -9,8 +9,182 @@
 
 #include "pooling_layer.hpp"
 
+#include "dll/util/max_pool.hpp"
+
 namespace dll {
 
+/*!
+ * \brief Standard dyn max pooling layer (1D pooling of the steps of
+ * sequences)
+ */
+template <typename Desc>
+struct dyn_mp_1d_layer_impl final : dyn_pooling_1d_layer<dyn_mp_1d_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                                  ///< The layer descriptor
+    using weight      = typename desc::weight;                 ///< The layer weight type
+    using this_type   = dyn_mp_1d_layer_impl<Desc>;            ///< This layer's type
+    using base        = dyn_pooling_1d_layer<this_type, desc>; ///< The layer base type
+    using layer_t     = this_type;                             ///< The type of this layer
+    using dyn_layer_t = typename desc::dyn_layer_t;            ///< The dynamic type of this layer
+
+    using input_one_t  = typename base::input_one_t;  ///< The type of one input
+    using output_one_t = typename base::output_one_t; ///< The type of one output
+    using input_t      = typename base::input_t;      ///< The type of many input
+    using output_t     = typename base::output_t;     ///< The type of many output
+
+    mutable pooling_argmax argmax; ///< The position of the maximums of the last training batch
+
+    dyn_mp_1d_layer_impl() = default;
+
+    /*!
+     * \brief Get a string representation of the layer
+     */
+    std::string to_short_string(std::string pre = "") const {
+        cpp_unused(pre);
+
+        return "MP(1D)";
+    }
+
+    /*!
+     * \brief Get a string representation of the layer
+     */
+    std::string to_full_string(std::string pre = "") const {
+        cpp_unused(pre);
+
+        char buffer[1024];
+        snprintf(buffer, 1024, "MP(1d): %lux%lu -> (%lu) -> %lux%lu",
+                 base::i1, base::i2, base::c1, base::o1, base::o2);
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {base::o1, base::o2};
+    }
+
+    /*!
+     * \brief Forward activation of the layer for one batch of sample
+     * \param output The output matrix
+     * \param input The input matrix
+     */
+    template <typename Input, typename Output>
+    void forward_batch(Output& output, const Input& input) const {
+        max_pool_1d_forward(output, input, base::c1);
+    }
+
+    using base::train_forward_batch;
+
+    /*!
+     * \brief Forward activation of the layer for one batch of sample, for
+     * training, recording the position of the maximums for the backward
+     * pass
+     * \param output The output matrix
+     * \param input The input matrix
+     */
+    template <typename Input, typename Output>
+    void train_forward_batch(Output& output, const Input& input) const {
+        if (base::c1 <= max_argmax_window) {
+            max_pool_1d_argmax_forward(output, input, base::c1, argmax);
+        } else {
+            argmax.offsets.clear();
+
+            forward_batch(output, input);
+        }
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DRBM>
+    static void dyn_init(DRBM&){
+        //Nothing to change
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        cpp_unused(context);
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        size_t c1 = base::c1;
+
+        if (argmax.matches(context.errors)) {
+            max_pool_1d_argmax_backward(output, context.errors, c1, argmax);
+        } else {
+            output = etl::ml::max_pool_backward(context.input, context.output, context.errors, c1, 1);
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        cpp_unused(context);
+    }
+};
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<dyn_mp_1d_layer_impl<Desc>> {
+    static constexpr bool is_neural     = false; ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = true;  ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = true;  ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of sgd_context for dyn_mp_1d_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, dyn_mp_1d_layer_impl<Desc>, L> {
+    using layer_t = dyn_mp_1d_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::dyn_matrix<weight, 3> input;
+    etl::dyn_matrix<weight, 3> output;
+    etl::dyn_matrix<weight, 3> errors;
+
+    sgd_context(const layer_t& layer)
+            : input(batch_size, layer.i1, layer.i2),
+              output(batch_size, layer.o1, layer.o2),
+              errors(batch_size, layer.o1, layer.o2) {}
+};
+
 /*!
  * \brief Standard dyn max pooling layer
  */
@@ -28,6 +202,8 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    mutable pooling_argmax argmax; ///< The position of the maximums of the last training batch
+
     dyn_mp_2d_layer_impl() = default;
 
     /*!
@@ -68,9 +244,36 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
+        if constexpr (etl::is_dma<Input> && etl::is_dma<Output>) {
+            if (base::window != small_pool_window::NONE) {
+                small_max_pool_forward(output, input, base::window);
+                return;
+            }
+        }
+
         output = etl::ml::max_pool_forward(input, base::c1, base::c2);
     }
 
+    using base::train_forward_batch;
+
+    /*!
+     * \brief Forward activation of the layer for one batch of sample, for
+     * training, recording the position of the maximums for the backward
+     * pass
+     * \param output The output matrix
+     * \param input The input matrix
+     */
+    template <typename Input, typename Output>
+    void train_forward_batch(Output& output, const Input& input) const {
+        if (base::c1 * base::c2 <= max_argmax_window) {
+            max_pool_argmax_forward(output, input, 1, base::c1, base::c2, argmax);
+        } else {
+            argmax.offsets.clear();
+
+            forward_batch(output, input);
+        }
+    }
+
     /*!
      * \brief Initialize the dynamic version of the layer from the
      * fast version of the layer
@@ -104,6 +307,18 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
         size_t c1 = base::c1;
         size_t c2 = base::c2;
 
+        if (argmax.matches(context.errors)) {
+            max_pool_argmax_backward(output, context.errors, 1, c1, c2, argmax);
+            return;
+        }
+
+        if constexpr (etl::is_dma<std::decay_t<H>>) {
+            if (base::window != small_pool_window::NONE) {
+                small_max_pool_backward(output, context.input, context.output, context.errors, base::window);
+                return;
+            }
+        }
+
         output = etl::ml::max_pool_backward(context.input, context.output, context.errors, c1, c2);
     }
 
@@ -174,6 +389,8 @@ struct dyn_mp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_mp_3d_layer_impl<De
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    mutable pooling_argmax argmax; ///< The position of the maximums of the last training batch
+
     dyn_mp_3d_layer_impl() = default;
 
     /*!
@@ -235,6 +452,26 @@ struct dyn_mp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_mp_3d_layer_impl<De
         output = etl::ml::max_pool_3d_forward(input, base::c1, base::c2, base::c3);
     }
 
+    using base::train_forward_batch;
+
+    /*!
+     * \brief Forward activation of the layer for one batch of sample, for
+     * training, recording the position of the maximums for the backward
+     * pass
+     * \param output The output matrix
+     * \param input The input matrix
+     */
+    template <typename Input, typename Output>
+    void train_forward_batch(Output& output, const Input& input) const {
+        if (base::c1 * base::c2 * base::c3 <= max_argmax_window) {
+            max_pool_argmax_forward(output, input, base::c1, base::c2, base::c3, argmax);
+        } else {
+            argmax.offsets.clear();
+
+            forward_batch(output, input);
+        }
+    }
+
     /*!
      * \brief Initialize the dynamic version of the layer from the
      * fast version of the layer
@@ -269,7 +506,11 @@ struct dyn_mp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_mp_3d_layer_impl<De
         size_t c2 = base::c2;
         size_t c3 = base::c3;
 
-        output = etl::ml::max_pool_3d_backward(context.input, context.output, context.errors, c1, c2, c3);
+        if (argmax.matches(context.errors)) {
+            max_pool_argmax_backward(output, context.errors, c1, c2, c3, argmax);
+        } else {
+            output = etl::ml::max_pool_3d_backward(context.input, context.output, context.errors, c1, c2, c3);
+        }
     }
 
     /*!
@@ -11,6 +11,24 @@
 
 namespace dll {
 
+/*!
+ * \brief Description of an Max Pooling one-dimensional layer, pooling the
+ * steps of sequences (I1 x I2).
+ */
+template <size_t T_I1, size_t T_I2, size_t T_C1, typename... Parameters>
+struct mp_1d_layer_desc : pooling_1d_layer_desc<T_I1, T_I2, T_C1, Parameters...> {
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    /*! The layer type */
+    using layer_t = mp_1d_layer_impl<mp_1d_layer_desc<T_I1, T_I2, T_C1, Parameters...>>;
+
+    /*! The dynamic layer type */
+    using dyn_layer_t = dyn_mp_1d_layer_impl<dyn_mp_1d_layer_desc<Parameters...>>;
+};
+
 /*!
  * \brief Description of an Max Pooling two-dimensional layer.
  */
@@ -45,6 +63,12 @@ struct mp_3d_layer_desc : pooling_3d_layer_desc<T_I1, T_I2, T_I3, T_C1, T_C2, T_
     using dyn_layer_t = dyn_mp_3d_layer_impl<dyn_mp_3d_layer_desc<Parameters...>>;
 };
 
+/*!
+ * \brief Description of an Max Pooling one-dimensional layer.
+ */
+template <size_t T_I1, size_t T_I2, size_t T_C1, typename... Parameters>
+using mp_1d_layer = typename mp_1d_layer_desc<T_I1, T_I2, T_C1, Parameters...>::layer_t;
+
 /*!
  * \brief Description of an Max Pooling two-dimensional layer.
  */
@@ -9,10 +9,189 @@
 
 #include "pooling_layer.hpp"
 
+#include "dll/util/max_pool.hpp"
 #include "dll/util/timers.hpp" // for auto_timer
 
 namespace dll {
 
+/*!
+ * \brief Standard max pooling layer (1D pooling of the steps of sequences)
+ */
+template <typename Desc>
+struct mp_1d_layer_impl final : pooling_1d_layer<mp_1d_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                                           ///< The layer descriptor
+    using weight      = typename desc::weight;                          ///< The layer weight type
+    using base        = pooling_1d_layer<mp_1d_layer_impl<Desc>, desc>; ///< The layer base type
+    using this_type   = mp_1d_layer_impl<Desc>;                         ///< The type of this layer
+    using layer_t     = this_type;                                      ///< The type of this layer
+    using dyn_layer_t = typename desc::dyn_layer_t;                     ///< The type of this layer
+
+    using input_one_t  = typename base::input_one_t;  ///< The type of one input
+    using output_one_t = typename base::output_one_t; ///< The type of one output
+    using input_t      = typename base::input_t;      ///< The type of many input
+    using output_t     = typename base::output_t;     ///< The type of many output
+
+    mutable pooling_argmax argmax; ///< The position of the maximums of the last training batch
+
+    mp_1d_layer_impl() = default;
+
+    /*!
+     * \brief Get a string representation of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        return "MP(1D)";
+    }
+
+    /*!
+     * \brief Get a string representation of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[1024];
+        snprintf(buffer, 1024, "MP(1D): %lux%lu -> (%lu) -> %lux%lu",
+                 base::I1, base::I2, base::C1, base::O1, base::O2);
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {base::O1, base::O2};
+    }
+
+    /*!
+     * \brief Forward activation of the layer for one batch of sample
+     * \param output The output matrix
+     * \param input The input matrix
+     */
+    template <typename Input, typename Output>
+    static void forward_batch(Output& output, const Input& input) {
+        dll::auto_timer timer("mp:forward_batch");
+
+        max_pool_1d_forward(output, input, base::C1);
+    }
+
+    using base::train_forward_batch;
+
+    /*!
+     * \brief Forward activation of the layer for one batch of sample, for
+     * training, recording the position of the maximums for the backward
+     * pass
+     * \param output The output matrix
+     * \param input The input matrix
+     */
+    template <typename Input, typename Output>
+    void train_forward_batch(Output& output, const Input& input) const {
+        dll::auto_timer timer("mp:train:forward");
+
+        if constexpr (base::C1 <= max_argmax_window) {
+            max_pool_1d_argmax_forward(output, input, base::C1, argmax);
+        } else {
+            forward_batch(output, input);
+        }
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DLayer>
+    static void dyn_init(DLayer& dyn){
+        dyn.init_layer(base::I1, base::I2, base::C1);
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        cpp_unused(context);
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("mp:backward_batch");
+
+        static constexpr size_t C1 = base::C1; ///< The pooling first dimension
+
+        if (argmax.matches(context.errors)) {
+            max_pool_1d_argmax_backward(output, context.errors, C1, argmax);
+        } else {
+            output = etl::ml::max_pool_backward<C1, 1>(context.input, context.output, context.errors);
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        cpp_unused(context);
+    }
+};
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<mp_1d_layer_impl<Desc>> {
+    static constexpr bool is_neural     = false; ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = true;  ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of sgd_context for mp_1d_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, mp_1d_layer_impl<Desc>, L> {
+    using layer_t = mp_1d_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr size_t I1 = layer_t::I1; ///< The input first dimension
+    static constexpr size_t I2 = layer_t::I2; ///< The input second dimension
+
+    static constexpr size_t O1 = layer_t::O1; ///< The output first dimension
+    static constexpr size_t O2 = layer_t::O2; ///< The output second dimension
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, I1, I2> input;
+    etl::fast_matrix<weight, batch_size, O1, O2> output;
+    etl::fast_matrix<weight, batch_size, O1, O2> errors;
+
+    sgd_context(const mp_1d_layer_impl<Desc>& /*layer*/){}
+};
+
 /*!
  * \brief Standard max pooling layer (2D pooling)
  */
@@ -30,6 +209,8 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    mutable pooling_argmax argmax; ///< The position of the maximums of the last training batch
+
     mp_2d_layer_impl() = default;
 
     /*!
@@ -72,7 +253,31 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
     static void forward_batch(Output& output, const Input& input) {
         dll::auto_timer timer("mp:forward_batch");
 
-        output = etl::ml::max_pool_forward<base::C1, base::C2>(input);
+        if constexpr (base::window != small_pool_window::NONE && etl::is_dma<Input> && etl::is_dma<Output>) {
+            small_max_pool_forward(output, input, base::window);
+        } else {
+            output = etl::ml::max_pool_forward<base::C1, base::C2>(input);
+        }
+    }
+
+    using base::train_forward_batch;
+
+    /*!
+     * \brief Forward activation of the layer for one batch of sample, for
+     * training, recording the position of the maximums for the backward
+     * pass
+     * \param output The output matrix
+     * \param input The input matrix
+     */
+    template <typename Input, typename Output>
+    void train_forward_batch(Output& output, const Input& input) const {
+        dll::auto_timer timer("mp:train:forward");
+
+        if constexpr (base::C1 * base::C2 <= max_argmax_window) {
+            max_pool_argmax_forward(output, input, 1, base::C1, base::C2, argmax);
+        } else {
+            forward_batch(output, input);
+        }
     }
 
     /*!
@@ -110,7 +315,13 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
         static constexpr size_t C1 = base::C1; ///< The pooling first dimension
         static constexpr size_t C2 = base::C2; ///< The pooling second dimension
 
-        output = etl::ml::max_pool_backward<C1, C2>(context.input, context.output, context.errors);
+        if (argmax.matches(context.errors)) {
+            max_pool_argmax_backward(output, context.errors, 1, C1, C2, argmax);
+        } else if constexpr (base::window != small_pool_window::NONE && etl::is_dma<std::decay_t<H>>) {
+            small_max_pool_backward(output, context.input, context.output, context.errors, base::window);
+        } else {
+            output = etl::ml::max_pool_backward<C1, C2>(context.input, context.output, context.errors);
+        }
     }
 
     /*!
@@ -185,6 +396,8 @@ struct mp_3d_layer_impl final : pooling_3d_layer<mp_3d_layer_impl<Desc>, Desc> {
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    mutable pooling_argmax argmax; ///< The position of the maximums of the last training batch
+
     mp_3d_layer_impl() = default;
 
     /*!
@@ -230,6 +443,26 @@ struct mp_3d_layer_impl final : pooling_3d_layer<mp_3d_layer_impl<Desc>, Desc> {
         output = etl::ml::max_pool_3d_forward<base::C1, base::C2, base::C3>(input);
     }
 
+    using base::train_forward_batch;
+
+    /*!
+     * \brief Forward activation of the layer for one batch of sample, for
+     * training, recording the position of the maximums for the backward
+     * pass
+     * \param output The output matrix
+     * \param input The input matrix
+     */
+    template <typename Input, typename Output>
+    void train_forward_batch(Output& output, const Input& input) const {
+        dll::auto_timer timer("mp:train:forward");
+
+        if constexpr (base::C1 * base::C2 * base::C3 <= max_argmax_window) {
+            max_pool_argmax_forward(output, input, base::C1, base::C2, base::C3, argmax);
+        } else {
+            forward_batch(output, input);
+        }
+    }
+
     /*!
      * \brief Initialize the dynamic version of the layer from the
      * fast version of the layer
@@ -266,7 +499,11 @@ struct mp_3d_layer_impl final : pooling_3d_layer<mp_3d_layer_impl<Desc>, Desc> {
         static constexpr size_t C2 = base::C2; ///< The pooling second dimension
         static constexpr size_t C3 = base::C3; ///< The pooling third dimension
 
-        output = etl::ml::max_pool_3d_backward<C1, C2, C3>(context.input, context.output, context.errors);
+        if (argmax.matches(context.errors)) {
+            max_pool_argmax_backward(output, context.errors, C1, C2, C3, argmax);
+        } else {
+            output = etl::ml::max_pool_3d_backward<C1, C2, C3>(context.input, context.output, context.errors);
+        }
     }
 
     /*!
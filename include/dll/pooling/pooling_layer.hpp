@@ -10,9 +10,169 @@
 #include "etl/etl.hpp"
 
 #include "dll/layer.hpp"
+#include "dll/util/small_pool.hpp"
 
 namespace dll {
 
+/*!
+ * \brief Standard 1D pooling layer, pooling the steps of sequences, with
+ * the channels last
+ */
+template <typename Parent, typename Desc>
+struct pooling_1d_layer : layer<Parent> {
+    using desc   = Desc; ///< The descriptor of the layer
+    using weight = typename desc::weight; ///< The data type for this layer
+
+    static constexpr size_t I1 = desc::I1; ///< The first dimension of the input (steps)
+    static constexpr size_t I2 = desc::I2; ///< The second dimension of the input (channels)
+    static constexpr size_t C1 = desc::C1; ///< The first dimension pooling ratio
+
+    static constexpr size_t O1 = I1 / C1; ///< The first dimension of the output
+    static constexpr size_t O2 = I2;      ///< The second dimension of the output
+
+    static constexpr bool is_nop = C1 == 1; ///< Indicate if the operation has no effect
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, I1, I2>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, O1, O2>; ///< The type of one output
+    using input_t      = std::vector<input_one_t>; ///< The type of the input
+    using output_t     = std::vector<output_one_t>; ///< The type of the output
+
+    pooling_1d_layer() = default;
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return I1 * I2;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return O1 * O2;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    static constexpr size_t parameters() noexcept {
+        return 0;
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     *
+     * \tparam Input The type of one Input
+     */
+    template <typename Input>
+    static output_one_t prepare_one_output() {
+        return output_one_t();
+    }
+};
+
+/*!
+ * \brief Standard dynamic 1D pooling layer
+ */
+template <typename Parent, typename Desc>
+struct dyn_pooling_1d_layer : layer<Parent> {
+    using desc   = Desc; ///< The descriptor of the layer
+    using weight = typename desc::weight; ///< The data type for this layer
+
+    static constexpr bool is_nop = false; ///< Indicate if the operation has no effect
+
+    using input_one_t  = etl::dyn_matrix<weight, 2>; ///< The type of one input
+    using output_one_t = etl::dyn_matrix<weight, 2>; ///< The type of one output
+    using input_t      = std::vector<input_one_t>; ///< The type of the input
+    using output_t     = std::vector<output_one_t>; ///< The type of the output
+
+    size_t i1; ///< The first dimension of the input (steps)
+    size_t i2; ///< The second dimension of the input (channels)
+    size_t c1; ///< The first dimension pooling ratio
+
+    size_t o1; ///< The first dimension of the output
+    size_t o2; ///< The second dimension of the output
+
+    dyn_pooling_1d_layer() = default;
+
+    /*!
+     * \brief Initialize the dynamic layer
+     */
+    void init_layer(size_t i1, size_t i2, size_t c1){
+        this->i1 = i1;
+        this->i2 = i2;
+        this->c1 = c1;
+        this->o1 = i1 / c1;
+        this->o2 = i2;
+    }
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    size_t input_size() const noexcept {
+        return i1 * i2;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    size_t output_size() const noexcept {
+        return o1 * o2;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    size_t parameters() const noexcept {
+        return 0;
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    output_t prepare_output(size_t samples) const {
+        output_t output;
+        output.reserve(samples);
+        for(size_t i = 0; i < samples; ++i){
+            output.emplace_back(o1, o2);
+        }
+        return output;
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     *
+     * \tparam Input The type of one Input
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return output_one_t(o1, o2);
+    }
+};
+
 /*!
  * \brief Standard pooling layer
  */
@@ -33,6 +193,8 @@ struct pooling_2d_layer : layer<Parent> {
 
     static constexpr bool is_nop = C1 * C2 == 1; ///< Indicate if the operation has no effect
 
+    static constexpr small_pool_window window = select_small_pool(C1, C2); ///< The specialized kernel of the window
+
     using input_one_t  = etl::fast_dyn_matrix<weight, I1, I2, I3>; ///< The type of one input
     using output_one_t = etl::fast_dyn_matrix<weight, O1, O2, O3>; ///< The type of one output
     using input_t      = std::vector<input_one_t>; ///< The type of the input
@@ -121,6 +283,8 @@ struct dyn_pooling_2d_layer : layer<Parent> {
     size_t o2; ///< The second dimension of the output
     size_t o3; ///< The third dimension of the output
 
+    small_pool_window window = small_pool_window::NONE; ///< The specialized kernel of the window
+
     dyn_pooling_2d_layer() = default;
 
     /*!
@@ -135,6 +299,17 @@ struct dyn_pooling_2d_layer : layer<Parent> {
         this->o1 = i1;
         this->o2 = i2 / c1;
         this->o3 = i3 / c2;
+
+        window = select_small_pool(c1, c2);
+    }
+
+    /*!
+     * \brief Keep only the given channels, after they have been removed
+     * from the preceding layer
+     * \param kept The indices of the channels to keep, in order
+     */
+    void shrink_units(const std::vector<size_t>& kept) {
+        init_layer(kept.size(), i2, i3, c1, c2);
     }
 
     /*!
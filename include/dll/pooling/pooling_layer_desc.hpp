@@ -9,6 +9,42 @@
 
 namespace dll {
 
+/*!
+ * \brief Descriptor for a 1D pooling layer desc, pooling the steps of
+ * sequences (I1 x I2), with the channels last
+ */
+template <size_t T_I1, size_t T_I2, size_t T_C1, typename... Parameters>
+struct pooling_1d_layer_desc {
+    static constexpr size_t I1 = T_I1; ///< The input first dimension (steps)
+    static constexpr size_t I2 = T_I2; ///< The input second dimension (channels)
+    static constexpr size_t C1 = T_C1; ///< The pooling first dimension
+
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    static_assert(C1 > 0, "Cannot shrink a layer by less than 1");
+    static_assert(I1 % C1 == 0, "Input dimension is not divisible by C");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id>, Parameters...>,
+        "Invalid parameters type for pooling_layer");
+};
+
+/*!
+ * \brief Descriptor for a Dynamic 1D pooling layer desc
+ */
+template <typename... Parameters>
+struct dyn_pooling_1d_layer_desc {
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id>, Parameters...>,
+        "Invalid parameters type for pooling_layer");
+};
+
 /*!
  * \brief Descriptor for a 2D pooling layer desc
  */
@@ -12,17 +12,29 @@
  * \brief This file is made to be included by the dllp generated file only.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <vector>
 #include <iostream>
 #include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <type_traits>
 
 #include "dll/rbm/rbm.hpp"
 #include "dll/rbm/conv_rbm.hpp"
 #include "dll/neural/dense_layer.hpp"
 #include "dll/neural/conv_layer.hpp"
 #include "dll/dbn.hpp"
+#include "dll/batch_tuner.hpp"
 #include "dll/text_reader.hpp"
+#include "dll/util/metrics_stream.hpp"
+#include "dll/util/tcp_transport.hpp"
+
+#ifdef DLL_MPI
+#include "dll/util/mpi_transport.hpp"
+#endif
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -37,6 +49,8 @@ struct options {
     bool cublas = false;
     bool cufft  = false;
     bool cache  = false;
+    bool pch    = false;
+    bool mpi    = false; ///< Compile with MPI (set by the distributed configurations)
 };
 
 template <typename LastLayer, typename Enable = void>
@@ -57,7 +71,7 @@ constexpr double stupid_default = -666.0;
 
 struct datasource {
     std::string source_file;
-    std::string reader;
+    std::string reader; ///< The reader (mnist, text or mmap for a memory-mapped dataset with its labels)
 
     bool binarize         = false;
     bool normalize        = false;
@@ -87,6 +101,14 @@ struct datasource_pack {
 struct general_desc {
     bool batch_mode       = false;
     size_t big_batch = 1;
+
+    std::string generator = "none"; ///< The generator of the training samples (none, inmemory or outmemory)
+    bool threaded         = false;  ///< Produce the batches in background threads (outmemory)
+    size_t workers        = 1;      ///< The number of producer threads
+    bool lock_free        = false;  ///< Use a lock-free ring between the producers and the trainer
+    bool prefetch         = false;  ///< Read the next big batch in the background (outmemory)
+    bool index_shuffle    = false;  ///< Only shuffle the order of the samples (inmemory)
+    std::string storage   = "none"; ///< The compact storage type of the samples (none, uint8 or bfloat16, inmemory)
 };
 
 struct pretraining_desc {
@@ -113,6 +135,42 @@ struct weights_desc {
     std::string file = "weights.dat";
 };
 
+struct profile_desc {
+    size_t batches = 10; ///< The number of measured batches
+    size_t warmup  = 2;  ///< The number of warmup batches, not measured
+    std::string file;    ///< The JSON report (next to the configuration)
+};
+
+struct tune_desc {
+    std::vector<size_t> batches{16, 32, 64, 128, 256}; ///< The candidate batch sizes
+    size_t budget    = 0;                               ///< The memory budget, in MiB (0 for no limit)
+    size_t warmup    = 2;                               ///< The number of warmup steps of each candidate
+    size_t steps     = 5;                               ///< The number of measured steps of each candidate
+    size_t effective = 0;                               ///< The effective batch size to reach with gradient accumulation (0 for none)
+    std::string file;                                   ///< The JSON report (next to the configuration)
+};
+
+struct distributed_desc {
+    size_t workers        = 1;           ///< The number of shards of each batch, trained in parallel in each process
+    size_t ranks          = 1;           ///< The number of processes
+    size_t rank           = 0;           ///< The rank of this process (set by the launcher)
+    std::string transport = "tcp";       ///< The transport between the processes (tcp or mpi)
+    std::string host      = "127.0.0.1"; ///< The host of the root rank (tcp)
+    size_t port           = 5555;        ///< The port of the root rank (tcp)
+    size_t bucket         = 0;           ///< The number of gradients summed at once (0 for one allreduce per variable)
+    bool shard            = true;        ///< Each rank only trains on its share of the training samples
+
+    bool enabled() const {
+        return ranks > 1 || transport == "mpi";
+    }
+};
+
+struct placement_desc {
+    bool pin         = false; ///< Pin the compute threads to the cores
+    size_t producers = 0;     ///< The number of physical cores dedicated to the producers of the generator
+    bool smt         = true;  ///< Use all the hardware threads of each core
+};
+
 struct task {
     std::vector<std::string> default_actions;
 
@@ -124,6 +182,10 @@ struct task {
     dll::processor::pretraining_desc pt_desc;
     dll::processor::training_desc ft_desc;
     dll::processor::weights_desc w_desc;
+    dll::processor::profile_desc p_desc;
+    dll::processor::tune_desc t_desc;
+    dll::processor::distributed_desc d_desc;
+    dll::processor::placement_desc pl_desc;
     dll::processor::general_desc general_desc;
 };
 
@@ -208,6 +270,109 @@ bool read_labels(const datasource& ds, std::vector<Label>& labels) {
     return !labels.empty();
 }
 
+/*!
+ * \brief Keep only the share of the given rank of the samples (or of the
+ * labels), interleaved between the ranks.
+ *
+ * All the ranks keep the same number of samples, so that they train on the
+ * same number of batches.
+ */
+template <typename T>
+void shard(std::vector<T>& values, const distributed_desc& desc) {
+    if (!desc.shard || desc.ranks <= 1) {
+        return;
+    }
+
+    const size_t n = values.size() / desc.ranks;
+
+    for (size_t i = 0; i < n; ++i) {
+        if (i * desc.ranks + desc.rank != i) {
+            values[i] = std::move(values[i * desc.ranks + desc.rank]);
+        }
+    }
+
+    values.erase(values.begin() + n, values.end());
+}
+
+/*!
+ * \brief Connect the network to the other ranks of the task
+ * \return false if the ranks cannot be connected
+ */
+template <typename DBN>
+bool distribute(DBN& dbn, distributed_desc& desc) {
+    if (!desc.enabled()) {
+        return true;
+    }
+
+    if (desc.transport == "mpi") {
+#ifdef DLL_MPI
+        dbn.transport = std::make_shared<dll::mpi_transport>(MPI_COMM_WORLD);
+#else
+        std::cout << "dllp: error: the program has not been compiled with MPI" << std::endl;
+        return false;
+#endif
+    } else {
+        auto transport = std::make_shared<dll::tcp_transport>(desc.rank, desc.ranks, desc.host, uint16_t(desc.port));
+
+        if (!transport->connected()) {
+            std::cout << "dllp: error: failed to connect rank " << desc.rank << " to " << desc.host << ":" << desc.port << std::endl;
+            return false;
+        }
+
+        dbn.transport = transport;
+    }
+
+    desc.rank  = dbn.transport->rank();
+    desc.ranks = dbn.transport->size();
+
+    dbn.gradient_bucket = desc.bucket;
+
+    return true;
+}
+
+/*!
+ * \brief Place the threads of the network as configured by the task
+ */
+template <typename DBN>
+void place(DBN& dbn, const placement_desc& desc) {
+    if (!desc.pin && !desc.producers) {
+        return;
+    }
+
+    dbn.placement.pin            = desc.pin;
+    dbn.placement.producer_cores = desc.producers;
+    dbn.placement.avoid_smt      = !desc.smt;
+
+    auto& placed = dbn.apply_placement();
+
+    std::cout << "placement: " << placed.compute.size() << " compute CPUs, " << placed.producers.size() << " producer CPUs" << std::endl;
+}
+
+/*!
+ * \brief Returns the value of the given parameter on the command line of
+ * the generated program (name=value), or the given value if it is not set.
+ *
+ * This lets dllp sweep reuse the same program for several values of the
+ * parameters that are not part of the type of the network.
+ */
+template <typename T>
+T parameter(int argc, char* argv[], const std::string& name, T value) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+
+        if (arg.size() > name.size() && !arg.compare(0, name.size(), name) && arg[name.size()] == '=') {
+            if constexpr (std::is_same_v<T, std::string>) {
+                value = arg.substr(name.size() + 1);
+            } else {
+                std::istringstream stream(arg.substr(name.size() + 1));
+                stream >> value;
+            }
+        }
+    }
+
+    return value;
+}
+
 inline void print_title(const std::string& value) {
     std::cout << std::string(25, ' ') << std::endl;
     std::cout << std::string(25, '*') << std::endl;
@@ -216,13 +381,234 @@ inline void print_title(const std::string& value) {
     std::cout << std::string(25, ' ') << std::endl;
 }
 
+/*!
+ * \brief Make a generator around the memory-mapped dataset of the given
+ * datasource, with the batch size of the network
+ */
+template <bool Three, typename DBN>
+auto mmap_generator(const DBN& /*dbn*/, const datasource& ds) {
+    using dbn_t = std::decay_t<DBN>;
+
+    return dll::make_mmap_generator<typename dbn_t::weight, Three ? 3 : 1>(ds.source_file, dll::mmap_data_generator_desc<dll::batch_size<dbn_t::batch_size>>{});
+}
+
+/*!
+ * \brief Profile the training and the inference of the network: the timers,
+ * the hardware counters and the parallel regions of a few training batches,
+ * the duration and the throughput of each layer in inference and the memory
+ * of the network, written as JSON to the profile file of the task as well.
+ */
 template <typename Container, bool Three, typename DBN>
+void profile(DBN& dbn, task& task) {
+    using dbn_t      = std::decay_t<DBN>;
+    using last_layer = typename dbn_t::template layer_type<dbn_t::layers - 1>;
+
+    auto& desc         = task.p_desc;
+    const size_t batch = dbn_t::batch_size;
+
+    dll::enable_perf_counters();
+    dll::enable_pool_stats();
+
+    std::cout << "kernels: " << dll::kernels_isa() << std::endl;
+
+    std::ostringstream json;
+    json << "{\n  \"batch_size\": " << batch << ",\n  \"batches\": " << desc.batches << ",\n  \"kernels\": \"" << dll::kernels_isa() << "\",\n";
+
+    auto json_timers = [&json]() {
+        json << "[";
+
+        std::string comma;
+        for (auto& timer : dll::metrics_timers()) {
+            json << comma << "\n    {\"name\": \"" << timer.name << "\", \"count\": " << timer.count << ", \"duration_ns\": " << timer.duration << "}";
+            comma = ",";
+        }
+
+        json << "]";
+    };
+
+    //1. Training batches
+
+    std::vector<Container> samples;
+    std::vector<size_t> labels;
+
+    auto samples_ds = task.training.samples;
+    auto labels_ds  = task.training.labels;
+
+    const long limit = (desc.warmup + desc.batches) * batch;
+
+    samples_ds.limit = samples_ds.limit > 0 ? std::min(samples_ds.limit, limit) : limit;
+    labels_ds.limit  = samples_ds.limit;
+
+    if constexpr (sgd_possible<last_layer>::value) {
+        if (!samples_ds.empty() && !labels_ds.empty() && samples_ds.reader != "mmap" && read_samples<Three>(samples_ds, samples) && read_labels(labels_ds, labels)) {
+            const size_t warm = std::min(samples.size(), desc.warmup * batch);
+
+            if (warm) {
+                dbn.fine_tune(samples.begin(), samples.begin() + warm, labels.begin(), labels.begin() + warm, 1);
+            }
+
+            dll::reset_timers();
+            dll::reset_pool_stats();
+
+            auto start = std::chrono::steady_clock::now();
+            dbn.fine_tune(samples.begin() + warm, samples.end(), labels.begin() + warm, labels.end(), 1);
+            auto end = std::chrono::steady_clock::now();
+
+            const double seconds = std::chrono::duration<double>(end - start).count();
+            const size_t n       = samples.size() - warm;
+
+            print_title("Training profile");
+
+            std::cout << n << " samples in " << seconds << "s (" << (seconds > 0.0 ? n / seconds : 0.0) << " samples/s)" << std::endl;
+
+            dll::dump_timers_pretty();
+            dll::dump_pool_stats();
+
+            json << "  \"training\": {\"samples\": " << n << ", \"seconds\": " << seconds << ", \"timers\": ";
+            json_timers();
+            json << "},\n";
+        } else {
+            std::cout << "dllp: warning: no training samples, only the inference is profiled" << std::endl;
+        }
+    }
+
+    //2. Inference
+
+    print_title("Inference profile");
+
+    dll::reset_timers();
+
+    auto costs     = dbn.layer_costs(batch);
+    auto durations = dbn.profile_forward(batch, desc.batches);
+
+    dbn.display_roofline(batch, desc.batches);
+
+    json << "  \"inference\": [";
+
+    size_t i = 0;
+
+    dbn.for_each_layer([&](auto& layer) {
+        auto& cost = costs[i];
+
+        json << (i ? "," : "") << "\n    {\"index\": " << i << ", \"layer\": \"" << layer.to_short_string("") << "\""
+             << ", \"forward_flops\": " << cost.forward_flops << ", \"forward_bytes\": " << cost.forward_bytes
+             << ", \"duration_ns\": " << durations[i]
+             << ", \"gflops\": " << (durations[i] > 0.0 ? cost.forward_flops / durations[i] : 0.0) << "}";
+
+        ++i;
+    });
+
+    json << "],\n";
+
+    //3. Memory
+
+    dbn.display_memory();
+
+    auto memory = dbn.memory();
+
+    json << "  \"memory\": {\"total\": " << memory.total() << ", \"entries\": [";
+
+    std::string comma;
+    for (auto& entry : memory.entries) {
+        json << comma << "\n    {\"name\": \"" << entry.name << "\", \"bytes\": " << entry.bytes << "}";
+        comma = ",";
+    }
+
+    json << "]}\n}\n";
+
+    if (!desc.file.empty()) {
+        std::ofstream os(desc.file);
+
+        if (!os) {
+            std::cout << "dllp: error: Impossible to open " << desc.file << std::endl;
+            return;
+        }
+
+        os << json.str();
+
+        std::cout << "Profile written to " << desc.file << std::endl;
+    }
+}
+
+/*!
+ * \brief Tune the batch size of the network for its training throughput
+ * within the memory budget of the task, among the candidates Net<B>, and
+ * print the recommended configuration, written as JSON to the tune file of
+ * the task as well.
+ *
+ * \tparam Net The alias template of the network over its batch size
+ * \tparam B The candidate batch sizes
+ */
+template <template <size_t> typename Net, size_t... B>
+void tune(task& task) {
+    print_title("Tune");
+
+    auto& desc = task.t_desc;
+
+    dll::batch_tuning_desc tuning_desc;
+    tuning_desc.budget    = desc.budget << 20;
+    tuning_desc.warmup    = desc.warmup;
+    tuning_desc.steps     = desc.steps;
+    tuning_desc.effective = desc.effective;
+
+    auto tuning = dll::tune_batch_size<Net, B...>(tuning_desc, [&task](auto& dbn) {
+        place(dbn, task.pl_desc);
+    });
+
+    tuning.display(std::cout);
+
+    if (tuning.batch) {
+        std::cout << "\ntraining:\n  batch: " << tuning.batch << "\ngeneral:\n  big_batch: " << tuning.big_batch << std::endl;
+    }
+
+    std::ostringstream json;
+    json << "{\n  \"budget\": " << tuning_desc.budget << ",\n  \"candidates\": [";
+
+    std::string comma;
+    for (auto& c : tuning.candidates) {
+        json << comma << "\n    {\"batch\": " << c.batch << ", \"bytes\": " << c.bytes << ", \"fits\": " << (c.fits ? "true" : "false")
+             << ", \"samples_per_second\": " << c.samples_per_second << "}";
+        comma = ",";
+    }
+
+    json << "],\n  \"batch\": " << tuning.batch << ",\n  \"big_batch\": " << tuning.big_batch << ",\n  \"accumulation\": " << tuning.accumulation << "\n}\n";
+
+    if (!desc.file.empty()) {
+        std::ofstream os(desc.file);
+
+        if (!os) {
+            std::cout << "dllp: error: Impossible to open " << desc.file << std::endl;
+            return;
+        }
+
+        os << json.str();
+
+        std::cout << "Tuning written to " << desc.file << std::endl;
+    }
+}
+
+/*!
+ * \brief Execute the actions of the task on the network
+ *
+ * \tparam Generator The descriptor of the generator of the training
+ * samples, void to let the network create its default generator
+ */
+template <typename Container, bool Three, typename Generator = void, typename DBN>
 void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
     print_title("Network");
     dbn.display();
 
     using dbn_t = std::decay_t<DBN>;
 
+    if (!distribute(dbn, task.d_desc)) {
+        return;
+    }
+
+    place(dbn, task.pl_desc);
+
+    // Only the root rank writes the weights
+    const bool root = task.d_desc.rank == 0;
+
     //Execute all the actions sequentially
     for (auto& action : actions) {
         if (action == "pretrain") {
@@ -233,6 +619,11 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
                 return;
             }
 
+            if (task.pretraining.samples.reader == "mmap") {
+                std::cout << "dllp: error: pretrain is not possible from a memory-mapped dataset" << std::endl;
+                return;
+            }
+
             std::vector<Container> pt_samples;
 
             //Try to read the samples
@@ -263,6 +654,28 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
         } else if (action == "train") {
             print_title("Training");
 
+            using last_layer = typename dbn_t::template layer_type<dbn_t::layers - 1>;
+
+            if(!sgd_possible<last_layer>::value){
+                std::cout << "dllp: error: The network is not trainable by SGD" << std::endl;
+                return;
+            }
+
+            // The labels of a memory-mapped dataset are in the same file
+            if (task.training.samples.reader == "mmap") {
+                if (task.d_desc.enabled() && task.d_desc.shard) {
+                    std::cout << "dllp: warning: the memory-mapped datasets are not sharded between the ranks" << std::endl;
+                }
+
+                if constexpr (sgd_possible<last_layer>::value) {
+                    auto generator = mmap_generator<Three>(dbn, task.training.samples);
+                    auto ft_error  = dbn.fine_tune(*generator, task.ft_desc.epochs);
+                    std::cout << "Train Classification Error:" << ft_error << std::endl;
+                }
+
+                continue;
+            }
+
             if (task.training.samples.empty() || task.training.labels.empty()) {
                 std::cout << "dllp: error: train is not possible without samples and labels" << std::endl;
                 return;
@@ -283,21 +696,36 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
                 return;
             }
 
-            using last_layer = typename dbn_t::template layer_type<dbn_t::layers - 1>;
-
-            if(!sgd_possible<last_layer>::value){
-                std::cout << "dllp: error: The network is not trainable by SGD" << std::endl;
-                return;
-            }
+            shard(ft_samples, task.d_desc);
+            shard(ft_labels, task.d_desc);
 
             //Train the network
-            if constexpr(sgd_possible<last_layer>::value) {
+            if constexpr (sgd_possible<last_layer>::value && !std::is_void_v<Generator>) {
+                auto generator = dll::make_generator(ft_samples, ft_labels, ft_samples.size(), dbn.output_size(), Generator{});
+
+                generator->set_safe();
+
+                auto ft_error = dbn.fine_tune(*generator, task.ft_desc.epochs);
+                std::cout << "Train Classification Error:" << ft_error << std::endl;
+            } else if constexpr (sgd_possible<last_layer>::value) {
                 auto ft_error = dbn.fine_tune(ft_samples, ft_labels, task.ft_desc.epochs);
                 std::cout << "Train Classification Error:" << ft_error << std::endl;
             }
         } else if (action == "test") {
             print_title("Testing");
 
+            // Only the error is computed from a memory-mapped dataset
+            if (task.testing.samples.reader == "mmap") {
+                auto generator  = mmap_generator<Three>(dbn, task.testing.samples);
+                auto test_error = dbn.evaluate_error(*generator);
+
+                std::cout << "Error rate: " << test_error << std::endl;
+                std::cout << "Accuracy: " << (1.0 - test_error) << std::endl
+                          << std::endl;
+
+                continue;
+            }
+
             if (task.testing.samples.empty() || task.testing.labels.empty()) {
                 std::cout << "dllp: error: test is not possible without samples and labels" << std::endl;
                 return;
@@ -385,8 +813,32 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
         } else if (action == "save") {
             print_title("Save Weights");
 
+            if (!root) {
+                continue;
+            }
+
             dbn.store(task.w_desc.file);
             std::cout << "Weights saved" << std::endl;
+        } else if (action == "profile") {
+            print_title("Profile");
+
+            profile<Container, Three>(dbn, task);
+        } else if (action == "tune") {
+            // The candidates are other networks, tuned before the execution of the actions (see tune)
+            continue;
+        } else if (action == "export") {
+            print_title("Export Weights");
+
+            if (!root) {
+                continue;
+            }
+
+            if (!dbn.store_mapped(task.w_desc.file + ".mapped")) {
+                std::cout << "dllp: error: failed to export the weights" << std::endl;
+                return;
+            }
+
+            std::cout << "Weights exported to " << task.w_desc.file << ".mapped" << std::endl;
         } else if (action == "load") {
             print_title("Load Weights");
 
@@ -0,0 +1,236 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief 8-bit quantized inference version of a network
+ */
+
+#pragma once
+
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "layer_fwd.hpp"
+#include "layer_traits.hpp"
+#include "util/batch_norm.hpp"
+#include "util/quantize.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief The layers without weights, computed in floating point by the
+ * quantized network
+ */
+struct quantized_passthrough_layer {};
+
+/*!
+ * \brief Select the quantized version of a layer
+ */
+template <typename Layer, typename Enable = void>
+struct quantized_layer {
+    static_assert(decay_layer_traits<Layer>::is_pooling_layer()
+                      || decay_layer_traits<Layer>::is_transform_layer()
+                      || is_batch_normalization_layer_v<Layer>,
+                  "This layer is not supported by the quantized inference");
+
+    using type = quantized_passthrough_layer; ///< The quantized layer type
+};
+
+template <typename Desc>
+struct quantized_layer<dense_layer_impl<Desc>> {
+    using type = quantized_dense_layer<typename Desc::weight, Desc::activation_function>; ///< The quantized layer type
+};
+
+template <typename Desc>
+struct quantized_layer<dyn_dense_layer_impl<Desc>> {
+    using type = quantized_dense_layer<typename Desc::weight, Desc::activation_function>; ///< The quantized layer type
+};
+
+template <typename Desc>
+struct quantized_layer<conv_layer_impl<Desc>> {
+    using type = quantized_conv_layer<typename Desc::weight, Desc::activation_function, false>; ///< The quantized layer type
+};
+
+template <typename Desc>
+struct quantized_layer<dyn_conv_layer_impl<Desc>> {
+    using type = quantized_conv_layer<typename Desc::weight, Desc::activation_function, false>; ///< The quantized layer type
+};
+
+template <typename Desc>
+struct quantized_layer<conv_same_layer_impl<Desc>> {
+    using type = quantized_conv_layer<typename Desc::weight, Desc::activation_function, true>; ///< The quantized layer type
+};
+
+template <typename Desc>
+struct quantized_layer<dyn_conv_same_layer_impl<Desc>> {
+    using type = quantized_conv_layer<typename Desc::weight, Desc::activation_function, true>; ///< The quantized layer type
+};
+
+template <typename Layer>
+using quantized_layer_t = typename quantized_layer<Layer>::type;
+
+template <typename DBN, typename Sequence>
+struct quantized_layers;
+
+template <typename DBN, size_t... I>
+struct quantized_layers<DBN, std::index_sequence<I...>> {
+    using type = std::tuple<quantized_layer_t<typename DBN::template layer_type<I>>...>; ///< The tuple of quantized layers
+};
+
+} //end of namespace detail
+
+/*!
+ * \brief Inference-only version of a network, with the dense and
+ * convolutional layers computed with 8-bit weights and input.
+ *
+ * The weights are quantized with one scale per output channel and the
+ * input of each layer with one scale per layer, calibrated on a set of
+ * samples. The products are accumulated in 32 bits and requantized, with
+ * the biases and the activation function, in the same pass. The layers
+ * without weights (pooling, activation, ...) are computed in floating
+ * point by the original network, which must outlive this object.
+ */
+template <typename DBN>
+struct quantized_network {
+    using dbn_t  = DBN;                    ///< The network type
+    using weight = typename dbn_t::weight; ///< The floating point type
+
+    static constexpr size_t layers = dbn_t::layers; ///< The number of layers
+
+    using layers_t = typename detail::quantized_layers<dbn_t, std::make_index_sequence<layers>>::type; ///< The quantized layers
+
+    /*!
+     * \brief Create the quantized version of the given network.
+     *
+     * The network is not usable before being calibrated.
+     *
+     * \param dbn The network
+     */
+    explicit quantized_network(dbn_t& dbn) : dbn(dbn) {}
+
+    /*!
+     * \brief Calibrate the input scales on the samples of the generator and
+     * quantize the weights of the network
+     * \param generator The generator of the calibration samples
+     */
+    template <typename Generator>
+    void calibrate(Generator& generator) {
+        ranges.assign(layers, weight(0));
+
+        generator.reset();
+        generator.set_test();
+
+        while (generator.has_next_batch()) {
+            calibrate_impl<0>(generator.data_batch());
+
+            generator.next_batch();
+        }
+
+        init_impl(std::make_index_sequence<layers>());
+    }
+
+    /*!
+     * \brief Returns the maximum absolute value of the input of the given
+     * layer, seen during calibration
+     */
+    weight input_range(size_t layer) const {
+        return ranges[layer];
+    }
+
+    /*!
+     * \brief Compute the output of the network for the given batch of input
+     * \param input The batch of input
+     * \return The batch of output
+     */
+    template <typename Input>
+    auto forward_batch(const Input& input) const {
+        return forward_impl<0>(input);
+    }
+
+    /*!
+     * \brief Evaluate the quantized network on the given classification
+     * task and return the classification error.
+     * \param generator The data generator
+     */
+    template <typename Generator>
+    double evaluate_error(Generator& generator) const {
+        auto forward_helper = [this](auto&& input_batch) {
+            return this->forward_batch(input_batch);
+        };
+
+        return std::get<0>(dbn.evaluate_metrics(generator, forward_helper));
+    }
+
+private:
+    template <size_t L>
+    static constexpr bool is_quantized = !std::is_same<std::tuple_element_t<L, layers_t>, detail::quantized_passthrough_layer>::value;
+
+    /*!
+     * \brief Record the range of the input of the quantized layers and
+     * propagate the batch through the floating point network
+     */
+    template <size_t L, typename Input>
+    void calibrate_impl(const Input& input) {
+        if constexpr (is_quantized<L>) {
+            ranges[L] = std::max(ranges[L], weight(etl::max(etl::abs(input))));
+        }
+
+        if constexpr (L + 1 < layers) {
+            calibrate_impl<L + 1>(dbn.template layer_get<L>().test_forward_batch(input));
+        }
+    }
+
+    /*!
+     * \brief Quantize the weights of the layers
+     */
+    template <size_t... I>
+    void init_impl(std::index_sequence<I...>) {
+        (init_layer<I>(), ...);
+    }
+
+    /*!
+     * \brief Quantize the weights of the given layer
+     */
+    template <size_t L>
+    void init_layer() {
+        if constexpr (is_quantized<L>) {
+            std::get<L>(qlayers).init(dbn.template layer_get<L>(), ranges[L]);
+        }
+    }
+
+    /*!
+     * \brief Propagate the batch from the given layer to the output
+     */
+    template <size_t L, typename Input>
+    auto forward_impl(const Input& input) const {
+        auto next = [&]() {
+            if constexpr (is_quantized<L>) {
+                return std::get<L>(qlayers).forward_batch(input);
+            } else {
+                return dbn.template layer_get<L>().test_forward_batch(input);
+            }
+        }();
+
+        if constexpr (L + 1 < layers) {
+            return forward_impl<L + 1>(next);
+        } else {
+            return next;
+        }
+    }
+
+    dbn_t& dbn;                 ///< The floating point network
+    layers_t qlayers;           ///< The quantized layers
+    std::vector<weight> ranges; ///< The range of the input of each layer
+};
+
+} //end of dll namespace
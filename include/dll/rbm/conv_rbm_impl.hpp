@@ -14,6 +14,7 @@
 
 #include "dll/base_traits.hpp"
 #include "dll/rbm/standard_crbm.hpp" //The base class
+#include "dll/util/winograd.hpp"     // for F(2x2,3x3) kernels
 
 namespace dll {
 
@@ -65,6 +66,8 @@ struct conv_rbm_impl final : public standard_crbm<conv_rbm_impl<Desc>, Desc> {
     std::unique_ptr<b_type> bak_b; ///< backup hidden biases bk
     std::unique_ptr<c_type> bak_c; ///< backup visible single bias c
 
+    mutable winograd_filters<weight> w_winograd; ///< The Winograd transform of the filters, if use_winograd()
+
     etl::fast_matrix<weight, NC, NV1, NV2> v1; //visible units
 
     conditional_fast_matrix_t<!dbn_only, weight, K, NH1, NH2> h1_a; ///< Activation probabilities of reconstructed hidden units
@@ -88,6 +91,22 @@ struct conv_rbm_impl final : public standard_crbm<conv_rbm_impl<Desc>, Desc> {
         }
     }
 
+    /*!
+     * \brief Indicates if the convolutions use the Winograd kernels, with
+     * the cached transform of the 3x3 filters
+     */
+    static constexpr bool use_winograd() noexcept {
+        return NW1 == 3 && NW2 == 3;
+    }
+
+    /*!
+     * \brief Invalidate the Winograd transform of the filters, after a
+     * modification of the weights
+     */
+    void invalidate_weights_cache() {
+        w_winograd.invalidate();
+    }
+
     /*!
      * \brief Return the input size of the layer
      */
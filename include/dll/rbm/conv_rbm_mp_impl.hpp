@@ -71,7 +71,7 @@ struct conv_rbm_mp_impl final : public standard_crbm_mp<conv_rbm_mp_impl<Desc>,
     std::unique_ptr<b_type> bak_b; ///< backup hidden biases bk
     std::unique_ptr<c_type> bak_c; ///< backup visible single bias c
 
-    etl::fast_matrix<weight, NC, NV1, NV2> v1; ///< visible units
+    conditional_fast_matrix_t<!dbn_only, weight, NC, NV1, NV2> v1; ///< visible units
 
     conditional_fast_matrix_t<!dbn_only, weight, K, NH1, NH2> h1_a; ///< Activation probabilities of reconstructed hidden units
     conditional_fast_matrix_t<!dbn_only, weight, K, NH1, NH2> h1_s; ///< Sampled values of reconstructed hidden units
@@ -9,6 +9,7 @@
 
 #include "dll/base_traits.hpp"
 #include "dll/rbm/standard_crbm.hpp" //The base class
+#include "dll/util/winograd.hpp"     // for F(2x2,3x3) kernels
 
 namespace dll {
 
@@ -49,6 +50,8 @@ struct dyn_conv_rbm_impl final : public standard_crbm<dyn_conv_rbm_impl<Desc>, D
     std::unique_ptr<b_type> bak_b; ///< backup hidden biases bk
     std::unique_ptr<c_type> bak_c; ///< backup visible single bias c
 
+    mutable winograd_filters<weight> w_winograd; ///< The Winograd transform of the filters, if use_winograd()
+
     etl::dyn_matrix<weight, 3> v1; ///< visible units
 
     etl::dyn_matrix<weight, 3> h1_a; ///< Activation probabilities of reconstructed hidden units
@@ -97,16 +100,8 @@ struct dyn_conv_rbm_impl final : public standard_crbm<dyn_conv_rbm_impl<Desc>, D
         b = etl::dyn_vector<weight>(k);
         c = etl::dyn_vector<weight>(nc);
 
-        v1 = etl::dyn_matrix<weight, 3>(nc, nv1, nv2);
-
-        h1_a = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
-        h1_s = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
-
-        v2_a = etl::dyn_matrix<weight, 3>(nc, nv1, nv2);
-        v2_s = etl::dyn_matrix<weight, 3>(nc, nv1, nv2);
-
-        h2_a = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
-        h2_s = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
+        // The per-sample states are only allocated when they are used
+        release_states();
 
         if (is_relu(hidden_unit)) {
             w = etl::normal_generator(0.0, 0.01);
@@ -117,6 +112,67 @@ struct dyn_conv_rbm_impl final : public standard_crbm<dyn_conv_rbm_impl<Desc>, D
             b = -0.1;
             c = 0.0;
         }
+
+        w_winograd.invalidate();
+    }
+
+    /*!
+     * \brief Indicates if the convolutions use the Winograd kernels, with
+     * the cached transform of the 3x3 filters
+     */
+    bool use_winograd() const noexcept {
+        return nw1 == 3 && nw2 == 3;
+    }
+
+    /*!
+     * \brief Invalidate the Winograd transform of the filters, after a
+     * modification of the weights
+     */
+    void invalidate_weights_cache() {
+        w_winograd.invalidate();
+    }
+
+    /*!
+     * \brief Allocate the per-sample states of the RBM (v1, h1_a, ...), if
+     * they are not already allocated.
+     *
+     * The states are only used by the single-sample functions (reconstruct,
+     * display, ...), the training (and the DBN) use the batched buffers of
+     * the trainers.
+     */
+    void prepare_states() {
+        if (!has_states()) {
+            v1 = etl::dyn_matrix<weight, 3>(nc, nv1, nv2);
+
+            h1_a = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
+            h1_s = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
+
+            v2_a = etl::dyn_matrix<weight, 3>(nc, nv1, nv2);
+            v2_s = etl::dyn_matrix<weight, 3>(nc, nv1, nv2);
+
+            h2_a = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
+            h2_s = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
+        }
+    }
+
+    /*!
+     * \brief Indicates if the per-sample states of the RBM are allocated
+     */
+    bool has_states() const {
+        return etl::size(v1) == nc * nv1 * nv2;
+    }
+
+    /*!
+     * \brief Release the memory of the per-sample states of the RBM
+     */
+    void release_states() {
+        v1   = etl::dyn_matrix<weight, 3>();
+        h1_a = etl::dyn_matrix<weight, 3>();
+        h1_s = etl::dyn_matrix<weight, 3>();
+        v2_a = etl::dyn_matrix<weight, 3>();
+        v2_s = etl::dyn_matrix<weight, 3>();
+        h2_a = etl::dyn_matrix<weight, 3>();
+        h2_s = etl::dyn_matrix<weight, 3>();
     }
 
     /*!
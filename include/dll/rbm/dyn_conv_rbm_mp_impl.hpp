@@ -111,22 +111,8 @@ struct dyn_conv_rbm_mp_impl final : public standard_crbm_mp<dyn_conv_rbm_mp_impl
         b = etl::dyn_vector<weight>(k);
         c = etl::dyn_vector<weight>(nc);
 
-        v1 = etl::dyn_matrix<weight, 3>(nc, nv1, nv2);
-
-        h1_a = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
-        h1_s = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
-
-        p1_a = etl::dyn_matrix<weight, 3>(k, np1, np2);
-        p1_s = etl::dyn_matrix<weight, 3>(k, np1, np2);
-
-        v2_a = etl::dyn_matrix<weight, 3>(nc, nv1, nv2);
-        v2_s = etl::dyn_matrix<weight, 3>(nc, nv1, nv2);
-
-        h2_a = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
-        h2_s = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
-
-        p2_a = etl::dyn_matrix<weight, 3>(k, np1, np2);
-        p2_s = etl::dyn_matrix<weight, 3>(k, np1, np2);
+        // The per-sample states are only allocated when they are used
+        release_states();
 
         if (is_relu(hidden_unit)) {
             w = etl::normal_generator(0.0, 0.01);
@@ -139,6 +125,59 @@ struct dyn_conv_rbm_mp_impl final : public standard_crbm_mp<dyn_conv_rbm_mp_impl
         }
     }
 
+    /*!
+     * \brief Allocate the per-sample states of the RBM (v1, h1_a, ...), if
+     * they are not already allocated.
+     *
+     * The states are only used by the single-sample functions (reconstruct,
+     * display, ...), the training (and the DBN) use the batched buffers of
+     * the trainers.
+     */
+    void prepare_states() {
+        if (!has_states()) {
+            v1 = etl::dyn_matrix<weight, 3>(nc, nv1, nv2);
+
+            h1_a = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
+            h1_s = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
+
+            p1_a = etl::dyn_matrix<weight, 3>(k, np1, np2);
+            p1_s = etl::dyn_matrix<weight, 3>(k, np1, np2);
+
+            v2_a = etl::dyn_matrix<weight, 3>(nc, nv1, nv2);
+            v2_s = etl::dyn_matrix<weight, 3>(nc, nv1, nv2);
+
+            h2_a = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
+            h2_s = etl::dyn_matrix<weight, 3>(k, nh1, nh2);
+
+            p2_a = etl::dyn_matrix<weight, 3>(k, np1, np2);
+            p2_s = etl::dyn_matrix<weight, 3>(k, np1, np2);
+        }
+    }
+
+    /*!
+     * \brief Indicates if the per-sample states of the RBM are allocated
+     */
+    bool has_states() const {
+        return etl::size(v1) == nc * nv1 * nv2;
+    }
+
+    /*!
+     * \brief Release the memory of the per-sample states of the RBM
+     */
+    void release_states() {
+        v1   = etl::dyn_matrix<weight, 3>();
+        h1_a = etl::dyn_matrix<weight, 3>();
+        h1_s = etl::dyn_matrix<weight, 3>();
+        p1_a = etl::dyn_matrix<weight, 3>();
+        p1_s = etl::dyn_matrix<weight, 3>();
+        v2_a = etl::dyn_matrix<weight, 3>();
+        v2_s = etl::dyn_matrix<weight, 3>();
+        h2_a = etl::dyn_matrix<weight, 3>();
+        h2_s = etl::dyn_matrix<weight, 3>();
+        p2_a = etl::dyn_matrix<weight, 3>();
+        p2_s = etl::dyn_matrix<weight, 3>();
+    }
+
     /*!
      * \brief Return the size of the input of this layer
      * \return The size of the input of this layer
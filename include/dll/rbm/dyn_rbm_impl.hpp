@@ -66,6 +66,8 @@ struct dyn_rbm_impl final : public standard_rbm<dyn_rbm_impl<Desc>, Desc> {
     size_t num_visible;
     size_t num_hidden;
 
+    size_t shape_index = default_dyn_shapes::size; ///< The index of the compile-time shape of the weights
+
     dyn_rbm_impl() : base_type() {}
 
     /*!
@@ -87,7 +89,8 @@ struct dyn_rbm_impl final : public standard_rbm<dyn_rbm_impl<Desc>, Desc> {
               h2_a(num_hidden),
               h2_s(num_hidden),
               num_visible(num_visible),
-              num_hidden(num_hidden) {
+              num_hidden(num_hidden),
+              shape_index(default_dyn_shapes::find(num_visible, num_hidden)) {
         //Initialize the weights with a zero-mean and unit variance Gaussian distribution
         w = etl::normal_generator<weight>() * 0.1;
     }
@@ -99,6 +102,9 @@ struct dyn_rbm_impl final : public standard_rbm<dyn_rbm_impl<Desc>, Desc> {
         num_visible = nv;
         num_hidden  = nh;
 
+        // Common shapes are computed with compile-time kernels
+        shape_index = default_dyn_shapes::find(num_visible, num_hidden);
+
         w    = etl::dyn_matrix<weight>(num_visible, num_hidden);
         b    = etl::dyn_vector<weight>(num_hidden, static_cast<weight>(0.0));
         c    = etl::dyn_vector<weight>(num_visible, static_cast<weight>(0.0));
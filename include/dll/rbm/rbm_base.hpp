@@ -66,6 +66,13 @@ struct rbm_base : layer<Parent> {
 
     weight gradient_clip = 5.0; ///< The default gradient clipping value
 
+    size_t fantasy_particles = 0; ///< The number of persistent chains of PCD, for the dense RBMs (0 for one chain per sample of the batch)
+
+    size_t monitor_batches = 1; ///< The free energy is monitored every N batches (free_energy)
+
+    size_t tempering_replicas = 5;   ///< The number of temperatures of Parallel Tempering
+    weight tempering_min_beta = 0.1; ///< The lowest inverse temperature of Parallel Tempering
+
     /*!
      * \brief Construct an empty rbm_base
      */
@@ -89,6 +96,29 @@ struct rbm_base : layer<Parent> {
         as_derived().w = *as_derived().bak_w;
         as_derived().b = *as_derived().bak_b;
         as_derived().c = *as_derived().bak_c;
+
+        as_derived().invalidate_weights_cache();
+    }
+
+    /*!
+     * \brief Swap the weights with the secondary weights matrix, restoring
+     * the backup in constant time. The secondary weights matrix holds the
+     * replaced weights afterwards.
+     */
+    void swap_weights() {
+        std::swap(as_derived().w, *as_derived().bak_w);
+        std::swap(as_derived().b, *as_derived().bak_b);
+        std::swap(as_derived().c, *as_derived().bak_c);
+
+        as_derived().invalidate_weights_cache();
+    }
+
+    /*!
+     * \brief Invalidate the data computed from the weights by the layer,
+     * after a modification of the weights.
+     */
+    void invalidate_weights_cache() {
+        // Nothing is computed from the weights by default
     }
 
     /*!
@@ -104,6 +134,9 @@ struct rbm_base : layer<Parent> {
      * \return a tuple containing references to the variables of this layer
      */
     decltype(auto) trainable_parameters(){
+        // The parameters may be modified through the references
+        as_derived().invalidate_weights_cache();
+
         return std::make_tuple(std::ref(as_derived().w), std::ref(as_derived().b));
     }
 
@@ -283,6 +316,8 @@ private:
         cpp::binary_load_all(is, rbm.w);
         cpp::binary_load_all(is, rbm.b);
         cpp::binary_load_all(is, rbm.c);
+
+        rbm.invalidate_weights_cache();
     }
 
     /*!
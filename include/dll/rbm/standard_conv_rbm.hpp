@@ -141,9 +141,30 @@ struct standard_conv_rbm : public rbm_base<Parent, Desc> {
      * \brief Return the free energy of the current input
      */
     weight free_energy() const {
+        check_states(as_derived());
+
         return free_energy(as_derived().v1);
     }
 
+    /*!
+     * \brief Return the sum of the energies of the given batch of joint
+     * configurations
+     * \param v The batch of inputs
+     * \param h The batch of outputs
+     */
+    template <typename Input, typename Out>
+    weight energy_batch(const Input& v, const Out& h) const {
+        return as_derived().energy_batch_impl(v, h);
+    }
+
+    /*!
+     * \brief Return the sum of the free energies of the given batch of inputs
+     */
+    template <typename V>
+    weight free_energy_batch(const V& v) const {
+        return as_derived().free_energy_batch_impl(v);
+    }
+
     friend base_type;
 
 private:
@@ -151,6 +172,29 @@ private:
     //to put the fields in standard_rbm, therefore, it is necessary to use template
     //functions to implement the details
 
+    /*!
+     * \brief Allocate the per-sample states of the dynamic RBMs, which are
+     * only allocated when used
+     */
+    static void prepare_states(parent_t& rbm) {
+        if constexpr (layer_traits<parent_t>::is_dynamic()) {
+            rbm.prepare_states();
+        } else {
+            cpp_unused(rbm);
+        }
+    }
+
+    /*!
+     * \brief Check that the per-sample states of the RBM are allocated
+     */
+    static void check_states(const parent_t& rbm) {
+        if constexpr (layer_traits<parent_t>::is_dynamic()) {
+            cpp_assert(rbm.has_states(), "The states of the RBM are only allocated by reconstruct");
+        }
+
+        cpp_unused(rbm);
+    }
+
     /*!
      * \brief Compute the reconstruction for the given input and RBM
      */
@@ -158,6 +202,8 @@ private:
     static double reconstruction_error_impl(const Input& items, parent_t& rbm) {
         cpp_assert(items.size() == input_size(rbm), "The size of the training sample must match visible units");
 
+        prepare_states(rbm);
+
         //Set the state of the visible units
         rbm.v1 = items;
 
@@ -176,6 +222,8 @@ private:
 
         cpp::stop_watch<> watch;
 
+        prepare_states(rbm);
+
         //Set the state of the visible units
         rbm.v1 = items;
 
@@ -191,6 +239,8 @@ private:
      * \brief Display the current visible unit activations
      */
     static void display_visible_unit_activations(const parent_t& rbm) {
+        check_states(rbm);
+
         for (size_t channel = 0; channel < parent_t::NC; ++channel) {
             std::cout << "Channel " << channel << std::endl;
 
@@ -207,6 +257,8 @@ private:
      * \brief Display the current visible unit samples
      */
     static void display_visible_unit_samples(const parent_t& rbm) {
+        check_states(rbm);
+
         for (size_t channel = 0; channel < parent_t::NC; ++channel) {
             std::cout << "Channel " << channel << std::endl;
 
@@ -223,6 +275,8 @@ private:
      * \brief Display the current hidden unit activations
      */
     static void display_hidden_unit_activations(const parent_t& rbm) {
+        check_states(rbm);
+
         for (size_t k = 0; k < get_k(rbm); ++k) {
             for (size_t i = 0; i < get_nv1(rbm); ++i) {
                 for (size_t j = 0; j < get_nv2(rbm); ++j) {
@@ -239,6 +293,8 @@ private:
      * \brief Display the current hidden unit samples
      */
     static void display_hidden_unit_samples(const parent_t& rbm) {
+        check_states(rbm);
+
         for (size_t k = 0; k < get_k(rbm); ++k) {
             for (size_t i = 0; i < get_nv1(rbm); ++i) {
                 for (size_t j = 0; j < get_nv2(rbm); ++j) {
@@ -24,6 +24,8 @@
 
 #include "standard_conv_rbm.hpp" //The base class
 #include "rbm_tmp.hpp"           // static_if macros
+#include "dll/util/energy.hpp"    // Batched energy reductions
+#include "dll/util/winograd.hpp"  // Winograd kernels of the 3x3 filters
 
 namespace dll {
 
@@ -69,7 +71,7 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         auto b_rep = as_derived().get_b_rep();
 
-        as_derived().reshape_h_a(h_a) = etl::conv_4d_valid_flipped(as_derived().reshape_v_a(v_a), as_derived().w);
+        hidden_convolution(as_derived().reshape_v_a(v_a), as_derived().reshape_h_a(h_a));
 
         // Need to be done before h_a is computed!
         H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(b_rep + h_a), 0.0));
@@ -107,7 +109,7 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         using namespace etl;
 
-        as_derived().reshape_v_a(v_a) = etl::conv_4d_full(as_derived().reshape_h_a(h_s), as_derived().w);
+        visible_convolution(as_derived().reshape_h_a(h_s), as_derived().reshape_v_a(v_a));
 
         auto c_rep = as_derived().get_c_rep();
 
@@ -124,8 +126,14 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
         }
     }
 
+    /*!
+     * \brief Compute the hidden activations (and samples) of a batch
+     * \param kept The storage of the transformed visible units of the
+     * Winograd kernels, kept for the gradients of the filters (can be
+     * nullptr, see hidden_convolution)
+     */
     template <bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2>
-    void batch_activate_hidden(H1&& h_a, H2&& h_s, const V1& v_a, const V2& /*v_s*/) const {
+    void batch_activate_hidden(H1&& h_a, H2&& h_s, const V1& v_a, const V2& /*v_s*/, weight* kept = nullptr) const {
         dll::auto_timer timer("crbm:batch_activate_hidden");
 
         static_assert(hidden_unit == unit_type::BINARY || is_relu(hidden_unit), "Invalid hidden unit type");
@@ -135,7 +143,7 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         using namespace etl;
 
-        h_a = etl::conv_4d_valid_flipped(v_a, as_derived().w);
+        hidden_convolution(v_a, h_a, kept);
 
         auto b_rep = as_derived().get_batch_b_rep(v_a);
 
@@ -168,7 +176,7 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         as_derived().template validate_outputs<H1, H2, 1>();
 
-        v_a = etl::conv_4d_full(h_s, as_derived().w);
+        visible_convolution(h_s, v_a);
 
         auto c_rep = as_derived().get_batch_c_rep(h_s);
 
@@ -185,6 +193,52 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
         }
     }
 
+    /*!
+     * \brief Compute the valid convolution of a batch of visible units by
+     * the filters, with the Winograd kernels and the cached transform of
+     * the filters when possible
+     * \param v The visible units (B x NC x NV1 x NV2)
+     * \param h The output (B x K x NH1 x NH2)
+     * \param kept If not nullptr, the storage of the transformed visible
+     * units (B x winograd_input_size), only written by the Winograd kernels
+     */
+    template <typename V, typename H>
+    void hidden_convolution(const V& v, H&& h, weight* kept = nullptr) const {
+        auto& rbm = as_derived();
+
+        if constexpr (etl::is_dma<V> && etl::is_dma<std::decay_t<H>>) {
+            if (rbm.use_winograd()) {
+                dll::winograd_forward(v, rbm.w_winograd.get(rbm.w), h, etl::dim<1>(v), etl::dim<2>(v), etl::dim<3>(v), etl::dim<0>(rbm.w), 0, nullptr, kept);
+                return;
+            }
+        }
+
+        cpp_unused(kept);
+
+        h = etl::conv_4d_valid_flipped(v, rbm.w);
+    }
+
+    /*!
+     * \brief Compute the full convolution of a batch of hidden units by the
+     * filters, with the Winograd kernels and the cached transform of the
+     * filters when possible
+     * \param h The hidden units (B x K x NH1 x NH2)
+     * \param v The output (B x NC x NV1 x NV2)
+     */
+    template <typename H, typename V>
+    void visible_convolution(const H& h, V&& v) const {
+        auto& rbm = as_derived();
+
+        if constexpr (etl::is_dma<H> && etl::is_dma<std::decay_t<V>>) {
+            if (rbm.use_winograd()) {
+                dll::winograd_backward(h, rbm.w_winograd.get(rbm.w), v, etl::dim<1>(v), etl::dim<2>(v), etl::dim<3>(v), etl::dim<0>(rbm.w), 0);
+                return;
+            }
+        }
+
+        v = etl::conv_4d_full(h, rbm.w);
+    }
+
     friend base_type;
 
 private:
@@ -194,7 +248,7 @@ private:
 
         auto rv = as_derived().reshape_v_a(v);
         auto tmp = as_derived().energy_tmp();
-        tmp = etl::conv_4d_valid_flipped(rv, as_derived().w);
+        hidden_convolution(rv, tmp);
 
         if constexpr (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
             //Definition according to Honglak Lee
@@ -216,7 +270,7 @@ private:
     weight free_energy_impl(const Input& v) const {
         auto rv = as_derived().reshape_v_a(v);
         auto tmp = as_derived().energy_tmp();
-        tmp = etl::conv_4d_valid_flipped(rv, as_derived().w);
+        hidden_convolution(rv, tmp);
 
         if constexpr (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
             //Definition computed from E(v,h)
@@ -236,6 +290,79 @@ private:
         }
     }
 
+    template <typename Input, typename Out>
+    weight energy_batch_impl(const Input& v, const Out& h) const {
+        static_assert(etl::is_etl_expr<Out>, "energy_batch_impl works with ETL expressions only");
+
+        decltype(auto) rbm = as_derived();
+
+        const size_t B = etl::dim<0>(v);
+
+        auto rv = etl::reshape(v, B, get_nc(rbm), get_nv1(rbm), get_nv2(rbm));
+
+        etl::dyn_matrix<weight, 4> tmp(B, get_k(rbm), get_nv1(rbm) - get_nw1(rbm) + 1, get_nv2(rbm) - get_nw2(rbm) + 1);
+        hidden_convolution(rv, tmp);
+
+        if constexpr (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
+            return -etl::sum(rbm.c >> etl::sum_r(etl::sum_l(rv))) - etl::sum(rbm.b >> etl::sum_r(etl::sum_l(h))) - etl::sum(h >> tmp);
+        } else if constexpr (desc::visible_unit == unit_type::GAUSSIAN && desc::hidden_unit == unit_type::BINARY) {
+            auto c_rep = rbm.get_c_rep();
+
+            weight visible = 0.0;
+
+            for (size_t i = 0; i < B; ++i) {
+                visible += etl::sum(etl::pow(rv(i) - c_rep, 2) / 2.0);
+            }
+
+            return -visible - etl::sum(rbm.b >> etl::sum_r(etl::sum_l(h))) - etl::sum(h >> tmp);
+        } else {
+            return 0.0;
+        }
+    }
+
+    template <typename Input>
+    weight free_energy_batch_impl(const Input& v) const {
+        decltype(auto) rbm = as_derived();
+
+        const size_t B = etl::dim<0>(v);
+
+        auto rv = etl::reshape(v, B, get_nc(rbm), get_nv1(rbm), get_nv2(rbm));
+
+        if constexpr ((desc::visible_unit == unit_type::BINARY || desc::visible_unit == unit_type::GAUSSIAN) && desc::hidden_unit == unit_type::BINARY) {
+            dll::auto_timer timer("crbm:free_energy_batch");
+
+            // A single convolution for the activations of the whole batch
+            etl::dyn_matrix<weight, 4> x(B, get_k(rbm), get_nv1(rbm) - get_nw1(rbm) + 1, get_nv2(rbm) - get_nw2(rbm) + 1);
+            hidden_convolution(rv, x);
+            x = etl::bias_add_4d(x, rbm.b);
+
+            x.ensure_cpu_up_to_date();
+
+            const weight* x_p = x.memory_start();
+            const size_t n    = etl::size(x) / B;
+
+            const double hidden = parallel_rows_sum(B, [x_p, n](size_t first, size_t last) {
+                return softplus_sum(x_p + first * n, (last - first) * n);
+            });
+
+            if constexpr (desc::visible_unit == unit_type::BINARY) {
+                return -etl::sum(rbm.c >> etl::sum_r(etl::sum_l(rv))) - hidden;
+            } else {
+                auto c_rep = rbm.get_c_rep();
+
+                weight visible = 0.0;
+
+                for (size_t i = 0; i < B; ++i) {
+                    visible += etl::sum(etl::pow(rv(i) - c_rep, 2) / 2.0);
+                }
+
+                return -visible - hidden;
+            }
+        } else {
+            return 0.0;
+        }
+    }
+
     /*!
      * \brief Returns a reference to the derived object, i.e. the object using the CRTP injector.
      * \return a reference to the derived object.
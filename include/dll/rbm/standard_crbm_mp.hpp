@@ -25,6 +25,7 @@
 #include "dll/rbm/standard_conv_rbm.hpp" //The base class
 #include "dll/base_conf.hpp"             //The configuration helpers
 #include "dll/rbm/rbm_tmp.hpp"           // static_if macros
+#include "dll/util/pmp.hpp"              // Fused Probabilistic Max Pooling
 
 namespace dll {
 
@@ -161,22 +162,25 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
 
         h_a = etl::conv_4d_valid_flipped(v_a, as_derived().w);
 
-        auto b_rep = as_derived().get_batch_b_rep(v_a);
+        if constexpr (hidden_unit == unit_type::BINARY) {
+            // Fused PMP kernel: biases, block softmax and sampling in place
+            constexpr weight scale = visible_unit == unit_type::GAUSSIAN ? 1.0 / (0.1 * 0.1) : 1.0;
 
-        // Note: this is wrong because of PMP
+            dll::pmp_hidden<S>(h_a, h_s, as_derived().b, this->C(), scale);
+        } else {
+            auto b_rep = as_derived().get_batch_b_rep(v_a);
 
-        // Need to be done before h_a is computed!
-        H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(b_rep + h_a), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(b_rep + h_a, 6.0), 0.0), 6.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(b_rep + h_a, 1.0), 0.0), 1.0));
+            // Note: this is wrong because of PMP
 
-        H_PROBS2(unit_type::BINARY, unit_type::BINARY, h_a = etl::p_max_pool_h(b_rep + h_a, this->C(), this->C()));
-        H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, h_a = etl::p_max_pool_h((1.0 / (0.1 * 0.1)) >> (b_rep + h_a), this->C(), this->C()));
-        H_PROBS(unit_type::RELU, h_a = max(b_rep + h_a, 0.0));
-        H_PROBS(unit_type::RELU6, h_a = min(max(b_rep + h_a, 0.0), 6.0));
-        H_PROBS(unit_type::RELU1, h_a = min(max(b_rep + h_a, 0.0), 1.0));
+            // Need to be done before h_a is computed!
+            H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(b_rep + h_a), 0.0));
+            H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(b_rep + h_a, 6.0), 0.0), 6.0));
+            H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(b_rep + h_a, 1.0), 0.0), 1.0));
 
-        H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
+            H_PROBS(unit_type::RELU, h_a = max(b_rep + h_a, 0.0));
+            H_PROBS(unit_type::RELU6, h_a = min(max(b_rep + h_a, 0.0), 6.0));
+            H_PROBS(unit_type::RELU1, h_a = min(max(b_rep + h_a, 0.0), 1.0));
+        }
 
         nan_check_deep(h_a);
 
@@ -198,12 +202,10 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         cpp_assert(etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
         cpp_unused(Batch);
 
-        auto b_rep = as_derived().get_batch_b_rep(v_a);
-
         auto h_a = etl::force_temporary(etl::conv_4d_valid_flipped(v_a, as_derived().w));
 
         if (pooling_unit == unit_type::BINARY) {
-            p_a = etl::p_max_pool_p(b_rep + h_a, C(), C());
+            dll::pmp_pooling(h_a, p_a, as_derived().b, C());
         }
 
         nan_check_etl(p_a);
@@ -348,6 +350,28 @@ private:
         }
     }
 
+    template <typename Input, typename Out>
+    weight energy_batch_impl(const Input& v, const Out& h) const {
+        weight energy = 0.0;
+
+        for (size_t i = 0; i < etl::dim<0>(v); ++i) {
+            energy += energy_impl(v(i), h(i));
+        }
+
+        return energy;
+    }
+
+    template <typename Input>
+    weight free_energy_batch_impl(const Input& v) const {
+        weight energy = 0.0;
+
+        for (size_t i = 0; i < etl::dim<0>(v); ++i) {
+            energy += free_energy_impl(v(i));
+        }
+
+        return energy;
+    }
+
     /*!
      * \brief Returns a reference to the derived object, i.e. the object using the CRTP injector.
      * \return a reference to the derived object.
@@ -23,6 +23,10 @@
 #include "dll/rbm/rbm_base.hpp"       //The base class
 #include "dll/base_conf.hpp"      //Descriptor configuration
 #include "dll/rbm/rbm_tmp.hpp"        // static_if macros
+#include "dll/util/sampling.hpp"  // Batched sampling kernels
+#include "dll/util/energy.hpp"    // Batched energy reductions
+#include "dll/util/csr_batch.hpp" // Sparse input kernels
+#include "dll/util/dyn_dispatch.hpp" // Compile-time shapes of the dynamic RBMs
 
 namespace dll {
 
@@ -48,6 +52,14 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
     static constexpr unit_type visible_unit = desc::visible_unit; ///< The type of visible unit
     static constexpr unit_type hidden_unit  = desc::hidden_unit;  ///< The type of hidden unit
 
+    static constexpr bool sparse_input = desc::parameters::template contains<dll::sparse_input>(); ///< Use the sparse kernels for the input
+
+    /*!
+     * \brief Indicates if the Gibbs steps can use the fused kernel
+     */
+    static constexpr bool fused_gibbs =
+        hidden_unit == unit_type::BINARY && (visible_unit == unit_type::BINARY || visible_unit == unit_type::GAUSSIAN);
+
     static_assert(visible_unit != unit_type::SOFTMAX, "Softmax Visible units are not support");
     static_assert(hidden_unit != unit_type::GAUSSIAN, "Gaussian hidden units are not supported");
 
@@ -91,6 +103,29 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
         return free_energy(rbm, rbm.v1);
     }
 
+    /*!
+     * \brief Return the sum of the energies of the given batch of joint
+     * configurations
+     * \param v The batch of inputs
+     * \param h The batch of outputs
+     */
+    template <typename Input, typename Output>
+    weight energy_batch(const Input& v, const Output& h) const {
+        return energy_batch(as_derived(), v, h);
+    }
+
+    /*!
+     * \brief Return the sum of the free energies of the given batch of inputs.
+     *
+     * The activations of the whole batch are computed with a single matrix
+     * multiplication and the softplus reduction is done on the thread pool
+     * of the network, if any.
+     */
+    template <typename Input>
+    weight free_energy_batch(const Input& v) const {
+        return free_energy_batch(as_derived(), v);
+    }
+
     //Various functions
 
     /*!
@@ -170,7 +205,9 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
 
     template <bool P = true, bool S = true, typename H, typename V>
     void batch_activate_visible(const H& h_a, const H& h_s, V&& v_a, V&& v_s) const {
-        batch_std_activate_visible<P, S>(h_a, h_s, std::forward<V>(v_a), std::forward<V>(v_s), as_derived().c, as_derived().w);
+        with_weights([&](auto&& w) {
+            batch_std_activate_visible<P, S>(h_a, h_s, v_a, v_s, as_derived().c, w);
+        });
     }
 
     // batch_activate_hidden
@@ -184,7 +221,9 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
      */
     template <bool P = true, bool S = true, typename H1, typename H2, typename V>
     void batch_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s) const {
-        batch_std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, as_derived().b, as_derived().w);
+        with_weights([&](auto&& w) {
+            batch_std_activate_hidden<P, S>(h_a, h_s, v_a, v_s, as_derived().b, w);
+        });
     }
 
     /*!
@@ -195,12 +234,67 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
      */
     template <typename H, typename V>
     void batch_activate_hidden(H&& h_a, const V& v_a) const {
-        if constexpr (etl::decay_traits<V>::dimensions() == 2) {
-            batch_std_activate_hidden<true, false>(std::forward<H>(h_a), std::forward<H>(h_a), v_a, v_a, as_derived().b, as_derived().w);
+        with_weights([&](auto&& w) {
+            if constexpr (etl::decay_traits<V>::dimensions() == 2) {
+                batch_std_activate_hidden<true, false>(h_a, h_a, v_a, v_a, as_derived().b, w);
+            } else {
+                batch_std_activate_hidden<true, false>(h_a, h_a,
+                                                       etl::reshape(v_a, etl::dim(h_a, 0), as_derived().input_size()),
+                                                       etl::reshape(v_a, etl::dim(h_a, 0), as_derived().input_size()), as_derived().b, w);
+            }
+        });
+    }
+
+    /*!
+     * \brief Perform a Gibbs step h -> v -> h on a batch, with the fused
+     * kernels.
+     *
+     * The products are computed directly in v_a and h_a, then the biases,
+     * the activation functions and the sampling are applied in one pass, so
+     * that a chain of steps does not allocate any temporary. The visible
+     * units are not sampled, as in the CD trainers.
+     *
+     * \param h_in The hidden samples the step starts from (can be the same as h_s)
+     * \param v_a The batch output of the visible activation probabilities
+     * \param h_a The batch output of the hidden activation probabilities
+     * \param h_s The batch output of the hidden samples, only set if S is set
+     */
+    template <bool S = true, typename H0, typename V, typename H1, typename H2>
+    void batch_gibbs_step(const H0& h_in, V&& v_a, H1&& h_a, H2&& h_s) const {
+        dll::auto_timer timer("rbm:std:batch_gibbs_step");
+
+        static_assert(fused_gibbs, "batch_gibbs_step is only implemented for binary hidden units");
+
+        with_weights([&](auto&& w) {
+            v_a = h_in * etl::transpose(w);
+
+            dll::bias_activation<visible_unit == unit_type::BINARY, false>(v_a, as_derived().c, v_a);
+
+            h_a = v_a * w;
+
+            dll::bias_activation<true, S>(h_a, as_derived().b, h_s);
+        });
+
+        nan_check_deep(v_a);
+        nan_check_deep(h_a);
+
+        if (S) {
+            nan_check_deep(h_s);
+        }
+    }
+
+    /*!
+     * \brief Call the functor with the weights of the RBM.
+     *
+     * The weights of the dynamic RBMs with a common shape are passed with
+     * their compile-time shape, for the compile-time kernels to be used.
+     */
+    template <typename Functor>
+    void with_weights(Functor&& functor) const {
+        if constexpr (layer_traits<parent_t>::is_dynamic()) {
+            default_dyn_shapes::dispatch(as_derived().shape_index, as_derived().w, functor);
         } else {
-            batch_std_activate_hidden<true, false>(std::forward<H>(h_a), std::forward<H>(h_a),
-                                                   etl::reshape(v_a, etl::dim(h_a, 0), as_derived().input_size()),
-                                                   etl::reshape(v_a, etl::dim(h_a, 0), as_derived().input_size()), as_derived().b, as_derived().w);
+            functor(as_derived().w);
         }
     }
 
@@ -484,6 +578,56 @@ private:
         }
     }
 
+    template <typename V, typename H>
+    weight energy_batch(const parent_t& rbm, const V& v, const H& h) const {
+        const size_t B = etl::dim<0>(v);
+
+        auto rv = etl::reshape(v, B, as_derived().num_visible);
+
+        if constexpr (visible_unit == unit_type::BINARY && hidden_unit == unit_type::BINARY) {
+            auto x = etl::bias_add_2d(rv * rbm.w, rbm.b);
+
+            return -etl::sum(rv * rbm.c) - etl::sum(h * rbm.b) - etl::sum(x);
+        } else if constexpr (visible_unit == unit_type::GAUSSIAN && hidden_unit == unit_type::BINARY) {
+            auto x = etl::bias_add_2d(rv * rbm.w, rbm.b);
+
+            return etl::sum(etl::pow(rv - etl::rep_l(rbm.c, B), 2) / 2.0) - etl::sum(h * rbm.b) - etl::sum(x);
+        } else {
+            return 0.0;
+        }
+    }
+
+    template <typename V>
+    weight free_energy_batch(const parent_t& rbm, const V& v) const {
+        const size_t B = etl::dim<0>(v);
+        const size_t H = as_derived().num_hidden;
+
+        auto rv = etl::reshape(v, B, as_derived().num_visible);
+
+        if constexpr ((visible_unit == unit_type::BINARY || visible_unit == unit_type::GAUSSIAN) && hidden_unit == unit_type::BINARY) {
+            dll::auto_timer timer("rbm:free_energy_batch");
+
+            etl::dyn_matrix<weight, 2> x(B, H);
+            x = etl::bias_add_2d(rv * rbm.w, rbm.b);
+
+            x.ensure_cpu_up_to_date();
+
+            const weight* x_p = x.memory_start();
+
+            const double hidden = parallel_rows_sum(B, [x_p, H](size_t first, size_t last) {
+                return softplus_sum(x_p + first * H, (last - first) * H);
+            });
+
+            if constexpr (visible_unit == unit_type::BINARY) {
+                return -etl::sum(rv * rbm.c) - hidden;
+            } else {
+                return etl::sum(etl::pow(rv - etl::rep_l(rbm.c, B), 2) / 2.0) - hidden;
+            }
+        } else {
+            return 0.0;
+        }
+    }
+
     template <bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W>
     void std_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V&, const B& b, const W& w) const {
         if constexpr (etl::decay_traits<V>::dimensions() == 1) {
@@ -499,14 +643,14 @@ private:
             H_PROBS(unit_type::SOFTMAX, h_a = stable_softmax(b + (v_a * w)));
 
             //Sample values from input
-            H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
+            H_SAMPLE_PROBS(unit_type::BINARY, dll::sample_bernoulli(h_a, h_s));
             H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(b + (v_a * w)), 0.0));
             H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(b + (v_a * w), 1.0), 0.0), 1.0));
             H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(b + (v_a * w), 6.0), 0.0), 6.0));
             H_SAMPLE_PROBS(unit_type::SOFTMAX, h_s = one_if_max(h_a));
 
             //Sample values from probs
-            H_SAMPLE_INPUT(unit_type::BINARY, h_s = bernoulli(etl::sigmoid(b + (v_a * w))));
+            H_SAMPLE_INPUT(unit_type::BINARY, h_s = etl::sigmoid(b + (v_a * w)); dll::sample_bernoulli(h_s));
             H_SAMPLE_INPUT(unit_type::RELU, h_s = max(logistic_noise(b + (v_a * w)), 0.0));
             H_SAMPLE_INPUT(unit_type::RELU1, h_s = min(max(ranged_noise(b + (v_a * w), 1.0), 0.0), 1.0));
             H_SAMPLE_INPUT(unit_type::RELU6, h_s = min(max(ranged_noise(b + (v_a * w), 6.0), 0.0), 6.0));
@@ -535,8 +679,8 @@ private:
         V_PROBS(unit_type::GAUSSIAN, v_a = c + (w * h_s));
         V_PROBS(unit_type::RELU, v_a = max(c + (w * h_s), 0.0));
 
-        V_SAMPLE_INPUT(unit_type::BINARY, v_s = bernoulli(etl::sigmoid(c + (w * h_s))));
-        V_SAMPLE_INPUT(unit_type::GAUSSIAN, v_s = normal_noise(c + (w * h_s)));
+        V_SAMPLE_INPUT(unit_type::BINARY, v_s = etl::sigmoid(c + (w * h_s)); dll::sample_bernoulli(v_s));
+        V_SAMPLE_INPUT(unit_type::GAUSSIAN, v_s = c + (w * h_s); dll::add_normal_noise(v_s));
         V_SAMPLE_INPUT(unit_type::RELU, v_s = logistic_noise(max(c + (w * h_s), 0.0)));
 
         if (P) {
@@ -558,6 +702,21 @@ private:
 
         cpp_assert(etl::dim<0>(h_s) == Batch && etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
 
+        // Sparse enough input only costs its non-zeros
+        if constexpr (sparse_input && etl::is_dma<V>) {
+            csr_batch<weight> sparse;
+
+            if (sparse.compress(v_a)) {
+                etl::dyn_matrix<weight, 2> x(Batch, etl::dim<1>(w));
+
+                csr_mul(sparse, w, x);
+                x = bias_add_2d(x, b);
+
+                batch_activate_hidden_preactivations<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), x);
+                return;
+            }
+        }
+
         H_PROBS(unit_type::BINARY, h_a = etl::sigmoid(rep_l(b, Batch) + v_a * w));
         H_PROBS(unit_type::RELU, h_a = max(rep_l(b, Batch) + v_a * w, 0.0));
         H_PROBS(unit_type::RELU1, h_a = min(max(rep_l(b, Batch) + v_a * w, 0.0), 1.0));
@@ -571,7 +730,7 @@ private:
             }
         }
 
-        H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
+        H_SAMPLE_PROBS(unit_type::BINARY, dll::sample_bernoulli(h_a, h_s));
         H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(rep_l(b, Batch) + v_a * w), 0.0));
         H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 1.0), 0.0), 1.0));
         H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 6.0), 0.0), 6.0));
@@ -581,7 +740,7 @@ private:
             }
         }
 
-        H_SAMPLE_INPUT(unit_type::BINARY, h_s = bernoulli(etl::sigmoid(rep_l(b, Batch) + v_a * w)));
+        H_SAMPLE_INPUT(unit_type::BINARY, h_s = etl::sigmoid(rep_l(b, Batch) + v_a * w); dll::sample_bernoulli(h_s));
         H_SAMPLE_INPUT(unit_type::RELU, h_s = max(logistic_noise(rep_l(b, Batch) + v_a * w), 0.0));
         H_SAMPLE_INPUT(unit_type::RELU1, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 1.0), 0.0), 1.0));
         H_SAMPLE_INPUT(unit_type::RELU6, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 6.0), 0.0), 6.0));
@@ -602,6 +761,56 @@ private:
         }
     }
 
+    /*!
+     * \brief Compute the hidden representation from the given
+     * pre-activations of the hidden units (biases included)
+     */
+    template <bool P = true, bool S = true, typename H1, typename H2, typename X>
+    static void batch_activate_hidden_preactivations(H1&& h_a, H2&& h_s, X& x) {
+        using namespace etl;
+
+        const auto Batch = etl::dim<0>(h_a);
+
+        H_PROBS(unit_type::BINARY, h_a = etl::sigmoid(x));
+        H_PROBS(unit_type::RELU, h_a = max(x, 0.0));
+        H_PROBS(unit_type::RELU1, h_a = min(max(x, 0.0), 1.0));
+        H_PROBS(unit_type::RELU6, h_a = min(max(x, 0.0), 6.0));
+
+        H_PROBS_MULTI(unit_type::SOFTMAX){
+            for (size_t b = 0; b < Batch; ++b) {
+                h_a(b) = stable_softmax(x(b));
+            }
+        }
+
+        H_SAMPLE_PROBS(unit_type::BINARY, dll::sample_bernoulli(h_a, h_s));
+        H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(x), 0.0));
+        H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(x, 1.0), 0.0), 1.0));
+        H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(x, 6.0), 0.0), 6.0));
+        H_SAMPLE_PROBS_MULTI(unit_type::SOFTMAX){
+            for (size_t b = 0; b < Batch; ++b) {
+                h_s(b) = stable_softmax(h_a(b));
+            }
+        }
+
+        H_SAMPLE_INPUT(unit_type::BINARY, h_s = etl::sigmoid(x); dll::sample_bernoulli(h_s));
+        H_SAMPLE_INPUT(unit_type::RELU, h_s = max(logistic_noise(x), 0.0));
+        H_SAMPLE_INPUT(unit_type::RELU1, h_s = min(max(ranged_noise(x, 1.0), 0.0), 1.0));
+        H_SAMPLE_INPUT(unit_type::RELU6, h_s = min(max(ranged_noise(x, 6.0), 0.0), 6.0));
+        H_SAMPLE_INPUT_MULTI(unit_type::SOFTMAX){
+            for (size_t b = 0; b < Batch; ++b) {
+                h_s(b) = one_if_max(stable_softmax(x(b)));
+            }
+        }
+
+        if (P) {
+            nan_check_deep(h_a);
+        }
+
+        if (S) {
+            nan_check_deep(h_s);
+        }
+    }
+
     template <bool P = true, bool S = true, typename H, typename V, typename C, typename W>
     static void batch_std_activate_visible(const H&, const H& h_s, V&& v_a, V&& v_s, const C& c, const W& w) {
         dll::auto_timer timer("rbm:std:batch_activate_visible");
@@ -616,8 +825,8 @@ private:
         V_PROBS(unit_type::GAUSSIAN, v_a = rep_l(c, Batch) + transpose(w * transpose(h_s)));
         V_PROBS(unit_type::RELU, v_a = max(rep_l(c, Batch) + transpose(w * transpose(h_s)), 0.0));
 
-        V_SAMPLE_INPUT(unit_type::BINARY, v_s = bernoulli(etl::sigmoid(rep_l(c, Batch) + transpose(w * transpose(h_s)))));
-        V_SAMPLE_INPUT(unit_type::GAUSSIAN, v_s = normal_noise(rep_l(c, Batch) + transpose(w * transpose(h_s))));
+        V_SAMPLE_INPUT(unit_type::BINARY, v_s = etl::sigmoid(rep_l(c, Batch) + transpose(w * transpose(h_s))); dll::sample_bernoulli(v_s));
+        V_SAMPLE_INPUT(unit_type::GAUSSIAN, v_s = rep_l(c, Batch) + transpose(w * transpose(h_s)); dll::add_normal_noise(v_s));
         V_SAMPLE_INPUT(unit_type::RELU, v_s = logistic_noise(max(rep_l(c, Batch) + transpose(w * transpose(h_s)), 0.0)));
 
         if (P) {
@@ -0,0 +1,36 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <string>
+
+namespace dll {
+
+/*!
+ * \brief The distribution of the negative classes of a sampled softmax
+ */
+enum class sampler_type {
+    UNIFORM,    ///< All the classes have the same probability
+    LOG_UNIFORM ///< Zipfian distribution, the classes being sorted by decreasing frequency
+};
+
+/*!
+ * \brief Returns a string representation of a sampler type
+ */
+inline std::string to_string(sampler_type s) {
+    switch (s) {
+        case sampler_type::UNIFORM:
+            return "UNIFORM";
+        case sampler_type::LOG_UNIFORM:
+            return "LOG_UNIFORM";
+    }
+
+    return "UNDEFINED";
+}
+
+} //end of dll namespace
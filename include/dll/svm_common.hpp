@@ -12,11 +12,23 @@
 
 #ifdef DLL_SVM_SUPPORT
 
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "cpp_utils/io.hpp"
+#include "cpp_utils/maybe_parallel.hpp"
 #include "nice_svm.hpp"
 
+#include "dll/util/pool_stats.hpp"
+
 namespace dll {
 
 inline svm_parameter default_svm_parameters() {
@@ -31,26 +43,113 @@ inline svm_parameter default_svm_parameters() {
     return parameters;
 }
 
-template <typename DBN>
-void svm_store(const DBN& dbn, std::ostream& os) {
-    if (dbn.svm_loaded) {
-        cpp::binary_write(os, true);
+namespace detail {
+
+/*!
+ * \brief An anonymous in-memory file, to let libsvm, which can only save
+ * and load models through paths, read and write models without touching
+ * the disk. If the in-memory file cannot be created, an unlinked temporary
+ * file is used instead.
+ */
+struct svm_memory_file {
+    int fd = -1; ///< The file descriptor
+
+    svm_memory_file() {
+#ifdef MFD_CLOEXEC
+        fd = ::memfd_create("dll_svm", MFD_CLOEXEC);
+#endif
+
+        if (fd < 0) {
+            char name[] = "/tmp/dll_svm_XXXXXX";
+
+            fd = ::mkstemp(name);
+
+            if (fd >= 0) {
+                ::unlink(name);
+            }
+        }
+    }
+
+    svm_memory_file(const svm_memory_file& rhs) = delete;
+    svm_memory_file& operator=(const svm_memory_file& rhs) = delete;
+
+    ~svm_memory_file() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
 
-        svm::save(dbn.svm_model, "..tmp.svm");
+    /*!
+     * \brief Returns the path of the file, usable by libsvm
+     */
+    std::string path() const {
+        return "/proc/self/fd/" + std::to_string(fd);
+    }
+
+    /*!
+     * \brief Copy the content of the file into the given stream
+     */
+    void copy_to(std::ostream& os) const {
+        char buffer[4096];
+
+        ::lseek(fd, 0, SEEK_SET);
 
-        std::ifstream svm_is("..tmp.svm", std::ios::binary);
+        ssize_t n;
+        while ((n = ::read(fd, buffer, sizeof(buffer))) > 0) {
+            os.write(buffer, n);
+        }
+    }
 
-        char buffer[1024];
+    /*!
+     * \brief Copy the rest of the given stream into the file
+     */
+    void copy_from(std::istream& is) const {
+        char buffer[4096];
 
         while (true) {
-            svm_is.read(buffer, 1024);
+            is.read(buffer, sizeof(buffer));
 
-            if (svm_is.gcount() == 0) {
+            if (is.gcount() == 0) {
                 break;
             }
 
-            os.write(buffer, svm_is.gcount());
+            if (::write(fd, buffer, is.gcount()) != is.gcount()) {
+                std::cerr << "ERROR: Impossible to copy the SVM model" << std::endl;
+                break;
+            }
         }
+
+        ::lseek(fd, 0, SEEK_SET);
+    }
+};
+
+/*!
+ * \brief Returns the values of one dimension of a RBF grid, regularly
+ * spaced on a logarithmic scale
+ */
+inline std::vector<double> svm_grid_values(double first, double last, size_t steps) {
+    std::vector<double> values;
+
+    for (size_t i = 0; i < steps; ++i) {
+        const double ratio = steps > 1 ? double(i) / double(steps - 1) : 0.0;
+        values.push_back(first * std::pow(last / first, ratio));
+    }
+
+    return values;
+}
+
+} // end of namespace detail
+
+template <typename DBN>
+void svm_store(const DBN& dbn, std::ostream& os) {
+    if (dbn.svm_loaded) {
+        cpp::binary_write(os, true);
+
+        detail::svm_memory_file file;
+
+        svm::save(dbn.svm_model, file.path());
+
+        file.copy_to(os);
     } else {
         cpp::binary_write(os, false);
     }
@@ -65,27 +164,62 @@ void svm_load(DBN& dbn, std::istream& is) {
         cpp::binary_load(is, svm);
 
         if (svm) {
-            std::ofstream svm_os("..tmp.svm", std::ios::binary);
+            detail::svm_memory_file file;
 
-            char buffer[1024];
+            file.copy_from(is);
 
-            while (true) {
-                is.read(buffer, 1024);
+            dbn.svm_model = svm::load(file.path());
 
-                if (is.gcount() == 0) {
-                    break;
-                }
+            dbn.svm_loaded = true;
+        }
+    }
+}
 
-                svm_os.write(buffer, is.gcount());
-            }
+/*!
+ * \brief Grid search of the C and gamma parameters of a RBF SVM, by
+ * cross-validation, with the points of the grid evaluated concurrently on
+ * the given thread pool.
+ *
+ * \param problem The SVM problem
+ * \param parameters The base parameters of the SVM
+ * \param n_fold The number of folds of the cross-validation
+ * \param g The grid
+ * \param pool The thread pool
+ * \return The best parameters
+ */
+template <typename Pool>
+svm_parameter svm_parallel_grid_search(svm::problem& problem, const svm_parameter& parameters, size_t n_fold, const svm::rbf_grid& g, Pool& pool) {
+    const auto c_values     = detail::svm_grid_values(g.c_first, g.c_last, g.c_steps);
+    const auto gamma_values = detail::svm_grid_values(g.gamma_first, g.gamma_last, g.gamma_steps);
+
+    const size_t points = c_values.size() * gamma_values.size();
+
+    std::vector<double> accuracies(points, 0.0);
+
+    dll::maybe_parallel_foreach_n(pool, 0, points, [&](size_t p) {
+        auto point_parameters  = parameters;
+        point_parameters.C     = c_values[p / gamma_values.size()];
+        point_parameters.gamma = gamma_values[p % gamma_values.size()];
+
+        accuracies[p] = svm::cross_validate(problem, point_parameters, n_fold, true);
+    });
 
-            svm_os.close();
+    auto best_parameters = parameters;
+    double best_accuracy = -1.0;
 
-            dbn.svm_model = svm::load("..tmp.svm");
+    for (size_t p = 0; p < points; ++p) {
+        std::cout << "C=" << c_values[p / gamma_values.size()] << ",gamma=" << gamma_values[p % gamma_values.size()] << " -> " << accuracies[p] << std::endl;
 
-            dbn.svm_loaded = true;
+        if (accuracies[p] > best_accuracy) {
+            best_accuracy         = accuracies[p];
+            best_parameters.C     = c_values[p / gamma_values.size()];
+            best_parameters.gamma = gamma_values[p % gamma_values.size()];
         }
     }
+
+    std::cout << "Best: C=" << best_parameters.C << ",gamma=" << best_parameters.gamma << " -> " << best_accuracy << std::endl;
+
+    return best_parameters;
 }
 
 template <typename DBN, typename Result, typename Sample>
@@ -203,8 +337,9 @@ bool svm_grid_search(DBN& dbn, const Samples& training_data, const Labels& label
         return false;
     }
 
-    //Perform a grid-search
-    svm::rbf_grid_search(dbn.problem, parameters, n_fold, g);
+    //Perform a grid-search, the points of the grid concurrently
+    cpp::thread_pool<true> pool;
+    svm_parallel_grid_search(dbn.problem, parameters, n_fold, g, pool);
 
     return true;
 }
@@ -226,8 +361,9 @@ bool svm_grid_search(DBN& dbn, Iterator&& first, Iterator&& last, LIterator&& lf
         return false;
     }
 
-    //Perform a grid-search
-    svm::rbf_grid_search(dbn.problem, parameters, n_fold, g);
+    //Perform a grid-search, the points of the grid concurrently
+    cpp::thread_pool<true> pool;
+    svm_parallel_grid_search(dbn.problem, parameters, n_fold, g, pool);
 
     return true;
 }
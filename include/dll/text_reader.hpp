@@ -17,23 +17,49 @@
 #include <iostream>
 #include <vector>
 #include <cstdint>
+#include <cstdlib>
 #include <memory>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <charconv>
 
 #include <dirent.h>
 
 #include "cpp_utils/tmp.hpp"
 #include "etl/etl_light.hpp"
 
+#include "dll/generators/mmap_dataset.hpp"
+
 namespace dll {
 namespace text {
 
-template<typename Container, typename Functor>
-void read_images(Container& images, const std::string& path, size_t limit, Functor func){
-    using Image = typename Container::value_type;
+namespace text_detail {
+
+/*!
+ * \brief A file of the dataset, identified by its id
+ */
+struct dataset_file {
+    size_t id;        ///< The id (1-based) of the file
+    std::string path; ///< The full path of the file
+};
+
+/*!
+ * \brief List the ".dat" files of the given folder
+ * \param path The folder to list
+ * \param limit The maximum id to accept (0 = no limit)
+ * \return The files of the folder
+ */
+inline std::vector<dataset_file> list_files(const std::string& path, size_t limit){
+    std::vector<dataset_file> files;
 
     struct dirent* entry;
     auto dir = opendir(path.c_str());
 
+    if (!dir) {
+        return files;
+    }
+
     while ((entry = readdir(dir))) {
         std::string file_name(entry->d_name);
 
@@ -43,77 +69,202 @@ void read_images(Container& images, const std::string& path, size_t limit, Funct
 
         int id = std::atoi(std::string(file_name.begin(), file_name.begin() + file_name.size() - 4).c_str());
 
-        if(!limit || id - 1 < (int) limit){
-            std::vector<double> temp;
+        if (id > 0 && (!limit || id - 1 < (int) limit)) {
+            files.push_back({size_t(id), path + "/" + file_name});
+        }
+    }
 
-            std::string full_path(path + "/" + file_name);
+    closedir(dir);
 
-            std::ifstream file(full_path);
+    return files;
+}
 
-            size_t lines = 0;
-            size_t columns = 0;
+/*!
+ * \brief Read a whole file in memory
+ * \param path The path of the file
+ * \param content The output content
+ * \return true if the file was read, false otherwise
+ */
+inline bool read_file(const std::string& path, std::string& content){
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
 
-            // There is a bug in G++7.1 that causes this false positive
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wstrict-aliasing"
-            std::string line;
-            while (std::getline(file, line)) {
-                std::istringstream ss(line);
-                std::string value;
+    if (!file) {
+        return false;
+    }
 
-                while (std::getline(ss, value, ';')) {
-                    auto v = std::atof(value.c_str());
-                    temp.push_back(v);
+    content.resize(size_t(file.tellg()));
 
-                    if(lines == 0){
-                        ++columns;
-                    }
-                }
+    file.seekg(0);
+    file.read(&content[0], content.size());
 
-                ++lines;
-            }
-#pragma GCC diagnostic pop
+    return bool(file);
+}
 
-            if((int) images.size() < id){
-                images.resize(id);
-            }
+/*!
+ * \brief Parse one value, an empty or invalid value being zero
+ */
+inline double parse_value(const char* first, const char* last){
+    while (first != last && (*first == ' ' || *first == '\t')) {
+        ++first;
+    }
+
+    double value = 0.0;
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    std::from_chars(first, last, value);
+#else
+    if (first != last) {
+        value = std::strtod(std::string(first, last).c_str(), nullptr);
+    }
+#endif
+
+    return value;
+}
+
+/*!
+ * \brief Parse a text file, values being separated by ';' and lines by
+ * end of line characters.
+ *
+ * \param content The content of the file
+ * \param values The output values
+ * \param lines The output number of lines
+ * \param columns The output number of values on the first line
+ */
+inline void parse_values(const std::string& content, std::vector<double>& values, size_t& lines, size_t& columns){
+    lines   = 0;
+    columns = 0;
+
+    const char* it  = content.data();
+    const char* end = content.data() + content.size();
 
-            images[id - 1] = func(1, lines, columns);
+    while (it != end) {
+        const char* eol = std::find(it, end, '\n');
+        const char* line_end = eol;
 
-            size_t i = 0;
-            for (auto& value : temp) {
-                images[id - 1][i++] = static_cast<typename Image::value_type>(value);
+        if (line_end != it && *(line_end - 1) == '\r') {
+            --line_end;
+        }
+
+        // A trailing separator does not start a new value
+        while (it < line_end) {
+            const char* sep = std::find(it, line_end, ';');
+
+            values.push_back(parse_value(it, sep));
+
+            if (lines == 0) {
+                ++columns;
             }
+
+            it = sep == line_end ? line_end : sep + 1;
         }
+
+        ++lines;
+
+        it = eol == end ? end : eol + 1;
     }
 }
 
-template<template<typename...> typename  Container = std::vector, typename Label = uint8_t>
-void read_labels(Container<Label>& labels, const std::string& path, size_t limit = 0){
-    struct dirent* entry;
-    auto dir = opendir(path.c_str());
+/*!
+ * \brief Apply the given functor on all the files, in parallel
+ * \param files The files
+ * \param functor The functor to apply on each file
+ */
+template<typename Functor>
+void parallel_files(const std::vector<dataset_file>& files, Functor functor){
+    const size_t threads = std::min(files.size(), std::max(size_t(1), size_t(std::thread::hardware_concurrency())));
 
-    while ((entry = readdir(dir))) {
-        std::string file_name(entry->d_name);
+    std::atomic<size_t> next(0);
 
-        if (file_name.size() <= 3 || file_name.find(".dat") != file_name.size() - 4) {
-            continue;
+    auto worker = [&] {
+        std::string content;
+        std::vector<double> values;
+
+        for (size_t i = next++; i < files.size(); i = next++) {
+            functor(files[i], content, values);
         }
+    };
 
-        int id = std::atoi(std::string(file_name.begin(), file_name.begin() + file_name.size() - 4).c_str());
+    std::vector<std::thread> pool;
+
+    for (size_t t = 1; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+
+    worker();
+
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+} // end of namespace text_detail
+
+/*!
+ * \brief Read the images of the given folder.
+ *
+ * The files are read in one go and parsed in parallel, each value being
+ * written directly into its image.
+ *
+ * \param images The container of images to fill
+ * \param path The folder of the images
+ * \param limit The maximum number of images to read (0 = no limit)
+ * \param func The functor to create an image from its dimensions
+ */
+template<typename Container, typename Functor>
+void read_images(Container& images, const std::string& path, size_t limit, Functor func){
+    using Image = typename Container::value_type;
+
+    auto files = text_detail::list_files(path, limit);
 
-        if((int) labels.size() < id){
-            labels.resize(id);
+    size_t n = images.size();
+    for (auto& file : files) {
+        n = std::max(n, file.id);
+    }
+
+    images.resize(n);
+
+    text_detail::parallel_files(files, [&images, &func](const text_detail::dataset_file& file, std::string& content, std::vector<double>& values) {
+        values.clear();
+
+        size_t lines   = 0;
+        size_t columns = 0;
+
+        if (text_detail::read_file(file.path, content)) {
+            text_detail::parse_values(content, values, lines, columns);
+        } else {
+            std::cerr << "ERROR: Impossible to read " << file.path << std::endl;
         }
 
-        std::string full_path(path + "/" + file_name);
+        auto& image = images[file.id - 1];
+
+        image = func(1, lines, columns);
 
-        std::ifstream file(full_path);
-        int value;
-        file >> value;
-        labels[id - 1] = static_cast<Label>(value);
+        size_t i = 0;
+        for (auto& value : values) {
+            image[i++] = static_cast<typename Image::value_type>(value);
+        }
+    });
+}
+
+template<template<typename...> typename  Container = std::vector, typename Label = uint8_t>
+void read_labels(Container<Label>& labels, const std::string& path, size_t limit = 0){
+    auto files = text_detail::list_files(path, 0);
+
+    size_t n = labels.size();
+    for (auto& file : files) {
+        n = std::max(n, file.id);
     }
 
+    labels.resize(n);
+
+    text_detail::parallel_files(files, [&labels](const text_detail::dataset_file& file, std::string& content, std::vector<double>& values) {
+        cpp_unused(values);
+
+        if (text_detail::read_file(file.path, content)) {
+            labels[file.id - 1] = static_cast<Label>(int(text_detail::parse_value(content.data(), content.data() + content.size())));
+        }
+    });
+
     if(limit && labels.size() > limit){
         labels.resize(limit);
     }
@@ -148,5 +299,26 @@ Container<Label> read_labels(const std::string& path, size_t limit){
     return labels;
 }
 
+/*!
+ * \brief Read a text dataset and write it in the memory-mapped format of
+ * mmap_data_generator.
+ *
+ * \tparam Image The ETL type of the images
+ * \tparam Three Indicates if the images are read as 3D images
+ * \param images_path The folder of the images
+ * \param labels_path The folder of the labels
+ * \param output The path of the file to write
+ * \param limit The maximum number of samples to read (0 = no limit)
+ * \param n_classes The number of classes, to store one-hot labels (0 to store the labels as such)
+ * \return true if the dataset was written, false otherwise
+ */
+template<typename Image, bool Three, typename Label = uint8_t>
+bool convert_to_mmap(const std::string& images_path, const std::string& labels_path, const std::string& output, size_t limit = 0, size_t n_classes = 0){
+    auto images = read_images<std::vector, Image, Three>(images_path, limit);
+    auto labels = read_labels<std::vector, Label>(labels_path, limit);
+
+    return write_mmap_dataset(output, images, labels, n_classes);
+}
+
 } //end of namespace text
 } //end of namespace dll
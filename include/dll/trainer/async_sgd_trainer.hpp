@@ -0,0 +1,229 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file async_sgd_trainer.hpp
+ * \brief Asynchronous (Hogwild) Stochastic Gradient Descent for neural networks
+ *
+ * Several workers train batches concurrently and apply their updates to the
+ * shared weights, without any lock. This is mostly interesting when the
+ * updates are sparse, for instance for networks starting with an embedding
+ * layer.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "dll/trainer/stochastic_gradient_descent.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Asynchronous gradient descent trainer
+ *
+ * Each batch is copied and handed to a free worker, which trains it with
+ * its own replica of the SGD contexts (including the updater contexts) and
+ * updates the shared weights directly. The number of batches in flight
+ * bounds the staleness of the gradients, it is set with
+ * dll::staleness<S> (by default, the number of workers).
+ *
+ * The error and the loss returned for a batch are the ones of the batches
+ * completed since the previous call.
+ */
+template <typename DBN>
+struct async_sgd_trainer {
+    using dbn_t     = DBN;                       ///< The type of DBN being trained
+    using weight    = typename dbn_t::weight;    ///< The data type for this layer
+    using this_type = async_sgd_trainer<dbn_t>;  ///< The type of this layer
+    using replica_t = sgd_trainer<dbn_t>;        ///< The type of the replica of each worker
+    using metrics_t = std::pair<double, double>; ///< The error and loss of a batch
+
+    static_assert(dbn_traits<dbn_t>::data_parallel() == 1, "The asynchronous trainer cannot be combined with data-parallel training");
+
+    dbn_t& dbn; ///< The DBN being trained
+
+    /*!
+     * \brief construct a new async_sgd_trainer
+     * \param dbn The DBN being trained
+     */
+    explicit async_sgd_trainer(dbn_t& dbn) : dbn(dbn) {
+        cpp_assert(!dbn.transport, "The asynchronous trainer does not support distributed training");
+
+        const size_t max_threads = std::max<size_t>(1, etl::threads);
+        const size_t bound       = dbn_traits<dbn_t>::staleness();
+
+        workers   = bound ? std::min(bound, max_threads) : max_threads;
+        staleness = bound ? bound : workers;
+
+        for (size_t w = 0; w < workers; ++w) {
+            replicas.push_back(std::make_unique<replica_t>(dbn));
+        }
+
+        for (size_t w = 0; w < workers; ++w) {
+            threads.emplace_back([this, w] { work(*replicas[w]); });
+        }
+    }
+
+    async_sgd_trainer(const async_sgd_trainer& rhs) = delete;
+    async_sgd_trainer& operator=(const async_sgd_trainer& rhs) = delete;
+
+    /*!
+     * \brief Stop and join the workers
+     */
+    ~async_sgd_trainer() {
+        {
+            std::unique_lock<std::mutex> ulock(lock);
+            stop_flag = true;
+        }
+
+        task_cv.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Initialize the training
+     */
+    void init_training(size_t) {}
+
+    /*!
+     * \brief Train a batch of data, asynchronously.
+     *
+     * The batch is copied, this only blocks while the maximum number of
+     * batches are in flight.
+     *
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss of the last completed batches
+     */
+    template <typename Inputs, typename Labels>
+    metrics_t train_batch(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        dll::auto_timer timer("async_sgd::train_batch");
+
+        auto task = [epoch, inputs = etl::force_temporary(inputs), labels = etl::force_temporary(labels)](replica_t& replica) {
+            return replica.train_batch(epoch, inputs, labels);
+        };
+
+        std::unique_lock<std::mutex> ulock(lock);
+
+        {
+            dll::auto_timer timer("async_sgd::wait");
+
+            done_cv.wait(ulock, [this] { return pending < staleness; });
+        }
+
+        tasks.emplace_back(std::move(task));
+        ++pending;
+
+        task_cv.notify_one();
+
+        if (completed) {
+            last = std::make_pair(completed_error / completed, completed_loss / completed);
+
+            completed       = 0;
+            completed_error = 0.0;
+            completed_loss  = 0.0;
+        }
+
+        return last;
+    }
+
+    /*!
+     * \brief Wait for all the batches in flight to be trained
+     */
+    void end_epoch() {
+        std::unique_lock<std::mutex> ulock(lock);
+
+        done_cv.wait(ulock, [this] { return pending == 0; });
+
+        // Apply the gradients still accumulated by the idle workers
+        for (auto& replica : replicas) {
+            replica->end_epoch();
+        }
+    }
+
+    /*!
+     * \brief Forward a batch through the network, once all the batches in
+     * flight are trained
+     */
+    template <bool Train, typename Inputs>
+    auto& forward_batch_helper(dbn_t& dbn, Inputs&& inputs) {
+        end_epoch();
+
+        return replicas[0]->template forward_batch_helper<Train>(dbn, inputs);
+    }
+
+private:
+    /*!
+     * \brief The loop of a worker
+     * \param replica The replica of the worker
+     */
+    void work(replica_t& replica) {
+        while (true) {
+            std::unique_lock<std::mutex> ulock(lock);
+
+            task_cv.wait(ulock, [this] { return stop_flag || !tasks.empty(); });
+
+            if (tasks.empty()) {
+                return;
+            }
+
+            auto task = std::move(tasks.front());
+            tasks.pop_front();
+
+            ulock.unlock();
+
+            metrics_t metrics;
+
+            SERIAL_SECTION {
+                metrics = task(replica);
+            }
+
+            ulock.lock();
+
+            completed_error += metrics.first;
+            completed_loss += metrics.second;
+            ++completed;
+            --pending;
+
+            done_cv.notify_all();
+        }
+    }
+
+    size_t workers   = 0; ///< The number of workers
+    size_t staleness = 0; ///< The maximum number of batches in flight
+
+    std::vector<std::unique_ptr<replica_t>> replicas; ///< The replicas of the workers
+    std::vector<std::thread> threads;                 ///< The threads of the workers
+
+    std::mutex lock;                 ///< The lock protecting the tasks and the statistics
+    std::condition_variable task_cv; ///< Signaled when a task is available (or on stop)
+    std::condition_variable done_cv; ///< Signaled when a task is completed
+
+    std::deque<std::function<metrics_t(replica_t&)>> tasks; ///< The batches waiting for a worker
+
+    size_t pending = 0;     ///< The number of batches in flight
+    bool stop_flag = false; ///< Indicates if the workers must stop
+
+    size_t completed       = 0;   ///< The number of batches completed since the last report
+    double completed_error = 0.0; ///< The sum of the errors of the completed batches
+    double completed_loss  = 0.0; ///< The sum of the losses of the completed batches
+    metrics_t last{1.0, 0.0};     ///< The last reported error and loss
+};
+
+} //end of dll namespace
@@ -16,9 +16,14 @@
 
 #pragma once
 
+#include <algorithm>
+#include <numeric>
 #include <utility>
 
+#include "cpp_utils/maybe_parallel.hpp"
+
 #include "dll/util/batch.hpp"
+#include "dll/util/pool_stats.hpp"
 
 namespace dll {
 
@@ -50,6 +55,8 @@ struct cg_trainer_base {
 
     dbn_t& dbn; ///< The DBN being trained
 
+    std::vector<std::vector<weight>> diffs; ///< The errors of each sample of the batch
+
     explicit cg_trainer_base(dbn_t& dbn) : dbn(dbn) {
         dbn.for_each_layer([](auto& r1) {
             r1.init_cg_context();
@@ -116,12 +123,33 @@ struct cg_trainer_base {
 
     /* Gradient */
 
+    /*!
+     * \brief Split the range [0, n) in chunks, processed in parallel by the
+     * thread pool of the network
+     * \param n The size of the range
+     * \param functor The functor to call with the first and last index of each chunk
+     */
+    template <typename Functor>
+    void parallel_chunks(size_t n, Functor&& functor) {
+        const size_t chunks = std::max<size_t>(1, std::min<size_t>(n, etl::threads));
+        const size_t step   = (n + chunks - 1) / chunks;
+
+        dll::maybe_parallel_foreach_n(dbn.get_thread_pool(), 0, chunks, [&](size_t c) {
+            const size_t first = c * step;
+            const size_t last  = std::min(n, first + step);
+
+            if (first < last) {
+                functor(first, last);
+            }
+        });
+    }
+
     template <bool Temp, typename R1, typename R2, typename C1, typename C2, typename D>
-    static void update_diffs(R1&, R2& r2, C1& c1, C2& c2, std::vector<D>& diffs, size_t n_samples) {
+    static void update_diffs(R1&, R2& r2, C1& c1, C2& c2, std::vector<D>& diffs, size_t first, size_t last) {
         auto n_visible = num_visible(r2);
         auto n_hidden  = num_hidden(r2);
 
-        for (size_t sample = 0; sample < n_samples; ++sample) {
+        for (size_t sample = first; sample < last; ++sample) {
             D diff(n_visible);
 
             for (size_t i = 0; i < n_visible; ++i) {
@@ -141,38 +169,62 @@ struct cg_trainer_base {
         }
     }
 
-    template <bool Temp, typename R, typename D, typename V>
-    static void update_incs(R& r, std::vector<D>& diffs, const V& visibles) {
+    /*!
+     * \brief Accumulate the increments of the weights of the given rows (the
+     * visible units) of the layer, over all the samples.
+     *
+     * Since each row is owned by a single chunk, the rows can be computed
+     * in parallel without contention.
+     */
+    template <typename R, typename D, typename V>
+    static void update_w_incs(R& r, std::vector<D>& diffs, const V& visibles, size_t first, size_t last) {
         auto& ctx = r.get_cg_context();
 
-        auto n_visible = num_visible(r);
-        auto n_hidden  = num_hidden(r);
+        auto n_hidden = num_hidden(r);
 
-        auto it            = visibles.begin();
-        auto end           = visibles.end();
         size_t sample = 0;
 
-        while (it != end) {
-            auto& v = *it;
+        for (auto& v : visibles) {
             auto& d = diffs[sample];
 
-            for (size_t i = 0; i < n_visible; ++i) {
+            for (size_t i = first; i < last; ++i) {
                 for (size_t j = 0; j < n_hidden; ++j) {
                     ctx.gr_w_incs(i, j) += v[i] * d[j];
                 }
             }
 
+            ++sample;
+        }
+    }
+
+    template <typename R, typename D, typename V>
+    void update_incs(R& r, std::vector<D>& diffs, const V& visibles) {
+        auto& ctx = r.get_cg_context();
+
+        auto n_hidden = num_hidden(r);
+
+        parallel_chunks(num_visible(r), [&](size_t first, size_t last) {
+            this_type::update_w_incs(r, diffs, visibles, first, last);
+        });
+
+        const size_t n_samples = std::distance(visibles.begin(), visibles.end());
+
+        for (size_t sample = 0; sample < n_samples; ++sample) {
+            auto& d = diffs[sample];
+
             for (size_t j = 0; j < n_hidden; ++j) {
                 ctx.gr_b_incs(j) += d[j];
             }
-
-            ++it;
-            ++sample;
         }
     }
 
     /*!
      * \brief Compute the gradient of one context
+     *
+     * The samples are forwarded and their errors backpropagated in
+     * parallel, by chunks of samples, while the increments of the weights
+     * are accumulated in parallel by chunks of rows.
+     *
      * \param contex The current gradient context
      * \param cost The current cost
      */
@@ -181,7 +233,6 @@ struct cg_trainer_base {
         const auto n_hidden = output_size(dbn.template layer_get<layers - 1>());
         auto n_samples      = context.inputs.size();
 
-        static std::vector<std::vector<weight>> diffs;
         diffs.resize(n_samples);
 
         dbn.for_each_layer([](auto& rbm) {
@@ -189,54 +240,56 @@ struct cg_trainer_base {
             rbm.get_cg_context().gr_b_incs = 0.0;
         });
 
-        cost         = 0.0;
-        weight error = 0.0;
-
-        auto it  = context.inputs.begin();
-        auto end = context.inputs.end();
-        auto tit = context.targets.begin();
-
-        size_t sample = 0;
+        // The cost and the error of each sample, summed in order at the end
+        std::vector<weight> costs(n_samples);
+        std::vector<weight> errors(n_samples);
+
+        parallel_chunks(n_samples, [&](size_t first, size_t last) {
+            for (size_t sample = first; sample < last; ++sample) {
+                auto& input  = *std::next(context.inputs.begin(), sample);
+                auto output  = std::ref(dbn.template layer_get<0>().get_cg_context().gr_probs_a[sample]);
+                auto& target = *std::next(context.targets.begin(), sample);
+
+                // Only the probabilities are used, the hidden units are
+                // not sampled
+                dbn.for_each_layer_i([&input, &output, sample](size_t I, auto& rbm) {
+                    auto& ctx        = rbm.get_cg_context();
+                    auto& output_ref = static_cast<etl::dyn_vector<weight>&>(output);
+
+                    if (I == 0) {
+                        rbm.template activate_hidden<true, false>(output_ref, ctx.gr_probs_s[sample], input, input, Temp ? ctx.gr_b_tmp : rbm.b, Temp ? ctx.gr_w_tmp : rbm.w);
+                    } else {
+                        rbm.template activate_hidden<true, false>(ctx.gr_probs_a[sample], ctx.gr_probs_s[sample], output_ref, output_ref, Temp ? ctx.gr_b_tmp : rbm.b, Temp ? ctx.gr_w_tmp : rbm.w);
+                        output = std::ref(ctx.gr_probs_a[sample]);
+                    }
+                });
 
-        while (it != end) {
-            auto& input  = *it;
-            auto output  = std::ref(dbn.template layer_get<0>().get_cg_context().gr_probs_a[sample]);
-            auto& target = *tit;
+                auto& diff = diffs[sample];
+                diff.resize(n_hidden);
 
-            dbn.for_each_layer_i([&input, &output, sample](size_t I, auto& rbm) {
-                auto& ctx        = rbm.get_cg_context();
-                auto& output_ref = static_cast<etl::dyn_vector<weight>&>(output);
+                auto& result = dbn.template layer_get<layers - 1>().get_cg_context().gr_probs_a[sample];
+                weight scale = std::accumulate(result.begin(), result.end(), 0.0);
 
-                if (I == 0) {
-                    rbm.activate_hidden(output_ref, ctx.gr_probs_s[sample], input, input, Temp ? ctx.gr_b_tmp : rbm.b, Temp ? ctx.gr_w_tmp : rbm.w);
-                } else {
-                    rbm.activate_hidden(ctx.gr_probs_a[sample], ctx.gr_probs_s[sample], output_ref, output_ref, Temp ? ctx.gr_b_tmp : rbm.b, Temp ? ctx.gr_w_tmp : rbm.w);
-                    output = std::ref(ctx.gr_probs_a[sample]);
+                for (auto& r : result) {
+                    r *= (1.0 / scale);
                 }
-            });
 
-            auto& diff = diffs[sample];
-            diff.resize(n_hidden);
+                weight sample_cost  = 0.0;
+                weight sample_error = 0.0;
 
-            auto& result = dbn.template layer_get<layers - 1>().get_cg_context().gr_probs_a[sample];
-            weight scale = std::accumulate(result.begin(), result.end(), 0.0);
-
-            for (auto& r : result) {
-                r *= (1.0 / scale);
-            }
+                for (size_t i = 0; i < n_hidden; ++i) {
+                    diff[i] = result[i] - target[i];
+                    sample_cost += target[i] * log(result[i]);
+                    sample_error += diff[i] * diff[i];
+                }
 
-            for (size_t i = 0; i < n_hidden; ++i) {
-                diff[i] = result[i] - target[i];
-                cost += target[i] * log(result[i]);
-                error += diff[i] * diff[i];
+                costs[sample]  = sample_cost;
+                errors[sample] = sample_error;
             }
+        });
 
-            ++it;
-            ++tit;
-            ++sample;
-        }
-
-        cost = -cost;
+        cost         = -std::accumulate(costs.begin(), costs.end(), weight(0.0));
+        weight error = std::accumulate(errors.begin(), errors.end(), weight(0.0));
 
         //Get pointers to the different gr_probs
         std::array<std::vector<etl::dyn_vector<weight>>*, layers> probs_refs;
@@ -244,36 +297,22 @@ struct cg_trainer_base {
             probs_refs[I] = &rbm.get_cg_context().gr_probs_a;
         });
 
-        update_incs<Temp>(dbn.template layer_get<layers - 1>(), diffs, dbn.template layer_get<layers - 2>().get_cg_context().gr_probs_a);
-
-#ifdef __clang__
-        dbn.for_each_layer_rpair_i([n_samples, &probs_refs](size_t I, auto& r1, auto& r2) {
-            auto& c1 = r1.get_cg_context();
-            auto& c2 = r2.get_cg_context();
-
-            this_type::update_diffs<Temp>(r1, r2, c1, c2, diffs, n_samples);
-
-            if (I > 0) {
-                this_type::update_incs<Temp>(r1, diffs, *probs_refs[I - 1]);
-            }
-        });
-
-#else
-        std::vector<std::vector<weight>>& diffs_p = diffs;
+        update_incs(dbn.template layer_get<layers - 1>(), diffs, dbn.template layer_get<layers - 2>().get_cg_context().gr_probs_a);
 
-        dbn.for_each_layer_rpair_i([&diffs_p, n_samples, &probs_refs](size_t I, auto& r1, auto& r2) {
+        dbn.for_each_layer_rpair_i([this, n_samples, &probs_refs](size_t I, auto& r1, auto& r2) {
             auto& c1 = r1.get_cg_context();
             auto& c2 = r2.get_cg_context();
 
-            this_type::update_diffs<Temp>(r1, r2, c1, c2, diffs_p, n_samples);
+            this->parallel_chunks(n_samples, [&](size_t first, size_t last) {
+                this_type::update_diffs<Temp>(r1, r2, c1, c2, diffs, first, last);
+            });
 
             if (I > 0) {
-                this_type::update_incs<Temp>(r1, diffs_p, *probs_refs[I - 1]);
+                this->update_incs(r1, diffs, *probs_refs[I - 1]);
             }
         });
-#endif
 
-        update_incs<Temp>(dbn.template layer_get<0>(), diffs, context.inputs);
+        update_incs(dbn.template layer_get<0>(), diffs, context.inputs);
 
         if (Debug) {
             std::cout << "evaluating(" << Temp << "): cost:" << cost << " error: " << (error / n_samples) << std::endl;
@@ -7,7 +7,14 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <numeric>
+#include <sstream>
+
 #include "cpp_utils/algorithm.hpp" // For parallel_shuffle
+#include "cpp_utils/io.hpp"        // For binary_write
 
 #include "etl/etl.hpp"
 
@@ -15,11 +22,183 @@
 #include "dll/util/timers.hpp"
 #include "dll/util/random.hpp"
 #include "dll/util/batch.hpp" // For make_batch
+#include "dll/util/batch_extend.hpp" // For copy_batch
 #include "dll/test.hpp"
 #include "dll/dbn_traits.hpp"
+#include "dll/generators/generator_stats.hpp"
+#include "dll/util/memory.hpp"
+#include "dll/util/pipeline.hpp"
+#include "dll/util/checks.hpp" // For numerical_fault
 
 namespace dll {
 
+/*!
+ * \brief Traits to test if a watcher can receive the statistics of the
+ * generator pipeline
+ */
+template <typename W, typename Enable = void>
+struct has_stats_hook : std::false_type {};
+
+/*!
+ * \copydoc has_stats_hook
+ */
+template <typename W>
+struct has_stats_hook<W, std::void_t<decltype(std::declval<W&>().ft_generator_stats(std::declval<const generator_stats&>()))>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a watcher can receive the statistics of the
+ * stages of the staged training
+ */
+template <typename W, typename Enable = void>
+struct has_stage_stats_hook : std::false_type {};
+
+/*!
+ * \copydoc has_stage_stats_hook
+ */
+template <typename W>
+struct has_stage_stats_hook<W, std::void_t<decltype(std::declval<W&>().ft_stage_stats(std::declval<const pipeline_stats&>()))>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a watcher can be notified of the checkpoints
+ */
+template <typename W, typename Enable = void>
+struct has_checkpoint_hook : std::false_type {};
+
+/*!
+ * \copydoc has_checkpoint_hook
+ */
+template <typename W>
+struct has_checkpoint_hook<W, std::void_t<decltype(std::declval<W&>().ft_checkpoint(size_t(), size_t(), std::declval<const std::string&>()))>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a watcher can receive the deltas of the timers
+ * of each epoch
+ */
+template <typename W, typename Enable = void>
+struct has_timers_hook : std::false_type {};
+
+/*!
+ * \copydoc has_timers_hook
+ */
+template <typename W>
+struct has_timers_hook<W, std::void_t<decltype(std::declval<W&>().ft_epoch_timers(size_t(), std::declval<const timers_delta&>()))>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a watcher can be notified of the first
+ * non-finite value found during the training
+ */
+template <typename W, typename Enable = void>
+struct has_non_finite_hook : std::false_type {};
+
+/*!
+ * \copydoc has_non_finite_hook
+ */
+template <typename W>
+struct has_non_finite_hook<W, std::void_t<decltype(std::declval<W&>().ft_non_finite(size_t(), std::declval<const numerical_fault&>()))>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a trainer checks the numerical health of the
+ * training
+ */
+template <typename T, typename Enable = void>
+struct has_numerical_health : std::false_type {};
+
+/*!
+ * \copydoc has_numerical_health
+ */
+template <typename T>
+struct has_numerical_health<T, std::void_t<decltype(std::declval<const T&>().health)>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a trainer can skip the computation of the
+ * metrics of a batch
+ */
+template <typename T, typename I, typename L, typename Enable = void>
+struct has_sampled_metrics : std::false_type {};
+
+/*!
+ * \copydoc has_sampled_metrics
+ */
+template <typename T, typename I, typename L>
+struct has_sampled_metrics<T, I, L, std::void_t<decltype(std::declval<T&>().train_batch(size_t(), std::declval<I>(), std::declval<L>(), bool()))>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a watcher can be notified of the sampled
+ * validation
+ */
+template <typename W, typename Enable = void>
+struct has_validation_hook : std::false_type {};
+
+/*!
+ * \copydoc has_validation_hook
+ */
+template <typename W>
+struct has_validation_hook<W, std::void_t<decltype(std::declval<W&>().ft_validation_batches(size_t(), size_t()))>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a trainer must be notified at the end of the
+ * batches of an epoch
+ */
+template <typename T, typename Enable = void>
+struct has_end_epoch : std::false_type {};
+
+/*!
+ * \copydoc has_end_epoch
+ */
+template <typename T>
+struct has_end_epoch<T, std::void_t<decltype(std::declval<T&>().end_epoch())>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a watcher can receive the memory report of the
+ * training
+ */
+template <typename W, typename Enable = void>
+struct has_memory_hook : std::false_type {};
+
+/*!
+ * \copydoc has_memory_hook
+ */
+template <typename W>
+struct has_memory_hook<W, std::void_t<decltype(std::declval<W&>().ft_memory(std::declval<const memory_report&>()))>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a trainer or a generator can report its memory
+ */
+template <typename T, typename Enable = void>
+struct has_report_memory : std::false_type {};
+
+/*!
+ * \copydoc has_report_memory
+ */
+template <typename T>
+struct has_report_memory<T, std::void_t<decltype(std::declval<const T&>().report_memory(std::declval<memory_report&>()))>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a generator can report its memory
+ */
+template <typename G, typename Enable = void>
+struct has_generator_memory : std::false_type {};
+
+/*!
+ * \copydoc has_generator_memory
+ */
+template <typename G>
+struct has_generator_memory<G, std::void_t<decltype(std::declval<const G&>().report_memory(std::declval<memory_report&>(), std::declval<const std::string&>()))>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a trainer or a generator can store its state in
+ * the checkpoints of the training
+ */
+template <typename T, typename Enable = void>
+struct has_training_state : std::false_type {};
+
+/*!
+ * \copydoc has_training_state
+ */
+template <typename T>
+struct has_training_state<T, std::void_t<decltype(std::declval<const T&>().store_state(std::declval<std::ostream&>())),
+                                         decltype(std::declval<T&>().load_state(std::declval<std::istream&>()))>> : std::true_type {};
+
 /*!
  * \brief A generic trainer for Deep Belief Network
  *
@@ -60,6 +239,64 @@ struct dbn_trainer {
     size_t best_epoch     = 0;   ///< The best epoch
     size_t patience       = 0;   ///< The current patience
 
+    std::unique_ptr<dbn_t> snapshot; ///< The snapshot of the weights used for asynchronous validation
+
+    size_t max_epochs = 0;           ///< The maximum number of epochs of the training
+    std::vector<size_t> val_batches; ///< The fixed subset of validation batches, when the validation is sampled
+
+    std::pair<double, double> last_batch_stats; ///< The metrics of the last sampled batch
+    double sampled_error   = 0.0;               ///< The sum of the errors of the sampled batches of the epoch
+    double sampled_loss    = 0.0;               ///< The sum of the losses of the sampled batches of the epoch
+    size_t sampled_batches = 0;                 ///< The number of sampled batches of the epoch
+
+    bool faulted = false; ///< Indicates if a non-finite value was found during the training (with dbn.finite_checks)
+
+    timers_checkpoint epoch_timers; ///< The values of the timers at the end of the last epoch
+
+    size_t resume_batches = 0; ///< The number of batches of the epoch already trained before the resume
+
+    static constexpr size_t state_magic   = 0x444C4C5354415445; ///< The magic number of the training state ("DLLSTATE")
+    static constexpr size_t state_version = 1;                  ///< The version of the training state
+
+    /*!
+     * \brief Report the memory held by the network, the trainer and the
+     * given generators, after the first epoch (when the caches have been
+     * allocated) to the watcher, and record its peak after each epoch
+     * \param dbn The network being trained
+     * \param epoch The current epoch
+     * \param generators The generators of the training
+     */
+    template <typename... Generators>
+    void report_epoch_memory(const dbn_t& dbn, size_t epoch, const Generators&... generators) {
+        memory_report report;
+
+        dbn.report_memory(report);
+
+        if constexpr (has_report_memory<trainer_t<dbn_t>>::value) {
+            trainer->report_memory(report);
+        }
+
+        size_t g = 0;
+
+        auto add_generator = [&](auto& generator) {
+            if constexpr (has_generator_memory<std::decay_t<decltype(generator)>>::value) {
+                generator.report_memory(report, g ? "val_generator" : "generator");
+            }
+
+            ++g;
+        };
+
+        (add_generator(generators), ...);
+
+        report.record_peak();
+
+        if constexpr (has_memory_hook<watcher_t<dbn_t>>::value) {
+            if (epoch == 0) {
+                watcher.ft_memory(report);
+            }
+        }
+    }
+
     /*!
      * \brief Initialize the training
      * \param dbn The network to train
@@ -74,6 +311,10 @@ struct dbn_trainer {
 
         watcher.fine_tuning_begin(dbn, max_epochs);
 
+        if constexpr (has_timers_hook<watcher_t<dbn_t>>::value) {
+            epoch_timers.reset();
+        }
+
         trainer = std::make_unique<trainer_t<dbn_t>>(dbn);
 
         //Initialize the trainer if necessary
@@ -85,6 +326,12 @@ struct dbn_trainer {
 
         current_val_error = 0.0;
         current_val_loss = 0.0;
+
+        this->max_epochs = max_epochs;
+
+        faulted = false;
+
+        val_batches.clear();
     }
 
     /*!
@@ -97,7 +344,9 @@ struct dbn_trainer {
      * \return the final error
      */
     error_type stop_training(dbn_t& dbn, size_t epoch, size_t max_epochs){
-        // Depending on the strategy, try to restore the best weights
+        // Depending on the strategy, try to restore the best weights. The
+        // training is over, so the best weights are swapped in rather than
+        // copied back, which also holds for the early stops below
 
         if(epoch == max_epochs){
             // The early stopping strategy
@@ -105,7 +354,7 @@ struct dbn_trainer {
 
             if constexpr (s != strategy::NONE) {
                 if(best_epoch < max_epochs - 1){
-                    dbn.restore_weights();
+                    reported(dbn).swap_weights();
 
                     if (is_error(s)) {
                         dbn.out << "Restore the best (error) weights from epoch " << best_epoch << std::endl;
@@ -121,6 +370,29 @@ struct dbn_trainer {
         return current_error;
     }
 
+    /*!
+     * \brief Returns the network holding the weights of the last reported
+     * epoch. With asynchronous validation, this is the snapshot, otherwise
+     * this is the trained network itself.
+     * \param dbn The network being trained
+     */
+    dbn_t& reported(dbn_t& dbn){
+        return snapshot ? *snapshot : dbn;
+    }
+
+    /*!
+     * \brief Copy the weights of a network into another network of the
+     * same type
+     * \param source The network to copy the weights from
+     * \param target The network to copy the weights to
+     */
+    static void copy_weights(const dbn_t& source, dbn_t& target){
+        std::stringstream stream;
+
+        source.store(stream);
+        target.load(stream);
+    }
+
     /*!
      * \brief Start a new epoch
      * \param dbn The network that is trained
@@ -157,14 +429,14 @@ struct dbn_trainer {
                     best_error = error;
                     best_epoch = epoch;
 
-                    dbn.backup_weights();
+                    reported(dbn).backup_weights();
                 }
             } else {
                 if(!epoch || loss < best_loss){
                     best_loss = loss;
                     best_epoch = epoch;
 
-                    dbn.backup_weights();
+                    reported(dbn).backup_weights();
                 }
             }
         }
@@ -178,7 +450,7 @@ struct dbn_trainer {
                     dbn.out << "Stopping: Loss below goal";
 
                     if(epoch != best_epoch){
-                        dbn.restore_weights();
+                        reported(dbn).swap_weights();
 
                         dbn.out << ", restore weights from epoch " << best_epoch;
                     }
@@ -194,7 +466,7 @@ struct dbn_trainer {
                     dbn.out << "Stopping: Error below goal";
 
                     if(epoch != best_epoch){
-                        dbn.restore_weights();
+                        reported(dbn).swap_weights();
 
                         dbn.out << ", restore weights from epoch " << best_epoch;
                     }
@@ -213,7 +485,7 @@ struct dbn_trainer {
                         dbn.out << "Stopping: Loss has been increasing for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            reported(dbn).swap_weights();
 
                             dbn.out << ", restore weights from epoch " << best_epoch;
                         }
@@ -235,7 +507,7 @@ struct dbn_trainer {
                         dbn.out << "Stopping: Error has been increasing for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            reported(dbn).swap_weights();
 
                             dbn.out << ", restore weights from epoch " << best_epoch;
                         }
@@ -257,7 +529,7 @@ struct dbn_trainer {
                         dbn.out << "Stopping: Loss has been increasing (from best) for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            reported(dbn).swap_weights();
 
                             dbn.out << ", restore weights from epoch " << best_epoch;
                         }
@@ -279,7 +551,7 @@ struct dbn_trainer {
                         dbn.out << "Stopping: Error has been increasing (from best) for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            reported(dbn).swap_weights();
 
                             dbn.out << ", restore weights from epoch " << best_epoch;
                         }
@@ -298,6 +570,79 @@ struct dbn_trainer {
         return false;
     }
 
+    /*!
+     * \brief Gradually prune the dense layers at the end of an epoch, the
+     * ratio of pruned weights following a cubic schedule up to
+     * pruning_sparsity after pruning_epochs epochs.
+     * \param dbn The network that is trained
+     * \param epoch The current epoch
+     */
+    void prune_epoch(dbn_t& dbn, size_t epoch){
+        if (dbn.pruning_sparsity > 0.0) {
+            const double p = std::min(1.0, double(epoch + 1) / double(std::max(size_t(1), dbn.pruning_epochs)));
+
+            dbn.prune(dbn.pruning_sparsity * (1.0 - std::pow(1.0 - p, 3.0)));
+        }
+    }
+
+    /*!
+     * \brief Report the deltas of the timers since the last reported epoch
+     * to the watcher, just before the end of the epoch
+     * \param epoch The reported epoch
+     */
+    void report_timers(size_t epoch){
+        if constexpr (has_timers_hook<watcher_t<dbn_t>>::value) {
+            watcher.ft_epoch_timers(epoch, epoch_timers.next());
+        } else {
+            cpp_unused(epoch);
+        }
+    }
+
+    /*!
+     * \brief Report the first non-finite value found by the trainer, without
+     * ending the line
+     */
+    void report_non_finite(dbn_t& dbn){
+        if constexpr (has_numerical_health<trainer_t<dbn_t>>::value) {
+            auto& fault = trainer->health;
+
+            dbn.out << "Stopping: Non-finite " << to_string(fault.stage) << " of layer " << fault.layer << " at iteration " << fault.iteration;
+        } else {
+            cpp_unused(dbn);
+        }
+    }
+
+    /*!
+     * \brief Stop the training after a non-finite value, restoring the best
+     * weights of the previous epochs when they were saved by the early
+     * stopping strategy
+     * \param dbn The network that is trained
+     * \param epoch The current epoch
+     * \return true if the training must be stopped
+     */
+    bool stop_non_finite(dbn_t& dbn, size_t epoch){
+        if (!faulted) {
+            return false;
+        }
+
+        report_non_finite(dbn);
+
+        // The weights are saved by the early stopping from the first epoch
+        if constexpr (dbn_t::early != strategy::NONE) {
+            if (epoch) {
+                reported(dbn).swap_weights();
+
+                dbn.out << ", restore weights from epoch " << best_epoch;
+            }
+        } else {
+            cpp_unused(epoch);
+        }
+
+        dbn.out << std::endl;
+
+        return true;
+    }
+
     /*!
      * \brief Indicates the end of an epoch
      * \param dbn The network that is trained
@@ -312,6 +657,10 @@ struct dbn_trainer {
             dbn.momentum = dbn.final_momentum;
         }
 
+        prune_epoch(dbn, epoch);
+
+        report_timers(epoch);
+
         watcher.ft_epoch_end(epoch, error, loss, dbn);
 
         // Early stopping with training error/loss
@@ -333,13 +682,30 @@ struct dbn_trainer {
      * \return true if the training is over
      */
     bool stop_epoch(dbn_t& dbn, size_t epoch, const std::pair<double, double>& train_stats, const std::pair<double, double>& val_stats){
-        double error = train_stats.first;
-
         //After some time increase the momentum
         if (dbn_traits<dbn_t>::updater() == updater_type::MOMENTUM && epoch == dbn.final_momentum_epoch) {
             dbn.momentum = dbn.final_momentum;
         }
 
+        prune_epoch(dbn, epoch);
+
+        return report_epoch(dbn, epoch, train_stats, val_stats);
+    }
+
+    /*!
+     * \brief Report the statistics of an epoch to the watcher and to the
+     * early stopping strategy
+     * \param dbn The network that is trained
+     * \param epoch The reported epoch
+     * \param train_stats The training error and loss of the epoch
+     * \param val_stats The validation error and loss of the epoch
+     * \return true if the training is over
+     */
+    bool report_epoch(dbn_t& dbn, size_t epoch, const std::pair<double, double>& train_stats, const std::pair<double, double>& val_stats){
+        double error = train_stats.first;
+
+        report_timers(epoch);
+
         watcher.ft_epoch_end(epoch, error, train_stats.second, val_stats.first, val_stats.second, dbn);
 
         // Early stopping with validation (or training) error/loss
@@ -376,16 +742,426 @@ struct dbn_trainer {
         if constexpr (dbn_traits<dbn_t>::error_on_epoch()){
             dll::auto_timer timer("net:trainer:train:epoch:error");
 
-            auto forward_helper = [this, &dbn](auto&& input_batch) -> decltype(auto) {
-                return this->trainer->template forward_batch_helper<false>(dbn, input_batch);
-            };
+            // The trainer has completed its batches, the batches are
+            // evaluated in parallel with the inference of the network
+            std::tie(new_error, new_loss) = dbn.evaluate_metrics(generator);
+        }
+
+        return std::make_pair(new_error, new_loss);
+    }
+
+    /*!
+     * \brief Compute error and loss of the epoch on the training generator.
+     *
+     * When the batch metrics are sampled (dbn.batch_metrics > 1), they are
+     * estimated from the sampled batches of the epoch, computed during
+     * training (in train mode), instead of doing another pass over the
+     * training set.
+     *
+     * \param dbn The network to be used
+     * \param generator The generator to get data from
+     * \return a pair containing (error, loss)
+     */
+    template<typename Generator>
+    std::pair<double, double> compute_train_error_loss(dbn_t& dbn, Generator& generator){
+        if constexpr (dbn_traits<dbn_t>::error_on_epoch()){
+            if (dbn.batch_metrics > 1 && sampled_batches) {
+                return std::make_pair(sampled_error / sampled_batches, sampled_loss / sampled_batches);
+            }
+        }
+
+        return compute_error_loss(dbn, generator);
+    }
+
+    /*!
+     * \brief Compute error and loss on the given validation generator.
+     *
+     * When dbn.validation_samples is set, only a fixed random subset of the
+     * validation batches is evaluated, except every dbn.full_validation
+     * epochs and for the last epoch, where the full validation set is
+     * evaluated.
+     *
+     * \param dbn The network to be used
+     * \param generator The generator to get data from
+     * \param epoch The current epoch
+     * \return a pair containing (error, loss)
+     */
+    template<typename Generator>
+    std::pair<double, double> compute_val_error_loss(dbn_t& dbn, Generator& generator, size_t epoch){
+        const size_t batches = generator.batches();
 
-            std::tie(new_error, new_loss) = dbn.evaluate_metrics(generator, forward_helper);
+        const bool full = !dbn.validation_samples
+                       || dbn.validation_samples >= generator.size()
+                       || (dbn.full_validation && (epoch + 1) % dbn.full_validation == 0)
+                       || epoch + 1 == max_epochs;
+
+        if (full) {
+            if constexpr (has_validation_hook<watcher_t<dbn_t>>::value) {
+                watcher.ft_validation_batches(batches, batches);
+            }
+
+            return compute_error_loss(dbn, generator);
+        }
+
+        // The subset is drawn once, to keep the signal comparable between epochs
+        if (val_batches.empty()) {
+            const size_t n = std::min(batches, std::max<size_t>(1, (dbn.validation_samples * batches + generator.size() - 1) / generator.size()));
+
+            val_batches.resize(batches);
+            std::iota(val_batches.begin(), val_batches.end(), 0);
+            std::shuffle(val_batches.begin(), val_batches.end(), dll::rand_engine());
+
+            val_batches.resize(n);
+            std::sort(val_batches.begin(), val_batches.end());
+        }
+
+        if constexpr (has_validation_hook<watcher_t<dbn_t>>::value) {
+            watcher.ft_validation_batches(val_batches.size(), batches);
+        }
+
+        double new_error =  1.0;
+        double new_loss  = -1.0;
+
+        if constexpr (dbn_traits<dbn_t>::error_on_epoch()){
+            dll::auto_timer timer("net:trainer:train:epoch:error");
+
+            std::tie(new_error, new_loss) = dbn.evaluate_metrics_batches(generator, val_batches);
         }
 
         return std::make_pair(new_error, new_loss);
     }
 
+    /*!
+     * \brief Train the network on one batch
+     * \param input The input batch
+     * \param labels The label batch
+     * \param epoch The current epoch
+     * \param batch The index of the batch in the epoch
+     * \param batches The number of batches of the epoch
+     */
+    template <typename Input, typename Labels>
+    void train_one_batch(dbn_t& dbn, Input&& input, Labels&& labels, size_t epoch, size_t batch, size_t batches) {
+        dll::auto_timer timer("net:trainer:train:epoch:batch");
+
+        watcher.ft_batch_start(epoch, dbn);
+
+        std::pair<double, double> batch_stats;
+
+        // The metrics of the batch are only computed every N batches
+        bool sampled = true;
+
+        if constexpr (has_sampled_metrics<trainer_t<dbn_t>, Input, Labels>::value) {
+            sampled = dbn.batch_metrics && batch % dbn.batch_metrics == 0;
+
+            batch_stats = trainer->train_batch(epoch, std::forward<Input>(input), std::forward<Labels>(labels), sampled);
+        } else {
+            batch_stats = trainer->train_batch(epoch, std::forward<Input>(input), std::forward<Labels>(labels));
+        }
+
+        if (sampled) {
+            last_batch_stats = batch_stats;
+
+            sampled_error += batch_stats.first;
+            sampled_loss += batch_stats.second;
+            ++sampled_batches;
+        }
+
+        watcher.ft_batch_end(epoch, batch, batches, last_batch_stats.first, last_batch_stats.second, dbn);
+
+        // The remaining batches are not trained after a non-finite value
+        if constexpr (has_numerical_health<trainer_t<dbn_t>>::value) {
+            if (!faulted && trainer->health) {
+                faulted = true;
+
+                if constexpr (has_non_finite_hook<watcher_t<dbn_t>>::value) {
+                    watcher.ft_non_finite(epoch, trainer->health);
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Take a checkpoint in the background after the given batch, if
+     * one is due.
+     *
+     * The checkpoint holds the weights followed by the state of the
+     * training. With asynchronous validation, the statistics of the last
+     * epoch are not known yet and only the weights are stored.
+     *
+     * \param dbn The network being trained
+     * \param generator The training generator
+     * \param epoch The current epoch
+     * \param batch The batch that has just been trained
+     */
+    template <typename Generator>
+    void checkpoint_batch(dbn_t& dbn, Generator& generator, size_t epoch, size_t batch) {
+        if (dbn.checkpoints && dbn.checkpoints->due() && !faulted) {
+            std::string file;
+
+            if (snapshot) {
+                file = dbn.store_async(*dbn.checkpoints);
+            } else {
+                file = dbn.checkpoints->checkpoint(dbn, [&](std::ostream& os) {
+                    store_training_state(dbn, generator, os, epoch, batch + 1);
+                });
+            }
+
+            if constexpr (has_checkpoint_hook<watcher_t<dbn_t>>::value) {
+                watcher.ft_checkpoint(epoch, batch, file);
+            }
+        }
+    }
+
+    /*!
+     * \brief Indicates if the given state, following the weights of a
+     * checkpoint, is a state of the training
+     */
+    static bool is_training_state(const std::string& state) {
+        size_t magic = 0;
+
+        if (state.size() >= sizeof(magic)) {
+            std::copy_n(state.data(), sizeof(magic), reinterpret_cast<char*>(&magic));
+        }
+
+        return magic == state_magic;
+    }
+
+    /*!
+     * \brief Store the state of the training into the given stream: the
+     * position in the epoch, the state of the early stopping (with the best
+     * weights) and of the sampled metrics, the momentum and learning rate,
+     * the random generator, the trainer (updater) and the order of the
+     * generator
+     *
+     * \param dbn The network being trained
+     * \param generator The training generator
+     * \param os The output stream
+     * \param epoch The current epoch
+     * \param next The next batch to train in the epoch
+     */
+    template <typename Generator>
+    void store_training_state(dbn_t& dbn, const Generator& generator, std::ostream& os, size_t epoch, size_t next) {
+        cpp::binary_write(os, state_magic);
+        cpp::binary_write(os, state_version);
+        cpp::binary_write(os, epoch);
+        cpp::binary_write(os, next);
+
+        cpp::binary_write(os, current_error);
+        cpp::binary_write(os, current_loss);
+        cpp::binary_write(os, current_val_error);
+        cpp::binary_write(os, current_val_loss);
+        cpp::binary_write(os, best_error);
+        cpp::binary_write(os, best_loss);
+        cpp::binary_write(os, best_epoch);
+        cpp::binary_write(os, patience);
+
+        cpp::binary_write(os, last_batch_stats.first);
+        cpp::binary_write(os, last_batch_stats.second);
+        cpp::binary_write(os, sampled_error);
+        cpp::binary_write(os, sampled_loss);
+        cpp::binary_write(os, sampled_batches);
+
+        cpp::binary_write(os, val_batches.size());
+        cpp::binary_write_all(os, val_batches);
+
+        cpp::binary_write(os, dbn.momentum);
+        cpp::binary_write(os, dbn.learning_rate);
+
+        // The best weights are saved by the early stopping from the first epoch
+        const bool best = dbn_t::early != strategy::NONE && epoch;
+
+        cpp::binary_write(os, best);
+
+        if (best) {
+            dbn.swap_weights();
+            dbn.store(os);
+            dbn.swap_weights();
+        }
+
+        store_random_state(os);
+
+        if constexpr (has_training_state<trainer_t<dbn_t>>::value) {
+            trainer->store_state(os);
+        }
+
+        if constexpr (has_training_state<Generator>::value) {
+            generator.store_state(os);
+        }
+    }
+
+    /*!
+     * \brief Restore the state of the training loaded by dbn.resume, if any,
+     * once the training has been started
+     *
+     * \param dbn The network being trained
+     * \param generator The training generator
+     * \return The epoch from which the training is resumed
+     */
+    template <typename Generator>
+    size_t resume_training(dbn_t& dbn, Generator& generator) {
+        if (dbn.resume_state.empty()) {
+            return 0;
+        }
+
+        std::istringstream is(std::move(dbn.resume_state));
+
+        dbn.resume_state.clear();
+
+        size_t magic   = 0;
+        size_t version = 0;
+        size_t epoch   = 0;
+
+        cpp::binary_load(is, magic);
+        cpp::binary_load(is, version);
+
+        cpp_assert(magic == state_magic && version == state_version, "Invalid state of the training");
+
+        cpp::binary_load(is, epoch);
+        cpp::binary_load(is, resume_batches);
+
+        cpp::binary_load(is, current_error);
+        cpp::binary_load(is, current_loss);
+        cpp::binary_load(is, current_val_error);
+        cpp::binary_load(is, current_val_loss);
+        cpp::binary_load(is, best_error);
+        cpp::binary_load(is, best_loss);
+        cpp::binary_load(is, best_epoch);
+        cpp::binary_load(is, patience);
+
+        cpp::binary_load(is, last_batch_stats.first);
+        cpp::binary_load(is, last_batch_stats.second);
+        cpp::binary_load(is, sampled_error);
+        cpp::binary_load(is, sampled_loss);
+        cpp::binary_load(is, sampled_batches);
+
+        size_t n_val = 0;
+        cpp::binary_load(is, n_val);
+        val_batches.resize(n_val);
+        cpp::binary_load_all(is, val_batches);
+
+        cpp::binary_load(is, dbn.momentum);
+        cpp::binary_load(is, dbn.learning_rate);
+
+        bool best = false;
+        cpp::binary_load(is, best);
+
+        // The trained weights are kept in the backup while the best weights are loaded
+        if (best) {
+            dbn.backup_weights();
+            dbn.load(is);
+            dbn.swap_weights();
+        }
+
+        load_random_state(is);
+
+        if constexpr (has_training_state<trainer_t<dbn_t>>::value) {
+            trainer->load_state(is);
+        }
+
+        if constexpr (has_training_state<Generator>::value) {
+            generator.load_state(is);
+        }
+
+        dbn.out << "Resume the training at epoch " << epoch << ", batch " << resume_batches << std::endl;
+
+        return epoch;
+    }
+
+    /*!
+     * \brief Reset the generator at the beginning of an epoch, with the
+     * shuffle of the samples if necessary. The order of the samples of a
+     * resumed epoch is the one of the checkpoint.
+     */
+    template <typename Generator>
+    void reset_epoch(Generator& generator) {
+        if (resume_batches) {
+            generator.reset();
+        } else {
+            reset_shuffle(generator);
+        }
+    }
+
+    /*!
+     * \brief Skip the batches of the resumed epoch already trained before
+     * the checkpoint
+     */
+    template <typename Generator>
+    void skip_resumed_batches(Generator& generator) {
+        for (; resume_batches && generator.has_next_batch(); --resume_batches) {
+            generator.next_batch();
+        }
+
+        resume_batches = 0;
+    }
+
+    /*!
+     * \brief Train the network for one epoch through an asynchronous
+     * pipeline of stages.
+     *
+     * A producer thread copies the batches of the generator into a fixed
+     * set of slots, which are uploaded to the GPU by their own thread when
+     * ETL uses one, while this thread trains the network on the slots, in
+     * order. The generator is only used by the producer during the epoch.
+     *
+     * \param generator The generator for training data
+     * \param epoch The current epoch
+     */
+    template <typename Generator>
+    void train_epoch_staged(dbn_t& dbn, Generator& generator, size_t epoch) {
+        using input_t = std::decay_t<decltype(etl::force_temporary(generator.data_batch()))>;
+        using label_t = std::decay_t<decltype(etl::force_temporary(generator.label_batch()))>;
+
+        struct batch_slot {
+            input_t input;    ///< The input batch
+            label_t labels;   ///< The label batch
+            size_t batch = 0; ///< The index of the batch in the epoch
+        };
+
+        const size_t batches = generator.batches();
+
+        staged_pipeline<batch_slot> pipeline(dbn_traits<dbn_t>::staged_training(), "compute");
+
+#ifdef ETL_GPU
+        pipeline.add_stage("upload", 1, [](batch_slot& slot) {
+            slot.input.ensure_gpu_up_to_date();
+            slot.labels.ensure_gpu_up_to_date();
+        });
+#endif
+
+        pipeline.start("load", [&generator](batch_slot& slot) {
+            if (!generator.has_next_batch()) {
+                return false;
+            }
+
+            copy_batch(slot.input, generator.data_batch());
+            copy_batch(slot.labels, generator.label_batch());
+
+            slot.batch = generator.current_batch();
+
+            generator.next_batch();
+
+            return true;
+        });
+
+        while (auto* slot = pipeline.next()) {
+            train_one_batch(dbn, slot->input, slot->labels, epoch, slot->batch, batches);
+
+            checkpoint_batch(dbn, generator, epoch, slot->batch);
+
+            pipeline.release(slot);
+
+            if (faulted) {
+                break;
+            }
+        }
+
+        pipeline.stop();
+
+        if constexpr (has_stage_stats_hook<watcher_t<dbn_t>>::value) {
+            watcher.ft_stage_stats(pipeline.stats());
+        }
+    }
+
     /*!
      * \brief Train the network for one epoch
      * \param generator The generator for training data
@@ -396,20 +1172,37 @@ struct dbn_trainer {
         // Set the generator in train mode
         generator.set_train();
 
-        //Train one mini-batch at a time
-        while(generator.has_next_batch()){
-            dll::auto_timer timer("net:trainer:train:epoch:batch");
+        // The sums of a resumed epoch are the ones of the checkpoint
+        if (resume_batches) {
+            skip_resumed_batches(generator);
+        } else {
+            sampled_error   = 0.0;
+            sampled_loss    = 0.0;
+            sampled_batches = 0;
+        }
 
-            watcher.ft_batch_start(epoch, dbn);
+        if constexpr (dbn_traits<dbn_t>::staged_training() > 0) {
+            train_epoch_staged(dbn, generator, epoch);
+        } else {
+            //Train one mini-batch at a time
+            while(generator.has_next_batch() && !faulted){
+                train_one_batch(dbn, generator.data_batch(), generator.label_batch(), epoch, generator.current_batch(), generator.batches());
 
-            auto [batch_error, batch_loss] = trainer->train_batch(
-                epoch,
-                generator.data_batch(),
-                generator.label_batch());
+                checkpoint_batch(dbn, generator, epoch, generator.current_batch());
 
-            watcher.ft_batch_end(epoch, generator.current_batch(), generator.batches(), batch_error, batch_loss, dbn);
+                generator.next_batch();
+            }
+        }
 
-            generator.next_batch();
+        // Let the trainer complete the batches still in flight
+        if constexpr (has_end_epoch<trainer_t<dbn_t>>::value) {
+            trainer->end_epoch();
+        }
+
+        // Report the statistics of the pipeline, before the generator is
+        // used again to compute the error
+        if constexpr (has_generator_stats<Generator>::value && has_stats_hook<watcher_t<dbn_t>>::value) {
+            watcher.ft_generator_stats(generator.stats());
         }
     }
 
@@ -428,7 +1221,7 @@ struct dbn_trainer {
         train_epoch_only(dbn, generator, epoch);
 
         // Compute the error at this epoch
-        return compute_error_loss(dbn, generator);
+        return compute_train_error_loss(dbn, generator);
     }
 
     /*!
@@ -448,10 +1241,10 @@ struct dbn_trainer {
         train_epoch_only(dbn, train_generator, epoch);
 
         // Compute the training error at this epoch
-        auto train_stats = compute_error_loss(dbn, train_generator);
+        auto train_stats = compute_train_error_loss(dbn, train_generator);
 
-        // Compute the training error at this epoch
-        auto val_stats = compute_error_loss(dbn, val_generator);
+        // Compute the validation error at this epoch
+        auto val_stats = compute_val_error_loss(dbn, val_generator, epoch);
 
         // Return the stats
         return std::make_pair(train_stats, val_stats);
@@ -484,7 +1277,7 @@ struct dbn_trainer {
 
         //Train the model for max_epochs epoch
 
-        size_t epoch = 0;
+        size_t epoch = resume_training(dbn, generator);
         for (; epoch < max_epochs; ++epoch) {
             dll::auto_timer timer("net:trainer:train:epoch");
 
@@ -492,7 +1285,7 @@ struct dbn_trainer {
                 dll::auto_timer timer("net:trainer:train:epoch:prepare");
 
                 // Shuffle before the epoch if necessary
-                reset_shuffle(generator);
+                reset_epoch(generator);
 
                 // This will ensure maximum performance for the training
                 generator.prepare_epoch();
@@ -502,7 +1295,9 @@ struct dbn_trainer {
 
             auto [error, loss] = train_epoch(dbn, generator, epoch);
 
-            if(stop_epoch(dbn, epoch, error, loss)){
+            report_epoch_memory(dbn, epoch, generator);
+
+            if(stop_non_finite(dbn, epoch) || stop_epoch(dbn, epoch, error, loss)){
                 break;
             }
         }
@@ -524,6 +1319,10 @@ struct dbn_trainer {
      */
     template <typename TrainGenerator, typename ValGenerator>
     error_type train(DBN& dbn, TrainGenerator& train_generator, ValGenerator& val_generator, size_t max_epochs) {
+        if constexpr (dbn_traits<dbn_t>::async_validation()) {
+            return train_async(dbn, train_generator, val_generator, max_epochs);
+        }
+
         dll::auto_timer timer("net:trainer:train");
 
         // The validation generator is always in test mode
@@ -534,22 +1333,20 @@ struct dbn_trainer {
 
         //Train the model for max_epochs epoch
 
-        size_t epoch = 0;
+        size_t epoch = resume_training(dbn, train_generator);
         for (; epoch < max_epochs; ++epoch) {
             dll::auto_timer timer("net:trainer:train:epoch");
 
             // Shuffle before the epoch if necessary
-            if(dbn_traits<dbn_t>::shuffle()){
-                train_generator.reset_shuffle();
-            } else {
-                train_generator.reset();
-            }
+            reset_epoch(train_generator);
 
             start_epoch(dbn, epoch);
 
             auto [train_stats, val_stats] = train_epoch(dbn, train_generator, val_generator, epoch);
 
-            if (stop_epoch(dbn, epoch, train_stats, val_stats)) {
+            report_epoch_memory(dbn, epoch, train_generator, val_generator);
+
+            if (stop_non_finite(dbn, epoch) || stop_epoch(dbn, epoch, train_stats, val_stats)) {
                 break;
             }
         }
@@ -558,6 +1355,144 @@ struct dbn_trainer {
 
         return stop_training(dbn, epoch, max_epochs);
     }
+
+    /*!
+     * \brief Train the network for max_epochs, computing the validation
+     * statistics asynchronously.
+     *
+     * At the end of each epoch, the weights are copied into a snapshot
+     * network which is evaluated on the validation set by another thread,
+     * while the next epoch is trained. The statistics of an epoch are
+     * therefore reported to the watcher and to the early stopping strategy
+     * once the next epoch has been trained. When the strategy stops the
+     * training, the network is reset to the weights of the reported epoch
+     * (or of the best epoch).
+     *
+     * \param dbn The network to be trained
+     * \param train_generator The generator for the training data
+     * \param val_generator The generator for the validation data
+     * \param max_epochs The maximum number of epochs
+     *
+     * \return The final error
+     */
+    template <typename TrainGenerator, typename ValGenerator>
+    error_type train_async(DBN& dbn, TrainGenerator& train_generator, ValGenerator& val_generator, size_t max_epochs) {
+        dll::auto_timer timer("net:trainer:train");
+
+        // The validation generator is always in test mode
+        val_generator.set_test();
+
+        // Initialization steps
+        start_training(dbn, max_epochs);
+
+        // The statistics of the epochs are still being computed at the
+        // checkpoints, so only the weights can be resumed
+        if (!dbn.resume_state.empty()) {
+            dbn.resume_state.clear();
+
+            dbn.out << "The training state is not resumed with asynchronous validation, only the weights" << std::endl;
+        }
+
+        snapshot = std::make_unique<dbn_t>();
+
+        std::future<std::pair<double, double>> val_future; // The validation of the previous epoch
+        std::pair<double, double> prev_train_stats;        // The training statistics of the previous epoch
+
+        auto launch_validation = [this, &val_generator] {
+            return std::async(std::launch::async, [this, &val_generator] {
+                double error = 1.0;
+                double loss  = -1.0;
+
+                if constexpr (dbn_traits<dbn_t>::error_on_epoch()) {
+                    SERIAL_SECTION {
+                        std::tie(error, loss) = snapshot->evaluate_metrics(val_generator);
+                    }
+                } else {
+                    cpp_unused(val_generator);
+                }
+
+                return std::make_pair(error, loss);
+            });
+        };
+
+        //Train the model for max_epochs epoch
+
+        size_t epoch = 0;
+        size_t last  = max_epochs;
+        bool stop    = false;
+
+        for (; epoch < max_epochs; ++epoch) {
+            dll::auto_timer timer("net:trainer:train:epoch");
+
+            // Shuffle before the epoch if necessary
+            reset_shuffle(train_generator);
+
+            start_epoch(dbn, epoch);
+
+            train_epoch_only(dbn, train_generator, epoch);
+
+            // The snapshot still holds the weights of the previous epoch,
+            // which are restored below
+            if (faulted) {
+                if (epoch) {
+                    val_future.wait();
+                }
+
+                report_non_finite(dbn);
+
+                if (epoch) {
+                    dbn.out << ", restore weights from epoch " << epoch - 1;
+                }
+
+                dbn.out << std::endl;
+
+                last = epoch;
+                stop = true;
+                break;
+            }
+
+            report_epoch_memory(dbn, epoch, train_generator, val_generator);
+
+            //After some time increase the momentum
+            if (dbn_traits<dbn_t>::updater() == updater_type::MOMENTUM && epoch == dbn.final_momentum_epoch) {
+                dbn.momentum = dbn.final_momentum;
+            }
+
+            prune_epoch(dbn, epoch);
+
+            auto train_stats = compute_train_error_loss(dbn, train_generator);
+
+            // Report the previous epoch, whose validation ran during this epoch
+            if (epoch && report_epoch(dbn, epoch - 1, prev_train_stats, val_future.get())) {
+                last = epoch - 1;
+                stop = true;
+                break;
+            }
+
+            copy_weights(dbn, *snapshot);
+
+            val_future       = launch_validation();
+            prev_train_stats = train_stats;
+        }
+
+        // Report the last epoch
+        if (!stop && epoch) {
+            report_epoch(dbn, epoch - 1, prev_train_stats, val_future.get());
+        }
+
+        // Finalization
+
+        auto error = stop_training(dbn, stop ? last : epoch, max_epochs);
+
+        // The snapshot holds the weights of the reported (or best) epoch
+        if (epoch) {
+            copy_weights(*snapshot, dbn);
+        }
+
+        snapshot.reset();
+
+        return error;
+    }
 };
 
 } //end of dll namespace
@@ -0,0 +1,156 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Online training of a network, one batch at a time from a stream
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+#include "dll/trainer/dbn_trainer.hpp"
+
+namespace dll {
+
+/*!
+ * \brief An online trainer, updating a network one batch at a time.
+ *
+ * The trainer of the network and its state (the contexts of the layers,
+ * the state of the updater, the accumulated gradients) are created once
+ * and kept between the batches, so that each call only trains the batch.
+ *
+ * A read-only snapshot of the network can be published for the inference
+ * on other threads while the network is trained, refreshed every N
+ * batches or on demand. The readers keep the snapshot they loaded alive,
+ * the previous snapshot is reused once it is not used anymore.
+ */
+template <typename DBN>
+struct online_trainer {
+    using dbn_t     = DBN;                                             ///< The type of network
+    using weight    = typename dbn_t::weight;                          ///< The data type of the network
+    using trainer_t = typename dbn_t::desc::template trainer_t<dbn_t>; ///< The concrete trainer
+
+    size_t refresh_every = 0; ///< The number of batches between two refreshes of the snapshot (0: only on demand)
+
+    /*!
+     * \brief Create the trainer of the given network
+     */
+    explicit online_trainer(dbn_t& dbn) : dbn(dbn) {
+        dbn.momentum = dbn.initial_momentum;
+
+        trainer = std::make_unique<trainer_t>(dbn);
+        trainer->init_training(dbn_t::batch_size);
+    }
+
+    online_trainer(const online_trainer& rhs) = delete;
+    online_trainer& operator=(const online_trainer& rhs) = delete;
+
+    /*!
+     * \brief Train the network on one batch.
+     *
+     * The labels are in the format of the training generators, i.e. one-hot
+     * encoded for classification.
+     *
+     * \param inputs The batch of inputs
+     * \param labels The batch of labels
+     *
+     * \return the (error, loss) of the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> partial_fit(const Inputs& inputs, const Labels& labels) {
+        dll::auto_timer timer("net:trainer:online:batch");
+
+        auto stats = trainer->train_batch(0, inputs, labels);
+
+        ++trained;
+
+        if (refresh_every && trained % refresh_every == 0) {
+            refresh_snapshot();
+        }
+
+        return stats;
+    }
+
+    /*!
+     * \brief Apply the updates still pending in the trainer (accumulated
+     * or pipelined gradients) to the network
+     */
+    void flush() {
+        if constexpr (has_end_epoch<trainer_t>::value) {
+            trainer->end_epoch();
+        }
+    }
+
+    /*!
+     * \brief Publish a new snapshot of the weights of the network, after
+     * the pending updates
+     */
+    void refresh_snapshot() {
+        dll::auto_timer timer("net:trainer:online:snapshot");
+
+        flush();
+
+        // Reuse the previous snapshot once no reader holds it anymore
+        std::shared_ptr<dbn_t> next;
+
+        if (spare && spare.use_count() == 1) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            next = std::move(spare);
+        } else {
+            next = std::make_shared<dbn_t>();
+        }
+
+        dbn_trainer<dbn_t>::copy_weights(dbn, *next);
+
+        std::atomic_store(&published, std::shared_ptr<const dbn_t>(next));
+
+        spare   = std::move(current);
+        current = std::move(next);
+    }
+
+    /*!
+     * \brief Returns the last published snapshot of the network, or nullptr
+     * if none was published yet. This can be called from any thread.
+     */
+    std::shared_ptr<const dbn_t> snapshot() const {
+        return std::atomic_load(&published);
+    }
+
+    /*!
+     * \brief Add the memory held by the trainer (the contexts of the layers
+     * and the state of the updater) to the given report
+     */
+    void report_memory(memory_report& report) const {
+        if constexpr (has_report_memory<trainer_t>::value) {
+            trainer->report_memory(report);
+        } else {
+            cpp_unused(report);
+        }
+    }
+
+    /*!
+     * \brief Returns the number of batches trained
+     */
+    size_t batches() const {
+        return trained;
+    }
+
+private:
+    dbn_t& dbn;                         ///< The trained network
+    std::unique_ptr<trainer_t> trainer; ///< The concrete trainer, kept between the batches
+    size_t trained = 0;                 ///< The number of batches trained
+
+    std::shared_ptr<const dbn_t> published; ///< The snapshot of the readers
+    std::shared_ptr<dbn_t> current;         ///< The published snapshot, for the writer
+    std::shared_ptr<dbn_t> spare;           ///< The previous snapshot, reused when it is released
+};
+
+} //end of dll namespace
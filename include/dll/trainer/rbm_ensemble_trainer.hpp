@@ -0,0 +1,174 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Trainer for several RBMs sharing the same pass over the data
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <tuple>
+#include <utility>
+
+#include "cpp_utils/maybe_parallel.hpp"
+
+#include "dll/trainer/rbm_trainer.hpp"
+#include "dll/util/pool_stats.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Train several RBMs in lockstep over the batches of the same
+ * generator.
+ *
+ * Each batch is read once and each RBM is trained on it by a thread of
+ * the pool, the batches are shared read-only between the threads. This is
+ * intended for hyper-parameter sweeps, where the RBMs only differ by their
+ * configuration.
+ *
+ * \tparam EnableWatcher Indicates if the watchers of the RBMs are enabled
+ * \tparam RBMs The types of the RBMs
+ */
+template <bool EnableWatcher, typename... RBMs>
+struct rbm_ensemble_trainer {
+    static constexpr size_t n_rbms = sizeof...(RBMs); ///< The number of trained RBMs
+
+    using first_rbm_t = cpp::nth_type_t<0, RBMs...>; ///< The type of the first RBM
+
+    static constexpr size_t batch_size = first_rbm_t::batch_size; ///< The batch size for pretraining
+
+    static_assert(n_rbms > 0, "The ensemble must contain at least one RBM");
+    static_assert(((RBMs::batch_size == batch_size) && ...), "The RBMs of the ensemble must have the same batch size");
+
+    std::tuple<rbm_trainer<RBMs, EnableWatcher, void>...> trainers; ///< The trainer of each RBM
+
+    cpp::thread_pool<true> pool; ///< The thread pool to train the RBMs
+
+    /*!
+     * \brief Construct a new ensemble trainer, with one thread per RBM, up
+     * to the number of threads of ETL.
+     */
+    rbm_ensemble_trainer() : pool(std::min(n_rbms, size_t(etl::threads))) {}
+
+    /*!
+     * \brief Train the RBMs with the data from the generator
+     * \param generator The generator to use for data
+     * \param max_epochs The maximum number of epochs for training
+     * \param rbms The RBMs to train
+     * \return The last reconstruction error of each RBM
+     */
+    template <typename Generator, cpp_enable_iff(is_generator<Generator>)>
+    std::array<double, n_rbms> train(Generator& generator, size_t max_epochs, RBMs&... rbms) {
+        return train_impl(generator, max_epochs, std::index_sequence_for<RBMs...>{}, rbms...);
+    }
+
+    /*!
+     * \brief Train the RBMs with the data from the given container
+     * \param training_data the training data
+     * \param max_epochs The maximum number of epochs for training
+     * \param rbms The RBMs to train
+     * \return The last reconstruction error of each RBM
+     */
+    template <typename Input, cpp_enable_iff(!is_generator<Input>)>
+    std::array<double, n_rbms> train(const Input& training_data, size_t max_epochs, RBMs&... rbms) {
+        // Create a single generator around the data
+        auto generator = make_generator(training_data, training_data, training_data.size(), typename first_rbm_t::generator_t{});
+
+        generator->set_safe();
+
+        return train(*generator, max_epochs, rbms...);
+    }
+
+private:
+    template <typename Generator, size_t... I>
+    std::array<double, n_rbms> train_impl(Generator& generator, size_t max_epochs, std::index_sequence<I...> /*seq*/, RBMs&... rbms) {
+        dll::auto_timer timer("rbm_ensemble_trainer:train");
+
+        static_assert(Generator::batch_size == batch_size, "Invalid batch size for generator");
+
+        auto rbm_tuple = std::tie(rbms...);
+
+        //Initialize the RBMs and the training parameters
+        (std::get<I>(trainers).init_training(std::get<I>(rbm_tuple), generator), ...);
+
+        //Some RBM may init weights based on the training data
+        auto init_weights = [&generator](auto& rbm) {
+            if constexpr (rbm_layer_traits<std::decay_t<decltype(rbm)>>::init_weights()) {
+                rbm.init_weights(generator);
+            }
+        };
+
+        (init_weights(std::get<I>(rbm_tuple)), ...);
+
+        //Allocate the trainers
+        auto cd_trainers = std::make_tuple(std::get<I>(trainers).get_trainer(std::get<I>(rbm_tuple))...);
+
+        constexpr bool shuffle = (rbm_layer_traits<RBMs>::has_shuffle() || ...);
+
+        //Train for max_epochs epoch
+        for (size_t epoch = 0; epoch < max_epochs; ++epoch) {
+            //Shuffle if necessary
+            if (shuffle) {
+                generator.reset_shuffle();
+            } else {
+                generator.reset();
+            }
+
+            // Set the the generator in train mode
+            generator.set_train();
+
+            //Create a new context for this epoch, for each RBM
+            std::array<rbm_training_context, n_rbms> contexts;
+
+            (std::get<I>(trainers).init_epoch(), ...);
+
+            //Train all the RBMs on each batch, read only once
+            while (generator.has_next_batch()) {
+                auto input    = generator.data_batch();
+                auto expected = generator.label_batch();
+
+                auto train_one = [&](auto i) {
+                    constexpr size_t J = decltype(i)::value;
+
+                    SERIAL_SECTION {
+                        std::get<J>(trainers).train_batch(input, expected, std::get<J>(cd_trainers), contexts[J], std::get<J>(rbm_tuple));
+                    }
+                };
+
+                dll::maybe_parallel_foreach_n(pool, 0, n_rbms, [&train_one](size_t r) {
+                    ((r == I ? train_one(std::integral_constant<size_t, I>{}) : void()), ...);
+                });
+
+                generator.next_batch();
+            }
+
+            //Finalize the current epoch
+            (std::get<I>(trainers).finalize_epoch(epoch, contexts[I], std::get<I>(rbm_tuple)), ...);
+        }
+
+        return {{double(std::get<I>(trainers).finalize_training(std::get<I>(rbm_tuple)))...}};
+    }
+};
+
+/*!
+ * \brief Train several RBMs in lockstep over the same data, see
+ * rbm_ensemble_trainer.
+ * \param data The generator or the container of the training data
+ * \param max_epochs The maximum number of epochs for training
+ * \param rbms The RBMs to train
+ * \return The last reconstruction error of each RBM
+ */
+template <bool EnableWatcher = true, typename Data, typename... RBMs>
+std::array<double, sizeof...(RBMs)> train_rbm_ensemble(Data& data, size_t max_epochs, RBMs&... rbms) {
+    rbm_ensemble_trainer<EnableWatcher, RBMs...> trainer;
+    return trainer.train(data, max_epochs, rbms...);
+}
+
+} //end of dll namespace
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <memory>
 
 #include "cpp_utils/algorithm.hpp"
@@ -71,6 +72,8 @@ struct rbm_trainer {
     size_t total_batches  = 0;   ///< The total number of batches
     error_type last_error = 0.0; ///< The last training error
 
+    timers_checkpoint epoch_timers; ///< The values of the timers at the end of the last epoch
+
     //Note: input_first/input_last only relevant for its size, not
     //values since they can point to the input of the first level
     //and not the current level
@@ -97,6 +100,10 @@ struct rbm_trainer {
         total_batches = size / batch_size;
 
         last_error = 0.0;
+
+        if (EnableWatcher) {
+            epoch_timers.reset();
+        }
     }
 
     /*!
@@ -192,8 +199,9 @@ struct rbm_trainer {
         context.sparsity += context.batch_sparsity;
 
         if constexpr (EnableWatcher && rbm_layer_traits<rbm_t>::free_energy()) {
-            for (auto& v : input) {
-                context.free_energy += rbm.free_energy(v);
+            if (rbm.monitor_batches && (batches - 1) % rbm.monitor_batches == 0) {
+                context.free_energy += rbm.free_energy_batch(input);
+                samples += etl::dim<0>(input);
             }
         }
 
@@ -206,7 +214,7 @@ struct rbm_trainer {
         //Average all the gathered information
         context.reconstruction_error /= batches;
         context.sparsity /= batches;
-        context.free_energy /= samples;
+        context.free_energy /= std::max(samples, size_t(1));
 
         //After some time increase the momentum
         if (rbm_layer_traits<rbm_t>::has_momentum() && epoch == rbm.final_momentum_epoch) {
@@ -215,6 +223,8 @@ struct rbm_trainer {
 
         //Notify the watcher
         if (EnableWatcher) {
+            context.timers = epoch_timers.next();
+
             watcher.epoch_end(epoch, context, rbm);
         }
 
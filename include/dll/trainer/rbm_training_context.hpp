@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include "dll/util/timers.hpp"
+
 namespace dll {
 
 /*!
@@ -23,6 +25,8 @@ struct rbm_training_context {
 
     double batch_error    = 0.0; ///< The mean reconstruction error for the last batch
     double batch_sparsity = 0.0; ///< The mean sparsity for the last batch
+
+    timers_delta timers; ///< The timers used during the epoch
 };
 
 } //end of dll namespace
@@ -15,10 +15,31 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <unordered_map>
+#include <future>
+#include <new>
+#include <vector>
+
+#include "cpp_utils/io.hpp"
 #include "cpp_utils/tuple_utils.hpp"
+#include "cpp_utils/maybe_parallel.hpp"
 
 #include "dll/trainer/context_fwd.hpp" // For sgd_context
+#include "dll/util/arena.hpp"          // For arena_scope
+#include "dll/util/batch_norm.hpp"     // For is_batch_normalization_layer_v
+#include "dll/util/branches.hpp"       // For for_each_branch
 #include "dll/util/checks.hpp"         // For NaN checks
+#include "dll/util/huge_pages.hpp"     // For advise_huge_pages
+#include "dll/util/gpu_resident.hpp"   // For upload_gpu
+#include "dll/util/labels.hpp"         // For is_index_labels
+#include "dll/util/memory.hpp"         // For memory_report
+#include "dll/util/multiversion.hpp"   // For vectorized_for
+#include "dll/util/pool_stats.hpp"     // For maybe_parallel_foreach_n
+#include "dll/util/pruning.hpp"        // For is_prunable_layer_v
 #include "dll/util/timers.hpp"         // For auto_timer
 
 namespace dll {
@@ -32,6 +53,31 @@ static constexpr bool is_merge_layer = cpp::is_specialization_of_v<dll::merge_la
 template <typename Layer>
 static constexpr bool is_utility_layer = is_group_layer<Layer> || is_merge_layer<Layer>;
 
+/*!
+ * \brief Traits to test if a layer has a sigmoid activation function
+ */
+template <typename Layer, typename Enable = void>
+struct has_sigmoid_output : std::false_type {};
+
+/*!
+ * \copydoc has_sigmoid_output
+ */
+template <typename Layer>
+struct has_sigmoid_output<Layer, std::enable_if_t<Layer::activation_function == function::SIGMOID>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a context can hold sparse gradients, only
+ * non-zero on some rows
+ */
+template <typename Context, typename Enable = void>
+struct has_sparse_gradients : std::false_type {};
+
+/*!
+ * \copydoc has_sparse_gradients
+ */
+template <typename Context>
+struct has_sparse_gradients<Context, std::void_t<decltype(std::declval<Context&>().rows)>> : std::true_type {};
+
 /*!
  * \brief Build the sub context for a updater context
  *
@@ -78,6 +124,22 @@ struct updater_sub_context <Layer, I, updater_type::SGD> {
 
     type grad; ///< The gradients of the variable
 
+    static constexpr size_t tensors = 1; ///< The number of tensors of the context, with the gradients
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() const {
+        return std::tie(grad);
+    }
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() {
+        return std::tie(grad);
+    }
+
     /*!
      * \brief Construct the sub_context for the given layer
      * \param layer The layer to build the context for
@@ -100,6 +162,22 @@ struct updater_sub_context <Layer, I, updater_type::MOMENTUM> {
     type grad; ///< The gradients of the variable
     type inc;  ///< The accumulated momentum cache
 
+    static constexpr size_t tensors = 2; ///< The number of tensors of the context, with the gradients
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() const {
+        return std::tie(grad, inc);
+    }
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() {
+        return std::tie(grad, inc);
+    }
+
     /*!
      * \brief Construct the sub_context for the given layer
      * \param layer The layer to build the context for
@@ -124,6 +202,22 @@ struct updater_sub_context <Layer, I, updater_type::NESTEROV> {
     type inc;      ///< The accumulated momentum cache
     type inc_prev; ///< The previous accumulated momentum cache
 
+    static constexpr size_t tensors = 3; ///< The number of tensors of the context, with the gradients
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() const {
+        return std::tie(grad, inc, inc_prev);
+    }
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() {
+        return std::tie(grad, inc, inc_prev);
+    }
+
     /*!
      * \brief Construct the sub_context for the given layer
      * \param layer The layer to build the context for
@@ -148,6 +242,22 @@ struct updater_sub_context <Layer, I, updater_type::RMSPROP> {
     type grad; ///< The gradients of the variable
     type inc;  ///< The accumulated squared gradients
 
+    static constexpr size_t tensors = 2; ///< The number of tensors of the context, with the gradients
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() const {
+        return std::tie(grad, inc);
+    }
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() {
+        return std::tie(grad, inc);
+    }
+
     /*!
      * \brief Construct the sub_context for the given layer
      * \param layer The layer to build the context for
@@ -171,6 +281,22 @@ struct updater_sub_context <Layer, I, updater_type::ADAGRAD> {
     type grad; ///< The gradients of the variable
     type inc;  ///< Accumulated gradients for adagrad
 
+    static constexpr size_t tensors = 2; ///< The number of tensors of the context, with the gradients
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() const {
+        return std::tie(grad, inc);
+    }
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() {
+        return std::tie(grad, inc);
+    }
+
     /*!
      * \brief Construct the sub_context for the given layer
      * \param layer The layer to build the context for
@@ -196,6 +322,22 @@ struct updater_sub_context <Layer, I, updater_type::ADADELTA> {
     type x;
     type v;
 
+    static constexpr size_t tensors = 4; ///< The number of tensors of the context, with the gradients
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() const {
+        return std::tie(grad, g, x, v);
+    }
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() {
+        return std::tie(grad, g, x, v);
+    }
+
     /*!
      * \brief Construct the sub_context for the given layer
      * \param layer The layer to build the context for
@@ -222,6 +364,22 @@ struct updater_sub_context <Layer, I, updater_type::ADAM> {
     type m;    ///< Estimates of the first moment of the gradient
     type v;    ///< Estimates of the second moment of the gradient
 
+    static constexpr size_t tensors = 3; ///< The number of tensors of the context, with the gradients
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() const {
+        return std::tie(grad, m, v);
+    }
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() {
+        return std::tie(grad, m, v);
+    }
+
     /*!
      * \brief Construct the sub_context for the given layer
      * \param layer The layer to build the context for
@@ -249,6 +407,22 @@ struct updater_sub_context <Layer, I, updater_type::ADAM_CORRECT> {
     type v;    ///< Estimates of the second moment of the gradient
     type vt;   ///< Corrected estimates of the second moment of the gradient
 
+    static constexpr size_t tensors = 5; ///< The number of tensors of the context, with the gradients
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() const {
+        return std::tie(grad, m, mt, v, vt);
+    }
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() {
+        return std::tie(grad, m, mt, v, vt);
+    }
+
     /*!
      * \brief Construct the sub_context for the given layer
      * \param layer The layer to build the context for
@@ -280,6 +454,22 @@ struct updater_sub_context <Layer, I, updater_type::NADAM> {
 
     double m_schedule;
 
+    static constexpr size_t tensors = 5; ///< The number of tensors of the context, with the gradients
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() const {
+        return std::tie(grad, m, mt, v, vt);
+    }
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() {
+        return std::tie(grad, m, mt, v, vt);
+    }
+
     /*!
      * \brief Construct the sub_context for the given layer
      * \param layer The layer to build the context for
@@ -309,6 +499,22 @@ struct updater_sub_context <Layer, I, updater_type::ADAMAX> {
     type m;    ///< Estimates of the first moment of the gradient
     type v;    ///< Estimates of the second moment of the gradient
 
+    static constexpr size_t tensors = 3; ///< The number of tensors of the context, with the gradients
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() const {
+        return std::tie(grad, m, v);
+    }
+
+    /*!
+     * \brief Returns all the tensors of the context, with the gradients
+     */
+    auto state() {
+        return std::tie(grad, m, v);
+    }
+
     /*!
      * \brief Construct the sub_context for the given layer
      * \param layer The layer to build the context for
@@ -352,6 +558,60 @@ struct updater_context<UT, true, Layer> {
     }
 };
 
+// TODO Activation checkpointing (recomputing the outputs of a segment
+// during the backward pass) cannot save memory as long as each layer
+// context owns its input, output and errors as fixed-size buffers that live
+// as long as the trainer. The contexts would first need to share a pool of
+// activation buffers.
+
+/*!
+ * \brief Returns the index of the layer tied to the weights of the layer L,
+ * or the number of layers when there is none
+ */
+template <typename DBN, size_t L, size_t I = 0>
+constexpr size_t tied_decoder() {
+    if constexpr (I == DBN::layers) {
+        return I;
+    } else if constexpr (is_tied_layer_v<typename DBN::template layer_type<I>>) {
+        if constexpr (DBN::template layer_type<I>::encoder == L) {
+            return I;
+        } else {
+            return tied_decoder<DBN, L, I + 1>();
+        }
+    } else {
+        return tied_decoder<DBN, L, I + 1>();
+    }
+}
+
+/*!
+ * \brief The link from the context of an encoder to the context of the layer
+ * D tied to its weights, whose gradients are accumulated into the gradients
+ * of the encoder
+ */
+template <typename DBN, size_t L, size_t D = tied_decoder<DBN, L>(), typename Enable = void>
+struct tied_link {};
+
+/*!
+ * \copydoc tied_link
+ */
+template <typename DBN, size_t L, size_t D>
+struct tied_link<DBN, L, D, std::enable_if_t<(D < DBN::layers)>> {
+    const sgd_context<DBN, typename DBN::template layer_type<D>, D>* context = nullptr; ///< The context of the tied layer
+};
+
+/*!
+ * \brief Traits to test if a context is linked to the context of a tied
+ * layer
+ */
+template <typename C, typename Enable = void>
+struct has_tied_context : std::false_type {};
+
+/*!
+ * \copydoc has_tied_context
+ */
+template <typename C>
+struct has_tied_context<C, std::void_t<decltype(std::declval<const C&>().tied.context)>> : std::true_type {};
+
 /*!
  * \brief The full SGD context, it contains the context of the layer as well as
  * the context for the SGD updater
@@ -360,10 +620,30 @@ template <typename DBN, typename Layer, size_t L>
 struct full_sgd_context : sgd_context<DBN, Layer, L> {
     using context_type = sgd_context<DBN, Layer, L>; ///< The parent context type
 
+    static constexpr size_t index = L;                                   ///< The index of the layer in the network
+    static constexpr bool frozen  = L < dbn_traits<DBN>::frozen_layers(); ///< Indicates if the layer is frozen
+
+    /*!
+     * \brief The updater context, without any state for the frozen layers
+     */
+    updater_context<DBN::updater, decay_layer_traits<Layer>::is_neural_layer() && !frozen, Layer> up;
+
+    using accumulator_t = updater_context<updater_type::SGD, decay_layer_traits<Layer>::is_neural_layer() && !frozen, Layer>; ///< The type of the gradient accumulator
+
+    /*!
+     * \brief The gradients accumulated over several batches, only allocated
+     * when gradient accumulation is used
+     */
+    std::unique_ptr<accumulator_t> acc;
+
     /*!
-     * \brief The updater context
+     * \brief The squared norms of the gradients of each variable, when they
+     * are computed with the gradients, for the clipping (negative when not
+     * available)
      */
-    updater_context<DBN::updater, decay_layer_traits<Layer>::is_neural_layer(), Layer> up;
+    std::vector<double> grad_sq_norms;
+
+    tied_link<DBN, L> tied; ///< The context of the layer tied to the weights of this layer, if any
 
     /*!
      * \brief Construct the full_sgd_context for the given layer
@@ -382,6 +662,8 @@ struct full_sgd_context <DBN, group_layer_impl<group_layer_desc<Layers...>>, L>
     using layer_t      = group_layer_impl<group_layer_desc<Layers...>>; ///< The layer
     using context_type = sgd_context<DBN, layer_t, L>;                  ///< The parent context type
 
+    static constexpr bool frozen = L < dbn_traits<DBN>::frozen_layers(); ///< Indicates if the layer is frozen
+
     static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
 
     std::tuple<full_sgd_context<DBN, Layers, L>...> sub_contexts; ///< The sub contexts
@@ -403,6 +685,8 @@ struct full_sgd_context <DBN, dyn_group_layer_impl<dyn_group_layer_desc<Layers..
     using layer_t      = dyn_group_layer_impl<dyn_group_layer_desc<Layers...>>; ///< The layer
     using context_type = sgd_context<DBN, layer_t, L>;                  ///< The parent context type
 
+    static constexpr bool frozen = L < dbn_traits<DBN>::frozen_layers(); ///< Indicates if the layer is frozen
+
     static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
 
     std::tuple<full_sgd_context<DBN, Layers, L>...> sub_contexts; ///< The sub contexts
@@ -424,14 +708,18 @@ struct full_sgd_context<DBN, merge_layer_impl<merge_layer_desc<D, Layers...>>, L
     using layer_t      = merge_layer_impl<merge_layer_desc<D, Layers...>>; ///< The layer
     using context_type = sgd_context<DBN, layer_t, L>;                     ///< The parent context type
 
+    static constexpr bool frozen = L < dbn_traits<DBN>::frozen_layers(); ///< Indicates if the layer is frozen
+
     static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
 
     std::tuple<full_sgd_context<DBN, Layers, L>...> sub_contexts; ///< The sub contexts
 
+    std::vector<typename context_type::input_type> back_errors; ///< The errors backpropagated by the branches after the first
+
     /*!
      * \brief Construct the full_sgd_context for the given layer
      */
-    full_sgd_context(const layer_t& layer) : context_type(layer), sub_contexts(layer.layers) {
+    full_sgd_context(const layer_t& layer) : context_type(layer), sub_contexts(layer.layers), back_errors(n_layers - 1, this->input) {
         // Nothing else to init
     }
 };
@@ -445,29 +733,101 @@ struct full_sgd_context<DBN, dyn_merge_layer_impl<dyn_merge_layer_desc<D, Layers
     using layer_t      = dyn_merge_layer_impl<dyn_merge_layer_desc<D, Layers...>>; ///< The layer
     using context_type = sgd_context<DBN, layer_t, L>;                     ///< The parent context type
 
+    static constexpr bool frozen = L < dbn_traits<DBN>::frozen_layers(); ///< Indicates if the layer is frozen
+
     static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
 
     std::tuple<full_sgd_context<DBN, Layers, L>...> sub_contexts; ///< The sub contexts
 
+    std::vector<typename context_type::input_type> back_errors; ///< The errors backpropagated by the branches after the first
+
     /*!
      * \brief Construct the full_sgd_context for the given layer
      */
-    full_sgd_context(const layer_t& layer) : context_type(layer), sub_contexts(layer.layers) {
+    full_sgd_context(const layer_t& layer) : context_type(layer), sub_contexts(layer.layers), back_errors(n_layers - 1, this->input) {
         // Nothing else to init
     }
 };
 
 /*!
- * \brief Build the context for a DBN for the given sequence of layers
+ * \brief Compute the offsets of consecutive objects of the given sizes and
+ * alignments in a single block of memory.
+ * \return the offset of each object, followed by the total size
+ */
+template <size_t N>
+constexpr std::array<size_t, N + 1> plan_offsets(const std::array<size_t, N>& sizes, const std::array<size_t, N>& aligns) {
+    std::array<size_t, N + 1> offsets{};
+
+    size_t offset = 0;
+
+    for (size_t i = 0; i < N; ++i) {
+        offset     = ((offset + aligns[i] - 1) / aligns[i]) * aligns[i];
+        offsets[i] = offset;
+        offset += sizes[i];
+    }
+
+    offsets[N] = offset;
+
+    return offsets;
+}
+
+/*!
+ * \brief The static plan of the contexts of a network in a single arena.
+ *
+ * The contexts of all the layers are placed in one block of memory, at
+ * offsets computed at compile-time, instead of being allocated separately.
+ */
+template <template <typename, typename, size_t> typename Context, typename CDBN, typename DBN, size_t... I>
+struct context_plan {
+    static constexpr size_t n = sizeof...(I); ///< The number of contexts
+
+    /*!
+     * \brief The offsets of the contexts, followed by the size of the arena
+     */
+    static constexpr auto offsets = plan_offsets<n>(
+        {{sizeof(Context<CDBN, typename DBN::template layer_type<I>, I>)...}},
+        {{alignof(Context<CDBN, typename DBN::template layer_type<I>, I>)...}});
+
+    static constexpr size_t size = offsets[n]; ///< The size of the arena
+
+    /*!
+     * \brief The alignment of the arena
+     */
+    static constexpr size_t align = std::max({alignof(std::max_align_t), alignof(Context<CDBN, typename DBN::template layer_type<I>, I>)...});
+};
+
+/*!
+ * \brief Construct a context in an arena. The context shares the ownership
+ * of the arena.
+ * \param arena The arena
+ * \param offset The offset of the context inside the arena
+ * \param layer The layer of the context
+ */
+template <typename C, typename Layer>
+std::shared_ptr<C> place_context(const std::shared_ptr<void>& arena, size_t offset, const Layer& layer) {
+    auto* context = new (static_cast<char*>(arena.get()) + offset) C(layer);
+
+    return std::shared_ptr<C>(context, [arena](C* c) { c->~C(); });
+}
+
+/*!
+ * \brief Build the context for a DBN for the given sequence of layers, the
+ * contexts being configured from the CDBN type
  * \param dbn The DBN to build the context from
  */
-template<template<typename, typename, size_t> typename Context, typename DBN, size_t... I>
-auto build_context(DBN& dbn, std::index_sequence<I...> /*seq*/){
+template<template<typename, typename, size_t> typename Context, typename CDBN, typename DBN, size_t... I>
+auto build_context_as(DBN& dbn, std::index_sequence<I...> /*seq*/){
+    using plan = context_plan<Context, CDBN, DBN, I...>;
+
+    std::shared_ptr<void> arena(::operator new(plan::size, std::align_val_t(plan::align)), [](void* memory) {
+        ::operator delete(memory, std::align_val_t(plan::align));
+    });
+
     return std::make_tuple
         (
             (std::make_pair(
                 std::ref(dbn.template layer_get<I>()),  // Reference to the layer
-                std::make_shared<Context<DBN, typename DBN::template layer_type<I>, I>>(dbn.template layer_get<I>()))
+                place_context<Context<CDBN, typename DBN::template layer_type<I>, I>>(arena, plan::offsets[I], dbn.template layer_get<I>()))
             )...
         );
 }
@@ -478,9 +838,96 @@ auto build_context(DBN& dbn, std::index_sequence<I...> /*seq*/){
  */
 template<template<typename, typename, size_t> typename Context, typename DBN>
 auto build_context(DBN& dbn){
-    return build_context<Context>(dbn, std::make_index_sequence<DBN::layers>());
+    return build_context_as<Context, DBN>(dbn, std::make_index_sequence<DBN::layers>());
 }
 
+/*!
+ * \brief The configuration of the contexts of one shard of a batch in
+ * data-parallel training: the DBN with a smaller batch size.
+ */
+template <typename DBN, size_t S>
+struct sgd_shard_dbn : DBN {
+    static constexpr size_t batch_size = DBN::batch_size / S; ///< The batch size of a shard
+};
+
+/*!
+ * \brief The contexts of the shards of a batch, none when data-parallel
+ * training is disabled
+ */
+template <typename DBN, size_t S, typename Enable = void>
+struct sgd_shard_contexts {
+    using type = std::tuple<>; ///< The contexts of one shard
+};
+
+/*!
+ * \copydoc sgd_shard_contexts
+ */
+template <typename DBN, size_t S>
+struct sgd_shard_contexts<DBN, S, std::enable_if_t<(S > 1)>> {
+    using type = decltype(build_context_as<full_sgd_context, sgd_shard_dbn<DBN, S>>(std::declval<DBN&>(), std::make_index_sequence<DBN::layers>())); ///< The contexts of one shard
+};
+
+/*!
+ * \brief Traits to test if a context has the input, output and errors of its layer
+ */
+template <typename C, typename Enable = void>
+struct has_sgd_buffers : std::false_type {};
+
+/*!
+ * \copydoc has_sgd_buffers
+ */
+template <typename C>
+struct has_sgd_buffers<C, std::void_t<decltype(std::declval<const C&>().input), decltype(std::declval<const C&>().output), decltype(std::declval<const C&>().errors)>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a context has an updater context
+ */
+template <typename C, typename Enable = void>
+struct has_updater_context : std::false_type {};
+
+/*!
+ * \copydoc has_updater_context
+ */
+template <typename C>
+struct has_updater_context<C, std::void_t<decltype(std::declval<const C&>().up), decltype(std::declval<const C&>().acc)>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if an updater context holds some state
+ */
+template <typename U, typename Enable = void>
+struct has_updater_state : std::false_type {};
+
+/*!
+ * \copydoc has_updater_state
+ */
+template <typename U>
+struct has_updater_state<U, std::void_t<decltype(std::declval<const U&>().context)>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if the context of an updater holds the scalar
+ * schedule of the momentum (NAdam)
+ */
+template <typename U, typename Enable = void>
+struct has_momentum_schedule : std::false_type {};
+
+/*!
+ * \copydoc has_momentum_schedule
+ */
+template <typename U>
+struct has_momentum_schedule<U, std::void_t<decltype(std::declval<const U&>().m_schedule)>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a context has sub contexts (group and merge layers)
+ */
+template <typename C, typename Enable = void>
+struct has_sub_contexts : std::false_type {};
+
+/*!
+ * \copydoc has_sub_contexts
+ */
+template <typename C>
+struct has_sub_contexts<C, std::void_t<decltype(std::declval<const C&>().sub_contexts)>> : std::true_type {};
+
 /*!
  * \brief Simple gradient descent trainer
  */
@@ -492,10 +939,38 @@ struct sgd_trainer {
 
     static constexpr auto layers     = dbn_t::layers;     ///< The number of layers
     static constexpr auto batch_size = dbn_t::batch_size; ///< The batch size for training
+    static constexpr auto shards     = dbn_traits<dbn_t>::data_parallel(); ///< The number of shards of a batch
+    static constexpr auto shard_size = batch_size / shards;               ///< The batch size of a shard
+
+    static constexpr size_t frozen_layers = dbn_traits<dbn_t>::frozen_layers(); ///< The number of frozen layers, at the beginning of the network
+    static constexpr bool gpu_resident    = dbn_traits<dbn_t>::gpu_resident();  ///< Indicates if the training stays on the GPU
+
+    /*!
+     * \brief Indicates if the last layer is trained on a sample of its
+     * classes, its errors being computed with the loss
+     */
+    static constexpr bool sampled_output = is_sampled_output_layer_v<typename dbn_t::template layer_type<layers - 1>>;
+
+    static_assert(shards > 0 && batch_size % shards == 0, "The batch size must be divisible by the number of shards");
+    static_assert(shards == 1 || !dbn_traits<dbn_t>::pipelined_updates(), "Pipelined updates cannot be combined with data-parallel training");
+    static_assert(shards == 1 || !sampled_output, "The sampled softmax does not support data-parallel training");
+    static_assert(frozen_layers < layers, "At least the last layer must be trained");
+
+    using shard_context_t = typename sgd_shard_contexts<dbn_t, shards>::type; ///< The contexts of one shard
 
     dbn_t& dbn;                                                  ///< The DBN being trained
     decltype(build_context<full_sgd_context>(dbn)) full_context; ///< The context
+    std::vector<shard_context_t> shard_contexts;                 ///< The contexts of the shards (data-parallel training)
+    step_arena arena;                                            ///< The temporaries of each step
+    std::array<step_arena, shards> shard_arenas;                 ///< The temporaries of each step of each shard
     size_t iteration;                                            ///< The current iteration
+    numerical_fault health;                                      ///< The first non-finite value found (with dbn.finite_checks)
+
+    size_t accumulated         = 0; ///< The number of batches whose gradients are accumulated
+    size_t accumulated_samples = 0; ///< The number of samples of the accumulated batches
+    size_t accumulated_epoch   = 0; ///< The epoch of the last accumulated batch
+
+    std::unordered_map<const weight*, std::vector<weight>> residuals; ///< The residuals of the compressed gradients (error feedback), by variable
 
     // Transform layers need to inherit dimensions from back
 
@@ -527,83 +1002,462 @@ struct sgd_trainer {
     explicit sgd_trainer(dbn_t& dbn) : dbn(dbn), full_context(build_context<full_sgd_context>(dbn)), iteration(1) {
         // Inherit dimensions from front to end (for transform layers)
 
-        cpp::for_each_pair(full_context, [](auto& layer_ctx_1, auto& layer_ctx_2) {
-            constexpr bool l2_transform = decay_layer_traits<decltype(layer_ctx_2.first)>::is_transform_layer();
+        inherit_dimensions(full_context);
+        link_tied_contexts(full_context, std::make_index_sequence<layers>());
 
-            if (l2_transform) {
-                this_type::inherit_from_front(layer_ctx_1, layer_ctx_2);
+        if constexpr (shards > 1) {
+            static_assert(!has_utility_layers(std::make_index_sequence<layers>()), "Data-parallel training does not support group and merge layers");
+
+            for (size_t s = 0; s < shards; ++s) {
+                shard_contexts.push_back(build_context_as<full_sgd_context, sgd_shard_dbn<dbn_t, shards>>(dbn, std::make_index_sequence<layers>()));
+
+                inherit_dimensions(shard_contexts.back());
+                link_tied_contexts(shard_contexts.back(), std::make_index_sequence<layers>());
             }
-        });
-    }
+        }
 
-    /*!
-     * \brief Initialize the training
-     */
-    void init_training(size_t) {}
+        if constexpr (dbn_traits<dbn_t>::huge_pages()) {
+            advise_contexts_huge_pages(full_context);
 
-    // CPP17 Replace SFINAE with if constexpr
+            for (auto& contexts : shard_contexts) {
+                advise_contexts_huge_pages(contexts);
+            }
+        }
 
-    /*!
-     * \brief Compute the errors of the last layer given the loss function
-     */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::CATEGORICAL_CROSS_ENTROPY)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
+        // The weights, the states of the updater and the buffers stay on the device
+        if constexpr (gpu_resident) {
+            dbn.for_each_layer([](auto& layer) {
+                upload_layer_gpu(layer);
+            });
 
-        if (cpp_unlikely(!full_batch)) {
-            last_ctx.errors = 0;
+            upload_contexts_gpu(full_context);
 
-            for (size_t i = 0; i < n; ++i) {
-                last_ctx.errors(i) = labels(i) - last_ctx.output(i);
+            for (auto& contexts : shard_contexts) {
+                upload_contexts_gpu(contexts);
             }
-        } else {
-            last_ctx.errors = labels - last_ctx.output;
         }
-
-        // Note: No need to multiply by the derivative of
-        // the activation function since the terms are
-        // canceling out in the derivative of the loss
     }
 
     /*!
-     * \brief Compute the errors of the last layer given the loss function
+     * \brief Link the contexts of the encoders to the contexts of the layers
+     * tied to their weights
      */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::MEAN_SQUARED_ERROR)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto& last_layer = std::get<layers - 1>(full_context).first;
-        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
+    template <typename Contexts, size_t... I>
+    static void link_tied_contexts(Contexts& contexts, std::index_sequence<I...> /*seq*/) {
+        (link_tied_context<I>(contexts), ...);
+    }
 
-        if (cpp_unlikely(!full_batch)) {
-            last_ctx.errors = 0;
+    template <size_t I, typename Contexts>
+    static void link_tied_context(Contexts& contexts) {
+        using layer_t = typename dbn_t::template layer_type<I>;
 
-            for (size_t i = 0; i < n; ++i) {
-                last_ctx.errors(i) = 2.0 * (labels(i) - last_ctx.output(i));
-            }
+        if constexpr (is_tied_layer_v<layer_t>) {
+            std::get<layer_t::encoder>(contexts).second->tied.context = std::get<I>(contexts).second.get();
         } else {
-            last_ctx.errors = 2.0 * (labels - last_ctx.output);
+            cpp_unused(contexts);
         }
-
-        // Multiply by the derivative of the activation function
-        last_layer.adapt_errors(last_ctx);
     }
 
     /*!
-     * \brief Compute the errors of the last layer given the loss function
+     * \brief Back the buffers and the states of the updater of the given
+     * contexts with huge pages
      */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::BINARY_CROSS_ENTROPY)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto& last_layer = std::get<layers - 1>(full_context).first;
-        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
+    template <typename Contexts>
+    static void advise_contexts_huge_pages(const Contexts& contexts) {
+        cpp::for_each(contexts, [](auto& layer_ctx) {
+            advise_context_huge_pages(*layer_ctx.second);
+        });
+    }
 
-        // Avoid Nan from division by ((1 - out) * out)
-        auto out = etl::force_temporary(etl::clip(last_ctx.output, 0.001, 0.999));
+    /*!
+     * \brief Back the buffers and the states of the updater of the given
+     * context, and of its sub contexts, with huge pages
+     */
+    template <typename Context>
+    static void advise_context_huge_pages(const Context& context) {
+        if constexpr (has_sgd_buffers<Context>::value) {
+            advise_huge_pages(std::tie(context.input, context.output, context.errors));
+        }
 
-        if (cpp_unlikely(!full_batch)) {
-            last_ctx.errors = 0;
+        if constexpr (has_updater_context<Context>::value) {
+            if constexpr (has_updater_state<std::decay_t<decltype(context.up)>>::value) {
+                std::apply([](auto&... sub) { (advise_huge_pages(sub->state()), ...); }, context.up.context);
+            }
+        }
+
+        if constexpr (has_sub_contexts<Context>::value) {
+            cpp::for_each(context.sub_contexts, [](auto& sub_context) {
+                advise_context_huge_pages(sub_context);
+            });
+        }
+    }
+
+    /*!
+     * \brief Upload the buffers and the states of the updater of the given
+     * contexts to the GPU
+     */
+    template <typename Contexts>
+    static void upload_contexts_gpu(const Contexts& contexts) {
+        cpp::for_each(contexts, [](auto& layer_ctx) {
+            upload_context_gpu(*layer_ctx.second);
+        });
+    }
+
+    /*!
+     * \brief Upload the buffers and the states of the updater (with the
+     * gradients) of the given context, and of its sub contexts, to the GPU
+     */
+    template <typename Context>
+    static void upload_context_gpu(const Context& context) {
+        if constexpr (has_sgd_buffers<Context>::value) {
+            upload_gpu(std::tie(context.input, context.output, context.errors));
+        }
+
+        if constexpr (has_updater_context<Context>::value) {
+            if constexpr (has_updater_state<std::decay_t<decltype(context.up)>>::value) {
+                std::apply([](auto&... sub) { (upload_gpu(sub->state()), ...); }, context.up.context);
+            }
+        }
+
+        if constexpr (has_sub_contexts<Context>::value) {
+            cpp::for_each(context.sub_contexts, [](auto& sub_context) {
+                upload_context_gpu(sub_context);
+            });
+        }
+    }
+
+    /*!
+     * \brief Inherit the dimensions of the transform layers from front to
+     * end in the given contexts
+     */
+    template <typename Contexts>
+    static void inherit_dimensions(Contexts& contexts) {
+        cpp::for_each_pair(contexts, [](auto& layer_ctx_1, auto& layer_ctx_2) {
+            constexpr bool l2_transform = decay_layer_traits<decltype(layer_ctx_2.first)>::is_transform_layer();
+
+            if (l2_transform) {
+                this_type::inherit_from_front(layer_ctx_1, layer_ctx_2);
+            }
+        });
+    }
+
+    /*!
+     * \brief Add the memory held by the contexts of the trainer (inputs,
+     * outputs and errors of the layers, states of the updater and
+     * accumulated gradients) to the given report
+     */
+    void report_memory(memory_report& report) const {
+        report_contexts_memory(report, "sgd", full_context);
+
+        for (size_t s = 0; s < shard_contexts.size(); ++s) {
+            report_contexts_memory(report, "sgd:shard" + std::to_string(s), shard_contexts[s]);
+        }
+    }
+
+    /*!
+     * \brief Add the memory held by the given contexts to the report
+     */
+    template <typename Contexts>
+    static void report_contexts_memory(memory_report& report, const std::string& prefix, const Contexts& contexts) {
+        cpp::for_each_i(contexts, [&](size_t i, auto& layer_ctx) {
+            report_context_memory(report, prefix + ":" + std::to_string(i), *layer_ctx.second);
+        });
+    }
+
+    /*!
+     * \brief Add the memory held by the given context, and by its sub
+     * contexts, to the report
+     */
+    template <typename Context>
+    static void report_context_memory(memory_report& report, const std::string& name, const Context& context) {
+        if constexpr (has_sgd_buffers<Context>::value) {
+            report.add(name + " activations", memory_bytes(std::tie(context.input, context.output, context.errors)));
+        }
+
+        if constexpr (has_updater_context<Context>::value) {
+            report.add(name + " updater", updater_bytes(context.up));
+
+            if (context.acc) {
+                report.add(name + " accumulator", updater_bytes(*context.acc));
+            }
+        }
+
+        if constexpr (has_sub_contexts<Context>::value) {
+            cpp::for_each_i(context.sub_contexts, [&](size_t j, auto& sub_context) {
+                report_context_memory(report, name + ":" + std::to_string(j), sub_context);
+            });
+        }
+    }
+
+    /*!
+     * \brief Returns the number of bytes of the given updater context
+     */
+    template <typename Updater>
+    static size_t updater_bytes(const Updater& up) {
+        if constexpr (has_updater_state<Updater>::value) {
+            return std::apply([](auto&... sub) { return (size_t(0) + ... + (sub->tensors * memory_bytes(sub->grad))); }, up.context);
+        } else {
+            return 0;
+        }
+    }
+
+    /*!
+     * \brief Store the state of the trainer (iteration, states of the
+     * updater and accumulated gradients) into the given stream
+     */
+    void store_state(std::ostream& os) const {
+        cpp::binary_write(os, iteration);
+        cpp::binary_write(os, accumulated);
+        cpp::binary_write(os, accumulated_samples);
+        cpp::binary_write(os, accumulated_epoch);
+
+        cpp::for_each(full_context, [&os](auto& layer_ctx) {
+            store_context_state(os, *layer_ctx.second);
+        });
+    }
+
+    /*!
+     * \brief Load the state of the trainer from the given stream, written
+     * by store_state for the same network
+     */
+    void load_state(std::istream& is) {
+        cpp::binary_load(is, iteration);
+        cpp::binary_load(is, accumulated);
+        cpp::binary_load(is, accumulated_samples);
+        cpp::binary_load(is, accumulated_epoch);
+
+        cpp::for_each(full_context, [&is](auto& layer_ctx) {
+            load_context_state(is, layer_ctx.first.get(), *layer_ctx.second);
+        });
+
+        if constexpr (gpu_resident) {
+            upload_contexts_gpu(full_context);
+        }
+    }
+
+    /*!
+     * \brief Store the states of the updater and the accumulated gradients
+     * of the given context, and of its sub contexts
+     */
+    template <typename Context>
+    static void store_context_state(std::ostream& os, const Context& context) {
+        if constexpr (has_updater_context<Context>::value) {
+            if constexpr (has_updater_state<std::decay_t<decltype(context.up)>>::value) {
+                std::apply([&os](auto&... sub) { (store_updater_state(os, *sub), ...); }, context.up.context);
+
+                cpp::binary_write(os, bool(context.acc));
+
+                if (context.acc) {
+                    std::apply([&os](auto&... sub) { (store_state_tensor(os, sub->grad), ...); }, context.acc->context);
+                }
+            }
+        }
+
+        if constexpr (has_sub_contexts<Context>::value) {
+            cpp::for_each(context.sub_contexts, [&os](auto& sub_context) {
+                store_context_state(os, sub_context);
+            });
+        }
+    }
+
+    /*!
+     * \brief Load the states of the updater and the accumulated gradients of
+     * the given context of the given layer, and of its sub contexts
+     */
+    template <typename Layer, typename Context>
+    static void load_context_state(std::istream& is, Layer& layer, Context& context) {
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [&is](auto& sub_layer, auto& sub_context) {
+                load_context_state(is, sub_layer, sub_context);
+            });
+        } else if constexpr (has_updater_context<Context>::value) {
+            if constexpr (has_updater_state<std::decay_t<decltype(context.up)>>::value) {
+                std::apply([&is](auto&... sub) { (load_updater_state(is, *sub), ...); }, context.up.context);
+
+                bool acc = false;
+                cpp::binary_load(is, acc);
+
+                if (acc) {
+                    if (!context.acc) {
+                        context.acc = std::make_unique<typename Context::accumulator_t>(layer);
+                    }
+
+                    std::apply([&is](auto&... sub) { (load_state_tensor(is, sub->grad), ...); }, context.acc->context);
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Store the tensors of the given context of the updater
+     */
+    template <typename Sub>
+    static void store_updater_state(std::ostream& os, const Sub& sub) {
+        std::apply([&os](auto&... tensor) { (store_state_tensor(os, tensor), ...); }, sub.state());
+
+        if constexpr (has_momentum_schedule<Sub>::value) {
+            cpp::binary_write(os, sub.m_schedule);
+        }
+    }
+
+    /*!
+     * \brief Load the tensors of the given context of the updater
+     */
+    template <typename Sub>
+    static void load_updater_state(std::istream& is, Sub& sub) {
+        std::apply([&is](auto&... tensor) { (load_state_tensor(is, tensor), ...); }, sub.state());
+
+        if constexpr (has_momentum_schedule<Sub>::value) {
+            cpp::binary_load(is, sub.m_schedule);
+        }
+    }
+
+    /*!
+     * \brief Store the values of the given tensor
+     */
+    template <typename T>
+    static void store_state_tensor(std::ostream& os, const T& tensor) {
+        tensor.ensure_cpu_up_to_date();
+
+        cpp::binary_write_all(os, tensor);
+    }
+
+    /*!
+     * \brief Load the values of the given tensor
+     */
+    template <typename T>
+    static void load_state_tensor(std::istream& is, T& tensor) {
+        cpp::binary_load_all(is, tensor);
+
+        tensor.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Indicates if the network contains group or merge layers
+     */
+    template <size_t... I>
+    static constexpr bool has_utility_layers(std::index_sequence<I...> /*seq*/) {
+        return (is_utility_layer<typename dbn_t::template layer_type<I>> || ...);
+    }
+
+    /*!
+     * \brief Initialize the training
+     */
+    void init_training(size_t) {
+        if (dbn.transport && dbn.transport->size() > 1) {
+            if (!distributed()) {
+                std::cerr << "Distributed training is only supported by the sequential SGD, without gradient accumulation" << std::endl;
+            }
+
+            // All the ranks start from the weights of the root
+
+            cpp::for_each(full_context, [this](auto& layer_ctx) {
+                this->broadcast_layer(layer_ctx.first);
+            });
+        }
+    }
+
+    /*!
+     * \brief Apply the gradients still accumulated at the end of an epoch
+     */
+    void end_epoch() {
+        if (accumulated) {
+            dll::auto_timer timer("sgd::grad");
+
+            cpp::for_each(full_context, [this](auto& layer_ctx) {
+                this->flush_gradients_layer(layer_ctx.first, *layer_ctx.second);
+            });
+
+            accumulated         = 0;
+            accumulated_samples = 0;
+
+            ++iteration;
+        }
+    }
+
+    // CPP17 Replace SFINAE with if constexpr
+
+    /*!
+     * \brief Compute the errors of the last layer given the loss function
+     */
+    template<loss_function F, typename Contexts, typename Labels, cpp_enable_iff(F == loss_function::CATEGORICAL_CROSS_ENTROPY)>
+    static void last_errors(Contexts& contexts, bool full_batch, size_t n, const Labels& labels){
+        auto& last_ctx   = *std::get<layers - 1>(contexts).second;
+
+        if constexpr (is_index_labels<Labels>) {
+            // The one-hot batch is never built, only the column of the
+            // expected class is corrected for each sample
+
+            last_ctx.errors = -last_ctx.output;
 
             for (size_t i = 0; i < n; ++i) {
-                last_ctx.errors(i) = (labels(i) - out(i)) / ((1.0 - out(i)) >> out(i));
+                last_ctx.errors(i, labels(i)) += 1.0;
+            }
+
+            if (n < etl::dim<0>(last_ctx.errors)) {
+                etl::slice(last_ctx.errors, n, etl::dim<0>(last_ctx.errors)) = 0;
             }
+        } else if (cpp_unlikely(!full_batch)) {
+            // Only the active rows are computed, the others must not
+            // contribute to the gradients
+
+            const size_t B = etl::dim<0>(last_ctx.errors);
+
+            etl::slice(last_ctx.errors, 0, n) = labels - etl::slice(last_ctx.output, 0, n);
+            etl::slice(last_ctx.errors, n, B) = 0;
+        } else {
+            last_ctx.errors = labels - last_ctx.output;
+        }
+
+        // Note: No need to multiply by the derivative of
+        // the activation function since the terms are
+        // canceling out in the derivative of the loss
+    }
+
+    /*!
+     * \brief Compute the errors of the last layer given the loss function
+     */
+    template<loss_function F, typename Contexts, typename Labels, cpp_enable_iff(F == loss_function::MEAN_SQUARED_ERROR)>
+    static void last_errors(Contexts& contexts, bool full_batch, size_t n, const Labels& labels){
+        static_assert(!is_index_labels<Labels>, "Index labels are only supported with the categorical cross entropy loss");
+
+        auto& last_layer = std::get<layers - 1>(contexts).first;
+        auto& last_ctx   = *std::get<layers - 1>(contexts).second;
+
+        if (cpp_unlikely(!full_batch)) {
+            const size_t B = etl::dim<0>(last_ctx.errors);
+
+            etl::slice(last_ctx.errors, 0, n) = 2.0 * (labels - etl::slice(last_ctx.output, 0, n));
+            etl::slice(last_ctx.errors, n, B) = 0;
+        } else {
+            last_ctx.errors = 2.0 * (labels - last_ctx.output);
+        }
+
+        // Multiply by the derivative of the activation function
+        last_layer.adapt_errors(last_ctx);
+    }
+
+    /*!
+     * \brief Compute the errors of the last layer given the loss function
+     */
+    template<loss_function F, typename Contexts, typename Labels, cpp_enable_iff(F == loss_function::BINARY_CROSS_ENTROPY)>
+    static void last_errors(Contexts& contexts, bool full_batch, size_t n, const Labels& labels){
+        static_assert(!is_index_labels<Labels>, "Index labels are only supported with the categorical cross entropy loss");
+
+        auto& last_layer = std::get<layers - 1>(contexts).first;
+        auto& last_ctx   = *std::get<layers - 1>(contexts).second;
+
+        // Avoid Nan from division by ((1 - out) * out)
+        auto clipped = dll::arena_temporary(etl::clip(last_ctx.output, 0.001, 0.999));
+        auto& out    = clipped.matrix;
+
+        if (cpp_unlikely(!full_batch)) {
+            const size_t B = etl::dim<0>(last_ctx.errors);
+
+            auto active = etl::slice(out, 0, n);
+
+            etl::slice(last_ctx.errors, 0, n) = (labels - active) / ((1.0 - active) >> active);
+            etl::slice(last_ctx.errors, n, B) = 0;
         } else {
             last_ctx.errors = (labels - out) / ((1.0 - out) >> out);
         }
@@ -618,92 +1472,1172 @@ struct sgd_trainer {
         nan_check_etl(last_ctx.errors);
     }
 
-    /*!
-     * \brief Train a batch of data
-     * \param epoch The current epoch
-     * \param inputs A batch of inputs
-     * \param labels A batch of labels
-     * \return a pair containing the error and the loss for the batch
-     */
-    template <typename Inputs, typename Labels>
-    std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels) {
-        dll::auto_timer timer("sgd::train_batch");
+    /*!
+     * \brief Indicates if the errors and the metrics of the last layer can
+     * be computed together in a single pass over the outputs
+     */
+    template <typename Labels>
+    static constexpr bool fused_loss =
+            sampled_output
+        || (!gpu_resident && (is_index_labels<Labels> || etl::is_dma<Labels>)
+        &&  (dbn_t::loss == loss_function::CATEGORICAL_CROSS_ENTROPY
+         || (dbn_t::loss == loss_function::BINARY_CROSS_ENTROPY && !is_index_labels<Labels> && has_sigmoid_output<typename dbn_t::template layer_type<layers - 1>>::value)));
+
+    /*!
+     * \brief Compute the errors of the last layer together with the error
+     * and the loss of the batch, in a single pass over the outputs.
+     *
+     * This computes the same values as last_errors followed by
+     * evaluate_metrics_batch, without going several times through the
+     * outputs, which matters when the output layer is large.
+     *
+     * \param contexts The contexts, filled by a forward pass
+     * \param n The number of samples
+     * \param labels The labels of the samples
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Contexts, typename Labels>
+    static std::pair<double, double> fused_last_errors(Contexts& contexts, size_t n, const Labels& labels) {
+        dll::auto_timer timer("sgd::fused_loss");
+
+        auto& last_ctx = *std::get<layers - 1>(contexts).second;
+
+        if constexpr (sampled_output) {
+            // The logits of the sampled classes are only computed now,
+            // with the labels
+
+            static_assert(dbn_t::loss == loss_function::CATEGORICAL_CROSS_ENTROPY, "The sampled softmax is only trained with the categorical cross entropy");
+            static_assert(is_index_labels<Labels> || etl::is_dma<Labels>, "The sampled softmax needs index labels or one-hot labels with direct memory access");
+
+            return std::get<layers - 1>(contexts).first.sampled_errors(last_ctx, n, labels);
+        }
+
+        auto& output = last_ctx.output;
+        auto& errors = last_ctx.errors;
+
+        const size_t B = etl::dim<0>(errors);
+        const size_t M = etl::size(errors) / B;
+
+        output.ensure_cpu_up_to_date();
+
+        const auto* out = output.memory_start();
+        auto* err       = errors.memory_start();
+
+        double loss  = 0.0;
+        double error = 0.0;
+
+        if constexpr (dbn_t::loss == loss_function::CATEGORICAL_CROSS_ENTROPY) {
+            // The outputs are already normalized by the softmax, the
+            // errors are directly the difference with the labels
+
+            for (size_t i = 0; i < n; ++i) {
+                const auto* o = out + i * M;
+                auto* e       = err + i * M;
+
+                size_t max_o = 0;
+
+                if constexpr (is_index_labels<Labels>) {
+                    const size_t l = labels(i);
+
+                    for (size_t j = 0; j < M; ++j) {
+                        e[j] = -o[j];
+
+                        if (o[j] > o[max_o]) {
+                            max_o = j;
+                        }
+                    }
+
+                    e[l] += 1.0;
+
+                    loss += std::log(o[l]);
+                    error += max_o != l ? 1.0 : 0.0;
+                } else {
+                    const auto* t = labels.memory_start() + i * M;
+
+                    size_t max_t = 0;
+
+                    for (size_t j = 0; j < M; ++j) {
+                        e[j] = t[j] - o[j];
+
+                        // 0 * log(0) must not pollute the loss
+                        if (t[j] != 0.0) {
+                            loss += t[j] * std::log(o[j]);
+                        }
+
+                        if (o[j] > o[max_o]) {
+                            max_o = j;
+                        }
+
+                        if (t[j] > t[max_t]) {
+                            max_t = j;
+                        }
+                    }
+
+                    error += max_o != max_t ? 1.0 : 0.0;
+                }
+            }
+
+            loss *= -1.0 / n;
+            error *= 1.0 / n;
+        } else { // BINARY_CROSS_ENTROPY with SIGMOID
+            // The derivative of the sigmoid cancels out with the
+            // denominator of the derivative of the loss
+
+            for (size_t i = 0; i < n; ++i) {
+                const auto* o = out + i * M;
+                const auto* t = labels.memory_start() + i * M;
+                auto* e       = err + i * M;
+
+                for (size_t j = 0; j < M; ++j) {
+                    // Avoid Nan in log(out) or log(1-out)
+                    const double c = std::min(std::max(double(o[j]), 0.001), 0.999);
+
+                    e[j] = t[j] - o[j];
+
+                    loss += t[j] * std::log(c) + (1.0 - t[j]) * std::log(1.0 - c);
+                    error += std::abs(t[j] - o[j]);
+                }
+            }
+
+            loss *= -1.0 / (n * M);
+            error *= 1.0 / (n * M);
+        }
+
+        // The inactive rows must not contribute to the gradients
+        std::fill(err + n * M, err + B * M, 0.0);
+
+        errors.invalidate_gpu();
+
+        nan_check_etl(errors);
+
+        return std::make_pair(error, loss);
+    }
+
+    /*!
+     * \brief Train a batch of data
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \param compute_metrics Indicates if the error and the loss of the batch must be computed
+     * \return a pair containing the error and the loss for the batch (only meaningful with compute_metrics)
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels, bool compute_metrics = true) {
+        if constexpr (shards > 1) {
+            auto metrics = train_batch_parallel(epoch, inputs, labels, compute_metrics);
+
+            check_health(compute_metrics, metrics);
+
+            return metrics;
+        }
+
+        dll::auto_timer timer("sgd::train_batch");
+        arena_scope step(arena);
+
+        const auto n = etl::dim<0>(inputs);
+
+        // Ensure that the data batch and the label batch are of the same size
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+
+        // Ensure that the context can hold the inputs
+        cpp_assert(n <= batch_size, "Invalid sizes");
+
+        if constexpr (dbn_traits<dbn_t>::sync_batch_norm()) {
+            sync_batch_normalization();
+        }
+
+        //Feedforward pass
+
+        {
+            dll::auto_timer timer("sgd::forward");
+
+            forward_batch_helper<true>(inputs);
+        }
+
+        // The error and the loss, when computed with the errors
+        std::pair<double, double> metrics;
+
+        if constexpr (dbn_traits<dbn_t>::pipelined_updates()) {
+            // The gradients and the update of each layer are computed on
+            // the thread pool, overlapped with the backward pass of the
+            // previous layers
+
+            auto& pool = dbn.get_thread_pool();
+
+            pool_region region;
+
+            {
+                dll::auto_timer timer("sgd::backward");
+
+                backward_batch(n, labels, metrics, [this, &pool, &region, epoch, n](auto& layer, auto& context) {
+                    pool.do_task(region.task([this, epoch, n, &layer, &context] {
+                        SERIAL_SECTION {
+                            this->apply_gradients_layer(epoch, n, layer, context);
+                        }
+                    }));
+                });
+            }
+
+            // All the updates must be done before the next forward pass
+
+            {
+                dll::auto_timer timer("sgd::grad");
+
+                pool.wait();
+            }
+        } else {
+            if (distributed()) {
+                distributed_backward(epoch, n, labels, metrics);
+            } else {
+                dll::auto_timer timer("sgd::backward");
+
+                backward_batch(n, labels, metrics, [](auto& /*layer*/, auto& /*context*/) {});
+            }
+
+            // Compute and apply the gradients
+
+            if (distributed()) {
+                // Already applied with the gradients of all the ranks
+            } else if (dbn.gradient_accumulation > 1) {
+                dll::auto_timer timer("sgd::grad");
+
+                // The weights are only updated once the gradients of all
+                // the batches are accumulated
+
+                const bool apply = accumulated + 1 == dbn.gradient_accumulation;
+
+                accumulated_samples += n;
+                accumulated_epoch = epoch;
+
+                cpp::for_each(full_context, [this, apply](auto& layer_ctx) {
+                    this->accumulate_gradients_layer(apply, layer_ctx.first, *layer_ctx.second);
+                });
+
+                if (apply) {
+                    accumulated         = 0;
+                    accumulated_samples = 0;
+                } else {
+                    ++accumulated;
+                }
+            } else {
+                dll::auto_timer timer("sgd::grad");
+
+                cpp::for_each(full_context, [this, epoch, n](auto& layer_ctx) {
+                    this->apply_gradients_layer(epoch, n, layer_ctx.first, *layer_ctx.second);
+                });
+            }
+        }
+
+        // Update the counter of iterations (once the weights are updated)
+        if (!accumulated) {
+            ++iteration;
+        }
+
+        // Compute error and loss
+
+        if (!compute_metrics) {
+            check_health(false, metrics);
+
+            return std::make_pair(1.0, -1.0);
+        }
+
+        if constexpr (!fused_loss<Labels>) {
+            dll::auto_timer timer("sgd::error");
+
+            auto& last_ctx = *std::get<layers - 1>(full_context).second;
+
+            auto[error, loss] = dbn.evaluate_metrics_batch(last_ctx.output, labels, n, true);
+
+            metrics = std::make_pair(error, loss);
+        }
+
+        if (distributed()) {
+            // Report the average of the metrics of all the ranks
+
+            double values[2] = {metrics.first, metrics.second};
+
+            dbn.transport->allreduce(values, 2);
+
+            const double ranks = dbn.transport->size();
+
+            metrics = std::make_pair(values[0] / ranks, values[1] / ranks);
+        }
+
+        check_health(true, metrics);
+
+        return metrics;
+    }
+
+    /*!
+     * \brief Check the numerical health of the batch that was just trained,
+     * when enabled with dbn.finite_checks. The first non-finite value is
+     * recorded in health.
+     *
+     * The loss and the squared norms of the gradients, which are already
+     * reduced, are checked for every batch. The outputs, the errors and the
+     * gradients of all the layers are only scanned every dbn.finite_checks
+     * iterations, or as soon as one of the cheap checks fails, to find the
+     * layer that produced the first non-finite value. The contexts of the
+     * shards are not scanned.
+     *
+     * \param compute_metrics Indicates if the metrics of the batch were computed
+     * \param metrics The metrics of the batch
+     */
+    void check_health(bool compute_metrics, const std::pair<double, double>& metrics) {
+        if (!dbn.finite_checks || health) {
+            return;
+        }
+
+        bool scan = iteration % dbn.finite_checks == 0;
+
+        if (compute_metrics && !std::isfinite(metrics.second)) {
+            health = {numerical_stage::LOSS, layers - 1, iteration};
+            scan   = true;
+        }
+
+        if constexpr (shards == 1) {
+            bool norms = true;
+
+            cpp::for_each(full_context, [&norms](auto& layer_ctx) {
+                norms = norms && finite_norms(*layer_ctx.second);
+            });
+
+            if (scan || !norms) {
+                scan_contexts();
+            }
+        } else {
+            cpp_unused(scan);
+        }
+    }
+
+    /*!
+     * \brief Scan the contexts of the layers to find the layer that produced
+     * the first non-finite value.
+     *
+     * The outputs are produced from the first layer to the last and then
+     * the errors and the gradients from the last layer to the first.
+     */
+    void scan_contexts() {
+        numerical_fault fault;
+
+        cpp::for_each_i(full_context, [this, &fault](size_t i, auto& layer_ctx) {
+            if (!fault && !finite_context(*layer_ctx.second, numerical_stage::OUTPUT)) {
+                fault = {numerical_stage::OUTPUT, i, iteration};
+            }
+        });
+
+        if (!fault) {
+            cpp::for_each_i(full_context, [this, &fault](size_t i, auto& layer_ctx) {
+                if (!finite_context(*layer_ctx.second, numerical_stage::ERRORS)) {
+                    fault = {numerical_stage::ERRORS, i, iteration};
+                } else if (!finite_context(*layer_ctx.second, numerical_stage::GRADIENTS)) {
+                    fault = {numerical_stage::GRADIENTS, i, iteration};
+                }
+            });
+        }
+
+        if (fault) {
+            health = fault;
+        }
+    }
+
+    /*!
+     * \brief Indicates if the squared norms of the gradients computed for
+     * the given context, and its sub contexts, are finite
+     */
+    template <typename Context>
+    static bool finite_norms(const Context& context) {
+        bool finite = true;
+
+        if constexpr (has_updater_context<Context>::value) {
+            for (auto norm : context.grad_sq_norms) {
+                finite = finite && std::isfinite(norm);
+            }
+        }
+
+        if constexpr (has_sub_contexts<Context>::value) {
+            cpp::for_each(context.sub_contexts, [&finite](auto& sub_context) {
+                finite = finite && finite_norms(sub_context);
+            });
+        }
+
+        return finite;
+    }
+
+    /*!
+     * \brief Indicates if the values of the given stage of the given context,
+     * and of its sub contexts, are finite
+     */
+    template <typename Context>
+    static bool finite_context(const Context& context, numerical_stage stage) {
+        bool finite = true;
+
+        if constexpr (has_sgd_buffers<Context>::value) {
+            if (stage == numerical_stage::OUTPUT) {
+                finite = finite_values(context.output);
+            } else if (stage == numerical_stage::ERRORS) {
+                finite = finite_values(context.errors);
+            }
+        }
+
+        if constexpr (has_updater_context<Context>::value) {
+            if constexpr (has_updater_state<std::decay_t<decltype(context.up)>>::value) {
+                if (stage == numerical_stage::GRADIENTS) {
+                    finite = std::apply([](auto&... sub) { return (finite_values(sub->grad) && ...); }, context.up.context);
+                }
+            }
+        }
+
+        if constexpr (has_sub_contexts<Context>::value) {
+            cpp::for_each(context.sub_contexts, [&finite, stage](auto& sub_context) {
+                finite = finite && finite_context(sub_context, stage);
+            });
+        }
+
+        return finite;
+    }
+
+    /*!
+     * \brief Indicates if all the values of the given expression are finite
+     */
+    template <typename E>
+    static bool finite_values(const E& value) {
+        if constexpr (etl::is_dma<E>) {
+            value.ensure_cpu_up_to_date();
+
+            return all_finite(value.memory_start(), etl::size(value));
+        } else {
+            return value.is_finite();
+        }
+    }
+
+    /*!
+     * \brief Synchronize the statistics of the batch normalization layers
+     * over the ranks when the batches are trained over several ranks, or
+     * use the statistics of this rank only.
+     */
+    void sync_batch_normalization() {
+        auto* transport = distributed() ? dbn.transport.get() : nullptr;
+
+        dbn.for_each_layer([transport](auto& layer) {
+            if constexpr (is_batch_normalization_layer_v<decltype(layer)>) {
+                layer.sync = transport;
+            }
+        });
+    }
+
+    /*!
+     * \brief Indicates if the batches are trained over several ranks
+     */
+    bool distributed() const {
+        return !dbn_traits<dbn_t>::pipelined_updates() && shards == 1 && dbn.gradient_accumulation <= 1 && dbn.transport && dbn.transport->size() > 1;
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the batch of this rank and update
+     * the weights with the gradients summed over all the ranks.
+     *
+     * The gradients of each layer are summed over the ranks on a
+     * communication thread, in order, as soon as the backward pass is done
+     * with the layer, overlapped with the backward pass of the previous
+     * layers.
+     *
+     * \param epoch The current epoch
+     * \param n The number of samples of the batch of this rank
+     * \param labels The labels of the samples
+     * \param metrics The metrics of the batch (only set with fused_loss)
+     */
+    template <typename Labels>
+    void distributed_backward(size_t epoch, size_t n, const Labels& labels, std::pair<double, double>& metrics) {
+        auto& transport = *dbn.transport;
+
+        // The last batch of each rank may be partial
+        double samples = n;
+        transport.allreduce(&samples, 1);
+
+        std::future<void> reduced;
+        gradient_bucket bucket;
+
+        {
+            dll::auto_timer timer("sgd::backward");
+
+            backward_batch(n, labels, metrics, [this, &bucket, &reduced](auto& layer, auto& context) {
+                this->distributed_gradients_layer(layer, context, bucket, reduced);
+            });
+
+            // The last bucket is not full
+            allreduce_bucket(bucket, reduced);
+        }
+
+        {
+            dll::auto_timer timer("sgd::grad");
+
+            if (reduced.valid()) {
+                reduced.wait();
+            }
+
+            cpp::for_each(full_context, [this, epoch, samples](auto& layer_ctx) {
+                this->distributed_update_layer(epoch, size_t(samples), layer_ctx.first, *layer_ctx.second);
+            });
+        }
+    }
+
+    /*!
+     * \brief The gradients of consecutive layers, summed over the ranks
+     * with a single allreduce
+     */
+    struct gradient_bucket {
+        std::vector<weight> values;                                      ///< The packed gradients
+        std::vector<std::function<const weight*(const weight*)>> unpack; ///< Copy back the summed gradients of a variable, returns the next ones
+        std::vector<std::function<void()>> compressed;                   ///< Sum the compressed gradients of a variable, not packed
+    };
+
+    /*!
+     * \brief Compute the gradients of the given layer and start summing them
+     * over all the ranks, after the layers already started. With a gradient
+     * bucket, the gradients are only summed once the bucket is full.
+     */
+    template <typename Layer, typename Context>
+    void distributed_gradients_layer(Layer& layer, Context& context, gradient_bucket& bucket, std::future<void>& reduced) {
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [this, &bucket, &reduced](auto& sub_layer, auto& sub_context) {
+                this->distributed_gradients_layer(sub_layer, sub_context, bucket, reduced);
+            });
+        } else {
+            compute_gradients(layer, context);
+
+            if constexpr (decay_layer_traits<Layer>::is_neural_layer() && !Context::frozen) {
+                static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+                if (dbn.gradient_bucket) {
+                    pack_variables(context, bucket, std::make_index_sequence<N>());
+
+                    if (bucket.values.size() >= dbn.gradient_bucket) {
+                        allreduce_bucket(bucket, reduced);
+                    }
+
+                    return;
+                }
+
+                reduced = std::async(std::launch::async, [this, &context, previous = std::move(reduced)] {
+                    if (previous.valid()) {
+                        previous.wait();
+                    }
+
+                    this->allreduce_variables(context, std::make_index_sequence<N>());
+                });
+            }
+        }
+    }
+
+    /*!
+     * \brief Sum the gradients of the given context over all the ranks
+     */
+    template <typename Context, size_t... I>
+    void allreduce_variables(Context& context, std::index_sequence<I...> /*seq*/) {
+        (allreduce_variable(std::get<I>(context.up.context)->grad, Context::index), ...);
+
+        // The rows referenced by the other ranks are not known
+        dense_gradients(context);
+    }
+
+    /*!
+     * \brief Sum the given gradients of the given layer over all the ranks,
+     * compressed if the policy of the network compresses them
+     */
+    template <typename G>
+    void allreduce_variable(G& grad, size_t layer) {
+        grad.ensure_cpu_up_to_date();
+
+        const auto codec = dbn.gradient_compression.select(layer, etl::size(grad));
+
+        if (codec == gradient_codec::NONE) {
+            dbn.transport->allreduce(grad.memory_start(), etl::size(grad));
+        } else {
+            compressed_allreduce(*dbn.transport, dbn.gradient_compression, codec, grad.memory_start(), etl::size(grad), residuals[grad.memory_start()]);
+        }
+
+        grad.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Append the gradients of the given context to the bucket. The
+     * compressed gradients are not packed, they are summed separately with
+     * the bucket.
+     */
+    template <typename Context, size_t... I>
+    void pack_variables(Context& context, gradient_bucket& bucket, std::index_sequence<I...> /*seq*/) {
+        (pack_variable(std::get<I>(context.up.context)->grad, Context::index, bucket), ...);
+
+        // The rows referenced by the other ranks are not known
+        bucket.unpack.push_back([&context](const weight* values) {
+            dense_gradients(context);
+            return values;
+        });
+    }
+
+    /*!
+     * \brief Append the given gradients to the bucket
+     */
+    template <typename G>
+    void pack_variable(G& grad, size_t layer, gradient_bucket& bucket) {
+        if (dbn.gradient_compression.select(layer, etl::size(grad)) != gradient_codec::NONE) {
+            bucket.compressed.push_back([this, &grad, layer] { this->allreduce_variable(grad, layer); });
+            return;
+        }
+
+        grad.ensure_cpu_up_to_date();
+
+        bucket.values.insert(bucket.values.end(), grad.memory_start(), grad.memory_end());
+
+        bucket.unpack.push_back([&grad](const weight* values) {
+            std::copy(values, values + etl::size(grad), grad.memory_start());
+            grad.invalidate_gpu();
+            return values + etl::size(grad);
+        });
+    }
+
+    /*!
+     * \brief Start summing the gradients of the bucket over all the ranks,
+     * after the buckets already started, and empty it
+     */
+    void allreduce_bucket(gradient_bucket& bucket, std::future<void>& reduced) {
+        if (bucket.unpack.empty()) {
+            return;
+        }
+
+        reduced = std::async(std::launch::async, [this, packed = std::move(bucket), previous = std::move(reduced)]() mutable {
+            if (previous.valid()) {
+                previous.wait();
+            }
+
+            if (!packed.values.empty()) {
+                dbn.transport->allreduce(packed.values.data(), packed.values.size());
+            }
+
+            for (auto& compressed : packed.compressed) {
+                compressed();
+            }
+
+            const weight* values = packed.values.data();
+
+            for (auto& unpack : packed.unpack) {
+                values = unpack(values);
+            }
+        });
+
+        bucket = gradient_bucket();
+    }
+
+    /*!
+     * \brief Update the weights of the given layer with the gradients summed
+     * over all the ranks
+     */
+    template <typename Layer, typename Context>
+    void distributed_update_layer(size_t epoch, size_t n, Layer& layer, Context& context) {
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [this, epoch, n](auto& sub_layer, auto& sub_context) {
+                this->distributed_update_layer(epoch, n, sub_layer, sub_context);
+            });
+        } else {
+            this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer, context, n);
+        }
+    }
+
+    /*!
+     * \brief Send the weights of the given layer from the root to all the
+     * other ranks
+     */
+    template <typename Layer>
+    void broadcast_layer(Layer& layer) {
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, [this](auto& sub_layer) {
+                this->broadcast_layer(sub_layer);
+            });
+        } else if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+            broadcast_variables(layer, std::make_index_sequence<N>());
+        }
+    }
+
+    /*!
+     * \brief Send the given variables from the root to all the other ranks
+     */
+    template <typename Layer, size_t... I>
+    void broadcast_variables(Layer& layer, std::index_sequence<I...> /*seq*/) {
+        (broadcast_variable(std::get<I>(layer.trainable_parameters())), ...);
+    }
+
+    /*!
+     * \brief Send the given variable from the root to all the other ranks
+     */
+    template <typename W>
+    void broadcast_variable(W& w) {
+        w.ensure_cpu_up_to_date();
+
+        dbn.transport->broadcast(w.memory_start(), etl::size(w));
+
+        w.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the errors of the last layer and backpropagate them
+     * through the full context. When possible, the metrics of the batch
+     * are computed in the same pass as the errors of the last layer.
+     *
+     * \param n The number of samples
+     * \param labels The labels of the samples
+     * \param metrics The metrics of the batch (only set with fused_loss)
+     * \param done The functor to call once a layer is done
+     */
+    template <typename Labels, typename Done>
+    void backward_batch(size_t n, const Labels& labels, std::pair<double, double>& metrics, Done&& done) {
+        if constexpr (fused_loss<Labels>) {
+            metrics = fused_last_errors(full_context, n, labels);
+
+            backpropagate_contexts(full_context, done);
+        } else {
+            cpp_unused(metrics);
+
+            backward_contexts(full_context, n, labels, done);
+        }
+    }
+
+    /*!
+     * \brief Train a batch of data split in shards. The shards are trained
+     * concurrently by the thread pool of the network, each in its own
+     * contexts, and their gradients are reduced before a single update.
+     *
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \param compute_metrics Indicates if the error and the loss of the batch must be computed
+     * \return a pair containing the error and the loss for the batch (only meaningful with compute_metrics)
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch_parallel(size_t epoch, const Inputs& inputs, const Labels& labels, bool compute_metrics) {
+        dll::auto_timer timer("sgd::train_batch");
+        arena_scope step(arena);
+
+        const auto n = etl::dim<0>(inputs);
+
+        // Ensure that the data batch and the label batch are of the same size
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+
+        // Ensure that the contexts can hold the inputs
+        cpp_assert(n <= batch_size, "Invalid sizes");
+
+        // The trailing shards of a partial batch are empty
+        const size_t active = (n + shard_size - 1) / shard_size;
+
+        // Forward, backward and gradients of each shard
+
+        {
+            dll::auto_timer timer("sgd::shards");
+
+            dll::maybe_parallel_foreach_n(dbn.get_thread_pool(), 0, active, [&](size_t s) {
+                SERIAL_SECTION {
+                    arena_scope shard_step(shard_arenas[s]);
+
+                    auto& contexts = shard_contexts[s];
+
+                    const size_t first = s * shard_size;
+                    const size_t last  = std::min(n, first + shard_size);
+
+                    auto shard_inputs = etl::slice(inputs, first, last);
+                    auto shard_labels = etl::slice(labels, first, last);
+
+                    forward_contexts<true>(contexts, shard_inputs);
+                    backward_contexts(contexts, last - first, shard_labels);
+
+                    cpp::for_each(contexts, [](auto& layer_ctx) {
+                        compute_gradients(layer_ctx.first, *layer_ctx.second);
+                    });
+                }
+            });
+        }
+
+        // Reduce and apply the gradients
+
+        {
+            dll::auto_timer timer("sgd::grad");
+
+            reduce_gradients(active, std::make_index_sequence<layers>());
+
+            cpp::for_each(full_context, [this, epoch, n](auto& layer_ctx) {
+                this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer_ctx.first, *layer_ctx.second, n);
+            });
+        }
+
+        // Update the counter of iterations
+        ++iteration;
+
+        // Compute error and loss
+
+        if (!compute_metrics) {
+            return std::make_pair(1.0, -1.0);
+        }
+
+        {
+            dll::auto_timer timer("sgd::error");
+
+            double error = 0.0;
+            double loss  = 0.0;
+
+            for (size_t s = 0; s < active; ++s) {
+                auto& last_ctx = *std::get<layers - 1>(shard_contexts[s]).second;
+
+                const size_t first = s * shard_size;
+                const size_t last  = std::min(n, first + shard_size);
+
+                auto[shard_error, shard_loss] = dbn.evaluate_metrics_batch(last_ctx.output, etl::slice(labels, first, last), last - first, false);
+
+                error += shard_error;
+                loss += shard_loss;
+            }
+
+            return std::make_pair(error / n, loss / n);
+        }
+    }
+
+    /*!
+     * \brief Sum the gradients of the active shards into the gradients of
+     * the full context
+     */
+    template <size_t... L>
+    void reduce_gradients(size_t active, std::index_sequence<L...> /*seq*/) {
+        (reduce_layer_gradients<L>(active), ...);
+    }
+
+    template <size_t L>
+    void reduce_layer_gradients(size_t active) {
+        if constexpr (decay_layer_traits<typename dbn_t::template layer_type<L>>::is_neural_layer() && L >= frozen_layers) {
+            static constexpr size_t N = std::tuple_size<decltype(std::get<L>(full_context).first.trainable_parameters())>();
+
+            reduce_variables<L>(active, std::make_index_sequence<N>());
+        }
+    }
+
+    template <size_t L, size_t... I>
+    void reduce_variables(size_t active, std::index_sequence<I...> /*seq*/) {
+        (reduce_variable<L, I>(active), ...);
+    }
+
+    /*!
+     * \brief Sum the gradients of one variable of one layer.
+     *
+     * The gradients are partitioned in contiguous chunks of whole cache
+     * lines, each chunk being reduced over all the shards by a single
+     * thread, so that no two threads write to the same line.
+     */
+    template <size_t L, size_t I>
+    void reduce_variable(size_t active) {
+        auto& grad = std::get<I>(std::get<L>(full_context).second->up.context)->grad;
+
+        constexpr size_t line = std::max<size_t>(1, 64 / sizeof(weight));
+
+        const size_t size   = etl::size(grad);
+        const size_t lines  = (size + line - 1) / line;
+        const size_t chunks = std::min<size_t>(shards, lines);
+        const size_t chunk  = ((lines + chunks - 1) / chunks) * line;
+
+        for (size_t s = 0; s < active; ++s) {
+            std::get<I>(std::get<L>(shard_contexts[s]).second->up.context)->grad.ensure_cpu_up_to_date();
+        }
+
+        grad.ensure_cpu_up_to_date();
+
+        weight* target = grad.memory_start();
+
+        dll::maybe_parallel_foreach_n(dbn.get_thread_pool(), 0, chunks, [&](size_t c) {
+            const size_t first = c * chunk;
+            const size_t last  = std::min(size, first + chunk);
+
+            const weight* source = std::get<I>(std::get<L>(shard_contexts[0]).second->up.context)->grad.memory_start();
+
+            std::copy(source + first, source + last, target + first);
+
+            for (size_t s = 1; s < active; ++s) {
+                source = std::get<I>(std::get<L>(shard_contexts[s]).second->up.context)->grad.memory_start();
+
+                for (size_t i = first; i < last; ++i) {
+                    target[i] += source[i];
+                }
+            }
+        });
+
+        grad.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the errors of the last layer and backpropagate them
+     * through the given contexts
+     * \param contexts The contexts, filled by a forward pass
+     * \param n The number of samples
+     * \param labels The labels of the samples
+     */
+    template <typename Contexts, typename Labels>
+    static void backward_contexts(Contexts& contexts, size_t n, const Labels& labels) {
+        backward_contexts(contexts, n, labels, [](auto& /*layer*/, auto& /*context*/) {});
+    }
+
+    /*!
+     * \brief Compute the errors of the last layer and backpropagate them
+     * through the given contexts.
+     *
+     * The done functor is called with each layer and its context, from the
+     * last to the first layer, as soon as the backward pass does not need
+     * the weights of the layer anymore.
+     *
+     * \param contexts The contexts, filled by a forward pass
+     * \param n The number of samples
+     * \param labels The labels of the samples
+     * \param done The functor to call once a layer is done
+     */
+    template <typename Contexts, typename Labels, typename Done>
+    static void backward_contexts(Contexts& contexts, size_t n, const Labels& labels, Done&& done) {
+        auto& first_ctx = *std::get<0>(contexts).second;
+
+        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+
+        //Compute the errors of the last layer
+
+        last_errors<dbn_t::loss>(contexts, full_batch, n, labels);
+
+        // Backpropagate the error
+
+        backpropagate_contexts(contexts, done);
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the last layer through the given
+     * contexts.
+     *
+     * \param contexts The contexts, with the errors of the last layer
+     * \param done The functor to call once a layer is done
+     */
+    template <typename Contexts, typename Done>
+    static void backpropagate_contexts(Contexts& contexts, Done&& done) {
+        bool last = true;
+
+        backpropagate_layers(contexts, done, last, std::make_index_sequence<layers - 1>());
+
+        if constexpr (frozen_layers == 0) {
+            auto& first_layer = std::get<0>(contexts).first;
+            auto& first_ctx   = *std::get<0>(contexts).second;
+
+            first_layer.adapt_errors(first_ctx);
+
+            done(first_layer, first_ctx);
+        }
+    }
+
+    template <typename Contexts, typename Done, size_t... I>
+    static void backpropagate_layers(Contexts& contexts, Done& done, bool& last, std::index_sequence<I...> /*seq*/) {
+        (backpropagate_layer<layers - 1 - I>(contexts, done, last), ...);
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the Lth layer into the errors of
+     * the previous layer. The backward pass stops at the first trained
+     * layer, the frozen layers need neither errors nor gradients.
+     */
+    template <size_t L, typename Contexts, typename Done>
+    static void backpropagate_layer(Contexts& contexts, Done& done, bool& last) {
+        auto& layer   = std::get<L>(contexts).first;
+        auto& context = *std::get<L>(contexts).second;
+
+        if constexpr (L > frozen_layers || is_utility_layer<std::decay_t<decltype(layer)>>) {
+            if constexpr (L >= frozen_layers) {
+                backward_layer(layer, context, get_errors(*std::get<L - 1>(contexts).second), last);
+            }
+        } else if constexpr (L == frozen_layers) {
+            // Only the errors of the first trained layer are completed
+            if (!last) {
+                layer.adapt_errors(context);
+            }
+
+            last = false;
+        }
+
+        if constexpr (L >= frozen_layers) {
+            done(layer, context);
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients of the given layer, unless it is frozen
+     */
+    template <typename Layer, typename Context>
+    static void compute_gradients(Layer& layer, Context& context) {
+        if constexpr (!Context::frozen) {
+            layer.compute_gradients(context);
+
+            // The gradients of the tied layer are those of the transposed weights
+            if constexpr (has_tied_context<Context>::value) {
+                auto& decoder = *context.tied.context;
+
+                std::get<0>(context.up.context)->grad += etl::batch_outer(decoder.errors, decoder.input);
+            }
+        } else {
+            cpp_unused(layer);
+            cpp_unused(context);
+        }
+    }
+
+    template <typename Layer, typename Context>
+    void apply_gradients_layer(size_t epoch, size_t n, Layer& layer, Context& context){
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [this, epoch, n](auto& sub_layer, auto& sub_context) {
+                this->apply_gradients_layer(epoch, n, sub_layer, sub_context);
+            });
+        } else {
+            // Compute the gradients
+            compute_gradients(layer, context);
+            gradient_norms(layer, context);
+
+            // Apply the gradients
+            this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer, context, n);
+        }
+    }
+
+    /*!
+     * \brief Compute the squared norms of the freshly computed gradients of
+     * the given layer, before they are evicted from the cache, to spare the
+     * first pass of the clipping in the fused update.
+     *
+     * This is only done for the variables without decay, whose gradients
+     * are not modified before the update.
+     */
+    template <typename Layer, typename Context>
+    void gradient_norms([[maybe_unused]] Layer& layer, [[maybe_unused]] Context& context){
+        if constexpr (!gpu_resident && dbn_traits<dbn_t>::has_clip_gradients() && decay_layer_traits<Layer>::is_neural_layer() && !Context::frozen && !has_sparse_gradients<Context>::value) {
+            static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+            context.grad_sq_norms.resize(N);
+
+            gradient_norms(context, std::make_index_sequence<N>());
+        }
+    }
+
+    template <typename Context, size_t... I>
+    void gradient_norms(Context& context, std::index_sequence<I...> /*seq*/){
+        (gradient_norm<I>(context), ...);
+    }
 
-        auto& first_layer = std::get<0>(full_context).first;
-        auto& first_ctx   = *std::get<0>(full_context).second;
-        auto& last_ctx    = *std::get<layers - 1>(full_context).second;
+    template <size_t I, typename Context>
+    void gradient_norm(Context& context){
+        constexpr auto decay = I == 0 ? w_decay(dbn_traits<dbn_t>::decay()) : b_decay(dbn_traits<dbn_t>::decay());
 
-        const auto n          = etl::dim<0>(inputs);
-        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+        auto& grad = std::get<I>(context.up.context)->grad;
 
-        // Ensure that the data batch and the label batch are of the same size
-        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+        if constexpr (decay == decay_type::NONE && etl::is_dma<std::decay_t<decltype(grad)>>) {
+            grad.ensure_cpu_up_to_date();
 
-        // Ensure that the context can hold the inputs
-        cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
+            const weight* g_p = grad.memory_start();
+            const size_t size = etl::size(grad);
 
-        //Feedforward pass
+            double sum = 0.0;
 
-        {
-            dll::auto_timer timer("sgd::forward");
+            for (size_t i = 0; i < size; ++i) {
+                sum += g_p[i] * g_p[i];
+            }
 
-            forward_batch_helper<true>(inputs);
+            context.grad_sq_norms[I] = sum;
+        } else {
+            context.grad_sq_norms[I] = -1.0;
         }
+    }
 
-        {
-            dll::auto_timer timer("sgd::backward");
-
-            //Compute the errors of the last layer
+    /*!
+     * \brief Compute the gradients of the given layer and accumulate them.
+     *
+     * When apply is set, the gradients of the current batch are completed
+     * with the accumulated gradients and the weights are updated.
+     */
+    template <typename Layer, typename Context>
+    void accumulate_gradients_layer(bool apply, Layer& layer, Context& context){
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [this, apply](auto& sub_layer, auto& sub_context) {
+                this->accumulate_gradients_layer(apply, sub_layer, sub_context);
+            });
+        } else {
+            // Compute the gradients
+            compute_gradients(layer, context);
 
-            last_errors<dbn_t::loss>(full_batch, n, labels);
+            if constexpr (decay_layer_traits<Layer>::is_neural_layer() && !Context::frozen) {
+                if (!context.acc) {
+                    context.acc = std::make_unique<typename Context::accumulator_t>(layer);
+                }
 
-            // Backpropagate the error
+                static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
 
-            bool last = true;
+                accumulate_variables(context, apply, std::make_index_sequence<N>());
 
-            cpp::for_each_rpair(full_context, [&last](auto& layer_ctx_1, auto& layer_ctx_2) {
-                backward_layer(layer_ctx_2.first, *layer_ctx_2.second, get_errors(*layer_ctx_1.second), last);
-            });
+                // Apply all the accumulated gradients
+                if (apply) {
+                    dense_gradients(context);
 
-            first_layer.adapt_errors(first_ctx);
+                    this->update_weights<dbn_traits<dbn_t>::updater()>(accumulated_epoch, layer, context, accumulated_samples);
+                }
+            }
         }
+    }
 
-        // Compute and apply the gradients
+    template <typename Context, size_t... I>
+    void accumulate_variables(Context& context, bool apply, std::index_sequence<I...> /*seq*/) {
+        (accumulate_variable<I>(context, apply), ...);
+    }
 
-        {
-            dll::auto_timer timer("sgd::grad");
+    template <size_t I, typename Context>
+    void accumulate_variable(Context& context, bool apply) {
+        auto& grad = std::get<I>(context.up.context)->grad;
+        auto& acc  = std::get<I>(context.acc->context)->grad;
 
-            cpp::for_each(full_context, [this, epoch, n](auto& layer_ctx) {
-                this->apply_gradients_layer(epoch, n, layer_ctx.first, *layer_ctx.second);
-            });
+        if (apply) {
+            grad += acc;
+        } else if (!accumulated) {
+            acc = grad;
+        } else {
+            acc += grad;
         }
+    }
 
-        // Update the counter of iterations
-        ++iteration;
-
-        // Compute error and loss
+    /*!
+     * \brief Update the weights of the given layer with the gradients
+     * accumulated so far
+     */
+    template <typename Layer, typename Context>
+    void flush_gradients_layer(Layer& layer, Context& context){
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [this](auto& sub_layer, auto& sub_context) {
+                this->flush_gradients_layer(sub_layer, sub_context);
+            });
+        } else if constexpr (decay_layer_traits<Layer>::is_neural_layer() && !Context::frozen) {
+            static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
 
-        {
-            dll::auto_timer timer("sgd::error");
+            flush_variables(context, std::make_index_sequence<N>());
 
-            auto[error, loss] = dbn.evaluate_metrics_batch(last_ctx.output, labels, n, true);
+            dense_gradients(context);
 
-            return std::make_pair(error, loss);
+            this->update_weights<dbn_traits<dbn_t>::updater()>(accumulated_epoch, layer, context, accumulated_samples);
         }
     }
 
-    template <typename Layer, typename Context>
-    void apply_gradients_layer(size_t epoch, size_t n, Layer& layer, Context& context){
-        if constexpr (is_utility_layer<Layer>) {
-            cpp::for_each(layer.layers, context.sub_contexts, [this, epoch, n](auto& sub_layer, auto& sub_context) {
-                this->apply_gradients_layer(epoch, n, sub_layer, sub_context);
-            });
-        } else {
-            // Compute the gradients
-            layer.compute_gradients(context);
+    template <typename Context, size_t... I>
+    static void flush_variables(Context& context, std::index_sequence<I...> /*seq*/) {
+        ((std::get<I>(context.up.context)->grad = std::get<I>(context.acc->context)->grad), ...);
+    }
 
-            // Apply the gradients
-            this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer, context, n);
+    /*!
+     * \brief Indicates that the gradients of the given context are not
+     * sparse anymore, after they have been written as a whole
+     */
+    template <typename Context>
+    static void dense_gradients([[maybe_unused]] Context& context) {
+        if constexpr (has_sparse_gradients<Context>::value) {
+            context.sparse = false;
         }
     }
 
@@ -747,32 +2681,50 @@ struct sgd_trainer {
 
     template <typename Layer, typename Context, typename Errors, cpp_enable_iff(is_merge_layer<Layer>)>
     static void backward_layer(Layer& layer, Context& context, Errors&& errors, bool& last){
-        errors = 0;
+        // Dispatch all the sub contexts, the first branch backpropagates
+        // into the errors, the others into their own errors, which are
+        // then added
 
-        // Dispatch all the sub contexts
+        auto cost = [&context](auto i) { return etl::size(get_output(std::get<i>(context.sub_contexts))); };
 
-        cpp::for_each_i(layer.layers, context.sub_contexts, [&context, &errors, &last](size_t i, auto& sub_layer, auto& sub_context){
-            batch_dispatch(get_errors(sub_context), context.errors, i);
+        for_each_branch<Layer::n_layers>(layer.parallel_threshold, cost, [&](auto i) {
+            auto& sub_context = std::get<i>(context.sub_contexts);
 
-            auto back_errors = errors;
+            dispatch_branch(get_errors(sub_context), context.errors, i);
 
             bool sub_last = last;
-            backward_layer(sub_layer, sub_context, back_errors, sub_last);
 
-            errors += back_errors;
+            if constexpr (i == 0) {
+                backward_layer(std::get<i>(layer.layers), sub_context, errors, sub_last);
+            } else {
+                backward_layer(std::get<i>(layer.layers), sub_context, context.back_errors[i - 1], sub_last);
+            }
         });
 
+        for (auto& sub_errors : context.back_errors) {
+            errors += sub_errors;
+        }
+
         last = false;
     }
 
     template <bool Train, typename Layer, typename Inputs, typename Context, cpp_disable_iff(is_utility_layer<Layer>)>
     static void forward_layer(Layer& layer, Inputs&& inputs, Context& context) {
-        context.input = inputs;
-
-        if constexpr (Train) {
-            layer.train_forward_batch(context.output, context.input);
+        if constexpr (is_in_place_layer_v<Layer> || is_last_step_layer_v<Layer>) {
+            // The backward pass does not need the input, it is not copied
+            if constexpr (Train) {
+                layer.train_forward_batch(context.output, inputs);
+            } else {
+                layer.test_forward_batch(context.output, inputs);
+            }
         } else {
-            layer.test_forward_batch(context.output, context.input);
+            context.input = inputs;
+
+            if constexpr (Train) {
+                layer.train_forward_batch(context.output, context.input);
+            } else {
+                layer.test_forward_batch(context.output, context.input);
+            }
         }
     }
 
@@ -799,30 +2751,22 @@ struct sgd_trainer {
         forward_layer_group<Train, 0>(layer, inputs, context);
     }
 
-    template <bool Train, size_t L, typename Layer, typename Inputs, typename Context>
-    static void forward_layer_merge(Layer& layer, Inputs&& inputs, Context& context) {
-        if constexpr (L < Layer::n_layers) {
-            auto& sub_layer   = std::get<L>(layer.layers);
-            auto& sub_context = std::get<L>(context.sub_contexts);
-
-            forward_layer<Train>(sub_layer, inputs, sub_context);
-
-            forward_layer_merge<Train, L + 1>(layer, inputs, context);
-        }
-    }
-
     template <bool Train, typename Layer, typename Inputs, typename Context, cpp_enable_iff(is_merge_layer<Layer>)>
     static void forward_layer(Layer& layer, Inputs&& inputs, Context& context) {
         context.input = inputs;
 
-        // Fully forward each group
+        // Fully forward each group, the groups are independent
+
+        auto cost = [&context](auto i) { return etl::size(get_output(std::get<i>(context.sub_contexts))); };
 
-        forward_layer_merge<Train, 0>(layer, context.input, context);
+        for_each_branch<Layer::n_layers>(layer.parallel_threshold, cost, [&layer, &context](auto i) {
+            auto& sub_context = std::get<i>(context.sub_contexts);
 
-        // Concatenate all the sub contexts
+            forward_layer<Train>(std::get<i>(layer.layers), context.input, sub_context);
 
-        cpp::for_each_i(context.sub_contexts, [&context](size_t i, auto& sub_context){
-            batch_merge(context.output, get_output(sub_context), i);
+            // Concatenate the output of the group
+
+            merge_branch(context.output, get_output(sub_context), i);
         });
     }
 
@@ -854,9 +2798,20 @@ struct sgd_trainer {
 
     template <bool Train, typename Inputs>
     auto& forward_batch_helper(Inputs&& inputs) {
-        auto& first_layer = std::get<0>(full_context).first;
-        auto& first_ctx   = *std::get<0>(full_context).second;
-        auto& last_ctx    = *std::get<layers - 1>(full_context).second;
+        return forward_contexts<Train>(full_context, inputs);
+    }
+
+    /*!
+     * \brief Forward propagate the inputs through the given contexts
+     * \param contexts The contexts to fill
+     * \param inputs The batch of inputs
+     * \return the output of the last layer
+     */
+    template <bool Train, typename Contexts, typename Inputs>
+    static auto& forward_contexts(Contexts& contexts, Inputs&& inputs) {
+        auto& first_layer = std::get<0>(contexts).first;
+        auto& first_ctx   = *std::get<0>(contexts).second;
+        auto& last_ctx    = *std::get<layers - 1>(contexts).second;
 
         const auto n          = etl::dim<0>(inputs);
         const bool full_batch = n == etl::dim<0>(first_ctx.input);
@@ -864,36 +2819,117 @@ struct sgd_trainer {
         // Ensure that the context can hold the inputs
         cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
 
+        using first_layer_t = std::decay_t<decltype(first_layer)>;
+
+        // The input of the first context is only read again to compute the
+        // gradients of a neural first layer. Otherwise, a full batch of the
+        // same shape and type is forwarded directly from the storage of the
+        // generator, without the copy.
+        constexpr bool bindable =
+            (!Train || frozen_layers > 0 || !decay_layer_traits<first_layer_t>::is_neural_layer())
+            && std::is_same<etl::value_t<std::decay_t<Inputs>>, etl::value_t<decltype(first_ctx.input)>>::value;
+
+        // A first layer that only reinterprets the shape of the batch is
+        // skipped, the second layer reads the batch directly
+        constexpr bool alias = layers > 1 && is_alias_layer_v<first_layer_t>;
+
+        if constexpr (bindable) {
+            if (full_batch && same_shape(inputs, first_ctx.input)) {
+                if constexpr (alias) {
+                    forward_next_contexts<Train, 1>(contexts, inputs);
+                } else {
+                    if constexpr (Train && frozen_layers == 0) {
+                        first_layer.train_forward_batch(first_ctx.output, inputs);
+                    } else {
+                        first_layer.test_forward_batch(first_ctx.output, inputs);
+                    }
+
+                    forward_next_contexts<Train, 1>(contexts, first_ctx.output);
+                }
+
+                return last_ctx.output;
+            }
+        }
+
         if (cpp_unlikely(!full_batch)) {
-            first_ctx.input  = 0;
-            first_ctx.output = 0;
+            // The active rows are copied at once and only the inactive rows
+            // are cleared, the output is entirely overwritten by the layer
 
-            for (size_t i = 0; i < etl::dim<0>(inputs); ++i) {
-                first_ctx.input(i) = inputs(i);
-            }
+            const size_t B = etl::dim<0>(first_ctx.input);
+
+            etl::slice(first_ctx.input, 0, n) = inputs;
+            etl::slice(first_ctx.input, n, B) = 0;
         } else {
             first_ctx.input = inputs;
         }
 
-        if constexpr (Train) {
-            first_layer.train_forward_batch(first_ctx.output, first_ctx.input);
+        if constexpr (alias) {
+            forward_next_contexts<Train, 1>(contexts, first_ctx.input);
         } else {
-            first_layer.test_forward_batch(first_ctx.output, first_ctx.input);
-        }
+            if constexpr (Train && frozen_layers == 0) {
+                first_layer.train_forward_batch(first_ctx.output, first_ctx.input);
+            } else {
+                first_layer.test_forward_batch(first_ctx.output, first_ctx.input);
+            }
 
-        cpp::for_each_pair(full_context, [this](auto& layer_ctx_1, auto& layer_ctx_2) {
-            this->template forward_layer<Train>(layer_ctx_2.first, get_output(*layer_ctx_1.second), *layer_ctx_2.second);
-        });
+            forward_next_contexts<Train, 1>(contexts, first_ctx.output);
+        }
 
         return last_ctx.output;
     }
 
+    /*!
+     * \brief Forward propagate the given batch through the contexts from
+     * the Ith one.
+     *
+     * The layers that only reinterpret the shape of their input, but the
+     * last one, are skipped: the next layer reads the same batch into its
+     * own input, with its own shape.
+     *
+     * \param source The input of the Ith layer
+     */
+    template <bool Train, size_t I, typename Contexts, typename Source>
+    static void forward_next_contexts(Contexts& contexts, Source& source) {
+        if constexpr (I < layers) {
+            auto& layer   = std::get<I>(contexts).first;
+            auto& context = *std::get<I>(contexts).second;
+
+            if constexpr (I < layers - 1 && is_alias_layer_v<decltype(layer)>) {
+                forward_next_contexts<Train, I + 1>(contexts, source);
+            } else {
+                // The frozen layers are forwarded as for inference
+                this_type::template forward_layer<Train && (I >= frozen_layers)>(layer, source, context);
+
+                forward_next_contexts<Train, I + 1>(contexts, get_output(context));
+            }
+        }
+    }
+
+    /*!
+     * \brief Indicates if the two given expressions have exactly the same
+     * dimensions
+     */
+    template <typename A, typename B>
+    static bool same_shape(const A& a, const B& b) {
+        if (etl::dimensions(a) != etl::dimensions(b)) {
+            return false;
+        }
+
+        for (size_t d = 0; d < etl::dimensions(a); ++d) {
+            if (etl::dim(a, d) != etl::dim(b, d)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
     /*!
      * \brief Apply the gradients to the given layer
      */
     template <updater_type UT, typename L, typename C>
     void update_weights([[maybe_unused]] size_t epoch, [[maybe_unused]] L& layer, [[maybe_unused]] C& context, [[maybe_unused]] size_t n) {
-        if constexpr (decay_layer_traits<L>::is_neural_layer()) {
+        if constexpr (decay_layer_traits<L>::is_neural_layer() && !C::frozen) {
             dll::auto_timer timer("sgd::update_weights");
 
             // Update all variables of the layer
@@ -901,6 +2937,12 @@ struct sgd_trainer {
             static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
 
             update_variables<UT>(epoch, layer, context, n, std::make_index_sequence<N>());
+
+            // Keep the pruned weights at zero
+
+            if constexpr (is_prunable_layer_v<L>) {
+                layer.apply_weights_mask();
+            }
         }
     }
 
@@ -920,21 +2962,408 @@ struct sgd_trainer {
             eps *= 1.0 / (1.0 + eps_decay * iteration);
         }
 
-        //2. Update the gradients (L1/L2 and gradient clipping)
-
         auto& w      = std::get<I>(layer.trainable_parameters());
         auto& w_grad = std::get<I>(context.up.context)->grad;
 
         // Note the distinction for w and b for decay is far from optimal...
-        if constexpr (I == 0) {
-            this->update_grad<w_decay(dbn_traits<dbn_t>::decay())>(w, w_grad, n);
+        constexpr auto decay = I == 0 ? w_decay(dbn_traits<dbn_t>::decay()) : b_decay(dbn_traits<dbn_t>::decay());
+
+        if constexpr (sparse_update<I, UT, decay, C>) {
+            if (context.sparse) {
+                // 2. and 3. Only update the rows referenced by the batch
+
+                sparse_apply_gradients<I, UT>(layer, context, n, eps);
+
+                cpp_unused(epoch);
+
+                return;
+            }
+        }
+
+        // The single pass is done on the CPU, the GPU-resident training
+        // keeps the expressions, computed on the device
+        if constexpr (!gpu_resident && etl::is_dma<std::decay_t<decltype(w)>> && etl::is_dma<std::decay_t<decltype(w_grad)>>) {
+            // 2. and 3. Update and apply the gradients in a single pass
+
+            fused_apply_gradients<I, UT, decay>(layer, context, n, eps);
+
+            cpp_unused(epoch);
         } else {
-            this->update_grad<b_decay(dbn_traits<dbn_t>::decay())>(w, w_grad, n);
+            //2. Update the gradients (L1/L2 and gradient clipping)
+
+            this->update_grad<decay>(w, w_grad, n);
+
+            // 3. Apply the gradients
+
+            apply_gradients<I, UT>(epoch, layer, context, n, eps);
+        }
+    }
+
+    /*!
+     * \brief Update and apply the gradients of one variable, element by
+     * element.
+     *
+     * The decay of the gradients is applied on the fly, the step functor
+     * receives the index of the element and its final gradient and must
+     * update the weight and the state of the updater. When the gradients
+     * are clipped and their norm has not been computed with them, it is
+     * computed in a first read-only pass. Both passes are compiled for the
+     * instruction set of the processor.
+     *
+     * \param w The weights
+     * \param grad The gradients
+     * \param n The number of samples of the batch
+     * \param sq_norm The squared norm of the gradients (negative if unknown)
+     * \param step The update of one element
+     */
+    template <decay_type decay, typename W, typename G, typename Step>
+    void fused_update(W& w, G& grad, size_t n, [[maybe_unused]] double sq_norm, Step step) {
+        w.ensure_cpu_up_to_date();
+        grad.ensure_cpu_up_to_date();
+
+        weight* w_p       = w.memory_start();
+        const weight* g_p = grad.memory_start();
+
+        const size_t size = etl::size(w);
+        const weight l1   = dbn.l1_weight_cost;
+        const weight l2   = dbn.l2_weight_cost;
+
+        auto decayed = [w_p, g_p, l1, l2](size_t i) {
+            weight g = g_p[i];
+
+            if constexpr (decay == decay_type::L1) {
+                g -= l1 * std::abs(w_p[i]);
+            } else if constexpr (decay == decay_type::L2) {
+                g -= l2 * w_p[i];
+            } else if constexpr (decay == decay_type::L1L2) {
+                g -= l1 * std::abs(w_p[i]) + l2 * w_p[i];
+            }
+
+            return g;
+        };
+
+        weight scale = 1.0;
+
+        if constexpr (dbn_traits<dbn_t>::has_clip_gradients()) {
+            double sum = sq_norm;
+
+            if (sum < 0.0) {
+                sum = detail::vectorized_sum(size, [decayed](size_t i) {
+                    const weight g = decayed(i);
+                    return g * g;
+                });
+            }
+
+            const auto t            = dbn.gradient_clip;
+            const auto grad_l2_norm = std::sqrt(sum / (n * n));
+
+            if (grad_l2_norm > t) {
+                scale = t / grad_l2_norm;
+            }
+        }
+
+        detail::vectorized_for(size, [step, scale, decayed](size_t i) {
+            step(i, scale * decayed(i));
+        });
+
+        w.invalidate_gpu();
+
+        nan_check_deep(w);
+    }
+
+    /*!
+     * \brief Indicates if the given variable can be updated only on the
+     * rows of its sparse gradients.
+     *
+     * This is exact for SGD without decay. For MOMENTUM and ADAM, the state
+     * of the other rows should still be decayed, this is only done when
+     * lazy updates are enabled.
+     */
+    template <size_t I, updater_type UT, decay_type decay, typename C>
+    static constexpr bool sparse_update =
+            !gpu_resident && has_sparse_gradients<C>::value && I == 0 && decay == decay_type::NONE
+        &&  (UT == updater_type::SGD || (dbn_traits<dbn_t>::lazy_updates() && (UT == updater_type::MOMENTUM || UT == updater_type::ADAM)));
+
+    /*!
+     * \brief Update and apply the sparse gradients of one variable, only on
+     * the rows referenced by the batch.
+     *
+     * The other rows of the gradients are zero, so the norm of the gradients
+     * for clipping is computed on the same rows.
+     *
+     * \param w The weights
+     * \param grad The gradients
+     * \param rows The non-zero rows of the gradients
+     * \param n The number of samples of the batch
+     * \param step The update of one element
+     */
+    template <typename W, typename G, typename Step>
+    void sparse_update_rows(W& w, G& grad, const std::vector<size_t>& rows, size_t n, Step step) {
+        w.ensure_cpu_up_to_date();
+        grad.ensure_cpu_up_to_date();
+
+        const weight* g_p = grad.memory_start();
+
+        const size_t K = etl::dim(w, 1);
+
+        weight scale = 1.0;
+
+        if constexpr (dbn_traits<dbn_t>::has_clip_gradients()) {
+            double sum = 0.0;
+
+            for (size_t r : rows) {
+                for (size_t i = r * K; i < (r + 1) * K; ++i) {
+                    sum += g_p[i] * g_p[i];
+                }
+            }
+
+            const auto t            = dbn.gradient_clip;
+            const auto grad_l2_norm = std::sqrt(sum / (n * n));
+
+            if (grad_l2_norm > t) {
+                scale = t / grad_l2_norm;
+            }
+        }
+
+        for (size_t r : rows) {
+            for (size_t i = r * K; i < (r + 1) * K; ++i) {
+                step(i, scale * g_p[i]);
+            }
+        }
+
+        w.invalidate_gpu();
+
+        nan_check_deep(w);
+    }
+
+    /*!
+     * \brief Update and apply the sparse gradients of one variable, row by
+     * row. This is the same update as fused_apply_gradients, restricted to
+     * the rows referenced by the batch.
+     */
+    template <size_t I, updater_type UT, typename L, typename C>
+    void sparse_apply_gradients(L& layer, C& context, size_t n, weight eps) {
+        dll::auto_timer timer("sgd::apply_grad:sparse");
+
+        auto& w   = std::get<I>(layer.trainable_parameters());
+        auto& ctx = *std::get<I>(context.up.context);
+
+        weight* w_p = w.memory_start();
+
+        if constexpr (UT == updater_type::SGD) {
+            const weight f = eps / n;
+
+            sparse_update_rows(w, ctx.grad, context.rows, n, [=](size_t i, weight g) {
+                w_p[i] += f * g;
+            });
+        } else if constexpr (UT == updater_type::MOMENTUM) {
+            const weight momentum = dbn.momentum;
+            const weight f        = eps / n;
+
+            weight* inc = state_memory(ctx.inc);
+
+            sparse_update_rows(w, ctx.grad, context.rows, n, [=](size_t i, weight g) {
+                inc[i] = momentum * inc[i] + f * g;
+                w_p[i] += inc[i];
+            });
+        } else if constexpr (UT == updater_type::ADAM) {
+            const weight beta1 = dbn.adam_beta1;
+            const weight beta2 = dbn.adam_beta2;
+            const weight e     = 1e-8;
+
+            weight* w_m = state_memory(ctx.m);
+            weight* w_v = state_memory(ctx.v);
+
+            sparse_update_rows(w, ctx.grad, context.rows, n, [=](size_t i, weight g) {
+                w_m[i] = beta1 * w_m[i] + (1.0 - beta1) * g;
+                w_v[i] = beta2 * w_v[i] + (1.0 - beta2) * (g * g);
+                w_p[i] += (eps * w_m[i]) / (std::sqrt(w_v[i]) + e);
+            });
+        }
+    }
+
+    /*!
+     * \brief Returns a pointer to the memory of the given state of the
+     * updater, ready to be updated on CPU
+     */
+    template <typename T>
+    static weight* state_memory(T& state) {
+        state.ensure_cpu_up_to_date();
+        state.invalidate_gpu();
+
+        return state.memory_start();
+    }
+
+    /*!
+     * \brief Update and apply the gradients of one variable in a single pass
+     * over the memory of the weights, the gradients and the state of the
+     * updater.
+     *
+     * This computes exactly the same update as the decay, the clipping and
+     * the apply_gradients of the updater, without the temporaries and
+     * intermediate passes of the separate expressions.
+     */
+    template <size_t I, updater_type UT, decay_type decay, typename L, typename C>
+    void fused_apply_gradients(L& layer, C& context, size_t n, weight eps) {
+        dll::auto_timer timer("sgd::apply_grad:fused");
+
+        auto& w   = std::get<I>(layer.trainable_parameters());
+        auto& ctx = *std::get<I>(context.up.context);
+
+        weight* w_p = w.memory_start();
+
+        const weight e = 1e-8;
+
+        // The squared norm of the gradients, if computed with them
+        double sq_norm = -1.0;
+
+        if (I < context.grad_sq_norms.size()) {
+            sq_norm = context.grad_sq_norms[I];
+
+            context.grad_sq_norms[I] = -1.0;
         }
 
-        // 3. Apply the gradients
+        if constexpr (UT == updater_type::SGD) {
+            const weight f = eps / n;
 
-        apply_gradients<I, UT>(epoch, layer, context, n, eps);
+            fused_update<decay>(w, ctx.grad, n, sq_norm, [=](size_t i, weight g) {
+                w_p[i] += f * g;
+            });
+        } else if constexpr (UT == updater_type::MOMENTUM) {
+            const weight momentum = dbn.momentum;
+            const weight f        = eps / n;
+
+            weight* inc = state_memory(ctx.inc);
+
+            fused_update<decay>(w, ctx.grad, n, sq_norm, [=](size_t i, weight g) {
+                inc[i] = momentum * inc[i] + f * g;
+                w_p[i] += inc[i];
+            });
+        } else if constexpr (UT == updater_type::NESTEROV) {
+            const weight momentum = dbn.momentum;
+            const weight f        = eps / n;
+
+            weight* inc      = state_memory(ctx.inc);
+            weight* inc_prev = state_memory(ctx.inc_prev);
+
+            fused_update<decay>(w, ctx.grad, n, sq_norm, [=](size_t i, weight g) {
+                inc_prev[i] = inc[i];
+                inc[i]      = momentum * inc[i] + f * g;
+                w_p[i] += -momentum * inc_prev[i] + (1.0 + momentum) * inc[i];
+            });
+        } else if constexpr (UT == updater_type::ADAGRAD) {
+            weight* inc = state_memory(ctx.inc);
+
+            fused_update<decay>(w, ctx.grad, n, sq_norm, [=](size_t i, weight g) {
+                inc[i] += g * g;
+                w_p[i] += (eps * g) / std::sqrt(inc[i] + e);
+            });
+        } else if constexpr (UT == updater_type::ADADELTA) {
+            const weight beta = dbn.adadelta_beta;
+
+            weight* w_g = state_memory(ctx.g);
+            weight* w_v = state_memory(ctx.v);
+            weight* w_x = state_memory(ctx.x);
+
+            fused_update<decay>(w, ctx.grad, n, sq_norm, [=](size_t i, weight g) {
+                w_g[i] = beta * w_g[i] + (1.0 - beta) * (g * g);
+                w_v[i] = (std::sqrt(w_x[i] + e) * g) / std::sqrt(w_g[i] + e);
+                w_x[i] = beta * w_x[i] + (1.0 - beta) * (w_v[i] * w_v[i]);
+                w_p[i] += w_v[i];
+            });
+        } else if constexpr (UT == updater_type::ADAM) {
+            const weight beta1 = dbn.adam_beta1;
+            const weight beta2 = dbn.adam_beta2;
+
+            weight* w_m = state_memory(ctx.m);
+            weight* w_v = state_memory(ctx.v);
+
+            fused_update<decay>(w, ctx.grad, n, sq_norm, [=](size_t i, weight g) {
+                w_m[i] = beta1 * w_m[i] + (1.0 - beta1) * g;
+                w_v[i] = beta2 * w_v[i] + (1.0 - beta2) * (g * g);
+                w_p[i] += (eps * w_m[i]) / (std::sqrt(w_v[i]) + e);
+            });
+        } else if constexpr (UT == updater_type::ADAM_CORRECT) {
+            const weight beta1 = dbn.adam_beta1;
+            const weight beta2 = dbn.adam_beta2;
+            const weight c1    = 1.0 / (1.0 - std::pow(beta1, iteration));
+            const weight c2    = 1.0 / (1.0 - std::pow(beta2, iteration));
+
+            weight* w_m  = state_memory(ctx.m);
+            weight* w_mt = state_memory(ctx.mt);
+            weight* w_v  = state_memory(ctx.v);
+            weight* w_vt = state_memory(ctx.vt);
+
+            // Note: Like the expression version, the corrected moments are
+            // kept in the state, but the update uses the raw moments
+
+            fused_update<decay>(w, ctx.grad, n, sq_norm, [=](size_t i, weight g) {
+                w_m[i]  = beta1 * w_m[i] + (1.0 - beta1) * g;
+                w_v[i]  = beta2 * w_v[i] + (1.0 - beta2) * (g * g);
+                w_mt[i] = w_m[i] * c1;
+                w_vt[i] = w_v[i] * c2;
+                w_p[i] += (eps * w_m[i]) / (std::sqrt(w_v[i]) + e);
+            });
+        } else if constexpr (UT == updater_type::ADAMAX) {
+            const weight beta1 = dbn.adam_beta1;
+            const weight beta2 = dbn.adam_beta2;
+
+            weight* w_m = state_memory(ctx.m);
+            weight* w_v = state_memory(ctx.v);
+
+            fused_update<decay>(w, ctx.grad, n, sq_norm, [=](size_t i, weight g) {
+                w_m[i] = beta1 * w_m[i] + (1.0 - beta1) * g;
+                w_v[i] = std::max(beta2 * w_v[i], std::abs(g));
+                w_p[i] += (eps * w_m[i]) / w_v[i];
+            });
+        } else if constexpr (UT == updater_type::NADAM) {
+            const weight beta1          = dbn.adam_beta1;
+            const weight beta2          = dbn.adam_beta2;
+            const weight schedule_decay = dbn.nadam_schedule_decay;
+            const weight t              = iteration;
+
+            auto& m_schedule = ctx.m_schedule;
+
+            // Compute the schedule for momentum
+
+            weight momentum_cache_t   = beta1 * (1.0 - 0.5 * (std::pow(0.96, t * schedule_decay)));
+            weight momentum_cache_t_1 = beta1 * (1.0 - 0.5 * (std::pow(0.96, (t + 1) * schedule_decay)));
+
+            weight m_schedule_new  = m_schedule * momentum_cache_t;
+            weight m_schedule_next = m_schedule * momentum_cache_t * momentum_cache_t_1;
+
+            if constexpr (I == 0) {
+                m_schedule = m_schedule_new;
+            }
+
+            const weight cm = 1.0 / (1.0 - m_schedule_next);
+            const weight cv = 1.0 / (1.0 - std::pow(beta2, t));
+
+            const weight m1 = eps * ((1.0 - momentum_cache_t) / (1.0 - m_schedule_new));
+            const weight m2 = eps * momentum_cache_t_1;
+
+            weight* w_m  = state_memory(ctx.m);
+            weight* w_mt = state_memory(ctx.mt);
+            weight* w_v  = state_memory(ctx.v);
+            weight* w_vt = state_memory(ctx.vt);
+
+            fused_update<decay>(w, ctx.grad, n, sq_norm, [=](size_t i, weight g) {
+                w_m[i]  = beta1 * w_m[i] + (1.0 - beta1) * g;
+                w_v[i]  = beta2 * w_v[i] + (1.0 - beta2) * (g * g);
+                w_mt[i] = w_m[i] * cm;
+                w_vt[i] = w_v[i] * cv;
+                w_p[i] += (m1 * g + m2 * w_mt[i]) / (std::sqrt(w_vt[i]) + e);
+            });
+        } else if constexpr (UT == updater_type::RMSPROP) {
+            const weight decay_rate = dbn.rmsprop_decay;
+
+            weight* inc = state_memory(ctx.inc);
+
+            fused_update<decay>(w, ctx.grad, n, sq_norm, [=](size_t i, weight g) {
+                inc[i] = decay_rate * inc[i] + (1 - decay_rate) * (g * g);
+                w_p[i] += (eps * g) / std::sqrt(inc[i] + e);
+            });
+        }
     }
 
     /*!
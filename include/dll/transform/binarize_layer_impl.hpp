@@ -9,6 +9,7 @@
 
 #include "dll/base_traits.hpp"
 #include "dll/transform/transform_layer.hpp"
+#include "dll/util/binary_states.hpp"
 
 namespace dll {
 
@@ -27,6 +28,7 @@ struct binarize_layer_impl : transform_layer<binarize_layer_impl<Desc>> {
     using dyn_layer_t = typename desc::dyn_layer_t;                 ///< The dynamic version of this layer
 
     static constexpr size_t Threshold = desc::T;
+    static constexpr bool in_place    = true; ///< Indicates if the layer can be computed in place
 
     binarize_layer_impl() = default;
 
@@ -55,13 +57,54 @@ struct binarize_layer_impl : transform_layer<binarize_layer_impl<Desc>> {
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        output = input;
+        if constexpr (etl::is_dma<Input> && etl::is_dma<Output>) {
+            input.ensure_cpu_up_to_date();
 
-        for (auto& value : output) {
-            value = value > Threshold ? 1 : 0;
+            threshold(output.memory_start(), input.memory_start(), etl::size(input));
+
+            output.invalidate_gpu();
+        } else {
+            output = input;
+
+            forward_batch_in_place(output);
+        }
+    }
+
+    /*!
+     * \brief Apply the layer in place to the given batch
+     * \param x The batch, replaced by the output of the layer
+     */
+    template <typename X>
+    static void forward_batch_in_place(X&& x) {
+        if constexpr (etl::is_dma<std::decay_t<X>>) {
+            x.ensure_cpu_up_to_date();
+
+            threshold(x.memory_start(), x.memory_start(), etl::size(x));
+
+            x.invalidate_gpu();
+        } else {
+            for (auto& value : x) {
+                value = value > Threshold ? 1 : 0;
+            }
         }
     }
 
+    /*!
+     * \brief Apply the layer to the batch of input, with a bit-packed
+     * output, one bit per unit.
+     *
+     * The packed output can be consumed by the following dense layer
+     * (forward_batch_packed), which only adds the weights of the active
+     * units.
+     *
+     * \param output The packed batch of output
+     * \param input The batch of input to apply the layer to
+     */
+    template <typename Input>
+    static void forward_batch_packed(binary_states& output, const Input& input) {
+        output.threshold(input, etl::value_t<Input>(Threshold));
+    }
+
     /*!
      * \brief Adapt the errors, called before backpropagation of the errors.
      *
@@ -93,6 +136,20 @@ struct binarize_layer_impl : transform_layer<binarize_layer_impl<Desc>> {
     void compute_gradients(C& context) const {
         cpp_unused(context);
     }
+
+private:
+    /*!
+     * \brief Threshold the n given values in one branchless pass, which can
+     * be vectorized by the compiler (out can be the same as in)
+     */
+    template <typename T, typename I>
+    static void threshold(T* out, const I* in, size_t n) {
+        const I t = I(Threshold);
+
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = T(in[i] > t);
+        }
+    }
 };
 
 //Allow odr-use of the constexpr static members
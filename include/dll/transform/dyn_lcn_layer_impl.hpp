@@ -28,6 +28,8 @@ struct dyn_lcn_layer_impl : transform_layer<dyn_lcn_layer_impl<Desc>> {
     size_t Mid;
     double sigma = 2.0;
 
+    workspace* arena = nullptr; ///< The workspace shared by the layers of the network
+
     /*!
      * \brief Initialize the dynamic layer
      */
@@ -79,13 +81,24 @@ struct dyn_lcn_layer_impl : transform_layer<dyn_lcn_layer_impl<Desc>> {
     void forward_batch(Output&& output, Input&& input) const {
         inherit_dim(output, input);
 
-        using weight_t = etl::value_t<Input>;
+        lcn_forward(output, input, K, Mid, sigma, arena);
+    }
 
-        auto w = filter<weight_t>(sigma);
+    /*!
+     * \brief Use the given workspace for the temporaries of the kernels
+     * \param ws The workspace shared by the layers of the network
+     */
+    void set_workspace(workspace* ws) {
+        arena = ws;
+    }
 
-        for (size_t b = 0; b < etl::dim<0>(input); ++b) {
-            lcn_compute(output(b), input(b), w, K, Mid);
-        }
+    /*!
+     * \brief Returns the size, in bytes, of the workspace needed by the
+     * layer. The temporaries depend on the batch size, the workspace grows
+     * on the first use instead.
+     */
+    size_t workspace_size() const {
+        return 0;
     }
 };
 
@@ -98,6 +98,16 @@ struct dyn_shape_3d_layer_impl : transform_layer<dyn_shape_3d_layer_impl<Desc>>
         output = input;
     }
 
+    /*!
+     * \brief Returns a view of the given batch of input with the shape of
+     * the output, the layer only reinterprets its input, without copy.
+     * \param input The batch of input
+     */
+    template <typename Input>
+    auto alias_batch(Input&& input) const {
+        return etl::reshape(input, etl::dim<0>(input), C, W, H);
+    }
+
     /*!
      * \brief Adapt the errors, called before backpropagation of the errors.
      *
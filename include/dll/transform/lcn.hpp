@@ -7,6 +7,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+#include "dll/util/workspace.hpp"
+
 namespace dll {
 
 inline double gaussian(double x, double y, double sigma) {
@@ -26,60 +36,191 @@ void lcn_filter(W& w, size_t K, size_t Mid, double sigma){
 }
 
 /*!
- * \brief Apply the layer to the input
- * \param y The output
- * \param x The input to apply the layer to
+ * \brief Compute the normalized 1D Gaussian filter of size K. The 2D filter
+ * of lcn_filter is the outer product of this filter with itself.
+ * \param g The filter to fill (K values)
  */
-template <typename Input, typename Output, typename W>
-void lcn_compute(Output&& y, const Input& x, const W& w, size_t K, size_t Mid){
-    using weight_t = etl::value_t<Input>;
-
-    auto v = etl::force_temporary(x(0));
-    auto o = etl::force_temporary(x(0));
-
-    for (size_t c = 0; c < etl::dim<0>(x); ++c) {
-        //1. For each pixel, remove mean of 9x9 neighborhood
-        for (size_t j = 0; j < etl::dim<1>(x); ++j) {
-            for (size_t k = 0; k < etl::dim<2>(x); ++k) {
-                weight_t sum(0.0);
-
-                for (size_t p = 0; p < K; ++p) {
-                    if (long(j) + p - Mid >= 0 && long(j) + p - Mid < etl::dim<1>(x)) {
-                        for (size_t q = 0; q < K; ++q) {
-                            if (long(k) + q - Mid >= 0 && long(k) + q - Mid < etl::dim<2>(x)) {
-                                sum += w(p, q) * x(c, j + p - Mid, k + q - Mid);
-                            }
-                        }
-                    }
-                }
-
-                v(j, k) = x(c, j, k) - sum;
+template <typename T>
+void lcn_filter_1d(T* g, size_t K, size_t Mid, double sigma) {
+    double sum = 0.0;
+
+    for (size_t i = 0; i < K; ++i) {
+        const double d = double(i) - double(Mid);
+        sum += std::exp(-(d * d) / (2.0 * sigma * sigma));
+    }
+
+    for (size_t i = 0; i < K; ++i) {
+        const double d = double(i) - double(Mid);
+        g[i]           = T(std::exp(-(d * d) / (2.0 * sigma * sigma)) / sum);
+    }
+}
+
+namespace detail {
+
+/*!
+ * \brief The number of chunks of the given number of channels
+ */
+inline size_t lcn_chunk_count(size_t n) {
+    if (!scoped_thread_pool() || n < 2) {
+        return 1;
+    }
+
+    return std::min(n, size_t(std::max(1u, std::thread::hardware_concurrency())));
+}
+
+/*!
+ * \brief Call functor(c, first, last) on the lcn_chunk_count(n) chunks of
+ * [0, n), on the scoped thread pool if there is one.
+ */
+template <typename Functor>
+void lcn_chunks(size_t n, Functor&& functor) {
+    auto* pool = scoped_thread_pool();
+
+    const size_t chunks = lcn_chunk_count(n);
+
+    if (pool && chunks > 1) {
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&functor, n, chunks](size_t c) {
+            functor(c, (c * n) / chunks, ((c + 1) * n) / chunks);
+        });
+    } else {
+        functor(0, 0, n);
+    }
+}
+
+/*!
+ * \brief Local contrast normalization of one channel (H x W).
+ *
+ * The Gaussian-weighted local sums of x and of x^2 are computed together,
+ * with a horizontal and then a vertical 1D pass, both vectorizable along
+ * the rows. The neighbours outside of the channel count as zeroes.
+ *
+ * \param y The output channel
+ * \param x The input channel
+ * \param g The normalized 1D filter (K values)
+ * \param buffer A temporary buffer of 4 * H * W values
+ */
+template <typename T>
+void lcn_channel(T* y, const T* x, const T* g, size_t K, size_t Mid, size_t H, size_t W, T* buffer) {
+    const size_t N = H * W;
+
+    T* hm = buffer; // The horizontal sums of x
+    T* hs = hm + N; // The horizontal sums of x^2
+    T* m  = hs + N; // The local means
+    T* s  = m + N;  // The local sums of squares
+
+    std::fill(buffer, buffer + 4 * N, T(0));
+
+    // 1. Horizontal pass of x and x^2
+
+    for (size_t j = 0; j < H; ++j) {
+        const T* x_j = x + j * W;
+        T* hm_j      = hm + j * W;
+        T* hs_j      = hs + j * W;
+
+        for (size_t q = 0; q < K; ++q) {
+            const T gq = g[q];
+
+            // The columns k such that k + q - Mid is inside the row
+            const size_t first = q < Mid ? Mid - q : 0;
+            const size_t last  = q > Mid ? (W > q - Mid ? W - (q - Mid) : 0) : W;
+
+            for (size_t k = first; k < last; ++k) {
+                const T v = x_j[k + q - Mid];
+
+                hm_j[k] += gq * v;
+                hs_j[k] += gq * v * v;
             }
         }
+    }
+
+    // 2. Vertical pass of both sums
 
-        //2. Scale down norm of 9x9 patch if norm is bigger than 1
+    for (size_t j = 0; j < H; ++j) {
+        T* m_j = m + j * W;
+        T* s_j = s + j * W;
 
-        for (size_t j = 0; j < etl::dim<1>(x); ++j) {
-            for (size_t k = 0; k < etl::dim<2>(x); ++k) {
-                weight_t sum(0.0);
+        for (size_t p = 0; p < K; ++p) {
+            if (j + p < Mid || j + p - Mid >= H) {
+                continue;
+            }
 
-                for (size_t p = 0; p < K; ++p) {
-                    if (long(j) + p - Mid >= 0 && long(j) + p - Mid < etl::dim<1>(x)) {
-                        for (size_t q = 0; q < K; ++q) {
-                            if (long(k) + q - Mid >= 0 && long(k) + q - Mid < etl::dim<2>(x)) {
-                                sum += w(p, q) * x(c, j + p - Mid, k + q - Mid) * x(c, j + p - Mid, k + q - Mid);
-                            }
-                        }
-                    }
-                }
+            const T gp    = g[p];
+            const T* hm_r = hm + (j + p - Mid) * W;
+            const T* hs_r = hs + (j + p - Mid) * W;
 
-                o(j, k) = std::sqrt(sum);
+            for (size_t k = 0; k < W; ++k) {
+                m_j[k] += gp * hm_r[k];
+                s_j[k] += gp * hs_r[k];
             }
         }
+    }
 
-        auto cst = etl::mean(o);
-        y(c) = v / etl::max(o, cst);
+    // 3. Remove the local mean and divide by the local norm, when it is
+    // bigger than its mean over the channel
+
+    T sum(0);
+
+    for (size_t i = 0; i < N; ++i) {
+        s[i] = std::sqrt(s[i]);
+        sum += s[i];
     }
+
+    const T mean = sum / T(N);
+
+    for (size_t i = 0; i < N; ++i) {
+        y[i] = (x[i] - m[i]) / std::max(s[i], mean);
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Apply the local contrast normalization to a batch.
+ *
+ * The (sample, channel) pairs are independent and are computed in
+ * parallel, on the scoped thread pool if there is one.
+ *
+ * \param y The output (B x C x H x W)
+ * \param x The input (B x C x H x W)
+ * \param K The size of the Gaussian filter
+ * \param Mid The middle of the filter
+ * \param sigma The standard deviation of the Gaussian filter
+ * \param ws The workspace for the temporaries (can be nullptr)
+ */
+template <typename Input, typename Output>
+void lcn_forward(Output&& y, const Input& x, size_t K, size_t Mid, double sigma, workspace* ws = nullptr) {
+    using T = etl::value_t<Input>;
+
+    static_assert(etl::is_dma<Input>, "The input of the LCN layers must have direct memory access");
+    static_assert(etl::is_dma<std::decay_t<Output>>, "The output of the LCN layers must have direct memory access");
+
+    const size_t B = etl::dim<0>(x);
+    const size_t C = etl::dim<1>(x);
+    const size_t H = etl::dim<2>(x);
+    const size_t W = etl::dim<3>(x);
+
+    const size_t chunks = detail::lcn_chunk_count(B * C);
+
+    // The filter, followed by the buffer of each chunk
+    workspace_lease<T> tmp(ws, K + chunks * 4 * H * W);
+
+    T* g_p = tmp.data();
+    lcn_filter_1d(g_p, K, Mid, sigma);
+
+    x.ensure_cpu_up_to_date();
+
+    const T* x_p = x.memory_start();
+    T* y_p       = y.memory_start();
+
+    detail::lcn_chunks(B * C, [=](size_t c, size_t first, size_t last) {
+        T* buffer = g_p + K + c * 4 * H * W;
+
+        for (size_t bc = first; bc < last; ++bc) {
+            detail::lcn_channel(y_p + bc * H * W, x_p + bc * H * W, g_p, K, Mid, H, W, buffer);
+        }
+    });
+
+    y.invalidate_gpu();
 }
 
 } //end of dll namespace
@@ -27,6 +27,8 @@ struct normalize_layer_impl : transform_layer<normalize_layer_impl<Desc>> {
     using layer_t     = this_type;                                   ///< This layer's type
     using dyn_layer_t = typename desc::dyn_layer_t;                  ///< The dynamic version of this layer
 
+    static constexpr bool in_place = true; ///< Indicates if the layer can be computed in place
+
     /*!
      * \brief Returns a string representation of the layer
      */
@@ -56,6 +58,15 @@ struct normalize_layer_impl : transform_layer<normalize_layer_impl<Desc>> {
         cpp::normalize(output);
     }
 
+    /*!
+     * \brief Apply the layer in place to the given batch
+     * \param x The batch, replaced by the output of the layer
+     */
+    template <typename X>
+    static void forward_batch_in_place(X&& x) {
+        cpp::normalize(x);
+    }
+
     /*!
      * \brief Adapt the errors, called before backpropagation of the errors.
      *
@@ -26,6 +26,8 @@ struct rectifier_layer_impl : transform_layer<rectifier_layer_impl<Desc>> {
     using dyn_layer_t = typename desc::dyn_layer_t;                  ///< The dynamic version of this layer
 
     static constexpr rectifier_method method = desc::method; ///< The rectifier method
+    static constexpr bool in_place           = true;         ///< Indicates if the layer can be computed in place
+    static constexpr bool fusable            = true;         ///< Indicates if the layer can be fused with the next elementwise layers
 
     static_assert(method == rectifier_method::ABS, "Only ABS rectifier has been implemented");
 
@@ -58,6 +60,26 @@ struct rectifier_layer_impl : transform_layer<rectifier_layer_impl<Desc>> {
             output = etl::abs(input);
         }
     }
+
+    /*!
+     * \brief Returns the expression of the layer applied to the given
+     * expression, to fuse the layer with the next elementwise layers
+     */
+    template <typename E>
+    static decltype(auto) fused_expr(E&& e) {
+        return etl::abs(std::forward<E>(e));
+    }
+
+    /*!
+     * \brief Apply the layer in place to the given batch
+     * \param x The batch, replaced by the output of the layer
+     */
+    template <typename X>
+    static void forward_batch_in_place(X&& x) {
+        if (method == rectifier_method::ABS) {
+            x = etl::abs(x);
+        }
+    }
 };
 
 //Allow odr-use of the constexpr static members
@@ -29,6 +29,9 @@ struct scale_layer_impl : transform_layer<scale_layer_impl<Desc>> {
     static constexpr int A = desc::A; ///< The scale multiplier
     static constexpr int B = desc::B; ///< The scale divisor
 
+    static constexpr bool in_place = true; ///< Indicates if the layer can be computed in place
+    static constexpr bool fusable  = true; ///< Indicates if the layer can be fused with the next elementwise layers
+
     /*!
      * \brief Returns a string representation of the layer
      */
@@ -57,6 +60,24 @@ struct scale_layer_impl : transform_layer<scale_layer_impl<Desc>> {
         output = input * (double(A) / double(B));
     }
 
+    /*!
+     * \brief Returns the expression of the layer applied to the given
+     * expression, to fuse the layer with the next elementwise layers
+     */
+    template <typename E>
+    static decltype(auto) fused_expr(E&& e) {
+        return std::forward<E>(e) * (double(A) / double(B));
+    }
+
+    /*!
+     * \brief Apply the layer in place to the given batch
+     * \param x The batch, replaced by the output of the layer
+     */
+    template <typename X>
+    static void forward_batch_in_place(X&& x) {
+        x = x * (double(A) / double(B));
+    }
+
     /*!
      * \brief Adapt the errors, called before backpropagation of the errors.
      *
@@ -88,6 +88,20 @@ struct shape_3d_layer_impl : transform_layer<shape_3d_layer_impl<Desc>> {
         output = input;
     }
 
+    /*!
+     * \brief Returns a view of the given batch of input with the shape of
+     * the output, the layer only reinterprets its input, without copy.
+     * \param input The batch of input
+     */
+    template <typename Input>
+    static auto alias_batch(Input&& input) {
+        if constexpr (etl::is_fast<Input>) {
+            return etl::reshape<etl::dim<0, Input>(), C, W, H>(input);
+        } else {
+            return etl::reshape(input, etl::dim<0>(input), C, W, H);
+        }
+    }
+
     /*!
      * \brief Adapt the errors, called before backpropagation of the errors.
      *
@@ -0,0 +1,218 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Bump-pointer arena for the temporaries of one training step or
+ * inference call
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/workspace.hpp" // For workspace_heap_allocations
+
+namespace dll {
+
+/*!
+ * \brief A bump-pointer arena for the temporaries of a step.
+ *
+ * The temporaries are allocated by moving a pointer in a single block and
+ * are all released at once when the arena is reset, at the end of the
+ * step. When the block is too small, the missing memory is allocated in
+ * overflow blocks and the block is grown to the peak of the step when the
+ * arena is reset, so that the next steps do not allocate anymore.
+ *
+ * Each arena is on its own cache lines, so that the arenas of different
+ * threads do not falsely share their pointers.
+ */
+struct alignas(64) step_arena {
+    static constexpr size_t alignment = 64; ///< The alignment of the allocations
+
+    step_arena() = default;
+
+    step_arena(const step_arena& rhs) = delete;
+    step_arena& operator=(const step_arena& rhs) = delete;
+
+    /*!
+     * \brief Allocate the given number of bytes from the arena
+     */
+    void* allocate(size_t bytes) {
+        bytes = (bytes + alignment - 1) & ~(alignment - 1);
+
+        used += bytes;
+        peak = std::max(peak, used);
+
+        if (offset + bytes <= capacity) {
+            auto* memory = reinterpret_cast<char*>(block.get()) + offset;
+            offset += bytes;
+            return memory;
+        }
+
+        ++detail::workspace_heap_allocations();
+
+        overflow.emplace_back(new aligned_line[bytes / alignment]);
+        return overflow.back().get();
+    }
+
+    /*!
+     * \brief Allocate n elements of type T from the arena
+     */
+    template <typename T>
+    T* allocate(size_t n) {
+        return static_cast<T*>(allocate(n * sizeof(T)));
+    }
+
+    /*!
+     * \brief Release all the temporaries of the step and make sure the
+     * next steps fit in the block
+     */
+    void reset() {
+        if (!overflow.empty()) {
+            overflow.clear();
+
+            block.reset(new aligned_line[peak / alignment]);
+            capacity = peak;
+
+            ++detail::workspace_heap_allocations();
+        }
+
+        offset = 0;
+        used   = 0;
+    }
+
+    /*!
+     * \brief Returns the size of the block of the arena, in bytes
+     */
+    size_t size() const {
+        return capacity;
+    }
+
+private:
+    struct alignas(alignment) aligned_line {
+        char bytes[alignment];
+    };
+
+    std::unique_ptr<aligned_line[]> block;                 ///< The memory of the arena
+    std::vector<std::unique_ptr<aligned_line[]>> overflow; ///< The memory allocated when the block was full
+    size_t capacity = 0;                                   ///< The size of the block (bytes)
+    size_t offset   = 0;                                   ///< The first free byte of the block
+    size_t used     = 0;                                   ///< The bytes allocated since the last reset
+    size_t peak     = 0;                                   ///< The most bytes allocated during a step
+};
+
+namespace detail {
+
+/*!
+ * \brief Returns the arena of the current step on this thread
+ */
+inline step_arena*& current_arena() {
+    thread_local step_arena* arena = nullptr;
+    return arena;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Make the temporaries of the current thread use the given arena
+ * for the lifetime of the scope, a step. The arena is reset at the end of
+ * the outermost scope of the arena.
+ */
+struct arena_scope {
+    step_arena& arena;    ///< The arena of the step
+    step_arena* previous; ///< The arena used before the scope
+
+    explicit arena_scope(step_arena& arena) : arena(arena), previous(detail::current_arena()) {
+        detail::current_arena() = &arena;
+    }
+
+    arena_scope(const arena_scope& rhs) = delete;
+    arena_scope& operator=(const arena_scope& rhs) = delete;
+
+    ~arena_scope() {
+        detail::current_arena() = previous;
+
+        if (previous != &arena) {
+            arena.reset();
+        }
+    }
+};
+
+/*!
+ * \brief A temporary matrix, in the arena of the current step if there is
+ * one, allocated otherwise.
+ *
+ * The temporary must not outlive the step.
+ */
+template <typename T, size_t D>
+struct arena_matrix {
+    std::vector<T> local;                ///< The memory when there is no arena
+    etl::custom_dyn_matrix<T, D> matrix; ///< The temporary
+
+    /*!
+     * \brief Create a temporary of the dimensions of the given expression
+     * \param expr The expression
+     * \param assign Indicates if the expression is evaluated into the temporary
+     */
+    template <typename E, size_t... I>
+    arena_matrix(const E& expr, std::index_sequence<I...> /*seq*/, bool assign)
+            : matrix(allocate(local, (etl::dim(expr, I) * ...)), etl::dim(expr, I)...) {
+        if (assign) {
+            matrix = expr;
+        }
+    }
+
+    arena_matrix(const arena_matrix& rhs) = delete;
+    arena_matrix& operator=(const arena_matrix& rhs) = delete;
+
+private:
+    static T* allocate(std::vector<T>& local, size_t n) {
+        if (auto* arena = detail::current_arena()) {
+            return arena->allocate<T>(n);
+        }
+
+        ++detail::workspace_heap_allocations();
+
+        local.resize(n);
+        return local.data();
+    }
+};
+
+/*!
+ * \brief Evaluate the given expression into a temporary of the arena of
+ * the current step, like etl::force_temporary.
+ *
+ * \return the temporary (its matrix member)
+ */
+template <typename E>
+auto arena_temporary(E&& expr) {
+    static constexpr size_t D = etl::decay_traits<E>::dimensions();
+
+    return arena_matrix<etl::value_t<E>, D>(expr, std::make_index_sequence<D>(), true);
+}
+
+/*!
+ * \brief Create a temporary of the arena of the current step with the same
+ * dimensions as the given expression, like etl::force_temporary_dim_only.
+ *
+ * \return the temporary (its matrix member)
+ */
+template <typename E>
+auto arena_temporary_dim_only(E&& expr) {
+    static constexpr size_t D = etl::decay_traits<E>::dimensions();
+
+    return arena_matrix<etl::value_t<E>, D>(expr, std::make_index_sequence<D>(), false);
+}
+
+} //end of dll namespace
@@ -48,4 +48,43 @@ decltype(auto) batch_extend(Batch&& batch, One&& one){
     cpp_unreachable("Invalid selection in batch_extend");
 }
 
+/*!
+ * \brief Create a batch of n samples of the shape of the given sample
+ *
+ * \param n The number of samples of the batch
+ * \param one A sample
+ *
+ * \return the batch
+ */
+template<typename One>
+auto make_batch(size_t n, const One& one){
+    using batch_t = etl::dyn_matrix<etl::value_t<One>, etl::dimensions<One>() + 1>;
+
+    if constexpr (etl::dimensions<One>() == 1) {
+        return batch_t(n, etl::dim<0>(one));
+    } else if constexpr (etl::dimensions<One>() == 2) {
+        return batch_t(n, etl::dim<0>(one), etl::dim<1>(one));
+    } else {
+        static_assert(etl::dimensions<One>() == 3, "Invalid number of dimensions for make_batch");
+
+        return batch_t(n, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
+    }
+}
+
+/*!
+ * \brief Copy a batch (of a generator) into the given batch, reallocated
+ * only if its size is different
+ *
+ * \param target The batch to fill
+ * \param batch The batch to copy
+ */
+template <typename T, typename E>
+void copy_batch(T& target, E&& batch) {
+    if (etl::size(target) == etl::size(batch)) {
+        target = batch;
+    } else {
+        target = etl::force_temporary(batch);
+    }
+}
+
 } //end of dll namespace
@@ -0,0 +1,507 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Kernels and inference helpers of the batch normalization layers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/base_conf.hpp"
+#include "dll/function.hpp"
+#include "dll/layer_traits.hpp"
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/structured_pruning.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+#include "dll/util/transport.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Call functor(first, last) on chunks of [0, n), on the scoped
+ * thread pool if there is one.
+ */
+template <typename Functor>
+void bn_chunks(size_t n, Functor&& functor) {
+    auto* pool = scoped_thread_pool();
+
+    if (pool && n > 1) {
+        const size_t chunks = std::min(n, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&functor, n, chunks](size_t c) {
+            functor((c * n) / chunks, ((c + 1) * n) / chunks);
+        });
+    } else {
+        functor(0, n);
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Compute the mean and the (biased) variance of each feature map of
+ * a batch (B x K x ...), in a single pass over the input.
+ *
+ * The sums and the sums of squares are accumulated relative to the first
+ * value of each feature map, which keeps the variance accurate when the
+ * mean is large compared to the deviation. The feature maps are computed
+ * in parallel, each one over the whole batch.
+ *
+ * \param input The batch of input, with direct memory access
+ * \param mean The output mean, one per feature map
+ * \param var The output variance, one per feature map
+ */
+template <typename I, typename M, typename V>
+void bn_statistics_4d(const I& input, M&& mean, V&& var) {
+    using T = etl::value_t<I>;
+
+    input.ensure_cpu_up_to_date();
+
+    const size_t B = etl::dim<0>(input);
+    const size_t K = etl::dim<1>(input);
+    const size_t S = etl::size(input) / (B * K);
+
+    const T* in = input.memory_start();
+    T* m        = mean.memory_start();
+    T* v        = var.memory_start();
+
+    detail::bn_chunks(K, [=](size_t first, size_t last) {
+        for (size_t k = first; k < last; ++k) {
+            const T shift = in[k * S];
+
+            T sum = 0;
+            T sq  = 0;
+
+            for (size_t b = 0; b < B; ++b) {
+                const T* x = in + (b * K + k) * S;
+
+                for (size_t i = 0; i < S; ++i) {
+                    const T d = x[i] - shift;
+                    sum += d;
+                    sq += d * d;
+                }
+            }
+
+            const T dm = sum / T(B * S);
+
+            m[k] = shift + dm;
+            v[k] = std::max(T(0), sq / T(B * S) - dm * dm);
+        }
+    });
+
+    mean.invalidate_gpu();
+    var.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the mean and the (biased) variance of each feature of a
+ * batch (B x N), in a single pass over the input.
+ *
+ * The batch is read row by row, the inner loop running over contiguous
+ * features, and the features are split between the threads.
+ *
+ * \param input The batch of input, with direct memory access
+ * \param mean The output mean, one per feature
+ * \param var The output variance, one per feature
+ */
+template <typename I, typename M, typename V>
+void bn_statistics_2d(const I& input, M&& mean, V&& var) {
+    using T = etl::value_t<I>;
+
+    input.ensure_cpu_up_to_date();
+
+    const size_t B = etl::dim<0>(input);
+    const size_t N = etl::size(input) / B;
+
+    const T* in = input.memory_start();
+    T* m        = mean.memory_start();
+    T* v        = var.memory_start();
+
+    detail::bn_chunks(N, [=](size_t first, size_t last) {
+        std::fill(m + first, m + last, T(0));
+        std::fill(v + first, v + last, T(0));
+
+        for (size_t b = 1; b < B; ++b) {
+            const T* x = in + b * N;
+
+            for (size_t j = first; j < last; ++j) {
+                const T d = x[j] - in[j];
+                m[j] += d;
+                v[j] += d * d;
+            }
+        }
+
+        for (size_t j = first; j < last; ++j) {
+            const T dm = m[j] / T(B);
+
+            m[j] = in[j] + dm;
+            v[j] = std::max(T(0), v[j] / T(B) - dm * dm);
+        }
+    });
+
+    mean.invalidate_gpu();
+    var.invalidate_gpu();
+}
+
+/*!
+ * \brief Normalize a batch (B x K x ...) with the given statistics, storing
+ * both the normalized input and the scaled and shifted output in the same
+ * pass over the input.
+ * \param input The batch of input, with direct memory access
+ * \param mean The mean, one per feature map
+ * \param inv_var The inverse standard deviation, one per feature map
+ * \param gamma The scale, one per feature map
+ * \param beta The shift, one per feature map
+ * \param input_pre The normalized input
+ * \param output The output
+ */
+template <typename I, typename M, typename IV, typename G, typename BB, typename P, typename O>
+void bn_normalize_4d(const I& input, const M& mean, const IV& inv_var, const G& gamma, const BB& beta, P&& input_pre, O&& output) {
+    using T = etl::value_t<I>;
+
+    input.ensure_cpu_up_to_date();
+    mean.ensure_cpu_up_to_date();
+    inv_var.ensure_cpu_up_to_date();
+    gamma.ensure_cpu_up_to_date();
+    beta.ensure_cpu_up_to_date();
+
+    const size_t B = etl::dim<0>(input);
+    const size_t K = etl::dim<1>(input);
+    const size_t S = etl::size(input) / (B * K);
+
+    const T* in  = input.memory_start();
+    const T* m   = mean.memory_start();
+    const T* iv  = inv_var.memory_start();
+    const T* g   = gamma.memory_start();
+    const T* bb  = beta.memory_start();
+    T* pre       = input_pre.memory_start();
+    T* out       = output.memory_start();
+
+    detail::bn_chunks(B * K, [=](size_t first, size_t last) {
+        for (size_t bk = first; bk < last; ++bk) {
+            const size_t k = bk % K;
+
+            const T* x = in + bk * S;
+            T* p       = pre + bk * S;
+            T* y       = out + bk * S;
+
+            for (size_t i = 0; i < S; ++i) {
+                p[i] = (x[i] - m[k]) * iv[k];
+                y[i] = g[k] * p[i] + bb[k];
+            }
+        }
+    });
+
+    input_pre.invalidate_gpu();
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Normalize a batch (B x N) with the given statistics, storing both
+ * the normalized input and the scaled and shifted output in the same pass
+ * over the input.
+ * \param input The batch of input, with direct memory access
+ * \param mean The mean, one per feature
+ * \param inv_var The inverse standard deviation, one per feature
+ * \param gamma The scale, one per feature
+ * \param beta The shift, one per feature
+ * \param input_pre The normalized input
+ * \param output The output
+ */
+template <typename I, typename M, typename IV, typename G, typename BB, typename P, typename O>
+void bn_normalize_2d(const I& input, const M& mean, const IV& inv_var, const G& gamma, const BB& beta, P&& input_pre, O&& output) {
+    using T = etl::value_t<I>;
+
+    input.ensure_cpu_up_to_date();
+    mean.ensure_cpu_up_to_date();
+    inv_var.ensure_cpu_up_to_date();
+    gamma.ensure_cpu_up_to_date();
+    beta.ensure_cpu_up_to_date();
+
+    const size_t B = etl::dim<0>(input);
+    const size_t N = etl::size(input) / B;
+
+    const T* in  = input.memory_start();
+    const T* m   = mean.memory_start();
+    const T* iv  = inv_var.memory_start();
+    const T* g   = gamma.memory_start();
+    const T* bb  = beta.memory_start();
+    T* pre       = input_pre.memory_start();
+    T* out       = output.memory_start();
+
+    detail::bn_chunks(B, [=](size_t first, size_t last) {
+        for (size_t b = first; b < last; ++b) {
+            const T* x = in + b * N;
+            T* p       = pre + b * N;
+            T* y       = out + b * N;
+
+            for (size_t j = 0; j < N; ++j) {
+                p[j] = (x[j] - m[j]) * iv[j];
+                y[j] = g[j] * p[j] + bb[j];
+            }
+        }
+    });
+
+    input_pre.invalidate_gpu();
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Cache of the affine transformation applied by a batch
+ * normalization layer at test time: y = scale * x + shift, with
+ * scale = gamma / sqrt(var + e) and shift = beta - mean * scale.
+ *
+ * The cache is computed on first use and must be invalidated when gamma,
+ * beta or the running statistics are modified.
+ */
+template <typename T>
+struct bn_inference_cache {
+    etl::dyn_matrix<T, 1> scale; ///< The scale of the transformation
+    etl::dyn_matrix<T, 1> shift; ///< The shift of the transformation
+
+    /*!
+     * \brief Compute the transformation if it is not up to date
+     */
+    template <typename G, typename B, typename M, typename V>
+    void update(const G& gamma, const B& beta, const M& mean, const V& var, T e) {
+        std::lock_guard<std::mutex> l(lock);
+
+        if (!valid) {
+            scale.inherit_if_null(gamma);
+            shift.inherit_if_null(gamma);
+
+            scale = gamma >> (T(1) / etl::sqrt(var + e));
+            shift = beta - (mean >> scale);
+
+            valid = true;
+        }
+    }
+
+    /*!
+     * \brief Invalidate the cache, after a modification of the parameters
+     */
+    void invalidate() {
+        std::lock_guard<std::mutex> l(lock);
+        valid = false;
+    }
+
+    /*!
+     * \brief Release the transformation, after a change of the number of
+     * units of the parameters
+     */
+    void reset() {
+        std::lock_guard<std::mutex> l(lock);
+
+        scale = etl::dyn_matrix<T, 1>();
+        shift = etl::dyn_matrix<T, 1>();
+        valid = false;
+    }
+
+private:
+    bool valid = false; ///< Indicates if the transformation is up to date
+    std::mutex lock;    ///< The lock for concurrent uses of the layer
+};
+
+/*!
+ * \brief Indicates if a batch normalization layer can be folded into the
+ * given preceding layer: the layer must be of the given kind (WD being
+ * the number of dimensions of its weights), must have biases and must not
+ * have any activation function.
+ */
+template <typename L, size_t WD>
+constexpr bool bn_foldable() {
+    using layer_t = std::decay_t<L>;
+    using traits  = decay_layer_traits<L>;
+
+    if constexpr (traits::is_standard_dense_layer() || traits::is_standard_convolutional_layer()) {
+        return layer_t::activation_function == function::IDENTITY
+            && !layer_t::desc::parameters::template contains<dll::no_bias>()
+            && etl::dimensions<typename layer_t::w_type>() == WD;
+    } else {
+        return false;
+    }
+}
+
+/*!
+ * \brief Fold the test-time transformation of a batch normalization layer
+ * into the weights (num_visible x num_hidden) and biases of the preceding
+ * dense layer
+ */
+template <typename L, typename S>
+void bn_fold_dense(L& layer, const S& scale, const S& shift) {
+    for (size_t i = 0; i < etl::dim<0>(layer.w); ++i) {
+        layer.w(i) = layer.w(i) >> scale;
+    }
+
+    layer.b = (layer.b >> scale) + shift;
+
+    layer.invalidate_weights_cache();
+}
+
+/*!
+ * \brief Fold the test-time transformation of a batch normalization layer
+ * into the filters (K x C x NW1 x NW2) and biases of the preceding
+ * convolutional layer
+ */
+template <typename L, typename S>
+void bn_fold_conv(L& layer, const S& scale, const S& shift) {
+    for (size_t k = 0; k < etl::dim<0>(layer.w); ++k) {
+        layer.w(k) = scale(k) >> layer.w(k);
+    }
+
+    layer.b = (layer.b >> scale) + shift;
+
+    layer.invalidate_weights_cache();
+}
+
+/*!
+ * \brief Keep only the given units of the per-unit parameters of a batch
+ * normalization layer (gamma, beta and the statistics)
+ * \param layer The batch normalization layer
+ * \param kept The indices of the units to keep, in order
+ */
+template <typename L>
+void bn_shrink_units(L& layer, const std::vector<size_t>& kept) {
+    const size_t units = etl::size(layer.gamma);
+
+    for (auto* v : {&layer.gamma, &layer.beta, &layer.mean, &layer.var, &layer.last_mean, &layer.last_var, &layer.inv_var}) {
+        std::decay_t<decltype(*v)> shrunk(kept.size());
+        gather_rows(*v, shrunk, kept, units);
+        *v = std::move(shrunk);
+    }
+
+    // The temporaries are sized again by the next training
+    layer.input_pre = decltype(layer.input_pre)();
+
+    layer.bak_gamma.reset();
+    layer.bak_beta.reset();
+
+    layer.test_cache.reset();
+}
+
+/*!
+ * \brief Combine the statistics of the last batch of a batch normalization
+ * layer with the ones of the other ranks, if the layer is synchronized.
+ *
+ * The per-unit sums and sums of squares of all the ranks are summed in a
+ * single allreduce, with the number of values, and the mean and the
+ * (biased) variance are replaced by the ones of the whole batch.
+ *
+ * \param layer The batch normalization layer
+ * \param n The number of values of each unit of this rank
+ * \return the number of values of each unit over all the ranks
+ */
+template <typename L>
+size_t bn_sync_statistics(L& layer, size_t n) {
+    if (!layer.sync) {
+        return n;
+    }
+
+    layer.last_mean.ensure_cpu_up_to_date();
+    layer.last_var.ensure_cpu_up_to_date();
+
+    const size_t K = etl::size(layer.last_mean);
+
+    auto* mean = layer.last_mean.memory_start();
+    auto* var  = layer.last_var.memory_start();
+
+    std::vector<double> sums(2 * K + 1);
+
+    for (size_t k = 0; k < K; ++k) {
+        sums[k]     = n * double(mean[k]);
+        sums[K + k] = n * (double(var[k]) + double(mean[k]) * double(mean[k]));
+    }
+
+    sums[2 * K] = n;
+
+    layer.sync->allreduce(sums.data(), sums.size());
+
+    const double N = sums[2 * K];
+
+    for (size_t k = 0; k < K; ++k) {
+        const double m = sums[k] / N;
+
+        mean[k] = m;
+        var[k]  = std::max(0.0, sums[K + k] / N - m * m);
+    }
+
+    layer.last_mean.invalidate_gpu();
+    layer.last_var.invalidate_gpu();
+
+    return size_t(N);
+}
+
+/*!
+ * \brief Sum the given per-unit sums of the backward pass of a batch
+ * normalization layer over all the ranks, if the layer is synchronized.
+ *
+ * \param layer The batch normalization layer
+ * \param first The first sums
+ * \param second The second sums
+ */
+template <typename L, typename A, typename B>
+void bn_sync_sums(const L& layer, A& first, B& second) {
+    if (!layer.sync) {
+        return;
+    }
+
+    first.ensure_cpu_up_to_date();
+    second.ensure_cpu_up_to_date();
+
+    const size_t K = etl::size(first);
+
+    std::vector<double> sums(2 * K);
+
+    std::copy_n(first.memory_start(), K, sums.begin());
+    std::copy_n(second.memory_start(), K, sums.begin() + K);
+
+    layer.sync->allreduce(sums.data(), sums.size());
+
+    std::copy_n(sums.begin(), K, first.memory_start());
+    std::copy_n(sums.begin() + K, K, second.memory_start());
+
+    first.invalidate_gpu();
+    second.invalidate_gpu();
+}
+
+/*!
+ * \brief Traits indicating if a layer is a batch normalization layer
+ */
+template <typename Layer>
+struct is_batch_normalization_layer : std::false_type {};
+
+template <typename Desc>
+struct is_batch_normalization_layer<batch_normalization_2d_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_batch_normalization_layer<dyn_batch_normalization_2d_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_batch_normalization_layer<batch_normalization_4d_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_batch_normalization_layer<dyn_batch_normalization_4d_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the given (possibly cv-qualified reference) type is
+ * a batch normalization layer
+ */
+template <typename Layer>
+constexpr bool is_batch_normalization_layer_v = is_batch_normalization_layer<std::decay_t<Layer>>::value;
+
+} //end of dll namespace
@@ -0,0 +1,315 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Executor coalescing single-sample inference requests into batches
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/util/batch_extend.hpp"
+#include "dll/util/inference_context.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The number of buckets of the histograms of a batching executor.
+ * The bucket k counts the values in [2^k, 2^(k+1)), the bucket 0 also
+ * counts the zeros and the last bucket counts all the larger values.
+ */
+constexpr size_t batching_buckets = 16;
+
+/*!
+ * \brief Histogram of sizes, in power-of-two buckets
+ */
+struct batching_histogram {
+    std::array<std::atomic<size_t>, batching_buckets> counts{}; ///< The number of values in each bucket
+
+    /*!
+     * \brief Returns the bucket of the given value
+     */
+    static size_t bucket(size_t value) {
+        size_t k = 0;
+
+        while (value > 1 && k + 1 < batching_buckets) {
+            value >>= 1;
+            ++k;
+        }
+
+        return k;
+    }
+
+    /*!
+     * \brief Count the given value
+     */
+    void add(size_t value) {
+        counts[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /*!
+     * \brief Returns the number of values in the given bucket
+     */
+    size_t operator[](size_t k) const {
+        return counts[k].load(std::memory_order_relaxed);
+    }
+
+    /*!
+     * \brief Reset all the buckets
+     */
+    void reset() {
+        for (auto& count : counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+/*!
+ * \brief The counters of a batching executor
+ */
+struct batching_stats {
+    std::atomic<size_t> requests{0}; ///< The number of submitted requests
+    std::atomic<size_t> batches{0};  ///< The number of computed batches
+
+    batching_histogram queue_depth; ///< The number of pending requests, at each submission
+    batching_histogram batch_size;  ///< The size of the computed batches
+
+    /*!
+     * \brief Reset all the counters
+     */
+    void reset() {
+        requests.store(0, std::memory_order_relaxed);
+        batches.store(0, std::memory_order_relaxed);
+        queue_depth.reset();
+        batch_size.reset();
+    }
+};
+
+/*!
+ * \brief Run the inference of single samples on a network, in batches.
+ *
+ * The submitted samples are queued and coalesced by the workers into
+ * batches of at most max_batch samples. A worker computes a batch as soon
+ * as it is full or when the oldest pending sample has waited for
+ * max_latency. Each worker has its own inference context, the workers
+ * share the weights of the network, which must not be modified while the
+ * executor is running.
+ *
+ * \tparam DBN The type of the network
+ * \tparam Sample The type of one input sample
+ */
+template <typename DBN, typename Sample = typename DBN::input_one_t>
+struct batching_executor {
+    using dbn_t    = DBN;                    ///< The type of the network
+    using sample_t = std::decay_t<Sample>;   ///< The type of one sample
+    using weight   = typename dbn_t::weight; ///< The type of the weights
+
+    using batch_t = decltype(dll::make_batch(0, std::declval<const sample_t&>())); ///< The type of the input batches
+
+    using batch_output_t = std::decay_t<decltype(std::declval<const dbn_t&>().forward_batch(std::declval<inference_context&>(), std::declval<batch_t&>()))>; ///< The type of the output batches
+    using output_t       = etl::dyn_matrix<weight, etl::dimensions<batch_output_t>() - 1>;                                                                     ///< The type of the output of one sample
+
+    /*!
+     * \brief Start the executor
+     * \param dbn The network, which must outlive the executor
+     * \param max_batch The maximum number of samples of a batch
+     * \param max_latency The maximum time a sample waits for its batch to be full
+     * \param workers The number of workers, each with its own inference context
+     */
+    explicit batching_executor(const dbn_t& dbn, size_t max_batch = 64, std::chrono::microseconds max_latency = std::chrono::microseconds(2000), size_t workers = 1)
+            : dbn(dbn), max_batch(max_batch), max_latency(max_latency) {
+        cpp_assert(max_batch > 0, "The batches must have at least one sample");
+        cpp_assert(workers > 0, "The executor needs at least one worker");
+
+        for (size_t w = 0; w < workers; ++w) {
+            threads.emplace_back([this] { work(); });
+        }
+    }
+
+    batching_executor(const batching_executor& rhs) = delete;
+    batching_executor& operator=(const batching_executor& rhs) = delete;
+
+    /*!
+     * \brief Compute the pending requests and stop the workers
+     */
+    ~batching_executor() {
+        {
+            std::unique_lock<std::mutex> l(lock);
+            stopping = true;
+        }
+
+        ready.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Submit one sample
+     * \param sample The input sample
+     * \return the future output of the network for the sample
+     */
+    std::future<output_t> submit(sample_t sample) {
+        request r{std::move(sample), {}, std::chrono::steady_clock::now()};
+
+        auto future = r.result.get_future();
+
+        size_t depth;
+
+        {
+            std::unique_lock<std::mutex> l(lock);
+
+            cpp_assert(!stopping, "Submission to a stopping executor");
+
+            pending.push_back(std::move(r));
+            depth = pending.size();
+        }
+
+        counters.requests.fetch_add(1, std::memory_order_relaxed);
+        counters.queue_depth.add(depth);
+
+        ready.notify_one();
+
+        return future;
+    }
+
+    /*!
+     * \brief Returns the counters of the executor
+     */
+    const batching_stats& stats() const {
+        return counters;
+    }
+
+    /*!
+     * \brief Returns the counters of the executor
+     */
+    batching_stats& stats() {
+        return counters;
+    }
+
+private:
+    /*!
+     * \brief A pending sample
+     */
+    struct request {
+        sample_t sample;                                 ///< The input sample
+        std::promise<output_t> result;                   ///< The output of the network
+        std::chrono::steady_clock::time_point submitted; ///< The time of the submission
+    };
+
+    /*!
+     * \brief Take the next batch of requests, waiting for it to be full or
+     * for the deadline of its oldest request
+     * \return false if the executor is stopped and there is nothing left
+     */
+    bool next_batch(std::vector<request>& batch) {
+        std::unique_lock<std::mutex> l(lock);
+
+        ready.wait(l, [this] { return stopping || !pending.empty(); });
+
+        if (pending.empty()) {
+            return false;
+        }
+
+        const auto deadline = pending.front().submitted + max_latency;
+
+        ready.wait_until(l, deadline, [this] { return stopping || pending.empty() || pending.size() >= max_batch; });
+
+        // Another worker may have taken the requests in the meantime
+        const size_t n = std::min(pending.size(), max_batch);
+
+        for (size_t i = 0; i < n; ++i) {
+            batch.push_back(std::move(pending.front()));
+            pending.pop_front();
+        }
+
+        // There may be enough requests left for another worker
+        if (!pending.empty()) {
+            ready.notify_one();
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief The loop of a worker
+     */
+    void work() {
+        auto context = dbn.make_inference_context();
+
+        std::vector<request> requests;
+        requests.reserve(max_batch);
+
+        while (next_batch(requests)) {
+            if (requests.empty()) {
+                continue;
+            }
+
+            const size_t n = requests.size();
+
+            counters.batches.fetch_add(1, std::memory_order_relaxed);
+            counters.batch_size.add(n);
+
+            try {
+                auto batch = dll::make_batch(n, requests.front().sample);
+
+                for (size_t i = 0; i < n; ++i) {
+                    batch(i) = requests[i].sample;
+                }
+
+                auto output = dbn.forward_batch(context, batch);
+
+                for (size_t i = 0; i < n; ++i) {
+                    requests[i].result.set_value(output_t(output(i)));
+                }
+            } catch (...) {
+                for (auto& r : requests) {
+                    try {
+                        r.result.set_exception(std::current_exception());
+                    } catch (const std::future_error&) {
+                        // The value of this request has already been set
+                    }
+                }
+            }
+
+            requests.clear();
+        }
+    }
+
+    const dbn_t& dbn;                            ///< The network
+    const size_t max_batch;                      ///< The maximum number of samples of a batch
+    const std::chrono::microseconds max_latency; ///< The maximum time a sample waits for its batch
+
+    std::mutex lock;               ///< The lock protecting the queue
+    std::condition_variable ready; ///< The condition for the workers to wait for requests
+    std::deque<request> pending;   ///< The pending requests
+    bool stopping = false;         ///< Indicates if the executor is stopping
+
+    batching_stats counters; ///< The counters of the executor
+
+    std::vector<std::thread> threads; ///< The workers
+};
+
+} //end of dll namespace
@@ -0,0 +1,71 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Reduced precision (bfloat16) storage type
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace dll {
+
+/*!
+ * \brief A 16 bits floating point storage type, with the range of a float
+ * (8 bits of exponent) and 8 bits of precision.
+ *
+ * This is a storage-only type: values are converted to float for any
+ * computation. It can be used with dll::storage_type to halve the memory
+ * of the cache of the in-memory generators.
+ */
+struct bfloat16 {
+    uint16_t bits = 0; ///< The upper 16 bits of the float representation
+
+    bfloat16() = default;
+
+    /*!
+     * \brief Convert a float to bfloat16, with rounding to nearest even
+     * \param value The value to convert
+     */
+    bfloat16(float value) : bits(from_float(value)) {}
+
+    /*!
+     * \brief Convert the value back to float
+     */
+    operator float() const {
+        uint32_t raw = uint32_t(bits) << 16;
+
+        float value;
+        std::memcpy(&value, &raw, sizeof(float));
+        return value;
+    }
+
+private:
+    /*!
+     * \brief Returns the upper 16 bits of the float, rounded to nearest even
+     */
+    static uint16_t from_float(float value) {
+        uint32_t raw;
+        std::memcpy(&raw, &value, sizeof(float));
+
+        // NaN must stay NaN, rounding could turn it into infinity
+        if ((raw & 0x7FFFFFFFu) > 0x7F800000u) {
+            return uint16_t((raw >> 16) | 0x0040u);
+        }
+
+        raw += 0x7FFFu + ((raw >> 16) & 1u);
+
+        return uint16_t(raw >> 16);
+    }
+};
+
+static_assert(sizeof(bfloat16) == 2, "bfloat16 must be stored in 16 bits");
+
+} //end of dll namespace
@@ -0,0 +1,254 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Bit-packed storage of sampled binary units
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A batch of sampled binary states, stored with one bit per unit.
+ *
+ * Each row is stored in 64-bit words, the unit j of a row is the bit j % 64
+ * of its word j / 64.
+ */
+struct binary_states {
+    size_t rows  = 0; ///< The number of rows (samples)
+    size_t cols  = 0; ///< The number of units per row
+    size_t words = 0; ///< The number of words per row
+
+    std::vector<uint64_t> bits; ///< The packed states
+
+    /*!
+     * \brief Resize the states, all the units are inactive
+     * \param r The number of rows
+     * \param c The number of units per row
+     */
+    void resize(size_t r, size_t c) {
+        rows  = r;
+        cols  = c;
+        words = (c + 63) / 64;
+
+        bits.assign(rows * words, 0);
+    }
+
+    /*!
+     * \brief Indicates if the given unit is active
+     */
+    bool get(size_t r, size_t j) const {
+        return (bits[r * words + j / 64] >> (j % 64)) & 1;
+    }
+
+    /*!
+     * \brief Store the indices of the active units of the given row
+     * \param r The row
+     * \param indices The output indices
+     */
+    void active_units(size_t r, std::vector<uint32_t>& indices) const {
+        const uint64_t* b = bits.data() + r * words;
+
+        indices.clear();
+
+        for (size_t k = 0; k < words; ++k) {
+            for (uint64_t m = b[k]; m; m &= m - 1) {
+                indices.push_back(uint32_t(k * 64 + __builtin_ctzll(m)));
+            }
+        }
+    }
+
+    /*!
+     * \brief Set the given row from a row of 0/1 values
+     * \param r The row to set
+     * \param values The values of the units
+     */
+    template <typename Row>
+    void set_row(size_t r, const Row& values) {
+        uint64_t* b = bits.data() + r * words;
+
+        std::fill(b, b + words, uint64_t(0));
+
+        for (size_t j = 0; j < cols; ++j) {
+            if (values[j] > 0.5) {
+                b[j / 64] |= uint64_t(1) << (j % 64);
+            }
+        }
+    }
+
+    /*!
+     * \brief Set all the rows from the given batch, a unit being active
+     * when its value is greater than the threshold. Each word is built from
+     * the branchless comparisons of its 64 values.
+     * \param values The batch of values, one row per sample
+     * \param threshold The threshold of the active units
+     */
+    template <typename Values, typename T>
+    void threshold(const Values& values, T threshold) {
+        values.ensure_cpu_up_to_date();
+
+        resize(etl::dim<0>(values), etl::size(values) / etl::dim<0>(values));
+
+        const auto* v = values.memory_start();
+
+        for (size_t r = 0; r < rows; ++r) {
+            uint64_t* b     = bits.data() + r * words;
+            const auto* v_r = v + r * cols;
+
+            for (size_t k = 0; k < words; ++k) {
+                const size_t first = k * 64;
+                const size_t n     = std::min(cols - first, size_t(64));
+
+                uint64_t word = 0;
+
+                for (size_t j = 0; j < n; ++j) {
+                    word |= uint64_t(v_r[first + j] > threshold) << j;
+                }
+
+                b[k] = word;
+            }
+        }
+    }
+
+    /*!
+     * \brief Sample the rows [first, last) from the given activation
+     * probabilities, writing the bits directly.
+     * \param probs The activation probabilities, one row per sample
+     * \param first The first row to sample
+     * \param last The end of the rows to sample
+     */
+    template <typename Probs>
+    void sample(Probs& probs, size_t first, size_t last) {
+        probs.ensure_cpu_up_to_date();
+
+        const auto* p = probs.memory_start();
+
+        auto& g = dll::rand_engine();
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+        for (size_t r = first; r < last; ++r) {
+            uint64_t* b     = bits.data() + r * words;
+            const auto* p_r = p + r * cols;
+
+            std::fill(b, b + words, uint64_t(0));
+
+            for (size_t j = 0; j < cols; ++j) {
+                if (dist(g) < p_r[j]) {
+                    b[j / 64] |= uint64_t(1) << (j % 64);
+                }
+            }
+        }
+    }
+};
+
+/*!
+ * \brief Compute the pre-activations of the visible units of the rows
+ * [first, last) from packed hidden states: out(r, i) = c(i) + sum_j w(i, j)
+ * for the active hidden units j of the row r.
+ *
+ * This only reads the weights of the active units, instead of a full
+ * product with the expanded states.
+ *
+ * \param states The packed hidden states
+ * \param first The first row
+ * \param last The end of the rows
+ * \param w The weights (visible x hidden)
+ * \param c The visible biases
+ * \param out The pre-activations (rows x visible)
+ */
+template <typename W, typename C, typename Out>
+void binary_visible_activations(const binary_states& states, size_t first, size_t last, const W& w, const C& c, Out& out) {
+    const size_t V = etl::dim<0>(w);
+    const size_t H = etl::dim<1>(w);
+
+    w.ensure_cpu_up_to_date();
+    c.ensure_cpu_up_to_date();
+    out.ensure_cpu_up_to_date();
+
+    const auto* w_p = w.memory_start();
+    const auto* c_p = c.memory_start();
+    auto* o_p       = out.memory_start();
+
+    std::vector<uint32_t> active;
+    active.reserve(H);
+
+    for (size_t r = first; r < last; ++r) {
+        states.active_units(r, active);
+
+        auto* o_r = o_p + r * V;
+
+        for (size_t i = 0; i < V; ++i) {
+            const auto* w_i = w_p + i * H;
+
+            auto sum = c_p[i];
+
+            for (auto j : active) {
+                sum += w_i[j];
+            }
+
+            o_r[i] = sum;
+        }
+    }
+
+    out.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the product of packed visible states with the weights:
+ * out(r, j) = sum_i w(i, j) for the active visible units i of the row r.
+ *
+ * This only adds the rows of the weights of the active units, instead of a
+ * full product with the expanded states.
+ *
+ * \param states The packed visible states
+ * \param w The weights (visible x hidden)
+ * \param out The output (rows x hidden)
+ */
+template <typename W, typename Out>
+void binary_hidden_product(const binary_states& states, const W& w, Out& out) {
+    const size_t H = etl::dim<1>(w);
+
+    cpp_assert(etl::dim<0>(w) == states.cols, "The packed states must have one unit per row of the weights");
+    cpp_assert(etl::size(out) == states.rows * H, "The output must have one row per packed row");
+
+    w.ensure_cpu_up_to_date();
+
+    const auto* w_p = w.memory_start();
+    auto* o_p       = out.memory_start();
+
+    std::vector<uint32_t> active;
+    active.reserve(states.cols);
+
+    for (size_t r = 0; r < states.rows; ++r) {
+        states.active_units(r, active);
+
+        auto* o_r = o_p + r * H;
+
+        std::fill(o_r, o_r + H, std::decay_t<decltype(*o_r)>(0));
+
+        for (auto i : active) {
+            const auto* w_i = w_p + i * H;
+
+            for (size_t j = 0; j < H; ++j) {
+                o_r[j] += w_i[j];
+            }
+        }
+    }
+
+    out.invalidate_gpu();
+}
+
+} //end of dll namespace
@@ -0,0 +1,169 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Execution of the independent branches of the merge layers, and
+ * copies between the branches and the merged batch
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The default cost from which a branch is run on the thread pool:
+ * all the branches are run one after another.
+ */
+constexpr size_t serial_branches = std::numeric_limits<size_t>::max();
+
+namespace detail {
+
+template <typename Cost, typename Functor, size_t... I>
+void for_each_branch(size_t threshold, Cost& cost, Functor& functor, std::index_sequence<I...> /*unused*/) {
+    auto* pool = sizeof...(I) > 1 ? scoped_thread_pool() : nullptr;
+
+    // On the scheduler, the branches compose with the regions nested in them
+    if (auto* scheduler = pool ? active_scheduler() : nullptr) {
+        task_group group(*scheduler);
+
+        auto run = [&](auto i) {
+            if (cost(i) >= threshold) {
+                group.run([&functor, i] { functor(i); });
+            } else {
+                functor(i);
+            }
+        };
+
+        (run(std::integral_constant<size_t, I>{}), ...);
+
+        group.wait();
+
+        return;
+    }
+
+    bool tasks = false;
+
+    pool_region region;
+
+    auto run = [&](auto i) {
+        if (pool && cost(i) >= threshold) {
+            pool->do_task(region.task([&functor, i] {
+                SERIAL_SECTION {
+                    functor(i);
+                }
+            }));
+
+            tasks = true;
+        } else {
+            functor(i);
+        }
+    };
+
+    (run(std::integral_constant<size_t, I>{}), ...);
+
+    if (tasks) {
+        pool->wait();
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Call functor(i) on each of the N independent branches, with i an
+ * std::integral_constant.
+ *
+ * When there is a scoped thread pool, the branches whose cost(i) is at
+ * least the threshold are run on the pool, the others are run on the
+ * calling thread, while the pool is working. With the work-stealing
+ * scheduler, they are forked on the scheduler.
+ *
+ * \param threshold The cost from which a branch is run on the pool
+ * \param cost The cost of a branch, for instance its number of outputs
+ * \param functor The functor to run each branch
+ */
+template <size_t N, typename Cost, typename Functor>
+void for_each_branch(size_t threshold, Cost&& cost, Functor&& functor) {
+    detail::for_each_branch(threshold, cost, functor, std::make_index_sequence<N>());
+}
+
+/*!
+ * \brief Copy the output of the ith branch into its slice of the merged
+ * output: the ith block of each sample of the merged output.
+ *
+ * \param merged The merged output (B x ...)
+ * \param sub The output of the branch (B x ...)
+ * \param i The index of the branch
+ */
+template <typename M, typename S>
+void merge_branch(M&& merged, const S& sub, size_t i) {
+    if constexpr (etl::is_dma<std::decay_t<M>> && etl::is_dma<S>) {
+        using T = etl::value_t<S>;
+
+        const size_t B  = etl::dim<0>(sub);
+        const size_t n  = etl::size(sub) / B;
+        const size_t mn = etl::size(merged) / B;
+
+        sub.ensure_cpu_up_to_date();
+        merged.ensure_cpu_up_to_date();
+
+        const T* s_p = sub.memory_start();
+        T* m_p       = merged.memory_start();
+
+        for (size_t b = 0; b < B; ++b) {
+            std::copy(s_p + b * n, s_p + (b + 1) * n, m_p + b * mn + i * n);
+        }
+
+        merged.invalidate_gpu();
+    } else {
+        etl::batch_merge(merged, sub, i);
+    }
+}
+
+/*!
+ * \brief Copy the slice of the ith branch of the merged errors into the
+ * errors of the branch, the reverse of merge_branch.
+ *
+ * \param sub The errors of the branch (B x ...)
+ * \param merged The merged errors (B x ...)
+ * \param i The index of the branch
+ */
+template <typename S, typename M>
+void dispatch_branch(S&& sub, const M& merged, size_t i) {
+    if constexpr (etl::is_dma<std::decay_t<S>> && etl::is_dma<M>) {
+        using T = etl::value_t<M>;
+
+        const size_t B  = etl::dim<0>(sub);
+        const size_t n  = etl::size(sub) / B;
+        const size_t mn = etl::size(merged) / B;
+
+        merged.ensure_cpu_up_to_date();
+
+        const T* m_p = merged.memory_start();
+        T* s_p       = sub.memory_start();
+
+        for (size_t b = 0; b < B; ++b) {
+            std::copy(m_p + b * mn + i * n, m_p + b * mn + (i + 1) * n, s_p + b * n);
+        }
+
+        sub.invalidate_gpu();
+    } else {
+        etl::batch_dispatch(sub, merged, i);
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,169 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Asynchronous checkpointing of the weights of a network, and of
+ * the state of its training
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+
+namespace dll {
+
+/*!
+ * \brief Store checkpoints of the weights of a network in the background.
+ *
+ * The weights are first copied into an in-memory snapshot, on the caller
+ * thread, and the snapshot is then written to a temporary file on a
+ * background thread and atomically renamed to its final name. Only the
+ * last checkpoints are kept on disk.
+ *
+ * When set on the network (dbn.checkpoints), a checkpoint is taken every
+ * "every" batches during fine-tuning. These checkpoints also hold the state
+ * of the training, from which it can be resumed with dbn.resume.
+ */
+struct checkpointer {
+    /*!
+     * \brief Create a new checkpointer
+     * \param prefix The prefix of the checkpoint files (prefix.N.dat)
+     * \param keep The number of checkpoints to keep on disk
+     * \param every The number of batches between two checkpoints during fine-tuning (0 to disable)
+     */
+    explicit checkpointer(std::string prefix, size_t keep = 3, size_t every = 0) : prefix(std::move(prefix)), keep(keep), every(every) {}
+
+    checkpointer(const checkpointer& rhs) = delete;
+    checkpointer& operator=(const checkpointer& rhs) = delete;
+
+    /*!
+     * \brief Wait for the last checkpoint to be written
+     */
+    ~checkpointer() {
+        wait();
+    }
+
+    /*!
+     * \brief Take a checkpoint of the given network.
+     *
+     * This only blocks for the snapshot of the weights (and for the
+     * previous checkpoint if it is still being written).
+     *
+     * \param dbn The network to store
+     * \return The name of the checkpoint file
+     */
+    template <typename DBN>
+    std::string checkpoint(const DBN& dbn) {
+        return checkpoint(dbn, [](std::ostream&) {});
+    }
+
+    /*!
+     * \brief Take a checkpoint of the given network, followed by the state
+     * written by the given functor.
+     *
+     * The weights are at the beginning of the checkpoint, which can
+     * therefore always be loaded with dbn.load. This only blocks for the
+     * snapshot of the weights and of the state (and for the previous
+     * checkpoint if it is still being written).
+     *
+     * \param dbn The network to store
+     * \param state The functor writing the state into the snapshot
+     * \return The name of the checkpoint file
+     */
+    template <typename DBN, typename State>
+    std::string checkpoint(const DBN& dbn, State&& state) {
+        wait();
+
+        std::ostringstream snapshot;
+        dbn.store(snapshot);
+        state(snapshot);
+
+        std::string file = prefix + "." + std::to_string(count++) + ".dat";
+
+        files.push_back(file);
+
+        std::string old;
+
+        if (keep && files.size() > keep) {
+            old = files.front();
+            files.pop_front();
+        }
+
+        writing = std::async(std::launch::async, [file, old, content = snapshot.str()] {
+            const std::string tmp = file + ".tmp";
+
+            {
+                std::ofstream os(tmp, std::ofstream::binary);
+                os.write(content.data(), content.size());
+
+                if (!os) {
+                    std::cerr << "checkpointer: Impossible to write " << tmp << std::endl;
+                    return;
+                }
+            }
+
+            if (std::rename(tmp.c_str(), file.c_str()) != 0) {
+                std::cerr << "checkpointer: Impossible to rename " << tmp << std::endl;
+                return;
+            }
+
+            if (!old.empty()) {
+                std::remove(old.c_str());
+            }
+        });
+
+        return file;
+    }
+
+    /*!
+     * \brief Indicates if a checkpoint must be taken after the current
+     * batch. Must be called once per batch.
+     */
+    bool due() {
+        ++batches;
+
+        return every && batches % every == 0;
+    }
+
+    /*!
+     * \brief Wait for the checkpoint being written, if any
+     */
+    void wait() {
+        if (writing.valid()) {
+            writing.wait();
+        }
+    }
+
+    /*!
+     * \brief Returns the name of the last checkpoint file, possibly still
+     * being written (empty if no checkpoint has been taken)
+     */
+    std::string last() const {
+        return files.empty() ? std::string() : files.back();
+    }
+
+private:
+    const std::string prefix; ///< The prefix of the checkpoint files
+    const size_t keep;        ///< The number of checkpoints to keep on disk
+    const size_t every;       ///< The number of batches between two checkpoints
+
+    size_t count   = 0; ///< The number of checkpoints taken
+    size_t batches = 0; ///< The number of batches seen
+
+    std::deque<std::string> files; ///< The checkpoints on disk
+    std::future<void> writing;     ///< The checkpoint being written
+};
+
+} //end of dll namespace
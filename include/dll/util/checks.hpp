@@ -7,6 +7,99 @@
 
 #pragma once
 
+#include <cmath>   //for std::isfinite
+#include <cstdint> //for the bits of the values
+#include <cstring> //for std::memcpy
+#include <type_traits>
+
+namespace dll {
+
+/*!
+ * \brief The stage of the training at which a non-finite value was found
+ */
+enum class numerical_stage {
+    NONE,      ///< No non-finite value
+    OUTPUT,    ///< The output of a layer
+    ERRORS,    ///< The errors backpropagated to a layer
+    GRADIENTS, ///< The gradients of the parameters of a layer
+    LOSS       ///< The loss of the batch
+};
+
+/*!
+ * \brief Returns a string representation of the given stage
+ */
+inline const char* to_string(numerical_stage stage) {
+    switch (stage) {
+        case numerical_stage::NONE:
+            return "none";
+        case numerical_stage::OUTPUT:
+            return "output";
+        case numerical_stage::ERRORS:
+            return "errors";
+        case numerical_stage::GRADIENTS:
+            return "gradients";
+        case numerical_stage::LOSS:
+            return "loss";
+    }
+
+    return "unknown";
+}
+
+/*!
+ * \brief The first non-finite value found during the training
+ */
+struct numerical_fault {
+    numerical_stage stage = numerical_stage::NONE; ///< The stage of the non-finite value
+    size_t layer          = 0;                     ///< The index of the layer that produced it
+    size_t iteration      = 0;                     ///< The iteration at which it was found
+
+    /*!
+     * \brief Indicates if a non-finite value was found
+     */
+    explicit operator bool() const {
+        return stage != numerical_stage::NONE;
+    }
+};
+
+/*!
+ * \brief Indicates if all the given values are finite.
+ *
+ * For float and double, the exponent bits of the values are tested, which
+ * vectorizes and is not folded away by fast math.
+ *
+ * \param values The values to test
+ * \param n The number of values
+ */
+template <typename T>
+bool all_finite(const T* values, size_t n) {
+    if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>) {
+        using bits_t = std::conditional_t<std::is_same_v<T, float>, uint32_t, uint64_t>;
+
+        constexpr bits_t exponent = std::is_same_v<T, float> ? bits_t(0x7F800000UL) : bits_t(0x7FF0000000000000ULL);
+
+        bool non_finite = false;
+
+        for (size_t i = 0; i < n; ++i) {
+            bits_t bits;
+            std::memcpy(&bits, values + i, sizeof(bits_t));
+
+            non_finite |= (bits & exponent) == exponent;
+        }
+
+        return !non_finite;
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            if (!std::isfinite(values[i])) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+} //end of namespace dll
+
 #ifndef NAN_DEBUG
 
 #define nan_check(value) ((void)0)
@@ -17,8 +110,6 @@
 
 #else
 
-#include <cmath> //for std::isfinite
-
 #include "cpp_utils/assert.hpp"
 
 #define nan_check(value) cpp_assert(std::isfinite(((value))), "NaN Verify");
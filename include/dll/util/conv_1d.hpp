@@ -0,0 +1,304 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Kernels of the 1D convolutional layers
+ *
+ * The sequences are stored time-major with the channels last (L x C), as
+ * the output of the embedding and recurrent layers. The NW rows of the
+ * window of an output step are therefore contiguous, and the filters are
+ * stored as (NW x C x K), so that a window is one row of NW * C values
+ * multiplied by a (NW * C) x K matrix.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <thread>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+#include "dll/util/workspace.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The number of input channels from which the 1D convolutions are
+ * computed with one GEMM per filter tap over the whole batch, instead of
+ * the direct kernels.
+ */
+constexpr size_t conv_1d_gemm_channels = 32;
+
+namespace detail {
+
+/*!
+ * \brief Call functor(first, last) on chunks of [0, n), on the scoped
+ * thread pool if there is one.
+ */
+template <typename Functor>
+void conv_1d_chunks(size_t n, Functor&& functor) {
+    auto* pool = scoped_thread_pool();
+
+    if (pool && n > 1) {
+        const size_t chunks = std::min(n, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&functor, n, chunks](size_t c) {
+            functor((c * n) / chunks, ((c + 1) * n) / chunks);
+        });
+    } else {
+        functor(0, n);
+    }
+}
+
+/*!
+ * \brief Direct 1D convolution, each output step being the product of its
+ * window by the filters, with the inner loop over the K contiguous
+ * outputs. The samples are computed in parallel.
+ */
+template <typename T>
+void conv_1d_direct_forward(const T* input, const T* w, T* output, size_t B, size_t L, size_t C, size_t K, size_t NW) {
+    const size_t LO = L - NW + 1;
+
+    conv_1d_chunks(B, [=](size_t first, size_t last) {
+        for (size_t b = first; b < last; ++b) {
+            const T* in = input + b * L * C;
+            T* out      = output + b * LO * K;
+
+            std::fill(out, out + LO * K, T(0));
+
+            for (size_t t = 0; t < LO; ++t) {
+                const T* window = in + t * C;
+                T* out_t        = out + t * K;
+
+                for (size_t j = 0; j < NW * C; ++j) {
+                    const T v    = window[j];
+                    const T* w_j = w + j * K;
+
+                    for (size_t k = 0; k < K; ++k) {
+                        out_t[k] += v * w_j[k];
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Direct gradients of the input of the 1D convolution, the errors
+ * of each output step going back to its window. The samples are computed
+ * in parallel.
+ */
+template <typename T>
+void conv_1d_direct_backward(const T* errors, const T* w, T* output, size_t B, size_t L, size_t C, size_t K, size_t NW) {
+    const size_t LO = L - NW + 1;
+
+    conv_1d_chunks(B, [=](size_t first, size_t last) {
+        for (size_t b = first; b < last; ++b) {
+            const T* e = errors + b * LO * K;
+            T* out     = output + b * L * C;
+
+            std::fill(out, out + L * C, T(0));
+
+            for (size_t t = 0; t < LO; ++t) {
+                const T* e_t = e + t * K;
+                T* window    = out + t * C;
+
+                for (size_t j = 0; j < NW * C; ++j) {
+                    const T* w_j = w + j * K;
+
+                    T acc(0);
+
+                    for (size_t k = 0; k < K; ++k) {
+                        acc += e_t[k] * w_j[k];
+                    }
+
+                    window[j] += acc;
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Direct gradients of the filters of the 1D convolution. The rows
+ * of the filters are computed in parallel, each one reducing over the
+ * whole batch.
+ */
+template <typename T>
+void conv_1d_direct_backward_filter(const T* input, const T* errors, T* grad, size_t B, size_t L, size_t C, size_t K, size_t NW) {
+    const size_t LO = L - NW + 1;
+
+    conv_1d_chunks(NW * C, [=](size_t first, size_t last) {
+        for (size_t j = first; j < last; ++j) {
+            T* g_j = grad + j * K;
+
+            std::fill(g_j, g_j + K, T(0));
+
+            for (size_t b = 0; b < B; ++b) {
+                const T* in = input + b * L * C;
+                const T* e  = errors + b * LO * K;
+
+                for (size_t t = 0; t < LO; ++t) {
+                    const T v    = in[t * C + j];
+                    const T* e_t = e + t * K;
+
+                    for (size_t k = 0; k < K; ++k) {
+                        g_j[k] += v * e_t[k];
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Copy the errors of the output (B x LO x K) into the steps of the
+ * batch seen as one sequence (B * L - NW + 1 x K), the steps whose window
+ * crosses two samples being set to zero.
+ */
+template <typename T>
+void conv_1d_spread_errors(const T* errors, T* z, size_t B, size_t L, size_t K, size_t NW) {
+    const size_t LO = L - NW + 1;
+    const size_t M  = B * L - NW + 1;
+
+    std::fill(z, z + M * K, T(0));
+
+    for (size_t b = 0; b < B; ++b) {
+        std::copy(errors + b * LO * K, errors + (b + 1) * LO * K, z + b * L * K);
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Compute the valid 1D convolution of a batch of sequences.
+ *
+ * For wide inputs, the batch is seen as one sequence of B * L steps and
+ * each filter tap is one GEMM over all of its steps, the steps whose
+ * window crosses two samples being computed and dropped.
+ *
+ * \param input The input (B x L x C)
+ * \param w The filters (NW x C x K)
+ * \param output The output (B x (L - NW + 1) x K)
+ * \param ws The workspace for the temporaries (can be nullptr)
+ */
+template <typename T>
+void conv_1d_forward(const T* input, const T* w, T* output, size_t B, size_t L, size_t C, size_t K, size_t NW, workspace* ws = nullptr) {
+    if (C < conv_1d_gemm_channels) {
+        detail::conv_1d_direct_forward(input, w, output, B, L, C, K, NW);
+        return;
+    }
+
+    const size_t LO = L - NW + 1;
+    const size_t M  = B * L - NW + 1;
+
+    workspace_lease<T> tmp(ws, M * K);
+
+    etl::custom_dyn_matrix<T, 2> z(tmp.data(), M, K);
+
+    for (size_t j = 0; j < NW; ++j) {
+        etl::custom_dyn_matrix<T, 2> x_j(const_cast<T*>(input + j * C), M, C);
+        etl::custom_dyn_matrix<T, 2> w_j(const_cast<T*>(w + j * C * K), C, K);
+
+        if (j == 0) {
+            z = x_j * w_j;
+        } else {
+            z += x_j * w_j;
+        }
+    }
+
+    for (size_t b = 0; b < B; ++b) {
+        std::copy(tmp.data() + b * L * K, tmp.data() + (b * L + LO) * K, output + b * LO * K);
+    }
+}
+
+/*!
+ * \brief Compute the gradients of the input of the 1D convolution.
+ * \param errors The errors of the output (B x (L - NW + 1) x K)
+ * \param w The filters (NW x C x K)
+ * \param output The gradients of the input (B x L x C)
+ * \param ws The workspace for the temporaries (can be nullptr)
+ */
+template <typename T>
+void conv_1d_backward(const T* errors, const T* w, T* output, size_t B, size_t L, size_t C, size_t K, size_t NW, workspace* ws = nullptr) {
+    if (C < conv_1d_gemm_channels) {
+        detail::conv_1d_direct_backward(errors, w, output, B, L, C, K, NW);
+        return;
+    }
+
+    const size_t M = B * L - NW + 1;
+
+    workspace_lease<T> tmp(ws, M * K);
+
+    detail::conv_1d_spread_errors(errors, tmp.data(), B, L, K, NW);
+
+    std::fill(output, output + B * L * C, T(0));
+
+    etl::custom_dyn_matrix<T, 2> z(tmp.data(), M, K);
+
+    for (size_t j = 0; j < NW; ++j) {
+        etl::custom_dyn_matrix<T, 2> out_j(output + j * C, M, C);
+        etl::custom_dyn_matrix<T, 2> w_j(const_cast<T*>(w + j * C * K), C, K);
+
+        out_j += z * etl::trans(w_j);
+    }
+}
+
+/*!
+ * \brief Compute the gradients of the filters of the 1D convolution,
+ * accumulated over the batch.
+ * \param input The input (B x L x C)
+ * \param errors The errors of the output (B x (L - NW + 1) x K)
+ * \param grad The gradients of the filters (NW x C x K)
+ * \param ws The workspace for the temporaries (can be nullptr)
+ */
+template <typename T>
+void conv_1d_backward_filter(const T* input, const T* errors, T* grad, size_t B, size_t L, size_t C, size_t K, size_t NW, workspace* ws = nullptr) {
+    if (C < conv_1d_gemm_channels) {
+        detail::conv_1d_direct_backward_filter(input, errors, grad, B, L, C, K, NW);
+        return;
+    }
+
+    const size_t M = B * L - NW + 1;
+
+    workspace_lease<T> tmp(ws, M * K);
+
+    detail::conv_1d_spread_errors(errors, tmp.data(), B, L, K, NW);
+
+    etl::custom_dyn_matrix<T, 2> z(tmp.data(), M, K);
+
+    for (size_t j = 0; j < NW; ++j) {
+        etl::custom_dyn_matrix<T, 2> x_j(const_cast<T*>(input + j * C), M, C);
+        etl::custom_dyn_matrix<T, 2> g_j(grad + j * C * K, C, K);
+
+        g_j = etl::trans(x_j) * z;
+    }
+}
+
+/*!
+ * \brief Compute the gradients of the biases of the 1D convolution, the
+ * sum of the errors of all the steps of the batch.
+ * \param errors The errors of the output (N x K)
+ * \param grad The gradients of the biases (K)
+ */
+template <typename T>
+void conv_1d_backward_bias(const T* errors, T* grad, size_t N, size_t K) {
+    std::fill(grad, grad + K, T(0));
+
+    for (size_t i = 0; i < N; ++i) {
+        const T* e_i = errors + i * K;
+
+        for (size_t k = 0; k < K; ++k) {
+            grad[k] += e_i[k];
+        }
+    }
+}
+
+} //end of dll namespace
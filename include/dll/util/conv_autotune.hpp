@@ -0,0 +1,320 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Autotuning of the algorithm of the convolutional layers
+ *
+ * The fastest algorithm depends on the shape of the layer, on the batch
+ * size, on the number of threads and on the machine. Each candidate is
+ * benchmarked on the forward pass of the layer and the decisions are kept
+ * in a cache, which can be stored in a file, keyed by the CPU model.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The algorithm computing the convolutions of a layer
+ */
+enum class conv_algorithm {
+    DEFAULT,    ///< Winograd for the 3x3 filters, the batched ETL kernels otherwise
+    BATCH,      ///< The batched convolution kernels of ETL
+    PER_SAMPLE, ///< One ETL convolution per sample, the samples in parallel
+    WINOGRAD    ///< The Winograd F(2x2,3x3) kernels (3x3 filters only)
+};
+
+/*!
+ * \brief Returns a string representation of a convolution algorithm
+ */
+inline std::string to_string(conv_algorithm a) {
+    switch (a) {
+        case conv_algorithm::DEFAULT:
+            return "DEFAULT";
+        case conv_algorithm::BATCH:
+            return "BATCH";
+        case conv_algorithm::PER_SAMPLE:
+            return "PER_SAMPLE";
+        case conv_algorithm::WINOGRAD:
+            return "WINOGRAD";
+    }
+
+    cpp_unreachable("Unreachable code");
+
+    return "UNDEFINED";
+}
+
+/*!
+ * \brief Returns the convolution algorithm of the given string
+ * representation, DEFAULT if it does not name an algorithm
+ */
+inline conv_algorithm conv_algorithm_from_string(const std::string& s) {
+    for (auto a : {conv_algorithm::BATCH, conv_algorithm::PER_SAMPLE, conv_algorithm::WINOGRAD}) {
+        if (s == to_string(a)) {
+            return a;
+        }
+    }
+
+    return conv_algorithm::DEFAULT;
+}
+
+/*!
+ * \brief Returns the model of the CPU, as reported by /proc/cpuinfo, or
+ * "unknown" if it is not available
+ */
+inline const std::string& cpu_model() {
+    static const std::string model = [] {
+        std::ifstream is("/proc/cpuinfo");
+        std::string line;
+
+        while (std::getline(is, line)) {
+            if (line.compare(0, 10, "model name") == 0) {
+                auto colon = line.find(':');
+
+                if (colon != std::string::npos && colon + 2 <= line.size()) {
+                    return line.substr(colon + 2);
+                }
+            }
+        }
+
+        return std::string("unknown");
+    }();
+
+    return model;
+}
+
+/*!
+ * \brief Returns the key of the decision for a convolution of the given
+ * shape, batch size and number of threads, on this machine
+ */
+inline std::string conv_tuning_key(size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2, size_t batch, size_t threads) {
+    char buffer[256];
+    snprintf(buffer, 256, "%lux%lux%lu:%lux%lux%lu:%lu:%lu", nc, nv1, nv2, k, nw1, nw2, batch, threads);
+    return cpu_model() + "/" + buffer;
+}
+
+/*!
+ * \brief The decisions of the autotuning of the convolutional layers.
+ *
+ * The file contains one decision per line, the key and the algorithm
+ * being separated by a tab.
+ */
+struct conv_tuning_cache {
+    std::map<std::string, conv_algorithm> decisions; ///< The algorithm of each key
+
+    /*!
+     * \brief Load the decisions from the given file, if it exists
+     * \return true if the file has been read, false otherwise
+     */
+    bool load(const std::string& file) {
+        std::ifstream is(file);
+
+        if (!is) {
+            return false;
+        }
+
+        std::string line;
+
+        while (std::getline(is, line)) {
+            auto tab = line.rfind('\t');
+
+            if (tab != std::string::npos) {
+                decisions[line.substr(0, tab)] = conv_algorithm_from_string(line.substr(tab + 1));
+            }
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Store all the decisions into the given file
+     */
+    void store(const std::string& file) const {
+        std::ofstream os(file);
+
+        for (auto& [key, algorithm] : decisions) {
+            os << key << '\t' << to_string(algorithm) << '\n';
+        }
+    }
+
+    /*!
+     * \brief Returns the decision for the given key, or nullptr if the
+     * convolution has not been tuned
+     */
+    const conv_algorithm* find(const std::string& key) const {
+        auto it = decisions.find(key);
+        return it == decisions.end() ? nullptr : &it->second;
+    }
+};
+
+/*!
+ * \brief The number of timed forward passes of each candidate
+ */
+constexpr size_t conv_autotune_repeats = 3;
+
+namespace detail {
+
+/*!
+ * \brief Select the fastest algorithm of the given layer by benchmarking
+ * its forward pass on the given batch with each candidate. The decision is
+ * set in the layer and in the cache.
+ *
+ * \param layer The layer to tune, with an algorithm member
+ * \param cache The decisions already taken
+ * \param key The key of the decision
+ * \param input The input batch
+ * \param output The output batch
+ * \param winograd Indicates if the Winograd kernels are a candidate
+ *
+ * \return The selected algorithm
+ */
+template <typename Layer, typename I, typename O>
+conv_algorithm autotune_forward(Layer& layer, conv_tuning_cache& cache, const std::string& key, I& input, O& output, bool winograd) {
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    auto best      = conv_algorithm::BATCH;
+    auto best_time = std::numeric_limits<double>::max();
+
+    for (auto candidate : {conv_algorithm::BATCH, conv_algorithm::PER_SAMPLE, conv_algorithm::WINOGRAD}) {
+        if (candidate == conv_algorithm::WINOGRAD && !winograd) {
+            continue;
+        }
+
+        layer.algorithm = candidate;
+
+        // Warm up the caches and the allocations of the kernels
+        layer.forward_batch(output, input);
+
+        auto time = std::numeric_limits<double>::max();
+
+        for (size_t r = 0; r < conv_autotune_repeats; ++r) {
+            auto start = std::chrono::steady_clock::now();
+
+            layer.forward_batch(output, input);
+
+            auto end = std::chrono::steady_clock::now();
+
+            time = std::min(time, std::chrono::duration<double>(end - start).count());
+        }
+
+        if (time < best_time) {
+            best      = candidate;
+            best_time = time;
+        }
+    }
+
+    cache.decisions[key] = best;
+
+    return layer.algorithm = best;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Select the fastest algorithm of the given convolutional layer for
+ * the given batch size, from the cache or by benchmarking the forward pass
+ * of each candidate on a random batch. The decision is set in the layer
+ * and in the cache.
+ *
+ * \param layer The layer to tune, with an algorithm member
+ * \param batch The batch size
+ * \param cache The decisions already taken
+ * \param nc The number of input channels
+ * \param nv1 The first dimension of the input
+ * \param nv2 The second dimension of the input
+ * \param k The number of filters
+ * \param nw1 The first dimension of the filters
+ * \param nw2 The second dimension of the filters
+ *
+ * \return The selected algorithm
+ */
+template <typename Layer>
+conv_algorithm autotune_conv(Layer& layer, size_t batch, conv_tuning_cache& cache, size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2) {
+    using weight = typename Layer::weight;
+
+    const auto key = conv_tuning_key(nc, nv1, nv2, k, nw1, nw2, batch, etl::threads);
+
+    if (const auto* decision = cache.find(key)) {
+        return layer.algorithm = *decision;
+    }
+
+    etl::dyn_matrix<weight, 4> input(batch, nc, nv1, nv2);
+    etl::dyn_matrix<weight, 4> output(batch, k, nv1 - nw1 + 1, nv2 - nw2 + 1);
+
+    return detail::autotune_forward(layer, cache, key, input, output, nw1 == 3 && nw2 == 3);
+}
+
+/*!
+ * \brief Select the fastest algorithm of the given deconvolutional layer
+ * for the given batch size, from the cache or by benchmarking the forward
+ * pass of each candidate on a random batch. The decision is set in the
+ * layer and in the cache.
+ *
+ * \param layer The layer to tune, with an algorithm member
+ * \param batch The batch size
+ * \param cache The decisions already taken
+ * \param nc The number of input channels
+ * \param nv1 The first dimension of the input
+ * \param nv2 The second dimension of the input
+ * \param k The number of filters
+ * \param nw1 The first dimension of the filters
+ * \param nw2 The second dimension of the filters
+ *
+ * \return The selected algorithm
+ */
+template <typename Layer>
+conv_algorithm autotune_deconv(Layer& layer, size_t batch, conv_tuning_cache& cache, size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2) {
+    using weight = typename Layer::weight;
+
+    // The deconvolutions and the convolutions of the same shape are tuned separately
+    const auto key = conv_tuning_key(nc, nv1, nv2, k, nw1, nw2, batch, etl::threads) + "/deconv";
+
+    if (const auto* decision = cache.find(key)) {
+        return layer.algorithm = *decision;
+    }
+
+    etl::dyn_matrix<weight, 4> input(batch, nc, nv1, nv2);
+    etl::dyn_matrix<weight, 4> output(batch, k, nv1 + nw1 - 1, nv2 + nw2 - 1);
+
+    return detail::autotune_forward(layer, cache, key, input, output, nw1 == 3 && nw2 == 3);
+}
+
+/*!
+ * \brief Traits indicating if a layer can select its convolution algorithm
+ * by autotuning (autotune)
+ */
+template <typename Layer, typename Enable = void>
+struct is_autotunable_layer : std::false_type {};
+
+/*!
+ * \copydoc is_autotunable_layer
+ */
+template <typename Layer>
+struct is_autotunable_layer<Layer, std::void_t<decltype(std::declval<Layer&>().autotune(size_t(), std::declval<conv_tuning_cache&>()))>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the given (possibly cv-qualified reference) type is a
+ * layer that can select its convolution algorithm by autotuning
+ */
+template <typename Layer>
+constexpr bool is_autotunable_layer_v = is_autotunable_layer<std::decay_t<Layer>>::value;
+
+} //end of dll namespace
@@ -7,11 +7,16 @@
 
 #pragma once
 
+#include "cpp_utils/assert.hpp"
 #include "cpp_utils/tmp.hpp"
 
+#include "etl/etl.hpp"
+
 #include <list>
 #include <vector>
 #include <deque>
+#include <type_traits>
+#include <utility>
 
 namespace dll {
 
@@ -28,8 +33,85 @@ struct cannot_convert {
     static constexpr bool value = false;
 };
 
+/*!
+ * \brief Indicates if contiguous values of type T_F can be used in place as
+ * the values of type T_T, without any conversion
+ */
+template <typename T_F, typename T_T>
+constexpr bool is_view_compatible = std::is_same<std::remove_cv_t<T_F>, T_T>::value && std::is_arithmetic<T_T>::value;
+
+/*!
+ * \brief Returns a non-owning view over contiguous values, with the given
+ * dimensions
+ *
+ * The view is read-only: the values are never modified through it.
+ *
+ * \param data The values
+ * \param sizes The dimensions of the view
+ */
+template <typename T, typename... S>
+const etl::custom_dyn_matrix<T, sizeof...(S)> input_view(const T* data, S... sizes) {
+    static_assert(std::is_arithmetic<T>::value, "The values of an input view must be arithmetic");
+
+    return etl::custom_dyn_matrix<T, sizeof...(S)>(const_cast<T*>(data), size_t(sizes)...);
+}
+
+/*!
+ * \brief Returns a non-owning view over the values of the given vector, with
+ * the given dimensions
+ *
+ * \param values The values
+ * \param sizes The dimensions of the view
+ */
+template <typename T, typename A, typename... S>
+const etl::custom_dyn_matrix<T, sizeof...(S)> input_view(const std::vector<T, A>& values, S... sizes) {
+    cpp_assert(values.size() == (size_t(1) * ... * size_t(sizes)), "Invalid dimensions for the input view");
+
+    return input_view(values.data(), sizes...);
+}
+
+namespace detail {
+
+/*!
+ * \brief Returns a view of n contiguous values with the dimensions of the
+ * dynamic input of the given layer.
+ *
+ * For several dimensions, the shape is taken from an input prepared by the
+ * layer, whose values are never written.
+ */
+template <size_t D, typename L, typename T, size_t... I>
+const etl::custom_dyn_matrix<T, D> layer_input_view(const L& l, const T* data, size_t n, std::index_sequence<I...>) {
+    if constexpr (D == 1) {
+        cpp_unused(l);
+
+        return input_view(data, n);
+    } else {
+        etl::dyn_matrix<T, D> shape;
+        l.prepare_input(shape);
+
+        cpp_assert(etl::size(shape) == n, "Invalid size for the input of the layer");
+        cpp_unused(n);
+
+        return input_view(data, etl::dim(shape, I)...);
+    }
+}
+
+/*!
+ * \copydoc layer_input_view
+ */
+template <size_t D, typename L, typename T>
+const etl::custom_dyn_matrix<T, D> layer_input_view(const L& l, const T* data, size_t n) {
+    return layer_input_view<D>(l, data, n, std::make_index_sequence<D>());
+}
+
+} //end of namespace detail
+
 /*!
  * \brief Converter utility to converty from type *From* to type *To*.
+ *
+ * The contiguous inputs (vectors and ETL containers) of the weight type
+ * are not copied, a non-owning view over their values is used instead.
+ * Only the other value types, lists and deques are converted.
  */
 template<typename From, typename To, typename Enable = void>
 struct converter_one {
@@ -62,7 +144,7 @@ struct converter_one <From, From> {
  * \copydoc converter_one
  */
 template<typename T_F, typename T_T, typename A>
-struct converter_one<std::vector<T_F, A>, etl::dyn_matrix<T_T, 1>> {
+struct converter_one<std::vector<T_F, A>, etl::dyn_matrix<T_T, 1>, std::enable_if_t<!is_view_compatible<T_F, T_T>>> {
     static_assert(std::is_convertible<T_F, T_T>::value, "DLL cannot convert your value type to the weight type (one)");
 
     /*!
@@ -134,7 +216,7 @@ struct converter_one<std::deque<T_F, A>, etl::dyn_matrix<T_T, 1>> {
  * \copydoc converter_one
  */
 template<typename T_F, typename T_T, typename A, size_t D>
-struct converter_one<std::vector<T_F, A>, etl::dyn_matrix<T_T, D>> {
+struct converter_one<std::vector<T_F, A>, etl::dyn_matrix<T_T, D>, std::enable_if_t<!is_view_compatible<T_F, T_T>>> {
     static_assert(std::is_convertible<T_F, T_T>::value, "DLL cannot convert your value type to the weight type (one)");
 
     /*!
@@ -209,7 +291,7 @@ struct converter_one<std::deque<T_F, A>, etl::dyn_matrix<T_T, D>> {
  * \copydoc converter_one
  */
 template<typename T_F, typename T_T, typename A, size_t... Dims>
-struct converter_one<std::vector<T_F, A>, etl::fast_dyn_matrix<T_T, Dims...>> {
+struct converter_one<std::vector<T_F, A>, etl::fast_dyn_matrix<T_T, Dims...>, std::enable_if_t<!is_view_compatible<T_F, T_T>>> {
     static_assert(std::is_convertible<T_F, T_T>::value, "DLL cannot convert your value type to the weight type (one)");
 
     /*!
@@ -281,7 +363,7 @@ struct converter_one<std::deque<T_F, A>, etl::fast_dyn_matrix<T_T, Dims...>> {
  * \copydoc converter_one
  */
 template<typename T_F, typename T_T, size_t... Dims, size_t... Dims2>
-struct converter_one<etl::fast_dyn_matrix<T_F, Dims...>, etl::fast_dyn_matrix<T_T, Dims2...>> {
+struct converter_one<etl::fast_dyn_matrix<T_F, Dims...>, etl::fast_dyn_matrix<T_T, Dims2...>, std::enable_if_t<!is_view_compatible<T_F, T_T>>> {
     static_assert(std::is_convertible<T_F, T_T>::value, "DLL cannot convert your value type to the weight type (one)");
 
     /*!
@@ -305,7 +387,7 @@ struct converter_one<etl::fast_dyn_matrix<T_F, Dims...>, etl::fast_dyn_matrix<T_
  * \copydoc converter_one
  */
 template<typename T_F, typename T_T, size_t... Dims, size_t... Dims2>
-struct converter_one<etl::fast_matrix<T_F, Dims...>, etl::fast_dyn_matrix<T_T, Dims2...>> {
+struct converter_one<etl::fast_matrix<T_F, Dims...>, etl::fast_dyn_matrix<T_T, Dims2...>, std::enable_if_t<!is_view_compatible<T_F, T_T>>> {
     static_assert(std::is_convertible<T_F, T_T>::value, "DLL cannot convert your value type to the weight type (one)");
 
     /*!
@@ -329,7 +411,7 @@ struct converter_one<etl::fast_matrix<T_F, Dims...>, etl::fast_dyn_matrix<T_T, D
  * \copydoc converter_one
  */
 template<typename T_F, typename T_T, size_t... Dims, size_t D>
-struct converter_one<etl::fast_dyn_matrix<T_F, Dims...>, etl::dyn_matrix<T_T, D>> {
+struct converter_one<etl::fast_dyn_matrix<T_F, Dims...>, etl::dyn_matrix<T_T, D>, std::enable_if_t<!is_view_compatible<T_F, T_T>>> {
     static_assert(std::is_convertible<T_F, T_T>::value, "DLL cannot convert your value type to the weight type (one)");
 
     /*!
@@ -354,7 +436,7 @@ struct converter_one<etl::fast_dyn_matrix<T_F, Dims...>, etl::dyn_matrix<T_T, D>
  * \copydoc converter_one
  */
 template<typename T_F, typename T_T, size_t... Dims, size_t D>
-struct converter_one<etl::fast_matrix<T_F, Dims...>, etl::dyn_matrix<T_T, D>> {
+struct converter_one<etl::fast_matrix<T_F, Dims...>, etl::dyn_matrix<T_T, D>, std::enable_if_t<!is_view_compatible<T_F, T_T>>> {
     static_assert(std::is_convertible<T_F, T_T>::value, "DLL cannot convert your value type to the weight type (one)");
 
     /*!
@@ -379,7 +461,7 @@ struct converter_one<etl::fast_matrix<T_F, Dims...>, etl::dyn_matrix<T_T, D>> {
  * \copydoc converter_one
  */
 template<typename T_F, typename T_T, size_t D, size_t... Dims>
-struct converter_one<etl::dyn_matrix<T_F, D>, etl::fast_dyn_matrix<T_T, Dims...>> {
+struct converter_one<etl::dyn_matrix<T_F, D>, etl::fast_dyn_matrix<T_T, Dims...>, std::enable_if_t<!is_view_compatible<T_F, T_T>>> {
     static_assert(std::is_convertible<T_F, T_T>::value, "DLL cannot convert your value type to the weight type (one)");
 
     /*!
@@ -427,7 +509,7 @@ struct converter_one<etl::dyn_matrix<T_F, D>, etl::dyn_matrix<T_T, D>, std::enab
  * \copydoc converter_one
  */
 template<typename T_F, typename T_T, size_t D, size_t D2>
-struct converter_one<etl::dyn_matrix<T_F, D>, etl::dyn_matrix<T_T, D2>, std::enable_if_t<(D != D2)>> {
+struct converter_one<etl::dyn_matrix<T_F, D>, etl::dyn_matrix<T_T, D2>, std::enable_if_t<(D != D2) && !is_view_compatible<T_F, T_T>>> {
     static_assert(std::is_convertible<T_F, T_T>::value, "DLL cannot convert your value type to the weight type (one)");
 
     /*!
@@ -446,6 +528,161 @@ struct converter_one<etl::dyn_matrix<T_F, D>, etl::dyn_matrix<T_T, D2>, std::ena
     }
 };
 
+// Views without conversion
+
+/*!
+ * \copydoc converter_one
+ */
+template<typename T_F, typename T_T, typename A, size_t D>
+struct converter_one<std::vector<T_F, A>, etl::dyn_matrix<T_T, D>, std::enable_if_t<is_view_compatible<T_F, T_T>>> {
+    /*!
+     * \brief Returns a view over the given container, with the shape of the input of the layer
+     * \param l The layer for which to convert
+     * \param from The container to view
+     * \return the view over the container
+     */
+    template<typename L>
+    static auto convert(const L& l, const std::vector<T_F, A>& from){
+        return detail::layer_input_view<D>(l, from.data(), from.size());
+    }
+};
+
+/*!
+ * \copydoc converter_one
+ */
+template<typename T_F, typename T_T, typename A, size_t... Dims>
+struct converter_one<std::vector<T_F, A>, etl::fast_dyn_matrix<T_T, Dims...>, std::enable_if_t<is_view_compatible<T_F, T_T>>> {
+    /*!
+     * \brief Returns a view over the given container, with the shape of the input of the layer
+     * \param l The layer for which to convert
+     * \param from The container to view
+     * \return the view over the container
+     */
+    template<typename L>
+    static auto convert(const L&, const std::vector<T_F, A>& from){
+        return input_view(from, Dims...);
+    }
+};
+
+/*!
+ * \copydoc converter_one
+ */
+template<typename T_F, typename T_T, size_t... Dims, size_t D>
+struct converter_one<etl::fast_dyn_matrix<T_F, Dims...>, etl::dyn_matrix<T_T, D>, std::enable_if_t<is_view_compatible<T_F, T_T>>> {
+    /*!
+     * \brief Returns a view over the given container, with the shape of the input of the layer
+     * \param l The layer for which to convert
+     * \param from The container to view
+     * \return the view over the container
+     */
+    template<typename L>
+    static auto convert(const L& l, const etl::fast_dyn_matrix<T_F, Dims...>& from){
+        if constexpr (D == sizeof...(Dims)) {
+            cpp_unused(l);
+            return input_view(from.memory_start(), Dims...);
+        } else {
+            return detail::layer_input_view<D>(l, from.memory_start(), etl::size(from));
+        }
+    }
+};
+
+/*!
+ * \copydoc converter_one
+ */
+template<typename T_F, typename T_T, size_t... Dims, size_t D>
+struct converter_one<etl::fast_matrix<T_F, Dims...>, etl::dyn_matrix<T_T, D>, std::enable_if_t<is_view_compatible<T_F, T_T>>> {
+    /*!
+     * \brief Returns a view over the given container, with the shape of the input of the layer
+     * \param l The layer for which to convert
+     * \param from The container to view
+     * \return the view over the container
+     */
+    template<typename L>
+    static auto convert(const L& l, const etl::fast_matrix<T_F, Dims...>& from){
+        if constexpr (D == sizeof...(Dims)) {
+            cpp_unused(l);
+            return input_view(from.memory_start(), Dims...);
+        } else {
+            return detail::layer_input_view<D>(l, from.memory_start(), etl::size(from));
+        }
+    }
+};
+
+/*!
+ * \copydoc converter_one
+ */
+template<typename T_F, typename T_T, size_t D, size_t D2>
+struct converter_one<etl::dyn_matrix<T_F, D>, etl::dyn_matrix<T_T, D2>, std::enable_if_t<(D != D2) && is_view_compatible<T_F, T_T>>> {
+    /*!
+     * \brief Returns a view over the given container, with the shape of the input of the layer
+     * \param l The layer for which to convert
+     * \param from The container to view
+     * \return the view over the container
+     */
+    template<typename L>
+    static auto convert(const L& l, const etl::dyn_matrix<T_F, D>& from){
+        return detail::layer_input_view<D2>(l, from.memory_start(), etl::size(from));
+    }
+};
+
+/*!
+ * \copydoc converter_one
+ */
+template<typename T_F, typename T_T, size_t D, size_t... Dims>
+struct converter_one<etl::dyn_matrix<T_F, D>, etl::fast_dyn_matrix<T_T, Dims...>, std::enable_if_t<is_view_compatible<T_F, T_T>>> {
+    /*!
+     * \brief Returns a view over the given container, with the shape of the input of the layer
+     * \param l The layer for which to convert
+     * \param from The container to view
+     * \return the view over the container
+     */
+    template<typename L>
+    static auto convert(const L&, const etl::dyn_matrix<T_F, D>& from){
+        cpp_assert(etl::size(from) == (size_t(1) * ... * Dims), "Invalid size for the input of the layer");
+
+        return input_view(from.memory_start(), Dims...);
+    }
+};
+
+/*!
+ * \copydoc converter_one
+ */
+template<typename T_F, typename T_T, size_t... Dims, size_t... Dims2>
+struct converter_one<etl::fast_dyn_matrix<T_F, Dims...>, etl::fast_dyn_matrix<T_T, Dims2...>,
+                     std::enable_if_t<is_view_compatible<T_F, T_T> && !std::is_same<etl::fast_dyn_matrix<T_F, Dims...>, etl::fast_dyn_matrix<T_T, Dims2...>>::value>> {
+    static_assert((size_t(1) * ... * Dims) == (size_t(1) * ... * Dims2), "Invalid size for the input of the layer");
+
+    /*!
+     * \brief Returns a view over the given container, with the shape of the input of the layer
+     * \param l The layer for which to convert
+     * \param from The container to view
+     * \return the view over the container
+     */
+    template<typename L>
+    static auto convert(const L&, const etl::fast_dyn_matrix<T_F, Dims...>& from){
+        return input_view(from.memory_start(), Dims2...);
+    }
+};
+
+/*!
+ * \copydoc converter_one
+ */
+template<typename T_F, typename T_T, size_t... Dims, size_t... Dims2>
+struct converter_one<etl::fast_matrix<T_F, Dims...>, etl::fast_dyn_matrix<T_T, Dims2...>, std::enable_if_t<is_view_compatible<T_F, T_T>>> {
+    static_assert((size_t(1) * ... * Dims) == (size_t(1) * ... * Dims2), "Invalid size for the input of the layer");
+
+    /*!
+     * \brief Returns a view over the given container, with the shape of the input of the layer
+     * \param l The layer for which to convert
+     * \param from The container to view
+     * \return the view over the container
+     */
+    template<typename L>
+    static auto convert(const L&, const etl::fast_matrix<T_F, Dims...>& from){
+        return input_view(from.memory_start(), Dims2...);
+    }
+};
+
 template<typename From, typename To>
 struct converter_many {
     static_assert(cannot_convert<From, To>::value, "DLL does not know how to convert your input type (many)");
@@ -454,10 +691,16 @@ struct converter_many {
 // Only convert the sub types not the outer container
 template<template<typename...> typename Container, typename From, typename To>
 struct converter_many <Container<From>, Container<To>> {
+    /*!
+     * \brief The type of the converted values (or of the views) for the given layer
+     */
+    template<typename L>
+    using value_t = std::decay_t<decltype(converter_one<From, To>::convert(std::declval<const L&>(), std::declval<const From&>()))>;
+
     template<typename L>
-    static Container<To> convert(const L& l, const Container<From>& from){
+    static Container<value_t<L>> convert(const L& l, const Container<From>& from){
         debug_convert("converter::many");
-        Container<To> to;
+        Container<value_t<L>> to;
         to.reserve(from.size());
         for(auto& value : from){
             to.emplace_back(converter_one<From, To>::convert(l, value));
@@ -0,0 +1,219 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Sparse (CSR) batches of input and their kernels
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The maximum density of a batch of input for the sparse kernels to
+ * be used, the denser batches use the dense kernels.
+ */
+constexpr double sparse_max_density = 0.1;
+
+/*!
+ * \brief A batch of input stored in Compressed Sparse Row format.
+ *
+ * The row r holds the values values[row_ptr[r], row_ptr[r + 1]) at the
+ * columns columns[row_ptr[r], row_ptr[r + 1]).
+ */
+template <typename T>
+struct csr_batch {
+    size_t rows = 0; ///< The number of rows (samples)
+    size_t cols = 0; ///< The number of columns (features)
+
+    std::vector<size_t> row_ptr;   ///< The beginning of each row, rows + 1 entries
+    std::vector<uint32_t> columns; ///< The column of each non-zero
+    std::vector<T> values;         ///< The value of each non-zero
+
+    /*!
+     * \brief Returns the number of non-zeros of the batch
+     */
+    size_t nnz() const {
+        return values.size();
+    }
+
+    /*!
+     * \brief Add a row to the batch from its non-zeros
+     * \param first The column of the first non-zero
+     * \param last The end of the columns
+     * \param vfirst The value of the first non-zero
+     */
+    template <typename CIterator, typename VIterator>
+    void push_row(CIterator first, CIterator last, VIterator vfirst) {
+        if (row_ptr.empty()) {
+            row_ptr.push_back(0);
+        }
+
+        for (; first != last; ++first, ++vfirst) {
+            columns.push_back(uint32_t(*first));
+            values.push_back(T(*vfirst));
+        }
+
+        row_ptr.push_back(values.size());
+        ++rows;
+    }
+
+    /*!
+     * \brief Compress the given dense batch (one row per sample), unless
+     * its density is higher than max_density.
+     * \param dense The dense batch, with direct memory access
+     * \param max_density The maximum density of the batch
+     * \return true if the batch has been compressed, false if it is too dense
+     */
+    template <typename M>
+    bool compress(const M& dense, double max_density = sparse_max_density) {
+        dense.ensure_cpu_up_to_date();
+
+        rows = etl::dim<0>(dense);
+        cols = rows ? etl::size(dense) / rows : 0;
+
+        const size_t limit = size_t(max_density * double(rows * cols));
+
+        const auto* d = dense.memory_start();
+
+        row_ptr.resize(rows + 1);
+        columns.clear();
+        values.clear();
+
+        row_ptr[0] = 0;
+
+        for (size_t r = 0; r < rows; ++r) {
+            const auto* d_r = d + r * cols;
+
+            for (size_t j = 0; j < cols; ++j) {
+                if (d_r[j] != 0) {
+                    columns.push_back(uint32_t(j));
+                    values.push_back(T(d_r[j]));
+                }
+            }
+
+            if (values.size() > limit) {
+                return false;
+            }
+
+            row_ptr[r + 1] = values.size();
+        }
+
+        return true;
+    }
+};
+
+/*!
+ * \brief Compute out = a * w, with a sparse batch and a dense weight
+ * matrix, in time proportional to the non-zeros of a.
+ *
+ * The rows are computed in chunks on the scoped thread pool if there is
+ * one.
+ *
+ * \param a The sparse batch (rows x visible)
+ * \param w The weights (visible x hidden)
+ * \param out The output (rows x hidden)
+ */
+template <typename T, typename W, typename Out>
+void csr_mul(const csr_batch<T>& a, const W& w, Out&& out) {
+    const size_t H = etl::dim<1>(w);
+
+    cpp_assert(etl::dim<0>(w) == a.cols, "Invalid dimensions for csr_mul");
+    cpp_assert(etl::size(out) == a.rows * H, "Invalid dimensions for csr_mul");
+
+    w.ensure_cpu_up_to_date();
+    out.ensure_cpu_up_to_date();
+
+    const auto* w_p = w.memory_start();
+    auto* o_p       = out.memory_start();
+
+    using value_t = std::decay_t<decltype(*o_p)>;
+
+    auto rows = [&a, w_p, o_p, H](size_t first, size_t last) {
+        for (size_t r = first; r < last; ++r) {
+            auto* o_r = o_p + r * H;
+
+            std::fill(o_r, o_r + H, value_t(0));
+
+            for (size_t k = a.row_ptr[r]; k < a.row_ptr[r + 1]; ++k) {
+                const auto v    = a.values[k];
+                const auto* w_k = w_p + size_t(a.columns[k]) * H;
+
+                for (size_t j = 0; j < H; ++j) {
+                    o_r[j] += v * w_k[j];
+                }
+            }
+        }
+    };
+
+    auto* pool = scoped_thread_pool();
+
+    if (pool && a.rows > 1) {
+        const size_t chunks = std::min(a.rows, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&rows, &a, chunks](size_t c) {
+            rows((c * a.rows) / chunks, ((c + 1) * a.rows) / chunks);
+        });
+    } else {
+        rows(0, a.rows);
+    }
+
+    out.invalidate_gpu();
+}
+
+/*!
+ * \brief Accumulate grad += alpha * transpose(a) * e, with a sparse batch,
+ * in time proportional to the non-zeros of a.
+ *
+ * Only the rows of grad at the columns of the non-zeros are touched.
+ *
+ * \param a The sparse batch (rows x visible)
+ * \param e The dense batch (rows x hidden)
+ * \param grad The gradients (visible x hidden)
+ * \param alpha The factor of the product
+ */
+template <typename T, typename E, typename G>
+void csr_outer_add(const csr_batch<T>& a, const E& e, G&& grad, double alpha = 1.0) {
+    const size_t H = etl::dim<1>(grad);
+
+    cpp_assert(etl::dim<0>(grad) == a.cols, "Invalid dimensions for csr_outer_add");
+    cpp_assert(etl::size(e) >= a.rows * H, "Invalid dimensions for csr_outer_add");
+
+    e.ensure_cpu_up_to_date();
+    grad.ensure_cpu_up_to_date();
+
+    const auto* e_p = e.memory_start();
+    auto* g_p       = grad.memory_start();
+
+    using value_t = std::decay_t<decltype(*g_p)>;
+
+    for (size_t r = 0; r < a.rows; ++r) {
+        const auto* e_r = e_p + r * H;
+
+        for (size_t k = a.row_ptr[r]; k < a.row_ptr[r + 1]; ++k) {
+            const value_t v = value_t(alpha * a.values[k]);
+            auto* g_k       = g_p + size_t(a.columns[k]) * H;
+
+            for (size_t j = 0; j < H; ++j) {
+                g_k[j] += v * e_r[j];
+            }
+        }
+    }
+
+    grad.invalidate_gpu();
+}
+
+} //end of dll namespace
@@ -0,0 +1,196 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Kernels of the deconvolutional layers.
+ *
+ * A deconvolution of an input (B x NC x NV1 x NV2) by filters (NC x K x NW1
+ * x NW2) is the full cross-correlation of the input with the filters. This
+ * is the gradient of the input of the convolution with the mirrored shape
+ * (K channels, NC filters) by the spatially flipped filters, and its
+ * gradient of the input is the forward pass of this convolution. Both are
+ * computed with the engines of the convolutional layers.
+ */
+
+#pragma once
+
+#include <mutex>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/conv_autotune.hpp" // for conv_algorithm
+#include "dll/util/grouped_conv.hpp"  // for the per-sample kernels
+#include "dll/util/winograd.hpp"      // for F(2x2,3x3) kernels
+#include "dll/util/workspace.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Cache of the transposed-convolution filters of a deconvolutional
+ * layer: the spatially flipped filters and the Winograd transforms of the
+ * flipped and of the original 3x3 filters.
+ *
+ * The cache is computed on first use and must be invalidated when the
+ * filters are modified.
+ */
+template <typename T>
+struct deconv_filters {
+    /*!
+     * \brief Returns the spatially flipped filters of the given filters
+     * (NC x K x NW1 x NW2)
+     */
+    template <typename W>
+    const etl::dyn_matrix<T, 4>& flipped(const W& w) {
+        std::lock_guard<std::mutex> l(lock);
+
+        if (!valid) {
+            const size_t N   = etl::dim<0>(w) * etl::dim<1>(w);
+            const size_t NW1 = etl::dim<2>(w);
+            const size_t NW2 = etl::dim<3>(w);
+
+            if (etl::size(f) != etl::size(w)) {
+                f = etl::dyn_matrix<T, 4>(etl::dim<0>(w), etl::dim<1>(w), NW1, NW2);
+            }
+
+            w.ensure_cpu_up_to_date();
+
+            const T* w_p = w.memory_start();
+            T* f_p       = f.memory_start();
+
+            for (size_t n = 0; n < N; ++n) {
+                for (size_t i = 0; i < NW1; ++i) {
+                    for (size_t j = 0; j < NW2; ++j) {
+                        f_p[(n * NW1 + i) * NW2 + j] = w_p[(n * NW1 + (NW1 - 1 - i)) * NW2 + (NW2 - 1 - j)];
+                    }
+                }
+            }
+
+            f.invalidate_gpu();
+
+            valid = true;
+        }
+
+        return f;
+    }
+
+    /*!
+     * \brief Returns the Winograd transform of the flipped 3x3 filters, for
+     * the forward pass
+     */
+    template <typename W>
+    const T* winograd_flipped(const W& w) {
+        return u_flipped.get(flipped(w));
+    }
+
+    /*!
+     * \brief Returns the Winograd transform of the 3x3 filters, for the
+     * backward pass
+     */
+    template <typename W>
+    const T* winograd(const W& w) {
+        return u.get(w);
+    }
+
+    /*!
+     * \brief Invalidate the cache, after a modification of the filters
+     */
+    void invalidate() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            valid = false;
+        }
+
+        u_flipped.invalidate();
+        u.invalidate();
+    }
+
+private:
+    etl::dyn_matrix<T, 4> f;       ///< The flipped filters
+    bool valid = false;            ///< Indicates if the flipped filters are up to date
+    std::mutex lock;               ///< The lock for concurrent uses of the layer
+    winograd_filters<T> u_flipped; ///< The Winograd transform of the flipped filters
+    winograd_filters<T> u;         ///< The Winograd transform of the filters
+};
+
+/*!
+ * \brief Returns the size of the workspace, in bytes, needed by the
+ * Winograd kernels of a deconvolution, for any batch size, 0 if the filters
+ * are not 3x3
+ */
+template <typename T>
+size_t deconv_workspace_size(size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2) {
+    if (nw1 == 3 && nw2 == 3) {
+        return winograd_workspace_size<T>(k, nv1 + nw1 - 1, nv2 + nw2 - 1, nc, 0);
+    }
+
+    return 0;
+}
+
+/*!
+ * \brief Compute the deconvolution of a batch, with the given algorithm.
+ *
+ * By default, the 3x3 filters use the Winograd kernels of the gradients of
+ * the input of the convolutions and the others the batched ETL kernels.
+ *
+ * \param input The input (B x NC x NV1 x NV2)
+ * \param w The filters (NC x K x NW1 x NW2)
+ * \param output The output (B x K x NV1 + NW1 - 1 x NV2 + NW2 - 1)
+ * \param algorithm The algorithm of the convolutions
+ * \param cache The cache of the transposed-convolution filters
+ * \param ws The workspace for the temporaries (can be nullptr)
+ */
+template <typename I, typename W, typename O, typename T>
+void deconv_forward(const I& input, const W& w, O&& output, conv_algorithm algorithm, deconv_filters<T>& cache, workspace* ws) {
+    const size_t NW1 = etl::dim<2>(w);
+    const size_t NW2 = etl::dim<3>(w);
+
+    if constexpr (etl::is_dma<I> && etl::is_dma<std::decay_t<O>>) {
+        if (NW1 == 3 && NW2 == 3 && (algorithm == conv_algorithm::DEFAULT || algorithm == conv_algorithm::WINOGRAD)) {
+            dll::winograd_backward(input, cache.winograd_flipped(w), output, etl::dim<1>(w), etl::dim<2>(output), etl::dim<3>(output), etl::dim<0>(w), 0, ws);
+            return;
+        }
+    }
+
+    if (algorithm == conv_algorithm::PER_SAMPLE) {
+        dll::grouped_conv_backward(input, cache.flipped(w), output, 1, 0, 0);
+    } else {
+        output = etl::conv_4d_full_flipped(input, w);
+    }
+}
+
+/*!
+ * \brief Compute the gradients of the input of the deconvolution of a
+ * batch, with the given algorithm.
+ *
+ * \param errors The errors of the output (B x K x NV1 + NW1 - 1 x NV2 + NW2 - 1)
+ * \param w The filters (NC x K x NW1 x NW2)
+ * \param output The gradients of the input (B x NC x NV1 x NV2)
+ * \param algorithm The algorithm of the convolutions
+ * \param cache The cache of the transposed-convolution filters
+ * \param ws The workspace for the temporaries (can be nullptr)
+ */
+template <typename E, typename W, typename O, typename T>
+void deconv_backward(const E& errors, const W& w, O&& output, conv_algorithm algorithm, deconv_filters<T>& cache, workspace* ws) {
+    const size_t NW1 = etl::dim<2>(w);
+    const size_t NW2 = etl::dim<3>(w);
+
+    if constexpr (etl::is_dma<E> && etl::is_dma<std::decay_t<O>>) {
+        if (NW1 == 3 && NW2 == 3 && (algorithm == conv_algorithm::DEFAULT || algorithm == conv_algorithm::WINOGRAD)) {
+            dll::winograd_forward(errors, cache.winograd(w), output, etl::dim<1>(w), etl::dim<2>(errors), etl::dim<3>(errors), etl::dim<0>(w), 0, ws);
+            return;
+        }
+    }
+
+    if (algorithm == conv_algorithm::PER_SAMPLE) {
+        dll::grouped_conv_forward(errors, w, output, 1, 0, 0);
+    } else {
+        output = etl::conv_4d_valid_flipped(errors, w);
+    }
+}
+
+} //end of namespace dll
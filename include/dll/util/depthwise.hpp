@@ -0,0 +1,223 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Kernels of the depthwise-separable convolutional layers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <thread>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Call functor(first, last) on chunks of [0, n), on the scoped
+ * thread pool if there is one.
+ */
+template <typename Functor>
+void depthwise_chunks(size_t n, Functor&& functor) {
+    auto* pool = scoped_thread_pool();
+
+    if (pool && n > 1) {
+        const size_t chunks = std::min(n, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&functor, n, chunks](size_t c) {
+            functor((c * n) / chunks, ((c + 1) * n) / chunks);
+        });
+    } else {
+        functor(0, n);
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Compute the valid per-channel convolution of a batch of input,
+ * each channel with its own filter.
+ *
+ * The inner loop runs over a contiguous output row for each filter
+ * coefficient, so that it is vectorized by the compiler.
+ *
+ * \param input The input (B x C x H x W)
+ * \param w The filters (C x NW1 x NW2)
+ * \param output The output (B x C x (H - NW1 + 1) x (W - NW2 + 1))
+ */
+template <typename T>
+void depthwise_forward(const T* input, const T* w, T* output, size_t B, size_t C, size_t H, size_t W, size_t NW1, size_t NW2) {
+    const size_t HO = H - NW1 + 1;
+    const size_t WO = W - NW2 + 1;
+
+    detail::depthwise_chunks(B * C, [=](size_t first, size_t last) {
+        for (size_t bc = first; bc < last; ++bc) {
+            const T* in  = input + bc * H * W;
+            const T* w_c = w + (bc % C) * NW1 * NW2;
+            T* out       = output + bc * HO * WO;
+
+            std::fill(out, out + HO * WO, T(0));
+
+            for (size_t ki = 0; ki < NW1; ++ki) {
+                for (size_t kj = 0; kj < NW2; ++kj) {
+                    const T wv = w_c[ki * NW2 + kj];
+
+                    for (size_t i = 0; i < HO; ++i) {
+                        const T* in_row = in + (i + ki) * W + kj;
+                        T* out_row      = out + i * WO;
+
+                        for (size_t j = 0; j < WO; ++j) {
+                            out_row[j] += wv * in_row[j];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute the gradients of the input of the per-channel
+ * convolution.
+ * \param errors The errors of the output (B x C x (H - NW1 + 1) x (W - NW2 + 1))
+ * \param w The filters (C x NW1 x NW2)
+ * \param output The gradients of the input (B x C x H x W)
+ */
+template <typename T>
+void depthwise_backward(const T* errors, const T* w, T* output, size_t B, size_t C, size_t H, size_t W, size_t NW1, size_t NW2) {
+    const size_t HO = H - NW1 + 1;
+    const size_t WO = W - NW2 + 1;
+
+    detail::depthwise_chunks(B * C, [=](size_t first, size_t last) {
+        for (size_t bc = first; bc < last; ++bc) {
+            const T* e   = errors + bc * HO * WO;
+            const T* w_c = w + (bc % C) * NW1 * NW2;
+            T* out       = output + bc * H * W;
+
+            std::fill(out, out + H * W, T(0));
+
+            for (size_t ki = 0; ki < NW1; ++ki) {
+                for (size_t kj = 0; kj < NW2; ++kj) {
+                    const T wv = w_c[ki * NW2 + kj];
+
+                    for (size_t i = 0; i < HO; ++i) {
+                        const T* e_row = e + i * WO;
+                        T* out_row     = out + (i + ki) * W + kj;
+
+                        for (size_t j = 0; j < WO; ++j) {
+                            out_row[j] += wv * e_row[j];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute the gradients of the filters of the per-channel
+ * convolution. The channels are processed in parallel, each one reducing
+ * over the whole batch.
+ * \param input The input (B x C x H x W)
+ * \param errors The errors of the output (B x C x (H - NW1 + 1) x (W - NW2 + 1))
+ * \param grad The gradients of the filters (C x NW1 x NW2)
+ */
+template <typename T>
+void depthwise_backward_filter(const T* input, const T* errors, T* grad, size_t B, size_t C, size_t H, size_t W, size_t NW1, size_t NW2) {
+    const size_t HO = H - NW1 + 1;
+    const size_t WO = W - NW2 + 1;
+
+    detail::depthwise_chunks(C, [=](size_t first, size_t last) {
+        for (size_t c = first; c < last; ++c) {
+            T* grad_c = grad + c * NW1 * NW2;
+
+            std::fill(grad_c, grad_c + NW1 * NW2, T(0));
+
+            for (size_t b = 0; b < B; ++b) {
+                const T* in = input + (b * C + c) * H * W;
+                const T* e  = errors + (b * C + c) * HO * WO;
+
+                for (size_t ki = 0; ki < NW1; ++ki) {
+                    for (size_t kj = 0; kj < NW2; ++kj) {
+                        T acc = 0;
+
+                        for (size_t i = 0; i < HO; ++i) {
+                            const T* in_row = in + (i + ki) * W + kj;
+                            const T* e_row  = e + i * WO;
+
+                            for (size_t j = 0; j < WO; ++j) {
+                                acc += in_row[j] * e_row[j];
+                            }
+                        }
+
+                        grad_c[ki * NW2 + kj] += acc;
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute the pointwise (1x1) convolution of a batch, as one GEMM
+ * per sample: output(b) (K x S) = u (K x C) * input(b) (C x S)
+ * \param input The input (B x C x S)
+ * \param u The pointwise weights (K x C)
+ * \param output The output (B x K x S)
+ */
+template <typename T, typename U>
+void pointwise_forward(const T* input, const U& u, T* output, size_t B, size_t C, size_t K, size_t S) {
+    for (size_t b = 0; b < B; ++b) {
+        etl::custom_dyn_matrix<T, 2> out_b(output + b * K * S, K, S);
+
+        out_b = u * etl::custom_dyn_matrix<T, 2>(const_cast<T*>(input + b * C * S), C, S);
+    }
+}
+
+/*!
+ * \brief Compute the gradients of the input of the pointwise convolution:
+ * output(b) (C x S) = trans(u) (C x K) * errors(b) (K x S)
+ * \param errors The errors (B x K x S)
+ * \param u The pointwise weights (K x C)
+ * \param output The gradients of the input (B x C x S)
+ */
+template <typename T, typename U>
+void pointwise_backward(const T* errors, const U& u, T* output, size_t B, size_t C, size_t K, size_t S) {
+    for (size_t b = 0; b < B; ++b) {
+        etl::custom_dyn_matrix<T, 2> out_b(output + b * C * S, C, S);
+
+        out_b = etl::trans(u) * etl::custom_dyn_matrix<T, 2>(const_cast<T*>(errors + b * K * S), K, S);
+    }
+}
+
+/*!
+ * \brief Compute the gradients of the pointwise weights, accumulated over
+ * the batch: grad (K x C) = sum(errors(b) (K x S) * trans(input(b)) (S x C))
+ * \param input The input (B x C x S)
+ * \param errors The errors (B x K x S)
+ * \param grad The gradients of the pointwise weights (K x C)
+ */
+template <typename T, typename G>
+void pointwise_backward_filter(const T* input, const T* errors, G& grad, size_t B, size_t C, size_t K, size_t S) {
+    grad = T(0);
+
+    for (size_t b = 0; b < B; ++b) {
+        etl::custom_dyn_matrix<T, 2> e_b(const_cast<T*>(errors + b * K * S), K, S);
+        etl::custom_dyn_matrix<T, 2> in_b(const_cast<T*>(input + b * C * S), C, S);
+
+        grad += e_b * etl::trans(in_b);
+    }
+}
+
+} //end of dll namespace
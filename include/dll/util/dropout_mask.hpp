@@ -0,0 +1,136 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Bit-packed masks of the dropout layers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/util/random.hpp"
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Call functor(first, last) on chunks of [0, n), on the scoped
+ * thread pool if there is one.
+ */
+template <typename Functor>
+void dropout_chunks(size_t n, Functor&& functor) {
+    auto* pool = scoped_thread_pool();
+
+    if (pool && n > 1) {
+        const size_t chunks = std::min(n, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&functor, n, chunks](size_t c) {
+            functor((c * n) / chunks, ((c + 1) * n) / chunks);
+        });
+    } else {
+        functor(0, n);
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Inverted dropout mask, with one bit per value (1 for the kept
+ * values), 32 times smaller than a mask of float values.
+ *
+ * The bits are generated from a counter-based hash of a key drawn from
+ * the engine of the layer, which is independent for each word of the mask
+ * and can be vectorized and split across threads.
+ */
+struct dropout_mask {
+    std::vector<uint64_t> bits; ///< The bits of the mask
+    size_t n    = 0;            ///< The number of values of the mask
+    float scale = 1.0f;         ///< The scale of the kept values
+
+    /*!
+     * \brief Generate a new mask
+     * \param engine The random engine of the layer
+     * \param size The number of values
+     * \param p The probability of dropping a value
+     */
+    void generate(random_engine& engine, size_t size, float p) {
+        n     = size;
+        scale = 1.0f / (1.0f - p);
+
+        bits.resize((n + 63) / 64);
+
+        const uint64_t key       = (uint64_t(engine()) << 32) ^ uint64_t(engine());
+        const uint64_t threshold = uint64_t(double(p) * 4294967296.0);
+
+        uint64_t* b_p = bits.data();
+
+        detail::dropout_chunks(bits.size(), [b_p, key, threshold](size_t first, size_t last) {
+            for (size_t w = first; w < last; ++w) {
+                uint64_t word = 0;
+
+                // Each hash gives the uniform values of two bits
+                for (size_t j = 0; j < 32; ++j) {
+                    const uint64_t r = detail::mix_bits(key + w * 32 + j);
+
+                    word |= uint64_t((r & 0xFFFFFFFFULL) >= threshold) << (2 * j);
+                    word |= uint64_t((r >> 32) >= threshold) << (2 * j + 1);
+                }
+
+                b_p[w] = word;
+            }
+        });
+    }
+
+    /*!
+     * \brief Apply the mask: output = input * mask * scale
+     * \param output The output, with direct memory access
+     * \param input The input, with direct memory access
+     */
+    template <typename Output, typename Input>
+    void apply(Output&& output, const Input& input) const {
+        using T = etl::value_t<Input>;
+
+        cpp_assert(etl::size(input) == n, "The mask does not match the input");
+        cpp_assert(etl::size(output) == n, "The mask does not match the output");
+
+        input.ensure_cpu_up_to_date();
+
+        const T* in_p       = input.memory_start();
+        T* out_p            = output.memory_start();
+        const uint64_t* b_p = bits.data();
+
+        const T s      = T(scale);
+        const size_t N = n;
+
+        detail::dropout_chunks(bits.size(), [=](size_t first, size_t last) {
+            for (size_t w = first; w < last; ++w) {
+                const uint64_t word = b_p[w];
+                const size_t end    = std::min(N, (w + 1) * 64);
+
+                for (size_t i = w * 64; i < end; ++i) {
+                    out_p[i] = in_p[i] * (s * T((word >> (i % 64)) & 1));
+                }
+            }
+        });
+
+        output.invalidate_gpu();
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,92 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Dispatch of the weights of the dynamic layers to compile-time
+ * shapes
+ */
+
+#pragma once
+
+#include <utility>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A compile-time shape of the weights of a layer
+ */
+template <size_t V, size_t H>
+struct dyn_shape {
+    static constexpr size_t visible = V; ///< The number of visible units
+    static constexpr size_t hidden  = H; ///< The number of hidden units
+};
+
+/*!
+ * \brief A list of compile-time shapes
+ */
+template <typename... Shapes>
+struct dyn_shapes {
+    static constexpr size_t size = sizeof...(Shapes); ///< The number of shapes
+
+    /*!
+     * \brief Returns the index of the shape (v, h) in the list, or size if
+     * it is not part of the list
+     */
+    static constexpr size_t find(size_t v, size_t h) {
+        constexpr size_t visibles[] = {Shapes::visible..., 0};
+        constexpr size_t hiddens[]  = {Shapes::hidden..., 0};
+
+        for (size_t i = 0; i < size; ++i) {
+            if (visibles[i] == v && hiddens[i] == h) {
+                return i;
+            }
+        }
+
+        return size;
+    }
+
+    /*!
+     * \brief Call functor with a view of the weights with the compile-time
+     * shape of the given index, or with the weights themselves if the
+     * index is not part of the list.
+     * \param index The index of the shape
+     * \param w The weights
+     * \param functor The functor to call
+     */
+    template <typename W, typename Functor>
+    static void dispatch(size_t index, W& w, Functor&& functor) {
+        dispatch_impl(index, w, functor, std::index_sequence_for<Shapes...>{});
+    }
+
+private:
+    template <typename W, typename Functor, size_t... I>
+    static void dispatch_impl(size_t index, W& w, Functor& functor, std::index_sequence<I...> /*seq*/) {
+        bool done = false;
+
+        ((!done && index == I ? (functor(etl::reshape<Shapes::visible, Shapes::hidden>(w)), done = true) : false), ...);
+
+        if (!done) {
+            functor(w);
+        }
+    }
+};
+
+/*!
+ * \brief The shapes of the weights of the dynamic layers that are
+ * dispatched to compile-time kernels, the most common ones of the MNIST
+ * and CIFAR networks.
+ */
+using default_dyn_shapes = dyn_shapes<
+    dyn_shape<784, 100>, dyn_shape<784, 200>, dyn_shape<784, 300>, dyn_shape<784, 500>, dyn_shape<784, 1000>,
+    dyn_shape<100, 10>, dyn_shape<200, 10>, dyn_shape<300, 10>, dyn_shape<500, 10>, dyn_shape<1000, 10>,
+    dyn_shape<500, 500>, dyn_shape<500, 1000>, dyn_shape<1000, 1000>, dyn_shape<500, 2000>, dyn_shape<2000, 10>,
+    dyn_shape<3072, 1000>>;
+
+} //end of dll namespace
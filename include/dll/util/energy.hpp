@@ -0,0 +1,77 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Reductions for the batched energy computations of the RBMs
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Returns the sum of softplus(x) = log(1 + e^x) over the given
+ * values.
+ *
+ * This uses the stable form max(x, 0) + log(1 + e^-|x|), which does not
+ * overflow for large activations.
+ *
+ * \param x The values
+ * \param n The number of values
+ */
+template <typename T>
+double softplus_sum(const T* x, size_t n) {
+    double sum = 0.0;
+
+    for (size_t i = 0; i < n; ++i) {
+        const T a = x[i];
+
+        sum += std::max(a, T(0)) + std::log1p(std::exp(-std::abs(a)));
+    }
+
+    return sum;
+}
+
+/*!
+ * \brief Returns the sum of functor(first, last) over chunks of the rows
+ * [0, n), computed on the scoped thread pool if there is one.
+ *
+ * \param n The number of rows
+ * \param functor The functor computing the sum of a range of rows
+ */
+template <typename Functor>
+double parallel_rows_sum(size_t n, Functor functor) {
+    auto* pool = scoped_thread_pool();
+
+    if (pool && n > 1) {
+        const size_t chunks = std::min(n, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+        std::vector<double> sums(chunks, 0.0);
+
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&sums, &functor, n, chunks](size_t c) {
+            SERIAL_SECTION {
+                sums[c] = functor((c * n) / chunks, ((c + 1) * n) / chunks);
+            }
+        });
+
+        return std::accumulate(sums.begin(), sums.end(), 0.0);
+    }
+
+    return functor(0, n);
+}
+
+} //end of dll namespace
@@ -0,0 +1,152 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused bias and activation epilogues of the forward kernels
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "etl/etl.hpp"
+
+#include "dll/function.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Indicates if the activation function can be fused with the bias
+ * in one pass over the output (element-wise functions only).
+ */
+template <function F>
+constexpr bool fused_epilogue = F != function::SOFTMAX;
+
+namespace detail {
+
+/*!
+ * \brief Apply the element-wise activation function F on one value
+ */
+template <function F, typename T>
+inline T activate_value(T v) {
+    if constexpr (F == function::SIGMOID) {
+        return T(1) / (T(1) + std::exp(-v));
+    } else if constexpr (F == function::TANH) {
+        return std::tanh(v);
+    } else if constexpr (F == function::RELU) {
+        return std::max(T(0), v);
+    } else {
+        return v;
+    }
+}
+
+/*!
+ * \brief Add the bias to the n values and apply F on them, in place
+ */
+template <function F, typename T>
+inline void bias_activate(T* out, size_t n, T bias) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = activate_value<F>(out[i] + bias);
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Add the biases to a batch of convolution output (B x K x ...) and
+ * apply the activation function F, in one pass over the output, each
+ * feature map being finished while it is still in cache.
+ * \param output The output of the convolution, with direct memory access
+ * \param b The biases, one per feature map
+ */
+template <function F, typename O, typename B>
+void bias_activate_4d(O&& output, const B& b) {
+    static_assert(fused_epilogue<F>, "Only element-wise functions can be fused");
+
+    output.ensure_cpu_up_to_date();
+    b.ensure_cpu_up_to_date();
+
+    auto* out       = output.memory_start();
+    const auto* b_p = b.memory_start();
+
+    const size_t B_ = etl::dim<0>(output);
+    const size_t K  = etl::dim<1>(output);
+    const size_t S  = etl::size(output) / (B_ * K);
+
+    for (size_t i = 0; i < B_; ++i) {
+        for (size_t k = 0; k < K; ++k) {
+            detail::bias_activate<F>(out + (i * K + k) * S, S, b_p[k]);
+        }
+    }
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Add the biases to a batch of dense output (B x N) and apply the
+ * activation function F, in one pass over the output.
+ * \param output The output of the layer, with direct memory access
+ * \param b The biases, one per output
+ */
+template <function F, typename O, typename B>
+void bias_activate_2d(O&& output, const B& b) {
+    static_assert(fused_epilogue<F>, "Only element-wise functions can be fused");
+
+    output.ensure_cpu_up_to_date();
+    b.ensure_cpu_up_to_date();
+
+    auto* out       = output.memory_start();
+    const auto* b_p = b.memory_start();
+
+    const size_t B_ = etl::dim<0>(output);
+    const size_t N  = etl::size(output) / B_;
+
+    for (size_t i = 0; i < B_; ++i) {
+        auto* out_i = out + i * N;
+
+        for (size_t j = 0; j < N; ++j) {
+            out_i[j] = detail::activate_value<F>(out_i[j] + b_p[j]);
+        }
+    }
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Add the biases to the last dimension of a batch of output
+ * (... x N), with the channels last, and apply the activation function F,
+ * in one pass over the output.
+ * \param output The output of the layer, with direct memory access
+ * \param b The biases, one per channel
+ */
+template <function F, typename O, typename B>
+void bias_activate_last(O&& output, const B& b) {
+    static_assert(fused_epilogue<F>, "Only element-wise functions can be fused");
+
+    output.ensure_cpu_up_to_date();
+    b.ensure_cpu_up_to_date();
+
+    auto* out       = output.memory_start();
+    const auto* b_p = b.memory_start();
+
+    const size_t N    = etl::size(b);
+    const size_t rows = etl::size(output) / N;
+
+    for (size_t i = 0; i < rows; ++i) {
+        auto* out_i = out + i * N;
+
+        for (size_t j = 0; j < N; ++j) {
+            out_i[j] = detail::activate_value<F>(out_i[j] + b_p[j]);
+        }
+    }
+
+    output.invalidate_gpu();
+}
+
+} //end of dll namespace
@@ -0,0 +1,79 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Keep large buffers (weights, states of the updater, contexts)
+ * resident on the GPU during the training.
+ *
+ * Without GPU support in ETL, nothing is uploaded.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <tuple>
+
+#include "dll/util/memory.hpp" // For the traits of memory_bytes
+
+namespace dll {
+
+#ifdef ETL_GPU
+constexpr bool gpu_enabled = true; ///< Indicates if ETL computes on a GPU
+#else
+constexpr bool gpu_enabled = false; ///< Indicates if ETL computes on a GPU
+#endif
+
+/*!
+ * \brief Upload the values held by the given object to the GPU, where they
+ * are kept up to date: ETL containers, owning pointers, vectors and tuples
+ * of them. The other types are left alone.
+ *
+ * \return the number of bytes uploaded, 0 without GPU support
+ */
+template <typename T>
+size_t upload_gpu([[maybe_unused]] const T& value) {
+    if constexpr (!gpu_enabled) {
+        return 0;
+    } else if constexpr (etl::is_etl_value<T>) {
+        value.ensure_gpu_up_to_date();
+
+        return etl::size(value) * sizeof(etl::value_t<T>);
+    } else if constexpr (detail::is_owning_ptr<T>::value) {
+        return value ? upload_gpu(*value) : 0;
+    } else if constexpr (detail::is_std_vector<T>::value) {
+        size_t bytes = 0;
+
+        if constexpr (!std::is_arithmetic<typename T::value_type>::value) {
+            for (auto& v : value) {
+                bytes += upload_gpu(v);
+            }
+        }
+
+        return bytes;
+    } else if constexpr (detail::is_std_tuple<T>::value) {
+        return std::apply([](auto&... v) { return (size_t(0) + ... + upload_gpu(v)); }, value);
+    } else {
+        return 0;
+    }
+}
+
+/*!
+ * \brief Upload the parameters of the given layer to the GPU
+ *
+ * \return the number of bytes uploaded, 0 without GPU support
+ */
+template <typename Layer>
+size_t upload_layer_gpu(const Layer& layer) {
+    if constexpr (detail::has_trainable_parameters<Layer>::value) {
+        return upload_gpu(layer.trainable_parameters());
+    } else {
+        return 0;
+    }
+}
+
+} //end of namespace dll
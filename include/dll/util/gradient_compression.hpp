@@ -0,0 +1,275 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Compression of the gradients summed over the ranks of a
+ * distributed training
+ *
+ * A compressed reduction encodes the gradients of the rank, gathers the
+ * encoded gradients of all the ranks (distributed_transport::allgather)
+ * and sums their decoded values. The top-k and sign encodings keep the
+ * part of the gradients that was not sent (error feedback) and add it to
+ * the gradients of the next reduction.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "dll/util/bfloat16.hpp"
+#include "dll/util/model_file.hpp" // For float_to_half and half_to_float
+#include "dll/util/timers.hpp"
+#include "dll/util/transport.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The encoding of the gradients of a variable for their reduction
+ * over the ranks
+ */
+enum class gradient_codec {
+    NONE, ///< The gradients are summed in full precision
+    FP16, ///< The gradients are sent in IEEE half precision
+    BF16, ///< The gradients are sent in bfloat16
+    TOPK, ///< Only the largest gradients are sent, with their index, the others are kept for the next reduction
+    SIGN  ///< Only the signs of the gradients are sent, with their mean magnitude, the error is kept for the next reduction
+};
+
+/*!
+ * \brief The compression of the gradients of a distributed training, and
+ * the counters of the achieved compression.
+ */
+struct gradient_compression_policy {
+    gradient_codec codec = gradient_codec::NONE; ///< The encoding of the layers without their own
+    double topk_ratio    = 0.01;                 ///< The ratio of the gradients sent by the TOPK encoding
+    size_t min_size      = 1024;                 ///< The smaller variables (the biases for instance) are always summed in full precision
+
+    std::map<size_t, gradient_codec> layers; ///< The encodings of the layers with their own, by index
+
+    size_t raw_bytes  = 0; ///< The size of the compressed gradients, in full precision
+    size_t sent_bytes = 0; ///< The size of the compressed gradients, as sent
+
+    /*!
+     * \brief Set the encoding of the variables of the given layer
+     */
+    void set_layer(size_t layer, gradient_codec layer_codec) {
+        layers[layer] = layer_codec;
+    }
+
+    /*!
+     * \brief Returns the encoding of a variable of the given layer with the
+     * given number of gradients
+     */
+    gradient_codec select(size_t layer, size_t size) const {
+        if (size < min_size) {
+            return gradient_codec::NONE;
+        }
+
+        auto it = layers.find(layer);
+
+        return it == layers.end() ? codec : it->second;
+    }
+
+    /*!
+     * \brief Returns the achieved compression ratio of the compressed
+     * variables (1 if none has been compressed)
+     */
+    double ratio() const {
+        return sent_bytes ? double(raw_bytes) / double(sent_bytes) : 1.0;
+    }
+};
+
+namespace detail {
+
+constexpr size_t topk_entry = sizeof(uint32_t) + sizeof(float); ///< The size of one gradient of the TOPK encoding, with its index
+
+/*!
+ * \brief Returns the number of gradients sent by the TOPK encoding of n
+ * gradients
+ */
+inline size_t topk_count(size_t n, double ratio) {
+    return std::min(n, std::max(size_t(1), size_t(std::ceil(n * ratio))));
+}
+
+/*!
+ * \brief Returns the size, in bytes, of the encoding of n gradients
+ */
+inline size_t encoded_bytes(gradient_codec codec, size_t n, size_t k) {
+    switch (codec) {
+        case gradient_codec::FP16:
+        case gradient_codec::BF16:
+            return n * sizeof(uint16_t);
+        case gradient_codec::TOPK:
+            return k * topk_entry;
+        case gradient_codec::SIGN:
+            return sizeof(float) + (n + 7) / 8;
+        default:
+            return n * sizeof(float);
+    }
+}
+
+/*!
+ * \brief Encode the n gradients. The residual of the top-k and sign
+ * encodings is added to the gradients before their encoding and is
+ * replaced by the part of the gradients that was not sent.
+ */
+template <typename T>
+void encode_gradients(gradient_codec codec, const T* grad, T* residual, size_t n, size_t k, uint8_t* out) {
+    if (codec == gradient_codec::FP16 || codec == gradient_codec::BF16) {
+        for (size_t i = 0; i < n; ++i) {
+            const uint16_t bits = codec == gradient_codec::FP16 ? float_to_half(float(grad[i])) : bfloat16(float(grad[i])).bits;
+            std::memcpy(out + i * sizeof(uint16_t), &bits, sizeof(uint16_t));
+        }
+    } else if (codec == gradient_codec::TOPK) {
+        for (size_t i = 0; i < n; ++i) {
+            residual[i] += grad[i];
+        }
+
+        std::vector<uint32_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+
+        std::nth_element(order.begin(), order.begin() + (k - 1), order.end(), [residual](uint32_t a, uint32_t b) {
+            return std::abs(residual[a]) > std::abs(residual[b]);
+        });
+
+        for (size_t j = 0; j < k; ++j) {
+            const uint32_t i = order[j];
+            const float v    = residual[i];
+
+            std::memcpy(out + j * topk_entry, &i, sizeof(uint32_t));
+            std::memcpy(out + j * topk_entry + sizeof(uint32_t), &v, sizeof(float));
+
+            residual[i] -= T(v);
+        }
+    } else {
+        double magnitude = 0.0;
+
+        for (size_t i = 0; i < n; ++i) {
+            residual[i] += grad[i];
+            magnitude += std::abs(residual[i]);
+        }
+
+        const float scale = magnitude / n;
+
+        std::memcpy(out, &scale, sizeof(float));
+        std::fill(out + sizeof(float), out + sizeof(float) + (n + 7) / 8, uint8_t(0));
+
+        for (size_t i = 0; i < n; ++i) {
+            if (residual[i] < T(0)) {
+                out[sizeof(float) + i / 8] |= uint8_t(1u << (i % 8));
+                residual[i] += T(scale);
+            } else {
+                residual[i] -= T(scale);
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Add the decoded values of the given encoded gradients to the n
+ * gradients
+ */
+template <typename T>
+void decode_add_gradients(gradient_codec codec, const uint8_t* in, size_t n, size_t k, T* grad) {
+    if (codec == gradient_codec::FP16 || codec == gradient_codec::BF16) {
+        for (size_t i = 0; i < n; ++i) {
+            uint16_t bits;
+            std::memcpy(&bits, in + i * sizeof(uint16_t), sizeof(uint16_t));
+
+            if (codec == gradient_codec::FP16) {
+                grad[i] += half_to_float(bits);
+            } else {
+                bfloat16 value;
+                value.bits = bits;
+                grad[i] += float(value);
+            }
+        }
+    } else if (codec == gradient_codec::TOPK) {
+        for (size_t j = 0; j < k; ++j) {
+            uint32_t i;
+            float v;
+
+            std::memcpy(&i, in + j * topk_entry, sizeof(uint32_t));
+            std::memcpy(&v, in + j * topk_entry + sizeof(uint32_t), sizeof(float));
+
+            grad[i] += v;
+        }
+    } else {
+        float scale;
+        std::memcpy(&scale, in, sizeof(float));
+
+        for (size_t i = 0; i < n; ++i) {
+            const bool negative = in[sizeof(float) + i / 8] & (1u << (i % 8));
+            grad[i] += negative ? -scale : scale;
+        }
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Sum the given gradients over all the ranks, in place, with the
+ * given (compressing) encoding.
+ *
+ * The encoding and the decoding are timed as "sgd::compress:encode" and
+ * "sgd::compress:decode" and the sizes of the gradients, in full precision
+ * and encoded, are added to the counters of the policy.
+ *
+ * \param transport The transport
+ * \param policy The compression policy, for the TOPK ratio and the counters
+ * \param codec The encoding of the gradients, not NONE
+ * \param grad The gradients of this rank, replaced by the sum
+ * \param n The number of gradients
+ * \param residual The residual of the error feedback of these gradients, resized if necessary
+ */
+template <typename T>
+void compressed_allreduce(distributed_transport& transport, gradient_compression_policy& policy, gradient_codec codec, T* grad, size_t n, std::vector<T>& residual) {
+    cpp_assert(codec != gradient_codec::NONE, "The gradients must be compressed");
+
+    const size_t k     = detail::topk_count(n, policy.topk_ratio);
+    const size_t bytes = detail::encoded_bytes(codec, n, k);
+    const size_t ranks = transport.size();
+
+    if (residual.size() != n) {
+        residual.assign(n, T(0));
+    }
+
+    std::vector<uint8_t> encoded(bytes);
+    std::vector<uint8_t> gathered(bytes * ranks);
+
+    {
+        dll::auto_timer timer("sgd::compress:encode");
+
+        detail::encode_gradients(codec, grad, residual.data(), n, k, encoded.data());
+    }
+
+    transport.allgather(encoded.data(), bytes, gathered.data());
+
+    {
+        dll::auto_timer timer("sgd::compress:decode");
+
+        std::fill(grad, grad + n, T(0));
+
+        for (size_t r = 0; r < ranks; ++r) {
+            detail::decode_add_gradients(codec, gathered.data() + r * bytes, n, k, grad);
+        }
+    }
+
+    policy.raw_bytes += n * sizeof(T);
+    policy.sent_bytes += bytes;
+}
+
+} //end of dll namespace
@@ -0,0 +1,172 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Kernels of the grouped convolutional layers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <thread>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+#include "dll/util/workspace.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief The number of chunks of the given number of tasks
+ */
+inline size_t grouped_chunk_count(size_t n) {
+    if (!scoped_thread_pool() || n < 2) {
+        return 1;
+    }
+
+    return std::min(n, size_t(std::max(1u, std::thread::hardware_concurrency())));
+}
+
+/*!
+ * \brief Call functor(c, first, last) on the grouped_chunk_count(n) chunks
+ * of [0, n), on the scoped thread pool if there is one. Each chunk runs its
+ * ETL kernels serially.
+ */
+template <typename Functor>
+void grouped_chunks(size_t n, Functor&& functor) {
+    auto* pool = scoped_thread_pool();
+
+    const size_t chunks = grouped_chunk_count(n);
+
+    if (pool && chunks > 1) {
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&functor, n, chunks](size_t c) {
+            SERIAL_SECTION {
+                functor(c, (c * n) / chunks, ((c + 1) * n) / chunks);
+            }
+        });
+    } else {
+        functor(0, 0, n);
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Compute the grouped convolution of a batch of input.
+ *
+ * The channels of each sample and the filters are split in G groups, the
+ * filters of a group only seeing the channels of the same group. The
+ * (sample, group) pairs are contiguous views of the input and of the
+ * output and are computed independently, in parallel.
+ *
+ * \param input The input (B x C x H x W)
+ * \param w The filters (K x C / G x NW1 x NW2)
+ * \param output The output (B x K x HO x WO)
+ * \param groups The number of groups
+ * \param p1 The first padding
+ * \param p2 The second padding
+ */
+template <typename I, typename W, typename O>
+void grouped_conv_forward(const I& input, const W& w, O&& output, size_t groups, size_t p1, size_t p2) {
+    const size_t B  = etl::dim<0>(input);
+    const size_t CG = etl::dim<1>(input) / groups;
+    const size_t KG = etl::dim<0>(w) / groups;
+
+    detail::grouped_chunks(B * groups, [&](size_t /*c*/, size_t first, size_t last) {
+        for (size_t bg = first; bg < last; ++bg) {
+            const size_t b = bg / groups;
+            const size_t g = bg % groups;
+
+            auto in_g  = etl::slice(input(b), g * CG, (g + 1) * CG);
+            auto out_g = etl::slice(output(b), g * KG, (g + 1) * KG);
+
+            etl::reshape(out_g, 1, KG, etl::dim<1>(out_g), etl::dim<2>(out_g)) = etl::ml::convolution_forward(
+                etl::reshape(in_g, 1, CG, etl::dim<1>(in_g), etl::dim<2>(in_g)), etl::slice(w, g * KG, (g + 1) * KG), 1, 1, p1, p2);
+        }
+    });
+}
+
+/*!
+ * \brief Compute the gradients of the input of the grouped convolution
+ * \param errors The errors of the output (B x K x HO x WO)
+ * \param w The filters (K x C / G x NW1 x NW2)
+ * \param output The gradients of the input (B x C x H x W)
+ * \param groups The number of groups
+ * \param p1 The first padding
+ * \param p2 The second padding
+ */
+template <typename E, typename W, typename O>
+void grouped_conv_backward(const E& errors, const W& w, O&& output, size_t groups, size_t p1, size_t p2) {
+    const size_t B  = etl::dim<0>(errors);
+    const size_t CG = etl::dim<1>(output) / groups;
+    const size_t KG = etl::dim<0>(w) / groups;
+
+    detail::grouped_chunks(B * groups, [&](size_t /*c*/, size_t first, size_t last) {
+        for (size_t bg = first; bg < last; ++bg) {
+            const size_t b = bg / groups;
+            const size_t g = bg % groups;
+
+            auto e_g   = etl::slice(errors(b), g * KG, (g + 1) * KG);
+            auto out_g = etl::slice(output(b), g * CG, (g + 1) * CG);
+
+            etl::reshape(out_g, 1, CG, etl::dim<1>(out_g), etl::dim<2>(out_g)) = etl::ml::convolution_backward(
+                etl::reshape(e_g, 1, KG, etl::dim<1>(e_g), etl::dim<2>(e_g)), etl::slice(w, g * KG, (g + 1) * KG), 1, 1, p1, p2);
+        }
+    });
+}
+
+/*!
+ * \brief Compute the gradients of the filters of the grouped convolution.
+ *
+ * The groups are computed in parallel, each over the whole batch, so that
+ * no reduction is necessary. The channels of a group are gathered for the
+ * batch once, to use a single batched kernel per group.
+ *
+ * \param input The input (B x C x H x W)
+ * \param errors The errors of the output (B x K x HO x WO)
+ * \param grad The gradients of the filters (K x C / G x NW1 x NW2)
+ * \param groups The number of groups
+ * \param p1 The first padding
+ * \param p2 The second padding
+ * \param ws The workspace for the gathered channels (can be nullptr)
+ */
+template <typename I, typename E, typename G>
+void grouped_conv_backward_filter(const I& input, const E& errors, G&& grad, size_t groups, size_t p1, size_t p2, workspace* ws = nullptr) {
+    using T = etl::value_t<I>;
+
+    const size_t B  = etl::dim<0>(input);
+    const size_t CG = etl::dim<1>(input) / groups;
+    const size_t KG = etl::dim<1>(errors) / groups;
+
+    const size_t in_size = B * CG * etl::dim<2>(input) * etl::dim<3>(input);
+    const size_t e_size  = B * KG * etl::dim<2>(errors) * etl::dim<3>(errors);
+
+    const size_t chunks = detail::grouped_chunk_count(groups);
+
+    workspace_lease<T> tmp(ws, chunks * (in_size + e_size));
+
+    detail::grouped_chunks(groups, [&](size_t c, size_t first, size_t last) {
+        etl::custom_dyn_matrix<T, 4> in_g(tmp.data() + c * (in_size + e_size), B, CG, etl::dim<2>(input), etl::dim<3>(input));
+        etl::custom_dyn_matrix<T, 4> e_g(tmp.data() + c * (in_size + e_size) + in_size, B, KG, etl::dim<2>(errors), etl::dim<3>(errors));
+
+        for (size_t g = first; g < last; ++g) {
+            for (size_t b = 0; b < B; ++b) {
+                in_g(b) = etl::slice(input(b), g * CG, (g + 1) * CG);
+                e_g(b)  = etl::slice(errors(b), g * KG, (g + 1) * KG);
+            }
+
+            etl::slice(grad, g * KG, (g + 1) * KG) = etl::ml::convolution_backward_filter(in_g, e_g, 1, 1, p1, p2);
+        }
+    });
+}
+
+} //end of dll namespace
@@ -0,0 +1,138 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Back large buffers (weights, contexts, caches) with transparent
+ * huge pages, to reduce the misses of the TLB.
+ *
+ * On the other systems, or when the kernel does not support transparent
+ * huge pages, the buffers simply keep their normal pages.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <tuple>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "dll/util/memory.hpp" // For the traits of memory_bytes
+
+namespace dll {
+
+constexpr size_t huge_page_size = 2 * 1024 * 1024; ///< The size of a transparent huge page
+
+namespace detail {
+
+/*!
+ * \brief The number of bytes advised to be backed by huge pages
+ */
+inline std::atomic<size_t>& huge_pages_bytes() {
+    static std::atomic<size_t> bytes{0};
+    return bytes;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Returns the number of bytes advised so far to be backed by huge
+ * pages (and accepted by the kernel)
+ */
+inline size_t huge_pages_advised() {
+    return detail::huge_pages_bytes().load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Advise the kernel to back the huge pages fully inside the given
+ * buffer with transparent huge pages (MADV_HUGEPAGE).
+ *
+ * The pages of the buffer that are already touched are collapsed in the
+ * background by the kernel, the next ones are directly huge pages. The
+ * buffers smaller than a huge page are left alone.
+ *
+ * \param start The start of the buffer
+ * \param bytes The size of the buffer
+ * \return the number of bytes backed by huge pages, 0 if not supported
+ */
+inline size_t advise_huge_pages([[maybe_unused]] const void* start, [[maybe_unused]] size_t bytes) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    const size_t first = reinterpret_cast<size_t>(start);
+    const size_t begin = (first + huge_page_size - 1) / huge_page_size * huge_page_size;
+    const size_t end   = (first + bytes) / huge_page_size * huge_page_size;
+
+    if (end <= begin || ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE)) {
+        return 0;
+    }
+
+    detail::huge_pages_bytes() += end - begin;
+
+    return end - begin;
+#else
+    return 0;
+#endif
+}
+
+/*!
+ * \brief Advise the kernel to back the values held by the given object
+ * with transparent huge pages: ETL containers, owning pointers, vectors
+ * and tuples of them. The other types are left alone.
+ *
+ * \return the number of bytes backed by huge pages
+ */
+template <typename T>
+size_t advise_huge_pages(const T& value) {
+    if constexpr (etl::is_etl_value<T>) {
+        return advise_huge_pages(value.memory_start(), etl::size(value) * sizeof(etl::value_t<T>));
+    } else if constexpr (detail::is_owning_ptr<T>::value) {
+        return value ? advise_huge_pages(*value) : 0;
+    } else if constexpr (detail::is_std_vector<T>::value) {
+        if constexpr (std::is_arithmetic<typename T::value_type>::value) {
+            return advise_huge_pages(value.data(), value.size() * sizeof(typename T::value_type));
+        } else {
+            size_t bytes = 0;
+
+            for (auto& v : value) {
+                bytes += advise_huge_pages(v);
+            }
+
+            return bytes;
+        }
+    } else if constexpr (detail::is_std_tuple<T>::value) {
+        return std::apply([](auto&... v) { return (size_t(0) + ... + advise_huge_pages(v)); }, value);
+    } else {
+        return 0;
+    }
+}
+
+/*!
+ * \brief Advise the kernel to back the parameters of the given layer with
+ * transparent huge pages
+ *
+ * \return the number of bytes backed by huge pages
+ */
+template <typename Layer>
+size_t advise_layer_huge_pages(const Layer& layer) {
+    if constexpr (detail::has_trainable_parameters<Layer>::value) {
+        return advise_huge_pages(layer.trainable_parameters());
+    } else if constexpr (detail::has_wb<Layer>::value) {
+        size_t bytes = advise_huge_pages(layer.w) + advise_huge_pages(layer.b);
+
+        if constexpr (detail::has_c<Layer>::value) {
+            bytes += advise_huge_pages(layer.c);
+        }
+
+        return bytes;
+    } else {
+        return 0;
+    }
+}
+
+} //end of namespace dll
@@ -0,0 +1,45 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Execution context of the inference of a network on one thread
+ */
+
+#pragma once
+
+#include "dll/util/arena.hpp"
+#include "dll/util/workspace.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The per-call state of the inference of a network, to let several
+ * threads run the inference of the same network at the same time.
+ *
+ * The parameters of the network are shared, read-only, by all the
+ * contexts. Each context has its own workspace for the temporaries of the
+ * kernels of the layers and its own arena for the temporaries of each
+ * call. A context must only be used by one thread at a time.
+ */
+struct inference_context {
+    workspace arena;        ///< The workspace of the kernels of the layers
+    step_arena temporaries; ///< The temporaries of each call
+
+    /*!
+     * \brief Create a context with a workspace of the given size
+     * \param bytes The size of the workspace of the network
+     */
+    explicit inference_context(size_t bytes) {
+        arena.reserve(bytes);
+    }
+
+    inference_context(const inference_context& rhs) = delete;
+    inference_context& operator=(const inference_context& rhs) = delete;
+};
+
+} //end of dll namespace
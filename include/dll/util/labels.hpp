@@ -8,10 +8,18 @@
 #pragma once
 
 #include <iterator>
+#include <type_traits>
 #include <vector>
 
 namespace dll {
 
+/*!
+ * \brief Indicates if a batch of labels contains class indices instead of
+ * one-hot vectors (see dll::index_labels)
+ */
+template <typename Labels>
+constexpr bool is_index_labels = std::is_integral<etl::value_t<std::decay_t<Labels>>>::value;
+
 template <typename V>
 struct fake_label_array {
     using value_type = V;
@@ -0,0 +1,58 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Kernels of the recurrent last layers
+ *
+ * The last time step of each sample of a batch (B x TS x H) is a
+ * contiguous row of H values, the rows of the samples being TS * H values
+ * apart.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+namespace dll {
+
+/*!
+ * \brief Copy the last time step of each sample of the input into the output
+ * \param input The input (B x TS x H)
+ * \param output The output (B x H)
+ */
+template <typename T>
+void last_step_forward(const T* input, T* output, size_t B, size_t TS, size_t H) {
+    for (size_t b = 0; b < B; ++b) {
+        const T* last = input + (b * TS + TS - 1) * H;
+
+        std::copy(last, last + H, output + b * H);
+    }
+}
+
+/*!
+ * \brief Copy the errors of each sample into the last time step of the errors
+ * of the input.
+ * \param errors The errors of the output (B x H)
+ * \param output The errors of the input (B x TS x H)
+ * \param clear Indicates if the other time steps must be set to zero, or are
+ * never read
+ */
+template <typename T>
+void last_step_backward(const T* errors, T* output, size_t B, size_t TS, size_t H, bool clear) {
+    for (size_t b = 0; b < B; ++b) {
+        T* out = output + b * TS * H;
+
+        if (clear) {
+            std::fill(out, out + (TS - 1) * H, T(0));
+        }
+
+        std::copy(errors + b * H, errors + (b + 1) * H, out + (TS - 1) * H);
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,389 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Latency histograms of the inference, for serving
+ *
+ * The histograms are disabled by default and enabled at runtime with
+ * enable_latency_histograms(). When disabled, a latency_timer only reads
+ * one flag. The durations are recorded in logarithmic buckets, with 8
+ * linear sub-buckets per power of two (at most 12.5% of relative error),
+ * in per-thread shards of atomic counters, without any lock.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace dll {
+
+constexpr size_t latency_sub_bits       = 3;                                ///< The number of bits of the linear sub-buckets
+constexpr size_t latency_sub_buckets    = size_t(1) << latency_sub_bits;    ///< The number of sub-buckets per power of two
+constexpr size_t latency_buckets        = latency_sub_buckets * 46;         ///< The number of buckets (up to 2^48 ns)
+constexpr size_t latency_shards         = 8;                                ///< The number of per-thread shards of a histogram
+constexpr size_t max_latency_histograms = 64;                               ///< The maximum number of histograms
+
+namespace detail {
+
+/*!
+ * \brief Returns the bucket of the given duration, in nanoseconds
+ */
+inline size_t latency_bucket(uint64_t ns) {
+    if (ns < latency_sub_buckets) {
+        return ns;
+    }
+
+    size_t e = 63 - __builtin_clzll(ns);
+
+    const size_t sub    = (ns >> (e - latency_sub_bits)) & (latency_sub_buckets - 1);
+    const size_t bucket = latency_sub_buckets + (e - latency_sub_bits) * latency_sub_buckets + sub;
+
+    return std::min(bucket, latency_buckets - 1);
+}
+
+/*!
+ * \brief Returns the largest duration, in nanoseconds, of the given bucket
+ */
+inline uint64_t latency_bucket_max(size_t bucket) {
+    if (bucket < latency_sub_buckets) {
+        return bucket;
+    }
+
+    const size_t shift = (bucket - latency_sub_buckets) / latency_sub_buckets;
+    const size_t sub   = (bucket - latency_sub_buckets) % latency_sub_buckets;
+
+    return ((latency_sub_buckets + sub + 1) << shift) - 1;
+}
+
+/*!
+ * \brief Returns the shard of the histograms used by the current thread
+ */
+inline size_t latency_shard() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % latency_shards;
+    return shard;
+}
+
+/*!
+ * \brief Returns the flag enabling the latency histograms
+ */
+inline std::atomic<bool>& latency_enabled() {
+    static std::atomic<bool> enabled{false};
+    return enabled;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief A histogram of durations
+ */
+struct latency_histogram {
+    /*!
+     * \brief The counters of a group of threads, on their own cache lines
+     */
+    struct alignas(64) shard {
+        std::array<std::atomic<uint64_t>, latency_buckets> counts{}; ///< The number of durations in each bucket
+    };
+
+    const char* name;                           ///< The name of the histogram
+    std::array<shard, latency_shards> shards{}; ///< The counters
+
+    /*!
+     * \brief Create an empty histogram with the given name
+     */
+    explicit latency_histogram(const char* name) : name(name) {}
+
+    /*!
+     * \brief Record the given duration, in nanoseconds
+     */
+    void record(uint64_t ns) {
+        shards[detail::latency_shard()].counts[detail::latency_bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /*!
+     * \brief Returns the counters of all the shards
+     */
+    std::array<uint64_t, latency_buckets> merged() const {
+        std::array<uint64_t, latency_buckets> counts{};
+
+        for (auto& s : shards) {
+            for (size_t b = 0; b < latency_buckets; ++b) {
+                counts[b] += s.counts[b].load(std::memory_order_relaxed);
+            }
+        }
+
+        return counts;
+    }
+
+    /*!
+     * \brief Reset all the counters
+     */
+    void reset() {
+        for (auto& s : shards) {
+            for (auto& count : s.counts) {
+                count.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+/*!
+ * \brief The structure holding all the latency histograms
+ */
+struct latency_histograms_t {
+    std::array<std::atomic<latency_histogram*>, max_latency_histograms> histograms{}; ///< The histograms
+    std::mutex lock;                                                                   ///< The lock protecting the creation of histograms
+
+    latency_histograms_t() = default;
+
+    latency_histograms_t(const latency_histograms_t& rhs) = delete;
+    latency_histograms_t& operator=(const latency_histograms_t& rhs) = delete;
+
+    ~latency_histograms_t() {
+        for (auto& histogram : histograms) {
+            delete histogram.load();
+        }
+    }
+};
+
+/*!
+ * \brief Get a reference to the latency histograms
+ */
+inline latency_histograms_t& get_latency_histograms() {
+    static latency_histograms_t histograms;
+    return histograms;
+}
+
+/*!
+ * \brief Returns the histogram with the given name, created if necessary
+ * \param name The name of the histogram, which must outlive the program
+ * \return The histogram, or nullptr if there are too many histograms
+ */
+inline latency_histogram* get_latency_histogram(const char* name) {
+    auto& histograms = get_latency_histograms();
+
+    // Try to find it without the lock
+
+    for (auto& slot : histograms.histograms) {
+        auto* histogram = slot.load(std::memory_order_acquire);
+
+        if (!histogram) {
+            break;
+        }
+
+        if (histogram->name == name) {
+            return histogram;
+        }
+    }
+
+    std::lock_guard<std::mutex> l(histograms.lock);
+
+    for (auto& slot : histograms.histograms) {
+        auto* histogram = slot.load(std::memory_order_acquire);
+
+        if (!histogram) {
+            histogram = new latency_histogram(name);
+            slot.store(histogram, std::memory_order_release);
+            return histogram;
+        }
+
+        if (histogram->name == name) {
+            return histogram;
+        }
+    }
+
+    std::cerr << "Unable to register latency histogram " << name << std::endl;
+
+    return nullptr;
+}
+
+/*!
+ * \brief Enable or disable the recording of the latency histograms
+ */
+inline void enable_latency_histograms(bool enable = true) {
+    detail::latency_enabled().store(enable, std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Indicates if the latency histograms are recorded
+ */
+inline bool latency_histograms_enabled() {
+    return detail::latency_enabled().load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Reset all the latency histograms
+ */
+inline void reset_latency_histograms() {
+    for (auto& slot : get_latency_histograms().histograms) {
+        if (auto* histogram = slot.load(std::memory_order_acquire)) {
+            histogram->reset();
+        }
+    }
+}
+
+/*!
+ * \brief Record the lifetime of the timer in the histogram of the given
+ * name, when the latency histograms are enabled.
+ */
+struct latency_timer {
+    latency_histogram* histogram = nullptr;                   ///< The histogram, nullptr when disabled
+    std::chrono::time_point<std::chrono::steady_clock> start; ///< The start time
+
+    /*!
+     * \brief Start the timer of the given name
+     * \param name The name of the histogram, which must outlive the program
+     */
+    explicit latency_timer(const char* name) {
+        if (latency_histograms_enabled()) {
+            histogram = get_latency_histogram(name);
+            start     = std::chrono::steady_clock::now();
+        }
+    }
+
+    latency_timer(const latency_timer& rhs) = delete;
+    latency_timer& operator=(const latency_timer& rhs) = delete;
+
+    /*!
+     * \brief Record the duration since the start
+     */
+    ~latency_timer() {
+        if (histogram) {
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            histogram->record(uint64_t(duration));
+        }
+    }
+};
+
+/*!
+ * \brief The percentiles of a latency histogram, in nanoseconds
+ */
+struct latency_summary {
+    std::string name; ///< The name of the histogram
+    uint64_t count;   ///< The number of durations
+    uint64_t p50;     ///< The median
+    uint64_t p90;     ///< The 90th percentile
+    uint64_t p99;     ///< The 99th percentile
+    uint64_t p999;    ///< The 99.9th percentile
+    uint64_t max;     ///< The maximum
+};
+
+/*!
+ * \brief Returns the given quantile of the given counters, as the largest
+ * duration of the bucket containing it
+ */
+inline uint64_t latency_quantile(const std::array<uint64_t, latency_buckets>& counts, uint64_t total, double q) {
+    const uint64_t rank = std::max(uint64_t(1), uint64_t(q * total + 0.5));
+
+    uint64_t seen = 0;
+
+    for (size_t b = 0; b < latency_buckets; ++b) {
+        seen += counts[b];
+
+        if (seen >= rank) {
+            return detail::latency_bucket_max(b);
+        }
+    }
+
+    return 0;
+}
+
+/*!
+ * \brief Returns the percentiles of all the non-empty latency histograms
+ */
+inline std::vector<latency_summary> latency_summaries() {
+    std::vector<latency_summary> summaries;
+
+    for (auto& slot : get_latency_histograms().histograms) {
+        auto* histogram = slot.load(std::memory_order_acquire);
+
+        if (!histogram) {
+            break;
+        }
+
+        const auto counts = histogram->merged();
+
+        uint64_t total = 0;
+        size_t last    = 0;
+
+        for (size_t b = 0; b < latency_buckets; ++b) {
+            total += counts[b];
+            last = counts[b] ? b : last;
+        }
+
+        if (total) {
+            summaries.push_back({histogram->name, total,
+                                 latency_quantile(counts, total, 0.5), latency_quantile(counts, total, 0.9),
+                                 latency_quantile(counts, total, 0.99), latency_quantile(counts, total, 0.999),
+                                 detail::latency_bucket_max(last)});
+        }
+    }
+
+    return summaries;
+}
+
+/*!
+ * \brief Export the latency histograms in the Prometheus text format, as
+ * summaries in seconds.
+ */
+inline std::string export_latency_histograms() {
+    std::ostringstream out;
+
+    out << "# TYPE dll_latency_seconds summary\n";
+
+    for (auto& summary : latency_summaries()) {
+        std::string name;
+
+        for (char c : summary.name) {
+            if (c == '"' || c == '\\') {
+                name += '\\';
+            }
+
+            name += c;
+        }
+
+        auto quantile = [&](const char* q, uint64_t ns) {
+            out << "dll_latency_seconds{name=\"" << name << "\",quantile=\"" << q << "\"} " << ns * 1e-9 << "\n";
+        };
+
+        quantile("0.5", summary.p50);
+        quantile("0.9", summary.p90);
+        quantile("0.99", summary.p99);
+        quantile("0.999", summary.p999);
+        quantile("1", summary.max);
+
+        out << "dll_latency_seconds_count{name=\"" << name << "\"} " << summary.count << "\n";
+    }
+
+    return out.str();
+}
+
+/*!
+ * \brief Dump the percentiles of the latency histograms on the console
+ */
+inline void dump_latency_histograms() {
+    for (auto& summary : latency_summaries()) {
+        std::cout << summary.name << "(" << summary.count << ") :"
+                  << " p50=" << summary.p50 * 1e-3 << "us"
+                  << " p90=" << summary.p90 * 1e-3 << "us"
+                  << " p99=" << summary.p99 * 1e-3 << "us"
+                  << " p999=" << summary.p999 * 1e-3 << "us"
+                  << " max=" << summary.max * 1e-3 << "us" << std::endl;
+    }
+}
+
+} //end of dll namespace
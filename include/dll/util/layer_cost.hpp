@@ -0,0 +1,112 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Static estimates of the floating point operations and of the
+ * memory traffic of the layers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <type_traits>
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_traits.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The estimated cost of a layer for one batch
+ */
+struct layer_cost {
+    size_t forward_flops   = 0; ///< The operations of the forward pass
+    size_t backward_flops  = 0; ///< The operations of the propagation of the errors
+    size_t gradients_flops = 0; ///< The operations of the computation of the gradients
+    size_t forward_bytes   = 0; ///< The memory traffic of the forward pass
+    size_t backward_bytes  = 0; ///< The memory traffic of the backward pass (errors and gradients)
+
+    /*!
+     * \brief Returns the arithmetic intensity of the forward pass, in operations per byte
+     */
+    double forward_intensity() const {
+        return forward_bytes ? double(forward_flops) / forward_bytes : 0.0;
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a layer has weights (w) and biases (b)
+ */
+template <typename Layer, typename Enable = void>
+struct has_weights_biases : std::false_type {};
+
+template <typename Layer>
+struct has_weights_biases<Layer, std::void_t<decltype(std::declval<Layer&>().w), decltype(std::declval<Layer&>().b)>> : std::true_type {};
+
+} //end of namespace detail
+
+/*!
+ * \brief Estimate the cost of a layer for a batch.
+ *
+ * A neural layer with weights and biases computes one multiply-add per
+ * weight for each position of its output (each position of its input for
+ * a deconvolution), followed by one operation per output for the biases
+ * and the activation. The other neural layers are counted as one
+ * multiply-add per parameter and per sample and the layers without
+ * parameters as one operation per value. The memory traffic counts the
+ * inputs and outputs of the batch and the parameters read once.
+ *
+ * \param layer The layer
+ * \param in The size of one input of the layer
+ * \param out The size of one output of the layer
+ * \param batch The size of the batch
+ * \param bytes The size of one value
+ */
+template <typename Layer>
+layer_cost estimate_layer_cost(const Layer& layer, size_t in, size_t out, size_t batch, size_t bytes) {
+    using traits = decay_layer_traits<Layer>;
+
+    layer_cost cost;
+
+    if constexpr (traits::is_neural_layer()) {
+        size_t macs = layer.parameters();
+
+        if constexpr (detail::has_weights_biases<Layer>::value) {
+            if constexpr (traits::is_deconvolutional_layer()) {
+                macs = etl::size(layer.w) * (in / std::max(size_t(1), size_t(etl::dim<0>(layer.w))));
+            } else {
+                macs = etl::size(layer.w) * (out / std::max(size_t(1), size_t(etl::size(layer.b))));
+            }
+        }
+
+        const size_t parameters = layer.parameters();
+
+        cost.forward_flops   = batch * (2 * macs + out);
+        cost.backward_flops  = batch * 2 * macs;
+        cost.gradients_flops = batch * (2 * macs + out);
+        cost.forward_bytes   = (batch * (in + out) + parameters) * bytes;
+        cost.backward_bytes  = (batch * (2 * in + 3 * out) + 2 * parameters) * bytes;
+    } else if constexpr (traits::is_pooling_layer()) {
+        cost.forward_flops  = batch * in;
+        cost.backward_flops = batch * in;
+        cost.forward_bytes  = batch * (in + out) * bytes;
+        cost.backward_bytes = batch * (2 * in + out) * bytes;
+    } else {
+        cost.forward_flops  = batch * std::max(in, out);
+        cost.backward_flops = batch * std::max(in, out);
+        cost.forward_bytes  = batch * (in + out) * bytes;
+        cost.backward_bytes = batch * (in + 2 * out) * bytes;
+    }
+
+    return cost;
+}
+
+} //end of dll namespace
@@ -0,0 +1,670 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused-gate kernels of the LSTM layers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "cpp_utils/likely.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/function.hpp"
+#include "dll/util/epilogue.hpp"
+#include "dll/util/sequence_packing.hpp"
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+#include "dll/util/workspace.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Call functor(first, last) on chunks of [0, n), on the scoped
+ * thread pool if there is one.
+ */
+template <typename Functor>
+void lstm_chunks(size_t n, Functor&& functor) {
+    auto* pool = scoped_thread_pool();
+
+    if (pool && n > 1) {
+        const size_t chunks = std::min(n, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&functor, n, chunks](size_t c) {
+            functor((c * n) / chunks, ((c + 1) * n) / chunks);
+        });
+    } else {
+        functor(0, n);
+    }
+}
+
+/*!
+ * \brief Copy the rows of the given matrix (rows x H) at the given column
+ * offset of the rows of the concatenated matrix (rows x 4H)
+ */
+template <typename T, typename M>
+void lstm_concat(T* out, const M& m, size_t rows, size_t H, size_t offset) {
+    m.ensure_cpu_up_to_date();
+
+    const T* m_p = m.memory_start();
+
+    for (size_t r = 0; r < rows; ++r) {
+        std::copy(m_p + r * H, m_p + (r + 1) * H, out + r * 4 * H + offset);
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Cache of the weights of the four gates of an LSTM layer,
+ * concatenated in the [i|f|g|o] order, so that each product computes all
+ * the gates at once.
+ *
+ * The cache is computed on first use and must be invalidated when the
+ * weights are modified.
+ */
+template <typename T>
+struct lstm_fused_weights {
+    etl::dyn_matrix<T, 2> u; ///< The input weights [U_i|U_f|U_g|U_o] (sequence_length x 4H)
+    etl::dyn_matrix<T, 2> w; ///< The recurrent weights [W_i|W_f|W_g|W_o] (H x 4H)
+    etl::dyn_matrix<T, 1> b; ///< The biases [b_i|b_f|b_g|b_o]
+
+    /*!
+     * \brief Concatenate the weights of the given layer if they have been
+     * modified
+     */
+    template <typename L>
+    void update(const L& layer) {
+        std::lock_guard<std::mutex> l(lock);
+
+        if (!valid) {
+            const size_t S = etl::dim<0>(layer.u_i);
+            const size_t H = etl::dim<1>(layer.u_i);
+
+            if (etl::size(b) != 4 * H || etl::dim<0>(u) != S) {
+                u = etl::dyn_matrix<T, 2>(S, 4 * H);
+                w = etl::dyn_matrix<T, 2>(H, 4 * H);
+                b = etl::dyn_matrix<T, 1>(4 * H);
+            }
+
+            detail::lstm_concat(u.memory_start(), layer.u_i, S, H, 0);
+            detail::lstm_concat(u.memory_start(), layer.u_f, S, H, H);
+            detail::lstm_concat(u.memory_start(), layer.u_g, S, H, 2 * H);
+            detail::lstm_concat(u.memory_start(), layer.u_o, S, H, 3 * H);
+
+            detail::lstm_concat(w.memory_start(), layer.w_i, H, H, 0);
+            detail::lstm_concat(w.memory_start(), layer.w_f, H, H, H);
+            detail::lstm_concat(w.memory_start(), layer.w_g, H, H, 2 * H);
+            detail::lstm_concat(w.memory_start(), layer.w_o, H, H, 3 * H);
+
+            detail::lstm_concat(b.memory_start(), layer.b_i, 1, H, 0);
+            detail::lstm_concat(b.memory_start(), layer.b_f, 1, H, H);
+            detail::lstm_concat(b.memory_start(), layer.b_g, 1, H, 2 * H);
+            detail::lstm_concat(b.memory_start(), layer.b_o, 1, H, 3 * H);
+
+            u.invalidate_gpu();
+            w.invalidate_gpu();
+            b.invalidate_gpu();
+
+            valid = true;
+        }
+    }
+
+    /*!
+     * \brief Invalidate the cache, after a modification of the weights
+     */
+    void invalidate() {
+        std::lock_guard<std::mutex> l(lock);
+        valid = false;
+    }
+
+private:
+    bool valid = false; ///< Indicates if the concatenated weights are up to date
+    std::mutex lock;    ///< The lock for concurrent uses of the layer
+};
+
+/*!
+ * \brief Compute the four gates, the state and the output of one time step
+ * of an LSTM layer, in one pass over the pre-activations.
+ *
+ * \param x_proj The input projection of the step (B x 4H)
+ * \param bias The biases of the gates (4H)
+ * \param rec The recurrent projection of the step (B x 4H), nullptr for the first step
+ * \param s_prev The state of the previous step (B x H), nullptr for the first step
+ * \param i The input gate (B x H)
+ * \param f The forget gate (B x H)
+ * \param g The input modulation gate (B x H)
+ * \param o The output gate (B x H)
+ * \param s The state (B x H)
+ * \param h The output (B x H)
+ */
+template <function F, typename T>
+void lstm_gates_step(const T* x_proj, const T* bias, const T* rec, const T* s_prev, T* i, T* f, T* g, T* o, T* s, T* h, size_t B, size_t H) {
+    detail::lstm_chunks(B, [=](size_t first, size_t last) {
+        for (size_t r = first; r < last; ++r) {
+            const T* z_r = x_proj + r * 4 * H;
+            const T* r_r = rec ? rec + r * 4 * H : nullptr;
+
+            for (size_t j = 0; j < H; ++j) {
+                const size_t n = r * H + j;
+
+                T z_i = z_r[j] + bias[j];
+                T z_f = z_r[H + j] + bias[H + j];
+                T z_g = z_r[2 * H + j] + bias[2 * H + j];
+                T z_o = z_r[3 * H + j] + bias[3 * H + j];
+
+                if (r_r) {
+                    z_i += r_r[j];
+                    z_f += r_r[H + j];
+                    z_g += r_r[2 * H + j];
+                    z_o += r_r[3 * H + j];
+                }
+
+                i[n] = detail::activate_value<function::SIGMOID>(z_i);
+                f[n] = detail::activate_value<function::SIGMOID>(z_f);
+                g[n] = detail::activate_value<function::TANH>(z_g);
+                o[n] = detail::activate_value<function::SIGMOID>(z_o);
+
+                if (s_prev) {
+                    s[n] = detail::activate_value<F>(g[n] * i[n] + s_prev[n] * f[n]);
+                    h[n] = s[n] * o[n];
+                } else {
+                    s[n] = g[n] * i[n];
+                    h[n] = detail::activate_value<F>(s[n]) * o[n];
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief The state of the training forward pass of an LSTM layer, needed by
+ * the backward pass, time major (time_steps x Batch x ...).
+ *
+ * The buffers are resized when the batch size changes.
+ */
+template <typename T>
+struct lstm_train_cache {
+    etl::dyn_matrix<T, 3> x_t; ///< The input
+    etl::dyn_matrix<T, 3> i_t; ///< The input gate
+    etl::dyn_matrix<T, 3> f_t; ///< The forget gate
+    etl::dyn_matrix<T, 3> g_t; ///< The input modulation gate
+    etl::dyn_matrix<T, 3> o_t; ///< The output gate
+    etl::dyn_matrix<T, 3> s_t; ///< The state
+    etl::dyn_matrix<T, 3> h_t; ///< The output
+
+    etl::dyn_matrix<T, 2> x_proj; ///< The input projection of the four gates of all the time steps
+    etl::dyn_matrix<T, 2> rec;    ///< The recurrent projection of the four gates of one time step
+
+    /*!
+     * \brief Make sure the buffers have the given dimensions
+     */
+    void prepare(size_t TS, size_t B, size_t S, size_t H) {
+        if (cpp_unlikely(!x_t.memory_start() || etl::dim<1>(x_t) != B)) {
+            x_t.resize(TS, B, S);
+            i_t.resize(TS, B, H);
+            f_t.resize(TS, B, H);
+            g_t.resize(TS, B, H);
+            o_t.resize(TS, B, H);
+            s_t.resize(TS, B, H);
+            h_t.resize(TS, B, H);
+
+            x_proj.resize(TS * B, 4 * H);
+            rec.resize(B, 4 * H);
+        }
+    }
+};
+
+/*!
+ * \brief The temporaries of the backward pass of an LSTM layer, only
+ * allocated on the first backward pass.
+ *
+ * The buffers are resized when the batch size changes.
+ */
+template <typename T>
+struct lstm_backward_cache {
+    etl::dyn_matrix<T, 3> delta_t; ///< The errors of the output
+    etl::dyn_matrix<T, 3> d_h_t;   ///< The errors of the output, through time
+    etl::dyn_matrix<T, 3> d_c_t;   ///< The errors of the state, through time
+    etl::dyn_matrix<T, 3> d_x_t;   ///< The errors of the input
+    etl::dyn_matrix<T, 3> d_h_i_t; ///< The errors of the input gate
+    etl::dyn_matrix<T, 3> d_h_f_t; ///< The errors of the forget gate
+    etl::dyn_matrix<T, 3> d_h_c_t; ///< The errors of the input modulation gate
+    etl::dyn_matrix<T, 3> d_h_o_t; ///< The errors of the output gate
+
+    etl::dyn_matrix<T, 2> d_gates; ///< The errors of the four gates of one time step
+
+    /*!
+     * \brief Make sure the buffers have the given dimensions
+     */
+    void prepare(size_t TS, size_t B, size_t S, size_t H) {
+        if (cpp_unlikely(!delta_t.memory_start() || etl::dim<1>(delta_t) != B)) {
+            delta_t.resize(TS, B, H);
+            d_h_t.resize(TS, B, H);
+            d_c_t.resize(TS, B, H);
+            d_x_t.resize(TS, B, S);
+            d_h_i_t.resize(TS, B, H);
+            d_h_f_t.resize(TS, B, H);
+            d_h_c_t.resize(TS, B, H);
+            d_h_o_t.resize(TS, B, H);
+
+            d_gates.resize(B, 4 * H);
+        }
+    }
+};
+
+/*!
+ * \brief The sums of the errors of the gates of each time step of an LSTM
+ * layer, time major (time_steps x Batch x H), for the gradients of the
+ * weights computed after the recurrence.
+ *
+ * The buffers are resized when the batch size changes.
+ */
+template <typename T>
+struct lstm_gate_errors {
+    etl::dyn_matrix<T, 3> i_t; ///< The errors of the input gate
+    etl::dyn_matrix<T, 3> f_t; ///< The errors of the forget gate
+    etl::dyn_matrix<T, 3> g_t; ///< The errors of the input modulation gate
+    etl::dyn_matrix<T, 3> o_t; ///< The errors of the output gate
+
+    /*!
+     * \brief Make sure the buffers have the given dimensions and clear them
+     */
+    void prepare(size_t TS, size_t B, size_t H) {
+        if (cpp_unlikely(!i_t.memory_start() || etl::dim<1>(i_t) != B)) {
+            i_t.resize(TS, B, H);
+            f_t.resize(TS, B, H);
+            g_t.resize(TS, B, H);
+            o_t.resize(TS, B, H);
+        }
+
+        i_t = 0;
+        f_t = 0;
+        g_t = 0;
+        o_t = 0;
+    }
+
+    /*!
+     * \brief Add the errors of the gates of the given time step
+     */
+    void accumulate(const lstm_backward_cache<T>& c, size_t t) {
+        i_t(t) += c.d_h_i_t(t);
+        f_t(t) += c.d_h_f_t(t);
+        g_t(t) += c.d_h_c_t(t);
+        o_t(t) += c.d_h_o_t(t);
+    }
+};
+
+/*!
+ * \brief Compute the gradients of the weights of one gate of an LSTM layer
+ * from the sums of its errors, with one product over all the time steps for
+ * each weight.
+ *
+ * \param x_t The input (time_steps x Batch x S)
+ * \param h_t The output (time_steps x Batch x H)
+ * \param e_t The sums of the errors of the gate (time_steps x Batch x H)
+ * \param w_grad The gradients of the recurrent weights (H x H)
+ * \param u_grad The gradients of the input weights (S x H)
+ * \param b_grad The gradients of the biases (H)
+ */
+template <typename T, typename WG, typename UG, typename BG>
+void lstm_deferred_gradients(etl::dyn_matrix<T, 3>& x_t, etl::dyn_matrix<T, 3>& h_t, etl::dyn_matrix<T, 3>& e_t, WG& w_grad, UG& u_grad, BG& b_grad) {
+    const size_t TS = etl::dim<0>(x_t);
+    const size_t B  = etl::dim<1>(x_t);
+    const size_t S  = etl::dim<2>(x_t);
+    const size_t H  = etl::dim<2>(h_t);
+
+    x_t.ensure_cpu_up_to_date();
+    h_t.ensure_cpu_up_to_date();
+    e_t.ensure_cpu_up_to_date();
+
+    etl::custom_dyn_matrix<T, 2> x_all(x_t.memory_start(), TS * B, S);
+    etl::custom_dyn_matrix<T, 2> e_all(e_t.memory_start(), TS * B, H);
+
+    u_grad = etl::batch_outer(x_all, e_all);
+    b_grad = etl::bias_batch_sum_2d(e_all);
+
+    if (TS > 1) {
+        etl::custom_dyn_matrix<T, 2> h_prev(h_t.memory_start(), (TS - 1) * B, H);
+        etl::custom_dyn_matrix<T, 2> e_next(e_t.memory_start() + B * H, (TS - 1) * B, H);
+
+        w_grad = etl::batch_outer(h_prev, e_next);
+    } else {
+        w_grad = 0;
+    }
+}
+
+/*!
+ * \brief Forward propagation through time of an LSTM layer with fused
+ * gates: the input projection of all the time steps is computed with one
+ * large product, and each time step with one recurrent product followed by
+ * one fused kernel for the four gates.
+ *
+ * The input must have been rearranged (time major, packed) in c.x_t. Each
+ * time step is only computed for its active rows, the others repeat their
+ * last output and state.
+ *
+ * \param c The training cache, whose state is filled
+ * \param fw The concatenated weights of the layer
+ * \param packing The packing of the batch
+ */
+template <function F, typename T>
+void lstm_fused_forward(lstm_train_cache<T>& c, const lstm_fused_weights<T>& fw, const sequence_packing& packing) {
+    const size_t TS = etl::dim<0>(c.x_t);
+    const size_t B  = etl::dim<1>(c.x_t);
+    const size_t S  = etl::dim<2>(c.x_t);
+    const size_t H  = etl::dim<2>(c.h_t);
+
+    // One product for the input projection of all the time steps
+
+    c.x_proj = etl::reshape(c.x_t, TS * B, S) * fw.u;
+
+    c.x_proj.ensure_cpu_up_to_date();
+
+    const T* b_p = fw.b.memory_start();
+
+    T* x_p = c.x_proj.memory_start();
+    T* i_p = c.i_t.memory_start();
+    T* f_p = c.f_t.memory_start();
+    T* g_p = c.g_t.memory_start();
+    T* o_p = c.o_t.memory_start();
+    T* s_p = c.s_t.memory_start();
+    T* h_p = c.h_t.memory_start();
+
+    const size_t step = B * H;
+
+    lstm_gates_step<F>(x_p, b_p, static_cast<const T*>(nullptr), static_cast<const T*>(nullptr), i_p, f_p, g_p, o_p, s_p, h_p, B, H);
+
+    for (size_t t = 1; t < TS; ++t) {
+        const size_t active = packing.active[t];
+
+        if (active == B) {
+            // One product for the recurrent projection of the four gates
+
+            c.h_t.invalidate_gpu();
+            c.rec = c.h_t(t - 1) * fw.w;
+            c.rec.ensure_cpu_up_to_date();
+        } else if (active) {
+            // The product only covers the still active rows
+
+            etl::custom_dyn_matrix<T, 2> rec(c.rec.memory_start(), active, 4 * H);
+            rec = etl::custom_dyn_matrix<T, 2>(h_p + (t - 1) * step, active, H) * fw.w;
+        }
+
+        if (active) {
+            lstm_gates_step<F>(x_p + t * 4 * step, b_p, c.rec.memory_start(), s_p + (t - 1) * step,
+                               i_p + t * step, f_p + t * step, g_p + t * step, o_p + t * step, s_p + t * step, h_p + t * step, active, H);
+        }
+
+        if (active < B) {
+            carry_rows(s_p + t * step, s_p + (t - 1) * step, active, B, H);
+            carry_rows(h_p + t * step, h_p + (t - 1) * step, active, B, H);
+
+            std::fill(i_p + t * step + active * H, i_p + (t + 1) * step, T(0));
+            std::fill(f_p + t * step + active * H, f_p + (t + 1) * step, T(0));
+            std::fill(g_p + t * step + active * H, g_p + (t + 1) * step, T(0));
+            std::fill(o_p + t * step + active * H, o_p + (t + 1) * step, T(0));
+        }
+    }
+
+    c.i_t.invalidate_gpu();
+    c.f_t.invalidate_gpu();
+    c.g_t.invalidate_gpu();
+    c.o_t.invalidate_gpu();
+    c.s_t.invalidate_gpu();
+    c.h_t.invalidate_gpu();
+}
+
+/*!
+ * \brief Inference forward propagation of an LSTM layer with fused gates.
+ *
+ * Only the state and the output of the previous time step are kept, and
+ * the gates of the current time step. Nothing is stored in the layer, the
+ * temporaries are borrowed from the workspace if possible, so the layer
+ * can be used from several threads.
+ *
+ * \param output The output batch (Batch x time_steps x H)
+ * \param x The input batch (Batch x time_steps x S)
+ * \param fw The concatenated weights of the layer
+ * \param ws The workspace for the temporaries (can be nullptr)
+ * \param variable Indicates if the sequences have variable lengths
+ */
+template <function F, typename O, typename X, typename T>
+void lstm_fused_inference(O&& output, const X& x, const lstm_fused_weights<T>& fw, workspace* ws = nullptr, bool variable = false) {
+    const size_t B  = etl::dim<0>(x);
+    const size_t TS = etl::dim<1>(x);
+    const size_t S  = etl::dim<0>(fw.u);
+    const size_t H  = etl::dim<0>(fw.w);
+    const size_t BH = B * H;
+
+    sequence_packing packing;
+    packing.pack(x, variable);
+
+    workspace_lease<T> tmp(ws, TS * B * S + TS * B * 4 * H + 4 * BH + 8 * BH);
+
+    T* x_p = tmp.data();        // The input, time major
+    T* p_p = x_p + TS * B * S;  // The input projection of all the time steps
+    T* r_p = p_p + TS * 4 * BH; // The recurrent projection of the current step
+    T* g_p = r_p + 4 * BH;      // The four gates of the current step
+    T* s_p = g_p + 4 * BH;      // The states of the previous and current steps
+    T* h_p = s_p + 2 * BH;      // The outputs of the previous and current steps
+
+    etl::custom_dyn_matrix<T, 3> x_t(x_p, TS, B, S);
+
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t t = 0; t < TS; ++t) {
+            x_t(t)(b) = x(packing.order[b])(t);
+        }
+    }
+
+    etl::custom_dyn_matrix<T, 2> x_proj(p_p, TS * B, 4 * H);
+    x_proj = etl::reshape(x_t, TS * B, S) * fw.u;
+    x_proj.ensure_cpu_up_to_date();
+
+    const T* b_p = fw.b.memory_start();
+
+    for (size_t t = 0; t < TS; ++t) {
+        T* s_cur = s_p + (t % 2) * BH;
+        T* h_cur = h_p + (t % 2) * BH;
+
+        if (t == 0) {
+            lstm_gates_step<F>(p_p, b_p, static_cast<const T*>(nullptr), static_cast<const T*>(nullptr),
+                               g_p, g_p + BH, g_p + 2 * BH, g_p + 3 * BH, s_cur, h_cur, B, H);
+        } else {
+            T* s_prev = s_p + ((t + 1) % 2) * BH;
+            T* h_prev = h_p + ((t + 1) % 2) * BH;
+
+            // Only the still active rows are computed, the others repeat their last state
+            const size_t active = packing.active[t];
+
+            if (active) {
+                etl::custom_dyn_matrix<T, 2> rec(r_p, active, 4 * H);
+                rec = etl::custom_dyn_matrix<T, 2>(h_prev, active, H) * fw.w;
+                rec.ensure_cpu_up_to_date();
+
+                lstm_gates_step<F>(p_p + t * 4 * BH, b_p, r_p, s_prev,
+                                   g_p, g_p + BH, g_p + 2 * BH, g_p + 3 * BH, s_cur, h_cur, active, H);
+            }
+
+            carry_rows(s_cur, s_prev, active, B, H);
+            carry_rows(h_cur, h_prev, active, B, H);
+        }
+
+        etl::custom_dyn_matrix<T, 2> h(h_cur, B, H);
+
+        for (size_t b = 0; b < B; ++b) {
+            output(packing.order[b])(t) = h(b);
+        }
+    }
+}
+
+/*!
+ * \brief The state carried between the calls of the streaming inference of
+ * an LSTM layer
+ */
+template <typename T>
+struct lstm_stream_state {
+    etl::dyn_matrix<T, 2> h; ///< The output of the last time step
+    etl::dyn_matrix<T, 2> s; ///< The state of the last time step
+    size_t steps = 0;        ///< The number of time steps since the last reset
+
+    /*!
+     * \brief Start again from a zero state
+     */
+    void reset() {
+        steps = 0;
+    }
+};
+
+/*!
+ * \brief Streaming inference of an LSTM layer with fused gates: the new
+ * time steps of the batch are computed from the state of the previous call,
+ * which is then updated, each new time step costing one recurrent product.
+ *
+ * \param output The output batch (Batch x n x H)
+ * \param x The new time steps of the input batch (Batch x n x S)
+ * \param fw The concatenated weights of the layer
+ * \param state The state carried between the calls
+ */
+template <function F, typename O, typename X, typename T>
+void lstm_stream_forward(O&& output, const X& x, const lstm_fused_weights<T>& fw, lstm_stream_state<T>& state) {
+    static_assert(fused_epilogue<F>, "The streaming inference only supports element-wise activation functions");
+
+    const size_t B  = etl::dim<0>(x);
+    const size_t N  = etl::dim<1>(x);
+    const size_t S  = etl::dim<0>(fw.u);
+    const size_t H  = etl::dim<0>(fw.w);
+    const size_t BH = B * H;
+
+    if (!state.steps) {
+        state.h = etl::dyn_matrix<T, 2>(B, H);
+        state.s = etl::dyn_matrix<T, 2>(B, H);
+    }
+
+    cpp_assert(etl::dim<0>(state.h) == B, "The batch size cannot change while streaming");
+
+    // One product for the input projection of the new time steps
+
+    etl::dyn_matrix<T, 3> x_t(N, B, S);
+
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t t = 0; t < N; ++t) {
+            x_t(t)(b) = x(b)(t);
+        }
+    }
+
+    etl::dyn_matrix<T, 2> x_proj(N * B, 4 * H);
+    x_proj = etl::reshape(x_t, N * B, S) * fw.u;
+    x_proj.ensure_cpu_up_to_date();
+
+    etl::dyn_matrix<T, 2> rec(B, 4 * H);
+    etl::dyn_matrix<T, 2> gates(4, BH);
+    etl::dyn_matrix<T, 2> s_new(B, H);
+    etl::dyn_matrix<T, 2> h_new(B, H);
+
+    const T* b_p = fw.b.memory_start();
+    T* g_p       = gates.memory_start();
+
+    for (size_t t = 0; t < N; ++t) {
+        const T* x_p = x_proj.memory_start() + t * 4 * BH;
+
+        if (!state.steps) {
+            lstm_gates_step<F>(x_p, b_p, static_cast<const T*>(nullptr), static_cast<const T*>(nullptr),
+                               g_p, g_p + BH, g_p + 2 * BH, g_p + 3 * BH, s_new.memory_start(), h_new.memory_start(), B, H);
+        } else {
+            rec = state.h * fw.w;
+            rec.ensure_cpu_up_to_date();
+
+            lstm_gates_step<F>(x_p, b_p, rec.memory_start(), state.s.memory_start(),
+                               g_p, g_p + BH, g_p + 2 * BH, g_p + 3 * BH, s_new.memory_start(), h_new.memory_start(), B, H);
+        }
+
+        s_new.invalidate_gpu();
+        h_new.invalidate_gpu();
+
+        std::swap(state.s, s_new);
+        std::swap(state.h, h_new);
+
+        ++state.steps;
+
+        for (size_t b = 0; b < B; ++b) {
+            output(b)(t) = state.h(b);
+        }
+    }
+}
+
+/*!
+ * \brief Backpropagate the errors of the four gates of one time step of an
+ * LSTM layer to its input and to the previous output, with one product
+ * each, instead of one per gate.
+ *
+ * The errors of the inactive rows of the time step are zero, the products
+ * only cover the active rows.
+ *
+ * \param c The backward cache
+ * \param fw The concatenated weights of the layer
+ * \param t The time step
+ * \param active The number of active rows of the time step
+ */
+template <typename T>
+void lstm_fused_backward_step(lstm_backward_cache<T>& c, const lstm_fused_weights<T>& fw, size_t t, size_t active) {
+    const size_t B = etl::dim<1>(c.d_h_t);
+    const size_t H = etl::dim<2>(c.d_h_t);
+
+    // Concatenate the errors of the gates ([i|f|g|o])
+
+    T* d_p = c.d_gates.memory_start();
+
+    detail::lstm_concat(d_p, c.d_h_i_t(t), active, H, 0);
+    detail::lstm_concat(d_p, c.d_h_f_t(t), active, H, H);
+    detail::lstm_concat(d_p, c.d_h_c_t(t), active, H, 2 * H);
+    detail::lstm_concat(d_p, c.d_h_o_t(t), active, H, 3 * H);
+
+    c.d_gates.invalidate_gpu();
+
+    if (active == B) {
+        // The part going back to x
+        c.d_x_t(t) = c.d_gates * etl::trans(fw.u);
+
+        // The part going back to h
+        c.d_h_t(t) = c.d_gates * etl::trans(fw.w);
+    } else {
+        const size_t S = etl::dim<2>(c.d_x_t);
+
+        c.d_x_t.ensure_cpu_up_to_date();
+        c.d_h_t.ensure_cpu_up_to_date();
+
+        T* x_p = c.d_x_t.memory_start() + t * B * S;
+        T* h_p = c.d_h_t.memory_start() + t * B * H;
+
+        if (active) {
+            etl::custom_dyn_matrix<T, 2> d_gates(d_p, active, 4 * H);
+            etl::custom_dyn_matrix<T, 2> d_x(x_p, active, S);
+            etl::custom_dyn_matrix<T, 2> d_h(h_p, active, H);
+
+            d_x = d_gates * etl::trans(fw.u);
+            d_h = d_gates * etl::trans(fw.w);
+        }
+
+        std::fill(x_p + active * S, x_p + B * S, T(0));
+        std::fill(h_p + active * H, h_p + B * H, T(0));
+
+        c.d_x_t.invalidate_gpu();
+        c.d_h_t.invalidate_gpu();
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,266 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief The memory-mapped weights file format
+ *
+ * A fixed-size header (mapped_weights_header) is followed by a table with
+ * the offset and the size of one block per layer of the network, and by
+ * the blocks. The block of a layer contains the weights of the layer, as
+ * written by its store function, and starts on an aligned offset so that
+ * the weights can be used directly from the mapping, without any copy.
+ * The mapping of a file is shared by all the processes using it.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace dll {
+
+/*!
+ * \brief The alignment of the blocks of a memory-mapped weights file
+ */
+constexpr size_t mapped_weights_alignment = 64;
+
+/*!
+ * \brief The magic identifier of a memory-mapped weights file
+ */
+constexpr char mapped_weights_magic[8] = {'D', 'L', 'L', 'W', 'M', 'A', 'P', '1'};
+
+/*!
+ * \brief The current version of the memory-mapped weights format
+ */
+constexpr uint32_t mapped_weights_version = 1;
+
+/*!
+ * \brief The header of a memory-mapped weights file
+ */
+struct mapped_weights_header {
+    char magic[8];         ///< The magic identifier of the format
+    uint32_t version;      ///< The version of the format
+    uint32_t dtype;        ///< The size in bytes of one value
+    uint64_t blocks;       ///< The number of blocks (one per layer)
+    uint64_t table_offset; ///< The offset of the table of the blocks
+};
+
+/*!
+ * \brief The position of one block of a memory-mapped weights file
+ */
+struct mapped_weights_block {
+    uint64_t offset; ///< The offset of the block
+    uint64_t size;   ///< The size of the block, in bytes
+};
+
+/*!
+ * \brief Write the given blocks in the memory-mapped weights format.
+ * \param path The path of the file to write
+ * \param dtype The size in bytes of one value
+ * \param blocks The content of the blocks, one per layer
+ * \return true if the file was written, false otherwise
+ */
+inline bool write_mapped_weights(const std::string& path, size_t dtype, const std::vector<std::string>& blocks) {
+    auto align = [](size_t offset) {
+        return ((offset + mapped_weights_alignment - 1) / mapped_weights_alignment) * mapped_weights_alignment;
+    };
+
+    std::ofstream stream(path, std::ios::binary);
+
+    if (!stream) {
+        std::cerr << "ERROR: Impossible to open " << path << std::endl;
+        return false;
+    }
+
+    mapped_weights_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, mapped_weights_magic, sizeof(header.magic));
+
+    header.version      = mapped_weights_version;
+    header.dtype        = dtype;
+    header.blocks       = blocks.size();
+    header.table_offset = sizeof(header);
+
+    std::vector<mapped_weights_block> table(blocks.size());
+
+    size_t offset = align(header.table_offset + table.size() * sizeof(mapped_weights_block));
+
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        table[b].offset = offset;
+        table[b].size   = blocks[b].size();
+
+        offset = align(offset + blocks[b].size());
+    }
+
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(mapped_weights_block));
+
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        while (size_t(stream.tellp()) < table[b].offset) {
+            stream.put('\0');
+        }
+
+        stream.write(blocks[b].data(), blocks[b].size());
+    }
+
+    return bool(stream);
+}
+
+/*!
+ * \brief A read-only memory mapping of a weights file.
+ *
+ * The weights of the blocks can be used directly by the inference, the
+ * pages being loaded on first use and shared with the other mappings of
+ * the same file.
+ */
+struct mapped_weights {
+    /*!
+     * \brief Map the given file
+     * \param path The path to the weights file
+     */
+    explicit mapped_weights(const std::string& path) {
+        std::memset(&header, 0, sizeof(header));
+
+        fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            std::cerr << "ERROR: Impossible to open " << path << std::endl;
+            return;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(header)) {
+            std::cerr << "ERROR: Invalid weights file " << path << std::endl;
+            close();
+            return;
+        }
+
+        mapping_size = st.st_size;
+
+        // The mapping is shared, the pages are shared with the other processes
+        void* ptr = ::mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (ptr == MAP_FAILED) {
+            std::cerr << "ERROR: Impossible to map " << path << std::endl;
+            close();
+            return;
+        }
+
+        mapping = static_cast<char*>(ptr);
+
+        std::memcpy(&header, mapping, sizeof(header));
+
+        if (std::memcmp(header.magic, mapped_weights_magic, sizeof(header.magic)) != 0 || header.version != mapped_weights_version) {
+            std::cerr << "ERROR: Incompatible weights file " << path << std::endl;
+            close();
+            return;
+        }
+
+        table = reinterpret_cast<const mapped_weights_block*>(mapping + header.table_offset);
+
+        for (size_t b = 0; b < header.blocks; ++b) {
+            if (table[b].offset + table[b].size > mapping_size) {
+                std::cerr << "ERROR: Truncated weights file " << path << std::endl;
+                close();
+                return;
+            }
+        }
+    }
+
+    mapped_weights(const mapped_weights& rhs) = delete;
+    mapped_weights& operator=(const mapped_weights& rhs) = delete;
+
+    /*!
+     * \brief Unmap the file
+     */
+    ~mapped_weights() {
+        close();
+    }
+
+    /*!
+     * \brief Indicates if the file is mapped
+     */
+    bool is_open() const {
+        return mapping != nullptr;
+    }
+
+    /*!
+     * \brief Returns the size in bytes of one value
+     */
+    size_t dtype() const {
+        return header.dtype;
+    }
+
+    /*!
+     * \brief Returns the number of blocks
+     */
+    size_t blocks() const {
+        return header.blocks;
+    }
+
+    /*!
+     * \brief Returns the start of the given block. The memory is read-only.
+     */
+    char* block(size_t b) const {
+        return mapping + table[b].offset;
+    }
+
+    /*!
+     * \brief Returns the size in bytes of the given block
+     */
+    size_t block_size(size_t b) const {
+        return table[b].size;
+    }
+
+private:
+    /*!
+     * \brief Unmap the file and close it
+     */
+    void close() {
+        if (mapping) {
+            ::munmap(mapping, mapping_size);
+            mapping = nullptr;
+        }
+
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    mapped_weights_header header;               ///< The header of the file
+    const mapped_weights_block* table = nullptr; ///< The table of the blocks
+    int fd                            = -1;      ///< The file descriptor
+    char* mapping                     = nullptr; ///< The start of the mapping
+    size_t mapping_size               = 0;       ///< The size of the mapping
+};
+
+/*!
+ * \brief A stream buffer reading a block of memory, to load the weights of
+ * a layer from a mapping
+ */
+struct mapped_block_buffer : std::streambuf {
+    /*!
+     * \brief Read the given block of memory
+     */
+    mapped_block_buffer(char* memory, size_t size) {
+        setg(memory, memory, memory + size);
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,406 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Max pooling kernels recording the position of the maximums
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/util/multiversion.hpp"
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The maximum number of values of a pooling window for the position
+ * of the maximums to be recorded (one byte per output)
+ */
+constexpr size_t max_argmax_window = 256;
+
+namespace detail {
+
+/*!
+ * \brief Call functor(first, last) on chunks of [0, n), on the scoped
+ * thread pool if there is one.
+ */
+template <typename Functor>
+void max_pool_chunks(size_t n, Functor&& functor) {
+    auto* pool = scoped_thread_pool();
+
+    if (pool && n > 1) {
+        const size_t chunks = std::min(n, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&functor, n, chunks](size_t c) {
+            functor((c * n) / chunks, ((c + 1) * n) / chunks);
+        });
+    } else {
+        functor(0, n);
+    }
+}
+
+/*!
+ * \brief Max pooling of one sample (I1 x I2 x I3) by (c1, c2, c3), recording
+ * the offset of the maximum of each window in a, if not nullptr, in the
+ * best version for the processor.
+ */
+template <typename T>
+DLL_MULTIVERSION void max_pool_argmax_sample(const T* in, T* out, uint8_t* a, size_t I1, size_t I2, size_t I3, size_t c1, size_t c2, size_t c3) {
+    const size_t O1 = I1 / c1;
+    const size_t O2 = I2 / c2;
+    const size_t O3 = I3 / c3;
+
+    for (size_t k = 0; k < O1; ++k) {
+        for (size_t y = 0; y < O2; ++y) {
+            for (size_t x = 0; x < O3; ++x) {
+                const T* window = in + ((k * c1) * I2 + y * c2) * I3 + x * c3;
+
+                T best             = window[0];
+                size_t best_offset = 0;
+
+                for (size_t a1 = 0; a1 < c1; ++a1) {
+                    for (size_t i = 0; i < c2; ++i) {
+                        for (size_t j = 0; j < c3; ++j) {
+                            const T v = window[(a1 * I2 + i) * I3 + j];
+
+                            if (v > best) {
+                                best        = v;
+                                best_offset = (a1 * c2 + i) * c3 + j;
+                            }
+                        }
+                    }
+                }
+
+                const size_t o = (k * O2 + y) * O3 + x;
+
+                out[o] = best;
+
+                if (a) {
+                    a[o] = uint8_t(best_offset);
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Scatter the errors of one pooled sample to the recorded position
+ * of their maximum in the errors of the input (I1 x I2 x I3), the other
+ * positions being set to zero.
+ */
+template <typename T>
+void max_pool_argmax_scatter_sample(const T* errors, T* out, const uint8_t* a, size_t I1, size_t I2, size_t I3, size_t c1, size_t c2, size_t c3) {
+    const size_t O1 = I1 / c1;
+    const size_t O2 = I2 / c2;
+    const size_t O3 = I3 / c3;
+
+    std::fill(out, out + I1 * I2 * I3, T(0));
+
+    for (size_t k = 0; k < O1; ++k) {
+        for (size_t y = 0; y < O2; ++y) {
+            for (size_t x = 0; x < O3; ++x) {
+                const size_t o      = (k * O2 + y) * O3 + x;
+                const size_t offset = a[o];
+
+                const size_t a1 = offset / (c2 * c3);
+                const size_t i  = (offset / c3) % c2;
+                const size_t j  = offset % c3;
+
+                out[((k * c1 + a1) * I2 + y * c2 + i) * I3 + x * c3 + j] = errors[o];
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Max pooling of one sequence (L x C) by c1 steps, with the inner
+ * loops over the C contiguous channels, recording the step of the maximum
+ * of each window in a, if not nullptr, in the best version for the
+ * processor.
+ */
+template <typename T>
+DLL_MULTIVERSION void max_pool_1d_argmax_sample(const T* in, T* out, uint8_t* a, size_t L, size_t C, size_t c1) {
+    const size_t O = L / c1;
+
+    for (size_t o = 0; o < O; ++o) {
+        const T* window = in + o * c1 * C;
+        T* out_o        = out + o * C;
+
+        std::copy(window, window + C, out_o);
+
+        if (a) {
+            std::fill(a + o * C, a + (o + 1) * C, uint8_t(0));
+        }
+
+        for (size_t p = 1; p < c1; ++p) {
+            const T* row = window + p * C;
+
+            if (a) {
+                uint8_t* a_o = a + o * C;
+
+                for (size_t c = 0; c < C; ++c) {
+                    if (row[c] > out_o[c]) {
+                        out_o[c] = row[c];
+                        a_o[c]   = uint8_t(p);
+                    }
+                }
+            } else {
+                for (size_t c = 0; c < C; ++c) {
+                    out_o[c] = std::max(out_o[c], row[c]);
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Scatter the errors of one pooled sequence to the recorded step of
+ * their maximum in the errors of the input (L x C), the other steps being
+ * set to zero.
+ */
+template <typename T>
+void max_pool_1d_argmax_scatter_sample(const T* errors, T* out, const uint8_t* a, size_t L, size_t C, size_t c1) {
+    const size_t O = L / c1;
+
+    std::fill(out, out + L * C, T(0));
+
+    for (size_t o = 0; o < O; ++o) {
+        for (size_t c = 0; c < C; ++c) {
+            out[(o * c1 + a[o * C + c]) * C + c] = errors[o * C + c];
+        }
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief The position of the maximum of each window of the last training
+ * forward pass of a max pooling layer, as an offset inside the window.
+ */
+struct pooling_argmax {
+    std::vector<uint8_t> offsets; ///< The offset of the maximum of each output
+
+    /*!
+     * \brief Indicates if the offsets have been recorded for output of the
+     * same size as the given errors
+     */
+    template <typename E>
+    bool matches(const E& errors) const {
+        return offsets.size() == etl::size(errors);
+    }
+};
+
+/*!
+ * \brief Max pooling of the last three dimensions of the input by
+ * (c1, c2, c3), recording the position of the maximum of each window.
+ *
+ * The 2D pooling corresponds to c1 = 1. When several values are equal to
+ * the maximum, the first one is recorded.
+ *
+ * \param output The output (... x I1 / c1 x I2 / c2 x I3 / c3)
+ * \param input The input (... x I1 x I2 x I3)
+ * \param argmax The position of the maximums, to fill
+ */
+template <typename Output, typename Input>
+void max_pool_argmax_forward(Output&& output, const Input& input, size_t c1, size_t c2, size_t c3, pooling_argmax& argmax) {
+    using T = etl::value_t<Input>;
+
+    cpp_assert(c1 * c2 * c3 <= max_argmax_window, "The pooling window is too large for the argmax offsets");
+
+    const size_t D  = etl::dimensions(input);
+    const size_t I1 = etl::dim(input, D - 3);
+    const size_t I2 = etl::dim(input, D - 2);
+    const size_t I3 = etl::dim(input, D - 1);
+
+    const size_t O1 = I1 / c1;
+    const size_t O2 = I2 / c2;
+    const size_t O3 = I3 / c3;
+
+    const size_t N = etl::size(input) / (I1 * I2 * I3);
+
+    cpp_assert(etl::size(output) == N * O1 * O2 * O3, "Invalid dimensions for max_pool_argmax_forward");
+
+    argmax.offsets.resize(N * O1 * O2 * O3);
+
+    input.ensure_cpu_up_to_date();
+
+    const T* in_p = input.memory_start();
+    T* out_p      = output.memory_start();
+    uint8_t* a_p  = argmax.offsets.data();
+
+    detail::max_pool_chunks(N, [=](size_t first, size_t last) {
+        for (size_t n = first; n < last; ++n) {
+            detail::max_pool_argmax_sample(in_p + n * I1 * I2 * I3, out_p + n * O1 * O2 * O3, a_p + n * O1 * O2 * O3, I1, I2, I3, c1, c2, c3);
+        }
+    });
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Backpropagate the errors of a max pooling layer with the recorded
+ * position of the maximums: each error goes to the position of its
+ * maximum, without reading the input again.
+ *
+ * \param output The errors of the input (... x I1 x I2 x I3)
+ * \param errors The errors of the output (... x I1 / c1 x I2 / c2 x I3 / c3)
+ * \param argmax The position of the maximums of the forward pass
+ */
+template <typename Output, typename Errors>
+void max_pool_argmax_backward(Output&& output, const Errors& errors, size_t c1, size_t c2, size_t c3, const pooling_argmax& argmax) {
+    using T = etl::value_t<Errors>;
+
+    cpp_assert(argmax.matches(errors), "The argmax offsets do not match the errors");
+
+    const size_t D  = etl::dimensions(output);
+    const size_t I1 = etl::dim(output, D - 3);
+    const size_t I2 = etl::dim(output, D - 2);
+    const size_t I3 = etl::dim(output, D - 1);
+
+    const size_t O1 = I1 / c1;
+    const size_t O2 = I2 / c2;
+    const size_t O3 = I3 / c3;
+
+    const size_t N = etl::size(output) / (I1 * I2 * I3);
+
+    errors.ensure_cpu_up_to_date();
+
+    const T* e_p       = errors.memory_start();
+    T* out_p           = output.memory_start();
+    const uint8_t* a_p = argmax.offsets.data();
+
+    detail::max_pool_chunks(N, [=](size_t first, size_t last) {
+        for (size_t n = first; n < last; ++n) {
+            detail::max_pool_argmax_scatter_sample(e_p + n * O1 * O2 * O3, out_p + n * I1 * I2 * I3, a_p + n * O1 * O2 * O3, I1, I2, I3, c1, c2, c3);
+        }
+    });
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Max pooling of the sequences of the input (... x L x C) by c1
+ * steps. The sequences are computed in parallel.
+ *
+ * \param output The output (... x L / c1 x C)
+ * \param input The input (... x L x C)
+ * \param c1 The pooling ratio of the steps
+ */
+template <typename Output, typename Input>
+void max_pool_1d_forward(Output&& output, const Input& input, size_t c1) {
+    using T = etl::value_t<Input>;
+
+    const size_t D = etl::dimensions(input);
+    const size_t L = etl::dim(input, D - 2);
+    const size_t C = etl::dim(input, D - 1);
+    const size_t O = L / c1;
+    const size_t N = etl::size(input) / (L * C);
+
+    cpp_assert(etl::size(output) == N * O * C, "Invalid dimensions for max_pool_1d_forward");
+
+    input.ensure_cpu_up_to_date();
+
+    const T* in_p = input.memory_start();
+    T* out_p      = output.memory_start();
+
+    detail::max_pool_chunks(N, [=](size_t first, size_t last) {
+        for (size_t n = first; n < last; ++n) {
+            detail::max_pool_1d_argmax_sample(in_p + n * L * C, out_p + n * O * C, nullptr, L, C, c1);
+        }
+    });
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Max pooling of the sequences of the input (... x L x C) by c1
+ * steps, recording the step of the maximum of each window.
+ *
+ * \param output The output (... x L / c1 x C)
+ * \param input The input (... x L x C)
+ * \param c1 The pooling ratio of the steps
+ * \param argmax The position of the maximums, to fill
+ */
+template <typename Output, typename Input>
+void max_pool_1d_argmax_forward(Output&& output, const Input& input, size_t c1, pooling_argmax& argmax) {
+    using T = etl::value_t<Input>;
+
+    cpp_assert(c1 <= max_argmax_window, "The pooling window is too large for the argmax offsets");
+
+    const size_t D = etl::dimensions(input);
+    const size_t L = etl::dim(input, D - 2);
+    const size_t C = etl::dim(input, D - 1);
+    const size_t O = L / c1;
+    const size_t N = etl::size(input) / (L * C);
+
+    cpp_assert(etl::size(output) == N * O * C, "Invalid dimensions for max_pool_1d_argmax_forward");
+
+    argmax.offsets.resize(N * O * C);
+
+    input.ensure_cpu_up_to_date();
+
+    const T* in_p = input.memory_start();
+    T* out_p      = output.memory_start();
+    uint8_t* a_p  = argmax.offsets.data();
+
+    detail::max_pool_chunks(N, [=](size_t first, size_t last) {
+        for (size_t n = first; n < last; ++n) {
+            detail::max_pool_1d_argmax_sample(in_p + n * L * C, out_p + n * O * C, a_p + n * O * C, L, C, c1);
+        }
+    });
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Backpropagate the errors of a 1D max pooling layer with the
+ * recorded step of the maximums.
+ *
+ * \param output The errors of the input (... x L x C)
+ * \param errors The errors of the output (... x L / c1 x C)
+ * \param c1 The pooling ratio of the steps
+ * \param argmax The position of the maximums of the forward pass
+ */
+template <typename Output, typename Errors>
+void max_pool_1d_argmax_backward(Output&& output, const Errors& errors, size_t c1, const pooling_argmax& argmax) {
+    using T = etl::value_t<Errors>;
+
+    cpp_assert(argmax.matches(errors), "The argmax offsets do not match the errors");
+
+    const size_t D = etl::dimensions(output);
+    const size_t L = etl::dim(output, D - 2);
+    const size_t C = etl::dim(output, D - 1);
+    const size_t O = L / c1;
+    const size_t N = etl::size(output) / (L * C);
+
+    errors.ensure_cpu_up_to_date();
+
+    const T* e_p       = errors.memory_start();
+    T* out_p           = output.memory_start();
+    const uint8_t* a_p = argmax.offsets.data();
+
+    detail::max_pool_chunks(N, [=](size_t first, size_t last) {
+        for (size_t n = first; n < last; ++n) {
+            detail::max_pool_1d_argmax_scatter_sample(e_p + n * O * C, out_p + n * L * C, a_p + n * O * C, L, C, c1);
+        }
+    });
+
+    output.invalidate_gpu();
+}
+
+} //end of dll namespace
@@ -0,0 +1,346 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Accounting of the memory held by the networks, the trainers and
+ * the generators
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a type is a std::unique_ptr or a std::shared_ptr
+ */
+template <typename T>
+struct is_owning_ptr : std::false_type {};
+
+template <typename T, typename D>
+struct is_owning_ptr<std::unique_ptr<T, D>> : std::true_type {};
+
+template <typename T>
+struct is_owning_ptr<std::shared_ptr<T>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a type is a std::vector
+ */
+template <typename T>
+struct is_std_vector : std::false_type {};
+
+template <typename T, typename A>
+struct is_std_vector<std::vector<T, A>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a type is a std::tuple or a std::pair
+ */
+template <typename T>
+struct is_std_tuple : std::false_type {};
+
+template <typename... T>
+struct is_std_tuple<std::tuple<T...>> : std::true_type {};
+
+template <typename T1, typename T2>
+struct is_std_tuple<std::pair<T1, T2>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a type reports its own memory
+ */
+template <typename T, typename Enable = void>
+struct has_memory_bytes : std::false_type {};
+
+template <typename T>
+struct has_memory_bytes<T, std::void_t<decltype(std::declval<const T&>().memory_bytes())>> : std::true_type {};
+
+} //end of namespace detail
+
+/*!
+ * \brief Returns the number of bytes of the values held by the given
+ * object: ETL containers, owning pointers, vectors and tuples of them, or
+ * any type with a memory_bytes() member. The other types count for
+ * nothing.
+ */
+template <typename T>
+size_t memory_bytes(const T& value) {
+    if constexpr (detail::has_memory_bytes<T>::value) {
+        return value.memory_bytes();
+    } else if constexpr (etl::is_etl_value<T>) {
+        return etl::size(value) * sizeof(etl::value_t<T>);
+    } else if constexpr (detail::is_owning_ptr<T>::value) {
+        return value ? memory_bytes(*value) : 0;
+    } else if constexpr (detail::is_std_vector<T>::value) {
+        if constexpr (std::is_arithmetic<typename T::value_type>::value) {
+            return value.capacity() * sizeof(typename T::value_type);
+        } else {
+            size_t bytes = 0;
+
+            for (auto& v : value) {
+                bytes += memory_bytes(v);
+            }
+
+            return bytes;
+        }
+    } else if constexpr (detail::is_std_tuple<T>::value) {
+        return std::apply([](auto&... v) { return (size_t(0) + ... + memory_bytes(v)); }, value);
+    } else {
+        return 0;
+    }
+}
+
+namespace detail {
+
+/*!
+ * \brief Traits to test if a layer exposes its trainable parameters
+ */
+template <typename Layer, typename Enable = void>
+struct has_trainable_parameters : std::false_type {};
+
+template <typename Layer>
+struct has_trainable_parameters<Layer, std::void_t<decltype(std::declval<const Layer&>().trainable_parameters())>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer has weights (w) and hidden biases (b)
+ */
+template <typename Layer, typename Enable = void>
+struct has_wb : std::false_type {};
+
+template <typename Layer>
+struct has_wb<Layer, std::void_t<decltype(std::declval<const Layer&>().w), decltype(std::declval<const Layer&>().b)>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer has visible biases (c)
+ */
+template <typename Layer, typename Enable = void>
+struct has_c : std::false_type {};
+
+template <typename Layer>
+struct has_c<Layer, std::void_t<decltype(std::declval<const Layer&>().c)>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer has backups of its weights and hidden biases
+ */
+template <typename Layer, typename Enable = void>
+struct has_bak_wb : std::false_type {};
+
+template <typename Layer>
+struct has_bak_wb<Layer, std::void_t<decltype(std::declval<const Layer&>().bak_w), decltype(std::declval<const Layer&>().bak_b)>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer has a backup of its visible biases
+ */
+template <typename Layer, typename Enable = void>
+struct has_bak_c : std::false_type {};
+
+template <typename Layer>
+struct has_bak_c<Layer, std::void_t<decltype(std::declval<const Layer&>().bak_c)>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer reports the memory of its backups
+ */
+template <typename Layer, typename Enable = void>
+struct has_backup_bytes : std::false_type {};
+
+template <typename Layer>
+struct has_backup_bytes<Layer, std::void_t<decltype(std::declval<const Layer&>().backup_bytes())>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer reports the memory of its caches
+ */
+template <typename Layer, typename Enable = void>
+struct has_cache_bytes : std::false_type {};
+
+template <typename Layer>
+struct has_cache_bytes<Layer, std::void_t<decltype(std::declval<const Layer&>().cache_bytes())>> : std::true_type {};
+
+} //end of namespace detail
+
+/*!
+ * \brief Returns the number of bytes of the parameters of the given layer
+ */
+template <typename Layer>
+size_t layer_weights_bytes(const Layer& layer) {
+    size_t bytes = 0;
+
+    if constexpr (detail::has_trainable_parameters<Layer>::value) {
+        bytes += memory_bytes(layer.trainable_parameters());
+    } else if constexpr (detail::has_wb<Layer>::value) {
+        bytes += memory_bytes(layer.w) + memory_bytes(layer.b);
+
+        if constexpr (detail::has_c<Layer>::value) {
+            bytes += memory_bytes(layer.c);
+        }
+    }
+
+    return bytes;
+}
+
+/*!
+ * \brief Returns the number of bytes of the backups of the parameters of the
+ * given layer (backup_weights)
+ */
+template <typename Layer>
+size_t layer_backup_bytes(const Layer& layer) {
+    size_t bytes = 0;
+
+    if constexpr (detail::has_backup_bytes<Layer>::value) {
+        return layer.backup_bytes();
+    }
+
+    if constexpr (detail::has_bak_wb<Layer>::value) {
+        bytes += memory_bytes(layer.bak_w) + memory_bytes(layer.bak_b);
+    }
+
+    if constexpr (detail::has_bak_c<Layer>::value) {
+        bytes += memory_bytes(layer.bak_c);
+    }
+
+    return bytes;
+}
+
+/*!
+ * \brief Returns the number of bytes of the caches of the given layer
+ */
+template <typename Layer>
+size_t layer_cache_bytes(const Layer& layer) {
+    if constexpr (detail::has_cache_bytes<Layer>::value) {
+        return layer.cache_bytes();
+    } else {
+        return 0;
+    }
+}
+
+/*!
+ * \brief Returns the largest total of all the memory reports
+ */
+inline std::atomic<size_t>& memory_peak() {
+    static std::atomic<size_t> peak{0};
+    return peak;
+}
+
+/*!
+ * \brief A report of the memory held by the parts of a training
+ */
+struct memory_report {
+    /*!
+     * \brief One part of the report
+     */
+    struct entry {
+        std::string name; ///< The name of the part
+        size_t bytes;     ///< The number of bytes held by the part
+    };
+
+    std::vector<entry> entries; ///< The parts of the report
+
+    /*!
+     * \brief Add a part to the report, if it holds some memory
+     */
+    void add(std::string name, size_t bytes) {
+        if (bytes) {
+            entries.push_back({std::move(name), bytes});
+        }
+    }
+
+    /*!
+     * \brief Returns the total number of bytes of the report
+     */
+    size_t total() const {
+        size_t bytes = 0;
+
+        for (auto& e : entries) {
+            bytes += e.bytes;
+        }
+
+        return bytes;
+    }
+
+    /*!
+     * \brief Returns the total of the entries whose name starts with the given prefix
+     */
+    size_t total(const std::string& prefix) const {
+        size_t bytes = 0;
+
+        for (auto& e : entries) {
+            if (!e.name.compare(0, prefix.size(), prefix)) {
+                bytes += e.bytes;
+            }
+        }
+
+        return bytes;
+    }
+
+    /*!
+     * \brief Update the peak of the reports with the total of this one
+     * \return The peak
+     */
+    size_t record_peak() const {
+        const size_t bytes = total();
+
+        auto& peak   = memory_peak();
+        size_t value = peak.load(std::memory_order_relaxed);
+
+        while (value < bytes && !peak.compare_exchange_weak(value, bytes, std::memory_order_relaxed)) {}
+
+        return std::max(value, bytes);
+    }
+
+    /*!
+     * \brief Returns a human readable size
+     */
+    static std::string bytes_str(size_t bytes) {
+        char buffer[64];
+
+        if (bytes >= (size_t(1) << 30)) {
+            snprintf(buffer, 64, "%.2fGiB", bytes / double(size_t(1) << 30));
+        } else if (bytes >= (size_t(1) << 20)) {
+            snprintf(buffer, 64, "%.2fMiB", bytes / double(size_t(1) << 20));
+        } else if (bytes >= (size_t(1) << 10)) {
+            snprintf(buffer, 64, "%.2fKiB", bytes / double(size_t(1) << 10));
+        } else {
+            snprintf(buffer, 64, "%luB", bytes);
+        }
+
+        return buffer;
+    }
+
+    /*!
+     * \brief Display the report on the given stream (or output policy)
+     */
+    template <typename Stream>
+    Stream& display(Stream& os) const {
+        size_t length = 5;
+
+        for (auto& e : entries) {
+            length = std::max(length, e.name.size());
+        }
+
+        for (auto& e : entries) {
+            os << "  " << e.name << std::string(length - e.name.size(), ' ') << " : " << bytes_str(e.bytes) << '\n';
+        }
+
+        os << "  Total" << std::string(length - 5, ' ') << " : " << bytes_str(total()) << " (peak " << bytes_str(std::max(total(), memory_peak().load())) << ")\n";
+
+        return os;
+    }
+};
+
+} //end of dll namespace
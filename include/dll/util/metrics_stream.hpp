@@ -0,0 +1,515 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Stream of training metrics as JSON lines, formatted and written
+ * by a background thread
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "dll/generators/generator_stats.hpp"
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The kind of a metrics record
+ */
+enum class metrics_kind {
+    TRAINING_BEGIN, ///< The fine-tuning started
+    EPOCH,          ///< A fine-tuning epoch ended
+    BATCH,          ///< A fine-tuning batch ended
+    TRAINING_END,   ///< The fine-tuning ended
+    RBM_EPOCH,      ///< A pretraining epoch of a RBM ended
+    RBM_BATCH       ///< A pretraining batch of a RBM ended
+};
+
+/*!
+ * \brief Returns the name of the given kind of record
+ */
+inline const char* to_string(metrics_kind kind) {
+    switch (kind) {
+        case metrics_kind::TRAINING_BEGIN:
+            return "training_begin";
+        case metrics_kind::EPOCH:
+            return "epoch";
+        case metrics_kind::BATCH:
+            return "batch";
+        case metrics_kind::TRAINING_END:
+            return "training_end";
+        case metrics_kind::RBM_EPOCH:
+            return "rbm_epoch";
+        case metrics_kind::RBM_BATCH:
+            return "rbm_batch";
+    }
+
+    return "unknown";
+}
+
+/*!
+ * \brief The cumulative value of a timer in a metrics record
+ */
+struct metrics_timer {
+    const char* name = nullptr; ///< The name of the timer
+    size_t count     = 0;       ///< The number of calls
+    size_t duration  = 0;       ///< The total duration (ns)
+};
+
+/*!
+ * \brief One record of the metrics stream, captured by the training thread
+ * and formatted by the writer thread
+ */
+struct metrics_record {
+    metrics_kind kind = metrics_kind::EPOCH; ///< The kind of the record
+    double time       = 0.0;                 ///< The time of the record, in seconds since the opening of the stream
+
+    size_t epoch      = 0; ///< The epoch
+    size_t max_epochs = 0; ///< The maximum number of epochs
+    size_t batch      = 0; ///< The batch (batch records)
+    size_t batches    = 0; ///< The number of batches of the epoch
+    size_t samples    = 0; ///< The number of samples of the epoch or the batch
+    size_t duration   = 0; ///< The duration of the epoch or the batch (ms)
+
+    double error     = 0.0; ///< The training error (reconstruction error for a RBM)
+    double loss      = 0.0; ///< The training loss (free energy for a RBM)
+    double val_error = 0.0; ///< The validation error
+    double val_loss  = 0.0; ///< The validation loss
+    double sparsity  = 0.0; ///< The sparsity (RBM)
+
+    bool validation = false; ///< Indicates if the validation metrics are set
+    bool has_stats  = false; ///< Indicates if the generator statistics are set
+
+    size_t val_batches       = 0; ///< The number of evaluated validation batches
+    size_t val_total_batches = 0; ///< The total number of validation batches
+
+    generator_stats stats;             ///< The statistics of the training generator
+    std::vector<metrics_timer> timers; ///< The cumulative timers (epoch and end records)
+};
+
+/*!
+ * \brief A stream of metrics records written as JSON lines to a file or a
+ * TCP socket.
+ *
+ * The training thread only enqueues the raw records, the formatting and
+ * the I/O are done by a background thread. The queue is bounded: when the
+ * writer falls behind, the records are dropped (and counted) rather than
+ * blocking the training.
+ */
+struct metrics_stream {
+    static constexpr size_t max_pending = 1 << 16; ///< The maximum number of records waiting to be written
+
+    metrics_stream() : start(std::chrono::steady_clock::now()) {}
+
+    metrics_stream(const metrics_stream& rhs) = delete;
+    metrics_stream& operator=(const metrics_stream& rhs) = delete;
+
+    /*!
+     * \brief Write the pending records and close the stream
+     */
+    ~metrics_stream() {
+        close();
+    }
+
+    /*!
+     * \brief Open the stream on the given file
+     * \param path The path of the file
+     * \param append Indicates if the records are appended to an existing file
+     * \return true if the file was opened, false otherwise
+     */
+    bool open_file(const std::string& path, bool append = false) {
+        close();
+
+        file.open(path, append ? std::ios::app : std::ios::trunc);
+
+        if (!file) {
+            std::cerr << "ERROR: Impossible to open the metrics file " << path << std::endl;
+            return false;
+        }
+
+        launch();
+
+        return true;
+    }
+
+    /*!
+     * \brief Open the stream on a TCP connection to the given host
+     * \param host The host of the collector
+     * \param port The port of the collector
+     * \return true if the connection was established, false otherwise
+     */
+    bool open_socket(const std::string& host, uint16_t port) {
+        close();
+
+        addrinfo hints{};
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo* result = nullptr;
+
+        if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+            std::cerr << "ERROR: Impossible to resolve the metrics host " << host << std::endl;
+            return false;
+        }
+
+        for (auto* addr = result; addr && socket < 0; addr = addr->ai_next) {
+            socket = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+
+            if (socket >= 0 && ::connect(socket, addr->ai_addr, addr->ai_addrlen) < 0) {
+                ::close(socket);
+                socket = -1;
+            }
+        }
+
+        ::freeaddrinfo(result);
+
+        if (socket < 0) {
+            std::cerr << "ERROR: Impossible to connect to the metrics collector " << host << ":" << port << std::endl;
+            return false;
+        }
+
+        launch();
+
+        return true;
+    }
+
+    /*!
+     * \brief Indicates if the stream is open
+     */
+    bool is_open() const {
+        return writer.joinable();
+    }
+
+    /*!
+     * \brief Enqueue a record, without waiting for its writing
+     * \param record The record to write
+     */
+    void push(metrics_record&& record) {
+        const auto now = std::chrono::steady_clock::now();
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+
+            record.time = std::chrono::duration<double>(now - start).count();
+
+            if (!writer.joinable() || queue.size() >= max_pending) {
+                ++dropped;
+                return;
+            }
+
+            queue.push_back(std::move(record));
+        }
+
+        ready.notify_one();
+    }
+
+    /*!
+     * \brief Wait until all the enqueued records are written
+     */
+    void flush() {
+        std::unique_lock<std::mutex> l(lock);
+        drained.wait(l, [this] { return queue.empty() && !writing; });
+    }
+
+    /*!
+     * \brief Write the pending records and close the stream
+     */
+    void close() {
+        if (writer.joinable()) {
+            {
+                std::lock_guard<std::mutex> l(lock);
+                stopping = true;
+            }
+
+            ready.notify_one();
+            writer.join();
+        }
+
+        if (file.is_open()) {
+            file.close();
+        }
+
+        if (socket >= 0) {
+            ::close(socket);
+            socket = -1;
+        }
+
+        stopping = false;
+    }
+
+    /*!
+     * \brief Returns the number of records that were dropped
+     */
+    size_t dropped_records() const {
+        std::lock_guard<std::mutex> l(lock);
+        return dropped;
+    }
+
+    /*!
+     * \brief Format a record as one JSON line
+     * \param record The record
+     * \param previous The timers of the previous record with timers, updated with the ones of this record
+     * \param dropped The number of records dropped so far
+     */
+    static std::string format(const metrics_record& record, std::unordered_map<const char*, metrics_timer>& previous, size_t dropped) {
+        std::string line;
+        line.reserve(256);
+
+        line += "{\"type\": \"";
+        line += to_string(record.kind);
+        line += "\"";
+
+        auto field = [&line](const char* name, double value) {
+            char buffer[64];
+
+            if (std::isfinite(value)) {
+                snprintf(buffer, 64, ", \"%s\": %.9g", name, value);
+            } else {
+                snprintf(buffer, 64, ", \"%s\": null", name);
+            }
+
+            line += buffer;
+        };
+
+        auto count = [&line](const char* name, size_t value) {
+            line += ", \"";
+            line += name;
+            line += "\": ";
+            line += std::to_string(value);
+        };
+
+        field("time", record.time);
+        count("epoch", record.epoch);
+
+        switch (record.kind) {
+            case metrics_kind::TRAINING_BEGIN:
+                count("max_epochs", record.max_epochs);
+                break;
+
+            case metrics_kind::BATCH:
+            case metrics_kind::RBM_BATCH:
+                count("batch", record.batch);
+                count("batches", record.batches);
+                break;
+
+            default:
+                count("batches", record.batches);
+                break;
+        }
+
+        if (record.kind == metrics_kind::RBM_EPOCH || record.kind == metrics_kind::RBM_BATCH) {
+            field("reconstruction_error", record.error);
+            field("free_energy", record.loss);
+            field("sparsity", record.sparsity);
+        } else if (record.kind != metrics_kind::TRAINING_BEGIN) {
+            field("error", record.error);
+            field("loss", record.loss);
+        }
+
+        if (record.validation) {
+            field("val_error", record.val_error);
+            field("val_loss", record.val_loss);
+            count("val_batches", record.val_batches);
+            count("val_total_batches", record.val_total_batches);
+        }
+
+        if (record.duration || record.samples) {
+            count("duration_ms", record.duration);
+            count("samples", record.samples);
+            field("samples_per_second", record.duration ? 1000.0 * record.samples / record.duration : 0.0);
+        }
+
+        if (record.has_stats) {
+            auto& s = record.stats;
+
+            line += ", \"generator\": {\"batches\": " + std::to_string(s.batches)
+                  + ", \"consumer_wait_us\": " + std::to_string(s.consumer_wait)
+                  + ", \"producer_wait_us\": " + std::to_string(s.producer_wait)
+                  + ", \"crop_mirror_us\": " + std::to_string(s.crop_mirror)
+                  + ", \"pre_transform_us\": " + std::to_string(s.pre_transform)
+                  + ", \"distortion_us\": " + std::to_string(s.distortion)
+                  + ", \"noise_us\": " + std::to_string(s.noise) + "}";
+        }
+
+        // The timers are reported as the increments since the previous record
+
+        if (!record.timers.empty()) {
+            line += ", \"timers\": {";
+
+            bool first = true;
+
+            for (auto& timer : record.timers) {
+                if (!timer.name) {
+                    continue;
+                }
+
+                auto& last = previous[timer.name];
+
+                const size_t calls    = timer.count - std::min(timer.count, last.count);
+                const size_t duration = timer.duration - std::min(timer.duration, last.duration);
+
+                last = timer;
+
+                if (!calls) {
+                    continue;
+                }
+
+                line += first ? "\"" : ", \"";
+                line += timer.name;
+                line += "\": {\"count\": " + std::to_string(calls) + ", \"duration_ns\": " + std::to_string(duration) + "}";
+
+                first = false;
+            }
+
+            line += "}";
+        }
+
+        if (dropped) {
+            count("dropped", dropped);
+        }
+
+        line += "}\n";
+
+        return line;
+    }
+
+private:
+    /*!
+     * \brief Start the writer thread
+     */
+    void launch() {
+        std::lock_guard<std::mutex> l(lock);
+
+        start  = std::chrono::steady_clock::now();
+        writer = std::thread([this] { run(); });
+    }
+
+    /*!
+     * \brief The loop of the writer thread
+     */
+    void run() {
+        std::unordered_map<const char*, metrics_timer> previous;
+
+        std::unique_lock<std::mutex> l(lock);
+
+        while (true) {
+            ready.wait(l, [this] { return stopping || !queue.empty(); });
+
+            if (queue.empty()) {
+                break;
+            }
+
+            auto record = std::move(queue.front());
+            queue.pop_front();
+
+            writing = true;
+
+            const size_t lost = dropped;
+
+            l.unlock();
+
+            write(format(record, previous, lost));
+
+            l.lock();
+
+            writing = false;
+
+            if (queue.empty()) {
+                drained.notify_all();
+            }
+        }
+
+        drained.notify_all();
+    }
+
+    /*!
+     * \brief Write a line to the file or the socket
+     */
+    void write(const std::string& line) {
+        if (file.is_open()) {
+            file << line;
+            file.flush();
+        } else if (socket >= 0) {
+            const char* p = line.data();
+            size_t bytes  = line.size();
+
+            while (bytes) {
+                auto sent = ::send(socket, p, bytes, MSG_NOSIGNAL);
+
+                if (sent <= 0) {
+                    std::cerr << "ERROR: The metrics collector closed the connection" << std::endl;
+                    ::close(socket);
+                    socket = -1;
+                    return;
+                }
+
+                p += sent;
+                bytes -= sent;
+            }
+        }
+    }
+
+    std::chrono::steady_clock::time_point start; ///< The opening of the stream
+
+    std::ofstream file; ///< The file of the stream, if any
+    int socket = -1;    ///< The socket of the stream, if any
+
+    std::thread writer;                ///< The writer thread
+    mutable std::mutex lock;           ///< The lock protecting the queue
+    std::condition_variable ready;     ///< Signals the writer that records are ready
+    std::condition_variable drained;   ///< Signals that all the records were written
+    std::deque<metrics_record> queue;  ///< The records waiting to be written
+    size_t dropped = 0;                ///< The number of dropped records
+    bool writing   = false;            ///< Indicates if the writer is writing a record
+    bool stopping  = false;            ///< Indicates that the writer must stop once the queue is empty
+};
+
+/*!
+ * \brief Returns the metrics stream of the process, used by the JSON watchers
+ */
+inline metrics_stream& get_metrics_stream() {
+    static metrics_stream stream;
+    return stream;
+}
+
+/*!
+ * \brief Returns a snapshot of the timers for a metrics record (empty if
+ * the timers are disabled)
+ */
+inline std::vector<metrics_timer> metrics_timers() {
+    std::vector<metrics_timer> timers;
+
+#ifndef DLL_NO_TIMERS
+    for (auto& timer : get_timers().snapshot()) {
+        timers.push_back({timer.name, timer.count, timer.duration});
+    }
+#endif
+
+    return timers;
+}
+
+} //end of dll namespace
@@ -0,0 +1,388 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Self-describing and compressed model file format
+ *
+ * A header (model_file_header) is followed by one tensor per layer of the
+ * network. Each tensor starts with a model_tensor_header, followed by the
+ * checksums of its chunks and by its encoded values. The values are
+ * encoded and decoded in chunks of model_chunk_values values, in parallel
+ * on the scoped thread pool.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpp_utils/maybe_parallel.hpp"
+
+#include "dll/util/quantize.hpp"
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The encoding of the values of a tensor of a model file
+ */
+enum class model_encoding : uint32_t {
+    RAW  = 0, ///< The values are stored with their own type
+    FP16 = 1, ///< The values are stored in IEEE half precision
+    INT8 = 2  ///< The values are stored in int8, with a scale per tensor
+};
+
+/*!
+ * \brief The magic identifier of a model file
+ */
+constexpr char model_file_magic[8] = {'D', 'L', 'L', 'M', 'O', 'D', 'E', 'L'};
+
+/*!
+ * \brief The current version of the model file format
+ */
+constexpr uint32_t model_file_version = 1;
+
+/*!
+ * \brief The number of values of each chunk of a tensor
+ */
+constexpr size_t model_chunk_values = 1 << 16;
+
+/*!
+ * \brief The header of a model file
+ */
+struct model_file_header {
+    char magic[8];    ///< The magic identifier of the format
+    uint32_t version; ///< The version of the format
+    uint32_t dtype;   ///< The size in bytes of one value of the network
+    uint64_t tensors; ///< The number of tensors (one per layer)
+};
+
+/*!
+ * \brief The header of one tensor of a model file
+ */
+struct model_tensor_header {
+    uint64_t elements; ///< The number of values
+    uint32_t encoding; ///< The encoding of the values
+    uint32_t chunks;   ///< The number of chunks
+    double scale;      ///< The scale of the int8 encoding
+    uint64_t bytes;    ///< The size of the encoded values, in bytes
+};
+
+namespace detail {
+
+/*!
+ * \brief Convert a float to IEEE half precision, with rounding to nearest
+ * even
+ */
+inline uint16_t float_to_half(float value) {
+    uint32_t raw;
+    std::memcpy(&raw, &value, sizeof(float));
+
+    const uint32_t sign = (raw >> 16) & 0x8000u;
+    const uint32_t abs  = raw & 0x7FFFFFFFu;
+
+    // NaN
+    if (abs > 0x7F800000u) {
+        return uint16_t(sign | 0x7E00u);
+    }
+
+    // Larger than the largest half (after rounding)
+    if (abs >= 0x477FF000u) {
+        return uint16_t(sign | 0x7C00u);
+    }
+
+    // Subnormal half, the scaling by 2^24 is exact
+    if (abs < 0x38800000u) {
+        return uint16_t(sign | uint32_t(std::nearbyint(std::fabs(value) * 16777216.0f)));
+    }
+
+    return uint16_t(sign | ((abs - 0x38000000u + 0xFFFu + ((abs >> 13) & 1u)) >> 13));
+}
+
+/*!
+ * \brief Convert an IEEE half precision value to float
+ */
+inline float half_to_float(uint16_t half) {
+    const uint32_t sign     = uint32_t(half & 0x8000u) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1Fu;
+    const uint32_t mantissa = half & 0x3FFu;
+
+    if (exponent == 0) {
+        const float value = std::ldexp(float(mantissa), -24);
+        return sign ? -value : value;
+    }
+
+    uint32_t raw;
+
+    if (exponent == 31) {
+        raw = sign | 0x7F800000u | (mantissa << 13);
+    } else {
+        raw = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &raw, sizeof(float));
+    return value;
+}
+
+/*!
+ * \brief Returns the FNV-1a checksum of the given bytes
+ */
+inline uint64_t model_checksum(const char* bytes, size_t n) {
+    uint64_t hash = 14695981039346656037ull;
+
+    for (size_t i = 0; i < n; ++i) {
+        hash ^= uint8_t(bytes[i]);
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+/*!
+ * \brief Returns the size in bytes of one encoded value
+ */
+template <typename T>
+size_t model_value_size(model_encoding encoding) {
+    switch (encoding) {
+        case model_encoding::FP16:
+            return sizeof(uint16_t);
+        case model_encoding::INT8:
+            return sizeof(int8_t);
+        default:
+            return sizeof(T);
+    }
+}
+
+/*!
+ * \brief Call functor(c) for each of the given chunks, on the scoped
+ * thread pool if there is one.
+ */
+template <typename Functor>
+void model_chunks(size_t chunks, Functor&& functor) {
+    auto* pool = scoped_thread_pool();
+
+    if (pool && chunks > 1) {
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, functor);
+    } else {
+        for (size_t c = 0; c < chunks; ++c) {
+            functor(c);
+        }
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Write the header of a model file
+ * \param os The output stream
+ * \param dtype The size in bytes of one value of the network
+ * \param tensors The number of tensors of the file
+ */
+inline void write_model_header(std::ostream& os, size_t dtype, size_t tensors) {
+    model_file_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, model_file_magic, sizeof(header.magic));
+
+    header.version = model_file_version;
+    header.dtype   = dtype;
+    header.tensors = tensors;
+
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+/*!
+ * \brief Read and validate the header of a model file
+ * \param is The input stream
+ * \param dtype The expected size in bytes of one value of the network
+ * \param tensors The expected number of tensors
+ * \return true if the header is valid, false otherwise
+ */
+inline bool read_model_header(std::istream& is, size_t dtype, size_t tensors) {
+    model_file_header header;
+
+    if (!is.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        std::cerr << "ERROR: Truncated model file" << std::endl;
+        return false;
+    }
+
+    if (std::memcmp(header.magic, model_file_magic, sizeof(header.magic)) != 0 || header.version != model_file_version) {
+        std::cerr << "ERROR: Incompatible model file" << std::endl;
+        return false;
+    }
+
+    if (header.dtype != dtype) {
+        std::cerr << "ERROR: The model file has values of " << header.dtype << " bytes, expected " << dtype << std::endl;
+        return false;
+    }
+
+    if (header.tensors != tensors) {
+        std::cerr << "ERROR: The model file has " << header.tensors << " layers, expected " << tensors << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Encode and write one tensor of a model file
+ * \param os The output stream
+ * \param values The values of the tensor
+ * \param n The number of values
+ * \param encoding The encoding of the values
+ */
+template <typename T>
+void write_model_tensor(std::ostream& os, const T* values, size_t n, model_encoding encoding) {
+    const size_t width  = detail::model_value_size<T>(encoding);
+    const size_t chunks = (n + model_chunk_values - 1) / model_chunk_values;
+
+    auto chunk_first = [](size_t c) { return c * model_chunk_values; };
+    auto chunk_last  = [n](size_t c) { return std::min(n, (c + 1) * model_chunk_values); };
+
+    T scale(1);
+
+    if (encoding == model_encoding::INT8) {
+        std::vector<T> maxima(chunks, T(0));
+
+        detail::model_chunks(chunks, [&](size_t c) {
+            for (size_t i = chunk_first(c); i < chunk_last(c); ++i) {
+                maxima[c] = std::max(maxima[c], T(std::abs(values[i])));
+            }
+        });
+
+        scale = quantization_scale(maxima.empty() ? T(0) : *std::max_element(maxima.begin(), maxima.end()));
+    }
+
+    std::string payload(n * width, '\0');
+    std::vector<uint64_t> checksums(chunks);
+
+    detail::model_chunks(chunks, [&](size_t c) {
+        char* out = &payload[0] + chunk_first(c) * width;
+
+        for (size_t i = chunk_first(c); i < chunk_last(c); ++i) {
+            if (encoding == model_encoding::FP16) {
+                const uint16_t half = detail::float_to_half(float(values[i]));
+                std::memcpy(out + (i - chunk_first(c)) * width, &half, width);
+            } else if (encoding == model_encoding::INT8) {
+                out[i - chunk_first(c)] = char(detail::quantize_value(values[i], T(1) / scale));
+            } else {
+                std::memcpy(out + (i - chunk_first(c)) * width, &values[i], width);
+            }
+        }
+
+        checksums[c] = detail::model_checksum(out, (chunk_last(c) - chunk_first(c)) * width);
+    });
+
+    model_tensor_header header;
+    std::memset(&header, 0, sizeof(header));
+
+    header.elements = n;
+    header.encoding = uint32_t(encoding);
+    header.chunks   = chunks;
+    header.scale    = scale;
+    header.bytes    = payload.size();
+
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    os.write(reinterpret_cast<const char*>(checksums.data()), checksums.size() * sizeof(uint64_t));
+    os.write(payload.data(), payload.size());
+}
+
+/*!
+ * \brief Read, verify and decode one tensor of a model file
+ * \param is The input stream
+ * \param values The decoded values
+ * \param expected The expected number of values
+ * \return true if the tensor is valid, false otherwise
+ */
+template <typename T>
+bool read_model_tensor(std::istream& is, std::vector<T>& values, size_t expected) {
+    model_tensor_header header;
+
+    if (!is.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        std::cerr << "ERROR: Truncated model file" << std::endl;
+        return false;
+    }
+
+    if (header.elements != expected) {
+        std::cerr << "ERROR: The tensor of the model file has " << header.elements << " values, expected " << expected << std::endl;
+        return false;
+    }
+
+    const auto encoding = model_encoding(header.encoding);
+
+    if (encoding != model_encoding::RAW && encoding != model_encoding::FP16 && encoding != model_encoding::INT8) {
+        std::cerr << "ERROR: Unknown encoding in the model file" << std::endl;
+        return false;
+    }
+
+    const size_t n      = expected;
+    const size_t width  = detail::model_value_size<T>(encoding);
+    const size_t chunks = (n + model_chunk_values - 1) / model_chunk_values;
+
+    if (header.chunks != chunks || header.bytes != n * width) {
+        std::cerr << "ERROR: Invalid tensor in the model file" << std::endl;
+        return false;
+    }
+
+    std::vector<uint64_t> checksums(chunks);
+    std::string payload(n * width, '\0');
+
+    is.read(reinterpret_cast<char*>(checksums.data()), checksums.size() * sizeof(uint64_t));
+    is.read(&payload[0], payload.size());
+
+    if (!is) {
+        std::cerr << "ERROR: Truncated model file" << std::endl;
+        return false;
+    }
+
+    values.resize(n);
+
+    const T scale(header.scale);
+
+    std::vector<int> valid(chunks, 1);
+
+    detail::model_chunks(chunks, [&](size_t c) {
+        const size_t first = c * model_chunk_values;
+        const size_t last  = std::min(n, (c + 1) * model_chunk_values);
+
+        const char* in = payload.data() + first * width;
+
+        if (detail::model_checksum(in, (last - first) * width) != checksums[c]) {
+            valid[c] = 0;
+            return;
+        }
+
+        for (size_t i = first; i < last; ++i) {
+            if (encoding == model_encoding::FP16) {
+                uint16_t half;
+                std::memcpy(&half, in + (i - first) * width, width);
+                values[i] = T(detail::half_to_float(half));
+            } else if (encoding == model_encoding::INT8) {
+                values[i] = T(int8_t(in[i - first])) * scale;
+            } else {
+                std::memcpy(&values[i], in + (i - first) * width, width);
+            }
+        }
+    });
+
+    if (std::find(valid.begin(), valid.end(), 0) != valid.end()) {
+        std::cerr << "ERROR: Corrupted tensor in the model file" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+} //end of dll namespace
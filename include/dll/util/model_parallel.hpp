@@ -0,0 +1,316 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Model-parallel kernels of the very wide dense layers.
+ *
+ * The outputs of the layer are split in shards of contiguous columns of the
+ * weights. Each shard is computed by one worker of the thread pool, from its
+ * own contiguous copy of its columns, allocated and filled by this worker
+ * (and therefore local to its NUMA node when the workers are pinned).
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/pool_stats.hpp"        // for maybe_parallel_foreach_n
+#include "dll/util/thread_pool_scope.hpp" // for scoped_thread_pool
+#include "dll/util/transposed_weights.hpp" // for transpose_free_gemm
+
+namespace dll {
+
+constexpr size_t model_parallel_min_columns = 256; ///< The minimum number of columns of a shard
+
+/*!
+ * \brief Returns the number of shards of a layer with the given number of
+ * outputs
+ * \param outputs The number of outputs of the layer
+ * \param shards The configured number of shards (0 for the number of threads)
+ */
+inline size_t model_parallel_shards(size_t outputs, size_t shards) {
+    if (!shards) {
+        shards = etl::threads;
+    }
+
+    return std::max(size_t(1), std::min(shards, outputs / model_parallel_min_columns));
+}
+
+/*!
+ * \brief Cache of the shards of the weights (NV x NH) of a dense layer: the
+ * copies of contiguous blocks of columns.
+ *
+ * Without the BLAS kernels, the transposes of the shards are kept as well,
+ * for the backward pass.
+ *
+ * The cache is computed on first use and must be invalidated when the
+ * weights are modified.
+ */
+template <typename T>
+struct weight_shards {
+    /*!
+     * \brief Returns the shards of the given weights, split in the given
+     * number of shards, each copied by a worker of the given pool
+     */
+    template <typename W>
+    const std::vector<etl::dyn_matrix<T, 2>>& get(cpp::thread_pool<true>& pool, const W& w, size_t shards) {
+        std::lock_guard<std::mutex> l(lock);
+
+        const size_t NV = etl::dim<0>(w);
+        const size_t NH = etl::dim<1>(w);
+
+        if (!valid || columns.size() != shards + 1 || columns.back() != NH || (shards && etl::dim<0>(w_shards[0]) != NV)) {
+            columns.resize(shards + 1);
+
+            for (size_t s = 0; s <= shards; ++s) {
+                columns[s] = (s * NH) / shards;
+            }
+
+            w_shards.resize(shards);
+            t_shards.resize(transpose_free_gemm ? 0 : shards);
+
+            w.ensure_cpu_up_to_date();
+
+            const T* w_p = w.memory_start();
+
+            dll::maybe_parallel_foreach_n(pool, 0, shards, [&](size_t s) {
+                const size_t first = columns[s];
+                const size_t n     = columns[s + 1] - first;
+
+                // Allocated by the worker, for the first touch of its pages
+                if (etl::dim<0>(w_shards[s]) != NV || etl::dim<1>(w_shards[s]) != n) {
+                    w_shards[s] = etl::dyn_matrix<T, 2>(NV, n);
+                }
+
+                T* s_p = w_shards[s].memory_start();
+
+                for (size_t i = 0; i < NV; ++i) {
+                    std::copy(w_p + i * NH + first, w_p + i * NH + first + n, s_p + i * n);
+                }
+
+                w_shards[s].invalidate_gpu();
+
+                if constexpr (!transpose_free_gemm) {
+                    SERIAL_SECTION {
+                        t_shards[s] = etl::dyn_matrix<T, 2>(n, NV);
+                        t_shards[s] = etl::transpose(w_shards[s]);
+                    }
+                }
+            });
+
+            valid = true;
+        }
+
+        return w_shards;
+    }
+
+    /*!
+     * \brief Returns the transpose of the given shard, only computed without
+     * the BLAS kernels
+     */
+    const etl::dyn_matrix<T, 2>& transposed(size_t s) const {
+        return t_shards[s];
+    }
+
+    /*!
+     * \brief Returns the first column of the given shard (the number of
+     * columns for the number of shards)
+     */
+    size_t first(size_t s) const {
+        return columns[s];
+    }
+
+    /*!
+     * \brief Invalidate the cache, after a modification of the weights
+     */
+    void invalidate() {
+        std::lock_guard<std::mutex> l(lock);
+        valid = false;
+    }
+
+private:
+    std::vector<etl::dyn_matrix<T, 2>> w_shards; ///< The shards of the weights
+    std::vector<etl::dyn_matrix<T, 2>> t_shards; ///< The transposed shards of the weights
+    std::vector<size_t> columns;                 ///< The first column of each shard, then the number of columns
+    bool valid = false;                          ///< Indicates if the shards are up to date
+    std::mutex lock;                             ///< The lock for concurrent uses of the layer
+};
+
+namespace detail {
+
+/*!
+ * \brief Copy the columns [first, first + n) of the given matrix (B x N)
+ * into the given contiguous matrix (B x n)
+ */
+template <typename T>
+void gather_columns(const T* in, size_t B, size_t N, size_t first, size_t n, T* out) {
+    for (size_t b = 0; b < B; ++b) {
+        std::copy(in + b * N + first, in + b * N + first + n, out + b * n);
+    }
+}
+
+/*!
+ * \brief Copy the given contiguous matrix (B x n) into the columns
+ * [first, first + n) of the given matrix (B x N)
+ */
+template <typename T>
+void scatter_columns(const T* in, size_t B, size_t N, size_t first, size_t n, T* out) {
+    for (size_t b = 0; b < B; ++b) {
+        std::copy(in + b * n, in + b * n + n, out + b * N + first);
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Compute output = input * w, each shard of the columns of the
+ * output by a worker of the pool
+ *
+ * \param input The input (B x NV)
+ * \param w The weights (NV x NH)
+ * \param output The output (B x NH)
+ * \param cache The cache of the shards of the weights
+ * \param shards The number of shards
+ */
+template <typename V, typename W, typename O, typename T>
+void model_parallel_forward(cpp::thread_pool<true>& pool, const V& input, const W& w, O&& output, weight_shards<T>& cache, size_t shards) {
+    auto& ws = cache.get(pool, w, shards);
+
+    const size_t B  = etl::dim<0>(output);
+    const size_t NH = etl::dim<1>(output);
+
+    T* out_p = output.memory_start();
+
+    dll::maybe_parallel_foreach_n(pool, 0, shards, [&](size_t s) {
+        SERIAL_SECTION {
+            const size_t first = cache.first(s);
+            const size_t n     = cache.first(s + 1) - first;
+
+            etl::dyn_matrix<T, 2> out_s(B, n);
+            out_s = input * ws[s];
+
+            out_s.ensure_cpu_up_to_date();
+            detail::scatter_columns(out_s.memory_start(), B, NH, first, n, out_p);
+        }
+    });
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute output = errors * w^T, each worker of the pool computing
+ * the product of its shard before the parallel reduction of the products
+ *
+ * \param errors The errors (B x NH)
+ * \param w The weights (NV x NH)
+ * \param output The output (B x NV)
+ * \param cache The cache of the shards of the weights
+ * \param shards The number of shards
+ */
+template <typename E, typename W, typename O, typename T>
+void model_parallel_backward(cpp::thread_pool<true>& pool, const E& errors, const W& w, O&& output, weight_shards<T>& cache, size_t shards) {
+    auto& ws = cache.get(pool, w, shards);
+
+    const size_t B  = etl::dim<0>(errors);
+    const size_t NH = etl::dim<1>(errors);
+    const size_t NV = etl::dim<0>(w);
+
+    errors.ensure_cpu_up_to_date();
+
+    const T* e_p = errors.memory_start();
+
+    std::vector<etl::dyn_matrix<T, 2>> partial(shards);
+
+    dll::maybe_parallel_foreach_n(pool, 0, shards, [&](size_t s) {
+        SERIAL_SECTION {
+            const size_t first = cache.first(s);
+            const size_t n     = cache.first(s + 1) - first;
+
+            etl::dyn_matrix<T, 2> e_s(B, n);
+            detail::gather_columns(e_p, B, NH, first, n, e_s.memory_start());
+            e_s.invalidate_gpu();
+
+            partial[s] = etl::dyn_matrix<T, 2>(B, NV);
+            if constexpr (transpose_free_gemm) {
+                partial[s] = e_s * etl::transpose(ws[s]);
+            } else {
+                partial[s] = e_s * cache.transposed(s);
+            }
+            partial[s].ensure_cpu_up_to_date();
+        }
+    });
+
+    // Reduction of the products, each worker summing a block of rows
+
+    T* out_p = output.memory_start();
+
+    dll::maybe_parallel_foreach_n(pool, 0, shards, [&](size_t c) {
+        const size_t first = (c * B * NV) / shards;
+        const size_t last  = ((c + 1) * B * NV) / shards;
+
+        std::copy(partial[0].memory_start() + first, partial[0].memory_start() + last, out_p + first);
+
+        for (size_t s = 1; s < shards; ++s) {
+            const T* p_p = partial[s].memory_start();
+
+            for (size_t i = first; i < last; ++i) {
+                out_p[i] += p_p[i];
+            }
+        }
+    });
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the gradients of the weights, grad = input^T * errors,
+ * each worker of the pool computing the columns of its shard
+ *
+ * \param input The input (B x NV)
+ * \param errors The errors (B x NH)
+ * \param grad The gradients of the weights (NV x NH)
+ * \param shards The number of shards
+ */
+template <typename V, typename E, typename G>
+void model_parallel_gradients(cpp::thread_pool<true>& pool, const V& input, const E& errors, G&& grad, size_t shards) {
+    using T = etl::value_t<std::decay_t<G>>;
+
+    const size_t B  = etl::dim<0>(errors);
+    const size_t NH = etl::dim<1>(errors);
+    const size_t NV = etl::dim<0>(grad);
+
+    errors.ensure_cpu_up_to_date();
+
+    const T* e_p = errors.memory_start();
+    T* g_p       = grad.memory_start();
+
+    dll::maybe_parallel_foreach_n(pool, 0, shards, [&](size_t s) {
+        SERIAL_SECTION {
+            const size_t first = (s * NH) / shards;
+            const size_t n     = ((s + 1) * NH) / shards - first;
+
+            etl::dyn_matrix<T, 2> e_s(B, n);
+            detail::gather_columns(e_p, B, NH, first, n, e_s.memory_start());
+            e_s.invalidate_gpu();
+
+            etl::dyn_matrix<T, 2> g_s(NV, n);
+            g_s = etl::batch_outer(input, e_s);
+
+            g_s.ensure_cpu_up_to_date();
+            detail::scatter_columns(g_s.memory_start(), NV, NH, first, n, g_p);
+        }
+    });
+
+    grad.invalidate_gpu();
+}
+
+} //end of namespace dll
@@ -0,0 +1,83 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief MPI transport for the distributed training
+ *
+ * This is only available when DLL_MPI is defined, the program must then be
+ * linked with the MPI library.
+ */
+
+#pragma once
+
+#ifdef DLL_MPI
+
+#include <mpi.h>
+
+#include "dll/util/transport.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A transport using MPI collective operations.
+ *
+ * MPI must be initialized (MPI_Init) before the transport is created.
+ */
+struct mpi_transport final : distributed_transport {
+    /*!
+     * \brief Create a transport over the given communicator
+     * \param comm The MPI communicator
+     */
+    explicit mpi_transport(MPI_Comm comm = MPI_COMM_WORLD) : comm(comm) {
+        int r;
+        int s;
+
+        MPI_Comm_rank(comm, &r);
+        MPI_Comm_size(comm, &s);
+
+        rank_ = r;
+        size_ = s;
+    }
+
+    size_t rank() const override {
+        return rank_;
+    }
+
+    size_t size() const override {
+        return size_;
+    }
+
+    void allreduce(float* data, size_t n) override {
+        MPI_Allreduce(MPI_IN_PLACE, data, int(n), MPI_FLOAT, MPI_SUM, comm);
+    }
+
+    void allreduce(double* data, size_t n) override {
+        MPI_Allreduce(MPI_IN_PLACE, data, int(n), MPI_DOUBLE, MPI_SUM, comm);
+    }
+
+    void broadcast(float* data, size_t n) override {
+        MPI_Bcast(data, int(n), MPI_FLOAT, 0, comm);
+    }
+
+    void broadcast(double* data, size_t n) override {
+        MPI_Bcast(data, int(n), MPI_DOUBLE, 0, comm);
+    }
+
+    void allgather(const uint8_t* data, size_t bytes, uint8_t* output) override {
+        MPI_Allgather(data, int(bytes), MPI_BYTE, output, int(bytes), MPI_BYTE, comm);
+    }
+
+private:
+    MPI_Comm comm; ///< The communicator
+    size_t rank_;  ///< The rank of this process
+    size_t size_;  ///< The number of processes
+};
+
+} //end of dll namespace
+
+#endif //DLL_MPI
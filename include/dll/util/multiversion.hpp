@@ -0,0 +1,90 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Runtime dispatch of the kernels of DLL to the instruction set of
+ * the processor (function multiversioning).
+ *
+ * The functions marked with DLL_MULTIVERSION are compiled once per level
+ * of the x86-64 micro-architectures (v4: AVX-512, v3: AVX2 and FMA, v2:
+ * SSE4.2 and the baseline) and the best version for the processor is
+ * selected when the program is loaded. The functors given to the kernels
+ * are inlined, and vectorized, in each version.
+ *
+ * The dispatch is only available with GCC on Linux x86-64. It is disabled
+ * when the code is already compiled for AVX-512 or when DLL_NO_MULTIVERSION
+ * is defined.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#if !defined(DLL_NO_MULTIVERSION) && defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12 && defined(__x86_64__) && defined(__linux__) && !defined(__AVX512F__)
+#define DLL_HAS_MULTIVERSION
+#define DLL_MULTIVERSION __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "arch=x86-64-v2", "default")))
+#else
+#define DLL_MULTIVERSION
+#endif
+
+namespace dll {
+
+/*!
+ * \brief Returns the version of the kernels selected for the processor:
+ * "x86-64-v4", "x86-64-v3", "x86-64-v2" or "default", or "native" without
+ * runtime dispatch
+ */
+inline const char* kernels_isa() {
+#ifdef DLL_HAS_MULTIVERSION
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("x86-64-v4")) {
+        return "x86-64-v4";
+    } else if (__builtin_cpu_supports("x86-64-v3")) {
+        return "x86-64-v3";
+    } else if (__builtin_cpu_supports("x86-64-v2")) {
+        return "x86-64-v2";
+    } else {
+        return "default";
+    }
+#else
+    return "native";
+#endif
+}
+
+namespace detail {
+
+/*!
+ * \brief Call functor(i) for each i in [0, n), in the best version for the
+ * processor
+ */
+template <typename Functor>
+DLL_MULTIVERSION void vectorized_for(size_t n, Functor functor) {
+    for (size_t i = 0; i < n; ++i) {
+        functor(i);
+    }
+}
+
+/*!
+ * \brief Returns the sum of functor(i) for each i in [0, n), in the best
+ * version for the processor
+ */
+template <typename Functor>
+DLL_MULTIVERSION double vectorized_sum(size_t n, Functor functor) {
+    double sum = 0.0;
+
+    for (size_t i = 0; i < n; ++i) {
+        sum += functor(i);
+    }
+
+    return sum;
+}
+
+} //end of namespace detail
+
+} //end of dll namespace
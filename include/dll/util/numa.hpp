@@ -0,0 +1,147 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief NUMA topology of the machine and thread placement
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sched.h>
+
+namespace dll {
+
+/*!
+ * \brief The NUMA nodes of the machine and their CPUs.
+ *
+ * The topology is read from /sys/devices/system/node. When it is not
+ * available, the machine is considered as a single node with all the
+ * hardware threads.
+ */
+struct numa_topology {
+    std::vector<std::vector<int>> nodes; ///< The CPUs of each node
+
+    /*!
+     * \brief Returns the number of nodes
+     */
+    size_t size() const {
+        return nodes.size();
+    }
+
+    /*!
+     * \brief Returns the node of the given CPU, 0 if it is unknown
+     */
+    size_t node_of(int cpu) const {
+        for (size_t n = 0; n < nodes.size(); ++n) {
+            for (int c : nodes[n]) {
+                if (c == cpu) {
+                    return n;
+                }
+            }
+        }
+
+        return 0;
+    }
+
+    /*!
+     * \brief Returns the node of the CPU running the current thread
+     */
+    size_t current_node() const {
+        const int cpu = ::sched_getcpu();
+        return cpu < 0 ? 0 : node_of(cpu);
+    }
+
+    /*!
+     * \brief Parse a list of CPUs in the format of the kernel ("0-3,8,10-11")
+     */
+    static std::vector<int> parse_cpulist(const std::string& list) {
+        std::vector<int> cpus;
+
+        std::stringstream stream(list);
+        std::string range;
+
+        while (std::getline(stream, range, ',')) {
+            if (range.empty() || range == "\n") {
+                continue;
+            }
+
+            const auto dash = range.find('-');
+
+            const int first = std::stoi(range.substr(0, dash));
+            const int last  = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+
+        return cpus;
+    }
+
+    /*!
+     * \brief Detect the topology of the current machine
+     */
+    static numa_topology detect() {
+        numa_topology topology;
+
+        for (size_t n = 0;; ++n) {
+            std::ifstream stream("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+
+            if (!stream) {
+                break;
+            }
+
+            std::string list;
+            std::getline(stream, list);
+
+            auto cpus = parse_cpulist(list);
+
+            // Memory-only nodes have no CPU
+            if (!cpus.empty()) {
+                topology.nodes.push_back(std::move(cpus));
+            }
+        }
+
+        if (topology.nodes.empty()) {
+            topology.nodes.emplace_back();
+
+            for (size_t cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+                topology.nodes.back().push_back(cpu);
+            }
+        }
+
+        return topology;
+    }
+};
+
+/*!
+ * \brief Restrict the current thread to the given CPUs
+ * \param cpus The CPUs
+ * \return true if the affinity was changed, false otherwise
+ */
+inline bool bind_current_thread(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    return ::sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+} //end of dll namespace
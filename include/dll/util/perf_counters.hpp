@@ -0,0 +1,233 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Hardware performance counters of the current thread, read with
+ * the perf_event interface of Linux.
+ *
+ * On the other systems, or when the kernel refuses the counters (for
+ * instance with a restrictive perf_event_paranoid or in a container),
+ * the counters are simply not available.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace dll {
+
+/*!
+ * \brief The hardware events counted around the timers
+ */
+enum class perf_event : size_t {
+    CYCLES,         ///< The number of core cycles
+    INSTRUCTIONS,   ///< The number of retired instructions
+    LLC_REFERENCES, ///< The number of references to the last level cache
+    LLC_MISSES,     ///< The number of misses of the last level cache
+    DTLB_MISSES,    ///< The number of misses of the data TLB
+    FP_SCALAR,      ///< The number of retired scalar floating point instructions
+    FP_VECTOR       ///< The number of retired packed (vector) floating point instructions
+};
+
+constexpr size_t perf_events = 7; ///< The number of counted hardware events
+
+using perf_values = std::array<size_t, perf_events>; ///< The value of each event
+
+/*!
+ * \brief Returns a string representation of a hardware event
+ */
+inline const char* to_string(perf_event event) {
+    switch (event) {
+        case perf_event::CYCLES:
+            return "cycles";
+        case perf_event::INSTRUCTIONS:
+            return "instructions";
+        case perf_event::LLC_REFERENCES:
+            return "llc_references";
+        case perf_event::LLC_MISSES:
+            return "llc_misses";
+        case perf_event::DTLB_MISSES:
+            return "dtlb_misses";
+        case perf_event::FP_SCALAR:
+            return "fp_scalar";
+        case perf_event::FP_VECTOR:
+            return "fp_vector";
+    }
+
+    return "unknown";
+}
+
+/*!
+ * \brief The hardware counters of one thread.
+ *
+ * Each event is opened as an independent counter, so that the kernel can
+ * multiplex them when there are not enough hardware counters, the values
+ * being scaled by the fraction of time they were really counted. The
+ * floating point events are raw events of the Intel processors
+ * (FP_ARITH_INST_RETIRED), they are not available on the others.
+ */
+struct perf_counters_t {
+    std::array<int, perf_events> fds; ///< The file descriptor of each counter, -1 if not available
+    bool opened = false;              ///< Indicates if the counters have been opened
+
+    perf_counters_t() {
+        fds.fill(-1);
+    }
+
+    perf_counters_t(const perf_counters_t& rhs) = delete;
+    perf_counters_t& operator=(const perf_counters_t& rhs) = delete;
+
+    ~perf_counters_t() {
+        close();
+    }
+
+    /*!
+     * \brief Open the counters for the current thread
+     */
+    void open() {
+        opened = true;
+
+#ifdef __linux__
+        const bool intel = is_intel();
+
+        for (size_t i = 0; i < perf_events; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+
+            attr.size           = sizeof(attr);
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            switch (perf_event(i)) {
+                case perf_event::CYCLES:
+                    attr.type   = PERF_TYPE_HARDWARE;
+                    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                    break;
+                case perf_event::INSTRUCTIONS:
+                    attr.type   = PERF_TYPE_HARDWARE;
+                    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                    break;
+                case perf_event::LLC_REFERENCES:
+                    attr.type   = PERF_TYPE_HARDWARE;
+                    attr.config = PERF_COUNT_HW_CACHE_REFERENCES;
+                    break;
+                case perf_event::LLC_MISSES:
+                    attr.type   = PERF_TYPE_HARDWARE;
+                    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                    break;
+                case perf_event::DTLB_MISSES:
+                    attr.type   = PERF_TYPE_HW_CACHE;
+                    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                    break;
+                case perf_event::FP_SCALAR:
+                    // FP_ARITH_INST_RETIRED.SCALAR_DOUBLE|SCALAR_SINGLE
+                    attr.type   = PERF_TYPE_RAW;
+                    attr.config = 0x03C7;
+                    break;
+                case perf_event::FP_VECTOR:
+                    // FP_ARITH_INST_RETIRED.*_PACKED_DOUBLE|*_PACKED_SINGLE (128, 256 and 512 bits)
+                    attr.type   = PERF_TYPE_RAW;
+                    attr.config = 0xFCC7;
+                    break;
+            }
+
+            if (attr.type == PERF_TYPE_RAW && !intel) {
+                continue;
+            }
+
+            fds[i] = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+
+    /*!
+     * \brief Close the counters
+     */
+    void close() {
+#ifdef __linux__
+        for (auto& fd : fds) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+#endif
+
+        fds.fill(-1);
+    }
+
+    /*!
+     * \brief Indicates if the given event is counted
+     */
+    bool available(perf_event event) const {
+        return fds[size_t(event)] >= 0;
+    }
+
+    /*!
+     * \brief Returns the bit mask of the counted events
+     */
+    size_t mask() const {
+        size_t m = 0;
+
+        for (size_t i = 0; i < perf_events; ++i) {
+            if (fds[i] >= 0) {
+                m |= size_t(1) << i;
+            }
+        }
+
+        return m;
+    }
+
+    /*!
+     * \brief Read the current (scaled) value of the counters, 0 for the
+     * events that are not counted
+     */
+    perf_values read() const {
+        perf_values values{};
+
+#ifdef __linux__
+        for (size_t i = 0; i < perf_events; ++i) {
+            uint64_t data[3]; // value, time enabled, time running
+
+            if (fds[i] >= 0 && ::read(fds[i], data, sizeof(data)) == ssize_t(sizeof(data))) {
+                values[i] = data[2] && data[2] < data[1] ? size_t(double(data[0]) * double(data[1]) / double(data[2])) : size_t(data[0]);
+            }
+        }
+#endif
+
+        return values;
+    }
+
+private:
+    /*!
+     * \brief Indicates if the processor is an Intel one
+     */
+    static bool is_intel() {
+        std::ifstream cpuinfo("/proc/cpuinfo");
+
+        for (std::string line; std::getline(cpuinfo, line);) {
+            if (!line.compare(0, 9, "vendor_id")) {
+                return line.find("GenuineIntel") != std::string::npos;
+            }
+        }
+
+        return false;
+    }
+};
+
+} //end of namespace dll
@@ -0,0 +1,455 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Asynchronous staged pipeline, with bounded queues between the
+ * stages and the occupancy of each stage
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The statistics of one stage of a pipeline
+ */
+struct stage_stats {
+    std::string name;   ///< The name of the stage
+    size_t threads = 0; ///< The number of threads of the stage
+    size_t items   = 0; ///< The number of items processed
+    size_t busy    = 0; ///< The time spent processing the items (ns)
+    size_t starved = 0; ///< The time spent waiting for items (ns)
+    size_t blocked = 0; ///< The time spent waiting for space in the next queue (ns)
+    size_t wall    = 0; ///< The duration of the pipeline (ns)
+
+    /*!
+     * \brief Returns the ratio of the time the threads of the stage were
+     * busy
+     */
+    double occupancy() const {
+        return wall && threads ? double(busy) / (double(wall) * threads) : 0.0;
+    }
+};
+
+/*!
+ * \brief The statistics of the stages of a pipeline
+ */
+struct pipeline_stats {
+    std::vector<stage_stats> stages; ///< The statistics of each stage
+
+    /*!
+     * \brief Display the occupancy of the stages on a single line
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        auto ms = [](size_t ns) { return double(ns) / 1e6; };
+
+        stream << "stages:";
+
+        for (auto& stage : stages) {
+            stream << " " << stage.name << " " << (100.0 * stage.occupancy()) << "% (" << stage.items << " items, "
+                   << ms(stage.starved) << "ms starved, " << ms(stage.blocked) << "ms blocked)";
+        }
+
+        return stream;
+    }
+};
+
+/*!
+ * \brief A bounded blocking queue, which can be closed
+ */
+template <typename T>
+struct bounded_queue {
+    using clock = std::chrono::steady_clock;
+
+    /*!
+     * \brief Create a queue of the given capacity
+     */
+    explicit bounded_queue(size_t capacity) : capacity(capacity) {
+        cpp_assert(capacity > 0, "The queue must have a capacity");
+    }
+
+    /*!
+     * \brief Push a value, waiting for some space
+     * \param waited Incremented by the time spent waiting (ns)
+     * \return false if the queue has been closed
+     */
+    bool push(T value, size_t& waited) {
+        std::unique_lock<std::mutex> l(lock);
+
+        if (values.size() >= capacity && !closed) {
+            auto start = clock::now();
+            not_full.wait(l, [this] { return closed || values.size() < capacity; });
+            waited += ns(clock::now() - start);
+        }
+
+        if (closed) {
+            return false;
+        }
+
+        values.push_back(std::move(value));
+
+        not_empty.notify_one();
+
+        return true;
+    }
+
+    /*!
+     * \brief Pop a value, waiting for one
+     * \param waited Incremented by the time spent waiting (ns)
+     * \return false if the queue is closed and empty
+     */
+    bool pop(T& value, size_t& waited) {
+        std::unique_lock<std::mutex> l(lock);
+
+        if (values.empty() && !closed) {
+            auto start = clock::now();
+            not_empty.wait(l, [this] { return closed || !values.empty(); });
+            waited += ns(clock::now() - start);
+        }
+
+        if (values.empty()) {
+            return false;
+        }
+
+        value = std::move(values.front());
+        values.pop_front();
+
+        not_full.notify_one();
+
+        return true;
+    }
+
+    /*!
+     * \brief Close the queue: the pushes fail and the pops fail once the
+     * queue is empty
+     */
+    void close() {
+        std::unique_lock<std::mutex> l(lock);
+
+        closed = true;
+
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+private:
+    static size_t ns(clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    }
+
+    const size_t capacity;             ///< The maximum number of values
+    std::deque<T> values;              ///< The values
+    bool closed = false;               ///< Indicates if the queue is closed
+    std::mutex lock;                   ///< The lock of the queue
+    std::condition_variable not_full;  ///< The condition of the producers
+    std::condition_variable not_empty; ///< The condition of the consumers
+};
+
+/*!
+ * \brief An asynchronous pipeline of stages over a fixed set of slots.
+ *
+ * A source thread fills the free slots in order, then each slot goes
+ * through the stages, each with its own threads and a bounded queue in
+ * front of it, and is handed to the consumer, in the order of the source,
+ * with next(). The consumer gives the slot back with release(). The
+ * number of slots bounds the number of items in flight.
+ *
+ * \tparam Slot The type of the slots
+ */
+template <typename Slot>
+struct staged_pipeline {
+    using clock           = std::chrono::steady_clock;
+    using stage_function  = std::function<void(Slot&)>; ///< The work of a stage on a slot
+    using source_function = std::function<bool(Slot&)>; ///< Fills a slot, returns false at the end
+
+    /*!
+     * \brief Create a pipeline with the given number of slots
+     * \param depth The number of slots
+     * \param consumer The name of the consumer, in the statistics
+     */
+    explicit staged_pipeline(size_t depth, const std::string& consumer = "consumer") : slots(depth), free(depth) {
+        consumer_stats.name    = consumer;
+        consumer_stats.threads = 1;
+
+        cpp_assert(depth > 0, "The pipeline needs at least one slot");
+
+        size_t waited = 0;
+
+        for (size_t s = 0; s < depth; ++s) {
+            free.push(s, waited);
+        }
+    }
+
+    staged_pipeline(const staged_pipeline& rhs) = delete;
+    staged_pipeline& operator=(const staged_pipeline& rhs) = delete;
+
+    /*!
+     * \brief Stop the threads of the pipeline
+     */
+    ~staged_pipeline() {
+        stop();
+    }
+
+    /*!
+     * \brief Add a stage, after the previous ones. The stages must be
+     * added before the pipeline is started.
+     *
+     * \param name The name of the stage
+     * \param threads The number of threads of the stage
+     * \param function The work of the stage on a slot
+     */
+    void add_stage(const std::string& name, size_t threads, stage_function function) {
+        cpp_assert(workers.empty(), "The stages must be added before the start");
+        cpp_assert(threads > 0, "A stage needs at least one thread");
+
+        auto s = std::make_unique<stage>(name, threads);
+        s->function = std::move(function);
+
+        stages.push_back(std::move(s));
+    }
+
+    /*!
+     * \brief Start the pipeline from the given source, run by its own
+     * thread
+     */
+    void start(const std::string& name, source_function source) {
+        start_time = clock::now();
+
+        // The output of the source
+        outputs.push_back(std::make_unique<bounded_queue<item>>(slots.size()));
+
+        for (auto& s : stages) {
+            outputs.push_back(std::make_unique<bounded_queue<item>>(slots.size()));
+            s->remaining = s->stats.threads;
+        }
+
+        source_stats.name    = name;
+        source_stats.threads = 1;
+
+        workers.emplace_back([this, source = std::move(source)] {
+            for (size_t sequence = 0;; ++sequence) {
+                item it{0, sequence};
+
+                if (!free.pop(it.slot, source_stats.blocked)) {
+                    break;
+                }
+
+                auto begin = clock::now();
+                const bool more = source(slots[it.slot]);
+                source_stats.busy += ns(clock::now() - begin);
+
+                if (!more) {
+                    break;
+                }
+
+                ++source_stats.items;
+
+                if (!outputs[0]->push(it, source_stats.blocked)) {
+                    break;
+                }
+            }
+
+            outputs[0]->close();
+        });
+
+        for (size_t k = 0; k < stages.size(); ++k) {
+            for (size_t t = 0; t < stages[k]->stats.threads; ++t) {
+                workers.emplace_back([this, k] { run_stage(k); });
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the next slot, in the order of the source, waiting
+     * for it to go through all the stages
+     * \return nullptr at the end of the source
+     */
+    Slot* next() {
+        while (true) {
+            for (size_t i = 0; i < reordered.size(); ++i) {
+                if (reordered[i].sequence == next_sequence) {
+                    auto slot = reordered[i].slot;
+                    reordered.erase(reordered.begin() + i);
+                    ++next_sequence;
+                    return &slots[slot];
+                }
+            }
+
+            item it;
+
+            if (!outputs.back()->pop(it, consumer_wait)) {
+                return nullptr;
+            }
+
+            reordered.push_back(it);
+        }
+    }
+
+    /*!
+     * \brief Give back a slot obtained with next() to the source
+     */
+    void release(Slot* slot) {
+        size_t waited = 0;
+        free.push(size_t(slot - slots.data()), waited);
+    }
+
+    /*!
+     * \brief Stop the pipeline and join its threads
+     */
+    void stop() {
+        if (workers.empty()) {
+            return;
+        }
+
+        free.close();
+
+        for (auto& output : outputs) {
+            output->close();
+        }
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        workers.clear();
+
+        wall = ns(clock::now() - start_time);
+    }
+
+    /*!
+     * \brief Returns the statistics of the source, of the stages and of the
+     * consumer, once the pipeline is stopped
+     */
+    pipeline_stats stats() const {
+        pipeline_stats result;
+
+        result.stages.push_back(source_stats);
+
+        for (auto& s : stages) {
+            stage_stats st = s->stats;
+
+            st.busy    = s->busy;
+            st.starved = s->starved;
+            st.blocked = s->blocked;
+            st.items   = s->items;
+
+            result.stages.push_back(st);
+        }
+
+        stage_stats consumer = consumer_stats;
+
+        consumer.items   = next_sequence;
+        consumer.starved = consumer_wait;
+        consumer.busy    = wall > consumer_wait ? wall - consumer_wait : 0;
+
+        result.stages.push_back(consumer);
+
+        for (auto& st : result.stages) {
+            st.wall = wall;
+        }
+
+        return result;
+    }
+
+private:
+    /*!
+     * \brief A slot going through the pipeline
+     */
+    struct item {
+        size_t slot;     ///< The index of the slot
+        size_t sequence; ///< The position of the slot in the source
+    };
+
+    /*!
+     * \brief A stage of the pipeline
+     */
+    struct stage {
+        stage(const std::string& name, size_t threads) {
+            stats.name    = name;
+            stats.threads = threads;
+        }
+
+        stage_function function; ///< The work of the stage
+        stage_stats stats;       ///< The description of the stage
+
+        std::atomic<size_t> items{0};     ///< The number of items processed
+        std::atomic<size_t> busy{0};      ///< The time spent processing (ns)
+        std::atomic<size_t> starved{0};   ///< The time spent waiting for items (ns)
+        std::atomic<size_t> blocked{0};   ///< The time spent waiting for space (ns)
+        std::atomic<size_t> remaining{0}; ///< The threads of the stage still running
+    };
+
+    /*!
+     * \brief The loop of a thread of the kth stage
+     */
+    void run_stage(size_t k) {
+        auto& s      = *stages[k];
+        auto& input  = *outputs[k];
+        auto& output = *outputs[k + 1];
+
+        size_t starved = 0;
+        size_t blocked = 0;
+
+        item it;
+
+        while (input.pop(it, starved)) {
+            auto begin = clock::now();
+            s.function(slots[it.slot]);
+            s.busy += ns(clock::now() - begin);
+            ++s.items;
+
+            if (!output.push(it, blocked)) {
+                break;
+            }
+        }
+
+        s.starved += starved;
+        s.blocked += blocked;
+
+        // The last thread of the stage ends the next one
+        if (--s.remaining == 0) {
+            output.close();
+        }
+    }
+
+    static size_t ns(clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    }
+
+    std::vector<Slot> slots;                                   ///< The slots
+    bounded_queue<size_t> free;                                ///< The free slots
+    std::vector<std::unique_ptr<stage>> stages;                ///< The stages
+    std::vector<std::unique_ptr<bounded_queue<item>>> outputs; ///< The output of the source and of each stage
+    std::vector<std::thread> workers;                          ///< The threads of the source and of the stages
+
+    stage_stats source_stats;     ///< The statistics of the source
+    stage_stats consumer_stats;   ///< The description of the consumer
+    std::vector<item> reordered;  ///< The slots out of the stages before their turn
+    size_t next_sequence = 0;     ///< The position of the next slot of the consumer
+    size_t consumer_wait = 0;     ///< The time the consumer waited (ns)
+    size_t wall          = 0;     ///< The duration of the pipeline (ns)
+    clock::time_point start_time; ///< The start of the pipeline
+};
+
+} //end of dll namespace
@@ -0,0 +1,276 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Placement of the compute and producer threads on the cores of the
+ * machine
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "cpp_utils/assert.hpp"
+#include "cpp_utils/maybe_parallel.hpp"
+
+#include "dll/util/numa.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The policy of placement of the threads of a network
+ */
+struct placement_policy {
+    bool pin              = false; ///< Pin the compute workers, one per CPU
+    size_t producer_cores = 0;     ///< The number of physical cores dedicated to the producers of the generators
+    bool avoid_smt        = false; ///< Only use one hardware thread of each physical core
+};
+
+/*!
+ * \brief The CPUs selected by a placement policy
+ */
+struct thread_placement {
+    std::vector<int> compute;   ///< The CPUs of the compute workers, the distinct physical cores first
+    std::vector<int> producers; ///< The CPUs of the producers
+
+    /*!
+     * \brief Indicates if the compute workers are pinned
+     */
+    bool pinned() const {
+        return !compute.empty();
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Returns the CPUs the process was allowed to run on when this was
+ * first called
+ */
+inline const std::vector<int>& allowed_cpus() {
+    static const std::vector<int> cpus = [] {
+        std::vector<int> result;
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+
+        if (::sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &set)) {
+                    result.push_back(cpu);
+                }
+            }
+        }
+
+        if (result.empty()) {
+            for (size_t cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+                result.push_back(cpu);
+            }
+        }
+
+        return result;
+    }();
+
+    return cpus;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Returns the physical cores the process is allowed to run on, each
+ * with its hardware threads (SMT siblings), in the order of their first
+ * CPU.
+ *
+ * The siblings are read from /sys/devices/system/cpu. When they are not
+ * available, each CPU is its own core.
+ */
+inline std::vector<std::vector<int>> physical_cores() {
+    const auto& allowed = detail::allowed_cpus();
+
+    std::vector<std::vector<int>> cores;
+    std::vector<int> seen;
+
+    for (int cpu : allowed) {
+        if (std::find(seen.begin(), seen.end(), cpu) != seen.end()) {
+            continue;
+        }
+
+        std::ifstream stream("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+
+        std::vector<int> siblings;
+
+        if (stream) {
+            std::string list;
+            std::getline(stream, list);
+
+            for (int sibling : numa_topology::parse_cpulist(list)) {
+                if (std::find(allowed.begin(), allowed.end(), sibling) != allowed.end()) {
+                    siblings.push_back(sibling);
+                }
+            }
+        }
+
+        if (siblings.empty()) {
+            siblings.push_back(cpu);
+        }
+
+        seen.insert(seen.end(), siblings.begin(), siblings.end());
+        cores.push_back(std::move(siblings));
+    }
+
+    return cores;
+}
+
+/*!
+ * \brief Select the CPUs of the compute workers and of the producers for
+ * the given policy.
+ *
+ * The producers get the last physical cores, at least one core is left to
+ * the compute workers. The compute CPUs start with the first hardware
+ * thread of each of their cores, followed by the siblings unless SMT is
+ * avoided, so that the first workers are on distinct physical cores.
+ */
+inline thread_placement make_placement(const placement_policy& policy) {
+    thread_placement placement;
+
+    if (!policy.pin && !policy.producer_cores) {
+        return placement;
+    }
+
+    auto cores = physical_cores();
+
+    const size_t producers = std::min(policy.producer_cores, cores.size() - 1);
+    const size_t compute   = cores.size() - producers;
+
+    for (size_t c = compute; c < cores.size(); ++c) {
+        if (policy.avoid_smt) {
+            placement.producers.push_back(cores[c].front());
+        } else {
+            placement.producers.insert(placement.producers.end(), cores[c].begin(), cores[c].end());
+        }
+    }
+
+    if (policy.pin) {
+        const size_t threads = policy.avoid_smt ? 1 : cores.front().size();
+
+        for (size_t t = 0; t < threads; ++t) {
+            for (size_t c = 0; c < compute; ++c) {
+                if (t < cores[c].size()) {
+                    placement.compute.push_back(cores[c][t]);
+                }
+            }
+        }
+    }
+
+    return placement;
+}
+
+/*!
+ * \brief Restrict the given thread to the given CPU
+ * \return true if the affinity was changed, false otherwise
+ */
+inline bool bind_thread(std::thread& thread, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+
+    CPU_SET(cpu, &set);
+
+    return ::pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+}
+
+/*!
+ * \brief Pin each of the workers of the given thread pool to one of the
+ * given CPUs, in turn.
+ *
+ * One task is given to each worker, which holds it until all the workers
+ * have their own (or a short timeout expires), so that each worker is
+ * pinned once.
+ *
+ * \param pool The thread pool
+ * \param workers The number of workers of the pool
+ * \param cpus The CPUs of the workers
+ */
+template <typename Pool>
+void pin_pool_workers(Pool& pool, size_t workers, const std::vector<int>& cpus) {
+    if constexpr (std::is_same_v<std::decay_t<Pool>, cpp::thread_pool<true>>) {
+        if (cpus.empty() || !workers) {
+            return;
+        }
+
+        std::atomic<size_t> arrived{0};
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+
+        cpp::maybe_parallel_foreach_n(pool, 0, workers, [&](size_t w) {
+            bind_current_thread({cpus[w % cpus.size()]});
+
+            ++arrived;
+
+            while (arrived.load() < workers && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::yield();
+            }
+        });
+    } else {
+        cpp_unused(pool);
+        cpp_unused(workers);
+        cpp_unused(cpus);
+    }
+}
+
+namespace detail {
+
+template <typename G, typename = void>
+struct has_producer_threads : std::false_type {};
+
+template <typename G>
+struct has_producer_threads<G, std::void_t<decltype(std::declval<G&>().pool.threads)>> : std::true_type {};
+
+} //end of namespace detail
+
+/*!
+ * \brief Pin the producer threads of the given generator to the given
+ * CPUs, one CPU per producer, in turn. The generators without producer
+ * threads are left alone.
+ *
+ * \return the number of pinned producers
+ */
+template <typename Generator>
+size_t pin_producers(Generator& generator, const std::vector<int>& cpus) {
+    size_t pinned = 0;
+
+    if constexpr (detail::has_producer_threads<Generator>::value) {
+        if (!cpus.empty()) {
+            size_t p = 0;
+
+            for (auto& thread : generator.pool.threads) {
+                pinned += bind_thread(thread, cpus[p++ % cpus.size()]);
+            }
+        }
+    } else {
+        cpp_unused(generator);
+        cpp_unused(cpus);
+    }
+
+    return pinned;
+}
+
+} //end of dll namespace
@@ -0,0 +1,246 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused kernels for Probabilistic Max Pooling
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "dll/util/random.hpp"
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Compute the Probabilistic Max Pooling of the samples [first, last)
+ * of a batch of hidden pre-activations (B x K x NH1 x NH2).
+ *
+ * Each C x C block of a filter holds a softmax over its units and an "off"
+ * state: h = exp(x) / (1 + sum(exp(x))) and p = 1 - 1 / (1 + sum(exp(x))),
+ * with x = scale * (input + b). The block is read once for its maximum
+ * (for stability), once for the exponentials and once for the
+ * normalization, the K filters being processed together in the inner
+ * loops.
+ *
+ * When sampling, at most one unit per block is on, drawn from the softmax
+ * of the block.
+ *
+ * \param x The pre-activations, without the biases (can be the same as h_a)
+ * \param bias The biases of the filters
+ * \param scale The scale of the activations
+ * \param h_a The hidden probabilities (can be nullptr)
+ * \param h_s The hidden samples (can be nullptr)
+ * \param p_a The pooled probabilities (can be nullptr)
+ */
+template <typename T>
+void pmp_samples(size_t first, size_t last, const T* x, const T* bias, T scale, size_t K, size_t NH1, size_t NH2, size_t C,
+                 T* h_a, T* h_s, T* p_a) {
+    const size_t NP1  = NH1 / C;
+    const size_t NP2  = NH2 / C;
+    const size_t Size = NH1 * NH2;
+
+    std::vector<T> max(K);
+    std::vector<T> sum(K);
+    std::vector<T> block(K * C * C);
+
+    auto& g = dll::rand_engine();
+    std::uniform_real_distribution<T> dist(T(0), T(1));
+
+    for (size_t b = first; b < last; ++b) {
+        const T* x_b = x + b * K * Size;
+
+        for (size_t pi = 0; pi < NP1; ++pi) {
+            for (size_t pj = 0; pj < NP2; ++pj) {
+                // The maximum of the block, with the off state
+                std::fill(max.begin(), max.end(), T(0));
+
+                for (size_t i = 0; i < C; ++i) {
+                    for (size_t j = 0; j < C; ++j) {
+                        const size_t u = (pi * C + i) * NH2 + pj * C + j;
+                        T* block_u     = block.data() + (i * C + j) * K;
+
+                        for (size_t k = 0; k < K; ++k) {
+                            block_u[k] = scale * (x_b[k * Size + u] + bias[k]);
+                            max[k]     = std::max(max[k], block_u[k]);
+                        }
+                    }
+                }
+
+                // The exponentials
+                for (size_t k = 0; k < K; ++k) {
+                    sum[k] = std::exp(-max[k]);
+                }
+
+                for (size_t v = 0; v < C * C; ++v) {
+                    T* block_v = block.data() + v * K;
+
+                    for (size_t k = 0; k < K; ++k) {
+                        block_v[k] = std::exp(block_v[k] - max[k]);
+                        sum[k] += block_v[k];
+                    }
+                }
+
+                // The normalization
+                for (size_t k = 0; k < K; ++k) {
+                    sum[k] = T(1) / sum[k];
+                }
+
+                for (size_t v = 0; v < C * C; ++v) {
+                    T* block_v = block.data() + v * K;
+
+                    for (size_t k = 0; k < K; ++k) {
+                        block_v[k] *= sum[k];
+                    }
+                }
+
+                if (p_a) {
+                    T* p_b = p_a + b * K * NP1 * NP2;
+
+                    for (size_t k = 0; k < K; ++k) {
+                        p_b[k * NP1 * NP2 + pi * NP2 + pj] = T(1) - std::exp(-max[k]) * sum[k];
+                    }
+                }
+
+                if (h_a) {
+                    T* h_b = h_a + b * K * Size;
+
+                    for (size_t i = 0; i < C; ++i) {
+                        for (size_t j = 0; j < C; ++j) {
+                            const size_t u   = (pi * C + i) * NH2 + pj * C + j;
+                            const T* block_u = block.data() + (i * C + j) * K;
+
+                            for (size_t k = 0; k < K; ++k) {
+                                h_b[k * Size + u] = block_u[k];
+                            }
+                        }
+                    }
+                }
+
+                if (h_s) {
+                    T* s_b = h_s + b * K * Size;
+
+                    for (size_t k = 0; k < K; ++k) {
+                        // The remaining probability is the off state
+                        T rest = dist(g);
+
+                        for (size_t i = 0; i < C; ++i) {
+                            for (size_t j = 0; j < C; ++j) {
+                                const size_t u = (pi * C + i) * NH2 + pj * C + j;
+                                const T p      = block[(i * C + j) * K + k];
+
+                                s_b[k * Size + u] = rest >= T(0) && rest < p ? T(1) : T(0);
+                                rest -= p;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Compute the Probabilistic Max Pooling of a batch of hidden
+ * pre-activations (B x K x NH1 x NH2), in one fused kernel.
+ *
+ * The samples of the batch are processed in chunks on the scoped thread
+ * pool if there is one.
+ *
+ * \param x The pre-activations, without the biases (can be the same as h_a)
+ * \param bias The biases of the filters
+ * \param C The pooling ratio
+ * \param scale The scale of the activations
+ * \param h_a The hidden probabilities (can be nullptr)
+ * \param h_s The hidden samples (can be nullptr)
+ * \param p_a The pooled probabilities (can be nullptr)
+ */
+template <typename X, typename B, typename T>
+void pmp_batch(const X& x, const B& bias, size_t C, T scale, T* h_a, T* h_s, T* p_a) {
+    const size_t Batch = etl::dim<0>(x);
+    const size_t K     = etl::dim<1>(x);
+    const size_t NH1   = etl::dim<2>(x);
+    const size_t NH2   = etl::dim<3>(x);
+
+    x.ensure_cpu_up_to_date();
+    bias.ensure_cpu_up_to_date();
+
+    const T* x_p = x.memory_start();
+    const T* b_p = bias.memory_start();
+
+    auto samples = [=](size_t first, size_t last) {
+        detail::pmp_samples(first, last, x_p, b_p, scale, K, NH1, NH2, C, h_a, h_s, p_a);
+    };
+
+    auto* pool = scoped_thread_pool();
+
+    if (pool && Batch > 1) {
+        const size_t chunks = std::min(Batch, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&samples, Batch, chunks](size_t c) {
+            samples((c * Batch) / chunks, ((c + 1) * Batch) / chunks);
+        });
+    } else {
+        samples(0, Batch);
+    }
+}
+
+/*!
+ * \brief Compute the hidden probabilities (and samples) with Probabilistic
+ * Max Pooling, in place of the pre-activations in h_a.
+ * \param h_a The pre-activations without the biases, replaced by the probabilities
+ * \param h_s The samples, only set if S is set
+ * \param bias The biases of the filters
+ * \param C The pooling ratio
+ * \param scale The scale of the activations
+ */
+template <bool S, typename H1, typename H2, typename B, typename T>
+void pmp_hidden(H1& h_a, H2& h_s, const B& bias, size_t C, T scale) {
+    if constexpr (S) {
+        h_s.ensure_cpu_up_to_date();
+    }
+
+    pmp_batch(h_a, bias, C, scale, h_a.memory_start(), S ? h_s.memory_start() : nullptr, static_cast<T*>(nullptr));
+
+    h_a.invalidate_gpu();
+
+    if constexpr (S) {
+        h_s.invalidate_gpu();
+    }
+}
+
+/*!
+ * \brief Compute the pooled probabilities with Probabilistic Max Pooling
+ * \param x The pre-activations of the hidden units, without the biases
+ * \param p_a The pooled probabilities
+ * \param bias The biases of the filters
+ * \param C The pooling ratio
+ */
+template <typename X, typename P, typename B>
+void pmp_pooling(const X& x, P& p_a, const B& bias, size_t C) {
+    using T = etl::value_t<P>;
+
+    p_a.ensure_cpu_up_to_date();
+
+    pmp_batch(x, bias, C, T(1), static_cast<T*>(nullptr), static_cast<T*>(nullptr), p_a.memory_start());
+
+    p_a.invalidate_gpu();
+}
+
+} //end of dll namespace
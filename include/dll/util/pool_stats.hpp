@@ -0,0 +1,370 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Utilization statistics of the parallel regions run on the thread
+ * pools: busy and idle time of each worker, number of tasks, queue wait
+ * and tail effect, aggregated per timer.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cpp_utils/maybe_parallel.hpp"
+
+#include "dll/util/scheduler.hpp"
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The statistics of one worker in the regions of a timer
+ */
+struct pool_worker_stats {
+    size_t tasks = 0; ///< The number of tasks run by the worker
+    size_t busy  = 0; ///< The time spent running the tasks (ns)
+};
+
+/*!
+ * \brief The statistics of the parallel regions of a timer
+ */
+struct pool_region_stats {
+    size_t regions   = 0;   ///< The number of parallel regions
+    size_t tasks     = 0;   ///< The number of tasks
+    size_t wall      = 0;   ///< The total duration of the regions (ns)
+    size_t busy      = 0;   ///< The total time spent running the tasks (ns)
+    size_t queue     = 0;   ///< The total time the tasks waited in the queue (ns)
+    size_t max_queue = 0;   ///< The longest wait of a task in the queue (ns)
+    size_t tail      = 0;   ///< The total time between the first and the last worker to finish (ns)
+    size_t max_tail  = 0;   ///< The longest tail of a region (ns)
+    double imbalance = 0.0; ///< The sum of the imbalance of the regions (busiest worker / mean worker)
+
+    std::map<size_t, pool_worker_stats> workers; ///< The statistics of each worker
+};
+
+/*!
+ * \brief The registry of the statistics of the parallel regions
+ */
+struct pool_stats_t {
+    std::atomic<bool> enabled{false};                 ///< Indicates if the regions are measured
+    std::atomic<size_t> next_worker{0};               ///< The id of the next worker
+    std::map<std::string, pool_region_stats> regions; ///< The statistics of each timer
+    std::mutex lock;                                  ///< The lock protecting the statistics
+};
+
+/*!
+ * \brief Get a reference to the statistics of the parallel regions
+ */
+inline pool_stats_t& get_pool_stats() {
+    static pool_stats_t stats;
+    return stats;
+}
+
+/*!
+ * \brief Returns the id of the current thread, as a worker of the pools
+ */
+inline size_t pool_worker_id() {
+    thread_local size_t id = get_pool_stats().next_worker.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+/*!
+ * \brief Enable or disable the measure of the parallel regions, for
+ * dump_pool_stats
+ */
+inline void enable_pool_stats(bool enable = true) {
+    get_pool_stats().enabled.store(enable, std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Indicates if the parallel regions are measured
+ */
+inline bool pool_stats_enabled() {
+    return get_pool_stats().enabled.load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Reset the statistics of the parallel regions
+ */
+inline void reset_pool_stats() {
+    auto& stats = get_pool_stats();
+
+    std::lock_guard<std::mutex> l(stats.lock);
+    stats.regions.clear();
+}
+
+/*!
+ * \brief Returns a copy of the statistics of the parallel regions
+ */
+inline std::map<std::string, pool_region_stats> pool_stats_snapshot() {
+    auto& stats = get_pool_stats();
+
+    std::lock_guard<std::mutex> l(stats.lock);
+    return stats.regions;
+}
+
+/*!
+ * \brief A parallel region being measured.
+ *
+ * The region is named after the innermost open timer of the thread that
+ * dispatches the tasks, the tasks given to the pool are wrapped with
+ * task() and the statistics are merged when the region is destroyed,
+ * once all its tasks are done.
+ */
+struct pool_region {
+    using clock = std::chrono::steady_clock;
+
+    /*!
+     * \brief The execution of one task of the region
+     */
+    struct task_record {
+        size_t worker;            ///< The worker that ran the task
+        clock::time_point queued; ///< The time the task was given to the pool
+        clock::time_point start;  ///< The start of the task
+        clock::time_point end;    ///< The end of the task
+    };
+
+    const bool active;                ///< Indicates if the region is measured
+    const char* name;                 ///< The name of the region
+    clock::time_point start;          ///< The start of the region
+    std::vector<task_record> records; ///< The tasks of the region
+    std::mutex lock;                  ///< The lock protecting the records
+
+    pool_region() : active(pool_stats_enabled()), name(active ? current_timer_name() : nullptr), start(clock::now()) {}
+
+    pool_region(const pool_region& rhs) = delete;
+    pool_region& operator=(const pool_region& rhs) = delete;
+
+    /*!
+     * \brief Merge the statistics of the region
+     */
+    ~pool_region() {
+        if (active && !records.empty()) {
+            finish(clock::now());
+        }
+    }
+
+    /*!
+     * \brief Run and measure a task of the region
+     * \param functor The task
+     * \param queued The time the task was given to the pool
+     */
+    template <typename Functor>
+    void run(Functor& functor, clock::time_point queued) {
+        if (!active) {
+            functor();
+            return;
+        }
+
+        auto task_start = clock::now();
+
+        functor();
+
+        auto task_end = clock::now();
+
+        std::lock_guard<std::mutex> l(lock);
+        records.push_back({pool_worker_id(), queued, task_start, task_end});
+    }
+
+    /*!
+     * \brief Wrap a task of the region, to measure it when it is run
+     */
+    template <typename Functor>
+    auto task(Functor&& functor) {
+        return [this, functor = std::forward<Functor>(functor), queued = active ? clock::now() : clock::time_point()]() mutable {
+            run(functor, queued);
+        };
+    }
+
+private:
+    static size_t ns(clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    }
+
+    void finish(clock::time_point end) {
+        std::map<size_t, pool_worker_stats> workers;
+        std::map<size_t, clock::time_point> finished;
+
+        size_t busy      = 0;
+        size_t queue     = 0;
+        size_t max_queue = 0;
+
+        for (auto& record : records) {
+            auto& worker = workers[record.worker];
+
+            ++worker.tasks;
+            worker.busy += ns(record.end - record.start);
+
+            auto it = finished.find(record.worker);
+
+            if (it == finished.end() || it->second < record.end) {
+                finished[record.worker] = record.end;
+            }
+
+            busy += ns(record.end - record.start);
+            queue += ns(record.start - record.queued);
+            max_queue = std::max(max_queue, ns(record.start - record.queued));
+        }
+
+        auto first_finish = finished.begin()->second;
+        auto last_finish  = finished.begin()->second;
+
+        size_t busiest = 0;
+
+        for (auto& [worker, time] : finished) {
+            first_finish = std::min(first_finish, time);
+            last_finish  = std::max(last_finish, time);
+            busiest      = std::max(busiest, workers[worker].busy);
+        }
+
+        const size_t tail = ns(last_finish - first_finish);
+        const double mean = double(busy) / workers.size();
+
+        auto& stats = get_pool_stats();
+
+        std::lock_guard<std::mutex> l(stats.lock);
+
+        auto& region = stats.regions[name ? name : "<none>"];
+
+        ++region.regions;
+        region.tasks += records.size();
+        region.wall += ns(end - start);
+        region.busy += busy;
+        region.queue += queue;
+        region.max_queue = std::max(region.max_queue, max_queue);
+        region.tail += tail;
+        region.max_tail = std::max(region.max_tail, tail);
+        region.imbalance += mean > 0.0 ? busiest / mean : 1.0;
+
+        for (auto& [worker, values] : workers) {
+            region.workers[worker].tasks += values.tasks;
+            region.workers[worker].busy += values.busy;
+        }
+    }
+};
+
+/*!
+ * \brief Call functor(i) for each i in [first, last) on the given thread
+ * pool, like cpp::maybe_parallel_foreach_n, measuring the region if the
+ * statistics are enabled.
+ *
+ * Inside a task of the work-stealing scheduler, or when work stealing is
+ * enabled, the region is forked on the scheduler instead, with the pool
+ * scoped in its tasks, so that the nested regions compose.
+ */
+template <typename TP, typename Functor>
+void maybe_parallel_foreach_n(TP& pool, size_t first, size_t last, Functor&& functor) {
+    if constexpr (std::is_same_v<std::decay_t<TP>, cpp::thread_pool<true>>) {
+        if (auto* scheduler = active_scheduler()) {
+            if (pool_stats_enabled()) {
+                pool_region region;
+
+                scheduler->foreach_n(first, last, [&region, &functor](size_t i) {
+                    auto task = [&functor, i] { functor(i); };
+                    region.run(task, region.start);
+                }, &pool);
+            } else {
+                scheduler->foreach_n(first, last, functor, &pool);
+            }
+
+            return;
+        }
+
+        if (pool_stats_enabled()) {
+            pool_region region;
+
+            cpp::maybe_parallel_foreach_n(pool, first, last, [&region, &functor](size_t i) {
+                auto task = [&functor, i] { functor(i); };
+                region.run(task, region.start);
+            });
+
+            return;
+        }
+    }
+
+    cpp::maybe_parallel_foreach_n(pool, first, last, functor);
+}
+
+/*!
+ * \brief Dump the statistics of the parallel regions on the console, one
+ * line per timer: the number of regions and tasks, the workers used, the
+ * mean duration of a region, the utilization of the workers, the mean and
+ * maximum queue wait, the mean and maximum tail (from the first to the
+ * last worker to finish) and the mean imbalance (busiest worker / mean).
+ *
+ * \param workers If true, the busy and idle time of each worker of each
+ * timer is dumped as well
+ */
+inline void dump_pool_stats(bool workers = false) {
+    auto regions = pool_stats_snapshot();
+
+    if (regions.empty()) {
+        std::cout << "No parallel regions have been recorded!" << std::endl;
+        return;
+    }
+
+    auto percent = [](double value) { return to_string_precision(100.0 * value, 3) + "%"; };
+
+    std::vector<std::pair<std::string, pool_region_stats>> sorted(regions.begin(), regions.end());
+
+    //Sort the regions by duration (DESC)
+    std::sort(sorted.begin(), sorted.end(), [](auto& left, auto& right) { return left.second.wall > right.second.wall; });
+
+    std::vector<std::array<std::string, 11>> rows;
+    rows.push_back({"Region", "Count", "Tasks", "Workers", "Average", "Utilization", "Queue", "Max queue", "Tail", "Max tail", "Imbalance"});
+
+    for (auto& [name, region] : sorted) {
+        const size_t n = region.workers.size();
+
+        rows.push_back({
+            name,
+            std::to_string(region.regions),
+            std::to_string(region.tasks),
+            std::to_string(n),
+            duration_str(double(region.wall) / region.regions, 4),
+            region.wall ? percent(double(region.busy) / (double(region.wall) * n)) : "-",
+            duration_str(double(region.queue) / region.tasks, 4),
+            duration_str(double(region.max_queue), 4),
+            duration_str(double(region.tail) / region.regions, 4),
+            duration_str(double(region.max_tail), 4),
+            to_string_precision(region.imbalance / region.regions, 3)});
+    }
+
+    detail::print_table(rows);
+
+    if (!workers) {
+        return;
+    }
+
+    std::vector<std::array<std::string, 5>> worker_rows;
+    worker_rows.push_back({"Region", "Worker", "Tasks", "Busy", "Idle"});
+
+    for (auto& [name, region] : sorted) {
+        for (auto& [worker, values] : region.workers) {
+            worker_rows.push_back({
+                name,
+                std::to_string(worker),
+                std::to_string(values.tasks),
+                duration_str(double(values.busy), 4),
+                duration_str(double(region.wall - std::min(region.wall, values.busy)), 4)});
+        }
+    }
+
+    detail::print_table(worker_rows);
+}
+
+} //end of namespace dll
@@ -0,0 +1,300 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Magnitude pruning of the weights and sparse weights kernels
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "cpp_utils/io.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/util/csr_batch.hpp"
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The maximum density of pruned weights for the sparse kernels to be
+ * used, the denser weights use the dense kernels.
+ */
+constexpr double pruned_max_density = 0.3;
+
+/*!
+ * \brief Traits to test if a layer supports magnitude pruning
+ */
+template <typename Layer, typename Enable = void>
+struct is_prunable_layer : std::false_type {};
+
+/*!
+ * \copydoc is_prunable_layer
+ */
+template <typename Layer>
+struct is_prunable_layer<Layer, std::void_t<decltype(std::declval<Layer&>().prune(typename Layer::weight(0)))>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the given (possibly cv-qualified reference) type is a
+ * prunable layer
+ */
+template <typename Layer>
+constexpr bool is_prunable_layer_v = is_prunable_layer<std::decay_t<Layer>>::value;
+
+/*!
+ * \brief Returns the magnitude under which the given ratio of the values
+ * are, i.e. the pruning threshold to reach the given sparsity.
+ * \param magnitudes The magnitudes of the weights, reordered
+ * \param sparsity The ratio of weights to prune, in [0, 1]
+ */
+template <typename T>
+T magnitude_threshold(std::vector<T>& magnitudes, double sparsity) {
+    const size_t n = size_t(sparsity * double(magnitudes.size()));
+
+    if (n == 0) {
+        return T(0);
+    }
+
+    if (n >= magnitudes.size()) {
+        return *std::max_element(magnitudes.begin(), magnitudes.end()) + T(1);
+    }
+
+    std::nth_element(magnitudes.begin(), magnitudes.begin() + n, magnitudes.end());
+
+    return magnitudes[n];
+}
+
+/*!
+ * \brief Append the magnitudes of the given weights to the vector
+ */
+template <typename W, typename T>
+void append_magnitudes(const W& w, std::vector<T>& magnitudes) {
+    w.ensure_cpu_up_to_date();
+
+    const auto* w_p = w.memory_start();
+
+    for (size_t i = 0; i < etl::size(w); ++i) {
+        magnitudes.push_back(std::abs(w_p[i]));
+    }
+}
+
+/*!
+ * \brief Prune the weights whose magnitude is under the threshold.
+ *
+ * The pruned weights are set to zero and recorded in the mask (1 for the
+ * kept weights, 0 for the pruned ones), which is created on the first
+ * pruning. The weights pruned before stay pruned.
+ *
+ * \param w The weights
+ * \param mask The mask of the weights
+ * \param threshold The magnitude under which the weights are pruned
+ * \return The number of pruned weights
+ */
+template <typename W, typename T>
+size_t prune_weights(W& w, std::unique_ptr<W>& mask, T threshold) {
+    if (!mask) {
+        mask  = std::make_unique<W>(w);
+        *mask = T(1);
+    }
+
+    w.ensure_cpu_up_to_date();
+    mask->ensure_cpu_up_to_date();
+
+    auto* w_p = w.memory_start();
+    auto* m_p = mask->memory_start();
+
+    size_t pruned = 0;
+
+    for (size_t i = 0; i < etl::size(w); ++i) {
+        if (m_p[i] == T(0) || std::abs(w_p[i]) < threshold) {
+            m_p[i] = T(0);
+            w_p[i] = T(0);
+            ++pruned;
+        }
+    }
+
+    w.invalidate_gpu();
+    mask->invalidate_gpu();
+
+    return pruned;
+}
+
+/*!
+ * \brief Cache of the non-zeros of pruned weights (visible x hidden), in
+ * CSR format, one row per visible unit.
+ *
+ * The cache is computed on first use and must be invalidated when the
+ * weights are modified.
+ */
+template <typename T>
+struct sparse_weights {
+    /*!
+     * \brief Returns the compressed weights, or nullptr if the weights are
+     * too dense for the sparse kernels
+     */
+    template <typename W>
+    const csr_batch<T>* get(const W& w) {
+        std::lock_guard<std::mutex> l(lock);
+
+        if (!valid) {
+            sparse = csr.compress(w, pruned_max_density);
+            valid  = true;
+        }
+
+        return sparse ? &csr : nullptr;
+    }
+
+    /*!
+     * \brief Invalidate the cache, after a modification of the weights
+     */
+    void invalidate() {
+        std::lock_guard<std::mutex> l(lock);
+        valid = false;
+    }
+
+private:
+    csr_batch<T> csr;    ///< The compressed weights
+    bool sparse = false; ///< Indicates if the weights are sparse enough
+    bool valid  = false; ///< Indicates if the compressed weights are up to date
+    std::mutex lock;     ///< The lock for concurrent uses of the layer
+};
+
+/*!
+ * \brief Compute out = input * w, with a dense batch and sparse weights, in
+ * time proportional to the non-zeros of the weights (and of the input).
+ *
+ * Each non-zero input value adds its row of the weights to its output row.
+ * The rows of the batch are computed in chunks on the scoped thread pool
+ * if there is one.
+ *
+ * \param input The input batch, with direct memory access (rows x visible)
+ * \param w The sparse weights (visible x hidden)
+ * \param out The output (rows x hidden)
+ */
+template <typename I, typename T, typename Out>
+void dense_csr_mul(const I& input, const csr_batch<T>& w, Out&& out) {
+    const size_t B = etl::dim<0>(input);
+    const size_t V = w.rows;
+    const size_t H = w.cols;
+
+    cpp_assert(etl::size(input) == B * V, "Invalid dimensions for dense_csr_mul");
+    cpp_assert(etl::size(out) == B * H, "Invalid dimensions for dense_csr_mul");
+
+    input.ensure_cpu_up_to_date();
+
+    const T* in_p = input.memory_start();
+    T* o_p        = out.memory_start();
+
+    auto rows = [&w, in_p, o_p, V, H](size_t first, size_t last) {
+        for (size_t r = first; r < last; ++r) {
+            const T* x = in_p + r * V;
+            T* o_r     = o_p + r * H;
+
+            std::fill(o_r, o_r + H, T(0));
+
+            for (size_t i = 0; i < V; ++i) {
+                const T xv = x[i];
+
+                if (xv == T(0)) {
+                    continue;
+                }
+
+                for (size_t k = w.row_ptr[i]; k < w.row_ptr[i + 1]; ++k) {
+                    o_r[w.columns[k]] += xv * w.values[k];
+                }
+            }
+        }
+    };
+
+    auto* pool = scoped_thread_pool();
+
+    if (pool && B > 1) {
+        const size_t chunks = std::min(B, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&rows, B, chunks](size_t c) {
+            rows((c * B) / chunks, ((c + 1) * B) / chunks);
+        });
+    } else {
+        rows(0, B);
+    }
+
+    out.invalidate_gpu();
+}
+
+/*!
+ * \brief Store pruned weights in CSR format, only their non-zeros
+ * \param os The output stream
+ * \param w The weights (visible x hidden)
+ */
+template <typename W>
+void store_sparse_weights(std::ostream& os, const W& w) {
+    csr_batch<etl::value_t<W>> csr;
+    csr.compress(w, 1.0);
+
+    cpp::binary_write(os, csr.nnz());
+    cpp::binary_write_all(os, csr.row_ptr);
+    cpp::binary_write_all(os, csr.columns);
+    cpp::binary_write_all(os, csr.values);
+}
+
+/*!
+ * \brief Load pruned weights stored in CSR format, and rebuild their mask
+ * \param is The input stream
+ * \param w The weights (visible x hidden), already sized
+ * \param mask The mask of the weights
+ */
+template <typename W>
+void load_sparse_weights(std::istream& is, W& w, std::unique_ptr<W>& mask) {
+    using T = etl::value_t<W>;
+
+    const size_t V = etl::dim<0>(w);
+    const size_t H = etl::dim<1>(w);
+
+    size_t nnz = 0;
+    cpp::binary_load(is, nnz);
+
+    std::vector<size_t> row_ptr(V + 1);
+    std::vector<uint32_t> columns(nnz);
+    std::vector<T> values(nnz);
+
+    cpp::binary_load_all(is, row_ptr);
+    cpp::binary_load_all(is, columns);
+    cpp::binary_load_all(is, values);
+
+    // All the zeros are considered pruned
+    if (!mask) {
+        mask = std::make_unique<W>(w);
+    }
+
+    w     = T(0);
+    *mask = T(0);
+
+    auto* w_p = w.memory_start();
+    auto* m_p = mask->memory_start();
+
+    for (size_t i = 0; i < V; ++i) {
+        for (size_t k = row_ptr[i]; k < row_ptr[i + 1]; ++k) {
+            w_p[i * H + columns[k]] = values[k];
+            m_p[i * H + columns[k]] = T(1);
+        }
+    }
+
+    w.invalidate_gpu();
+    mask->invalidate_gpu();
+}
+
+} //end of dll namespace
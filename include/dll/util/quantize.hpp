@@ -0,0 +1,410 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Kernels and layers of the 8-bit quantized inference
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/function.hpp"
+#include "dll/util/epilogue.hpp"
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Call functor(first, last) on chunks of [0, n), on the scoped
+ * thread pool if there is one.
+ */
+template <typename Functor>
+void quantized_chunks(size_t n, Functor&& functor) {
+    auto* pool = scoped_thread_pool();
+
+    if (pool && n > 1) {
+        const size_t chunks = std::min(n, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&functor, n, chunks](size_t c) {
+            functor((c * n) / chunks, ((c + 1) * n) / chunks);
+        });
+    } else {
+        functor(0, n);
+    }
+}
+
+/*!
+ * \brief Quantize one value to int8 with the given inverse scale
+ */
+template <typename T>
+inline int8_t quantize_value(T v, T inv_scale) {
+    return int8_t(std::min(T(127), std::max(T(-127), std::round(v * inv_scale))));
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Returns the symmetric int8 scale of values in [-max_abs, max_abs]
+ */
+template <typename T>
+T quantization_scale(T max_abs) {
+    return max_abs > T(0) ? max_abs / T(127) : T(1);
+}
+
+/*!
+ * \brief Quantize a batch of values to int8, with a single scale
+ * \param input The values, with or without direct memory access
+ * \param scale The quantization scale
+ * \param output The quantized values, resized if necessary
+ */
+template <typename I, typename T>
+void quantize_batch(const I& input, T scale, std::vector<int8_t>& output) {
+    if constexpr (etl::is_dma<I>) {
+        input.ensure_cpu_up_to_date();
+
+        const size_t n = etl::size(input);
+
+        output.resize(n);
+
+        const T* in = input.memory_start();
+        const T inv = T(1) / scale;
+        int8_t* out = output.data();
+
+        detail::quantized_chunks(n, [=](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                out[i] = detail::quantize_value(in[i], inv);
+            }
+        });
+    } else {
+        quantize_batch(etl::force_temporary(input), scale, output);
+    }
+}
+
+/*!
+ * \brief Weights quantized to int8 with one scale per output channel.
+ *
+ * The weights are stored channel-major, each channel being contiguous.
+ */
+template <typename T>
+struct quantized_weights {
+    std::vector<int8_t> values; ///< The quantized weights
+    std::vector<T> scales;      ///< The scale of each channel
+
+    size_t channels = 0; ///< The number of channels
+    size_t size     = 0; ///< The number of weights per channel
+
+    /*!
+     * \brief Quantize the given weights (channels x size)
+     */
+    void quantize(const T* w, size_t channels, size_t size) {
+        this->channels = channels;
+        this->size     = size;
+
+        values.resize(channels * size);
+        scales.resize(channels);
+
+        for (size_t c = 0; c < channels; ++c) {
+            const T* w_c = w + c * size;
+
+            T max_abs = 0;
+
+            for (size_t i = 0; i < size; ++i) {
+                max_abs = std::max(max_abs, std::abs(w_c[i]));
+            }
+
+            scales[c] = quantization_scale(max_abs);
+
+            const T inv = T(1) / scales[c];
+
+            for (size_t i = 0; i < size; ++i) {
+                values[c * size + i] = detail::quantize_value(w_c[i], inv);
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the quantized weights of the given channel
+     */
+    const int8_t* channel(size_t c) const {
+        return values.data() + c * size;
+    }
+};
+
+/*!
+ * \brief Compute a quantized dense product, with int32 accumulation, and
+ * requantize the result in the same pass, with the biases and the
+ * activation function F: output = F(in_scale * w_scale(j) * (x . w(j)) + b(j))
+ * \param input The quantized input (B x NV)
+ * \param w The quantized weights (NH x NV)
+ * \param b The biases
+ * \param in_scale The scale of the input
+ * \param output The output (B x NH)
+ */
+template <function F, typename T>
+void quantized_dense_forward(const int8_t* input, const quantized_weights<T>& w, const T* b, T in_scale, T* output, size_t B) {
+    const size_t NV = w.size;
+    const size_t NH = w.channels;
+
+    detail::quantized_chunks(B, [=, &w](size_t first, size_t last) {
+        for (size_t s = first; s < last; ++s) {
+            const int8_t* x = input + s * NV;
+            T* out          = output + s * NH;
+
+            for (size_t j = 0; j < NH; ++j) {
+                const int8_t* w_j = w.channel(j);
+
+                int32_t acc = 0;
+
+                for (size_t i = 0; i < NV; ++i) {
+                    acc += int32_t(x[i]) * int32_t(w_j[i]);
+                }
+
+                out[j] = detail::activate_value<F>(T(acc) * (in_scale * w.scales[j]) + b[j]);
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute a quantized (grouped) convolution, with int32
+ * accumulation, and requantize the result in the same pass, with the
+ * biases and the activation function F.
+ *
+ * The convolution is a cross-correlation, like etl::ml::convolution_forward,
+ * with a zero padding of (P1, P2).
+ *
+ * \param input The quantized input (B x C x H x W)
+ * \param w The quantized filters (K x C / G x NW1 x NW2)
+ * \param b The biases
+ * \param in_scale The scale of the input
+ * \param output The output (B x K x HO x WO)
+ */
+template <function F, typename T>
+void quantized_conv_forward(const int8_t* input, const quantized_weights<T>& w, const T* b, T in_scale, T* output,
+                            size_t B, size_t C, size_t H, size_t W, size_t NW1, size_t NW2, size_t P1, size_t P2, size_t G) {
+    const size_t K  = w.channels;
+    const size_t CG = C / G;
+    const size_t KG = K / G;
+    const size_t HO = H + 2 * P1 - NW1 + 1;
+    const size_t WO = W + 2 * P2 - NW2 + 1;
+
+    detail::quantized_chunks(B * K, [=, &w](size_t first, size_t last) {
+        std::vector<int32_t> acc(HO * WO);
+
+        for (size_t bk = first; bk < last; ++bk) {
+            const size_t s = bk / K;
+            const size_t k = bk % K;
+            const size_t g = k / KG;
+
+            std::fill(acc.begin(), acc.end(), 0);
+
+            for (size_t c = 0; c < CG; ++c) {
+                const int8_t* in  = input + (s * C + g * CG + c) * H * W;
+                const int8_t* w_c = w.channel(k) + c * NW1 * NW2;
+
+                for (size_t ki = 0; ki < NW1; ++ki) {
+                    for (size_t kj = 0; kj < NW2; ++kj) {
+                        const int32_t wv = w_c[ki * NW2 + kj];
+
+                        // Output columns whose input column is not in the padding
+                        const size_t j_first = kj < P2 ? P2 - kj : 0;
+                        const size_t j_last  = std::min(WO, W + P2 - kj);
+
+                        for (size_t i = 0; i < HO; ++i) {
+                            if (i + ki < P1 || i + ki - P1 >= H) {
+                                continue;
+                            }
+
+                            const int8_t* in_row = in + (i + ki - P1) * W;
+                            int32_t* acc_row     = acc.data() + i * WO;
+
+                            for (size_t j = j_first; j < j_last; ++j) {
+                                acc_row[j] += wv * int32_t(in_row[j + kj - P2]);
+                            }
+                        }
+                    }
+                }
+            }
+
+            const T scale = in_scale * w.scales[k];
+
+            T* out = output + bk * HO * WO;
+
+            for (size_t i = 0; i < HO * WO; ++i) {
+                out[i] = detail::activate_value<F>(T(acc[i]) * scale + b[k]);
+            }
+        }
+    });
+}
+
+/*!
+ * \brief The function applied in the requantization epilogue, the
+ * softmax being applied on the whole output afterwards
+ */
+template <function F>
+constexpr function epilogue_function = fused_epilogue<F> ? F : function::IDENTITY;
+
+/*!
+ * \brief Quantized inference version of a dense layer
+ */
+template <typename T, function F>
+struct quantized_dense_layer {
+    quantized_weights<T> w; ///< The quantized weights (num_hidden x num_visible)
+    std::vector<T> b;       ///< The biases
+    T in_scale = 1;         ///< The scale of the input
+
+    mutable std::vector<int8_t> q_input; ///< The quantized input
+
+    /*!
+     * \brief Quantize the given layer
+     * \param layer The dense layer
+     * \param max_abs The maximum absolute value of the input of the layer
+     */
+    template <typename L>
+    void init(const L& layer, T max_abs) {
+        etl::dyn_matrix<T, 2> w_t(etl::transpose(layer.w));
+
+        w.quantize(w_t.memory_start(), etl::dim<0>(w_t), etl::dim<1>(w_t));
+
+        b.assign(w.channels, T(0));
+
+        if constexpr (!L::no_bias) {
+            layer.b.ensure_cpu_up_to_date();
+            std::copy(layer.b.memory_start(), layer.b.memory_start() + w.channels, b.begin());
+        }
+
+        in_scale = quantization_scale(max_abs);
+    }
+
+    /*!
+     * \brief Apply the layer to a batch of input
+     */
+    template <typename I>
+    etl::dyn_matrix<T, 2> forward_batch(const I& input) const {
+        const size_t B = etl::dim<0>(input);
+
+        cpp_assert(etl::size(input) == B * w.size, "Invalid input for the quantized dense layer");
+
+        etl::dyn_matrix<T, 2> output(B, w.channels);
+
+        quantize_batch(input, in_scale, q_input);
+        quantized_dense_forward<epilogue_function<F>>(q_input.data(), w, b.data(), in_scale, output.memory_start(), B);
+
+        output.invalidate_gpu();
+
+        if constexpr (!fused_epilogue<F>) {
+            output = f_activate<F>(output);
+        }
+
+        return output;
+    }
+};
+
+/*!
+ * \brief Quantized inference version of a convolutional layer
+ */
+template <typename T, function F, bool Same>
+struct quantized_conv_layer {
+    quantized_weights<T> w; ///< The quantized filters
+    std::vector<T> b;       ///< The biases
+    T in_scale = 1;         ///< The scale of the input
+
+    size_t groups = 1; ///< The number of groups of filters
+    size_t nw1    = 0; ///< The first dimension of the filters
+    size_t nw2    = 0; ///< The second dimension of the filters
+
+    mutable std::vector<int8_t> q_input; ///< The quantized input
+
+    /*!
+     * \brief Quantize the given layer
+     * \param layer The convolutional layer
+     * \param max_abs The maximum absolute value of the input of the layer
+     */
+    template <typename L>
+    void init(const L& layer, T max_abs) {
+        layer.w.ensure_cpu_up_to_date();
+
+        const size_t K = etl::dim<0>(layer.w);
+
+        groups = L::Groups;
+        nw1    = etl::dim<2>(layer.w);
+        nw2    = etl::dim<3>(layer.w);
+
+        if constexpr (Same) {
+            cpp_assert(layer.geometry().S1 == 1 && layer.geometry().S2 == 1, "The quantized same convolution only works without strides");
+            cpp_assert(nw1 % 2 == 1 && nw2 % 2 == 1, "The quantized same convolution only works with odd-sized filters");
+        }
+
+        w.quantize(layer.w.memory_start(), K, etl::size(layer.w) / K);
+
+        b.assign(K, T(0));
+
+        if constexpr (has_biases<L>()) {
+            layer.b.ensure_cpu_up_to_date();
+            std::copy(layer.b.memory_start(), layer.b.memory_start() + K, b.begin());
+        }
+
+        in_scale = quantization_scale(max_abs);
+    }
+
+    /*!
+     * \brief Apply the layer to a batch of input (B x C x H x W)
+     */
+    template <typename I>
+    etl::dyn_matrix<T, 4> forward_batch(const I& input) const {
+        static_assert(etl::dimensions<I>() == 4, "The quantized convolutional layers need 4D input");
+
+        const size_t B  = etl::dim<0>(input);
+        const size_t C  = etl::dim<1>(input);
+        const size_t H  = etl::dim<2>(input);
+        const size_t W  = etl::dim<3>(input);
+        const size_t P1 = Same ? (nw1 - 1) / 2 : 0;
+        const size_t P2 = Same ? (nw2 - 1) / 2 : 0;
+
+        etl::dyn_matrix<T, 4> output(B, w.channels, H + 2 * P1 - nw1 + 1, W + 2 * P2 - nw2 + 1);
+
+        quantize_batch(input, in_scale, q_input);
+        quantized_conv_forward<epilogue_function<F>>(q_input.data(), w, b.data(), in_scale, output.memory_start(), B, C, H, W, nw1, nw2, P1, P2, groups);
+
+        output.invalidate_gpu();
+
+        if constexpr (!fused_epilogue<F>) {
+            output = f_activate<F>(output);
+        }
+
+        return output;
+    }
+
+private:
+    /*!
+     * \brief Indicates if the given layer has biases, the same convolutional
+     * layers always having biases
+     */
+    template <typename L>
+    static constexpr bool has_biases() {
+        if constexpr (Same) {
+            return true;
+        } else {
+            return !L::no_bias;
+        }
+    }
+};
+
+} //end of dll namespace
@@ -7,7 +7,13 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <iostream>
 #include <random>
+#include <sstream>
+#include <string>
+#include <thread>
 
 namespace dll {
 
@@ -52,14 +58,170 @@ inline void set_seed(size_t new_seed){
     detail::seed_impl(new_seed);
 }
 
+namespace detail {
+
+/*!
+ * \brief Mix the bits of the given value (splitmix64 finalizer)
+ */
+inline uint64_t mix_bits(uint64_t x){
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/*!
+ * \brief The counter used to allocate new streams
+ */
+inline std::atomic<size_t>& stream_counter(){
+    static std::atomic<size_t> counter(1);
+    return counter;
+}
+
+/*!
+ * \brief The engine currently used by the thread, if any (see engine_scope)
+ */
+inline random_engine*& scoped_engine(){
+    thread_local random_engine* engine = nullptr;
+    return engine;
+}
+
+} // end of namespace detail
+
+/*!
+ * \brief Allocate new random streams.
+ *
+ * The streams are numbered in the order of allocation, which makes them
+ * reproducible as long as they are allocated in the same order.
+ *
+ * \param n The number of consecutive streams to allocate
+ * \return The id of the first allocated stream
+ */
+inline size_t new_streams(size_t n = 1){
+    return detail::stream_counter().fetch_add(n);
+}
+
+/*!
+ * \brief Compute the seed of the engine of the given stream, at the given
+ * counter.
+ *
+ * The stream 0 at counter 0 is the main stream of DLL and is seeded with
+ * the DLL seed directly. The seeds only depend on the DLL seed, the stream
+ * and the counter, not on which thread uses them.
+ *
+ * \param stream The id of the stream
+ * \param counter The counter inside the stream
+ * \return The seed of the engine
+ */
+inline size_t stream_seed(size_t stream, size_t counter = 0){
+    if (!stream && !counter) {
+        return seed();
+    }
+
+    return detail::mix_bits(detail::mix_bits(seed() ^ detail::mix_bits(stream)) + counter);
+}
+
+/*!
+ * \brief Create an engine for the given stream and counter
+ * \param stream The id of the stream
+ * \param counter The counter inside the stream
+ * \return a new random engine
+ */
+inline random_engine make_engine(size_t stream, size_t counter = 0){
+    return random_engine(stream_seed(stream, counter));
+}
+
 /*!
- * \brief Return a reference to the DLL random engine
+ * \brief Make rand_engine() return the given engine on the current thread,
+ * for the lifetime of the scope.
+ */
+struct engine_scope {
+    random_engine* previous; ///< The engine used before the scope
+
+    /*!
+     * \brief Start using the given engine on the current thread
+     */
+    explicit engine_scope(random_engine& engine) : previous(detail::scoped_engine()) {
+        detail::scoped_engine() = &engine;
+    }
+
+    engine_scope(const engine_scope& rhs) = delete;
+    engine_scope& operator=(const engine_scope& rhs) = delete;
+
+    /*!
+     * \brief Restore the previous engine
+     */
+    ~engine_scope() {
+        detail::scoped_engine() = previous;
+    }
+};
+
+/*!
+ * \brief Return a reference to the DLL random engine of the current thread.
+ *
+ * Inside an engine_scope, this is the engine of the scope. Otherwise, the
+ * first thread to use it gets the main engine and the other threads get
+ * an engine on a new stream.
+ *
  * \return The DLL random engine
  */
 inline random_engine& rand_engine(){
+    if (auto* engine = detail::scoped_engine()) {
+        return *engine;
+    }
+
     static random_engine engine(seed());
+    static const auto main_thread = std::this_thread::get_id();
 
-    return engine;
+    if (std::this_thread::get_id() == main_thread) {
+        return engine;
+    }
+
+    thread_local random_engine local(stream_seed(new_streams()));
+
+    return local;
+}
+
+/*!
+ * \brief Store the state of the random generation of the current thread
+ * (the seed, the counter of the streams and its engine) into the given
+ * stream.
+ *
+ * The engines of the other threads are not stored, they are created again
+ * from new streams.
+ *
+ * \param os The output stream
+ */
+inline void store_random_state(std::ostream& os){
+    std::ostringstream engine;
+    engine << rand_engine();
+
+    const std::string text = engine.str();
+
+    const size_t values[3] = {seed(), detail::stream_counter().load(), text.size()};
+
+    os.write(reinterpret_cast<const char*>(values), sizeof(values));
+    os.write(text.data(), text.size());
+}
+
+/*!
+ * \brief Load the state of the random generation of the current thread
+ * from the given stream, written by store_random_state
+ * \param is The input stream
+ */
+inline void load_random_state(std::istream& is){
+    size_t values[3] = {0, 0, 0};
+
+    is.read(reinterpret_cast<char*>(values), sizeof(values));
+
+    std::string text(values[2], ' ');
+    is.read(&text[0], text.size());
+
+    set_seed(values[0]);
+    detail::stream_counter().store(values[1]);
+
+    std::istringstream engine(text);
+    engine >> rand_engine();
 }
 
 } //end of dll namespace
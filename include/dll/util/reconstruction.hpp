@@ -0,0 +1,73 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused kernel of the reconstruction metrics (error and loss) of a
+ * batch of outputs against their expected values
+ *
+ * The absolute error and the loss are accumulated in a single pass over
+ * the outputs and the labels. The outputs of the binary cross entropy are
+ * clipped value by value, in registers, instead of in a clipped copy of
+ * the batch.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "dll/loss.hpp"
+
+namespace dll {
+
+constexpr double bce_clip_min = 0.001; ///< The smallest output of the binary cross entropy, to avoid log(0)
+constexpr double bce_clip_max = 0.999; ///< The largest output of the binary cross entropy, to avoid log(0)
+
+/*!
+ * \brief Compute the sums of the absolute errors and of the losses of the
+ * given n outputs against the given n labels.
+ *
+ * The loss of the MEAN_SQUARED_ERROR is the squared error and the loss of
+ * the BINARY_CROSS_ENTROPY is the (positive) cross entropy of the clipped
+ * output. The absolute error is always computed on the raw output.
+ *
+ * \tparam Loss The loss function, MEAN_SQUARED_ERROR or BINARY_CROSS_ENTROPY
+ *
+ * \param output The outputs
+ * \param labels The expected values
+ * \param n The number of values
+ *
+ * \return a pair containing (sum of the absolute errors, sum of the losses)
+ */
+template <loss_function Loss, typename T, typename L>
+std::pair<double, double> reconstruction_metrics(const T* output, const L* labels, size_t n) {
+    static_assert(Loss == loss_function::MEAN_SQUARED_ERROR || Loss == loss_function::BINARY_CROSS_ENTROPY, "Only the reconstruction losses have a fused kernel");
+
+    double error = 0.0;
+    double loss  = 0.0;
+
+    for (size_t i = 0; i < n; ++i) {
+        const double o = output[i];
+        const double l = labels[i];
+
+        error += std::abs(l - o);
+
+        if constexpr (Loss == loss_function::MEAN_SQUARED_ERROR) {
+            loss += (o - l) * (o - l);
+        } else {
+            const double c = std::min(std::max(o, bce_clip_min), bce_clip_max);
+
+            loss -= l * std::log(c) + (1.0 - l) * std::log(1.0 - c);
+        }
+    }
+
+    return {error, loss};
+}
+
+} //end of dll namespace
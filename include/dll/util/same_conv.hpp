@@ -0,0 +1,529 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Boundary-aware kernels of the 'same' convolutions.
+ *
+ * The zero border of the input is never materialized: the direct kernels
+ * clip the filters to the input and the lowered kernels (im2col + GEMM)
+ * write zeros for the positions outside of the input. The filters can have
+ * even sizes (the extra padding is at the bottom and the right, as in
+ * TensorFlow) and the convolutions can be strided, the output having
+ * ceil(H / S1) x ceil(W / S2) pixels.
+ *
+ * The lowering of the input of a training batch can be kept by the forward
+ * pass (same_conv_lowered) and reused for the gradients of the filters.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/grouped_conv.hpp" // for the chunks of samples
+#include "dll/util/workspace.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The minimum number of rows of the lowered input (channels x filter
+ * size) for the lowered kernels to be used instead of the direct kernels
+ */
+constexpr size_t same_conv_lowering_rows = 32;
+
+/*!
+ * \brief The geometry of a 'same' convolution
+ */
+struct same_conv_geometry {
+    size_t C;   ///< The number of input channels
+    size_t H;   ///< The height of the input
+    size_t W;   ///< The width of the input
+    size_t K;   ///< The number of filters
+    size_t NW1; ///< The height of the filters
+    size_t NW2; ///< The width of the filters
+    size_t S1;  ///< The vertical stride
+    size_t S2;  ///< The horizontal stride
+    size_t HO;  ///< The height of the output
+    size_t WO;  ///< The width of the output
+    size_t P1;  ///< The padding at the top
+    size_t P2;  ///< The padding at the left
+
+    same_conv_geometry(size_t C, size_t H, size_t W, size_t K, size_t NW1, size_t NW2, size_t S1 = 1, size_t S2 = 1)
+            : C(C), H(H), W(W), K(K), NW1(NW1), NW2(NW2), S1(S1), S2(S2),
+              HO(same_output(H, S1)), WO(same_output(W, S2)),
+              P1(same_padding(H, HO, NW1, S1)), P2(same_padding(W, WO, NW2, S2)) {}
+
+    /*!
+     * \brief Returns the size of the output of a 'same' convolution of the
+     * given size and stride
+     */
+    static constexpr size_t same_output(size_t n, size_t s) {
+        return (n + s - 1) / s;
+    }
+
+    /*!
+     * \brief Returns the padding before the input of a 'same' convolution,
+     * half of the total padding, rounded down
+     */
+    static constexpr size_t same_padding(size_t n, size_t no, size_t nw, size_t s) {
+        return ((no - 1) * s + nw > n ? (no - 1) * s + nw - n : 0) / 2;
+    }
+
+    /*!
+     * \brief Returns the number of rows of the lowered input
+     */
+    size_t rows() const {
+        return C * NW1 * NW2;
+    }
+
+    /*!
+     * \brief Indicates if the lowered kernels are used
+     */
+    bool lowered() const {
+        return rows() >= same_conv_lowering_rows;
+    }
+
+    /*!
+     * \brief Returns the number of temporary elements of one chunk of samples
+     */
+    size_t chunk_size() const {
+        return lowered() ? rows() * HO * WO : 0;
+    }
+};
+
+/*!
+ * \brief Returns the size of the workspace, in bytes, needed by the kernels
+ * of a 'same' convolution, for any batch size
+ */
+template <typename T>
+size_t same_conv_workspace_size(const same_conv_geometry& g) {
+    const size_t chunks = std::max(1u, std::thread::hardware_concurrency());
+
+    return chunks * g.chunk_size() * sizeof(T);
+}
+
+/*!
+ * \brief The lowered input of the last training batch of a 'same'
+ * convolution, kept by the forward pass for the gradients of the filters.
+ *
+ * \tparam L The type used to store the lowered input (float, double or
+ * bfloat16)
+ */
+template <typename L>
+struct same_conv_lowered {
+    std::vector<L> values;       ///< The lowered samples (B x C * NW1 * NW2 x HO * WO)
+    size_t batch       = 0;       ///< The number of samples kept, 0 if none
+    const void* source = nullptr; ///< The memory of the input that was lowered
+
+    /*!
+     * \brief Prepare the storage for the lowering of the given input
+     * \return a pointer to the first lowered sample
+     */
+    L* prepare(const same_conv_geometry& g, size_t B, const void* input) {
+        values.resize(B * g.chunk_size());
+        batch  = B;
+        source = input;
+
+        return values.data();
+    }
+
+    /*!
+     * \brief Indicates if the lowering of the given input is kept
+     */
+    bool holds(size_t B, const void* input) const {
+        return batch == B && source == input;
+    }
+
+    /*!
+     * \brief Forget the kept lowering
+     */
+    void clear() {
+        batch  = 0;
+        source = nullptr;
+    }
+
+    /*!
+     * \brief Returns the size, in bytes, of the kept lowering
+     */
+    size_t memory_size() const {
+        return values.capacity() * sizeof(L);
+    }
+};
+
+namespace detail {
+
+/*!
+ * \brief Lower one sample (C x H x W) into col (C * NW1 * NW2 x HO * WO),
+ * with zeros for the positions outside of the input
+ */
+template <typename T>
+void same_conv_lower(const same_conv_geometry& g, const T* in, T* col) {
+    for (size_t c = 0; c < g.C; ++c) {
+        for (size_t i = 0; i < g.NW1; ++i) {
+            for (size_t j = 0; j < g.NW2; ++j) {
+                T* row = col + ((c * g.NW1 + i) * g.NW2 + j) * g.HO * g.WO;
+
+                for (size_t y = 0; y < g.HO; ++y) {
+                    // Wraps around for the top border
+                    const size_t yy = y * g.S1 + i - g.P1;
+
+                    for (size_t x = 0; x < g.WO; ++x) {
+                        const size_t xx = x * g.S2 + j - g.P2;
+
+                        row[y * g.WO + x] = yy < g.H && xx < g.W ? in[(c * g.H + yy) * g.W + xx] : T(0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Accumulate col (C * NW1 * NW2 x HO * WO) into one sample (C x H x
+ * W), the adjoint of same_conv_lower
+ */
+template <typename T>
+void same_conv_raise(const same_conv_geometry& g, const T* col, T* out) {
+    std::fill(out, out + g.C * g.H * g.W, T(0));
+
+    for (size_t c = 0; c < g.C; ++c) {
+        for (size_t i = 0; i < g.NW1; ++i) {
+            for (size_t j = 0; j < g.NW2; ++j) {
+                const T* row = col + ((c * g.NW1 + i) * g.NW2 + j) * g.HO * g.WO;
+
+                for (size_t y = 0; y < g.HO; ++y) {
+                    const size_t yy = y * g.S1 + i - g.P1;
+
+                    if (yy >= g.H) {
+                        continue;
+                    }
+
+                    for (size_t x = 0; x < g.WO; ++x) {
+                        const size_t xx = x * g.S2 + j - g.P2;
+
+                        if (xx < g.W) {
+                            out[(c * g.H + yy) * g.W + xx] += row[y * g.WO + x];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Returns the range [first, last) of the filter positions inside
+ * the input for the given output position
+ */
+inline std::pair<size_t, size_t> same_conv_range(size_t o, size_t s, size_t p, size_t nw, size_t n) {
+    const size_t start = o * s;
+    const size_t first = p > start ? p - start : 0;
+    const size_t last  = std::min(nw, n + p - start);
+
+    return {first, std::max(first, last)};
+}
+
+/*!
+ * \brief Compute the convolution of one sample, with the filters clipped to
+ * the input
+ */
+template <typename T>
+void same_conv_direct(const same_conv_geometry& g, const T* in, const T* w, T* out) {
+    for (size_t k = 0; k < g.K; ++k) {
+        for (size_t y = 0; y < g.HO; ++y) {
+            const auto [i_first, i_last] = same_conv_range(y, g.S1, g.P1, g.NW1, g.H);
+
+            for (size_t x = 0; x < g.WO; ++x) {
+                const auto [j_first, j_last] = same_conv_range(x, g.S2, g.P2, g.NW2, g.W);
+
+                T value(0);
+
+                for (size_t c = 0; c < g.C; ++c) {
+                    const T* w_kc = w + (k * g.C + c) * g.NW1 * g.NW2;
+
+                    for (size_t i = i_first; i < i_last; ++i) {
+                        const T* in_row = in + (c * g.H + y * g.S1 + i - g.P1) * g.W;
+
+                        for (size_t j = j_first; j < j_last; ++j) {
+                            value += w_kc[i * g.NW2 + j] * in_row[x * g.S2 + j - g.P2];
+                        }
+                    }
+                }
+
+                out[(k * g.HO + y) * g.WO + x] = value;
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Compute the gradients of the input of one sample, with the filters
+ * clipped to the input
+ */
+template <typename T>
+void same_conv_direct_backward(const same_conv_geometry& g, const T* errors, const T* w, T* out) {
+    std::fill(out, out + g.C * g.H * g.W, T(0));
+
+    for (size_t k = 0; k < g.K; ++k) {
+        for (size_t y = 0; y < g.HO; ++y) {
+            const auto [i_first, i_last] = same_conv_range(y, g.S1, g.P1, g.NW1, g.H);
+
+            for (size_t x = 0; x < g.WO; ++x) {
+                const auto [j_first, j_last] = same_conv_range(x, g.S2, g.P2, g.NW2, g.W);
+
+                const T e = errors[(k * g.HO + y) * g.WO + x];
+
+                for (size_t c = 0; c < g.C; ++c) {
+                    const T* w_kc = w + (k * g.C + c) * g.NW1 * g.NW2;
+
+                    for (size_t i = i_first; i < i_last; ++i) {
+                        T* out_row = out + (c * g.H + y * g.S1 + i - g.P1) * g.W;
+
+                        for (size_t j = j_first; j < j_last; ++j) {
+                            out_row[x * g.S2 + j - g.P2] += w_kc[i * g.NW2 + j] * e;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Compute the 'same' convolution (cross-correlation, as
+ * etl::ml::convolution_forward) of a batch, without padded copy of the
+ * input. The samples are computed in parallel.
+ *
+ * \param input The input batch, with direct memory access (B x C x H x W)
+ * \param w The filters, with direct memory access (K x C x NW1 x NW2)
+ * \param output The output batch, with direct memory access (B x K x HO x WO)
+ * \param g The geometry of the convolution
+ * \param ws The workspace for the temporaries (can be nullptr)
+ * \param kept If not nullptr, the lowered input is kept there for
+ * same_conv_backward_filter
+ */
+template <typename I, typename W, typename O, typename L = etl::value_t<I>>
+void same_conv_forward(const I& input, const W& w, O&& output, const same_conv_geometry& g, workspace* ws = nullptr, same_conv_lowered<L>* kept = nullptr) {
+    using T = etl::value_t<I>;
+
+    const size_t B = etl::dim<0>(input);
+
+    input.ensure_cpu_up_to_date();
+    w.ensure_cpu_up_to_date();
+    output.ensure_cpu_up_to_date();
+
+    const T* in_p = input.memory_start();
+    const T* w_p  = w.memory_start();
+    T* out_p      = output.memory_start();
+
+    const size_t chunks = detail::grouped_chunk_count(B);
+
+    // The lowering is kept in its storage type, directly lowered there if no conversion is needed
+    constexpr bool direct_keep = std::is_same<L, T>::value;
+
+    L* kept_p = nullptr;
+
+    if (kept) {
+        if (g.lowered()) {
+            kept_p = kept->prepare(g, B, in_p);
+        } else {
+            kept->clear();
+        }
+    }
+
+    workspace_lease<T> tmp(ws, direct_keep && kept_p ? 0 : chunks * g.chunk_size());
+
+    detail::grouped_chunks(B, [&](size_t c, size_t first, size_t last) {
+        for (size_t b = first; b < last; ++b) {
+            const T* in_b = in_p + b * g.C * g.H * g.W;
+            T* out_b      = out_p + b * g.K * g.HO * g.WO;
+
+            if (g.lowered()) {
+                T* col = tmp.data() + c * g.chunk_size();
+
+                if constexpr (direct_keep) {
+                    if (kept_p) {
+                        col = kept_p + b * g.chunk_size();
+                    }
+                }
+
+                detail::same_conv_lower(g, in_b, col);
+
+                etl::custom_dyn_matrix<T, 2> out_m(out_b, g.K, g.HO * g.WO);
+                out_m = etl::reshape(w, g.K, g.rows()) * etl::custom_dyn_matrix<T, 2>(col, g.rows(), g.HO * g.WO);
+
+                if constexpr (!direct_keep) {
+                    if (kept_p) {
+                        std::copy(col, col + g.chunk_size(), kept_p + b * g.chunk_size());
+                    }
+                }
+            } else {
+                detail::same_conv_direct(g, in_b, w_p, out_b);
+            }
+        }
+    });
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the gradients of the input of a 'same' convolution (as
+ * etl::ml::convolution_backward), the adjoint of same_conv_forward. The
+ * samples are computed in parallel.
+ *
+ * \param errors The errors of the output, with direct memory access (B x K x HO x WO)
+ * \param w The filters, with direct memory access (K x C x NW1 x NW2)
+ * \param output The gradients of the input, with direct memory access (B x C x H x W)
+ * \param g The geometry of the convolution
+ * \param ws The workspace for the temporaries (can be nullptr)
+ */
+template <typename E, typename W, typename O>
+void same_conv_backward(const E& errors, const W& w, O&& output, const same_conv_geometry& g, workspace* ws = nullptr) {
+    using T = etl::value_t<E>;
+
+    const size_t B = etl::dim<0>(errors);
+
+    errors.ensure_cpu_up_to_date();
+    w.ensure_cpu_up_to_date();
+    output.ensure_cpu_up_to_date();
+
+    const T* e_p = errors.memory_start();
+    const T* w_p = w.memory_start();
+    T* out_p     = output.memory_start();
+
+    const size_t chunks = detail::grouped_chunk_count(B);
+
+    workspace_lease<T> tmp(ws, chunks * g.chunk_size());
+
+    detail::grouped_chunks(B, [&](size_t c, size_t first, size_t last) {
+        for (size_t b = first; b < last; ++b) {
+            const T* e_b = e_p + b * g.K * g.HO * g.WO;
+            T* out_b     = out_p + b * g.C * g.H * g.W;
+
+            if (g.lowered()) {
+                T* col = tmp.data() + c * g.chunk_size();
+
+                etl::custom_dyn_matrix<T, 2> col_m(col, g.rows(), g.HO * g.WO);
+                col_m = etl::transpose(etl::reshape(w, g.K, g.rows())) * etl::reshape(etl::slice(errors, b, b + 1), g.K, g.HO * g.WO);
+
+                detail::same_conv_raise(g, col, out_b);
+            } else {
+                detail::same_conv_direct_backward(g, e_b, w_p, out_b);
+            }
+        }
+    });
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the gradients of the filters of a 'same' convolution (as
+ * etl::ml::convolution_backward_filter), summed over the batch.
+ *
+ * The lowered kernels accumulate one GEMM per sample, the direct kernels
+ * compute the filters in parallel, so that no reduction is necessary. The
+ * input is not lowered again if its lowering was kept by the forward pass.
+ *
+ * \param input The input batch, with direct memory access (B x C x H x W)
+ * \param errors The errors of the output, with direct memory access (B x K x HO x WO)
+ * \param grad The gradients of the filters, with direct memory access (K x C x NW1 x NW2)
+ * \param g The geometry of the convolution
+ * \param ws The workspace for the temporaries (can be nullptr)
+ * \param kept The lowered input kept by same_conv_forward (can be nullptr)
+ */
+template <typename I, typename E, typename G, typename L = etl::value_t<I>>
+void same_conv_backward_filter(const I& input, const E& errors, G&& grad, const same_conv_geometry& g, workspace* ws = nullptr, const same_conv_lowered<L>* kept = nullptr) {
+    using T = etl::value_t<I>;
+
+    const size_t B = etl::dim<0>(input);
+
+    input.ensure_cpu_up_to_date();
+    errors.ensure_cpu_up_to_date();
+
+    const T* in_p = input.memory_start();
+    const T* e_p  = errors.memory_start();
+
+    if (g.lowered()) {
+        const bool reuse = kept && kept->holds(B, in_p);
+
+        workspace_lease<T> tmp(ws, reuse && std::is_same<L, T>::value ? 0 : g.chunk_size());
+
+        auto grad_m = etl::reshape(grad, g.K, g.rows());
+
+        for (size_t b = 0; b < B; ++b) {
+            T* col = tmp.data();
+
+            if (!reuse) {
+                detail::same_conv_lower(g, in_p + b * g.C * g.H * g.W, col);
+            } else if constexpr (std::is_same<L, T>::value) {
+                // The GEMM only reads the kept lowering
+                col = const_cast<T*>(kept->values.data()) + b * g.chunk_size();
+            } else {
+                const L* kept_b = kept->values.data() + b * g.chunk_size();
+                std::copy(kept_b, kept_b + g.chunk_size(), col);
+            }
+
+            etl::custom_dyn_matrix<T, 2> col_m(col, g.rows(), g.HO * g.WO);
+
+            if (b == 0) {
+                grad_m = etl::reshape(etl::slice(errors, b, b + 1), g.K, g.HO * g.WO) * etl::transpose(col_m);
+            } else {
+                grad_m += etl::reshape(etl::slice(errors, b, b + 1), g.K, g.HO * g.WO) * etl::transpose(col_m);
+            }
+        }
+
+        return;
+    }
+
+    grad.ensure_cpu_up_to_date();
+
+    T* grad_p = grad.memory_start();
+
+    detail::grouped_chunks(g.K, [&](size_t /*c*/, size_t first, size_t last) {
+        std::fill(grad_p + first * g.C * g.NW1 * g.NW2, grad_p + last * g.C * g.NW1 * g.NW2, T(0));
+
+        for (size_t b = 0; b < B; ++b) {
+            const T* in_b = in_p + b * g.C * g.H * g.W;
+            const T* e_b  = e_p + b * g.K * g.HO * g.WO;
+
+            for (size_t k = first; k < last; ++k) {
+                for (size_t y = 0; y < g.HO; ++y) {
+                    const auto [i_first, i_last] = detail::same_conv_range(y, g.S1, g.P1, g.NW1, g.H);
+
+                    for (size_t x = 0; x < g.WO; ++x) {
+                        const auto [j_first, j_last] = detail::same_conv_range(x, g.S2, g.P2, g.NW2, g.W);
+
+                        const T e = e_b[(k * g.HO + y) * g.WO + x];
+
+                        for (size_t c = 0; c < g.C; ++c) {
+                            T* grad_kc = grad_p + (k * g.C + c) * g.NW1 * g.NW2;
+
+                            for (size_t i = i_first; i < i_last; ++i) {
+                                const T* in_row = in_b + (c * g.H + y * g.S1 + i - g.P1) * g.W;
+
+                                for (size_t j = j_first; j < j_last; ++j) {
+                                    grad_kc[i * g.NW2 + j] += e * in_row[x * g.S2 + j - g.P2];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    grad.invalidate_gpu();
+}
+
+} //end of namespace dll
@@ -0,0 +1,90 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Negative sampling of the classes of the sampled softmax
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/sampler_type.hpp"
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Draw one class of [0, classes) from the distribution S
+ * \param g The random engine
+ * \param classes The number of classes
+ */
+template <sampler_type S, typename G>
+size_t sample_class(G& g, size_t classes) {
+    if constexpr (S == sampler_type::UNIFORM) {
+        std::uniform_int_distribution<size_t> dist(0, classes - 1);
+        return dist(g);
+    } else {
+        // Inverse of the CDF of P(c) = log((c + 2) / (c + 1)) / log(classes + 1)
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+        const auto c = size_t(std::exp(dist(g) * std::log(classes + 1.0))) - 1;
+
+        return std::min(c, classes - 1);
+    }
+}
+
+/*!
+ * \brief Returns the probability of the class c in the distribution S
+ * \param c The class
+ * \param classes The number of classes
+ */
+template <sampler_type S>
+double class_probability(size_t c, size_t classes) {
+    if constexpr (S == sampler_type::UNIFORM) {
+        cpp_unused(c);
+
+        return 1.0 / classes;
+    } else {
+        return std::log((c + 2.0) / (c + 1.0)) / std::log(classes + 1.0);
+    }
+}
+
+/*!
+ * \brief Compute the candidate classes of a batch: the classes of the
+ * labels and the given number of negative classes drawn from S, sorted and
+ * without duplicates.
+ *
+ * \param positives The classes of the labels of the batch
+ * \param samples The number of negative classes to draw
+ * \param classes The number of classes
+ * \param candidates The candidate classes, to fill
+ */
+template <sampler_type S>
+void sample_candidates(const std::vector<size_t>& positives, size_t samples, size_t classes, std::vector<size_t>& candidates) {
+    auto& g = dll::rand_engine();
+
+    candidates = positives;
+    candidates.reserve(positives.size() + samples);
+
+    for (size_t s = 0; s < samples; ++s) {
+        candidates.push_back(sample_class<S>(g, classes));
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+}
+
+} //end of dll namespace
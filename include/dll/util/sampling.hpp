@@ -0,0 +1,322 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Batched sampling kernels with a counter-based random generator
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/multiversion.hpp"
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+namespace detail {
+
+constexpr size_t sampling_lanes = 16; ///< The number of Philox counters computed together
+
+/*!
+ * \brief Compute sampling_lanes blocks of the Philox4x32-10 counter-based
+ * generator.
+ *
+ * Each lane is independent, without any branch, for the loops to be
+ * vectorized by the compiler.
+ *
+ * \param counter The first counter (the lanes use counter + lane)
+ * \param key The key of the stream
+ * \param out The 4 * sampling_lanes random numbers, lane-major per word
+ */
+inline void philox_lanes(uint64_t counter, uint64_t key, uint32_t (&out)[4][sampling_lanes]) {
+    constexpr uint32_t M0 = 0xD2511F53;
+    constexpr uint32_t M1 = 0xCD9E8D57;
+    constexpr uint32_t W0 = 0x9E3779B9;
+    constexpr uint32_t W1 = 0xBB67AE85;
+
+    uint32_t c0[sampling_lanes];
+    uint32_t c1[sampling_lanes];
+    uint32_t c2[sampling_lanes];
+    uint32_t c3[sampling_lanes];
+
+    for (size_t l = 0; l < sampling_lanes; ++l) {
+        const uint64_t c = counter + l;
+
+        c0[l] = uint32_t(c);
+        c1[l] = uint32_t(c >> 32);
+        c2[l] = 0;
+        c3[l] = 0;
+    }
+
+    uint32_t k0 = uint32_t(key);
+    uint32_t k1 = uint32_t(key >> 32);
+
+    for (size_t round = 0; round < 10; ++round) {
+        for (size_t l = 0; l < sampling_lanes; ++l) {
+            const uint64_t p0 = uint64_t(M0) * c0[l];
+            const uint64_t p1 = uint64_t(M1) * c2[l];
+
+            const uint32_t n0 = uint32_t(p1 >> 32) ^ c1[l] ^ k0;
+            const uint32_t n1 = uint32_t(p1);
+            const uint32_t n2 = uint32_t(p0 >> 32) ^ c3[l] ^ k1;
+            const uint32_t n3 = uint32_t(p0);
+
+            c0[l] = n0;
+            c1[l] = n1;
+            c2[l] = n2;
+            c3[l] = n3;
+        }
+
+        k0 += W0;
+        k1 += W1;
+    }
+
+    for (size_t l = 0; l < sampling_lanes; ++l) {
+        out[0][l] = c0[l];
+        out[1][l] = c1[l];
+        out[2][l] = c2[l];
+        out[3][l] = c3[l];
+    }
+}
+
+/*!
+ * \brief Convert a random number to a float uniformly distributed in [0, 1)
+ */
+inline float to_uniform(uint32_t x) {
+    return float(x >> 8) * (1.0f / 16777216.0f);
+}
+
+/*!
+ * \brief Draw a new key for the sampling kernels from the random engine
+ * of the current thread, to integrate with its random stream
+ */
+inline uint64_t sampling_key() {
+    auto& g = dll::rand_engine();
+
+    return (uint64_t(g()) << 32) ^ uint64_t(g());
+}
+
+/*!
+ * \brief Apply the given functor to blocks of uniform random numbers
+ * covering n elements: functor(i, u) with the index of the element and its
+ * uniform number.
+ *
+ * The generator and the functor are compiled for the instruction set of
+ * the processor.
+ */
+template <typename Functor>
+DLL_MULTIVERSION void uniform_blocks(size_t n, Functor functor) {
+    constexpr size_t block = 4 * sampling_lanes;
+
+    const uint64_t key = sampling_key();
+
+    uint32_t r[4][sampling_lanes];
+
+    for (size_t first = 0; first < n; first += block) {
+        philox_lanes(first / 4, key, r);
+
+        const size_t last = std::min(n, first + block);
+
+        for (size_t i = first; i < last; ++i) {
+            const size_t j = i - first;
+
+            functor(i, to_uniform(r[j / sampling_lanes][j % sampling_lanes]));
+        }
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Sample binary states from the given activation probabilities.
+ *
+ * With direct memory access, this uses the Philox counter-based kernel,
+ * whose key is drawn from the random engine of the current thread.
+ * Otherwise, this is the ETL bernoulli expression.
+ *
+ * \param probs The activation probabilities
+ * \param samples The output samples (can be the same as probs)
+ */
+template <typename Probs, typename Samples>
+void sample_bernoulli(const Probs& probs, Samples&& samples) {
+    if constexpr (etl::is_dma<std::decay_t<Probs>> && etl::is_dma<std::decay_t<Samples>>) {
+        probs.ensure_cpu_up_to_date();
+        samples.ensure_cpu_up_to_date();
+
+        const auto* p = probs.memory_start();
+        auto* s       = samples.memory_start();
+
+        using value_t = std::decay_t<decltype(*s)>;
+
+        detail::uniform_blocks(etl::size(samples), [p, s](size_t i, float u) {
+            s[i] = u < p[i] ? value_t(1) : value_t(0);
+        });
+
+        samples.invalidate_gpu();
+    } else {
+        samples = etl::bernoulli(probs);
+    }
+}
+
+/*!
+ * \brief Sample binary states in place, from the activation probabilities
+ * stored in the given matrix
+ */
+template <typename Samples>
+void sample_bernoulli(Samples&& samples) {
+    sample_bernoulli(samples, samples);
+}
+
+/*!
+ * \brief Add gaussian noise to the given values, in place.
+ *
+ * With direct memory access, this uses the Philox counter-based kernel,
+ * with the Box-Muller transform. Otherwise, this is the ETL normal_noise
+ * expression.
+ *
+ * \param values The values to add noise to
+ * \param stddev The standard deviation of the noise
+ */
+template <typename Values>
+void add_normal_noise(Values&& values, float stddev = 1.0f) {
+    if constexpr (etl::is_dma<std::decay_t<Values>>) {
+        values.ensure_cpu_up_to_date();
+
+        auto* v = values.memory_start();
+
+        using value_t = std::decay_t<decltype(*v)>;
+
+        const size_t n = etl::size(values);
+
+        // The even elements keep the other uniform of their pair
+        float previous = 0.0f;
+
+        detail::uniform_blocks(n + (n & 1), [v, n, stddev, &previous](size_t i, float u) {
+            if (i & 1) {
+                const float r     = stddev * std::sqrt(-2.0f * std::log(1.0f - previous));
+                const float theta = 6.28318530718f * u;
+
+                v[i - 1] += value_t(r * std::cos(theta));
+
+                if (i < n) {
+                    v[i] += value_t(r * std::sin(theta));
+                }
+            } else {
+                previous = u;
+            }
+        });
+
+        values.invalidate_gpu();
+    } else if (stddev == 1.0f) {
+        values = etl::normal_noise(values);
+    } else {
+        values = values + etl::normal_generator(0.0, double(stddev));
+    }
+}
+
+/*!
+ * \brief Set each of the given values to zero with the given probability,
+ * in place (masking noise).
+ * \param values The values to corrupt, with direct memory access
+ * \param p The probability of a value to be set to zero
+ */
+template <typename Values>
+void mask_noise(Values&& values, float p) {
+    values.ensure_cpu_up_to_date();
+
+    auto* v = values.memory_start();
+
+    using value_t = std::decay_t<decltype(*v)>;
+
+    detail::uniform_blocks(etl::size(values), [v, p](size_t i, float u) {
+        v[i] = u < p ? value_t(0) : v[i];
+    });
+
+    values.invalidate_gpu();
+}
+
+/*!
+ * \brief Set each of the given values to zero or one with the given
+ * probability, in place (salt-and-pepper noise).
+ * \param values The values to corrupt, with direct memory access
+ * \param p The probability of a value to be corrupted
+ */
+template <typename Values>
+void salt_pepper_noise(Values&& values, float p) {
+    values.ensure_cpu_up_to_date();
+
+    auto* v = values.memory_start();
+
+    using value_t = std::decay_t<decltype(*v)>;
+
+    const float half = 0.5f * p;
+
+    detail::uniform_blocks(etl::size(values), [v, p, half](size_t i, float u) {
+        v[i] = u < p ? (u < half ? value_t(0) : value_t(1)) : v[i];
+    });
+
+    values.invalidate_gpu();
+}
+
+/*!
+ * \brief Add the biases to the given pre-activations (one row per sample),
+ * apply the logistic sigmoid if Sigmoid is set and sample binary states if
+ * Sample is set, in one pass over the memory.
+ *
+ * \param x The pre-activations, replaced by the activations
+ * \param b The biases, one per column
+ * \param samples The output samples (only used if Sample is set)
+ */
+template <bool Sigmoid, bool Sample, typename X, typename B, typename Samples>
+void bias_activation(X&& x, const B& b, Samples&& samples) {
+    x.ensure_cpu_up_to_date();
+    b.ensure_cpu_up_to_date();
+
+    auto* a        = x.memory_start();
+    const auto* bp = b.memory_start();
+
+    using value_t = std::decay_t<decltype(*a)>;
+
+    const size_t n = etl::size(x);
+    const size_t m = etl::size(b);
+
+    if constexpr (Sample) {
+        samples.ensure_cpu_up_to_date();
+
+        auto* s = samples.memory_start();
+
+        detail::uniform_blocks(n, [a, bp, s, m](size_t i, float u) {
+            const value_t v = a[i] + bp[i % m];
+
+            a[i] = Sigmoid ? value_t(1) / (value_t(1) + std::exp(-v)) : v;
+            s[i] = u < a[i] ? value_t(1) : value_t(0);
+        });
+
+        samples.invalidate_gpu();
+    } else {
+        detail::vectorized_for(m ? n / m : 0, [a, bp, m](size_t r) {
+            value_t* a_r = a + r * m;
+
+            for (size_t j = 0; j < m; ++j) {
+                const value_t v = a_r[j] + bp[j];
+
+                a_r[j] = Sigmoid ? value_t(1) / (value_t(1) + std::exp(-v)) : v;
+            }
+        });
+    }
+
+    x.invalidate_gpu();
+}
+
+} //end of dll namespace
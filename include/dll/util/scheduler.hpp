@@ -0,0 +1,401 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Work-stealing scheduler of fork-join tasks, shared by the parallel
+ * regions of DLL so that the nested regions compose.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/thread_pool_scope.hpp"
+
+namespace dll {
+
+struct work_stealing_scheduler;
+
+namespace detail {
+
+/*!
+ * \brief Returns the scheduler of the current scope on this thread
+ */
+inline work_stealing_scheduler*& scoped_scheduler() {
+    thread_local work_stealing_scheduler* scheduler = nullptr;
+    return scheduler;
+}
+
+/*!
+ * \brief Returns the index of the current thread in the workers of its
+ * scheduler, or -1 if it is not a worker
+ */
+inline long& scheduler_worker() {
+    thread_local long worker = -1;
+    return worker;
+}
+
+/*!
+ * \brief Returns the flag indicating if the shared scheduler is used by
+ * the parallel regions
+ */
+inline std::atomic<bool>& work_stealing_flag() {
+    static std::atomic<bool> flag{false};
+    return flag;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief A fork-join group of tasks: the tasks are run on the scheduler and
+ * wait() returns once they are all done.
+ */
+struct task_group {
+    explicit task_group(work_stealing_scheduler& scheduler) : scheduler(scheduler) {}
+
+    task_group(const task_group& rhs) = delete;
+    task_group& operator=(const task_group& rhs) = delete;
+
+    /*!
+     * \brief Wait for the remaining tasks
+     */
+    ~task_group() {
+        wait();
+    }
+
+    /*!
+     * \brief Fork a new task, run with the given thread pool scoped
+     */
+    template <typename Functor>
+    void run(Functor&& functor, cpp::thread_pool<true>* pool = scoped_thread_pool());
+
+    /*!
+     * \brief Wait for all the tasks of the group, running the pending
+     * tasks of the scheduler in the meantime
+     */
+    void wait();
+
+    work_stealing_scheduler& scheduler; ///< The scheduler of the tasks
+    std::atomic<size_t> remaining{0};   ///< The number of tasks not done yet
+};
+
+/*!
+ * \brief A work-stealing scheduler.
+ *
+ * Each worker has its own queue of tasks: the tasks forked by a worker are
+ * pushed to its queue and it runs them in LIFO order, while the idle
+ * workers steal the oldest tasks of the others. The tasks forked from the
+ * other threads go to a shared queue. A thread waiting for a group runs
+ * the pending tasks instead of blocking, so nested regions never block a
+ * worker and never need more threads than the workers.
+ *
+ * The tasks run with the thread pool scoped where they were forked and
+ * with the ETL expressions in serial, their parallelism being the one of
+ * the scheduler. The idle workers sleep.
+ */
+struct work_stealing_scheduler {
+    /*!
+     * \brief Start the given number of workers
+     */
+    explicit work_stealing_scheduler(size_t workers) : queues(workers + 1) {
+        for (auto& q : queues) {
+            q = std::make_unique<queue>();
+        }
+
+        for (size_t w = 0; w < workers; ++w) {
+            threads.emplace_back([this, w] { work(w); });
+        }
+    }
+
+    work_stealing_scheduler(const work_stealing_scheduler& rhs) = delete;
+    work_stealing_scheduler& operator=(const work_stealing_scheduler& rhs) = delete;
+
+    /*!
+     * \brief Stop and join the workers
+     */
+    ~work_stealing_scheduler() {
+        {
+            std::unique_lock<std::mutex> l(sleep_lock);
+            stopping = true;
+        }
+
+        wake.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Returns the number of workers
+     */
+    size_t size() const {
+        return threads.size();
+    }
+
+    /*!
+     * \brief Call functor(i) for each i in [first, last), each as a task
+     * except the first one, run by the calling thread.
+     *
+     * \param pool The thread pool scoped in the tasks
+     */
+    template <typename Functor>
+    void foreach_n(size_t first, size_t last, Functor&& functor, cpp::thread_pool<true>* pool = scoped_thread_pool()) {
+        if (first >= last) {
+            return;
+        }
+
+        task_group group(*this);
+
+        for (size_t i = first + 1; i < last; ++i) {
+            group.run([&functor, i] { functor(i); }, pool);
+        }
+
+        run_task([&functor, first] { functor(first); }, pool);
+
+        group.wait();
+    }
+
+    /*!
+     * \brief Run one pending task, from the queue of the current worker,
+     * the shared queue or the queue of another worker.
+     * \return true if a task was run, false if there was none
+     */
+    bool run_one() {
+        task t;
+
+        if (!take(t)) {
+            return false;
+        }
+
+        run_task(t.function, t.pool);
+
+        // The captures of the task must not outlive its group
+        t.function = nullptr;
+
+        t.group->remaining.fetch_sub(1, std::memory_order_release);
+
+        return true;
+    }
+
+private:
+    /*!
+     * \brief A task of a group
+     */
+    struct task {
+        std::function<void()> function;         ///< The work of the task
+        task_group* group;                      ///< The group of the task
+        cpp::thread_pool<true>* pool = nullptr; ///< The pool scoped when the task was forked
+    };
+
+    /*!
+     * \brief A queue of tasks, on its own cache lines
+     */
+    struct alignas(64) queue {
+        std::mutex lock;         ///< The lock of the queue
+        std::deque<task> tasks;  ///< The tasks
+    };
+
+    friend struct task_group;
+
+    /*!
+     * \brief Add a task to the queue of the current worker, or to the shared
+     * queue
+     */
+    void submit(task t) {
+        auto& q = *queues[current_queue()];
+
+        {
+            std::unique_lock<std::mutex> l(q.lock);
+            q.tasks.push_back(std::move(t));
+        }
+
+        pending.fetch_add(1, std::memory_order_release);
+
+        // The lock makes sure a worker going to sleep sees the task
+        {
+            std::unique_lock<std::mutex> l(sleep_lock);
+        }
+
+        wake.notify_one();
+    }
+
+    /*!
+     * \brief Returns the queue of the current thread
+     */
+    size_t current_queue() const {
+        const long worker = detail::scheduler_worker();
+
+        return detail::scoped_scheduler() == this && worker >= 0 ? size_t(worker) : queues.size() - 1;
+    }
+
+    /*!
+     * \brief Take a task: the newest of the own queue, or the oldest of the
+     * shared queue or of one of the others
+     */
+    bool take(task& t) {
+        if (!pending.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        const size_t self = current_queue();
+
+        auto pop = [this, &t](size_t index, bool back) {
+            auto& q = *queues[index];
+
+            std::unique_lock<std::mutex> l(q.lock);
+
+            if (q.tasks.empty()) {
+                return false;
+            }
+
+            if (back) {
+                t = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            } else {
+                t = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+
+            pending.fetch_sub(1, std::memory_order_relaxed);
+
+            return true;
+        };
+
+        if (pop(self, true)) {
+            return true;
+        }
+
+        const size_t n = queues.size();
+
+        for (size_t i = 1; i < n; ++i) {
+            if (pop((self + i) % n, false)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Run a task with the given scoped pool and in serial for ETL
+     */
+    template <typename Functor>
+    void run_task(Functor&& functor, cpp::thread_pool<true>* pool) {
+        auto& scoped_pool      = detail::scoped_thread_pool();
+        auto& scoped_scheduler = detail::scoped_scheduler();
+
+        auto* previous_pool      = scoped_pool;
+        auto* previous_scheduler = scoped_scheduler;
+
+        scoped_pool      = pool;
+        scoped_scheduler = this;
+
+        SERIAL_SECTION {
+            functor();
+        }
+
+        scoped_pool      = previous_pool;
+        scoped_scheduler = previous_scheduler;
+    }
+
+    /*!
+     * \brief The loop of a worker
+     */
+    void work(size_t w) {
+        detail::scheduler_worker() = w;
+        detail::scoped_scheduler() = this;
+
+        while (true) {
+            if (run_one()) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> l(sleep_lock);
+
+            wake.wait(l, [this] { return stopping || pending.load(std::memory_order_acquire); });
+
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<queue>> queues; ///< The queue of each worker, then the shared queue
+    std::vector<std::thread> threads;           ///< The workers
+    std::atomic<size_t> pending{0};             ///< The number of tasks in the queues
+
+    std::mutex sleep_lock;        ///< The lock of the sleeping workers
+    std::condition_variable wake; ///< The condition of the sleeping workers
+    bool stopping = false;        ///< Indicates if the workers must stop
+};
+
+template <typename Functor>
+void task_group::run(Functor&& functor, cpp::thread_pool<true>* pool) {
+    remaining.fetch_add(1, std::memory_order_relaxed);
+
+    scheduler.submit({std::forward<Functor>(functor), this, pool});
+}
+
+inline void task_group::wait() {
+    while (remaining.load(std::memory_order_acquire)) {
+        if (!scheduler.run_one()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/*!
+ * \brief Returns the scheduler shared by the networks, with one worker
+ * less than the hardware threads, the waiting thread running tasks too
+ */
+inline work_stealing_scheduler& shared_scheduler() {
+    static work_stealing_scheduler scheduler(std::max(2u, std::thread::hardware_concurrency()) - 1);
+    return scheduler;
+}
+
+/*!
+ * \brief Enable or disable the shared work-stealing scheduler for the
+ * parallel regions on the thread pools (maybe_parallel_foreach_n and the
+ * branches of the merge layers)
+ */
+inline void enable_work_stealing(bool enable = true) {
+    detail::work_stealing_flag().store(enable, std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Indicates if the shared work-stealing scheduler is used
+ */
+inline bool work_stealing_enabled() {
+    return detail::work_stealing_flag().load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Returns the scheduler of the parallel regions of the current
+ * thread: the scheduler of the current task, the shared scheduler if work
+ * stealing is enabled, or nullptr to use the thread pools.
+ */
+inline work_stealing_scheduler* active_scheduler() {
+    if (auto* scheduler = detail::scoped_scheduler()) {
+        return scheduler;
+    }
+
+    return work_stealing_enabled() ? &shared_scheduler() : nullptr;
+}
+
+} //end of dll namespace
@@ -0,0 +1,142 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Packing of the batches of variable-length sequences of the
+ * recurrent layers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The packing of a batch of variable-length sequences.
+ *
+ * The sequences are padded with zero time steps at their end: the length
+ * of a sequence is the index of its last non-zero time step plus one (at
+ * least one). The rows of the batch are sorted by decreasing length, so
+ * that the still active rows of each time step are the first rows of the
+ * batch and each time step only needs to be computed on them.
+ */
+struct sequence_packing {
+    std::vector<size_t> order;   ///< The sample of each packed row
+    std::vector<size_t> lengths; ///< The length of each packed row
+    std::vector<size_t> active;  ///< The number of active rows of each time step
+
+    /*!
+     * \brief Pack the given batch
+     * \param x The batch (Batch x time_steps x ...)
+     * \param variable Indicates if the sequences have variable lengths, if
+     * false, all the sequences are considered full-length
+     */
+    template <typename X>
+    void pack(const X& x, bool variable) {
+        const size_t B  = etl::dim<0>(x);
+        const size_t TS = etl::dim<1>(x);
+
+        order.resize(B);
+        lengths.resize(B);
+        active.resize(TS);
+
+        std::iota(order.begin(), order.end(), size_t(0));
+
+        if (!variable) {
+            std::fill(lengths.begin(), lengths.end(), TS);
+            std::fill(active.begin(), active.end(), B);
+            return;
+        }
+
+        std::vector<size_t> sample_lengths(B);
+
+        for (size_t b = 0; b < B; ++b) {
+            size_t l = TS;
+
+            while (l > 1 && is_padding(x(b)(l - 1))) {
+                --l;
+            }
+
+            sample_lengths[b] = l;
+        }
+
+        std::stable_sort(order.begin(), order.end(), [&sample_lengths](size_t lhs, size_t rhs) {
+            return sample_lengths[lhs] > sample_lengths[rhs];
+        });
+
+        for (size_t r = 0; r < B; ++r) {
+            lengths[r] = sample_lengths[order[r]];
+        }
+
+        for (size_t t = 0; t < TS; ++t) {
+            active[t] = std::count_if(lengths.begin(), lengths.end(), [t](size_t l) { return l > t; });
+        }
+    }
+
+private:
+    /*!
+     * \brief Indicates if the given time step is a padding one
+     */
+    template <typename S>
+    static bool is_padding(const S& step) {
+        for (size_t i = 0; i < etl::size(step); ++i) {
+            if (step[i] != 0) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+/*!
+ * \brief Copy the inactive rows of the previous time step to the current
+ * one, so that the padded steps of a finished sequence repeat its last
+ * output and state.
+ *
+ * \param cur The current time step (B x H)
+ * \param prev The previous time step (B x H)
+ * \param active The number of active rows of the current time step
+ */
+template <typename T>
+void carry_rows(T* cur, const T* prev, size_t active, size_t B, size_t H) {
+    std::copy(prev + active * H, prev + B * H, cur + active * H);
+}
+
+/*!
+ * \brief Move the errors of the padded time steps of each row to its last
+ * active time step.
+ *
+ * The padded steps repeat the output of the last active step, their
+ * errors are therefore errors of the last active step. The padded steps
+ * are then left with zero errors and contribute nothing to the
+ * backpropagation through time.
+ *
+ * \param delta_t The errors of the output (time_steps x Batch x H), packed
+ * \param packing The packing of the batch
+ */
+template <typename D>
+void fold_padded_errors(D& delta_t, const sequence_packing& packing) {
+    const size_t TS = etl::dim<0>(delta_t);
+
+    for (size_t r = 0; r < packing.lengths.size(); ++r) {
+        const size_t l = packing.lengths[r];
+
+        for (size_t t = l; t < TS; ++t) {
+            delta_t(l - 1)(r) += delta_t(t)(r);
+            delta_t(t)(r) = 0;
+        }
+    }
+}
+
+} //end of dll namespace
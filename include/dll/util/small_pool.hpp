@@ -0,0 +1,318 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Specialized kernels of the 2D max and average pooling with 2x2
+ * and 3x3 windows.
+ *
+ * The size of the window is a template parameter of the kernels of one
+ * plane, so the loops of the window are unrolled and the loops over the
+ * output columns are vectorized, in the best version for the processor.
+ * The planes (batch x channels) are computed in parallel on the scoped
+ * thread pool.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <type_traits>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/max_pool.hpp" // for the parallel chunks
+#include "dll/util/multiversion.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The windows with specialized pooling kernels
+ */
+enum class small_pool_window {
+    NONE, ///< No specialized kernel
+    W2X2, ///< 2x2 window
+    W3X3  ///< 3x3 window
+};
+
+/*!
+ * \brief Returns the specialized kernel of the given pooling window
+ */
+constexpr small_pool_window select_small_pool(size_t c1, size_t c2) {
+    return c1 == 2 && c2 == 2 ? small_pool_window::W2X2 : c1 == 3 && c2 == 3 ? small_pool_window::W3X3 : small_pool_window::NONE;
+}
+
+namespace detail {
+
+/*!
+ * \brief Max pooling of one plane (H x W) by CxC
+ */
+template <size_t C, typename T>
+DLL_MULTIVERSION void small_max_pool_plane(const T* in, T* out, size_t H, size_t W) {
+    const size_t OH = H / C;
+    const size_t OW = W / C;
+
+    for (size_t y = 0; y < OH; ++y) {
+        const T* in_y = in + y * C * W;
+        T* out_y      = out + y * OW;
+
+        for (size_t x = 0; x < OW; ++x) {
+            T m = in_y[x * C];
+
+            for (size_t i = 0; i < C; ++i) {
+                for (size_t j = 0; j < C; ++j) {
+                    const T v = in_y[i * W + x * C + j];
+                    m         = v > m ? v : m;
+                }
+            }
+
+            out_y[x] = m;
+        }
+    }
+}
+
+/*!
+ * \brief Average pooling of one plane (H x W) by CxC
+ */
+template <size_t C, typename T>
+DLL_MULTIVERSION void small_avg_pool_plane(const T* in, T* out, size_t H, size_t W) {
+    const size_t OH = H / C;
+    const size_t OW = W / C;
+
+    const T scale = T(1) / T(C * C);
+
+    for (size_t y = 0; y < OH; ++y) {
+        const T* in_y = in + y * C * W;
+        T* out_y      = out + y * OW;
+
+        for (size_t x = 0; x < OW; ++x) {
+            T s(0);
+
+            for (size_t i = 0; i < C; ++i) {
+                for (size_t j = 0; j < C; ++j) {
+                    s += in_y[i * W + x * C + j];
+                }
+            }
+
+            out_y[x] = s * scale;
+        }
+    }
+}
+
+/*!
+ * \brief Backpropagate the errors of one max pooled plane (H / C x W / C):
+ * each error goes to the positions of the window equal to its maximum
+ */
+template <size_t C, typename T>
+DLL_MULTIVERSION void small_max_pool_backward_plane(const T* in, const T* pooled, const T* errors, T* out, size_t H, size_t W) {
+    const size_t OH = H / C;
+    const size_t OW = W / C;
+
+    if (H % C || W % C) {
+        std::fill(out, out + H * W, T(0));
+    }
+
+    for (size_t y = 0; y < OH; ++y) {
+        for (size_t i = 0; i < C; ++i) {
+            const T* in_row = in + (y * C + i) * W;
+            T* out_row      = out + (y * C + i) * W;
+
+            for (size_t x = 0; x < OW; ++x) {
+                const T m = pooled[y * OW + x];
+                const T e = errors[y * OW + x];
+
+                for (size_t j = 0; j < C; ++j) {
+                    out_row[x * C + j] = in_row[x * C + j] == m ? e : T(0);
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Backpropagate the errors of one average pooled plane (H / C x W /
+ * C): each error is shared by the positions of its window
+ */
+template <size_t C, typename T>
+DLL_MULTIVERSION void small_avg_pool_backward_plane(const T* errors, T* out, size_t H, size_t W) {
+    const size_t OH = H / C;
+    const size_t OW = W / C;
+
+    const T scale = T(1) / T(C * C);
+
+    if (H % C || W % C) {
+        std::fill(out, out + H * W, T(0));
+    }
+
+    for (size_t y = 0; y < OH; ++y) {
+        for (size_t i = 0; i < C; ++i) {
+            T* out_row = out + (y * C + i) * W;
+
+            for (size_t x = 0; x < OW; ++x) {
+                const T e = errors[y * OW + x] * scale;
+
+                for (size_t j = 0; j < C; ++j) {
+                    out_row[x * C + j] = e;
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Call functor(c, n) on each plane n of the batch, in parallel, with
+ * c the size of the given window as an std::integral_constant
+ */
+template <typename Functor>
+void small_pool_planes(small_pool_window window, size_t N, Functor&& functor) {
+    max_pool_chunks(N, [&](size_t first, size_t last) {
+        for (size_t n = first; n < last; ++n) {
+            if (window == small_pool_window::W2X2) {
+                functor(std::integral_constant<size_t, 2>{}, n);
+            } else {
+                functor(std::integral_constant<size_t, 3>{}, n);
+            }
+        }
+    });
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief 2D max pooling of the last two dimensions of the input, by the
+ * given specialized window
+ *
+ * \param output The output (... x H / C x W / C), with direct memory access
+ * \param input The input (... x H x W), with direct memory access
+ * \param window The window, one of the specialized windows
+ */
+template <typename Output, typename Input>
+void small_max_pool_forward(Output&& output, const Input& input, small_pool_window window) {
+    using T = etl::value_t<Input>;
+
+    cpp_assert(window != small_pool_window::NONE, "The window has no specialized kernel");
+
+    const size_t D = etl::dimensions(input);
+    const size_t H = etl::dim(input, D - 2);
+    const size_t W = etl::dim(input, D - 1);
+    const size_t N = etl::size(input) / (H * W);
+    const size_t O = etl::size(output) / N;
+
+    input.ensure_cpu_up_to_date();
+
+    const T* in_p = input.memory_start();
+    T* out_p      = output.memory_start();
+
+    detail::small_pool_planes(window, N, [=](auto c, size_t n) {
+        detail::small_max_pool_plane<decltype(c)::value>(in_p + n * H * W, out_p + n * O, H, W);
+    });
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief 2D average pooling of the last two dimensions of the input, by
+ * the given specialized window
+ *
+ * \param output The output (... x H / C x W / C), with direct memory access
+ * \param input The input (... x H x W), with direct memory access
+ * \param window The window, one of the specialized windows
+ */
+template <typename Output, typename Input>
+void small_avg_pool_forward(Output&& output, const Input& input, small_pool_window window) {
+    using T = etl::value_t<Input>;
+
+    cpp_assert(window != small_pool_window::NONE, "The window has no specialized kernel");
+
+    const size_t D = etl::dimensions(input);
+    const size_t H = etl::dim(input, D - 2);
+    const size_t W = etl::dim(input, D - 1);
+    const size_t N = etl::size(input) / (H * W);
+    const size_t O = etl::size(output) / N;
+
+    input.ensure_cpu_up_to_date();
+
+    const T* in_p = input.memory_start();
+    T* out_p      = output.memory_start();
+
+    detail::small_pool_planes(window, N, [=](auto c, size_t n) {
+        detail::small_avg_pool_plane<decltype(c)::value>(in_p + n * H * W, out_p + n * O, H, W);
+    });
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Backpropagate the errors of a 2D max pooling by the given
+ * specialized window (as etl::ml::max_pool_backward)
+ *
+ * \param output The errors of the input (... x H x W), with direct memory access
+ * \param input The input of the pooling (... x H x W), with direct memory access
+ * \param pooled The output of the pooling (... x H / C x W / C), with direct memory access
+ * \param errors The errors of the output (... x H / C x W / C), with direct memory access
+ * \param window The window, one of the specialized windows
+ */
+template <typename Output, typename Input, typename Pooled, typename Errors>
+void small_max_pool_backward(Output&& output, const Input& input, const Pooled& pooled, const Errors& errors, small_pool_window window) {
+    using T = etl::value_t<Input>;
+
+    cpp_assert(window != small_pool_window::NONE, "The window has no specialized kernel");
+
+    const size_t D = etl::dimensions(input);
+    const size_t H = etl::dim(input, D - 2);
+    const size_t W = etl::dim(input, D - 1);
+    const size_t N = etl::size(input) / (H * W);
+    const size_t O = etl::size(errors) / N;
+
+    input.ensure_cpu_up_to_date();
+    pooled.ensure_cpu_up_to_date();
+    errors.ensure_cpu_up_to_date();
+
+    const T* in_p = input.memory_start();
+    const T* p_p  = pooled.memory_start();
+    const T* e_p  = errors.memory_start();
+    T* out_p      = output.memory_start();
+
+    detail::small_pool_planes(window, N, [=](auto c, size_t n) {
+        detail::small_max_pool_backward_plane<decltype(c)::value>(in_p + n * H * W, p_p + n * O, e_p + n * O, out_p + n * H * W, H, W);
+    });
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Backpropagate the errors of a 2D average pooling by the given
+ * specialized window (as etl::ml::avg_pool_backward)
+ *
+ * \param output The errors of the input (... x H x W), with direct memory access
+ * \param errors The errors of the output (... x H / C x W / C), with direct memory access
+ * \param window The window, one of the specialized windows
+ */
+template <typename Output, typename Errors>
+void small_avg_pool_backward(Output&& output, const Errors& errors, small_pool_window window) {
+    using T = etl::value_t<Errors>;
+
+    cpp_assert(window != small_pool_window::NONE, "The window has no specialized kernel");
+
+    const size_t D = etl::dimensions(output);
+    const size_t H = etl::dim(output, D - 2);
+    const size_t W = etl::dim(output, D - 1);
+    const size_t N = etl::size(output) / (H * W);
+    const size_t O = etl::size(errors) / N;
+
+    errors.ensure_cpu_up_to_date();
+
+    const T* e_p = errors.memory_start();
+    T* out_p     = output.memory_start();
+
+    detail::small_pool_planes(window, N, [=](auto c, size_t n) {
+        detail::small_avg_pool_backward_plane<decltype(c)::value>(e_p + n * O, out_p + n * H * W, H, W);
+    });
+
+    output.invalidate_gpu();
+}
+
+} //end of dll namespace
@@ -0,0 +1,235 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Row-wise softmax and log-softmax kernels for wide outputs
+ *
+ * Each row is computed in two passes over memory. The first pass keeps a
+ * running maximum and a running sum of the exponentials, rescaled when the
+ * maximum grows, block by block so that each block is read a second time
+ * from the cache. The second pass normalizes the exponentials (or
+ * subtracts the log-sum-exp for the log-softmax). The rows are computed in
+ * parallel.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/multiversion.hpp"
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The number of values of a row whose maximum is computed before
+ * their exponentials are accumulated in the first pass of the softmax
+ */
+constexpr size_t softmax_block = 1024;
+
+namespace detail {
+
+/*!
+ * \brief Call functor(first, last) on chunks of [0, n), on the scoped
+ * thread pool if there is one.
+ */
+template <typename Functor>
+void softmax_chunks(size_t n, Functor&& functor) {
+    auto* pool = scoped_thread_pool();
+
+    if (pool && n > 1) {
+        const size_t chunks = std::min(n, size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&functor, n, chunks](size_t c) {
+            functor((c * n) / chunks, ((c + 1) * n) / chunks);
+        });
+    } else {
+        functor(0, n);
+    }
+}
+
+/*!
+ * \brief Returns the value j of the row, with its bias if Bias is set
+ */
+template <bool Bias, typename T>
+inline T softmax_value(const T* in, const T* bias, size_t j) {
+    if constexpr (Bias) {
+        return in[j] + bias[j];
+    } else {
+        return in[j];
+    }
+}
+
+/*!
+ * \brief Compute the maximum and the sum of the exponentials (relative to
+ * the maximum) of one row of n values, in a single online pass
+ */
+template <bool Bias, typename T>
+void softmax_statistics(const T* in, const T* bias, size_t n, T& max, T& sum) {
+    max = -std::numeric_limits<T>::infinity();
+    sum = T(0);
+
+    for (size_t first = 0; first < n; first += softmax_block) {
+        const size_t last = std::min(n, first + softmax_block);
+
+        T block_max = max;
+
+        for (size_t j = first; j < last; ++j) {
+            const T v = softmax_value<Bias>(in, bias, j);
+            block_max = v > block_max ? v : block_max;
+        }
+
+        // The previous exponentials were relative to the old maximum
+        if (block_max > max) {
+            sum *= std::exp(max - block_max);
+            max = block_max;
+        }
+
+        T block_sum = 0;
+
+        for (size_t j = first; j < last; ++j) {
+            block_sum += std::exp(softmax_value<Bias>(in, bias, j) - max);
+        }
+
+        sum += block_sum;
+    }
+}
+
+/*!
+ * \brief Compute the softmax (or the log-softmax if Log is set) of one row
+ * of n values of in (plus the bias if Bias is set) into out, in the best
+ * version for the processor
+ */
+template <bool Log, bool Bias, typename T>
+DLL_MULTIVERSION void softmax_row(const T* in, const T* bias, T* out, size_t n) {
+    T max;
+    T sum;
+    softmax_statistics<Bias>(in, bias, n, max, sum);
+
+    if constexpr (Log) {
+        const T lse = max + std::log(sum);
+
+        for (size_t j = 0; j < n; ++j) {
+            out[j] = softmax_value<Bias>(in, bias, j) - lse;
+        }
+    } else {
+        const T inv = T(1) / sum;
+
+        for (size_t j = 0; j < n; ++j) {
+            out[j] = std::exp(softmax_value<Bias>(in, bias, j) - max) * inv;
+        }
+    }
+}
+
+/*!
+ * \brief Compute the softmax (or the log-softmax if Log is set) of the
+ * rows x n values of in (plus the bias if Bias is set) into out, which
+ * can be the same as in
+ */
+template <bool Log, bool Bias, typename T>
+void softmax_rows_impl(const T* in, const T* bias, T* out, size_t rows, size_t n) {
+    softmax_chunks(rows, [=](size_t first, size_t last) {
+        for (size_t r = first; r < last; ++r) {
+            softmax_row<Log, Bias>(in + r * n, bias, out + r * n, n);
+        }
+    });
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Compute the softmax of each of the rows of n values of in into
+ * out, which can be the same as in
+ */
+template <typename T>
+void softmax_rows(const T* in, T* out, size_t rows, size_t n) {
+    detail::softmax_rows_impl<false, false>(in, static_cast<const T*>(nullptr), out, rows, n);
+}
+
+/*!
+ * \brief Compute the log-softmax of each of the rows of n values of in
+ * into out, which can be the same as in
+ */
+template <typename T>
+void log_softmax_rows(const T* in, T* out, size_t rows, size_t n) {
+    detail::softmax_rows_impl<true, false>(in, static_cast<const T*>(nullptr), out, rows, n);
+}
+
+/*!
+ * \brief Compute the softmax of each sample of a batch (B x N)
+ * \param output The output, with direct memory access, can be the input
+ * \param input The input, with direct memory access
+ */
+template <typename O, typename I>
+void softmax_2d(O&& output, const I& input) {
+    input.ensure_cpu_up_to_date();
+
+    const size_t B = etl::dim<0>(input);
+
+    softmax_rows(input.memory_start(), output.memory_start(), B, etl::size(input) / B);
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the log-softmax of each sample of a batch (B x N)
+ * \param output The output, with direct memory access, can be the input
+ * \param input The input, with direct memory access
+ */
+template <typename O, typename I>
+void log_softmax_2d(O&& output, const I& input) {
+    input.ensure_cpu_up_to_date();
+
+    const size_t B = etl::dim<0>(input);
+
+    log_softmax_rows(input.memory_start(), output.memory_start(), B, etl::size(input) / B);
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the softmax of each row of the last dimension of the
+ * output (... x N), in place
+ * \param output The output of the layer, with direct memory access
+ * \param n The size of the last dimension
+ */
+template <typename O>
+void softmax_last(O&& output, size_t n) {
+    output.ensure_cpu_up_to_date();
+
+    softmax_rows(output.memory_start(), output.memory_start(), etl::size(output) / n, n);
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Add the biases to the last dimension of the output (... x N) and
+ * compute the softmax of each row, in place, the biases being added in
+ * both passes instead of in a pass of their own.
+ * \param output The output of the layer, with direct memory access
+ * \param b The biases, one per output
+ */
+template <typename O, typename B>
+void bias_softmax_last(O&& output, const B& b) {
+    output.ensure_cpu_up_to_date();
+    b.ensure_cpu_up_to_date();
+
+    const size_t N = etl::size(b);
+
+    detail::softmax_rows_impl<false, true>(output.memory_start(), b.memory_start(), output.memory_start(), etl::size(output) / N, N);
+
+    output.invalidate_gpu();
+}
+
+} //end of dll namespace
@@ -0,0 +1,262 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Structured pruning: removal of whole neurons and filters from the
+ * dynamic layers, which are physically shrunk
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_fwd.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Traits to test if a layer can remove some of its output units
+ * (neurons or filters) and some of its input units
+ */
+template <typename Layer, typename Enable = void>
+struct is_shrinkable_layer : std::false_type {};
+
+/*!
+ * \copydoc is_shrinkable_layer
+ */
+template <typename Layer>
+struct is_shrinkable_layer<Layer, std::void_t<decltype(std::declval<Layer&>().shrink_outputs(std::declval<const std::vector<size_t>&>()))>>
+        : std::true_type {};
+
+/*!
+ * \brief Indicates if the given (possibly cv-qualified reference) type is a
+ * shrinkable layer
+ */
+template <typename Layer>
+constexpr bool is_shrinkable_layer_v = is_shrinkable_layer<std::decay_t<Layer>>::value;
+
+/*!
+ * \brief Traits to test if a layer keeps the units of its input, with one
+ * state per unit that must be shrunk with them (batch normalization,
+ * pooling)
+ */
+template <typename Layer, typename Enable = void>
+struct has_shrink_units : std::false_type {};
+
+/*!
+ * \copydoc has_shrink_units
+ */
+template <typename Layer>
+struct has_shrink_units<Layer, std::void_t<decltype(std::declval<Layer&>().shrink_units(std::declval<const std::vector<size_t>&>()))>>
+        : std::true_type {};
+
+/*!
+ * \brief Traits indicating if a layer keeps the units of its input,
+ * without any state
+ */
+template <typename Layer>
+struct is_unit_preserving_layer : std::false_type {};
+
+template <typename Desc>
+struct is_unit_preserving_layer<activation_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_unit_preserving_layer<dropout_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_unit_preserving_layer<dyn_dropout_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the units removed from the output of a layer can go
+ * through the given (possibly cv-qualified reference) layer
+ */
+template <typename Layer>
+constexpr bool is_unit_passthrough_layer_v =
+    is_unit_preserving_layer<std::decay_t<Layer>>::value || has_shrink_units<std::decay_t<Layer>>::value;
+
+/*!
+ * \brief Returns the indices, in order, of the units to keep, the ones with
+ * the highest scores.
+ *
+ * At least one unit is kept.
+ *
+ * \param scores The score of each unit
+ * \param ratio The ratio of units to remove, in [0, 1]
+ */
+template <typename T>
+std::vector<size_t> select_units(const std::vector<T>& scores, double ratio) {
+    const size_t n    = scores.size();
+    const size_t keep = std::max(size_t(1), n - std::min(n, size_t(ratio * double(n))));
+
+    std::vector<size_t> kept(n);
+    std::iota(kept.begin(), kept.end(), 0);
+
+    if (keep < n) {
+        std::nth_element(kept.begin(), kept.begin() + keep, kept.end(), [&scores](size_t lhs, size_t rhs) {
+            return scores[lhs] > scores[rhs];
+        });
+
+        kept.resize(keep);
+        std::sort(kept.begin(), kept.end());
+    }
+
+    return kept;
+}
+
+/*!
+ * \brief Returns the L2 norm of each group of consecutive values of the given
+ * weights. With the units in the first dimension, this is the norm of each
+ * unit.
+ * \param w The weights
+ * \param units The number of units
+ */
+template <typename W>
+std::vector<etl::value_t<W>> unit_row_norms(const W& w, size_t units) {
+    using T = etl::value_t<W>;
+
+    w.ensure_cpu_up_to_date();
+
+    const size_t group = etl::size(w) / units;
+    const T* w_p       = w.memory_start();
+
+    std::vector<T> norms(units);
+
+    for (size_t u = 0; u < units; ++u) {
+        T sum = 0;
+
+        for (size_t i = 0; i < group; ++i) {
+            sum += w_p[u * group + i] * w_p[u * group + i];
+        }
+
+        norms[u] = std::sqrt(sum);
+    }
+
+    return norms;
+}
+
+/*!
+ * \brief Returns the L2 norm of each column of the given weights (visible x
+ * hidden), i.e. of each hidden unit
+ */
+template <typename W>
+std::vector<etl::value_t<W>> unit_column_norms(const W& w) {
+    using T = etl::value_t<W>;
+
+    w.ensure_cpu_up_to_date();
+
+    const size_t V = etl::dim<0>(w);
+    const size_t H = etl::dim<1>(w);
+    const T* w_p   = w.memory_start();
+
+    std::vector<T> norms(H, T(0));
+
+    for (size_t i = 0; i < V; ++i) {
+        for (size_t j = 0; j < H; ++j) {
+            norms[j] += w_p[i * H + j] * w_p[i * H + j];
+        }
+    }
+
+    for (auto& norm : norms) {
+        norm = std::sqrt(norm);
+    }
+
+    return norms;
+}
+
+/*!
+ * \brief Returns the absolute values of the given vector, as scores
+ */
+template <typename V>
+std::vector<etl::value_t<V>> unit_magnitudes(const V& v) {
+    v.ensure_cpu_up_to_date();
+
+    std::vector<etl::value_t<V>> scores(etl::size(v));
+
+    for (size_t i = 0; i < scores.size(); ++i) {
+        scores[i] = std::abs(v.memory_start()[i]);
+    }
+
+    return scores;
+}
+
+/*!
+ * \brief Gather the kept groups of consecutive values of the source into
+ * the target, of the reduced size.
+ *
+ * With the units in the first dimension of the source, this keeps the
+ * units of the given indices, each unit being (size / units) values.
+ *
+ * \param source The source
+ * \param target The target, already sized for the kept units
+ * \param kept The indices of the kept units, in order
+ * \param units The number of units of the source
+ */
+template <typename S, typename T>
+void gather_rows(const S& source, T& target, const std::vector<size_t>& kept, size_t units) {
+    cpp_assert(etl::size(source) % units == 0, "Invalid number of units");
+
+    const size_t group = etl::size(source) / units;
+
+    cpp_assert(etl::size(target) == kept.size() * group, "Invalid size of the shrunk target");
+
+    source.ensure_cpu_up_to_date();
+
+    const auto* s_p = source.memory_start();
+    auto* t_p       = target.memory_start();
+
+    for (size_t k = 0; k < kept.size(); ++k) {
+        std::copy_n(s_p + kept[k] * group, group, t_p + k * group);
+    }
+
+    target.invalidate_gpu();
+}
+
+/*!
+ * \brief Gather the kept groups of values of each row of the source into
+ * the target.
+ *
+ * Each row of the source has (units x group) values, each row of the target
+ * has (kept x group) values.
+ *
+ * \param source The source
+ * \param target The target, already sized for the kept units
+ * \param kept The indices of the kept units, in order
+ * \param units The number of units in a row of the source
+ */
+template <typename S, typename T>
+void gather_columns(const S& source, T& target, const std::vector<size_t>& kept, size_t units) {
+    const size_t rows  = etl::dim<0>(source);
+    const size_t row   = etl::size(source) / rows;
+    const size_t group = row / units;
+
+    cpp_assert(row % units == 0, "Invalid number of units");
+    cpp_assert(etl::size(target) == rows * kept.size() * group, "Invalid size of the shrunk target");
+
+    source.ensure_cpu_up_to_date();
+
+    const auto* s_p = source.memory_start();
+    auto* t_p       = target.memory_start();
+
+    for (size_t r = 0; r < rows; ++r) {
+        for (size_t k = 0; k < kept.size(); ++k) {
+            std::copy_n(s_p + r * row + kept[k] * group, group, t_p + (r * kept.size() + k) * group);
+        }
+    }
+
+    target.invalidate_gpu();
+}
+
+} //end of dll namespace
@@ -0,0 +1,347 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Plain TCP transport for the distributed training
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "dll/util/transport.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A transport over plain TCP sockets, to use when MPI is not
+ * available.
+ *
+ * The root rank listens on the given port and all the other ranks connect
+ * to it (star topology). The reductions are done by the root, in the order
+ * of the ranks, and sent back to all the ranks.
+ */
+struct tcp_transport final : distributed_transport {
+    /*!
+     * \brief Create the transport and connect all the ranks together.
+     *
+     * This blocks until all the ranks are connected.
+     *
+     * \param rank The rank of this process
+     * \param size The number of processes
+     * \param host The host of the root rank
+     * \param port The port of the root rank
+     */
+    tcp_transport(size_t rank, size_t size, const std::string& host, uint16_t port) : rank_(rank), size_(size) {
+        if (size_ <= 1) {
+            return;
+        }
+
+        if (rank_ == 0) {
+            ok = listen_peers(port);
+        } else {
+            ok = connect_root(host, port);
+        }
+
+        if (!ok) {
+            std::cerr << "tcp_transport: Impossible to connect rank " << rank_ << std::endl;
+        }
+    }
+
+    tcp_transport(const tcp_transport& rhs) = delete;
+    tcp_transport& operator=(const tcp_transport& rhs) = delete;
+
+    /*!
+     * \brief Close all the connections
+     */
+    ~tcp_transport() {
+        for (int socket : peers) {
+            if (socket >= 0) {
+                ::close(socket);
+            }
+        }
+    }
+
+    /*!
+     * \brief Indicates if all the ranks are connected
+     */
+    bool connected() const {
+        return ok;
+    }
+
+    size_t rank() const override {
+        return rank_;
+    }
+
+    size_t size() const override {
+        return size_;
+    }
+
+    void allreduce(float* data, size_t n) override {
+        allreduce_impl(data, n);
+    }
+
+    void allreduce(double* data, size_t n) override {
+        allreduce_impl(data, n);
+    }
+
+    void broadcast(float* data, size_t n) override {
+        broadcast_impl(data, n);
+    }
+
+    void broadcast(double* data, size_t n) override {
+        broadcast_impl(data, n);
+    }
+
+    void allgather(const uint8_t* data, size_t bytes, uint8_t* output) override {
+        std::copy(data, data + bytes, output + rank_ * bytes);
+
+        if (size_ <= 1 || !ok) {
+            return;
+        }
+
+        // The root gathers the bytes of the ranks and sends them all back
+        if (rank_ == 0) {
+            for (size_t r = 1; r < size_; ++r) {
+                ok = ok && receive_all(peers[r - 1], output + r * bytes, bytes);
+            }
+
+            for (int socket : peers) {
+                ok = ok && send_all(socket, output, size_ * bytes);
+            }
+        } else {
+            ok = send_all(peers[0], data, bytes) && receive_all(peers[0], output, size_ * bytes);
+        }
+
+        if (!ok) {
+            std::cerr << "tcp_transport: allgather failed on rank " << rank_ << std::endl;
+        }
+    }
+
+private:
+    /*!
+     * \brief Sum the buffers of all the ranks on the root and send the
+     * result back to all the ranks
+     */
+    template <typename T>
+    void allreduce_impl(T* data, size_t n) {
+        if (size_ <= 1 || !ok) {
+            return;
+        }
+
+        const size_t bytes = n * sizeof(T);
+
+        if (rank_ == 0) {
+            buffer.resize(bytes);
+
+            auto* tmp = reinterpret_cast<T*>(buffer.data());
+
+            for (int socket : peers) {
+                ok = ok && receive_all(socket, tmp, bytes);
+
+                for (size_t i = 0; i < n; ++i) {
+                    data[i] += tmp[i];
+                }
+            }
+
+            for (int socket : peers) {
+                ok = ok && send_all(socket, data, bytes);
+            }
+        } else {
+            ok = send_all(peers[0], data, bytes) && receive_all(peers[0], data, bytes);
+        }
+
+        if (!ok) {
+            std::cerr << "tcp_transport: allreduce failed on rank " << rank_ << std::endl;
+        }
+    }
+
+    /*!
+     * \brief Send the buffer of the root to all the ranks
+     */
+    template <typename T>
+    void broadcast_impl(T* data, size_t n) {
+        if (size_ <= 1 || !ok) {
+            return;
+        }
+
+        const size_t bytes = n * sizeof(T);
+
+        if (rank_ == 0) {
+            for (int socket : peers) {
+                ok = ok && send_all(socket, data, bytes);
+            }
+        } else {
+            ok = receive_all(peers[0], data, bytes);
+        }
+
+        if (!ok) {
+            std::cerr << "tcp_transport: broadcast failed on rank " << rank_ << std::endl;
+        }
+    }
+
+    /*!
+     * \brief Accept the connections of all the other ranks, ordered by rank
+     */
+    bool listen_peers(uint16_t port) {
+        int server = ::socket(AF_INET, SOCK_STREAM, 0);
+
+        if (server < 0) {
+            return false;
+        }
+
+        int reuse = 1;
+        ::setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in address{};
+        address.sin_family      = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port        = htons(port);
+
+        if (::bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(server, int(size_)) < 0) {
+            ::close(server);
+            return false;
+        }
+
+        peers.assign(size_ - 1, -1);
+
+        bool success = true;
+
+        for (size_t i = 0; i < size_ - 1 && success; ++i) {
+            int socket = ::accept(server, nullptr, nullptr);
+
+            uint32_t peer_rank = 0;
+
+            if (socket < 0 || !receive_all(socket, &peer_rank, sizeof(peer_rank)) || peer_rank == 0 || peer_rank >= size_ || peers[peer_rank - 1] >= 0) {
+                if (socket >= 0) {
+                    ::close(socket);
+                }
+
+                success = false;
+            } else {
+                no_delay(socket);
+                peers[peer_rank - 1] = socket;
+            }
+        }
+
+        ::close(server);
+
+        return success;
+    }
+
+    /*!
+     * \brief Connect to the root rank, retrying until it listens
+     */
+    bool connect_root(const std::string& host, uint16_t port) {
+        addrinfo hints{};
+        hints.ai_family   = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo* result = nullptr;
+
+        if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+            return false;
+        }
+
+        int socket = -1;
+
+        for (size_t attempt = 0; attempt < max_attempts && socket < 0; ++attempt) {
+            socket = ::socket(AF_INET, SOCK_STREAM, 0);
+
+            if (socket >= 0 && ::connect(socket, result->ai_addr, result->ai_addrlen) < 0) {
+                ::close(socket);
+                socket = -1;
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+
+        ::freeaddrinfo(result);
+
+        if (socket < 0) {
+            return false;
+        }
+
+        no_delay(socket);
+        peers.assign(1, socket);
+
+        uint32_t r = rank_;
+        return send_all(socket, &r, sizeof(r));
+    }
+
+    /*!
+     * \brief Disable the Nagle algorithm on the given socket
+     */
+    static void no_delay(int socket) {
+        int flag = 1;
+        ::setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
+
+    /*!
+     * \brief Send all the given bytes on the socket
+     */
+    static bool send_all(int socket, const void* data, size_t bytes) {
+        auto* p = static_cast<const char*>(data);
+
+        while (bytes) {
+            auto sent = ::send(socket, p, bytes, MSG_NOSIGNAL);
+
+            if (sent <= 0) {
+                return false;
+            }
+
+            p += sent;
+            bytes -= sent;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Receive exactly the given number of bytes from the socket
+     */
+    static bool receive_all(int socket, void* data, size_t bytes) {
+        auto* p = static_cast<char*>(data);
+
+        while (bytes) {
+            auto received = ::recv(socket, p, bytes, 0);
+
+            if (received <= 0) {
+                return false;
+            }
+
+            p += received;
+            bytes -= received;
+        }
+
+        return true;
+    }
+
+    static constexpr size_t max_attempts = 600; ///< The number of attempts to connect to the root (100ms apart)
+
+    size_t rank_;             ///< The rank of this process
+    size_t size_;             ///< The number of processes
+    bool ok = true;           ///< Indicates if the transport is working
+    std::vector<int> peers;   ///< The sockets (to the other ranks on the root, to the root otherwise)
+    std::vector<char> buffer; ///< The receive buffer of the root
+};
+
+} //end of dll namespace
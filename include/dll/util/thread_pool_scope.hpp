@@ -0,0 +1,72 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Scoped thread pool, to let the layers trainers use the thread pool
+ * of the network
+ */
+
+#pragma once
+
+#include "cpp_utils/maybe_parallel.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Returns the thread pool of the current scope on this thread
+ */
+inline cpp::thread_pool<true>*& scoped_thread_pool(){
+    thread_local cpp::thread_pool<true>* pool = nullptr;
+    return pool;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Make scoped_thread_pool() return the given pool on the current
+ * thread, for the lifetime of the scope.
+ *
+ * A serial pool does not change the scoped pool.
+ */
+struct thread_pool_scope {
+    cpp::thread_pool<true>* previous; ///< The pool used before the scope
+
+    /*!
+     * \brief Start using the given pool on the current thread
+     */
+    template <bool Parallel>
+    explicit thread_pool_scope(cpp::thread_pool<Parallel>& pool) : previous(detail::scoped_thread_pool()) {
+        if constexpr (Parallel) {
+            detail::scoped_thread_pool() = &pool;
+        } else {
+            cpp_unused(pool);
+        }
+    }
+
+    thread_pool_scope(const thread_pool_scope& rhs) = delete;
+    thread_pool_scope& operator=(const thread_pool_scope& rhs) = delete;
+
+    /*!
+     * \brief Restore the previous pool
+     */
+    ~thread_pool_scope() {
+        detail::scoped_thread_pool() = previous;
+    }
+};
+
+/*!
+ * \brief Returns the thread pool of the current scope, or nullptr if
+ * there is none.
+ */
+inline cpp::thread_pool<true>* scoped_thread_pool(){
+    return detail::scoped_thread_pool();
+}
+
+} //end of dll namespace
@@ -0,0 +1,202 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Training throughput: rolling (EWMA) samples and batches per
+ * second, split between the compute and the generator
+ */
+
+#pragma once
+
+#include <chrono>
+#include <initializer_list>
+#include <iostream>
+
+namespace dll {
+
+/*!
+ * \brief An exponentially weighted moving average
+ */
+struct ewma {
+    double alpha = 0.1;  ///< The weight of a new value
+    double value = 0.0;  ///< The current average
+    bool empty   = true; ///< Indicates if no value has been added yet
+
+    /*!
+     * \brief Add a new value to the average
+     */
+    void add(double x) {
+        value = empty ? x : alpha * x + (1.0 - alpha) * value;
+        empty = false;
+    }
+
+    /*!
+     * \brief Forget all the values
+     */
+    void reset() {
+        value = 0.0;
+        empty = true;
+    }
+};
+
+/*!
+ * \brief The throughput of an epoch
+ */
+struct throughput_stats {
+    size_t samples   = 0; ///< The number of samples
+    size_t batches   = 0; ///< The number of batches
+    size_t wall      = 0; ///< The duration of the epoch (ns)
+    size_t compute   = 0; ///< The time spent training on the batches (ns)
+    size_t generator = 0; ///< The time spent waiting for the batches of the generator (ns)
+
+    /*!
+     * \brief Returns the rate of n events in the given duration (ns)
+     */
+    static double rate(size_t n, size_t ns) {
+        return ns ? n * 1e9 / ns : 0.0;
+    }
+
+    /*!
+     * \brief Returns the number of samples per second of the epoch
+     */
+    double samples_per_second() const {
+        return rate(samples, wall);
+    }
+
+    /*!
+     * \brief Returns the number of batches per second of the epoch
+     */
+    double batches_per_second() const {
+        return rate(batches, wall);
+    }
+
+    /*!
+     * \brief Returns the number of samples per second of compute, as if
+     * the generator was free
+     */
+    double compute_samples_per_second() const {
+        return rate(samples, compute);
+    }
+
+    /*!
+     * \brief Returns the number of samples per second the generator
+     * delivered, as if the compute was free
+     */
+    double generator_samples_per_second() const {
+        return rate(samples, generator);
+    }
+
+    /*!
+     * \brief Display the throughput on a single line
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "throughput: " << samples_per_second() << " samples/s " << batches_per_second() << " batches/s"
+               << " compute " << compute_samples_per_second() << " samples/s"
+               << " generator " << generator_samples_per_second() << " samples/s"
+               << " (" << (wall ? 100.0 * generator / wall : 0.0) << "% waiting)";
+
+        return stream;
+    }
+};
+
+/*!
+ * \brief Measure the training throughput from the batch events of the
+ * trainer.
+ *
+ * The compute time of a batch is the time between its start and its end,
+ * the generator time is the time between the end of the previous batch (or
+ * the start of the epoch) and the start of the batch. The rolling rates are
+ * smoothed with an EWMA over the batches.
+ */
+struct throughput_meter {
+    using clock = std::chrono::steady_clock;
+
+    ewma samples_rate;   ///< The rolling number of samples per second
+    ewma batches_rate;   ///< The rolling number of batches per second
+    ewma compute_rate;   ///< The rolling number of samples per second of compute
+    ewma generator_rate; ///< The rolling number of samples per second of the generator
+    ewma batch_time;     ///< The rolling duration of a batch (ns)
+
+    throughput_stats epoch; ///< The throughput of the current epoch
+
+    clock::time_point epoch_start; ///< The start of the epoch
+    clock::time_point last_end;    ///< The end of the previous batch (or the start of the epoch)
+    clock::time_point batch_begin; ///< The start of the current batch
+
+    /*!
+     * \brief Set the weight of a new batch in the rolling rates
+     */
+    void set_alpha(double alpha) {
+        for (auto* average : {&samples_rate, &batches_rate, &compute_rate, &generator_rate, &batch_time}) {
+            average->alpha = alpha;
+        }
+    }
+
+    /*!
+     * \brief Indicates the start of an epoch
+     */
+    void start_epoch() {
+        epoch       = throughput_stats();
+        epoch_start = clock::now();
+        last_end    = epoch_start;
+    }
+
+    /*!
+     * \brief Indicates the start of a batch
+     */
+    void start_batch() {
+        batch_begin = clock::now();
+    }
+
+    /*!
+     * \brief Indicates the end of a batch
+     * \param samples The number of samples of the batch
+     */
+    void end_batch(size_t samples) {
+        auto now = clock::now();
+
+        const size_t compute   = ns(now - batch_begin);
+        const size_t generator = ns(batch_begin - last_end);
+        const size_t wall      = ns(now - last_end);
+
+        epoch.samples += samples;
+        ++epoch.batches;
+        epoch.compute += compute;
+        epoch.generator += generator;
+        epoch.wall = ns(now - epoch_start);
+
+        samples_rate.add(throughput_stats::rate(samples, wall));
+        batches_rate.add(throughput_stats::rate(1, wall));
+        compute_rate.add(throughput_stats::rate(samples, compute));
+        batch_time.add(double(wall));
+
+        // A batch that was already waiting does not tell anything about the generator
+        if (generator) {
+            generator_rate.add(throughput_stats::rate(samples, generator));
+        }
+
+        last_end = now;
+    }
+
+    /*!
+     * \brief Returns the estimated time to process the given number of
+     * batches (s), from the rolling batch duration
+     */
+    double eta(size_t batches) const {
+        return batch_time.value * batches * 1e-9;
+    }
+
+private:
+    static size_t ns(clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    }
+};
+
+} //end of dll namespace
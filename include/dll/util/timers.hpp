@@ -7,13 +7,28 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #ifndef DLL_NO_TIMERS
 
-#include <iosfwd>
-#include <iomanip>
-#include <sstream>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <unordered_map>
+
+#include "dll/util/perf_counters.hpp"
 
 #endif
 
@@ -42,6 +57,125 @@ struct stop_timer {
     }
 };
 
+inline std::string to_string_precision(double duration, int precision = 6) {
+    std::ostringstream out;
+    out << std::setprecision(precision) << duration;
+    return out.str();
+}
+
+inline std::string duration_str(double duration, int precision = 6) {
+    if (duration > 1000.0 * 1000.0 * 1000.0) {
+        return to_string_precision(duration / (1000.0 * 1000.0 * 1000.0), precision) + "s";
+    } else if (duration > 1000.0 * 1000.0) {
+        return to_string_precision(duration / (1000.0 * 1000.0), precision) + "ms";
+    } else if (duration > 1000.0) {
+        return to_string_precision(duration / 1000.0, precision) + "us";
+    } else {
+        return to_string_precision(duration, precision) + "ns";
+    }
+}
+
+namespace detail {
+
+/*!
+ * \brief Print a table on the console, the first row being the header
+ */
+template <size_t Columns>
+void print_table(const std::vector<std::array<std::string, Columns>>& rows) {
+    // Compute the width of each column
+    std::array<size_t, Columns> column_length{};
+
+    for (auto& row : rows) {
+        for (size_t c = 0; c < Columns; ++c) {
+            column_length[c] = std::max(column_length[c], row[c].size());
+        }
+    }
+
+    size_t line_length = (Columns + 1) * 1 + 2 + (Columns - 1) * 2;
+
+    for (auto length : column_length) {
+        line_length += length;
+    }
+
+    std::cout << std::endl;
+    std::cout << " " << std::string(line_length, '-') << '\n';
+
+    for (size_t r = 0; r < rows.size(); ++r) {
+        std::cout << " |";
+
+        for (size_t c = 0; c < Columns; ++c) {
+            printf(" %-*s |", int(column_length[c]), rows[r][c].c_str());
+        }
+
+        std::cout << '\n';
+
+        if (!r) {
+            std::cout << " " << std::string(line_length, '-') << '\n';
+        }
+    }
+
+    std::cout << " " << std::string(line_length, '-') << '\n';
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief The values of a timer during a period of the training (an epoch)
+ */
+struct timer_delta {
+    const char* name;      ///< The name of the timer
+    size_t count;          ///< The number of times it was incremented during the period
+    size_t duration;       ///< The duration during the period
+    size_t total_duration; ///< The total duration, since the last reset of the timers
+};
+
+/*!
+ * \brief The values of the timers during a period of the training (an
+ * epoch), the most expensive timers first
+ */
+struct timers_delta {
+    size_t wall = 0;                 ///< The wall duration of the period
+    std::vector<timer_delta> timers; ///< The timers used during the period
+
+    /*!
+     * \brief Indicates if no timer was used during the period
+     */
+    bool empty() const {
+        return timers.empty();
+    }
+
+    /*!
+     * \brief Display the n most expensive timers of the period in the form
+     * of a table, with their percentage of the wall duration of the period.
+     *
+     * The timers are nested and measured on each thread, the percentages
+     * are not exclusive and can exceed 100%.
+     */
+    void display_hotspots(size_t n) const {
+        if (timers.empty()) {
+            return;
+        }
+
+        std::vector<std::array<std::string, 6>> rows;
+
+        rows.push_back({"%", "Timer", "Count", "Duration", "Mean", "Total"});
+
+        for (size_t i = 0; i < std::min(n, timers.size()); ++i) {
+            auto& timer = timers[i];
+
+            rows.push_back({
+                to_string_precision(100.0 * (timer.duration / std::max(double(wall), 1.0)), 4),
+                timer.name,
+                std::to_string(timer.count),
+                duration_str(timer.duration),
+                duration_str(timer.duration / timer.count),
+                duration_str(timer.total_duration)});
+        }
+
+        detail::print_table(rows);
+    }
+};
+
 #ifdef DLL_NO_TIMERS
 
 /*!
@@ -70,6 +204,37 @@ inline void dump_timers_pretty() {
     std::cout << "Timers have been disabled by defining DLL_NO_TIMERS" << std::endl;
 }
 
+inline void reset_timers() {}
+
+inline void enable_timer_events(bool /*enable*/ = true) {}
+
+inline void enable_perf_counters(bool /*enable*/ = true) {}
+
+inline const char* current_timer_name() {
+    return nullptr;
+}
+
+inline bool perf_counters_available() {
+    return false;
+}
+
+/*!
+ * \brief Dump the hardware counters of the timers on the console.
+ *
+ * This has no effect if the timers were disabled.
+ */
+inline void dump_timers_perf() {
+    std::cout << "Timers have been disabled by defining DLL_NO_TIMERS" << std::endl;
+}
+
+inline std::string export_timers_folded() {
+    return {};
+}
+
+inline std::string export_timers_chrome_trace() {
+    return "{\"traceEvents\":[]}\n";
+}
+
 struct auto_timer {
     auto_timer(const char* /*name*/) {}
 };
@@ -80,108 +245,494 @@ struct unsafe_auto_timer {
 
 #else
 
-constexpr size_t max_timers = 128; ///< The maximum number of timers
+constexpr size_t max_timers = 128; ///< The maximum number of distinct timers
 
 /*!
- * \brief A timer
+ * \brief The values of a timer
  */
 struct timer_t {
-    const char* name;             ///< The name of the timer
-    std::atomic<size_t> count;    ///< The number of times it was incremented
-    std::atomic<size_t> duration; ///< The total duration
+    const char* name; ///< The name of the timer
+    size_t count;     ///< The number of times it was incremented
+    size_t duration;  ///< The total duration
+};
+
+/*!
+ * \brief The hardware counters of a timer
+ */
+struct timer_perf_t {
+    const char* name;   ///< The name of the timer
+    size_t count;       ///< The number of counted scopes
+    perf_values values; ///< The total of each hardware event
+};
+
+struct thread_timers_t;
+
+/*!
+ * \brief A nested scope of a timer, in the tree of the scopes of a thread
+ */
+struct timer_node {
+    size_t parent;                   ///< The parent node (timer_root for a top-level scope)
+    size_t id;                       ///< The id of the timer
+    std::atomic<size_t> count{0};    ///< The number of times the scope was closed
+    std::atomic<size_t> duration{0}; ///< The total duration of the scope
+
+    timer_node(size_t parent, size_t id) : parent(parent), id(id) {}
+};
+
+/*!
+ * \brief One execution of a timer, recorded when the events are enabled
+ */
+struct timer_event {
+    size_t id;       ///< The id of the timer
+    size_t tid;      ///< The thread of the event
+    size_t start;    ///< The start, in nanoseconds since the creation of the timers
+    size_t duration; ///< The duration, in nanoseconds
+};
+
+constexpr size_t timer_root       = size_t(-1); ///< The parent of the top-level scopes
+constexpr size_t max_timer_events = 1 << 20;    ///< The maximum number of events per thread
+
+/*!
+ * \brief The structure holding all the timers.
+ *
+ * Each timer name is registered once, with an id. The durations are
+ * accumulated by each thread in its own counters (thread_timers_t),
+ * indexed by id, and merged only when the timers are read.
+ */
+struct timers_t {
+    std::array<const char*, max_timers> names{};        ///< The names of the registered timers
+    size_t registered = 0;                              ///< The number of registered timers
+    std::vector<thread_timers_t*> threads;              ///< The counters of the running threads
+    std::array<size_t, max_timers> retired_counts{};    ///< The counts of the terminated threads
+    std::array<size_t, max_timers> retired_durations{}; ///< The durations of the terminated threads
+    std::map<std::string, size_t> retired_stacks;       ///< The self durations of the stacks of the terminated threads
+    std::vector<timer_event> retired_events;            ///< The events of the terminated threads
+    std::array<perf_values, max_timers> retired_perf{}; ///< The hardware counters of the terminated threads
+    std::array<size_t, max_timers> retired_perf_counts{}; ///< The counted scopes of the terminated threads
+    size_t next_tid = 0;                                ///< The id of the next thread
+    std::atomic<bool> events{false};                    ///< Indicates if the events are recorded
+    std::atomic<bool> perf{false};                      ///< Indicates if the hardware counters are read
+    std::atomic<size_t> perf_mask{0};                   ///< The events counted by at least one thread
+    std::mutex lock;                                    ///< The lock to protect the registry
+
+    const std::chrono::time_point<std::chrono::steady_clock> epoch = std::chrono::steady_clock::now(); ///< The origin of the events
 
     /*!
-     * \brief Initialize an empty counter
+     * \brief Returns the id of the timer with the given name, registered if
+     * necessary, or max_timers if there are too many timers
      */
-    timer_t()
-            : name(nullptr), count(0), duration(0) {}
+    size_t id(const char* name) {
+        std::lock_guard<std::mutex> l(lock);
+
+        for (size_t i = 0; i < registered; ++i) {
+            if (names[i] == name || !std::strcmp(names[i], name)) {
+                return i;
+            }
+        }
+
+        if (registered == max_timers) {
+            std::cerr << "Unable to register timer " << name << std::endl;
+            return max_timers;
+        }
+
+        names[registered] = name;
+
+        return registered++;
+    }
 
     /*!
-     * \brief Copy a timer
+     * \brief Reset the status of the timers
      */
-    timer_t(const timer_t& rhs)
-            : name(rhs.name), count(rhs.count.load()), duration(rhs.duration.load()) {}
+    void reset();
 
     /*!
-     * \brief Copy assign a timer
+     * \brief Returns the merged values of all the used timers
      */
-    timer_t& operator=(const timer_t& rhs) {
-        if (&rhs != this) {
-            name     = rhs.name;
-            count    = rhs.count.load();
-            duration = rhs.duration.load();
+    std::vector<timer_t> snapshot();
+
+    /*!
+     * \brief Returns the self duration of each stack of scopes, the frames
+     * separated with ';'
+     */
+    std::map<std::string, size_t> stacks();
+
+    /*!
+     * \brief Returns the recorded events of all the threads
+     */
+    std::vector<timer_event> all_events();
+
+    /*!
+     * \brief Returns the merged hardware counters of all the timers counted
+     * while the counters were enabled
+     */
+    std::vector<timer_perf_t> perf_snapshot();
+};
+
+/*!
+ * \brief Get a reference to the timer structure
+ */
+inline timers_t& get_timers() {
+    static timers_t timers;
+    return timers;
+}
+
+/*!
+ * \brief The counters of the timers of one thread.
+ *
+ * Only the owning thread increments the counters, without contention, the
+ * other threads only read them (or reset them). The nested scopes form a
+ * tree of nodes, new nodes and events being added under the lock of the
+ * thread, which is only contended while the timers are exported.
+ */
+struct thread_timers_t {
+    std::array<std::atomic<size_t>, max_timers> counts{};    ///< The number of times each timer was incremented
+    std::array<std::atomic<size_t>, max_timers> durations{}; ///< The total duration of each timer
+    std::unordered_map<const char*, size_t> ids;             ///< The ids of the names already seen by this thread
+    std::deque<timer_node> nodes;                            ///< The tree of the scopes
+    std::unordered_map<size_t, size_t> children;             ///< The node of each (parent, id)
+    std::vector<size_t> stack;                               ///< The nodes of the open scopes
+    std::vector<timer_event> events;                         ///< The recorded events
+    std::array<std::array<std::atomic<size_t>, perf_events>, max_timers> perf{}; ///< The hardware counters of each timer
+    std::array<std::atomic<size_t>, max_timers> perf_counts{}; ///< The number of counted scopes of each timer
+    std::vector<std::pair<size_t, perf_values>> perf_starts; ///< The depth and the counters at the start of the counted scopes
+    perf_counters_t perf_counters;                           ///< The hardware counters of the thread
+    size_t tid;                                              ///< The id of the thread
+    std::mutex lock;                                         ///< The lock protecting the nodes and the events
+
+    /*!
+     * \brief Register the counters of the current thread
+     */
+    thread_timers_t() {
+        auto& timers = get_timers();
+
+        std::lock_guard<std::mutex> l(timers.lock);
+        timers.threads.push_back(this);
+        tid = timers.next_tid++;
+    }
+
+    thread_timers_t(const thread_timers_t& rhs) = delete;
+    thread_timers_t& operator=(const thread_timers_t& rhs) = delete;
+
+    /*!
+     * \brief Merge the counters of the terminating thread
+     */
+    ~thread_timers_t() {
+        auto& timers = get_timers();
+
+        std::lock_guard<std::mutex> l(timers.lock);
+        std::lock_guard<std::mutex> l2(lock);
+
+        for (size_t i = 0; i < max_timers; ++i) {
+            timers.retired_counts[i] += counts[i].load(std::memory_order_relaxed);
+            timers.retired_durations[i] += durations[i].load(std::memory_order_relaxed);
+            timers.retired_perf_counts[i] += perf_counts[i].load(std::memory_order_relaxed);
+
+            for (size_t e = 0; e < perf_events; ++e) {
+                timers.retired_perf[i][e] += perf[i][e].load(std::memory_order_relaxed);
+            }
         }
 
-        return *this;
+        add_stacks(timers, timers.retired_stacks);
+
+        timers.retired_events.insert(timers.retired_events.end(), events.begin(), events.end());
+
+        timers.threads.erase(std::find(timers.threads.begin(), timers.threads.end(), this));
     }
 
     /*!
-     * \brief Move construct a timer
+     * \brief Open a scope of the timer with the given name
+     * \return The node of the scope
      */
-    timer_t(timer_t&& rhs)
-            : name(std::move(rhs.name)), count(rhs.count.load()), duration(rhs.duration.load()) {}
+    size_t enter(const char* name) {
+        auto it = ids.find(name);
+
+        if (it == ids.end()) {
+            it = ids.emplace(name, get_timers().id(name)).first;
+        }
+
+        const size_t id     = it->second;
+        const size_t parent = stack.empty() ? timer_root : stack.back();
+
+        if (id == max_timers) {
+            stack.push_back(parent);
+            return timer_root;
+        }
+
+        const size_t key = (parent + 1) * max_timers + id;
+
+        auto child = children.find(key);
+
+        if (child == children.end()) {
+            std::lock_guard<std::mutex> l(lock);
+
+            nodes.emplace_back(parent, id);
+            child = children.emplace(key, nodes.size() - 1).first;
+        }
+
+        stack.push_back(child->second);
+
+        if (get_timers().perf.load(std::memory_order_relaxed)) {
+            start_perf();
+        }
+
+        return child->second;
+    }
 
     /*!
-     * \brief Move assign a timer
+     * \brief Read the hardware counters at the start of the current scope
      */
-    timer_t& operator=(timer_t&& rhs) {
-        if (&rhs != this) {
-            name     = std::move(rhs.name);
-            count    = rhs.count.load();
-            duration = rhs.duration.load();
+    void start_perf() {
+        if (!perf_counters.opened) {
+            perf_counters.open();
+            get_timers().perf_mask.fetch_or(perf_counters.mask(), std::memory_order_relaxed);
         }
 
-        return *this;
+        if (perf_counters.mask()) {
+            perf_starts.emplace_back(stack.size(), perf_counters.read());
+        }
     }
-};
 
-/*!
- * \brief The structure holding all the timers
- */
-struct timers_t {
-    std::array<timer_t, max_timers> timers; ///< The timers
-    std::mutex lock; ///< The lock to protect the timers
+    /*!
+     * \brief Close the current scope, of the given node
+     */
+    void leave(size_t node, std::chrono::time_point<std::chrono::steady_clock> start, size_t duration) {
+        // Only the scopes opened while the counters were enabled are counted
+        const bool counted = !perf_starts.empty() && perf_starts.back().first == stack.size();
+
+        stack.pop_back();
+
+        if (node == timer_root) {
+            return;
+        }
+
+        auto& n = nodes[node];
+
+        if (counted) {
+            auto values = perf_counters.read();
+            auto& first = perf_starts.back().second;
+
+            for (size_t e = 0; e < perf_events; ++e) {
+                perf[n.id][e].fetch_add(values[e] - std::min(values[e], first[e]), std::memory_order_relaxed);
+            }
+
+            perf_counts[n.id].fetch_add(1, std::memory_order_relaxed);
+            perf_starts.pop_back();
+        }
+
+        n.count.fetch_add(1, std::memory_order_relaxed);
+        n.duration.fetch_add(duration, std::memory_order_relaxed);
+
+        counts[n.id].fetch_add(1, std::memory_order_relaxed);
+        durations[n.id].fetch_add(duration, std::memory_order_relaxed);
+
+        auto& timers = get_timers();
+
+        if (timers.events.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> l(lock);
+
+            if (events.size() < max_timer_events) {
+                auto offset = std::chrono::duration_cast<std::chrono::nanoseconds>(start - timers.epoch).count();
+                events.push_back({n.id, tid, size_t(offset), duration});
+            }
+        }
+    }
 
     /*!
-     * \brief Reset the status of the timers
+     * \brief Add the self duration of the stacks of this thread to the given
+     * stacks, with the locks of the timers and of this thread held
      */
-    void reset(){
-        std::lock_guard<std::mutex> l(lock);
+    void add_stacks(const timers_t& timers, std::map<std::string, size_t>& result) const {
+        std::vector<size_t> self(nodes.size());
+
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            self[i] += nodes[i].duration.load(std::memory_order_relaxed);
+
+            if (nodes[i].parent != timer_root) {
+                self[nodes[i].parent] -= std::min(self[nodes[i].parent], nodes[i].duration.load(std::memory_order_relaxed));
+            }
+        }
+
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (!nodes[i].count.load(std::memory_order_relaxed)) {
+                continue;
+            }
+
+            std::string path = timers.names[nodes[i].id];
+
+            for (size_t p = nodes[i].parent; p != timer_root; p = nodes[p].parent) {
+                path = std::string(timers.names[nodes[p].id]) + ";" + path;
+            }
 
-        for(auto& timer : timers){
-            timer.name = nullptr;
-            timer.duration = 0;
-            timer.count = 0;
+            result[path] += self[i];
         }
     }
 };
 
 /*!
- * \brief Get a reference to the timer structure
+ * \brief Get a reference to the timer counters of the current thread
  */
-inline timers_t& get_timers() {
-    static timers_t timers;
+inline thread_timers_t& get_thread_timers() {
+    thread_local thread_timers_t timers;
     return timers;
 }
 
-inline std::string to_string_precision(double duration, int precision = 6) {
-    std::ostringstream out;
-    out << std::setprecision(precision) << duration;
-    return out.str();
+/*!
+ * \brief Returns the name of the innermost open timer of the current
+ * thread, or nullptr if there is none
+ */
+inline const char* current_timer_name() {
+    auto& thread = get_thread_timers();
+
+    for (auto it = thread.stack.rbegin(); it != thread.stack.rend(); ++it) {
+        if (*it != timer_root) {
+            return get_timers().names[thread.nodes[*it].id];
+        }
+    }
+
+    return nullptr;
 }
 
-inline std::string duration_str(double duration, int precision = 6) {
-    if (duration > 1000.0 * 1000.0 * 1000.0) {
-        return to_string_precision(duration / (1000.0 * 1000.0 * 1000.0), precision) + "s";
-    } else if (duration > 1000.0 * 1000.0) {
-        return to_string_precision(duration / (1000.0 * 1000.0), precision) + "ms";
-    } else if (duration > 1000.0) {
-        return to_string_precision(duration / 1000.0, precision) + "us";
-    } else {
-        return to_string_precision(duration, precision) + "ns";
+inline void timers_t::reset() {
+    std::lock_guard<std::mutex> l(lock);
+
+    retired_counts.fill(0);
+    retired_durations.fill(0);
+    retired_stacks.clear();
+    retired_events.clear();
+    retired_perf_counts.fill(0);
+
+    for (auto& values : retired_perf) {
+        values.fill(0);
+    }
+
+    for (auto* thread : threads) {
+        std::lock_guard<std::mutex> l2(thread->lock);
+
+        for (size_t i = 0; i < max_timers; ++i) {
+            thread->counts[i].store(0, std::memory_order_relaxed);
+            thread->durations[i].store(0, std::memory_order_relaxed);
+            thread->perf_counts[i].store(0, std::memory_order_relaxed);
+
+            for (auto& value : thread->perf[i]) {
+                value.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        for (auto& node : thread->nodes) {
+            node.count.store(0, std::memory_order_relaxed);
+            node.duration.store(0, std::memory_order_relaxed);
+        }
+
+        thread->events.clear();
     }
 }
 
+inline std::vector<timer_t> timers_t::snapshot() {
+    std::lock_guard<std::mutex> l(lock);
+
+    std::vector<timer_t> values;
+
+    for (size_t i = 0; i < registered; ++i) {
+        timer_t timer{names[i], retired_counts[i], retired_durations[i]};
+
+        for (auto* thread : threads) {
+            timer.count += thread->counts[i].load(std::memory_order_relaxed);
+            timer.duration += thread->durations[i].load(std::memory_order_relaxed);
+        }
+
+        if (timer.count) {
+            values.push_back(timer);
+        }
+    }
+
+    return values;
+}
+
+inline std::map<std::string, size_t> timers_t::stacks() {
+    std::lock_guard<std::mutex> l(lock);
+
+    auto result = retired_stacks;
+
+    for (auto* thread : threads) {
+        std::lock_guard<std::mutex> l2(thread->lock);
+        thread->add_stacks(*this, result);
+    }
+
+    return result;
+}
+
+inline std::vector<timer_event> timers_t::all_events() {
+    std::lock_guard<std::mutex> l(lock);
+
+    auto result = retired_events;
+
+    for (auto* thread : threads) {
+        std::lock_guard<std::mutex> l2(thread->lock);
+        result.insert(result.end(), thread->events.begin(), thread->events.end());
+    }
+
+    return result;
+}
+
+inline std::vector<timer_perf_t> timers_t::perf_snapshot() {
+    std::lock_guard<std::mutex> l(lock);
+
+    std::vector<timer_perf_t> values;
+
+    for (size_t i = 0; i < registered; ++i) {
+        timer_perf_t timer{names[i], retired_perf_counts[i], retired_perf[i]};
+
+        for (auto* thread : threads) {
+            timer.count += thread->perf_counts[i].load(std::memory_order_relaxed);
+
+            for (size_t e = 0; e < perf_events; ++e) {
+                timer.values[e] += thread->perf[i][e].load(std::memory_order_relaxed);
+            }
+        }
+
+        if (timer.count) {
+            values.push_back(timer);
+        }
+    }
+
+    return values;
+}
+
+/*!
+ * \brief Enable or disable the recording of the timestamped events of the
+ * timers, for export_timers_chrome_trace
+ */
+inline void enable_timer_events(bool enable = true) {
+    get_timers().events.store(enable, std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Enable or disable the reading of the hardware counters (cycles,
+ * instructions, cache and TLB misses, floating point instructions) around
+ * the scopes of the timers, for dump_timers_perf.
+ *
+ * Each counted scope costs a few system calls, the counters should only be
+ * enabled while profiling.
+ */
+inline void enable_perf_counters(bool enable = true) {
+    get_timers().perf.store(enable, std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Indicates if the hardware counters can be read by the current
+ * thread
+ */
+inline bool perf_counters_available() {
+    auto& counters = get_thread_timers().perf_counters;
+
+    if (!counters.opened) {
+        counters.open();
+        get_timers().perf_mask.fetch_or(counters.mask(), std::memory_order_relaxed);
+    }
+
+    return counters.available(perf_event::CYCLES);
+}
+
 /*!
  * \brief Reset all timers
  */
@@ -196,7 +747,7 @@ inline void reset_timers() {
  * This has no effect if the timers were disabled.
  */
 inline void dump_timers() {
-    decltype(auto) timers = get_timers().timers;
+    auto timers = get_timers().snapshot();
 
     //Sort the timers by duration (DESC)
     std::sort(timers.begin(), timers.end(), [](auto& left, auto& right) {
@@ -222,7 +773,7 @@ inline void dump_timers() {
  * The total is the counter with the maximum total time
  */
 inline void dump_timers_one() {
-    decltype(auto) timers = get_timers().timers;
+    auto timers = get_timers().snapshot();
 
     if(timers.empty()){
         return;
@@ -233,7 +784,7 @@ inline void dump_timers_one() {
         return left.duration > right.duration;
     });
 
-    double total_duration = timers.front().duration.load();
+    double total_duration = timers.front().duration;
 
     // Print all the used timers
     for (decltype(auto) timer : timers) {
@@ -247,11 +798,70 @@ inline void dump_timers_one() {
     }
 }
 
+/*!
+ * \brief Dump the hardware counters of the timers on the console, in the
+ * form of a table: the instructions per cycle, the misses of the last level
+ * cache (per reference and per thousand instructions), the misses of the
+ * data TLB per thousand instructions and the fraction of the floating
+ * point instructions that are vectorized.
+ *
+ * The counters are only read after enable_perf_counters(), the events that
+ * are not available are displayed as "-".
+ */
+inline void dump_timers_perf() {
+    auto& registry = get_timers();
+    auto timers    = registry.perf_snapshot();
+
+    if (timers.empty()) {
+        std::cout << "No hardware counters have been recorded!" << std::endl;
+        return;
+    }
+
+    const size_t mask = registry.perf_mask.load(std::memory_order_relaxed);
+
+    auto has = [mask](perf_event event) { return mask & (size_t(1) << size_t(event)); };
+
+    auto value = [](auto& timer, perf_event event) { return double(timer.values[size_t(event)]); };
+
+    auto ratio = [](double num, double den, double scale, const char* suffix) {
+        return den > 0.0 ? to_string_precision(scale * num / den, 3) + suffix : std::string("-");
+    };
+
+    //Sort the timers by cycles (DESC)
+    std::sort(timers.begin(), timers.end(), [](auto& left, auto& right) {
+        return left.values[size_t(perf_event::CYCLES)] > right.values[size_t(perf_event::CYCLES)];
+    });
+
+    constexpr size_t columns = 8;
+
+    std::vector<std::array<std::string, columns>> rows;
+    rows.push_back({"Timer", "Count", "Cycles", "IPC", "LLC miss", "LLC MPKI", "dTLB MPKI", "Vector"});
+
+    for (auto& timer : timers) {
+        const double cycles       = value(timer, perf_event::CYCLES);
+        const double instructions = value(timer, perf_event::INSTRUCTIONS);
+        const double scalar       = value(timer, perf_event::FP_SCALAR);
+        const double vector       = value(timer, perf_event::FP_VECTOR);
+
+        rows.push_back({
+            timer.name,
+            std::to_string(timer.count),
+            has(perf_event::CYCLES) ? std::to_string(size_t(cycles)) : "-",
+            has(perf_event::INSTRUCTIONS) && has(perf_event::CYCLES) ? ratio(instructions, cycles, 1.0, "") : "-",
+            has(perf_event::LLC_MISSES) && has(perf_event::LLC_REFERENCES) ? ratio(value(timer, perf_event::LLC_MISSES), value(timer, perf_event::LLC_REFERENCES), 100.0, "%") : "-",
+            has(perf_event::LLC_MISSES) && has(perf_event::INSTRUCTIONS) ? ratio(value(timer, perf_event::LLC_MISSES), instructions, 1000.0, "") : "-",
+            has(perf_event::DTLB_MISSES) && has(perf_event::INSTRUCTIONS) ? ratio(value(timer, perf_event::DTLB_MISSES), instructions, 1000.0, "") : "-",
+            has(perf_event::FP_SCALAR) && has(perf_event::FP_VECTOR) ? ratio(vector, scalar + vector, 100.0, "%") : "-"});
+    }
+
+    detail::print_table(rows);
+}
+
 /*!
  * \brief Dump all timers values to the console in the form of a nice table.
  */
 inline void dump_timers_pretty() {
-    decltype(auto) timers = get_timers().timers;
+    auto timers = get_timers().snapshot();
 
     if(timers.empty()){
         std::cout << "No timers have been recorded!" << std::endl;
@@ -265,7 +875,7 @@ inline void dump_timers_pretty() {
         return left.duration > right.duration;
     });
 
-    double total_duration = timers.front().duration.load();
+    double total_duration = timers.front().duration;
 
     constexpr size_t columns = 5;
 
@@ -325,13 +935,73 @@ inline void dump_timers_pretty() {
     }
 
     std::cout << " " << std::string(line_length, '-') << '\n';
+
+    // The hardware counters, next to the durations, if they were read
+    if (!get_timers().perf_snapshot().empty()) {
+        dump_timers_perf();
+    }
+}
+
+/*!
+ * \brief Export the self duration of the nested scopes of the timers in the
+ * folded stacks format of the flamegraphs ("parent;child duration").
+ */
+inline std::string export_timers_folded() {
+    std::ostringstream out;
+
+    for (auto& [path, duration] : get_timers().stacks()) {
+        if (duration) {
+            out << path << " " << duration << "\n";
+        }
+    }
+
+    return out.str();
+}
+
+/*!
+ * \brief Export the recorded events of the timers in the JSON format of
+ * the Chrome trace viewer, one track per thread.
+ *
+ * The events are only recorded after enable_timer_events().
+ */
+inline std::string export_timers_chrome_trace() {
+    auto& timers = get_timers();
+    auto events  = timers.all_events();
+
+    std::sort(events.begin(), events.end(), [](auto& left, auto& right) { return left.start < right.start; });
+
+    std::ostringstream out;
+
+    out << "{\"traceEvents\":[";
+
+    for (size_t i = 0; i < events.size(); ++i) {
+        auto& event = events[i];
+
+        std::string name;
+
+        for (const char* c = timers.names[event.id]; *c; ++c) {
+            if (*c == '"' || *c == '\\') {
+                name += '\\';
+            }
+
+            name += *c;
+        }
+
+        out << (i ? ",\n" : "\n")
+            << "{\"name\":\"" << name << "\",\"cat\":\"dll\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.tid
+            << ",\"ts\":" << event.start * 1e-3 << ",\"dur\":" << event.duration * 1e-3 << "}";
+    }
+
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    return out.str();
 }
 
 /*!
  * \brief Automatic timer with RAII.
  */
 struct auto_timer {
-    const char* name;                               ///< The name of the timer
+    size_t node;                                              ///< The node of the scope of the timer
     std::chrono::time_point<std::chrono::steady_clock> start; ///< The start time
     std::chrono::time_point<std::chrono::steady_clock> end;   ///< The end time
 
@@ -339,10 +1009,13 @@ struct auto_timer {
      * \brief Create an auto_timer witht the given name
      * \param name The name of the timer
      */
-    auto_timer(const char* name) : name(name) {
+    auto_timer(const char* name) : node(get_thread_timers().enter(name)) {
         start = std::chrono::steady_clock::now();
     }
 
+    auto_timer(const auto_timer& rhs) = delete;
+    auto_timer& operator=(const auto_timer& rhs) = delete;
+
     /*!
      * \brief Destructs the timer, effectively incrementing the timer.
      */
@@ -350,56 +1023,18 @@ struct auto_timer {
         end           = std::chrono::steady_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
 
-        decltype(auto) timers = get_timers();
-
-        // Try to increment without the lock
-
-        for (decltype(auto) timer : timers.timers) {
-            if (timer.name == name) {
-                timer.duration += duration;
-                ++timer.count;
-
-                return;
-            }
-        }
-
-        {
-            std::lock_guard<std::mutex> lock(timers.lock);
-
-            // Retry again to increment with lock
-
-            for (decltype(auto) timer : timers.timers) {
-                if (timer.name == name) {
-                    timer.duration += duration;
-                    ++timer.count;
-
-                    return;
-                }
-            }
-
-            // At this point the timer does not exist, create it
-
-            for (decltype(auto) timer : timers.timers) {
-                if (!timer.name) {
-                    timer.name     = name;
-                    timer.duration = duration;
-                    timer.count    = 1;
-
-                    return;
-                }
-            }
-        }
-
-        // If there are no more timers
-        std::cerr << "Unable to register timer " << name << std::endl;
+        get_thread_timers().leave(node, start, duration);
     }
 };
 
 /*!
- * \brief Automatic timer with RAII, without synchronization.
+ * \brief Automatic timer with RAII.
+ *
+ * The timers do not need any synchronization anymore, this is kept for
+ * compatibility.
  */
 struct unsafe_auto_timer {
-    const char* name;                                         ///< The name of the timer
+    size_t node;                                              ///< The node of the scope of the timer
     std::chrono::time_point<std::chrono::steady_clock> start; ///< The start time
     std::chrono::time_point<std::chrono::steady_clock> end;   ///< The end time
 
@@ -407,10 +1042,13 @@ struct unsafe_auto_timer {
      * \brief Create an unsafe_auto_timer witht the given name
      * \param name The name of the timer
      */
-    unsafe_auto_timer(const char* name) : name(name) {
+    unsafe_auto_timer(const char* name) : node(get_thread_timers().enter(name)) {
         start = std::chrono::steady_clock::now();
     }
 
+    unsafe_auto_timer(const unsafe_auto_timer& rhs) = delete;
+    unsafe_auto_timer& operator=(const unsafe_auto_timer& rhs) = delete;
+
     /*!
      * \brief Destructs the timer, effectively incrementing the timer.
      */
@@ -418,36 +1056,83 @@ struct unsafe_auto_timer {
         end           = std::chrono::steady_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
 
-        decltype(auto) timers = get_timers();
+        get_thread_timers().leave(node, start, duration);
+    }
+};
+
+#endif
+
+/*!
+ * \brief Compute the deltas of the timers between consecutive points of the
+ * training, for instance the ends of the epochs.
+ *
+ * The timers themselves remain global and cumulative, only a snapshot of
+ * their values is kept at each point.
+ */
+struct timers_checkpoint {
+    std::vector<timer_delta> last;                            ///< The values of the timers at the last point
+    std::chrono::time_point<std::chrono::steady_clock> start; ///< The time of the last point
 
-        // Increment the timer if it exists
+    timers_checkpoint() {
+        reset();
+    }
 
-        for (decltype(auto) timer : timers.timers) {
-            if (timer.name == name) {
-                timer.duration += duration;
-                ++timer.count;
+    /*!
+     * \brief Take the current values of the timers as the start of the next
+     * period
+     */
+    void reset() {
+        last  = values();
+        start = std::chrono::steady_clock::now();
+    }
 
-                return;
-            }
-        }
+    /*!
+     * \brief Returns the deltas of the timers since the last point and start
+     * a new period
+     */
+    timers_delta next() {
+        auto current = values();
+        auto now     = std::chrono::steady_clock::now();
 
-        // At this point the timer does not exist, create it
+        timers_delta delta;
+        delta.wall = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
 
-        for (decltype(auto) timer : timers.timers) {
-            if (!timer.name) {
-                timer.name     = name;
-                timer.duration = duration;
-                timer.count    = 1;
+        for (auto& timer : current) {
+            auto it = std::find_if(last.begin(), last.end(), [&timer](auto& previous) { return previous.name == timer.name; });
 
-                return;
+            // The timers may have been reset since the last point
+            if (it == last.end() || it->count > timer.count || it->total_duration > timer.total_duration) {
+                delta.timers.push_back({timer.name, timer.count, timer.total_duration, timer.total_duration});
+            } else if (timer.count > it->count) {
+                delta.timers.push_back({timer.name, timer.count - it->count, timer.total_duration - it->total_duration, timer.total_duration});
             }
         }
 
-        // If there are no more timers
-        std::cerr << "Unable to register timer " << name << std::endl;
+        std::sort(delta.timers.begin(), delta.timers.end(), [](auto& left, auto& right) {
+            return left.duration > right.duration;
+        });
+
+        last  = std::move(current);
+        start = now;
+
+        return delta;
     }
-};
 
+private:
+    /*!
+     * \brief Returns the current values of the timers
+     */
+    static std::vector<timer_delta> values() {
+        std::vector<timer_delta> result;
+
+#ifndef DLL_NO_TIMERS
+        for (auto& timer : get_timers().snapshot()) {
+            result.push_back({timer.name, timer.count, 0, timer.duration});
+        }
 #endif
 
+        return result;
+    }
+};
+
 } //end of namespace dll
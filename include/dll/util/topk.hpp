@@ -0,0 +1,113 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Partial selection of the k best outputs of a network
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The largest k selected by insertion, larger k are selected with a
+ * heap (partial sort).
+ */
+constexpr size_t topk_insertion_limit = 16;
+
+namespace detail {
+
+/*!
+ * \brief Indicates if the value a at index i is ranked before the value b
+ * at index j (higher value first, lower index first on ties)
+ */
+template <typename T>
+inline bool topk_before(T a, size_t i, T b, size_t j) {
+    return a > b || (a == b && i < j);
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Select the indices of the k largest values of a row, from the
+ * largest to the smallest, without sorting the row.
+ *
+ * \param row The values
+ * \param width The number of values
+ * \param k The number of indices to select (at most width)
+ * \param out The k selected indices
+ */
+template <typename T>
+void topk_row(const T* row, size_t width, size_t k, size_t* out) {
+    cpp_assert(k <= width, "Cannot select more values than the row contains");
+
+    if (!k) {
+        return;
+    }
+
+    if (k <= topk_insertion_limit) {
+        // The k best indices, kept sorted, one pass over the row
+        size_t filled = 0;
+
+        for (size_t i = 0; i < width; ++i) {
+            if (filled == k && !detail::topk_before(row[i], i, row[out[k - 1]], out[k - 1])) {
+                continue;
+            }
+
+            size_t p = filled < k ? filled++ : k - 1;
+
+            while (p > 0 && detail::topk_before(row[i], i, row[out[p - 1]], out[p - 1])) {
+                out[p] = out[p - 1];
+                --p;
+            }
+
+            out[p] = i;
+        }
+    } else {
+        std::vector<size_t> indices(width);
+        std::iota(indices.begin(), indices.end(), 0);
+
+        std::partial_sort(indices.begin(), indices.begin() + k, indices.end(), [row](size_t i, size_t j) {
+            return detail::topk_before(row[i], i, row[j], j);
+        });
+
+        std::copy(indices.begin(), indices.begin() + k, out);
+    }
+}
+
+/*!
+ * \brief Returns the rank of the given index in a row, i.e. the number of
+ * values ranked before it.
+ *
+ * The index is in the top-k of the row if its rank is lower than k, which
+ * does not need any selection.
+ *
+ * \param row The values
+ * \param width The number of values
+ * \param index The index
+ */
+template <typename T>
+size_t topk_rank(const T* row, size_t width, size_t index) {
+    const T value = row[index];
+
+    size_t rank = 0;
+
+    for (size_t i = 0; i < width; ++i) {
+        rank += detail::topk_before(row[i], i, value, index) ? 1 : 0;
+    }
+
+    return rank;
+}
+
+} //end of dll namespace
@@ -0,0 +1,99 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Transport interface for the distributed training over several nodes
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief The interface of the transports used to train a network over
+ * several processes (ranks), each training on its own shard of the data.
+ *
+ * All the collective operations must be called by all the ranks, in the
+ * same order, with buffers of the same size.
+ */
+struct distributed_transport {
+    virtual ~distributed_transport() = default;
+
+    /*!
+     * \brief Returns the rank of this process
+     */
+    virtual size_t rank() const = 0;
+
+    /*!
+     * \brief Returns the number of processes
+     */
+    virtual size_t size() const = 0;
+
+    /*!
+     * \brief Sum the given buffer over all the ranks, in place
+     * \param data The buffer
+     * \param n The number of elements of the buffer
+     */
+    virtual void allreduce(float* data, size_t n) = 0;
+
+    /*!
+     * \copydoc allreduce
+     */
+    virtual void allreduce(double* data, size_t n) = 0;
+
+    /*!
+     * \brief Broadcast the buffer of the root rank to all the other ranks
+     * \param data The buffer
+     * \param n The number of elements of the buffer
+     */
+    virtual void broadcast(float* data, size_t n) = 0;
+
+    /*!
+     * \copydoc broadcast
+     */
+    virtual void broadcast(double* data, size_t n) = 0;
+
+    /*!
+     * \brief Gather the bytes of all the ranks, in the order of the ranks,
+     * into the output of every rank.
+     *
+     * The default implementation sums the bytes of each rank, in its own
+     * slot, with allreduce. The transports should override it to only send
+     * the bytes themselves.
+     *
+     * \param data The bytes of this rank
+     * \param bytes The number of bytes of each rank
+     * \param output The bytes of all the ranks (size() * bytes)
+     */
+    virtual void allgather(const uint8_t* data, size_t bytes, uint8_t* output) {
+        std::vector<float> values(size() * bytes, 0.0f);
+
+        for (size_t i = 0; i < bytes; ++i) {
+            values[rank() * bytes + i] = data[i];
+        }
+
+        allreduce(values.data(), values.size());
+
+        for (size_t i = 0; i < values.size(); ++i) {
+            output[i] = uint8_t(values[i]);
+        }
+    }
+
+    /*!
+     * \brief Indicates if this process is the root rank
+     */
+    bool is_root() const {
+        return rank() == 0;
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,76 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Cache of the transposed weights of the dense layers, for the
+ * products of the backward pass without the BLAS kernels.
+ */
+
+#pragma once
+
+#include <mutex>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/timers.hpp" // for auto_timer
+
+namespace dll {
+
+/*!
+ * \brief Indicates if the products by a transposed matrix are computed by
+ * the BLAS kernels with their transposition flags, without temporaries
+ */
+constexpr bool transpose_free_gemm = etl::cblas_enabled || etl::cublas_enabled;
+
+/*!
+ * \brief Cache of the transpose (NH x NV) of the weights (NV x NH) of a
+ * dense layer.
+ *
+ * The cache is computed on first use and must be invalidated when the
+ * weights are modified. Each refresh is counted by the "dense:transpose"
+ * timer.
+ */
+template <typename T>
+struct transposed_weights {
+    /*!
+     * \brief Returns the transpose of the given weights
+     */
+    template <typename W>
+    const etl::dyn_matrix<T, 2>& get(const W& w) {
+        std::lock_guard<std::mutex> l(lock);
+
+        if (!valid) {
+            dll::auto_timer timer("dense:transpose");
+
+            if (etl::dim<0>(w_t) != etl::dim<1>(w) || etl::dim<1>(w_t) != etl::dim<0>(w)) {
+                w_t = etl::dyn_matrix<T, 2>(etl::dim<1>(w), etl::dim<0>(w));
+            }
+
+            w_t = etl::transpose(w);
+
+            valid = true;
+        }
+
+        return w_t;
+    }
+
+    /*!
+     * \brief Invalidate the cache, after a modification of the weights
+     */
+    void invalidate() {
+        std::lock_guard<std::mutex> l(lock);
+        valid = false;
+    }
+
+private:
+    etl::dyn_matrix<T, 2> w_t; ///< The transposed weights
+    bool valid = false;        ///< Indicates if the transposed weights are up to date
+    std::mutex lock;           ///< The lock for concurrent uses of the layer
+};
+
+} //end of namespace dll
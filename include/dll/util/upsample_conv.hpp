@@ -0,0 +1,332 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Kernels of the 'same' convolutions of a virtually upsampled input.
+ *
+ * The input (C x H x W) is upsampled by nearest neighbour (U1 x U2) and
+ * convolved with 'same' padding, without materializing the upsampled input.
+ * The outputs at the same phase (y % U1, x % U2) only see the input through
+ * the sums of the taps of the filters falling on the same source pixel, so
+ * each phase is a 'same' convolution of the low-resolution input with
+ * smaller filters, computed with the kernels of same_conv.hpp. For 3x3
+ * filters and an upsampling of 2x2, the filters of the phases are 2x2.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/same_conv.hpp"
+
+namespace dll {
+
+/*!
+ * \brief One phase of an upsampled convolution: the filter rows and
+ * columns of the taps and the geometry of its low-resolution convolution
+ */
+struct upsample_conv_phase {
+    same_conv_geometry g;     ///< The geometry of the convolution of the phase
+    std::vector<size_t> rows; ///< The row of the filters of the phase of each row of the filters
+    std::vector<size_t> cols; ///< The column of the filters of the phase of each column of the filters
+};
+
+/*!
+ * \brief The geometry of a 'same' convolution of an upsampled input
+ */
+struct upsample_conv_geometry {
+    size_t C;   ///< The number of input channels
+    size_t H;   ///< The height of the input
+    size_t W;   ///< The width of the input
+    size_t U1;  ///< The vertical upsampling factor
+    size_t U2;  ///< The horizontal upsampling factor
+    size_t K;   ///< The number of filters
+    size_t NW1; ///< The height of the filters
+    size_t NW2; ///< The width of the filters
+    size_t HO;  ///< The height of the output
+    size_t WO;  ///< The width of the output
+    size_t P1;  ///< The padding at the top of the upsampled input
+    size_t P2;  ///< The padding at the left of the upsampled input
+
+    upsample_conv_geometry(size_t C, size_t H, size_t W, size_t U1, size_t U2, size_t K, size_t NW1, size_t NW2)
+            : C(C), H(H), W(W), U1(U1), U2(U2), K(K), NW1(NW1), NW2(NW2), HO(H * U1), WO(W * U2),
+              P1(same_conv_geometry::same_padding(HO, HO, NW1, 1)), P2(same_conv_geometry::same_padding(WO, WO, NW2, 1)) {}
+
+    /*!
+     * \brief Returns the number of phases
+     */
+    size_t phases() const {
+        return U1 * U2;
+    }
+
+    /*!
+     * \brief Returns the given phase, p = py * U2 + px
+     */
+    upsample_conv_phase phase(size_t p) const {
+        const size_t py = p / U2;
+        const size_t px = p % U2;
+
+        upsample_conv_phase phase{same_conv_geometry(C, H, W, K, 1, 1), {}, {}};
+
+        const long d_first = floor_div(long(py) - long(P1), U1);
+        const long e_first = floor_div(long(px) - long(P2), U2);
+
+        for (size_t i = 0; i < NW1; ++i) {
+            phase.rows.push_back(size_t(floor_div(long(py + i) - long(P1), U1) - d_first));
+        }
+
+        for (size_t j = 0; j < NW2; ++j) {
+            phase.cols.push_back(size_t(floor_div(long(px + j) - long(P2), U2) - e_first));
+        }
+
+        // The source pixel of a tap is valid if and only if its upsampled pixel is
+        auto& g = phase.g;
+        g.NW1   = phase.rows.back() + 1;
+        g.NW2   = phase.cols.back() + 1;
+        g.P1    = size_t(-d_first);
+        g.P2    = size_t(-e_first);
+
+        return phase;
+    }
+
+private:
+    /*!
+     * \brief Returns floor(a / b)
+     */
+    static long floor_div(long a, size_t b) {
+        return a >= 0 ? a / long(b) : -((-a + long(b) - 1) / long(b));
+    }
+};
+
+/*!
+ * \brief Returns the size of the workspace, in bytes, needed by the kernels
+ * of an upsampled convolution, for any batch size
+ */
+template <typename T>
+size_t upsample_conv_workspace_size(const upsample_conv_geometry& g) {
+    size_t size = 0;
+
+    for (size_t p = 0; p < g.phases(); ++p) {
+        size = std::max(size, same_conv_workspace_size<T>(g.phase(p).g));
+    }
+
+    return size;
+}
+
+namespace detail {
+
+/*!
+ * \brief Compute the filters of a phase (K x C x D1 x D2): the sums of the
+ * taps of the filters (K x C x NW1 x NW2) on the same source pixels
+ */
+template <typename T>
+void upsample_conv_phase_filters(const upsample_conv_geometry& g, const upsample_conv_phase& phase, const T* w, T* wp) {
+    const size_t D1 = phase.g.NW1;
+    const size_t D2 = phase.g.NW2;
+
+    std::fill(wp, wp + g.K * g.C * D1 * D2, T(0));
+
+    for (size_t kc = 0; kc < g.K * g.C; ++kc) {
+        for (size_t i = 0; i < g.NW1; ++i) {
+            for (size_t j = 0; j < g.NW2; ++j) {
+                wp[(kc * D1 + phase.rows[i]) * D2 + phase.cols[j]] += w[(kc * g.NW1 + i) * g.NW2 + j];
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Accumulate the gradients of the filters of a phase into the
+ * gradients of the filters, the adjoint of upsample_conv_phase_filters
+ */
+template <typename T>
+void upsample_conv_phase_gradients(const upsample_conv_geometry& g, const upsample_conv_phase& phase, const T* gp, T* grad) {
+    const size_t D1 = phase.g.NW1;
+    const size_t D2 = phase.g.NW2;
+
+    for (size_t kc = 0; kc < g.K * g.C; ++kc) {
+        for (size_t i = 0; i < g.NW1; ++i) {
+            for (size_t j = 0; j < g.NW2; ++j) {
+                grad[(kc * g.NW1 + i) * g.NW2 + j] += gp[(kc * D1 + phase.rows[i]) * D2 + phase.cols[j]];
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Copy the outputs of a phase (B x K x H x W) into the output (B x K
+ * x HO x WO)
+ */
+template <typename T>
+void upsample_conv_scatter(const upsample_conv_geometry& g, size_t p, size_t B, const T* in, T* out) {
+    const size_t py = p / g.U2;
+    const size_t px = p % g.U2;
+
+    for (size_t bk = 0; bk < B * g.K; ++bk) {
+        for (size_t y = 0; y < g.H; ++y) {
+            const T* in_row = in + (bk * g.H + y) * g.W;
+            T* out_row      = out + (bk * g.HO + y * g.U1 + py) * g.WO + px;
+
+            for (size_t x = 0; x < g.W; ++x) {
+                out_row[x * g.U2] = in_row[x];
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Copy the errors of a phase from the errors (B x K x HO x WO) into
+ * errors (B x K x H x W), the adjoint of upsample_conv_scatter
+ */
+template <typename T>
+void upsample_conv_gather(const upsample_conv_geometry& g, size_t p, size_t B, const T* in, T* out) {
+    const size_t py = p / g.U2;
+    const size_t px = p % g.U2;
+
+    for (size_t bk = 0; bk < B * g.K; ++bk) {
+        for (size_t y = 0; y < g.H; ++y) {
+            const T* in_row = in + (bk * g.HO + y * g.U1 + py) * g.WO + px;
+            T* out_row      = out + (bk * g.H + y) * g.W;
+
+            for (size_t x = 0; x < g.W; ++x) {
+                out_row[x] = in_row[x * g.U2];
+            }
+        }
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Compute the 'same' convolution (cross-correlation) of the
+ * upsampled input of a batch, without upsampled copy of the input.
+ *
+ * \param input The input batch, with direct memory access (B x C x H x W)
+ * \param w The filters, with direct memory access (K x C x NW1 x NW2)
+ * \param output The output batch, with direct memory access (B x K x HO x WO)
+ * \param g The geometry of the convolution
+ * \param ws The workspace for the temporaries (can be nullptr)
+ */
+template <typename I, typename W, typename O>
+void upsample_conv_forward(const I& input, const W& w, O&& output, const upsample_conv_geometry& g, workspace* ws = nullptr) {
+    using T = etl::value_t<I>;
+
+    const size_t B = etl::dim<0>(input);
+
+    w.ensure_cpu_up_to_date();
+    output.ensure_cpu_up_to_date();
+
+    etl::dyn_matrix<T, 4> out_p(B, g.K, g.H, g.W);
+
+    for (size_t p = 0; p < g.phases(); ++p) {
+        const auto phase = g.phase(p);
+
+        etl::dyn_matrix<T, 4> wp(g.K, g.C, phase.g.NW1, phase.g.NW2);
+        detail::upsample_conv_phase_filters(g, phase, w.memory_start(), wp.memory_start());
+
+        same_conv_forward(input, wp, out_p, phase.g, ws);
+
+        detail::upsample_conv_scatter(g, p, B, out_p.memory_start(), output.memory_start());
+    }
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the gradients of the input of an upsampled 'same'
+ * convolution, the adjoint of upsample_conv_forward: the errors of the
+ * upsampled pixels are accumulated into their source pixels.
+ *
+ * \param errors The errors of the output, with direct memory access (B x K x HO x WO)
+ * \param w The filters, with direct memory access (K x C x NW1 x NW2)
+ * \param output The gradients of the input, with direct memory access (B x C x H x W)
+ * \param g The geometry of the convolution
+ * \param ws The workspace for the temporaries (can be nullptr)
+ */
+template <typename E, typename W, typename O>
+void upsample_conv_backward(const E& errors, const W& w, O&& output, const upsample_conv_geometry& g, workspace* ws = nullptr) {
+    using T = etl::value_t<E>;
+
+    const size_t B = etl::dim<0>(errors);
+
+    errors.ensure_cpu_up_to_date();
+    w.ensure_cpu_up_to_date();
+
+    etl::dyn_matrix<T, 4> e_p(B, g.K, g.H, g.W);
+    etl::dyn_matrix<T, 4> back_p(B, g.C, g.H, g.W);
+
+    output = T(0);
+    output.ensure_cpu_up_to_date();
+
+    T* out_p = output.memory_start();
+
+    for (size_t p = 0; p < g.phases(); ++p) {
+        const auto phase = g.phase(p);
+
+        etl::dyn_matrix<T, 4> wp(g.K, g.C, phase.g.NW1, phase.g.NW2);
+        detail::upsample_conv_phase_filters(g, phase, w.memory_start(), wp.memory_start());
+
+        detail::upsample_conv_gather(g, p, B, errors.memory_start(), e_p.memory_start());
+        e_p.invalidate_gpu();
+
+        same_conv_backward(e_p, wp, back_p, phase.g, ws);
+
+        const T* back = back_p.memory_start();
+
+        for (size_t i = 0; i < B * g.C * g.H * g.W; ++i) {
+            out_p[i] += back[i];
+        }
+    }
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the gradients of the filters of an upsampled 'same'
+ * convolution, summed over the batch.
+ *
+ * \param input The input batch, with direct memory access (B x C x H x W)
+ * \param errors The errors of the output, with direct memory access (B x K x HO x WO)
+ * \param grad The gradients of the filters, with direct memory access (K x C x NW1 x NW2)
+ * \param g The geometry of the convolution
+ * \param ws The workspace for the temporaries (can be nullptr)
+ */
+template <typename I, typename E, typename G>
+void upsample_conv_backward_filter(const I& input, const E& errors, G&& grad, const upsample_conv_geometry& g, workspace* ws = nullptr) {
+    using T = etl::value_t<I>;
+
+    const size_t B = etl::dim<0>(errors);
+
+    errors.ensure_cpu_up_to_date();
+
+    etl::dyn_matrix<T, 4> e_p(B, g.K, g.H, g.W);
+
+    grad = T(0);
+    grad.ensure_cpu_up_to_date();
+
+    for (size_t p = 0; p < g.phases(); ++p) {
+        const auto phase = g.phase(p);
+
+        etl::dyn_matrix<T, 4> gp(g.K, g.C, phase.g.NW1, phase.g.NW2);
+
+        detail::upsample_conv_gather(g, p, B, errors.memory_start(), e_p.memory_start());
+        e_p.invalidate_gpu();
+
+        same_conv_backward_filter(input, e_p, gp, phase.g, ws);
+
+        gp.ensure_cpu_up_to_date();
+        detail::upsample_conv_phase_gradients(g, phase, gp.memory_start(), grad.memory_start());
+    }
+
+    grad.invalidate_gpu();
+}
+
+} //end of namespace dll
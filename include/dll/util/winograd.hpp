@@ -0,0 +1,571 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Winograd F(2x2,3x3) convolution kernels for the 3x3 stride-1
+ * convolutional layers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/pool_stats.hpp"
+#include "dll/util/thread_pool_scope.hpp"
+#include "dll/util/workspace.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Apply the 1D transform f (N -> M values) on the columns and then
+ * on the rows of the N x N tile, into the M x M tile.
+ */
+template <size_t N, size_t M, typename T, typename F>
+void winograd_2d(const T* in, T* out, F f) {
+    T tmp[M * N];
+
+    for (size_t j = 0; j < N; ++j) {
+        T x[N];
+        T y[M];
+
+        for (size_t i = 0; i < N; ++i) {
+            x[i] = in[i * N + j];
+        }
+
+        f(x, y);
+
+        for (size_t i = 0; i < M; ++i) {
+            tmp[i * N + j] = y[i];
+        }
+    }
+
+    for (size_t i = 0; i < M; ++i) {
+        f(tmp + i * N, out + i * M);
+    }
+}
+
+// The 1D transforms (G, B^T, A^T) and their adjoints (G^T, B, A)
+
+template <typename T>
+void winograd_g(const T* g, T* u) {
+    u[0] = g[0];
+    u[1] = T(0.5) * (g[0] + g[1] + g[2]);
+    u[2] = T(0.5) * (g[0] - g[1] + g[2]);
+    u[3] = g[2];
+}
+
+template <typename T>
+void winograd_gt(const T* u, T* g) {
+    g[0] = u[0] + T(0.5) * (u[1] + u[2]);
+    g[1] = T(0.5) * (u[1] - u[2]);
+    g[2] = T(0.5) * (u[1] + u[2]) + u[3];
+}
+
+template <typename T>
+void winograd_bt(const T* d, T* v) {
+    v[0] = d[0] - d[2];
+    v[1] = d[1] + d[2];
+    v[2] = d[2] - d[1];
+    v[3] = d[1] - d[3];
+}
+
+template <typename T>
+void winograd_b(const T* v, T* d) {
+    d[0] = v[0];
+    d[1] = v[1] - v[2] + v[3];
+    d[2] = v[1] + v[2] - v[0];
+    d[3] = -v[3];
+}
+
+template <typename T>
+void winograd_at(const T* m, T* y) {
+    y[0] = m[0] + m[1] + m[2];
+    y[1] = m[1] - m[2] - m[3];
+}
+
+template <typename T>
+void winograd_a(const T* y, T* m) {
+    m[0] = y[0];
+    m[1] = y[0] + y[1];
+    m[2] = y[0] - y[1];
+    m[3] = -y[1];
+}
+
+/*!
+ * \brief The geometry of a Winograd convolution
+ */
+struct winograd_geometry {
+    size_t C;  ///< The number of input channels
+    size_t H;  ///< The height of the input
+    size_t W;  ///< The width of the input
+    size_t K;  ///< The number of filters
+    size_t P;  ///< The padding
+    size_t HO; ///< The height of the output
+    size_t WO; ///< The width of the output
+    size_t T1; ///< The number of tiles in height
+    size_t T2; ///< The number of tiles in width
+    size_t NT; ///< The number of tiles
+
+    winograd_geometry(size_t C, size_t H, size_t W, size_t K, size_t P)
+            : C(C), H(H), W(W), K(K), P(P), HO(H + 2 * P - 2), WO(W + 2 * P - 2), T1((HO + 1) / 2), T2((WO + 1) / 2), NT(T1 * T2) {}
+
+    /*!
+     * \brief Returns the number of temporary elements of one chunk of samples
+     */
+    size_t chunk_size() const {
+        return 16 * (C + K) * NT;
+    }
+};
+
+/*!
+ * \brief Compute the transformed input tiles V[16][C][NT] of one sample
+ */
+template <typename T>
+void winograd_input(const winograd_geometry& g, const T* in, T* v) {
+    for (size_t c = 0; c < g.C; ++c) {
+        const T* in_c = in + c * g.H * g.W;
+
+        for (size_t t1 = 0; t1 < g.T1; ++t1) {
+            for (size_t t2 = 0; t2 < g.T2; ++t2) {
+                T d[16];
+
+                for (size_t i = 0; i < 4; ++i) {
+                    // Unsigned wrapping makes the padding out of bounds
+                    const size_t y = 2 * t1 + i - g.P;
+
+                    for (size_t j = 0; j < 4; ++j) {
+                        const size_t x = 2 * t2 + j - g.P;
+
+                        d[i * 4 + j] = y < g.H && x < g.W ? in_c[y * g.W + x] : T(0);
+                    }
+                }
+
+                T tile[16];
+                winograd_2d<4, 4>(d, tile, winograd_bt<T>);
+
+                const size_t t = t1 * g.T2 + t2;
+
+                for (size_t xi = 0; xi < 16; ++xi) {
+                    v[(xi * g.C + c) * g.NT + t] = tile[xi];
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Compute the transformed output errors E[16][K][NT] of one sample
+ */
+template <typename T>
+void winograd_errors(const winograd_geometry& g, const T* errors, T* e) {
+    for (size_t k = 0; k < g.K; ++k) {
+        const T* errors_k = errors + k * g.HO * g.WO;
+
+        for (size_t t1 = 0; t1 < g.T1; ++t1) {
+            for (size_t t2 = 0; t2 < g.T2; ++t2) {
+                T dy[4];
+
+                for (size_t i = 0; i < 2; ++i) {
+                    for (size_t j = 0; j < 2; ++j) {
+                        const size_t y = 2 * t1 + i;
+                        const size_t x = 2 * t2 + j;
+
+                        dy[i * 2 + j] = y < g.HO && x < g.WO ? errors_k[y * g.WO + x] : T(0);
+                    }
+                }
+
+                T tile[16];
+                winograd_2d<2, 4>(dy, tile, winograd_a<T>);
+
+                const size_t t = t1 * g.T2 + t2;
+
+                for (size_t xi = 0; xi < 16; ++xi) {
+                    e[(xi * g.K + k) * g.NT + t] = tile[xi];
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Compute out[16][R][NT] = sum_s f[16][R][S] * in[16][S][NT], or with
+ * f[16][S][R] if Transposed is set
+ */
+template <bool Transposed, typename T>
+void winograd_products(const T* f, const T* in, T* out, size_t R, size_t S, size_t NT) {
+    std::fill(out, out + 16 * R * NT, T(0));
+
+    for (size_t xi = 0; xi < 16; ++xi) {
+        for (size_t r = 0; r < R; ++r) {
+            T* out_r = out + (xi * R + r) * NT;
+
+            for (size_t s = 0; s < S; ++s) {
+                const T u     = Transposed ? f[(xi * S + s) * R + r] : f[(xi * R + r) * S + s];
+                const T* in_s = in + (xi * S + s) * NT;
+
+                for (size_t t = 0; t < NT; ++t) {
+                    out_r[t] += u * in_s[t];
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Apply the functor to the samples [0, n) in chunks, on the scoped
+ * thread pool if there is one: functor(c, first, last).
+ */
+template <typename Functor>
+void winograd_chunks(size_t n, size_t chunks, Functor&& functor) {
+    auto* pool = scoped_thread_pool();
+
+    if (pool && chunks > 1) {
+        dll::maybe_parallel_foreach_n(*pool, 0, chunks, [&functor, n, chunks](size_t c) {
+            functor(c, (c * n) / chunks, ((c + 1) * n) / chunks);
+        });
+    } else {
+        functor(0, 0, n);
+    }
+}
+
+/*!
+ * \brief The number of chunks for the given number of samples
+ */
+inline size_t winograd_chunk_count(size_t n) {
+    if (!scoped_thread_pool()) {
+        return 1;
+    }
+
+    return std::max(size_t(1), std::min(n, size_t(std::max(1u, std::thread::hardware_concurrency()))));
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Returns the size of the workspace, in bytes, needed by the
+ * Winograd kernels of a convolution, for any batch size
+ */
+template <typename T>
+size_t winograd_workspace_size(size_t C, size_t H, size_t W, size_t K, size_t P) {
+    const detail::winograd_geometry g(C, H, W, K, P);
+
+    const size_t chunks = std::max(1u, std::thread::hardware_concurrency());
+
+    return chunks * (g.chunk_size() + 16 * K * C) * sizeof(T);
+}
+
+/*!
+ * \brief Returns the number of elements of the transformed input tiles of
+ * one sample (V[16][C][NT]), kept between winograd_forward and
+ * winograd_backward_filter
+ */
+inline size_t winograd_input_size(size_t C, size_t H, size_t W, size_t P) {
+    const detail::winograd_geometry g(C, H, W, 1, P);
+
+    return 16 * C * g.NT;
+}
+
+/*!
+ * \brief Cache of the Winograd transform of the 3x3 filters of a layer,
+ * U = G g G^T, stored as U[16][K][C].
+ *
+ * The cache is computed on first use and must be invalidated when the
+ * filters are modified.
+ */
+template <typename T>
+struct winograd_filters {
+    /*!
+     * \brief Returns the transformed filters of the given filters (K x C x 3 x 3)
+     */
+    template <typename W>
+    const T* get(const W& w) {
+        std::lock_guard<std::mutex> l(lock);
+
+        if (!valid) {
+            const size_t K = etl::dim<0>(w);
+            const size_t C = etl::dim<1>(w);
+
+            w.ensure_cpu_up_to_date();
+
+            const T* w_p = w.memory_start();
+
+            u.resize(16 * K * C);
+
+            for (size_t k = 0; k < K; ++k) {
+                for (size_t c = 0; c < C; ++c) {
+                    T tile[16];
+                    detail::winograd_2d<3, 4>(w_p + (k * C + c) * 9, tile, detail::winograd_g<T>);
+
+                    for (size_t xi = 0; xi < 16; ++xi) {
+                        u[(xi * K + k) * C + c] = tile[xi];
+                    }
+                }
+            }
+
+            valid = true;
+        }
+
+        return u.data();
+    }
+
+    /*!
+     * \brief Invalidate the cache, after a modification of the filters
+     */
+    void invalidate() {
+        std::lock_guard<std::mutex> l(lock);
+        valid = false;
+    }
+
+private:
+    std::vector<T> u;   ///< The transformed filters
+    bool valid = false; ///< Indicates if the transformed filters are up to date
+    std::mutex lock;    ///< The lock for concurrent uses of the layer
+};
+
+/*!
+ * \brief Compute the 3x3 stride-1 convolution (cross-correlation, as
+ * etl::ml::convolution_forward) of a batch with Winograd F(2x2,3x3).
+ * \param input The input batch, with direct memory access (B x C x H x W)
+ * \param u The transformed filters
+ * \param output The output batch (B x K x HO x WO)
+ * \param C The number of input channels
+ * \param H The height of the input
+ * \param W The width of the input
+ * \param K The number of filters
+ * \param P The padding
+ * \param ws The workspace for the temporaries (can be nullptr)
+ * \param kept If not nullptr, the storage of the transformed input tiles of
+ * all the samples (B x winograd_input_size), kept for winograd_backward_filter
+ */
+template <typename I, typename T, typename O>
+void winograd_forward(const I& input, const T* u, O&& output, size_t C, size_t H, size_t W, size_t K, size_t P, workspace* ws = nullptr, T* kept = nullptr) {
+    const detail::winograd_geometry g(C, H, W, K, P);
+
+    const size_t B = etl::dim<0>(input);
+
+    input.ensure_cpu_up_to_date();
+    output.ensure_cpu_up_to_date();
+
+    const T* in_p = input.memory_start();
+    T* out_p      = output.memory_start();
+
+    const size_t chunks = detail::winograd_chunk_count(B);
+
+    workspace_lease<T> tmp(ws, chunks * g.chunk_size());
+
+    detail::winograd_chunks(B, chunks, [&](size_t chunk, size_t first, size_t last) {
+        T* m = tmp.data() + chunk * g.chunk_size() + 16 * C * g.NT;
+
+        for (size_t b = first; b < last; ++b) {
+            T* v = kept ? kept + b * 16 * C * g.NT : tmp.data() + chunk * g.chunk_size();
+
+            detail::winograd_input(g, in_p + b * C * H * W, v);
+            detail::winograd_products<false>(u, v, m, K, C, g.NT);
+
+            T* out_b = out_p + b * K * g.HO * g.WO;
+
+            for (size_t k = 0; k < K; ++k) {
+                for (size_t t1 = 0; t1 < g.T1; ++t1) {
+                    for (size_t t2 = 0; t2 < g.T2; ++t2) {
+                        const size_t t = t1 * g.T2 + t2;
+
+                        T tile[16];
+                        for (size_t xi = 0; xi < 16; ++xi) {
+                            tile[xi] = m[(xi * K + k) * g.NT + t];
+                        }
+
+                        T y[4];
+                        detail::winograd_2d<4, 2>(tile, y, detail::winograd_at<T>);
+
+                        for (size_t i = 0; i < 2 && 2 * t1 + i < g.HO; ++i) {
+                            for (size_t j = 0; j < 2 && 2 * t2 + j < g.WO; ++j) {
+                                out_b[(k * g.HO + 2 * t1 + i) * g.WO + 2 * t2 + j] = y[i * 2 + j];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the gradients of the input of a Winograd convolution
+ * (as etl::ml::convolution_backward), the adjoint of winograd_forward.
+ * \param errors The errors of the output, with direct memory access (B x K x HO x WO)
+ * \param u The transformed filters
+ * \param output The gradients of the input (B x C x H x W)
+ * \param ws The workspace for the temporaries (can be nullptr)
+ */
+template <typename E, typename T, typename O>
+void winograd_backward(const E& errors, const T* u, O&& output, size_t C, size_t H, size_t W, size_t K, size_t P, workspace* ws = nullptr) {
+    const detail::winograd_geometry g(C, H, W, K, P);
+
+    const size_t B = etl::dim<0>(errors);
+
+    errors.ensure_cpu_up_to_date();
+    output.ensure_cpu_up_to_date();
+
+    const T* e_p = errors.memory_start();
+    T* out_p     = output.memory_start();
+
+    const size_t chunks = detail::winograd_chunk_count(B);
+
+    workspace_lease<T> tmp(ws, chunks * g.chunk_size());
+
+    detail::winograd_chunks(B, chunks, [&](size_t chunk, size_t first, size_t last) {
+        T* e = tmp.data() + chunk * g.chunk_size();
+        T* d = e + 16 * K * g.NT;
+
+        for (size_t b = first; b < last; ++b) {
+            detail::winograd_errors(g, e_p + b * K * g.HO * g.WO, e);
+            detail::winograd_products<true>(u, e, d, C, K, g.NT);
+
+            T* out_b = out_p + b * C * H * W;
+
+            std::fill(out_b, out_b + C * H * W, T(0));
+
+            for (size_t c = 0; c < C; ++c) {
+                for (size_t t1 = 0; t1 < g.T1; ++t1) {
+                    for (size_t t2 = 0; t2 < g.T2; ++t2) {
+                        const size_t t = t1 * g.T2 + t2;
+
+                        T tile[16];
+                        for (size_t xi = 0; xi < 16; ++xi) {
+                            tile[xi] = d[(xi * C + c) * g.NT + t];
+                        }
+
+                        T dd[16];
+                        detail::winograd_2d<4, 4>(tile, dd, detail::winograd_b<T>);
+
+                        // The overlapping tiles accumulate
+                        for (size_t i = 0; i < 4; ++i) {
+                            const size_t y = 2 * t1 + i - g.P;
+
+                            for (size_t j = 0; j < 4; ++j) {
+                                const size_t x = 2 * t2 + j - g.P;
+
+                                if (y < H && x < W) {
+                                    out_b[(c * H + y) * W + x] += dd[i * 4 + j];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    output.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the gradients of the filters of a Winograd convolution
+ * (as etl::ml::convolution_backward_filter), summed over the batch.
+ * \param input The input batch, with direct memory access (B x C x H x W)
+ * \param errors The errors of the output, with direct memory access (B x K x HO x WO)
+ * \param grad The gradients of the filters (K x C x 3 x 3)
+ * \param ws The workspace for the temporaries (can be nullptr)
+ * \param kept If not nullptr, the transformed input tiles of all the samples
+ * kept by winograd_forward, used instead of transforming the input again
+ */
+template <typename I, typename E, typename G>
+void winograd_backward_filter(const I& input, const E& errors, G&& grad, size_t C, size_t H, size_t W, size_t K, size_t P, workspace* ws = nullptr, const etl::value_t<std::decay_t<G>>* kept = nullptr) {
+    using T = etl::value_t<std::decay_t<G>>;
+
+    const detail::winograd_geometry g(C, H, W, K, P);
+
+    const size_t B = etl::dim<0>(input);
+
+    input.ensure_cpu_up_to_date();
+    errors.ensure_cpu_up_to_date();
+    grad.ensure_cpu_up_to_date();
+
+    const T* in_p = input.memory_start();
+    const T* e_p  = errors.memory_start();
+
+    const size_t chunks = detail::winograd_chunk_count(B);
+
+    workspace_lease<T> tmp(ws, chunks * (g.chunk_size() + 16 * K * C));
+
+    // The transformed gradients of each chunk, reduced at the end
+    T* acc = tmp.data() + chunks * g.chunk_size();
+
+    std::fill(acc, acc + chunks * 16 * K * C, T(0));
+
+    detail::winograd_chunks(B, chunks, [&](size_t chunk, size_t first, size_t last) {
+        T* e = tmp.data() + chunk * g.chunk_size() + 16 * C * g.NT;
+
+        T* acc_c = acc + chunk * 16 * K * C;
+
+        for (size_t b = first; b < last; ++b) {
+            const T* v;
+
+            if (kept) {
+                v = kept + b * 16 * C * g.NT;
+            } else {
+                T* tiles = tmp.data() + chunk * g.chunk_size();
+
+                detail::winograd_input(g, in_p + b * C * H * W, tiles);
+
+                v = tiles;
+            }
+
+            detail::winograd_errors(g, e_p + b * K * g.HO * g.WO, e);
+
+            for (size_t xi = 0; xi < 16; ++xi) {
+                for (size_t k = 0; k < K; ++k) {
+                    const T* e_k = e + (xi * K + k) * g.NT;
+
+                    for (size_t c = 0; c < C; ++c) {
+                        const T* v_c = v + (xi * C + c) * g.NT;
+
+                        T sum(0);
+                        for (size_t t = 0; t < g.NT; ++t) {
+                            sum += e_k[t] * v_c[t];
+                        }
+
+                        acc_c[(xi * K + k) * C + c] += sum;
+                    }
+                }
+            }
+        }
+    });
+
+    for (size_t chunk = 1; chunk < chunks; ++chunk) {
+        for (size_t i = 0; i < 16 * K * C; ++i) {
+            acc[i] += acc[chunk * 16 * K * C + i];
+        }
+    }
+
+    T* grad_p = grad.memory_start();
+
+    for (size_t k = 0; k < K; ++k) {
+        for (size_t c = 0; c < C; ++c) {
+            T tile[16];
+            for (size_t xi = 0; xi < 16; ++xi) {
+                tile[xi] = acc[(xi * K + k) * C + c];
+            }
+
+            detail::winograd_2d<4, 3>(tile, grad_p + (k * C + c) * 9, detail::winograd_gt<T>);
+        }
+    }
+
+    grad.invalidate_gpu();
+}
+
+} //end of dll namespace
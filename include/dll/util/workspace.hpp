@@ -0,0 +1,219 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Workspace shared by the kernels of the layers of a network
+ */
+
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief The number of heap allocations made for the temporaries of the
+ * kernels, by the workspaces and the leases
+ */
+inline std::atomic<size_t>& workspace_heap_allocations() {
+    static std::atomic<size_t> allocations{0};
+    return allocations;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Returns the number of heap allocations made so far for the
+ * temporaries of the kernels of the layers: the growths of the workspaces
+ * and the leases that could not borrow a workspace.
+ *
+ * Once the first steps have sized the workspaces, the forward and training
+ * steps of a network should not increase this counter.
+ */
+inline size_t workspace_allocations() {
+    return detail::workspace_heap_allocations().load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief A memory arena shared by the kernels of the layers of a network.
+ *
+ * The layers of a network never run their kernels at the same time, so
+ * they can share the same temporary memory. The arena is sized to the
+ * largest requirement of the layers when the network is built.
+ */
+struct workspace {
+    workspace() = default;
+
+    workspace(const workspace& rhs) = delete;
+    workspace& operator=(const workspace& rhs) = delete;
+
+    /*!
+     * \brief Make sure the workspace has at least the given size
+     * \param bytes The number of bytes
+     */
+    void reserve(size_t bytes) {
+        const size_t n = (bytes + sizeof(double) - 1) / sizeof(double);
+
+        if (n > memory.size()) {
+            memory.resize(n);
+            ++detail::workspace_heap_allocations();
+        }
+    }
+
+    /*!
+     * \brief Returns the size of the workspace, in bytes
+     */
+    size_t size() const {
+        return memory.size() * sizeof(double);
+    }
+
+private:
+    std::vector<double> memory;    ///< The memory of the workspace
+    std::atomic<bool> busy{false}; ///< Indicates if the workspace is in use
+
+    template <typename T>
+    friend struct workspace_lease;
+};
+
+namespace detail {
+
+/*!
+ * \brief The redirection of a workspace of the current scope on this thread
+ */
+struct workspace_redirection {
+    const workspace* from = nullptr; ///< The redirected workspace
+    workspace* to         = nullptr; ///< The workspace used instead
+};
+
+/*!
+ * \brief Returns the workspace redirection of the current scope on this thread
+ */
+inline workspace_redirection& scoped_workspace() {
+    thread_local workspace_redirection redirection;
+    return redirection;
+}
+
+/*!
+ * \brief Returns the workspace to use instead of the given one on this
+ * thread
+ */
+inline workspace* redirect_workspace(workspace* ws) {
+    auto& redirection = scoped_workspace();
+    return ws && ws == redirection.from ? redirection.to : ws;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Make the leases of the given workspace borrow from another one on
+ * the current thread, for the lifetime of the scope.
+ *
+ * This lets several threads run the kernels of the same layers, each with
+ * its own temporary memory.
+ */
+struct workspace_scope {
+    detail::workspace_redirection previous; ///< The redirection used before the scope
+
+    /*!
+     * \brief Start using the workspace to instead of the workspace from on
+     * the current thread
+     */
+    workspace_scope(const workspace& from, workspace& to) : previous(detail::scoped_workspace()) {
+        detail::scoped_workspace() = {&from, &to};
+    }
+
+    workspace_scope(const workspace_scope& rhs) = delete;
+    workspace_scope& operator=(const workspace_scope& rhs) = delete;
+
+    /*!
+     * \brief Restore the previous redirection
+     */
+    ~workspace_scope() {
+        detail::scoped_workspace() = previous;
+    }
+};
+
+/*!
+ * \brief Traits indicating if a layer uses the workspace of the network
+ */
+template <typename Layer, typename Enable = void>
+struct uses_workspace : std::false_type {};
+
+/*!
+ * \copydoc uses_workspace
+ */
+template <typename Layer>
+struct uses_workspace<Layer, std::void_t<decltype(std::declval<Layer&>().set_workspace(nullptr))>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the given (possibly cv-qualified reference) type is a
+ * layer using the workspace of the network
+ */
+template <typename Layer>
+constexpr bool uses_workspace_v = uses_workspace<std::decay_t<Layer>>::value;
+
+/*!
+ * \brief Temporary memory for the kernel of a layer, borrowed from the
+ * workspace of the network if there is one and if it is not already in
+ * use, allocated otherwise.
+ *
+ * The workspace of the current workspace_scope is borrowed instead of the
+ * workspace it redirects.
+ */
+template <typename T>
+struct workspace_lease {
+    /*!
+     * \brief Borrow n elements from the given workspace
+     * \param ws The workspace (can be nullptr)
+     * \param n The number of elements
+     */
+    workspace_lease(workspace* ws, size_t n) {
+        ws = detail::redirect_workspace(ws);
+
+        if (ws && !ws->busy.exchange(true)) {
+            owner = ws;
+            owner->reserve(n * sizeof(T));
+            memory = reinterpret_cast<T*>(owner->memory.data());
+        } else {
+            local.resize(n);
+            memory = local.data();
+            ++detail::workspace_heap_allocations();
+        }
+    }
+
+    workspace_lease(const workspace_lease& rhs) = delete;
+    workspace_lease& operator=(const workspace_lease& rhs) = delete;
+
+    /*!
+     * \brief Give the memory back to the workspace
+     */
+    ~workspace_lease() {
+        if (owner) {
+            owner->busy = false;
+        }
+    }
+
+    /*!
+     * \brief Returns a pointer to the memory
+     */
+    T* data() {
+        return memory;
+    }
+
+private:
+    workspace* owner = nullptr; ///< The borrowed workspace
+    std::vector<T> local;       ///< The memory when no workspace is borrowed
+    T* memory = nullptr;        ///< The memory
+};
+
+} //end of dll namespace
@@ -238,6 +238,18 @@ struct dyn_group_layer_impl<dyn_group_layer_desc<Layers...>> final : layer<dyn_g
         });
     }
 
+    /*!
+     * \brief Swap the weights of the layers with their secondary weights
+     * matrices, restoring the backup in constant time
+     */
+    void swap_weights() {
+        cpp::for_each(layers, [](auto& layer){
+            if constexpr (decay_layer_traits<decltype(layer)>::is_trained()) {
+                layer.swap_weights();
+            }
+        });
+    }
+
     /*!
      * \brief Return the Lth layer
      * \tparam L The layer index
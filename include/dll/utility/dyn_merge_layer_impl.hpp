@@ -9,7 +9,8 @@
 
 #include "dll/neural_layer.hpp"
 
-#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/branches.hpp" // for for_each_branch and merge_branch
+#include "dll/util/timers.hpp"   // for auto_timer
 
 namespace dll {
 
@@ -39,6 +40,8 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
 
     std::tuple<Layers...> layers; ///< The layers to merge
 
+    size_t parallel_threshold = serial_branches; ///< The number of outputs of the batch from which a branch runs on the thread pool
+
     /*!
      * \brief Return the type of the Lth layer
      * \tparam L The layer index
@@ -127,6 +130,15 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
         return output;
     }
 
+    /*!
+     * \brief Returns the cost of the Ith branch for the given batch, its
+     * number of outputs
+     */
+    template <size_t I, typename V>
+    size_t branch_cost(const V& input) const {
+        return etl::dim<0>(input) * std::get<I>(layers).output_size();
+    }
+
     using base_type::forward_batch;
     using base_type::train_forward_batch;
     using base_type::test_forward_batch;
@@ -139,10 +151,14 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
      */
     template <typename H1, typename V>
     void test_forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.test_forward_batch(input);
+        input.ensure_cpu_up_to_date();
 
-            etl::batch_merge(output, sub_output, i);
+        auto cost = [this, &input](auto i) { return branch_cost<i>(input); };
+
+        for_each_branch<n_layers>(parallel_threshold, cost, [this, &input, &output](auto i) {
+            auto sub_output = std::get<i>(layers).test_forward_batch(input);
+
+            merge_branch(output, sub_output, i);
         });
     }
 
@@ -154,10 +170,14 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
      */
     template <typename H1, typename V>
     void train_forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.train_forward_batch(input);
+        input.ensure_cpu_up_to_date();
+
+        auto cost = [this, &input](auto i) { return branch_cost<i>(input); };
+
+        for_each_branch<n_layers>(parallel_threshold, cost, [this, &input, &output](auto i) {
+            auto sub_output = std::get<i>(layers).train_forward_batch(input);
 
-            etl::batch_merge(output, sub_output, i);
+            merge_branch(output, sub_output, i);
         });
     }
 
@@ -169,10 +189,14 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.forward_batch(input);
+        input.ensure_cpu_up_to_date();
 
-            etl::batch_merge(output, sub_output, i);
+        auto cost = [this, &input](auto i) { return branch_cost<i>(input); };
+
+        for_each_branch<n_layers>(parallel_threshold, cost, [this, &input, &output](auto i) {
+            auto sub_output = std::get<i>(layers).forward_batch(input);
+
+            merge_branch(output, sub_output, i);
         });
     }
 
@@ -250,6 +274,16 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
         });
     }
 
+    /*!
+     * \brief Swap the weights of the layers with their secondary weights
+     * matrices, restoring the backup in constant time
+     */
+    void swap_weights() {
+        cpp::for_each(layers, [](auto& layer) {
+            layer.swap_weights();
+        });
+    }
+
     /*!
      * \brief Return the Lth layer
      * \tparam L The layer index
@@ -225,6 +225,18 @@ struct group_layer_impl<group_layer_desc<Layers...>> final : layer<group_layer_i
         });
     }
 
+    /*!
+     * \brief Swap the weights of the layers with their secondary weights
+     * matrices, restoring the backup in constant time
+     */
+    void swap_weights() {
+        cpp::for_each(layers, [](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_trained()) {
+                layer.swap_weights();
+            }
+        });
+    }
+
     /*!
      * \brief Return the Lth layer
      * \tparam L The layer index
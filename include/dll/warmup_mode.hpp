@@ -0,0 +1,40 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <string>
+
+namespace dll {
+
+/*!
+ * \brief The usage a network is warmed up for
+ */
+enum class warmup_mode {
+    INFERENCE, ///< Allocate the buffers of the inference
+    TRAINING   ///< Allocate the buffers of the inference and of the training
+};
+
+/*!
+ * \brief Returns a string representation of a warmup mode
+ * \param mode The warmup mode to transform to string
+ * \return a string representation of a warmup mode
+ */
+inline std::string to_string(warmup_mode mode) {
+    switch (mode) {
+        case warmup_mode::INFERENCE:
+            return "Inference";
+        case warmup_mode::TRAINING:
+            return "Training";
+    }
+
+    cpp_unreachable("Unreachable code");
+
+    return "UNDEFINED";
+}
+
+} //end of dll namespace
@@ -15,6 +15,12 @@
 #include "cpp_utils/stop_watch.hpp"
 
 #include "trainer/rbm_training_context.hpp"
+#include "generators/generator_stats.hpp"
+#include "util/memory.hpp"
+#include "util/pipeline.hpp"
+#include "util/metrics_stream.hpp"
+#include "util/checks.hpp"
+#include "util/throughput.hpp"
 #include "layer_traits.hpp"
 #include "dbn_traits.hpp"
 
@@ -28,6 +34,8 @@ template <typename R>
 struct default_rbm_watcher {
     cpp::stop_watch<std::chrono::seconds> watch; ///< Timer for the entire training
 
+    size_t timer_hotspots = 0; ///< The number of most expensive timers displayed for each epoch (0 to disable)
+
     /*!
      * \brief Indicates that the training of the given RBM started.
      * \param rbm The rbm that started training.
@@ -99,6 +107,10 @@ struct default_rbm_watcher {
 
         std::cout << formatted << std::endl;
 
+        if (timer_hotspots) {
+            context.timers.display_hotspots(timer_hotspots);
+        }
+
         cpp_unused(rbm);
     }
 
@@ -144,6 +156,20 @@ struct default_dbn_watcher {
     dll::stop_timer ft_batch_timer;              ///< Timer for a batch
     cpp::stop_watch<std::chrono::seconds> watch; ///< Timer for the entire training
 
+    generator_stats ft_pipeline_stats; ///< The pipeline statistics of the training generator for the epoch
+    bool ft_has_pipeline_stats = false; ///< Indicates if pipeline statistics are available for the epoch
+
+    pipeline_stats ft_stages;   ///< The statistics of the stages of the training for the epoch
+    bool ft_has_stages = false; ///< Indicates if the statistics of the stages are available for the epoch
+
+    size_t ft_val_batches       = 0; ///< The number of validation batches evaluated for the epoch
+    size_t ft_val_total_batches = 0; ///< The total number of validation batches
+
+    throughput_meter ft_throughput; ///< The training throughput
+
+    size_t ft_timer_hotspots = 0; ///< The number of most expensive timers displayed for each epoch (0 to disable)
+    timers_delta ft_timers;       ///< The timers used during the epoch
+
     /*!
      * \brief Indicates that the pretraining has begun for the given
      * DBN
@@ -261,6 +287,7 @@ struct default_dbn_watcher {
         cpp_unused(epoch);
         cpp_unused(dbn);
         ft_epoch_timer.start();
+        ft_throughput.start_epoch();
 
         last_line_length = 0;
     }
@@ -293,6 +320,10 @@ struct default_dbn_watcher {
             std::cout << "\r" << buffer;
         }
 
+        display_throughput();
+        display_pipeline_stats();
+        display_timers();
+
         std::cout.flush();
     }
 
@@ -308,14 +339,20 @@ struct default_dbn_watcher {
 
         auto duration = ft_epoch_timer.stop();
 
+        char sampled[64] = "";
+
+        if (ft_val_batches < ft_val_total_batches) {
+            snprintf(sampled, 64, " (val. on %ld/%ld batches)", ft_val_batches, ft_val_total_batches);
+        }
+
         char buffer[512];
 
         if constexpr (dbn_traits<DBN>::error_on_epoch()){
-            snprintf(buffer, 512, "epoch %3ld/%ld - error: %.5f loss: %.5f val_error: %.5f val_loss: %.5f time %ldms \n",
-                epoch, ft_max_epochs, train_error, train_loss, val_error, val_loss, duration);
+            snprintf(buffer, 512, "epoch %3ld/%ld - error: %.5f loss: %.5f val_error: %.5f val_loss: %.5f%s time %ldms \n",
+                epoch, ft_max_epochs, train_error, train_loss, val_error, val_loss, sampled, duration);
         } else {
-            snprintf(buffer, 512, "epoch %3ld/%ld - loss: %.5f val_loss: %.5f time %ldms \n",
-                epoch, ft_max_epochs, train_loss, val_loss, duration);
+            snprintf(buffer, 512, "epoch %3ld/%ld - loss: %.5f val_loss: %.5f%s time %ldms \n",
+                epoch, ft_max_epochs, train_loss, val_loss, sampled, duration);
         }
 
         if constexpr (dbn_traits<DBN>::is_verbose()){
@@ -324,9 +361,107 @@ struct default_dbn_watcher {
             std::cout << "\r" << buffer;
         }
 
+        display_throughput();
+        display_pipeline_stats();
+        display_timers();
+
         std::cout.flush();
     }
 
+    /*!
+     * \brief Indicates how many validation batches are evaluated for the
+     * current epoch. This is displayed with the end of the epoch.
+     * \param batches The number of evaluated batches
+     * \param total The total number of validation batches
+     */
+    void ft_validation_batches(size_t batches, size_t total) {
+        ft_val_batches       = batches;
+        ft_val_total_batches = total;
+    }
+
+    /*!
+     * \brief Receive the pipeline statistics of the training generator,
+     * at the end of the training part of an epoch. They are displayed with
+     * the end of the epoch.
+     * \param stats The statistics of the generator
+     */
+    void ft_generator_stats(const generator_stats& stats) {
+        ft_pipeline_stats     = stats;
+        ft_has_pipeline_stats = true;
+    }
+
+    /*!
+     * \brief Receive the statistics of the stages of the staged training,
+     * at the end of the training part of an epoch. They are displayed with
+     * the end of the epoch.
+     * \param stats The statistics of the stages
+     */
+    void ft_stage_stats(const pipeline_stats& stats) {
+        ft_stages     = stats;
+        ft_has_stages = true;
+    }
+
+    /*!
+     * \brief Receive the deltas of the timers of an epoch, just before its
+     * end. The most expensive ones are displayed with the end of the epoch
+     * when ft_timer_hotspots is set.
+     * \param epoch The current epoch
+     * \param timers The deltas of the timers of the epoch
+     */
+    void ft_epoch_timers(size_t epoch, const timers_delta& timers) {
+        cpp_unused(epoch);
+
+        if (ft_timer_hotspots) {
+            ft_timers = timers;
+        }
+    }
+
+    /*!
+     * \brief Receive the memory held by the network, the trainer and the
+     * generators, after the first epoch, and display it
+     * \param report The memory report
+     */
+    void ft_memory(const memory_report& report) {
+        std::cout << "Memory after the first epoch:" << std::endl;
+        report.display(std::cout) << std::endl;
+    }
+
+    /*!
+     * \brief Display the throughput of the epoch
+     */
+    void display_throughput() {
+        if (ft_throughput.epoch.batches) {
+            ft_throughput.epoch.display(std::cout) << std::endl;
+        }
+    }
+
+    /*!
+     * \brief Display the most expensive timers of the epoch, if enabled
+     */
+    void display_timers() {
+        if (ft_timer_hotspots) {
+            ft_timers.display_hotspots(ft_timer_hotspots);
+            ft_timers = {};
+        }
+    }
+
+    /*!
+     * \brief Display the pending pipeline statistics, if any
+     */
+    void display_pipeline_stats() {
+        if (ft_has_pipeline_stats) {
+            ft_pipeline_stats.display(std::cout) << std::endl;
+
+            ft_has_pipeline_stats = false;
+        }
+
+        if (ft_has_stages) {
+            ft_stages.display(std::cout) << std::endl;
+
+            ft_has_stages = false;
+        }
+    }
+
     /*!
      * \brief Indicates the beginning of a fine-tuning batch
      * \param epoch The current epoch
@@ -336,6 +471,34 @@ struct default_dbn_watcher {
         cpp_unused(epoch);
         cpp_unused(dbn);
         ft_batch_timer.start();
+        ft_throughput.start_batch();
+    }
+
+    /*!
+     * \brief Indicates that a checkpoint of the weights has been taken
+     * (it may still be written in the background)
+     * \param epoch The current epoch
+     * \param batch The current batch
+     * \param file The checkpoint file
+     */
+    void ft_checkpoint(size_t epoch, size_t batch, const std::string& file) {
+        if constexpr (dbn_traits<DBN>::is_verbose()) {
+            std::cout << "epoch " << epoch << " batch " << (batch + 1) << " - checkpoint: " << file << std::endl;
+        } else {
+            cpp_unused(epoch);
+            cpp_unused(batch);
+            cpp_unused(file);
+        }
+    }
+
+    /*!
+     * \brief Indicates that a non-finite value was found during the
+     * training, which is stopped
+     * \param epoch The current epoch
+     * \param fault The first non-finite value
+     */
+    void ft_non_finite(size_t epoch, const numerical_fault& fault) {
+        std::cout << "epoch " << epoch << " - non-finite " << to_string(fault.stage) << " of layer " << fault.layer << " at iteration " << fault.iteration << std::endl;
     }
 
     size_t max_batches;
@@ -352,19 +515,22 @@ struct default_dbn_watcher {
     void ft_batch_end(size_t epoch, size_t batch, size_t batches, double batch_error, double batch_loss, const DBN& dbn) {
         auto duration = ft_batch_timer.stop();
 
+        ft_throughput.end_batch(DBN::batch_size);
+
         char buffer[512];
 
         if constexpr (dbn_traits<DBN>::is_verbose()){
-            snprintf(buffer, 512, "epoch %3ld/%ld batch %4ld/%4ld- B. Error: %.5f B. Loss: %.5f Time %ldms",
-                epoch, ft_max_epochs, batch + 1, batches, batch_error, batch_loss, duration);
+            snprintf(buffer, 512, "epoch %3ld/%ld batch %4ld/%4ld- B. Error: %.5f B. Loss: %.5f Time %ldms %.1f samples/s",
+                epoch, ft_max_epochs, batch + 1, batches, batch_error, batch_loss, duration, ft_throughput.samples_rate.value);
             std::cout << buffer << std::endl;
         } else {
             total_batch_duration += duration;
             ++total_batches;
 
-            auto estimated_duration = ((total_batch_duration / total_batches) * (batches - batch)) / 1000;
-            snprintf(buffer, 512, "epoch %3ld/%ld batch %4ld/%4ld - error: %.5f loss: %.5f ETA %lds",
-                epoch, ft_max_epochs, batch + 1, batches, batch_error, batch_loss, estimated_duration);
+            // The ETA follows the rolling duration of the batches, generator included
+            auto estimated_duration = size_t(ft_throughput.eta(batches - batch - 1));
+            snprintf(buffer, 512, "epoch %3ld/%ld batch %4ld/%4ld - error: %.5f loss: %.5f %.1f samples/s ETA %lds",
+                epoch, ft_max_epochs, batch + 1, batches, batch_error, batch_loss, ft_throughput.samples_rate.value, estimated_duration);
 
             if (batch == 0) {
                 std::cout << buffer;
@@ -530,4 +696,318 @@ struct mute_dbn_watcher {
     void fine_tuning_end(const DBN& /*dbn*/) {}
 };
 
+/*!
+ * \brief Returns the metrics stream of the JSON watchers, opened on
+ * dll_metrics.jsonl if it was not opened before
+ */
+inline metrics_stream& json_watcher_stream() {
+    auto& stream = get_metrics_stream();
+
+    if (!stream.is_open()) {
+        stream.open_file("dll_metrics.jsonl");
+    }
+
+    return stream;
+}
+
+/*!
+ * \brief A watcher for RBM pretraining emitting its metrics as JSON lines
+ * on the metrics stream (see get_metrics_stream()).
+ *
+ * The records are only captured by the training thread, their formatting
+ * and their writing are done in the background.
+ *
+ * \tparam R The RBM type
+ */
+template <typename R>
+struct json_rbm_watcher {
+    dll::stop_timer epoch_timer; ///< Timer for an epoch
+
+    json_rbm_watcher() {
+        json_watcher_stream();
+    }
+
+    /*!
+     * \brief Indicates that the training of the given RBM started.
+     * \param rbm The rbm that started training.
+     */
+    template <typename RBM = R>
+    void training_begin(const RBM& rbm) {
+        cpp_unused(rbm);
+        epoch_timer.start();
+    }
+
+    /*!
+     * \brief Indicates the end of an epoch of pretraining.
+     * \param epoch The epoch that just finished training
+     * \param context The RBM's training context
+     * \param rbm The RBM being trained
+     */
+    template <typename RBM = R>
+    void epoch_end(size_t epoch, const rbm_training_context& context, const RBM& rbm) {
+        metrics_record record;
+
+        record.kind     = metrics_kind::RBM_EPOCH;
+        record.epoch    = epoch;
+        record.error    = context.reconstruction_error;
+        record.loss     = context.free_energy;
+        record.sparsity = context.sparsity;
+        record.duration = epoch_timer.stop();
+        record.timers   = metrics_timers();
+
+        get_metrics_stream().push(std::move(record));
+
+        epoch_timer.start();
+
+        cpp_unused(rbm);
+    }
+
+    /*!
+     * \brief Indicates the end of a batch of pretraining.
+     * \param batch The batch that just finished training
+     * \param batches The total number of batches
+     * \param context The RBM's training context
+     * \param rbm The RBM being trained
+     */
+    template <typename RBM = R>
+    void batch_end(const RBM& rbm, const rbm_training_context& context, size_t batch, size_t batches) {
+        metrics_record record;
+
+        record.kind     = metrics_kind::RBM_BATCH;
+        record.batch    = batch;
+        record.batches  = batches;
+        record.error    = context.batch_error;
+        record.sparsity = context.batch_sparsity;
+        record.samples  = RBM::batch_size;
+
+        get_metrics_stream().push(std::move(record));
+
+        cpp_unused(rbm);
+    }
+
+    /*!
+     * \brief Indicates the end of pretraining.
+     * \param rbm The RBM being trained
+     */
+    template <typename RBM = R>
+    void training_end(const RBM& rbm) {
+        cpp_unused(rbm);
+    }
+};
+
+/*!
+ * \brief A watcher for DBN training emitting its metrics as JSON lines on
+ * the metrics stream (see get_metrics_stream()), instead of formatted
+ * text: one record per batch and per epoch (errors and losses, validation
+ * metrics, samples per second, generator statistics and the increments of
+ * the timers), and the pretraining records of the RBM layers.
+ *
+ * The records are only captured by the training thread, their formatting
+ * and their writing are done in the background.
+ */
+template <typename DBN>
+struct json_dbn_watcher : json_rbm_watcher<DBN> {
+    static constexpr bool ignore_sub  = false; ///< For pretraining of a DBN, indicates if the regular RBM watcher should be used (false) or ignored (true)
+    static constexpr bool replace_sub = true;  ///< For pretraining of a DBN, indicates if the DBN watcher should replace (true) the RBM watcher or not (false)
+
+    size_t ft_max_epochs = 0;       ///< The maximum number of epochs
+    dll::stop_timer ft_epoch_timer; ///< Timer for an epoch
+    dll::stop_timer ft_batch_timer; ///< Timer for a batch
+
+    size_t ft_batches = 0; ///< The number of batches of the current epoch
+    size_t ft_samples = 0; ///< The number of samples of the current epoch
+
+    generator_stats ft_pipeline_stats;  ///< The pipeline statistics of the training generator for the epoch
+    bool ft_has_pipeline_stats = false; ///< Indicates if pipeline statistics are available for the epoch
+
+    size_t ft_val_batches       = 0; ///< The number of validation batches evaluated for the epoch
+    size_t ft_val_total_batches = 0; ///< The total number of validation batches
+
+    void pretraining_begin(const DBN& /*dbn*/, size_t /*max_epochs*/) {}
+
+    template <typename RBM>
+    void pretrain_layer(const DBN& /*dbn*/, size_t /*I*/, const RBM& /*rbm*/, size_t /*input_size*/) {}
+
+    void pretraining_end(const DBN& /*dbn*/) {}
+
+    void pretraining_batch(const DBN& /*dbn*/, size_t /*batch*/) {}
+
+    /*!
+     * \brief Fine-tuning of the given network just started
+     * \param dbn The DBN that is being trained
+     * \param max_epochs The maximum number of epochs to train the network
+     */
+    void fine_tuning_begin(const DBN& dbn, size_t max_epochs) {
+        ft_max_epochs = max_epochs;
+
+        metrics_record record;
+
+        record.kind       = metrics_kind::TRAINING_BEGIN;
+        record.max_epochs = max_epochs;
+        record.timers     = metrics_timers();
+
+        get_metrics_stream().push(std::move(record));
+
+        cpp_unused(dbn);
+    }
+
+    /*!
+     * \brief One fine-tuning epoch is starting
+     * \param epoch The current epoch
+     * \param dbn The network being trained
+     */
+    void ft_epoch_start(size_t epoch, const DBN& dbn) {
+        cpp_unused(epoch);
+        cpp_unused(dbn);
+
+        ft_epoch_timer.start();
+
+        ft_batches = 0;
+        ft_samples = 0;
+    }
+
+    /*!
+     * \brief One fine-tuning epoch is over
+     * \param epoch The current epoch
+     * \param error The current error
+     * \param loss The current loss
+     * \param dbn The network being trained
+     */
+    void ft_epoch_end(size_t epoch, double error, double loss, const DBN& dbn) {
+        get_metrics_stream().push(epoch_record(epoch, error, loss));
+
+        cpp_unused(dbn);
+    }
+
+    /*!
+     * \brief One fine-tuning epoch is over
+     * \param epoch The current epoch
+     * \param train_error The current error
+     * \param train_loss The current loss
+     * \param val_error The current validation error
+     * \param val_loss The current validation loss
+     * \param dbn The network being trained
+     */
+    void ft_epoch_end(size_t epoch, double train_error, double train_loss, double val_error, double val_loss, const DBN& dbn) {
+        auto record = epoch_record(epoch, train_error, train_loss);
+
+        record.validation        = true;
+        record.val_error         = val_error;
+        record.val_loss          = val_loss;
+        record.val_batches       = ft_val_batches;
+        record.val_total_batches = ft_val_total_batches;
+
+        get_metrics_stream().push(std::move(record));
+
+        cpp_unused(dbn);
+    }
+
+    /*!
+     * \brief Indicates how many validation batches are evaluated for the
+     * current epoch
+     * \param batches The number of evaluated batches
+     * \param total The total number of validation batches
+     */
+    void ft_validation_batches(size_t batches, size_t total) {
+        ft_val_batches       = batches;
+        ft_val_total_batches = total;
+    }
+
+    /*!
+     * \brief Receive the pipeline statistics of the training generator,
+     * at the end of the training part of an epoch
+     * \param stats The statistics of the generator
+     */
+    void ft_generator_stats(const generator_stats& stats) {
+        ft_pipeline_stats     = stats;
+        ft_has_pipeline_stats = true;
+    }
+
+    /*!
+     * \brief Indicates the beginning of a fine-tuning batch
+     * \param epoch The current epoch
+     * \param dbn The DBN being trained
+     */
+    void ft_batch_start(size_t epoch, const DBN& dbn) {
+        cpp_unused(epoch);
+        cpp_unused(dbn);
+
+        ft_batch_timer.start();
+    }
+
+    /*!
+     * \brief Indicates the end of a fine-tuning batch
+     * \param epoch The current epoch
+     * \param batch The current batch
+     * \param batches THe total number of batches
+     * \param batch_error The batch error
+     * \param batch_loss The batch loss
+     * \param dbn The DBN being trained
+     */
+    void ft_batch_end(size_t epoch, size_t batch, size_t batches, double batch_error, double batch_loss, const DBN& dbn) {
+        metrics_record record;
+
+        record.kind     = metrics_kind::BATCH;
+        record.epoch    = epoch;
+        record.batch    = batch;
+        record.batches  = batches;
+        record.error    = batch_error;
+        record.loss     = batch_loss;
+        record.samples  = DBN::batch_size;
+        record.duration = ft_batch_timer.stop();
+
+        get_metrics_stream().push(std::move(record));
+
+        ft_batches = batches;
+        ft_samples += DBN::batch_size;
+
+        cpp_unused(dbn);
+    }
+
+    void lr_adapt(const DBN& /*dbn*/) {}
+
+    /*!
+     * \brief Fine-tuning of the given network just finished
+     * \param dbn The DBN that is being trained
+     */
+    void fine_tuning_end(const DBN& dbn) {
+        metrics_record record;
+
+        record.kind       = metrics_kind::TRAINING_END;
+        record.max_epochs = ft_max_epochs;
+        record.timers     = metrics_timers();
+
+        get_metrics_stream().push(std::move(record));
+
+        cpp_unused(dbn);
+    }
+
+private:
+    /*!
+     * \brief Capture the record of the end of an epoch
+     */
+    metrics_record epoch_record(size_t epoch, double error, double loss) {
+        metrics_record record;
+
+        record.kind       = metrics_kind::EPOCH;
+        record.epoch      = epoch;
+        record.max_epochs = ft_max_epochs;
+        record.batches    = ft_batches;
+        record.samples    = ft_samples;
+        record.error      = error;
+        record.loss       = loss;
+        record.duration   = ft_epoch_timer.stop();
+        record.timers     = metrics_timers();
+
+        if (ft_has_pipeline_stats) {
+            record.has_stats = true;
+            record.stats     = ft_pipeline_stats;
+
+            ft_has_pipeline_stats = false;
+        }
+
+        return record;
+    }
+};
+
 } //end of dll namespace
@@ -0,0 +1,63 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "dll/processor/processor.hpp"
+
+#include "layer.hpp"
+
+namespace dllp {
+
+/*!
+ * \brief A swept parameter of the configuration
+ */
+struct sweep_parameter {
+    std::string name;                ///< The name of the parameter (section.key)
+    std::string key;                 ///< The key of the parameter in its section
+    size_t line;                     ///< The index of the line of the parameter
+    std::vector<std::string> values; ///< The values of the parameter
+};
+
+/*!
+ * \brief The description of a sweep
+ */
+struct sweep_desc {
+    std::vector<std::string> lines;          ///< The lines of the configuration, without the sweep block
+    std::vector<sweep_parameter> parameters; ///< The swept parameters
+    size_t threads = 1;                      ///< The number of threads of each run
+    size_t jobs    = 0;                      ///< The number of parallel compilations (0 for automatic)
+};
+
+/*!
+ * \brief One point of the sweep
+ */
+struct sweep_variant {
+    std::vector<std::string> lines;  ///< The lines of the configuration of the point
+    std::vector<std::string> values; ///< The value of each swept parameter
+};
+
+bool expand_values(const std::string& value, std::vector<std::string>& values);
+bool parse_sweep(const std::vector<std::string>& lines, sweep_desc& desc);
+std::vector<sweep_variant> sweep_variants(const sweep_desc& desc);
+
+int process_sweep(const dll::processor::options& opt, const std::vector<std::string>& actions, const std::string& source_file);
+
+// Shared with the processor
+
+bool read_conf(const std::string& source_file, std::vector<std::string>& lines);
+bool parse_lines(const std::vector<std::string>& lines, dll::processor::task& t, std::vector<std::unique_ptr<dllp::layer>>& layers);
+void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions, const std::string& file);
+bool build_program(const dll::processor::options& opt, const std::string& source, const std::string& output);
+bool make_directories(const std::string& dir);
+std::string read_file(const std::string& file);
+
+} //end of namespace dllp
@@ -22,7 +22,9 @@
 namespace {
 
 void print_usage() {
-    std::cout << "Usage: dllp conf_file action" << std::endl;
+    std::cout << "Usage: dllp [--mkl] [--cublas] [--cufft] [--cache] [--pch] conf_file action..." << std::endl;
+    std::cout << "       dllp [options] conf_file sweep [action...]" << std::endl;
+    std::cout << "       dllp [options] conf_file export-inference [action...]" << std::endl;
 }
 
 void parse_options(int argc, char* argv[], dll::processor::options& opt, std::vector<std::string>& actions, std::string& source_file) {
@@ -41,6 +43,9 @@ void parse_options(int argc, char* argv[], dll::processor::options& opt, std::ve
         } else if (std::string(argv[i]) == "--cache") {
             opt.cache = true;
             ++i;
+        } else if (std::string(argv[i]) == "--pch") {
+            opt.pch = true;
+            ++i;
         } else {
             break;
         }
@@ -11,16 +11,28 @@
 #include <fstream>
 #include <memory>
 #include <cstdlib>
-
+#include <cstdio>
+#include <cstdint>
+#include <climits>
+#include <cmath>
+#include <cerrno>
+#include <sstream>
+#include <iomanip>
+
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "cpp_utils/string.hpp"
 
 #include "parse_utils.hpp"
 #include "layer.hpp"
+#include "sweep.hpp"
 
 #include "dll/processor/processor.hpp"
+#include "dll/version.hpp"
 
 namespace dllp {
 
@@ -115,8 +127,8 @@ void parse_datasource_pack(dll::processor::datasource_pack& pack, const std::vec
     pack.labels.limit  = limit;
 }
 
-void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions);
-bool compile(const options& opt);
+bool compile_flags(const options& opt, std::string& cflags, std::string& ldflags, bool inference = false);
+bool compile(const options& opt, const std::string& cflags, const std::string& ldflags, const std::string& pch_flags, const std::string& source, const std::string& output);
 
 void process_includes(std::vector<std::string>& lines){
     for (size_t i = 0; i < lines.size();) {
@@ -157,6 +169,64 @@ void process_data(size_t& i, const std::vector<std::string>& lines, dll::process
     }
 }
 
+bool valid_generator(const dll::processor::general_desc& desc) {
+    if (desc.generator != "none" && desc.generator != "inmemory" && desc.generator != "outmemory") {
+        std::cout << "dllp: error: invalid generator must be one of [inmemory, outmemory]" << std::endl;
+        return false;
+    }
+
+    if (desc.storage != "none" && desc.storage != "uint8" && desc.storage != "bfloat16") {
+        std::cout << "dllp: error: invalid storage must be one of [uint8, bfloat16]" << std::endl;
+        return false;
+    }
+
+    if (desc.workers == 0) {
+        std::cout << "dllp: error: the generator needs at least one worker" << std::endl;
+        return false;
+    }
+
+    if (desc.generator == "none" && (desc.threaded || desc.workers > 1 || desc.lock_free || desc.prefetch || desc.index_shuffle || desc.storage != "none")) {
+        std::cout << "dllp: error: the generator options need a generator: [inmemory, outmemory]" << std::endl;
+        return false;
+    }
+
+    if (desc.generator == "inmemory" && (desc.threaded || desc.prefetch)) {
+        std::cout << "dllp: error: threaded and prefetch are only supported by the outmemory generator" << std::endl;
+        return false;
+    }
+
+    if (desc.generator == "outmemory" && (desc.index_shuffle || desc.storage != "none")) {
+        std::cout << "dllp: error: index_shuffle and storage are only supported by the inmemory generator" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool valid_distributed(const dll::processor::distributed_desc& desc) {
+    if (desc.transport != "tcp" && desc.transport != "mpi") {
+        std::cout << "dllp: error: invalid transport must be one of [tcp, mpi]" << std::endl;
+        return false;
+    }
+
+    if (desc.workers == 0 || desc.ranks == 0) {
+        std::cout << "dllp: error: the distributed training needs at least one worker and one rank" << std::endl;
+        return false;
+    }
+
+    if (desc.workers > 1 && desc.enabled()) {
+        std::cout << "dllp: error: the batches cannot be split between workers when they are split between ranks" << std::endl;
+        return false;
+    }
+
+    if (desc.port == 0 || desc.port > 65535) {
+        std::cout << "dllp: error: invalid port: " << desc.port << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
 bool process_options(size_t& i, const std::vector<std::string>& lines, dll::processor::task& t) {
     ++i;
 
@@ -185,10 +255,35 @@ bool process_options(size_t& i, const std::vector<std::string>& lines, dll::proc
                 } else if (dllp::starts_with(lines[i], "big_batch: ")) {
                     t.general_desc.big_batch = std::stol(dllp::extract_value(lines[i], "big_batch: "));
                     ++i;
+                } else if (dllp::starts_with(lines[i], "generator: ")) {
+                    t.general_desc.generator = dllp::extract_value(lines[i], "generator: ");
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "threaded: ")) {
+                    t.general_desc.threaded = dllp::extract_value(lines[i], "threaded: ") == "true";
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "workers: ")) {
+                    t.general_desc.workers = std::stol(dllp::extract_value(lines[i], "workers: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "lock_free: ")) {
+                    t.general_desc.lock_free = dllp::extract_value(lines[i], "lock_free: ") == "true";
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "prefetch: ")) {
+                    t.general_desc.prefetch = dllp::extract_value(lines[i], "prefetch: ") == "true";
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "index_shuffle: ")) {
+                    t.general_desc.index_shuffle = dllp::extract_value(lines[i], "index_shuffle: ") == "true";
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "storage: ")) {
+                    t.general_desc.storage = dllp::extract_value(lines[i], "storage: ");
+                    ++i;
                 } else {
                     break;
                 }
             }
+
+            if (!valid_generator(t.general_desc)) {
+                return false;
+            }
         } else if (lines[i] == "training:") {
             ++i;
 
@@ -225,6 +320,106 @@ bool process_options(size_t& i, const std::vector<std::string>& lines, dll::proc
                         return false;
                     }
 
+                    ++i;
+                } else {
+                    break;
+                }
+            }
+        } else if (lines[i] == "profile:") {
+            ++i;
+
+            while (i < lines.size()) {
+                if (dllp::starts_with(lines[i], "batches: ")) {
+                    t.p_desc.batches = std::stol(dllp::extract_value(lines[i], "batches: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "warmup: ")) {
+                    t.p_desc.warmup = std::stol(dllp::extract_value(lines[i], "warmup: "));
+                    ++i;
+                } else {
+                    break;
+                }
+            }
+        } else if (lines[i] == "tune:") {
+            ++i;
+
+            while (i < lines.size()) {
+                if (dllp::starts_with(lines[i], "batches: ")) {
+                    std::istringstream values(dllp::extract_value(lines[i], "batches: "));
+                    std::string value;
+
+                    t.t_desc.batches.clear();
+
+                    while (std::getline(values, value, ',')) {
+                        t.t_desc.batches.push_back(std::stol(value));
+                    }
+
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "budget: ")) {
+                    t.t_desc.budget = std::stol(dllp::extract_value(lines[i], "budget: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "warmup: ")) {
+                    t.t_desc.warmup = std::stol(dllp::extract_value(lines[i], "warmup: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "steps: ")) {
+                    t.t_desc.steps = std::stol(dllp::extract_value(lines[i], "steps: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "effective: ")) {
+                    t.t_desc.effective = std::stol(dllp::extract_value(lines[i], "effective: "));
+                    ++i;
+                } else {
+                    break;
+                }
+            }
+
+            if (t.t_desc.batches.empty()) {
+                std::cout << "dllp: error: tune needs at least one candidate batch size" << std::endl;
+                return false;
+            }
+        } else if (lines[i] == "distributed:") {
+            ++i;
+
+            while (i < lines.size()) {
+                if (dllp::starts_with(lines[i], "workers: ")) {
+                    t.d_desc.workers = std::stol(dllp::extract_value(lines[i], "workers: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "ranks: ")) {
+                    t.d_desc.ranks = std::stol(dllp::extract_value(lines[i], "ranks: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "transport: ")) {
+                    t.d_desc.transport = dllp::extract_value(lines[i], "transport: ");
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "host: ")) {
+                    t.d_desc.host = dllp::extract_value(lines[i], "host: ");
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "port: ")) {
+                    t.d_desc.port = std::stol(dllp::extract_value(lines[i], "port: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "bucket: ")) {
+                    t.d_desc.bucket = std::stol(dllp::extract_value(lines[i], "bucket: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "shard: ")) {
+                    t.d_desc.shard = dllp::extract_value(lines[i], "shard: ") == "true";
+                    ++i;
+                } else {
+                    break;
+                }
+            }
+
+            if (!valid_distributed(t.d_desc)) {
+                return false;
+            }
+        } else if (lines[i] == "placement:") {
+            ++i;
+
+            while (i < lines.size()) {
+                if (dllp::starts_with(lines[i], "pin: ")) {
+                    t.pl_desc.pin = dllp::extract_value(lines[i], "pin: ") == "true";
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "producers: ")) {
+                    t.pl_desc.producers = std::stol(dllp::extract_value(lines[i], "producers: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "smt: ")) {
+                    t.pl_desc.smt = dllp::extract_value(lines[i], "smt: ") == "true";
                     ++i;
                 } else {
                     break;
@@ -341,10 +536,10 @@ bool process_layers(size_t& i, const std::vector<std::string>& lines, std::vecto
     return true;
 }
 
-bool parse_file(const std::string& source_file, dll::processor::task& t, std::vector<std::unique_ptr<dllp::layer>>& layers) {
+bool read_conf(const std::string& source_file, std::vector<std::string>& lines) {
     //0. Parse the source file
 
-    auto lines = read_lines(source_file);
+    lines = read_lines(source_file);
 
     if (lines.empty()) {
         std::cout << "dllp: warning: included file is empty or does not exist" << std::endl;
@@ -355,6 +550,16 @@ bool parse_file(const std::string& source_file, dll::processor::task& t, std::ve
 
     process_includes(lines);
 
+    return true;
+}
+
+bool parse_file(const std::string& source_file, dll::processor::task& t, std::vector<std::unique_ptr<dllp::layer>>& layers) {
+    std::vector<std::string> lines;
+
+    return read_conf(source_file, lines) && parse_lines(lines, t, layers);
+}
+
+bool parse_lines(const std::vector<std::string>& lines, dll::processor::task& t, std::vector<std::unique_ptr<dllp::layer>>& layers) {
     //2. Process the lines
 
     for (size_t i = 0; i < lines.size();) {
@@ -388,44 +593,298 @@ bool parse_file(const std::string& source_file, dll::processor::task& t, std::ve
         return false;
     }
 
+    if (t.general_desc.storage != "none" && (t.training.samples.shift || t.training.samples.normal_noise)) {
+        std::cout << "dllp: error: shift and normal_noise are not supported with a compact storage" << std::endl;
+        return false;
+    }
+
     return true;
 }
 
-bool compile_exe(const dllp::options& opt, const std::vector<std::string>& actions, const std::string& source_file, const dll::processor::task& t, const std::vector<std::unique_ptr<dllp::layer>>& layers) {
-    bool process = true;
+/*!
+ * \brief Returns the folder of the cache of the compiled networks:
+ * $DLLP_CACHE_DIR, or $XDG_CACHE_HOME/dllp, or ~/.cache/dllp
+ */
+std::string cache_directory() {
+    if (const auto* dir = std::getenv("DLLP_CACHE_DIR")) {
+        return dir;
+    }
 
-    if (opt.cache) {
-        struct stat attr_conf;
-        struct stat attr_exec;
+    if (const auto* xdg = std::getenv("XDG_CACHE_HOME")) {
+        return std::string(xdg) + "/dllp";
+    }
 
-        if (!stat(source_file.c_str(), &attr_conf)) {
-            if (!stat("./.dbn.out", &attr_exec)) {
-                auto mtime_conf = attr_conf.st_mtime;
-                auto mtime_exec = attr_exec.st_mtime;
+    if (const auto* home = std::getenv("HOME")) {
+        return std::string(home) + "/.cache/dllp";
+    }
 
-                if (mtime_exec > mtime_conf) {
-                    if (!opt.quiet) {
-                        std::cout << "Skip compilation" << std::endl;
-                    }
-                    process = false;
-                }
+    return ".dllp-cache";
+}
+
+/*!
+ * \brief Create the given folder and its parents, if necessary
+ */
+bool make_directories(const std::string& dir) {
+    for (size_t i = 1; i <= dir.size(); ++i) {
+        if (i == dir.size() || dir[i] == '/') {
+            auto parent = dir.substr(0, i);
+
+            if (mkdir(parent.c_str(), 0755) && errno != EEXIST) {
+                return false;
             }
         }
     }
 
-    if (process) {
-        //Generate the CPP file
-        dllp::generate(layers, t, actions);
+    return true;
+}
+
+/*!
+ * \brief Hash the given data into the given FNV-1a hash
+ */
+void hash_combine(uint64_t& hash, const std::string& data) {
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    // Separate the fields
+    hash ^= 0xFF;
+    hash *= 1099511628211ULL;
+}
+
+/*!
+ * \brief Returns the content of the given file
+ */
+std::string read_file(const std::string& file) {
+    std::ifstream in(file, std::ios::binary);
+
+    std::ostringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+/*!
+ * \brief Returns the key of a compiled network in the cache: the hash of
+ * the generated source (or of the precompiled header), of the compiler (and its version), of the flags
+ * and of the versions of DLL and ETL.
+ *
+ * dllp is built against the same headers as the generated programs, its
+ * build time stands for the versions of the headers, so that a cache is
+ * not reused after an update of DLL or ETL.
+ */
+std::string cache_key(const std::string& source, const std::string& flags) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    const auto* cxx = std::getenv("CXX");
+
+    hash_combine(hash, source);
+    hash_combine(hash, cxx);
+    hash_combine(hash, command_result(std::string(cxx) + " --version"));
+    hash_combine(hash, flags);
+    hash_combine(hash, DLL_VERSION_STR);
+#ifdef ETL_VERSION_STR
+    hash_combine(hash, ETL_VERSION_STR);
+#endif
+    hash_combine(hash, __DATE__ " " __TIME__);
+
+    std::ostringstream key;
+    key << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return key.str();
+}
+
+/*!
+ * \brief Copy a file, through a temporary file renamed once complete
+ */
+bool copy_file(const std::string& from, const std::string& to) {
+    std::ifstream in(from, std::ios::binary);
+
+    if (!in) {
+        return false;
+    }
+
+    const auto tmp = to + ".tmp" + std::to_string(getpid());
 
-        //Compile the generate file
-        if (!dllp::compile(opt)) {
+    {
+        std::ofstream out(tmp, std::ios::binary);
+
+        if (!out || !(out << in.rdbuf())) {
+            std::remove(tmp.c_str());
             return false;
         }
     }
 
+    if (chmod(tmp.c_str(), 0755) || std::rename(tmp.c_str(), to.c_str())) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+
     return true;
 }
 
+/*!
+ * \brief Returns the headers included by the generated programs
+ */
+const std::vector<std::string>& generated_includes() {
+    static const std::vector<std::string> includes{
+        "memory",
+        "dll/processor/processor.hpp",
+        "dll/rbm/rbm.hpp",
+        "dll/rbm/conv_rbm.hpp",
+        "dll/rbm/conv_rbm_mp.hpp",
+        "dll/neural/dense_layer.hpp",
+        "dll/neural/conv_layer.hpp",
+        "dll/pooling/mp_layer.hpp",
+        "dll/pooling/avgp_layer.hpp",
+        "dll/neural/activation_layer.hpp",
+        "dll/dbn.hpp"};
+
+    return includes;
+}
+
+/*!
+ * \brief Prepare the precompiled header of the generated programs, built
+ * once per compiler and flags in the cache folder.
+ *
+ * The headers of DLL and ETL are the same for all the networks, only the
+ * instantiations differ, so most of the parsing is done once.
+ *
+ * \param opt The options of dllp
+ * \param cflags The compilation flags of the programs
+ * \param pch_flags Receives the flags to use the precompiled header
+ *
+ * \return false if the precompiled header cannot be built
+ */
+bool precompiled_header(const options& opt, const std::string& cflags, std::string& pch_flags) {
+    std::string header;
+
+    for (auto& include : generated_includes()) {
+        header += "#include " + std::string(include == "memory" ? "<memory>" : "\"" + include + "\"") + "\n";
+    }
+
+    const auto* cxx   = std::getenv("CXX");
+    const bool clang  = command_result(std::string(cxx) + " --version").find("clang") != std::string::npos;
+    const auto dir    = cache_directory() + "/pch-" + cache_key(header, cflags);
+    const auto file   = dir + "/dllp_pch.hpp";
+    const auto binary = file + (clang ? ".pch" : ".gch");
+
+    // With GCC, the precompiled header is found next to the included header
+    const auto flags = clang ? " -include-pch " + binary + " " : " -Winvalid-pch -include " + file + " ";
+
+    struct stat attr;
+
+    if (!stat(binary.c_str(), &attr)) {
+        pch_flags = flags;
+        return true;
+    }
+
+    if (!make_directories(dir)) {
+        std::cout << "dllp: warning: impossible to create the cache folder " << dir << std::endl;
+        return false;
+    }
+
+    {
+        std::ofstream out(file);
+        out << header;
+    }
+
+    if (!opt.quiet) {
+        std::cout << "Precompiling the headers..." << std::endl;
+    }
+
+    // Built under a temporary name, so that a concurrent dllp never uses a partial header
+    const auto tmp = binary + ".tmp" + std::to_string(getpid());
+
+    std::string command(cxx);
+
+    command += " -x c++-header " + file + " -o " + tmp + " " + cflags;
+
+    if (system(command.c_str()) || std::rename(tmp.c_str(), binary.c_str())) {
+        std::cout << "dllp: warning: precompilation of the headers failed" << std::endl;
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    pch_flags = flags;
+
+    return true;
+}
+
+bool build_program(const options& opt, const std::string& source, const std::string& output) {
+    std::string cflags;
+    std::string ldflags;
+
+    if (!dllp::compile_flags(opt, cflags, ldflags)) {
+        return false;
+    }
+
+    const auto flags = cflags + ldflags;
+
+    // The compiled networks are cached by the hash of everything that
+    // determines the binary
+    std::string cached;
+
+    if (opt.cache) {
+        const auto dir = cache_directory();
+
+        cached = dir + "/" + cache_key(read_file(source), flags) + ".out";
+
+        struct stat attr_exec;
+
+        if (!stat(cached.c_str(), &attr_exec) && copy_file(cached, output)) {
+            if (!opt.quiet) {
+                std::cout << "Skip compilation (cached in " << cached << ")" << std::endl;
+            }
+
+            return true;
+        }
+
+        if (!make_directories(dir)) {
+            std::cout << "dllp: warning: impossible to create the cache folder " << dir << std::endl;
+            cached.clear();
+        }
+    }
+
+    // The precompiled header is only an optimization, the program is
+    // compiled without it if it cannot be built
+    std::string pch_flags;
+
+    if (opt.pch) {
+        precompiled_header(opt, cflags, pch_flags);
+    }
+
+    //Compile the generate file
+    if (!dllp::compile(opt, cflags, ldflags, pch_flags, source, output)) {
+        return false;
+    }
+
+    if (!cached.empty() && !copy_file(output, cached)) {
+        std::cout << "dllp: warning: impossible to store the program in the cache " << cached << std::endl;
+    }
+
+    return true;
+}
+
+bool compile_exe(const dllp::options& opt, const std::vector<std::string>& actions, const std::string& source_file, const dll::processor::task& t, const std::vector<std::unique_ptr<dllp::layer>>& layers) {
+    auto task = t;
+
+    // The profile and the tuning are written next to the configuration
+    auto dot = source_file.find_last_of('.');
+    auto sep = source_file.find_last_of('/');
+
+    const auto base = dot != std::string::npos && (sep == std::string::npos || dot > sep) ? source_file.substr(0, dot) : source_file;
+
+    task.p_desc.file = base + ".profile.json";
+    task.t_desc.file = base + ".tune.json";
+
+    //Generate the CPP file
+    dllp::generate(layers, task, actions, ".dbn.cpp");
+
+    auto build_opt = opt;
+    build_opt.mpi  = t.d_desc.transport == "mpi";
+
+    return build_program(build_opt, ".dbn.cpp", "./.dbn.out");
+}
+
 std::string datasource_to_string(const std::string& lhs, const dll::processor::datasource& ds) {
     std::string result;
 
@@ -466,6 +925,52 @@ std::string w_desc_to_string(const std::string& lhs, const dll::processor::weigh
     return result;
 }
 
+std::string p_desc_to_string(const std::string& lhs, const dll::processor::profile_desc& desc) {
+    std::string result;
+
+    result += lhs + ".batches = " + std::to_string(desc.batches) + ";\n";
+    result += lhs + ".warmup = " + std::to_string(desc.warmup) + ";\n";
+    result += lhs + ".file = \"" + desc.file + "\";";
+
+    return result;
+}
+
+std::string t_desc_to_string(const std::string& lhs, const dll::processor::tune_desc& desc) {
+    std::string result;
+
+    result += lhs + ".budget = " + std::to_string(desc.budget) + ";\n";
+    result += lhs + ".warmup = " + std::to_string(desc.warmup) + ";\n";
+    result += lhs + ".steps = " + std::to_string(desc.steps) + ";\n";
+    result += lhs + ".effective = " + std::to_string(desc.effective) + ";\n";
+    result += lhs + ".file = \"" + desc.file + "\";";
+
+    return result;
+}
+
+std::string d_desc_to_string(const std::string& lhs, const dll::processor::distributed_desc& desc) {
+    std::string result;
+
+    result += lhs + ".workers = " + std::to_string(desc.workers) + ";\n";
+    result += lhs + ".ranks = " + std::to_string(desc.ranks) + ";\n";
+    result += lhs + ".transport = \"" + desc.transport + "\";\n";
+    result += lhs + ".host = \"" + desc.host + "\";\n";
+    result += lhs + ".port = " + std::to_string(desc.port) + ";\n";
+    result += lhs + ".bucket = " + std::to_string(desc.bucket) + ";\n";
+    result += lhs + ".shard = " + (desc.shard ? "true" : "false") + ";";
+
+    return result;
+}
+
+std::string pl_desc_to_string(const std::string& lhs, const dll::processor::placement_desc& desc) {
+    std::string result;
+
+    result += lhs + ".pin = " + (desc.pin ? "true" : "false") + ";\n";
+    result += lhs + ".producers = " + std::to_string(desc.producers) + ";\n";
+    result += lhs + ".smt = " + (desc.smt ? "true" : "false") + ";";
+
+    return result;
+}
+
 std::string task_to_string(const std::string& name, const dll::processor::task& t) {
     std::string result;
 
@@ -490,6 +995,70 @@ std::string task_to_string(const std::string& name, const dll::processor::task&
     result += "\n";
     result += w_desc_to_string("   " + name + ".w_desc", t.w_desc);
     result += "\n";
+    result += p_desc_to_string("   " + name + ".p_desc", t.p_desc);
+    result += "\n";
+    result += t_desc_to_string("   " + name + ".t_desc", t.t_desc);
+    result += "\n";
+    result += d_desc_to_string("   " + name + ".d_desc", t.d_desc);
+    result += "\n";
+    result += pl_desc_to_string("   " + name + ".pl_desc", t.pl_desc);
+    result += "\n";
+
+    return result;
+}
+
+std::string generator_to_string(const dll::processor::task& t) {
+    auto& desc = t.general_desc;
+
+    if (desc.generator == "none") {
+        return "";
+    }
+
+    std::string result;
+
+    result += "   using generator_t = dll::" + desc.generator + "_data_generator_desc<\n";
+    result += "      dll::batch_size<dbn_t::batch_size>, dll::big_batch_size<" + std::to_string(desc.big_batch) + ">, dll::categorical";
+
+    if (desc.threaded) {
+        result += ", dll::threaded";
+    }
+
+    if (desc.workers > 1) {
+        result += ", dll::workers<" + std::to_string(desc.workers) + ">";
+    }
+
+    if (desc.lock_free) {
+        result += ", dll::lock_free";
+    }
+
+    if (desc.prefetch) {
+        result += ", dll::prefetch";
+    }
+
+    if (desc.index_shuffle) {
+        result += ", dll::index_shuffle";
+    }
+
+    if (desc.storage != "none") {
+        auto& samples = t.training.samples;
+
+        result += desc.storage == "uint8" ? ", dll::storage_type<uint8_t>" : ", dll::storage_type<dll::bfloat16>";
+
+        // The transformations of the samples are done by the generator
+        if (samples.binarize) {
+            result += ", dll::binarize_pre<30>";
+        }
+
+        if (samples.normalize) {
+            result += ", dll::normalize_pre";
+        }
+
+        if (samples.scale && samples.scale_d > 0.0) {
+            result += ", dll::scale_pre<" + std::to_string(size_t(std::round(1.0 / samples.scale_d))) + ">";
+        }
+    }
+
+    result += ">;\n";
 
     return result;
 }
@@ -546,23 +1115,12 @@ std::string get_data_type(const std::vector<std::unique_ptr<dllp::layer>>& layer
     }
 }
 
-void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions) {
-    std::ofstream out_stream(".dbn.cpp");
-
-    out_stream << "#include <memory>\n";
-
-    out_stream << "#include \"dll/processor/processor.hpp\"\n";
-    out_stream << "#include \"dll/rbm/rbm.hpp\"\n";
-    out_stream << "#include \"dll/rbm/conv_rbm.hpp\"\n";
-    out_stream << "#include \"dll/rbm/conv_rbm_mp.hpp\"\n";
-    out_stream << "#include \"dll/neural/dense_layer.hpp\"\n";
-    out_stream << "#include \"dll/neural/conv_layer.hpp\"\n";
-    out_stream << "#include \"dll/pooling/mp_layer.hpp\"\n";
-    out_stream << "#include \"dll/pooling/avgp_layer.hpp\"\n";
-    out_stream << "#include \"dll/neural/activation_layer.hpp\"\n";
-    out_stream << "#include \"dll/dbn.hpp\"\n";
-
-    out_stream << "using dbn_t = dll::dbn_desc<dll::dbn_layers<\n";
+/*!
+ * \brief Generate the descriptor of the network, with the given batch size
+ * (the batch size of the task if empty)
+ */
+void generate_network_desc(std::ostream& out_stream, const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::string& batch) {
+    out_stream << "dll::dbn_desc<dll::dbn_layers<\n";
 
     std::string comma = "  ";
 
@@ -588,7 +1146,9 @@ void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll
         out_stream << ", dll::verbose\n";
     }
 
-    if (t.ft_desc.batch_size > 0) {
+    if (!batch.empty()) {
+        out_stream << ", dll::batch_size<" << batch << ">\n";
+    } else if (t.ft_desc.batch_size > 0) {
         out_stream << ", dll::batch_size<" << t.ft_desc.batch_size << ">\n";
     }
 
@@ -600,28 +1160,77 @@ void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll
         }
     }
 
+    if (t.d_desc.workers > 1) {
+        out_stream << ", dll::data_parallel<" << t.d_desc.workers << ">\n";
+    }
+
     out_stream << ", dll::weight_decay<dll::decay_type::" << decay_to_str(t.ft_desc.decay) << ">\n";
 
     out_stream << ">::dbn_t;\n\n";
+}
+
+/*!
+ * \brief Generate the type of the network and, to tune its batch size, the
+ * alias template of the network over its batch size
+ */
+void generate_network(std::ostream& out_stream, const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, bool tune) {
+    out_stream << "using dbn_t = ";
+    generate_network_desc(out_stream, layers, t, "");
+
+    if (tune) {
+        out_stream << "template <size_t B>\nusing tune_dbn_t = typename ";
+        generate_network_desc(out_stream, layers, t, "B");
+    }
+}
+
+void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions, const std::string& file) {
+    std::ofstream out_stream(file);
+
+    for (auto& include : generated_includes()) {
+        if (include == "memory") {
+            out_stream << "#include <memory>\n";
+        } else {
+            out_stream << "#include \"" << include << "\"\n";
+        }
+    }
+
+    auto final_actions = actions;
+
+    if(std::find(actions.begin(), actions.end(), "auto") != actions.end()){
+        final_actions = t.default_actions;
+    }
+
+    const bool tune = std::find(final_actions.begin(), final_actions.end(), "tune") != final_actions.end();
+
+    generate_network(out_stream, layers, t, tune);
+
 
     out_stream << "int main(int argc, char* argv[]){\n";
+
+    if (t.d_desc.transport == "mpi") {
+        out_stream << "   MPI_Init(&argc, &argv);\n";
+    }
+
     out_stream << "   auto dbn = std::make_unique<dbn_t>();\n";
 
+    // The parameters that are not part of the type of the network can be
+    // overriden on the command line of the program (see dllp sweep)
+
     if (t.ft_desc.learning_rate != dll::processor::stupid_default) {
-        out_stream << "   dbn->learning_rate = " << t.ft_desc.learning_rate << ";\n";
+        out_stream << "   dbn->learning_rate = dll::processor::parameter(argc, argv, \"learning_rate\", " << t.ft_desc.learning_rate << ");\n";
     }
 
     if (t.ft_desc.momentum != dll::processor::stupid_default) {
-        out_stream << "   dbn->initial_momentum = " << t.ft_desc.momentum << ";\n";
-        out_stream << "   dbn->final_momentum = " << t.ft_desc.momentum << ";\n";
+        out_stream << "   dbn->initial_momentum = dll::processor::parameter(argc, argv, \"momentum\", " << t.ft_desc.momentum << ");\n";
+        out_stream << "   dbn->final_momentum = dbn->initial_momentum;\n";
     }
 
     if (t.ft_desc.l1_weight_cost != dll::processor::stupid_default) {
-        out_stream << "   dbn->l1_weight_cost = " << t.ft_desc.l1_weight_cost << ";\n";
+        out_stream << "   dbn->l1_weight_cost = dll::processor::parameter(argc, argv, \"l1_weight_cost\", " << t.ft_desc.l1_weight_cost << ");\n";
     }
 
     if (t.ft_desc.l2_weight_cost != dll::processor::stupid_default) {
-        out_stream << "   dbn->l2_weight_cost = " << t.ft_desc.l2_weight_cost << ";\n";
+        out_stream << "   dbn->l2_weight_cost = dll::processor::parameter(argc, argv, \"l2_weight_cost\", " << t.ft_desc.l2_weight_cost << ");\n";
     }
 
     for (size_t i = 0; i < layers.size(); ++i) {
@@ -630,83 +1239,243 @@ void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll
         layer->set(out_stream, "   dbn->layer_get<" + std::to_string(i) + ">()");
     }
 
-    auto final_actions = actions;
+    // With a compact storage, the generator transforms the samples when the
+    // batches are materialized, they must be stored as they are read
+    auto task = t;
 
-    if(std::find(actions.begin(), actions.end(), "auto") != actions.end()){
-        final_actions = t.default_actions;
+    if (t.general_desc.storage != "none") {
+        task.training.samples.binarize  = false;
+        task.training.samples.normalize = false;
+        task.training.samples.scale     = false;
     }
 
-    out_stream << task_to_string("t", t) << "\n";
+    out_stream << generator_to_string(t) << "\n";
+    out_stream << task_to_string("t", task) << "\n";
+    out_stream << "   t.pt_desc.epochs = dll::processor::parameter(argc, argv, \"pretraining_epochs\", t.pt_desc.epochs);\n";
+    out_stream << "   t.ft_desc.epochs = dll::processor::parameter(argc, argv, \"epochs\", t.ft_desc.epochs);\n";
+    out_stream << "   t.w_desc.file = dll::processor::parameter(argc, argv, \"weights\", t.w_desc.file);\n";
+    out_stream << "   t.d_desc.rank = dll::processor::parameter(argc, argv, \"rank\", t.d_desc.rank);\n";
     out_stream << vector_to_string("actions", final_actions) << "\n";
     out_stream << "   using data_type = " << get_data_type(layers, t) << ";\n";
     out_stream << "   static constexpr bool three = " << layers.front()->is_conv() << ";\n";
-    out_stream << "   dll::processor::execute<data_type, three>(*dbn, t, actions);\n";
+
+    if (tune) {
+        out_stream << "   dll::processor::tune<tune_dbn_t";
+
+        for (auto batch : t.t_desc.batches) {
+            out_stream << ", " << batch;
+        }
+
+        out_stream << ">(t);\n";
+    }
+
+    if (t.general_desc.generator == "none") {
+        out_stream << "   dll::processor::execute<data_type, three>(*dbn, t, actions);\n";
+    } else {
+        out_stream << "   dll::processor::execute<data_type, three, generator_t>(*dbn, t, actions);\n";
+    }
+
+    if (t.d_desc.transport == "mpi") {
+        out_stream << "   dbn.reset();\n";
+        out_stream << "   MPI_Finalize();\n";
+    }
+
     out_stream << "}\n";
 }
 
-bool append_pkg_flags(std::string& flags, const std::string& pkg) {
-    auto cflags = command_result("pkg-config --cflags " + pkg);
+/*!
+ * \brief Returns the C++ expression of the batch of n inputs of the network
+ */
+std::string input_batch(const std::vector<std::unique_ptr<dllp::layer>>& layers) {
+    auto& first = *layers.front();
+
+    if (auto* conv = dynamic_cast<const dllp::conv_layer*>(&first)) {
+        return "etl::dyn_matrix<float, 4>(n, " + std::to_string(conv->c) + ", " + std::to_string(conv->v1) + ", " + std::to_string(conv->v2) + ")";
+    } else if (auto* crbm = dynamic_cast<const dllp::conv_rbm_layer*>(&first)) {
+        return "etl::dyn_matrix<float, 4>(n, " + std::to_string(crbm->c) + ", " + std::to_string(crbm->v1) + ", " + std::to_string(crbm->v2) + ")";
+    } else if (auto* crbm_mp = dynamic_cast<const dllp::conv_rbm_mp_layer*>(&first)) {
+        return "etl::dyn_matrix<float, 4>(n, " + std::to_string(crbm_mp->c) + ", " + std::to_string(crbm_mp->v1) + ", " + std::to_string(crbm_mp->v2) + ")";
+    }
+
+    return "etl::dyn_matrix<float, 2>(n, model.dbn->input_size())";
+}
+
+void generate_inference(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::string& weights, const std::string& file) {
+    std::ofstream out_stream(file);
+
+    // The training code of the processor is not part of the library
+    for (auto& include : generated_includes()) {
+        if (include == "memory") {
+            out_stream << "#include <memory>\n";
+        } else if (include != "dll/processor/processor.hpp") {
+            out_stream << "#include \"" << include << "\"\n";
+        }
+    }
+
+    out_stream << "#include \"dll/util/mapped_weights.hpp\"\n\n";
+
+    generate_network(out_stream, layers, t);
+
+    out_stream << "namespace {\n\n";
+    out_stream << "struct inference_model {\n";
+    out_stream << "   std::unique_ptr<dbn_t> dbn;\n";
+    out_stream << "   std::unique_ptr<dll::mapped_weights> weights;\n";
+    out_stream << "   std::unique_ptr<dll::frozen_network<dbn_t>> frozen;\n";
+    out_stream << "};\n\n";
+    out_stream << "inference_model model;\n\n";
+    out_stream << "} // end of anonymous namespace\n\n";
+
+    out_stream << "extern \"C\" {\n\n";
+
+    out_stream << "int dllp_load(const char* weights) {\n";
+    out_stream << "   auto mapping = std::make_unique<dll::mapped_weights>(weights ? weights : \"" << weights << "\");\n";
+    out_stream << "   if (!mapping->is_open() || mapping->blocks() != dbn_t::layers || mapping->dtype() != sizeof(float)) {\n";
+    out_stream << "      return -1;\n";
+    out_stream << "   }\n";
+    out_stream << "   model.frozen.reset();\n";
+    out_stream << "   model.dbn     = std::make_unique<dbn_t>();\n";
+    out_stream << "   model.weights = std::move(mapping);\n";
+    out_stream << "   model.frozen  = std::make_unique<dll::frozen_network<dbn_t>>(model.dbn->freeze(*model.weights));\n";
+    out_stream << "   return 0;\n";
+    out_stream << "}\n\n";
+
+    out_stream << "size_t dllp_input_size() {\n";
+    out_stream << "   return (model.dbn || !dllp_load(nullptr)) ? model.dbn->input_size() : 0;\n";
+    out_stream << "}\n\n";
+
+    out_stream << "size_t dllp_output_size() {\n";
+    out_stream << "   return (model.dbn || !dllp_load(nullptr)) ? model.dbn->output_size() : 0;\n";
+    out_stream << "}\n\n";
+
+    out_stream << "int predict(const float* input, size_t n, float* output) {\n";
+    out_stream << "   if (!model.frozen && dllp_load(nullptr)) {\n";
+    out_stream << "      return -1;\n";
+    out_stream << "   }\n";
+    out_stream << "   auto batch = " << input_batch(layers) << ";\n";
+    out_stream << "   std::copy(input, input + etl::size(batch), batch.memory_start());\n";
+    out_stream << "   auto result = model.frozen->forward_batch(batch);\n";
+    out_stream << "   result.ensure_cpu_up_to_date();\n";
+    out_stream << "   std::copy(result.memory_start(), result.memory_end(), output);\n";
+    out_stream << "   return 0;\n";
+    out_stream << "}\n\n";
+
+    out_stream << "} // end of extern \"C\"\n";
+}
 
-    if (cflags.empty()) {
+void generate_inference_header(const std::string& file) {
+    std::ofstream out_stream(file);
+
+    out_stream << "#pragma once\n\n";
+    out_stream << "#include <stddef.h>\n\n";
+    out_stream << "#ifdef __cplusplus\n";
+    out_stream << "extern \"C\" {\n";
+    out_stream << "#endif\n\n";
+    out_stream << "/* Map the weights of the network (nullptr for the exported weights), 0 on success */\n";
+    out_stream << "int dllp_load(const char* weights);\n\n";
+    out_stream << "/* The number of values of one input and of one output of the network */\n";
+    out_stream << "size_t dllp_input_size(void);\n";
+    out_stream << "size_t dllp_output_size(void);\n\n";
+    out_stream << "/* Compute the outputs of n inputs (n * dllp_output_size() values), 0 on success */\n";
+    out_stream << "int predict(const float* input, size_t n, float* output);\n\n";
+    out_stream << "#ifdef __cplusplus\n";
+    out_stream << "}\n";
+    out_stream << "#endif\n";
+}
+
+bool append_pkg_flags(std::string& cflags, std::string& ldflags, const std::string& pkg) {
+    auto pkg_cflags = command_result("pkg-config --cflags " + pkg);
+
+    if (pkg_cflags.empty()) {
         std::cout << "Failed to get compilation flags for " << pkg << std::endl;
         std::cout << "   `pkg-config --cflags " << pkg << "` should return the compilation for " << pkg << std::endl;
         return false;
     }
 
-    auto ldflags = command_result("pkg-config --libs " + pkg);
+    auto libs = command_result("pkg-config --libs " + pkg);
 
-    if (ldflags.empty()) {
+    if (libs.empty()) {
         std::cout << "Failed to get linking flags for " << pkg << std::endl;
         std::cout << "   `pkg-config --libs " << pkg << "` should return the linking for " << pkg << std::endl;
         return false;
     }
 
-    flags += " " + cflags + " ";
-    flags += " " + ldflags + " ";
+    cflags += " " + pkg_cflags + " ";
+    ldflags += " " + libs + " ";
 
     return true;
 }
 
-bool compile(const options& opt) {
-    if (!opt.quiet) {
-        std::cout << "Compiling the program..." << std::endl;
+/*!
+ * \brief Compute the flags to compile (cflags) and to link (ldflags) the
+ * generated program
+ * \return false if the flags of a library cannot be found
+ */
+bool compile_flags(const options& opt, std::string& cflags, std::string& ldflags, bool inference) {
+    if (inference) {
+        // The inference library is optimized for the machine it is built on
+        cflags += " -O3 -march=native -DNDEBUG -DETL_VECTORIZE_FULL ";
+        cflags += " -fPIC -shared ";
+    } else {
+        cflags += " -g ";
+        cflags += " -O2 -DETL_VECTORIZE_FULL ";
     }
 
-    const auto* cxx = std::getenv("CXX");
-
-    std::string compile_command(cxx);
-
-    compile_command += " -o .dbn.out ";
-    compile_command += " -g ";
-    compile_command += " -O2 -DETL_VECTORIZE_FULL ";
-    compile_command += " -std=c++1z ";
-    compile_command += " -pthread ";
-    compile_command += " .dbn.cpp ";
+    cflags += " -std=c++1z ";
+    cflags += " -pthread ";
 
     if (opt.mkl) {
-        compile_command += " -DETL_MKL_MODE ";
+        cflags += " -DETL_MKL_MODE ";
 
-        if (!append_pkg_flags(compile_command, "mkl")) {
+        if (!append_pkg_flags(cflags, ldflags, "mkl")) {
             return false;
         }
     }
 
     if (opt.cublas) {
-        compile_command += " -DETL_CUBLAS_MODE ";
+        cflags += " -DETL_CUBLAS_MODE ";
 
-        if (!append_pkg_flags(compile_command, "cublas")) {
+        if (!append_pkg_flags(cflags, ldflags, "cublas")) {
             return false;
         }
     }
 
     if (opt.cufft) {
-        compile_command += " -DETL_CUFFT_MODE ";
+        cflags += " -DETL_CUFFT_MODE ";
 
-        if (!append_pkg_flags(compile_command, "cufft")) {
+        if (!append_pkg_flags(cflags, ldflags, "cufft")) {
             return false;
         }
     }
 
+    if (opt.mpi) {
+        cflags += " -DDLL_MPI ";
+
+        // The name of the package depends on the implementation of MPI
+        const auto* mpi = std::getenv("DLLP_MPI_PKG");
+
+        if (!append_pkg_flags(cflags, ldflags, mpi ? mpi : "ompi")) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool compile(const options& opt, const std::string& cflags, const std::string& ldflags, const std::string& pch_flags, const std::string& source, const std::string& output) {
+    if (!opt.quiet) {
+        std::cout << "Compiling the program..." << std::endl;
+    }
+
+    const auto* cxx = std::getenv("CXX");
+
+    std::string compile_command(cxx);
+
+    compile_command += " -o " + output + " ";
+    compile_command += pch_flags;
+    compile_command += cflags;
+    compile_command += " " + source + " ";
+    compile_command += ldflags;
+
     int compile_result = system(compile_command.c_str());
 
     if (compile_result) {
@@ -721,9 +1490,155 @@ bool compile(const options& opt) {
     return true;
 }
 
+/*!
+ * \brief Returns the command running the generated program, launched by
+ * mpirun ($DLLP_MPIRUN) on all the ranks with MPI
+ */
+std::string run_command(const dll::processor::task& t) {
+    if (t.d_desc.transport == "mpi") {
+        const auto* mpirun = std::getenv("DLLP_MPIRUN");
+
+        return std::string(mpirun ? mpirun : "mpirun") + " -np " + std::to_string(t.d_desc.ranks) + " ./.dbn.out";
+    }
+
+    return "./.dbn.out";
+}
+
+/*!
+ * \brief Start the generated program in the background for the ranks
+ * other than the root of a distributed task over TCP, the output of each
+ * rank being in .dllp-rank-<rank>.log
+ * \return the pids of the started ranks
+ */
+std::vector<pid_t> start_ranks(const dll::processor::task& t) {
+    std::vector<pid_t> pids;
+
+    if (t.d_desc.transport != "tcp") {
+        return pids;
+    }
+
+    for (size_t rank = 1; rank < t.d_desc.ranks; ++rank) {
+        auto pid = fork();
+
+        if (pid < 0) {
+            std::cout << "dllp: error: impossible to start rank " << rank << std::endl;
+            break;
+        }
+
+        if (pid > 0) {
+            pids.push_back(pid);
+            continue;
+        }
+
+        const auto log = ".dllp-rank-" + std::to_string(rank) + ".log";
+        const auto arg = "rank=" + std::to_string(rank);
+
+        auto fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+
+        execl("./.dbn.out", "./.dbn.out", arg.c_str(), static_cast<char*>(nullptr));
+
+        _exit(127);
+    }
+
+    return pids;
+}
+
+/*!
+ * \brief Wait for the given ranks
+ * \return true if all the ranks succeeded
+ */
+bool wait_ranks(const std::vector<pid_t>& pids) {
+    bool success = true;
+
+    for (auto pid : pids) {
+        int status = 0;
+
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+            success = false;
+        }
+    }
+
+    if (!success) {
+        std::cout << "dllp: error: some ranks failed (see .dllp-rank-*.log)" << std::endl;
+    }
+
+    return success;
+}
+
+int process_export(const options& opt, const std::vector<std::string>& actions, const std::string& source_file) {
+    //1. Parse the configuration file
+
+    dll::processor::task t;
+    std::vector<std::unique_ptr<dllp::layer>> layers;
+
+    if (!parse_file(source_file, t, layers)) {
+        return 1;
+    }
+
+    //2. Export the weights in the mapped format with the training program
+
+    auto export_actions = actions.empty() ? std::vector<std::string>{"load"} : actions;
+    export_actions.push_back("export");
+
+    // The weights are exported by a single process
+    t.d_desc.ranks     = 1;
+    t.d_desc.transport = "tcp";
+
+    if (!compile_exe(opt, export_actions, source_file, t, layers)) {
+        return 1;
+    }
+
+    if (auto exec_result = system("./.dbn.out")) {
+        std::cout << "Impossible to execute the generated file" << std::endl;
+        return exec_result;
+    }
+
+    char weights[PATH_MAX];
+
+    if (!realpath((t.w_desc.file + ".mapped").c_str(), weights)) {
+        std::cout << "dllp: error: the weights have not been exported" << std::endl;
+        return 1;
+    }
+
+    //3. Compile the inference library
+
+    auto name = source_file.substr(source_file.find_last_of('/') + 1);
+    name      = name.substr(0, name.find('.'));
+
+    generate_inference(layers, t, weights, ".dbn.inference.cpp");
+    generate_inference_header(name + ".h");
+
+    std::string cflags;
+    std::string ldflags;
+
+    if (!compile_flags(opt, cflags, ldflags, true) || !compile(opt, cflags, ldflags, "", ".dbn.inference.cpp", "lib" + name + ".so")) {
+        return 1;
+    }
+
+    if (!opt.quiet) {
+        std::cout << "Inference library: lib" << name << ".so (" << name << ".h), weights: " << weights << std::endl;
+    }
+
+    return 0;
+}
+
 } //end of namespace dllp
 
 int dll::processor::process_file(const dllp::options& opt, const std::vector<std::string>& actions, const std::string& source_file) {
+    if (!actions.empty() && actions.front() == "sweep") {
+        return dllp::process_sweep(opt, {actions.begin() + 1, actions.end()}, source_file);
+    }
+
+    if (!actions.empty() && actions.front() == "export-inference") {
+        return dllp::process_export(opt, {actions.begin() + 1, actions.end()}, source_file);
+    }
+
     //1. Parse the configuration file
 
     dll::processor::task t;
@@ -745,7 +1660,13 @@ int dll::processor::process_file(const dllp::options& opt, const std::vector<std
         std::cout << "Executing the program" << std::endl;
     }
 
-    auto exec_result = system("./.dbn.out");
+    auto ranks = dllp::start_ranks(t);
+
+    auto exec_result = system(dllp::run_command(t).c_str());
+
+    if (!dllp::wait_ranks(ranks) && !exec_result) {
+        exec_result = 1;
+    }
 
     if (exec_result) {
         std::cout << "Impossible to execute the generated file" << std::endl;
@@ -771,7 +1692,14 @@ std::string dll::processor::process_file_result(const dllp::options& opt, const
         return "";
     }
 
-    //3. Execute and return the result directly
+    //3. Execute and return the result (of the root rank) directly
+
+    auto ranks  = dllp::start_ranks(t);
+    auto result = dllp::command_result(dllp::run_command(t));
+
+    if (!dllp::wait_ranks(ranks)) {
+        return "";
+    }
 
-    return dllp::command_result("./.dbn.out");
+    return result;
 }
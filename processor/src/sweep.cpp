@@ -0,0 +1,576 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "cpp_utils/string.hpp"
+
+#include "parse_utils.hpp"
+#include "sweep.hpp"
+
+namespace dllp {
+
+namespace {
+
+constexpr const char* sweep_dir = ".dllp-sweep";
+
+/*!
+ * \brief The parameters that are read by the generated program at runtime
+ * (see dll::processor::parameter) and do not need a new compilation
+ */
+const std::map<std::string, std::string> runtime_parameters{
+    {"training.learning_rate", "learning_rate"},
+    {"training.momentum", "momentum"},
+    {"training.l1_weight_cost", "l1_weight_cost"},
+    {"training.l2_weight_cost", "l2_weight_cost"},
+    {"training.epochs", "epochs"},
+    {"pretraining.epochs", "pretraining_epochs"}};
+
+/*!
+ * \brief The result of one run of the sweep
+ */
+struct sweep_run {
+    size_t variant    = 0;    ///< The index of the variant
+    size_t program    = 0;    ///< The index of the program of the variant
+    std::string log;          ///< The log file of the run
+    int status        = -1;   ///< The exit status of the run
+    double seconds    = 0.0;  ///< The duration of the run
+    double ft_error   = -1.0; ///< The final training error, -1 if not reported
+    double test_error = -1.0; ///< The test error, -1 if not reported
+
+    std::vector<std::string> args; ///< The runtime arguments of the program
+};
+
+bool parse_number(const std::string& str, double& value) {
+    if (str.empty()) {
+        return false;
+    }
+
+    char* end = nullptr;
+    value     = std::strtod(str.c_str(), &end);
+
+    return *end == '\0';
+}
+
+bool is_integer(const std::string& str) {
+    return str.find_first_of(".eE") == std::string::npos;
+}
+
+std::string format_number(double value, bool integer) {
+    if (integer) {
+        return std::to_string(std::llround(value));
+    }
+
+    std::ostringstream stream;
+    stream << value;
+    return stream.str();
+}
+
+/*!
+ * \brief Indicates if the line is the header of a section (xxx:)
+ */
+bool is_header(const std::string& line) {
+    return !line.empty() && line.back() == ':' && line.find(' ') == std::string::npos;
+}
+
+/*!
+ * \brief Returns the last error reported with the given prefix in a log
+ */
+double last_error(const std::string& log, const std::string& prefix) {
+    double error = -1.0;
+
+    std::ifstream stream(log);
+
+    for (std::string line; std::getline(stream, line);) {
+        if (dllp::starts_with(line, prefix)) {
+            parse_number(std::string(cpp::trim(line.substr(prefix.size()))), error);
+        }
+    }
+
+    return error;
+}
+
+std::string error_str(double error) {
+    return error < 0.0 ? "-" : format_number(error, false);
+}
+
+/*!
+ * \brief Start a run on the given cores, its output being in its log
+ * \return the pid of the run, -1 if it cannot be started
+ */
+pid_t start_run(const std::string& program, const sweep_run& run, size_t first_core, size_t threads) {
+    auto pid = fork();
+
+    if (pid != 0) {
+        return pid;
+    }
+
+    // In the child, pin the run to its cores and limit its threads
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (size_t c = first_core; c < first_core + threads; ++c) {
+        CPU_SET(c, &set);
+    }
+
+    sched_setaffinity(0, sizeof(set), &set);
+
+    setenv("OMP_NUM_THREADS", std::to_string(threads).c_str(), 1);
+    setenv("MKL_NUM_THREADS", std::to_string(threads).c_str(), 1);
+
+    auto fd = open(run.log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(program.c_str()));
+
+    for (auto& arg : run.args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+
+    argv.push_back(nullptr);
+
+    execv(program.c_str(), argv.data());
+
+    _exit(127);
+}
+
+} //end of anonymous namespace
+
+bool expand_values(const std::string& value, std::vector<std::string>& values) {
+    values.clear();
+
+    // List of values: {a, b, c}
+
+    if (value.size() > 1 && value.front() == '{' && value.back() == '}') {
+        std::istringstream stream(value.substr(1, value.size() - 2));
+
+        for (std::string item; std::getline(stream, item, ',');) {
+            std::string trimmed(cpp::trim(item));
+
+            if (!trimmed.empty()) {
+                values.push_back(trimmed);
+            }
+        }
+
+        return !values.empty();
+    }
+
+    // Range of values: first..last[:step]
+
+    auto dots = value.find("..");
+
+    if (dots == std::string::npos) {
+        return false;
+    }
+
+    auto colon = value.find(':', dots);
+
+    std::string first_str = value.substr(0, dots);
+    std::string last_str  = value.substr(dots + 2, colon == std::string::npos ? std::string::npos : colon - dots - 2);
+    std::string step_str  = colon == std::string::npos ? "1" : value.substr(colon + 1);
+
+    double first = 0.0;
+    double last  = 0.0;
+    double step  = 0.0;
+
+    if (!parse_number(first_str, first) || !parse_number(last_str, last) || !parse_number(step_str, step) || step <= 0.0 || last < first) {
+        return false;
+    }
+
+    const bool integer = is_integer(first_str) && is_integer(last_str) && is_integer(step_str);
+    const size_t n     = size_t(std::floor((last - first) / step + 1e-9)) + 1;
+
+    for (size_t i = 0; i < n; ++i) {
+        values.push_back(format_number(first + i * step, integer));
+    }
+
+    return true;
+}
+
+bool parse_sweep(const std::vector<std::string>& lines, sweep_desc& desc) {
+    std::string section;
+    std::string subsection;
+    std::map<std::string, size_t> layer_counts;
+
+    for (size_t i = 0; i < lines.size(); ++i) {
+        auto& line = lines[i];
+
+        // The sweep block describes how the runs are done
+
+        if (line == "sweep:") {
+            while (i + 1 < lines.size()) {
+                if (dllp::starts_with(lines[i + 1], "threads: ")) {
+                    desc.threads = std::max(1L, std::stol(dllp::extract_value(lines[i + 1], "threads: ")));
+                } else if (dllp::starts_with(lines[i + 1], "jobs: ")) {
+                    desc.jobs = std::stol(dllp::extract_value(lines[i + 1], "jobs: "));
+                } else {
+                    break;
+                }
+
+                ++i;
+            }
+
+            continue;
+        }
+
+        desc.lines.push_back(line);
+
+        if (line == "data:" || line == "network:" || line == "options:") {
+            section = line.substr(0, line.size() - 1);
+            subsection.clear();
+            layer_counts.clear();
+            continue;
+        }
+
+        if (dllp::starts_with(line, "include: ") || dllp::starts_with(line, "action: ")) {
+            section.clear();
+            continue;
+        }
+
+        if (is_header(line)) {
+            subsection = line.substr(0, line.size() - 1);
+
+            if (section == "network") {
+                subsection += std::to_string(++layer_counts[subsection]);
+            }
+
+            continue;
+        }
+
+        // The data is never swept, the files may contain anything
+        if (section != "network" && section != "options") {
+            continue;
+        }
+
+        auto separator = line.find(": ");
+
+        if (separator == std::string::npos) {
+            continue;
+        }
+
+        sweep_parameter parameter;
+        parameter.key  = line.substr(0, separator);
+        parameter.name = subsection.empty() ? parameter.key : subsection + "." + parameter.key;
+        parameter.line = desc.lines.size() - 1;
+
+        if (expand_values(line.substr(separator + 2), parameter.values)) {
+            desc.parameters.push_back(std::move(parameter));
+        }
+    }
+
+    return true;
+}
+
+std::vector<sweep_variant> sweep_variants(const sweep_desc& desc) {
+    std::vector<sweep_variant> variants(1);
+    variants.front().lines = desc.lines;
+
+    // Cartesian product of the values of the parameters
+
+    for (auto& parameter : desc.parameters) {
+        std::vector<sweep_variant> next;
+
+        for (auto& variant : variants) {
+            for (auto& value : parameter.values) {
+                auto copy = variant;
+
+                copy.lines[parameter.line] = parameter.key + ": " + value;
+                copy.values.push_back(value);
+
+                next.push_back(std::move(copy));
+            }
+        }
+
+        variants = std::move(next);
+    }
+
+    return variants;
+}
+
+int process_sweep(const dll::processor::options& opt, const std::vector<std::string>& actions, const std::string& source_file) {
+    //1. Read the configuration and expand the sweep
+
+    std::vector<std::string> lines;
+
+    if (!read_conf(source_file, lines)) {
+        return 1;
+    }
+
+    sweep_desc desc;
+
+    if (!parse_sweep(lines, desc)) {
+        return 1;
+    }
+
+    auto variants = sweep_variants(desc);
+
+    if (!make_directories(sweep_dir)) {
+        std::cout << "dllp: error: impossible to create the folder " << sweep_dir << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> run_actions = actions;
+
+    if (run_actions.empty()) {
+        run_actions = {"train", "test"};
+    }
+
+    //2. Generate the programs, the variants that only differ by runtime
+    //parameters share the same program
+
+    std::vector<dll::processor::task> tasks(variants.size());
+    std::vector<sweep_run> runs(variants.size());
+    std::vector<std::string> programs;
+    std::map<std::string, size_t> sources;
+
+    for (size_t v = 0; v < variants.size(); ++v) {
+        std::vector<std::unique_ptr<dllp::layer>> layers;
+
+        if (!parse_lines(variants[v].lines, tasks[v], layers)) {
+            std::cout << "dllp: error: invalid configuration for the variant " << v << std::endl;
+            return 1;
+        }
+
+        auto& run = runs[v];
+        run.variant = v;
+        run.log     = std::string(sweep_dir) + "/run-" + std::to_string(v) + ".log";
+
+        for (size_t p = 0; p < desc.parameters.size(); ++p) {
+            auto it = runtime_parameters.find(desc.parameters[p].name);
+
+            if (it != runtime_parameters.end()) {
+                run.args.push_back(it->second + "=" + variants[v].values[p]);
+            }
+        }
+
+        // Each run has its own weights
+        run.args.push_back("weights=" + std::string(sweep_dir) + "/run-" + std::to_string(v) + ".dat");
+
+        // The runtime parameters are read from the command line, they are
+        // normalized so that they do not change the generated source
+        auto t = tasks[v];
+
+        t.ft_desc.learning_rate  = tasks.front().ft_desc.learning_rate;
+        t.ft_desc.momentum       = tasks.front().ft_desc.momentum;
+        t.ft_desc.l1_weight_cost = tasks.front().ft_desc.l1_weight_cost;
+        t.ft_desc.l2_weight_cost = tasks.front().ft_desc.l2_weight_cost;
+        t.ft_desc.epochs         = tasks.front().ft_desc.epochs;
+        t.pt_desc.epochs         = tasks.front().pt_desc.epochs;
+
+        // The runs are already parallel, each one is trained in a single process
+        t.d_desc.ranks     = 1;
+        t.d_desc.transport = "tcp";
+
+        const auto file = std::string(sweep_dir) + "/variant.cpp";
+
+        generate(layers, t, run_actions, file);
+
+        auto source = read_file(file);
+        auto it     = sources.find(source);
+
+        if (it == sources.end()) {
+            const auto program = std::string(sweep_dir) + "/program-" + std::to_string(programs.size());
+
+            std::ofstream(program + ".cpp") << source;
+
+            it = sources.emplace(std::move(source), programs.size()).first;
+            programs.push_back(program);
+        }
+
+        run.program = it->second;
+    }
+
+    std::remove((std::string(sweep_dir) + "/variant.cpp").c_str());
+
+    const size_t cores = std::max(1U, std::thread::hardware_concurrency());
+
+    if (!opt.quiet) {
+        std::cout << "dllp: sweep of " << variants.size() << " runs with " << programs.size() << " programs" << std::endl;
+    }
+
+    //3. Compile the programs in parallel
+    //The first program is compiled alone since it fills the precompiled header
+
+    std::vector<char> compiled(programs.size(), false);
+
+    auto build = [&](size_t p) { compiled[p] = build_program(opt, programs[p] + ".cpp", programs[p] + ".out"); };
+
+    build(0);
+
+    std::atomic<size_t> next_program{1};
+    std::vector<std::thread> builders;
+
+    const size_t jobs = desc.jobs ? desc.jobs : cores;
+
+    for (size_t j = 0; j < std::min(jobs, programs.size() - 1); ++j) {
+        builders.emplace_back([&] {
+            for (size_t p; (p = next_program++) < programs.size();) {
+                build(p);
+            }
+        });
+    }
+
+    for (auto& builder : builders) {
+        builder.join();
+    }
+
+    //4. Run the variants, each with its slot of cores
+
+    const size_t slots = std::max(size_t(1), cores / desc.threads);
+
+    std::vector<pid_t> slot_pids(slots, -1);
+    std::map<pid_t, std::pair<size_t, std::chrono::steady_clock::time_point>> running;
+
+    auto wait_one = [&] {
+        int status = 0;
+        auto pid   = waitpid(-1, &status, 0);
+
+        auto it = running.find(pid);
+
+        if (it == running.end()) {
+            return;
+        }
+
+        auto& run   = runs[it->second.first];
+        run.status  = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - it->second.second).count();
+
+        if (!opt.quiet) {
+            std::cout << "dllp: run " << run.variant << " done (" << run.status << ") in " << run.seconds << "s" << std::endl;
+        }
+
+        for (auto& slot : slot_pids) {
+            if (slot == pid) {
+                slot = -1;
+            }
+        }
+
+        running.erase(it);
+    };
+
+    for (auto& run : runs) {
+        if (!compiled[run.program]) {
+            continue;
+        }
+
+        while (running.size() >= slots) {
+            wait_one();
+        }
+
+        size_t slot = 0;
+        while (slot_pids[slot] != -1) {
+            ++slot;
+        }
+
+        auto pid = start_run(programs[run.program] + ".out", run, (slot * desc.threads) % cores, std::min(desc.threads, cores));
+
+        if (pid < 0) {
+            std::cout << "dllp: error: impossible to start the run " << run.variant << std::endl;
+            continue;
+        }
+
+        slot_pids[slot] = pid;
+        running[pid]    = {run.variant, std::chrono::steady_clock::now()};
+    }
+
+    while (!running.empty()) {
+        wait_one();
+    }
+
+    //5. Collect the results
+
+    std::vector<std::vector<std::string>> rows;
+
+    std::vector<std::string> header{"run"};
+
+    for (auto& parameter : desc.parameters) {
+        header.push_back(parameter.name);
+    }
+
+    header.insert(header.end(), {"status", "seconds", "train_error", "test_error"});
+    rows.push_back(header);
+
+    size_t best = runs.size();
+
+    for (auto& run : runs) {
+        run.ft_error   = last_error(run.log, "Train Classification Error:");
+        run.test_error = last_error(run.log, "Error rate: ");
+
+        std::vector<std::string> row{std::to_string(run.variant)};
+        row.insert(row.end(), variants[run.variant].values.begin(), variants[run.variant].values.end());
+        row.insert(row.end(), {compiled[run.program] ? std::to_string(run.status) : "compile", format_number(run.seconds, false), error_str(run.ft_error), error_str(run.test_error)});
+        rows.push_back(row);
+
+        if (run.status == 0 && run.test_error >= 0.0 && (best == runs.size() || run.test_error < runs[best].test_error)) {
+            best = run.variant;
+        }
+    }
+
+    std::vector<size_t> widths(header.size(), 0);
+
+    for (auto& row : rows) {
+        for (size_t c = 0; c < row.size(); ++c) {
+            widths[c] = std::max(widths[c], row[c].size());
+        }
+    }
+
+    const auto csv_file = std::string(sweep_dir) + "/results.csv";
+    std::ofstream csv(csv_file);
+
+    for (auto& row : rows) {
+        for (size_t c = 0; c < row.size(); ++c) {
+            std::cout << (c ? " | " : "| ") << row[c] << std::string(widths[c] - row[c].size(), ' ');
+            csv << (c ? "," : "") << row[c];
+        }
+
+        std::cout << " |" << std::endl;
+        csv << "\n";
+    }
+
+    if (best < runs.size()) {
+        std::cout << "Best run: " << best << " (test error " << error_str(runs[best].test_error) << ", log in " << runs[best].log << ")" << std::endl;
+    }
+
+    if (!opt.quiet) {
+        std::cout << "Results written to " << csv_file << std::endl;
+    }
+
+    for (auto& run : runs) {
+        if (!compiled[run.program] || run.status != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+} //end of namespace dllp
@@ -10,6 +10,7 @@
  * \brief Tests for data augmentations and generators
  */
 
+#include <cstdio>
 #include <deque>
 
 #include "dll_test.hpp"
@@ -17,6 +18,7 @@
 #include "dll/dbn.hpp"
 #include "dll/rbm/rbm.hpp"
 #include "dll/neural/dense_layer.hpp"
+#include "dll/datasets.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -328,3 +330,570 @@ TEST_CASE("unit/augment/mnist/8", "[dbn][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.3);
 }
+
+// Use a threaded out-memory generator with several workers
+TEST_CASE("unit/augment/mnist/9", "[dbn][unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using ref_generator_t = dll::outmemory_data_generator_desc<dll::batch_size<16>, dll::categorical, dll::scale_pre<255>>;
+    using train_generator_t = dll::outmemory_data_generator_desc<dll::batch_size<16>, dll::big_batch_size<5>, dll::categorical, dll::scale_pre<255>, dll::threaded, dll::workers<3>>;
+
+    auto ref_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        ref_generator_t{});
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    // The batches must be produced in the order of the dataset
+    for (size_t epoch = 0; epoch < 2; ++epoch) {
+        ref_generator->reset();
+        train_generator->reset();
+
+        while (ref_generator->has_next_batch()) {
+            REQUIRE(train_generator->has_next_batch());
+
+            REQUIRE(etl::dim<0>(train_generator->data_batch()) == etl::dim<0>(ref_generator->data_batch()));
+            REQUIRE(etl::approx_equals(train_generator->data_batch(), ref_generator->data_batch(), 0.0001));
+            REQUIRE(etl::approx_equals(train_generator->label_batch(), ref_generator->label_batch(), 0.0001));
+
+            ref_generator->next_batch();
+            train_generator->next_batch();
+        }
+
+        REQUIRE(!train_generator->has_next_batch());
+    }
+}
+
+// Use an augmented in-memory generator with several workers
+TEST_CASE("unit/augment/mnist/10", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::big_batch_size<4>, dll::workers<3>, dll::noise<20>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 60);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use a memory-mapped generator for fine-tuning
+TEST_CASE("unit/augment/mnist/11", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_dataset(dataset);
+
+    REQUIRE(dll::write_mmap_dataset("/tmp/dll_mnist_train.mmap", dataset.training_images, dataset.training_labels, 10));
+    REQUIRE(dll::write_mmap_dataset("/tmp/dll_mnist_test.mmap", dataset.test_images, dataset.test_labels, 10));
+
+    using generator_t = dll::mmap_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<4>>;
+
+    auto train_generator = dll::make_mmap_generator<float, 1>("/tmp/dll_mnist_train.mmap", generator_t{});
+    auto test_generator  = dll::make_mmap_generator<float, 1>("/tmp/dll_mnist_test.mmap", generator_t{});
+
+    REQUIRE(train_generator->is_open());
+    REQUIRE(train_generator->size() == dataset.training_images.size());
+
+    // The batches are views on the samples
+    REQUIRE(etl::approx_equals(train_generator->data_batch()(0), dataset.training_images[0], 0.0001));
+    REQUIRE(train_generator->label_batch()(0, dataset.training_labels[0]) == 1.0f);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use a block-compressed generator for fine-tuning
+TEST_CASE("unit/augment/mnist/compressed", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::shuffle>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_dataset(dataset);
+
+#ifdef DLL_LZ4
+    constexpr auto codec = dll::block_codec::LZ4;
+#else
+    constexpr auto codec = dll::block_codec::NONE;
+#endif
+
+    // Blocks of 4 batches, the last one being incomplete
+    REQUIRE(dll::write_compressed_dataset("/tmp/dll_mnist_train.blkz", dataset.training_images, dataset.training_labels, codec, 100, 10));
+
+    REQUIRE(dll::write_mmap_dataset("/tmp/dll_mnist_test.mmap", dataset.test_images, dataset.test_labels, 10));
+    REQUIRE(dll::compress_mmap_dataset<float>("/tmp/dll_mnist_test.mmap", "/tmp/dll_mnist_test.blkz", codec, 100));
+
+    using generator_t = dll::compressed_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<2>, dll::workers<2>>;
+
+    auto train_generator = dll::make_compressed_generator<float, 1>("/tmp/dll_mnist_train.blkz", generator_t{});
+    auto test_generator  = dll::make_compressed_generator<float, 1>("/tmp/dll_mnist_test.blkz", generator_t{});
+
+    REQUIRE(train_generator->is_open());
+    REQUIRE(train_generator->size() == dataset.training_images.size());
+    REQUIRE(train_generator->batches() == 20);
+
+    REQUIRE(etl::approx_equals(train_generator->data_batch()(0), dataset.training_images[0], 0.0001));
+    REQUIRE(train_generator->label_batch()(0, dataset.training_labels[0]) == 1.0f);
+
+    // All the batches of the last block are served
+    size_t batches = 0;
+    while (test_generator->has_next_batch()) {
+        ++batches;
+        test_generator->next_batch();
+    }
+
+    REQUIRE(batches == test_generator->batches());
+
+    test_generator->reset();
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Read the MNIST files directly into the caches of the generators
+TEST_CASE("unit/augment/mnist/direct", "[dbn][unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto train_generator = dll::make_mnist_generator_train(100, 500, dll::batch_size<25>{}, dll::scale_pre<255>{});
+    auto test_generator  = dll::make_mnist_generator_test(0, 600, dll::batch_size<25>{}, dll::normalize_pre{});
+
+    REQUIRE(train_generator->size() == 500);
+    REQUIRE(test_generator->size() == 600);
+
+    auto train_image = dataset.training_images[100];
+    train_image /= 255.0f;
+
+    REQUIRE(etl::approx_equals(etl::reshape<28 * 28>(train_generator->data_batch()(0)), train_image, 0.0001));
+    REQUIRE(train_generator->label_batch()(0, dataset.training_labels[100]) == 1.0f);
+    REQUIRE(etl::sum(train_generator->label_batch()(0)) == 1.0f);
+
+    mnist::normalize_dataset(dataset);
+
+    REQUIRE(etl::approx_equals(etl::reshape<28 * 28>(test_generator->data_batch()(3)), dataset.test_images[3], 0.0001));
+    REQUIRE(test_generator->label_batch()(3, dataset.test_labels[3]) == 1.0f);
+}
+
+// Export the features of a layer for a whole dataset and read them back
+TEST_CASE("unit/augment/mnist/export", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<16>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_dataset(dataset);
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<16>, dll::categorical>;
+
+    auto generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->template export_features<0>(*generator, "/tmp/dll_mnist_features.mmap"));
+
+    using features_generator_t = dll::mmap_data_generator_desc<dll::batch_size<16>>;
+
+    auto features = dll::make_mmap_generator<float, 1>("/tmp/dll_mnist_features.mmap", features_generator_t{});
+
+    REQUIRE(features->is_open());
+    REQUIRE(features->size() == dataset.training_images.size());
+
+    auto expected = dbn->template forward_many<0>(dataset.training_images);
+
+    size_t i = 0;
+
+    features->reset();
+
+    while (features->has_next_batch()) {
+        auto data  = features->data_batch();
+        auto label = features->label_batch();
+
+        for (size_t b = 0; b < etl::dim<0>(data); ++b, ++i) {
+            REQUIRE(etl::approx_equals(data(b), expected[i], 1e-5));
+            REQUIRE(label(b, dataset.training_labels[i]) == 1.0f);
+        }
+
+        features->next_batch();
+    }
+
+    REQUIRE(i == dataset.training_images.size());
+
+    std::remove("/tmp/dll_mnist_features.mmap");
+}
+
+// Use a threaded out-memory generator with a lock-free ring
+TEST_CASE("unit/augment/mnist/12", "[dbn][unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using ref_generator_t = dll::outmemory_data_generator_desc<dll::batch_size<16>, dll::categorical, dll::scale_pre<255>>;
+    using train_generator_t = dll::outmemory_data_generator_desc<dll::batch_size<16>, dll::big_batch_size<3>, dll::categorical, dll::scale_pre<255>, dll::threaded, dll::workers<2>, dll::lock_free>;
+
+    auto ref_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        ref_generator_t{});
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    for (size_t epoch = 0; epoch < 3; ++epoch) {
+        ref_generator->reset();
+        train_generator->reset();
+
+        while (ref_generator->has_next_batch()) {
+            REQUIRE(train_generator->has_next_batch());
+
+            REQUIRE(etl::approx_equals(train_generator->data_batch(), ref_generator->data_batch(), 0.0001));
+            REQUIRE(etl::approx_equals(train_generator->label_batch(), ref_generator->label_batch(), 0.0001));
+
+            ref_generator->next_batch();
+            train_generator->next_batch();
+        }
+
+        REQUIRE(!train_generator->has_next_batch());
+    }
+}
+
+// Use an out-memory generator with background prefetching
+TEST_CASE("unit/augment/mnist/13", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::outmemory_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<3>, dll::prefetch, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use an in-memory generator with index shuffling
+TEST_CASE("unit/augment/mnist/14", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<20>, dll::shuffle>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::index_shuffle, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use an in-memory generator storing the samples as bytes
+TEST_CASE("unit/augment/mnist/15", "[dbn][unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    using ref_generator_t   = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::categorical, dll::scale_pre<255>>;
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::storage_type<uint8_t>, dll::categorical, dll::scale_pre<255>>;
+
+    auto ref_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        ref_generator_t{});
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    REQUIRE(etl::size(train_generator->input_cache) == etl::size(ref_generator->input_cache));
+
+    while (ref_generator->has_next_batch()) {
+        REQUIRE(train_generator->has_next_batch());
+
+        REQUIRE(etl::approx_equals(train_generator->data_batch(), ref_generator->data_batch(), 0.0001));
+        REQUIRE(etl::approx_equals(train_generator->label_batch(), ref_generator->label_batch(), 0.0001));
+
+        ref_generator->next_batch();
+        train_generator->next_batch();
+    }
+
+    REQUIRE(!train_generator->has_next_batch());
+}
+
+// Use an in-memory generator with index labels
+TEST_CASE("unit/augment/mnist/16", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(610);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::categorical, dll::index_labels, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    REQUIRE(etl::size(train_generator->label_cache) == dataset.training_images.size());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Statistics of the pipeline of a threaded generator
+TEST_CASE("unit/augment/mnist/17", "[dbn][unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::big_batch_size<3>, dll::workers<2>, dll::noise<20>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    train_generator->set_train();
+    train_generator->reset();
+
+    while (train_generator->has_next_batch()) {
+        train_generator->next_batch();
+    }
+
+    auto stats = train_generator->stats();
+
+    REQUIRE(stats.batches == train_generator->batches());
+
+    stats.display(std::cout) << std::endl;
+
+    // A new generation starts with fresh counters
+    train_generator->reset();
+
+    REQUIRE(train_generator->stats().batches <= 3);
+}
+
+// Use an in-memory generator with reduced precision (bfloat16) storage
+TEST_CASE("unit/augment/mnist/18", "[dbn][unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    using ref_generator_t   = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::categorical, dll::scale_pre<255>>;
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::storage_type<dll::bfloat16>, dll::categorical, dll::scale_pre<255>>;
+
+    auto ref_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        ref_generator_t{});
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    REQUIRE(sizeof(etl::value_t<decltype(train_generator->input_cache)>) == 2);
+
+    // The pixels (0-255) are exactly represented in bfloat16
+    while (ref_generator->has_next_batch()) {
+        REQUIRE(train_generator->has_next_batch());
+
+        REQUIRE(etl::approx_equals(train_generator->data_batch(), ref_generator->data_batch(), 0.0001));
+        REQUIRE(etl::approx_equals(train_generator->label_batch(), ref_generator->label_batch(), 0.0001));
+
+        ref_generator->next_batch();
+        train_generator->next_batch();
+    }
+
+    REQUIRE(!train_generator->has_next_batch());
+}
+
+// Use an in-memory auto-encoder generator with salt-and-pepper noise
+TEST_CASE("unit/augment/mnist/19", "[dbn][unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::noise<30>, dll::corruption<dll::corruption_type::SALT_PEPPER>,
+                                                          dll::autoencoder, dll::binarize_pre<30>>;
+
+    auto generator = dll::make_generator(
+        dataset.training_images, dataset.training_images,
+        dataset.training_images.size(), 28 * 28,
+        generator_t{});
+
+    generator->set_train();
+    generator->reset();
+
+    size_t values  = 0;
+    size_t changed = 0;
+
+    while (generator->has_next_batch()) {
+        auto data  = generator->data_batch();
+        auto label = generator->label_batch();
+
+        for (size_t i = 0; i < etl::size(data); ++i) {
+            REQUIRE((data[i] == 0.0f || data[i] == 1.0f));
+            REQUIRE((label[i] == 0.0f || label[i] == 1.0f));
+
+            changed += data[i] != label[i];
+            ++values;
+        }
+
+        generator->next_batch();
+    }
+
+    // Half of the corrupted values keep their value
+    REQUIRE(double(changed) / values == Approx(0.15).epsilon(0.2));
+}
+
+// Use an in-memory generator with virtual copies of each sample
+TEST_CASE("unit/augment/mnist/20", "[dbn][unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 3>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::horizontal_mirroring, dll::copy<3>, dll::categorical>;
+
+    auto generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    // Each sample is only stored once
+    REQUIRE(generator->size() == 300);
+    REQUIRE(generator->stored_size() == 100);
+    REQUIRE(etl::dim<0>(generator->input_cache) == 100);
+    REQUIRE(generator->batches() == 12);
+
+    generator->set_train();
+    generator->reset_shuffle();
+
+    std::vector<size_t> labels(10, 0);
+    size_t samples = 0;
+
+    while (generator->has_next_batch()) {
+        auto label = generator->label_batch();
+
+        for (size_t i = 0; i < etl::dim<0>(label); ++i) {
+            ++labels[etl::max_index(label(i))];
+            ++samples;
+        }
+
+        generator->next_batch();
+    }
+
+    REQUIRE(samples == 300);
+
+    // Each label is seen three times
+    for (size_t l = 0; l < 10; ++l) {
+        REQUIRE(labels[l] == 3 * size_t(std::count(dataset.training_labels.begin(), dataset.training_labels.end(), l)));
+    }
+}
@@ -204,3 +204,250 @@ TEST_CASE("unit/bn/5", "[unit][bn]") {
     FT_CHECK_2_VAL(net, dataset, 50, 5e-2);
     TEST_CHECK_2(net, dataset, 0.25);
 }
+
+// Folding BN into the preceding layer does not change the output
+TEST_CASE("unit/bn/fold/1", "[unit][bn]") {
+    dll::dense_layer_desc<13, 7, dll::no_activation>::layer_t dense;
+    dll::batch_normalization_2d_layer_desc<7>::layer_t bn_2d;
+
+    dll::conv_layer_desc<3, 8, 8, 4, 3, 3, dll::no_activation>::layer_t conv;
+    dll::batch_normalization_4d_layer_desc<4, 6, 6>::layer_t bn_4d;
+
+    bn_2d.gamma = etl::uniform_generator(0.5, 1.5);
+    bn_2d.beta  = etl::uniform_generator(-1.0, 1.0);
+    bn_2d.mean  = etl::uniform_generator(-1.0, 1.0);
+    bn_2d.var   = etl::uniform_generator(0.5, 2.0);
+
+    bn_4d.gamma = etl::uniform_generator(0.5, 1.5);
+    bn_4d.beta  = etl::uniform_generator(-1.0, 1.0);
+    bn_4d.mean  = etl::uniform_generator(-1.0, 1.0);
+    bn_4d.var   = etl::uniform_generator(0.5, 2.0);
+
+    etl::fast_matrix<float, 8, 13> x;
+    etl::fast_matrix<float, 4, 3, 8, 8> y;
+
+    x = etl::uniform_generator(-2.0, 2.0);
+    y = etl::uniform_generator(-2.0, 2.0);
+
+    etl::fast_matrix<float, 8, 7> x_tmp;
+    etl::fast_matrix<float, 8, 7> x_ref;
+    etl::fast_matrix<float, 4, 4, 6, 6> y_tmp;
+    etl::fast_matrix<float, 4, 4, 6, 6> y_ref;
+
+    dense.forward_batch(x_tmp, x);
+    bn_2d.test_forward_batch(x_ref, x_tmp);
+
+    conv.forward_batch(y_tmp, y);
+    bn_4d.test_forward_batch(y_ref, y_tmp);
+
+    REQUIRE(bn_2d.foldable_into<decltype(dense)>());
+    REQUIRE(bn_4d.foldable_into<decltype(conv)>());
+
+    bn_2d.fold_into(dense);
+    bn_4d.fold_into(conv);
+
+    etl::fast_matrix<float, 8, 7> x_folded;
+    etl::fast_matrix<float, 4, 4, 6, 6> y_folded;
+
+    dense.forward_batch(x_tmp, x);
+    bn_2d.test_forward_batch(x_folded, x_tmp);
+
+    conv.forward_batch(y_tmp, y);
+    bn_4d.test_forward_batch(y_folded, y_tmp);
+
+    REQUIRE(etl::approx_equals(x_folded, x_ref, 1e-4));
+    REQUIRE(etl::approx_equals(y_folded, y_ref, 1e-4));
+}
+
+// Only the BN layers following a linear layer with biases are folded
+TEST_CASE("unit/bn/fold/2", "[unit][bn]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 5, 5, dll::no_activation>::layer_t,
+            dll::batch_normalization_4d_layer_desc<6, 24, 24>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+
+            dll::dense_layer_desc<6 * 24 * 24, 200, dll::no_activation>::layer_t,
+            dll::batch_normalization_2d_layer_desc<200>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+
+            dll::dense_layer_desc<200, 200, dll::no_bias, dll::no_activation>::layer_t,
+            dll::batch_normalization_2d_layer_desc<200>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+
+            dll::dense_layer_desc<200, 10, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SOFTMAX>::layer_t
+        >,
+        dll::updater<dll::updater_type::ADADELTA>, dll::early_training, dll::batch_size<25>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 2500, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->learning_rate = 0.01;
+
+    FT_CHECK_2_VAL(net, dataset, 25, 5e-2);
+
+    auto test_error = net->evaluate_error(dataset.test());
+
+    REQUIRE(net->fold_batch_normalization() == 2);
+    REQUIRE(net->fold_batch_normalization() == 0);
+
+    REQUIRE(net->layer_get<1>().folded);
+    REQUIRE(net->layer_get<4>().folded);
+    REQUIRE(!net->layer_get<7>().folded);
+
+    REQUIRE(net->evaluate_error(dataset.test()) == Approx(test_error).epsilon(0.01));
+}
+
+// The single-pass statistics match the two-pass ones
+TEST_CASE("unit/bn/statistics", "[unit][bn]") {
+    etl::fast_matrix<float, 9, 13> x;
+    etl::fast_matrix<float, 5, 3, 6, 7> y;
+
+    x = etl::uniform_generator(5.0, 7.0);
+    y = etl::uniform_generator(-3.0, 1.0);
+
+    etl::fast_matrix<float, 13> x_mean;
+    etl::fast_matrix<float, 13> x_var;
+    etl::fast_matrix<float, 3> y_mean;
+    etl::fast_matrix<float, 3> y_var;
+
+    dll::bn_statistics_2d(x, x_mean, x_var);
+    dll::bn_statistics_4d(y, y_mean, y_var);
+
+    etl::fast_matrix<float, 13> x_mean_ref;
+    etl::fast_matrix<float, 13> x_var_ref;
+    etl::fast_matrix<float, 3> y_mean_ref;
+    etl::fast_matrix<float, 3> y_var_ref;
+
+    x_mean_ref = etl::bias_batch_mean_2d(x);
+    x_var_ref  = etl::bias_batch_var_2d(x, x_mean_ref);
+    y_mean_ref = etl::bias_batch_mean_4d(y);
+    y_var_ref  = 0;
+
+    for (size_t b = 0; b < 5; ++b) {
+        for (size_t k = 0; k < 3; ++k) {
+            y_var_ref(k) += etl::sum((y(b)(k) - y_mean_ref(k)) >> (y(b)(k) - y_mean_ref(k)));
+        }
+    }
+
+    y_var_ref /= 5 * 6 * 7;
+
+    REQUIRE(etl::approx_equals(x_mean, x_mean_ref, 1e-4));
+    REQUIRE(etl::approx_equals(x_var, x_var_ref, 1e-4));
+    REQUIRE(etl::approx_equals(y_mean, y_mean_ref, 1e-4));
+    REQUIRE(etl::approx_equals(y_var, y_var_ref, 1e-4));
+}
+
+namespace {
+
+// Simulate a second rank, whose sums have already been computed
+struct simulated_rank_transport : dll::distributed_transport {
+    std::vector<double> other; ///< The sums of the other rank
+
+    size_t rank() const override {
+        return 0;
+    }
+
+    size_t size() const override {
+        return 2;
+    }
+
+    void allreduce(float* data, size_t n) override {
+        for (size_t i = 0; i < n; ++i) {
+            data[i] += other[i];
+        }
+    }
+
+    void allreduce(double* data, size_t n) override {
+        for (size_t i = 0; i < n; ++i) {
+            data[i] += other[i];
+        }
+    }
+
+    void broadcast(float* /*data*/, size_t /*n*/) override {}
+    void broadcast(double* /*data*/, size_t /*n*/) override {}
+};
+
+} // end of anonymous namespace
+
+// The synchronized statistics are the ones of the batches of all the ranks
+TEST_CASE("unit/bn/sync", "[unit][bn]") {
+    etl::fast_matrix<float, 18, 13> x;
+
+    x = etl::uniform_generator(5.0, 7.0);
+
+    auto x_1 = etl::force_temporary(etl::slice(x, 0, 9));
+    auto x_2 = etl::force_temporary(etl::slice(x, 9, 18));
+
+    etl::fast_matrix<float, 13> mean_2;
+    etl::fast_matrix<float, 13> var_2;
+
+    dll::bn_statistics_2d(x_2, mean_2, var_2);
+
+    simulated_rank_transport transport;
+
+    for (size_t k = 0; k < 13; ++k) {
+        transport.other.push_back(9.0 * mean_2[k]);
+    }
+
+    for (size_t k = 0; k < 13; ++k) {
+        transport.other.push_back(9.0 * (var_2[k] + mean_2[k] * mean_2[k]));
+    }
+
+    transport.other.push_back(9.0);
+
+    dll::batch_normalization_2d_layer_desc<13>::layer_t layer;
+
+    dll::bn_statistics_2d(x_1, layer.last_mean, layer.last_var);
+
+    // Without synchronization, the statistics are the local ones
+    REQUIRE(dll::bn_sync_statistics(layer, 9) == 9);
+
+    layer.sync = &transport;
+
+    REQUIRE(dll::bn_sync_statistics(layer, 9) == 18);
+
+    etl::fast_matrix<float, 13> mean_ref;
+    etl::fast_matrix<float, 13> var_ref;
+
+    dll::bn_statistics_2d(x, mean_ref, var_ref);
+
+    REQUIRE(etl::approx_equals(layer.last_mean, mean_ref, 1e-4));
+    REQUIRE(etl::approx_equals(layer.last_var, var_ref, 1e-3));
+}
+
+// Once the arena has seen a step, the temporaries of the steps allocate nothing
+TEST_CASE("unit/bn/arena", "[unit][bn]") {
+    etl::dyn_matrix<float, 4> errors(5, 4, 6, 6);
+    errors = etl::uniform_generator(-1.0, 1.0);
+
+    dll::step_arena arena;
+
+    for (size_t step = 0; step < 2; ++step) {
+        dll::arena_scope scope(arena);
+
+        auto dxhat = dll::arena_temporary(errors >> errors);
+        auto tmp   = dll::arena_temporary_dim_only(errors);
+
+        REQUIRE(etl::size(dxhat.matrix) == etl::size(errors));
+        REQUIRE(dxhat.matrix.memory_start() != tmp.matrix.memory_start());
+        REQUIRE(dxhat.matrix(1, 2, 3, 4) == Approx(errors(1, 2, 3, 4) * errors(1, 2, 3, 4)));
+    }
+
+    REQUIRE(arena.size() >= 2 * etl::size(errors) * sizeof(float));
+
+    const size_t allocations = dll::workspace_allocations();
+
+    for (size_t step = 0; step < 3; ++step) {
+        dll::arena_scope scope(arena);
+
+        auto dxhat = dll::arena_temporary(errors >> errors);
+        auto tmp   = dll::arena_temporary_dim_only(errors);
+
+        tmp.matrix = dxhat.matrix + errors;
+    }
+
+    REQUIRE(dll::workspace_allocations() == allocations);
+}
@@ -0,0 +1,179 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "dll_test.hpp"
+
+#include "dll/neural/conv_1d_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/network.hpp"
+#include "dll/datasets.hpp"
+
+namespace {
+
+/*!
+ * \brief Check the 1D kernels against the 2D convolutions of ETL, the
+ * sequences being single-channel images (L x C) and the filters (NW x C).
+ */
+template <size_t C>
+void check_conv_1d_kernels() {
+    constexpr size_t B  = 2;
+    constexpr size_t L  = 9;
+    constexpr size_t K  = 4;
+    constexpr size_t NW = 3;
+    constexpr size_t LO = L - NW + 1;
+
+    etl::fast_dyn_matrix<float, B, L, C> input;
+    etl::fast_dyn_matrix<float, NW, C, K> w;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+    w     = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, B, LO, K> output;
+    etl::fast_dyn_matrix<float, B, L, C> back;
+    etl::fast_dyn_matrix<float, NW, C, K> grad;
+
+    dll::conv_1d_forward(input.memory_start(), w.memory_start(), output.memory_start(), B, L, C, K, NW);
+    dll::conv_1d_backward(output.memory_start(), w.memory_start(), back.memory_start(), B, L, C, K, NW);
+    dll::conv_1d_backward_filter(input.memory_start(), output.memory_start(), grad.memory_start(), B, L, C, K, NW);
+
+    etl::fast_dyn_matrix<float, B, 1, L, C> input_2d;
+    etl::fast_dyn_matrix<float, B, K, LO, 1> output_2d;
+    etl::fast_dyn_matrix<float, K, 1, NW, C> w_2d;
+
+    for (size_t b = 0; b < B; ++b) {
+        input_2d(b)(0) = input(b);
+
+        for (size_t t = 0; t < LO; ++t) {
+            for (size_t k = 0; k < K; ++k) {
+                output_2d(b, k, t, 0) = output(b, t, k);
+            }
+        }
+    }
+
+    for (size_t j = 0; j < NW; ++j) {
+        for (size_t c = 0; c < C; ++c) {
+            for (size_t k = 0; k < K; ++k) {
+                w_2d(k, 0, j, c) = w(j, c, k);
+            }
+        }
+    }
+
+    etl::fast_dyn_matrix<float, B, K, LO, 1> ref_output;
+    etl::fast_dyn_matrix<float, B, 1, L, C> ref_back;
+    etl::fast_dyn_matrix<float, K, 1, NW, C> ref_grad;
+
+    ref_output = etl::ml::convolution_forward(input_2d, w_2d);
+    ref_back   = etl::ml::convolution_backward(output_2d, w_2d);
+    ref_grad   = etl::ml::convolution_backward_filter(input_2d, output_2d);
+
+    REQUIRE(etl::approx_equals(output_2d, ref_output, 1e-4));
+
+    for (size_t b = 0; b < B; ++b) {
+        REQUIRE(etl::approx_equals(back(b), ref_back(b)(0), 1e-3));
+    }
+
+    for (size_t j = 0; j < NW; ++j) {
+        for (size_t c = 0; c < C; ++c) {
+            for (size_t k = 0; k < K; ++k) {
+                REQUIRE(grad(j, c, k) == Approx(ref_grad(k, 0, j, c)).epsilon(1e-3));
+            }
+        }
+    }
+}
+
+} // end of anonymous namespace
+
+// Sequences of 28 steps of 28 channels
+TEST_CASE("unit/conv_1d/1", "[unit][conv_1d]") {
+    auto dataset = dll::make_mnist_dataset_nc_sub(0, 1000, dll::batch_size<50>{}, dll::scale_pre<255>{});
+
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::conv_1d_layer<28, 28, 16, 5, dll::relu>,
+            dll::mp_1d_layer<24, 16, 2>,
+            dll::dense_layer<12 * 16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAM>
+        , dll::batch_size<50>
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    REQUIRE(net->fine_tune(dataset.train(), 25) < 0.15);
+    REQUIRE(net->evaluate_error(dataset.test()) < 0.25);
+}
+
+// The dynamic layers, with the GEMM kernels
+TEST_CASE("unit/conv_1d/2", "[unit][conv_1d]") {
+    auto dataset = dll::make_mnist_dataset_nc_sub(0, 1000, dll::batch_size<50>{}, dll::scale_pre<255>{});
+
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::conv_1d_layer<28, 28, 40, 3, dll::relu>,
+            dll::dyn_conv_1d_layer<dll::relu>,
+            dll::dyn_mp_1d_layer<>,
+            dll::dense_layer<12 * 16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAM>
+        , dll::batch_size<50>
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    net->template layer_get<1>().init_layer(26, 40, 16, 3);
+    net->template layer_get<2>().init_layer(24, 16, 2);
+
+    REQUIRE(net->fine_tune(dataset.train(), 25) < 0.15);
+    REQUIRE(net->evaluate_error(dataset.test()) < 0.25);
+}
+
+// The direct and the GEMM kernels compute the same convolutions as ETL
+TEST_CASE("unit/conv_1d/kernels", "[unit][conv_1d]") {
+    check_conv_1d_kernels<3>();
+    check_conv_1d_kernels<dll::conv_1d_gemm_channels + 8>();
+}
+
+TEST_CASE("unit/conv_1d/mp", "[unit][conv_1d]") {
+    dll::mp_1d_layer<6, 3, 2> layer;
+
+    etl::fast_dyn_matrix<float, 2, 6, 3> input;
+    etl::fast_dyn_matrix<float, 2, 3, 3> output;
+    etl::fast_dyn_matrix<float, 2, 3, 3> train_output;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    layer.forward_batch(output, input);
+    layer.train_forward_batch(train_output, input);
+
+    for (size_t b = 0; b < 2; ++b) {
+        for (size_t o = 0; o < 3; ++o) {
+            for (size_t c = 0; c < 3; ++c) {
+                REQUIRE(output(b, o, c) == std::max(input(b, 2 * o, c), input(b, 2 * o + 1, c)));
+                REQUIRE(train_output(b, o, c) == output(b, o, c));
+            }
+        }
+    }
+
+    // The errors go back to the steps of the maximums
+    etl::fast_dyn_matrix<float, 2, 3, 3> errors;
+    etl::fast_dyn_matrix<float, 2, 6, 3> back;
+
+    errors = etl::uniform_generator(-1.0, 1.0);
+
+    dll::max_pool_1d_argmax_backward(back, errors, 2, layer.argmax);
+
+    for (size_t b = 0; b < 2; ++b) {
+        for (size_t t = 0; t < 6; ++t) {
+            for (size_t c = 0; c < 3; ++c) {
+                const float expected = input(b, t, c) == output(b, t / 2, c) ? errors(b, t / 2, c) : 0.0f;
+
+                REQUIRE(back(b, t, c) == expected);
+            }
+        }
+    }
+}
@@ -10,9 +10,11 @@
 #include "dll_test.hpp"
 
 #include "dll/neural/conv_layer.hpp"
+#include "dll/neural/conv_mp_layer.hpp"
 #include "dll/neural/dense_layer.hpp"
 #include "dll/dbn.hpp"
 #include "dll/pooling/mp_layer.hpp"
+#include "dll/pooling/dyn_mp_layer.hpp"
 #include "dll/pooling/avgp_layer.hpp"
 
 #include "mnist/mnist_reader.hpp"
@@ -92,3 +94,154 @@ TEST_CASE("unit/conv/sgd/8", "[unit][conv][dbn][mnist][sgd]") {
     FT_CHECK(25, 6e-2);
     TEST_CHECK(0.25);
 }
+
+// The recorded argmax gives the same backward pass as the input
+TEST_CASE("unit/conv/mp/argmax", "[unit][conv][mp]") {
+    struct context_2d {
+        etl::fast_dyn_matrix<float, 3, 2, 8, 8> input;
+        etl::fast_dyn_matrix<float, 3, 2, 4, 4> output;
+        etl::fast_dyn_matrix<float, 3, 2, 4, 4> errors;
+    };
+
+    struct context_3d {
+        etl::fast_dyn_matrix<float, 3, 4, 8, 8> input;
+        etl::fast_dyn_matrix<float, 3, 2, 4, 4> output;
+        etl::fast_dyn_matrix<float, 3, 2, 4, 4> errors;
+    };
+
+    dll::mp_2d_layer<2, 8, 8, 2, 2> mp_2d;
+    dll::mp_3d_layer<4, 8, 8, 2, 2, 2> mp_3d;
+
+    dll::dyn_mp_2d_layer<> dyn_mp_2d;
+    dyn_mp_2d.init_layer(2, 8, 8, 2, 2);
+
+    dll::dyn_mp_3d_layer<> dyn_mp_3d;
+    dyn_mp_3d.init_layer(4, 8, 8, 2, 2, 2);
+
+    context_2d c2;
+    c2.input  = etl::uniform_generator(-1.0, 1.0);
+    c2.errors = etl::uniform_generator(-1.0, 1.0);
+
+    context_3d c3;
+    c3.input  = etl::uniform_generator(-1.0, 1.0);
+    c3.errors = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, 2, 4, 4> out_2d;
+    etl::fast_dyn_matrix<float, 3, 2, 4, 4> out_3d;
+
+    mp_2d.forward_batch(c2.output, c2.input);
+    mp_2d.train_forward_batch(out_2d, c2.input);
+    REQUIRE(etl::approx_equals(out_2d, c2.output, 1e-6));
+
+    mp_3d.forward_batch(c3.output, c3.input);
+    mp_3d.train_forward_batch(out_3d, c3.input);
+    REQUIRE(etl::approx_equals(out_3d, c3.output, 1e-6));
+
+    etl::fast_dyn_matrix<float, 3, 2, 8, 8> back_2d;
+    etl::fast_dyn_matrix<float, 3, 4, 8, 8> back_3d;
+
+    mp_2d.backward_batch(back_2d, c2);
+    REQUIRE(etl::approx_equals(back_2d, etl::ml::max_pool_backward<2, 2>(c2.input, c2.output, c2.errors), 1e-6));
+
+    mp_3d.backward_batch(back_3d, c3);
+    REQUIRE(etl::approx_equals(back_3d, etl::ml::max_pool_3d_backward<2, 2, 2>(c3.input, c3.output, c3.errors), 1e-6));
+
+    dyn_mp_2d.train_forward_batch(out_2d, c2.input);
+    dyn_mp_2d.backward_batch(back_2d, c2);
+    REQUIRE(etl::approx_equals(back_2d, etl::ml::max_pool_backward<2, 2>(c2.input, c2.output, c2.errors), 1e-6));
+
+    dyn_mp_3d.train_forward_batch(out_3d, c3.input);
+    dyn_mp_3d.backward_batch(back_3d, c3);
+    REQUIRE(etl::approx_equals(back_3d, etl::ml::max_pool_3d_backward<2, 2, 2>(c3.input, c3.output, c3.errors), 1e-6));
+}
+
+TEST_CASE("unit/conv/sgd/9", "[unit][conv][mp][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_mp_layer<1, 28, 28, 6, 5, 5, 2, 2, dll::relu>,
+            dll::conv_layer<6, 12, 12, 5, 3, 3, dll::relu>,
+            dll::dense_layer<5 * 10 * 10, 100, dll::relu>,
+            dll::dense_layer<100, 10, dll::softmax>
+        >,
+        dll::updater<dll::updater_type::MOMENTUM>,
+        dll::batch_size<20>
+    >::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(2000);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->display();
+
+    dbn->learning_rate = 0.005;
+
+    FT_CHECK(50, 6e-2);
+    TEST_CHECK(0.25);
+}
+
+// The fused layer computes the same forward and backward passes as a
+// convolutional layer followed by a max pooling layer
+TEST_CASE("unit/conv/mp/fused", "[unit][conv][mp]") {
+    struct context_conv {
+        etl::fast_dyn_matrix<float, 4, 2, 10, 10> input;
+        etl::fast_dyn_matrix<float, 4, 3, 8, 8> output;
+        etl::fast_dyn_matrix<float, 4, 3, 8, 8> errors;
+    };
+
+    struct context_mp {
+        etl::fast_dyn_matrix<float, 4, 3, 8, 8> input;
+        etl::fast_dyn_matrix<float, 4, 3, 4, 4> output;
+        etl::fast_dyn_matrix<float, 4, 3, 4, 4> errors;
+    };
+
+    struct context_fused {
+        etl::fast_dyn_matrix<float, 4, 2, 10, 10> input;
+        etl::fast_dyn_matrix<float, 4, 3, 4, 4> output;
+        etl::fast_dyn_matrix<float, 4, 3, 4, 4> errors;
+    };
+
+    dll::conv_layer<2, 10, 10, 3, 3, 3, dll::sigmoid> conv;
+    dll::mp_2d_layer<3, 8, 8, 2, 2> mp;
+    dll::conv_mp_layer<2, 10, 10, 3, 3, 3, 2, 2, dll::sigmoid> fused;
+
+    conv.b  = etl::uniform_generator(-1.0, 1.0);
+    fused.w = conv.w;
+    fused.b = conv.b;
+
+    context_conv c_conv;
+    context_mp c_mp;
+    context_fused c_fused;
+
+    c_conv.input  = etl::uniform_generator(-1.0, 1.0);
+    c_fused.input = c_conv.input;
+
+    conv.train_forward_batch(c_conv.output, c_conv.input);
+    c_mp.input = c_conv.output;
+    mp.train_forward_batch(c_mp.output, c_mp.input);
+
+    fused.train_forward_batch(c_fused.output, c_fused.input);
+    REQUIRE(etl::approx_equals(c_fused.output, c_mp.output, 1e-5));
+
+    etl::fast_dyn_matrix<float, 4, 3, 4, 4> inference;
+    fused.forward_batch(inference, c_fused.input);
+    REQUIRE(etl::approx_equals(inference, c_mp.output, 1e-5));
+
+    c_mp.errors    = etl::uniform_generator(-1.0, 1.0);
+    c_fused.errors = c_mp.errors;
+
+    mp.backward_batch(c_conv.errors, c_mp);
+    conv.adapt_errors(c_conv);
+
+    etl::fast_dyn_matrix<float, 4, 2, 10, 10> back_conv;
+    etl::fast_dyn_matrix<float, 4, 2, 10, 10> back_fused;
+
+    conv.backward_batch(back_conv, c_conv);
+
+    fused.adapt_errors(c_fused);
+    fused.backward_batch(back_fused, c_fused);
+
+    REQUIRE(etl::approx_equals(back_fused, back_conv, 1e-5));
+}
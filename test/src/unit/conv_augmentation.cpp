@@ -421,3 +421,74 @@ TEST_CASE("unit/augment/conv/mnist/11", "[dbn][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     CHECK(test_error < 0.3);
 }
+
+TEST_CASE("unit/augment/conv/mnist/12", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 3, 3>::layer_t,
+            dll::mp_2d_layer_desc<6, 26, 26, 2, 2>::layer_t,
+            dll::dense_layer_desc<6 * 13 * 13, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::updater<dll::updater_type::MOMENTUM>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(400);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::elastic_distortion<3>, dll::categorical, dll::scale_pre<255>>;
+    using test_generator_t  = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        test_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Center crop (test mode) of compact samples, with the fused crop and pre-transform
+TEST_CASE("unit/augment/conv/mnist/13", "[dbn][unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::random_crop<24, 24>, dll::horizontal_mirroring,
+                                                           dll::storage_type<uint8_t>, dll::categorical, dll::scale_pre<255>>;
+
+    auto generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    generator->set_test();
+    generator->reset();
+
+    size_t n = 0;
+
+    while (generator->has_next_batch()) {
+        auto batch = generator->data_batch();
+
+        for (size_t i = 0; i < etl::dim<0>(batch); ++i, ++n) {
+            for (size_t y = 0; y < 24; ++y) {
+                for (size_t x = 0; x < 24; ++x) {
+                    REQUIRE(batch(i, 0, y, x) == Approx(dataset.training_images[n](0, 2 + y, 2 + x) / 255.0f));
+                }
+            }
+        }
+
+        generator->next_batch();
+    }
+
+    REQUIRE(n == dataset.training_images.size());
+}
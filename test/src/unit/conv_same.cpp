@@ -5,12 +5,16 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <cstdio>
 #include <deque>
+#include <thread>
 
 #include "dll_test.hpp"
 
 #include "dll/neural/conv_same_layer.hpp"
+#include "dll/neural/upsample_conv_layer.hpp"
 #include "dll/neural/conv_layer.hpp"
+#include "dll/neural/deconv_layer.hpp"
 #include "dll/neural/dense_layer.hpp"
 #include "dll/dbn.hpp"
 #include "dll/pooling/mp_layer.hpp"
@@ -58,3 +62,539 @@ TEST_CASE("unit/conv/same/2", "[conv][dbn][mnist][sgd]") {
     FT_CHECK(100, 5e-2);
     TEST_CHECK(0.2);
 }
+
+// The Winograd kernels compute the same convolutions as ETL
+TEST_CASE("unit/conv/same/winograd", "[conv][unit]") {
+    etl::fast_dyn_matrix<float, 3, 2, 7, 6> input;
+    etl::fast_dyn_matrix<float, 4, 2, 3, 3> w;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+    w     = etl::uniform_generator(-1.0, 1.0);
+
+    dll::winograd_filters<float> u;
+
+    // Same padding
+    {
+        etl::fast_dyn_matrix<float, 3, 4, 7, 6> output;
+        etl::fast_dyn_matrix<float, 3, 2, 7, 6> back;
+        etl::fast_dyn_matrix<float, 4, 2, 3, 3> grad;
+
+        dll::winograd_forward(input, u.get(w), output, 2, 7, 6, 4, 1);
+        REQUIRE(etl::approx_equals(output, etl::ml::convolution_forward<1, 1, 1, 1>(input, w), 1e-4));
+
+        dll::winograd_backward(output, u.get(w), back, 2, 7, 6, 4, 1);
+        REQUIRE(etl::approx_equals(back, etl::ml::convolution_backward<1, 1, 1, 1>(output, w), 1e-3));
+
+        dll::winograd_backward_filter(input, output, grad, 2, 7, 6, 4, 1);
+        REQUIRE(etl::approx_equals(grad, etl::ml::convolution_backward_filter<1, 1, 1, 1>(input, output), 1e-3));
+    }
+
+    // Valid convolution
+    {
+        etl::fast_dyn_matrix<float, 3, 4, 5, 4> output;
+        etl::fast_dyn_matrix<float, 3, 2, 7, 6> back;
+        etl::fast_dyn_matrix<float, 4, 2, 3, 3> grad;
+
+        dll::winograd_forward(input, u.get(w), output, 2, 7, 6, 4, 0);
+        REQUIRE(etl::approx_equals(output, etl::ml::convolution_forward(input, w), 1e-4));
+
+        dll::winograd_backward(output, u.get(w), back, 2, 7, 6, 4, 0);
+        REQUIRE(etl::approx_equals(back, etl::ml::convolution_backward(output, w), 1e-3));
+
+        dll::winograd_backward_filter(input, output, grad, 2, 7, 6, 4, 0);
+        REQUIRE(etl::approx_equals(grad, etl::ml::convolution_backward_filter(input, output), 1e-3));
+    }
+
+    // The cache is only recomputed once invalidated
+    w = 0.0;
+    REQUIRE(u.get(w)[0] != 0.0f);
+
+    u.invalidate();
+    REQUIRE(u.get(w)[0] == 0.0f);
+}
+
+// The kernels compute the same results in the workspace of the network
+TEST_CASE("unit/conv/same/workspace", "[conv][unit]") {
+    etl::fast_dyn_matrix<float, 3, 2, 7, 6> input;
+    etl::fast_dyn_matrix<float, 4, 2, 3, 3> w;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+    w     = etl::uniform_generator(-1.0, 1.0);
+
+    dll::winograd_filters<float> u;
+    dll::workspace ws;
+
+    etl::fast_dyn_matrix<float, 3, 4, 7, 6> output;
+    etl::fast_dyn_matrix<float, 3, 4, 7, 6> output_ws;
+    etl::fast_dyn_matrix<float, 4, 2, 3, 3> grad;
+    etl::fast_dyn_matrix<float, 4, 2, 3, 3> grad_ws;
+
+    dll::winograd_forward(input, u.get(w), output, 2, 7, 6, 4, 1);
+    dll::winograd_forward(input, u.get(w), output_ws, 2, 7, 6, 4, 1, &ws);
+    REQUIRE(etl::approx_equals(output, output_ws, 1e-6));
+
+    dll::winograd_backward_filter(input, output, grad, 2, 7, 6, 4, 1);
+    dll::winograd_backward_filter(input, output, grad_ws, 2, 7, 6, 4, 1, &ws);
+    REQUIRE(etl::approx_equals(grad, grad_ws, 1e-6));
+
+    // The arena only grows
+    const size_t size = ws.size();
+    REQUIRE(size > 0);
+
+    ws.reserve(16);
+    REQUIRE(ws.size() == size);
+
+    ws.reserve(dll::winograd_workspace_size<float>(2, 7, 6, 4, 1));
+    REQUIRE(ws.size() >= dll::winograd_workspace_size<float>(2, 7, 6, 4, 1));
+}
+
+// The boundary-aware kernels compute the padded convolutions of ETL
+TEST_CASE("unit/conv/same/boundary", "[conv][unit]") {
+    etl::fast_dyn_matrix<float, 3, 2, 7, 7> input;
+    etl::fast_dyn_matrix<float, 4, 2, 5, 5> w;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+    w     = etl::uniform_generator(-1.0, 1.0);
+
+    dll::workspace ws;
+
+    // Odd filters without strides
+    {
+        dll::same_conv_geometry g(2, 7, 7, 4, 5, 5);
+
+        REQUIRE(g.HO == 7);
+        REQUIRE(g.P1 == 2);
+
+        etl::fast_dyn_matrix<float, 3, 4, 7, 7> output;
+        etl::fast_dyn_matrix<float, 3, 2, 7, 7> back;
+        etl::fast_dyn_matrix<float, 4, 2, 5, 5> grad;
+
+        dll::same_conv_forward(input, w, output, g, &ws);
+        REQUIRE(etl::approx_equals(output, etl::ml::convolution_forward<1, 1, 2, 2>(input, w), 1e-4));
+
+        dll::same_conv_backward(output, w, back, g, &ws);
+        REQUIRE(etl::approx_equals(back, etl::ml::convolution_backward<1, 1, 2, 2>(output, w), 1e-3));
+
+        dll::same_conv_backward_filter(input, output, grad, g, &ws);
+        REQUIRE(etl::approx_equals(grad, etl::ml::convolution_backward_filter<1, 1, 2, 2>(input, output), 1e-3));
+    }
+
+    // Strided convolutions
+    {
+        etl::fast_dyn_matrix<float, 4, 2, 3, 3> w3;
+        w3 = etl::uniform_generator(-1.0, 1.0);
+
+        dll::same_conv_geometry g(2, 7, 7, 4, 3, 3, 2, 2);
+
+        REQUIRE(g.HO == 4);
+        REQUIRE(g.P1 == 1);
+
+        etl::fast_dyn_matrix<float, 3, 4, 4, 4> output;
+        etl::fast_dyn_matrix<float, 3, 2, 7, 7> back;
+        etl::fast_dyn_matrix<float, 4, 2, 3, 3> grad;
+
+        dll::same_conv_forward(input, w3, output, g, &ws);
+        REQUIRE(etl::approx_equals(output, etl::ml::convolution_forward<2, 2, 1, 1>(input, w3), 1e-4));
+
+        dll::same_conv_backward(output, w3, back, g, &ws);
+        REQUIRE(etl::approx_equals(back, etl::ml::convolution_backward<2, 2, 1, 1>(output, w3), 1e-3));
+
+        dll::same_conv_backward_filter(input, output, grad, g, &ws);
+        REQUIRE(etl::approx_equals(grad, etl::ml::convolution_backward_filter<2, 2, 1, 1>(input, output), 1e-3));
+    }
+
+    // Even filters are padded once more at the bottom and at the right
+    using even_layer_t = dll::conv_same_desc<2, 7, 7, 4, 2, 2, dll::strides<2>, dll::activation<dll::function::IDENTITY>>::layer_t;
+
+    auto layer = std::make_unique<even_layer_t>();
+
+    REQUIRE(even_layer_t::NH1 == 4);
+    REQUIRE(even_layer_t::P1 == 0);
+    REQUIRE(layer->output_size() == 4 * 4 * 4);
+
+    etl::fast_dyn_matrix<float, 3, 4, 4, 4> output;
+    etl::fast_dyn_matrix<float, 3, 4, 3, 3> ref;
+
+    layer->forward_batch(output, input);
+
+    // Only the last row and column see the extra padding
+    ref = etl::bias_add_4d(etl::ml::convolution_forward<2, 2, 0, 0>(input, layer->w), layer->b);
+
+    for (size_t b = 0; b < 3; ++b) {
+        for (size_t k = 0; k < 4; ++k) {
+            for (size_t i = 0; i < 3; ++i) {
+                for (size_t j = 0; j < 3; ++j) {
+                    REQUIRE(output(b, k, i, j) == Approx(ref(b, k, i, j)).epsilon(1e-4));
+                }
+            }
+        }
+    }
+}
+
+// The gradients of the filters reuse the lowering of the forward pass
+TEST_CASE("unit/conv/same/keep_lowered", "[conv][unit]") {
+    etl::fast_dyn_matrix<float, 3, 2, 7, 7> input;
+    etl::fast_dyn_matrix<float, 4, 2, 5, 5> w;
+    etl::fast_dyn_matrix<float, 3, 4, 7, 7> errors;
+
+    input  = etl::uniform_generator(-1.0, 1.0);
+    w      = etl::uniform_generator(-1.0, 1.0);
+    errors = etl::uniform_generator(-1.0, 1.0);
+
+    dll::same_conv_geometry g(2, 7, 7, 4, 5, 5);
+
+    REQUIRE(g.lowered());
+
+    etl::fast_dyn_matrix<float, 3, 4, 7, 7> output;
+    etl::fast_dyn_matrix<float, 4, 2, 5, 5> grad;
+
+    dll::workspace ws;
+
+    // Full precision
+    {
+        dll::same_conv_lowered<float> kept;
+
+        dll::same_conv_forward(input, w, output, g, &ws, &kept);
+        REQUIRE(kept.holds(3, input.memory_start()));
+        REQUIRE(etl::approx_equals(output, etl::ml::convolution_forward<1, 1, 2, 2>(input, w), 1e-4));
+
+        dll::same_conv_backward_filter(input, errors, grad, g, &ws, &kept);
+        REQUIRE(etl::approx_equals(grad, etl::ml::convolution_backward_filter<1, 1, 2, 2>(input, errors), 1e-3));
+    }
+
+    // Compact storage
+    {
+        dll::same_conv_lowered<dll::bfloat16> kept;
+
+        dll::same_conv_forward(input, w, output, g, &ws, &kept);
+        REQUIRE(kept.memory_size() == 3 * g.chunk_size() * sizeof(dll::bfloat16));
+
+        dll::same_conv_backward_filter(input, errors, grad, g, &ws, &kept);
+        REQUIRE(etl::approx_equals(grad, etl::ml::convolution_backward_filter<1, 1, 2, 2>(input, errors), 0.5));
+
+        // Another input is lowered again
+        etl::fast_dyn_matrix<float, 3, 2, 7, 7> other;
+        other = etl::uniform_generator(-1.0, 1.0);
+
+        REQUIRE(!kept.holds(3, other.memory_start()));
+
+        dll::same_conv_backward_filter(other, errors, grad, g, &ws, &kept);
+        REQUIRE(etl::approx_equals(grad, etl::ml::convolution_backward_filter<1, 1, 2, 2>(other, errors), 1e-3));
+    }
+}
+
+TEST_CASE("unit/conv/same/groups/1", "[conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 4, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+            dll::conv_same_desc<4, 26, 26, 8, 5, 5, dll::groups<2>, dll::activation<dll::function::SIGMOID>>::layer_t,
+            dll::dense_layer_desc<8 * 26 * 26, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    dbn->display();
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.2);
+}
+
+// Each group is an independent convolution of its own channels
+TEST_CASE("unit/conv/same/groups/2", "[conv][unit]") {
+    etl::fast_dyn_matrix<float, 3, 4, 7, 6> input;
+    etl::fast_dyn_matrix<float, 6, 2, 3, 3> w;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+    w     = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, 6, 7, 6> output;
+    etl::fast_dyn_matrix<float, 3, 4, 7, 6> back;
+    etl::fast_dyn_matrix<float, 6, 2, 3, 3> grad;
+
+    dll::grouped_conv_forward(input, w, output, 2, 1, 1);
+    dll::grouped_conv_backward(output, w, back, 2, 1, 1);
+    dll::grouped_conv_backward_filter(input, output, grad, 2, 1, 1);
+
+    for (size_t g = 0; g < 2; ++g) {
+        etl::fast_dyn_matrix<float, 3, 2, 7, 6> input_g;
+        etl::fast_dyn_matrix<float, 3, 3, 7, 6> output_g;
+        etl::fast_dyn_matrix<float, 3, 2, 3, 3> w_g;
+
+        for (size_t b = 0; b < 3; ++b) {
+            input_g(b)  = etl::slice(input(b), g * 2, (g + 1) * 2);
+            output_g(b) = etl::slice(output(b), g * 3, (g + 1) * 3);
+        }
+
+        w_g = etl::slice(w, g * 3, (g + 1) * 3);
+
+        etl::fast_dyn_matrix<float, 3, 3, 7, 6> ref_output;
+        etl::fast_dyn_matrix<float, 3, 2, 7, 6> ref_back;
+        etl::fast_dyn_matrix<float, 3, 2, 3, 3> ref_grad;
+
+        ref_output = etl::ml::convolution_forward<1, 1, 1, 1>(input_g, w_g);
+        ref_back   = etl::ml::convolution_backward<1, 1, 1, 1>(output_g, w_g);
+        ref_grad   = etl::ml::convolution_backward_filter<1, 1, 1, 1>(input_g, output_g);
+
+        for (size_t b = 0; b < 3; ++b) {
+            REQUIRE(etl::approx_equals(etl::slice(output(b), g * 3, (g + 1) * 3), ref_output(b), 1e-4));
+            REQUIRE(etl::approx_equals(etl::slice(back(b), g * 2, (g + 1) * 2), ref_back(b), 1e-3));
+        }
+
+        REQUIRE(etl::approx_equals(etl::slice(grad, g * 3, (g + 1) * 3), ref_grad, 1e-3));
+    }
+}
+
+// The fused layer computes an upsampling followed by a 'same' convolution
+TEST_CASE("unit/conv/same/upsample", "[conv][unit]") {
+    dll::upsample_conv_layer_desc<3, 5, 4, 2, 2, 4, 3, 3, dll::activation<dll::function::IDENTITY>>::layer_t layer;
+
+    etl::fast_dyn_matrix<float, 2, 3, 5, 4> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 2, 3, 10, 8> upsampled;
+    upsampled = etl::upsample_3d<1, 2, 2>(input);
+
+    etl::fast_dyn_matrix<float, 2, 4, 10, 8> output;
+    etl::fast_dyn_matrix<float, 2, 4, 10, 8> ref_output;
+
+    layer.forward_batch(output, input);
+    ref_output = etl::ml::convolution_forward<1, 1, 1, 1>(upsampled, layer.w);
+
+    REQUIRE(etl::approx_equals(output, ref_output, 1e-4));
+
+    // The errors of the upsampled pixels are summed into their source pixels
+    struct {
+        etl::fast_dyn_matrix<float, 2, 4, 10, 8> errors;
+    } context;
+
+    context.errors = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 2, 3, 5, 4> back;
+    etl::fast_dyn_matrix<float, 2, 3, 10, 8> ref_up_back;
+
+    layer.backward_batch(back, context);
+    ref_up_back = etl::ml::convolution_backward<1, 1, 1, 1>(context.errors, layer.w);
+
+    etl::fast_dyn_matrix<float, 2, 3, 5, 4> ref_back;
+    ref_back = 0.0f;
+
+    for (size_t b = 0; b < 2; ++b) {
+        for (size_t c = 0; c < 3; ++c) {
+            for (size_t y = 0; y < 10; ++y) {
+                for (size_t x = 0; x < 8; ++x) {
+                    ref_back(b, c, y / 2, x / 2) += ref_up_back(b, c, y, x);
+                }
+            }
+        }
+    }
+
+    REQUIRE(etl::approx_equals(back, ref_back, 1e-3));
+
+    etl::fast_dyn_matrix<float, 4, 3, 3, 3> grad;
+    etl::fast_dyn_matrix<float, 4, 3, 3, 3> ref_grad;
+
+    dll::upsample_conv_backward_filter(input, context.errors, grad, layer.geometry());
+    ref_grad = etl::ml::convolution_backward_filter<1, 1, 1, 1>(upsampled, context.errors);
+
+    REQUIRE(etl::approx_equals(grad, ref_grad, 1e-3));
+}
+
+// All the algorithms compute the same convolutions and the decisions are
+// reused from the file
+TEST_CASE("unit/conv/autotune", "[conv][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<2, 12, 12, 4, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+            dll::conv_layer_desc<4, 10, 10, 4, 5, 5, dll::activation<dll::function::SIGMOID>>::layer_t,
+            dll::dense_layer_desc<4 * 6 * 6, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<8>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 8, 2, 12, 12> input;
+    etl::fast_dyn_matrix<float, 8, 4, 10, 10> ref;
+    etl::fast_dyn_matrix<float, 8, 4, 10, 10> output;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    auto& layer = dbn->template layer_get<0>();
+
+    layer.forward_batch(ref, input);
+
+    for (auto a : {dll::conv_algorithm::BATCH, dll::conv_algorithm::PER_SAMPLE, dll::conv_algorithm::WINOGRAD}) {
+        layer.algorithm = a;
+        layer.forward_batch(output, input);
+
+        REQUIRE(etl::approx_equals(output, ref, 1e-4));
+    }
+
+    const std::string file = "/tmp/dll_conv_autotune.txt";
+
+    std::remove(file.c_str());
+
+    dbn->autotune_convolutions(8, file);
+
+    REQUIRE(dbn->template layer_get<0>().algorithm != dll::conv_algorithm::DEFAULT);
+    REQUIRE(dbn->template layer_get<1>().algorithm != dll::conv_algorithm::DEFAULT);
+    REQUIRE(dbn->template layer_get<1>().algorithm != dll::conv_algorithm::WINOGRAD);
+
+    dll::conv_tuning_cache cache;
+
+    REQUIRE(cache.load(file));
+    REQUIRE(cache.decisions.size() == 2);
+
+    // A second network takes the decisions from the file
+    auto copy = std::make_unique<dbn_t>();
+
+    copy->autotune_convolutions(8, file);
+
+    REQUIRE(copy->template layer_get<0>().algorithm == dbn->template layer_get<0>().algorithm);
+    REQUIRE(copy->template layer_get<1>().algorithm == dbn->template layer_get<1>().algorithm);
+
+    std::remove(file.c_str());
+}
+
+// The deconvolutions computed as the gradients of the input of the
+// convolutions match the generic full convolutions
+TEST_CASE("unit/conv/deconv/algorithms", "[conv][unit]") {
+    using layer_t = dll::deconv_layer_desc<2, 6, 6, 3, 3, 3, dll::activation<dll::function::IDENTITY>>::layer_t;
+
+    auto layer = std::make_unique<layer_t>();
+
+    etl::fast_dyn_matrix<float, 4, 2, 6, 6> input;
+    etl::fast_dyn_matrix<float, 4, 3, 8, 8> errors;
+    etl::fast_dyn_matrix<float, 4, 3, 8, 8> ref;
+    etl::fast_dyn_matrix<float, 4, 3, 8, 8> output;
+    etl::fast_dyn_matrix<float, 4, 2, 6, 6> ref_back;
+    etl::fast_dyn_matrix<float, 4, 2, 6, 6> back;
+
+    input  = etl::uniform_generator(-1.0, 1.0);
+    errors = etl::uniform_generator(-1.0, 1.0);
+
+    ref      = etl::bias_add_4d(etl::conv_4d_full_flipped(input, layer->w), layer->b);
+    ref_back = etl::conv_4d_valid_flipped(errors, layer->w);
+
+    for (auto a : {dll::conv_algorithm::BATCH, dll::conv_algorithm::PER_SAMPLE, dll::conv_algorithm::WINOGRAD}) {
+        layer->algorithm = a;
+        layer->forward_batch(output, input);
+
+        REQUIRE(etl::approx_equals(output, ref, 1e-4));
+
+        dll::deconv_backward(errors, layer->w, back, a, layer->w_transposed, nullptr);
+
+        REQUIRE(etl::approx_equals(back, ref_back, 1e-4));
+    }
+
+    // The cached filters follow the modifications of the weights
+    layer->w *= 2.0;
+    layer->invalidate_weights_cache();
+
+    ref = etl::bias_add_4d(etl::conv_4d_full_flipped(input, layer->w), layer->b);
+
+    layer->forward_batch(output, input);
+
+    REQUIRE(etl::approx_equals(output, ref, 1e-4));
+
+    dll::conv_tuning_cache cache;
+
+    layer->autotune(4, cache);
+
+    REQUIRE(layer->algorithm != dll::conv_algorithm::DEFAULT);
+    REQUIRE(cache.decisions.size() == 1);
+}
+
+TEST_CASE("unit/conv/inference_context", "[conv][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<2, 12, 12, 4, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+            dll::conv_layer_desc<4, 10, 10, 4, 5, 5, dll::activation<dll::function::SIGMOID>>::layer_t,
+            dll::dense_layer_desc<4 * 6 * 6, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<8>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 8, 2, 12, 12> input;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    auto ref = dbn->forward_batch(input);
+
+    constexpr size_t threads = 4;
+
+    std::vector<std::thread> workers;
+    std::vector<int> equals(threads, 0);
+
+    // The threads share the weights of the network, each with its own context
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&dbn, &input, &ref, &equals, t] {
+            auto context = dbn->make_inference_context();
+
+            bool all = true;
+
+            for (size_t i = 0; i < 10; ++i) {
+                auto output = dbn->forward_batch(context, input);
+
+                all = all && etl::approx_equals(output, ref, 1e-5);
+            }
+
+            equals[t] = all;
+        });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (size_t t = 0; t < threads; ++t) {
+        REQUIRE(equals[t]);
+    }
+}
+
+TEST_CASE("unit/conv/pool/small", "[conv][unit]") {
+    etl::fast_dyn_matrix<float, 4, 3, 12, 12> input;
+    etl::fast_dyn_matrix<float, 4, 3, 6, 6> pooled_2;
+    etl::fast_dyn_matrix<float, 4, 3, 6, 6> errors_2;
+    etl::fast_dyn_matrix<float, 4, 3, 4, 4> pooled_3;
+    etl::fast_dyn_matrix<float, 4, 3, 4, 4> errors_3;
+    etl::fast_dyn_matrix<float, 4, 3, 12, 12> output;
+
+    input    = etl::uniform_generator(-1.0, 1.0);
+    errors_2 = etl::uniform_generator(-1.0, 1.0);
+    errors_3 = etl::uniform_generator(-1.0, 1.0);
+
+    REQUIRE(dll::select_small_pool(2, 2) == dll::small_pool_window::W2X2);
+    REQUIRE(dll::select_small_pool(3, 3) == dll::small_pool_window::W3X3);
+    REQUIRE(dll::select_small_pool(2, 3) == dll::small_pool_window::NONE);
+
+    dll::small_max_pool_forward(pooled_2, input, dll::small_pool_window::W2X2);
+    REQUIRE(etl::approx_equals(pooled_2, etl::ml::max_pool_forward<2, 2>(input), 1e-6));
+
+    dll::small_max_pool_backward(output, input, pooled_2, errors_2, dll::small_pool_window::W2X2);
+    REQUIRE(etl::approx_equals(output, etl::ml::max_pool_backward<2, 2>(input, pooled_2, errors_2), 1e-6));
+
+    dll::small_avg_pool_forward(pooled_3, input, dll::small_pool_window::W3X3);
+    REQUIRE(etl::approx_equals(pooled_3, etl::ml::avg_pool_forward<3, 3>(input), 1e-5));
+
+    dll::small_avg_pool_backward(output, errors_3, dll::small_pool_window::W3X3);
+    REQUIRE(etl::approx_equals(output, etl::ml::avg_pool_backward<3, 3>(input, pooled_3, errors_3), 1e-5));
+
+    // The last row and column of the planes are outside of the windows
+    etl::fast_dyn_matrix<float, 2, 2, 7, 7> odd;
+    etl::fast_dyn_matrix<float, 2, 2, 3, 3> odd_pooled;
+    etl::fast_dyn_matrix<float, 2, 2, 3, 3> odd_errors;
+    etl::fast_dyn_matrix<float, 2, 2, 7, 7> odd_output;
+
+    odd        = etl::uniform_generator(-1.0, 1.0);
+    odd_errors = etl::uniform_generator(-1.0, 1.0);
+
+    dll::small_max_pool_forward(odd_pooled, odd, dll::small_pool_window::W2X2);
+    REQUIRE(etl::approx_equals(odd_pooled, etl::ml::max_pool_forward<2, 2>(odd), 1e-6));
+
+    dll::small_max_pool_backward(odd_output, odd, odd_pooled, odd_errors, dll::small_pool_window::W2X2);
+    REQUIRE(etl::approx_equals(odd_output, etl::ml::max_pool_backward<2, 2>(odd, odd_pooled, odd_errors), 1e-6));
+}
@@ -12,6 +12,7 @@
 #include "cpp_utils/data.hpp"
 
 #include "dll/rbm/conv_rbm.hpp"
+#include "dll/util/thread_pool_scope.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -160,3 +161,104 @@ TEST_CASE("unit/crbm/mnist/7", "[crbm][unit]") {
     auto error = rbm.train(dataset.training_images, 50);
     REQUIRE(error < 7e-2);
 }
+
+// Gradients computed on the thread pool of the scope, with a partial batch
+TEST_CASE("unit/crbm/mnist/pool", "[crbm][parallel][unit]") {
+    dll::conv_rbm_square_desc<
+        1, 28, 20, 17,
+        dll::batch_size<16>,
+        dll::momentum>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    cpp::thread_pool<true> pool;
+    dll::thread_pool_scope scope(pool);
+
+    auto error = rbm.train(dataset.training_images, 25);
+    REQUIRE(error < 5e-2);
+}
+
+// The batched energies are the sums of the energies of the samples
+TEST_CASE("unit/crbm/mnist/energy_batch", "[crbm][unit]") {
+    dll::conv_rbm_square_desc<
+        1, 28, 20, 17,
+        dll::batch_size<10>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(10);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    etl::dyn_matrix<float, 4> v(10, 1, 28, 28);
+    etl::dyn_matrix<float, 4> h(10, 20, 12, 12);
+
+    for (size_t i = 0; i < 10; ++i) {
+        v(i) = dataset.training_images[i];
+
+        rbm.v1 = dataset.training_images[i];
+        rbm.template activate_hidden<true, false>(rbm.h1_a, rbm.h1_a, rbm.v1, rbm.v1);
+
+        h(i) = rbm.h1_a;
+    }
+
+    double free_energy = 0.0;
+    double energy      = 0.0;
+
+    for (size_t i = 0; i < 10; ++i) {
+        free_energy += rbm.free_energy(dataset.training_images[i]);
+        energy += rbm.energy(dataset.training_images[i], h(i));
+    }
+
+    REQUIRE(rbm.free_energy_batch(v) == Approx(free_energy).epsilon(1e-3));
+    REQUIRE(rbm.energy_batch(v, h) == Approx(energy).epsilon(1e-3));
+
+    cpp::thread_pool<true> pool;
+    dll::thread_pool_scope scope(pool);
+
+    REQUIRE(rbm.free_energy_batch(v) == Approx(free_energy).epsilon(1e-3));
+}
+
+// The 3x3 filters use the Winograd kernels with the cached filters
+TEST_CASE("unit/crbm/mnist/winograd", "[crbm][unit]") {
+    dll::conv_rbm_square_desc<
+        1, 28, 10, 26,
+        dll::batch_size<10>,
+        dll::momentum>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 10);
+    REQUIRE(error < 5e-2);
+
+    etl::fast_dyn_matrix<float, 10, 1, 28, 28> v;
+    etl::fast_dyn_matrix<float, 10, 10, 26, 26> h;
+    etl::fast_dyn_matrix<float, 10, 1, 28, 28> r;
+
+    for (size_t i = 0; i < 10; ++i) {
+        v(i) = dataset.training_images[i];
+    }
+
+    rbm.template batch_activate_hidden<true, false>(h, h, v, v);
+
+    etl::fast_dyn_matrix<float, 10, 10, 26, 26> h_ref;
+    h_ref = etl::sigmoid(etl::bias_add_4d(etl::conv_4d_valid_flipped(v, rbm.w), rbm.b));
+
+    for (size_t i = 0; i < etl::size(h); ++i) {
+        REQUIRE(h[i] == Approx(h_ref[i]).epsilon(1e-3));
+    }
+
+    rbm.template batch_activate_visible<true, false>(h, h, r, r);
+
+    etl::fast_dyn_matrix<float, 10, 1, 28, 28> r_ref;
+    r_ref = etl::sigmoid(etl::bias_add_4d(etl::conv_4d_full(h, rbm.w), rbm.c));
+
+    for (size_t i = 0; i < etl::size(r); ++i) {
+        REQUIRE(r[i] == Approx(r_ref[i]).epsilon(1e-3));
+    }
+}
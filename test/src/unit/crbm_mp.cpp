@@ -157,3 +157,47 @@ TEST_CASE("unit/crbm_mp/mnist/7", "[crbm_mp][lee][gaussian][unit]") {
     auto error = rbm.train(dataset.training_images, 30);
     REQUIRE(error < 0.1);
 }
+
+TEST_CASE("unit/crbm_mp/pmp", "[crbm_mp][unit]") {
+    etl::fast_dyn_matrix<float, 3, 4, 6, 6> x;
+    etl::fast_dyn_matrix<float, 3, 4, 6, 6> h_a;
+    etl::fast_dyn_matrix<float, 3, 4, 6, 6> h_s;
+    etl::fast_dyn_matrix<float, 3, 4, 3, 3> p_a;
+    etl::fast_dyn_matrix<float, 4> b;
+
+    x = 4.0 * etl::uniform_generator(-1.0, 1.0);
+    b = etl::uniform_generator(-1.0, 1.0);
+
+    auto b_rep = etl::force_temporary(etl::rep_l(etl::rep(b, 6, 6), 3));
+    auto ref   = etl::force_temporary(etl::p_max_pool_h(b_rep + x, 2, 2));
+
+    h_a = x;
+    dll::pmp_hidden<true>(h_a, h_s, b, 2, 1.0f);
+    dll::pmp_pooling(x, p_a, b, 2);
+
+    for (size_t i = 0; i < etl::size(h_a); ++i) {
+        REQUIRE(h_a[i] == Approx(ref[i]).epsilon(1e-4));
+    }
+
+    // The pooling unit is on when any unit of its block is on
+    for (size_t s = 0; s < 3; ++s) {
+        for (size_t k = 0; k < 4; ++k) {
+            for (size_t i = 0; i < 3; ++i) {
+                for (size_t j = 0; j < 3; ++j) {
+                    float sum_a = 0.0;
+                    float sum_s = 0.0;
+
+                    for (size_t ii = 0; ii < 2; ++ii) {
+                        for (size_t jj = 0; jj < 2; ++jj) {
+                            sum_a += h_a(s, k, i * 2 + ii, j * 2 + jj);
+                            sum_s += h_s(s, k, i * 2 + ii, j * 2 + jj);
+                        }
+                    }
+
+                    REQUIRE(p_a(s, k, i, j) == Approx(sum_a).epsilon(1e-4));
+                    REQUIRE(sum_s <= 1.0f);
+                }
+            }
+        }
+    }
+}
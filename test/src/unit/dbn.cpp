@@ -16,6 +16,7 @@
 #include "dll/rbm/dyn_rbm.hpp"
 #include "dll/transform/shape_1d_layer.hpp"
 #include "dll/transform/binarize_layer.hpp"
+#include "dll/datasets.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -63,6 +64,25 @@ TEST_CASE("unit/dbn/mnist/1", "[dbn][unit]") {
     REQUIRE((big == 1 || big == 2));
 }
 
+TEST_CASE("unit/dbn/mnist/cg/generator", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm<28 * 28, 150, dll::momentum, dll::batch_size<10>, dll::init_weights>,
+            dll::rbm<150, 10, dll::momentum, dll::batch_size<10>, dll::hidden<dll::unit_type::SOFTMAX>>>,
+        dll::batch_size<25>, dll::trainer<dll::cg_trainer>>::dbn_t dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::batch_size<25>{}, dll::binarize_pre<30>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.train(), 20);
+
+    // The line search is evaluated in parallel over the samples
+    auto error = dbn->fine_tune(dataset.train(), 5);
+    std::cout << "error:" << error << std::endl;
+    REQUIRE(error < 0.1);
+}
+
 TEST_CASE("unit/dbn/mnist/2", "[dbn][unit]") {
     auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(350);
     REQUIRE(!dataset.training_images.empty());
@@ -238,6 +258,87 @@ TEST_CASE("unit/dbn/mnist/8", "[dbn][unit]") {
     dbn->pretrain(dataset.training_images, 20);
 }
 
+// Pretrain with the outputs of the layers cached on disk
+TEST_CASE("unit/dbn/mnist/cache", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::binarize_pre<30>, dll::pretrain_cache<dll::bfloat16>, dll::trainer<dll::cg_trainer>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+    dbn->pretrain_prefix = ".tmp.pretrain";
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    REQUIRE(std::ifstream(".tmp.pretrain.1.dat").good());
+    REQUIRE(std::ifstream(".tmp.pretrain.2.dat").good());
+
+    // Only retrain the last layers, from the cached outputs of the first one
+    etl::dyn_matrix<float> w = dbn->layer_get<0>().w;
+
+    dbn->pretrain_start = 1;
+    dbn->pretrain(dataset.training_images, 20);
+
+    REQUIRE(etl::approx_equals(dbn->layer_get<0>().w, w, 0.0));
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 10);
+    REQUIRE(error < 0.1);
+
+    std::remove(".tmp.pretrain.1.dat");
+    std::remove(".tmp.pretrain.2.dat");
+}
+
+TEST_CASE("unit/dbn/mnist/pipeline", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::binarize_pre<30>, dll::pretrain_pipeline, dll::trainer<dll::cg_trainer>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 10);
+    REQUIRE(error < 0.1);
+}
+
+TEST_CASE("unit/dbn/mnist/batch/pipeline", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_mode, dll::batch_size<25>, dll::pretrain_pipeline, dll::pretrain_cache<dll::bfloat16>, dll::trainer<dll::cg_trainer>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->batch_mode());
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    auto error = dbn->fine_tune(
+        dataset.training_images.begin(), dataset.training_images.end(),
+        dataset.training_labels.begin(), dataset.training_labels.end(),
+        10);
+
+    REQUIRE(error < 0.1);
+}
+
 // Pretrain in denoising mode
 // Not include in standard test suite (covered by unit/dbn/mnist/10)
 TEST_CASE("unit/dbn/mnist/9", "[dbn][denoising][unit_full]") {
@@ -5,15 +5,34 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <algorithm>
+#include <cstdio>
 #include <deque>
+#include <fstream>
+#include <numeric>
+#include <limits>
+#include <random>
+#include <thread>
 
 #include "dll_test.hpp"
 
 #include "dll/neural/dense_layer.hpp"
+#include "dll/neural/tied_dense_layer.hpp"
 #include "dll/transform/shape_1d_layer.hpp"
 #include "dll/neural/activation_layer.hpp"
+#include "dll/transform/scale_layer.hpp"
+#include "dll/transform/rectifier_layer.hpp"
+#include "dll/transform/binarize_layer.hpp"
+#include "dll/neural/dropout_layer.hpp"
 #include "dll/dbn.hpp"
 #include "dll/datasets.hpp"
+#include "dll/util/tcp_transport.hpp"
+#include "dll/util/batching_executor.hpp"
+#include "dll/numa_network.hpp"
+#include "dll/ensemble.hpp"
+#include "dll/cross_validation.hpp"
+#include "dll/batch_tuner.hpp"
+#include "dll/util/converter.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -310,3 +329,2341 @@ TEST_CASE("unit/dense/sgd/14", "[unit][dense][dbn][mnist][sgd]") {
     FT_CHECK(50, 5e-2);
     TEST_CHECK(0.2);
 }
+
+// Validation computed asynchronously on a snapshot of the weights
+TEST_CASE("unit/dense/sgd/async_val", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>, dll::async_validation
+    >::dbn_t;
+
+    // Load the dataset
+    auto dataset = dll::make_mnist_dataset_val(0, 1000, 1500, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.03;
+
+    FT_CHECK_DATASET_VAL(25, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Validation evaluated on a sampled subset, except every 5 epochs
+TEST_CASE("unit/dense/sgd/sampled_val", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    // Load the dataset
+    auto dataset = dll::make_mnist_dataset_val(0, 1000, 1500, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate      = 0.03;
+    dbn->validation_samples = 100;
+    dbn->full_validation    = 5;
+
+    FT_CHECK_DATASET_VAL(25, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Gradient clipping, with the norm of the biases computed with the gradients
+TEST_CASE("unit/dense/sgd/clip", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::weight_decay<>, dll::clip_gradients, dll::batch_size<20>
+    >::dbn_t;
+
+    // Load the dataset
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+    dbn->gradient_clip = 1.0;
+
+    FT_CHECK_DATASET(25, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Batch metrics only computed every 4 batches
+TEST_CASE("unit/dense/sgd/batch_metrics", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    // Load the dataset
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.03;
+    dbn->batch_metrics = 4;
+
+    FT_CHECK_DATASET(25, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Data-parallel training of the shards of each batch
+TEST_CASE("unit/dense/sgd/parallel", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>, dll::data_parallel<4>
+    >::dbn_t;
+
+    // Load the dataset (with a partial last batch)
+    auto dataset = dll::make_mnist_dataset_sub(0, 1010, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.03;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Weight updates overlapped with the backward pass
+TEST_CASE("unit/dense/sgd/pipelined", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::ADAM>, dll::batch_size<20>, dll::pipelined_updates
+    >::dbn_t;
+
+    // Load the dataset
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Gradients accumulated over several batches
+TEST_CASE("unit/dense/sgd/accumulate", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>
+    >::dbn_t;
+
+    // Load the dataset (with a partial accumulation at the end of each epoch)
+    auto dataset = dll::make_mnist_dataset_sub(0, 1010, dll::normalize_pre{}, dll::batch_size<10>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate         = 0.05;
+    dbn->gradient_accumulation = 4;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Partial last batch with the mean squared error loss
+TEST_CASE("unit/dense/sgd/partial", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10>::layer_t>,
+        dll::loss<dll::loss_function::MEAN_SQUARED_ERROR>, dll::batch_size<32>
+    >::dbn_t;
+
+    // Load the dataset (the last batch only has 8 samples)
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<32>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK_DATASET(100, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+TEST_CASE("unit/dense/sgd/fused_loss", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<32>
+    >::dbn_t;
+
+    // Load the dataset (the last batch only has 8 samples)
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<32>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+TEST_CASE("unit/dense/sgd/checkpoint", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<25>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<25>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    // One checkpoint at the end of each epoch (40 batches), only two are kept
+    dbn->checkpoints = std::make_shared<dll::checkpointer>(".tmp.checkpoint", 2, 40);
+
+    FT_CHECK_DATASET(5, 5e-2);
+
+    dbn->checkpoints->wait();
+
+    REQUIRE(dbn->checkpoints->last() == ".tmp.checkpoint.4.dat");
+    REQUIRE(std::ifstream(".tmp.checkpoint.3.dat").good());
+    REQUIRE(!std::ifstream(".tmp.checkpoint.2.dat").good());
+
+    // The last checkpoint contains the final weights
+    auto restored = std::make_unique<dbn_t>();
+
+    restored->load(".tmp.checkpoint.4.dat");
+
+    REQUIRE(etl::approx_equals(restored->template layer_get<0>().w, dbn->template layer_get<0>().w, 1e-6));
+    REQUIRE(etl::approx_equals(restored->template layer_get<1>().b, dbn->template layer_get<1>().b, 1e-6));
+}
+
+TEST_CASE("unit/dense/sgd/resume", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::ADAM>, dll::batch_size<25>, dll::shuffle
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<25>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.01;
+
+    // A single checkpoint, in the middle of the second epoch (40 batches per epoch)
+    dbn->checkpoints = std::make_shared<dll::checkpointer>(".tmp.resume", 1, 50);
+
+    FT_CHECK_DATASET(2, 0.2);
+
+    dbn->checkpoints->wait();
+
+    REQUIRE(dbn->checkpoints->last() == ".tmp.resume.0.dat");
+
+    // The resumed training continues exactly where the checkpoint was taken
+    auto resumed_dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<25>{});
+
+    auto resumed = std::make_unique<dbn_t>();
+
+    resumed->learning_rate = 0.01;
+
+    REQUIRE(resumed->resume(".tmp.resume.0.dat"));
+
+    resumed->fine_tune(resumed_dataset.train(), 2);
+
+    REQUIRE(etl::approx_equals(resumed->template layer_get<0>().w, dbn->template layer_get<0>().w, 1e-5));
+    REQUIRE(etl::approx_equals(resumed->template layer_get<1>().b, dbn->template layer_get<1>().b, 1e-5));
+
+    std::remove(".tmp.resume.0.dat");
+}
+
+TEST_CASE("unit/dense/sgd/distributed", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<25>
+    >::dbn_t;
+
+    constexpr size_t ranks = 2;
+
+    std::vector<std::unique_ptr<dbn_t>> dbns(ranks);
+    std::vector<double> errors(ranks);
+    std::vector<std::thread> threads;
+
+    // Each rank trains on its own half of the dataset
+    for (size_t r = 0; r < ranks; ++r) {
+        threads.emplace_back([&dbns, &errors, r] {
+            auto dataset = dll::make_mnist_dataset_sub(r * 500, 500, dll::normalize_pre{}, dll::batch_size<25>{});
+
+            auto& dbn = dbns[r];
+
+            dbn = std::make_unique<dbn_t>();
+
+            dbn->learning_rate = 0.1;
+            dbn->transport     = std::make_shared<dll::tcp_transport>(r, ranks, "127.0.0.1", 27315);
+
+            errors[r] = dbn->fine_tune(dataset.train(), 25);
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // All the ranks must end with the same weights
+    REQUIRE(etl::approx_equals(dbns[0]->template layer_get<0>().w, dbns[1]->template layer_get<0>().w, 1e-6));
+    REQUIRE(etl::approx_equals(dbns[0]->template layer_get<1>().b, dbns[1]->template layer_get<1>().b, 1e-6));
+
+    REQUIRE(errors[0] < 0.1);
+    REQUIRE(errors[1] < 0.1);
+}
+
+// The weights and the contexts backed by huge pages behave the same
+TEST_CASE("unit/dense/sgd/huge_pages", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 1000>::layer_t,
+            dll::dense_layer_desc<1000, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::ADAM>, dll::batch_size<25>, dll::huge_pages
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::normalize_pre{}, dll::batch_size<25>{}, dll::huge_pages{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.001;
+
+    FT_CHECK_DATASET(25, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+
+    // Only whole huge pages are advised (none without transparent huge pages)
+    REQUIRE(dll::huge_pages_advised() % dll::huge_page_size == 0);
+}
+
+TEST_CASE("unit/dense/sgd/partial_fit", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::normalize_pre{}, dll::batch_size<10>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    REQUIRE(!dbn->inference_snapshot());
+
+    dbn->get_online_trainer().refresh_every = 10;
+
+    auto& generator = dataset.train();
+
+    // The batches are streamed, the trainer is kept between the calls
+    for (size_t epoch = 0; epoch < 50; ++epoch) {
+        generator.reset();
+        generator.set_train();
+
+        while (generator.has_next_batch()) {
+            dbn->partial_fit(generator.data_batch(), generator.label_batch());
+            generator.next_batch();
+        }
+    }
+
+    REQUIRE(dbn->get_online_trainer().batches() == 50 * 50);
+
+    TEST_CHECK_DATASET(0.3);
+
+    // The snapshot was refreshed after the last batch
+    auto snapshot = dbn->inference_snapshot();
+
+    REQUIRE(snapshot);
+
+    auto& test = dataset.test();
+    test.reset();
+
+    auto context = snapshot->make_inference_context();
+
+    REQUIRE(etl::approx_equals(snapshot->forward_batch(context, test.data_batch()), dbn->forward_batch(test.data_batch()), 1e-5));
+}
+
+TEST_CASE("unit/dense/sgd/staged", "[unit][dense][dbn][mnist][sgd]") {
+    dll::staged_pipeline<std::vector<size_t>> pipeline(3);
+
+    pipeline.add_stage("square", 2, [](std::vector<size_t>& slot) { slot[0] *= slot[0]; });
+
+    size_t produced = 0;
+
+    pipeline.start("load", [&produced](std::vector<size_t>& slot) {
+        if (produced == 100) {
+            return false;
+        }
+
+        slot.assign(1, produced++);
+        return true;
+    });
+
+    // The slots are consumed in the order of the source
+    size_t consumed = 0;
+
+    while (auto* slot = pipeline.next()) {
+        REQUIRE((*slot)[0] == consumed * consumed);
+
+        ++consumed;
+        pipeline.release(slot);
+    }
+
+    pipeline.stop();
+
+    auto stats = pipeline.stats();
+
+    REQUIRE(consumed == 100);
+    REQUIRE(stats.stages.size() == 3);
+    REQUIRE(stats.stages[1].items == 100);
+    REQUIRE(stats.stages[1].occupancy() <= 1.0);
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>, dll::staged_training<3>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::normalize_pre{}, dll::batch_size<10>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+TEST_CASE("unit/dense/sgd/gpu_resident", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>, dll::gpu_resident
+    >::dbn_t;
+
+    // The next batches are staged only when the training is on the GPU
+    REQUIRE(dll::dbn_traits<dbn_t>::gpu_resident() == dll::gpu_enabled);
+    REQUIRE((dll::dbn_traits<dbn_t>::staged_training() > 0) == dll::gpu_enabled);
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::normalize_pre{}, dll::batch_size<10>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+TEST_CASE("unit/dense/sgd/frozen", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::frozen_layers<1>, dll::batch_size<10>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::normalize_pre{}, dll::batch_size<10>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    // The first layer is only forwarded during the fine-tuning
+    auto w = etl::force_temporary(dbn->template layer_get<0>().w);
+    auto b = etl::force_temporary(dbn->template layer_get<0>().b);
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+
+    REQUIRE(etl::approx_equals(dbn->template layer_get<0>().w, w, 0.0));
+    REQUIRE(etl::approx_equals(dbn->template layer_get<0>().b, b, 0.0));
+}
+
+// Test the sparse kernels with a bag-of-words like input
+TEST_CASE("unit/dense/sgd/sparse", "[unit][dense][dbn][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<1000, 10, dll::softmax, dll::sparse_input>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    std::mt19937_64 g(42);
+    std::uniform_int_distribution<size_t> word_dist(10, 999);
+
+    std::vector<etl::dyn_vector<float>> samples;
+    std::vector<size_t> labels;
+
+    // The first 10 words indicate the class, the other ones are noise
+    for (size_t i = 0; i < 400; ++i) {
+        etl::dyn_vector<float> sample(1000, 0.0f);
+
+        sample[i % 10] = 1.0f;
+
+        for (size_t w = 0; w < 5; ++w) {
+            sample[word_dist(g)] = 1.0f;
+        }
+
+        samples.push_back(sample);
+        labels.push_back(i % 10);
+    }
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    // The sparse forward pass must give the same result as the dense one
+    etl::dyn_matrix<float, 2> batch(20, 1000);
+    etl::dyn_matrix<float, 2> sparse_output(20, 10);
+
+    for (size_t i = 0; i < 20; ++i) {
+        batch(i) = samples[i];
+    }
+
+    auto& layer = dbn->template layer_get<0>();
+
+    layer.forward_batch(sparse_output, batch);
+
+    etl::dyn_matrix<float, 2> dense_output = etl::bias_add_2d(batch * layer.w, layer.b);
+
+    for (size_t i = 0; i < 20; ++i) {
+        dense_output(i) = etl::stable_softmax(dense_output(i));
+    }
+
+    REQUIRE(etl::approx_equals(sparse_output, dense_output, 1e-5));
+
+    auto error = dbn->fine_tune(samples, labels, 50);
+    REQUIRE(error < 5e-2);
+}
+
+// The fused epilogues compute the same activations as ETL
+TEST_CASE("unit/dense/epilogue", "[unit][dense]") {
+    etl::fast_matrix<float, 8, 13> x;
+    etl::fast_matrix<float, 4, 3, 5, 6> y;
+    etl::fast_matrix<float, 13> b_2d;
+    etl::fast_matrix<float, 3> b_4d;
+
+    x    = etl::uniform_generator(-2.0, 2.0);
+    y    = etl::uniform_generator(-2.0, 2.0);
+    b_2d = etl::uniform_generator(-1.0, 1.0);
+    b_4d = etl::uniform_generator(-1.0, 1.0);
+
+    auto check = [&](auto f) {
+        constexpr dll::function F = decltype(f)::value;
+
+        etl::fast_matrix<float, 8, 13> x_fused(x);
+        etl::fast_matrix<float, 4, 3, 5, 6> y_fused(y);
+
+        dll::bias_activate_2d<F>(x_fused, b_2d);
+        dll::bias_activate_4d<F>(y_fused, b_4d);
+
+        etl::fast_matrix<float, 8, 13> x_ref;
+        etl::fast_matrix<float, 4, 3, 5, 6> y_ref;
+
+        x_ref = dll::f_activate<F>(etl::bias_add_2d(x, b_2d));
+        y_ref = dll::f_activate<F>(etl::bias_add_4d(y, b_4d));
+
+        REQUIRE(etl::approx_equals(x_fused, x_ref, 1e-5));
+        REQUIRE(etl::approx_equals(y_fused, y_ref, 1e-5));
+    };
+
+    check(std::integral_constant<dll::function, dll::function::IDENTITY>{});
+    check(std::integral_constant<dll::function, dll::function::SIGMOID>{});
+    check(std::integral_constant<dll::function, dll::function::TANH>{});
+    check(std::integral_constant<dll::function, dll::function::RELU>{});
+}
+
+// The activation layers are computed in place on the output of the network
+TEST_CASE("unit/dense/in_place", "[unit][dense][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 15, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+            dll::dense_layer_desc<15, 10, dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    static_assert(dll::is_in_place_layer_v<dll::activation_layer_desc<dll::function::SIGMOID>::layer_t>, "Sigmoid can be computed in place");
+    static_assert(!dll::is_in_place_layer_v<dll::activation_layer_desc<dll::function::SOFTMAX>::layer_t>, "Softmax is not elementwise");
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_matrix<float, 8, 20> batch;
+    batch = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_matrix<float, 8, 20> copy(batch);
+
+    auto& l0 = dbn->template layer_get<0>();
+    auto& l2 = dbn->template layer_get<2>();
+
+    etl::fast_matrix<float, 8, 15> h;
+    etl::fast_matrix<float, 8, 10> expected;
+
+    h        = etl::sigmoid(etl::bias_add_2d(batch * l0.w, l0.b));
+    expected = etl::softmax(etl::bias_add_2d(h * l2.w, l2.b));
+
+    auto output = dbn->forward_batch(batch);
+
+    REQUIRE(etl::approx_equals(output, expected, 1e-5));
+    REQUIRE(etl::approx_equals(batch, copy, 0.0));
+}
+
+// The consecutive elementwise layers are fused in a single expression
+TEST_CASE("unit/dense/fused", "[unit][dense][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 15, dll::no_activation>::layer_t,
+            dll::scale_layer_desc<1, 2>::layer_t,
+            dll::rectifier_layer_desc<>::layer_t,
+            dll::activation_layer_desc<dll::function::TANH>::layer_t,
+            dll::dense_layer_desc<15, 10, dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    static_assert(dbn_t::fused_end<1, 4>() == 4, "The three elementwise layers must be fused");
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_matrix<float, 8, 20> batch;
+    batch = etl::uniform_generator(-1.0, 1.0);
+
+    auto& l0 = dbn->template layer_get<0>();
+    auto& l4 = dbn->template layer_get<4>();
+
+    etl::fast_matrix<float, 8, 15> h;
+    etl::fast_matrix<float, 8, 10> expected;
+
+    h        = etl::tanh(etl::abs(etl::bias_add_2d(batch * l0.w, l0.b) * 0.5));
+    expected = etl::softmax(etl::bias_add_2d(h * l4.w, l4.b));
+
+    auto output = dbn->forward_batch(batch);
+
+    REQUIRE(etl::approx_equals(output, expected, 1e-5));
+}
+
+// The single samples are computed with the vector-matrix kernels
+TEST_CASE("unit/dense/forward_one", "[unit][dense][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 15, dll::relu>::layer_t,
+            dll::dense_layer_desc<15, 12, dll::sigmoid>::layer_t,
+            dll::dyn_dense_layer_desc<dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    static_assert(dll::has_forward_one_direct<dll::dense_layer_desc<20, 15>::layer_t>::value, "Dense has a single-sample kernel");
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->template layer_get<2>().init_layer(12, 10);
+
+    etl::fast_matrix<float, 8, 20> batch;
+    batch = etl::uniform_generator(-1.0, 1.0);
+
+    auto output = dbn->forward_batch(batch);
+
+    // Twice, the intermediate outputs being reused
+    for (size_t r = 0; r < 2; ++r) {
+        for (size_t i = 0; i < 8; ++i) {
+            etl::fast_dyn_matrix<float, 20> sample(batch(i));
+
+            auto one = dbn->forward_one(sample);
+
+            REQUIRE(etl::size(one) == 10);
+            REQUIRE(etl::approx_equals(one, output(i), 1e-5));
+        }
+    }
+}
+
+// Dropout with bit-packed masks
+TEST_CASE("unit/dense/sgd/dropout", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 200>::layer_t,
+            dll::dropout_layer<20>,
+            dll::dense_layer_desc<200, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.03;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+
+    // The mask drops the given ratio of the values and is applied again
+    // to the errors
+
+    auto& dropout = dbn->template layer_get<1>();
+
+    etl::fast_dyn_matrix<float, 100, 50> input(1.0);
+    etl::fast_dyn_matrix<float, 100, 50> output;
+
+    dropout.train_forward_batch(output, input);
+
+    size_t dropped = 0;
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        if (output[i] == 0.0f) {
+            ++dropped;
+        } else {
+            REQUIRE(output[i] == Approx(1.0f / 0.8f));
+        }
+    }
+
+    REQUIRE(dropped > 800);
+    REQUIRE(dropped < 1200);
+
+    struct {
+        etl::fast_dyn_matrix<float, 100, 50> errors;
+    } context;
+
+    context.errors = 2.0;
+
+    etl::fast_dyn_matrix<float, 100, 50> back;
+    dropout.backward_batch(back, context);
+
+    REQUIRE(etl::approx_equals(back, 2.0 * output, 1e-5));
+}
+
+// The two-pass softmax of the wide output layers
+TEST_CASE("unit/dense/softmax", "[unit][dense]") {
+    constexpr size_t B = 4;
+    constexpr size_t N = 3 * dll::softmax_block + 17;
+
+    dll::dense_layer_desc<8, N, dll::softmax>::layer_t layer;
+
+    etl::fast_dyn_matrix<float, B, 8> input;
+    etl::fast_dyn_matrix<float, B, N> output;
+
+    input = etl::uniform_generator(-5.0, 5.0);
+    layer.b = etl::uniform_generator(-5.0, 5.0);
+
+    layer.forward_batch(output, input);
+
+    etl::fast_dyn_matrix<float, B, N> logits;
+    logits = input * layer.w;
+
+    for (size_t i = 0; i < B; ++i) {
+        logits(i) = logits(i) + layer.b;
+    }
+
+    etl::fast_dyn_matrix<float, B, N> log_output;
+    dll::log_softmax_2d(log_output, logits);
+
+    for (size_t i = 0; i < B; ++i) {
+        const double max = etl::max(logits(i));
+
+        double sum = 0.0;
+        for (size_t j = 0; j < N; ++j) {
+            sum += std::exp(logits(i, j) - max);
+        }
+
+        REQUIRE(etl::sum(output(i)) == Approx(1.0).epsilon(1e-3));
+
+        for (size_t j = 0; j < N; ++j) {
+            REQUIRE(output(i, j) == Approx(std::exp(logits(i, j) - max) / sum).epsilon(1e-3));
+            REQUIRE(log_output(i, j) == Approx(logits(i, j) - max - std::log(sum)).epsilon(1e-3));
+        }
+    }
+}
+
+// The compute workers and the producers are placed on distinct cores
+TEST_CASE("unit/dense/placement", "[unit][dense][dbn][mnist][sgd]") {
+    auto cores = dll::physical_cores();
+
+    REQUIRE(!cores.empty());
+
+    dll::placement_policy policy;
+    policy.pin            = true;
+    policy.producer_cores = 1;
+    policy.avoid_smt      = true;
+
+    auto placement = dll::make_placement(policy);
+
+    REQUIRE(placement.compute.size() == std::max(size_t(1), cores.size() - 1));
+    REQUIRE(placement.producers.size() == (cores.size() > 1 ? 1 : 0));
+
+    for (int cpu : placement.producers) {
+        REQUIRE(std::find(placement.compute.begin(), placement.compute.end(), cpu) == placement.compute.end());
+    }
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>, dll::pin_threads, dll::producer_cores<1>, dll::no_smt
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::normalize_pre{}, dll::batch_size<10>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// The kernels dispatched to the instruction set of the processor
+TEST_CASE("unit/dense/multiversion", "[unit][dense]") {
+    const std::string isa = dll::kernels_isa();
+
+    REQUIRE((isa == "x86-64-v4" || isa == "x86-64-v3" || isa == "x86-64-v2" || isa == "default" || isa == "native"));
+
+    std::vector<float> x(1037);
+    std::vector<float> y(1037);
+
+    std::iota(x.begin(), x.end(), 0.0f);
+
+    dll::detail::vectorized_for(x.size(), [&x, &y](size_t i) { y[i] = 2.0f * x[i] + 1.0f; });
+
+    for (size_t i = 0; i < x.size(); ++i) {
+        REQUIRE(y[i] == 2.0f * i + 1.0f);
+    }
+
+    const double sum = dll::detail::vectorized_sum(x.size(), [&x](size_t i) { return double(x[i]); });
+
+    REQUIRE(sum == Approx(1036.0 * 1037.0 / 2.0));
+}
+
+TEST_CASE("unit/dense/batching_executor", "[unit][dense][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 30>::layer_t,
+            dll::dense_layer_desc<30, 5, dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    constexpr size_t clients = 4;
+    constexpr size_t samples = 25;
+
+    std::vector<etl::dyn_matrix<float, 1>> inputs;
+
+    for (size_t i = 0; i < clients * samples; ++i) {
+        inputs.emplace_back(20);
+        inputs.back() = etl::uniform_generator(-1.0, 1.0);
+    }
+
+    std::vector<int> equals(clients, 0);
+
+    {
+        dll::batching_executor<dbn_t, etl::dyn_matrix<float, 1>> executor(*dbn, 16, std::chrono::microseconds(500), 2);
+
+        std::vector<std::thread> threads;
+
+        // The clients submit single samples concurrently
+        for (size_t c = 0; c < clients; ++c) {
+            threads.emplace_back([&, c] {
+                std::vector<std::future<etl::dyn_matrix<float, 1>>> futures;
+
+                for (size_t i = 0; i < samples; ++i) {
+                    futures.push_back(executor.submit(inputs[c * samples + i]));
+                }
+
+                bool all = true;
+
+                for (size_t i = 0; i < samples; ++i) {
+                    auto output   = futures[i].get();
+                    auto expected = dbn->forward_one(inputs[c * samples + i]);
+
+                    all = all && etl::approx_equals(output, expected, 1e-5);
+                }
+
+                equals[c] = all;
+            });
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        auto& stats = executor.stats();
+
+        REQUIRE(stats.requests == clients * samples);
+        REQUIRE(stats.batches > 0);
+        REQUIRE(stats.batches <= clients * samples);
+
+        size_t batches = 0;
+        size_t depths  = 0;
+
+        for (size_t k = 0; k < dll::batching_buckets; ++k) {
+            batches += stats.batch_size[k];
+            depths += stats.queue_depth[k];
+        }
+
+        REQUIRE(batches == stats.batches);
+        REQUIRE(depths == clients * samples);
+
+        // No batch is larger than the maximum (bucket 4 is [16, 32))
+        for (size_t k = 5; k < dll::batching_buckets; ++k) {
+            REQUIRE(stats.batch_size[k] == 0);
+        }
+    }
+
+    for (size_t c = 0; c < clients; ++c) {
+        REQUIRE(equals[c]);
+    }
+}
+
+TEST_CASE("unit/dense/forward_many", "[unit][dense][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 30>::layer_t,
+            dll::dense_layer_desc<30, 5, dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // The last batch is not full
+    std::vector<etl::dyn_matrix<float, 1>> inputs;
+
+    for (size_t i = 0; i < 21; ++i) {
+        inputs.emplace_back(20);
+        inputs.back() = etl::uniform_generator(-1.0, 1.0);
+    }
+
+    auto outputs = dbn->forward_many(inputs);
+    auto hidden  = dbn->template forward_many<0>(inputs.begin(), inputs.end());
+
+    REQUIRE(outputs.size() == inputs.size());
+    REQUIRE(hidden.size() == inputs.size());
+
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        REQUIRE(etl::approx_equals(outputs[i], dbn->forward_one(inputs[i]), 1e-5));
+        REQUIRE(etl::approx_equals(hidden[i], dbn->template forward_one<0>(inputs[i]), 1e-5));
+    }
+}
+
+TEST_CASE("unit/dense/freeze", "[unit][dense][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 30>::layer_t,
+            dll::dropout_layer<50>,
+            dll::dense_layer_desc<30, 5, dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto frozen = dbn->freeze();
+
+    // The weights and biases of both dense layers, each on a cache line
+    REQUIRE(frozen.packed_size() >= 20 * 30 + 30 + 30 * 5 + 5);
+    REQUIRE(frozen.packed_size() % (dll::frozen_alignment / sizeof(float)) == 0);
+
+    etl::fast_dyn_matrix<float, 8, 20> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    auto output   = frozen.forward_batch(input);
+    auto expected = dbn->forward_batch(input);
+
+    REQUIRE(etl::approx_equals(output, expected, 1e-5));
+
+    REQUIRE(etl::approx_equals(frozen.forward_one(input(3)), expected(3), 1e-5));
+}
+
+TEST_CASE("unit/dense/mapped", "[unit][dense][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 30>::layer_t,
+            dll::dropout_layer<50>,
+            dll::dense_layer_desc<30, 5, dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->store_mapped("unit_dense_mapped.dat"));
+
+    dll::mapped_weights weights("unit_dense_mapped.dat");
+
+    REQUIRE(weights.is_open());
+    REQUIRE(weights.blocks() == 3);
+    REQUIRE(weights.block_size(1) == 0);
+    REQUIRE(size_t(weights.block(0)) % dll::mapped_weights_alignment == 0);
+    REQUIRE(size_t(weights.block(2)) % dll::mapped_weights_alignment == 0);
+
+    auto loaded = std::make_unique<dbn_t>();
+
+    auto frozen = loaded->freeze(weights);
+
+    // The dense layers are views in the mapping
+    REQUIRE(frozen.packed_size() == 1);
+
+    etl::fast_dyn_matrix<float, 8, 20> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    auto output   = frozen.forward_batch(input);
+    auto expected = dbn->forward_batch(input);
+
+    REQUIRE(etl::approx_equals(output, expected, 1e-5));
+
+    loaded->load_mapped(weights);
+
+    REQUIRE(etl::approx_equals(loaded->forward_batch(input), expected, 1e-5));
+
+    std::remove("unit_dense_mapped.dat");
+}
+
+TEST_CASE("unit/dense/compressed", "[unit][dense][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 30>::layer_t,
+            dll::dropout_layer<50>,
+            dll::dense_layer_desc<30, 5, dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    using other_dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 40>::layer_t,
+            dll::dropout_layer<50>,
+            dll::dense_layer_desc<40, 5, dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 8, 20> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    auto expected = dbn->forward_batch(input);
+
+    SECTION("raw") {
+        REQUIRE(dbn->store_compressed("unit_dense_compressed.dat"));
+
+        auto loaded = std::make_unique<dbn_t>();
+        REQUIRE(loaded->load_compressed("unit_dense_compressed.dat"));
+
+        REQUIRE(etl::approx_equals(loaded->forward_batch(input), expected, 1e-6));
+    }
+
+    SECTION("fp16") {
+        REQUIRE(dbn->store_compressed("unit_dense_compressed.dat", dll::model_encoding::FP16));
+
+        auto loaded = std::make_unique<dbn_t>();
+        REQUIRE(loaded->load_compressed("unit_dense_compressed.dat"));
+
+        REQUIRE(etl::approx_equals(loaded->forward_batch(input), expected, 1e-2));
+    }
+
+    SECTION("int8") {
+        REQUIRE(dbn->store_compressed("unit_dense_compressed.dat", dll::model_encoding::INT8));
+
+        auto loaded = std::make_unique<dbn_t>();
+        REQUIRE(loaded->load_compressed("unit_dense_compressed.dat"));
+
+        REQUIRE(etl::approx_equals(loaded->forward_batch(input), expected, 5e-2));
+    }
+
+    SECTION("mismatch") {
+        REQUIRE(dbn->store_compressed("unit_dense_compressed.dat"));
+
+        auto other = std::make_unique<other_dbn_t>();
+        REQUIRE(!other->load_compressed("unit_dense_compressed.dat"));
+    }
+
+    SECTION("corrupted") {
+        REQUIRE(dbn->store_compressed("unit_dense_compressed.dat"));
+
+        {
+            std::fstream stream("unit_dense_compressed.dat", std::ios::in | std::ios::out | std::ios::binary);
+            stream.seekp(-4, std::ios::end);
+            stream.put('\x7F');
+        }
+
+        auto loaded = std::make_unique<dbn_t>();
+        auto before = loaded->forward_batch(input);
+
+        REQUIRE(!loaded->load_compressed("unit_dense_compressed.dat"));
+        REQUIRE(etl::approx_equals(loaded->forward_batch(input), before, 1e-6));
+    }
+
+    std::remove("unit_dense_compressed.dat");
+}
+
+TEST_CASE("unit/dense/warmup", "[unit][dense][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 30>::layer_t,
+            dll::dropout_layer<50>,
+            dll::dense_layer_desc<30, 5, dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 8, 20> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    auto expected = dbn->forward_batch(input);
+
+    dbn->warmup(16, dll::warmup_mode::TRAINING);
+
+    // The warmup does not change the network
+    REQUIRE(etl::approx_equals(dbn->forward_batch(input), expected, 1e-6));
+
+    // The backup weights are allocated
+    dbn->restore_weights();
+
+    REQUIRE(etl::approx_equals(dbn->forward_batch(input), expected, 1e-6));
+}
+
+TEST_CASE("unit/dense/swap_weights", "[unit][dense][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 15>::layer_t,
+            dll::dyn_dense_layer_desc<dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->template layer_get<1>().init_layer(15, 10);
+
+    etl::fast_dyn_matrix<float, 8, 20> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    auto expected = dbn->forward_batch(input);
+
+    dbn->backup_weights();
+
+    dbn->template layer_get<0>().w = 0.5;
+    dbn->template layer_get<1>().w = 0.5;
+
+    auto modified = dbn->forward_batch(input);
+
+    // The dynamic weights are swapped, not copied
+    auto* memory = dbn->template layer_get<1>().w.memory_start();
+
+    dbn->swap_weights();
+
+    REQUIRE(dbn->template layer_get<1>().w.memory_start() != memory);
+    REQUIRE(etl::approx_equals(dbn->forward_batch(input), expected, 1e-6));
+
+    // The backup holds the replaced weights
+    dbn->swap_weights();
+
+    REQUIRE(dbn->template layer_get<1>().w.memory_start() == memory);
+    REQUIRE(etl::approx_equals(dbn->forward_batch(input), modified, 1e-6));
+}
+
+TEST_CASE("unit/dense/prune_units", "[unit][dense][dbn][mnist][prune]") {
+    using static_dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::normalize_pre{}, dll::batch_size<10>{});
+
+    auto original = std::make_unique<static_dbn_t>();
+
+    original->learning_rate = 0.05;
+    original->fine_tune(dataset.train(), 50);
+
+    auto dbn = dll::make_dynamic(*original);
+
+    dbn->learning_rate = 0.05;
+
+    auto& test = dataset.test();
+    test.reset();
+
+    REQUIRE(etl::approx_equals(dbn->forward_batch(test.data_batch()), original->forward_batch(test.data_batch()), 1e-5));
+
+    // Half of the neurons of the two hidden layers are removed
+    REQUIRE(dbn->prune_units(0.5) == 75);
+
+    REQUIRE(dbn->template layer_get<0>().output_size() == 50);
+    REQUIRE(dbn->template layer_get<1>().input_size() == 50);
+    REQUIRE(dbn->template layer_get<1>().output_size() == 25);
+    REQUIRE(dbn->template layer_get<2>().input_size() == 25);
+    REQUIRE(dbn->template layer_get<2>().output_size() == 10);
+
+    FT_CHECK_DATASET(20, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// The decoder uses the transposed weights of the encoder
+TEST_CASE("unit/dense/tied", "[unit][dense][dbn][mnist][sgd][ae]") {
+    using network_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::tied_dense_layer_desc<100, 28 * 28, 0>::layer_t>,
+        dll::autoencoder, dll::loss<dll::loss_function::BINARY_CROSS_ENTROPY>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>
+    >::network_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<network_t>();
+
+    dbn->display();
+
+    // Only the biases of the decoder are stored in the decoder
+    REQUIRE(dbn->template layer_get<1>().parameters() == 28 * 28);
+    REQUIRE(dbn->template layer_get<1>().w().memory_start() == dbn->template layer_get<0>().w.memory_start());
+
+    dbn->learning_rate = 0.1;
+
+    auto ft_error = dbn->fine_tune_ae(dataset.training_images, 25);
+    std::cout << "ft_error:" << ft_error << std::endl;
+
+    CHECK(ft_error < 0.1);
+
+    auto test_error = dll::test_set_ae(*dbn, dataset.test_images);
+    std::cout << "test_error:" << test_error << std::endl;
+    REQUIRE(test_error < 0.1);
+}
+
+TEST_CASE("unit/dense/ae/metrics", "[unit][dense][dbn][mnist][ae]") {
+    using network_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 50>::layer_t,
+            dll::dense_layer_desc<50, 28 * 28>::layer_t>,
+        dll::autoencoder, dll::loss<dll::loss_function::BINARY_CROSS_ENTROPY>, dll::batch_size<20>
+    >::network_t;
+
+    // The last batch is not full
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(490);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto& samples = dataset.training_images;
+
+    auto dbn = std::make_unique<network_t>();
+
+    auto generator = dll::make_generator(samples, samples, samples.size(), 28 * 28, dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::autoencoder>{});
+
+    auto [error, loss] = dbn->evaluate_metrics(*generator);
+
+    // The metrics of the batches, in order, with a clipped copy of the outputs
+    double ref_error = 0.0;
+    double ref_loss  = 0.0;
+
+    generator->reset();
+    generator->set_test();
+
+    while (generator->has_next_batch()) {
+        auto input_batch = generator->data_batch();
+        auto label_batch = generator->label_batch();
+
+        const size_t n = etl::dim<0>(input_batch);
+
+        etl::dyn_matrix<float, 2> output  = etl::slice(dbn->forward_batch(input_batch), 0, n);
+        etl::dyn_matrix<float, 2> clipped = etl::clip(output, 0.001, 0.999);
+
+        ref_error += etl::asum(label_batch - output) / (28.0 * 28.0);
+        ref_loss += -etl::sum((label_batch >> log(clipped)) + ((1.0 - label_batch) >> log(1.0 - clipped))) / (28.0 * 28.0);
+
+        generator->next_batch();
+    }
+
+    REQUIRE(error == Approx(ref_error / samples.size()).epsilon(1e-3));
+    REQUIRE(loss == Approx(ref_loss / samples.size()).epsilon(1e-3));
+
+    // A subset of the batches, evaluated in parallel as well
+    std::vector<size_t> batches(generator->batches());
+    std::iota(batches.begin(), batches.end(), 0);
+
+    auto [subset_error, subset_loss] = dbn->evaluate_metrics_batches(*generator, batches);
+
+    REQUIRE(subset_error == Approx(error));
+    REQUIRE(subset_loss == Approx(loss));
+}
+
+TEST_CASE("unit/dense/topk", "[unit][dense][dbn][mnist]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::NADAM>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK_DATASET(10, 5e-2);
+
+    // The top-1 error is the error
+    REQUIRE(dbn->evaluate_topk_error(dataset.test(), 1) == Approx(dbn->evaluate_error(dataset.test())));
+
+    // The label is always in the top-10 of 10 outputs
+    REQUIRE(dbn->evaluate_topk_error(dataset.test(), 10) == 0.0);
+
+    REQUIRE(dbn->evaluate_topk_error(dataset.test(), 5) <= dbn->evaluate_topk_error(dataset.test(), 1));
+
+    etl::fast_dyn_matrix<float, 8, 28 * 28> input;
+    input = etl::uniform_generator(0.0, 1.0);
+
+    auto output = dbn->forward_batch(input);
+    auto top    = dbn->predict_topk_batch(input, 3);
+
+    REQUIRE(top.size() == 8 * 3);
+
+    for (size_t i = 0; i < 8; ++i) {
+        std::vector<size_t> sorted(10);
+        std::iota(sorted.begin(), sorted.end(), 0);
+        std::stable_sort(sorted.begin(), sorted.end(), [&](size_t a, size_t b) { return output(i, a) > output(i, b); });
+
+        for (size_t j = 0; j < 3; ++j) {
+            REQUIRE(top[i * 3 + j] == sorted[j]);
+        }
+
+        REQUIRE(dbn->predict_topk(input(i), 3) == std::vector<size_t>(top.begin() + i * 3, top.begin() + (i + 1) * 3));
+        REQUIRE(dbn->predict_topk(input(i), 1)[0] == dbn->predict(input(i)));
+    }
+
+    // Larger k are selected with a heap
+    std::vector<float> row(100);
+    std::iota(row.begin(), row.end(), 0.0f);
+    std::shuffle(row.begin(), row.end(), std::mt19937(42));
+
+    std::vector<size_t> best(40);
+    dll::topk_row(row.data(), row.size(), best.size(), best.data());
+
+    for (size_t j = 0; j < best.size(); ++j) {
+        REQUIRE(row[best[j]] == float(99 - j));
+        REQUIRE(dll::topk_rank(row.data(), row.size(), best[j]) == j);
+    }
+}
+
+TEST_CASE("unit/dense/latency", "[unit][dense][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 30>::layer_t,
+            dll::dense_layer_desc<30, 5, dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 8, 20> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    dll::reset_latency_histograms();
+    dll::enable_latency_histograms();
+
+    for (size_t i = 0; i < 10; ++i) {
+        dbn->forward_batch(input);
+    }
+
+    dll::enable_latency_histograms(false);
+
+    // Disabled histograms do not record anything
+    dbn->forward_batch(input);
+
+    auto summaries = dll::latency_summaries();
+
+    size_t layers = 0;
+
+    for (auto& summary : summaries) {
+        if (summary.name == "net:forward_batch") {
+            REQUIRE(summary.count == 10);
+            REQUIRE(summary.p50 <= summary.p99);
+            REQUIRE(summary.p99 <= summary.max);
+        } else if (summary.name.find("layer:") == 0) {
+            REQUIRE(summary.count == 10);
+            ++layers;
+        }
+    }
+
+    REQUIRE(layers == 2);
+
+    auto exported = dll::export_latency_histograms();
+
+    REQUIRE(exported.find("dll_latency_seconds{name=\"net:forward_batch\",quantile=\"0.99\"}") != std::string::npos);
+    REQUIRE(exported.find("dll_latency_seconds_count{name=\"net:forward_batch\"} 10") != std::string::npos);
+
+    // The buckets have at most 12.5% of relative error
+    dll::latency_histogram histogram("unit/dense/latency");
+
+    for (uint64_t ns = 1; ns <= 1000; ++ns) {
+        histogram.record(ns * 1000);
+    }
+
+    auto counts = histogram.merged();
+    auto p50    = dll::latency_quantile(counts, 1000, 0.5);
+    auto p999   = dll::latency_quantile(counts, 1000, 0.999);
+
+    REQUIRE(p50 >= 500000);
+    REQUIRE(p50 <= 500000 * 1.125);
+    REQUIRE(p999 >= 999000);
+    REQUIRE(p999 <= 999000 * 1.125);
+
+    dll::reset_latency_histograms();
+}
+
+TEST_CASE("unit/dense/numa", "[unit][dense][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 30>::layer_t,
+            dll::dense_layer_desc<30, 5, dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    REQUIRE(dll::numa_topology::parse_cpulist("0-3,8,10-11") == std::vector<int>{0, 1, 2, 3, 8, 10, 11});
+    REQUIRE(dll::numa_topology::detect().size() >= 1);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 8, 20> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    auto expected = dbn->forward_batch(input);
+
+    // Two nodes sharing the first CPU
+    dll::numa_topology topology;
+    topology.nodes = {{0}, {0}};
+
+    dll::numa_network<dbn_t> numa(*dbn, topology, 1);
+
+    REQUIRE(numa.size() == 2);
+
+    // Each node has its own copy of the weights
+    REQUIRE(&numa.replica(0) != &numa.replica(1));
+
+    for (size_t n = 0; n < numa.size(); ++n) {
+        auto output = numa.submit(n, [&input](auto& replica) { return replica.forward_batch(input); }).get();
+        REQUIRE(etl::approx_equals(output, expected, 1e-5));
+    }
+
+    REQUIRE(etl::approx_equals(numa.forward_batch(input), expected, 1e-5));
+}
+
+TEST_CASE("unit/dense/ensemble", "[unit][dense][dbn]") {
+    using first_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::scale_layer_desc<1, 2>::layer_t,
+            dll::dense_layer_desc<20, 30>::layer_t,
+            dll::dense_layer_desc<30, 5, dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    using second_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::scale_layer_desc<1, 2>::layer_t,
+            dll::dense_layer_desc<20, 5, dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    auto first  = std::make_unique<first_t>();
+    auto second = std::make_unique<second_t>();
+    auto third  = std::make_unique<second_t>();
+
+    auto ensemble = dll::make_ensemble(*first, *second, *third);
+
+    // The scale layer is computed only once
+    REQUIRE(decltype(ensemble)::prefix == 1);
+
+    etl::fast_dyn_matrix<float, 8, 20> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    auto a = first->forward_batch(input);
+    auto b = second->forward_batch(input);
+    auto c = third->forward_batch(input);
+
+    auto average = ensemble.forward_batch(input);
+
+    REQUIRE(etl::dim<0>(average) == 8);
+    REQUIRE(etl::dim<1>(average) == 5);
+    REQUIRE(etl::approx_equals(average, (a + b + c) / 3.0f, 1e-5));
+
+    auto votes = ensemble.forward_batch(input, dll::ensemble_reduction::VOTE);
+
+    for (size_t i = 0; i < 8; ++i) {
+        REQUIRE(etl::sum(votes(i)) == Approx(1.0f));
+        REQUIRE(votes(i, etl::max_index(a(i))) >= 1.0f / 3.0f - 1e-5f);
+    }
+
+    auto one = ensemble.forward_one(input(0));
+
+    REQUIRE(etl::approx_equals(one, average(0), 1e-5));
+}
+
+TEST_CASE("unit/dense/timers", "[unit][dense]") {
+    dll::reset_timers();
+
+    std::vector<std::thread> threads;
+
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([] {
+            for (size_t i = 0; i < 100; ++i) {
+                dll::auto_timer timer("test:timers");
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // The counters of the terminated threads are kept
+    auto timers = dll::get_timers().snapshot();
+
+    auto it = std::find_if(timers.begin(), timers.end(), [](auto& timer) { return std::string(timer.name) == "test:timers"; });
+
+    REQUIRE(it != timers.end());
+    REQUIRE(it->count == 400);
+
+    dll::reset_timers();
+
+    REQUIRE(dll::get_timers().snapshot().empty());
+}
+
+TEST_CASE("unit/dense/timers/delta", "[unit][dense]") {
+    dll::reset_timers();
+
+    dll::timers_checkpoint checkpoint;
+
+    for (size_t i = 0; i < 3; ++i) {
+        dll::auto_timer timer("test:delta");
+    }
+
+    auto first = checkpoint.next();
+
+    REQUIRE(first.timers.size() == 1);
+    REQUIRE(std::string(first.timers[0].name) == "test:delta");
+    REQUIRE(first.timers[0].count == 3);
+
+    for (size_t i = 0; i < 2; ++i) {
+        dll::auto_timer timer("test:delta");
+    }
+
+    {
+        dll::auto_timer timer("test:delta:other");
+    }
+
+    auto second = checkpoint.next();
+
+    auto it = std::find_if(second.timers.begin(), second.timers.end(), [](auto& timer) { return std::string(timer.name) == "test:delta"; });
+
+    REQUIRE(second.timers.size() == 2);
+    REQUIRE(it != second.timers.end());
+    REQUIRE(it->count == 2);
+    REQUIRE(it->total_duration >= it->duration);
+
+    // Nothing was timed since the last point
+    REQUIRE(checkpoint.next().empty());
+
+    dll::reset_timers();
+}
+
+TEST_CASE("unit/dense/timers/nested", "[unit][dense]") {
+    dll::reset_timers();
+    dll::enable_timer_events();
+
+    for (size_t i = 0; i < 3; ++i) {
+        dll::auto_timer outer("test:outer");
+        dll::auto_timer inner("test:inner");
+    }
+
+    dll::enable_timer_events(false);
+
+    auto folded = dll::export_timers_folded();
+
+    REQUIRE(folded.find("test:outer ") != std::string::npos);
+    REQUIRE(folded.find("test:outer;test:inner ") != std::string::npos);
+
+    auto trace = dll::export_timers_chrome_trace();
+
+    REQUIRE(trace.find("\"traceEvents\"") != std::string::npos);
+    REQUIRE(trace.find("\"name\":\"test:inner\"") != std::string::npos);
+    REQUIRE(dll::get_timers().all_events().size() == 6);
+
+    dll::reset_timers();
+}
+
+TEST_CASE("unit/dense/timers/perf", "[unit][dense]") {
+    dll::reset_timers();
+    dll::enable_perf_counters();
+
+    float sum = 0.0f;
+
+    for (size_t i = 0; i < 10; ++i) {
+        dll::auto_timer timer("test:perf");
+
+        for (size_t j = 0; j < 10000; ++j) {
+            sum += std::sqrt(float(j));
+        }
+    }
+
+    dll::enable_perf_counters(false);
+
+    {
+        dll::auto_timer timer("test:perf:disabled");
+    }
+
+    REQUIRE(sum > 0.0f);
+
+    auto timers = dll::get_timers().perf_snapshot();
+
+    // The counters are not available on every machine
+    if (dll::perf_counters_available()) {
+        auto it = std::find_if(timers.begin(), timers.end(), [](auto& timer) { return std::string(timer.name) == "test:perf"; });
+
+        REQUIRE(it != timers.end());
+        REQUIRE(it->count == 10);
+        REQUIRE(it->values[size_t(dll::perf_event::CYCLES)] > 0);
+    }
+
+    REQUIRE(std::find_if(timers.begin(), timers.end(), [](auto& timer) { return std::string(timer.name) == "test:perf:disabled"; }) == timers.end());
+
+    dll::reset_timers();
+
+    REQUIRE(dll::get_timers().perf_snapshot().empty());
+}
+
+TEST_CASE("unit/dense/pool_stats", "[unit][dense]") {
+    cpp::thread_pool<true> pool;
+
+    dll::reset_pool_stats();
+    dll::enable_pool_stats();
+
+    std::atomic<size_t> sum{0};
+
+    for (size_t r = 0; r < 3; ++r) {
+        dll::auto_timer timer("test:pool");
+
+        dll::maybe_parallel_foreach_n(pool, 0, 8, [&sum](size_t i) { sum += i; });
+    }
+
+    dll::enable_pool_stats(false);
+
+    dll::maybe_parallel_foreach_n(pool, 0, 8, [&sum](size_t i) { sum += i; });
+
+    REQUIRE(sum == 4 * 28);
+
+    auto regions = dll::pool_stats_snapshot();
+
+    REQUIRE(regions.size() == 1);
+
+    auto& region = regions["test:pool"];
+
+    REQUIRE(region.regions == 3);
+    REQUIRE(region.tasks == 24);
+    REQUIRE(!region.workers.empty());
+    REQUIRE(region.imbalance > 2.99);
+
+    size_t tasks = 0;
+    for (auto& [worker, values] : region.workers) {
+        tasks += values.tasks;
+    }
+
+    REQUIRE(tasks == 24);
+
+    dll::reset_pool_stats();
+
+    REQUIRE(dll::pool_stats_snapshot().empty());
+}
+
+// The nested regions are forked on the work-stealing scheduler
+TEST_CASE("unit/dense/work_stealing", "[unit][dense][dbn][mnist][sgd]") {
+    cpp::thread_pool<true> pool;
+
+    std::atomic<size_t> sum{0};
+    std::atomic<size_t> scoped{0};
+
+    dll::enable_work_stealing();
+
+    dll::maybe_parallel_foreach_n(pool, 0, 16, [&pool, &sum, &scoped](size_t i) {
+        scoped += dll::scoped_thread_pool() == &pool;
+
+        dll::maybe_parallel_foreach_n(pool, 0, 16, [&sum, i](size_t j) { sum += i * 16 + j; });
+    });
+
+    REQUIRE(sum == 255 * 256 / 2);
+    REQUIRE(scoped == 16);
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::normalize_pre{}, dll::batch_size<10>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+
+    dll::enable_work_stealing(false);
+
+    REQUIRE(!dll::active_scheduler());
+}
+
+TEST_CASE("unit/dense/cost", "[unit][dense][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 30>::layer_t,
+            dll::scale_layer_desc<1, 2>::layer_t,
+            dll::dense_layer_desc<30, 5, dll::softmax>::layer_t>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto costs = dbn->layer_costs(8);
+
+    REQUIRE(costs.size() == 3);
+
+    // One multiply-add per weight and per sample, plus the biases and the activation
+    REQUIRE(costs[0].forward_flops == 8 * (2 * 20 * 30 + 30));
+    REQUIRE(costs[0].backward_flops == 8 * 2 * 20 * 30);
+    REQUIRE(costs[0].forward_bytes == (8 * (20 + 30) + 20 * 30 + 30) * sizeof(float));
+
+    REQUIRE(costs[1].forward_flops == 8 * 30);
+    REQUIRE(costs[2].forward_flops == 8 * (2 * 30 * 5 + 5));
+
+    auto durations = dbn->profile_forward(8, 2);
+
+    REQUIRE(durations.size() == 3);
+    REQUIRE(durations[0] > 0.0);
+
+    dbn->display_roofline(8, 2);
+}
+
+TEST_CASE("unit/dense/memory", "[unit][dense][dbn]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 30>::layer_t,
+            dll::dense_layer_desc<30, 5, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::ADAM>,
+        dll::batch_size<8>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto report = dbn->memory();
+
+    REQUIRE(report.total() == (20 * 30 + 30 + 30 * 5 + 5) * sizeof(float));
+    REQUIRE(report.total("layer:0") == (20 * 30 + 30) * sizeof(float));
+
+    // The backups are only allocated by backup_weights
+    dbn->backup_weights();
+
+    REQUIRE(dbn->memory().total() == 2 * report.total());
+
+    dll::sgd_trainer<dbn_t> trainer(*dbn);
+
+    dll::memory_report training;
+    trainer.report_memory(training);
+
+    // Input, output and errors of the batch
+    REQUIRE(training.total("sgd:0 activations") == 8 * (20 + 30 + 30) * sizeof(float));
+
+    // Gradients and the two moments of Adam
+    REQUIRE(training.total("sgd:0 updater") == 3 * (20 * 30 + 30) * sizeof(float));
+
+    training.record_peak();
+
+    REQUIRE(dll::memory_peak() >= training.total());
+}
+
+TEST_CASE("unit/dense/throughput", "[unit][dense]") {
+    dll::throughput_meter meter;
+
+    meter.start_epoch();
+
+    for (size_t b = 0; b < 4; ++b) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        meter.start_batch();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+
+        meter.end_batch(10);
+    }
+
+    auto& epoch = meter.epoch;
+
+    REQUIRE(epoch.samples == 40);
+    REQUIRE(epoch.batches == 4);
+    REQUIRE(epoch.compute >= 8000000);
+    REQUIRE(epoch.generator >= 4000000);
+    REQUIRE(epoch.wall >= epoch.compute + epoch.generator);
+
+    // The compute alone is faster than the whole epoch
+    REQUIRE(epoch.compute_samples_per_second() > epoch.samples_per_second());
+    REQUIRE(epoch.samples_per_second() > 0.0);
+    REQUIRE(meter.samples_rate.value > 0.0);
+    REQUIRE(meter.eta(10) > 0.0);
+
+    meter.start_epoch();
+
+    REQUIRE(meter.epoch.batches == 0);
+}
+
+TEST_CASE("unit/dense/json_watcher", "[unit][dense][dbn][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<10, 20>::layer_t,
+            dll::dense_layer_desc<20, 2, dll::softmax>::layer_t>,
+        dll::batch_size<10>,
+        dll::watcher<dll::json_dbn_watcher>
+    >::dbn_t;
+
+    std::vector<etl::dyn_vector<float>> samples;
+    std::vector<size_t> labels;
+
+    for (size_t i = 0; i < 100; ++i) {
+        samples.emplace_back(10);
+        samples.back() = etl::uniform_generator(-1.0, 1.0);
+        labels.push_back(i % 2);
+    }
+
+    const std::string file = "dll_test_metrics.jsonl";
+
+    REQUIRE(dll::get_metrics_stream().open_file(file));
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->fine_tune(samples, labels, 3);
+
+    dll::get_metrics_stream().flush();
+
+    std::ifstream is(file);
+
+    size_t epochs  = 0;
+    size_t batches = 0;
+    size_t ends    = 0;
+
+    for (std::string line; std::getline(is, line);) {
+        REQUIRE(line.front() == '{');
+        REQUIRE(line.back() == '}');
+
+        if (line.find("\"type\": \"epoch\"") != std::string::npos) {
+            ++epochs;
+
+            REQUIRE(line.find("\"samples_per_second\": ") != std::string::npos);
+            REQUIRE(line.find("\"loss\": ") != std::string::npos);
+        } else if (line.find("\"type\": \"batch\"") != std::string::npos) {
+            ++batches;
+        } else if (line.find("\"type\": \"training_end\"") != std::string::npos) {
+            ++ends;
+        }
+    }
+
+    REQUIRE(epochs > 0);
+    REQUIRE(epochs <= 3);
+    REQUIRE(batches == epochs * 10);
+    REQUIRE(ends == 1);
+
+    dll::get_metrics_stream().close();
+    std::remove(file.c_str());
+}
+
+// The training is stopped by the first non-finite value
+TEST_CASE("unit/dense/finite_checks", "[unit][dense][dbn][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<10, 20>::layer_t,
+            dll::dense_layer_desc<20, 2, dll::softmax>::layer_t>,
+        dll::batch_size<10>,
+        dll::watcher<dll::json_dbn_watcher>
+    >::dbn_t;
+
+    std::vector<float> values(37, 1.0f);
+
+    REQUIRE(dll::all_finite(values.data(), values.size()));
+
+    values[35] = std::numeric_limits<float>::infinity();
+
+    REQUIRE(!dll::all_finite(values.data(), values.size()));
+    REQUIRE(dll::all_finite(values.data(), 35));
+
+    std::vector<etl::dyn_vector<float>> samples;
+    std::vector<size_t> labels;
+
+    for (size_t i = 0; i < 100; ++i) {
+        samples.emplace_back(10);
+        samples.back() = etl::uniform_generator(-1.0, 1.0);
+        labels.push_back(i % 2);
+    }
+
+    // The fourth batch diverges
+    samples[35][3] = std::numeric_limits<float>::quiet_NaN();
+
+    const std::string file = "dll_test_finite.jsonl";
+
+    REQUIRE(dll::get_metrics_stream().open_file(file));
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->finite_checks = 100;
+
+    dbn->fine_tune(samples, labels, 3);
+
+    dll::get_metrics_stream().flush();
+
+    std::ifstream is(file);
+
+    size_t epochs  = 0;
+    size_t batches = 0;
+
+    for (std::string line; std::getline(is, line);) {
+        if (line.find("\"type\": \"epoch\"") != std::string::npos) {
+            ++epochs;
+        } else if (line.find("\"type\": \"batch\"") != std::string::npos) {
+            ++batches;
+        }
+    }
+
+    REQUIRE(epochs == 0);
+    REQUIRE(batches == 4);
+
+    dll::get_metrics_stream().close();
+    std::remove(file.c_str());
+}
+
+// The contiguous inputs of the weight type are used in place
+TEST_CASE("unit/dense/input_view", "[unit][dense]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<12, 5, dll::relu>::layer_t,
+            dll::dense_layer_desc<5, 3, dll::softmax>::layer_t>,
+        dll::batch_size<4>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    std::vector<float> sample(12);
+    std::iota(sample.begin(), sample.end(), 0.0f);
+
+    etl::dyn_matrix<float, 1> copy(12);
+    std::copy(sample.begin(), sample.end(), copy.begin());
+
+    auto view = dll::input_view(sample, 12);
+
+    REQUIRE(view.memory_start() == sample.data());
+    REQUIRE(etl::approx_equals(dbn->features(view), dbn->features(copy), 1e-6));
+    REQUIRE(dbn->predict(view) == dbn->predict(copy));
+
+    // The converters only copy when the value type differs
+    auto& layer = dbn->template layer_get<0>();
+
+    auto same = dll::converter_one<std::vector<float>, etl::dyn_matrix<float, 1>>::convert(layer, sample);
+    REQUIRE(same.memory_start() == sample.data());
+
+    std::vector<double> wide(sample.begin(), sample.end());
+
+    auto converted = dll::converter_one<std::vector<double>, etl::dyn_matrix<float, 1>>::convert(layer, wide);
+    REQUIRE(etl::approx_equals(converted, copy, 1e-6));
+
+    std::vector<std::vector<float>> samples(3, sample);
+
+    auto views = dll::converter_many<std::vector<std::vector<float>>, std::vector<etl::dyn_matrix<float, 1>>>::convert(layer, samples);
+    REQUIRE(views.size() == 3);
+    REQUIRE(views[2].memory_start() == samples[2].data());
+}
+
+// The model-parallel kernels compute the same products as ETL
+TEST_CASE("unit/dense/model_parallel", "[unit][dense][dbn][mnist][sgd]") {
+    cpp::thread_pool<true> pool;
+
+    etl::dyn_matrix<float, 2> input(8, 20);
+    etl::dyn_matrix<float, 2> w(20, 1024);
+    etl::dyn_matrix<float, 2> errors(8, 1024);
+
+    input  = etl::normal_generator(0.0, 1.0);
+    w      = etl::normal_generator(0.0, 1.0);
+    errors = etl::normal_generator(0.0, 1.0);
+
+    REQUIRE(dll::model_parallel_shards(1024, 4) == 4);
+    REQUIRE(dll::model_parallel_shards(1024, 8) == 4);
+    REQUIRE(dll::model_parallel_shards(100, 4) == 1);
+
+    dll::weight_shards<float> shards;
+
+    etl::dyn_matrix<float, 2> output(8, 1024);
+    dll::model_parallel_forward(pool, input, w, output, shards, 4);
+    REQUIRE(etl::approx_equals(output, etl::dyn_matrix<float, 2>(input * w), 1e-3));
+
+    etl::dyn_matrix<float, 2> back(8, 20);
+    dll::model_parallel_backward(pool, errors, w, back, shards, 4);
+    REQUIRE(etl::approx_equals(back, etl::dyn_matrix<float, 2>(errors * etl::transpose(w)), 1e-3));
+
+    etl::dyn_matrix<float, 2> grad(20, 1024);
+    dll::model_parallel_gradients(pool, input, errors, grad, 4);
+    REQUIRE(etl::approx_equals(grad, etl::dyn_matrix<float, 2>(etl::batch_outer(input, errors)), 1e-3));
+
+    // The shards are computed again after an update of the weights
+    w *= 2.0f;
+    shards.invalidate();
+
+    dll::model_parallel_forward(pool, input, w, output, shards, 4);
+    REQUIRE(etl::approx_equals(output, etl::dyn_matrix<float, 2>(input * w), 1e-3));
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 1024, dll::model_parallel<4>>::layer_t,
+            dll::dense_layer_desc<1024, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::normalize_pre{}, dll::batch_size<10>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// The backward pass multiplies by the cached transposed weights without BLAS
+TEST_CASE("unit/dense/transposed_weights", "[unit][dense]") {
+    dll::reset_timers();
+
+    dll::dense_layer_desc<20, 30>::layer_t layer;
+
+    struct {
+        etl::fast_dyn_matrix<float, 8, 30> errors;
+    } context;
+
+    context.errors = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 8, 20> back;
+
+    for (size_t i = 0; i < 3; ++i) {
+        layer.backward_batch(back, context);
+    }
+
+    REQUIRE(etl::approx_equals(back, etl::fast_dyn_matrix<float, 8, 20>(context.errors * etl::transpose(layer.w)), 1e-4));
+
+    // The weights are transposed once per update, never in the products
+    layer.w *= 2.0f;
+    layer.invalidate_weights_cache();
+
+    layer.backward_batch(back, context);
+
+    REQUIRE(etl::approx_equals(back, etl::fast_dyn_matrix<float, 8, 20>(context.errors * etl::transpose(layer.w)), 1e-4));
+
+    auto timers = dll::get_timers().snapshot();
+
+    auto it = std::find_if(timers.begin(), timers.end(), [](auto& timer) { return std::string(timer.name) == "dense:transpose"; });
+
+    if (dll::transpose_free_gemm) {
+        REQUIRE(it == timers.end());
+    } else {
+        REQUIRE(it != timers.end());
+        REQUIRE(it->count == 2);
+    }
+
+    dll::reset_timers();
+}
+
+TEST_CASE("unit/dense/packed", "[unit][dense]") {
+    using binarize_t = dll::binarize_layer_desc<30>::layer_t;
+
+    dll::dense_layer_desc<100, 40>::layer_t layer;
+
+    etl::fast_dyn_matrix<float, 8, 100> input;
+    input = etl::uniform_generator(0.0, 60.0);
+
+    etl::fast_dyn_matrix<float, 8, 100> binary;
+    binarize_t::forward_batch(binary, input);
+
+    for (size_t i = 0; i < etl::size(input); ++i) {
+        REQUIRE(binary[i] == (input[i] > 30.0f ? 1.0f : 0.0f));
+    }
+
+    dll::binary_states packed;
+    binarize_t::forward_batch_packed(packed, input);
+
+    REQUIRE(packed.rows == 8);
+    REQUIRE(packed.cols == 100);
+
+    for (size_t r = 0; r < 8; ++r) {
+        for (size_t j = 0; j < 100; ++j) {
+            REQUIRE(packed.get(r, j) == (binary(r, j) == 1.0f));
+        }
+    }
+
+    etl::fast_dyn_matrix<float, 8, 40> expected;
+    etl::fast_dyn_matrix<float, 8, 40> output;
+
+    layer.forward_batch(expected, binary);
+    layer.forward_batch_packed(output, packed);
+
+    REQUIRE(etl::approx_equals(output, expected, 1e-4));
+}
+
+TEST_CASE("unit/dense/cross_validation", "[unit][dense][dbn][mnist]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    std::vector<size_t> configured(4, 0);
+
+    auto results = dll::cross_validate<dbn_t>(dataset.train(), 4, 10, [&configured](dbn_t& dbn, size_t fold) {
+        dbn.learning_rate = 0.03;
+        configured[fold]  = 1;
+    });
+
+    REQUIRE(results.folds.size() == 4);
+    REQUIRE(std::accumulate(configured.begin(), configured.end(), size_t(0)) == 4);
+
+    double mean = 0.0;
+
+    for (auto& fold : results.folds) {
+        REQUIRE(fold.train_error < 0.2);
+        REQUIRE(fold.error < 0.3);
+
+        mean += fold.error / 4;
+    }
+
+    REQUIRE(results.mean_error == Approx(mean));
+    REQUIRE(results.stddev_error >= 0.0);
+
+    // The shared generator is left untouched
+    REQUIRE(dataset.train().size() == 1000);
+}
+
+namespace {
+
+// Simulate a second rank, which sends the same bytes as this rank
+struct mirrored_rank_transport : dll::distributed_transport {
+    size_t rank() const override {
+        return 0;
+    }
+
+    size_t size() const override {
+        return 2;
+    }
+
+    void allreduce(float* data, size_t n) override {
+        for (size_t i = 0; i < n; ++i) {
+            data[i] *= 2.0f;
+        }
+    }
+
+    void allreduce(double* data, size_t n) override {
+        for (size_t i = 0; i < n; ++i) {
+            data[i] *= 2.0;
+        }
+    }
+
+    void broadcast(float* /*data*/, size_t /*n*/) override {}
+    void broadcast(double* /*data*/, size_t /*n*/) override {}
+
+    void allgather(const uint8_t* data, size_t bytes, uint8_t* output) override {
+        std::copy(data, data + bytes, output);
+        std::copy(data, data + bytes, output + bytes);
+    }
+};
+
+} // end of anonymous namespace
+
+TEST_CASE("unit/dense/gradient_compression", "[unit][dense]") {
+    constexpr size_t n = 2000;
+
+    mirrored_rank_transport transport;
+    dll::gradient_compression_policy policy;
+
+    policy.codec      = dll::gradient_codec::FP16;
+    policy.topk_ratio = 0.1;
+    policy.set_layer(1, dll::gradient_codec::TOPK);
+    policy.set_layer(2, dll::gradient_codec::SIGN);
+
+    // The small variables are never compressed
+    REQUIRE(policy.select(0, 100) == dll::gradient_codec::NONE);
+    REQUIRE(policy.select(0, n) == dll::gradient_codec::FP16);
+    REQUIRE(policy.select(1, n) == dll::gradient_codec::TOPK);
+    REQUIRE(policy.select(2, n) == dll::gradient_codec::SIGN);
+
+    std::vector<float> grad(n);
+    std::vector<float> reduced(n);
+    std::vector<float> residual;
+
+    std::mt19937_64 engine(42);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    for (auto& value : grad) {
+        value = dist(engine);
+    }
+
+    // Half precision: the sum of the two ranks, within the precision
+    reduced = grad;
+    dll::compressed_allreduce(transport, policy, dll::gradient_codec::FP16, reduced.data(), n, residual);
+
+    for (size_t i = 0; i < n; ++i) {
+        REQUIRE(reduced[i] == Approx(2.0f * grad[i]).margin(2e-3));
+    }
+
+    // Top-k: the largest gradients are sent, the others are kept in the residual
+    residual.clear();
+    reduced = grad;
+    dll::compressed_allreduce(transport, policy, dll::gradient_codec::TOPK, reduced.data(), n, residual);
+
+    REQUIRE(std::count_if(reduced.begin(), reduced.end(), [](float v) { return v != 0.0f; }) == 200);
+
+    for (size_t i = 0; i < n; ++i) {
+        REQUIRE(reduced[i] / 2.0f + residual[i] == Approx(grad[i]));
+    }
+
+    // Sign: the error of the signs is kept in the residual
+    residual.clear();
+    reduced = grad;
+    dll::compressed_allreduce(transport, policy, dll::gradient_codec::SIGN, reduced.data(), n, residual);
+
+    for (size_t i = 0; i < n; ++i) {
+        REQUIRE(std::abs(reduced[i]) == Approx(std::abs(reduced[0])));
+        REQUIRE(reduced[i] / 2.0f + residual[i] == Approx(grad[i]));
+    }
+
+    REQUIRE(policy.sent_bytes == 2 * n + 200 * 8 + 4 + n / 8);
+    REQUIRE(policy.ratio() > 3.0);
+}
+
+TEST_CASE("unit/dense/sgd/distributed/compressed", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<25>
+    >::dbn_t;
+
+    constexpr size_t ranks = 2;
+
+    std::vector<std::unique_ptr<dbn_t>> dbns(ranks);
+    std::vector<double> errors(ranks);
+    std::vector<std::thread> threads;
+
+    for (size_t r = 0; r < ranks; ++r) {
+        threads.emplace_back([&dbns, &errors, r] {
+            auto dataset = dll::make_mnist_dataset_sub(r * 500, 500, dll::normalize_pre{}, dll::batch_size<25>{});
+
+            auto& dbn = dbns[r];
+
+            dbn = std::make_unique<dbn_t>();
+
+            dbn->learning_rate = 0.1;
+            dbn->transport     = std::make_shared<dll::tcp_transport>(r, ranks, "127.0.0.1", 27316);
+
+            // Half precision for the first layer, top-k for the second one, the biases in full precision
+            dbn->gradient_compression.codec      = dll::gradient_codec::FP16;
+            dbn->gradient_compression.min_size   = 512;
+            dbn->gradient_compression.topk_ratio = 0.25;
+            dbn->gradient_compression.set_layer(1, dll::gradient_codec::TOPK);
+
+            errors[r] = dbn->fine_tune(dataset.train(), 25);
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // All the ranks sum the same decoded gradients
+    REQUIRE(etl::approx_equals(dbns[0]->template layer_get<0>().w, dbns[1]->template layer_get<0>().w, 1e-6));
+    REQUIRE(etl::approx_equals(dbns[0]->template layer_get<1>().w, dbns[1]->template layer_get<1>().w, 1e-6));
+
+    REQUIRE(dbns[0]->gradient_compression.ratio() > 1.5);
+
+    REQUIRE(errors[0] < 0.2);
+    REQUIRE(errors[1] < 0.2);
+}
+
+namespace {
+
+template <size_t B>
+using tuned_dbn_t = typename dll::dbn_desc<
+    dll::dbn_layers<
+        dll::dense_layer_desc<28 * 28, 100>::layer_t,
+        dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+    dll::batch_size<B>
+>::dbn_t;
+
+} // end of anonymous namespace
+
+TEST_CASE("unit/dense/batch_tuner", "[unit][dense][dbn]") {
+    dll::batch_tuning_desc desc;
+    desc.warmup    = 1;
+    desc.steps     = 2;
+    desc.effective = 256;
+
+    size_t configured = 0;
+
+    auto tuning = dll::tune_batch_size<tuned_dbn_t, 8, 32, 128>(desc, [&configured](auto& dbn) {
+        dbn.learning_rate = 0.1;
+        ++configured;
+    });
+
+    REQUIRE(configured == 3);
+    REQUIRE(tuning.candidates.size() == 3);
+
+    for (auto& c : tuning.candidates) {
+        REQUIRE(c.fits);
+        REQUIRE(c.samples_per_second > 0.0);
+        REQUIRE(c.batch_bytes == c.batch * (28 * 28 + 10) * sizeof(float));
+    }
+
+    // The memory grows with the batch size
+    REQUIRE(tuning.candidates[0].bytes < tuning.candidates[2].bytes);
+
+    REQUIRE(tuning.batch > 0);
+    REQUIRE(tuning.big_batch == desc.max_big_batch);
+    REQUIRE(tuning.accumulation == 256 / tuning.batch);
+
+    size_t applied = 0;
+
+    REQUIRE(dll::with_tuned_batch<8, 32, 128>(tuning, [&applied](auto b) {
+        applied = tuned_dbn_t<decltype(b)::value>::batch_size;
+    }));
+
+    REQUIRE(applied == tuning.batch);
+
+    // Only the smallest candidate fits in a budget between the two smallest
+    desc.budget = (tuning.candidates[0].bytes + tuning.candidates[1].bytes) / 2;
+
+    auto limited = dll::tune_batch_size<tuned_dbn_t, 8, 32, 128>(desc);
+
+    REQUIRE(limited.candidates[0].fits);
+    REQUIRE(!limited.candidates[1].fits);
+    REQUIRE(!limited.candidates[2].fits);
+
+    REQUIRE(limited.batch == 8);
+    REQUIRE(limited.big_batch == std::min(desc.max_big_batch, (desc.budget - limited.candidates[0].bytes) / limited.candidates[0].batch_bytes + 1));
+}
@@ -0,0 +1,108 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <deque>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/depthwise_conv_layer.hpp"
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/dyn_dense_layer.hpp"
+#include "dll/dbn.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+TEST_CASE("unit/depthwise/1", "[depthwise][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 4, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+            dll::depthwise_conv_layer_desc<4, 26, 26, 8, 3, 3, dll::activation<dll::function::SIGMOID>>::layer_t,
+            dll::dense_layer_desc<8 * 24 * 24, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    dbn->display_pretty();
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.2);
+}
+
+TEST_CASE("unit/depthwise/2", "[depthwise][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dyn_depthwise_conv_layer_desc<dll::activation<dll::function::SIGMOID>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_3d<std::vector, etl::dyn_matrix<float, 3>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->template layer_get<0>().init_layer(1, 28, 28, 6, 5, 5);
+    dbn->template layer_get<1>().init_layer(6 * 24 * 24, 10);
+
+    dbn->learning_rate = 0.05;
+
+    dbn->display_pretty();
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.2);
+}
+
+// The kernels compute the same convolutions as ETL for each channel
+TEST_CASE("unit/depthwise/kernels", "[depthwise][unit]") {
+    etl::fast_dyn_matrix<float, 2, 3, 7, 6> input;
+    etl::fast_dyn_matrix<float, 3, 3, 3> w;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+    w     = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 2, 3, 5, 4> output;
+    etl::fast_dyn_matrix<float, 2, 3, 7, 6> back;
+    etl::fast_dyn_matrix<float, 3, 3, 3> grad;
+
+    dll::depthwise_forward(input.memory_start(), w.memory_start(), output.memory_start(), 2, 3, 7, 6, 3, 3);
+    dll::depthwise_backward(output.memory_start(), w.memory_start(), back.memory_start(), 2, 3, 7, 6, 3, 3);
+    dll::depthwise_backward_filter(input.memory_start(), output.memory_start(), grad.memory_start(), 2, 3, 7, 6, 3, 3);
+
+    for (size_t c = 0; c < 3; ++c) {
+        etl::fast_dyn_matrix<float, 2, 1, 7, 6> input_c;
+        etl::fast_dyn_matrix<float, 2, 1, 5, 4> output_c;
+        etl::fast_dyn_matrix<float, 1, 1, 3, 3> w_c;
+
+        for (size_t b = 0; b < 2; ++b) {
+            input_c(b)(0)  = input(b)(c);
+            output_c(b)(0) = output(b)(c);
+        }
+
+        w_c(0)(0) = w(c);
+
+        etl::fast_dyn_matrix<float, 2, 1, 5, 4> ref_output;
+        etl::fast_dyn_matrix<float, 2, 1, 7, 6> ref_back;
+        etl::fast_dyn_matrix<float, 1, 1, 3, 3> ref_grad;
+
+        ref_output = etl::ml::convolution_forward(input_c, w_c);
+        ref_back   = etl::ml::convolution_backward(output_c, w_c);
+        ref_grad   = etl::ml::convolution_backward_filter(input_c, output_c);
+
+        for (size_t b = 0; b < 2; ++b) {
+            REQUIRE(etl::approx_equals(output(b)(c), ref_output(b)(0), 1e-4));
+            REQUIRE(etl::approx_equals(back(b)(c), ref_back(b)(0), 1e-4));
+        }
+
+        REQUIRE(etl::approx_equals(grad(c), ref_grad(0)(0), 1e-3));
+    }
+}
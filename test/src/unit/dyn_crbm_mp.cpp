@@ -66,3 +66,30 @@ TEST_CASE("unit/dyn_crbm_mp/mnist/4", "[dyn_crbm_mp][relu][unit]") {
     auto error = rbm.train(dataset.training_images, 50);
     REQUIRE(error < 5e-2);
 }
+
+TEST_CASE("unit/dyn_crbm_mp/mnist/states", "[dyn_crbm_mp][unit]") {
+    dll::dyn_conv_rbm_mp_desc<dll::momentum>::layer_t rbm;
+
+    rbm.init_layer(1, 28, 28, 20, 17, 17, 2);
+
+    // The per-sample states are not used by the training
+    REQUIRE(!rbm.has_states());
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 20);
+    REQUIRE(error < 1e-1);
+
+    REQUIRE(!rbm.has_states());
+
+    // They are allocated by the single-sample functions
+    auto sample_error = rbm.reconstruction_error(dataset.training_images[0]);
+    REQUIRE(rbm.has_states());
+    REQUIRE(sample_error < 1.0);
+
+    rbm.release_states();
+    REQUIRE(!rbm.has_states());
+}
@@ -192,3 +192,70 @@ TEST_CASE("unit/dyn_dense/sgd/7", "[unit][dyn_dense][dbn][mnist][sgd]") {
     FT_CHECK(50, 5e-2);
     TEST_CHECK(0.2);
 }
+
+// Test the dispatch of the common shapes to compile-time kernels
+TEST_CASE("unit/dyn_dense/sgd/shapes", "[unit][dyn_dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dyn_dense_layer_desc<>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>, dll::normalize_pre>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->template layer_get<0>().init_layer(28 * 28, 100);
+    dbn->template layer_get<1>().init_layer(100, 10);
+
+    REQUIRE(dbn->template layer_get<0>().shape_index < dll::default_dyn_shapes::size);
+    REQUIRE(dbn->template layer_get<1>().shape_index < dll::default_dyn_shapes::size);
+
+    // The dispatched product must be the same as the dynamic one
+    auto& layer = dbn->template layer_get<0>();
+
+    etl::dyn_matrix<float, 2> batch(10, 28 * 28);
+    etl::dyn_matrix<float, 2> output(10, 100);
+
+    for (size_t i = 0; i < 10; ++i) {
+        batch(i) = dataset.training_images[i] / 255.0f;
+    }
+
+    layer.forward_batch(output, batch);
+
+    etl::dyn_matrix<float, 2> expected = etl::sigmoid(etl::bias_add_2d(batch * layer.w, layer.b));
+
+    REQUIRE(etl::approx_equals(output, expected, 1e-5));
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// The shape layer is only a view of the batch given to the next layer
+TEST_CASE("unit/dyn_dense/shape/alias", "[unit][dyn_dense][dbn]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::shape_1d_layer_desc<28 * 28>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::SIGMOID>>::layer_t>,
+        dll::batch_size<10>>::dbn_t dbn_t;
+
+    static_assert(dll::is_alias_layer_v<dll::shape_1d_layer_desc<28 * 28>::layer_t>, "The shape layers must be aliases");
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->template layer_get<1>().init_layer(28 * 28, 100);
+
+    etl::dyn_matrix<float, 2> batch(10, 28 * 28);
+    etl::dyn_matrix<float, 2> expected(10, 100);
+
+    batch = etl::uniform_generator(0.0, 1.0);
+
+    dbn->template layer_get<1>().forward_batch(expected, batch);
+
+    auto output = dbn->forward_batch(batch);
+
+    REQUIRE(etl::approx_equals(output, expected, 1e-5));
+}
@@ -54,3 +54,19 @@ TEST_CASE("unit/dyn_rbm/mnist/3", "[rbm][dyn][relu][momentum][unit]") {
     auto error = rbm.train(dataset.training_images, 50);
     REQUIRE(error < 5e-2);
 }
+
+TEST_CASE("unit/dyn_rbm/mnist/pt", "[rbm][dyn][pt][unit]") {
+    dll::dyn_rbm_desc<
+        dll::momentum,
+        dll::trainer_rbm<dll::pt1_trainer_t>>::layer_t rbm(28 * 28, 100);
+
+    rbm.tempering_replicas = 4;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+    REQUIRE(error < 15e-2);
+}
@@ -12,6 +12,7 @@
 #include "cpp_utils/tuple_utils.hpp"
 
 #include "dll/neural/embedding_layer.hpp"
+#include "dll/neural/one_hot_dense_layer.hpp"
 #include "dll/neural/conv_layer.hpp"
 #include "dll/pooling/mp_layer.hpp"
 #include "dll/neural/dense_layer.hpp"
@@ -142,3 +143,272 @@ TEST_CASE("unit/embedding/2", "[unit][embedding]") {
     REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
     REQUIRE(net->evaluate_error(samples, labels) < 5e-2);
 }
+
+// Simple embedding with three group CNN, the groups running in parallel
+TEST_CASE("unit/embedding/parallel", "[unit][embedding]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t embedding = 16;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding>
+            , dll::merge_layer<
+                0
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 3, embedding>
+                    , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+                >
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 4, embedding>
+                    , dll::mp_2d_layer<16, length - 4 + 1, 1, length - 4 + 1, 1>
+                >
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 5, embedding>
+                    , dll::mp_2d_layer<16, length - 5 + 1, 1, length - 5 + 1, 1>
+                >
+            >
+            , dll::dense_layer<48, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>     // Nesterov Adam (NADAM)
+        , dll::batch_size<50>                        // The mini-batch size
+        , dll::shuffle                               // Shuffle before each epoch
+    >::network_t;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    net->template layer_get<1>().parallel_threshold = 0;
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
+    REQUIRE(net->evaluate_error(samples, labels) < 5e-2);
+}
+
+// Simple embedding with one CNN, trained asynchronously
+TEST_CASE("unit/embedding/async", "[unit][embedding]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t embedding = 8;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding>,
+              dll::conv_layer<1, length, embedding, 16, 3, embedding>
+            , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+            , dll::dense_layer<16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>     // Nesterov Adam (NADAM)
+        , dll::trainer<dll::async_sgd_trainer>       // Hogwild training
+        , dll::staleness<4>                          // At most 4 batches in flight
+        , dll::batch_size<50>                        // The mini-batch size
+        , dll::shuffle                               // Shuffle before each epoch
+    >::network_t;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 0.1);
+    REQUIRE(net->evaluate_error(samples, labels) < 0.25);
+}
+
+TEST_CASE("unit/embedding/lazy", "[unit][embedding]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t embedding = 8;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding>,
+              dll::conv_layer<1, length, embedding, 16, 3, embedding>
+            , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+            , dll::dense_layer<16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAM>      // Adam
+        , dll::lazy_updates                          // Only update the referenced rows of the embedding
+        , dll::batch_size<50>                        // The mini-batch size
+        , dll::shuffle                               // Shuffle before each epoch
+    >::network_t;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 0.1);
+    REQUIRE(net->evaluate_error(samples, labels) < 0.25);
+}
+
+// The lookup takes integer indices as well as floating point ones
+TEST_CASE("unit/embedding/gather", "[unit][embedding]") {
+    dll::embedding_layer<26, 15, 8> layer;
+
+    etl::fast_dyn_matrix<float, 4, 15> input;
+    etl::fast_dyn_matrix<uint32_t, 4, 15> indices;
+
+    for (size_t i = 0; i < etl::size(input); ++i) {
+        indices[i] = (i * 7) % 26;
+        input[i]   = indices[i];
+    }
+
+    etl::fast_dyn_matrix<float, 4, 15, 8> output;
+    layer.forward_batch(output, input);
+
+    etl::fast_dyn_matrix<float, 4, 15, 8> int_output;
+    layer.forward_batch(int_output, indices);
+
+    for (size_t b = 0; b < 4; ++b) {
+        for (size_t i = 0; i < 15; ++i) {
+            REQUIRE(etl::approx_equals(output(b)(i), layer.w(indices(b, i)), 1e-6));
+            REQUIRE(etl::approx_equals(int_output(b)(i), layer.w(indices(b, i)), 1e-6));
+        }
+    }
+
+    // The gradients accumulate the errors of the repeated rows
+
+    etl::fast_dyn_matrix<float, 4, 15, 8> errors;
+    errors = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 26, 8> grad;
+    std::vector<size_t> rows;
+    bool sparse = false;
+
+    dll::sparse_embedding_gradients(input, errors, grad, rows, sparse);
+
+    etl::fast_dyn_matrix<float, 26, 8> expected(0.0);
+
+    for (size_t b = 0; b < 4; ++b) {
+        for (size_t i = 0; i < 15; ++i) {
+            expected(indices(b, i)) += errors(b)(i);
+        }
+    }
+
+    REQUIRE(etl::approx_equals(grad, expected, 1e-5));
+    REQUIRE(std::is_sorted(rows.begin(), rows.end()));
+    REQUIRE(rows.size() == 26);
+}
+
+// The one-hot dense layer is the dense layer on the one-hot input
+TEST_CASE("unit/embedding/one_hot", "[unit][embedding]") {
+    constexpr size_t L = 6;
+    constexpr size_t V = 5;
+
+    dll::one_hot_dense_layer<L, V, 7> layer;
+    dll::dense_layer<L * V, 7> dense;
+
+    dense.w = layer.w;
+    dense.b = etl::uniform_generator(-1.0, 1.0);
+    layer.b = dense.b;
+
+    etl::fast_dyn_matrix<float, 4, L> input;
+    etl::fast_dyn_matrix<float, 4, L * V> one_hot(0.0);
+
+    for (size_t b = 0; b < 4; ++b) {
+        for (size_t l = 0; l < L; ++l) {
+            input(b, l) = (b * 3 + l * 2) % V;
+
+            one_hot(b, l * V + size_t(input(b, l))) = 1.0;
+        }
+    }
+
+    etl::fast_dyn_matrix<float, 4, 7> output;
+    etl::fast_dyn_matrix<float, 4, 7> expected;
+
+    layer.forward_batch(output, input);
+    dense.forward_batch(expected, one_hot);
+
+    REQUIRE(etl::approx_equals(output, expected, 1e-5));
+
+    // Only the rows of the indices have gradients
+
+    etl::fast_dyn_matrix<float, 4, 7> errors;
+    errors = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, L * V, 7> grad;
+    std::vector<size_t> rows;
+    bool sparse = false;
+
+    dll::sparse_one_hot_gradients(input, errors, grad, rows, sparse, V);
+
+    etl::fast_dyn_matrix<float, L * V, 7> expected_grad;
+    expected_grad = etl::batch_outer(one_hot, errors);
+
+    REQUIRE(etl::approx_equals(grad, expected_grad, 1e-5));
+    REQUIRE(std::is_sorted(rows.begin(), rows.end()));
+    REQUIRE(rows.size() <= 4 * L);
+    REQUIRE(sparse);
+}
+
+// Texts encoded as indices, trained through a one-hot dense layer
+TEST_CASE("unit/embedding/one_hot/train", "[unit][embedding]") {
+    std::vector<std::string> words;
+    std::vector<size_t> labels;
+
+    generate(words, labels, "ZEROX", 0);
+    generate(words, labels, "XONEX", 1);
+    generate(words, labels, "XTWOX", 2);
+    generate(words, labels, "THREE", 3);
+    generate(words, labels, "FOURX", 4);
+
+    constexpr size_t length = 15;
+    constexpr size_t vocabulary_size = 26 + 2;
+
+    dll::text_vocabulary vocabulary;
+
+    auto generator = dll::make_text_index_generator<length>(words, labels, 5, vocabulary, dll::text_tokens::CHARS,
+                                                            dll::inmemory_data_generator_desc<dll::batch_size<50>, dll::categorical>{});
+
+    REQUIRE(vocabulary.size() <= vocabulary_size);
+    REQUIRE(generator->size() == words.size());
+
+    // The unknown characters of a frozen vocabulary and the padding
+    vocabulary.frozen = true;
+
+    etl::fast_dyn_matrix<float, length> sample;
+    dll::encode_text(vocabulary, "ZERO?", dll::text_tokens::CHARS, sample);
+
+    REQUIRE(sample[0] == vocabulary.index("Z"));
+    REQUIRE(sample[4] == dll::text_vocabulary::unknown);
+    REQUIRE(sample[5] == dll::text_vocabulary::padding);
+    REQUIRE(vocabulary.size() <= vocabulary_size);
+
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::one_hot_dense_layer<length, vocabulary_size, 32>,
+            dll::dense_layer<32, 5, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>
+        , dll::batch_size<50>
+        , dll::shuffle
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    REQUIRE(net->fine_tune(*generator, 25) < 5e-2);
+}
+
+// The branch copies give the same merge as ETL
+TEST_CASE("unit/merge/branch", "[unit][merge]") {
+    etl::fast_dyn_matrix<float, 4, 3, 5> a;
+    etl::fast_dyn_matrix<float, 4, 3, 5> b;
+
+    etl::fast_dyn_matrix<float, 4, 6, 5> merged;
+    etl::fast_dyn_matrix<float, 4, 6, 5> expected;
+
+    a = etl::uniform_generator(-1.0, 1.0);
+    b = etl::uniform_generator(-1.0, 1.0);
+
+    dll::merge_branch(merged, a, 0);
+    dll::merge_branch(merged, b, 1);
+
+    etl::batch_merge(expected, a, 0);
+    etl::batch_merge(expected, b, 1);
+
+    REQUIRE(etl::approx_equals(merged, expected, 1e-6));
+
+    etl::fast_dyn_matrix<float, 4, 3, 5> sub;
+
+    dll::dispatch_branch(sub, merged, 1);
+
+    REQUIRE(etl::approx_equals(sub, b, 1e-6));
+}
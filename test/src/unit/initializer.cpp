@@ -219,3 +219,51 @@ TEST_CASE("initializer/he", "[dense][unit][mnist][sgd]") {
 
     TEST_CHECK(0.2);
 }
+
+// The chunks drawn in parallel are the same as the serial ones
+TEST_CASE("initializer/parallel", "[unit][initializer]") {
+    const size_t n = 3 * dll::init_chunk + 5;
+
+    etl::dyn_matrix<float, 2> serial(n, 1);
+    etl::dyn_matrix<float, 2> parallel(n, 1);
+    etl::dyn_matrix<float, 2> deferred(n, 1);
+
+    {
+        dll::random_engine engine(42);
+        dll::engine_scope scope(engine);
+
+        dll::init_he::initialize(serial, 100, 10);
+    }
+
+    {
+        cpp::thread_pool<true> pool(4);
+        dll::thread_pool_scope pool_scope(pool);
+
+        dll::random_engine engine(42);
+        dll::engine_scope scope(engine);
+
+        dll::init_he::initialize(parallel, 100, 10);
+    }
+
+    {
+        cpp::thread_pool<true> pool(3);
+
+        dll::random_engine engine(42);
+        dll::engine_scope scope(engine);
+
+        dll::deferred_initialization inits;
+
+        dll::init_he::initialize(deferred, 100, 10);
+
+        inits.run(pool);
+    }
+
+    bool same = true;
+
+    for (size_t i = 0; i < n; ++i) {
+        same = same && serial[i] == parallel[i] && serial[i] == deferred[i];
+    }
+
+    REQUIRE(same);
+    REQUIRE(serial[0] != serial[dll::init_chunk]);
+}
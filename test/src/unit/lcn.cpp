@@ -260,3 +260,80 @@ TEST_CASE("unit/cdbn/lcn/mnist/8", "[cdbn][lcn][svm][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.1);
 }
+
+// The separable passes give the same normalization as the full 2D filter
+TEST_CASE("unit/lcn/separable", "[lcn][unit]") {
+    dll::lcn_layer_desc<5>::layer_t lcn;
+
+    dll::dyn_lcn_layer_desc::layer_t dyn_lcn;
+    dyn_lcn.init_layer(5);
+
+    etl::fast_dyn_matrix<float, 3, 2, 9, 11> input;
+    etl::fast_dyn_matrix<float, 3, 2, 9, 11> output;
+    etl::fast_dyn_matrix<float, 3, 2, 9, 11> dyn_output;
+    etl::fast_dyn_matrix<float, 3, 2, 9, 11> expected;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    lcn.forward_batch(output, input);
+    dyn_lcn.forward_batch(dyn_output, input);
+
+    auto w = lcn.filter<float>(lcn.sigma);
+
+    etl::fast_dyn_matrix<float, 9, 11> v;
+    etl::fast_dyn_matrix<float, 9, 11> o;
+
+    for (size_t b = 0; b < 3; ++b) {
+        for (size_t c = 0; c < 2; ++c) {
+            for (long j = 0; j < 9; ++j) {
+                for (long k = 0; k < 11; ++k) {
+                    float mean = 0.0f;
+                    float sum  = 0.0f;
+
+                    for (long p = 0; p < 5; ++p) {
+                        for (long q = 0; q < 5; ++q) {
+                            const long y = j + p - 2;
+                            const long x = k + q - 2;
+
+                            if (y >= 0 && y < 9 && x >= 0 && x < 11) {
+                                mean += w(p, q) * input(b, c, y, x);
+                                sum += w(p, q) * input(b, c, y, x) * input(b, c, y, x);
+                            }
+                        }
+                    }
+
+                    v(j, k) = input(b, c, j, k) - mean;
+                    o(j, k) = std::sqrt(sum);
+                }
+            }
+
+            expected(b)(c) = v / etl::max(o, etl::mean(o));
+        }
+    }
+
+    REQUIRE(etl::approx_equals(output, expected, 1e-4));
+    REQUIRE(etl::approx_equals(dyn_output, expected, 1e-4));
+}
+
+// Once the workspace is large enough, the forward pass allocates nothing
+TEST_CASE("unit/lcn/workspace", "[lcn][unit]") {
+    dll::dyn_lcn_layer_desc::layer_t lcn;
+    lcn.init_layer(5);
+
+    dll::workspace ws;
+    lcn.set_workspace(&ws);
+
+    etl::dyn_matrix<float, 4> input(3, 2, 9, 11);
+    etl::dyn_matrix<float, 4> output(3, 2, 9, 11);
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    lcn.forward_batch(output, input);
+
+    const size_t allocations = dll::workspace_allocations();
+
+    lcn.forward_batch(output, input);
+    lcn.forward_batch(output, input);
+
+    REQUIRE(dll::workspace_allocations() == allocations);
+}
@@ -5,6 +5,8 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <sstream>
+
 #include "dll_test.hpp"
 
 #include "dll/neural/dense_layer.hpp"
@@ -85,3 +87,188 @@ TEST_CASE("unit/lstm/3", "[unit][lstm]") {
     REQUIRE(net->fine_tune(dataset.train(), 50) < 0.5);
     REQUIRE(net->evaluate_error(dataset.test()) < 0.5);
 }
+
+// The fused gates are equivalent to the separate gates
+TEST_CASE("unit/lstm/fused", "[unit][lstm]") {
+    constexpr size_t time_steps      = 5;
+    constexpr size_t sequence_length = 7;
+    constexpr size_t hidden_units    = 6;
+
+    dll::lstm_layer<time_steps, sequence_length, hidden_units> layer;
+
+    etl::fast_dyn_matrix<float, 3, time_steps, sequence_length> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, time_steps, hidden_units> output;
+    layer.forward_batch(output, input);
+
+    etl::fast_dyn_matrix<float, 3, hidden_units> h;
+    etl::fast_dyn_matrix<float, 3, hidden_units> s;
+
+    for (size_t t = 0; t < time_steps; ++t) {
+        etl::fast_dyn_matrix<float, 3, sequence_length> x;
+
+        for (size_t b = 0; b < 3; ++b) {
+            x(b) = input(b)(t);
+        }
+
+        etl::fast_dyn_matrix<float, 3, hidden_units> g;
+        etl::fast_dyn_matrix<float, 3, hidden_units> i;
+        etl::fast_dyn_matrix<float, 3, hidden_units> f;
+        etl::fast_dyn_matrix<float, 3, hidden_units> o;
+
+        if (t == 0) {
+            g = etl::tanh(etl::bias_add_2d(x * layer.u_g, layer.b_g));
+            i = etl::sigmoid(etl::bias_add_2d(x * layer.u_i, layer.b_i));
+            o = etl::sigmoid(etl::bias_add_2d(x * layer.u_o, layer.b_o));
+
+            s = g >> i;
+            h = dll::f_activate<decltype(layer)::activation_function>(s) >> o;
+        } else {
+            g = etl::tanh(etl::bias_add_2d(x * layer.u_g + h * layer.w_g, layer.b_g));
+            i = etl::sigmoid(etl::bias_add_2d(x * layer.u_i + h * layer.w_i, layer.b_i));
+            f = etl::sigmoid(etl::bias_add_2d(x * layer.u_f + h * layer.w_f, layer.b_f));
+            o = etl::sigmoid(etl::bias_add_2d(x * layer.u_o + h * layer.w_o, layer.b_o));
+
+            s = dll::f_activate<decltype(layer)::activation_function>((g >> i) + (s >> f));
+            h = s >> o;
+        }
+
+        for (size_t b = 0; b < 3; ++b) {
+            REQUIRE(etl::approx_equals(output(b)(t), h(b), 1e-4));
+        }
+    }
+}
+
+// The inference path does not depend on the state of the training path
+TEST_CASE("unit/lstm/inference", "[unit][lstm]") {
+    constexpr size_t time_steps      = 5;
+    constexpr size_t sequence_length = 7;
+    constexpr size_t hidden_units    = 6;
+
+    dll::lstm_layer<time_steps, sequence_length, hidden_units> layer;
+
+    etl::fast_dyn_matrix<float, 3, time_steps, sequence_length> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, time_steps, hidden_units> output;
+    layer.forward_batch(output, input);
+
+    etl::fast_dyn_matrix<float, 3, time_steps, hidden_units> test_output;
+    layer.test_forward_batch(test_output, input);
+
+    REQUIRE(etl::approx_equals(output, test_output, 1e-5));
+
+    // The training caches follow the batch size
+
+    etl::fast_dyn_matrix<float, 2, time_steps, sequence_length> small_input;
+    small_input(0) = input(1);
+    small_input(1) = input(2);
+
+    etl::fast_dyn_matrix<float, 2, time_steps, hidden_units> small_output;
+    layer.forward_batch(small_output, small_input);
+
+    REQUIRE(etl::approx_equals(small_output(0), output(1), 1e-5));
+    REQUIRE(etl::approx_equals(small_output(1), output(2), 1e-5));
+}
+
+// Streaming the time steps gives the same output as the full window
+TEST_CASE("unit/lstm/stream", "[unit][lstm]") {
+    constexpr size_t time_steps      = 5;
+    constexpr size_t sequence_length = 7;
+    constexpr size_t hidden_units    = 6;
+
+    dll::lstm_layer<time_steps, sequence_length, hidden_units> layer;
+
+    etl::fast_dyn_matrix<float, 3, time_steps, sequence_length> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, time_steps, hidden_units> output;
+    layer.test_forward_batch(output, input);
+
+    for (size_t r = 0; r < 2; ++r) {
+        layer.reset_state();
+
+        for (size_t t = 0; t < time_steps; ++t) {
+            etl::fast_dyn_matrix<float, 3, 1, sequence_length> step;
+            etl::fast_dyn_matrix<float, 3, 1, hidden_units> step_output;
+
+            for (size_t b = 0; b < 3; ++b) {
+                step(b)(0) = input(b)(t);
+            }
+
+            layer.stream_batch(step_output, step);
+
+            for (size_t b = 0; b < 3; ++b) {
+                REQUIRE(etl::approx_equals(step_output(b)(0), output(b)(t), 1e-5));
+            }
+        }
+    }
+}
+
+// The padded steps of the variable-length sequences repeat their last output
+TEST_CASE("unit/lstm/variable", "[unit][lstm]") {
+    constexpr size_t time_steps      = 5;
+    constexpr size_t sequence_length = 7;
+    constexpr size_t hidden_units    = 6;
+
+    dll::lstm_layer<time_steps, sequence_length, hidden_units> layer;
+    dll::lstm_layer<time_steps, sequence_length, hidden_units, dll::variable_length> packed;
+
+    std::stringstream weights;
+    layer.store(weights);
+    packed.load(weights);
+
+    etl::fast_dyn_matrix<float, 4, time_steps, sequence_length> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    const size_t lengths[4] = {3, 5, 1, 4};
+
+    for (size_t b = 0; b < 4; ++b) {
+        for (size_t t = lengths[b]; t < time_steps; ++t) {
+            input(b)(t) = 0;
+        }
+    }
+
+    etl::fast_dyn_matrix<float, 4, time_steps, hidden_units> output;
+    layer.forward_batch(output, input);
+
+    etl::fast_dyn_matrix<float, 4, time_steps, hidden_units> packed_output;
+    packed.forward_batch(packed_output, input);
+
+    etl::fast_dyn_matrix<float, 4, time_steps, hidden_units> test_output;
+    packed.test_forward_batch(test_output, input);
+
+    for (size_t b = 0; b < 4; ++b) {
+        for (size_t t = 0; t < time_steps; ++t) {
+            const size_t last = std::min(t, lengths[b] - 1);
+
+            REQUIRE(etl::approx_equals(packed_output(b)(t), output(b)(last), 1e-5));
+            REQUIRE(etl::approx_equals(test_output(b)(t), output(b)(last), 1e-5));
+        }
+    }
+}
+
+// Batch-parallel backpropagation through time
+TEST_CASE("unit/lstm/parallel_bptt", "[unit][lstm]") {
+    auto dataset = dll::make_mnist_dataset_nc_sub(0, 2000, dll::batch_size<100>{}, dll::scale_pre<255>{});
+
+    constexpr size_t time_steps      = 28;
+    constexpr size_t sequence_length = 28;
+    constexpr size_t hidden_units    = 75;
+
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::lstm_layer<time_steps, sequence_length, hidden_units, dll::last_only, dll::parallel_bptt>,
+            dll::recurrent_last_layer<time_steps, hidden_units>,
+            dll::dense_layer<hidden_units, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAM>      // Adam
+        , dll::batch_size<100>                       // The mini-batch size
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    REQUIRE(net->fine_tune(dataset.train(), 30) < 0.15);
+    REQUIRE(net->evaluate_error(dataset.test()) < 0.25);
+}
@@ -212,6 +212,30 @@ TEST_CASE("unit/processor/dense/sgd/2", "[unit][dense][dbn][mnist][sgd][proc]")
     TEST_ERROR_BELOW(0.3);
 }
 
+TEST_CASE("unit/processor/dense/sgd/3", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto lines = get_result(default_options(), {"train", "test"}, "dense_sgd_3.conf");
+    REQUIRE(!lines.empty());
+
+    FT_ERROR_BELOW(5e-2);
+    TEST_ERROR_BELOW(0.3);
+}
+
+TEST_CASE("unit/processor/dense/sgd/4", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto lines = get_result(default_options(), {"train", "test"}, "dense_sgd_4.conf");
+    REQUIRE(!lines.empty());
+
+    FT_ERROR_BELOW(5e-2);
+    TEST_ERROR_BELOW(0.3);
+}
+
+TEST_CASE("unit/processor/dense/sgd/5", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto lines = get_result(default_options(), {"train", "test"}, "dense_sgd_5.conf");
+    REQUIRE(!lines.empty());
+
+    FT_ERROR_BELOW(5e-2);
+    TEST_ERROR_BELOW(0.3);
+}
+
 // Conv+Dense (SGD)
 
 TEST_CASE("unit/processor/conv/sgd/1", "[unit][conv][dense][dbn][mnist][sgd][proc]") {
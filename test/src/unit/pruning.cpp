@@ -0,0 +1,115 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <sstream>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/dyn_dense_layer.hpp"
+#include "dll/network.hpp"
+#include "dll/datasets.hpp"
+
+TEST_CASE("unit/pruning/1", "[unit][pruning]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t
+        >,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<25>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 1000, 2000, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->learning_rate = 0.1;
+
+    FT_CHECK_2_VAL(net, dataset, 25, 5e-2);
+
+    net->prune(0.8);
+
+    REQUIRE(net->layer_get<0>().sparsity() > 0.7);
+    REQUIRE(net->layer_get<1>().sparsity() < 0.9);
+
+    // The pruned weights stay pruned during the fine-tuning
+
+    const double sparsity = net->layer_get<0>().sparsity();
+
+    net->fine_tune(dataset.train(), 5);
+
+    REQUIRE(net->layer_get<0>().sparsity() == Approx(sparsity));
+    REQUIRE(etl::sum(etl::abs(net->layer_get<0>().w >> (1.0f - *net->layer_get<0>().w_mask))) == 0.0f);
+
+    TEST_CHECK_2(net, dataset, 0.2);
+}
+
+TEST_CASE("unit/pruning/2", "[unit][pruning]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::SIGMOID>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::SOFTMAX>>::layer_t
+        >,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<25>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 1000, 2000, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->template layer_get<0>().init_layer(28 * 28, 100);
+    net->template layer_get<1>().init_layer(100, 10);
+
+    // Gradual pruning of 70% of the weights during the first 10 epochs
+
+    net->learning_rate    = 0.1;
+    net->pruning_sparsity = 0.7;
+    net->pruning_epochs   = 10;
+
+    FT_CHECK_2_VAL(net, dataset, 25, 5e-2);
+
+    const double pruned = (28 * 28 * 100) * net->layer_get<0>().sparsity() + (100 * 10) * net->layer_get<1>().sparsity();
+
+    REQUIRE(pruned / (28 * 28 * 100 + 100 * 10) == Approx(0.7).epsilon(0.01));
+
+    TEST_CHECK_2(net, dataset, 0.2);
+}
+
+// The sparse storage and the sparse kernel are exact
+TEST_CASE("unit/pruning/sparse", "[unit][pruning]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::dense_layer_desc<50, 40>::layer_t,
+            dll::dense_layer_desc<40, 10, dll::softmax>::layer_t
+        >,
+        dll::batch_size<5>>::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    net->prune(0.9);
+
+    etl::fast_dyn_matrix<float, 5, 50> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 5, 40> output;
+    net->layer_get<0>().forward_batch(output, input);
+
+    etl::fast_dyn_matrix<float, 5, 40> ref_output;
+    ref_output = etl::sigmoid(etl::bias_add_2d(input * net->layer_get<0>().w, net->layer_get<0>().b));
+
+    REQUIRE(etl::approx_equals(output, ref_output, 1e-5));
+
+    std::stringstream stream;
+    net->store_sparse(stream);
+
+    REQUIRE(stream.str().size() < (50 * 40 + 40 * 10) * sizeof(float));
+
+    auto net_2 = std::make_unique<network_t>();
+    net_2->load_sparse(stream);
+
+    REQUIRE(net_2->layer_get<0>().sparsity() == Approx(net->layer_get<0>().sparsity()));
+    REQUIRE(etl::approx_equals(net_2->layer_get<0>().w, net->layer_get<0>().w, 0.0));
+    REQUIRE(etl::approx_equals(net_2->layer_get<1>().b, net->layer_get<1>().b, 0.0));
+}
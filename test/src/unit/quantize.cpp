@@ -0,0 +1,117 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "dll_test.hpp"
+
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/conv_same_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/activation_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/network.hpp"
+#include "dll/datasets.hpp"
+
+TEST_CASE("unit/quantize/1", "[unit][quantize]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::activation<dll::function::SIGMOID>>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SOFTMAX>::layer_t
+        >,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<25>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 1000, 2000, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->learning_rate = 0.1;
+
+    FT_CHECK_2_VAL(net, dataset, 25, 5e-2);
+
+    auto test_error = net->evaluate_error(dataset.test());
+
+    auto quantized = net->quantize(dataset.train());
+
+    REQUIRE(quantized.input_range(0) == Approx(1.0).epsilon(0.01));
+
+    auto quantized_error = quantized.evaluate_error(dataset.test());
+
+    std::cout << "test_error:" << test_error << " quantized_error:" << quantized_error << std::endl;
+
+    REQUIRE(quantized_error < test_error + 0.02);
+}
+
+TEST_CASE("unit/quantize/2", "[unit][quantize]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::conv_same_desc<1, 28, 28, 6, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+            dll::mp_2d_layer_desc<6, 28, 28, 2, 2>::layer_t,
+            dll::conv_layer_desc<6, 14, 14, 8, 5, 5, dll::activation<dll::function::RELU>>::layer_t,
+            dll::mp_2d_layer_desc<8, 10, 10, 2, 2>::layer_t,
+            dll::dense_layer_desc<8 * 5 * 5, 10, dll::activation<dll::function::SOFTMAX>>::layer_t
+        >,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<25>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 1000, 2000, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->learning_rate = 0.05;
+
+    FT_CHECK_2_VAL(net, dataset, 25, 5e-2);
+
+    auto test_error = net->evaluate_error(dataset.test());
+
+    auto quantized = net->quantize(dataset.train());
+
+    auto quantized_error = quantized.evaluate_error(dataset.test());
+
+    std::cout << "test_error:" << test_error << " quantized_error:" << quantized_error << std::endl;
+
+    REQUIRE(quantized_error < test_error + 0.02);
+}
+
+// The int8 kernels are close to the floating point ones
+TEST_CASE("unit/quantize/kernels", "[unit][quantize]") {
+    etl::fast_dyn_matrix<float, 2, 4, 7, 6> input;
+    etl::fast_dyn_matrix<float, 6, 2, 3, 3> w;
+    etl::fast_dyn_matrix<float, 6> b;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+    w     = etl::uniform_generator(-1.0, 1.0);
+    b     = etl::uniform_generator(-1.0, 1.0);
+
+    const float in_scale = dll::quantization_scale(1.0f);
+
+    std::vector<int8_t> q_input;
+    dll::quantize_batch(input, in_scale, q_input);
+
+    dll::quantized_weights<float> q_w;
+    q_w.quantize(w.memory_start(), 6, 2 * 3 * 3);
+
+    // Valid grouped convolution
+
+    etl::fast_dyn_matrix<float, 2, 6, 5, 4> output;
+    dll::quantized_conv_forward<dll::function::IDENTITY>(q_input.data(), q_w, b.memory_start(), in_scale, output.memory_start(), 2, 4, 7, 6, 3, 3, 0, 0, 2);
+
+    etl::fast_dyn_matrix<float, 2, 6, 5, 4> ref_output;
+    dll::grouped_conv_forward(input, w, ref_output, 2, 0, 0);
+    ref_output = etl::bias_add_4d(ref_output, b);
+
+    REQUIRE(etl::approx_equals(output, ref_output, 0.05));
+
+    // Same grouped convolution
+
+    etl::fast_dyn_matrix<float, 2, 6, 7, 6> output_same;
+    dll::quantized_conv_forward<dll::function::IDENTITY>(q_input.data(), q_w, b.memory_start(), in_scale, output_same.memory_start(), 2, 4, 7, 6, 3, 3, 1, 1, 2);
+
+    etl::fast_dyn_matrix<float, 2, 6, 7, 6> ref_same;
+    dll::grouped_conv_forward(input, w, ref_same, 2, 1, 1);
+    ref_same = etl::bias_add_4d(ref_same, b);
+
+    REQUIRE(etl::approx_equals(output_same, ref_same, 0.05));
+}
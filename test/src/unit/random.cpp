@@ -17,6 +17,8 @@
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
 
+#include <thread>
+
 TEST_CASE("unit/cdbn/random/mnist/1", "[cdbn][rectifier][svm][unit]") {
     using dbn_t =
         dll::dbn_desc<dll::dbn_layers<
@@ -73,3 +75,33 @@ TEST_CASE("unit/cdbn/random/mnist/2", "[cdbn][rectifier][svm][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 1.0);
 }
+
+TEST_CASE("unit/random/streams/1", "[random][unit]") {
+    const size_t stream = dll::new_streams(2);
+
+    auto a = dll::make_engine(stream, 3);
+    auto b = dll::make_engine(stream, 3);
+    auto c = dll::make_engine(stream, 4);
+    auto d = dll::make_engine(stream + 1, 3);
+
+    REQUIRE(a() == b());
+    REQUIRE(a() != c());
+    REQUIRE(b() != d());
+
+    // The engine of a scope does not depend on the thread using it
+
+    size_t values[2];
+
+    for (size_t t = 0; t < 2; ++t) {
+        std::thread thread([&values, stream, t] {
+            auto engine = dll::make_engine(stream, 7);
+            dll::engine_scope scope(engine);
+
+            values[t] = dll::rand_engine()();
+        });
+
+        thread.join();
+    }
+
+    REQUIRE(values[0] == values[1]);
+}
@@ -12,6 +12,9 @@
 #include "cpp_utils/data.hpp"
 
 #include "dll/rbm/rbm.hpp"
+#include "dll/trainer/rbm_ensemble_trainer.hpp"
+#include "dll/util/binary_states.hpp"
+#include "dll/util/sampling.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -126,6 +129,195 @@ TEST_CASE("unit/rbm/mnist/6", "[rbm][pcd][unit]") {
     }
 }
 
+// PCD with more persistent chains than samples in the batch
+TEST_CASE("unit/rbm/mnist/particles", "[rbm][pcd][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<5>,
+        dll::momentum,
+        dll::trainer_rbm<dll::pcd1_trainer_t>>::layer_t rbm;
+
+    rbm.fantasy_particles = 50;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    if (std::isfinite(error)) {
+        REQUIRE(error < 15e-2);
+    }
+}
+
+// The packed binary states give the same visible activations as the floats
+TEST_CASE("unit/rbm/mnist/pt", "[rbm][pt][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::trainer_rbm<dll::pt1_trainer_t>>::layer_t rbm;
+
+    rbm.tempering_replicas = 4;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+    REQUIRE(error < 15e-2);
+}
+
+TEST_CASE("unit/rbm/mnist/ensemble", "[rbm][unit]") {
+    dll::rbm_desc<28 * 28, 100, dll::batch_size<10>, dll::momentum>::layer_t rbm_a;
+    dll::rbm_desc<28 * 28, 100, dll::batch_size<10>, dll::momentum>::layer_t rbm_b;
+    dll::rbm_desc<28 * 28, 50, dll::batch_size<10>, dll::momentum, dll::sparsity<>>::layer_t rbm_c;
+
+    rbm_a.learning_rate = 0.1;
+    rbm_b.learning_rate = 0.05;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto errors = dll::train_rbm_ensemble(dataset.training_images, 50, rbm_a, rbm_b, rbm_c);
+
+    REQUIRE(errors.size() == 3);
+    REQUIRE(errors[0] < 5e-2);
+    REQUIRE(errors[1] < 5e-2);
+    REQUIRE(errors[2] < 1e-1);
+}
+
+TEST_CASE("unit/rbm/binary_states", "[rbm][unit]") {
+    etl::dyn_matrix<float> w(20, 70);
+    etl::dyn_vector<float> c(20);
+    etl::dyn_matrix<float> h(3, 70);
+
+    w = etl::normal_generator(0.0, 1.0);
+    c = etl::normal_generator(0.0, 1.0);
+
+    for (size_t r = 0; r < 3; ++r) {
+        for (size_t j = 0; j < 70; ++j) {
+            h(r, j) = (r * 7 + j * 3) % 5 < 2 ? 1.0f : 0.0f;
+        }
+    }
+
+    dll::binary_states states;
+    states.resize(3, 70);
+
+    for (size_t r = 0; r < 3; ++r) {
+        states.set_row(r, h(r));
+
+        for (size_t j = 0; j < 70; ++j) {
+            REQUIRE(states.get(r, j) == (h(r, j) > 0.5));
+        }
+    }
+
+    etl::dyn_matrix<float> packed(3, 20);
+    dll::binary_visible_activations(states, 0, 3, w, c, packed);
+
+    etl::dyn_matrix<float> expected(3, 20);
+    expected = etl::rep_l(c, 3) + transpose(w * transpose(h));
+
+    REQUIRE(etl::approx_equals(packed, expected, 1e-4));
+}
+
+// The batched kernels sample from the expected distributions
+TEST_CASE("unit/rbm/sampling", "[rbm][unit]") {
+    etl::dyn_matrix<float> p(100, 101);
+    etl::dyn_matrix<float> s(100, 101);
+
+    p = 0.3f;
+
+    dll::sample_bernoulli(p, s);
+
+    REQUIRE(etl::min(s) >= 0.0f);
+    REQUIRE(etl::max(s) <= 1.0f);
+    REQUIRE(etl::mean(s) == Approx(0.3).epsilon(0.05));
+
+    etl::dyn_matrix<float> v(100, 101);
+    v = 0.0f;
+
+    dll::add_normal_noise(v);
+
+    const double mean = etl::mean(v);
+    const double var  = etl::mean(v >> v) - mean * mean;
+
+    REQUIRE(std::abs(mean) < 0.05);
+    REQUIRE(var == Approx(1.0).epsilon(0.05));
+}
+
+// The fused Gibbs step computes the same probabilities as the two activations
+TEST_CASE("unit/rbm/gibbs_step", "[rbm][unit]") {
+    using rbm_t = dll::rbm_desc<30, 20, dll::batch_size<10>>::layer_t;
+
+    rbm_t rbm;
+
+    etl::fast_dyn_matrix<float, 10, 20> h_in;
+    etl::fast_dyn_matrix<float, 10, 30> v_a;
+    etl::fast_dyn_matrix<float, 10, 30> v_s;
+    etl::fast_dyn_matrix<float, 10, 20> h_a;
+    etl::fast_dyn_matrix<float, 10, 20> h_s;
+
+    h_in = etl::bernoulli(etl::fast_dyn_matrix<float, 10, 20>(0.5f));
+
+    rbm.template batch_gibbs_step<true>(h_in, v_a, h_a, h_s);
+
+    etl::fast_dyn_matrix<float, 10, 30> ref_v_a;
+    etl::fast_dyn_matrix<float, 10, 20> ref_h_a;
+
+    rbm.template batch_activate_visible<true, false>(h_in, h_in, ref_v_a, v_s);
+    rbm.template batch_activate_hidden<true, false>(ref_h_a, ref_h_a, ref_v_a, ref_v_a);
+
+    for (size_t i = 0; i < etl::size(v_a); ++i) {
+        REQUIRE(v_a[i] == Approx(ref_v_a[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(h_a); ++i) {
+        REQUIRE(h_a[i] == Approx(ref_h_a[i]).epsilon(1e-4));
+        REQUIRE((h_s[i] == 0.0f || h_s[i] == 1.0f));
+    }
+}
+
+// The batched energies are the sums of the energies of the samples
+TEST_CASE("unit/rbm/mnist/energy_batch", "[rbm][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::free_energy>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(20);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    rbm.train(dataset.training_images, 2);
+
+    etl::dyn_matrix<float> v(20, 28 * 28);
+    etl::dyn_matrix<float> h(20, 100);
+
+    etl::dyn_vector<float> h_i(100);
+
+    double free_energy = 0.0;
+    double energy      = 0.0;
+
+    for (size_t i = 0; i < 20; ++i) {
+        h_i = etl::sigmoid(rbm.b + dataset.training_images[i] * rbm.w);
+
+        v(i) = dataset.training_images[i];
+        h(i) = h_i;
+
+        free_energy += rbm.free_energy(dataset.training_images[i]);
+        energy += rbm.energy(dataset.training_images[i], h_i);
+    }
+
+    REQUIRE(rbm.free_energy_batch(v) == Approx(free_energy).epsilon(1e-3));
+    REQUIRE(rbm.energy_batch(v, h) == Approx(energy).epsilon(1e-3));
+}
+
 TEST_CASE("unit/rbm/mnist/7", "[rbm][relu][unit]") {
     dll::rbm_desc<
         28 * 28, 100,
@@ -212,3 +404,49 @@ TEST_CASE("unit/rbm/mnist/10", "[rbm][pcd][unit]") {
         REQUIRE(error < 15e-2);
     }
 }
+
+// The fused update is the decay, the penalties and the momentum in sequence
+TEST_CASE("unit/rbm/fused_update", "[rbm][momentum][unit]") {
+    dll::rbm_desc<
+        6, 4,
+        dll::batch_size<5>,
+        dll::momentum,
+        dll::weight_decay<dll::decay_type::L1L2>>::layer_t rbm;
+
+    rbm.momentum = 0.9;
+
+    etl::fast_matrix<float, 6, 4> w;
+    etl::fast_matrix<float, 6, 4> grad;
+    etl::fast_matrix<float, 6, 4> inc;
+    etl::fast_vector<float, 4> penalties{0.1f, -0.2f, 0.3f, 0.0f};
+
+    w    = etl::uniform_generator(-1.0, 1.0);
+    grad = etl::uniform_generator(-1.0, 1.0);
+    inc  = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_matrix<float, 6, 4> ref_w    = w;
+    etl::fast_matrix<float, 6, 4> ref_grad = grad;
+    etl::fast_matrix<float, 6, 4> ref_inc  = inc;
+
+    const float eps     = 0.05f;
+    const float penalty = 0.01f;
+
+    ref_grad = ref_grad - rbm.l1_weight_cost * abs(ref_w) - rbm.l2_weight_cost * ref_w - penalty;
+
+    for (size_t j = 0; j < 6; ++j) {
+        for (size_t i = 0; i < 4; ++i) {
+            ref_grad(j, i) -= penalties(i);
+        }
+    }
+
+    ref_inc = rbm.momentum * ref_inc + eps * ref_grad;
+    ref_w += ref_inc;
+
+    dll::fused_update<dll::decay_type::L1L2, true, true>(rbm, w, grad, inc, penalty, penalties.memory_start(), 4, 1, eps);
+
+    for (size_t i = 0; i < etl::size(w); ++i) {
+        REQUIRE(grad[i] == Approx(ref_grad[i]));
+        REQUIRE(inc[i] == Approx(ref_inc[i]));
+        REQUIRE(w[i] == Approx(ref_w[i]));
+    }
+}
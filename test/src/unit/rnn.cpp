@@ -5,6 +5,8 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <sstream>
+
 #include "dll_test.hpp"
 
 #include "dll/neural/dense_layer.hpp"
@@ -85,3 +87,178 @@ TEST_CASE("unit/rnn/3", "[unit][rnn]") {
     REQUIRE(net->fine_tune(dataset.train(), 50) < 0.5);
     REQUIRE(net->evaluate_error(dataset.test()) < 0.5);
 }
+
+// Streaming the time steps gives the same output as the full window
+TEST_CASE("unit/rnn/stream", "[unit][rnn]") {
+    constexpr size_t time_steps      = 5;
+    constexpr size_t sequence_length = 7;
+    constexpr size_t hidden_units    = 6;
+
+    dll::rnn_layer<time_steps, sequence_length, hidden_units> layer;
+
+    etl::fast_dyn_matrix<float, 3, time_steps, sequence_length> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, time_steps, hidden_units> output;
+    layer.forward_batch(output, input);
+
+    layer.reset_state();
+
+    // Two time steps, then the three others
+
+    etl::fast_dyn_matrix<float, 3, 2, sequence_length> first;
+    etl::fast_dyn_matrix<float, 3, 3, sequence_length> second;
+
+    for (size_t b = 0; b < 3; ++b) {
+        for (size_t t = 0; t < 2; ++t) {
+            first(b)(t) = input(b)(t);
+        }
+
+        for (size_t t = 0; t < 3; ++t) {
+            second(b)(t) = input(b)(t + 2);
+        }
+    }
+
+    etl::fast_dyn_matrix<float, 3, 2, hidden_units> first_output;
+    etl::fast_dyn_matrix<float, 3, 3, hidden_units> second_output;
+
+    layer.stream_batch(first_output, first);
+    layer.stream_batch(second_output, second);
+
+    for (size_t b = 0; b < 3; ++b) {
+        for (size_t t = 0; t < 2; ++t) {
+            REQUIRE(etl::approx_equals(first_output(b)(t), output(b)(t), 1e-5));
+        }
+
+        for (size_t t = 0; t < 3; ++t) {
+            REQUIRE(etl::approx_equals(second_output(b)(t), output(b)(t + 2), 1e-5));
+        }
+    }
+}
+
+// The padded steps of the variable-length sequences repeat their last output
+TEST_CASE("unit/rnn/variable", "[unit][rnn]") {
+    constexpr size_t time_steps      = 5;
+    constexpr size_t sequence_length = 7;
+    constexpr size_t hidden_units    = 6;
+
+    dll::rnn_layer<time_steps, sequence_length, hidden_units> layer;
+    dll::rnn_layer<time_steps, sequence_length, hidden_units, dll::variable_length> packed;
+
+    std::stringstream weights;
+    layer.store(weights);
+    packed.load(weights);
+
+    etl::fast_dyn_matrix<float, 4, time_steps, sequence_length> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    const size_t lengths[4] = {3, 5, 1, 4};
+
+    for (size_t b = 0; b < 4; ++b) {
+        for (size_t t = lengths[b]; t < time_steps; ++t) {
+            input(b)(t) = 0;
+        }
+    }
+
+    etl::fast_dyn_matrix<float, 4, time_steps, hidden_units> output;
+    layer.forward_batch(output, input);
+
+    etl::fast_dyn_matrix<float, 4, time_steps, hidden_units> packed_output;
+    packed.forward_batch(packed_output, input);
+
+    etl::fast_dyn_matrix<float, 4, time_steps, hidden_units> test_output;
+    packed.test_forward_batch(test_output, input);
+
+    for (size_t b = 0; b < 4; ++b) {
+        for (size_t t = 0; t < time_steps; ++t) {
+            const size_t last = std::min(t, lengths[b] - 1);
+
+            REQUIRE(etl::approx_equals(packed_output(b)(t), output(b)(last), 1e-5));
+            REQUIRE(etl::approx_equals(test_output(b)(t), output(b)(last), 1e-5));
+        }
+    }
+}
+
+// Only the last time step goes through the recurrent last layer
+TEST_CASE("unit/rnn/last_step", "[unit][rnn]") {
+    constexpr size_t time_steps      = 5;
+    constexpr size_t sequence_length = 7;
+    constexpr size_t hidden_units    = 6;
+
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::rnn_layer<time_steps, sequence_length, hidden_units>,
+            dll::recurrent_last_layer<time_steps, hidden_units>,
+            dll::dense_layer<hidden_units, 10, dll::softmax>
+        >
+        , dll::batch_size<4>
+    >::network_t;
+
+    using packed_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::rnn_layer<time_steps, sequence_length, hidden_units, dll::variable_length>,
+            dll::recurrent_last_layer<time_steps, hidden_units>,
+            dll::dense_layer<hidden_units, 10, dll::softmax>
+        >
+        , dll::batch_size<4>
+    >::network_t;
+
+    static_assert(dll::sparse_last_step_errors<network_t, 1>(), "The RNN only reads the errors of the last step");
+    static_assert(!dll::sparse_last_step_errors<packed_network_t, 1>(), "The padded steps need all the errors");
+    static_assert(!dll::sparse_last_step_errors<network_t, 2>(), "The dense layer keeps all its input");
+
+    dll::recurrent_last_layer<time_steps, hidden_units> layer;
+
+    etl::fast_dyn_matrix<float, 4, time_steps, hidden_units> input;
+    etl::fast_dyn_matrix<float, 4, hidden_units> output;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    layer.forward_batch(output, input);
+
+    for (size_t b = 0; b < 4; ++b) {
+        REQUIRE(etl::approx_equals(output(b), input(b)(time_steps - 1), 0.0));
+    }
+
+    etl::fast_dyn_matrix<float, 4, time_steps, hidden_units> errors;
+    errors = 1.0;
+
+    // The other time steps are only cleared if they can be read
+    dll::last_step_backward(output.memory_start(), errors.memory_start(), 4, time_steps, hidden_units, false);
+
+    for (size_t b = 0; b < 4; ++b) {
+        REQUIRE(etl::approx_equals(errors(b)(time_steps - 1), output(b), 0.0));
+        REQUIRE(etl::sum(errors(b)(0)) == Approx(float(hidden_units)));
+    }
+
+    dll::last_step_backward(output.memory_start(), errors.memory_start(), 4, time_steps, hidden_units, true);
+
+    for (size_t b = 0; b < 4; ++b) {
+        REQUIRE(etl::approx_equals(errors(b)(time_steps - 1), output(b), 0.0));
+        REQUIRE(etl::sum(errors(b)(0)) == Approx(0.0f));
+    }
+}
+
+// Batch-parallel backpropagation through time
+TEST_CASE("unit/rnn/parallel_bptt", "[unit][rnn]") {
+    auto dataset = dll::make_mnist_dataset_nc_sub(0, 2000, dll::batch_size<100>{}, dll::scale_pre<255>{});
+
+    constexpr size_t time_steps      = 28;
+    constexpr size_t sequence_length = 28;
+    constexpr size_t hidden_units    = 75;
+
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::rnn_layer<time_steps, sequence_length, hidden_units, dll::last_only, dll::parallel_bptt>,
+            dll::recurrent_last_layer<time_steps, hidden_units>,
+            dll::dense_layer<hidden_units, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAM>      // Adam
+        , dll::batch_size<100>                       // The mini-batch size
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    REQUIRE(net->fine_tune(dataset.train(), 30) < 0.15);
+    REQUIRE(net->evaluate_error(dataset.test()) < 0.25);
+}
@@ -0,0 +1,91 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/sampled_softmax_layer.hpp"
+#include "dll/dbn.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+// Trained on half of the classes of each batch, evaluated on all of them
+TEST_CASE("unit/sampled_softmax/1", "[unit][sampled_softmax][dbn][mnist]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::sampled_softmax_layer_desc<100, 10, 5, dll::negative_sampler<dll::sampler_type::UNIFORM>>::layer_t>,
+        dll::updater<dll::updater_type::ADAM>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->display();
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.25);
+}
+
+// Log-uniform sampling, with index labels
+TEST_CASE("unit/sampled_softmax/2", "[unit][sampled_softmax][dbn][mnist]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::sampled_softmax_layer_desc<100, 10, 4>::layer_t>,
+        dll::updater<dll::updater_type::ADAM>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::categorical, dll::index_labels, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(dataset.training_images, dataset.training_labels, dataset.training_images.size(), 10, generator_t{});
+    auto test_generator  = dll::make_generator(dataset.test_images, dataset.test_labels, dataset.test_images.size(), 10, generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// The candidates contain the positive classes, sorted and unique
+TEST_CASE("unit/sampled_softmax/candidates", "[unit][sampled_softmax]") {
+    std::vector<size_t> positives{7, 3, 7, 999};
+    std::vector<size_t> candidates;
+
+    dll::sample_candidates<dll::sampler_type::LOG_UNIFORM>(positives, 50, 1000, candidates);
+
+    REQUIRE(std::is_sorted(candidates.begin(), candidates.end()));
+    REQUIRE(std::adjacent_find(candidates.begin(), candidates.end()) == candidates.end());
+    REQUIRE(candidates.size() <= 53);
+
+    for (size_t p : positives) {
+        REQUIRE(std::binary_search(candidates.begin(), candidates.end(), p));
+    }
+
+    for (size_t c : candidates) {
+        REQUIRE(c < 1000);
+    }
+
+    double sum = 0.0;
+
+    for (size_t c = 0; c < 1000; ++c) {
+        sum += dll::class_probability<dll::sampler_type::LOG_UNIFORM>(c, 1000);
+    }
+
+    REQUIRE(sum == Approx(1.0));
+}
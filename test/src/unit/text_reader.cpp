@@ -124,3 +124,26 @@ TEST_CASE("unit/text_reader/images/5", "[unit][reader]") {
     REQUIRE(samples[7](0, 17, 16) == 9);
     REQUIRE(samples[8](0, 17, 15) == 253);
 }
+
+TEST_CASE("unit/text_reader/mmap/1", "[unit][reader]") {
+    REQUIRE(dll::text::convert_to_mmap<etl::dyn_matrix<float, 1>, false>("test/text_db/images", "test/text_db/labels", "/tmp/dll_text_db.mmap", 20, 10));
+
+    std::ifstream file("/tmp/dll_text_db.mmap", std::ios::binary);
+
+    dll::mmap_dataset_header header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    REQUIRE(file);
+    REQUIRE(header.samples == 9);
+    REQUIRE(header.dtype == sizeof(float));
+    REQUIRE(header.dimensions == 1);
+    REQUIRE(header.shape[0] == 28 * 28);
+    REQUIRE(header.label_width == 10);
+
+    // One pixel of the first sample
+    float value = 1.0f;
+    file.seekg(header.data_offset + (17 * 28 + 16) * sizeof(float));
+    file.read(reinterpret_cast<char*>(&value), sizeof(value));
+
+    REQUIRE(value == 254.0f);
+}
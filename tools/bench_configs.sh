@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# Run the benchmark suite under several configurations of ETL and
+# tabulate the results of all the configurations.
+#
+# Each configuration is compared against the baseline of the machine
+# (saved on its first run in $DLL_BENCH_OUT/baselines).
+#
+# Usage: tools/bench_configs.sh [dll_bench options]
+#
+#   DLL_BENCH_CONFIGS  The configurations (default: "default mkl blas cublas native")
+#   DLL_BENCH_OUT      The folder of the results (default: bench_results)
+
+out=${DLL_BENCH_OUT:-bench_results}
+configs=${DLL_BENCH_CONFIGS:-"default mkl blas cublas native"}
+
+mkdir -p $out/baselines
+
+reports=""
+
+for config in $configs
+do
+    case $config in
+        default) flags="" ;;
+        mkl)     flags="ETL_MKL=1" ;;
+        blas)    flags="ETL_BLAS=1" ;;
+        cublas)  flags="ETL_CUBLAS=1" ;;
+        native)  flags="DLL_PERF_FLAGS=-march=native" ;;
+        *)
+            echo "Unknown configuration $config"
+            exit 1
+            ;;
+    esac
+
+    echo "Configuration $config"
+
+    make clean > /dev/null
+
+    if ! env $flags make -j$(nproc) release/bin/dll_bench > $out/$config.log 2>&1
+    then
+        echo "The build of $config failed (see $out/$config.log)"
+        continue
+    fi
+
+    ./release/bin/dll_bench --config=$config --json=$out/$config.json --csv=$out/$config.csv --baseline-dir=$out/baselines "$@"
+
+    reports="$reports,$out/$config.json"
+done
+
+if [[ -n $reports ]]
+then
+    ./release/bin/dll_bench --tabulate=${reports#,} --csv=$out/configs.csv
+fi